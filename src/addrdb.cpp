@@ -114,15 +114,23 @@ CAddrDB::CAddrDB() {
 }
 
 bool CAddrDB::Write(const CAddrMan &addr) {
+    CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
+    Snapshot(addr, ssPeers);
+    return Write(ssPeers);
+}
+
+void CAddrDB::Snapshot(const CAddrMan &addr, CDataStream &ssPeers) {
+    ssPeers << FLATDATA(Params().DiskMagic());
+    ssPeers << addr;
+}
+
+bool CAddrDB::Write(CDataStream &ssPeers) {
     // Generate random temporary filename
     unsigned short randv = 0;
     GetRandBytes((uint8_t *)&randv, sizeof(randv));
     std::string tmpfn = strprintf("peers.dat.%04x", randv);
 
-    // serialize addresses, checksum data up to that point, then append csum
-    CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
-    ssPeers << FLATDATA(Params().DiskMagic());
-    ssPeers << addr;
+    // checksum the serialized addresses, then append csum
     uint256 hash = Hash(ssPeers.begin(), ssPeers.end());
     ssPeers << hash;
 
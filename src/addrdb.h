@@ -76,6 +76,12 @@ private:
 public:
     CAddrDB();
     bool Write(const CAddrMan &addr);
+    /**
+     * Serialize addr for Write(CDataStream &). Only this part needs addr's
+     * lock; writing the result out can then be left to another thread.
+     */
+    static void Snapshot(const CAddrMan &addr, CDataStream &ssPeers);
+    bool Write(CDataStream &ssPeers);
     bool Read(CAddrMan &addr);
     bool Read(CAddrMan &addr, CDataStream &ssPeers);
 };
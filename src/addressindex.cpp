@@ -0,0 +1,174 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+
+#include "chain.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "txdb.h"
+#include "undo.h"
+#include "util.h"
+#include "validation.h"
+
+#include <vector>
+
+std::unique_ptr<CAddressIndex> g_addressindex;
+
+uint160 GetAddressIndexHash(const CScript &scriptPubKey) {
+    return Hash160(scriptPubKey.begin(), scriptPubKey.end());
+}
+
+/** What the address index keeps of out, which is in a block at nHeight */
+static CAddressIndexValue GetAddressIndexValue(const CTxOut &out,
+                                               uint32_t nHeight,
+                                               bool fCoinBase) {
+    CAddressIndexValue value;
+    value.nValue = out.nValue;
+    value.nHeight = nHeight;
+    value.nLockTime = out.nLockTime;
+    value.fCoinBase = fCoinBase;
+    // Like the deposit index, see GetDepositIndexEntries.
+    if (!fCoinBase && out.nLockTime > 0 &&
+        out.nLockTime < LOCKTIME_THRESHOLD) {
+        value.nPrincipal = out.nPrincipal;
+        if (out.nPrincipal > 0 && out.nValue > out.nPrincipal) {
+            value.nInterest = out.nValue - out.nPrincipal;
+        }
+    }
+    return value;
+}
+
+CAddressIndex::CAddressIndex(const Config &configIn, bool fDrop)
+    : CBaseIndex(configIn, fDrop, "addressindex", "address index",
+                 "addressindex") {
+    Start();
+}
+
+CAddressIndex::~CAddressIndex() {
+    Stop();
+}
+
+bool CAddressIndex::ReadBestBlock(uint256 &hashBest) {
+    return pblocktree->ReadAddressIndexBestBlock(hashBest);
+}
+
+bool CAddressIndex::EraseBestBlock() {
+    return pblocktree->EraseAddressIndexBestBlock();
+}
+
+bool CAddressIndex::EraseEntries(size_t nBatch, size_t &nErased) {
+    return pblocktree->EraseAddressIndex(nBatch, nErased);
+}
+
+bool CAddressIndex::AddBlock(const CBlockIndex *pindex, bool fDisconnect,
+                             CAddressIndexUpdate &update) {
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, config)) {
+        return error("%s: failed to read block %s", __func__,
+                     pindex->GetBlockHash().ToString());
+    }
+    CBlockUndo blockUndo;
+    const CDiskBlockPos pos = pindex->GetUndoPos();
+    if (pos.IsNull() ||
+        !UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash())) {
+        return error("%s: failed to read undo data of block %s", __func__,
+                     pindex->GetBlockHash().ToString());
+    }
+    if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: block and undo data inconsistent", __func__);
+    }
+
+    const uint32_t nHeight = pindex->nHeight;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = *block.vtx[i];
+        const uint256 txid = tx.GetId();
+        for (uint32_t n = 0; n < tx.vout.size(); n++) {
+            const CTxOut &out = tx.vout[n];
+            if (out.scriptPubKey.IsUnspendable()) {
+                continue;
+            }
+            const uint160 scriptHash = GetAddressIndexHash(out.scriptPubKey);
+            CAddressHistoryKey key(scriptHash, nHeight, txid, n, false);
+            CAddressUnspentKey unspentKey(scriptHash, COutPoint(txid, n));
+            if (fDisconnect) {
+                update.vHistoryErased.push_back(key);
+                update.vUnspentErased.push_back(unspentKey);
+                continue;
+            }
+            const CAddressIndexValue value =
+                GetAddressIndexValue(out, nHeight, tx.IsCoinBase());
+            update.vHistory.emplace_back(key, value);
+            update.vUnspent.emplace_back(unspentKey, value);
+        }
+
+        if (tx.IsCoinBase()) {
+            continue;
+        }
+        const CTxUndo &txundo = blockUndo.vtxundo[i - 1];
+        if (txundo.vprevout.size() != tx.vin.size()) {
+            return error("%s: transaction and undo data inconsistent",
+                         __func__);
+        }
+        for (uint32_t n = 0; n < tx.vin.size(); n++) {
+            const Coin &coin = txundo.vprevout[n];
+            const uint160 scriptHash =
+                GetAddressIndexHash(coin.GetTxOut().scriptPubKey);
+            const CAddressIndexValue value = GetAddressIndexValue(
+                coin.GetTxOut(), coin.GetHeight(), coin.IsCoinBase());
+            CAddressHistoryKey key(scriptHash, nHeight, txid, n, true);
+            CAddressUnspentKey unspentKey(scriptHash, tx.vin[n].prevout);
+            if (fDisconnect) {
+                update.vHistoryErased.push_back(key);
+                update.vUnspent.emplace_back(unspentKey, value);
+            } else {
+                update.vHistory.emplace_back(key, value);
+                update.vUnspentErased.push_back(unspentKey);
+            }
+        }
+    }
+    return true;
+}
+
+bool CAddressIndex::WriteBlocks(
+    const std::vector<const CBlockIndex *> &vBlocks) {
+    CAddressIndexUpdate update;
+    for (const CBlockIndex *pindex : vBlocks) {
+        if (IsStopped()) {
+            return false;
+        }
+        // The outputs of the genesis block can't be spent.
+        if (pindex->nHeight == 0) {
+            continue;
+        }
+        if (!AddBlock(pindex, false, update)) {
+            return false;
+        }
+    }
+
+    if (!pblocktree->UpdateAddressIndex(update,
+                                        vBlocks.back()->GetBlockHash())) {
+        return error("%s: failed to write the address index", __func__);
+    }
+    return true;
+}
+
+bool CAddressIndex::Rewind(const CBlockIndex *pindexFork) {
+    // One block at a time, each is written with its parent as best.
+    for (const CBlockIndex *pindex = GetBestBlock(); pindex != pindexFork;
+         pindex = pindex->pprev) {
+        if (IsStopped()) {
+            return false;
+        }
+        CAddressIndexUpdate update;
+        if (!AddBlock(pindex, true, update) ||
+            !pblocktree->UpdateAddressIndex(update,
+                                            pindex->pprev->GetBlockHash())) {
+            return error("%s: failed to disconnect block %s", __func__,
+                         pindex->GetBlockHash().ToString());
+        }
+    }
+    return true;
+}
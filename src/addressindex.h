@@ -0,0 +1,67 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "baseindex.h"
+#include "uint256.h"
+
+#include <cstddef>
+#include <memory>
+
+class CBlockIndex;
+class Config;
+class CScript;
+struct CAddressIndexUpdate;
+
+static const bool DEFAULT_ADDRESSINDEX = false;
+/** Transactions the address index writes in one batch, at the least */
+static const size_t ADDRESSINDEX_BATCH_TRANSACTIONS = 20000;
+/** Entries erased in one batch when the address index is dropped */
+static const size_t ADDRESSINDEX_ERASE_BATCH = 100000;
+/** History entries getaddresshistory returns by default, and at most */
+static const int DEFAULT_ADDRESS_HISTORY_COUNT = 1000;
+static const int MAX_ADDRESS_HISTORY_COUNT = 100000;
+
+/** The hash a script is known by in the address index */
+uint160 GetAddressIndexHash(const CScript &scriptPubKey);
+
+/**
+ * Maintains the address index: for each script, the outputs paying to it and
+ * the inputs spending those, and the outputs it has unspent.
+ *
+ * The blocks are read back from disk with their undo data, which has the
+ * outputs the inputs spend. Unlike the transaction index it also follows
+ * reorganizations back, a block that is disconnected has its entries erased
+ * and the outputs it spent are unspent again.
+ */
+class CAddressIndex : public CBaseIndex {
+public:
+    CAddressIndex(const Config &configIn, bool fDrop);
+    ~CAddressIndex();
+
+protected:
+    bool ReadBestBlock(uint256 &hashBest) override;
+    bool EraseBestBlock() override;
+    bool EraseEntries(size_t nBatch, size_t &nErased) override;
+    size_t GetEraseBatch() const override { return ADDRESSINDEX_ERASE_BATCH; }
+    bool IsBatchFull(size_t nBlocks, size_t nTransactions) const override {
+        return nTransactions >= ADDRESSINDEX_BATCH_TRANSACTIONS;
+    }
+    bool WriteBlocks(const std::vector<const CBlockIndex *> &vBlocks) override;
+    bool Rewind(const CBlockIndex *pindexFork) override;
+
+private:
+    //! Add the changes of connecting pindex, or of disconnecting it with
+    //! fDisconnect, to update.
+    bool AddBlock(const CBlockIndex *pindex, bool fDisconnect,
+                  CAddressIndexUpdate &update);
+};
+
+/** The address index thread, building the index with -addressindex or
+ * dropping it without */
+extern std::unique_ptr<CAddressIndex> g_addressindex;
+
+#endif // BITCOIN_ADDRESSINDEX_H
@@ -118,6 +118,28 @@ void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2) {
     vRandom[nRndPos2] = nId1;
 }
 
+void CAddrMan::SetTried(int nKBucket, int nKBucketPos, int nId) {
+    int &nEntry = vvTried[nKBucket][nKBucketPos];
+    int nSlot = nKBucket * ADDRMAN_BUCKET_SIZE + nKBucketPos;
+    if (nEntry == -1 && nId != -1) {
+        slotsTried.Insert(nSlot);
+    } else if (nEntry != -1 && nId == -1) {
+        slotsTried.Erase(nSlot);
+    }
+    nEntry = nId;
+}
+
+void CAddrMan::SetNew(int nUBucket, int nUBucketPos, int nId) {
+    int &nEntry = vvNew[nUBucket][nUBucketPos];
+    int nSlot = nUBucket * ADDRMAN_BUCKET_SIZE + nUBucketPos;
+    if (nEntry == -1 && nId != -1) {
+        slotsNew.Insert(nSlot);
+    } else if (nEntry != -1 && nId == -1) {
+        slotsNew.Erase(nSlot);
+    }
+    nEntry = nId;
+}
+
 void CAddrMan::Delete(int nId) {
     assert(mapInfo.count(nId) != 0);
     CAddrInfo &info = mapInfo[nId];
@@ -138,7 +160,7 @@ void CAddrMan::ClearNew(int nUBucket, int nUBucketPos) {
         CAddrInfo &infoDelete = mapInfo[nIdDelete];
         assert(infoDelete.nRefCount > 0);
         infoDelete.nRefCount--;
-        vvNew[nUBucket][nUBucketPos] = -1;
+        SetNew(nUBucket, nUBucketPos, -1);
         if (infoDelete.nRefCount == 0) {
             Delete(nIdDelete);
         }
@@ -150,7 +172,7 @@ void CAddrMan::MakeTried(CAddrInfo &info, int nId) {
     for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
         int pos = info.GetBucketPosition(nKey, true, bucket);
         if (vvNew[bucket][pos] == nId) {
-            vvNew[bucket][pos] = -1;
+            SetNew(bucket, pos, -1);
             info.nRefCount--;
         }
     }
@@ -172,7 +194,7 @@ void CAddrMan::MakeTried(CAddrInfo &info, int nId) {
 
         // Remove the to-be-evicted item from the tried set.
         infoOld.fInTried = false;
-        vvTried[nKBucket][nKBucketPos] = -1;
+        SetTried(nKBucket, nKBucketPos, -1);
         nTried--;
 
         // find which new bucket it belongs to
@@ -183,12 +205,12 @@ void CAddrMan::MakeTried(CAddrInfo &info, int nId) {
 
         // Enter it into the new set again.
         infoOld.nRefCount = 1;
-        vvNew[nUBucket][nUBucketPos] = nIdEvict;
+        SetNew(nUBucket, nUBucketPos, nIdEvict);
         nNew++;
     }
     assert(vvTried[nKBucket][nKBucketPos] == -1);
 
-    vvTried[nKBucket][nKBucketPos] = nId;
+    SetTried(nKBucket, nKBucketPos, nId);
     nTried++;
     info.fInTried = true;
 }
@@ -305,7 +327,7 @@ bool CAddrMan::Add_(const CAddress &addr, const CNetAddr &source,
         if (fInsert) {
             ClearNew(nUBucket, nUBucketPos);
             pinfo->nRefCount++;
-            vvNew[nUBucket][nUBucketPos] = nId;
+            SetNew(nUBucket, nUBucketPos, nId);
         } else {
             if (pinfo->nRefCount == 0) {
                 Delete(nId);
@@ -346,18 +368,9 @@ CAddrInfo CAddrMan::Select_(bool newOnly) {
         // use a tried node
         double fChanceFactor = 1.0;
         while (1) {
-            int nKBucket = RandomInt(ADDRMAN_TRIED_BUCKET_COUNT);
-            int nKBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvTried[nKBucket][nKBucketPos] == -1) {
-                nKBucket =
-                    (nKBucket +
-                     insecure_rand.randbits(ADDRMAN_TRIED_BUCKET_COUNT_LOG2)) %
-                    ADDRMAN_TRIED_BUCKET_COUNT;
-                nKBucketPos =
-                    (nKBucketPos +
-                     insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) %
-                    ADDRMAN_BUCKET_SIZE;
-            }
+            int nSlot = slotsTried[RandomInt(slotsTried.Size())];
+            int nKBucket = nSlot / ADDRMAN_BUCKET_SIZE;
+            int nKBucketPos = nSlot % ADDRMAN_BUCKET_SIZE;
             int nId = vvTried[nKBucket][nKBucketPos];
             assert(mapInfo.count(nId) == 1);
             CAddrInfo &info = mapInfo[nId];
@@ -371,18 +384,9 @@ CAddrInfo CAddrMan::Select_(bool newOnly) {
         // use a new node
         double fChanceFactor = 1.0;
         while (1) {
-            int nUBucket = RandomInt(ADDRMAN_NEW_BUCKET_COUNT);
-            int nUBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvNew[nUBucket][nUBucketPos] == -1) {
-                nUBucket =
-                    (nUBucket +
-                     insecure_rand.randbits(ADDRMAN_NEW_BUCKET_COUNT_LOG2)) %
-                    ADDRMAN_NEW_BUCKET_COUNT;
-                nUBucketPos =
-                    (nUBucketPos +
-                     insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) %
-                    ADDRMAN_BUCKET_SIZE;
-            }
+            int nSlot = slotsNew[RandomInt(slotsNew.Size())];
+            int nUBucket = nSlot / ADDRMAN_BUCKET_SIZE;
+            int nUBucketPos = nSlot % ADDRMAN_BUCKET_SIZE;
             int nId = vvNew[nUBucket][nUBucketPos];
             assert(mapInfo.count(nId) == 1);
             CAddrInfo &info = mapInfo[nId];
@@ -455,6 +459,7 @@ int CAddrMan::Check_() {
     if (setTried.size()) return -13;
     if (mapNew.size()) return -15;
     if (nKey.IsNull()) return -16;
+    if (slotsTried.Size() != size_t(nTried)) return -20;
 
     return 0;
 }
@@ -13,6 +13,7 @@
 #include "timedata.h"
 #include "util.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <map>
 #include <set>
@@ -186,6 +187,44 @@ public:
 #define ADDRMAN_NEW_BUCKET_COUNT (1 << ADDRMAN_NEW_BUCKET_COUNT_LOG2)
 #define ADDRMAN_BUCKET_SIZE (1 << ADDRMAN_BUCKET_SIZE_LOG2)
 
+/**
+ * The occupied slots of a bucket table, numbered bucket * ADDRMAN_BUCKET_SIZE
+ * + position, so that one can be picked uniformly at random in constant time
+ * however sparse the table is.
+ */
+class CAddrManSlots {
+public:
+    explicit CAddrManSlots(int nSlots) : vIndex(nSlots, -1) {}
+
+    void Insert(int nSlot) {
+        vIndex[nSlot] = vSlots.size();
+        vSlots.push_back(nSlot);
+    }
+
+    void Erase(int nSlot) {
+        // Move the last slot into the hole.
+        int nIndex = vIndex[nSlot];
+        vSlots[nIndex] = vSlots.back();
+        vIndex[vSlots[nIndex]] = nIndex;
+        vSlots.pop_back();
+        vIndex[nSlot] = -1;
+    }
+
+    void Clear() {
+        vSlots.clear();
+        std::fill(vIndex.begin(), vIndex.end(), -1);
+    }
+
+    size_t Size() const { return vSlots.size(); }
+    int operator[](size_t i) const { return vSlots[i]; }
+
+private:
+    //! occupied slots, in no particular order
+    std::vector<int> vSlots;
+    //! index of each slot in vSlots, or -1 if it is empty
+    std::vector<int> vIndex;
+};
+
 /**
  * Stochastical (IP) address manager
  */
@@ -218,6 +257,11 @@ private:
     //! list of "new" buckets
     int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
 
+    //! occupied positions of vvTried and vvNew, kept in step by SetTried and
+    //! SetNew
+    CAddrManSlots slotsTried;
+    CAddrManSlots slotsNew;
+
     //! last time Good was called (memory only)
     int64_t nLastGood;
 
@@ -239,6 +283,11 @@ protected:
     //! Swap two elements in vRandom.
     void SwapRandom(unsigned int nRandomPos1, unsigned int nRandomPos2);
 
+    //! Store nId, or -1 to empty it, at a position of the "tried" or "new"
+    //! table. All changes to vvTried and vvNew go through these.
+    void SetTried(int nKBucket, int nKBucketPos, int nId);
+    void SetNew(int nUBucket, int nUBucketPos, int nId);
+
     //! Move an entry from the "new" table(s) to the "tried" table
     void MakeTried(CAddrInfo &info, int nId);
 
@@ -409,7 +458,7 @@ public:
                 int nUBucket = info.GetNewBucket(nKey);
                 int nUBucketPos = info.GetBucketPosition(nKey, true, nUBucket);
                 if (vvNew[nUBucket][nUBucketPos] == -1) {
-                    vvNew[nUBucket][nUBucketPos] = n;
+                    SetNew(nUBucket, nUBucketPos, n);
                     info.nRefCount++;
                 }
             }
@@ -429,7 +478,7 @@ public:
                 vRandom.push_back(nIdCount);
                 mapInfo[nIdCount] = info;
                 mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
+                SetTried(nKBucket, nKBucketPos, nIdCount);
                 nIdCount++;
             } else {
                 nLost++;
@@ -453,7 +502,7 @@ public:
                         vvNew[bucket][nUBucketPos] == -1 &&
                         info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
                         info.nRefCount++;
-                        vvNew[bucket][nUBucketPos] = nIndex;
+                        SetNew(bucket, nUBucketPos, nIndex);
                     }
                 }
             }
@@ -493,6 +542,8 @@ public:
                 vvTried[bucket][entry] = -1;
             }
         }
+        slotsNew.Clear();
+        slotsTried.Clear();
 
         nIdCount = 0;
         nTried = 0;
@@ -501,7 +552,11 @@ public:
         nLastGood = 1;
     }
 
-    CAddrMan() { Clear(); }
+    CAddrMan()
+        : slotsTried(ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE),
+          slotsNew(ADDRMAN_NEW_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE) {
+        Clear();
+    }
 
     ~CAddrMan() { nKey.SetNull(); }
 
@@ -0,0 +1,92 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "affinity.h"
+
+#include "utilstrencodings.h"
+
+#include <map>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+bool ParseCpuList(const std::string &str, std::vector<int> &vCpus) {
+    vCpus.clear();
+    std::vector<std::string> vRanges;
+    boost::split(vRanges, str, boost::is_any_of(","));
+    for (const std::string &strRange : vRanges) {
+        std::vector<std::string> vBounds;
+        boost::split(vBounds, strRange, boost::is_any_of("-"));
+        int32_t nFirst, nLast;
+        if (vBounds.size() > 2 || !ParseInt32(vBounds.front(), &nFirst) ||
+            !ParseInt32(vBounds.back(), &nLast) || nFirst < 0 ||
+            nLast < nFirst) {
+            return false;
+        }
+        for (int32_t nCpu = nFirst; nCpu <= nLast; nCpu++) {
+            vCpus.push_back(nCpu);
+        }
+    }
+    return true;
+}
+
+std::vector<std::vector<int>> GetNumaNodeCpus() {
+    std::vector<std::vector<int>> vNodes;
+#ifdef __linux__
+    namespace fs = boost::filesystem;
+    const fs::path nodeDir("/sys/devices/system/node");
+    boost::system::error_code ec;
+    if (!fs::is_directory(nodeDir, ec)) {
+        return vNodes;
+    }
+
+    // Node numbers can have gaps, so order by number rather than by name.
+    std::map<int32_t, std::vector<int>> mapNodes;
+    for (fs::directory_iterator it(nodeDir, ec), end; !ec && it != end;
+         it.increment(ec)) {
+        const std::string strName = it->path().filename().string();
+        int32_t nNode;
+        if (strName.compare(0, 4, "node") != 0 ||
+            !ParseInt32(strName.substr(4), &nNode)) {
+            continue;
+        }
+
+        fs::ifstream file(it->path() / "cpulist");
+        std::string strCpus;
+        std::vector<int> vCpus;
+        if (!std::getline(file, strCpus) ||
+            !ParseCpuList(boost::trim_copy(strCpus), vCpus)) {
+            // Memory only nodes have an empty list.
+            continue;
+        }
+        mapNodes[nNode] = vCpus;
+    }
+    for (const auto &node : mapNodes) {
+        vNodes.push_back(node.second);
+    }
+#endif
+    return vNodes;
+}
+
+bool SetThreadAffinity(const std::vector<int> &vCpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int nCpu : vCpus) {
+        if (nCpu < CPU_SETSIZE) {
+            CPU_SET(nCpu, &set);
+        }
+    }
+    return CPU_COUNT(&set) > 0 &&
+           pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
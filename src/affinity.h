@@ -0,0 +1,25 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_AFFINITY_H
+#define BITCOIN_AFFINITY_H
+
+#include <string>
+#include <vector>
+
+/**
+ * Parse a Linux cpulist such as "0-3,8,10-11" into the listed CPU numbers.
+ */
+bool ParseCpuList(const std::string &str, std::vector<int> &vCpus);
+
+/**
+ * CPUs of each NUMA node with CPUs, in node order. Empty if the topology is
+ * unknown, which is the case on anything but Linux.
+ */
+std::vector<std::vector<int>> GetNumaNodeCpus();
+
+/** Restrict the calling thread to the given CPUs */
+bool SetThreadAffinity(const std::vector<int> &vCpus);
+
+#endif // BITCOIN_AFFINITY_H
@@ -19,30 +19,29 @@ base_uint<BITS>::base_uint(const std::string &str) {
 
 template <unsigned int BITS>
 base_uint<BITS> &base_uint<BITS>::operator<<=(unsigned int shift) {
-    base_uint<BITS> a(*this);
-    for (int i = 0; i < WIDTH; i++)
-        pn[i] = 0;
-    int k = shift / 32;
+    // From the top down, so each limb is read before it is overwritten.
+    const int k = shift / 32;
     shift = shift % 32;
-    for (int i = 0; i < WIDTH; i++) {
-        if (i + k + 1 < WIDTH && shift != 0)
-            pn[i + k + 1] |= (a.pn[i] >> (32 - shift));
-        if (i + k < WIDTH) pn[i + k] |= (a.pn[i] << shift);
+    for (int i = WIDTH - 1; i >= 0; i--) {
+        uint32_t n = i - k >= 0 ? pn[i - k] << shift : 0;
+        if (i - k - 1 >= 0 && shift != 0) {
+            n |= pn[i - k - 1] >> (32 - shift);
+        }
+        pn[i] = n;
     }
     return *this;
 }
 
 template <unsigned int BITS>
 base_uint<BITS> &base_uint<BITS>::operator>>=(unsigned int shift) {
-    base_uint<BITS> a(*this);
-    for (int i = 0; i < WIDTH; i++)
-        pn[i] = 0;
-    int k = shift / 32;
+    const int k = shift / 32;
     shift = shift % 32;
     for (int i = 0; i < WIDTH; i++) {
-        if (i - k - 1 >= 0 && shift != 0)
-            pn[i - k - 1] |= (a.pn[i] << (32 - shift));
-        if (i - k >= 0) pn[i - k] |= (a.pn[i] >> shift);
+        uint32_t n = i + k < WIDTH ? pn[i + k] >> shift : 0;
+        if (i + k + 1 < WIDTH && shift != 0) {
+            n |= pn[i + k + 1] << (32 - shift);
+        }
+        pn[i] = n;
     }
     return *this;
 }
@@ -58,48 +57,184 @@ base_uint<BITS> &base_uint<BITS>::operator*=(uint32_t b32) {
     return *this;
 }
 
+namespace {
+
+/**
+ * Multiplication and division work on limbs of the widest type whose product
+ * the compiler can hold, 64 bits with __int128, and 32 bits otherwise. The
+ * 32-bit limbs of a base_uint are regrouped into them.
+ */
+#ifdef __SIZEOF_INT128__
+typedef uint64_t limb_t;
+typedef unsigned __int128 double_limb_t;
+#else
+typedef uint32_t limb_t;
+typedef uint64_t double_limb_t;
+#endif
+const int LIMB_SIZE = 8 * sizeof(limb_t);
+const int PN_PER_LIMB = sizeof(limb_t) / sizeof(uint32_t);
+
+void ToLimbs(const uint32_t *pn, int nWidth, limb_t *limbs) {
+    for (int i = 0; i < nWidth / PN_PER_LIMB; i++) {
+        limbs[i] = 0;
+        for (int j = PN_PER_LIMB - 1; j >= 0; j--) {
+            limbs[i] = (limbs[i] << 16 << 16) | pn[i * PN_PER_LIMB + j];
+        }
+    }
+}
+
+void FromLimbs(const limb_t *limbs, int nWidth, uint32_t *pn) {
+    for (int i = 0; i < nWidth / PN_PER_LIMB; i++) {
+        limb_t n = limbs[i];
+        for (int j = 0; j < PN_PER_LIMB; j++) {
+            pn[i * PN_PER_LIMB + j] = uint32_t(n);
+            n = n >> 16 >> 16;
+        }
+    }
+}
+
+//! Limbs in use, those below the highest one that is not zero
+int CountLimbs(const limb_t *limbs, int nLimbs) {
+    while (nLimbs > 0 && limbs[nLimbs - 1] == 0) {
+        nLimbs--;
+    }
+    return nLimbs;
+}
+
+int CountLeadingZeroes(limb_t n) {
+    int nZeroes = 0;
+    for (int nStep = LIMB_SIZE / 2; nStep > 0; nStep /= 2) {
+        if ((n >> (LIMB_SIZE - nStep)) == 0) {
+            n <<= nStep;
+            nZeroes += nStep;
+        }
+    }
+    return nZeroes;
+}
+
+/**
+ * q = u / v, for u and v of LIMBS limbs and v not zero. This is algorithm D
+ * of Knuth, TAOCP 4.3.1: the quotient is worked out a limb at a time, each
+ * estimated from the top limbs and then corrected, rather than a bit at a
+ * time.
+ */
+template <int LIMBS>
+void DivideLimbs(const limb_t *u, const limb_t *v, limb_t *q) {
+    const int m = CountLimbs(u, LIMBS);
+    const int n = CountLimbs(v, LIMBS);
+    for (int i = 0; i < LIMBS; i++) {
+        q[i] = 0;
+    }
+    if (m < n) {
+        return;
+    }
+
+    if (n == 1) {
+        double_limb_t rem = 0;
+        for (int i = m - 1; i >= 0; i--) {
+            const double_limb_t cur = (rem << LIMB_SIZE) | u[i];
+            q[i] = limb_t(cur / v[0]);
+            rem = cur % v[0];
+        }
+        return;
+    }
+
+    // Normalize, so the top limb of the divisor has its top bit set.
+    limb_t vn[LIMBS];
+    limb_t un[LIMBS + 1];
+    const int s = CountLeadingZeroes(v[n - 1]);
+    for (int i = n - 1; i > 0; i--) {
+        vn[i] = (v[i] << s) | (s ? v[i - 1] >> (LIMB_SIZE - s) : 0);
+    }
+    vn[0] = v[0] << s;
+    un[m] = s ? u[m - 1] >> (LIMB_SIZE - s) : 0;
+    for (int i = m - 1; i > 0; i--) {
+        un[i] = (u[i] << s) | (s ? u[i - 1] >> (LIMB_SIZE - s) : 0);
+    }
+    un[0] = u[0] << s;
+
+    for (int j = m - n; j >= 0; j--) {
+        // Estimate the quotient limb from the top two limbs, then refine it
+        // with the third, after which it is at most one too large.
+        const double_limb_t num =
+            (double_limb_t(un[j + n]) << LIMB_SIZE) | un[j + n - 1];
+        double_limb_t qhat = num / vn[n - 1];
+        double_limb_t rhat = num % vn[n - 1];
+        while ((qhat >> LIMB_SIZE) != 0 ||
+               qhat * vn[n - 2] > ((rhat << LIMB_SIZE) | un[j + n - 2])) {
+            qhat--;
+            rhat += vn[n - 1];
+            if ((rhat >> LIMB_SIZE) != 0) {
+                break;
+            }
+        }
+
+        // un -= qhat * vn, at limb j.
+        limb_t borrow = 0;
+        limb_t carry = 0;
+        for (int i = 0; i < n; i++) {
+            const double_limb_t p = qhat * vn[i] + carry;
+            carry = limb_t(p >> LIMB_SIZE);
+            const limb_t plo = limb_t(p);
+            const limb_t t = un[i + j] - plo;
+            const limb_t borrowNext = (un[i + j] < plo) + (t < borrow);
+            un[i + j] = t - borrow;
+            borrow = borrowNext;
+        }
+        const double_limb_t sub = double_limb_t(carry) + borrow;
+        const bool fNegative = un[j + n] < sub;
+        un[j + n] -= limb_t(sub);
+
+        q[j] = limb_t(qhat);
+        if (fNegative) {
+            // qhat was one too large, add vn back.
+            q[j]--;
+            limb_t c = 0;
+            for (int i = 0; i < n; i++) {
+                const double_limb_t sum =
+                    double_limb_t(un[i + j]) + vn[i] + c;
+                un[i + j] = limb_t(sum);
+                c = limb_t(sum >> LIMB_SIZE);
+            }
+            un[j + n] += c;
+        }
+    }
+}
+
+} // namespace
+
 template <unsigned int BITS>
 base_uint<BITS> &base_uint<BITS>::operator*=(const base_uint &b) {
-    base_uint<BITS> a = *this;
-    *this = 0;
-    for (int j = 0; j < WIDTH; j++) {
-        uint64_t carry = 0;
-        for (int i = 0; i + j < WIDTH; i++) {
-            uint64_t n = carry + pn[i + j] + (uint64_t)a.pn[j] * b.pn[i];
-            pn[i + j] = n & 0xffffffff;
-            carry = n >> 32;
+    static_assert(WIDTH % PN_PER_LIMB == 0, "limbs must fit the width");
+    const int nLimbs = WIDTH / PN_PER_LIMB;
+    limb_t x[nLimbs], y[nLimbs], r[nLimbs] = {};
+    ToLimbs(pn, WIDTH, x);
+    ToLimbs(b.pn, WIDTH, y);
+    for (int j = 0; j < nLimbs; j++) {
+        limb_t carry = 0;
+        for (int i = 0; i + j < nLimbs; i++) {
+            const double_limb_t n =
+                double_limb_t(x[j]) * y[i] + r[i + j] + carry;
+            r[i + j] = limb_t(n);
+            carry = limb_t(n >> LIMB_SIZE);
         }
     }
+    FromLimbs(r, WIDTH, pn);
     return *this;
 }
 
 template <unsigned int BITS>
 base_uint<BITS> &base_uint<BITS>::operator/=(const base_uint &b) {
-    // make a copy, so we can shift.
-    base_uint<BITS> div = b;
-    // make a copy, so we can subtract.
-    base_uint<BITS> num = *this;
-    // the quotient.
-    *this = 0;
-    int num_bits = num.bits();
-    int div_bits = div.bits();
-    if (div_bits == 0) throw uint_error("Division by zero");
-    // the result is certainly 0.
-    if (div_bits > num_bits) return *this;
-    int shift = num_bits - div_bits;
-    // shift so that div and num align.
-    div <<= shift;
-    while (shift >= 0) {
-        if (num >= div) {
-            num -= div;
-            // set a bit of the result.
-            pn[shift / 32] |= (1 << (shift & 31));
-        }
-        // shift back.
-        div >>= 1;
-        shift--;
+    static_assert(WIDTH % PN_PER_LIMB == 0, "limbs must fit the width");
+    if (!b) {
+        throw uint_error("Division by zero");
     }
-    // num now contains the remainder of the division.
+    const int nLimbs = WIDTH / PN_PER_LIMB;
+    limb_t u[nLimbs], v[nLimbs], q[nLimbs];
+    ToLimbs(pn, WIDTH, u);
+    ToLimbs(b.pn, WIDTH, v);
+    DivideLimbs<nLimbs>(u, v, q);
+    FromLimbs(q, WIDTH, pn);
     return *this;
 }
 
@@ -151,10 +286,7 @@ template <unsigned int BITS> std::string base_uint<BITS>::ToString() const {
 template <unsigned int BITS> unsigned int base_uint<BITS>::bits() const {
     for (int pos = WIDTH - 1; pos >= 0; pos--) {
         if (pn[pos]) {
-            for (int bits = 31; bits > 0; bits--) {
-                if (pn[pos] & 1 << bits) return 32 * pos + bits + 1;
-            }
-            return 32 * pos + 1;
+            return 32 * pos + CountBits(pn[pos]);
         }
     }
     return 0;
@@ -222,13 +354,10 @@ uint32_t arith_uint256::GetCompact(bool fNegative) const {
 
 ethash_h256_t arith_uint256::ToEthashH256() const
 {
+    // Big endian, straight from the limbs.
     ethash_h256_t ret;
-    uint256 b = ArithToUint256(*this);
-
-    unsigned char *p = (unsigned char *)(b.begin());
-    for (int i = 0; i < 32; i++, p++) {
-        ret.b[31 - i] = (uint8_t)(*p);
-//        ret.b[i] = (uint8_t)(*p);
+    for (int x = 0; x < WIDTH; x++) {
+        WriteBE32(ret.b + 28 - 4 * x, pn[x]);
     }
     return ret;
 }
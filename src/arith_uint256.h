@@ -128,7 +128,12 @@ public:
     }
 
     base_uint &operator-=(const base_uint &b) {
-        *this += -b;
+        uint64_t borrow = 0;
+        for (int i = 0; i < WIDTH; i++) {
+            uint64_t n = (uint64_t)pn[i] - b.pn[i] - borrow;
+            pn[i] = n & 0xffffffff;
+            borrow = (n >> 32) & 1;
+        }
         return *this;
     }
 
@@ -142,7 +147,7 @@ public:
     base_uint &operator-=(uint64_t b64) {
         base_uint b;
         b = b64;
-        *this += -b;
+        *this -= b;
         return *this;
     }
 
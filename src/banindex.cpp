@@ -0,0 +1,67 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "banindex.h"
+
+#include <algorithm>
+
+void CBanIndex::Add(const CSubNet &subNet, int64_t nBanUntil) {
+    // Invalid subnets match nothing.
+    if (!subNet.IsValid()) {
+        return;
+    }
+    auto it = std::find_if(vNetmasks.begin(), vNetmasks.end(),
+                           [&subNet](const Netmask &netmask) {
+                               return netmask.subNet.HasSameNetmask(subNet);
+                           });
+    if (it == vNetmasks.end()) {
+        it = vNetmasks.insert(vNetmasks.end(), Netmask{subNet, {}});
+    }
+    int64_t &nBanUntilIndexed = it->mapBanUntil[subNet];
+    nBanUntilIndexed = std::max(nBanUntilIndexed, nBanUntil);
+}
+
+void CBanIndex::Remove(const CSubNet &subNet) {
+    for (auto it = vNetmasks.begin(); it != vNetmasks.end(); ++it) {
+        if (it->subNet.HasSameNetmask(subNet)) {
+            it->mapBanUntil.erase(subNet);
+            if (it->mapBanUntil.empty()) {
+                vNetmasks.erase(it);
+            }
+            return;
+        }
+    }
+}
+
+void CBanIndex::Rebuild(const banmap_t &banMap) {
+    Clear();
+    for (const auto &ban : banMap) {
+        Add(ban.first, ban.second.nBanUntil);
+    }
+}
+
+void CBanIndex::Clear() {
+    vNetmasks.clear();
+}
+
+bool CBanIndex::IsBanned(const CNetAddr &addr, int64_t nNow) const {
+    if (!addr.IsValid()) {
+        return false;
+    }
+    for (const Netmask &netmask : vNetmasks) {
+        auto it = netmask.mapBanUntil.find(netmask.subNet.GetSubNetOf(addr));
+        if (it != netmask.mapBanUntil.end() && nNow < it->second) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t CBanIndex::Size() const {
+    size_t nSize = 0;
+    for (const Netmask &netmask : vNetmasks) {
+        nSize += netmask.mapBanUntil.size();
+    }
+    return nSize;
+}
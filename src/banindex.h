@@ -0,0 +1,47 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BANINDEX_H
+#define BITCOIN_BANINDEX_H
+
+#include "addrdb.h"
+#include "netaddress.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+/**
+ * The ban times of the banned subnets, grouped by netmask, so that whether an
+ * address is banned takes one map lookup per netmask in use, at most 129 for
+ * CIDR subnets, instead of a match against every ban.
+ *
+ * Expired bans stay in until they are removed, and are skipped by lookups.
+ * Not thread safe: CConnman guards it with cs_setBanned, along with the ban
+ * map it mirrors.
+ */
+class CBanIndex {
+public:
+    /** Ban subNet until nBanUntil, unless it already is for longer */
+    void Add(const CSubNet &subNet, int64_t nBanUntil);
+    void Remove(const CSubNet &subNet);
+    void Rebuild(const banmap_t &banMap);
+    void Clear();
+
+    /** Whether a subnet addr is in is banned after nNow */
+    bool IsBanned(const CNetAddr &addr, int64_t nNow) const;
+
+    size_t Size() const;
+
+private:
+    struct Netmask {
+        //! A subnet with the netmask, the key of the bans is taken from it
+        CSubNet subNet;
+        std::map<CSubNet, int64_t> mapBanUntil;
+    };
+    std::vector<Netmask> vNetmasks;
+};
+
+#endif // BITCOIN_BANINDEX_H
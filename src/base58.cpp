@@ -20,6 +20,35 @@
 static const char *pszBase58 =
     "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
 
+/** The value of each base58 character, -1 for the others */
+static const int8_t mapBase58[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, 0,  1,  2,  3,  4,  5,  6,  7,  8,  -1, -1, -1, -1, -1, -1,
+    -1, 9,  10, 11, 12, 13, 14, 15, 16, -1, 17, 18, 19, 20, 21, -1,
+    22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, -1, -1, -1, -1, -1,
+    -1, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, -1, 44, 45, 46,
+    47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+/**
+ * The number is worked on in 32-bit limbs, least significant first, so that
+ * a limb times a step plus the carry fits in 64 bits. Encoding, the limbs are
+ * base 58^5 and take 4 bytes a step; decoding, they are base 2^32 and take 5
+ * characters a step. That is 20 times fewer steps than digit by digit.
+ */
+static const uint32_t BASE58_LIMB = 656356768; // 58^5
+static const int BASE58_LIMB_DIGITS = 5;
+
 bool DecodeBase58(const char *psz, std::vector<uint8_t> &vch) {
     // Skip leading spaces.
     while (*psz && isspace(*psz)) {
@@ -27,51 +56,67 @@ bool DecodeBase58(const char *psz, std::vector<uint8_t> &vch) {
     }
     // Skip and count leading '1's.
     int zeroes = 0;
-    int length = 0;
     while (*psz == '1') {
         zeroes++;
         psz++;
     }
-    // Allocate enough space in big-endian base256 representation.
-    // log(58) / log(256), rounded up.
-    int size = strlen(psz) * 733 / 1000 + 1;
-    std::vector<uint8_t> b256(size);
-    // Process the characters.
-    while (*psz && !isspace(*psz)) {
-        // Decode base58 character
-        const char *ch = strchr(pszBase58, *psz);
-        if (ch == nullptr) {
-            return false;
-        }
-        // Apply "b256 = b256 * 58 + ch".
-        int carry = ch - pszBase58;
-        int i = 0;
-        for (std::vector<uint8_t>::reverse_iterator it = b256.rbegin();
-             (carry != 0 || i < length) && (it != b256.rend()); ++it, ++i) {
-            carry += 58 * (*it);
-            *it = carry % 256;
-            carry /= 256;
-        }
-        assert(carry == 0);
-        length = i;
-        psz++;
+    // Find the end of the digits.
+    const char *pend = psz;
+    while (*pend && !isspace(*pend)) {
+        pend++;
     }
     // Skip trailing spaces.
-    while (isspace(*psz)) {
-        psz++;
+    const char *pspace = pend;
+    while (isspace(*pspace)) {
+        pspace++;
     }
-    if (*psz != 0) {
+    if (*pspace != 0) {
         return false;
     }
-    // Skip leading zeroes in b256.
-    std::vector<uint8_t>::iterator it = b256.begin() + (size - length);
-    while (it != b256.end() && *it == 0)
-        it++;
-    // Copy result into output vector.
-    vch.reserve(zeroes + (b256.end() - it));
+    // Enough limbs for log(58) / log(2^32) per digit, rounded up.
+    const size_t nDigits = pend - psz;
+    std::vector<uint32_t> limbs(nDigits * 733 / 4000 + 1);
+    size_t nLimbs = 0;
+    // Process the characters, a short group first so the others are whole.
+    size_t nStep = nDigits % BASE58_LIMB_DIGITS;
+    if (nStep == 0) {
+        nStep = BASE58_LIMB_DIGITS;
+    }
+    while (psz != pend) {
+        uint64_t carry = 0;
+        uint64_t nMul = 1;
+        for (size_t i = 0; i < nStep; i++) {
+            const int8_t digit = mapBase58[uint8_t(*psz++)];
+            if (digit < 0) {
+                return false;
+            }
+            carry = carry * 58 + digit;
+            nMul *= 58;
+        }
+        // Apply "limbs = limbs * 58^nStep + carry".
+        size_t i = 0;
+        for (; i < nLimbs || carry != 0; i++) {
+            assert(i < limbs.size());
+            carry += nMul * limbs[i];
+            limbs[i] = uint32_t(carry);
+            carry >>= 32;
+        }
+        nLimbs = i;
+        nStep = BASE58_LIMB_DIGITS;
+    }
+    // Copy result into output vector, skipping leading zeroes in the limbs.
     vch.assign(zeroes, 0x00);
-    while (it != b256.end()) {
-        vch.push_back(*(it++));
+    vch.reserve(zeroes + 4 * nLimbs);
+    bool fLeading = true;
+    for (size_t i = nLimbs; i-- > 0;) {
+        for (int nShift = 24; nShift >= 0; nShift -= 8) {
+            const uint8_t ch = limbs[i] >> nShift;
+            if (fLeading && ch == 0) {
+                continue;
+            }
+            fLeading = false;
+            vch.push_back(ch);
+        }
     }
     return true;
 }
@@ -79,42 +124,56 @@ bool DecodeBase58(const char *psz, std::vector<uint8_t> &vch) {
 std::string EncodeBase58(const uint8_t *pbegin, const uint8_t *pend) {
     // Skip & count leading zeroes.
     int zeroes = 0;
-    int length = 0;
     while (pbegin != pend && *pbegin == 0) {
         pbegin++;
         zeroes++;
     }
-    // Allocate enough space in big-endian base58 representation.
-    // log(256) / log(58), rounded up.
-    int size = (pend - pbegin) * 138 / 100 + 1;
-    std::vector<uint8_t> b58(size);
-    // Process the bytes.
+    // Enough limbs for log(256) / log(58^5) per byte, rounded up.
+    const size_t nBytes = pend - pbegin;
+    std::vector<uint32_t> limbs(nBytes * 138 / 500 + 1);
+    size_t nLimbs = 0;
+    // Process the bytes, a short group first so the others are whole.
+    size_t nStep = nBytes % 4;
+    if (nStep == 0) {
+        nStep = 4;
+    }
     while (pbegin != pend) {
-        int carry = *pbegin;
-        int i = 0;
-        // Apply "b58 = b58 * 256 + ch".
-        for (std::vector<uint8_t>::reverse_iterator it = b58.rbegin();
-             (carry != 0 || i < length) && (it != b58.rend()); it++, i++) {
-            carry += 256 * (*it);
-            *it = carry % 58;
-            carry /= 58;
+        uint64_t carry = 0;
+        for (size_t i = 0; i < nStep; i++) {
+            carry = (carry << 8) | *pbegin++;
         }
-
-        assert(carry == 0);
-        length = i;
-        pbegin++;
-    }
-    // Skip leading zeroes in base58 result.
-    std::vector<uint8_t>::iterator it = b58.begin() + (size - length);
-    while (it != b58.end() && *it == 0) {
-        it++;
+        // Apply "limbs = limbs * 256^nStep + carry".
+        const int nShift = 8 * nStep;
+        size_t i = 0;
+        for (; i < nLimbs || carry != 0; i++) {
+            assert(i < limbs.size());
+            carry += uint64_t(limbs[i]) << nShift;
+            limbs[i] = carry % BASE58_LIMB;
+            carry /= BASE58_LIMB;
+        }
+        nLimbs = i;
+        nStep = 4;
     }
-    // Translate the result into a string.
+    // Translate the result into a string, skipping leading zeroes in the
+    // limbs.
     std::string str;
-    str.reserve(zeroes + (b58.end() - it));
+    str.reserve(zeroes + BASE58_LIMB_DIGITS * nLimbs);
     str.assign(zeroes, '1');
-    while (it != b58.end()) {
-        str += pszBase58[*(it++)];
+    const size_t nPrefix = str.size();
+    for (size_t i = nLimbs; i-- > 0;) {
+        char digits[BASE58_LIMB_DIGITS];
+        uint32_t limb = limbs[i];
+        for (int j = BASE58_LIMB_DIGITS; j-- > 0;) {
+            digits[j] = pszBase58[limb % 58];
+            limb /= 58;
+        }
+        int j = 0;
+        if (str.size() == nPrefix) {
+            while (j < BASE58_LIMB_DIGITS && digits[j] == '1') {
+                j++;
+            }
+        }
+        str.append(digits + j, BASE58_LIMB_DIGITS - j);
     }
     return str;
 }
@@ -0,0 +1,179 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "baseindex.h"
+
+#include "chain.h"
+#include "txdb.h"
+#include "util.h"
+#include "validation.h"
+
+#include <functional>
+
+CBaseIndex::CBaseIndex(const Config &configIn, bool fDropIn,
+                       const std::string &strThreadNameIn,
+                       const std::string &strNameIn,
+                       const std::string &strFlagIn)
+    : config(configIn), fDrop(fDropIn), strThreadName(strThreadNameIn),
+      strName(strNameIn), strFlag(strFlagIn), fNewTip(false), fStop(false),
+      fSynced(false), pindexBest(nullptr) {}
+
+CBaseIndex::~CBaseIndex() {
+    Stop();
+}
+
+void CBaseIndex::Start() {
+    if (fDrop) {
+        thread = std::thread(
+            &TraceThread<std::function<void()>>, strThreadName.c_str(),
+            std::function<void()>(std::bind(&CBaseIndex::ThreadDrop, this)));
+        return;
+    }
+    RegisterValidationInterface(this);
+    thread = std::thread(
+        &TraceThread<std::function<void()>>, strThreadName.c_str(),
+        std::function<void()>(std::bind(&CBaseIndex::ThreadSync, this)));
+}
+
+void CBaseIndex::Stop() {
+    UnregisterValidationInterface(this);
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+    }
+    cond.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void CBaseIndex::UpdatedBlockTip(const CBlockIndex *pindexNew,
+                                 const CBlockIndex *pindexFork,
+                                 bool fInitialDownload) {
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fNewTip = true;
+    }
+    cond.notify_all();
+}
+
+bool CBaseIndex::WaitForTip() {
+    std::unique_lock<std::mutex> lock(cs);
+    cond.wait(lock, [this] { return fStop || fNewTip; });
+    fNewTip = false;
+    return !fStop;
+}
+
+bool CBaseIndex::IsStopped() {
+    std::lock_guard<std::mutex> lock(cs);
+    return fStop;
+}
+
+bool CBaseIndex::EraseAll() {
+    const size_t nBatch = GetEraseBatch();
+    while (!IsStopped()) {
+        size_t nErased;
+        if (!EraseEntries(nBatch, nErased)) {
+            return error("%s: failed to erase the %s", __func__, strName);
+        }
+        if (nErased < nBatch) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CBaseIndex::ThreadDrop() {
+    // Without its best block the index is incomplete, whenever this stops.
+    LogPrintf("Dropping the %s\n", strName);
+    if (!EraseBestBlock() || !EraseAll()) {
+        return;
+    }
+    pblocktree->WriteFlag(strFlag, false);
+    LogPrintf("The %s is dropped\n", strName);
+    fSynced = true;
+}
+
+void CBaseIndex::ThreadSync() {
+    const CBlockIndex *pindex = nullptr;
+    uint256 hashBest;
+    if (ReadBestBlock(hashBest)) {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hashBest);
+        if (it != mapBlockIndex.end()) {
+            pindex = it->second;
+        }
+    }
+    if (pindex && !Resume(pindex)) {
+        pindex = nullptr;
+    }
+    if (!pindex) {
+        LogPrintf("Building the %s\n", strName);
+        if (EraseToStartOver() && !EraseAll()) {
+            return;
+        }
+    }
+    pindexBest = pindex;
+    pblocktree->WriteFlag(strFlag, true);
+
+    while (true) {
+        bool fRewind = false;
+        const CBlockIndex *pindexFork = nullptr;
+        std::vector<const CBlockIndex *> vBlocks;
+        {
+            LOCK(cs_main);
+            pindex = pindexBest;
+            if (pindex && !chainActive.Contains(pindex)) {
+                // Off the active chain since, back to the fork first.
+                fRewind = true;
+                pindexFork = chainActive.FindFork(pindex);
+            } else {
+                pindex = pindex ? chainActive.Next(pindex)
+                                : chainActive.Genesis();
+                size_t nTransactions = 0;
+                for (; pindex && !IsBatchFull(vBlocks.size(), nTransactions);
+                     pindex = chainActive.Next(pindex)) {
+                    vBlocks.push_back(pindex);
+                    nTransactions += pindex->nTx;
+                }
+            }
+        }
+
+        if (fRewind) {
+            if (!Rewind(pindexFork)) {
+                if (!IsStopped()) {
+                    LogPrintf("%s: the %s is not updated anymore\n", __func__,
+                              strName);
+                }
+                return;
+            }
+            pindexBest = pindexFork;
+            continue;
+        }
+
+        if (vBlocks.empty()) {
+            if (!fSynced) {
+                LogPrintf("The %s is up to date\n", strName);
+                fSynced = true;
+            }
+            if (!WaitForTip()) {
+                return;
+            }
+            continue;
+        }
+
+        if (!WriteBlocks(vBlocks)) {
+            if (!IsStopped()) {
+                LogPrintf("%s: the %s is not updated anymore\n", __func__,
+                          strName);
+            }
+            return;
+        }
+        pindexBest = vBlocks.back();
+        if (!fSynced) {
+            LogPrintf("The %s is built up to height %d\n", strName,
+                      vBlocks.back()->nHeight);
+        }
+    }
+}
@@ -0,0 +1,128 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BASEINDEX_H
+#define BITCOIN_BASEINDEX_H
+
+#include "validationinterface.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CBlockIndex;
+class Config;
+class uint256;
+
+/**
+ * An index in the block tree database, maintained on a thread of its own so
+ * connecting a block doesn't wait for it.
+ *
+ * The thread follows the active chain from the last block the index is
+ * complete up to, handing the blocks after it to WriteBlocks() in batches.
+ * It catches up at startup, after the index has been turned on or lost, and
+ * keeps up from there as blocks are connected. When that block is no longer
+ * on the active chain, Rewind() takes the index back to the fork first.
+ *
+ * Built with fDrop, it erases the index instead, after its option was turned
+ * off.
+ *
+ * Derived classes call Start() at the end of their constructor and Stop() in
+ * their destructor, so that the thread only runs while they are whole.
+ */
+class CBaseIndex : public CValidationInterface {
+public:
+    virtual ~CBaseIndex();
+
+    /**
+     * Whether the index has caught up with the active chain since it started,
+     * or, with fDrop, is gone.
+     */
+    bool IsSynced() const { return fSynced; }
+
+    /** Whether the index is being dropped rather than built */
+    bool IsDropping() const { return fDrop; }
+
+    /** The block the index is complete up to, nullptr before the first */
+    const CBlockIndex *GetBestBlock() const { return pindexBest; }
+
+protected:
+    /**
+     * strNameIn is what the log calls the index, strFlagIn the flag of the
+     * block tree database that records whether it is on.
+     */
+    CBaseIndex(const Config &configIn, bool fDropIn,
+               const std::string &strThreadNameIn, const std::string &strNameIn,
+               const std::string &strFlagIn);
+
+    void Start();
+    void Stop();
+    bool IsStopped();
+
+    void UpdatedBlockTip(const CBlockIndex *pindexNew,
+                         const CBlockIndex *pindexFork,
+                         bool fInitialDownload) override;
+
+    virtual bool ReadBestBlock(uint256 &hashBest) = 0;
+    virtual bool EraseBestBlock() = 0;
+    //! Erase up to nBatch entries, nErased of them.
+    virtual bool EraseEntries(size_t nBatch, size_t &nErased) = 0;
+    //! Entries EraseEntries() is asked to erase at once
+    virtual size_t GetEraseBatch() const = 0;
+
+    /**
+     * Whether the index goes on from pindex, the block it was complete up to
+     * when it stopped, rather than start over.
+     */
+    virtual bool Resume(const CBlockIndex *pindex) { return true; }
+    /**
+     * Whether starting over erases the entries an older version or a build
+     * that was interrupted left behind first.
+     */
+    virtual bool EraseToStartOver() const { return true; }
+    //! Whether a batch of nBlocks blocks with nTransactions is full.
+    virtual bool IsBatchFull(size_t nBlocks, size_t nTransactions) const = 0;
+    /**
+     * Add the blocks of vBlocks, which follow the best block, and make the
+     * last of them the best block. Returns false if stopped or on error.
+     */
+    virtual bool
+    WriteBlocks(const std::vector<const CBlockIndex *> &vBlocks) = 0;
+    /**
+     * Take the index back from the best block, which left the active chain,
+     * to pindexFork and make it the best block. Returns false if stopped or
+     * on error.
+     */
+    virtual bool Rewind(const CBlockIndex *pindexFork) = 0;
+
+    const Config &config;
+
+private:
+    void ThreadSync();
+    void ThreadDrop();
+    //! Erase all entries. Returns false if stopped or on error.
+    bool EraseAll();
+    //! Wait for a new tip. Returns false if stopped instead.
+    bool WaitForTip();
+
+    const bool fDrop;
+    const std::string strThreadName;
+    const std::string strName;
+    const std::string strFlag;
+
+    std::mutex cs;
+    std::condition_variable cond;
+    bool fNewTip;
+    bool fStop;
+    std::atomic<bool> fSynced;
+    std::atomic<const CBlockIndex *> pindexBest;
+
+    std::thread thread;
+};
+
+#endif // BITCOIN_BASEINDEX_H
@@ -0,0 +1,40 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "arith_uint256.h"
+
+static const arith_uint256 nTarget =
+    arith_uint256().SetCompact(0x1b0404cb);
+
+static void ArithMultiply(benchmark::State &state) {
+    arith_uint256 a = ~nTarget;
+    while (state.KeepRunning()) {
+        a *= nTarget;
+        a |= 1;
+    }
+}
+
+static void ArithDivide(benchmark::State &state) {
+    const arith_uint256 a = ~nTarget;
+    arith_uint256 b = nTarget;
+    while (state.KeepRunning()) {
+        b = (a / b) | 1;
+    }
+}
+
+// The work of a block, as GetBlockProof works it out.
+static void ArithBlockProof(benchmark::State &state) {
+    uint32_t nBits = 0x1b0404cb;
+    while (state.KeepRunning()) {
+        arith_uint256 bnTarget;
+        bnTarget.SetCompact(nBits++);
+        (~bnTarget / (bnTarget + 1)) + 1;
+    }
+}
+
+BENCHMARK(ArithMultiply);
+BENCHMARK(ArithDivide);
+BENCHMARK(ArithBlockProof);
@@ -5,8 +5,12 @@
 #include "bench.h"
 #include "perf.h"
 
+#include <univalue.h>
+
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <regex>
 #include <sys/time.h>
 
 benchmark::BenchRunner::BenchmarkMap &benchmark::BenchRunner::benchmarks() {
@@ -25,30 +29,139 @@ benchmark::BenchRunner::BenchRunner(std::string name,
     benchmarks().insert(std::make_pair(name, func));
 }
 
-void benchmark::BenchRunner::RunAll(double elapsedTimeForOne) {
+std::vector<std::string> benchmark::BenchRunner::Names() {
+    std::vector<std::string> names;
+    for (const auto &p : benchmarks()) {
+        names.push_back(p.first);
+    }
+    return names;
+}
+
+std::vector<benchmark::Result>
+benchmark::BenchRunner::RunAll(const Options &options) {
+    std::regex filter(options.filter);
+    Options runOptions = options;
     perf_init();
-    std::cout << "#Benchmark"
-              << ","
-              << "count"
-              << ","
-              << "min"
-              << ","
-              << "max"
-              << ","
-              << "average"
-              << ","
-              << "min_cycles"
-              << ","
-              << "max_cycles"
-              << ","
-              << "average_cycles"
-              << "\n";
+    if (runOptions.fPerfCounters && !perf_counters_init()) {
+        std::cerr << "Hardware performance counters are not available\n";
+        runOptions.fPerfCounters = false;
+    }
 
+    std::vector<Result> results;
     for (const auto &p : benchmarks()) {
-        State state(p.first, elapsedTimeForOne);
+        if (!std::regex_match(p.first, filter)) {
+            continue;
+        }
+        results.emplace_back();
+        State state(p.first, runOptions, results.back());
         p.second(state);
     }
+
+    if (runOptions.fPerfCounters) {
+        perf_counters_fini();
+    }
     perf_fini();
+    return results;
+}
+
+void benchmark::PrintCSV(const std::vector<Result> &results,
+                         std::ostream &os) {
+    os << "#Benchmark,count,min,max,average,min_cycles,max_cycles,"
+          "average_cycles,cycles,instructions,cache_misses\n";
+    for (const Result &result : results) {
+        os << std::fixed << std::setprecision(15) << result.name << ","
+           << result.count << "," << result.minTime << "," << result.maxTime
+           << "," << result.average << "," << result.minCycles << ","
+           << result.maxCycles << "," << result.averageCycles;
+        if (result.fCounters) {
+            os << std::setprecision(1) << "," << result.cycles << ","
+               << result.instructions << "," << result.cacheMisses;
+        } else {
+            os << ",,,";
+        }
+        os << "\n";
+    }
+}
+
+void benchmark::PrintJSON(const std::vector<Result> &results,
+                          std::ostream &os) {
+    UniValue benchmarks(UniValue::VARR);
+    for (const Result &result : results) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("name", result.name);
+        entry.pushKV("count", result.count);
+        entry.pushKV("min", result.minTime);
+        entry.pushKV("max", result.maxTime);
+        entry.pushKV("average", result.average);
+        entry.pushKV("min_cycles", result.minCycles);
+        entry.pushKV("max_cycles", result.maxCycles);
+        entry.pushKV("average_cycles", result.averageCycles);
+        if (result.fCounters) {
+            entry.pushKV("cycles", result.cycles);
+            entry.pushKV("instructions", result.instructions);
+            entry.pushKV("cache_misses", result.cacheMisses);
+        }
+        benchmarks.push_back(entry);
+    }
+    os << benchmarks.write(2) << "\n";
+}
+
+bool benchmark::ReadJSON(std::istream &is, std::vector<Result> &results) {
+    std::string str((std::istreambuf_iterator<char>(is)),
+                    std::istreambuf_iterator<char>());
+    UniValue benchmarks;
+    if (!benchmarks.read(str) || !benchmarks.isArray()) {
+        return false;
+    }
+    for (size_t i = 0; i < benchmarks.size(); i++) {
+        const UniValue &entry = benchmarks[i];
+        if (!entry.isObject() || !entry["name"].isStr() ||
+            !entry["average"].isNum()) {
+            return false;
+        }
+        Result result;
+        result.name = entry["name"].get_str();
+        result.average = entry["average"].get_real();
+        if (entry["count"].isNum()) {
+            result.count = entry["count"].get_int64();
+        }
+        if (entry["instructions"].isNum()) {
+            result.fCounters = true;
+            result.instructions = entry["instructions"].get_real();
+        }
+        results.push_back(result);
+    }
+    return true;
+}
+
+int benchmark::CompareResults(const std::vector<Result> &baseline,
+                              const std::vector<Result> &results,
+                              double threshold, std::ostream &os) {
+    std::map<std::string, const Result *> mapBaseline;
+    for (const Result &result : baseline) {
+        mapBaseline[result.name] = &result;
+    }
+
+    int nRegressions = 0;
+    os << "#Benchmark,baseline,average,change\n";
+    for (const Result &result : results) {
+        auto it = mapBaseline.find(result.name);
+        if (it == mapBaseline.end() || it->second->average <= 0) {
+            os << result.name << ",,," << "new\n";
+            continue;
+        }
+        double change = result.average / it->second->average - 1;
+        os << std::fixed << std::setprecision(15) << result.name << ","
+           << it->second->average << "," << result.average << ","
+           << std::setprecision(1) << std::showpos << change * 100 << "%"
+           << std::noshowpos;
+        if (change > threshold) {
+            os << ",REGRESSION";
+            nRegressions++;
+        }
+        os << "\n";
+    }
+    return nRegressions;
 }
 
 bool benchmark::State::KeepRunning() {
@@ -61,6 +174,12 @@ bool benchmark::State::KeepRunning() {
     if (count == 0) {
         lastTime = beginTime = now = gettimedouble();
         lastCycles = beginCycles = nowCycles = perf_cpucycles();
+        perf_counters counters;
+        if (fPerfCounters && perf_counters_read(&counters)) {
+            beginCounters[0] = counters.cycles;
+            beginCounters[1] = counters.instructions;
+            beginCounters[2] = counters.cache_misses;
+        }
     } else {
         now = gettimedouble();
         double elapsed = now - lastTime;
@@ -75,7 +194,11 @@ bool benchmark::State::KeepRunning() {
         if (elapsedOneCycles < minCycles) minCycles = elapsedOneCycles;
         if (elapsedOneCycles > maxCycles) maxCycles = elapsedOneCycles;
 
-        if (elapsed * 128 < maxElapsed) {
+        // With an iteration limit, the count mask must stay below it for the
+        // limit to be checked.
+        bool fGrow =
+            maxIterations == 0 || (countMask + 1) * 8 <= maxIterations;
+        if (elapsed * 128 < maxElapsed && fGrow) {
             // If the execution was much too fast (1/128th of maxElapsed),
             // increase the count mask by 8x and restart timing.
             // The restart avoids including the overhead of this code in the
@@ -89,7 +212,7 @@ bool benchmark::State::KeepRunning() {
             maxCycles = std::numeric_limits<uint64_t>::min();
             return true;
         }
-        if (elapsed * 16 < maxElapsed) {
+        if (elapsed * 16 < maxElapsed && fGrow) {
             uint64_t newCountMask = ((countMask << 1) | 1) & ((1LL << 60) - 1);
             if ((count & newCountMask) == 0) {
                 countMask = newCountMask;
@@ -101,16 +224,31 @@ bool benchmark::State::KeepRunning() {
     lastCycles = nowCycles;
     ++count;
 
-    if (now - beginTime < maxElapsed) return true; // Keep going
+    if (now - beginTime < maxElapsed &&
+        (maxIterations == 0 || count <= maxIterations)) {
+        // Keep going
+        return true;
+    }
 
     --count;
 
-    // Output results
-    double average = (now - beginTime) / count;
-    int64_t averageCycles = (nowCycles - beginCycles) / count;
-    std::cout << std::fixed << std::setprecision(15) << name << "," << count
-              << "," << minTime << "," << maxTime << "," << average << ","
-              << minCycles << "," << maxCycles << "," << averageCycles << "\n";
+    result.name = name;
+    result.count = count;
+    result.minTime = minTime;
+    result.maxTime = maxTime;
+    result.average = (now - beginTime) / count;
+    result.minCycles = minCycles;
+    result.maxCycles = maxCycles;
+    result.averageCycles = (nowCycles - beginCycles) / count;
+    perf_counters counters;
+    if (fPerfCounters && perf_counters_read(&counters)) {
+        result.fCounters = true;
+        result.cycles = double(counters.cycles - beginCounters[0]) / count;
+        result.instructions =
+            double(counters.instructions - beginCounters[1]) / count;
+        result.cacheMisses =
+            double(counters.cache_misses - beginCounters[2]) / count;
+    }
 
     return false;
 }
@@ -5,10 +5,13 @@
 #ifndef BITCOIN_BENCH_BENCH_H
 #define BITCOIN_BENCH_BENCH_H
 
+#include <cstdint>
 #include <functional>
+#include <iostream>
 #include <limits>
 #include <map>
 #include <string>
+#include <vector>
 
 #include <boost/preprocessor/cat.hpp>
 #include <boost/preprocessor/stringize.hpp>
@@ -37,9 +40,34 @@ BENCHMARK(CODE_TO_TIME);
 
 namespace benchmark {
 
+/** What a benchmark measured, times are in seconds per iteration */
+struct Result {
+    std::string name;
+    uint64_t count = 0;
+    double minTime = 0, maxTime = 0, average = 0;
+    uint64_t minCycles = 0, maxCycles = 0, averageCycles = 0;
+    //! Hardware counters per iteration, if they could be read
+    bool fCounters = false;
+    double cycles = 0, instructions = 0, cacheMisses = 0;
+};
+
+struct Options {
+    //! Regular expression the names of the benchmarks to run must match
+    std::string filter = ".*";
+    //! Seconds spent running each benchmark
+    double elapsed = 1.0;
+    //! Iterations after which a benchmark stops early, 0 for no limit
+    uint64_t maxIterations = 0;
+    //! Whether to read the hardware counters, see perf_counters_read
+    bool fPerfCounters = false;
+};
+
 class State {
     std::string name;
     double maxElapsed;
+    uint64_t maxIterations;
+    bool fPerfCounters;
+    Result &result;
     double beginTime;
     double lastTime, minTime, maxTime, countMaskInv;
     uint64_t count;
@@ -48,10 +76,13 @@ class State {
     uint64_t lastCycles;
     uint64_t minCycles;
     uint64_t maxCycles;
+    uint64_t beginCounters[3];
 
 public:
-    State(std::string _name, double _maxElapsed)
-        : name(_name), maxElapsed(_maxElapsed), count(0) {
+    State(std::string _name, const Options &options, Result &_result)
+        : name(_name), maxElapsed(options.elapsed),
+          maxIterations(options.maxIterations),
+          fPerfCounters(options.fPerfCounters), result(_result), count(0) {
         minTime = std::numeric_limits<double>::max();
         maxTime = std::numeric_limits<double>::min();
         minCycles = std::numeric_limits<uint64_t>::max();
@@ -71,8 +102,22 @@ class BenchRunner {
 public:
     BenchRunner(std::string name, BenchFunction func);
 
-    static void RunAll(double elapsedTimeForOne = 1.0);
+    static std::vector<std::string> Names();
+    static std::vector<Result> RunAll(const Options &options);
 };
+
+void PrintCSV(const std::vector<Result> &results, std::ostream &os);
+void PrintJSON(const std::vector<Result> &results, std::ostream &os);
+/** Read results written by PrintJSON, false if they are malformed */
+bool ReadJSON(std::istream &is, std::vector<Result> &results);
+
+/**
+ * Print how the average time of each benchmark changed from baseline, and
+ * return how many got slower by more than threshold (0.1 for 10%).
+ */
+int CompareResults(const std::vector<Result> &baseline,
+                   const std::vector<Result> &results, double threshold,
+                   std::ostream &os);
 }
 
 // BENCHMARK(foo) expands to:  benchmark::BenchRunner bench_11foo("foo", foo);
@@ -4,16 +4,133 @@
 
 #include "bench.h"
 
+#include "crypto/sha256.h"
 #include "key.h"
 #include "util.h"
 #include "validation.h"
 
+#include <fstream>
+#include <regex>
+
+static const char *DEFAULT_BENCH_FILTER = ".*";
+static const char *DEFAULT_BENCH_PRINTER = "csv";
+static const double DEFAULT_BENCH_TIME = 1.0;
+static const double DEFAULT_BENCH_THRESHOLD = 10.0;
+
+static void PrintUsage() {
+    std::string strUsage = HelpMessageGroup("Options:");
+    strUsage += HelpMessageOpt("-?", "This help message");
+    strUsage += HelpMessageOpt("-list", "List the benchmarks and exit");
+    strUsage += HelpMessageOpt(
+        "-filter=<regex>",
+        strprintf("Only run the benchmarks whose name matches (default: %s)",
+                  DEFAULT_BENCH_FILTER));
+    strUsage += HelpMessageOpt(
+        "-time=<n>", strprintf("Seconds to run each benchmark for (default: "
+                               "%.1f)",
+                               DEFAULT_BENCH_TIME));
+    strUsage += HelpMessageOpt(
+        "-iterations=<n>",
+        "Stop each benchmark after about <n> iterations (default: no limit)");
+    strUsage += HelpMessageOpt(
+        "-perfcounters", "Also report the cycles, instructions and cache "
+                         "misses per iteration, from the Linux "
+                         "perf_event_open hardware counters");
+    strUsage += HelpMessageOpt("-printer=<csv|json>",
+                               strprintf("Format of the results (default: %s)",
+                                         DEFAULT_BENCH_PRINTER));
+    strUsage += HelpMessageOpt(
+        "-output=<file>", "Write the results to <file> instead of stdout");
+    strUsage += HelpMessageOpt(
+        "-compare=<file>", "Compare the average times with the JSON results "
+                           "in <file>, and fail if any regressed");
+    strUsage += HelpMessageOpt(
+        "-threshold=<n>",
+        strprintf("Percentage by which an average time must grow to be a "
+                  "regression (default: %.1f)",
+                  DEFAULT_BENCH_THRESHOLD));
+    fprintf(stdout, "%s", strUsage.c_str());
+}
+
 int main(int argc, char **argv) {
+    ParseParameters(argc, argv);
+    if (IsArgSet("-?") || IsArgSet("-h") || IsArgSet("-help")) {
+        PrintUsage();
+        return 0;
+    }
+    if (IsArgSet("-list")) {
+        for (const std::string &name : benchmark::BenchRunner::Names()) {
+            fprintf(stdout, "%s\n", name.c_str());
+        }
+        return 0;
+    }
+
+    benchmark::Options options;
+    options.filter = GetArg("-filter", DEFAULT_BENCH_FILTER);
+    options.elapsed = IsArgSet("-time") ? atof(GetArg("-time", "").c_str())
+                                        : DEFAULT_BENCH_TIME;
+    options.maxIterations = std::max<int64_t>(GetArg("-iterations", 0), 0);
+    options.fPerfCounters = GetBoolArg("-perfcounters", false);
+    std::string strPrinter = GetArg("-printer", DEFAULT_BENCH_PRINTER);
+    if (strPrinter != "csv" && strPrinter != "json") {
+        fprintf(stderr, "Error: unknown printer %s\n", strPrinter.c_str());
+        return 1;
+    }
+    try {
+        std::regex filter(options.filter);
+    } catch (const std::regex_error &e) {
+        fprintf(stderr, "Error: invalid filter %s: %s\n",
+                options.filter.c_str(), e.what());
+        return 1;
+    }
+
+    std::vector<benchmark::Result> baseline;
+    if (IsArgSet("-compare")) {
+        std::ifstream file(GetArg("-compare", ""));
+        if (!file.is_open() || !benchmark::ReadJSON(file, baseline)) {
+            fprintf(stderr, "Error: cannot read the baseline results in %s\n",
+                    GetArg("-compare", "").c_str());
+            return 1;
+        }
+    }
+
+    SHA256SelectImplementation();
     ECC_Start();
     SetupEnvironment();
     fPrintToDebugLog = false; // don't want to write to debug.log file
 
-    benchmark::BenchRunner::RunAll();
+    std::vector<benchmark::Result> results =
+        benchmark::BenchRunner::RunAll(options);
 
     ECC_Stop();
+
+    std::ofstream file;
+    if (IsArgSet("-output")) {
+        file.open(GetArg("-output", ""));
+        if (!file.is_open()) {
+            fprintf(stderr, "Error: cannot write to %s\n",
+                    GetArg("-output", "").c_str());
+            return 1;
+        }
+    }
+    std::ostream &os = file.is_open() ? file : std::cout;
+    if (strPrinter == "json") {
+        benchmark::PrintJSON(results, os);
+    } else {
+        benchmark::PrintCSV(results, os);
+    }
+
+    if (IsArgSet("-compare")) {
+        double threshold =
+            IsArgSet("-threshold") ? atof(GetArg("-threshold", "").c_str())
+                                   : DEFAULT_BENCH_THRESHOLD;
+        int nRegressions = benchmark::CompareResults(
+            baseline, results, threshold / 100, std::cerr);
+        if (nRegressions > 0) {
+            fprintf(stderr, "%d benchmark(s) regressed by more than %.1f%%\n",
+                    nRegressions, threshold);
+            return 1;
+        }
+    }
+    return 0;
 }
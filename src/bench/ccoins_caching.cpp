@@ -4,9 +4,11 @@
 
 #include "bench.h"
 #include "coins.h"
+#include "crypto/common.h"
 #include "policy/policy.h"
 #include "wallet/crypter.h"
 
+#include <cassert>
 #include <vector>
 
 // FIXME: Dedup with SetupDummyInputs in test/transaction_tests.cpp.
@@ -89,4 +91,44 @@ static void CCoinsCaching(benchmark::State &state) {
     }
 }
 
+
+// Fill a coins map as the chainstate cache does while connecting blocks, look
+// every coin up and spend half of them, with the map's nodes from a pool or
+// from one heap allocation each.
+static void FillCoinsMap(benchmark::State &state, bool fPool) {
+    std::vector<COutPoint> vOutPoints;
+    for (uint32_t i = 0; i < 10000; i++) {
+        uint256 txid;
+        WriteLE32(txid.begin(), i);
+        vOutPoints.emplace_back(txid, i % 4);
+    }
+
+    CCoinsMapMemoryResource resource;
+    while (state.KeepRunning()) {
+        CCoinsMap map(0, SaltedOutpointHasher(), CCoinsMap::key_equal(),
+                      fPool ? CCoinsMapAllocator(&resource)
+                            : CCoinsMapAllocator());
+        for (const COutPoint &outpoint : vOutPoints) {
+            map.emplace(outpoint, CCoinsCacheEntry());
+        }
+        for (size_t i = 0; i < vOutPoints.size(); i++) {
+            CCoinsMap::iterator it = map.find(vOutPoints[i]);
+            assert(it != map.end());
+            if (i % 2) {
+                map.erase(it);
+            }
+        }
+    }
+}
+
+static void CCoinsMapPool(benchmark::State &state) {
+    FillCoinsMap(state, true);
+}
+
+static void CCoinsMapNoPool(benchmark::State &state) {
+    FillCoinsMap(state, false);
+}
+
 BENCHMARK(CCoinsCaching);
+BENCHMARK(CCoinsMapPool);
+BENCHMARK(CCoinsMapNoPool);
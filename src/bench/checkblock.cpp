@@ -5,12 +5,64 @@
 #include "bench.h"
 
 #include "config.h"
+#include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
+#include "random.h"
 #include "streams.h"
 #include "validation.h"
 
-namespace block_bench {
-#include "bench/data/block413567.raw.h"
+// Roughly 1.5MB worth of two-in two-out P2PKH spends.
+static const int BLOCK_TX_COUNT = 4000;
+
+/**
+ * Build a block shaped like a full Platopia block. Proof of work is not
+ * solved, so CheckBlock must be called with fCheckPOW = false.
+ */
+static CBlock MakeBlock() {
+    FastRandomContext insecure_rand(true);
+    auto randHash = [&insecure_rand]() {
+        uint256 hash;
+        for (int i = 0; i < 8; i++) {
+            WriteLE32(hash.begin() + 4 * i, insecure_rand.rand32());
+        }
+        return hash;
+    };
+
+    CBlock block;
+    block.nBits = 0x1d00ffff;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << 0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+
+    for (int i = 1; i < BLOCK_TX_COUNT; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(2);
+        for (auto &txin : mtx.vin) {
+            txin.prevout = COutPoint(randHash(), insecure_rand.rand32() % 4);
+            txin.scriptSig = CScript() << std::vector<uint8_t>(72, 0x30)
+                                       << std::vector<uint8_t>(33, 0x02);
+        }
+        mtx.vout.resize(2);
+        for (auto &txout : mtx.vout) {
+            uint256 keyHash = randHash();
+            txout.nValue = COIN;
+            txout.scriptPubKey =
+                CScript() << OP_DUP << OP_HASH160
+                          << std::vector<uint8_t>(keyHash.begin(),
+                                                  keyHash.begin() + 20)
+                          << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
 }
 
 // These are the two major time-sinks which happen after we have fully received
@@ -18,25 +70,23 @@ namespace block_bench {
 // compact block relay.
 
 static void DeserializeBlockTest(benchmark::State &state) {
-    CDataStream stream((const char *)block_bench::block413567,
-                       (const char *)&block_bench::block413567[sizeof(
-                           block_bench::block413567)],
-                       SER_NETWORK, PROTOCOL_VERSION);
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << MakeBlock();
+    size_t nSize = stream.size();
     char a;
     stream.write(&a, 1); // Prevent compaction
 
     while (state.KeepRunning()) {
         CBlock block;
         stream >> block;
-        assert(stream.Rewind(sizeof(block_bench::block413567)));
+        assert(stream.Rewind(nSize));
     }
 }
 
 static void DeserializeAndCheckBlockTest(benchmark::State &state) {
-    CDataStream stream((const char *)block_bench::block413567,
-                       (const char *)&block_bench::block413567[sizeof(
-                           block_bench::block413567)],
-                       SER_NETWORK, PROTOCOL_VERSION);
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << MakeBlock();
+    size_t nSize = stream.size();
     char a;
     stream.write(&a, 1); // Prevent compaction
 
@@ -46,12 +96,21 @@ static void DeserializeAndCheckBlockTest(benchmark::State &state) {
         // here.
         CBlock block;
         stream >> block;
-        assert(stream.Rewind(sizeof(block_bench::block413567)));
+        assert(stream.Rewind(nSize));
 
         CValidationState validationState;
-        assert(CheckBlock(config, block, validationState));
+        assert(CheckBlock(config, block, validationState, false));
+    }
+}
+
+static void BlockMerkleRootTest(benchmark::State &state) {
+    const CBlock block = MakeBlock();
+    while (state.KeepRunning()) {
+        bool mutated;
+        BlockMerkleRoot(block, &mutated);
     }
 }
 
-//BENCHMARK(DeserializeBlockTest);
-//BENCHMARK(DeserializeAndCheckBlockTest);
+BENCHMARK(DeserializeBlockTest);
+BENCHMARK(DeserializeAndCheckBlockTest);
+BENCHMARK(BlockMerkleRootTest);
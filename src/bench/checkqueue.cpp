@@ -4,8 +4,10 @@
 
 #include "checkqueue.h"
 #include "bench.h"
+#include "hash.h"
 #include "prevector.h"
 #include "random.h"
+#include "script/script.h"
 #include "util.h"
 #include "validation.h"
 
@@ -18,7 +20,8 @@
 static const int MIN_CORES = 2;
 static const size_t BATCHES = 101;
 static const size_t BATCH_SIZE = 30;
-static const int PREVECTOR_SIZE = 28;
+// As large as a CScript, so the prevectors spill as scripts do.
+static const int PREVECTOR_SIZE = SCRIPT_INLINE_SIZE;
 static const int QUEUE_BATCH_SIZE = 128;
 static void CCheckQueueSpeed(benchmark::State &state) {
     struct FakeJobNoWork {
@@ -90,5 +93,66 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State &state) {
     tg.interrupt_all();
     tg.join_all();
 }
+
+// This Benchmark compares the queues at fixed thread counts, with checks that
+// do a little work and are added a transaction's worth at a time, as in
+// ConnectBlock.
+static const size_t SCALING_BATCHES = 1000;
+static const size_t SCALING_BATCH_SIZE = 4;
+struct HashJob {
+    uint256 hash;
+    bool operator()() {
+        for (int i = 0; i < 16; i++) {
+            hash = Hash(hash.begin(), hash.end());
+        }
+        return true;
+    }
+    void swap(HashJob &x) { std::swap(hash, x.hash); };
+};
+
+template <typename Queue>
+static void CheckQueueScaling(benchmark::State &state, Queue &queue,
+                              int nThreads) {
+    boost::thread_group tg;
+    // The master is the last thread.
+    for (auto x = 0; x < nThreads - 1; ++x) {
+        tg.create_thread([&] { queue.Thread(); });
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<HashJob, Queue> control(&queue);
+        for (size_t i = 0; i < SCALING_BATCHES; i++) {
+            std::vector<HashJob> vChecks(SCALING_BATCH_SIZE);
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void CCheckQueueScaling(benchmark::State &state, int nThreads) {
+    CCheckQueue<HashJob> queue{QUEUE_BATCH_SIZE};
+    CheckQueueScaling(state, queue, nThreads);
+}
+
+static void WorkStealingScaling(benchmark::State &state, int nThreads) {
+    CWorkStealingCheckQueue<HashJob> queue{QUEUE_BATCH_SIZE, 64};
+    CheckQueueScaling(state, queue, nThreads);
+}
+
+#define CHECKQUEUE_SCALING(n)                                                  \
+    static void CCheckQueueScaling##n(benchmark::State &state) {              \
+        CCheckQueueScaling(state, n);                                          \
+    }                                                                          \
+    static void CWorkStealingCheckQueueScaling##n(benchmark::State &state) {  \
+        WorkStealingScaling(state, n);                                         \
+    }                                                                          \
+    BENCHMARK(CCheckQueueScaling##n);                                          \
+    BENCHMARK(CWorkStealingCheckQueueScaling##n);
+
 BENCHMARK(CCheckQueueSpeed);
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
+CHECKQUEUE_SCALING(4);
+CHECKQUEUE_SCALING(16);
+CHECKQUEUE_SCALING(32);
+CHECKQUEUE_SCALING(64);
@@ -59,4 +59,87 @@ static void CoinSelection(benchmark::State &state) {
     }
 }
 
+// The same with coins of many sizes, as a wallet that is used for long
+// collects them.
+static void CoinSelectionLargeWallet(benchmark::State &state) {
+    const CWallet wallet;
+    std::vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+
+    for (int i = 0; i < 10000; i++) {
+        addCoin((1 + i % 1000) * COIN / 10, wallet, vCoins);
+    }
+
+    while (state.KeepRunning()) {
+        std::set<std::pair<const CWalletTx *, unsigned int>> setCoinsRet;
+        CAmount nValueRet;
+        bool success = wallet.SelectCoinsMinConf(5000 * COIN, 1, 6, 0, vCoins,
+                                                 setCoinsRet, nValueRet);
+        assert(success);
+        assert(nValueRet >= 5000 * COIN);
+    }
+
+    for (COutput output : vCoins) {
+        delete output.tx;
+    }
+}
+
+// Finding the coins of a wallet with a long history, most of whose outputs
+// were spent long ago: a chain of transactions each spending the one before,
+// every 100th also paying to an output that stays unspent. None is in a block
+// or the mempool, so no coin is available, the cost is in finding the
+// candidates.
+static void AvailableCoinsLargeWallet(benchmark::State &state) {
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+    const CScript script = CScript() << OP_TRUE;
+    wallet.AddWatchOnly(script, 0);
+
+    uint256 hashPrev;
+    for (int i = 0; i < 100000; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(hashPrev, 0);
+        tx.vout.push_back(CTxOut(COIN, script));
+        if (i % 100 == 0) {
+            tx.vout.push_back(CTxOut(COIN, script));
+        }
+        CWalletTx wtx(&wallet, MakeTransactionRef(std::move(tx)));
+        hashPrev = wtx.GetId();
+        wallet.LoadToWallet(wtx);
+    }
+
+    while (state.KeepRunning()) {
+        std::vector<COutput> vCoins;
+        wallet.AvailableCoins(vCoins, false, nullptr, false, true);
+        assert(vCoins.empty());
+    }
+}
+
+// Branch and bound over the same coins, for a payment they can make without
+// change.
+static void CoinSelectionBnB(benchmark::State &state) {
+    std::vector<CBnBCoin> vCoins;
+    for (int i = 0; i < 10000; i++) {
+        CBnBCoin coin;
+        coin.coin = std::make_pair(nullptr, (unsigned int)i);
+        coin.nValue = (1 + i % 1000) * COIN / 10;
+        coin.nEffectiveValue = coin.nValue - COIN / 10;
+        coin.nWaste = 100;
+        vCoins.push_back(coin);
+    }
+
+    while (state.KeepRunning()) {
+        std::set<std::pair<const CWalletTx *, unsigned int>> setCoinsRet;
+        CAmount nValueRet;
+        bool success = SelectCoinsBnB(vCoins, 5000 * COIN, 10000, setCoinsRet,
+                                      nValueRet);
+        assert(success);
+        assert(nValueRet >= 5000 * COIN);
+    }
+}
+
 BENCHMARK(CoinSelection);
+BENCHMARK(CoinSelectionLargeWallet);
+BENCHMARK(CoinSelectionBnB);
+BENCHMARK(AvailableCoinsLargeWallet);
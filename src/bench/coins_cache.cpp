@@ -0,0 +1,242 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "crypto/common.h"
+#include "pubkey.h"
+#include "random.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <vector>
+
+// Coins in the cache of the in-memory benchmarks, and in the database of the
+// LevelDB-backed ones.
+static const uint32_t CACHE_COINS = 2000000;
+static const uint32_t DB_COINS = 1000000;
+// Lookups per iteration, and coins spent and created per block.
+static const int LOOKUPS = 1000;
+static const int BLOCK_SPENDS = 2000;
+// Coins spent and created between two flushes to the database.
+static const int FLUSH_SPENDS = 50000;
+
+/**
+ * The outpoint of the nth coin created. Transactions have up to four outputs,
+ * and every txid differs in its first bytes, like hashes.
+ */
+static COutPoint BenchOutPoint(uint32_t n) {
+    uint256 txid;
+    WriteLE32(txid.begin(), n / 4 * 2654435761U);
+    WriteLE32(txid.begin() + 4, n / 4);
+    return COutPoint(txid, n % 4);
+}
+
+/**
+ * The nth coin created. One in ten came with content, which coins don't keep,
+ * and one in ten is an interest earning deposit. The others pay to a P2PKH.
+ */
+static Coin BenchCoin(uint32_t n) {
+    uint160 hash;
+    WriteLE32(hash.begin(), n);
+    CScript script = GetScriptForDestination(CKeyID(hash));
+    CAmount nValue = 1000 + n % 100000;
+    uint32_t nHeight = n / 2000;
+    switch (n % 10) {
+        case 0:
+            return Coin(CTxOut(nValue, script, std::string(200, 'c')),
+                        nHeight, false);
+        case 1:
+            return Coin(CTxOut(nValue, script, "", nHeight + 1000, nValue),
+                        nHeight, false);
+        default:
+            return Coin(CTxOut(nValue, script), nHeight, n % 100 == 2);
+    }
+}
+
+/**
+ * Picks coins by age, the newest more often, with a Zipfian distribution: the
+ * coin of age k is picked with a probability proportional to 1 / (k + 1).
+ * Most coins are spent soon after they are created, and a few are spent
+ * after years.
+ */
+class ZipfByAge {
+public:
+    explicit ZipfByAge(uint32_t nMaxAge) : rng(true) {
+        vCumulative.reserve(nMaxAge);
+        double dSum = 0;
+        for (uint32_t k = 0; k < nMaxAge; k++) {
+            dSum += 1.0 / (k + 1);
+            vCumulative.push_back(dSum);
+        }
+    }
+
+    //! The index of a coin among the nCreated created so far
+    uint32_t Pick(uint32_t nCreated) {
+        double u = (rng.rand64() >> 11) / 9007199254740992.0;
+        uint32_t nAge = std::lower_bound(vCumulative.begin(),
+                                         vCumulative.end(),
+                                         u * vCumulative.back()) -
+                        vCumulative.begin();
+        return nCreated - 1 - std::min(nAge, nCreated - 1);
+    }
+
+private:
+    FastRandomContext rng;
+    std::vector<double> vCumulative;
+};
+
+//! Add the coins from nBegin to nEnd, not included
+static void FillCache(CCoinsViewCache &cache, uint32_t nBegin, uint32_t nEnd) {
+    for (uint32_t n = nBegin; n < nEnd; n++) {
+        cache.AddCoin(BenchOutPoint(n), BenchCoin(n), false);
+    }
+}
+
+/**
+ * Spend nSpends unspent coins picked by age and create as many, in cache.
+ * vSpent has whether each coin created so far is spent.
+ */
+static void SpendAndCreate(CCoinsViewCache &cache, ZipfByAge &zipf,
+                           std::vector<bool> &vSpent, int nSpends) {
+    for (int i = 0; i < nSpends; i++) {
+        uint32_t n;
+        do {
+            n = zipf.Pick(vSpent.size());
+        } while (vSpent[n]);
+        bool fSpent = cache.SpendCoin(BenchOutPoint(n));
+        assert(fSpent);
+        vSpent[n] = true;
+    }
+    for (int i = 0; i < nSpends; i++) {
+        uint32_t n = vSpent.size();
+        cache.AddCoin(BenchOutPoint(n), BenchCoin(n), false);
+        vSpent.push_back(false);
+    }
+}
+
+// Look coins up in a cache holding millions.
+static void CoinsCacheFetch(benchmark::State &state) {
+    CCoinsView viewDummy;
+    CCoinsViewCache cache(&viewDummy);
+    FillCache(cache, 0, CACHE_COINS);
+    ZipfByAge zipf(CACHE_COINS);
+
+    while (state.KeepRunning()) {
+        for (int i = 0; i < LOOKUPS; i++) {
+            const Coin &coin =
+                cache.AccessCoin(BenchOutPoint(zipf.Pick(CACHE_COINS)));
+            assert(!coin.IsSpent());
+        }
+    }
+}
+
+// The same through a short-lived cache on top, as a block or a transaction
+// being validated sees the chainstate: every first lookup of a coin misses
+// and copies it from the layer below.
+static void CoinsCacheNestedFetch(benchmark::State &state) {
+    CCoinsView viewDummy;
+    CCoinsViewCache cache(&viewDummy);
+    FillCache(cache, 0, CACHE_COINS);
+    ZipfByAge zipf(CACHE_COINS);
+
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&cache);
+        for (int i = 0; i < LOOKUPS; i++) {
+            const Coin &coin =
+                view.AccessCoin(BenchOutPoint(zipf.Pick(CACHE_COINS)));
+            assert(!coin.IsSpent());
+        }
+    }
+}
+
+// Connect blocks: spend and create coins in a cache on top of the chainstate
+// cache, then write them down to it with BatchWrite.
+static void CoinsCacheConnect(benchmark::State &state) {
+    CCoinsView viewDummy;
+    CCoinsViewCache cache(&viewDummy);
+    FillCache(cache, 0, CACHE_COINS);
+    ZipfByAge zipf(CACHE_COINS);
+    std::vector<bool> vSpent(CACHE_COINS, false);
+
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&cache);
+        SpendAndCreate(view, zipf, vSpent, BLOCK_SPENDS);
+        bool fFlushed = view.Flush();
+        assert(fFlushed);
+    }
+}
+
+/** A coins database in memory, holding DB_COINS coins */
+class BenchCoinsDB {
+public:
+    BenchCoinsDB() {
+        pathData = boost::filesystem::temp_directory_path() /
+                   boost::filesystem::unique_path("bench_bitcoin_%%%%%%%%");
+        boost::filesystem::create_directories(pathData);
+        ForceSetArg("-datadir", pathData.string());
+        ClearDatadirCache();
+        db.reset(new CCoinsViewDB(1 << 23, true));
+
+        // Written in batches, as flushes would.
+        for (uint32_t nStart = 0; nStart < DB_COINS; nStart += 100000) {
+            CCoinsViewCache cache(db.get());
+            FillCache(cache, nStart, std::min(nStart + 100000, DB_COINS));
+            bool fFlushed = cache.Flush();
+            assert(fFlushed);
+        }
+    }
+
+    ~BenchCoinsDB() {
+        db.reset();
+        boost::filesystem::remove_all(pathData);
+    }
+
+    std::unique_ptr<CCoinsViewDB> db;
+
+private:
+    boost::filesystem::path pathData;
+};
+
+// Look coins up from a cold cache, so that they are read from LevelDB.
+static void CoinsCacheFetchDB(benchmark::State &state) {
+    BenchCoinsDB coinsdb;
+    ZipfByAge zipf(DB_COINS);
+
+    while (state.KeepRunning()) {
+        CCoinsViewCache cache(coinsdb.db.get());
+        for (int i = 0; i < LOOKUPS; i++) {
+            const Coin &coin =
+                cache.AccessCoin(BenchOutPoint(zipf.Pick(DB_COINS)));
+            assert(!coin.IsSpent());
+        }
+    }
+}
+
+// Spend coins read from LevelDB, create as many, and write both back.
+static void CoinsCacheFlushDB(benchmark::State &state) {
+    BenchCoinsDB coinsdb;
+    ZipfByAge zipf(DB_COINS);
+    std::vector<bool> vSpent(DB_COINS, false);
+
+    while (state.KeepRunning()) {
+        CCoinsViewCache cache(coinsdb.db.get());
+        SpendAndCreate(cache, zipf, vSpent, FLUSH_SPENDS);
+        bool fFlushed = cache.Flush();
+        assert(fFlushed);
+    }
+}
+
+BENCHMARK(CoinsCacheFetch);
+BENCHMARK(CoinsCacheNestedFetch);
+BENCHMARK(CoinsCacheConnect);
+BENCHMARK(CoinsCacheFetchDB);
+BENCHMARK(CoinsCacheFlushDB);
@@ -0,0 +1,398 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "config.h"
+#include "consensus/consensus.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "keystore.h"
+#include "pow.h"
+#include "script/scriptcache.h"
+#include "script/sigcache.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "util.h"
+#include "validation.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#include <cassert>
+
+// Coinbases split by the fan-out block, each into FANOUT_OUTPUTS coins that
+// the payload blocks spend two at a time.
+static const int FANOUT_COINBASES = 40;
+static const int FANOUT_OUTPUTS = 50;
+static const CAmount PAYLOAD_FEE = 10000;
+// Script check threads besides the one connecting the block.
+static const int SCRIPT_CHECK_WORKERS = 3;
+
+/**
+ * A regtest chain built the same way on every run: keys, block times and
+ * signatures (RFC6979) are all deterministic.
+ *
+ * Mature coinbases are split by a fan-out block into P2PKH and bare 2-of-3
+ * multisig coins. Two sibling payload blocks on top of it spend all of them,
+ * into P2PKH, multisig, content and interest earning deposit outputs.
+ */
+class BenchChain {
+public:
+    BenchChain();
+    ~BenchChain();
+
+    const Config &config;
+    CBlockIndex *pindexFanout;
+    std::shared_ptr<const CBlock> payload[2];
+
+    //! Make the fan-out block the tip, with the payload blocks unconnected
+    void DisconnectPayload();
+    //! Connect payload[n], disconnecting the other one if needed
+    void ConnectPayload(int n);
+
+private:
+    boost::filesystem::path pathData;
+    boost::thread_group threadGroup;
+    CCoinsViewDB *pcoinsdbview;
+
+    CBasicKeyStore keystore;
+    CScript scriptP2PKH;
+    CScript scriptMultisig;
+    uint32_t nTime;
+
+    CBlock MakeBlock(std::vector<CMutableTransaction> &&txs);
+    void ProcessBlock(const CBlock &block);
+    CBlock MakePayload(const CBlock &fanout, int nVariant);
+};
+
+BenchChain::BenchChain() : config(GetConfig()) {
+    SelectParams(CBaseChainParams::REGTEST);
+    // Blocks are mined against the quick check only, and verified without
+    // the signature and script caches, as for a block not seen in mempool.
+    fFullPowCheck = false;
+    ForceSetArg("-maxsigcachesize", "0");
+    ForceSetArg("-maxscriptcachesize", "0");
+    InitSignatureCache();
+    InitScriptExecutionCache();
+    InitProofOfWorkCache();
+
+    pathData = boost::filesystem::temp_directory_path() /
+               boost::filesystem::unique_path("bench_bitcoin_%%%%%%%%");
+    boost::filesystem::create_directories(pathData);
+    ForceSetArg("-datadir", pathData.string());
+    ClearDatadirCache();
+    pblocktree = new CBlockTreeDB(1 << 20, true);
+    pcoinsdbview = new CCoinsViewDB(1 << 23, true);
+    pcoinsWriter = new CCoinsViewAsyncWrite(pcoinsdbview);
+    pcoinsTip = new CCoinsViewCache(pcoinsWriter);
+    InitBlockIndex(config);
+    {
+        CValidationState state;
+        bool fActivated = ActivateBestChain(config, state);
+        assert(fActivated);
+    }
+    for (int i = 0; i < SCRIPT_CHECK_WORKERS; i++) {
+        threadGroup.create_thread(&ThreadScriptCheck);
+        threadGroup.create_thread(&ThreadCoinPrefetch);
+    }
+
+    std::vector<CPubKey> vMultisigKeys;
+    for (int i = 0; i < 4; i++) {
+        CKey key;
+        std::vector<uint8_t> vchSecret(32, i + 1);
+        key.Set(vchSecret.begin(), vchSecret.end(), true);
+        keystore.AddKey(key);
+        if (i == 0) {
+            scriptP2PKH = GetScriptForDestination(key.GetPubKey().GetID());
+        } else {
+            vMultisigKeys.push_back(key.GetPubKey());
+        }
+    }
+    scriptMultisig = GetScriptForMultisig(2, vMultisigKeys);
+    nTime = chainActive.Tip()->nTime;
+
+    // Coinbases to split, and enough blocks for them to mature
+    std::vector<CTransactionRef> vCoinbases;
+    for (int i = 0; i < FANOUT_COINBASES + COINBASE_MATURITY; i++) {
+        CBlock block = MakeBlock({});
+        ProcessBlock(block);
+        vCoinbases.push_back(block.vtx[0]);
+    }
+    vCoinbases.resize(FANOUT_COINBASES);
+
+    std::vector<CMutableTransaction> vFanout;
+    for (const CTransactionRef &coinbase : vCoinbases) {
+        const CTxOut &txout = coinbase->vout[0];
+        CMutableTransaction mtx;
+        mtx.vin.emplace_back(
+            COutPoint(coinbase->GetId(), 0, txout.nValue));
+        CAmount nValue = (txout.nValue - PAYLOAD_FEE) / FANOUT_OUTPUTS;
+        for (int i = 0; i < FANOUT_OUTPUTS; i++) {
+            mtx.vout.emplace_back(nValue, i % 2 ? scriptMultisig : scriptP2PKH);
+        }
+        bool fSigned = SignSignature(keystore, txout.scriptPubKey, mtx, 0,
+                                     txout.nValue, SIGHASH_ALL);
+        assert(fSigned);
+        vFanout.push_back(mtx);
+    }
+    CBlock fanout = MakeBlock(std::move(vFanout));
+    ProcessBlock(fanout);
+    pindexFanout = chainActive.Tip();
+
+    for (int n = 0; n < 2; n++) {
+        payload[n] = std::make_shared<const CBlock>(MakePayload(fanout, n));
+    }
+}
+
+BenchChain::~BenchChain() {
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    UnloadBlockIndex();
+    delete pcoinsTip;
+    pcoinsTip = nullptr;
+    delete pcoinsWriter;
+    pcoinsWriter = nullptr;
+    delete pcoinsdbview;
+    delete pblocktree;
+    pblocktree = nullptr;
+    boost::filesystem::remove_all(pathData);
+}
+
+/** A block on the tip with the given transactions, its proof of work solved */
+CBlock BenchChain::MakeBlock(std::vector<CMutableTransaction> &&txs) {
+    const CBlockIndex *pindexPrev = chainActive.Tip();
+    const Consensus::Params &consensus = Params().GetConsensus();
+    int nHeight = pindexPrev->nHeight + 1;
+
+    CBlock block;
+    block.nVersion = ComputeBlockVersion(pindexPrev, consensus);
+    block.hashPrevBlock = pindexPrev->GetBlockHash();
+    block.nTime = nTime += 60;
+    block.nBlockHeight = nHeight;
+    block.nBits = GetNextWorkRequired(pindexPrev, &block, config);
+
+    CAmount nFees = 0;
+    CAmount nInterest = 0;
+    block.vtx.emplace_back();
+    for (CMutableTransaction &mtx : txs) {
+        CTransactionRef tx = MakeTransactionRef(std::move(mtx));
+        nFees += PAYLOAD_FEE;
+        nInterest += tx->GetInterest();
+        block.vtx.push_back(tx);
+    }
+
+    CMutableTransaction coinbase;
+    coinbase.nFlags = TX_FLAGS_COINBASE;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].prevout.n = nHeight;
+    coinbase.vin[0].scriptSig = CScript() << OP_0;
+    coinbase.vout.emplace_back(nFees + GetBlockSubsidy(nHeight, consensus),
+                               scriptP2PKH, "", COINBASE_MATURITY);
+    coinbase.vin[0].prevout.nValue = coinbase.vout[0].nValue;
+    block.vtx[0] = MakeTransactionRef(std::move(coinbase));
+    block.nChainInterest = pindexPrev->nChainInterest + nInterest;
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+
+    while (!CheckProofOfWork(block, config)) {
+        ++block.nNonce;
+    }
+    return block;
+}
+
+void BenchChain::ProcessBlock(const CBlock &block) {
+    bool fProcessed = ProcessNewBlock(
+        config, std::make_shared<const CBlock>(block), true, nullptr);
+    assert(fProcessed && chainActive.Tip()->GetBlockHash() == block.GetHash());
+}
+
+/**
+ * A block spending every coin of the fan-out block. The variants spend the
+ * same coins into other outputs, so that they conflict.
+ */
+CBlock BenchChain::MakePayload(const CBlock &fanout, int nVariant) {
+    const CChainParams &params = Params();
+    const uint32_t nDepositLock = params.LockInterestBlocksThreshould(0);
+    const std::string strContent(200, 'a' + nVariant);
+
+    std::vector<CMutableTransaction> vPayload;
+    int nTx = 0;
+    for (size_t i = 1; i < fanout.vtx.size(); i++) {
+        const CTransaction &txFanout = *fanout.vtx[i];
+        // One P2PKH and one multisig coin per transaction
+        for (size_t n = 0; n + 1 < txFanout.vout.size(); n += 2) {
+            CMutableTransaction mtx;
+            CAmount nValueIn = 0;
+            for (size_t m = n; m < n + 2; m++) {
+                const CTxOut &txout = txFanout.vout[m];
+                mtx.vin.emplace_back(
+                    COutPoint(txFanout.GetId(), m, txout.nValue));
+                nValueIn += txout.nValue;
+            }
+
+            CAmount nValue = nValueIn - PAYLOAD_FEE;
+            switch ((nTx++ + nVariant) % 4) {
+                case 0:
+                    mtx.vout.emplace_back(nValue, scriptP2PKH);
+                    break;
+                case 1:
+                    mtx.vout.emplace_back(nValue, scriptMultisig);
+                    break;
+                case 2:
+                    mtx.vout.emplace_back(COIN / 100, scriptP2PKH,
+                                          strContent);
+                    mtx.vout.emplace_back(nValue - COIN / 100, scriptP2PKH);
+                    break;
+                case 3: {
+                    // The deposit earns the interest validation computes
+                    mtx.vout.emplace_back(nValue, scriptP2PKH, "",
+                                          nDepositLock, nValue);
+                    CAmount nInterest =
+                        GetTxInterest(CTransaction(mtx), pindexFanout);
+                    mtx.vout[0].nValue += nInterest;
+                    break;
+                }
+            }
+
+            for (size_t m = 0; m < 2; m++) {
+                const CTxOut &txout = txFanout.vout[n + m];
+                bool fSigned = SignSignature(keystore, txout.scriptPubKey, mtx,
+                                             m, txout.nValue, SIGHASH_ALL);
+                assert(fSigned);
+            }
+            vPayload.push_back(mtx);
+        }
+    }
+    return MakeBlock(std::move(vPayload));
+}
+
+void BenchChain::DisconnectPayload() {
+    LOCK(cs_main);
+    while (chainActive.Tip() != pindexFanout) {
+        CValidationState state;
+        bool fInvalidated = InvalidateBlock(config, state, chainActive.Tip());
+        assert(fInvalidated);
+    }
+}
+
+void BenchChain::ConnectPayload(int n) {
+    CBlockIndex *pindex;
+    {
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(payload[n]->GetHash());
+        if (!pindex) {
+            // Not stored yet, it is connected by being processed
+            if (chainActive.Tip() != pindexFanout) {
+                CValidationState state;
+                bool fInvalidated =
+                    InvalidateBlock(config, state, chainActive.Tip());
+                assert(fInvalidated);
+            }
+        } else {
+            ResetBlockFailureFlags(pindex);
+            if (chainActive.Tip() != pindexFanout &&
+                chainActive.Tip() != pindex) {
+                CValidationState state;
+                bool fInvalidated =
+                    InvalidateBlock(config, state, chainActive.Tip());
+                assert(fInvalidated);
+            }
+        }
+    }
+
+    if (!pindex) {
+        ProcessNewBlock(config, payload[n], true, nullptr);
+    } else {
+        CValidationState state;
+        ActivateBestChain(config, state);
+    }
+    assert(chainActive.Tip()->GetBlockHash() == payload[n]->GetHash());
+}
+
+static BenchChain &GetBenchChain() {
+    static BenchChain chain;
+    return chain;
+}
+
+/**
+ * ConnectBlock as when the payload block arrives on the fan-out block, with
+ * its coins in the coins cache (hot) or only in the database (cold), and
+ * script checks on one thread or several.
+ */
+static void ConnectPayloadBlock(benchmark::State &state, bool fHot,
+                                int nThreads) {
+    BenchChain &chain = GetBenchChain();
+    chain.DisconnectPayload();
+    const CBlock &payload = *chain.payload[0];
+
+    LOCK(cs_main);
+    int nScriptCheckThreadsOld = nScriptCheckThreads;
+    nScriptCheckThreads = nThreads > 1 ? nThreads : 0;
+    // Start either way from coins that are on disk.
+    FlushStateToDisk();
+    std::vector<COutPoint> vOutpoints;
+    for (size_t i = 1; i < payload.vtx.size(); i++) {
+        for (const CTxIn &txin : payload.vtx[i]->vin) {
+            vOutpoints.push_back(txin.prevout);
+        }
+    }
+
+    while (state.KeepRunning()) {
+        for (const COutPoint &outpoint : vOutpoints) {
+            if (fHot) {
+                pcoinsTip->AccessCoin(outpoint);
+            } else {
+                pcoinsTip->Uncache(outpoint);
+            }
+        }
+        // CheckBlock results are cached in the block
+        CBlock block(payload);
+        block.fChecked = false;
+        CValidationState validationState;
+        bool fValid = TestBlockValidity(chain.config, validationState, block,
+                                        chainActive.Tip(), false, true);
+        assert(fValid);
+    }
+    nScriptCheckThreads = nScriptCheckThreadsOld;
+}
+
+static void ConnectBlockHot(benchmark::State &state) {
+    ConnectPayloadBlock(state, true, 1);
+}
+
+static void ConnectBlockHotPar4(benchmark::State &state) {
+    ConnectPayloadBlock(state, true, SCRIPT_CHECK_WORKERS + 1);
+}
+
+static void ConnectBlockCold(benchmark::State &state) {
+    ConnectPayloadBlock(state, false, 1);
+}
+
+static void ConnectBlockColdPar4(benchmark::State &state) {
+    ConnectPayloadBlock(state, false, SCRIPT_CHECK_WORKERS + 1);
+}
+
+/**
+ * Switch the tip between the two payload blocks: disconnect one, with its
+ * transactions going back to the mempool, and connect the other, writing
+ * the block and its undo data.
+ */
+static void ReorgPayloadBlock(benchmark::State &state) {
+    BenchChain &chain = GetBenchChain();
+    chain.ConnectPayload(0);
+    int n = 1;
+    while (state.KeepRunning()) {
+        chain.ConnectPayload(n);
+        n ^= 1;
+    }
+}
+
+BENCHMARK(ConnectBlockHot);
+BENCHMARK(ConnectBlockHotPar4);
+BENCHMARK(ConnectBlockCold);
+BENCHMARK(ConnectBlockColdPar4);
+BENCHMARK(ReorgPayloadBlock);
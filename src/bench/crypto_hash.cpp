@@ -48,6 +48,42 @@ static void SHA256_32b(benchmark::State &state) {
     }
 }
 
+static void SHA256D64_1024(benchmark::State &state) {
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA256D64(in.data(), in.data(), 1024);
+    }
+}
+
+/**
+ * Run a SHA-256 benchmark under the named implementation, so that each one
+ * gets its own line. Implementations this CPU lacks report nothing.
+ */
+static void WithSHA256Implementation(benchmark::State &state, const char *name,
+                                     void (*bench)(benchmark::State &)) {
+    std::string previous = SHA256SelectImplementation();
+    if (!SHA256SetImplementation(name)) {
+        return;
+    }
+    bench(state);
+    SHA256SetImplementation(previous);
+}
+
+#define SHA256_IMPLEMENTATION_BENCHMARKS(impl, suffix)                         \
+    static void SHA256_##suffix(benchmark::State &state) {                     \
+        WithSHA256Implementation(state, impl, SHA256);                         \
+    }                                                                          \
+    static void SHA256D64_1024_##suffix(benchmark::State &state) {             \
+        WithSHA256Implementation(state, impl, SHA256D64_1024);                 \
+    }                                                                          \
+    BENCHMARK(SHA256_##suffix);                                                \
+    BENCHMARK(SHA256D64_1024_##suffix);
+
+SHA256_IMPLEMENTATION_BENCHMARKS("standard", standard)
+SHA256_IMPLEMENTATION_BENCHMARKS("sse4.1", sse41)
+SHA256_IMPLEMENTATION_BENCHMARKS("avx2", avx2)
+SHA256_IMPLEMENTATION_BENCHMARKS("shani", shani)
+
 static void SHA512(benchmark::State &state) {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
     std::vector<uint8_t> in(BUFFER_SIZE, 0);
@@ -90,6 +126,7 @@ BENCHMARK(SHA256);
 BENCHMARK(SHA512);
 
 BENCHMARK(SHA256_32b);
+BENCHMARK(SHA256D64_1024);
 BENCHMARK(SipHash_32b);
 BENCHMARK(FastRandom_32bit);
 BENCHMARK(FastRandom_1bit);
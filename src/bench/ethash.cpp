@@ -0,0 +1,115 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "ethash/internal.h"
+#include "ethash/sha3.h"
+
+#include <cstring>
+#include <vector>
+
+// Scaled down from the 16MB cache and 1GB DAG of epoch 0, so the setup stays
+// quick. Hashing cost does not depend on the sizes, only cache misses do.
+static const uint64_t BENCH_CACHE_BYTES = 1024 * 1024;
+static const uint64_t BENCH_FULL_BYTES = 128 * 262144;
+
+static ethash_h256_t BenchSeed() {
+    ethash_h256_t seed;
+    memset(&seed, 0x5a, sizeof(seed));
+    return seed;
+}
+
+static ethash_h256_t BenchHeader() {
+    ethash_h256_t header;
+    for (int i = 0; i < 32; i++) {
+        header.b[i] = i * 7 + 1;
+    }
+    return header;
+}
+
+static void EthashLightNew(benchmark::State &state) {
+    const ethash_h256_t seed = BenchSeed();
+    while (state.KeepRunning()) {
+        ethash_light_delete(ethash_light_new_internal(BENCH_CACHE_BYTES, &seed));
+    }
+}
+
+static void EthashDagItem(benchmark::State &state) {
+    const ethash_h256_t seed = BenchSeed();
+    ethash_light_t light = ethash_light_new_internal(BENCH_CACHE_BYTES, &seed);
+    const uint32_t nItems = BENCH_FULL_BYTES / sizeof(node);
+    node item;
+    uint32_t i = 0;
+    while (state.KeepRunning()) {
+        ethash_calculate_dag_item(&item, i++ % nItems, light);
+    }
+    ethash_light_delete(light);
+}
+
+static void EthashLightCompute(benchmark::State &state) {
+    const ethash_h256_t seed = BenchSeed();
+    const ethash_h256_t header = BenchHeader();
+    ethash_light_t light = ethash_light_new_internal(BENCH_CACHE_BYTES, &seed);
+    uint64_t nNonce = 0;
+    while (state.KeepRunning()) {
+        ethash_light_compute_internal(light, BENCH_FULL_BYTES, header,
+                                      nNonce++);
+    }
+    ethash_light_delete(light);
+}
+
+static void EthashFullCompute(benchmark::State &state) {
+    const ethash_h256_t seed = BenchSeed();
+    const ethash_h256_t header = BenchHeader();
+    ethash_light_t light = ethash_light_new_internal(BENCH_CACHE_BYTES, &seed);
+    std::vector<node> data(BENCH_FULL_BYTES / sizeof(node));
+    ethash_compute_full_data(data.data(), BENCH_FULL_BYTES, light, nullptr);
+    ethash_light_delete(light);
+    struct ethash_full full = {nullptr, BENCH_FULL_BYTES, data.data(),
+                               data.data(), BENCH_FULL_BYTES};
+
+    uint64_t nNonce = 0;
+    while (state.KeepRunning()) {
+        ethash_full_compute(&full, header, nNonce++);
+    }
+}
+
+static void EthashQuickCheck(benchmark::State &state) {
+    const ethash_h256_t header = BenchHeader();
+    ethash_h256_t mixHash, boundary;
+    memset(&mixHash, 0x11, sizeof(mixHash));
+    memset(&boundary, 0xff, sizeof(boundary));
+    uint64_t nNonce = 0;
+    while (state.KeepRunning()) {
+        ethash_quick_check_difficulty(&header, nNonce++, &mixHash, &boundary);
+    }
+}
+
+static void SHA3_256_32b(benchmark::State &state) {
+    ethash_h256_t hash = BenchHeader();
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000000; i++) {
+            SHA3_256(&hash, hash.b, sizeof(hash));
+        }
+    }
+}
+
+static void SHA3_512_64b(benchmark::State &state) {
+    uint8_t hash[64] = {0};
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000000; i++) {
+            SHA3_512(hash, hash, sizeof(hash));
+        }
+    }
+}
+
+BENCHMARK(EthashLightNew);
+BENCHMARK(EthashDagItem);
+BENCHMARK(EthashLightCompute);
+BENCHMARK(EthashFullCompute);
+BENCHMARK(EthashQuickCheck);
+
+BENCHMARK(SHA3_256_32b);
+BENCHMARK(SHA3_512_64b);
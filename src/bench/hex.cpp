@@ -0,0 +1,46 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "utilstrencodings.h"
+
+#include <string>
+#include <vector>
+
+// About the size of a transaction with the largest content.
+static const size_t HEX_BENCH_BYTES = 1000000;
+
+static void HexEncodeLarge(benchmark::State &state) {
+    const std::vector<uint8_t> vch(HEX_BENCH_BYTES, 0x5a);
+    while (state.KeepRunning()) {
+        HexStr(vch);
+    }
+}
+
+static void HexDecodeLarge(benchmark::State &state) {
+    const std::string strHex = HexStr(std::vector<uint8_t>(HEX_BENCH_BYTES));
+    while (state.KeepRunning()) {
+        ParseHex(strHex);
+    }
+}
+
+static void HexIsHexLarge(benchmark::State &state) {
+    const std::string strHex = HexStr(std::vector<uint8_t>(HEX_BENCH_BYTES));
+    while (state.KeepRunning()) {
+        IsHex(strHex);
+    }
+}
+
+static void HexEncodeHash(benchmark::State &state) {
+    const std::vector<uint8_t> vch(32, 0x5a);
+    while (state.KeepRunning()) {
+        HexStr(vch);
+    }
+}
+
+BENCHMARK(HexEncodeLarge);
+BENCHMARK(HexDecodeLarge);
+BENCHMARK(HexIsHexLarge);
+BENCHMARK(HexEncodeHash);
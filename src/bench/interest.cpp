@@ -0,0 +1,52 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "interest.h"
+
+#include <cassert>
+#include <cmath>
+
+// Outputs locked for every interest level, a third of the way through the
+// decay periods.
+static const size_t BENCH_PERIOD = 100;
+
+// The double arithmetic validation used before the fixed point table.
+static void InterestDouble(benchmark::State &state) {
+    const CChainParams &params = Params(CBaseChainParams::MAIN);
+    const CInterestTable &table = params.InterestTable();
+    CAmount nTotal = 0;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 8; i++) {
+            int nLock = params.LockInterestBlocksThreshould(i) + i;
+            nLock = params.AdjustToLockInterestThreshold(nLock);
+            const double rate =
+                table.GetRate(table.GetLevel(nLock), BENCH_PERIOD);
+            const double unitInterest =
+                rate * uint32_t(nLock) / params.BlocksInterestInterval();
+            nTotal += static_cast<CAmount>(
+                std::round((12345 + i) * COIN * unitInterest));
+        }
+    }
+    assert(nTotal != 0);
+}
+
+static void InterestFixedPoint(benchmark::State &state) {
+    const CChainParams &params = Params(CBaseChainParams::MAIN);
+    const CInterestTable &table = params.InterestTable();
+    CAmount nTotal = 0;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 8; i++) {
+            nTotal += table.GetInterest(
+                (12345 + i) * COIN, params.LockInterestBlocksThreshould(i) + i,
+                BENCH_PERIOD);
+        }
+    }
+    assert(nTotal != 0);
+}
+
+BENCHMARK(InterestDouble);
+BENCHMARK(InterestFixedPoint);
@@ -0,0 +1,219 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/common.h"
+#include "policy/policy.h"
+#include "random.h"
+#include "txmempool.h"
+
+#include <cassert>
+#include <limits>
+#include <vector>
+
+// Every 32nd transaction starts a chain this deep, the rest spend coins.
+static const size_t MIX_CHAIN_INTERVAL = 32;
+static const size_t MIX_CHAIN_DEPTH = 24;
+// One in eight transactions creates a deposit, one in sixteen uploads content.
+static const size_t MIX_DEPOSIT_INTERVAL = 8;
+static const size_t MIX_CONTENT_INTERVAL = 16;
+static const size_t MIX_CONTENT_SIZE = 4000;
+
+struct MixEntry {
+    CTransactionRef tx;
+    CAmount nFee;
+};
+
+/**
+ * N transactions shaped like Platopia mempool traffic: payments, deposits
+ * with nPrincipal/nLockTime, content uploads and deep chains, parents first.
+ * Built once per size, as hashing them would dominate the benchmarks.
+ */
+template <size_t N> static const std::vector<MixEntry> &MakeMempoolMix() {
+    static std::vector<MixEntry> vMix;
+    if (!vMix.empty()) {
+        return vMix;
+    }
+
+    FastRandomContext insecure_rand(true);
+    auto randHash = [&insecure_rand]() {
+        uint256 hash;
+        for (int i = 0; i < 8; i++) {
+            WriteLE32(hash.begin() + 4 * i, insecure_rand.rand32());
+        }
+        return hash;
+    };
+
+    vMix.reserve(N);
+    size_t nChainLeft = 0;
+    for (size_t i = 0; i < N; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        if (nChainLeft > 0) {
+            const CTxOut &prevout = vMix.back().tx->vout[0];
+            mtx.vin[0].prevout =
+                COutPoint(vMix.back().tx->GetId(), 0, prevout.nValue);
+            nChainLeft--;
+        } else {
+            mtx.vin[0].prevout = COutPoint(randHash(), 0, 100 * COIN);
+            if (i % MIX_CHAIN_INTERVAL == 0) {
+                nChainLeft = MIX_CHAIN_DEPTH - 1;
+            }
+        }
+        mtx.vin[0].scriptSig = CScript() << std::vector<uint8_t>(72, 0x30)
+                                         << std::vector<uint8_t>(33, 0x02);
+
+        mtx.vout.resize(2);
+        for (CTxOut &txout : mtx.vout) {
+            uint256 keyHash = randHash();
+            txout.nValue = COIN;
+            txout.scriptPubKey =
+                CScript() << OP_DUP << OP_HASH160
+                          << std::vector<uint8_t>(keyHash.begin(),
+                                                  keyHash.begin() + 20)
+                          << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        if (i % MIX_DEPOSIT_INTERVAL == 1) {
+            mtx.vout[1].nPrincipal = COIN;
+            mtx.vout[1].nValue = COIN + COIN / 100;
+            mtx.vout[1].nLockTime = 10000;
+        }
+        if (i % MIX_CONTENT_INTERVAL == 2) {
+            mtx.vout[1].strContent = std::string(MIX_CONTENT_SIZE, 'c');
+        }
+
+        CAmount nFee = 1000 + insecure_rand.rand32() % 20000;
+        vMix.push_back({MakeTransactionRef(std::move(mtx)), nFee});
+    }
+    return vMix;
+}
+
+template <size_t N> static void FillMempool(CTxMemPool &pool) {
+    LockPoints lp;
+    for (const MixEntry &mix : MakeMempoolMix<N>()) {
+        pool.addUnchecked(mix.tx->GetId(),
+                          CTxMemPoolEntry(mix.tx, mix.nFee, 0, 10.0, 1,
+                                          mix.tx->GetValueOut(), false, 4,
+                                          lp));
+    }
+}
+
+// The cost of building the pool, to subtract from the benchmarks below.
+template <size_t N> static void MempoolMixFill(benchmark::State &state) {
+    MakeMempoolMix<N>();
+    while (state.KeepRunning()) {
+        CTxMemPool pool(CFeeRate(CAmount(1000)));
+        FillMempool<N>(pool);
+    }
+}
+
+template <size_t N> static void MempoolMixTrimToSize(benchmark::State &state) {
+    MakeMempoolMix<N>();
+    while (state.KeepRunning()) {
+        CTxMemPool pool(CFeeRate(CAmount(1000)));
+        FillMempool<N>(pool);
+        pool.TrimToSize(pool.DynamicMemoryUsage() / 2);
+    }
+}
+
+template <size_t N>
+static void MempoolMixTrimContent(benchmark::State &state) {
+    MakeMempoolMix<N>();
+    while (state.KeepRunning()) {
+        CTxMemPool pool(CFeeRate(CAmount(1000)));
+        FillMempool<N>(pool);
+        pool.TrimContentToSize(pool.GetTotalContentSize() / 2);
+    }
+}
+
+// Mine the first quarter of the pool, leaving chains split across the block.
+template <size_t N>
+static void MempoolMixRemoveForBlock(benchmark::State &state) {
+    const std::vector<MixEntry> &vMix = MakeMempoolMix<N>();
+    std::vector<CTransactionRef> vtx;
+    for (size_t i = 0; i < vMix.size() / 4; i++) {
+        vtx.push_back(vMix[i].tx);
+    }
+
+    while (state.KeepRunning()) {
+        CTxMemPool pool(CFeeRate(CAmount(1000)));
+        FillMempool<N>(pool);
+        pool.removeForBlock(vtx, 1);
+    }
+}
+
+template <size_t N>
+static void MempoolMixCalculateAncestors(benchmark::State &state) {
+    const std::vector<MixEntry> &vMix = MakeMempoolMix<N>();
+    CTxMemPool pool(CFeeRate(CAmount(1000)));
+    FillMempool<N>(pool);
+
+    // The deepest entry of every chain.
+    std::vector<CTxMemPool::txiter> vTips;
+    for (size_t i = MIX_CHAIN_DEPTH - 1; i < vMix.size();
+         i += MIX_CHAIN_INTERVAL) {
+        vTips.push_back(pool.mapTx.find(vMix[i].tx->GetId()));
+    }
+
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    while (state.KeepRunning()) {
+        for (CTxMemPool::txiter it : vTips) {
+            CTxMemPool::setEntries setAncestors;
+            pool.CalculateMemPoolAncestors(*it, setAncestors, nNoLimit,
+                                           nNoLimit, nNoLimit, nNoLimit, dummy,
+                                           false);
+            assert(setAncestors.size() == MIX_CHAIN_DEPTH - 1);
+        }
+    }
+}
+
+static void MempoolMixFill10k(benchmark::State &state) {
+    MempoolMixFill<10000>(state);
+}
+static void MempoolMixFill100k(benchmark::State &state) {
+    MempoolMixFill<100000>(state);
+}
+static void MempoolMixTrimToSize10k(benchmark::State &state) {
+    MempoolMixTrimToSize<10000>(state);
+}
+static void MempoolMixTrimToSize100k(benchmark::State &state) {
+    MempoolMixTrimToSize<100000>(state);
+}
+static void MempoolMixTrimContent10k(benchmark::State &state) {
+    MempoolMixTrimContent<10000>(state);
+}
+static void MempoolMixTrimContent100k(benchmark::State &state) {
+    MempoolMixTrimContent<100000>(state);
+}
+static void MempoolMixRemoveForBlock10k(benchmark::State &state) {
+    MempoolMixRemoveForBlock<10000>(state);
+}
+static void MempoolMixRemoveForBlock100k(benchmark::State &state) {
+    MempoolMixRemoveForBlock<100000>(state);
+}
+static void MempoolMixCalculateAncestors10k(benchmark::State &state) {
+    MempoolMixCalculateAncestors<10000>(state);
+}
+static void MempoolMixCalculateAncestors100k(benchmark::State &state) {
+    MempoolMixCalculateAncestors<100000>(state);
+}
+// Building a million entries takes a while, so only the read-only walk runs
+// at that size.
+static void MempoolMixCalculateAncestors1M(benchmark::State &state) {
+    MempoolMixCalculateAncestors<1000000>(state);
+}
+
+BENCHMARK(MempoolMixFill10k);
+BENCHMARK(MempoolMixFill100k);
+BENCHMARK(MempoolMixTrimToSize10k);
+BENCHMARK(MempoolMixTrimToSize100k);
+BENCHMARK(MempoolMixTrimContent10k);
+BENCHMARK(MempoolMixTrimContent100k);
+BENCHMARK(MempoolMixRemoveForBlock10k);
+BENCHMARK(MempoolMixRemoveForBlock100k);
+BENCHMARK(MempoolMixCalculateAncestors10k);
+BENCHMARK(MempoolMixCalculateAncestors100k);
+BENCHMARK(MempoolMixCalculateAncestors1M);
@@ -51,3 +51,78 @@ uint64_t perf_cpucycles(void) {
 }
 
 #endif
+
+#if defined(__linux__)
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+
+// Group leader, counting cycles, then instructions and cache misses
+static int counter_fds[3] = {-1, -1, -1};
+
+static int perf_counter_open(uint64_t config, int group_fd) {
+    struct perf_event_attr pe;
+    memset(&pe, 0, sizeof(pe));
+    pe.type = PERF_TYPE_HARDWARE;
+    pe.size = sizeof(pe);
+    pe.config = config;
+    pe.read_format = PERF_FORMAT_GROUP;
+    // Allowed without privileges under the default perf_event_paranoid
+    pe.exclude_kernel = 1;
+    pe.exclude_hv = 1;
+    return syscall(__NR_perf_event_open, &pe, 0, -1, group_fd, 0);
+}
+
+bool perf_counters_init(void) {
+    static const uint64_t configs[3] = {PERF_COUNT_HW_CPU_CYCLES,
+                                        PERF_COUNT_HW_INSTRUCTIONS,
+                                        PERF_COUNT_HW_CACHE_MISSES};
+    for (int i = 0; i < 3; i++) {
+        counter_fds[i] =
+            perf_counter_open(configs[i], i == 0 ? -1 : counter_fds[0]);
+        if (counter_fds[i] == -1) {
+            perf_counters_fini();
+            return false;
+        }
+    }
+    return true;
+}
+
+void perf_counters_fini(void) {
+    for (int &counter_fd : counter_fds) {
+        if (counter_fd != -1) {
+            close(counter_fd);
+            counter_fd = -1;
+        }
+    }
+}
+
+bool perf_counters_read(struct perf_counters *counters) {
+    // The number of events, then their values in the order they were opened
+    uint64_t values[4];
+    if (counter_fds[0] == -1 ||
+        read(counter_fds[0], values, sizeof(values)) <
+            (ssize_t)sizeof(values) ||
+        values[0] != 3) {
+        return false;
+    }
+    counters->cycles = values[1];
+    counters->instructions = values[2];
+    counters->cache_misses = values[3];
+    return true;
+}
+
+#else
+
+bool perf_counters_init(void) {
+    return false;
+}
+void perf_counters_fini(void) {}
+bool perf_counters_read(struct perf_counters *counters) {
+    return false;
+}
+
+#endif
@@ -32,4 +32,19 @@ uint64_t perf_cpucycles(void);
 void perf_init(void);
 void perf_fini(void);
 
+/** Hardware event counts of the calling thread */
+struct perf_counters {
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t cache_misses;
+};
+
+/**
+ * Start counting hardware events for the calling thread, with
+ * perf_event_open on Linux. Returns false where it is not available.
+ */
+bool perf_counters_init(void);
+void perf_counters_fini(void);
+bool perf_counters_read(struct perf_counters *counters);
+
 #endif // H_PERF
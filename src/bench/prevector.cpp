@@ -0,0 +1,71 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "clientversion.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "streams.h"
+
+#include <vector>
+
+// Scripts as large as those of a P2PKH output, which fits inline, and of the
+// input that spends it, which doesn't.
+static const size_t SCRIPT_PUBKEY_SIZE = 25;
+static const size_t SCRIPT_SIG_SIZE = 107;
+static const size_t SCRIPTS = 1000;
+
+static CScript MakeScript(size_t nSize) {
+    const std::vector<uint8_t> vch(nSize, OP_1);
+    return CScript(vch.begin(), vch.end());
+}
+
+static void ScriptCopy(benchmark::State &state, size_t nSize) {
+    const CScript script = MakeScript(nSize);
+    std::vector<CScript> vScripts(SCRIPTS);
+    while (state.KeepRunning()) {
+        for (CScript &copy : vScripts) {
+            copy = script;
+        }
+    }
+}
+
+static void ScriptDeserialize(benchmark::State &state, size_t nSize) {
+    CScript script = MakeScript(nSize);
+    std::vector<uint8_t> vch;
+    CVectorWriter writer(SER_DISK, CLIENT_VERSION, vch, 0);
+    for (size_t i = 0; i < SCRIPTS; i++) {
+        writer << *(CScriptBase *)(&script);
+    }
+    std::vector<CScript> vScripts(SCRIPTS);
+    while (state.KeepRunning()) {
+        CSpanReader reader(SER_DISK, CLIENT_VERSION, vch.data(),
+                           vch.data() + vch.size());
+        for (CScript &copy : vScripts) {
+            reader >> *(CScriptBase *)(&copy);
+        }
+    }
+}
+
+static void ScriptCopyPubKey(benchmark::State &state) {
+    ScriptCopy(state, SCRIPT_PUBKEY_SIZE);
+}
+
+static void ScriptCopySig(benchmark::State &state) {
+    ScriptCopy(state, SCRIPT_SIG_SIZE);
+}
+
+static void ScriptDeserializePubKey(benchmark::State &state) {
+    ScriptDeserialize(state, SCRIPT_PUBKEY_SIZE);
+}
+
+static void ScriptDeserializeSig(benchmark::State &state) {
+    ScriptDeserialize(state, SCRIPT_SIG_SIZE);
+}
+
+BENCHMARK(ScriptCopyPubKey);
+BENCHMARK(ScriptCopySig);
+BENCHMARK(ScriptDeserializePubKey);
+BENCHMARK(ScriptDeserializeSig);
@@ -2,10 +2,13 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <algorithm>
 #include <iostream>
 
 #include "bench.h"
 #include "bloom.h"
+#include "crypto/common.h"
+#include "uint256.h"
 #include "utiltime.h"
 
 static void RollingBloom(benchmark::State &state) {
@@ -41,4 +44,48 @@ static void RollingBloom(benchmark::State &state) {
     }
 }
 
+// A trickle's worth of txids checked against and added to a peer's
+// filterInventoryKnown, one at a time and as a batch.
+static const size_t ROLLING_BLOOM_BATCH = 1000;
+
+static std::vector<uint256> RollingBloomHashes(uint32_t &count) {
+    std::vector<uint256> vHashes(ROLLING_BLOOM_BATCH);
+    for (uint256 &hash : vHashes) {
+        count++;
+        for (int i = 0; i < 8; i++) {
+            WriteLE32(hash.begin() + 4 * i, count * (0x9e3779b9 + i));
+        }
+    }
+    return vHashes;
+}
+
+static void RollingBloomHashOne(benchmark::State &state) {
+    CRollingBloomFilter filter(50000, 0.000001);
+    uint32_t count = 0;
+    uint64_t match = 0;
+    while (state.KeepRunning()) {
+        const std::vector<uint256> vHashes = RollingBloomHashes(count);
+        for (const uint256 &hash : vHashes) {
+            match += filter.contains(hash);
+        }
+        for (const uint256 &hash : vHashes) {
+            filter.insert(hash);
+        }
+    }
+}
+
+static void RollingBloomHashBatch(benchmark::State &state) {
+    CRollingBloomFilter filter(50000, 0.000001);
+    uint32_t count = 0;
+    uint64_t match = 0;
+    while (state.KeepRunning()) {
+        const std::vector<uint256> vHashes = RollingBloomHashes(count);
+        const std::vector<bool> vContains = filter.contains(vHashes);
+        match += std::count(vContains.begin(), vContains.end(), true);
+        filter.insert(vHashes);
+    }
+}
+
 BENCHMARK(RollingBloom);
+BENCHMARK(RollingBloomHashOne);
+BENCHMARK(RollingBloomHashBatch);
@@ -15,6 +15,7 @@
 #include "util.h"
 #include "utilstrencodings.h"
 
+#include <boost/algorithm/string.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <cstdio>
 
@@ -26,6 +27,7 @@
 static const char DEFAULT_RPCCONNECT[] = "127.0.0.1";
 static const int DEFAULT_HTTP_CLIENT_TIMEOUT = 900;
 static const bool DEFAULT_NAMED = false;
+static const int DEFAULT_RPCBATCHSIZE = 1;
 static const int CONTINUE_EXECUTION = -1;
 
 std::string HelpMessageCli() {
@@ -64,6 +66,17 @@ std::string HelpMessageCli() {
         "-stdin", _("Read extra arguments from standard input, one per line "
                     "until EOF/Ctrl-D (recommended for sensitive information "
                     "such as passphrases)"));
+    strUsage += HelpMessageOpt(
+        "-batch",
+        _("Read a command and its arguments per line of standard input, "
+          "separated by spaces, send them all over one connection and write "
+          "the result or the error of each as a line of standard output, in "
+          "order"));
+    strUsage += HelpMessageOpt(
+        "-rpcbatchsize=<n>",
+        strprintf(_("Commands -batch sends per JSON-RPC batch request "
+                    "(default: %d)"),
+                  DEFAULT_RPCBATCHSIZE));
 
     return strUsage;
 }
@@ -105,7 +118,9 @@ static int AppInitRPC(int argc, char *argv[]) {
                 "  bitcoin-cli [options] -named <command> [name=value] ... " +
                 strprintf(_("Send command to %s (with named arguments)"),
                           _(PACKAGE_NAME)) +
-                "\n" + "  bitcoin-cli [options] help                " +
+                "\n" + "  bitcoin-cli [options] -batch              " +
+                _("Send the commands read from standard input") + "\n" +
+                "  bitcoin-cli [options] help                " +
                 _("List commands") + "\n" +
                 "  bitcoin-cli [options] help <command>      " +
                 _("Get help for a command") + "\n";
@@ -150,11 +165,12 @@ static int AppInitRPC(int argc, char *argv[]) {
 
 /** Reply structure for request_done to fill in */
 struct HTTPReply {
-    HTTPReply() : status(0), error(-1) {}
+    HTTPReply() : status(0), error(-1), done(false) {}
 
     int status;
     int error;
     std::string body;
+    bool done;
 };
 
 const char *http_errorstring(int code) {
@@ -180,6 +196,7 @@ const char *http_errorstring(int code) {
 
 static void http_request_done(struct evhttp_request *req, void *ctx) {
     HTTPReply *reply = static_cast<HTTPReply *>(ctx);
+    reply->done = true;
 
     if (req == nullptr) {
         /**
@@ -208,27 +225,36 @@ static void http_error_cb(enum evhttp_request_error err, void *ctx) {
 }
 #endif
 
-UniValue CallRPC(const std::string &strMethod, const UniValue &params) {
-    std::string host = GetArg("-rpcconnect", DEFAULT_RPCCONNECT);
-    int port = GetArg("-rpcport", BaseParams().RPCPort());
+/**
+ * An HTTP connection to the RPC server. With fKeepAlive it stays open across
+ * calls, so that -batch connects and authenticates once for all commands.
+ */
+class CRPCConnection {
+public:
+    explicit CRPCConnection(bool fKeepAliveIn);
 
-    // Obtain event base
-    raii_event_base base = obtain_event_base();
+    /** Send a JSON-RPC request, or a batch of them, and parse the reply */
+    UniValue Call(const UniValue &request);
+
+private:
+    const bool fKeepAlive;
+    const std::string host;
+    raii_event_base base;
+    raii_evhttp_connection evcon;
+    std::string strAuthorization;
+};
+
+CRPCConnection::CRPCConnection(bool fKeepAliveIn)
+    : fKeepAlive(fKeepAliveIn),
+      host(GetArg("-rpcconnect", DEFAULT_RPCCONNECT)),
+      base(obtain_event_base()) {
+    int port = GetArg("-rpcport", BaseParams().RPCPort());
 
     // Synchronously look up hostname
-    raii_evhttp_connection evcon =
-        obtain_evhttp_connection_base(base.get(), host, port);
+    evcon = obtain_evhttp_connection_base(base.get(), host, port);
     evhttp_connection_set_timeout(
         evcon.get(), GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
 
-    HTTPReply response;
-    raii_evhttp_request req =
-        obtain_evhttp_request(http_request_done, (void *)&response);
-    if (req == nullptr) throw std::runtime_error("create http request failed");
-#if LIBEVENT_VERSION_NUMBER >= 0x02010300
-    evhttp_request_set_error_cb(req.get(), http_error_cb);
-#endif
-
     // Get credentials
     std::string strRPCUserColonPass;
     if (GetArg("-rpcpassword", "") == "") {
@@ -247,19 +273,29 @@ UniValue CallRPC(const std::string &strMethod, const UniValue &params) {
         strRPCUserColonPass =
             GetArg("-rpcuser", "") + ":" + GetArg("-rpcpassword", "");
     }
+    strAuthorization = "Basic " + EncodeBase64(strRPCUserColonPass);
+}
+
+UniValue CRPCConnection::Call(const UniValue &request) {
+    HTTPReply response;
+    raii_evhttp_request req =
+        obtain_evhttp_request(http_request_done, (void *)&response);
+    if (req == nullptr) throw std::runtime_error("create http request failed");
+#if LIBEVENT_VERSION_NUMBER >= 0x02010300
+    evhttp_request_set_error_cb(req.get(), http_error_cb);
+#endif
 
     struct evkeyvalq *output_headers =
         evhttp_request_get_output_headers(req.get());
     assert(output_headers);
     evhttp_add_header(output_headers, "Host", host.c_str());
-    evhttp_add_header(output_headers, "Connection", "close");
-    evhttp_add_header(
-        output_headers, "Authorization",
-        (std::string("Basic ") + EncodeBase64(strRPCUserColonPass)).c_str());
+    evhttp_add_header(output_headers, "Connection",
+                      fKeepAlive ? "keep-alive" : "close");
+    evhttp_add_header(output_headers, "Authorization",
+                      strAuthorization.c_str());
 
     // Attach request data
-    std::string strRequest =
-        JSONRPCRequestObj(strMethod, params, 1).write() + "\n";
+    std::string strRequest = request.write() + "\n";
     struct evbuffer *output_buffer =
         evhttp_request_get_output_buffer(req.get());
     assert(output_buffer);
@@ -272,7 +308,13 @@ UniValue CallRPC(const std::string &strMethod, const UniValue &params) {
         throw CConnectionFailed("send http request failed");
     }
 
-    event_base_dispatch(base.get());
+    // A kept alive connection keeps events pending, so run the loop until the
+    // reply is in rather than until it runs out of them.
+    while (!response.done) {
+        if (event_base_loop(base.get(), EVLOOP_ONCE) != 0) {
+            break;
+        }
+    }
 
     if (response.status == 0) {
         throw CConnectionFailed(strprintf(
@@ -296,6 +338,13 @@ UniValue CallRPC(const std::string &strMethod, const UniValue &params) {
     if (!valReply.read(response.body)) {
         throw std::runtime_error("couldn't parse reply from server");
     }
+    return valReply;
+}
+
+UniValue CallRPC(const std::string &strMethod, const UniValue &params) {
+    CRPCConnection connection(false);
+    const UniValue valReply =
+        connection.Call(JSONRPCRequestObj(strMethod, params, 1));
     const UniValue &reply = valReply.get_obj();
     if (reply.empty()) {
         throw std::runtime_error(
@@ -305,6 +354,133 @@ UniValue CallRPC(const std::string &strMethod, const UniValue &params) {
     return reply;
 }
 
+/** The params of a command, the way -named asks for */
+static UniValue ConvertParams(const std::string &strMethod,
+                              const std::vector<std::string> &args) {
+    if (GetBoolArg("-named", DEFAULT_NAMED)) {
+        return RPCConvertNamedValues(strMethod, args);
+    }
+    return RPCConvertValues(strMethod, args);
+}
+
+/** A -batch output line for the reply to a command, false for an error */
+static bool FormatBatchReply(const UniValue &reply, std::string &strPrint) {
+    if (!reply.isObject()) {
+        strPrint = "error: expected reply to have result, error and id "
+                   "properties";
+        return false;
+    }
+    const UniValue &error = find_value(reply, "error");
+    if (!error.isNull()) {
+        strPrint = "error: " + error.write();
+        return false;
+    }
+    const UniValue &result = find_value(reply, "result");
+    if (result.isNull()) {
+        strPrint = "";
+    } else if (result.isStr()) {
+        strPrint = result.get_str();
+    } else {
+        strPrint = result.write();
+    }
+    return true;
+}
+
+/**
+ * -batch: the commands of standard input go over one kept alive connection,
+ * -rpcbatchsize of them per request, and their results come out a line each
+ * and in order, as soon as their request is answered. Failing commands don't
+ * stop the others, the exit code tells whether any failed.
+ */
+static int BatchRPC() {
+    const size_t nBatchSize =
+        std::max<int64_t>(GetArg("-rpcbatchsize", DEFAULT_RPCBATCHSIZE), 1);
+    const bool fWait = GetBoolArg("-rpcwait", false);
+    CRPCConnection connection(true);
+    bool fFailed = false;
+
+    std::string line;
+    bool fEOF = false;
+    while (!fEOF) {
+        // The output of each command of the batch, those that could not be
+        // sent are failed already.
+        std::vector<std::string> vPrint;
+        std::vector<char> vSucceeded;
+        UniValue batch(UniValue::VARR);
+        while (batch.size() < nBatchSize) {
+            if (!std::getline(std::cin, line)) {
+                fEOF = true;
+                break;
+            }
+            std::vector<std::string> args;
+            const std::string strTrimmed = boost::algorithm::trim_copy(line);
+            if (!strTrimmed.empty()) {
+                boost::split(args, strTrimmed, boost::is_any_of(" \t"),
+                             boost::token_compress_on);
+            }
+            vPrint.emplace_back();
+            vSucceeded.push_back(false);
+            try {
+                if (args.empty()) {
+                    throw std::runtime_error(
+                        "too few parameters (need at least command)");
+                }
+                const std::string strMethod = args[0];
+                args.erase(args.begin());
+                // The id is where the reply goes.
+                batch.push_back(JSONRPCRequestObj(
+                    strMethod, ConvertParams(strMethod, args),
+                    int(vPrint.size() - 1)));
+                vPrint.back() = "error: no reply from server";
+            } catch (const std::exception &e) {
+                vPrint.back() = std::string("error: ") + e.what();
+            }
+        }
+
+        if (!batch.empty()) {
+            UniValue valReply;
+            while (true) {
+                try {
+                    valReply = connection.Call(
+                        nBatchSize > 1 ? batch : batch[0]);
+                    break;
+                } catch (const CConnectionFailed &) {
+                    if (!fWait) {
+                        throw;
+                    }
+                    MilliSleep(1000);
+                }
+            }
+
+            // A single request has a single reply, and a batch that could not
+            // be parsed too.
+            if (!valReply.isArray()) {
+                UniValue replies(UniValue::VARR);
+                replies.push_back(valReply);
+                valReply = replies;
+            }
+            for (size_t i = 0; i < valReply.size(); i++) {
+                const UniValue &reply = valReply[i];
+                const UniValue &id = find_value(reply, "id");
+                if (!id.isNum() || id.get_int() < 0 ||
+                    size_t(id.get_int()) >= vPrint.size()) {
+                    continue;
+                }
+                const size_t nIndex = id.get_int();
+                vSucceeded[nIndex] = FormatBatchReply(reply, vPrint[nIndex]);
+            }
+        }
+
+        for (size_t i = 0; i < vPrint.size(); i++) {
+            fprintf(stdout, "%s\n", vPrint[i].c_str());
+            fFailed |= !vSucceeded[i];
+        }
+        fflush(stdout);
+    }
+
+    return fFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 int CommandLineRPC(int argc, char *argv[]) {
     std::string strPrint;
     int nRet = 0;
@@ -314,6 +490,13 @@ int CommandLineRPC(int argc, char *argv[]) {
             argc--;
             argv++;
         }
+        if (GetBoolArg("-batch", false)) {
+            if (argc > 1) {
+                throw std::runtime_error(
+                    "commands are read from standard input with -batch");
+            }
+            return BatchRPC();
+        }
         std::vector<std::string> args =
             std::vector<std::string>(&argv[1], &argv[argc]);
         if (GetBoolArg("-stdin", false)) {
@@ -331,12 +514,7 @@ int CommandLineRPC(int argc, char *argv[]) {
         // Remove trailing method name from arguments vector
         args.erase(args.begin());
 
-        UniValue params;
-        if (GetBoolArg("-named", DEFAULT_NAMED)) {
-            params = RPCConvertNamedValues(strMethod, args);
-        } else {
-            params = RPCConvertValues(strMethod, args);
-        }
+        UniValue params = ConvertParams(strMethod, args);
 
         // Execute and handle connection failures with -rpcwait
         const bool fWait = GetBoolArg("-rpcwait", false);
@@ -23,13 +23,19 @@
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
 
+#include <atomic>
 #include <cstdio>
+#include <iostream>
+#include <thread>
 
 #include <boost/algorithm/string.hpp>
 
 static bool fCreateBlank;
-static std::map<std::string, UniValue> registers;
 static const int CONTINUE_EXECUTION = -1;
+/** Lines of standard input -batch reads and processes at a time */
+static const size_t BATCH_LINES = 1024;
+
+typedef std::map<std::string, UniValue> Registers;
 
 //
 // This function returns either one of EXIT_ codes when it's expected to stop
@@ -60,12 +66,26 @@ static int AppInitRawTx(int argc, char *argv[]) {
             "  bitcoin-tx [options] <hex-tx> [commands]  " +
             _("Update hex-encoded bitcoin transaction") + "\n" +
             "  bitcoin-tx [options] -create [commands]   " +
-            _("Create hex-encoded bitcoin transaction") + "\n" + "\n";
+            _("Create hex-encoded bitcoin transaction") + "\n" +
+            "  bitcoin-tx [options] -batch [registers]   " +
+            _("Update or create a transaction per line of standard input") +
+            "\n" + "\n";
 
         fprintf(stdout, "%s", strUsage.c_str());
 
         strUsage = HelpMessageGroup(_("Options:"));
         strUsage += HelpMessageOpt("-?", _("This help message"));
+        strUsage += HelpMessageOpt(
+            "-batch",
+            _("Read a hex-encoded TX and its commands per line of standard "
+              "input, separated by spaces, and write the result or the error "
+              "of each as a line of standard output, in order. With -create "
+              "the lines only hold commands. Register commands on the command "
+              "line apply to every line."));
+        strUsage += HelpMessageOpt(
+            "-batchthreads=<n>",
+            _("Number of threads -batch processes lines with, 0 for one per "
+              "core (default: 0)"));
         strUsage += HelpMessageOpt("-create", _("Create new, empty TX."));
         strUsage += HelpMessageOpt("-json", _("Select JSON output"));
         strUsage +=
@@ -130,7 +150,7 @@ static int AppInitRawTx(int argc, char *argv[]) {
     return CONTINUE_EXECUTION;
 }
 
-static void RegisterSetJson(const std::string &key,
+static void RegisterSetJson(Registers &registers, const std::string &key,
                             const std::string &rawJson) {
     UniValue val;
     if (!val.read(rawJson)) {
@@ -141,7 +161,7 @@ static void RegisterSetJson(const std::string &key,
     registers[key] = val;
 }
 
-static void RegisterSet(const std::string &strInput) {
+static void RegisterSet(Registers &registers, const std::string &strInput) {
     // separate NAME:VALUE in string
     size_t pos = strInput.find(':');
     if ((pos == std::string::npos) || (pos == 0) ||
@@ -152,10 +172,10 @@ static void RegisterSet(const std::string &strInput) {
     std::string key = strInput.substr(0, pos);
     std::string valStr = strInput.substr(pos + 1, std::string::npos);
 
-    RegisterSetJson(key, valStr);
+    RegisterSetJson(registers, key, valStr);
 }
 
-static void RegisterLoad(const std::string &strInput) {
+static void RegisterLoad(Registers &registers, const std::string &strInput) {
     // separate NAME:FILENAME in string
     size_t pos = strInput.find(':');
     if ((pos == std::string::npos) || (pos == 0) ||
@@ -193,7 +213,7 @@ static void RegisterLoad(const std::string &strInput) {
     }
 
     // evaluate as JSON buffer register
-    RegisterSetJson(key, valStr);
+    RegisterSetJson(registers, key, valStr);
 }
 
 static CAmount ExtractAndValidateValue(const std::string &strValue) {
@@ -542,7 +562,8 @@ static CAmount AmountFromValue(const UniValue &value) {
     return amount;
 }
 
-static void MutateTxSign(CMutableTransaction &tx, const std::string &flagStr) {
+static void MutateTxSign(CMutableTransaction &tx, const std::string &flagStr,
+                         Registers &registers) {
     int nHashType = SIGHASH_ALL ;
 
     if ((flagStr.size() > 0) && !findSighashFlags(nHashType, flagStr)) {
@@ -704,10 +725,9 @@ public:
     ~Secp256k1Init() { ECC_Stop(); }
 };
 
+/** The caller starts the secp256k1 context before any "sign" command. */
 static void MutateTx(CMutableTransaction &tx, const std::string &command,
-                     const std::string &commandVal) {
-    std::unique_ptr<Secp256k1Init> ecc;
-
+                     const std::string &commandVal, Registers &registers) {
     if (command == "nversion") {
         MutateTxVersion(tx, commandVal);
     } else if (command == "locktime") {
@@ -729,48 +749,43 @@ static void MutateTx(CMutableTransaction &tx, const std::string &command,
     } else if (command == "outdata") {
         MutateTxAddOutData(tx, commandVal);
     } else if (command == "sign") {
-        if (!ecc) {
-            ecc.reset(new Secp256k1Init());
-        }
-
-        MutateTxSign(tx, commandVal);
+        MutateTxSign(tx, commandVal, registers);
     } else if (command == "load") {
-        RegisterLoad(commandVal);
+        RegisterLoad(registers, commandVal);
     } else if (command == "set") {
-        RegisterSet(commandVal);
+        RegisterSet(registers, commandVal);
     } else {
         throw std::runtime_error("unknown command");
     }
 }
 
-static void OutputTxJSON(const CTransaction &tx) {
-    UniValue entry(UniValue::VOBJ);
-    TxToUniv(tx, uint256(), entry);
-
-    std::string jsonOutput = entry.write(4);
-    fprintf(stdout, "%s\n", jsonOutput.c_str());
-}
-
-static void OutputTxHash(const CTransaction &tx) {
-    // the hex-encoded transaction id.
-    std::string strHexHash = tx.GetId().GetHex();
-
-    fprintf(stdout, "%s\n", strHexHash.c_str());
+/** The output for tx, JSON on a single line unless fIndent */
+static std::string FormatTx(const CTransaction &tx, bool fIndent) {
+    if (GetBoolArg("-json", false)) {
+        UniValue entry(UniValue::VOBJ);
+        TxToUniv(tx, uint256(), entry);
+        return entry.write(fIndent ? 4 : 0);
+    } else if (GetBoolArg("-txid", false)) {
+        // the hex-encoded transaction id.
+        return tx.GetId().GetHex();
+    }
+    return EncodeHexTx(tx);
 }
 
-static void OutputTxHex(const CTransaction &tx) {
-    std::string strHex = EncodeHexTx(tx);
-
-    fprintf(stdout, "%s\n", strHex.c_str());
+static void OutputTx(const CTransaction &tx) {
+    fprintf(stdout, "%s\n", FormatTx(tx, true).c_str());
 }
 
-static void OutputTx(const CTransaction &tx) {
-    if (GetBoolArg("-json", false)) {
-        OutputTxJSON(tx);
-    } else if (GetBoolArg("-txid", false)) {
-        OutputTxHash(tx);
+/** Split a command argument into its name and its value */
+static void SplitCommand(const std::string &arg, std::string &key,
+                         std::string &value) {
+    size_t eqpos = arg.find('=');
+    if (eqpos == std::string::npos) {
+        key = arg;
+        value.clear();
     } else {
-        OutputTxHex(tx);
+        key = arg.substr(0, eqpos);
+        value = arg.substr(eqpos + 1);
     }
 }
 
@@ -831,18 +846,16 @@ static int CommandLineRawTx(int argc, char *argv[]) {
             startArg = 1;
         }
 
+        Registers registers;
+        std::unique_ptr<Secp256k1Init> ecc;
         for (int i = startArg; i < argc; i++) {
-            std::string arg = argv[i];
             std::string key, value;
-            size_t eqpos = arg.find('=');
-            if (eqpos == std::string::npos) {
-                key = arg;
-            } else {
-                key = arg.substr(0, eqpos);
-                value = arg.substr(eqpos + 1);
+            SplitCommand(argv[i], key, value);
+            if (key == "sign" && !ecc) {
+                ecc.reset(new Secp256k1Init());
             }
 
-            MutateTx(tx, key, value);
+            MutateTx(tx, key, value, registers);
         }
 
         OutputTx(tx);
@@ -865,6 +878,132 @@ static int CommandLineRawTx(int argc, char *argv[]) {
     return nRet;
 }
 
+/**
+ * Process a line of -batch, starting from a copy of the registers set on the
+ * command line. Returns false with the error as strResult on failure.
+ */
+static bool ProcessBatchLine(const std::string &strLine,
+                             const Registers &baseRegisters,
+                             std::string &strResult) {
+    try {
+        std::vector<std::string> vArgs;
+        const std::string strTrimmed = boost::algorithm::trim_copy(strLine);
+        if (!strTrimmed.empty()) {
+            boost::split(vArgs, strTrimmed, boost::is_any_of(" \t"),
+                         boost::token_compress_on);
+        }
+
+        CMutableTransaction tx;
+        size_t startArg = 0;
+        if (!fCreateBlank) {
+            if (vArgs.empty()) {
+                throw std::runtime_error("too few parameters");
+            }
+            if (!DecodeHexTx(tx, vArgs[0])) {
+                throw std::runtime_error("invalid transaction encoding");
+            }
+            startArg = 1;
+        }
+
+        Registers registers(baseRegisters);
+        for (size_t i = startArg; i < vArgs.size(); i++) {
+            std::string key, value;
+            SplitCommand(vArgs[i], key, value);
+            MutateTx(tx, key, value, registers);
+        }
+
+        strResult = FormatTx(CTransaction(tx), false);
+        return true;
+    } catch (const std::exception &e) {
+        strResult = std::string("error: ") + e.what();
+        return false;
+    }
+}
+
+/**
+ * -batch: the lines of standard input are read BATCH_LINES at a time and
+ * spread over the threads, all of them sharing the chain params and the
+ * secp256k1 context, and their results are written in the input order.
+ */
+static int BatchRawTx(int argc, char *argv[]) {
+    // Skip switches, then only register commands are left.
+    while (argc > 1 && IsSwitchChar(argv[1][0])) {
+        argc--;
+        argv++;
+    }
+
+    Registers registers;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string key, value;
+            SplitCommand(argv[i], key, value);
+            if (key == "load") {
+                RegisterLoad(registers, value);
+            } else if (key == "set") {
+                RegisterSet(registers, value);
+            } else {
+                throw std::runtime_error(
+                    "only register commands go on the command line with "
+                    "-batch");
+            }
+        }
+    } catch (const std::exception &e) {
+        fprintf(stderr, "error: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    int nThreads = GetArg("-batchthreads", 0);
+    if (nThreads <= 0) {
+        nThreads = std::max(GetNumCores(), 1);
+    }
+
+    Secp256k1Init ecc;
+    bool fFailed = false;
+    std::vector<std::string> vLines;
+    std::vector<std::string> vResults;
+    std::vector<char> vSucceeded;
+    std::string strLine;
+    while (std::cin) {
+        vLines.clear();
+        while (vLines.size() < BATCH_LINES && std::getline(std::cin, strLine)) {
+            vLines.push_back(strLine);
+        }
+        if (vLines.empty()) {
+            break;
+        }
+
+        vResults.assign(vLines.size(), std::string());
+        vSucceeded.assign(vLines.size(), false);
+        std::atomic<size_t> nNext(0);
+        auto worker = [&]() {
+            for (size_t i = nNext++; i < vLines.size(); i = nNext++) {
+                vSucceeded[i] =
+                    ProcessBatchLine(vLines[i], registers, vResults[i]);
+            }
+        };
+        std::vector<std::thread> vThreads;
+        for (int i = 1; i < nThreads && size_t(i) < vLines.size(); i++) {
+            vThreads.emplace_back(worker);
+        }
+        worker();
+        for (std::thread &thread : vThreads) {
+            thread.join();
+        }
+
+        for (size_t i = 0; i < vLines.size(); i++) {
+            fprintf(stdout, "%s\n", vResults[i].c_str());
+            fFailed |= !vSucceeded[i];
+        }
+        fflush(stdout);
+    }
+
+    if (std::cin.bad()) {
+        fprintf(stderr, "error: error reading stdin\n");
+        return EXIT_FAILURE;
+    }
+    return fFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[]) {
     SetupEnvironment();
 
@@ -881,7 +1020,8 @@ int main(int argc, char *argv[]) {
 
     int ret = EXIT_FAILURE;
     try {
-        ret = CommandLineRawTx(argc, argv);
+        ret = GetBoolArg("-batch", false) ? BatchRawTx(argc, argv)
+                                           : CommandLineRawTx(argc, argv);
     } catch (const std::exception &e) {
         PrintExceptionContinue(&e, "CommandLineRawTx()");
     } catch (...) {
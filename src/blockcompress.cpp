@@ -0,0 +1,253 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcompress.h"
+
+#include "crypto/common.h"
+#include "serialize.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const size_t MIN_MATCH = 4;
+const size_t MAX_OFFSET = 65535;
+const int HASH_BITS = 16;
+//! Format byte and uncompressed size
+const size_t RECORD_HEADER_SIZE = 5;
+
+/**
+ * History the codec starts from in format 1: the sequences that open and
+ * close the usual scripts and inputs, as they appear serialized.
+ */
+const uint8_t DICTIONARY[] = {
+    // Coinbase prevout and final sequence numbers.
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff,
+    // Signature pushes followed by compressed and uncompressed key pushes.
+    0x6a, 0x47, 0x30, 0x44, 0x02, 0x20, 0x02, 0x20, 0x41, 0x21, 0x02, 0x21,
+    0x03, 0x6b, 0x48, 0x30, 0x45, 0x02, 0x21, 0x00, 0x02, 0x20, 0x41, 0x41,
+    0x04, 0x8a, 0x47, 0x30, 0x44, 0x02, 0x20, 0x02, 0x21, 0x00, 0x41, 0x41,
+    0x04, 0xfe, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    // P2SH and P2PKH outputs, with no content and no lock time.
+    0x17, 0xa9, 0x14, 0x87, 0x00, 0x00, 0x19, 0x76, 0xa9, 0x14, 0x88, 0xac,
+    0x00, 0x00, 0x19, 0x76, 0xa9, 0x14, 0x88, 0xac, 0x00, 0x00, 0x00, 0x00,
+};
+
+uint32_t Hash4(const uint8_t *p) {
+    return (ReadLE32(p) * 2654435761U) >> (32 - HASH_BITS);
+}
+
+void PutLength(std::vector<uint8_t> &vOut, size_t n) {
+    while (n >= 255) {
+        vOut.push_back(255);
+        n -= 255;
+    }
+    vOut.push_back(n);
+}
+
+bool GetLength(const uint8_t *&p, const uint8_t *pend, size_t &n) {
+    while (p != pend) {
+        uint8_t b = *p++;
+        n += b;
+        if (n > MAX_SIZE) {
+            return false;
+        }
+        if (b != 255) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Append nLit literals and then a match, or only the literals at the end. */
+void PutSequence(std::vector<uint8_t> &vOut, const uint8_t *pLit, size_t nLit,
+                 size_t nOffset, size_t nMatch) {
+    const size_t nMatchCode = nMatch ? nMatch - MIN_MATCH : 0;
+    vOut.push_back((std::min<size_t>(nLit, 15) << 4) |
+                   std::min<size_t>(nMatchCode, 15));
+    if (nLit >= 15) {
+        PutLength(vOut, nLit - 15);
+    }
+    vOut.insert(vOut.end(), pLit, pLit + nLit);
+    if (nMatch == 0) {
+        return;
+    }
+    vOut.push_back(nOffset & 0xff);
+    vOut.push_back(nOffset >> 8);
+    if (nMatchCode >= 15) {
+        PutLength(vOut, nMatchCode - 15);
+    }
+}
+
+} // namespace
+
+bool CompressBlock(const uint8_t *pdata, size_t nSize,
+                   std::vector<uint8_t> &vOut) {
+    if (nSize > MAX_SIZE) {
+        return false;
+    }
+
+    // Matches can reach back into the dictionary in front of the block.
+    std::vector<uint8_t> vBuf(std::begin(DICTIONARY), std::end(DICTIONARY));
+    vBuf.insert(vBuf.end(), pdata, pdata + nSize);
+    const uint8_t *base = vBuf.data();
+    const size_t nStart = sizeof(DICTIONARY);
+    const size_t nEnd = vBuf.size();
+
+    // Last position of each hashed 4 byte sequence, nEnd if none.
+    std::vector<uint32_t> vTable(size_t(1) << HASH_BITS, nEnd);
+    for (size_t i = 0; i + MIN_MATCH <= nStart; i++) {
+        vTable[Hash4(base + i)] = i;
+    }
+
+    vOut.clear();
+    vOut.reserve(RECORD_HEADER_SIZE + nSize);
+    vOut.push_back(BLOCK_COMPRESSION_FORMAT);
+    uint8_t size[4];
+    WriteLE32(size, nSize);
+    vOut.insert(vOut.end(), size, size + 4);
+
+    size_t nAnchor = nStart;
+    size_t i = nStart;
+    while (i + MIN_MATCH <= nEnd) {
+        const uint32_t nHash = Hash4(base + i);
+        const size_t nCandidate = vTable[nHash];
+        vTable[nHash] = i;
+        if (nCandidate >= i || i - nCandidate > MAX_OFFSET ||
+            memcmp(base + nCandidate, base + i, MIN_MATCH) != 0) {
+            i++;
+            continue;
+        }
+
+        size_t nMatch = MIN_MATCH;
+        while (i + nMatch < nEnd &&
+               base[nCandidate + nMatch] == base[i + nMatch]) {
+            nMatch++;
+        }
+        PutSequence(vOut, base + nAnchor, i - nAnchor, i - nCandidate, nMatch);
+        for (size_t j = i + 1; j < i + nMatch && j + MIN_MATCH <= nEnd; j++) {
+            vTable[Hash4(base + j)] = j;
+        }
+        i += nMatch;
+        nAnchor = i;
+
+        if (vOut.size() >= nSize) {
+            return false;
+        }
+    }
+    if (nAnchor < nEnd) {
+        PutSequence(vOut, base + nAnchor, nEnd - nAnchor, 0, 0);
+    }
+    return vOut.size() < nSize;
+}
+
+bool DecompressBlock(const uint8_t *pdata, size_t nSize,
+                     std::vector<uint8_t> &vOut) {
+    if (nSize < RECORD_HEADER_SIZE || pdata[0] != BLOCK_COMPRESSION_FORMAT) {
+        return false;
+    }
+    const uint32_t nRawSize = ReadLE32(pdata + 1);
+    if (nRawSize > MAX_SIZE) {
+        return false;
+    }
+
+    const size_t nTotal = sizeof(DICTIONARY) + nRawSize;
+    std::vector<uint8_t> vBuf;
+    // Matches copy from vBuf into itself, it must never reallocate.
+    vBuf.reserve(nTotal);
+    vBuf.assign(std::begin(DICTIONARY), std::end(DICTIONARY));
+
+    const uint8_t *p = pdata + RECORD_HEADER_SIZE;
+    const uint8_t *pend = pdata + nSize;
+    while (p != pend) {
+        const uint8_t nToken = *p++;
+        size_t nLit = nToken >> 4;
+        if (nLit == 15 && !GetLength(p, pend, nLit)) {
+            return false;
+        }
+        if (nLit > size_t(pend - p) || nLit > nTotal - vBuf.size()) {
+            return false;
+        }
+        vBuf.insert(vBuf.end(), p, p + nLit);
+        p += nLit;
+        if (p == pend) {
+            break;
+        }
+
+        if (pend - p < 2) {
+            return false;
+        }
+        const size_t nOffset = p[0] | (size_t(p[1]) << 8);
+        p += 2;
+        size_t nMatch = nToken & 15;
+        if (nMatch == 15 && !GetLength(p, pend, nMatch)) {
+            return false;
+        }
+        nMatch += MIN_MATCH;
+        if (nOffset == 0 || nOffset > vBuf.size() ||
+            nMatch > nTotal - vBuf.size()) {
+            return false;
+        }
+        // The match may overlap the bytes it produces.
+        const size_t nFrom = vBuf.size() - nOffset;
+        for (size_t j = 0; j < nMatch; j++) {
+            vBuf.push_back(vBuf[nFrom + j]);
+        }
+    }
+    if (vBuf.size() != nTotal) {
+        return false;
+    }
+
+    vOut.assign(vBuf.begin() + sizeof(DICTIONARY), vBuf.end());
+    return true;
+}
+
+CDecompressedBlockCache::CDecompressedBlockCache(size_t nMaxBytesIn)
+    : nMaxBytes(nMaxBytesIn), nBytes(0) {}
+
+std::shared_ptr<const std::vector<uint8_t>>
+CDecompressedBlockCache::Get(const CDiskBlockPos &pos) {
+    LOCK(cs);
+    auto it = mapBlocks.find(Key(pos.nFile, pos.nPos));
+    if (it == mapBlocks.end()) {
+        return nullptr;
+    }
+    listBlocks.splice(listBlocks.begin(), listBlocks, it->second);
+    return it->second->second;
+}
+
+void CDecompressedBlockCache::Put(
+    const CDiskBlockPos &pos,
+    const std::shared_ptr<const std::vector<uint8_t>> &data) {
+    if (data->size() > nMaxBytes) {
+        return;
+    }
+
+    LOCK(cs);
+    const Key key(pos.nFile, pos.nPos);
+    if (mapBlocks.count(key)) {
+        return;
+    }
+    listBlocks.emplace_front(key, data);
+    mapBlocks.emplace(key, listBlocks.begin());
+    nBytes += data->size();
+    while (nBytes > nMaxBytes) {
+        nBytes -= listBlocks.back().second->size();
+        mapBlocks.erase(listBlocks.back().first);
+        listBlocks.pop_back();
+    }
+}
+
+void CDecompressedBlockCache::EraseFile(int nFile) {
+    LOCK(cs);
+    auto it = mapBlocks.lower_bound(Key(nFile, 0));
+    while (it != mapBlocks.end() && it->first.first == nFile) {
+        nBytes -= it->second->second->size();
+        listBlocks.erase(it->second);
+        it = mapBlocks.erase(it);
+    }
+}
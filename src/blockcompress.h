@@ -0,0 +1,72 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCOMPRESS_H
+#define BITCOIN_BLOCKCOMPRESS_H
+
+#include "chain.h"
+#include "sync.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+
+/** Default for -blockcompression */
+static const bool DEFAULT_BLOCK_COMPRESSION = false;
+/** Set in the size field of a block record whose data is compressed */
+static const uint32_t BLOCK_COMPRESSED_FLAG = 0x80000000;
+/** Format of the compressed records written now */
+static const uint8_t BLOCK_COMPRESSION_FORMAT = 1;
+/** Bytes of decompressed blocks kept for repeated reads */
+static const size_t MAX_DECOMPRESSED_BLOCK_CACHE = 32 << 20;
+
+/**
+ * Compress a serialized block into a block file record. The record starts
+ * with the format, which picks the dictionary, and the uncompressed size.
+ * Returns false if compressing doesn't make the block smaller.
+ *
+ * The codec is a plain LZ77 with 64 KiB of history, in the sequence format of
+ * LZ4. The history starts out holding a dictionary of the byte sequences that
+ * are common in transactions, so that even small blocks compress.
+ */
+bool CompressBlock(const uint8_t *pdata, size_t nSize,
+                   std::vector<uint8_t> &vOut);
+/** Undo CompressBlock. Returns false if the record is corrupt. */
+bool DecompressBlock(const uint8_t *pdata, size_t nSize,
+                     std::vector<uint8_t> &vOut);
+
+/**
+ * Recently decompressed blocks, by where their records are, so that a block
+ * served to several peers in a row is only decompressed once.
+ */
+class CDecompressedBlockCache {
+public:
+    explicit CDecompressedBlockCache(
+        size_t nMaxBytesIn = MAX_DECOMPRESSED_BLOCK_CACHE);
+
+    std::shared_ptr<const std::vector<uint8_t>>
+    Get(const CDiskBlockPos &pos);
+    void Put(const CDiskBlockPos &pos,
+             const std::shared_ptr<const std::vector<uint8_t>> &data);
+    /** Forget the blocks of a file, e.g. when it is deleted. */
+    void EraseFile(int nFile);
+
+private:
+    typedef std::pair<int, unsigned int> Key;
+    typedef std::shared_ptr<const std::vector<uint8_t>> Block;
+    typedef std::list<std::pair<Key, Block>> List;
+
+    const size_t nMaxBytes;
+
+    CCriticalSection cs;
+    //! Most recently used first.
+    List listBlocks;
+    std::map<Key, List::iterator> mapBlocks;
+    size_t nBytes;
+};
+
+#endif // BITCOIN_BLOCKCOMPRESS_H
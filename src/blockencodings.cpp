@@ -16,16 +16,26 @@
 
 #include <unordered_map>
 
-CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock &block)
-    : nonce(GetRand(std::numeric_limits<uint64_t>::max())),
-      shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block) {
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock &block,
+                                                     const PrefillFn &fPrefill)
+    : nonce(GetRand(std::numeric_limits<uint64_t>::max())), prefilledtxn(1),
+      header(block) {
     FillShortTxIDSelector();
-    // TODO: Use our mempool prior to block acceptance to predictively fill more
-    // than just the coinbase.
+    shorttxids.reserve(block.vtx.size() - 1);
     prefilledtxn[0] = {0, block.vtx[0]};
+    // Prefilled indexes are stored as the distance from the previous one.
+    size_t lastprefilledindex = 0;
     for (size_t i = 1; i < block.vtx.size(); i++) {
         const CTransaction &tx = *block.vtx[i];
-        shorttxids[i - 1] = GetShortID(tx.GetHash());
+        if (fPrefill &&
+            i - lastprefilledindex - 1 <= std::numeric_limits<uint16_t>::max() &&
+            fPrefill(tx)) {
+            prefilledtxn.push_back(
+                {uint16_t(i - lastprefilledindex - 1), block.vtx[i]});
+            lastprefilledindex = i;
+        } else {
+            shorttxids.push_back(GetShortID(tx.GetHash()));
+        }
     }
 }
 
@@ -7,6 +7,7 @@
 
 #include "primitives/block.h"
 
+#include <functional>
 #include <memory>
 
 class Config;
@@ -159,7 +160,13 @@ public:
     // Dummy for deserialization
     CBlockHeaderAndShortTxIDs() {}
 
-    CBlockHeaderAndShortTxIDs(const CBlock &block);
+    /**
+     * Transactions for which fPrefill returns true are sent in full along
+     * with the coinbase, for those the receiver is unlikely to have.
+     */
+    typedef std::function<bool(const CTransaction &)> PrefillFn;
+    CBlockHeaderAndShortTxIDs(const CBlock &block,
+                              const PrefillFn &fPrefill = PrefillFn());
 
     uint64_t GetShortID(const uint256 &txhash) const;
 
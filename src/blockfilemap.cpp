@@ -0,0 +1,123 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "util.h"
+
+#include <algorithm>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Reads starting this close after the end of the previous one count as
+// sequential; blocks are separated by their index header.
+static const size_t SEQUENTIAL_READ_GAP = 4096;
+
+CMappedBlockFile::CMappedBlockFile(const uint8_t *pdataIn, size_t nSizeIn)
+    : pdata(pdataIn), nSize(nSizeIn), nNextPos(0) {}
+
+CMappedBlockFile::~CMappedBlockFile() {
+#ifndef WIN32
+    munmap(const_cast<uint8_t *>(pdata), nSize);
+#endif
+}
+
+const uint8_t *CMappedBlockFile::Get(size_t nPos, size_t nLen) const {
+    if (nPos > nSize || nLen > nSize - nPos) {
+        return nullptr;
+    }
+
+#ifndef WIN32
+    static const size_t nPageSize = sysconf(_SC_PAGESIZE);
+    const size_t nEnd = nPos + nLen;
+    size_t nAdviseEnd = nEnd;
+    const size_t nPrevEnd = nNextPos.exchange(nEnd);
+    if (nPos >= nPrevEnd && nPos - nPrevEnd <= SEQUENTIAL_READ_GAP) {
+        nAdviseEnd = std::min(nSize, nEnd + BLOCK_FILE_READAHEAD);
+    }
+    const size_t nAdviseBegin = nPos - nPos % nPageSize;
+    madvise(const_cast<uint8_t *>(pdata) + nAdviseBegin,
+            nAdviseEnd - nAdviseBegin, MADV_WILLNEED);
+#endif
+
+    return pdata + nPos;
+}
+
+std::shared_ptr<const CMappedBlockFile>
+CMappedBlockFile::Open(const boost::filesystem::path &path, bool fSequential) {
+#ifdef WIN32
+    return nullptr;
+#else
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+    void *pdata = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file.
+    close(fd);
+    if (pdata == MAP_FAILED) {
+        LogPrint("db", "Could not map %s\n", path.string());
+        return nullptr;
+    }
+    // For random access each read asks for its own readahead, so that serving
+    // random blocks to peers doesn't pull in the neighbouring ones.
+    madvise(pdata, st.st_size, fSequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    return std::make_shared<const CMappedBlockFile>(
+        static_cast<const uint8_t *>(pdata), st.st_size);
+#endif
+}
+
+CBlockFileMap::CBlockFileMap(size_t nMaxFilesIn)
+    : nMaxFiles(nMaxFilesIn), nUseCounter(0) {}
+
+std::shared_ptr<const CMappedBlockFile>
+CBlockFileMap::Get(int nFile, const boost::filesystem::path &path) {
+    if (nMaxFiles == 0) {
+        return nullptr;
+    }
+
+    LOCK(cs);
+    auto it = mapFiles.find(nFile);
+    if (it != mapFiles.end()) {
+        it->second.nLastUsed = ++nUseCounter;
+        return it->second.file;
+    }
+
+    std::shared_ptr<const CMappedBlockFile> file =
+        CMappedBlockFile::Open(path);
+    if (!file) {
+        return nullptr;
+    }
+
+    if (mapFiles.size() >= nMaxFiles) {
+        auto itOldest = mapFiles.begin();
+        for (auto itFile = mapFiles.begin(); itFile != mapFiles.end();
+             ++itFile) {
+            if (itFile->second.nLastUsed < itOldest->second.nLastUsed) {
+                itOldest = itFile;
+            }
+        }
+        mapFiles.erase(itOldest);
+    }
+
+    Entry &entry = mapFiles[nFile];
+    entry.file = file;
+    entry.nLastUsed = ++nUseCounter;
+    return file;
+}
+
+void CBlockFileMap::Erase(int nFile) {
+    LOCK(cs);
+    mapFiles.erase(nFile);
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include "sync.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+
+#include <boost/filesystem/path.hpp>
+
+/** Maximum number of block files kept mapped. None on 32-bit systems, which
+ * don't have the address space for them. */
+static const size_t MAX_MAPPED_BLOCK_FILES = sizeof(void *) >= 8 ? 64 : 0;
+/** Bytes prefetched past a read that continues where the previous read of the
+ * same file ended */
+static const size_t BLOCK_FILE_READAHEAD = 4 << 20;
+
+/**
+ * A block file mapped read-only into memory. The mapping goes away with the
+ * last reference to it.
+ */
+class CMappedBlockFile {
+public:
+    CMappedBlockFile(const uint8_t *pdataIn, size_t nSizeIn);
+    ~CMappedBlockFile();
+
+    /**
+     * Map the file at path, or return nullptr if it can't be. A file that
+     * is going to be read front to back once is advised as such, otherwise
+     * reads are expected all over the file.
+     */
+    static std::shared_ptr<const CMappedBlockFile>
+    Open(const boost::filesystem::path &path, bool fSequential = false);
+
+    const uint8_t *data() const { return pdata; }
+    size_t size() const { return nSize; }
+
+    /**
+     * The nLen bytes at nPos, or nullptr if they are not all in the file.
+     * The kernel is asked to page them in, and the readahead after them too
+     * when reads are going through the file in order.
+     */
+    const uint8_t *Get(size_t nPos, size_t nLen) const;
+
+private:
+    CMappedBlockFile(const CMappedBlockFile &);
+    CMappedBlockFile &operator=(const CMappedBlockFile &);
+
+    const uint8_t *const pdata;
+    const size_t nSize;
+    //! Where the last read ended, to tell sequential scans from random reads.
+    mutable std::atomic<size_t> nNextPos;
+};
+
+/**
+ * Read-only memory maps of finalized block files, so blocks are deserialized
+ * straight from the page cache instead of going through stdio.
+ *
+ * Only files that are no longer written to may be mapped. The least recently
+ * used mapping is dropped once there are nMaxFiles of them.
+ */
+class CBlockFileMap {
+public:
+    explicit CBlockFileMap(size_t nMaxFilesIn = MAX_MAPPED_BLOCK_FILES);
+
+    /** The mapping of file nFile at path, or nullptr if it can't be mapped. */
+    std::shared_ptr<const CMappedBlockFile>
+    Get(int nFile, const boost::filesystem::path &path);
+    /** Drop the mapping of a file, e.g. before it is deleted. */
+    void Erase(int nFile);
+
+private:
+    struct Entry {
+        std::shared_ptr<const CMappedBlockFile> file;
+        uint64_t nLastUsed;
+    };
+
+    const size_t nMaxFiles;
+
+    CCriticalSection cs;
+    std::map<int, Entry> mapFiles;
+    uint64_t nUseCounter;
+};
+
+#endif // BITCOIN_BLOCKFILEMAP_H
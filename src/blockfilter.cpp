@@ -0,0 +1,239 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "crypto/common.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "streams.h"
+#include "undo.h"
+#include "version.h"
+
+#include <algorithm>
+#include <ios>
+
+/** (x * n) >> 64, which maps a 64 bit hash x uniformly into [0, n) */
+static uint64_t MapIntoRange(uint64_t x, uint64_t n) {
+    const uint64_t xHi = x >> 32, xLo = uint32_t(x);
+    const uint64_t nHi = n >> 32, nLo = uint32_t(n);
+    const uint64_t nMid1 = xHi * nLo, nMid2 = xLo * nHi;
+    const uint64_t nCarry =
+        ((xLo * nLo >> 32) + uint32_t(nMid1) + uint32_t(nMid2)) >> 32;
+    return xHi * nHi + (nMid1 >> 32) + (nMid2 >> 32) + nCarry;
+}
+
+/** Appends bits to a byte vector, most significant bit first */
+class CBitWriter {
+public:
+    explicit CBitWriter(std::vector<uint8_t> &vchIn) : vch(vchIn), nBits(0) {}
+
+    void Write(uint64_t nValue, int nCount) {
+        while (nCount > 0) {
+            if (nBits == 0) {
+                vch.push_back(0);
+                nBits = 8;
+            }
+            const int nTake = std::min(nCount, nBits);
+            const uint8_t nChunk =
+                (nValue >> (nCount - nTake)) & ((1 << nTake) - 1);
+            vch.back() |= nChunk << (nBits - nTake);
+            nBits -= nTake;
+            nCount -= nTake;
+        }
+    }
+
+private:
+    std::vector<uint8_t> &vch;
+    //! Bits left in the last byte
+    int nBits;
+};
+
+/** Reads the bits CBitWriter wrote, from nPos on */
+class CBitReader {
+public:
+    CBitReader(const std::vector<uint8_t> &vchIn, size_t nPosIn)
+        : vch(vchIn), nPos(nPosIn), nBits(0) {}
+
+    uint64_t Read(int nCount) {
+        uint64_t nValue = 0;
+        while (nCount > 0) {
+            if (nBits == 0) {
+                if (nPos == vch.size()) {
+                    throw std::ios_base::failure("CBitReader: end of data");
+                }
+                nByte = vch[nPos++];
+                nBits = 8;
+            }
+            const int nTake = std::min(nCount, nBits);
+            nValue = (nValue << nTake) |
+                     ((nByte >> (nBits - nTake)) & ((1 << nTake) - 1));
+            nBits -= nTake;
+            nCount -= nTake;
+        }
+        return nValue;
+    }
+
+    /** A Golomb-Rice coded value */
+    uint64_t ReadGolombRice(uint8_t nP) {
+        uint64_t nQuotient = 0;
+        while (Read(1) == 1) {
+            nQuotient++;
+        }
+        return (nQuotient << nP) | Read(nP);
+    }
+
+private:
+    const std::vector<uint8_t> &vch;
+    size_t nPos;
+    uint8_t nByte;
+    int nBits;
+};
+
+CGCSFilter::CGCSFilter(uint64_t nSipHashK0In, uint64_t nSipHashK1In,
+                       uint8_t nPIn, uint32_t nMIn)
+    : nSipHashK0(nSipHashK0In), nSipHashK1(nSipHashK1In), nP(nPIn), nM(nMIn),
+      nN(0), nF(0) {
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, vchEncoded, 0,
+                  COMPACTSIZE(uint64_t(nN)));
+}
+
+CGCSFilter::CGCSFilter(uint64_t nSipHashK0In, uint64_t nSipHashK1In,
+                       uint8_t nPIn, uint32_t nMIn,
+                       std::vector<uint8_t> vchEncodedIn)
+    : nSipHashK0(nSipHashK0In), nSipHashK1(nSipHashK1In), nP(nPIn), nM(nMIn),
+      vchEncoded(std::move(vchEncodedIn)) {
+    CDataStream stream(vchEncoded, SER_NETWORK, PROTOCOL_VERSION);
+    const uint64_t nNIn = ReadCompactSize(stream);
+    nN = nNIn;
+    if (nN != nNIn) {
+        throw std::ios_base::failure("CGCSFilter: N too large");
+    }
+    nF = uint64_t(nN) * nM;
+
+    // Each of the values must be there.
+    CBitReader reader(vchEncoded, vchEncoded.size() - stream.size());
+    for (uint32_t i = 0; i < nN; i++) {
+        reader.ReadGolombRice(nP);
+    }
+}
+
+CGCSFilter::CGCSFilter(uint64_t nSipHashK0In, uint64_t nSipHashK1In,
+                       uint8_t nPIn, uint32_t nMIn, const ElementSet &elements)
+    : nSipHashK0(nSipHashK0In), nSipHashK1(nSipHashK1In), nP(nPIn), nM(nMIn),
+      nN(elements.size()), nF(uint64_t(elements.size()) * nMIn) {
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, vchEncoded, 0,
+                  COMPACTSIZE(uint64_t(nN)));
+
+    std::vector<uint64_t> vHashes;
+    vHashes.reserve(elements.size());
+    for (const Element &element : elements) {
+        vHashes.push_back(HashToRange(element));
+    }
+    std::sort(vHashes.begin(), vHashes.end());
+
+    CBitWriter writer(vchEncoded);
+    uint64_t nLast = 0;
+    for (uint64_t nHash : vHashes) {
+        const uint64_t nDelta = nHash - nLast;
+        // The quotient in unary, then the remainder.
+        for (uint64_t nQuotient = nDelta >> nP; nQuotient > 0;) {
+            const int nOnes = std::min<uint64_t>(nQuotient, 32);
+            writer.Write((uint64_t(1) << nOnes) - 1, nOnes);
+            nQuotient -= nOnes;
+        }
+        writer.Write(0, 1);
+        writer.Write(nDelta, nP);
+        nLast = nHash;
+    }
+}
+
+uint64_t CGCSFilter::HashToRange(const Element &element) const {
+    const uint64_t nHash = CSipHasher(nSipHashK0, nSipHashK1)
+                               .Write(element.data(), element.size())
+                               .Finalize();
+    return MapIntoRange(nHash, nF);
+}
+
+bool CGCSFilter::MatchHashes(const std::vector<uint64_t> &vHashes) const {
+    CDataStream stream(vchEncoded, SER_NETWORK, PROTOCOL_VERSION);
+    ReadCompactSize(stream);
+    CBitReader reader(vchEncoded, vchEncoded.size() - stream.size());
+
+    // Walk both sorted lists at once.
+    uint64_t nValue = 0;
+    size_t nHash = 0;
+    for (uint32_t i = 0; i < nN && nHash < vHashes.size(); i++) {
+        nValue += reader.ReadGolombRice(nP);
+        while (nHash < vHashes.size() && vHashes[nHash] < nValue) {
+            nHash++;
+        }
+        if (nHash < vHashes.size() && vHashes[nHash] == nValue) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CGCSFilter::Match(const Element &element) const {
+    return MatchHashes(std::vector<uint64_t>(1, HashToRange(element)));
+}
+
+bool CGCSFilter::MatchAny(const ElementSet &elements) const {
+    std::vector<uint64_t> vHashes;
+    vHashes.reserve(elements.size());
+    for (const Element &element : elements) {
+        vHashes.push_back(HashToRange(element));
+    }
+    std::sort(vHashes.begin(), vHashes.end());
+    return MatchHashes(vHashes);
+}
+
+static CGCSFilter::ElementSet GetBasicFilterElements(const CBlock &block,
+                                                     const CBlockUndo &undo) {
+    CGCSFilter::ElementSet elements;
+    for (const CTransactionRef &tx : block.vtx) {
+        for (const CTxOut &out : tx->vout) {
+            const CScript &script = out.scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN) {
+                continue;
+            }
+            elements.emplace(script.begin(), script.end());
+        }
+    }
+    for (const CTxUndo &txundo : undo.vtxundo) {
+        for (const Coin &coin : txundo.vprevout) {
+            const CScript &script = coin.GetTxOut().scriptPubKey;
+            if (script.empty()) {
+                continue;
+            }
+            elements.emplace(script.begin(), script.end());
+        }
+    }
+    return elements;
+}
+
+CBlockFilter::CBlockFilter(const CBlock &block, const CBlockUndo &blockUndo)
+    : hashBlock(block.GetHash()),
+      filter(ReadLE64(hashBlock.begin()), ReadLE64(hashBlock.begin() + 8),
+             BASIC_FILTER_P, BASIC_FILTER_M,
+             GetBasicFilterElements(block, blockUndo)) {}
+
+CBlockFilter::CBlockFilter(const uint256 &hashBlockIn,
+                           std::vector<uint8_t> vchEncodedFilter)
+    : hashBlock(hashBlockIn),
+      filter(ReadLE64(hashBlock.begin()), ReadLE64(hashBlock.begin() + 8),
+             BASIC_FILTER_P, BASIC_FILTER_M, std::move(vchEncodedFilter)) {}
+
+uint256 CBlockFilter::GetHash() const {
+    const std::vector<uint8_t> &vch = GetEncodedFilter();
+    return Hash(vch.begin(), vch.end());
+}
+
+uint256 CBlockFilter::ComputeHeader(const uint256 &hashPrevHeader) const {
+    const uint256 hashFilter = GetHash();
+    return Hash(hashFilter.begin(), hashFilter.end(), hashPrevHeader.begin(),
+                hashPrevHeader.end());
+}
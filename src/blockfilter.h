@@ -0,0 +1,108 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+/** The basic block filter of BIP 158 */
+static const uint8_t BLOCK_FILTER_BASIC = 0;
+static const uint8_t BASIC_FILTER_P = 19;
+static const uint32_t BASIC_FILTER_M = 784931;
+
+/**
+ * A Golomb-coded set as BIP 158 defines it: the elements are hashed with
+ * SipHash into [0, N * M), sorted, and the differences of the hashes are
+ * Golomb-Rice coded with parameter P. An element that isn't in the set
+ * matches with a probability of about 1 / M.
+ */
+class CGCSFilter {
+public:
+    typedef std::vector<uint8_t> Element;
+    typedef std::set<Element> ElementSet;
+
+    /** An empty filter */
+    CGCSFilter(uint64_t nSipHashK0In = 0, uint64_t nSipHashK1In = 0,
+               uint8_t nPIn = BASIC_FILTER_P, uint32_t nMIn = BASIC_FILTER_M);
+    /** The filter encoded as vchEncoded, which must be well formed */
+    CGCSFilter(uint64_t nSipHashK0In, uint64_t nSipHashK1In, uint8_t nPIn,
+               uint32_t nMIn, std::vector<uint8_t> vchEncodedIn);
+    /** The filter of elements */
+    CGCSFilter(uint64_t nSipHashK0In, uint64_t nSipHashK1In, uint8_t nPIn,
+               uint32_t nMIn, const ElementSet &elements);
+
+    uint32_t GetN() const { return nN; }
+    const std::vector<uint8_t> &GetEncoded() const { return vchEncoded; }
+
+    /** Whether element may be in the set */
+    bool Match(const Element &element) const;
+    /** Whether any of elements may be in the set, faster than one by one */
+    bool MatchAny(const ElementSet &elements) const;
+
+private:
+    uint64_t HashToRange(const Element &element) const;
+    //! Whether any of the sorted hashes is in the set
+    bool MatchHashes(const std::vector<uint64_t> &vHashes) const;
+
+    uint64_t nSipHashK0;
+    uint64_t nSipHashK1;
+    uint8_t nP;
+    uint32_t nM;
+    uint32_t nN;
+    uint64_t nF;
+    std::vector<uint8_t> vchEncoded;
+};
+
+/**
+ * The basic filter of a block: the scripts its outputs pay to but data
+ * carriers, and the scripts of the outputs its inputs spend, which come from
+ * the undo data. Keyed by the block hash.
+ */
+class CBlockFilter {
+public:
+    CBlockFilter() {}
+    CBlockFilter(const CBlock &block, const CBlockUndo &blockUndo);
+    CBlockFilter(const uint256 &hashBlockIn,
+                 std::vector<uint8_t> vchEncodedFilter);
+
+    const uint256 &GetBlockHash() const { return hashBlock; }
+    const CGCSFilter &GetFilter() const { return filter; }
+    const std::vector<uint8_t> &GetEncodedFilter() const {
+        return filter.GetEncoded();
+    }
+
+    /** The hash of the encoded filter */
+    uint256 GetHash() const;
+    /** The filter header, which commits to those of all earlier blocks */
+    uint256 ComputeHeader(const uint256 &hashPrevHeader) const;
+
+private:
+    uint256 hashBlock;
+    CGCSFilter filter;
+};
+
+/** What the block filter index keeps of a block */
+struct CBlockFilterEntry {
+    std::vector<uint8_t> vchFilter;
+    uint256 hashHeader;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(vchFilter);
+        READWRITE(hashHeader);
+    }
+};
+
+#endif // BITCOIN_BLOCKFILTER_H
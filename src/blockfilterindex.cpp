@@ -0,0 +1,121 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilterindex.h"
+
+#include "blockfilter.h"
+#include "chain.h"
+#include "primitives/block.h"
+#include "txdb.h"
+#include "undo.h"
+#include "util.h"
+#include "validation.h"
+
+#include <ios>
+#include <utility>
+#include <vector>
+
+std::unique_ptr<CBlockFilterIndex> g_blockfilterindex;
+
+CBlockFilterIndex::CBlockFilterIndex(const Config &configIn, bool fDrop)
+    : CBaseIndex(configIn, fDrop, "blockfilter", "block filter index",
+                 "blockfilterindex") {
+    Start();
+}
+
+CBlockFilterIndex::~CBlockFilterIndex() {
+    Stop();
+}
+
+bool CBlockFilterIndex::LookupFilter(const CBlockIndex *pindex,
+                                     CBlockFilter &filter) const {
+    CBlockFilterEntry entry;
+    if (!pblocktree->ReadBlockFilter(pindex->GetBlockHash(), entry)) {
+        return false;
+    }
+    try {
+        filter =
+            CBlockFilter(pindex->GetBlockHash(), std::move(entry.vchFilter));
+    } catch (const std::ios_base::failure &e) {
+        return error("%s: filter of block %s is corrupt", __func__,
+                     pindex->GetBlockHash().ToString());
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHeader(const CBlockIndex *pindex,
+                                           uint256 &hashHeader) const {
+    CBlockFilterEntry entry;
+    if (!pblocktree->ReadBlockFilter(pindex->GetBlockHash(), entry)) {
+        return false;
+    }
+    hashHeader = entry.hashHeader;
+    return true;
+}
+
+bool CBlockFilterIndex::ReadBestBlock(uint256 &hashBest) {
+    return pblocktree->ReadBlockFilterIndexBestBlock(hashBest);
+}
+
+bool CBlockFilterIndex::EraseBestBlock() {
+    return pblocktree->EraseBlockFilterIndexBestBlock();
+}
+
+bool CBlockFilterIndex::EraseEntries(size_t nBatch, size_t &nErased) {
+    return pblocktree->EraseBlockFilterIndex(nBatch, nErased);
+}
+
+bool CBlockFilterIndex::Resume(const CBlockIndex *pindex) {
+    return LookupFilterHeader(pindex, hashHeader);
+}
+
+bool CBlockFilterIndex::WriteBlocks(
+    const std::vector<const CBlockIndex *> &vBlocks) {
+    std::vector<std::pair<uint256, CBlockFilterEntry>> vFilters;
+    vFilters.reserve(vBlocks.size());
+    uint256 hashPrevHeader = hashHeader;
+    for (const CBlockIndex *pindex : vBlocks) {
+        if (IsStopped()) {
+            return false;
+        }
+        CBlock block;
+        CBlockUndo blockUndo;
+        bool fRead = ReadBlockFromDisk(block, pindex, config);
+        // The genesis block spends nothing and has no undo data.
+        if (fRead && pindex->pprev) {
+            const CDiskBlockPos pos = pindex->GetUndoPos();
+            fRead = !pos.IsNull() &&
+                    UndoReadFromDisk(blockUndo, pos,
+                                     pindex->pprev->GetBlockHash());
+        }
+        if (!fRead) {
+            return error("%s: failed to read block %s", __func__,
+                         pindex->GetBlockHash().ToString());
+        }
+
+        const CBlockFilter filter(block, blockUndo);
+        CBlockFilterEntry entry;
+        entry.vchFilter = filter.GetEncodedFilter();
+        entry.hashHeader = filter.ComputeHeader(hashPrevHeader);
+        hashPrevHeader = entry.hashHeader;
+        vFilters.emplace_back(pindex->GetBlockHash(), entry);
+    }
+
+    if (!pblocktree->WriteBlockFilters(vFilters,
+                                       vBlocks.back()->GetBlockHash())) {
+        return error("%s: failed to write the block filter index", __func__);
+    }
+    hashHeader = hashPrevHeader;
+    return true;
+}
+
+bool CBlockFilterIndex::Rewind(const CBlockIndex *pindexFork) {
+    if (!LookupFilterHeader(pindexFork, hashHeader) ||
+        !pblocktree->WriteBlockFilterIndexBestBlock(
+            pindexFork->GetBlockHash())) {
+        return error("%s: failed to go back to block %s", __func__,
+                     pindexFork->GetBlockHash().ToString());
+    }
+    return true;
+}
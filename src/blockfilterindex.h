@@ -0,0 +1,70 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTERINDEX_H
+#define BITCOIN_BLOCKFILTERINDEX_H
+
+#include "baseindex.h"
+#include "uint256.h"
+
+#include <cstddef>
+#include <memory>
+
+class CBlockFilter;
+class CBlockIndex;
+class Config;
+
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
+/** Blocks the block filter index writes in one batch */
+static const size_t BLOCKFILTERINDEX_BATCH_BLOCKS = 1000;
+/** Filters erased in one batch when the block filter index is dropped */
+static const size_t BLOCKFILTERINDEX_ERASE_BATCH = 100000;
+
+/**
+ * Maintains the BIP 158 basic filters of the blocks. The filters are built
+ * from the blocks and their undo data, which have the scripts the inputs
+ * spend, and kept by block hash with their headers.
+ *
+ * The filters of blocks that are disconnected stay, they are still right for
+ * those blocks. After a reorganization the index continues from the fork.
+ */
+class CBlockFilterIndex : public CBaseIndex {
+public:
+    CBlockFilterIndex(const Config &configIn, bool fDrop);
+    ~CBlockFilterIndex();
+
+    /** The filter of pindex. Returns false if it wasn't built yet. */
+    bool LookupFilter(const CBlockIndex *pindex, CBlockFilter &filter) const;
+    /** The filter header of pindex. Returns false if it wasn't built yet. */
+    bool LookupFilterHeader(const CBlockIndex *pindex,
+                            uint256 &hashHeader) const;
+
+protected:
+    bool ReadBestBlock(uint256 &hashBest) override;
+    bool EraseBestBlock() override;
+    bool EraseEntries(size_t nBatch, size_t &nErased) override;
+    size_t GetEraseBatch() const override {
+        return BLOCKFILTERINDEX_ERASE_BATCH;
+    }
+    bool Resume(const CBlockIndex *pindex) override;
+    //! The filters of an interrupted build are right, there is no need to
+    //! start over without them.
+    bool EraseToStartOver() const override { return false; }
+    bool IsBatchFull(size_t nBlocks, size_t nTransactions) const override {
+        return nBlocks >= BLOCKFILTERINDEX_BATCH_BLOCKS;
+    }
+    bool WriteBlocks(const std::vector<const CBlockIndex *> &vBlocks) override;
+    bool Rewind(const CBlockIndex *pindexFork) override;
+
+private:
+    //! The filter header of the best block, only used by the thread
+    uint256 hashHeader;
+};
+
+/** The block filter index thread, building the index with -blockfilterindex
+ * or dropping it without */
+extern std::unique_ptr<CBlockFilterIndex> g_blockfilterindex;
+
+#endif // BITCOIN_BLOCKFILTERINDEX_H
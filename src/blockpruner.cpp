@@ -0,0 +1,260 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockpruner.h"
+
+#include "chain.h"
+#include "coins.h"
+#include "primitives/block.h"
+#include "txdb.h"
+#include "util.h"
+#include "validation.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+
+std::unique_ptr<CBlockPruner> g_blockpruner;
+
+CBlockPruner::CBlockPruner(const Config &configIn, bool fArchiveIn,
+                           bool fDropArchiveIn)
+    : config(configIn), fArchive(fArchiveIn), fDropArchive(fDropArchiveIn),
+      fWork(true), fStop(false), fFailed(false), nManualPruneHeight(0),
+      nPassesStarted(0), nPassesDone(0), pindexArchive(nullptr) {
+    RegisterValidationInterface(this);
+    thread = std::thread(
+        &TraceThread<std::function<void()>>, "pruner",
+        std::function<void()>(std::bind(&CBlockPruner::ThreadPrune, this)));
+}
+
+CBlockPruner::~CBlockPruner() {
+    UnregisterValidationInterface(this);
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+    }
+    cond.notify_all();
+    thread.join();
+}
+
+void CBlockPruner::UpdatedBlockTip(const CBlockIndex *pindexNew,
+                                   const CBlockIndex *pindexFork,
+                                   bool fInitialDownload) {
+    Wake();
+}
+
+void CBlockPruner::Wake() {
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fWork = true;
+    }
+    cond.notify_all();
+}
+
+void CBlockPruner::Prune(int nManualPruneHeightIn) {
+    std::unique_lock<std::mutex> lock(cs);
+    nManualPruneHeight = std::max(nManualPruneHeight, nManualPruneHeightIn);
+    fWork = true;
+    // The next pass to start takes the height.
+    const uint64_t nPass = nPassesStarted + 1;
+    cond.notify_all();
+    cond.wait(lock, [this, nPass] {
+        return fStop || fFailed || nPassesDone >= nPass;
+    });
+}
+
+bool CBlockPruner::WaitForWork(int &nManualPruneHeightOut) {
+    std::unique_lock<std::mutex> lock(cs);
+    cond.wait(lock, [this] { return fStop || fWork; });
+    fWork = false;
+    nManualPruneHeightOut = nManualPruneHeight;
+    nManualPruneHeight = 0;
+    nPassesStarted++;
+    return !fStop;
+}
+
+bool CBlockPruner::IsStopped() {
+    std::lock_guard<std::mutex> lock(cs);
+    return fStop;
+}
+
+bool CBlockPruner::LookupContent(const COutPoint &outpoint,
+                                 std::string &strContent) const {
+    if (!fArchive) {
+        return false;
+    }
+    // Taken first: the contents up to it are all written.
+    const CBlockIndex *pindex = pindexArchive;
+    if (!pindex) {
+        return false;
+    }
+    if (pblocktree->ReadArchivedContent(outpoint, strContent)) {
+        return true;
+    }
+    // Outputs without content aren't archived. An unspent output that the
+    // archive has gone past has none.
+    LOCK(cs_main);
+    const Coin &coin = pcoinsTip->AccessCoin(outpoint);
+    if (coin.IsSpent() || int(coin.GetHeight()) > pindex->nHeight) {
+        return false;
+    }
+    strContent.clear();
+    return true;
+}
+
+bool CBlockPruner::DropArchive() {
+    LogPrintf("Dropping the content archive\n");
+    if (!pblocktree->EraseContentArchiveBestBlock()) {
+        return error("%s: failed to erase the content archive", __func__);
+    }
+    while (!IsStopped()) {
+        size_t nErased;
+        if (!pblocktree->EraseContentArchive(CONTENTARCHIVE_ERASE_BATCH,
+                                             nErased)) {
+            return error("%s: failed to erase the content archive", __func__);
+        }
+        if (nErased < CONTENTARCHIVE_ERASE_BATCH) {
+            pblocktree->WriteFlag("contentarchive", false);
+            LogPrintf("Content archive dropped\n");
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CBlockPruner::UpdateArchive() {
+    while (!IsStopped()) {
+        std::vector<const CBlockIndex *> vBlocks;
+        {
+            LOCK(cs_main);
+            const CBlockIndex *pindex = pindexArchive;
+            if (pindex && !chainActive.Contains(pindex)) {
+                // The spent outputs that would be back are erased already.
+                return error("%s: block %s was disconnected, deeper than "
+                             "-prunedepth, the content archive needs -reindex",
+                             __func__, pindex->GetBlockHash().ToString());
+            }
+            const int nFinalHeight = chainActive.Height() - nPruneDepth;
+            pindex = pindex ? chainActive.Next(pindex) : chainActive.Genesis();
+            for (; pindex && pindex->nHeight <= nFinalHeight &&
+                   vBlocks.size() < CONTENTARCHIVE_BATCH_BLOCKS;
+                 pindex = chainActive.Next(pindex)) {
+                vBlocks.push_back(pindex);
+            }
+        }
+        if (vBlocks.empty()) {
+            return true;
+        }
+
+        // Outputs created and spent within the batch are never written.
+        std::map<COutPoint, std::string> mapAdded;
+        CContentArchiveUpdate update;
+        const CBlockIndex *pindexLast = nullptr;
+        size_t nBytes = 0;
+        for (const CBlockIndex *pindex : vBlocks) {
+            if (IsStopped()) {
+                return true;
+            }
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindex, config)) {
+                return error("%s: failed to read block %s", __func__,
+                             pindex->GetBlockHash().ToString());
+            }
+            for (const CTransactionRef &tx : block.vtx) {
+                if (!tx->IsCoinBase()) {
+                    for (const CTxIn &txin : tx->vin) {
+                        auto it = mapAdded.find(txin.prevout);
+                        if (it != mapAdded.end()) {
+                            nBytes -= it->second.size();
+                            mapAdded.erase(it);
+                        } else if (pblocktree->HaveArchivedContent(
+                                       txin.prevout)) {
+                            update.vErased.push_back(txin.prevout);
+                        }
+                    }
+                }
+                for (size_t i = 0; i < tx->vout.size(); i++) {
+                    const std::string &strContent = tx->vout[i].strContent;
+                    if (!strContent.empty()) {
+                        mapAdded.emplace(COutPoint(tx->GetId(), i),
+                                         strContent);
+                        nBytes += strContent.size();
+                    }
+                }
+            }
+            pindexLast = pindex;
+            if (nBytes >= CONTENTARCHIVE_BATCH_SIZE) {
+                break;
+            }
+        }
+
+        update.vAdded.reserve(mapAdded.size());
+        for (auto &entry : mapAdded) {
+            update.vAdded.emplace_back(entry.first, std::move(entry.second));
+        }
+        if (!pblocktree->UpdateContentArchive(update,
+                                              pindexLast->GetBlockHash())) {
+            return error("%s: failed to write the content archive", __func__);
+        }
+        pindexArchive = pindexLast;
+        LogPrint("prune", "Content archive updated to height %d, %u contents "
+                          "added, %u erased\n",
+                 pindexLast->nHeight, update.vAdded.size(),
+                 update.vErased.size());
+    }
+    return true;
+}
+
+void CBlockPruner::ThreadPrune() {
+    bool fOk = true;
+    if (fDropArchive) {
+        fOk = DropArchive();
+    }
+    if (fOk && fArchive) {
+        uint256 hashBest;
+        if (pblocktree->ReadContentArchiveBestBlock(hashBest)) {
+            LOCK(cs_main);
+            BlockMap::const_iterator it = mapBlockIndex.find(hashBest);
+            if (it != mapBlockIndex.end()) {
+                pindexArchive = it->second;
+            }
+        }
+        if (!pindexArchive) {
+            LogPrintf("Building the content archive\n");
+        }
+        pblocktree->WriteFlag("contentarchive", true);
+    }
+
+    int nManualPruneHeightPass;
+    while (fOk && WaitForWork(nManualPruneHeightPass)) {
+        int nMaxPruneHeight = std::numeric_limits<int>::max();
+        if (fArchive) {
+            if (!UpdateArchive()) {
+                LogPrintf("%s: content archive is not updated anymore, block "
+                          "files are not pruned anymore\n",
+                          __func__);
+                break;
+            }
+            const CBlockIndex *pindex = pindexArchive;
+            nMaxPruneHeight = pindex ? pindex->nHeight : -1;
+        }
+        if (!PruneBlockFiles(nMaxPruneHeight, nManualPruneHeightPass)) {
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            nPassesDone = nPassesStarted;
+        }
+        cond.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fFailed = true;
+    }
+    cond.notify_all();
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKPRUNER_H
+#define BITCOIN_BLOCKPRUNER_H
+
+#include "validationinterface.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class CBlockIndex;
+class COutPoint;
+class Config;
+
+static const bool DEFAULT_CONTENTARCHIVE = false;
+/** Blocks the content archive applies in one batch, at the most */
+static const size_t CONTENTARCHIVE_BATCH_BLOCKS = 1000;
+/** Bytes of content the content archive writes in one batch, at the least */
+static const size_t CONTENTARCHIVE_BATCH_SIZE = 32 << 20;
+/** Contents erased in one batch when the content archive is dropped */
+static const size_t CONTENTARCHIVE_ERASE_BATCH = 100000;
+
+/**
+ * Prunes the block and undo files in prune mode on a thread of its own, so
+ * that neither connecting blocks nor flushing the chainstate waits for the
+ * block index to be written and the files to be deleted.
+ *
+ * The blocks within -prunedepth of the tip are kept with their undo data, so
+ * that reorganizations that deep can still be made. Pruning no longer forces
+ * the coin database to be written first: the blocks it would need to be
+ * replayed are kept until a flush gets it past them.
+ *
+ * With -contentarchive, the thread also keeps the contents of the outputs
+ * that are still unspent in the block tree database, so that pruned nodes can
+ * still answer content lookups. It follows the active chain -prunedepth
+ * blocks behind the tip, adding the contents of the outputs created and
+ * erasing those of the outputs spent, and blocks are only pruned once it has
+ * gone past them. It cannot follow a reorganization deeper than -prunedepth.
+ *
+ * Built with fDropArchive, it erases the content archive first, after
+ * -contentarchive was turned off.
+ */
+class CBlockPruner : public CValidationInterface {
+public:
+    CBlockPruner(const Config &configIn, bool fArchiveIn, bool fDropArchiveIn);
+    ~CBlockPruner();
+
+    /** Have the thread look for files to prune. */
+    void Wake();
+
+    /**
+     * Prune the block files up to nManualPruneHeight, within the limits
+     * above, and wait until it is done.
+     */
+    void Prune(int nManualPruneHeight);
+
+    /**
+     * The content of outpoint, from the content archive. Returns false if
+     * the archive doesn't know it.
+     */
+    bool LookupContent(const COutPoint &outpoint,
+                       std::string &strContent) const;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew,
+                         const CBlockIndex *pindexFork,
+                         bool fInitialDownload) override;
+
+private:
+    void ThreadPrune();
+    //! Erase the content archive. Returns false if stopped or on error.
+    bool DropArchive();
+    //! Bring the content archive up to -prunedepth blocks from the tip.
+    //! Returns false on error.
+    bool UpdateArchive();
+    //! Wait for work, and take the manual prune height asked for, if any.
+    //! Returns false if stopped instead.
+    bool WaitForWork(int &nManualPruneHeightOut);
+    bool IsStopped();
+
+    const Config &config;
+    const bool fArchive;
+    const bool fDropArchive;
+
+    std::mutex cs;
+    std::condition_variable cond;
+    bool fWork;
+    bool fStop;
+    //! Set once the thread exited, so that Prune doesn't wait for it.
+    bool fFailed;
+    int nManualPruneHeight;
+    uint64_t nPassesStarted;
+    uint64_t nPassesDone;
+    //! The block the content archive is complete up to, nullptr before the
+    //! first.
+    std::atomic<const CBlockIndex *> pindexArchive;
+
+    std::thread thread;
+};
+
+/** The block pruner thread, in prune mode */
+extern std::unique_ptr<CBlockPruner> g_blockpruner;
+
+#endif // BITCOIN_BLOCKPRUNER_H
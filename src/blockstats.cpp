@@ -0,0 +1,127 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstats.h"
+
+#include "primitives/block.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "undo.h"
+#include "version.h"
+
+#include <algorithm>
+#include <cassert>
+
+/** Whether out is locked for a number of blocks, see CheckTxInputs */
+static bool IsDeposit(const CTxOut &out) {
+    return out.nLockTime > 0 && out.nLockTime < LOCKTIME_THRESHOLD;
+}
+
+/** The value of out without interest */
+static CAmount GetPrincipal(const CTxOut &out) {
+    return out.nPrincipal > 0 ? out.nPrincipal : out.nValue;
+}
+
+void CBlockStats::SetNull() {
+    nTxs = 0;
+    nInputs = 0;
+    nOutputs = 0;
+    nSize = 0;
+    nContentOutputs = 0;
+    nContentBytes = 0;
+    nTotalOut = 0;
+    nFees = 0;
+    nInterest = 0;
+    nDeposits = 0;
+    nDepositPrincipal = 0;
+    nWithdrawals = 0;
+    nWithdrawnPrincipal = 0;
+    nMinFeeRate = 0;
+    nMaxFeeRate = 0;
+    vFeeRatePercentiles.assign(NUM_BLOCK_STATS_PERCENTILES, 0);
+}
+
+CBlockStats::CBlockStats(const CBlock &block, const CBlockUndo &blockUndo) {
+    SetNull();
+    nTxs = block.vtx.size();
+    nSize = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+
+    std::vector<std::pair<CAmount, int64_t>> vFeeRates;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = *block.vtx[i];
+        nOutputs += tx.vout.size();
+        for (const CTxOut &out : tx.vout) {
+            if (!out.strContent.empty()) {
+                nContentOutputs++;
+                nContentBytes += out.strContent.size();
+            }
+        }
+        if (tx.IsCoinBase()) {
+            continue;
+        }
+
+        // The undo data leaves the coinbase out.
+        assert(i - 1 < blockUndo.vtxundo.size());
+        const CTxUndo &txundo = blockUndo.vtxundo[i - 1];
+        nInputs += tx.vin.size();
+        CAmount nValueIn = 0;
+        for (const Coin &coin : txundo.vprevout) {
+            const CTxOut &out = coin.GetTxOut();
+            nValueIn += out.nValue;
+            if (!coin.IsCoinBase() && IsDeposit(out)) {
+                nWithdrawals++;
+                nWithdrawnPrincipal += GetPrincipal(out);
+            }
+        }
+        for (const CTxOut &out : tx.vout) {
+            if (IsDeposit(out)) {
+                nDeposits++;
+                nDepositPrincipal += GetPrincipal(out);
+            }
+        }
+
+        const CAmount nFee = nValueIn - tx.GetValueOutWithoutInterest();
+        nTotalOut += tx.GetValueOut();
+        nFees += nFee;
+        nInterest += tx.GetInterest();
+
+        const int64_t nTxSize = GetTransactionSize(tx);
+        const CAmount nFeeRate = nTxSize > 0 ? nFee * 1000 / nTxSize : 0;
+        vFeeRates.emplace_back(nFeeRate, nTxSize);
+    }
+
+    if (!vFeeRates.empty()) {
+        vFeeRatePercentiles = GetFeeRatePercentiles(vFeeRates);
+        nMinFeeRate = vFeeRates.front().first;
+        nMaxFeeRate = vFeeRates.back().first;
+    }
+}
+
+std::vector<CAmount>
+GetFeeRatePercentiles(std::vector<std::pair<CAmount, int64_t>> &vFeeRates) {
+    std::vector<CAmount> vPercentiles(NUM_BLOCK_STATS_PERCENTILES, 0);
+    if (vFeeRates.empty()) {
+        return vPercentiles;
+    }
+
+    std::sort(vFeeRates.begin(), vFeeRates.end());
+    int64_t nTotalSize = 0;
+    for (const auto &entry : vFeeRates) {
+        nTotalSize += entry.second;
+    }
+
+    // Each percentile is the fee rate of the transaction that brings the
+    // cumulated size to its share of the total.
+    size_t nNext = 0;
+    int64_t nCumulated = 0;
+    for (const auto &entry : vFeeRates) {
+        nCumulated += entry.second;
+        while (nNext < NUM_BLOCK_STATS_PERCENTILES &&
+               nCumulated * 100 >=
+                   nTotalSize * BLOCK_STATS_PERCENTILES[nNext]) {
+            vPercentiles[nNext++] = entry.first;
+        }
+    }
+    return vPercentiles;
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKSTATS_H
+#define BITCOIN_BLOCKSTATS_H
+
+#include "amount.h"
+#include "serialize.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+/** The fee rate percentiles the block stats keep, in percent */
+static const int BLOCK_STATS_PERCENTILES[] = {10, 25, 50, 75, 90};
+static const size_t NUM_BLOCK_STATS_PERCENTILES =
+    sizeof(BLOCK_STATS_PERCENTILES) / sizeof(BLOCK_STATS_PERCENTILES[0]);
+
+/**
+ * Statistics of a block, from the block and its undo data. Only the
+ * transaction, output, size and content counts include the coinbase.
+ *
+ * Fees are the value in less the value out without interest, as
+ * CheckTxInputs tallies them. Deposits are the outputs locked for a number of
+ * blocks, counted by principal; withdrawals the deposits the block spends.
+ */
+struct CBlockStats {
+    uint32_t nTxs;
+    uint32_t nInputs;
+    uint32_t nOutputs;
+    uint64_t nSize;
+    uint32_t nContentOutputs;
+    uint64_t nContentBytes;
+    CAmount nTotalOut;
+    CAmount nFees;
+    CAmount nInterest;
+    uint32_t nDeposits;
+    CAmount nDepositPrincipal;
+    uint32_t nWithdrawals;
+    CAmount nWithdrawnPrincipal;
+    //! Per kB, all of them 0 without transactions to pay one
+    CAmount nMinFeeRate;
+    CAmount nMaxFeeRate;
+    //! At BLOCK_STATS_PERCENTILES, weighted by transaction size
+    std::vector<CAmount> vFeeRatePercentiles;
+
+    CBlockStats() { SetNull(); }
+    /** blockUndo must have the undo data of each transaction of block */
+    CBlockStats(const CBlock &block, const CBlockUndo &blockUndo);
+
+    void SetNull();
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(nTxs);
+        READWRITE(nInputs);
+        READWRITE(nOutputs);
+        READWRITE(nSize);
+        READWRITE(nContentOutputs);
+        READWRITE(nContentBytes);
+        READWRITE(nTotalOut);
+        READWRITE(nFees);
+        READWRITE(nInterest);
+        READWRITE(nDeposits);
+        READWRITE(nDepositPrincipal);
+        READWRITE(nWithdrawals);
+        READWRITE(nWithdrawnPrincipal);
+        READWRITE(nMinFeeRate);
+        READWRITE(nMaxFeeRate);
+        READWRITE(vFeeRatePercentiles);
+    }
+};
+
+/**
+ * The fee rates at BLOCK_STATS_PERCENTILES of vFeeRates, pairs of a fee rate
+ * and a size, weighted by size. vFeeRates is sorted in place.
+ */
+std::vector<CAmount>
+GetFeeRatePercentiles(std::vector<std::pair<CAmount, int64_t>> &vFeeRates);
+
+#endif // BITCOIN_BLOCKSTATS_H
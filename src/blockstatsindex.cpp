@@ -0,0 +1,86 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstatsindex.h"
+
+#include "blockstats.h"
+#include "chain.h"
+#include "primitives/block.h"
+#include "txdb.h"
+#include "undo.h"
+#include "util.h"
+#include "validation.h"
+
+#include <utility>
+#include <vector>
+
+std::unique_ptr<CBlockStatsIndex> g_blockstatsindex;
+
+CBlockStatsIndex::CBlockStatsIndex(const Config &configIn, bool fDrop)
+    : CBaseIndex(configIn, fDrop, "blockstats", "block stats index",
+                 "blockstatsindex") {
+    Start();
+}
+
+CBlockStatsIndex::~CBlockStatsIndex() {
+    Stop();
+}
+
+bool CBlockStatsIndex::LookupStats(const CBlockIndex *pindex,
+                                   CBlockStats &stats) const {
+    return pblocktree->ReadBlockStats(pindex->GetBlockHash(), stats);
+}
+
+bool CBlockStatsIndex::ReadBestBlock(uint256 &hashBest) {
+    return pblocktree->ReadBlockStatsIndexBestBlock(hashBest);
+}
+
+bool CBlockStatsIndex::EraseBestBlock() {
+    return pblocktree->EraseBlockStatsIndexBestBlock();
+}
+
+bool CBlockStatsIndex::EraseEntries(size_t nBatch, size_t &nErased) {
+    return pblocktree->EraseBlockStatsIndex(nBatch, nErased);
+}
+
+bool CBlockStatsIndex::WriteBlocks(
+    const std::vector<const CBlockIndex *> &vBlocks) {
+    std::vector<std::pair<uint256, CBlockStats>> vStats;
+    vStats.reserve(vBlocks.size());
+    for (const CBlockIndex *pindex : vBlocks) {
+        if (IsStopped()) {
+            return false;
+        }
+        CBlock block;
+        CBlockUndo blockUndo;
+        bool fRead = ReadBlockFromDisk(block, pindex, config);
+        // The genesis block spends nothing and has no undo data.
+        if (fRead && pindex->pprev) {
+            const CDiskBlockPos pos = pindex->GetUndoPos();
+            fRead = !pos.IsNull() &&
+                    UndoReadFromDisk(blockUndo, pos,
+                                     pindex->pprev->GetBlockHash());
+        }
+        if (!fRead || blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
+            return error("%s: failed to read block %s", __func__,
+                         pindex->GetBlockHash().ToString());
+        }
+        vStats.emplace_back(pindex->GetBlockHash(),
+                            CBlockStats(block, blockUndo));
+    }
+
+    if (!pblocktree->WriteBlockStats(vStats, vBlocks.back()->GetBlockHash())) {
+        return error("%s: failed to write the block stats index", __func__);
+    }
+    return true;
+}
+
+bool CBlockStatsIndex::Rewind(const CBlockIndex *pindexFork) {
+    if (!pblocktree->WriteBlockStatsIndexBestBlock(
+            pindexFork->GetBlockHash())) {
+        return error("%s: failed to go back to block %s", __func__,
+                     pindexFork->GetBlockHash().ToString());
+    }
+    return true;
+}
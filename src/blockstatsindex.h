@@ -0,0 +1,61 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKSTATSINDEX_H
+#define BITCOIN_BLOCKSTATSINDEX_H
+
+#include "baseindex.h"
+
+#include <cstddef>
+#include <memory>
+
+class CBlockIndex;
+struct CBlockStats;
+class Config;
+
+static const bool DEFAULT_BLOCKSTATSINDEX = false;
+/** Blocks the block stats index writes in one batch */
+static const size_t BLOCKSTATSINDEX_BATCH_BLOCKS = 1000;
+/** Stats erased in one batch when the block stats index is dropped */
+static const size_t BLOCKSTATSINDEX_ERASE_BATCH = 100000;
+/** Blocks getblockstats returns the stats of in one call, at the most */
+static const int MAX_BLOCKSTATS_RANGE = 10000;
+
+/**
+ * Maintains the CBlockStats of the blocks, so that getblockstats reads them
+ * rather than every block and its undo data. They are kept by block hash.
+ *
+ * The stats of blocks that are disconnected stay, they are still right for
+ * those blocks. After a reorganization the index continues from the fork.
+ */
+class CBlockStatsIndex : public CBaseIndex {
+public:
+    CBlockStatsIndex(const Config &configIn, bool fDrop);
+    ~CBlockStatsIndex();
+
+    /** The stats of pindex. Returns false if they weren't computed yet. */
+    bool LookupStats(const CBlockIndex *pindex, CBlockStats &stats) const;
+
+protected:
+    bool ReadBestBlock(uint256 &hashBest) override;
+    bool EraseBestBlock() override;
+    bool EraseEntries(size_t nBatch, size_t &nErased) override;
+    size_t GetEraseBatch() const override {
+        return BLOCKSTATSINDEX_ERASE_BATCH;
+    }
+    //! The stats of an interrupted build are right, there is no need to
+    //! start over without them.
+    bool EraseToStartOver() const override { return false; }
+    bool IsBatchFull(size_t nBlocks, size_t nTransactions) const override {
+        return nBlocks >= BLOCKSTATSINDEX_BATCH_BLOCKS;
+    }
+    bool WriteBlocks(const std::vector<const CBlockIndex *> &vBlocks) override;
+    bool Rewind(const CBlockIndex *pindexFork) override;
+};
+
+/** The block stats index thread, building the index with -blockstatsindex or
+ * dropping it without */
+extern std::unique_ptr<CBlockStatsIndex> g_blockstatsindex;
+
+#endif // BITCOIN_BLOCKSTATSINDEX_H
@@ -0,0 +1,70 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockview.h"
+
+#include "clientversion.h"
+#include "hash.h"
+#include "serialize.h"
+#include "streams.h"
+
+#include <ios>
+#include <utility>
+
+/** The next nSize bytes of the reader, which is advanced past them */
+static CByteSpan ReadSpan(CSpanReader &reader, uint64_t nSize) {
+    const uint8_t *pbegin = reader.data();
+    reader.ignore(nSize);
+    return CByteSpan(pbegin, pbegin + nSize);
+}
+
+CTransactionView::CTransactionView(CSpanReader &reader) {
+    // As UnserializeTransaction reads it. The counts aren't trusted to
+    // reserve, a short read throws before the vectors grow large.
+    const uint8_t *pbegin = reader.data();
+    int32_t nVersion, nFlags;
+    reader >> VARINT(nVersion) >> VARINT(nFlags);
+
+    const uint64_t nInputs = ReadCompactSize(reader);
+    for (uint64_t i = 0; i < nInputs; i++) {
+        COutPoint prevout;
+        reader >> prevout;
+        // scriptSig
+        reader.ignore(ReadCompactSize(reader));
+        vPrevout.push_back(prevout);
+    }
+
+    const uint64_t nOutputs = ReadCompactSize(reader);
+    for (uint64_t i = 0; i < nOutputs; i++) {
+        CTxOutView out;
+        reader >> VARINT(out.nValue) >> VARINT(out.nPrincipal);
+        out.scriptPubKey = ReadSpan(reader, ReadCompactSize(reader));
+        const uint64_t nContentSize = ReadCompactSize(reader);
+        if (nContentSize > MAX_TX_OUT_CONTENT_SIZE) {
+            throw std::ios_base::failure("String length limit exceeded");
+        }
+        out.content = ReadSpan(reader, nContentSize);
+        reader >> VARINT(out.nLockTime);
+        vout.push_back(out);
+    }
+
+    bytes = CByteSpan(pbegin, reader.data());
+    txid = Hash(bytes.begin(), bytes.end());
+}
+
+CTransactionRef CTransactionView::Get() const {
+    CSpanReader reader(SER_DISK, CLIENT_VERSION, bytes.begin(), bytes.end());
+    return std::make_shared<const CTransaction>(deserialize, reader);
+}
+
+CBlockView::CBlockView(std::shared_ptr<const void> ownerIn,
+                       const uint8_t *pbegin, const uint8_t *pend)
+    : owner(std::move(ownerIn)) {
+    CSpanReader reader(SER_DISK, CLIENT_VERSION, pbegin, pend);
+    reader >> header;
+    const uint64_t nTransactions = ReadCompactSize(reader);
+    for (uint64_t i = 0; i < nTransactions; i++) {
+        vtx.emplace_back(reader);
+    }
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKVIEW_H
+#define BITCOIN_BLOCKVIEW_H
+
+#include "amount.h"
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+#include "uint256.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class CSpanReader;
+
+/** Bytes that belong to someone else, such as the buffer of a CBlockView */
+class CByteSpan {
+public:
+    CByteSpan() : pbegin(nullptr), pend(nullptr) {}
+    CByteSpan(const uint8_t *pbeginIn, const uint8_t *pendIn)
+        : pbegin(pbeginIn), pend(pendIn) {}
+
+    const uint8_t *begin() const { return pbegin; }
+    const uint8_t *end() const { return pend; }
+    size_t size() const { return pend - pbegin; }
+    bool empty() const { return pbegin == pend; }
+
+private:
+    const uint8_t *pbegin;
+    const uint8_t *pend;
+};
+
+/** An output of a CTransactionView, its script and content left in place */
+struct CTxOutView {
+    CAmount nValue;
+    CAmount nPrincipal;
+    CByteSpan scriptPubKey;
+    CByteSpan content;
+    uint32_t nLockTime;
+};
+
+/**
+ * A serialized transaction looked at where it is. The scripts and contents of
+ * its outputs point into the serialization, only the outpoints its inputs
+ * spend are copied, and its id is hashed from the bytes. Get() deserializes it
+ * when the whole transaction is needed.
+ *
+ * It is valid as long as the bytes are, those of a CBlockView as long as the
+ * view.
+ */
+class CTransactionView {
+public:
+    /** Parse the transaction the reader is at, and advance past it */
+    explicit CTransactionView(CSpanReader &reader);
+
+    const uint256 &GetId() const { return txid; }
+    const CByteSpan &GetBytes() const { return bytes; }
+    const std::vector<COutPoint> &GetPrevouts() const { return vPrevout; }
+    const std::vector<CTxOutView> &GetOutputs() const { return vout; }
+
+    /** The transaction, deserialized from the bytes */
+    CTransactionRef Get() const;
+
+private:
+    CByteSpan bytes;
+    uint256 txid;
+    std::vector<COutPoint> vPrevout;
+    std::vector<CTxOutView> vout;
+};
+
+/**
+ * A block that is read without deserializing its transactions, for the code
+ * that only looks at some of them, like the wallet rescan. The header is
+ * deserialized, the transactions are views into the buffer the block is in,
+ * which the view keeps alive. See ReadBlockViewFromDisk.
+ */
+class CBlockView {
+public:
+    CBlockView() {}
+    /**
+     * Parse the block in [pbegin, pend), which owner keeps alive. Throws
+     * std::ios_base::failure where a CBlock fails to deserialize.
+     */
+    CBlockView(std::shared_ptr<const void> ownerIn, const uint8_t *pbegin,
+               const uint8_t *pend);
+
+    const CBlockHeader &GetHeader() const { return header; }
+    const std::vector<CTransactionView> &GetTransactions() const {
+        return vtx;
+    }
+
+private:
+    std::shared_ptr<const void> owner;
+    CBlockHeader header;
+    std::vector<CTransactionView> vtx;
+};
+
+#endif // BITCOIN_BLOCKVIEW_H
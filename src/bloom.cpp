@@ -5,6 +5,7 @@
 #include "bloom.h"
 
 #include "hash.h"
+#include "memusage.h"
 #include "primitives/transaction.h"
 #include "random.h"
 #include "script/script.h"
@@ -48,58 +49,65 @@ CBloomFilter::CBloomFilter(unsigned int nElements, double nFPRate,
       nHashFuncs((unsigned int)(vData.size() * 8 / nElements * LN2)),
       nTweak(nTweakIn), nFlags(BLOOM_UPDATE_NONE) {}
 
-inline unsigned int
-CBloomFilter::Hash(unsigned int nHashNum,
-                   const std::vector<uint8_t> &vDataToHash) const {
+// The hashes are part of the protocol: SPV clients build their filters with
+// the same ones.
+inline unsigned int CBloomFilter::Hash(unsigned int nHashNum,
+                                       const uint8_t *pch, size_t nLen) const {
     // 0xFBA4C795 chosen as it guarantees a reasonable bit difference between
     // nHashNum values.
-    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, vDataToHash) %
+    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, pch, nLen) %
            (vData.size() * 8);
 }
 
-void CBloomFilter::insert(const std::vector<uint8_t> &vKey) {
+void CBloomFilter::InsertBytes(const uint8_t *pch, size_t nLen) {
     if (isFull) return;
     for (unsigned int i = 0; i < nHashFuncs; i++) {
-        unsigned int nIndex = Hash(i, vKey);
+        unsigned int nIndex = Hash(i, pch, nLen);
         // Sets bit nIndex of vData
         vData[nIndex >> 3] |= (1 << (7 & nIndex));
     }
     isEmpty = false;
 }
 
+bool CBloomFilter::ContainsBytes(const uint8_t *pch, size_t nLen) const {
+    if (isFull) return true;
+    if (isEmpty) return false;
+    for (unsigned int i = 0; i < nHashFuncs; i++) {
+        unsigned int nIndex = Hash(i, pch, nLen);
+        // Checks bit nIndex of vData
+        if (!(vData[nIndex >> 3] & (1 << (7 & nIndex)))) return false;
+    }
+    return true;
+}
+
+void CBloomFilter::insert(const std::vector<uint8_t> &vKey) {
+    InsertBytes(vKey.data(), vKey.size());
+}
+
 void CBloomFilter::insert(const COutPoint &outpoint) {
     CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
     stream << outpoint;
-    std::vector<uint8_t> data(stream.begin(), stream.end());
-    insert(data);
+    InsertBytes(reinterpret_cast<const uint8_t *>(stream.data()),
+                stream.size());
 }
 
 void CBloomFilter::insert(const uint256 &hash) {
-    std::vector<uint8_t> data(hash.begin(), hash.end());
-    insert(data);
+    InsertBytes(hash.begin(), hash.size());
 }
 
 bool CBloomFilter::contains(const std::vector<uint8_t> &vKey) const {
-    if (isFull) return true;
-    if (isEmpty) return false;
-    for (unsigned int i = 0; i < nHashFuncs; i++) {
-        unsigned int nIndex = Hash(i, vKey);
-        // Checks bit nIndex of vData
-        if (!(vData[nIndex >> 3] & (1 << (7 & nIndex)))) return false;
-    }
-    return true;
+    return ContainsBytes(vKey.data(), vKey.size());
 }
 
 bool CBloomFilter::contains(const COutPoint &outpoint) const {
     CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
     stream << outpoint;
-    std::vector<uint8_t> data(stream.begin(), stream.end());
-    return contains(data);
+    return ContainsBytes(reinterpret_cast<const uint8_t *>(stream.data()),
+                         stream.size());
 }
 
 bool CBloomFilter::contains(const uint256 &hash) const {
-    std::vector<uint8_t> data(hash.begin(), hash.end());
-    return contains(data);
+    return ContainsBytes(hash.begin(), hash.size());
 }
 
 void CBloomFilter::clear() {
@@ -118,6 +126,56 @@ bool CBloomFilter::IsWithinSizeConstraints() const {
            nHashFuncs <= MAX_HASH_FUNCS;
 }
 
+/** The non-empty data pushed by script, up to the first invalid opcode */
+static std::vector<std::vector<uint8_t>> GetPushedData(const CScript &script) {
+    std::vector<std::vector<uint8_t>> vData;
+    CScript::const_iterator pc = script.begin();
+    std::vector<uint8_t> data;
+    while (pc < script.end()) {
+        opcodetype opcode;
+        if (!script.GetOp(pc, opcode, data)) break;
+        if (data.size() != 0) vData.push_back(data);
+    }
+    return vData;
+}
+
+CBloomTxElements::CBloomTxElements(const CTransaction &tx) : txid(tx.GetId()) {
+    vOutputs.resize(tx.vout.size());
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        const CTxOut &txout = tx.vout[i];
+        Output &output = vOutputs[i];
+        output.vData = GetPushedData(txout.scriptPubKey);
+        output.outpoint = COutPoint(txid, i, txout.nValue);
+        txnouttype type;
+        std::vector<std::vector<uint8_t>> vSolutions;
+        output.fPubKeyOrMultisig =
+            Solver(txout.scriptPubKey, type, vSolutions) &&
+            (type == TX_PUBKEY || type == TX_MULTISIG);
+    }
+    vInputs.reserve(tx.vin.size());
+    for (const CTxIn &txin : tx.vin) {
+        vInputs.emplace_back(txin.prevout, GetPushedData(txin.scriptSig));
+    }
+}
+
+size_t CBloomTxElements::DynamicMemoryUsage() const {
+    size_t nUsage = memusage::DynamicUsage(vOutputs) +
+                    memusage::DynamicUsage(vInputs);
+    for (const Output &output : vOutputs) {
+        nUsage += memusage::DynamicUsage(output.vData);
+        for (const std::vector<uint8_t> &data : output.vData) {
+            nUsage += memusage::DynamicUsage(data);
+        }
+    }
+    for (const auto &input : vInputs) {
+        nUsage += memusage::DynamicUsage(input.second);
+        for (const std::vector<uint8_t> &data : input.second) {
+            nUsage += memusage::DynamicUsage(data);
+        }
+    }
+    return nUsage;
+}
+
 bool CBloomFilter::IsRelevantAndUpdate(const CTransaction &tx) {
     bool fFound = false;
     // Match if the filter contains the hash of tx for finding tx when they
@@ -177,6 +235,51 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction &tx) {
     return false;
 }
 
+bool CBloomFilter::IsRelevantAndUpdate(const CBloomTxElements &elements) {
+    bool fFound = false;
+    // Match if the filter contains the hash of tx for finding tx when they
+    // appear in a block
+    if (isFull) return true;
+    if (isEmpty) return false;
+    if (contains(elements.txid)) fFound = true;
+
+    for (const CBloomTxElements::Output &output : elements.vOutputs) {
+        // Match if the filter contains any arbitrary script data element in any
+        // scriptPubKey in tx. If this matches, also add the specific output
+        // that was matched. This means clients don't have to update the filter
+        // themselves when a new relevant tx is discovered in order to find
+        // spending transactions, which avoids round-tripping and race
+        // conditions.
+        for (const std::vector<uint8_t> &data : output.vData) {
+            if (contains(data)) {
+                fFound = true;
+                if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_ALL)
+                    insert(output.outpoint);
+                else if ((nFlags & BLOOM_UPDATE_MASK) ==
+                             BLOOM_UPDATE_P2PUBKEY_ONLY &&
+                         output.fPubKeyOrMultisig)
+                    insert(output.outpoint);
+                break;
+            }
+        }
+    }
+
+    if (fFound) return true;
+
+    for (const auto &input : elements.vInputs) {
+        // Match if the filter contains an outpoint tx spends
+        if (contains(input.first)) return true;
+
+        // Match if the filter contains any arbitrary script data element in any
+        // scriptSig in tx
+        for (const std::vector<uint8_t> &data : input.second) {
+            if (contains(data)) return true;
+        }
+    }
+
+    return false;
+}
+
 void CBloomFilter::UpdateEmptyFull() {
     bool full = true;
     bool empty = true;
@@ -224,14 +327,37 @@ CRollingBloomFilter::CRollingBloomFilter(unsigned int nElements,
     reset();
 }
 
-/* Similar to CBloomFilter::Hash */
-static inline uint32_t
-RollingBloomHash(unsigned int nHashNum, uint32_t nTweak,
-                 const std::vector<uint8_t> &vDataToHash) {
-    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, vDataToHash);
+/* Unlike CBloomFilter's, these hashes aren't seen outside the node, so
+ * rather than hashing the key once per hash function, the nHashFuncs
+ * positions are derived from two hashes by enhanced double hashing (Dillinger
+ * and Manolios), which does as well for a bloom filter as independent hashes.
+ */
+inline CRollingBloomFilter::KeyHashes
+CRollingBloomFilter::Hash(const uint8_t *pch, size_t nLen) const {
+    KeyHashes hashes;
+    hashes.h1 = MurmurHash3(nTweak, pch, nLen);
+    hashes.h2 = MurmurHash3(0xFBA4C795 + nTweak, pch, nLen);
+    return hashes;
 }
 
-void CRollingBloomFilter::insert(const std::vector<uint8_t> &vKey) {
+/* A position is a pair of words, picked by the top bits of h1 with a multiply
+ * rather than a modulo, and the bit in them is the bottom six bits of h1. */
+static inline size_t RollingBloomPair(uint32_t h, size_t nPairs) {
+    return (uint64_t(h) * nPairs) >> 32;
+}
+
+inline size_t
+CRollingBloomFilter::FirstPosition(const KeyHashes &hashes) const {
+    return RollingBloomPair(hashes.h1, data.size() >> 1) << 1;
+}
+
+static inline void PrefetchRollingBloom(const uint64_t *p) {
+#if defined(__GNUC__)
+    __builtin_prefetch(p);
+#endif
+}
+
+void CRollingBloomFilter::InsertHashes(KeyHashes hashes) {
     if (nEntriesThisGeneration == nEntriesPerGeneration) {
         nEntriesThisGeneration = 0;
         nGeneration++;
@@ -250,41 +376,78 @@ void CRollingBloomFilter::insert(const std::vector<uint8_t> &vKey) {
     }
     nEntriesThisGeneration++;
 
+    const size_t nPairs = data.size() >> 1;
     for (int n = 0; n < nHashFuncs; n++) {
-        uint32_t h = RollingBloomHash(n, nTweak, vKey);
-        int bit = h & 0x3F;
-        uint32_t pos = (h >> 6) % data.size();
-        /* The lowest bit of pos is ignored, and set to zero for the first bit,
-         * and to one for the second. */
-        data[pos & ~1] = (data[pos & ~1] & ~(((uint64_t)1) << bit)) |
-                         ((uint64_t)(nGeneration & 1)) << bit;
-        data[pos | 1] = (data[pos | 1] & ~(((uint64_t)1) << bit)) |
+        int bit = hashes.h1 & 0x3F;
+        size_t pos = RollingBloomPair(hashes.h1, nPairs) << 1;
+        /* data[pos] holds the first bit of the generation, data[pos + 1] the
+         * second. */
+        data[pos] = (data[pos] & ~(((uint64_t)1) << bit)) |
+                    ((uint64_t)(nGeneration & 1)) << bit;
+        data[pos + 1] = (data[pos + 1] & ~(((uint64_t)1) << bit)) |
                         ((uint64_t)(nGeneration >> 1)) << bit;
+        hashes.h1 += hashes.h2;
+        hashes.h2 += n;
     }
 }
 
-void CRollingBloomFilter::insert(const uint256 &hash) {
-    std::vector<uint8_t> vData(hash.begin(), hash.end());
-    insert(vData);
-}
-
-bool CRollingBloomFilter::contains(const std::vector<uint8_t> &vKey) const {
+bool CRollingBloomFilter::ContainsHashes(KeyHashes hashes) const {
+    const size_t nPairs = data.size() >> 1;
     for (int n = 0; n < nHashFuncs; n++) {
-        uint32_t h = RollingBloomHash(n, nTweak, vKey);
-        int bit = h & 0x3F;
-        uint32_t pos = (h >> 6) % data.size();
-        /* If the relevant bit is not set in either data[pos & ~1] or data[pos |
-         * 1], the filter does not contain vKey */
-        if (!(((data[pos & ~1] | data[pos | 1]) >> bit) & 1)) {
+        int bit = hashes.h1 & 0x3F;
+        size_t pos = RollingBloomPair(hashes.h1, nPairs) << 1;
+        /* If the relevant bit is not set in either data[pos] or data[pos + 1],
+         * the filter does not contain the key */
+        if (!(((data[pos] | data[pos + 1]) >> bit) & 1)) {
             return false;
         }
+        hashes.h1 += hashes.h2;
+        hashes.h2 += n;
     }
     return true;
 }
 
+void CRollingBloomFilter::insert(const std::vector<uint8_t> &vKey) {
+    InsertHashes(Hash(vKey.data(), vKey.size()));
+}
+
+void CRollingBloomFilter::insert(const uint256 &hash) {
+    InsertHashes(Hash(hash.begin(), hash.size()));
+}
+
+bool CRollingBloomFilter::contains(const std::vector<uint8_t> &vKey) const {
+    return ContainsHashes(Hash(vKey.data(), vKey.size()));
+}
+
 bool CRollingBloomFilter::contains(const uint256 &hash) const {
-    std::vector<uint8_t> vData(hash.begin(), hash.end());
-    return contains(vData);
+    return ContainsHashes(Hash(hash.begin(), hash.size()));
+}
+
+void CRollingBloomFilter::insert(const std::vector<uint256> &vHashes) {
+    std::vector<KeyHashes> vKeyHashes;
+    vKeyHashes.reserve(vHashes.size());
+    for (const uint256 &hash : vHashes) {
+        vKeyHashes.push_back(Hash(hash.begin(), hash.size()));
+        PrefetchRollingBloom(&data[FirstPosition(vKeyHashes.back())]);
+    }
+    for (const KeyHashes &hashes : vKeyHashes) {
+        InsertHashes(hashes);
+    }
+}
+
+std::vector<bool>
+CRollingBloomFilter::contains(const std::vector<uint256> &vHashes) const {
+    std::vector<KeyHashes> vKeyHashes;
+    vKeyHashes.reserve(vHashes.size());
+    for (const uint256 &hash : vHashes) {
+        vKeyHashes.push_back(Hash(hash.begin(), hash.size()));
+        PrefetchRollingBloom(&data[FirstPosition(vKeyHashes.back())]);
+    }
+    std::vector<bool> vContains(vHashes.size());
+    for (size_t i = 0; i < vKeyHashes.size(); i++) {
+        vContains[i] = ContainsHashes(vKeyHashes[i]);
+    }
+    return vContains;
 }
 
 void CRollingBloomFilter::reset() {
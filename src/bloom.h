@@ -5,14 +5,12 @@
 #ifndef BITCOIN_BLOOM_H
 #define BITCOIN_BLOOM_H
 
+#include "primitives/transaction.h"
 #include "serialize.h"
+#include "uint256.h"
 
 #include <vector>
 
-class COutPoint;
-class CTransaction;
-class uint256;
-
 //! 20,000 items with fp rate < 0.1% or 10,000 items and <0.0001%
 static const unsigned int MAX_BLOOM_FILTER_SIZE = 36000; // bytes
 static const unsigned int MAX_HASH_FUNCS = 50;
@@ -30,6 +28,31 @@ enum bloomflags {
     BLOOM_UPDATE_MASK = 3,
 };
 
+/**
+ * The elements of a transaction that bloom filters match, taken out of its
+ * scripts once, so that the transaction can be matched against the filters of
+ * many peers with only filter lookups.
+ */
+struct CBloomTxElements {
+    struct Output {
+        //! The data pushed by the scriptPubKey, in order
+        std::vector<std::vector<uint8_t>> vData;
+        COutPoint outpoint;
+        //! Whether the scriptPubKey is a pay-to-pubkey or a multisig
+        bool fPubKeyOrMultisig;
+    };
+
+    uint256 txid;
+    std::vector<Output> vOutputs;
+    //! The outpoints spent and the data pushed by the scriptSig of each input
+    std::vector<std::pair<COutPoint, std::vector<std::vector<uint8_t>>>>
+        vInputs;
+
+    explicit CBloomTxElements(const CTransaction &tx);
+
+    size_t DynamicMemoryUsage() const;
+};
+
 /**
  * BloomFilter is a probabilistic filter which SPV clients provide so that we
  * can filter the transactions we send them.
@@ -50,8 +73,10 @@ private:
     unsigned int nTweak;
     uint8_t nFlags;
 
-    unsigned int Hash(unsigned int nHashNum,
-                      const std::vector<uint8_t> &vDataToHash) const;
+    unsigned int Hash(unsigned int nHashNum, const uint8_t *pch,
+                      size_t nLen) const;
+    void InsertBytes(const uint8_t *pch, size_t nLen);
+    bool ContainsBytes(const uint8_t *pch, size_t nLen) const;
 
     // Private constructor for CRollingBloomFilter, no restrictions on size
     CBloomFilter(unsigned int nElements, double nFPRate, unsigned int nTweak);
@@ -103,6 +128,8 @@ public:
     //! Also adds any outputs which match the filter to the filter (to match
     //! their spending txes)
     bool IsRelevantAndUpdate(const CTransaction &tx);
+    //! The same, from the elements of the transaction
+    bool IsRelevantAndUpdate(const CBloomTxElements &elements);
 
     //! Checks for empty and full filters to avoid wasting cpu
     void UpdateEmptyFull();
@@ -134,9 +161,28 @@ public:
     bool contains(const std::vector<uint8_t> &vKey) const;
     bool contains(const uint256 &hash) const;
 
+    //! Insert many hashes, in order, hashing them all before touching the
+    //! filter so its memory can be fetched ahead
+    void insert(const std::vector<uint256> &vHashes);
+    //! Whether the filter contains each of vHashes, one entry per hash
+    std::vector<bool> contains(const std::vector<uint256> &vHashes) const;
+
     void reset();
 
 private:
+    /** The two hashes of a key all its positions in the filter come from */
+    struct KeyHashes {
+        uint32_t h1;
+        uint32_t h2;
+    };
+
+    KeyHashes Hash(const uint8_t *pch, size_t nLen) const;
+    //! Index in data of the first of the pair of words holding the key's
+    //! first bit
+    size_t FirstPosition(const KeyHashes &hashes) const;
+    void InsertHashes(KeyHashes hashes);
+    bool ContainsHashes(KeyHashes hashes) const;
+
     int nEntriesPerGeneration;
     int nEntriesThisGeneration;
     int nGeneration;
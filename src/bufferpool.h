@@ -0,0 +1,103 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BUFFERPOOL_H
+#define BITCOIN_BUFFERPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * Free list of vector-like buffers, kept in power-of-two capacity classes so
+ * that network messages can reuse the allocations of earlier ones.
+ *
+ * Get() returns an empty buffer whose capacity is at least the requested size,
+ * Put() hands one back. Buffers larger than the biggest class, and buffers
+ * returned to a class that is already full, are simply freed, which bounds the
+ * memory held by the pool.
+ */
+template <typename Buffer> class CBufferPool {
+public:
+    // Classes run from 32 bytes to 256 KiB.
+    static const size_t MIN_CLASS_SIZE = 32;
+    static const size_t NUM_CLASSES = 14;
+    static const size_t MAX_CLASS_SIZE = MIN_CLASS_SIZE << (NUM_CLASSES - 1);
+
+    explicit CBufferPool(size_t nMaxPerClassIn)
+        : nMaxPerClass(nMaxPerClassIn), nHits(0), nMisses(0) {}
+
+    Buffer Get(size_t nSize) {
+        Buffer buf;
+        if (nSize <= MAX_CLASS_SIZE) {
+            size_t nClass = ClassFor(nSize);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::vector<Buffer> &vFree = vFreeBuffers[nClass];
+                if (!vFree.empty()) {
+                    buf.swap(vFree.back());
+                    vFree.pop_back();
+                    nHits++;
+                    return buf;
+                }
+            }
+            // Allocate the whole class so the buffer fits any later request
+            // that maps to it.
+            nSize = MIN_CLASS_SIZE << nClass;
+        }
+        nMisses++;
+        buf.reserve(nSize);
+        return buf;
+    }
+
+    void Put(Buffer &&bufIn) {
+        size_t nCapacity = bufIn.capacity();
+        if (nCapacity < MIN_CLASS_SIZE) {
+            return;
+        }
+
+        // File the buffer under the largest class it can fully serve.
+        size_t nClass = ClassFor(nCapacity);
+        if (nClass >= NUM_CLASSES) {
+            return;
+        }
+        if ((MIN_CLASS_SIZE << nClass) > nCapacity) {
+            nClass--;
+        }
+
+        Buffer buf;
+        buf.swap(bufIn);
+        buf.clear();
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<Buffer> &vFree = vFreeBuffers[nClass];
+        if (vFree.size() < nMaxPerClass) {
+            vFree.push_back(std::move(buf));
+        }
+    }
+
+    /** Requests served from the pool. */
+    uint64_t GetHits() const { return nHits; }
+    /** Requests that needed a fresh allocation. */
+    uint64_t GetMisses() const { return nMisses; }
+
+private:
+    /** Smallest class whose buffers hold nSize bytes. */
+    static size_t ClassFor(size_t nSize) {
+        size_t nClass = 0;
+        while ((MIN_CLASS_SIZE << nClass) < nSize) {
+            nClass++;
+        }
+        return nClass;
+    }
+
+    const size_t nMaxPerClass;
+    std::mutex mutex;
+    std::vector<Buffer> vFreeBuffers[NUM_CLASSES];
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+};
+
+#endif // BITCOIN_BUFFERPOOL_H
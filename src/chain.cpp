@@ -5,6 +5,40 @@
 
 #include "chain.h"
 
+#include "memusage.h"
+
+#include <type_traits>
+
+void CBlockIndexArena::NewChunk() {
+    std::unique_ptr<uint8_t[]> chunk(
+        new uint8_t[BLOCK_INDEX_ARENA_CHUNK * ENTRY_SIZE + CACHE_LINE_SIZE]);
+    uint8_t *pbegin = chunk.get() + CACHE_LINE_SIZE -
+                      reinterpret_cast<uintptr_t>(chunk.get()) % CACHE_LINE_SIZE;
+    vChunks.emplace_back(std::move(chunk), pbegin);
+    nUsed = 0;
+}
+
+void CBlockIndexArena::Clear() {
+    // CBlockIndex has nothing to destroy, the memory can just go.
+    static_assert(std::is_trivially_destructible<CBlockIndex>::value,
+                  "CBlockIndex entries are freed without destroying them");
+    vChunks.clear();
+    nUsed = 0;
+}
+
+size_t CBlockIndexArena::Size() const {
+    return vChunks.empty()
+               ? 0
+               : (vChunks.size() - 1) * BLOCK_INDEX_ARENA_CHUNK + nUsed;
+}
+
+size_t CBlockIndexArena::DynamicMemoryUsage() const {
+    return memusage::DynamicUsage(vChunks) +
+           vChunks.size() * memusage::MallocUsage(BLOCK_INDEX_ARENA_CHUNK *
+                                                      ENTRY_SIZE +
+                                                  CACHE_LINE_SIZE);
+}
+
 /**
  * CChain implementation
  */
@@ -65,6 +99,19 @@ const CBlockIndex *CChain::FindFork(const CBlockIndex *pindex) const {
     return pindex;
 }
 
+const CBlockIndex *CChainSnapshot::FindFork(const CBlockIndex *pindex) const {
+    if (pindex == nullptr) {
+        return nullptr;
+    }
+    if (pindex->nHeight > Height()) {
+        pindex = pindex->GetAncestor(Height());
+    }
+    while (pindex && !Contains(pindex)) {
+        pindex = pindex->pprev;
+    }
+    return pindex;
+}
+
 CBlockIndex *CChain::FindEarliestAtLeast(int64_t nTime) const {
     std::vector<CBlockIndex *>::const_iterator lower =
         std::lower_bound(vChain.begin(), vChain.end(), nTime,
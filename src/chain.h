@@ -13,7 +13,11 @@
 #include "tinyformat.h"
 #include "uint256.h"
 
+#include <cstdint>
+#include <memory>
+#include <new>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 class CBlockFileInfo {
@@ -171,9 +175,9 @@ enum BlockStatus : uint32_t {
  */
 class CBlockIndex {
 public:
-    //! pointer to the hash of the block, if any. Memory is owned by this
-    //! CBlockIndex
-    const uint256 *phashBlock;
+    // Fields used when walking the tree come first, so that they share the
+    // first cache line of the entry. The header fields after them are only
+    // needed when the block itself is looked at.
 
     //! pointer to the index of the predecessor of this block
     CBlockIndex *pprev;
@@ -181,27 +185,20 @@ public:
     //! pointer to the index of some further predecessor of this block
     CBlockIndex *pskip;
 
+    //! pointer to the hash of the block, if any. Memory is owned by this
+    //! CBlockIndex
+    const uint256 *phashBlock;
+
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
-    //! Which # file this block is stored in (blk?????.dat)
-    int nFile;
-
-    //! Byte offset within blk?????.dat where this block's data is stored
-    unsigned int nDataPos;
-
-    //! Byte offset within rev?????.dat where this block's undo data is stored
-    unsigned int nUndoPos;
+    //! Verification status of this block. See enum BlockStatus
+    uint32_t nStatus;
 
     //! (memory only) Total amount of work (expected number of hashes) in the
     //! chain up to and including this block
     arith_uint256 nChainWork;
 
-    //! Number of transactions in this block.
-    //! Note: in a potential headers-first mode, this number cannot be relied
-    //! upon
-    unsigned int nTx;
-
     //! (memory only) Number of transactions in the chain up to and including
     //! this block.
     //! This value will be non-zero only if and only if transactions for this
@@ -209,25 +206,36 @@ public:
     //! necessary; won't happen before 2030
     unsigned int nChainTx;
 
-    //! Verification status of this block. See enum BlockStatus
-    uint32_t nStatus;
+    //! (memory only) Sequential id assigned to distinguish order in which
+    //! blocks are received.
+    int32_t nSequenceId;
+
+    //! (memory only) Maximum nTime in the chain upto and including this block.
+    unsigned int nTimeMax;
+
+    //! Number of transactions in this block.
+    //! Note: in a potential headers-first mode, this number cannot be relied
+    //! upon
+    unsigned int nTx;
+
+    //! Which # file this block is stored in (blk?????.dat)
+    int nFile;
+
+    //! Byte offset within blk?????.dat where this block's data is stored
+    unsigned int nDataPos;
+
+    //! Byte offset within rev?????.dat where this block's undo data is stored
+    unsigned int nUndoPos;
 
     //! block header
     int32_t nVersion;
-    uint256 hashMerkleRoot;
     uint32_t nTime;
     uint32_t nBits;
+    uint256 hashMerkleRoot;
     uint64_t nChainInterest;
     ethash_h256_t hashMix;
     uint64_t nNonce;
 
-    //! (memory only) Sequential id assigned to distinguish order in which
-    //! blocks are received.
-    int32_t nSequenceId;
-
-    //! (memory only) Maximum nTime in the chain upto and including this block.
-    unsigned int nTimeMax;
-
     void SetNull() {
         phashBlock = nullptr;
         pprev = nullptr;
@@ -298,6 +306,10 @@ public:
         block.nBits = nBits;
         block.hashMix = hashMix;
         block.nNonce = nNonce;
+        // The index is keyed by the hash of the header.
+        if (phashBlock) {
+            block.CacheHash(*phashBlock);
+        }
         return block;
     }
 
@@ -364,6 +376,54 @@ public:
     const CBlockIndex *GetAncestor(int height) const;
 };
 
+/** Block index entries allocated at once by CBlockIndexArena */
+static const size_t BLOCK_INDEX_ARENA_CHUNK = 4096;
+
+/**
+ * Storage for block index entries. Entries are laid out one after the other
+ * in large chunks and only freed all together, so entries created together,
+ * like a chain being loaded or synced, are next to each other in memory and
+ * there is no allocator overhead per entry. Each entry starts on a cache
+ * line, which then holds all the fields used to walk the tree.
+ */
+class CBlockIndexArena {
+public:
+    CBlockIndexArena() : nUsed(0) {}
+    ~CBlockIndexArena() { Clear(); }
+
+    template <typename... Args> CBlockIndex *Create(Args &&... args) {
+        if (vChunks.empty() || nUsed == BLOCK_INDEX_ARENA_CHUNK) {
+            NewChunk();
+        }
+        uint8_t *p = vChunks.back().second + nUsed * ENTRY_SIZE;
+        nUsed++;
+        return new (p) CBlockIndex(std::forward<Args>(args)...);
+    }
+
+    /** Free all entries. */
+    void Clear();
+
+    size_t Size() const;
+    /** Bytes allocated for the entries, used or not */
+    size_t DynamicMemoryUsage() const;
+
+private:
+    CBlockIndexArena(const CBlockIndexArena &);
+    CBlockIndexArena &operator=(const CBlockIndexArena &);
+
+    static const size_t CACHE_LINE_SIZE = 64;
+    static const size_t ENTRY_SIZE =
+        (sizeof(CBlockIndex) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE *
+        CACHE_LINE_SIZE;
+
+    void NewChunk();
+
+    //! Each chunk as allocated and its first cache line aligned entry.
+    std::vector<std::pair<std::unique_ptr<uint8_t[]>, uint8_t *>> vChunks;
+    //! Entries used in the last chunk.
+    size_t nUsed;
+};
+
 /**
  * Maintain a map of CBlockIndex for all known headers.
  */
@@ -537,4 +597,53 @@ public:
     CBlockIndex *FindEarliestAtLeast(int64_t nTime) const;
 };
 
+/**
+ * The chain up to a tip, for readers without cs_main. Nothing in it changes,
+ * a new one stands for a new tip. It walks the skip list where CChain looks
+ * up its vector, the parent, height and skip pointers of a block index entry
+ * are set before anyone else sees the entry and never change after.
+ */
+class CChainSnapshot {
+private:
+    const CBlockIndex *const pindexTip;
+
+public:
+    explicit CChainSnapshot(const CBlockIndex *pindexTipIn)
+        : pindexTip(pindexTipIn) {}
+
+    /** The tip, or nullptr if none. */
+    const CBlockIndex *Tip() const { return pindexTip; }
+
+    /** The height of the tip, -1 without one. */
+    int Height() const { return pindexTip ? pindexTip->nHeight : -1; }
+
+    /** Interest paid out up to and including the tip. */
+    uint64_t GetChainInterest() const {
+        return pindexTip ? pindexTip->nChainInterest : 0;
+    }
+
+    /** The block at nHeight, or nullptr if there is none. */
+    const CBlockIndex *operator[](int nHeight) const {
+        if (nHeight < 0 || nHeight > Height()) {
+            return nullptr;
+        }
+        return pindexTip->GetAncestor(nHeight);
+    }
+
+    bool Contains(const CBlockIndex *pindex) const {
+        return (*this)[pindex->nHeight] == pindex;
+    }
+
+    /** The successor of pindex, nullptr if pindex is the tip or not in. */
+    const CBlockIndex *Next(const CBlockIndex *pindex) const {
+        if (!Contains(pindex)) {
+            return nullptr;
+        }
+        return (*this)[pindex->nHeight + 1];
+    }
+
+    /** The last block of this chain pindex descends from. */
+    const CBlockIndex *FindFork(const CBlockIndex *pindex) const;
+};
+
 #endif // BITCOIN_CHAIN_H
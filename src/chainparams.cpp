@@ -121,6 +121,7 @@ public:
         consensus.nLockInterestRate[4]=(double)0.0714285;
         consensus.nLockInterestRate[5]=(double)0.0857142;
         consensus.nLockInterestRate[6]=(double)0.0999999;
+        interestTable = CInterestTable(consensus);
 
         consensus.nBlockReward = OldChainSubsidyForBlock(1440001);
         consensus.nGenesisReward = OldChainSubsidyTillBlock(1440000) + 39168290492526951 + OldChainLotteryTillCentury(centuryForBlock(1440000));
@@ -139,6 +140,11 @@ public:
         consensus.nPowTargetSpacing = 90;
         consensus.fPowAllowMinDifficultyBlocks = false;
         consensus.fPowNoRetargeting = false;
+        consensus.nEthashCacheBytesInit = ETHASH_CACHE_BYTES_INIT;
+        consensus.nEthashCacheBytesGrowth = ETHASH_CACHE_BYTES_GROWTH;
+        consensus.nEthashDatasetBytesInit = ETHASH_DATASET_BYTES_INIT;
+        consensus.nEthashDatasetBytesGrowth = ETHASH_DATASET_BYTES_GROWTH;
+        consensus.nEthashEpochLength = ETHASH_EPOCH_LENGTH;
         // 95% of 2016
         consensus.nRuleChangeActivationThreshold = 1916;
         // nPowTargetTimespan / nPowTargetSpacing
@@ -261,6 +267,7 @@ public:
         consensus.nLockInterestRate[4]=(double)0.0714285;
         consensus.nLockInterestRate[5]=(double)0.0857142;
         consensus.nLockInterestRate[6]=(double)0.0999999;
+        interestTable = CInterestTable(consensus);
 
         consensus.BIP34Height = 10000;
         consensus.BIP34Hash = uint256();
@@ -278,6 +285,11 @@ public:
         consensus.nPowTargetSpacing = 10;
         consensus.fPowAllowMinDifficultyBlocks = false;
         consensus.fPowNoRetargeting = false;
+        consensus.nEthashCacheBytesInit = ETHASH_CACHE_BYTES_INIT;
+        consensus.nEthashCacheBytesGrowth = ETHASH_CACHE_BYTES_GROWTH;
+        consensus.nEthashDatasetBytesInit = ETHASH_DATASET_BYTES_INIT;
+        consensus.nEthashDatasetBytesGrowth = ETHASH_DATASET_BYTES_GROWTH;
+        consensus.nEthashEpochLength = ETHASH_EPOCH_LENGTH;
 
         // The best chain should have at least this much work.
         consensus.nMinimumChainWork =
@@ -368,6 +380,7 @@ public:
         consensus.nLockInterestRate[4]=(double)7.14285;
         consensus.nLockInterestRate[5]=(double)8.57142;
         consensus.nLockInterestRate[6]=(double)9.99999;
+        interestTable = CInterestTable(consensus);
 
         // BIP34 has not activated on regtest (far in the future so block v1 are
         // not rejected in tests)
@@ -384,6 +397,14 @@ public:
         consensus.nPowTargetSpacing = 10;
         consensus.fPowAllowMinDifficultyBlocks = true;
         consensus.fPowNoRetargeting = true;
+        // A cache of 13 nodes and a DAG of 251 pages in the first epoch, so
+        // that mining regtest blocks takes no time nor memory, and short
+        // epochs so that tests go through a few of them.
+        consensus.nEthashCacheBytesInit = 1024;
+        consensus.nEthashCacheBytesGrowth = 128;
+        consensus.nEthashDatasetBytesInit = 32768;
+        consensus.nEthashDatasetBytesGrowth = 1024;
+        consensus.nEthashEpochLength = 1000;
         // 75% for testchains
         consensus.nRuleChangeActivationThreshold = 108;
         // Faster than normal for regtest (144 instead of 2016)
@@ -412,12 +433,12 @@ public:
         consensus.nBlockReward = OldChainSubsidyForBlock(1501);
         consensus.nGenesisReward = OldChainSubsidyTillBlock(1500) + 39168290492526951 + OldChainLotteryTillCentury(centuryForBlock(1500));
         genesis = CreateGenesisBlock(1512403200, 1,
-                                     ethash_h256_decode_big("0x836c063fc357fc6a3e09df0f6781a183e6f0aa49259a43f568ee1c6f8c7ce448"),
+                                     ethash_h256_decode_big("0xd150d511272eca993868d027e945b86bffac7ca51476b6289b1c2999942dbc4f"),
                                      0x207fffff, 3, std::string("76a914ab9eb67a1bc20e8f138523dffc88586f2f31e94188ac"),
                                      consensus.nGenesisReward, 39168290492526951);
         consensus.hashGenesisBlock = genesis.GetHash();
         assert(consensus.hashGenesisBlock ==
-               uint256S("0x98df12433b40e2ac03774aa911de4683099e707ccaff03d7ace0ba57f49f3be8"));
+               uint256S("0x9dea510243919fdf5a6110b0aa9fbea49e52ead9b6b995195335b614d07e1cd7"));
         assert(genesis.hashMerkleRoot ==
                uint256S("0xa3a7521e105bc501b3c9aea0a2064441ea3dab4ff25825f9611d2bcbd64d1151"));
 
@@ -433,7 +454,7 @@ public:
 
         checkpointData = {
             .mapCheckpoints = {
-                    {0, uint256S("0x98df12433b40e2ac03774aa911de4683099e707ccaff03d7ace0ba57f49f3be8")},
+                    {0, uint256S("0x9dea510243919fdf5a6110b0aa9fbea49e52ead9b6b995195335b614d07e1cd7")},
             }};
 
         chainTxData = ChainTxData{0, 0, 0};
@@ -481,6 +502,15 @@ CChainParams &Params(const std::string &chain) {
 void SelectParams(const std::string &network) {
     SelectBaseParams(network);
     pCurrentParams = &Params(network);
+
+    const Consensus::Params &consensus = pCurrentParams->GetConsensus();
+    ethash_params_t params;
+    params.cache_bytes_init = consensus.nEthashCacheBytesInit;
+    params.cache_bytes_growth = consensus.nEthashCacheBytesGrowth;
+    params.dataset_bytes_init = consensus.nEthashDatasetBytesInit;
+    params.dataset_bytes_growth = consensus.nEthashDatasetBytesGrowth;
+    params.epoch_length = consensus.nEthashEpochLength;
+    ethash_set_params(&params);
 }
 
 void UpdateRegtestBIP9Parameters(Consensus::DeploymentPos d, int64_t nStartTime,
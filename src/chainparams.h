@@ -8,6 +8,7 @@
 
 #include "chainparamsbase.h"
 #include "consensus/params.h"
+#include "interest.h"
 #include "primitives/block.h"
 #include "protocol.h"
 
@@ -133,6 +134,7 @@ public:
     double DecayRatio() const {
         return consensus.nDecayRatio;
     }
+    const CInterestTable &InterestTable() const { return interestTable; }
 
     int centuryForBlock(uint32_t blockHeight) const {
         return (blockHeight - 1) / consensus.nBlocksPerCentury + 1;
@@ -161,6 +163,7 @@ protected:
     uint32_t oldChainHeight;//genesis block height continuing from old chain
 
     Consensus::Params consensus;
+    CInterestTable interestTable;
     CMessageHeader::MessageMagic diskMagic;
     CMessageHeader::MessageMagic netMagic;
     int nDefaultPort;
@@ -204,7 +207,8 @@ const CChainParams &Params();
 CChainParams &Params(const std::string &chain);
 
 /**
- * Sets the params returned by Params() to those for the given BIP70 chain name.
+ * Sets the params returned by Params() to those for the given BIP70 chain name,
+ * and the ethash parameters to those of the chain.
  * @throws std::runtime_error when the chain is not supported.
  */
 void SelectParams(const std::string &chain);
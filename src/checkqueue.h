@@ -6,13 +6,16 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
 
-template <typename T> class CCheckQueueControl;
+template <typename T, typename Queue> class CCheckQueueControl;
 
 /**
  * Queue for verifications that have to be performed.
@@ -141,8 +144,8 @@ public:
     //! successful.
     bool Wait() { return Loop(true); }
 
-    //! Add a batch of checks to the queue
-    void Add(std::vector<T> &vChecks) {
+    //! Add a batch of checks to the queue, from any vector of T
+    template <typename Checks> void Add(Checks &vChecks) {
         boost::unique_lock<boost::mutex> lock(mutex);
         for (T &check : vChecks) {
             queue.push_back(std::move(check));
@@ -161,20 +164,229 @@ public:
         boost::unique_lock<boost::mutex> lock(mutex);
         return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
     }
+
+    unsigned int GetBatchSize() const { return nBatchSize; }
+};
+
+/**
+ * A CCheckQueue where each worker has its own deque of verifications, so
+ * workers don't contend on one lock when there are many of them.
+ *
+ * Add deals the verifications out to the deques of the workers, which take
+ * batches from the back of their own deque and, once it is empty, steal half
+ * of another one's from the front. The shared mutex is only taken to sleep
+ * when there is no work left anywhere, and to wake up.
+ */
+template <typename T> class CWorkStealingCheckQueue {
+private:
+    struct WorkerDeque {
+        boost::mutex mutex;
+        std::deque<T> checks;
+    };
+
+    //! Deque 0 is the master's, workers share the others if there are more
+    //! workers than deques.
+    std::vector<std::unique_ptr<WorkerDeque>> vDeques;
+
+    //! The number of workers that called Thread() so far.
+    std::atomic<unsigned int> nWorkers;
+
+    //! Where the next Add starts dealing, so small adds are spread out too.
+    std::atomic<unsigned int> nNextDeque;
+
+    //! The number of verifications in the deques.
+    std::atomic<unsigned int> nQueued;
+
+    /**
+     * Number of verifications that haven't completed yet, including those
+     * taken out of the deques but still in a worker's batch.
+     */
+    std::atomic<unsigned int> nTodo;
+
+    //! The temporary evaluation result.
+    std::atomic<bool> fAllOk;
+
+    //! Protects the sleeping, nQueued and nTodo are checked under it before
+    //! waiting and changed before it is taken to notify, so no wakeup is lost.
+    boost::mutex mutexSleep;
+    boost::condition_variable condWorker;
+    boost::condition_variable condMaster;
+
+    //! The maximum number of elements to be processed in one batch
+    unsigned int nBatchSize;
+
+    //! Deques that Add deals to: the master's and one per worker.
+    size_t GetActiveDeques() const {
+        return std::min(vDeques.size(), size_t(nWorkers) + 1);
+    }
+
+    //! Move verifications from the back of a deque, or steal from its front.
+    unsigned int Take(WorkerDeque &deque, std::vector<T> &vChecks,
+                      bool fSteal) {
+        boost::unique_lock<boost::mutex> lock(deque.mutex);
+        size_t nSize = deque.checks.size();
+        if (nSize == 0) {
+            return 0;
+        }
+        // Own work is taken in batches that get smaller as the deque empties,
+        // stolen work is half of what is left, so everyone finishes together.
+        unsigned int nNow = std::max<size_t>(
+            1, std::min<size_t>(nBatchSize, fSteal ? nSize / 2 : nSize));
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++) {
+            if (fSteal) {
+                vChecks[i].swap(deque.checks.front());
+                deque.checks.pop_front();
+            } else {
+                vChecks[i].swap(deque.checks.back());
+                deque.checks.pop_back();
+            }
+        }
+        nQueued -= nNow;
+        return nNow;
+    }
+
+    //! Fill vChecks from our own deque, or any other one.
+    unsigned int Find(size_t nOwn, std::vector<T> &vChecks) {
+        unsigned int nNow = Take(*vDeques[nOwn], vChecks, false);
+        for (size_t i = 1; nNow == 0 && nQueued > 0 && i < vDeques.size();
+             i++) {
+            nNow = Take(*vDeques[(nOwn + i) % vDeques.size()], vChecks, true);
+        }
+        return nNow;
+    }
+
+    /** Internal function that does bulk of the verification work. */
+    bool Loop(size_t nOwn, bool fMaster) {
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSize);
+        while (true) {
+            unsigned int nNow = Find(nOwn, vChecks);
+            if (nNow == 0) {
+                boost::unique_lock<boost::mutex> lock(mutexSleep);
+                if (nQueued > 0) {
+                    continue;
+                }
+                if (fMaster) {
+                    if (nTodo == 0) {
+                        bool fRet = fAllOk;
+                        // reset the status for new work later
+                        fAllOk = true;
+                        return fRet;
+                    }
+                    condMaster.wait(lock);
+                } else {
+                    condWorker.wait(lock);
+                }
+                continue;
+            }
+
+            // Once one verification failed, the rest are only counted.
+            bool fOk = fAllOk;
+            for (T &check : vChecks) {
+                if (fOk) fOk = check();
+            }
+            vChecks.clear();
+            if (!fOk) {
+                fAllOk = false;
+            }
+            if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+                // We processed the last element; inform the master it can
+                // exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutexSleep);
+                condMaster.notify_one();
+            }
+        }
+    }
+
+public:
+    //! Create a new check queue with up to nDeques deques
+    CWorkStealingCheckQueue(unsigned int nBatchSizeIn, unsigned int nDeques)
+        : nWorkers(0), nNextDeque(0), nQueued(0), nTodo(0), fAllOk(true),
+          nBatchSize(nBatchSizeIn) {
+        for (unsigned int i = 0; i < std::max(1U, nDeques); i++) {
+            vDeques.emplace_back(new WorkerDeque());
+        }
+    }
+
+    //! Worker thread
+    void Thread() {
+        unsigned int nWorker = nWorkers++;
+        size_t nOwn = 0;
+        if (vDeques.size() > 1) {
+            nOwn = 1 + nWorker % (vDeques.size() - 1);
+        }
+        Loop(nOwn, false);
+    }
+
+    //! Wait until execution finishes, and return whether all evaluations were
+    //! successful.
+    bool Wait() { return Loop(0, true); }
+
+    //! Add a batch of checks to the queue, from any vector of T
+    template <typename Checks> void Add(Checks &vChecks) {
+        if (vChecks.empty()) {
+            return;
+        }
+        // nTodo goes first, so it never drops below what workers took.
+        nTodo += vChecks.size();
+
+        // Deal out in chunks, one lock per deque.
+        const size_t nActive = GetActiveDeques();
+        const size_t nChunk =
+            std::max<size_t>(1, (vChecks.size() + nActive - 1) / nActive);
+        size_t nDeque = nNextDeque++ % nActive;
+        for (size_t nStart = 0; nStart < vChecks.size(); nStart += nChunk) {
+            size_t nEnd = std::min(vChecks.size(), nStart + nChunk);
+            WorkerDeque &deque = *vDeques[nDeque];
+            {
+                boost::unique_lock<boost::mutex> lock(deque.mutex);
+                for (size_t i = nStart; i < nEnd; i++) {
+                    deque.checks.emplace_back();
+                    deque.checks.back().swap(vChecks[i]);
+                }
+                // Under the deque's lock, so Take can't count them first.
+                nQueued += nEnd - nStart;
+            }
+            nDeque = (nDeque + 1) % nActive;
+        }
+
+        boost::unique_lock<boost::mutex> lock(mutexSleep);
+        if (vChecks.size() == 1) {
+            condWorker.notify_one();
+        } else {
+            condWorker.notify_all();
+        }
+    }
+
+    bool IsIdle() { return nTodo == 0 && nQueued == 0 && fAllOk; }
+
+    unsigned int GetBatchSize() const { return nBatchSize; }
 };
 
 /**
  * RAII-style controller object for a CCheckQueue that guarantees the passed
  * queue is finished before continuing.
+ *
+ * Checks are handed to the queue in batches of its batch size, so adding the
+ * checks of one transaction at a time doesn't take the queue's locks as often.
  */
-template <typename T> class CCheckQueueControl {
+template <typename T, typename Queue = CCheckQueue<T>>
+class CCheckQueueControl {
 private:
-    CCheckQueue<T> *pqueue;
+    Queue *pqueue;
     bool fDone;
+    std::vector<T> vPending;
+
+    void Submit() {
+        if (!vPending.empty()) {
+            pqueue->Add(vPending);
+            vPending.clear();
+        }
+    }
 
 public:
-    CCheckQueueControl(CCheckQueue<T> *pqueueIn)
-        : pqueue(pqueueIn), fDone(false) {
+    CCheckQueueControl(Queue *pqueueIn) : pqueue(pqueueIn), fDone(false) {
         // passed queue is supposed to be unused, or nullptr
         if (pqueue != nullptr) {
             bool isIdle = pqueue->IsIdle();
@@ -184,13 +396,26 @@ public:
 
     bool Wait() {
         if (pqueue == nullptr) return true;
+        Submit();
         bool fRet = pqueue->Wait();
         fDone = true;
         return fRet;
     }
 
-    void Add(std::vector<T> &vChecks) {
-        if (pqueue != nullptr) pqueue->Add(vChecks);
+    //! Hand the checks over, leaving vChecks with empty ones
+    template <typename Checks> void Add(Checks &vChecks) {
+        if (pqueue == nullptr) return;
+        if (vPending.empty() && vChecks.size() >= pqueue->GetBatchSize()) {
+            pqueue->Add(vChecks);
+            return;
+        }
+        for (T &check : vChecks) {
+            vPending.emplace_back();
+            vPending.back().swap(check);
+        }
+        if (vPending.size() >= pqueue->GetBatchSize()) {
+            Submit();
+        }
     }
 
     ~CCheckQueueControl() {
@@ -7,6 +7,7 @@
 #include "consensus/consensus.h"
 #include "memusage.h"
 #include "random.h"
+#include "streams.h"
 
 #include <cassert>
 
@@ -19,7 +20,11 @@ bool CCoinsView::HaveCoin(const COutPoint &outpoint) const {
 uint256 CCoinsView::GetBestBlock() const {
     return uint256();
 }
-bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+bool CCoinsView::GetStats(CUTXOStats &stats) const {
+    return false;
+}
+bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                            const CUTXOStats *pstats) {
     return false;
 }
 CCoinsViewCursor *CCoinsView::Cursor() const {
@@ -36,12 +41,19 @@ bool CCoinsViewBacked::HaveCoin(const COutPoint &outpoint) const {
 uint256 CCoinsViewBacked::GetBestBlock() const {
     return base->GetBestBlock();
 }
+bool CCoinsViewBacked::GetStats(CUTXOStats &stats) const {
+    return base->GetStats(stats);
+}
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) {
     base = &viewIn;
 }
+CCoinsView *CCoinsViewBacked::GetBackend() const {
+    return base;
+}
 bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins,
-                                  const uint256 &hashBlock) {
-    return base->BatchWrite(mapCoins, hashBlock);
+                                  const uint256 &hashBlock,
+                                  const CUTXOStats *pstats) {
+    return base->BatchWrite(mapCoins, hashBlock, pstats);
 }
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const {
     return base->Cursor();
@@ -50,12 +62,63 @@ size_t CCoinsViewBacked::EstimateSize() const {
     return base->EstimateSize();
 }
 
+static std::vector<uint8_t> SerializeStatsEntry(const COutPoint &outpoint,
+                                               const Coin &coin) {
+    std::vector<uint8_t> vch;
+    CVectorWriter(SER_DISK, 0, vch, 0)
+        << outpoint.hash << VARINT(outpoint.n) << coin;
+    return vch;
+}
+
+static int64_t GetBogoSize(const Coin &coin) {
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ +
+           8 /* amount */ + 2 /* scriptPubKey len */ +
+           coin.GetTxOut().scriptPubKey.size() /* scriptPubKey */;
+}
+
+void CUTXOStats::AddCoin(const COutPoint &outpoint, const Coin &coin) {
+    std::vector<uint8_t> vch = SerializeStatsEntry(outpoint, coin);
+    muhash.Insert(vch.data(), vch.size());
+    nCoins++;
+    nTotalAmount += coin.GetTxOut().nValue;
+    nTotalPrincipal += coin.GetTxOut().nPrincipal;
+    nBogoSize += GetBogoSize(coin);
+}
+
+void CUTXOStats::RemoveCoin(const COutPoint &outpoint, const Coin &coin) {
+    std::vector<uint8_t> vch = SerializeStatsEntry(outpoint, coin);
+    muhash.Remove(vch.data(), vch.size());
+    nCoins--;
+    nTotalAmount -= coin.GetTxOut().nValue;
+    nTotalPrincipal -= coin.GetTxOut().nPrincipal;
+    nBogoSize -= GetBogoSize(coin);
+}
+
+void CUTXOStats::Apply(const CUTXOStats &delta) {
+    muhash *= delta.muhash;
+    nCoins += delta.nCoins;
+    nTotalAmount += delta.nTotalAmount;
+    nTotalPrincipal += delta.nTotalPrincipal;
+    nBogoSize += delta.nBogoSize;
+}
+
+uint256 CUTXOStats::GetHash() const {
+    MuHash3072 muhashFinal = muhash;
+    uint256 hash;
+    muhashFinal.Finalize(hash.begin());
+    return hash;
+}
+
 SaltedOutpointHasher::SaltedOutpointHasher()
     : k0(GetRand(std::numeric_limits<uint64_t>::max())),
       k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
 CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn)
-    : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+    : CCoinsViewBacked(baseIn),
+      cacheCoins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(),
+                 CCoinsMapAllocator(&cacheCoinsResource)),
+      cachedCoinsUsage(0), nCacheHits(0), nCacheMisses(0), nGeneration(0),
+      fTrackStats(false), fStatsFetched(false) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
@@ -65,8 +128,11 @@ CCoinsMap::iterator
 CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
     if (it != cacheCoins.end()) {
+        it->second.generation = nGeneration;
+        nCacheHits++;
         return it;
     }
+    nCacheMisses++;
     Coin tmp;
     if (!base->GetCoin(outpoint, tmp)) {
         return cacheCoins.end();
@@ -81,6 +147,7 @@ CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
         // our version as fresh.
         ret->second.flags = CCoinsCacheEntry::FRESH;
     }
+    ret->second.generation = nGeneration;
     cachedCoinsUsage += ret->second.coin.DynamicMemoryUsage();
     return ret;
 }
@@ -116,9 +183,18 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin coin,
         }
         fresh = !(it->second.flags & CCoinsCacheEntry::DIRTY);
     }
+    // A coin overwritten in the base without having been fetched is missed,
+    // callers tracking stats check HaveCoin() first.
+    if (fTrackStats && FetchStats()) {
+        if (!it->second.coin.IsSpent()) {
+            pstats->RemoveCoin(outpoint, it->second.coin);
+        }
+        pstats->AddCoin(outpoint, coin);
+    }
     it->second.coin = std::move(coin);
     it->second.flags |=
         CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
+    it->second.generation = nGeneration;
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
 }
 
@@ -140,6 +216,9 @@ bool CCoinsViewCache::SpendCoin(const COutPoint &outpoint, Coin *moveout) {
         return false;
     }
     cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+    if (fTrackStats && !it->second.coin.IsSpent() && FetchStats()) {
+        pstats->RemoveCoin(outpoint, it->second.coin);
+    }
     if (moveout) {
         *moveout = std::move(it->second.coin);
     }
@@ -172,6 +251,20 @@ bool CCoinsViewCache::HaveCoinInCache(const COutPoint &outpoint) const {
     return it != cacheCoins.end();
 }
 
+void CCoinsViewCache::AddFetchedCoin(const COutPoint &outpoint, Coin &&coin) {
+    auto inserted = cacheCoins.emplace(std::piecewise_construct,
+                                       std::forward_as_tuple(outpoint),
+                                       std::forward_as_tuple(std::move(coin)));
+    if (!inserted.second) {
+        return;
+    }
+    if (inserted.first->second.coin.IsSpent()) {
+        inserted.first->second.flags = CCoinsCacheEntry::FRESH;
+    }
+    inserted.first->second.generation = nGeneration;
+    cachedCoinsUsage += inserted.first->second.coin.DynamicMemoryUsage();
+}
+
 uint256 CCoinsViewCache::GetBestBlock() const {
     if (hashBlock.IsNull()) {
         hashBlock = base->GetBestBlock();
@@ -181,10 +274,31 @@ uint256 CCoinsViewCache::GetBestBlock() const {
 
 void CCoinsViewCache::SetBestBlock(const uint256 &hashBlockIn) {
     hashBlock = hashBlockIn;
+    nGeneration++;
+}
+
+CUTXOStats *CCoinsViewCache::FetchStats() const {
+    if (!fStatsFetched) {
+        pstats.reset(new CUTXOStats());
+        if (!base->GetStats(*pstats)) {
+            pstats.reset();
+        }
+        fStatsFetched = true;
+    }
+    return pstats.get();
+}
+
+bool CCoinsViewCache::GetStats(CUTXOStats &stats) const {
+    if (!fTrackStats || !FetchStats()) {
+        return false;
+    }
+    stats = *pstats;
+    return true;
 }
 
 bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
-                                 const uint256 &hashBlockIn) {
+                                 const uint256 &hashBlockIn,
+                                 const CUTXOStats *pstatsIn) {
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         // Ignore non-dirty entries (optimization).
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -200,6 +314,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                     entry.coin = std::move(it->second.coin);
                     cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
                     entry.flags = CCoinsCacheEntry::DIRTY;
+                    entry.generation = nGeneration;
                     // We can mark it FRESH in the parent if it was FRESH in the
                     // child. Otherwise it might have just been flushed from the
                     // parent's cache and already exist in the grandparent
@@ -231,6 +346,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                     itUs->second.coin = std::move(it->second.coin);
                     cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                    itUs->second.generation = nGeneration;
                     // NOTE: It is possible the child has a FRESH flag here in
                     // the event the entry we found in the parent is pruned. But
                     // we must not copy that FRESH flag to the parent as that
@@ -243,16 +359,132 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
         mapCoins.erase(itOld);
     }
     hashBlock = hashBlockIn;
+    pstats.reset(pstatsIn ? new CUTXOStats(*pstatsIn) : nullptr);
+    fStatsFetched = true;
+    // The child cache moved on by a block.
+    nGeneration++;
     return true;
 }
 
 bool CCoinsViewCache::Flush() {
-    bool fOk = base->BatchWrite(cacheCoins, hashBlock);
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock,
+                                fTrackStats ? FetchStats() : nullptr);
     cacheCoins.clear();
     cachedCoinsUsage = 0;
     return fOk;
 }
 
+bool CCoinsViewCache::FlushPartial(size_t nTargetUsage) {
+    // Write a copy of the modified entries, from a pool of its own.
+    CCoinsMapMemoryResource resourceDirty;
+    CCoinsMap mapDirty(0, SaltedOutpointHasher(), CCoinsMap::key_equal(),
+                       CCoinsMapAllocator(&resourceDirty));
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) {
+            it++;
+            continue;
+        }
+        CCoinsCacheEntry &entry = mapDirty[it->first];
+        entry.coin = it->second.coin;
+        entry.flags = CCoinsCacheEntry::DIRTY;
+        if (it->second.coin.IsSpent()) {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            CCoinsMap::iterator itOld = it++;
+            cacheCoins.erase(itOld);
+        } else {
+            // The base has it now.
+            it->second.flags = 0;
+            it++;
+        }
+    }
+    bool fOk = base->BatchWrite(mapDirty, hashBlock,
+                                fTrackStats ? FetchStats() : nullptr);
+    Trim(nTargetUsage);
+    return fOk;
+}
+
+void CCoinsViewCache::Trim(size_t nTargetUsage) {
+    size_t nUsage = DynamicMemoryUsage();
+    if (nUsage <= nTargetUsage) {
+        return;
+    }
+
+    // Memory of the evictable entries by the number of blocks since their
+    // last use, then the youngest age that has to go.
+    const size_t nNodeUsage =
+        memusage::MallocUsage(sizeof(CCoinsMap::value_type) + sizeof(void *));
+    size_t vAgeUsage[256] = {};
+    for (const CCoinsMap::value_type &entry : cacheCoins) {
+        if (!(entry.second.flags & CCoinsCacheEntry::DIRTY)) {
+            uint8_t nAge = nGeneration - entry.second.generation;
+            vAgeUsage[nAge] +=
+                nNodeUsage + entry.second.coin.DynamicMemoryUsage();
+        }
+    }
+    int nMinAge = 256;
+    while (nMinAge > 0 && nUsage > nTargetUsage) {
+        nMinAge--;
+        nUsage -= std::min(nUsage, vAgeUsage[nMinAge]);
+    }
+
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        uint8_t nAge = nGeneration - it->second.generation;
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY) && nAge >= nMinAge) {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            CCoinsMap::iterator itOld = it++;
+            cacheCoins.erase(itOld);
+        } else {
+            it++;
+        }
+    }
+}
+
+void CCoinsViewCache::GetHotCoins(size_t nMax,
+                                  std::vector<COutPoint> &vOutPoints) const {
+    // Unspent entries by the number of blocks since their last use, then the
+    // oldest age that fits whole.
+    size_t vAgeCount[256] = {};
+    for (const CCoinsMap::value_type &entry : cacheCoins) {
+        if (!entry.second.coin.IsSpent()) {
+            vAgeCount[uint8_t(nGeneration - entry.second.generation)]++;
+        }
+    }
+    int nMaxAge = -1;
+    size_t nCount = 0;
+    while (nMaxAge < 255 && nCount + vAgeCount[nMaxAge + 1] <= nMax) {
+        nMaxAge++;
+        nCount += vAgeCount[nMaxAge];
+    }
+
+    // What is left is taken from the next age.
+    size_t nPartial =
+        nMaxAge < 255 ? std::min(nMax - nCount, vAgeCount[nMaxAge + 1]) : 0;
+    vOutPoints.reserve(vOutPoints.size() + nCount + nPartial);
+    for (const CCoinsMap::value_type &entry : cacheCoins) {
+        if (entry.second.coin.IsSpent()) {
+            continue;
+        }
+        int nAge = uint8_t(nGeneration - entry.second.generation);
+        if (nAge <= nMaxAge) {
+            vOutPoints.push_back(entry.first);
+        } else if (nAge == nMaxAge + 1 && nPartial > 0) {
+            vOutPoints.push_back(entry.first);
+            nPartial--;
+        }
+    }
+}
+
+void CCoinsViewCache::ReallocateCache() {
+    // Nodes go back to the pool, not to the system, so replace both.
+    assert(cacheCoins.empty());
+    cacheCoins.~CCoinsMap();
+    cacheCoinsResource.~CCoinsMapMemoryResource();
+    ::new (&cacheCoinsResource) CCoinsMapMemoryResource();
+    ::new (&cacheCoins)
+        CCoinsMap(0, SaltedOutpointHasher(), CCoinsMap::key_equal(),
+                  CCoinsMapAllocator(&cacheCoinsResource));
+}
+
 void CCoinsViewCache::Uncache(const COutPoint &outpoint) {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
     if (it != cacheCoins.end() && it->second.flags == 0) {
@@ -8,13 +8,17 @@
 
 #include "compressor.h"
 #include "core_memusage.h"
+#include "crypto/muhash.h"
 #include "hash.h"
 #include "memusage.h"
 #include "serialize.h"
+#include "support/allocators/pool.h"
 #include "uint256.h"
 
 #include <cassert>
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <unordered_map>
 
 /**
@@ -25,7 +29,9 @@
  * - the non-spent CTxOut (via CTxOutCompressor)
  */
 class Coin {
-    //! Unspent transaction output.
+    //! Unspent transaction output. Its content is not kept, as nothing
+    //! spending it needs that. Load it from the transaction with
+    //! GetCoinContent() instead.
     CTxOut out;
 
     //! Whether containing transaction was a coinbase and height at which the
@@ -37,8 +43,15 @@ public:
     Coin() : nHeightAndIsCoinBase(0) {}
 
     //! Constructor from a CTxOut and height/coinbase information.
-    Coin(CTxOut outIn, uint32_t nHeightIn, bool IsCoinbase)
+    Coin(CTxOut &&outIn, uint32_t nHeightIn, bool IsCoinbase)
         : out(std::move(outIn)),
+          nHeightAndIsCoinBase((nHeightIn << 1) | IsCoinbase) {
+        DropContent();
+    }
+    //! Copies everything but the content, which can be large.
+    Coin(const CTxOut &outIn, uint32_t nHeightIn, bool IsCoinbase)
+        : out(outIn.nValue, outIn.scriptPubKey, std::string(), outIn.nLockTime,
+              outIn.nPrincipal),
           nHeightAndIsCoinBase((nHeightIn << 1) | IsCoinbase) {}
 
     uint32_t GetHeight() const { return nHeightAndIsCoinBase >> 1; }
@@ -62,10 +75,52 @@ public:
     template <typename Stream> void Unserialize(Stream &s) {
         ::Unserialize(s, VARINT(nHeightAndIsCoinBase));
         ::Unserialize(s, REF(CTxOutCompressor(out)));
+        // Written before content was dropped from coins.
+        DropContent();
     }
 
     size_t DynamicMemoryUsage() const {
-        return memusage::DynamicUsage(out.scriptPubKey);
+        return memusage::DynamicUsage(out.scriptPubKey) +
+               memusage::DynamicUsage(out.strContent);
+    }
+
+private:
+    void DropContent() { std::string().swap(out.strContent); }
+};
+
+/**
+ * Totals over a set of coins, and a MuHash of its entries: the outpoint's txid
+ * and VARINT(n) followed by the serialized Coin. Coins may be removed before
+ * they are added, so a CUTXOStats can also be the change between two sets.
+ */
+class CUTXOStats {
+public:
+    MuHash3072 muhash;
+    int64_t nCoins;
+    CAmount nTotalAmount;
+    CAmount nTotalPrincipal;
+    //! Database-independent size, as in gettxoutsetinfo
+    int64_t nBogoSize;
+
+    CUTXOStats()
+        : nCoins(0), nTotalAmount(0), nTotalPrincipal(0), nBogoSize(0) {}
+
+    void AddCoin(const COutPoint &outpoint, const Coin &coin);
+    void RemoveCoin(const COutPoint &outpoint, const Coin &coin);
+    //! Add the changes of another CUTXOStats
+    void Apply(const CUTXOStats &delta);
+
+    uint256 GetHash() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(muhash);
+        READWRITE(nCoins);
+        READWRITE(nTotalAmount);
+        READWRITE(nTotalPrincipal);
+        READWRITE(nBogoSize);
     }
 };
 
@@ -94,6 +149,8 @@ struct CCoinsCacheEntry {
     // The actual cached data.
     Coin coin;
     uint8_t flags;
+    //! Generation of the owning cache when the entry was last used
+    uint8_t generation;
 
     enum Flags {
         // This cache entry is potentially different from the version in the
@@ -107,12 +164,23 @@ struct CCoinsCacheEntry {
            that condition is not guaranteed. */
     };
 
-    CCoinsCacheEntry() : flags(0) {}
+    CCoinsCacheEntry() : flags(0), generation(0) {}
     explicit CCoinsCacheEntry(Coin coinIn)
-        : coin(std::move(coinIn)), flags(0) {}
+        : coin(std::move(coinIn)), flags(0), generation(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher>
+/**
+ * The nodes of a CCoinsMap come from a pool instead of one heap allocation per
+ * coin, sized for them with some slack for the node's own pointers.
+ */
+typedef PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                      sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) +
+                          sizeof(void *) * 4>
+    CCoinsMapAllocator;
+typedef CCoinsMapAllocator::ResourceType CCoinsMapMemoryResource;
+
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher,
+                           std::equal_to<COutPoint>, CCoinsMapAllocator>
     CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
@@ -127,6 +195,9 @@ public:
 
     virtual bool Valid() const = 0;
     virtual void Next() = 0;
+    //! Move to the first entry at or after key. Returns false if the cursor
+    //! can't seek.
+    virtual bool Seek(const COutPoint &key) { return false; }
 
     //! Get best block at the time this cursor was created
     const uint256 &GetBestBlock() const { return hashBlock; }
@@ -148,9 +219,14 @@ public:
     //! Retrieve the block hash whose state this CCoinsView currently represents
     virtual uint256 GetBestBlock() const;
 
+    //! Retrieve the statistics of that state, false if they aren't known
+    virtual bool GetStats(CUTXOStats &stats) const;
+
     //! Do a bulk modification (multiple Coin changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! The passed mapCoins can be modified. pstats has the statistics after
+    //! the change, nullptr if they aren't known.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                            const CUTXOStats *pstats);
 
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
@@ -172,8 +248,11 @@ public:
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
+    bool GetStats(CUTXOStats &stats) const override;
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    CCoinsView *GetBackend() const;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                    const CUTXOStats *pstats) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
 };
@@ -188,11 +267,32 @@ protected:
      * declared as "const".
      */
     mutable uint256 hashBlock;
+    mutable CCoinsMapMemoryResource cacheCoinsResource;
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    //! Lookups found in the cache, and those that went to the base
+    mutable uint64_t nCacheHits;
+    mutable uint64_t nCacheMisses;
+
+    /**
+     * Advances with every block connected or disconnected through the cache.
+     * Entries are stamped with it when used, so Trim() can tell how many
+     * blocks ago that was, up to 255.
+     */
+    uint8_t nGeneration;
+
+    /**
+     * Statistics of the coins, fetched from the base on first use and kept up
+     * to date by AddCoin and SpendCoin if TrackStats() was called. Null if the
+     * base didn't know them.
+     */
+    bool fTrackStats;
+    mutable bool fStatsFetched;
+    mutable std::unique_ptr<CUTXOStats> pstats;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -201,7 +301,16 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     void SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool GetStats(CUTXOStats &stats) const override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                    const CUTXOStats *pstats) override;
+
+    /**
+     * Keep the statistics of the coins up to date, which costs a MuHash
+     * update per added or spent coin. Without it, flushing makes the
+     * statistics of the base unknown.
+     */
+    void TrackStats() { fTrackStats = true; }
 
     /**
      * Check if we have the given utxo already loaded in this cache.
@@ -210,6 +319,12 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
+    /**
+     * Add a coin read from the backing CCoinsView by the caller, as if it had
+     * been fetched through this cache. Does nothing if it's already cached.
+     */
+    void AddFetchedCoin(const COutPoint &outpoint, Coin &&coin);
+
     /**
      * Return a reference to a Coin in the cache, or a pruned one if not found.
      * This is more efficient than GetCoin. Modifications to other cache entries
@@ -239,6 +354,31 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications to the base like Flush(), but keep the unspent
+     * coins cached, now unmodified, and then Trim() to nTargetUsage. Blocks
+     * after a flush then don't have to start from a cold cache.
+     */
+    bool FlushPartial(size_t nTargetUsage);
+
+    /**
+     * Evict unmodified entries, those unused for the most blocks first, until
+     * the cache takes no more than nTargetUsage bytes.
+     */
+    void Trim(size_t nTargetUsage);
+
+    /**
+     * The outpoints of at most nMax unspent coins of the cache, those used
+     * the fewest blocks ago.
+     */
+    void GetHotCoins(size_t nMax, std::vector<COutPoint> &vOutPoints) const;
+
+    /**
+     * Give the memory of the empty cache back to the system. Flush() keeps it
+     * for reuse, which is what short-lived caches want.
+     */
+    void ReallocateCache();
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is not
      * modified.
@@ -251,6 +391,10 @@ public:
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
+    //! Lookups of coins found in the cache, and not, since it was created
+    uint64_t GetCacheHits() const { return nCacheHits; }
+    uint64_t GetCacheMisses() const { return nCacheMisses; }
+
     /**
      * CAmount of bitcoins coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of
@@ -277,6 +421,7 @@ public:
 
 private:
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
+    CUTXOStats *FetchStats() const;
 
     /**
      * By making the copy constructor private, we prevent accidentally using it
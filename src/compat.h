@@ -47,6 +47,14 @@
 #include <unistd.h>
 #endif
 
+// On Linux the socket handler waits on epoll and single sockets are waited on
+// with poll(), so descriptors are not limited to FD_SETSIZE.
+#ifdef __linux__
+#define USE_EPOLL
+#include <poll.h>
+#include <sys/epoll.h>
+#endif
+
 #ifdef WIN32
 #define MSG_DONTWAIT 0
 #else
@@ -96,7 +104,7 @@ size_t strnlen(const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
 static bool inline IsSelectableSocket(SOCKET s) {
-#ifdef WIN32
+#if defined(WIN32) || defined(USE_EPOLL)
     return true;
 #else
     return (s < FD_SETSIZE);
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "merkle.h"
+#include "crypto/sha256.h"
 #include "hash.h"
 #include "utilstrencodings.h"
 
@@ -143,10 +144,27 @@ static void MerkleComputation(const std::vector<uint256> &leaves,
     if (proot) *proot = h;
 }
 
-uint256 ComputeMerkleRoot(const std::vector<uint256> &leaves, bool *mutated) {
-    uint256 hash;
-    MerkleComputation(leaves, &hash, mutated, -1, nullptr);
-    return hash;
+uint256 ComputeMerkleRoot(std::vector<uint256> leaves, bool *mutated) {
+    // Unlike MerkleComputation, work level by level so that every level is
+    // hashed with a single SHA256D64 call over contiguous 64-byte pairs.
+    bool mutation = false;
+    while (leaves.size() > 1) {
+        if (mutated) {
+            for (size_t pos = 0; pos + 1 < leaves.size(); pos += 2) {
+                if (leaves[pos] == leaves[pos + 1]) {
+                    mutation = true;
+                }
+            }
+        }
+        if (leaves.size() & 1) {
+            leaves.push_back(leaves.back());
+        }
+        SHA256D64(leaves[0].begin(), leaves[0].begin(), leaves.size() / 2);
+        leaves.resize(leaves.size() / 2);
+    }
+    if (mutated) *mutated = mutation;
+    if (leaves.size() == 0) return uint256();
+    return leaves[0];
 }
 
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256> &leaves,
@@ -178,7 +196,7 @@ uint256 BlockMerkleRoot(const CBlock &block, bool *mutated) {
     for (size_t s = 0; s < block.vtx.size(); s++) {
         leaves[s] = block.vtx[s]->GetId();
     }
-    return ComputeMerkleRoot(leaves, mutated);
+    return ComputeMerkleRoot(std::move(leaves), mutated);
 }
 
 std::vector<uint256> BlockMerkleBranch(const CBlock &block, uint32_t position) {
@@ -12,8 +12,11 @@
 #include "primitives/transaction.h"
 #include "uint256.h"
 
-uint256 ComputeMerkleRoot(const std::vector<uint256> &leaves,
-                          bool *mutated = nullptr);
+/**
+ * Compute the Merkle root of leaves, which is reduced in place one tree level
+ * at a time. *mutated is set to true if a duplicated subtree was found.
+ */
+uint256 ComputeMerkleRoot(std::vector<uint256> leaves, bool *mutated = nullptr);
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256> &leaves,
                                          uint32_t position);
 uint256 ComputeMerkleRootFromBranch(const uint256 &leaf,
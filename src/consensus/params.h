@@ -78,6 +78,13 @@ struct Params {
     int64_t DifficultyAdjustmentInterval() const {
         return nPowTargetTimespan / nPowTargetSpacing;
     }
+    /** Ethash cache and DAG sizes in bytes, see ethash_set_params */
+    uint64_t nEthashCacheBytesInit;
+    uint64_t nEthashCacheBytesGrowth;
+    uint64_t nEthashDatasetBytesInit;
+    uint64_t nEthashDatasetBytesGrowth;
+    /** Blocks that share an ethash cache and DAG */
+    uint64_t nEthashEpochLength;
     uint256 nMinimumChainWork;
     uint256 defaultAssumeValid;
 };
@@ -23,7 +23,8 @@ static inline size_t RecursiveDynamicUsage(const CTxIn &in) {
 }
 
 static inline size_t RecursiveDynamicUsage(const CTxOut &out) {
-    return RecursiveDynamicUsage(out.scriptPubKey);
+    return RecursiveDynamicUsage(out.scriptPubKey) +
+           memusage::DynamicUsage(out.strContent);
 }
 
 static inline size_t RecursiveDynamicUsage(const CTransaction &tx) {
@@ -66,4 +67,9 @@ static inline size_t RecursiveDynamicUsage(const CBlockLocator &locator) {
     return memusage::DynamicUsage(locator.vHave);
 }
 
+template <typename X>
+static inline size_t RecursiveDynamicUsage(const std::shared_ptr<X> &p) {
+    return p ? memusage::DynamicUsage(p) + RecursiveDynamicUsage(*p) : 0;
+}
+
 #endif // BITCOIN_CORE_MEMUSAGE_H
@@ -138,7 +138,7 @@ std::string ScriptToAsmStr(const CScript &script,
 std::string EncodeHexTx(const CTransaction &tx, const int serialFlags) {
     CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION | serialFlags);
     ssTx << tx;
-    return HexStr(ssTx.begin(), ssTx.end());
+    return HexStr(ssTx.data(), ssTx.data() + ssTx.size());
 }
 
 void ScriptPubKeyToUniv(const CScript &scriptPubKey, UniValue &out,
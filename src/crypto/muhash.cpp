@@ -0,0 +1,162 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/chacha20.h"
+#include "crypto/sha256.h"
+
+#include <limits>
+
+namespace {
+
+//! 2^3072 - MAX_PRIME_DIFF is the modulus
+const Num3072::limb_t MAX_PRIME_DIFF = 1103717;
+const Num3072::limb_t LIMB_MAX = std::numeric_limits<Num3072::limb_t>::max();
+
+} // namespace
+
+Num3072::Num3072(const uint8_t *data) {
+    for (int i = 0; i < LIMBS; ++i) {
+        limbs[i] = 0;
+        for (size_t j = 0; j < sizeof(limb_t); ++j) {
+            limbs[i] |= limb_t(data[i * sizeof(limb_t) + j]) << (8 * j);
+        }
+    }
+    if (IsOverflow()) {
+        FullReduce();
+    }
+}
+
+void Num3072::ToBytes(uint8_t *out) const {
+    for (int i = 0; i < LIMBS; ++i) {
+        for (size_t j = 0; j < sizeof(limb_t); ++j) {
+            out[i * sizeof(limb_t) + j] = uint8_t(limbs[i] >> (8 * j));
+        }
+    }
+}
+
+void Num3072::SetToOne() {
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i) {
+        limbs[i] = 0;
+    }
+}
+
+bool Num3072::IsOverflow() const {
+    if (limbs[0] <= LIMB_MAX - MAX_PRIME_DIFF) {
+        return false;
+    }
+    for (int i = 1; i < LIMBS; ++i) {
+        if (limbs[i] != LIMB_MAX) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Num3072::FullReduce() {
+    // Subtracting the modulus is adding MAX_PRIME_DIFF and dropping 2^3072.
+    double_limb_t c = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS; ++i) {
+        c += limbs[i];
+        limbs[i] = limb_t(c);
+        c >>= LIMB_SIZE;
+    }
+}
+
+void Num3072::Multiply(const Num3072 &a) {
+    limb_t t[2 * LIMBS] = {0};
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t carry = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            double_limb_t x = double_limb_t(limbs[i]) * a.limbs[j] +
+                              t[i + j] + carry;
+            t[i + j] = limb_t(x);
+            carry = limb_t(x >> LIMB_SIZE);
+        }
+        t[i + LIMBS] = carry;
+    }
+
+    // 2^3072 is MAX_PRIME_DIFF modulo the prime, so fold the high half in.
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        double_limb_t x = double_limb_t(t[LIMBS + i]) * MAX_PRIME_DIFF + t[i] +
+                          carry;
+        limbs[i] = limb_t(x);
+        carry = limb_t(x >> LIMB_SIZE);
+    }
+    while (carry != 0) {
+        double_limb_t x = double_limb_t(carry) * MAX_PRIME_DIFF;
+        for (int i = 0; i < LIMBS; ++i) {
+            x += limbs[i];
+            limbs[i] = limb_t(x);
+            x >>= LIMB_SIZE;
+        }
+        carry = limb_t(x);
+    }
+    if (IsOverflow()) {
+        FullReduce();
+    }
+}
+
+Num3072 Num3072::GetInverse() const {
+    // a^(p - 2) by Fermat, with p - 2 = 2^3072 - MAX_PRIME_DIFF - 2, which
+    // has all bits set except in its lowest limb.
+    const limb_t nLowest = LIMB_MAX - MAX_PRIME_DIFF - 1;
+    Num3072 r;
+    for (int i = LIMBS - 1; i >= 0; --i) {
+        const limb_t e = i == 0 ? nLowest : LIMB_MAX;
+        for (int b = LIMB_SIZE - 1; b >= 0; --b) {
+            r.Multiply(r);
+            if ((e >> b) & 1) {
+                r.Multiply(*this);
+            }
+        }
+    }
+    return r;
+}
+
+void Num3072::Divide(const Num3072 &a) {
+    Multiply(a.GetInverse());
+}
+
+Num3072 MuHash3072::ToNum3072(const uint8_t *data, size_t len) {
+    uint8_t hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(hash);
+    uint8_t tmp[Num3072::BYTE_SIZE];
+    ChaCha20(hash, sizeof(hash)).Output(tmp, sizeof(tmp));
+    return Num3072(tmp);
+}
+
+MuHash3072 &MuHash3072::Insert(const uint8_t *data, size_t len) {
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072 &MuHash3072::Remove(const uint8_t *data, size_t len) {
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072 &MuHash3072::operator*=(const MuHash3072 &mul) {
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072 &MuHash3072::operator/=(const MuHash3072 &div) {
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(uint8_t hash[OUTPUT_SIZE]) {
+    numerator.Divide(denominator);
+    denominator.SetToOne();
+
+    uint8_t data[Num3072::BYTE_SIZE];
+    numerator.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(hash);
+}
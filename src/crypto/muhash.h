@@ -0,0 +1,101 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <cstdint>
+#include <cstdlib>
+
+/** A number modulo the prime 2^3072 - 1103717, always fully reduced. */
+class Num3072 {
+public:
+    static const size_t BYTE_SIZE = 384;
+
+#ifdef __SIZEOF_INT128__
+    typedef uint64_t limb_t;
+    typedef unsigned __int128 double_limb_t;
+#else
+    typedef uint32_t limb_t;
+    typedef uint64_t double_limb_t;
+#endif
+    static const int LIMB_SIZE = 8 * sizeof(limb_t);
+    static const int LIMBS = 3072 / LIMB_SIZE;
+
+    Num3072() { SetToOne(); }
+    //! From BYTE_SIZE little endian bytes
+    explicit Num3072(const uint8_t *data);
+
+    void SetToOne();
+    void Multiply(const Num3072 &a);
+    void Divide(const Num3072 &a);
+    void ToBytes(uint8_t *out) const;
+
+    template <typename Stream> void Serialize(Stream &s) const {
+        uint8_t data[BYTE_SIZE];
+        ToBytes(data);
+        s.write(reinterpret_cast<const char *>(data), BYTE_SIZE);
+    }
+
+    template <typename Stream> void Unserialize(Stream &s) {
+        uint8_t data[BYTE_SIZE];
+        s.read(reinterpret_cast<char *>(data), BYTE_SIZE);
+        *this = Num3072(data);
+    }
+
+private:
+    limb_t limbs[LIMBS];
+
+    bool IsOverflow() const;
+    void FullReduce();
+    Num3072 GetInverse() const;
+};
+
+/**
+ * A hash of a set of byte strings, which can be updated as strings are added
+ * and removed, in any order.
+ *
+ * Each string is hashed with SHA256, expanded to a Num3072 with ChaCha20 and
+ * multiplied in (or divided out). Sets with the same contents give the same
+ * product, and finding two that do otherwise is as hard as the discrete
+ * logarithm in that group. The product is hashed with SHA256 to finalize.
+ *
+ * The numerator and the denominator are kept apart, so updates only multiply
+ * and the division is left to Finalize.
+ */
+class MuHash3072 {
+public:
+    static const size_t OUTPUT_SIZE = 32;
+
+    //! The hash of the empty set
+    MuHash3072() {}
+
+    MuHash3072 &Insert(const uint8_t *data, size_t len);
+    MuHash3072 &Remove(const uint8_t *data, size_t len);
+
+    //! Union of the sets, if they are disjoint
+    MuHash3072 &operator*=(const MuHash3072 &mul);
+    //! Difference of the sets, if div is a subset
+    MuHash3072 &operator/=(const MuHash3072 &div);
+
+    void Finalize(uint8_t hash[OUTPUT_SIZE]);
+
+    template <typename Stream> void Serialize(Stream &s) const {
+        numerator.Serialize(s);
+        denominator.Serialize(s);
+    }
+
+    template <typename Stream> void Unserialize(Stream &s) {
+        numerator.Unserialize(s);
+        denominator.Unserialize(s);
+    }
+
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const uint8_t *data, size_t len);
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
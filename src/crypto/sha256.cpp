@@ -186,7 +186,340 @@ namespace sha256 {
         s[7] += h;
     }
 
+    void TransformBlocks(uint32_t *s, const uint8_t *chunk, size_t blocks) {
+        while (blocks--) {
+            Transform(s, chunk);
+            chunk += 64;
+        }
+    }
+
+    /** Round constants, for the vectorized transforms. */
+    const uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+        0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+        0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+        0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+        0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+        0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+        0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    /** Initial state, and the message words of the two padding blocks. */
+    const uint32_t INIT[8] = {0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul,
+                              0xa54ff53aul, 0x510e527ful, 0x9b05688cul,
+                              0x1f83d9abul, 0x5be0cd19ul};
+    const uint32_t PAD64[16] = {0x80000000ul, 0, 0, 0, 0, 0, 0, 0,
+                                0,            0, 0, 0, 0, 0, 0, 0x200};
+
 } // namespace sha256
+
+/*
+ * The accelerated variants are compiled with per-function target attributes,
+ * like the ethash kernels, so the library still builds for (and runs on) a
+ * baseline CPU. SHA256SelectImplementation() picks one at runtime.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__))
+#define SHA256_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+
+namespace sha256_shani {
+    /** One 4-round step with the next message quad added to the constants. */
+    __attribute__((target("sha,sse4.1"))) inline void
+    QuadRound(__m128i &state0, __m128i &state1, __m128i msg, int i) {
+        msg = _mm_add_epi32(
+            msg, _mm_loadu_si128((const __m128i *)&sha256::K[4 * i]));
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+        state0 = _mm_sha256rnds2_epu32(state0, state1,
+                                       _mm_shuffle_epi32(msg, 0x0e));
+    }
+
+    /** next = msg2(next + (cur:prev >> 32), cur), the schedule's last step */
+    __attribute__((target("sha,sse4.1"))) inline void
+    ShiftMessage(__m128i prev, __m128i cur, __m128i &next) {
+        next = _mm_sha256msg2_epu32(
+            _mm_add_epi32(next, _mm_alignr_epi8(cur, prev, 4)), cur);
+    }
+
+    __attribute__((target("sha,sse4.1"))) inline __m128i
+    Load(const uint8_t *in) {
+        const __m128i mask =
+            _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+        return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)in), mask);
+    }
+
+    __attribute__((target("sha,sse4.1"))) void
+    Transform(uint32_t *s, const uint8_t *chunk, size_t blocks) {
+        // The SHA instructions keep the state as ABEF and CDGH.
+        __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((__m128i *)&s[0]), 0xb1);
+        __m128i state1 =
+            _mm_shuffle_epi32(_mm_loadu_si128((__m128i *)&s[4]), 0x1b);
+        __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+        state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+        while (blocks--) {
+            const __m128i save0 = state0, save1 = state1;
+            __m128i m0, m1, m2, m3;
+
+            QuadRound(state0, state1, m0 = Load(chunk), 0);
+            QuadRound(state0, state1, m1 = Load(chunk + 16), 1);
+            m0 = _mm_sha256msg1_epu32(m0, m1);
+            QuadRound(state0, state1, m2 = Load(chunk + 32), 2);
+            m1 = _mm_sha256msg1_epu32(m1, m2);
+            QuadRound(state0, state1, m3 = Load(chunk + 48), 3);
+            ShiftMessage(m2, m3, m0);
+            m2 = _mm_sha256msg1_epu32(m2, m3);
+            for (int i = 4; i < 12; i += 4) {
+                QuadRound(state0, state1, m0, i);
+                ShiftMessage(m3, m0, m1);
+                m3 = _mm_sha256msg1_epu32(m3, m0);
+                QuadRound(state0, state1, m1, i + 1);
+                ShiftMessage(m0, m1, m2);
+                m0 = _mm_sha256msg1_epu32(m0, m1);
+                QuadRound(state0, state1, m2, i + 2);
+                ShiftMessage(m1, m2, m3);
+                m1 = _mm_sha256msg1_epu32(m1, m2);
+                QuadRound(state0, state1, m3, i + 3);
+                ShiftMessage(m2, m3, m0);
+                m2 = _mm_sha256msg1_epu32(m2, m3);
+            }
+            QuadRound(state0, state1, m0, 12);
+            ShiftMessage(m3, m0, m1);
+            m3 = _mm_sha256msg1_epu32(m3, m0);
+            QuadRound(state0, state1, m1, 13);
+            ShiftMessage(m0, m1, m2);
+            QuadRound(state0, state1, m2, 14);
+            ShiftMessage(m1, m2, m3);
+            QuadRound(state0, state1, m3, 15);
+
+            state0 = _mm_add_epi32(state0, save0);
+            state1 = _mm_add_epi32(state1, save1);
+            chunk += 64;
+        }
+
+        tmp = _mm_shuffle_epi32(state0, 0x1b);
+        state1 = _mm_shuffle_epi32(state1, 0xb1);
+        _mm_storeu_si128((__m128i *)&s[0], _mm_blend_epi16(tmp, state1, 0xf0));
+        _mm_storeu_si128((__m128i *)&s[4], _mm_alignr_epi8(state1, tmp, 8));
+    }
+
+    bool Supported() {
+        uint32_t a, b, c, d;
+        __cpuid(0, a, b, c, d);
+        if (a < 7) {
+            return false;
+        }
+        __cpuid_count(7, 0, a, b, c, d);
+        return ((b >> 29) & 1) && __builtin_cpu_supports("sse4.1");
+    }
+} // namespace sha256_shani
+
+/*
+ * Double SHA-256 of several 64-byte inputs at once, one per vector lane. Both
+ * widths share these macros, written against V_ADD etc. which each variant
+ * defines for its vector type V_T.
+ */
+#define MW_ROTR(x, n) V_OR(V_SHR(x, n), V_SHL(x, 32 - (n)))
+#define MW_Ch(x, y, z) V_XOR(z, V_AND(x, V_XOR(y, z)))
+#define MW_Maj(x, y, z) V_OR(V_AND(x, y), V_AND(z, V_OR(x, y)))
+#define MW_Sigma0(x) V_XOR(V_XOR(MW_ROTR(x, 2), MW_ROTR(x, 13)), MW_ROTR(x, 22))
+#define MW_Sigma1(x) V_XOR(V_XOR(MW_ROTR(x, 6), MW_ROTR(x, 11)), MW_ROTR(x, 25))
+#define MW_sigma0(x) V_XOR(V_XOR(MW_ROTR(x, 7), MW_ROTR(x, 18)), V_SHR(x, 3))
+#define MW_sigma1(x) V_XOR(V_XOR(MW_ROTR(x, 17), MW_ROTR(x, 19)), V_SHR(x, 10))
+
+/** Compress the 16 message words w into the state s of every lane. */
+#define MW_TRANSFORM(s, w)                                                     \
+    do {                                                                       \
+        V_T a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5],        \
+            g = s[6], h = s[7];                                                \
+        for (int i = 0; i < 64; i++) {                                         \
+            if (i >= 16) {                                                     \
+                w[i & 15] = V_ADD(                                             \
+                    V_ADD(w[i & 15], MW_sigma1(w[(i - 2) & 15])),              \
+                    V_ADD(w[(i - 7) & 15], MW_sigma0(w[(i - 15) & 15])));      \
+            }                                                                  \
+            V_T t1 = V_ADD(V_ADD(h, MW_Sigma1(e)),                             \
+                           V_ADD(MW_Ch(e, f, g),                               \
+                                 V_ADD(V_SET1(sha256::K[i]), w[i & 15])));     \
+            V_T t2 = V_ADD(MW_Sigma0(a), MW_Maj(a, b, c));                     \
+            h = g;                                                             \
+            g = f;                                                             \
+            f = e;                                                             \
+            e = V_ADD(d, t1);                                                  \
+            d = c;                                                             \
+            c = b;                                                             \
+            b = a;                                                             \
+            a = V_ADD(t1, t2);                                                 \
+        }                                                                      \
+        s[0] = V_ADD(s[0], a);                                                 \
+        s[1] = V_ADD(s[1], b);                                                 \
+        s[2] = V_ADD(s[2], c);                                                 \
+        s[3] = V_ADD(s[3], d);                                                 \
+        s[4] = V_ADD(s[4], e);                                                 \
+        s[5] = V_ADD(s[5], f);                                                 \
+        s[6] = V_ADD(s[6], g);                                                 \
+        s[7] = V_ADD(s[7], h);                                                 \
+    } while (0)
+
+/** The whole double hash; V_LOAD(in, j) gathers word j of every lane. */
+#define MW_TRANSFORM_D64(out, in, LANES)                                       \
+    do {                                                                       \
+        V_T s[8], w[16];                                                       \
+        for (int j = 0; j < 8; j++) {                                          \
+            s[j] = V_SET1(sha256::INIT[j]);                                    \
+        }                                                                      \
+        for (int j = 0; j < 16; j++) {                                         \
+            w[j] = V_LOAD(in, j);                                              \
+        }                                                                      \
+        MW_TRANSFORM(s, w);                                                    \
+        for (int j = 0; j < 16; j++) {                                         \
+            w[j] = V_SET1(sha256::PAD64[j]);                                   \
+        }                                                                      \
+        MW_TRANSFORM(s, w);                                                    \
+        for (int j = 0; j < 8; j++) {                                          \
+            w[j] = s[j];                                                       \
+            s[j] = V_SET1(sha256::INIT[j]);                                    \
+        }                                                                      \
+        w[8] = V_SET1(0x80000000ul);                                           \
+        for (int j = 9; j < 15; j++) {                                         \
+            w[j] = V_SET1(0);                                                  \
+        }                                                                      \
+        w[15] = V_SET1(0x100);                                                 \
+        MW_TRANSFORM(s, w);                                                    \
+        uint32_t lanes[LANES];                                                 \
+        for (int j = 0; j < 8; j++) {                                          \
+            V_STORE(lanes, s[j]);                                              \
+            for (int l = 0; l < LANES; l++) {                                  \
+                WriteBE32(out + 32 * l + 4 * j, lanes[l]);                     \
+            }                                                                  \
+        }                                                                      \
+    } while (0)
+
+namespace sha256d64_sse41 {
+#define V_T __m128i
+#define V_ADD(x, y) _mm_add_epi32(x, y)
+#define V_XOR(x, y) _mm_xor_si128(x, y)
+#define V_OR(x, y) _mm_or_si128(x, y)
+#define V_AND(x, y) _mm_and_si128(x, y)
+#define V_SHR(x, n) _mm_srli_epi32(x, n)
+#define V_SHL(x, n) _mm_slli_epi32(x, n)
+#define V_SET1(x) _mm_set1_epi32((int)(x))
+#define V_LOAD(in, j)                                                          \
+    _mm_set_epi32(ReadBE32(in + 192 + 4 * j), ReadBE32(in + 128 + 4 * j),      \
+                  ReadBE32(in + 64 + 4 * j), ReadBE32(in + 4 * j))
+#define V_STORE(p, x) _mm_storeu_si128((__m128i *)p, x)
+
+    __attribute__((target("sse4.1"))) void Transform_4way(uint8_t *out,
+                                                          const uint8_t *in) {
+        MW_TRANSFORM_D64(out, in, 4);
+    }
+
+#undef V_T
+#undef V_ADD
+#undef V_XOR
+#undef V_OR
+#undef V_AND
+#undef V_SHR
+#undef V_SHL
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+} // namespace sha256d64_sse41
+
+namespace sha256d64_avx2 {
+#define V_T __m256i
+#define V_ADD(x, y) _mm256_add_epi32(x, y)
+#define V_XOR(x, y) _mm256_xor_si256(x, y)
+#define V_OR(x, y) _mm256_or_si256(x, y)
+#define V_AND(x, y) _mm256_and_si256(x, y)
+#define V_SHR(x, n) _mm256_srli_epi32(x, n)
+#define V_SHL(x, n) _mm256_slli_epi32(x, n)
+#define V_SET1(x) _mm256_set1_epi32((int)(x))
+#define V_LOAD(in, j)                                                          \
+    _mm256_set_epi32(ReadBE32(in + 448 + 4 * j), ReadBE32(in + 384 + 4 * j),   \
+                     ReadBE32(in + 320 + 4 * j), ReadBE32(in + 256 + 4 * j),   \
+                     ReadBE32(in + 192 + 4 * j), ReadBE32(in + 128 + 4 * j),   \
+                     ReadBE32(in + 64 + 4 * j), ReadBE32(in + 4 * j))
+#define V_STORE(p, x) _mm256_storeu_si256((__m256i *)p, x)
+
+    __attribute__((target("avx2"))) void Transform_8way(uint8_t *out,
+                                                        const uint8_t *in) {
+        MW_TRANSFORM_D64(out, in, 8);
+    }
+
+#undef V_T
+#undef V_ADD
+#undef V_XOR
+#undef V_OR
+#undef V_AND
+#undef V_SHR
+#undef V_SHL
+#undef V_SET1
+#undef V_LOAD
+#undef V_STORE
+} // namespace sha256d64_avx2
+
+#undef MW_TRANSFORM_D64
+#undef MW_TRANSFORM
+#undef MW_sigma1
+#undef MW_sigma0
+#undef MW_Sigma1
+#undef MW_Sigma0
+#undef MW_Maj
+#undef MW_Ch
+#undef MW_ROTR
+#endif // x86
+
+/** A SHA-256 implementation selectable at runtime. */
+struct SHA256Implementation {
+    //! Human readable name, e.g. "avx2"
+    const char *name;
+    //! Compress consecutive 64-byte chunks into the state
+    void (*transform)(uint32_t *s, const uint8_t *chunk, size_t blocks);
+    //! Double hash 4 or 8 64-byte inputs at once, nullptr when unavailable
+    void (*d64_4way)(uint8_t *out, const uint8_t *in);
+    void (*d64_8way)(uint8_t *out, const uint8_t *in);
+};
+
+const SHA256Implementation implStandard = {"standard", sha256::TransformBlocks,
+                                           nullptr, nullptr};
+#ifdef SHA256_X86
+const SHA256Implementation implSSE41 = {"sse4.1", sha256::TransformBlocks,
+                                        sha256d64_sse41::Transform_4way,
+                                        nullptr};
+const SHA256Implementation implAVX2 = {"avx2", sha256::TransformBlocks,
+                                       sha256d64_sse41::Transform_4way,
+                                       sha256d64_avx2::Transform_8way};
+const SHA256Implementation implSHANI = {"shani", sha256_shani::Transform,
+                                        nullptr, nullptr};
+#endif
+
+/** Every implementation usable on this CPU, fastest first, standard last. */
+const SHA256Implementation *SupportedImplementation(unsigned i) {
+    const SHA256Implementation *supported[4];
+    unsigned count = 0;
+#ifdef SHA256_X86
+    __builtin_cpu_init();
+    if (sha256_shani::Supported()) {
+        supported[count++] = &implSHANI;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        supported[count++] = &implAVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        supported[count++] = &implSSE41;
+    }
+#endif
+    supported[count++] = &implStandard;
+    return i < count ? supported[i] : nullptr;
+}
+
+const SHA256Implementation *implementation = &implStandard;
+bool fImplementationSelected = false;
 } // namespace
 
 ////// SHA-256
@@ -203,14 +536,15 @@ CSHA256 &CSHA256::Write(const uint8_t *data, size_t len) {
         memcpy(buf + bufsize, data, 64 - bufsize);
         bytes += 64 - bufsize;
         data += 64 - bufsize;
-        sha256::Transform(s, buf);
+        implementation->transform(s, buf, 1);
         bufsize = 0;
     }
-    while (end >= data + 64) {
+    if (end >= data + 64) {
         // Process full chunks directly from the source.
-        sha256::Transform(s, data);
-        bytes += 64;
-        data += 64;
+        size_t blocks = (end - data) / 64;
+        implementation->transform(s, data, blocks);
+        bytes += 64 * blocks;
+        data += 64 * blocks;
     }
     if (end > data) {
         // Fill the buffer with what remains.
@@ -241,3 +575,73 @@ CSHA256 &CSHA256::Reset() {
     sha256::Initialize(s);
     return *this;
 }
+
+const char *SHA256SelectImplementation() {
+    if (!fImplementationSelected) {
+        implementation = SupportedImplementation(0);
+        fImplementationSelected = true;
+    }
+    return implementation->name;
+}
+
+bool SHA256SetImplementation(const std::string &name) {
+    const SHA256Implementation *impl;
+    for (unsigned i = 0; (impl = SupportedImplementation(i)) != nullptr; i++) {
+        if (name == impl->name) {
+            implementation = impl;
+            fImplementationSelected = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SHA256D64(uint8_t *out, const uint8_t *in, size_t blocks) {
+    if (implementation->d64_8way) {
+        while (blocks >= 8) {
+            implementation->d64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (implementation->d64_4way) {
+        while (blocks >= 4) {
+            implementation->d64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+
+    // The padding blocks are constant: a 64-byte message fills one chunk and
+    // needs a second for its length, the 32-byte inner hash fits in one.
+    static const uint8_t pad64[64] = {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                      0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                      0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                      0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                      0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0};
+    uint8_t chunk[64] = {0};
+    chunk[32] = 0x80;
+    chunk[62] = 1;
+
+    uint32_t s[8];
+    while (blocks--) {
+        sha256::Initialize(s);
+        implementation->transform(s, in, 1);
+        implementation->transform(s, pad64, 1);
+        for (int i = 0; i < 8; i++) {
+            WriteBE32(chunk + 4 * i, s[i]);
+        }
+
+        // The input is fully consumed before anything is written, so the
+        // output may overlap it.
+        sha256::Initialize(s);
+        implementation->transform(s, chunk, 1);
+        for (int i = 0; i < 8; i++) {
+            WriteBE32(out + 4 * i, s[i]);
+        }
+        in += 64;
+        out += 32;
+    }
+}
@@ -7,6 +7,7 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256 {
@@ -24,4 +25,24 @@ public:
     CSHA256 &Reset();
 };
 
+/**
+ * Pick the fastest SHA-256 implementation this CPU supports, unless
+ * SHA256SetImplementation() forced one, and return its name. Call it once at
+ * startup so that the selection never races with hashing threads.
+ */
+const char *SHA256SelectImplementation();
+
+/**
+ * Use the named implementation ("standard", "sse4.1", "avx2" or "shani"), for
+ * tests and benchmarks. Returns false if this CPU does not support it.
+ */
+bool SHA256SetImplementation(const std::string &name);
+
+/**
+ * Compute the double SHA-256 of each of blocks 64-byte inputs in `in`, writing
+ * the 32-byte results consecutively to `out`. `out` may alias `in`, which is
+ * how merkle tree levels are reduced in place.
+ */
+void SHA256D64(uint8_t *out, const uint8_t *in, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
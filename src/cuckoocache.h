@@ -118,6 +118,7 @@ public:
  *
  *  Read Operations:
  *      - contains(*, false)
+ *      - for_each_live()
  *
  *  Read+Erase Operations:
  *      - contains(*, true)
@@ -455,6 +456,22 @@ public:
         }
         return false;
     }
+
+    /**
+     * for_each_live calls f on every element which has not been garbage
+     * collected, in table order. It is used to persist the cache.
+     *
+     * Requires the same synchronization as a Read operation.
+     *
+     * @param f a callable taking a const Element &
+     */
+    template <typename F> void for_each_live(F f) const {
+        for (uint32_t i = 0; i < size; ++i) {
+            if (!collection_flags.bit_is_set(i)) {
+                f(table[i]);
+            }
+        }
+    }
 };
 } // namespace CuckooCache
 
@@ -15,14 +15,19 @@
 #include <leveldb/filter_policy.h>
 #include <memenv.h>
 
-static leveldb::Options GetOptions(size_t nCacheSize) {
+static leveldb::Options GetOptions(size_t nCacheSize,
+                                   const CDBOptions &dbOptions) {
     leveldb::Options options;
     options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
     // up to two write buffers may be held in memory simultaneously
     options.write_buffer_size = nCacheSize / 4;
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    if (dbOptions.nBloomBitsPerKey > 0) {
+        options.filter_policy =
+            leveldb::NewBloomFilterPolicy(dbOptions.nBloomBitsPerKey);
+    }
     options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.max_open_files = dbOptions.nMaxOpenFiles;
+    options.max_file_size = dbOptions.nMaxFileSize;
     if (leveldb::kMajorVersion > 1 ||
         (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption.
@@ -33,13 +38,14 @@ static leveldb::Options GetOptions(size_t nCacheSize) {
 }
 
 CDBWrapper::CDBWrapper(const boost::filesystem::path &path, size_t nCacheSize,
-                       bool fMemory, bool fWipe, bool obfuscate) {
+                       bool fMemory, bool fWipe, bool obfuscate,
+                       const CDBOptions &dbOptions) {
     penv = nullptr;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, dbOptions);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -25,6 +25,30 @@ public:
     dbwrapper_error(const std::string &msg) : std::runtime_error(msg) {}
 };
 
+//! LevelDB's own default table file size
+static const size_t DEFAULT_DB_MAX_FILE_SIZE = 2 << 20;
+static const int DEFAULT_DB_MAX_OPEN_FILES = 64;
+static const int DEFAULT_DB_BLOOM_BITS_PER_KEY = 10;
+
+/**
+ * Storage tuning for one database, so that each can be set up for the way it
+ * is used.
+ */
+struct CDBOptions {
+    //! Table files kept open at once
+    int nMaxOpenFiles;
+    //! Size at which compaction starts a new table file. Larger files mean
+    //! fewer of them to keep open, and fewer, larger compactions.
+    size_t nMaxFileSize;
+    //! Bloom filter bits per key, or 0 for no filter
+    int nBloomBitsPerKey;
+
+    CDBOptions()
+        : nMaxOpenFiles(DEFAULT_DB_MAX_OPEN_FILES),
+          nMaxFileSize(DEFAULT_DB_MAX_FILE_SIZE),
+          nBloomBitsPerKey(DEFAULT_DB_BLOOM_BITS_PER_KEY) {}
+};
+
 class CDBWrapper;
 
 /**
@@ -219,10 +243,12 @@ public:
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If
      * false, XOR
      *                        with a zero'd byte array.
+     * @param[in] dbOptions   Tuning for this database's access pattern.
      */
     CDBWrapper(const boost::filesystem::path &path, size_t nCacheSize,
                bool fMemory = false, bool fWipe = false,
-               bool obfuscate = false);
+               bool obfuscate = false,
+               const CDBOptions &dbOptions = CDBOptions());
     ~CDBWrapper();
 
     template <typename K, typename V> bool Read(const K &key, V &value) const {
@@ -239,11 +265,14 @@ public:
             dbwrapper_private::HandleError(status);
         }
         try {
-            CDataStream ssValue(strValue.data(),
-                                strValue.data() + strValue.size(), SER_DISK,
-                                CLIENT_VERSION);
-            ssValue.Xor(obfuscate_key);
-            ssValue >> value;
+            // strValue is ours: deobfuscated in place and read from, rather
+            // than copied into a stream first.
+            uint8_t *pValue = reinterpret_cast<uint8_t *>(&strValue[0]);
+            XorWithKey(pValue, strValue.size(), obfuscate_key.data(),
+                       obfuscate_key.size());
+            CSpanReader reader(SER_DISK, CLIENT_VERSION, pValue,
+                               pValue + strValue.size());
+            reader >> value;
         } catch (const std::exception &) {
             return false;
         }
@@ -0,0 +1,173 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file ethash.cl
+ * Ethash nonce search for the OpenCL mining backend, one nonce per work item.
+ *
+ * Only plain C is used here, so test/ethash_cl_tests.cpp can build the kernel
+ * on the host and check it against ethash_full_compute().
+ */
+
+#define CL_ACCESSES 64
+#define CL_MIX_WORDS 32
+#define CL_FNV_PRIME 0x01000193U
+#define CL_MAX_OUTPUTS 4
+
+#define cl_fnv(x, y) ((x) * CL_FNV_PRIME ^ (y))
+#define cl_rotl64(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+
+__constant ulong keccak_rc[24] = {
+	0x0000000000000001UL, 0x0000000000008082UL, 0x800000000000808aUL, 0x8000000080008000UL,
+	0x000000000000808bUL, 0x0000000080000001UL, 0x8000000080008081UL, 0x8000000000008009UL,
+	0x000000000000008aUL, 0x0000000000000088UL, 0x0000000080008009UL, 0x000000008000000aUL,
+	0x000000008000808bUL, 0x800000000000008bUL, 0x8000000000008089UL, 0x8000000000008003UL,
+	0x8000000000008002UL, 0x8000000000000080UL, 0x000000000000800aUL, 0x800000008000000aUL,
+	0x8000000080008081UL, 0x8000000000008080UL, 0x0000000080000001UL, 0x8000000080008008UL
+};
+
+__constant uint keccak_rho[24] = {
+	1,  3,  6, 10, 15, 21, 28, 36, 45, 55,  2, 14,
+	27, 41, 56,  8, 25, 43, 62, 18, 39, 61, 20, 44
+};
+
+__constant uint keccak_pi[24] = {
+	10,  7, 11, 17, 18,  3,  5, 16,  8, 21, 24,  4,
+	15, 23, 19, 13, 12,  2, 20, 14, 22,  9,  6,  1
+};
+
+static void keccak_f1600(ulong* a)
+{
+	ulong b[5];
+	for (uint round = 0; round < 24; ++round) {
+		// theta
+		for (uint x = 0; x < 5; ++x) {
+			b[x] = a[x] ^ a[x + 5] ^ a[x + 10] ^ a[x + 15] ^ a[x + 20];
+		}
+		for (uint x = 0; x < 5; ++x) {
+			ulong const t = b[(x + 4) % 5] ^ cl_rotl64(b[(x + 1) % 5], 1);
+			for (uint y = 0; y < 25; y += 5) {
+				a[y + x] ^= t;
+			}
+		}
+		// rho and pi
+		ulong t = a[1];
+		for (uint i = 0; i < 24; ++i) {
+			uint const j = keccak_pi[i];
+			ulong const next = a[j];
+			a[j] = cl_rotl64(t, keccak_rho[i]);
+			t = next;
+		}
+		// chi
+		for (uint y = 0; y < 25; y += 5) {
+			for (uint x = 0; x < 5; ++x) {
+				b[x] = a[y + x];
+			}
+			for (uint x = 0; x < 5; ++x) {
+				a[y + x] = b[x] ^ ((~b[(x + 1) % 5]) & b[(x + 2) % 5]);
+			}
+		}
+		// iota
+		a[0] ^= keccak_rc[round];
+	}
+}
+
+static ulong cl_bswap64(ulong x)
+{
+	x = ((x & 0x00000000ffffffffUL) << 32) | (x >> 32);
+	x = ((x & 0x0000ffff0000ffffUL) << 16) | ((x >> 16) & 0x0000ffff0000ffffUL);
+	x = ((x & 0x00ff00ff00ff00ffUL) << 8) | ((x >> 8) & 0x00ff00ff00ff00ffUL);
+	return x;
+}
+
+/**
+ * Hash nonce start_nonce + get_global_id(0). Nonces whose final hash starts
+ * with at most target, the first 8 bytes of the boundary read big endian, are
+ * appended to output: output[0] counts them and nonce i goes to
+ * output[1 + 2i] (low word) and output[2 + 2i] (high word). The host checks
+ * them against the full boundary.
+ *
+ * @param dag          The DAG, as little endian 32-bit words
+ * @param num_pages    Number of 128 byte pages in the DAG
+ * @param header       The header hash, as 4 little endian 64-bit words
+ */
+__kernel void ethash_search(
+	__global uint const* dag,
+	uint num_pages,
+	__global ulong const* header,
+	ulong start_nonce,
+	ulong target,
+	__global volatile uint* output
+)
+{
+	ulong const nonce = start_nonce + get_global_id(0);
+
+	// keccak-512 of header and nonce, 40 of the 72 bytes of rate
+	ulong st[25];
+	for (uint i = 0; i < 25; ++i) {
+		st[i] = 0;
+	}
+	for (uint i = 0; i < 4; ++i) {
+		st[i] = header[i];
+	}
+	st[4] = nonce;
+	st[5] ^= 0x01;
+	st[8] ^= 0x8000000000000000UL;
+	keccak_f1600(st);
+
+	ulong seed[8];
+	for (uint i = 0; i < 8; ++i) {
+		seed[i] = st[i];
+	}
+
+	uint mix[CL_MIX_WORDS];
+	for (uint w = 0; w < CL_MIX_WORDS; ++w) {
+		ulong const s = seed[(w % 16) / 2];
+		mix[w] = (uint)(w % 2 ? s >> 32 : s);
+	}
+
+	uint const seed0 = (uint)seed[0];
+	for (uint i = 0; i < CL_ACCESSES; ++i) {
+		uint const index = cl_fnv(seed0 ^ i, mix[i % CL_MIX_WORDS]) % num_pages;
+		__global uint const* page = dag + (ulong)index * CL_MIX_WORDS;
+		for (uint w = 0; w < CL_MIX_WORDS; ++w) {
+			mix[w] = cl_fnv(mix[w], page[w]);
+		}
+	}
+
+	// compress the mix and keccak-256 seed and mix, 96 of the 136 bytes of rate
+	for (uint i = 0; i < 25; ++i) {
+		st[i] = 0;
+	}
+	for (uint i = 0; i < 8; ++i) {
+		st[i] = seed[i];
+	}
+	for (uint w = 0; w < CL_MIX_WORDS; w += 8) {
+		uint lo = cl_fnv(cl_fnv(cl_fnv(mix[w], mix[w + 1]), mix[w + 2]), mix[w + 3]);
+		uint hi = cl_fnv(cl_fnv(cl_fnv(mix[w + 4], mix[w + 5]), mix[w + 6]), mix[w + 7]);
+		st[8 + w / 8] = (ulong)lo | ((ulong)hi << 32);
+	}
+	st[12] ^= 0x01;
+	st[16] ^= 0x8000000000000000UL;
+	keccak_f1600(st);
+
+	if (cl_bswap64(st[0]) <= target) {
+		uint const slot = atomic_inc(&output[0]);
+		if (slot < CL_MAX_OUTPUTS) {
+			output[1 + 2 * slot] = (uint)nonce;
+			output[2 + 2 * slot] = (uint)(nonce >> 32);
+		}
+	}
+}
@@ -29,7 +29,7 @@
 #define ETHASH_REVISION 23
 #define ETHASH_DATASET_BYTES_INIT 1073741824U // 2**30
 #define ETHASH_DATASET_BYTES_GROWTH 8388608U  // 2**23
-#define ETHASH_CACHE_BYTES_INIT 1073741824U // 2**24
+#define ETHASH_CACHE_BYTES_INIT 16777216U // 2**24
 #define ETHASH_CACHE_BYTES_GROWTH 131072U  // 2**17
 #define ETHASH_EPOCH_LENGTH 180000U
 #define ETHASH_MIX_BYTES 128
@@ -44,6 +44,16 @@
 extern "C" {
 #endif
 
+/// The sizes of the cache and DAG and the length of an epoch. The ETHASH_*
+/// constants above are the defaults, networks can have their own.
+typedef struct ethash_params {
+	uint64_t cache_bytes_init;
+	uint64_t cache_bytes_growth;
+	uint64_t dataset_bytes_init;
+	uint64_t dataset_bytes_growth;
+	uint64_t epoch_length;
+} ethash_params_t;
+
 /// Type of a seedhash/blockhash e.t.c.
 #ifndef __ETHASH_H256__
 #define __ETHASH_H256__    
@@ -113,6 +123,81 @@ ethash_return_value_t ethash_light_compute(
  */
 ethash_full_t ethash_full_new(ethash_light_t light, ethash_callback_t callback);
 
+/**
+ * Allocate and initialize a new ethash_full handler, computing the DAG with
+ * several threads
+ *
+ * @param light         The light handler containing the cache.
+ * @param callback      A callback function with signature of @ref ethash_callback_t.
+ *                      Same semantics as for @ref ethash_full_new(). It is shared
+ *                      by all worker threads but never invoked concurrently.
+ * @param num_threads   Number of threads computing the DAG. 0 or 1 means the DAG
+ *                      is computed on the calling thread.
+ * @return              Newly allocated ethash_full handler or NULL in case of
+ *                      ERRNOMEM or invalid parameters used for @ref ethash_compute_full_data()
+ */
+ethash_full_t ethash_full_new_parallel(
+	ethash_light_t light,
+	ethash_callback_t callback,
+	unsigned num_threads
+);
+
+/**
+ * Allocate and initialize a new ethash_full handler, keeping the DAG file in
+ * the given directory. A complete DAG file left there by an earlier run is
+ * reused once a sample of its items checks out against the light cache.
+ * Same as @ref ethash_full_new_parallel() otherwise.
+ *
+ * @param dirname       Directory of the DAG files, NULL for the default one
+ *                      from @ref ethash_get_default_dirname()
+ */
+ethash_full_t ethash_full_new_dir(
+	char const* dirname,
+	ethash_light_t light,
+	ethash_callback_t callback,
+	unsigned num_threads
+);
+
+/**
+ * Delete the DAG file of the epoch of block_number, if there is one
+ *
+ * @param dirname       Directory of the DAG files, NULL for the default one
+ * @return              true if a file was removed
+ */
+bool ethash_remove_dag_file(char const* dirname, uint64_t block_number);
+
+/** Page sizes for @ref ethash_full_clone() */
+enum ethash_page_size {
+	ETHASH_PAGES_DEFAULT = 0,
+	ETHASH_PAGES_2MB = 1, //!< 2MB huge pages, transparent ones if none are reserved
+	ETHASH_PAGES_1GB = 2  //!< 1GB huge pages, then as ETHASH_PAGES_2MB
+};
+
+/**
+ * Copy the DAG of a full handler into anonymous memory, which is not backed
+ * by the DAG file and can use huge pages. The pages are allocated by the
+ * calling thread, so on NUMA machines they end up on its node.
+ *
+ * @param full          The full handler to copy
+ * @param page_size     Pages backing the copy, see @ref ethash_page_size
+ * @return              Newly allocated ethash_full handler or NULL if the
+ *                      memory could not be allocated
+ */
+ethash_full_t ethash_full_clone(ethash_full_t full, enum ethash_page_size page_size);
+
+/**
+ * Fault in all pages of the DAG, so the first hashes don't wait on the disk
+ */
+void ethash_full_prefault(ethash_full_t full);
+
+/**
+ * Lock the DAG in RAM, so it is never swapped out
+ *
+ * @return              false if the OS refused, usually because of the
+ *                      RLIMIT_MEMLOCK limit
+ */
+bool ethash_full_lock(ethash_full_t full);
+
 /**
  * Frees a previously allocated ethash_full handler
  * @param full    The light handler to free
@@ -131,6 +216,61 @@ ethash_return_value_t ethash_full_compute(
 	ethash_h256_t const header_hash,
 	uint64_t nonce
 );
+/**
+ * Callback supplying the DAG pages for @ref ethash_compute_pages()
+ *
+ * @param ctx            The context given to @ref ethash_compute_pages()
+ * @param access         Which of the ETHASH_ACCESSES reads this is
+ * @param index          Index of the page in the DAG
+ * @param page           Where to copy the ETHASH_MIX_BYTES of the page
+ * @return               false to abort the computation
+ */
+typedef bool(*ethash_page_callback_t)(void* ctx, unsigned access, uint32_t index, uint8_t* page);
+/**
+ * Calculate the ethash of a header with DAG pages supplied by a callback, for
+ * instance pages proven against a commitment to the DAG instead of a whole
+ * DAG in memory.
+ *
+ * @param ret            The hash and mix hash computed
+ * @param full_size      The size of the DAG in bytes, see @ref ethash_full_dag_size()
+ * @param header_hash    The header hash to pack into the mix
+ * @param nonce          The nonce to pack into the mix
+ * @param callback       Called once for each page read, in order
+ * @param ctx            Passed to the callback
+ * @return               false if the callback aborted or full_size is invalid
+ */
+bool ethash_compute_pages(
+	ethash_return_value_t* ret,
+	uint64_t full_size,
+	ethash_h256_t const header_hash,
+	uint64_t nonce,
+	ethash_page_callback_t callback,
+	void* ctx
+);
+/**
+ * Search count nonces from start_nonce for one whose hash meets the boundary.
+ * Several nonces are hashed side by side to hide the latency of the DAG
+ * reads, which makes this a lot faster than calling ethash_full_compute() in
+ * a loop.
+ *
+ * @param full           The full client handler
+ * @param header_hash    The header hash to pack into the mix
+ * @param boundary       The boundary the final hash must not exceed
+ * @param start_nonce    The first nonce to try, later ones wrap around
+ * @param count          Number of nonces to try
+ * @param nonce_out      The nonce found, if any
+ * @param ret_out        The hash and mix hash of the nonce found, if any
+ * @return               true if a nonce was found
+ */
+bool ethash_full_search(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	ethash_h256_t const boundary,
+	uint64_t start_nonce,
+	uint64_t count,
+	uint64_t* nonce_out,
+	ethash_return_value_t* ret_out
+);
 /**
  * Get a pointer to the full DAG data
  */
@@ -145,6 +285,41 @@ uint64_t ethash_full_dag_size(ethash_full_t full);
  */
 ethash_h256_t ethash_get_seedhash(uint64_t block_number);
 
+/**
+ * Set the sizes of the cache and DAG and the epoch length, those of the
+ * ETHASH_* constants until then. Should be called at startup, before any
+ * cache or DAG is computed: those computed before don't match the new
+ * parameters.
+ *
+ * @param params    The initial sizes must be at least 4 items (cache nodes,
+ *                  DAG pages) and the epoch length must not be 0
+ */
+void ethash_set_params(ethash_params_t const* params);
+/**
+ * Get the parameters set by @ref ethash_set_params()
+ */
+ethash_params_t ethash_get_params(void);
+/**
+ * Get the number of blocks of an epoch, which share a cache and DAG
+ */
+uint64_t ethash_get_epoch_length(void);
+
+/**
+ * Detect the CPU features and select the fastest FNV mixing kernels
+ * (AVX2, SSE4.1, NEON or scalar) used for DAG generation and hashing.
+ * Should be called once at startup, before any DAG or hash is computed.
+ *
+ * @return          The name of the selected kernels
+ */
+char const* ethash_select_kernels(void);
+/**
+ * Force a specific set of kernels, e.g. to benchmark or test them.
+ *
+ * @param name      One of "avx2", "sse4.1", "neon" or "scalar"
+ * @return          false if the kernels are not supported on this CPU
+ */
+bool ethash_set_kernels(char const* name);
+
 void ethash_h256_print(ethash_h256_t hash);
 #ifdef __cplusplus
 }
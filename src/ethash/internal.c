@@ -20,11 +20,14 @@
 * @date 2015
 */
 
+#define _GNU_SOURCE
 #include <assert.h>
 #include <inttypes.h>
 #include <stddef.h>
+#include <string.h>
 #include <errno.h>
 #include <math.h>
+#include <pthread.h>
 #include "mmap.h"
 #include "ethash.h"
 #include "fnv.h"
@@ -32,6 +35,8 @@
 #include "internal.h"
 #include "data_sizes.h"
 #include "io.h"
+#include "kernels.h"
+#include "util.h"
 
 #ifdef WITH_CRYPTOPP
 
@@ -41,16 +46,90 @@
 #include "sha3.h"
 #endif // WITH_CRYPTOPP
 
+static ethash_params_t ethash_params = {
+	ETHASH_CACHE_BYTES_INIT,
+	ETHASH_CACHE_BYTES_GROWTH,
+	ETHASH_DATASET_BYTES_INIT,
+	ETHASH_DATASET_BYTES_GROWTH,
+	ETHASH_EPOCH_LENGTH
+};
+
+void ethash_set_params(ethash_params_t const* params)
+{
+	assert(params->cache_bytes_init >= 4 * ETHASH_HASH_BYTES);
+	assert(params->dataset_bytes_init >= 4 * ETHASH_MIX_BYTES);
+	assert(params->epoch_length > 0);
+	ethash_params = *params;
+}
+
+ethash_params_t ethash_get_params(void)
+{
+	return ethash_params;
+}
+
+uint64_t ethash_get_epoch_length(void)
+{
+	return ethash_params.epoch_length;
+}
+
+// The precomputed tables of data_sizes.h are for the default sizes only
+static bool ethash_default_sizes(void)
+{
+	return ethash_params.cache_bytes_init == ETHASH_CACHE_BYTES_INIT &&
+		ethash_params.cache_bytes_growth == ETHASH_CACHE_BYTES_GROWTH &&
+		ethash_params.dataset_bytes_init == ETHASH_DATASET_BYTES_INIT &&
+		ethash_params.dataset_bytes_growth == ETHASH_DATASET_BYTES_GROWTH;
+}
+
+static bool ethash_is_prime(uint64_t n)
+{
+	if (n < 2) {
+		return false;
+	}
+	for (uint64_t i = 2; i * i <= n; ++i) {
+		if (n % i == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// The largest size below init + growth * epoch that is a prime number of
+// items, as the tables of data_sizes.h were computed
+static uint64_t ethash_compute_size(
+	uint64_t init,
+	uint64_t growth,
+	uint64_t item_bytes,
+	uint64_t epoch
+)
+{
+	uint64_t size = init + growth * epoch - item_bytes;
+	while (!ethash_is_prime(size / item_bytes)) {
+		size -= 2 * item_bytes;
+	}
+	return size;
+}
+
 uint64_t ethash_get_datasize(uint64_t const block_number)
 {
-	assert(block_number / ETHASH_EPOCH_LENGTH < 2048);
-	return dag_sizes[block_number / ETHASH_EPOCH_LENGTH];
+	uint64_t const epoch = block_number / ethash_params.epoch_length;
+	if (!ethash_default_sizes()) {
+		return ethash_compute_size(ethash_params.dataset_bytes_init,
+			ethash_params.dataset_bytes_growth, ETHASH_MIX_BYTES, epoch);
+	}
+	assert(epoch < 2048);
+	return dag_sizes[epoch];
 }
 
 uint64_t ethash_get_cachesize(uint64_t const block_number)
 {
-	assert(block_number / ETHASH_EPOCH_LENGTH < 2048);
-	return cache_sizes[block_number / ETHASH_EPOCH_LENGTH];
+	uint64_t const epoch = block_number / ethash_params.epoch_length;
+	if (!ethash_default_sizes()) {
+		return ethash_compute_size(ethash_params.cache_bytes_init,
+			ethash_params.cache_bytes_growth, ETHASH_HASH_BYTES, epoch);
+	}
+	assert(epoch < 2048);
+	return cache_sizes[epoch];
 }
 
 // Follows Sergio's "STRICT MEMORY HARD HASHING FUNCTIONS" (2014)
@@ -102,44 +181,41 @@ void ethash_calculate_dag_item(
 	memcpy(ret, init, sizeof(node));
 	ret->words[0] ^= node_index;
 	SHA3_512(ret->bytes, ret->bytes, sizeof(node));
-#if defined(_M_X64) && ENABLE_SSE
-	__m128i const fnv_prime = _mm_set1_epi32(FNV_PRIME);
-	__m128i xmm0 = ret->xmm[0];
-	__m128i xmm1 = ret->xmm[1];
-	__m128i xmm2 = ret->xmm[2];
-	__m128i xmm3 = ret->xmm[3];
-#endif
+	ethash_get_kernels()->dag_parents(ret, node_index, cache_nodes, num_parent_nodes);
+	SHA3_512(ret->bytes, ret->bytes, sizeof(node));
+}
 
-	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
-		uint32_t parent_index = fnv_hash(node_index ^ i, ret->words[i % NODE_WORDS]) % num_parent_nodes;
-		node const *parent = &cache_nodes[parent_index];
-
-#if defined(_M_X64) && ENABLE_SSE
-		{
-			xmm0 = _mm_mullo_epi32(xmm0, fnv_prime);
-			xmm1 = _mm_mullo_epi32(xmm1, fnv_prime);
-			xmm2 = _mm_mullo_epi32(xmm2, fnv_prime);
-			xmm3 = _mm_mullo_epi32(xmm3, fnv_prime);
-			xmm0 = _mm_xor_si128(xmm0, parent->xmm[0]);
-			xmm1 = _mm_xor_si128(xmm1, parent->xmm[1]);
-			xmm2 = _mm_xor_si128(xmm2, parent->xmm[2]);
-			xmm3 = _mm_xor_si128(xmm3, parent->xmm[3]);
-
-			// have to write to ret as values are used to compute index
-			ret->xmm[0] = xmm0;
-			ret->xmm[1] = xmm1;
-			ret->xmm[2] = xmm2;
-			ret->xmm[3] = xmm3;
+/// The @a count DAG items from @a first, hashing four of them at a time
+static void ethash_calculate_dag_items(
+	node* const ret,
+	uint32_t first,
+	uint32_t count,
+	ethash_light_t const light
+)
+{
+	uint32_t num_parent_nodes = (uint32_t) (light->cache_size / sizeof(node));
+	node const* cache_nodes = (node const *) light->cache;
+	ethash_kernels_t const* kernels = ethash_get_kernels();
+	uint32_t n = 0;
+	for (; n + 4 <= count; n += 4) {
+		uint8_t* bytes[4];
+		uint8_t const* in[4];
+		for (unsigned k = 0; k != 4; ++k) {
+			uint32_t const node_index = first + n + k;
+			memcpy(&ret[n + k], &cache_nodes[node_index % num_parent_nodes], sizeof(node));
+			ret[n + k].words[0] ^= node_index;
+			bytes[k] = ret[n + k].bytes;
+			in[k] = ret[n + k].bytes;
 		}
-		#else
-		{
-			for (unsigned w = 0; w != NODE_WORDS; ++w) {
-				ret->words[w] = fnv_hash(ret->words[w], parent->words[w]);
-			}
+		sha3_512_x4(bytes, in, sizeof(node));
+		for (unsigned k = 0; k != 4; ++k) {
+			kernels->dag_parents(&ret[n + k], first + n + k, cache_nodes, num_parent_nodes);
 		}
-#endif
+		sha3_512_x4(bytes, in, sizeof(node));
+	}
+	for (; n != count; ++n) {
+		ethash_calculate_dag_item(&ret[n], first + n, light);
 	}
-	SHA3_512(ret->bytes, ret->bytes, sizeof(node));
 }
 
 bool ethash_compute_full_data(
@@ -155,39 +231,129 @@ bool ethash_compute_full_data(
 	}
 	uint32_t const max_n = (uint32_t)(full_size / sizeof(node));
 	node* full_nodes = mem;
-	double const progress_change = 1.0f / max_n;
-	double progress = 0.0f;
+	// report progress every percent
+	uint32_t const step = max_n >= 100 ? max_n / 100 : 1;
 	// now compute full nodes
-	for (uint32_t n = 0; n != max_n; ++n) {
+	for (uint32_t n = 0; n < max_n; n += step) {
 		if (callback &&
-			n % (max_n / 100) == 0 &&
-			callback((unsigned int)(ceil(progress * 100.0f))) != 0) {
+			callback((unsigned int)(ceil(n * 100.0 / max_n))) != 0) {
 
 			return false;
 		}
-		progress += progress_change;
-		ethash_calculate_dag_item(&(full_nodes[n]), n, light);
+		ethash_calculate_dag_items(&(full_nodes[n]), n, min_u32(step, max_n - n), light);
 	}
 	return true;
 }
 
-static bool ethash_hash(
-	ethash_return_value_t* ret,
-	node const* full_nodes,
-	ethash_light_t const light,
+// Number of DAG nodes a worker claims at a time in the parallel builder.
+// Small enough to keep all threads busy until the end, large enough to keep
+// contention on the shared progress lock negligible.
+#define ETHASH_DAG_CHUNK_NODES 4096
+
+struct ethash_dag_progress {
+	pthread_mutex_t lock;
+	node* full_nodes;
+	ethash_light_t light;
+	uint32_t max_n;
+	uint32_t next;          ///< first node not yet claimed by a worker
+	uint32_t done;          ///< number of nodes fully computed
+	unsigned reported;      ///< last percentage passed to the callback
+	ethash_callback_t callback;
+	bool aborted;
+};
+
+static void* ethash_compute_full_data_worker(void* arg)
+{
+	struct ethash_dag_progress* p = (struct ethash_dag_progress*)arg;
+	uint32_t begin = 0;
+	uint32_t count = 0;
+	for (;;) {
+		pthread_mutex_lock(&p->lock);
+		p->done += count;
+		if (p->callback && !p->aborted) {
+			unsigned const percent = (unsigned)((uint64_t)p->done * 100 / p->max_n);
+			if (percent > p->reported) {
+				p->reported = percent;
+				// the callback is always invoked under the lock, so it never
+				// has to deal with concurrent calls
+				if (p->callback(percent) != 0) {
+					p->aborted = true;
+				}
+			}
+		}
+		if (p->aborted || p->next == p->max_n) {
+			pthread_mutex_unlock(&p->lock);
+			return NULL;
+		}
+		begin = p->next;
+		count = min_u32(ETHASH_DAG_CHUNK_NODES, p->max_n - begin);
+		p->next += count;
+		pthread_mutex_unlock(&p->lock);
+
+		ethash_calculate_dag_items(&(p->full_nodes[begin]), begin, count, p->light);
+	}
+}
+
+bool ethash_compute_full_data_parallel(
+	void* mem,
 	uint64_t full_size,
-	ethash_h256_t const header_hash,
-	uint64_t const nonce
+	ethash_light_t const light,
+	ethash_callback_t callback,
+	unsigned num_threads
 )
 {
-	if (full_size % MIX_WORDS != 0) {
+	if (num_threads <= 1) {
+		return ethash_compute_full_data(mem, full_size, light, callback);
+	}
+	if (full_size % (sizeof(uint32_t) * MIX_WORDS) != 0 ||
+		(full_size % sizeof(node)) != 0) {
+		return false;
+	}
+
+	struct ethash_dag_progress progress;
+	memset(&progress, 0, sizeof(progress));
+	if (pthread_mutex_init(&progress.lock, NULL) != 0) {
+		return false;
+	}
+	progress.full_nodes = (node*)mem;
+	progress.light = light;
+	progress.max_n = (uint32_t)(full_size / sizeof(node));
+	progress.callback = callback;
+	if (callback && callback(0) != 0) {
+		pthread_mutex_destroy(&progress.lock);
 		return false;
 	}
 
+	pthread_t* threads = calloc(num_threads, sizeof(pthread_t));
+	if (!threads) {
+		pthread_mutex_destroy(&progress.lock);
+		return false;
+	}
+	unsigned started = 0;
+	for (; started != num_threads; ++started) {
+		if (pthread_create(&threads[started], NULL, ethash_compute_full_data_worker, &progress) != 0) {
+			break;
+		}
+	}
+	// if no helper could be spawned the calling thread does all the work
+	if (started == 0) {
+		ethash_compute_full_data_worker(&progress);
+	}
+	for (unsigned i = 0; i != started; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	pthread_mutex_destroy(&progress.lock);
+
+	return !progress.aborted && progress.done == progress.max_n;
+}
+
+// seed s_mix[0] with the hash of header and nonce and replicate it across the mix in s_mix[1..]
+static void ethash_hash_init(node* s_mix, ethash_h256_t const* header_hash, uint64_t const nonce)
+{
 	// pack hash and nonce together into first 40 bytes of s_mix
 	assert(sizeof(node) * 8 == 512);
-	node s_mix[MIX_NODES + 1];
-	memcpy(s_mix[0].bytes, &header_hash, 32);
+	memcpy(s_mix[0].bytes, header_hash, 32);
 	fix_endian64(s_mix[0].double_words[4], nonce);
 
 	// compute sha3-512 hash and replicate across mix
@@ -198,47 +364,12 @@ static bool ethash_hash(
 	for (uint32_t w = 0; w != MIX_WORDS; ++w) {
 		mix->words[w] = s_mix[0].words[w % NODE_WORDS];
 	}
+}
 
-	unsigned const page_size = sizeof(uint32_t) * MIX_WORDS;
-	unsigned const num_full_pages = (unsigned) (full_size / page_size);
-
-	for (unsigned i = 0; i != ETHASH_ACCESSES; ++i) {
-		uint32_t const index = fnv_hash(s_mix->words[0] ^ i, mix->words[i % MIX_WORDS]) % num_full_pages;
-
-		for (unsigned n = 0; n != MIX_NODES; ++n) {
-			node const* dag_node;
-			if (full_nodes) {
-				dag_node = &full_nodes[MIX_NODES * index + n];
-			} else {
-				node tmp_node;
-				ethash_calculate_dag_item(&tmp_node, index * MIX_NODES + n, light);
-				dag_node = &tmp_node;
-			}
-
-#if defined(_M_X64) && ENABLE_SSE
-			{
-				__m128i fnv_prime = _mm_set1_epi32(FNV_PRIME);
-				__m128i xmm0 = _mm_mullo_epi32(fnv_prime, mix[n].xmm[0]);
-				__m128i xmm1 = _mm_mullo_epi32(fnv_prime, mix[n].xmm[1]);
-				__m128i xmm2 = _mm_mullo_epi32(fnv_prime, mix[n].xmm[2]);
-				__m128i xmm3 = _mm_mullo_epi32(fnv_prime, mix[n].xmm[3]);
-				mix[n].xmm[0] = _mm_xor_si128(xmm0, dag_node->xmm[0]);
-				mix[n].xmm[1] = _mm_xor_si128(xmm1, dag_node->xmm[1]);
-				mix[n].xmm[2] = _mm_xor_si128(xmm2, dag_node->xmm[2]);
-				mix[n].xmm[3] = _mm_xor_si128(xmm3, dag_node->xmm[3]);
-			}
-			#else
-			{
-				for (unsigned w = 0; w != NODE_WORDS; ++w) {
-					mix[n].words[w] = fnv_hash(mix[n].words[w], dag_node->words[w]);
-				}
-			}
-#endif
-		}
-
-	}
-
-	// compress mix
+// compress the mix of s_mix[1..] and compute the final hash
+static void ethash_hash_final(ethash_return_value_t* ret, node* s_mix)
+{
+	node* const mix = s_mix + 1;
 	for (uint32_t w = 0; w != MIX_WORDS; w += 4) {
 		uint32_t reduction = mix->words[w + 0];
 		reduction = reduction * FNV_PRIME ^ mix->words[w + 1];
@@ -251,6 +382,44 @@ static bool ethash_hash(
 	memcpy(&ret->mix_hash, mix->bytes, 32);
 	// final Keccak hash
 	SHA3_256(&ret->result, s_mix->bytes, 64 + 32); // Keccak-256(s + compressed_mix)
+}
+
+static bool ethash_hash(
+	ethash_return_value_t* ret,
+	node const* full_nodes,
+	ethash_light_t const light,
+	uint64_t full_size,
+	ethash_h256_t const header_hash,
+	uint64_t const nonce
+)
+{
+	if (full_size % MIX_WORDS != 0) {
+		return false;
+	}
+
+	node s_mix[MIX_NODES + 1];
+	ethash_hash_init(s_mix, &header_hash, nonce);
+	node* const mix = s_mix + 1;
+
+	unsigned const page_size = sizeof(uint32_t) * MIX_WORDS;
+	unsigned const num_full_pages = (unsigned) (full_size / page_size);
+	ethash_kernels_t const* kernels = ethash_get_kernels();
+
+	for (unsigned i = 0; i != ETHASH_ACCESSES; ++i) {
+		uint32_t const index = fnv_hash(s_mix->words[0] ^ i, mix->words[i % MIX_WORDS]) % num_full_pages;
+
+		if (full_nodes) {
+			kernels->fnv_mix(mix, &full_nodes[MIX_NODES * index], MIX_NODES);
+		} else {
+			node dag_nodes[MIX_NODES];
+			for (unsigned n = 0; n != MIX_NODES; ++n) {
+				ethash_calculate_dag_item(&dag_nodes[n], index * MIX_NODES + n, light);
+			}
+			kernels->fnv_mix(mix, dag_nodes, MIX_NODES);
+		}
+	}
+
+	ethash_hash_final(ret, s_mix);
 	return true;
 }
 
@@ -274,7 +443,7 @@ ethash_h256_t ethash_get_seedhash(uint64_t block_number)
 {
 	ethash_h256_t ret;
 	ethash_h256_reset(&ret);
-	uint64_t const epochs = block_number / ETHASH_EPOCH_LENGTH;
+	uint64_t const epochs = block_number / ethash_params.epoch_length;
 	for (uint32_t i = 0; i < epochs; ++i)
 		SHA3_256(&ret, (uint8_t*)&ret, 32);
 	return ret;
@@ -323,7 +492,9 @@ ethash_light_t ethash_light_new(uint64_t block_number)
 	ethash_h256_t seedhash = ethash_get_seedhash(block_number);
 	ethash_light_t ret;
 	ret = ethash_light_new_internal(ethash_get_cachesize(block_number), &seedhash);
-	ret->block_number = block_number;
+	if (ret) {
+		ret->block_number = block_number;
+	}
 	return ret;
 }
 
@@ -381,6 +552,30 @@ static bool ethash_mmap(struct ethash_full* ret, FILE* f)
 		return false;
 	}
 	ret->data = (node*)(mmapped_data + ETHASH_DAG_MAGIC_NUM_SIZE);
+	ret->map = mmapped_data;
+	ret->map_size = (size_t)ret->file_size + ETHASH_DAG_MAGIC_NUM_SIZE;
+	return true;
+}
+
+// DAG items recomputed to check a DAG file found on disk
+#define ETHASH_DAG_CHECK_SAMPLES 16
+
+/**
+ * The magic number is written once the DAG is computed, but the mmapped data
+ * itself may not have made it to disk before a crash. Spot check a few items
+ * spread over the whole DAG against the light cache.
+ */
+static bool ethash_full_check_sample(struct ethash_full const* full, ethash_light_t const light)
+{
+	uint64_t const num_nodes = full->file_size / sizeof(node);
+	for (unsigned i = 0; i < ETHASH_DAG_CHECK_SAMPLES; ++i) {
+		uint32_t const index = (uint32_t)((num_nodes - 1) * i / (ETHASH_DAG_CHECK_SAMPLES - 1));
+		node item;
+		ethash_calculate_dag_item(&item, index, light);
+		if (memcmp(&item, &full->data[index], sizeof(node)) != 0) {
+			return false;
+		}
+	}
 	return true;
 }
 
@@ -389,7 +584,8 @@ ethash_full_t ethash_full_new_internal(
 	ethash_h256_t const seed_hash,
 	uint64_t full_size,
 	ethash_light_t const light,
-	ethash_callback_t callback
+	ethash_callback_t callback,
+	unsigned num_threads
 )
 {
 	struct ethash_full* ret;
@@ -408,7 +604,13 @@ ethash_full_t ethash_full_new_internal(
 			ETHASH_CRITICAL("mmap failure()");
 			goto fail_close_file;
 		}
-		return ret;
+		if (ethash_full_check_sample(ret, light)) {
+			return ret;
+		}
+		munmap(ret->map, ret->map_size);
+		fclose(ret->file);
+		ret->file = NULL;
+		// fallthrough, the file is corrupt and gets recreated like one of the wrong size
 	case ETHASH_IO_MEMO_SIZE_MISMATCH:
 		// if a DAG of same filename but unexpected size is found, silently force new file creation
 		if (ethash_io_prepare(dirname, seed_hash, &f, (size_t)full_size, true) != ETHASH_IO_MEMO_MISMATCH) {
@@ -424,7 +626,7 @@ ethash_full_t ethash_full_new_internal(
 		break;
 	}
 
-	if (!ethash_compute_full_data(ret->data, full_size, light, callback)) {
+	if (!ethash_compute_full_data_parallel(ret->data, full_size, light, callback, num_threads)) {
 		ETHASH_CRITICAL("Failure at computing DAG data.");
 		goto fail_free_full_data;
 	}
@@ -447,7 +649,7 @@ ethash_full_t ethash_full_new_internal(
 
 fail_free_full_data:
 	// could check that munmap(..) == 0 but even if it did not can't really do anything here
-	munmap(ret->data, (size_t)full_size);
+	munmap(ret->map, ret->map_size);
 fail_close_file:
 	fclose(ret->file);
 fail_free_full:
@@ -456,21 +658,135 @@ fail_free_full:
 }
 
 ethash_full_t ethash_full_new(ethash_light_t light, ethash_callback_t callback)
+{
+	return ethash_full_new_parallel(light, callback, 1);
+}
+
+ethash_full_t ethash_full_new_parallel(
+	ethash_light_t light,
+	ethash_callback_t callback,
+	unsigned num_threads
+)
+{
+	return ethash_full_new_dir(NULL, light, callback, num_threads);
+}
+
+ethash_full_t ethash_full_new_dir(
+	char const* dirname,
+	ethash_light_t light,
+	ethash_callback_t callback,
+	unsigned num_threads
+)
 {
 	char strbuf[256];
-	if (!ethash_get_default_dirname(strbuf, 256)) {
-		return NULL;
+	if (!dirname) {
+		if (!ethash_get_default_dirname(strbuf, 256)) {
+			return NULL;
+		}
+		dirname = strbuf;
 	}
 
 	uint64_t full_size = ethash_get_datasize(light->block_number);
 	ethash_h256_t seedhash = ethash_get_seedhash(light->block_number);
-	return ethash_full_new_internal(strbuf, seedhash, full_size, light, callback);
+	return ethash_full_new_internal(dirname, seedhash, full_size, light, callback, num_threads);
+}
+
+bool ethash_remove_dag_file(char const* dirname, uint64_t block_number)
+{
+	char strbuf[256];
+	if (!dirname) {
+		if (!ethash_get_default_dirname(strbuf, 256)) {
+			return false;
+		}
+		dirname = strbuf;
+	}
+
+	char mutable_name[DAG_MUTABLE_NAME_MAX_SIZE];
+	ethash_h256_t const seedhash = ethash_get_seedhash(block_number);
+	if (!ethash_io_mutable_name(ETHASH_REVISION, &seedhash, mutable_name)) {
+		return false;
+	}
+	char* filename = ethash_io_create_filename(dirname, mutable_name, strlen(mutable_name));
+	if (!filename) {
+		return false;
+	}
+	bool const removed = remove(filename) == 0;
+	free(filename);
+	return removed;
+}
+
+static void* ethash_map_anonymous(size_t size, size_t page_size, int flags, size_t* map_size)
+{
+	*map_size = (size + page_size - 1) / page_size * page_size;
+	void* p = mmap(NULL, *map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+	return p == MAP_FAILED ? NULL : p;
+}
+
+ethash_full_t ethash_full_clone(ethash_full_t full, enum ethash_page_size page_size)
+{
+	struct ethash_full* ret = calloc(sizeof(*ret), 1);
+	if (!ret) {
+		return NULL;
+	}
+	size_t const size = (size_t)full->file_size;
+	void* map = NULL;
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+	// explicit huge pages only exist if the admin reserved them, see vm.nr_hugepages
+	if (page_size == ETHASH_PAGES_1GB) {
+		map = ethash_map_anonymous(size, (size_t)1 << 30, MAP_HUGETLB | (30 << MAP_HUGE_SHIFT), &ret->map_size);
+	}
+	if (!map && page_size != ETHASH_PAGES_DEFAULT) {
+		map = ethash_map_anonymous(size, (size_t)1 << 21, MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), &ret->map_size);
+	}
+#endif
+	if (!map) {
+		map = ethash_map_anonymous(size, 4096, 0, &ret->map_size);
+		if (!map) {
+			free(ret);
+			return NULL;
+		}
+#if defined(MADV_HUGEPAGE)
+		if (page_size != ETHASH_PAGES_DEFAULT) {
+			// fall back to transparent huge pages, failing is harmless
+			madvise(map, ret->map_size, MADV_HUGEPAGE);
+		}
+#endif
+	}
+	memcpy(map, full->data, size);
+	ret->file = NULL;
+	ret->file_size = full->file_size;
+	ret->data = (node*)map;
+	ret->map = map;
+	return ret;
+}
+
+void ethash_full_prefault(ethash_full_t full)
+{
+#if defined(MADV_WILLNEED)
+	madvise(full->map, full->map_size, MADV_WILLNEED);
+#endif
+	volatile uint8_t const* p = (uint8_t const*)full->map;
+	uint8_t sum = 0;
+	for (size_t i = 0; i < full->map_size; i += 4096) {
+		sum += p[i];
+	}
+	(void)sum;
+}
+
+bool ethash_full_lock(ethash_full_t full)
+{
+#if defined(_WIN32)
+	(void)full;
+	return false;
+#else
+	return mlock(full->map, full->map_size) == 0;
+#endif
 }
 
 void ethash_full_delete(ethash_full_t full)
 {
 	// could check that munmap(..) == 0 but even if it did not can't really do anything here
-	munmap(full->data, (size_t)full->file_size);
+	munmap(full->map, full->map_size);
 	if (full->file) {
 		fclose(full->file);
 	}
@@ -497,6 +813,107 @@ ethash_return_value_t ethash_full_compute(
 	return ret;
 }
 
+bool ethash_compute_pages(
+	ethash_return_value_t* ret,
+	uint64_t full_size,
+	ethash_h256_t const header_hash,
+	uint64_t nonce,
+	ethash_page_callback_t callback,
+	void* ctx
+)
+{
+	ret->success = false;
+	if (full_size % MIX_WORDS != 0) {
+		return false;
+	}
+
+	node s_mix[MIX_NODES + 1];
+	ethash_hash_init(s_mix, &header_hash, nonce);
+	node* const mix = s_mix + 1;
+
+	unsigned const page_size = sizeof(uint32_t) * MIX_WORDS;
+	unsigned const num_full_pages = (unsigned) (full_size / page_size);
+	ethash_kernels_t const* kernels = ethash_get_kernels();
+
+	for (unsigned i = 0; i != ETHASH_ACCESSES; ++i) {
+		uint32_t const index = fnv_hash(s_mix->words[0] ^ i, mix->words[i % MIX_WORDS]) % num_full_pages;
+		node page[MIX_NODES];
+		if (!callback(ctx, i, index, page[0].bytes)) {
+			return false;
+		}
+		kernels->fnv_mix(mix, page, MIX_NODES);
+	}
+
+	ethash_hash_final(ret, s_mix);
+	ret->success = true;
+	return true;
+}
+
+// nonces hashed side by side by ethash_full_search()
+#define ETHASH_SEARCH_LANES 4
+
+#if defined(__GNUC__)
+#define ethash_prefetch(p) __builtin_prefetch((p), 0, 0)
+#else
+#define ethash_prefetch(p) ((void)(p))
+#endif
+
+bool ethash_full_search(
+	ethash_full_t full,
+	ethash_h256_t const header_hash,
+	ethash_h256_t const boundary,
+	uint64_t start_nonce,
+	uint64_t count,
+	uint64_t* nonce_out,
+	ethash_return_value_t* ret_out
+)
+{
+	uint64_t const full_size = full->file_size;
+	node const* const full_nodes = (node const*)full->data;
+	if (full_size % MIX_WORDS != 0) {
+		return false;
+	}
+	unsigned const page_size = sizeof(uint32_t) * MIX_WORDS;
+	unsigned const num_full_pages = (unsigned) (full_size / page_size);
+	ethash_kernels_t const* kernels = ethash_get_kernels();
+
+	node s_mix[ETHASH_SEARCH_LANES][MIX_NODES + 1];
+	node const* pages[ETHASH_SEARCH_LANES];
+	for (uint64_t done = 0; done < count; done += ETHASH_SEARCH_LANES) {
+		unsigned const lanes = count - done < ETHASH_SEARCH_LANES ? (unsigned)(count - done) : ETHASH_SEARCH_LANES;
+		for (unsigned l = 0; l != lanes; ++l) {
+			ethash_hash_init(s_mix[l], &header_hash, start_nonce + done + l);
+		}
+
+		// Each access depends on the previous one of the same nonce, but not
+		// on the other lanes. Requesting all lanes' pages before mixing any of
+		// them keeps several DAG reads in flight at once.
+		for (unsigned i = 0; i != ETHASH_ACCESSES; ++i) {
+			for (unsigned l = 0; l != lanes; ++l) {
+				uint32_t const index = fnv_hash(s_mix[l][0].words[0] ^ i, s_mix[l][1].words[i % MIX_WORDS]) % num_full_pages;
+				pages[l] = &full_nodes[MIX_NODES * index];
+				ethash_prefetch(pages[l]);
+				ethash_prefetch(pages[l] + 1);
+			}
+			for (unsigned l = 0; l != lanes; ++l) {
+				kernels->fnv_mix(s_mix[l] + 1, pages[l], MIX_NODES);
+			}
+		}
+
+		for (unsigned l = 0; l != lanes; ++l) {
+			ethash_return_value_t ret;
+			ethash_hash_final(&ret, s_mix[l]);
+			if (ethash_check_difficulty(&ret.result, &boundary)) {
+				ret.success = true;
+				*nonce_out = start_nonce + done + l;
+				*ret_out = ret;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
 void const* ethash_full_dag(ethash_full_t full)
 {
 	return full->data;
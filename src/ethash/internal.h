@@ -4,12 +4,6 @@
 #include "ethash.h"
 #include <stdio.h>
 
-#define ENABLE_SSE 0
-
-#if defined(_M_X64) && ENABLE_SSE
-#include <smmintrin.h>
-#endif
-
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -24,11 +18,6 @@ typedef union node {
 	uint8_t bytes[NODE_WORDS * 4];
 	uint32_t words[NODE_WORDS];
 	uint64_t double_words[NODE_WORDS / 2];
-
-#if defined(_M_X64) && ENABLE_SSE
-	__m128i xmm[NODE_WORDS/4];
-#endif
-
 } node;
 
 static inline uint8_t ethash_h256_get(ethash_h256_t const* hash, unsigned int i)
@@ -115,6 +104,9 @@ struct ethash_full {
 	FILE* file;
 	uint64_t file_size;
 	node* data;
+	// the whole mapping, data points past the magic number for file backed DAGs
+	void* map;
+	size_t map_size;
 };
 
 /**
@@ -131,6 +123,8 @@ struct ethash_full {
  *                       It accepts an unsigned with which a progress of DAG calculation
  *                       can be displayed. If all goes well the callback should return 0.
  *                       If a non-zero value is returned then DAG generation will stop.
+ * @param num_threads    Number of threads used to compute the DAG, see
+ *                       @ref ethash_compute_full_data_parallel()
  * @return               Newly allocated ethash_full handler or NULL in case of
  *                       ERRNOMEM or invalid parameters used for @ref ethash_compute_full_data()
  */
@@ -139,7 +133,8 @@ ethash_full_t ethash_full_new_internal(
 	ethash_h256_t const seed_hash,
 	uint64_t full_size,
 	ethash_light_t const light,
-	ethash_callback_t callback
+	ethash_callback_t callback,
+	unsigned num_threads
 );
 
 void ethash_calculate_dag_item(
@@ -174,6 +169,30 @@ bool ethash_compute_full_data(
 	ethash_callback_t callback
 );
 
+/**
+ * Compute the memory data for a full node's memory using several threads
+ *
+ * The node range is handed out to the workers in small chunks, so threads that
+ * run faster simply pick up more of the work. The callback is shared by all
+ * workers but is never invoked concurrently.
+ *
+ * @param mem          A pointer to an ethash full's memory
+ * @param full_size    The size of the full data in bytes
+ * @param cache        A cache object to use in the calculation
+ * @param callback     The callback function. Check @ref ethash_full_new() for details.
+ * @param num_threads  Number of worker threads. 0 or 1 computes the data on the
+ *                     calling thread, like @ref ethash_compute_full_data()
+ * @return             true if all went fine and false for invalid parameters or
+ *                     if the callback requested to stop
+ */
+bool ethash_compute_full_data_parallel(
+	void* mem,
+	uint64_t full_size,
+	ethash_light_t const light,
+	ethash_callback_t callback,
+	unsigned num_threads
+);
+
 #ifdef __cplusplus
 }
 #endif
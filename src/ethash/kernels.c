@@ -0,0 +1,257 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file kernels.c
+ * Scalar, SSE4.1, AVX2 and NEON versions of the FNV mixing loops.
+ *
+ * The x86 variants are compiled with per-function target attributes, so the
+ * library itself can still be built for (and run on) a baseline x86-64 CPU.
+ */
+
+#include <string.h>
+#include "ethash.h"
+#include "fnv.h"
+#include "kernels.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define ETHASH_KERNELS_X86 1
+#include <immintrin.h>
+#define ETHASH_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define ETHASH_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+static void dag_parents_scalar(
+	node* ret,
+	uint32_t node_index,
+	node const* cache_nodes,
+	uint32_t num_parent_nodes
+)
+{
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
+		uint32_t parent_index = fnv_hash(node_index ^ i, ret->words[i % NODE_WORDS]) % num_parent_nodes;
+		node const* parent = &cache_nodes[parent_index];
+		for (unsigned w = 0; w != NODE_WORDS; ++w) {
+			ret->words[w] = fnv_hash(ret->words[w], parent->words[w]);
+		}
+	}
+}
+
+static void fnv_mix_scalar(node* mix, node const* data, unsigned num_nodes)
+{
+	for (unsigned n = 0; n != num_nodes; ++n) {
+		for (unsigned w = 0; w != NODE_WORDS; ++w) {
+			mix[n].words[w] = fnv_hash(mix[n].words[w], data[n].words[w]);
+		}
+	}
+}
+
+static ethash_kernels_t const kernels_scalar = {
+	"scalar", dag_parents_scalar, fnv_mix_scalar
+};
+
+#ifdef ETHASH_KERNELS_X86
+
+ETHASH_TARGET("sse4.1")
+static void dag_parents_sse41(
+	node* ret,
+	uint32_t node_index,
+	node const* cache_nodes,
+	uint32_t num_parent_nodes
+)
+{
+	__m128i const fnv_prime = _mm_set1_epi32(FNV_PRIME);
+	__m128i xmm0 = _mm_loadu_si128((__m128i const*)&ret->words[0]);
+	__m128i xmm1 = _mm_loadu_si128((__m128i const*)&ret->words[4]);
+	__m128i xmm2 = _mm_loadu_si128((__m128i const*)&ret->words[8]);
+	__m128i xmm3 = _mm_loadu_si128((__m128i const*)&ret->words[12]);
+
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
+		uint32_t parent_index = fnv_hash(node_index ^ i, ret->words[i % NODE_WORDS]) % num_parent_nodes;
+		uint32_t const* parent = cache_nodes[parent_index].words;
+
+		xmm0 = _mm_xor_si128(_mm_mullo_epi32(xmm0, fnv_prime), _mm_loadu_si128((__m128i const*)&parent[0]));
+		xmm1 = _mm_xor_si128(_mm_mullo_epi32(xmm1, fnv_prime), _mm_loadu_si128((__m128i const*)&parent[4]));
+		xmm2 = _mm_xor_si128(_mm_mullo_epi32(xmm2, fnv_prime), _mm_loadu_si128((__m128i const*)&parent[8]));
+		xmm3 = _mm_xor_si128(_mm_mullo_epi32(xmm3, fnv_prime), _mm_loadu_si128((__m128i const*)&parent[12]));
+
+		// have to write to ret as values are used to compute index
+		_mm_storeu_si128((__m128i*)&ret->words[0], xmm0);
+		_mm_storeu_si128((__m128i*)&ret->words[4], xmm1);
+		_mm_storeu_si128((__m128i*)&ret->words[8], xmm2);
+		_mm_storeu_si128((__m128i*)&ret->words[12], xmm3);
+	}
+}
+
+ETHASH_TARGET("sse4.1")
+static void fnv_mix_sse41(node* mix, node const* data, unsigned num_nodes)
+{
+	__m128i const fnv_prime = _mm_set1_epi32(FNV_PRIME);
+	for (unsigned n = 0; n != num_nodes; ++n) {
+		for (unsigned w = 0; w != NODE_WORDS; w += 4) {
+			__m128i m = _mm_loadu_si128((__m128i const*)&mix[n].words[w]);
+			__m128i d = _mm_loadu_si128((__m128i const*)&data[n].words[w]);
+			_mm_storeu_si128((__m128i*)&mix[n].words[w], _mm_xor_si128(_mm_mullo_epi32(m, fnv_prime), d));
+		}
+	}
+}
+
+static ethash_kernels_t const kernels_sse41 = {
+	"sse4.1", dag_parents_sse41, fnv_mix_sse41
+};
+
+ETHASH_TARGET("avx2")
+static void dag_parents_avx2(
+	node* ret,
+	uint32_t node_index,
+	node const* cache_nodes,
+	uint32_t num_parent_nodes
+)
+{
+	__m256i const fnv_prime = _mm256_set1_epi32(FNV_PRIME);
+	__m256i ymm0 = _mm256_loadu_si256((__m256i const*)&ret->words[0]);
+	__m256i ymm1 = _mm256_loadu_si256((__m256i const*)&ret->words[8]);
+
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
+		uint32_t parent_index = fnv_hash(node_index ^ i, ret->words[i % NODE_WORDS]) % num_parent_nodes;
+		uint32_t const* parent = cache_nodes[parent_index].words;
+
+		ymm0 = _mm256_xor_si256(_mm256_mullo_epi32(ymm0, fnv_prime), _mm256_loadu_si256((__m256i const*)&parent[0]));
+		ymm1 = _mm256_xor_si256(_mm256_mullo_epi32(ymm1, fnv_prime), _mm256_loadu_si256((__m256i const*)&parent[8]));
+
+		_mm256_storeu_si256((__m256i*)&ret->words[0], ymm0);
+		_mm256_storeu_si256((__m256i*)&ret->words[8], ymm1);
+	}
+}
+
+ETHASH_TARGET("avx2")
+static void fnv_mix_avx2(node* mix, node const* data, unsigned num_nodes)
+{
+	__m256i const fnv_prime = _mm256_set1_epi32(FNV_PRIME);
+	for (unsigned n = 0; n != num_nodes; ++n) {
+		for (unsigned w = 0; w != NODE_WORDS; w += 8) {
+			__m256i m = _mm256_loadu_si256((__m256i const*)&mix[n].words[w]);
+			__m256i d = _mm256_loadu_si256((__m256i const*)&data[n].words[w]);
+			_mm256_storeu_si256((__m256i*)&mix[n].words[w], _mm256_xor_si256(_mm256_mullo_epi32(m, fnv_prime), d));
+		}
+	}
+}
+
+static ethash_kernels_t const kernels_avx2 = {
+	"avx2", dag_parents_avx2, fnv_mix_avx2
+};
+
+#endif // ETHASH_KERNELS_X86
+
+#ifdef ETHASH_KERNELS_NEON
+
+static void dag_parents_neon(
+	node* ret,
+	uint32_t node_index,
+	node const* cache_nodes,
+	uint32_t num_parent_nodes
+)
+{
+	uint32x4_t const fnv_prime = vdupq_n_u32(FNV_PRIME);
+	uint32x4_t q0 = vld1q_u32(&ret->words[0]);
+	uint32x4_t q1 = vld1q_u32(&ret->words[4]);
+	uint32x4_t q2 = vld1q_u32(&ret->words[8]);
+	uint32x4_t q3 = vld1q_u32(&ret->words[12]);
+
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
+		uint32_t parent_index = fnv_hash(node_index ^ i, ret->words[i % NODE_WORDS]) % num_parent_nodes;
+		uint32_t const* parent = cache_nodes[parent_index].words;
+
+		q0 = veorq_u32(vmulq_u32(q0, fnv_prime), vld1q_u32(&parent[0]));
+		q1 = veorq_u32(vmulq_u32(q1, fnv_prime), vld1q_u32(&parent[4]));
+		q2 = veorq_u32(vmulq_u32(q2, fnv_prime), vld1q_u32(&parent[8]));
+		q3 = veorq_u32(vmulq_u32(q3, fnv_prime), vld1q_u32(&parent[12]));
+
+		vst1q_u32(&ret->words[0], q0);
+		vst1q_u32(&ret->words[4], q1);
+		vst1q_u32(&ret->words[8], q2);
+		vst1q_u32(&ret->words[12], q3);
+	}
+}
+
+static void fnv_mix_neon(node* mix, node const* data, unsigned num_nodes)
+{
+	uint32x4_t const fnv_prime = vdupq_n_u32(FNV_PRIME);
+	for (unsigned n = 0; n != num_nodes; ++n) {
+		for (unsigned w = 0; w != NODE_WORDS; w += 4) {
+			uint32x4_t m = vld1q_u32(&mix[n].words[w]);
+			uint32x4_t d = vld1q_u32(&data[n].words[w]);
+			vst1q_u32(&mix[n].words[w], veorq_u32(vmulq_u32(m, fnv_prime), d));
+		}
+	}
+}
+
+static ethash_kernels_t const kernels_neon = {
+	"neon", dag_parents_neon, fnv_mix_neon
+};
+
+#endif // ETHASH_KERNELS_NEON
+
+/// Every variant usable on this CPU, fastest first, scalar last
+static ethash_kernels_t const* ethash_supported_kernels(unsigned i)
+{
+	ethash_kernels_t const* supported[4];
+	unsigned count = 0;
+#ifdef ETHASH_KERNELS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		supported[count++] = &kernels_avx2;
+	}
+	if (__builtin_cpu_supports("sse4.1")) {
+		supported[count++] = &kernels_sse41;
+	}
+#endif
+#ifdef ETHASH_KERNELS_NEON
+	supported[count++] = &kernels_neon;
+#endif
+	supported[count++] = &kernels_scalar;
+	return i < count ? supported[i] : NULL;
+}
+
+static ethash_kernels_t const* s_kernels = NULL;
+
+ethash_kernels_t const* ethash_get_kernels(void)
+{
+	if (!s_kernels) {
+		s_kernels = ethash_supported_kernels(0);
+	}
+	return s_kernels;
+}
+
+char const* ethash_select_kernels(void)
+{
+	return ethash_get_kernels()->name;
+}
+
+bool ethash_set_kernels(char const* name)
+{
+	ethash_kernels_t const* k;
+	for (unsigned i = 0; (k = ethash_supported_kernels(i)) != NULL; ++i) {
+		if (strcmp(k->name, name) == 0) {
+			s_kernels = k;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,56 @@
+/*
+  This file is part of ethash.
+
+  ethash is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  ethash is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ethash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file kernels.h
+ * FNV mixing kernels used by the DAG item calculation and the hashimoto loop,
+ * with SIMD variants selected at runtime.
+ */
+#pragma once
+#include <stdint.h>
+#include "internal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ethash_kernels {
+	/// Human readable name of the instruction set, e.g. "avx2"
+	char const* name;
+	/**
+	 * Mix the ETHASH_DATASET_PARENTS parents of a DAG item into @a ret.
+	 * @a ret must already hold the hash of the seeding cache node.
+	 */
+	void (*dag_parents)(
+		node* ret,
+		uint32_t node_index,
+		node const* cache_nodes,
+		uint32_t num_parent_nodes
+	);
+	/// mix[i] = fnv(mix[i], data[i]) for @a num_nodes consecutive nodes
+	void (*fnv_mix)(node* mix, node const* data, unsigned num_nodes);
+} ethash_kernels_t;
+
+/**
+ * Get the kernels to use. The first call detects the CPU features and picks
+ * the fastest supported variant, unless ethash_set_kernels() forced one.
+ * ethash_select_kernels() should be called once at startup so that the
+ * selection never races with hashing threads.
+ */
+ethash_kernels_t const* ethash_get_kernels(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -43,9 +43,8 @@ static const uint64_t RC[24] = \
 	v = 0;										\
 	REPEAT5(e; v += s;)
 
-/*** Keccak-f[1600] ***/
-static inline void keccakf(void* state) {
-	uint64_t* a = (uint64_t*)state;
+/*** Keccak-f[1600], as in libkeccak-tiny ***/
+static void keccakf_generic(uint64_t* a) {
 	uint64_t b[5] = {0};
 	uint64_t t = 0;
 	uint8_t x, y;
@@ -78,6 +77,338 @@ static inline void keccakf(void* state) {
 	}
 }
 
+/*** Unrolled Keccak-f[1600] ***/
+
+// Lanes are named by row (b, g, k, m, s) and column (a, e, i, o, u), in the
+// order they are stored in the state.
+#define KECCAK_LANES(X) \
+	X(ba, 0)  X(be, 1)  X(bi, 2)  X(bo, 3)  X(bu, 4)  \
+	X(ga, 5)  X(ge, 6)  X(gi, 7)  X(go, 8)  X(gu, 9)  \
+	X(ka, 10) X(ke, 11) X(ki, 12) X(ko, 13) X(ku, 14) \
+	X(ma, 15) X(me, 16) X(mi, 17) X(mo, 18) X(mu, 19) \
+	X(sa, 20) X(se, 21) X(si, 22) X(so, 23) X(su, 24)
+
+#define KECCAK_DECLARE_LANE(n, i) A##n, E##n, B##n,
+#define KECCAK_DECLARE(T) \
+	T KECCAK_LANES(KECCAK_DECLARE_LANE) Ca, Ce, Ci, Co, Cu, Da, De, Di, Do, Du
+
+/**
+ * One round from A to E. V is the prefix of the lane operations: XOR, XOR5,
+ * RAX1(c, d) = c ^ rol(d, 1), XROL(x, d, r) = rol(x ^ d, r) and
+ * CHI(x, y, z) = x ^ (~y & z).
+ */
+#define KECCAK_ROUND(V, A, E, rc) \
+	Ca = V##_XOR5(A##ba, A##ga, A##ka, A##ma, A##sa); \
+	Ce = V##_XOR5(A##be, A##ge, A##ke, A##me, A##se); \
+	Ci = V##_XOR5(A##bi, A##gi, A##ki, A##mi, A##si); \
+	Co = V##_XOR5(A##bo, A##go, A##ko, A##mo, A##so); \
+	Cu = V##_XOR5(A##bu, A##gu, A##ku, A##mu, A##su); \
+	Da = V##_RAX1(Cu, Ce); \
+	De = V##_RAX1(Ca, Ci); \
+	Di = V##_RAX1(Ce, Co); \
+	Do = V##_RAX1(Ci, Cu); \
+	Du = V##_RAX1(Co, Ca); \
+	Bba = V##_XOR(A##ba, Da); \
+	Bbe = V##_XROL(A##ge, De, 44); \
+	Bbi = V##_XROL(A##ki, Di, 43); \
+	Bbo = V##_XROL(A##mo, Do, 21); \
+	Bbu = V##_XROL(A##su, Du, 14); \
+	E##ba = V##_XOR(V##_CHI(Bba, Bbe, Bbi), rc); \
+	E##be = V##_CHI(Bbe, Bbi, Bbo); \
+	E##bi = V##_CHI(Bbi, Bbo, Bbu); \
+	E##bo = V##_CHI(Bbo, Bbu, Bba); \
+	E##bu = V##_CHI(Bbu, Bba, Bbe); \
+	Bga = V##_XROL(A##bo, Do, 28); \
+	Bge = V##_XROL(A##gu, Du, 20); \
+	Bgi = V##_XROL(A##ka, Da, 3); \
+	Bgo = V##_XROL(A##me, De, 45); \
+	Bgu = V##_XROL(A##si, Di, 61); \
+	E##ga = V##_CHI(Bga, Bge, Bgi); \
+	E##ge = V##_CHI(Bge, Bgi, Bgo); \
+	E##gi = V##_CHI(Bgi, Bgo, Bgu); \
+	E##go = V##_CHI(Bgo, Bgu, Bga); \
+	E##gu = V##_CHI(Bgu, Bga, Bge); \
+	Bka = V##_XROL(A##be, De, 1); \
+	Bke = V##_XROL(A##gi, Di, 6); \
+	Bki = V##_XROL(A##ko, Do, 25); \
+	Bko = V##_XROL(A##mu, Du, 8); \
+	Bku = V##_XROL(A##sa, Da, 18); \
+	E##ka = V##_CHI(Bka, Bke, Bki); \
+	E##ke = V##_CHI(Bke, Bki, Bko); \
+	E##ki = V##_CHI(Bki, Bko, Bku); \
+	E##ko = V##_CHI(Bko, Bku, Bka); \
+	E##ku = V##_CHI(Bku, Bka, Bke); \
+	Bma = V##_XROL(A##bu, Du, 27); \
+	Bme = V##_XROL(A##ga, Da, 36); \
+	Bmi = V##_XROL(A##ke, De, 10); \
+	Bmo = V##_XROL(A##mi, Di, 15); \
+	Bmu = V##_XROL(A##so, Do, 56); \
+	E##ma = V##_CHI(Bma, Bme, Bmi); \
+	E##me = V##_CHI(Bme, Bmi, Bmo); \
+	E##mi = V##_CHI(Bmi, Bmo, Bmu); \
+	E##mo = V##_CHI(Bmo, Bmu, Bma); \
+	E##mu = V##_CHI(Bmu, Bma, Bme); \
+	Bsa = V##_XROL(A##bi, Di, 62); \
+	Bse = V##_XROL(A##go, Do, 55); \
+	Bsi = V##_XROL(A##ku, Du, 39); \
+	Bso = V##_XROL(A##ma, Da, 41); \
+	Bsu = V##_XROL(A##se, De, 2); \
+	E##sa = V##_CHI(Bsa, Bse, Bsi); \
+	E##se = V##_CHI(Bse, Bsi, Bso); \
+	E##si = V##_CHI(Bsi, Bso, Bsu); \
+	E##so = V##_CHI(Bso, Bsu, Bsa); \
+	E##su = V##_CHI(Bsu, Bsa, Bse);
+
+/*
+ * 64-bit scalar lanes. Chi is written for the lane complementing transform:
+ * with lanes 1, 2, 8, 12, 17 and 20 kept inverted, all but one NOT per row
+ * turn into OR or AND, see the Keccak implementation overview, section 2.2.
+ * Apart from chi this is KECCAK_ROUND.
+ */
+#define LC_XOR(a, b) ((a) ^ (b))
+#define LC_XOR5(a, b, c, d, e) ((a) ^ (b) ^ (c) ^ (d) ^ (e))
+#define LC_RAX1(c, d) ((c) ^ rol(d, 1))
+#define LC_XROL(x, d, r) rol((x) ^ (d), r)
+
+#define KECCAK_LC_ROUND(A, E, rc) \
+	Ca = LC_XOR5(A##ba, A##ga, A##ka, A##ma, A##sa); \
+	Ce = LC_XOR5(A##be, A##ge, A##ke, A##me, A##se); \
+	Ci = LC_XOR5(A##bi, A##gi, A##ki, A##mi, A##si); \
+	Co = LC_XOR5(A##bo, A##go, A##ko, A##mo, A##so); \
+	Cu = LC_XOR5(A##bu, A##gu, A##ku, A##mu, A##su); \
+	Da = LC_RAX1(Cu, Ce); \
+	De = LC_RAX1(Ca, Ci); \
+	Di = LC_RAX1(Ce, Co); \
+	Do = LC_RAX1(Ci, Cu); \
+	Du = LC_RAX1(Co, Ca); \
+	Bba = A##ba ^ Da; \
+	Bbe = LC_XROL(A##ge, De, 44); \
+	Bbi = LC_XROL(A##ki, Di, 43); \
+	Bbo = LC_XROL(A##mo, Do, 21); \
+	Bbu = LC_XROL(A##su, Du, 14); \
+	E##ba = Bba ^ (Bbe | Bbi) ^ (rc); \
+	E##be = Bbe ^ (~Bbi | Bbo); \
+	E##bi = Bbi ^ (Bbo & Bbu); \
+	E##bo = Bbo ^ (Bbu | Bba); \
+	E##bu = Bbu ^ (Bba & Bbe); \
+	Bga = LC_XROL(A##bo, Do, 28); \
+	Bge = LC_XROL(A##gu, Du, 20); \
+	Bgi = LC_XROL(A##ka, Da, 3); \
+	Bgo = LC_XROL(A##me, De, 45); \
+	Bgu = LC_XROL(A##si, Di, 61); \
+	E##ga = Bga ^ (Bge | Bgi); \
+	E##ge = Bge ^ (Bgi & Bgo); \
+	E##gi = Bgi ^ (Bgo | ~Bgu); \
+	E##go = Bgo ^ (Bgu | Bga); \
+	E##gu = Bgu ^ (Bga & Bge); \
+	Bka = LC_XROL(A##be, De, 1); \
+	Bke = LC_XROL(A##gi, Di, 6); \
+	Bki = LC_XROL(A##ko, Do, 25); \
+	Bko = LC_XROL(A##mu, Du, 8); \
+	Bku = LC_XROL(A##sa, Da, 18); \
+	E##ka = Bka ^ (Bke | Bki); \
+	E##ke = Bke ^ (Bki & Bko); \
+	E##ki = Bki ^ (~Bko & Bku); \
+	E##ko = ~Bko ^ (Bku | Bka); \
+	E##ku = Bku ^ (Bka & Bke); \
+	Bma = LC_XROL(A##bu, Du, 27); \
+	Bme = LC_XROL(A##ga, Da, 36); \
+	Bmi = LC_XROL(A##ke, De, 10); \
+	Bmo = LC_XROL(A##mi, Di, 15); \
+	Bmu = LC_XROL(A##so, Do, 56); \
+	E##ma = Bma ^ (Bme & Bmi); \
+	E##me = Bme ^ (Bmi | Bmo); \
+	E##mi = Bmi ^ (~Bmo | Bmu); \
+	E##mo = ~Bmo ^ (Bmu & Bma); \
+	E##mu = Bmu ^ (Bma | Bme); \
+	Bsa = LC_XROL(A##bi, Di, 62); \
+	Bse = LC_XROL(A##go, Do, 55); \
+	Bsi = LC_XROL(A##ku, Du, 39); \
+	Bso = LC_XROL(A##ma, Da, 41); \
+	Bsu = LC_XROL(A##se, De, 2); \
+	E##sa = Bsa ^ (~Bse & Bsi); \
+	E##se = ~Bse ^ (Bsi | Bso); \
+	E##si = Bsi ^ (Bso & Bsu); \
+	E##so = Bso ^ (Bsu | Bsa); \
+	E##su = Bsu ^ (Bsa & Bse);
+
+#define KECCAK_LOAD_LANE(n, i) A##n = a[i];
+#define KECCAK_STORE_LANE(n, i) a[i] = A##n;
+
+static void keccakf_opt64(uint64_t* a) {
+	KECCAK_DECLARE(uint64_t);
+	a[1] = ~a[1]; a[2] = ~a[2]; a[8] = ~a[8];
+	a[12] = ~a[12]; a[17] = ~a[17]; a[20] = ~a[20];
+	KECCAK_LANES(KECCAK_LOAD_LANE)
+	for (int i = 0; i < 24; i += 2) {
+		KECCAK_LC_ROUND(A, E, RC[i])
+		KECCAK_LC_ROUND(E, A, RC[i + 1])
+	}
+	KECCAK_LANES(KECCAK_STORE_LANE)
+	a[1] = ~a[1]; a[2] = ~a[2]; a[8] = ~a[8];
+	a[12] = ~a[12]; a[17] = ~a[17]; a[20] = ~a[20];
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define ETHASH_KECCAK_AVX2 1
+#include <immintrin.h>
+
+/*
+ * Four states at once, lane i of state k in 64-bit element k of vector i.
+ * Used for DAG generation, where items are independent.
+ */
+#define AVX2_XOR(a, b) _mm256_xor_si256(a, b)
+#define AVX2_XOR5(a, b, c, d, e) AVX2_XOR(AVX2_XOR(AVX2_XOR(a, b), AVX2_XOR(c, d)), e)
+#define AVX2_ROL(x, r) _mm256_or_si256(_mm256_slli_epi64(x, r), _mm256_srli_epi64(x, 64 - (r)))
+#define AVX2_RAX1(c, d) AVX2_XOR(c, AVX2_ROL(d, 1))
+#define AVX2_XROL(x, d, r) AVX2_ROL(AVX2_XOR(x, d), r)
+#define AVX2_CHI(x, y, z) AVX2_XOR(x, _mm256_andnot_si256(y, z))
+
+#define KECCAK_AVX2_LOAD_LANE(n, i) \
+	A##n = _mm256_set_epi64x((long long)s[3][i], (long long)s[2][i], (long long)s[1][i], (long long)s[0][i]);
+#define KECCAK_AVX2_STORE_LANE(n, i) \
+	_mm256_storeu_si256((__m256i*)t, A##n); \
+	s[0][i] = t[0]; s[1][i] = t[1]; s[2][i] = t[2]; s[3][i] = t[3];
+
+__attribute__((target("avx2")))
+static void keccakf_avx2_x4(uint64_t* const s[4]) {
+	KECCAK_DECLARE(__m256i);
+	uint64_t t[4];
+	KECCAK_LANES(KECCAK_AVX2_LOAD_LANE)
+	for (int i = 0; i < 24; i += 2) {
+		KECCAK_ROUND(AVX2, A, E, _mm256_set1_epi64x((long long)RC[i]))
+		KECCAK_ROUND(AVX2, E, A, _mm256_set1_epi64x((long long)RC[i + 1]))
+	}
+	KECCAK_LANES(KECCAK_AVX2_STORE_LANE)
+}
+#endif // x86
+
+#if defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+#define ETHASH_KECCAK_SHA3 1
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#ifndef HWCAP_SHA3
+#define HWCAP_SHA3 (1 << 17)
+#endif
+#endif
+#ifdef __clang__
+#define ETHASH_TARGET_SHA3 __attribute__((target("sha3")))
+#else
+#define ETHASH_TARGET_SHA3 __attribute__((target("arch=armv8.2-a+sha3")))
+#endif
+
+/*
+ * ARMv8.2 SHA3 extension: EOR3, RAX1, XAR and BCAX do theta, rho and chi in
+ * one instruction each. Two states fit in a vector.
+ */
+#define SHA3_XOR(a, b) veorq_u64(a, b)
+#define SHA3_XOR5(a, b, c, d, e) veor3q_u64(veor3q_u64(a, b, c), d, e)
+#define SHA3_RAX1(c, d) vrax1q_u64(c, d)
+#define SHA3_XROL(x, d, r) vxarq_u64(x, d, 64 - (r))
+#define SHA3_CHI(x, y, z) vbcaxq_u64(x, z, y)
+
+#define KECCAK_SHA3_LOAD_LANE(n, i) A##n = vcombine_u64(vcreate_u64(s0[i]), vcreate_u64(s1[i]));
+#define KECCAK_SHA3_STORE_LANE(n, i) s0[i] = vgetq_lane_u64(A##n, 0); s1[i] = vgetq_lane_u64(A##n, 1);
+
+ETHASH_TARGET_SHA3
+static void keccakf_sha3_x2(uint64_t* s0, uint64_t* s1) {
+	KECCAK_DECLARE(uint64x2_t);
+	KECCAK_LANES(KECCAK_SHA3_LOAD_LANE)
+	for (int i = 0; i < 24; i += 2) {
+		KECCAK_ROUND(SHA3, A, E, vdupq_n_u64(RC[i]))
+		KECCAK_ROUND(SHA3, E, A, vdupq_n_u64(RC[i + 1]))
+	}
+	KECCAK_LANES(KECCAK_SHA3_STORE_LANE)
+}
+
+static void keccakf_sha3(uint64_t* a) {
+	uint64_t unused[25] = {0};
+	keccakf_sha3_x2(a, unused);
+}
+
+static void keccakf_sha3_x4(uint64_t* const s[4]) {
+	keccakf_sha3_x2(s[0], s[1]);
+	keccakf_sha3_x2(s[2], s[3]);
+}
+
+static bool keccak_sha3_supported(void) {
+#if defined(__ARM_FEATURE_SHA3)
+	return true;
+#elif defined(__linux__)
+	return (getauxval(AT_HWCAP) & HWCAP_SHA3) != 0;
+#else
+	return false;
+#endif
+}
+#endif // aarch64
+
+/*** Runtime selection ***/
+
+typedef struct ethash_keccak {
+	char const* name;
+	void (*f1600)(uint64_t* state);
+	/// Four independent permutations, NULL to call f1600 four times
+	void (*f1600_x4)(uint64_t* const states[4]);
+} ethash_keccak_t;
+
+static ethash_keccak_t const keccak_generic = {"generic", keccakf_generic, NULL};
+static ethash_keccak_t const keccak_opt64 = {"opt64", keccakf_opt64, NULL};
+#ifdef ETHASH_KECCAK_AVX2
+static ethash_keccak_t const keccak_avx2 = {"avx2", keccakf_opt64, keccakf_avx2_x4};
+#endif
+#ifdef ETHASH_KECCAK_SHA3
+static ethash_keccak_t const keccak_sha3 = {"armv8-sha3", keccakf_sha3, keccakf_sha3_x4};
+#endif
+
+/// Every variant usable on this CPU, fastest first, generic last
+static ethash_keccak_t const* ethash_supported_keccak(unsigned i)
+{
+	ethash_keccak_t const* supported[4];
+	unsigned count = 0;
+#ifdef ETHASH_KECCAK_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		supported[count++] = &keccak_avx2;
+	}
+#endif
+#ifdef ETHASH_KECCAK_SHA3
+	if (keccak_sha3_supported()) {
+		supported[count++] = &keccak_sha3;
+	}
+#endif
+	supported[count++] = &keccak_opt64;
+	supported[count++] = &keccak_generic;
+	return i < count ? supported[i] : NULL;
+}
+
+static ethash_keccak_t const* s_keccak = NULL;
+
+static ethash_keccak_t const* ethash_get_keccak(void)
+{
+	if (!s_keccak) {
+		s_keccak = ethash_supported_keccak(0);
+	}
+	return s_keccak;
+}
+
+char const* ethash_select_keccak(void)
+{
+	return ethash_get_keccak()->name;
+}
+
+bool ethash_set_keccak(char const* name)
+{
+	ethash_keccak_t const* k;
+	for (unsigned i = 0; (k = ethash_supported_keccak(i)) != NULL; ++i) {
+		if (strcmp(k->name, name) == 0) {
+			s_keccak = k;
+			return true;
+		}
+	}
+	return false;
+}
+
 /******** The FIPS202-defined functions. ********/
 
 /*** Some helper macros. ***/
@@ -101,7 +432,7 @@ static inline void keccakf(void* state) {
 mkapply_ds(xorin, dst[i] ^= src[i])  // xorin
 mkapply_sd(setout, dst[i] = src[i])  // setout
 
-#define P keccakf
+#define P(a) ethash_get_keccak()->f1600((uint64_t*)(a))
 #define Plen 200
 
 // Fold P*F over the full blocks of an input.
@@ -120,7 +451,9 @@ static inline int hash(uint8_t* out, size_t outlen,
 	if ((out == NULL) || ((in == NULL) && inlen != 0) || (rate >= Plen)) {
 		return -1;
 	}
-	uint8_t a[Plen] = {0};
+	// lanes are read as 64-bit words, so keep them aligned
+	uint64_t st[Plen / 8] = {0};
+	uint8_t* a = (uint8_t*)st;
 	// Absorb input.
 	foldP(in, inlen, xorin);
 	// Xor in the DS and pad frame.
@@ -137,6 +470,38 @@ static inline int hash(uint8_t* out, size_t outlen,
 	return 0;
 }
 
+void sha3_256_init(ethash_sha3_ctx* ctx) {
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->rate = 200 - 256 / 4;
+}
+
+void sha3_update(ethash_sha3_ctx* ctx, uint8_t const* in, size_t inlen) {
+	uint8_t* a = (uint8_t*)ctx->state;
+	while (inlen > 0) {
+		size_t n = ctx->rate - ctx->offset;
+		if (n > inlen) {
+			n = inlen;
+		}
+		xorin(a + ctx->offset, in, n);
+		ctx->offset += n;
+		in += n;
+		inlen -= n;
+		if (ctx->offset == ctx->rate) {
+			P(a);
+			ctx->offset = 0;
+		}
+	}
+}
+
+void sha3_256_final(ethash_sha3_ctx* ctx, struct ethash_h256* out) {
+	uint8_t* a = (uint8_t*)ctx->state;
+	a[ctx->offset] ^= 0x01;
+	a[ctx->rate - 1] ^= 0x80;
+	P(a);
+	setout(a, (uint8_t*)out, 32);
+	memset(ctx, 0, sizeof(*ctx));
+}
+
 #define defsha3(bits)													\
 	int sha3_##bits(uint8_t* out, size_t outlen,						\
 		const uint8_t* in, size_t inlen) {								\
@@ -149,3 +514,27 @@ static inline int hash(uint8_t* out, size_t outlen,
 /*** FIPS202 SHA3 FOFs ***/
 defsha3(256)
 defsha3(512)
+
+void sha3_512_x4(uint8_t* const out[4], uint8_t const* const in[4], size_t inlen) {
+	size_t const rate = 200 - 512 / 4;
+	ethash_keccak_t const* k = ethash_get_keccak();
+	if (!k->f1600_x4 || inlen >= rate) {
+		for (unsigned i = 0; i < 4; i++) {
+			sha3_512(out[i], 64, in[i], inlen);
+		}
+		return;
+	}
+	uint64_t st[4][Plen / 8];
+	uint64_t* const states[4] = {st[0], st[1], st[2], st[3]};
+	memset(st, 0, sizeof(st));
+	for (unsigned i = 0; i < 4; i++) {
+		uint8_t* a = (uint8_t*)st[i];
+		xorin(a, in[i], inlen);
+		a[inlen] ^= 0x01;
+		a[rate - 1] ^= 0x80;
+	}
+	k->f1600_x4(states);
+	for (unsigned i = 0; i < 4; i++) {
+		setout((uint8_t*)st[i], out[i], 64);
+	}
+}
@@ -5,6 +5,7 @@ extern "C" {
 #endif
 
 #include "compiler.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 
@@ -16,6 +17,41 @@ struct ethash_h256;
 decsha3(256)
 decsha3(512)
 
+/// Incremental SHA3, for data that isn't in one buffer
+typedef struct ethash_sha3_ctx {
+	uint64_t state[25];
+	size_t rate;
+	size_t offset;
+} ethash_sha3_ctx;
+
+void sha3_256_init(ethash_sha3_ctx* ctx);
+void sha3_update(ethash_sha3_ctx* ctx, uint8_t const* data, size_t size);
+/// Same result as SHA3_256() of everything passed to sha3_update()
+void sha3_256_final(ethash_sha3_ctx* ctx, struct ethash_h256* out);
+
+/**
+ * Four SHA3-512 hashes of @a size bytes each, computed side by side with SIMD
+ * where the selected Keccak supports it. The outputs may alias the inputs.
+ * Inputs shorter than the 72 byte rate, like DAG items, take the fast path.
+ */
+void sha3_512_x4(uint8_t* const out[4], uint8_t const* const in[4], size_t size);
+
+/**
+ * Detect the CPU features and select the fastest Keccak-f[1600] permutation
+ * behind SHA3_256() and SHA3_512(). Like ethash_select_kernels(), call it
+ * once at startup before anything is hashed.
+ *
+ * @return          The name of the selected permutation
+ */
+char const* ethash_select_keccak(void);
+/**
+ * Force a specific permutation, e.g. to benchmark or test it.
+ *
+ * @param name      One of "avx2", "armv8-sha3", "opt64" or "generic"
+ * @return          false if it is not supported on this CPU
+ */
+bool ethash_set_keccak(char const* name);
+
 static inline void SHA3_256(struct ethash_h256 const* ret, uint8_t const* data, size_t const size)
 {
 	sha3_256((uint8_t*)ret, 32, data, size);
@@ -0,0 +1,150 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "ethashcache.h"
+
+#include "ethash/internal.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <chrono>
+
+CEthashLightCache::CEthashLightCache(size_t nMaxEpochsIn, Factory factoryIn)
+    : nMaxEpochs(std::max<size_t>(nMaxEpochsIn, 1)), factory(factoryIn) {}
+
+EthashLightRef CEthashLightCache::Get(uint64_t nBlockNumber) {
+    const uint64_t nEpoch = nBlockNumber / ethash_get_epoch_length();
+
+    std::promise<EthashLightRef> promise;
+    Pending pending;
+    bool fBuild = false;
+    {
+        LOCK(cs);
+        auto it = mapEpochs.find(nEpoch);
+        if (it != mapEpochs.end()) {
+            pending = it->second;
+            Touch(nEpoch);
+        } else {
+            pending = promise.get_future().share();
+            mapEpochs.emplace(nEpoch, pending);
+            listRecent.push_front(nEpoch);
+            fBuild = true;
+        }
+    }
+
+    if (fBuild) {
+        // Computed without holding the lock: this takes a while and other
+        // epochs must remain available in the meantime.
+        int64_t nStart = GetTimeMillis();
+        EthashLightRef light;
+        ethash_light_t plight = factory(nEpoch * ethash_get_epoch_length());
+        if (plight != nullptr) {
+            light.reset(plight, ethash_light_delete);
+            LogPrintf("Computed ethash light cache for epoch %u in %dms\n",
+                      nEpoch, GetTimeMillis() - nStart);
+        } else {
+            LogPrintf("Failed to compute ethash light cache for epoch %u\n",
+                      nEpoch);
+        }
+        promise.set_value(light);
+
+        LOCK(cs);
+        if (!light) {
+            // Don't cache failures, the next caller will retry.
+            auto it = mapEpochs.find(nEpoch);
+            if (it != mapEpochs.end() &&
+                it->second.wait_for(std::chrono::seconds(0)) ==
+                    std::future_status::ready &&
+                !it->second.get()) {
+                Erase(nEpoch);
+            }
+        }
+        EvictExcess();
+    }
+
+    return pending.get();
+}
+
+EthashLightRef CEthashLightCache::GetIfCached(uint64_t nBlockNumber) {
+    const uint64_t nEpoch = nBlockNumber / ethash_get_epoch_length();
+
+    LOCK(cs);
+    auto it = mapEpochs.find(nEpoch);
+    if (it == mapEpochs.end() || it->second.wait_for(std::chrono::seconds(
+                                     0)) != std::future_status::ready) {
+        return EthashLightRef();
+    }
+    Touch(nEpoch);
+    return it->second.get();
+}
+
+void CEthashLightCache::SetMaxEpochs(size_t nMaxEpochsIn) {
+    LOCK(cs);
+    nMaxEpochs = std::max<size_t>(nMaxEpochsIn, 1);
+    EvictExcess();
+}
+
+size_t CEthashLightCache::Size() const {
+    LOCK(cs);
+    return mapEpochs.size();
+}
+
+uint64_t CEthashLightCache::MemoryUsage() const {
+    LOCK(cs);
+    uint64_t nBytes = 0;
+    for (const auto &it : mapEpochs) {
+        nBytes += ethash_get_cachesize(it.first * ethash_get_epoch_length());
+    }
+    return nBytes;
+}
+
+void CEthashLightCache::Clear() {
+    LOCK(cs);
+    mapEpochs.clear();
+    listRecent.clear();
+}
+
+void CEthashLightCache::Touch(uint64_t nEpoch) {
+    AssertLockHeld(cs);
+    listRecent.remove(nEpoch);
+    listRecent.push_front(nEpoch);
+}
+
+void CEthashLightCache::Erase(uint64_t nEpoch) {
+    AssertLockHeld(cs);
+    mapEpochs.erase(nEpoch);
+    listRecent.remove(nEpoch);
+}
+
+void CEthashLightCache::EvictExcess() {
+    AssertLockHeld(cs);
+    // Walk from the least recently used epoch and drop finished caches until
+    // we are within budget. Caches still being computed are never evicted,
+    // their waiters would otherwise trigger a second computation.
+    auto it = listRecent.end();
+    while (mapEpochs.size() > nMaxEpochs && it != listRecent.begin()) {
+        --it;
+        auto mit = mapEpochs.find(*it);
+        assert(mit != mapEpochs.end());
+        if (mit->second.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready) {
+            continue;
+        }
+        mapEpochs.erase(mit);
+        it = listRecent.erase(it);
+    }
+}
+
+CEthashLightCache &EthashLightCache() {
+    static CEthashLightCache cache;
+    return cache;
+}
+
+void InitEthashLightCache() {
+    int64_t nMaxEpochs = GetArg("-maxethashcaches",
+                                DEFAULT_MAX_ETHASH_LIGHT_CACHES);
+    EthashLightCache().SetMaxEpochs(std::max<int64_t>(nMaxEpochs, 1));
+    LogPrintf("Keeping at most %d ethash light caches in memory\n",
+              std::max<int64_t>(nMaxEpochs, 1));
+}
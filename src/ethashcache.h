@@ -0,0 +1,91 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ETHASHCACHE_H
+#define BITCOIN_ETHASHCACHE_H
+
+#include "ethash/ethash.h"
+#include "sync.h"
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+
+/** Default for -maxethashcaches: the current and the next epoch */
+static const unsigned int DEFAULT_MAX_ETHASH_LIGHT_CACHES = 2;
+
+/**
+ * A reference to an ethash light cache. The cache is freed once the last
+ * reference is dropped, even if it has been evicted from the
+ * CEthashLightCache in the meantime.
+ */
+typedef std::shared_ptr<struct ethash_light> EthashLightRef;
+
+/** A reference to an ethash DAG, freed once the last reference is dropped */
+typedef std::shared_ptr<struct ethash_full> EthashFullRef;
+
+/**
+ * Process-wide cache of ethash light caches, one per epoch.
+ *
+ * Light caches are very large and expensive to compute, so every user (the
+ * miner, the mining RPCs and PoW verification) shares them through this
+ * class instead of calling ethash_light_new() on its own. Only the most
+ * recently used epochs are kept; a cache for a given epoch is only ever
+ * computed once at a time, concurrent requests for it wait for the thread
+ * that is already building it.
+ */
+class CEthashLightCache {
+public:
+    typedef std::function<ethash_light_t(uint64_t nBlockNumber)> Factory;
+
+    explicit CEthashLightCache(
+        size_t nMaxEpochsIn = DEFAULT_MAX_ETHASH_LIGHT_CACHES,
+        Factory factoryIn = ethash_light_new);
+
+    /**
+     * Get the light cache for the epoch of nBlockNumber, computing it if it
+     * isn't cached yet. Returns an empty reference if the computation failed.
+     */
+    EthashLightRef Get(uint64_t nBlockNumber);
+
+    /** Get the light cache for the epoch of nBlockNumber if it's ready. */
+    EthashLightRef GetIfCached(uint64_t nBlockNumber);
+
+    /** Change how many epochs are kept, evicting the oldest if needed. */
+    void SetMaxEpochs(size_t nMaxEpochsIn);
+
+    /** Number of epochs currently cached (including ones being computed). */
+    size_t Size() const;
+
+    /** Bytes taken by the cached epochs, counting those being computed. */
+    uint64_t MemoryUsage() const;
+
+    void Clear();
+
+private:
+    typedef std::shared_future<EthashLightRef> Pending;
+
+    mutable CCriticalSection cs;
+    size_t nMaxEpochs;
+    const Factory factory;
+    //! Epoch to (possibly still being computed) light cache
+    std::map<uint64_t, Pending> mapEpochs;
+    //! Epochs in mapEpochs, most recently used first
+    std::list<uint64_t> listRecent;
+
+    void Touch(uint64_t nEpoch);
+    void Erase(uint64_t nEpoch);
+    void EvictExcess();
+};
+
+/** The light cache shared by the whole process */
+CEthashLightCache &EthashLightCache();
+
+/** To be called once in AppInitMain to apply -maxethashcaches */
+void InitEthashLightCache();
+
+#endif // BITCOIN_ETHASHCACHE_H
@@ -0,0 +1,370 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "ethashproof.h"
+
+#include "arith_uint256.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "config.h"
+#include "consensus/merkle.h"
+#include "ethash/internal.h"
+#include "hash.h"
+#include "memusage.h"
+#include "miner.h"
+#include "primitives/block.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+std::unique_ptr<CEthashProver> g_ethashprover;
+
+uint256 DagPageHash(const uint8_t *pPage) {
+    return Hash(pPage, pPage + ETHASH_MIX_BYTES);
+}
+
+unsigned int DagCommitmentDepth(uint64_t nPages, unsigned int nChunkBits) {
+    uint64_t nNodes = std::max<uint64_t>(
+        (nPages + (uint64_t(1) << nChunkBits) - 1) >> nChunkBits, 1);
+    unsigned int nDepth = nChunkBits;
+    while (nNodes > 1) {
+        nNodes = (nNodes + 1) / 2;
+        nDepth++;
+    }
+    return nDepth;
+}
+
+/**
+ * Replace vHashes with the level above, where each node hashes two of them,
+ * or the last one twice if there is an odd number of them.
+ */
+static void HashLevel(std::vector<uint256> &vHashes) {
+    const size_t nSize = vHashes.size();
+    for (size_t i = 0; i < nSize; i += 2) {
+        const uint256 &left = vHashes[i];
+        const uint256 &right = i + 1 < nSize ? vHashes[i + 1] : left;
+        vHashes[i / 2] =
+            Hash(left.begin(), left.end(), right.begin(), right.end());
+    }
+    vHashes.resize((nSize + 1) / 2);
+}
+
+CDagCommitment::CDagCommitment(const uint8_t *pDagIn, uint64_t nPagesIn,
+                               unsigned int nChunkBitsIn,
+                               const std::atomic<bool> *pfInterrupt)
+    : pDag(pDagIn), nPages(nPagesIn), nChunkBits(nChunkBitsIn) {
+    const uint64_t nChunks = std::max<uint64_t>(
+        (nPages + (uint64_t(1) << nChunkBits) - 1) >> nChunkBits, 1);
+    std::vector<uint256> vChunks(nChunks);
+    for (uint64_t nChunk = 0; nChunk < nChunks; nChunk++) {
+        if (pfInterrupt && *pfInterrupt) {
+            break;
+        }
+        std::vector<uint256> vHashes = ChunkLeaves(nChunk);
+        for (unsigned int i = 0; i < nChunkBits; i++) {
+            HashLevel(vHashes);
+        }
+        vChunks[nChunk] = vHashes[0];
+    }
+
+    vLevels.push_back(std::move(vChunks));
+    while (vLevels.back().size() > 1) {
+        std::vector<uint256> vLevel = vLevels.back();
+        HashLevel(vLevel);
+        vLevels.push_back(std::move(vLevel));
+    }
+}
+
+std::vector<uint256> CDagCommitment::ChunkLeaves(uint64_t nChunk) const {
+    const uint64_t nBegin = nChunk << nChunkBits;
+    const uint64_t nEnd =
+        std::min(nPages, nBegin + (uint64_t(1) << nChunkBits));
+    std::vector<uint256> vHashes;
+    vHashes.reserve(nEnd - nBegin);
+    for (uint64_t nPage = nBegin; nPage < nEnd; nPage++) {
+        vHashes.push_back(DagPageHash(pDag + nPage * ETHASH_MIX_BYTES));
+    }
+    // An empty DAG still has a root.
+    if (vHashes.empty()) {
+        vHashes.emplace_back();
+    }
+    return vHashes;
+}
+
+std::vector<uint256> CDagCommitment::GetBranch(uint32_t nIndex) const {
+    std::vector<uint256> vBranch;
+    vBranch.reserve(vLevels.size() - 1 + nChunkBits);
+
+    // The levels under the chunk are hashed again.
+    uint64_t nPos = nIndex & ((uint64_t(1) << nChunkBits) - 1);
+    std::vector<uint256> vHashes = ChunkLeaves(nIndex >> nChunkBits);
+    for (unsigned int i = 0; i < nChunkBits; i++) {
+        vBranch.push_back(vHashes[std::min<uint64_t>(nPos ^ 1,
+                                                     vHashes.size() - 1)]);
+        HashLevel(vHashes);
+        nPos >>= 1;
+    }
+
+    nPos = nIndex >> nChunkBits;
+    for (size_t i = 0; i + 1 < vLevels.size(); i++) {
+        const std::vector<uint256> &vLevel = vLevels[i];
+        vBranch.push_back(
+            vLevel[std::min<uint64_t>(nPos ^ 1, vLevel.size() - 1)]);
+        nPos >>= 1;
+    }
+    return vBranch;
+}
+
+namespace {
+struct ProveContext {
+    const CDagCommitment &commitment;
+    const uint8_t *pDag;
+    CEthashProof &proof;
+};
+
+struct VerifyContext {
+    const CEthashProof &proof;
+    const uint256 &dagRoot;
+    unsigned int nDepth;
+};
+} // namespace
+
+static bool ProvePage(void *ctx, unsigned nAccess, uint32_t nIndex,
+                      uint8_t *pPage) {
+    ProveContext &context = *static_cast<ProveContext *>(ctx);
+    const uint8_t *pDagPage =
+        context.pDag + uint64_t(nIndex) * ETHASH_MIX_BYTES;
+    memcpy(pPage, pDagPage, ETHASH_MIX_BYTES);
+
+    CEthashPageProof page;
+    page.nIndex = nIndex;
+    page.vchPage.assign(pDagPage, pDagPage + ETHASH_MIX_BYTES);
+    page.vBranch = context.commitment.GetBranch(nIndex);
+    context.proof.vPages.push_back(std::move(page));
+    return true;
+}
+
+ethash_return_value_t CDagCommitment::Prove(const ethash_h256_t &headerHash,
+                                            uint64_t nNonce,
+                                            CEthashProof &proof) const {
+    proof.vPages.clear();
+    proof.vPages.reserve(ETHASH_ACCESSES);
+    ProveContext context{*this, pDag, proof};
+    ethash_return_value_t ret;
+    ethash_compute_pages(&ret, nPages * ETHASH_MIX_BYTES, headerHash, nNonce,
+                         ProvePage, &context);
+    return ret;
+}
+
+size_t CDagCommitment::DynamicMemoryUsage() const {
+    size_t nUsage = memusage::DynamicUsage(vLevels);
+    for (const std::vector<uint256> &vLevel : vLevels) {
+        nUsage += memusage::DynamicUsage(vLevel);
+    }
+    return nUsage;
+}
+
+static bool VerifyPage(void *ctx, unsigned nAccess, uint32_t nIndex,
+                       uint8_t *pPage) {
+    const VerifyContext &context = *static_cast<VerifyContext *>(ctx);
+    if (nAccess >= context.proof.vPages.size()) {
+        return false;
+    }
+    const CEthashPageProof &page = context.proof.vPages[nAccess];
+    if (page.nIndex != nIndex || page.vchPage.size() != ETHASH_MIX_BYTES ||
+        page.vBranch.size() != context.nDepth) {
+        return false;
+    }
+    if (ComputeMerkleRootFromBranch(DagPageHash(page.vchPage.data()),
+                                    page.vBranch,
+                                    nIndex) != context.dagRoot) {
+        return false;
+    }
+    memcpy(pPage, page.vchPage.data(), ETHASH_MIX_BYTES);
+    return true;
+}
+
+bool VerifyEthashProof(const CEthashProof &proof, const uint256 &dagRoot,
+                       uint64_t nFullSize, const ethash_h256_t &headerHash,
+                       uint64_t nNonce, ethash_return_value_t &ret) {
+    if (proof.vPages.size() != ETHASH_ACCESSES) {
+        return false;
+    }
+    VerifyContext context{proof, dagRoot,
+                          DagCommitmentDepth(nFullSize / ETHASH_MIX_BYTES)};
+    return ethash_compute_pages(&ret, nFullSize, headerHash, nNonce,
+                                VerifyPage, &context);
+}
+
+bool CheckProofOfWorkWithProof(const CBlockHeader &header,
+                               const CEthashProof &proof,
+                               const uint256 &dagRoot, const Config &config) {
+    bool fNegative;
+    bool fOverflow;
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(header.nBits, &fNegative, &fOverflow);
+    if (fNegative || bnTarget == 0 || fOverflow ||
+        bnTarget >
+            UintToArith256(config.GetChainParams().GetConsensus().powLimit)) {
+        return false;
+    }
+    const ethash_h256_t boundary = bnTarget.ToEthashH256();
+
+    ethash_return_value_t ret;
+    if (!VerifyEthashProof(proof, dagRoot,
+                           ethash_get_datasize(header.nBlockHeight),
+                           header.GetBaseEthash(), header.nNonce, ret)) {
+        return false;
+    }
+    return memcmp(&ret.mix_hash, &header.hashMix, sizeof(ret.mix_hash)) == 0 &&
+           ethash_check_difficulty(&ret.result, &boundary);
+}
+
+//! Set to stop a DAG or commitment being built, there is one prover at most
+static std::atomic<bool> fInterruptProver(false);
+
+static int DagProgress(unsigned nProgress) {
+    return fInterruptProver ? 1 : 0;
+}
+
+CEthashProver::CEthashProver(const Config &configIn)
+    : config(configIn), nNextHeight(-1), fStop(false) {
+    fInterruptProver = false;
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip() && !IsInitialBlockDownload()) {
+            nNextHeight = chainActive.Height() + 1;
+        }
+    }
+    RegisterValidationInterface(this);
+    thread = std::thread(
+        &TraceThread<std::function<void()>>, "powproof",
+        std::function<void()>(std::bind(&CEthashProver::ThreadProve, this)));
+}
+
+CEthashProver::~CEthashProver() {
+    UnregisterValidationInterface(this);
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+    }
+    fInterruptProver = true;
+    cond.notify_all();
+    thread.join();
+}
+
+void CEthashProver::UpdatedBlockTip(const CBlockIndex *pindexNew,
+                                    const CBlockIndex *pindexFork,
+                                    bool fInitialDownload) {
+    // Epochs synced through are skipped.
+    if (fInitialDownload) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        nNextHeight = pindexNew->nHeight + 1;
+    }
+    cond.notify_all();
+}
+
+std::shared_ptr<const CEthashProver::Epoch>
+CEthashProver::GetEpoch(int64_t nEpoch) const {
+    std::lock_guard<std::mutex> lock(cs);
+    auto it = mapEpochs.find(nEpoch);
+    return it != mapEpochs.end() ? it->second : nullptr;
+}
+
+std::map<int64_t, uint256> CEthashProver::GetDagRoots() const {
+    std::lock_guard<std::mutex> lock(cs);
+    std::map<int64_t, uint256> mapRoots;
+    for (const auto &entry : mapEpochs) {
+        mapRoots.emplace(entry.first, entry.second->commitment->GetRoot());
+    }
+    return mapRoots;
+}
+
+std::shared_ptr<const CEthashProver::Epoch>
+CEthashProver::BuildEpoch(int64_t nEpoch) {
+    const int64_t nStart = GetTimeMillis();
+    LogPrintf("Building the DAG commitment of epoch %d\n", nEpoch);
+
+    std::shared_ptr<Epoch> epoch;
+    {
+        // The light cache is only needed while the DAG is generated.
+        EthashLightRef light =
+            EthashLightCache().Get(nEpoch * ethash_get_epoch_length());
+        if (!light) {
+            error("%s: no light cache for epoch %d", __func__, nEpoch);
+            return nullptr;
+        }
+        ethash_full_t pfull = NewEthashFull(light.get(), DagProgress);
+        if (!pfull) {
+            if (!fInterruptProver) {
+                error("%s: DAG generation failed for epoch %d", __func__,
+                      nEpoch);
+            }
+            return nullptr;
+        }
+        epoch = std::make_shared<Epoch>();
+        epoch->full = EthashFullRef(pfull, ethash_full_delete);
+    }
+
+    const uint8_t *pDag =
+        static_cast<const uint8_t *>(ethash_full_dag(epoch->full.get()));
+    const uint64_t nPages =
+        ethash_full_dag_size(epoch->full.get()) / ETHASH_MIX_BYTES;
+    epoch->commitment.reset(new CDagCommitment(
+        pDag, nPages, DAG_COMMITMENT_CHUNK_BITS, &fInterruptProver));
+    if (fInterruptProver) {
+        return nullptr;
+    }
+
+    LogPrintf("DAG commitment of epoch %d is %s, built in %dms\n", nEpoch,
+              epoch->commitment->GetRoot().ToString(),
+              GetTimeMillis() - nStart);
+    return epoch;
+}
+
+void CEthashProver::ThreadProve() {
+    while (true) {
+        int64_t nEpoch;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            // Wait for a tip in an epoch without a DAG.
+            cond.wait(lock, [this] {
+                return fStop || (nNextHeight >= 0 &&
+                                 !mapEpochs.count(nNextHeight /
+                                                  ethash_get_epoch_length()));
+            });
+            if (fStop) {
+                return;
+            }
+            nEpoch = nNextHeight / ethash_get_epoch_length();
+        }
+
+        std::shared_ptr<const Epoch> epoch = BuildEpoch(nEpoch);
+        if (!epoch) {
+            if (!fInterruptProver) {
+                LogPrintf("%s: no DAG commitment for epoch %d, proofs of work "
+                          "are not served anymore\n",
+                          __func__, nEpoch);
+            }
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(cs);
+        mapEpochs[nEpoch] = epoch;
+        // Keep the previous epoch, for the headers just before the switch.
+        while (mapEpochs.begin()->first < nEpoch - 1) {
+            mapEpochs.erase(mapEpochs.begin());
+        }
+        for (auto it = mapEpochs.upper_bound(nEpoch); it != mapEpochs.end();) {
+            it = mapEpochs.erase(it);
+        }
+    }
+}
@@ -0,0 +1,181 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ETHASHPROOF_H
+#define BITCOIN_ETHASHPROOF_H
+
+#include "ethash/ethash.h"
+#include "ethashcache.h"
+#include "serialize.h"
+#include "uint256.h"
+#include "validationinterface.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CBlockHeader;
+class Config;
+
+/** Default for -powproofs */
+static const bool DEFAULT_POW_PROOFS = false;
+/**
+ * Pages of the DAG under each node of the lowest level a DAG commitment
+ * keeps, as a power of two. The levels below are hashed again from the DAG
+ * for each proof.
+ */
+static const unsigned int DAG_COMMITMENT_CHUNK_BITS = 10;
+
+/** A DAG page ethash read, with its Merkle branch to the DAG root */
+struct CEthashPageProof {
+    uint32_t nIndex;
+    //! The ETHASH_MIX_BYTES of the page, as they are in the DAG
+    std::vector<uint8_t> vchPage;
+    std::vector<uint256> vBranch;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(nIndex);
+        READWRITE(vchPage);
+        READWRITE(vBranch);
+    }
+};
+
+/**
+ * The ETHASH_ACCESSES pages the ethash of a header reads, in the order it
+ * reads them. A client that trusts the DAG root of the epoch can check the
+ * proof of work of the header with it, without the light cache.
+ */
+struct CEthashProof {
+    std::vector<CEthashPageProof> vPages;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(vPages);
+    }
+};
+
+/** Hash of a DAG page, the leaves of DAG commitments */
+uint256 DagPageHash(const uint8_t *pPage);
+
+/** Length of the branches of a DAG commitment over nPages pages */
+unsigned int
+DagCommitmentDepth(uint64_t nPages,
+                   unsigned int nChunkBits = DAG_COMMITMENT_CHUNK_BITS);
+
+/**
+ * Merkle tree over the page hashes of a DAG, built like the ones of blocks:
+ * an odd last node is paired with itself. It is at least nChunkBits levels
+ * deep, which only matters for DAGs of fewer pages than that.
+ *
+ * Only the levels from chunks of 2^nChunkBits pages up are kept, a few
+ * hundred kB for a real DAG. The DAG must outlive the commitment.
+ *
+ * Hashing a real DAG takes a while: if *pfInterrupt is set in the meantime,
+ * the commitment is left incomplete and must be dropped.
+ */
+class CDagCommitment {
+public:
+    CDagCommitment(const uint8_t *pDagIn, uint64_t nPagesIn,
+                   unsigned int nChunkBitsIn = DAG_COMMITMENT_CHUNK_BITS,
+                   const std::atomic<bool> *pfInterrupt = nullptr);
+
+    const uint256 &GetRoot() const { return vLevels.back()[0]; }
+    uint64_t GetPages() const { return nPages; }
+    std::vector<uint256> GetBranch(uint32_t nIndex) const;
+
+    /**
+     * Compute the ethash of headerHash and nNonce over the DAG, and the proof
+     * of the pages it reads.
+     */
+    ethash_return_value_t Prove(const ethash_h256_t &headerHash,
+                                uint64_t nNonce, CEthashProof &proof) const;
+
+    size_t DynamicMemoryUsage() const;
+
+private:
+    const uint8_t *const pDag;
+    const uint64_t nPages;
+    const unsigned int nChunkBits;
+    //! From the chunk roots up to the root
+    std::vector<std::vector<uint256>> vLevels;
+
+    //! The page hashes of chunk nChunk
+    std::vector<uint256> ChunkLeaves(uint64_t nChunk) const;
+};
+
+/**
+ * Compute the ethash of headerHash and nNonce from the pages of proof,
+ * checking each against dagRoot, the root of the commitment to the DAG of
+ * nFullSize bytes of the epoch. Returns false if the proof doesn't hold.
+ */
+bool VerifyEthashProof(const CEthashProof &proof, const uint256 &dagRoot,
+                       uint64_t nFullSize, const ethash_h256_t &headerHash,
+                       uint64_t nNonce, ethash_return_value_t &ret);
+
+/**
+ * Check the proof of work of header with a proof against dagRoot, the same
+ * way CheckProofOfWork does with the light cache.
+ */
+bool CheckProofOfWorkWithProof(const CBlockHeader &header,
+                               const CEthashProof &proof,
+                               const uint256 &dagRoot, const Config &config);
+
+/**
+ * Builds the DAG and its commitment for the epoch of the tip on a thread of
+ * its own, once per epoch, and serves proofs of work of the headers of the
+ * epochs it has. The DAG of the previous epoch is kept as well, for the
+ * headers just before the switch.
+ */
+class CEthashProver : public CValidationInterface {
+public:
+    /** A DAG with its commitment */
+    struct Epoch {
+        EthashFullRef full;
+        std::unique_ptr<const CDagCommitment> commitment;
+    };
+
+    explicit CEthashProver(const Config &configIn);
+    ~CEthashProver();
+
+    /** The DAG of epoch nEpoch, nullptr if it isn't ready */
+    std::shared_ptr<const Epoch> GetEpoch(int64_t nEpoch) const;
+    /** The epochs ready, with their DAG root */
+    std::map<int64_t, uint256> GetDagRoots() const;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew,
+                         const CBlockIndex *pindexFork,
+                         bool fInitialDownload) override;
+
+private:
+    void ThreadProve();
+    //! Build the DAG and commitment of nEpoch, nullptr if stopped or failed
+    std::shared_ptr<const Epoch> BuildEpoch(int64_t nEpoch);
+
+    const Config &config;
+
+    mutable std::mutex cs;
+    std::condition_variable cond;
+    //! Height of the next block, -1 until a tip is known
+    int64_t nNextHeight;
+    bool fStop;
+    std::map<int64_t, std::shared_ptr<const Epoch>> mapEpochs;
+
+    std::thread thread;
+};
+
+/** The DAG commitment builder, with -powproofs */
+extern std::unique_ptr<CEthashProver> g_ethashprover;
+
+#endif // BITCOIN_ETHASHPROOF_H
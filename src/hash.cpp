@@ -18,20 +18,20 @@ bool EthashEquals(ethash_h256_t hash1, ethash_h256_t hash2)
     return true;
 }
 
-unsigned int MurmurHash3(unsigned int nHashSeed,
-                         const std::vector<uint8_t> &vDataToHash) {
+unsigned int MurmurHash3(unsigned int nHashSeed, const uint8_t *pch,
+                         size_t nLen) {
     // The following is MurmurHash3 (x86_32), see
     // http://code.google.com/p/smhasher/source/browse/trunk/MurmurHash3.cpp
     uint32_t h1 = nHashSeed;
-    if (vDataToHash.size() > 0) {
+    if (nLen > 0) {
         const uint32_t c1 = 0xcc9e2d51;
         const uint32_t c2 = 0x1b873593;
 
-        const int nblocks = vDataToHash.size() / 4;
+        const int nblocks = nLen / 4;
 
         //----------
         // body
-        const uint8_t *blocks = &vDataToHash[0] + nblocks * 4;
+        const uint8_t *blocks = pch + nblocks * 4;
 
         for (int i = -nblocks; i; i++) {
             uint32_t k1 = ReadLE32(blocks + i * 4);
@@ -47,11 +47,11 @@ unsigned int MurmurHash3(unsigned int nHashSeed,
 
         //----------
         // tail
-        const uint8_t *tail = (const uint8_t *)(&vDataToHash[0] + nblocks * 4);
+        const uint8_t *tail = pch + nblocks * 4;
 
         uint32_t k1 = 0;
 
-        switch (vDataToHash.size() & 3) {
+        switch (nLen & 3) {
             case 3:
                 k1 ^= tail[2] << 16;
             // FALLTHROUGH
@@ -69,7 +69,7 @@ unsigned int MurmurHash3(unsigned int nHashSeed,
 
     //----------
     // finalization
-    h1 ^= vDataToHash.size();
+    h1 ^= nLen;
     h1 ^= h1 >> 16;
     h1 *= 0x85ebca6b;
     h1 ^= h1 >> 13;
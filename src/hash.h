@@ -210,21 +210,59 @@ uint256 SerializeHash(const T &obj, int nType = SER_GETHASH,
     return ss.GetHash();
 }
 
+/** A writer stream (for serialization) that computes an ethash SHA3-256. */
+class CEthashWriter {
+private:
+    ethash_sha3_ctx ctx;
+
+    const int nType;
+    const int nVersion;
+
+public:
+    CEthashWriter(int nTypeIn, int nVersionIn)
+        : nType(nTypeIn), nVersion(nVersionIn) {
+        sha3_256_init(&ctx);
+    }
+
+    int GetType() const { return nType; }
+    int GetVersion() const { return nVersion; }
+
+    void write(const char *pch, size_t size) {
+        sha3_update(&ctx, (const uint8_t *)pch, size);
+    }
+
+    // invalidates the object
+    ethash_h256_t GetEthash() {
+        ethash_h256_t result;
+        sha3_256_final(&ctx, &result);
+        return result;
+    }
+
+    template <typename T> CEthashWriter &operator<<(const T &obj) {
+        // Serialize to this stream
+        ::Serialize(*this, obj);
+        return (*this);
+    }
+};
+
+/** Compute the ethash SHA3-256 of an object's serialization. */
 template<typename T>
 ethash_h256_t SerializeEthash(const T& obj, int nType=SER_GETHASH, int nVersion=PROTOCOL_VERSION)
 {
-    CDataStream ss(nType, nVersion);
+    CEthashWriter ss(nType, nVersion);
     ss << obj;
-    ethash_h256_t result;
-    SHA3_256(&result, (uint8_t *)(ss.str().data()), ss.str().size());
-    return result;
+    return ss.GetEthash();
 }
 
 bool EthashEquals(ethash_h256_t hash1, ethash_h256_t hash2) ;
 
 
-unsigned int MurmurHash3(unsigned int nHashSeed,
-                         const std::vector<uint8_t> &vDataToHash);
+unsigned int MurmurHash3(unsigned int nHashSeed, const uint8_t *pch,
+                         size_t nLen);
+inline unsigned int MurmurHash3(unsigned int nHashSeed,
+                                const std::vector<uint8_t> &vDataToHash) {
+    return MurmurHash3(nHashSeed, vDataToHash.data(), vDataToHash.size());
+}
 
 void BIP32Hash(const ChainCode &chainCode, unsigned int nChild, uint8_t header,
                const uint8_t data[32], uint8_t output[64]);
@@ -9,9 +9,12 @@
 #include "config.h"
 #include "crypto/hmac_sha256.h"
 #include "httpserver.h"
+#include "metrics.h"
 #include "random.h"
+#include "rpc/jsonstream.h"
 #include "rpc/protocol.h"
 #include "rpc/server.h"
+#include "rpc/stats.h"
 #include "sync.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -25,6 +28,22 @@
 /** WWW-Authenticate to present with 401 Unauthorized response */
 static const char *WWW_AUTH_HEADER_DATA = "Basic realm=\"jsonrpc\"";
 
+/** Bytes at the start of a request body searched for the method */
+static const size_t JSONRPC_PEEK_SIZE = 1024;
+
+/**
+ * Slow calls that run at most this many at once by default, so they can't
+ * take all threads of their lane. -rpcmethodlimit changes these.
+ */
+static const struct {
+    const char *method;
+    int nMax;
+} defaultMethodLimits[] = {
+    {"gettxoutsetinfo", 1}, {"dumptxoutset", 1}, {"loadtxoutset", 1},
+    {"verifychain", 1},     {"importwallet", 1}, {"importmulti", 1},
+    {"dumpwallet", 1},
+};
+
 /** Simple one-shot callback timer to be used by the RPC mechanism to e.g.
  * re-lock the wallet.
  */
@@ -78,6 +97,15 @@ static void JSONErrorReply(HTTPRequest *req, const UniValue &objError,
     req->WriteReply(nStatus, strReply);
 }
 
+/**
+ * A handler writing its result out as it goes failed after the reply started.
+ * The status went out already, the reply can only be cut short.
+ */
+static void CutStreamedReply(HTTPRequest *req, const std::string &strError) {
+    LogPrintf("JSON-RPC reply cut short: %s\n", strError);
+    req->EndChunkedReply();
+}
+
 // This function checks username and password against -rpcauth entries from
 // config file.
 static bool multiUserAuthorized(std::string strUserPass) {
@@ -150,15 +178,11 @@ static bool RPCAuthorized(const std::string &strAuth,
     return multiUserAuthorized(strUserPass);
 }
 
-static bool HTTPReq_JSONRPC(Config &config, HTTPRequest *req,
-                            const std::string &) {
-    // JSONRPC handles only POST
-    if (req->GetRequestMethod() != HTTPRequest::POST) {
-        req->WriteReply(HTTP_BAD_METHOD,
-                        "JSONRPC server handles only POST requests");
-        return false;
-    }
-    // Check authorization
+/**
+ * Check the credentials of req, setting strAuthUser. Replies to it and
+ * returns false if they are missing or wrong.
+ */
+static bool CheckRPCAuthorization(HTTPRequest *req, std::string &strAuthUser) {
     std::pair<bool, std::string> authHeader = req->GetHeader("authorization");
     if (!authHeader.first) {
         req->WriteHeader("WWW-Authenticate", WWW_AUTH_HEADER_DATA);
@@ -166,8 +190,13 @@ static bool HTTPReq_JSONRPC(Config &config, HTTPRequest *req,
         return false;
     }
 
-    JSONRPCRequest jreq;
-    if (!RPCAuthorized(authHeader.second, jreq.authUser)) {
+    // Requests after the first on a keep-alive connection skip the check.
+    bool fAuthorized = req->GetConnectionAuth(authHeader.second, strAuthUser);
+    if (!fAuthorized && RPCAuthorized(authHeader.second, strAuthUser)) {
+        req->SetConnectionAuth(authHeader.second, strAuthUser);
+        fAuthorized = true;
+    }
+    if (!fAuthorized) {
         LogPrintf("ThreadRPCServer incorrect password attempt from %s\n",
                   req->GetPeer().ToString());
 
@@ -180,7 +209,24 @@ static bool HTTPReq_JSONRPC(Config &config, HTTPRequest *req,
         req->WriteReply(HTTP_UNAUTHORIZED);
         return false;
     }
+    return true;
+}
 
+static bool HTTPReq_JSONRPC(Config &config, HTTPRequest *req,
+                            const std::string &) {
+    // JSONRPC handles only POST
+    if (req->GetRequestMethod() != HTTPRequest::POST) {
+        req->WriteReply(HTTP_BAD_METHOD,
+                        "JSONRPC server handles only POST requests");
+        return false;
+    }
+    JSONRPCRequest jreq;
+    if (!CheckRPCAuthorization(req, jreq.authUser)) {
+        return false;
+    }
+
+    // Whether a handler started to write its result out as it goes.
+    bool fStreamStarted = false;
     try {
         // Parse request
         UniValue valRequest;
@@ -195,10 +241,38 @@ static bool HTTPReq_JSONRPC(Config &config, HTTPRequest *req,
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
+            // Big results go out in chunks as the handler writes them, the
+            // reply starts with the first one.
+            size_t nStreamed = 0;
+            CJSONStreamWriter stream([&](const std::string &strChunk) {
+                nStreamed += strChunk.size();
+                if (!fStreamStarted) {
+                    req->WriteHeader("Content-Type", "application/json");
+                    req->StartChunkedReply(HTTP_OK);
+                    fStreamStarted = true;
+                    if (!req->WriteReplyChunk("{\"result\":")) {
+                        return false;
+                    }
+                }
+                return req->WriteReplyChunk(strChunk);
+            });
+            jreq.pStream = &stream;
+
             UniValue result = tableRPC.execute(config, jreq);
 
+            if (!stream.Empty()) {
+                stream.Flush();
+                // The rest of what JSONRPCReply writes.
+                req->WriteReplyChunk(",\"id\":" + jreq.id.write() +
+                                     ",\"jsonrpc\":\"2.0\"}\n");
+                req->EndChunkedReply();
+                rpcStats.AddReply(jreq.strMethod, nStreamed);
+                return true;
+            }
+
             // Send reply
             strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            rpcStats.AddReply(jreq.strMethod, strReply.size());
 
             // array of requests
         } else if (valRequest.isArray()) {
@@ -210,15 +284,120 @@ static bool HTTPReq_JSONRPC(Config &config, HTTPRequest *req,
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strReply);
     } catch (const UniValue &objError) {
+        if (fStreamStarted) {
+            CutStreamedReply(req, objError.write());
+            return false;
+        }
         JSONErrorReply(req, objError, jreq.id);
         return false;
     } catch (const std::exception &e) {
+        if (fStreamStarted) {
+            CutStreamedReply(req, e.what());
+            return false;
+        }
         JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
         return false;
     }
     return true;
 }
 
+static bool HTTPReq_Metrics(Config &config, HTTPRequest *req,
+                            const std::string &) {
+    if (req->GetRequestMethod() != HTTPRequest::GET) {
+        req->WriteReply(HTTP_BAD_METHOD, "/metrics handles only GET requests");
+        return false;
+    }
+    std::string strAuthUser;
+    if (!CheckRPCAuthorization(req, strAuthUser)) {
+        return false;
+    }
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, metrics.ToPrometheus());
+    return true;
+}
+
+bool PeekJSONRPCMethod(const std::string &strBody, std::string &strMethod) {
+    size_t pos = strBody.find_first_not_of(" \t\r\n");
+    if (pos == std::string::npos || strBody[pos] != '{') {
+        return false;
+    }
+    pos = strBody.find("\"method\"", pos);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    pos = strBody.find_first_not_of(" \t\r\n", pos + 8);
+    if (pos == std::string::npos || strBody[pos] != ':') {
+        return false;
+    }
+    pos = strBody.find_first_not_of(" \t\r\n", pos + 1);
+    if (pos == std::string::npos || strBody[pos] != '"') {
+        return false;
+    }
+    size_t end = strBody.find_first_of("\"\\", pos + 1);
+    if (end == std::string::npos || strBody[end] != '"') {
+        return false;
+    }
+    strMethod = strBody.substr(pos + 1, end - pos - 1);
+    return true;
+}
+
+/**
+ * Mining calls go to the mining lane, wallet calls to the wallet lane and
+ * calls that wait for events to the events lane, the rest and batches to the
+ * chain lane. Only the start of the body is
+ * looked at, a call whose method isn't found there is a chain call.
+ */
+static HTTPWorkClass JSONRPCWorkClass(HTTPRequest *req, const std::string &) {
+    HTTPWorkClass workClass;
+    std::string strMethod;
+    if (!PeekJSONRPCMethod(req->PeekBody(JSONRPC_PEEK_SIZE), strMethod)) {
+        return workClass;
+    }
+    const CRPCCommand *pcmd = tableRPC[strMethod];
+    if (!pcmd) {
+        return workClass;
+    }
+    if (pcmd->category == "mining") {
+        workClass.lane = HTTP_LANE_MINING;
+    } else if (pcmd->category == "wallet") {
+        workClass.lane = HTTP_LANE_WALLET;
+    } else if (pcmd->category == "events") {
+        workClass.lane = HTTP_LANE_EVENTS;
+    }
+    workClass.strMethod = strMethod;
+    return workClass;
+}
+
+static bool InitRPCMethodLimits() {
+    std::map<std::string, int> mapLimits;
+    for (const auto &limit : defaultMethodLimits) {
+        mapLimits[limit.method] = limit.nMax;
+    }
+    if (mapMultiArgs.count("-rpcmethodlimit")) {
+        for (const std::string &strLimit :
+             mapMultiArgs.at("-rpcmethodlimit")) {
+            size_t pos = strLimit.find(':');
+            int32_t nMax;
+            if (pos == std::string::npos ||
+                !ParseInt32(strLimit.substr(pos + 1), &nMax) || nMax < 0) {
+                uiInterface.ThreadSafeMessageBox(
+                    strprintf(_("Invalid -rpcmethodlimit=<method>:<n> '%s'"),
+                              strLimit),
+                    "", CClientUIInterface::MSG_ERROR);
+                return false;
+            }
+            mapLimits[strLimit.substr(0, pos)] = nMax;
+        }
+    }
+    for (const auto &limit : mapLimits) {
+        // A limit of 0 lifts the default one.
+        if (limit.second > 0) {
+            SetHTTPMethodLimit(limit.first, limit.second);
+        }
+    }
+    return true;
+}
+
 static bool InitRPCAuthentication() {
     if (GetArg("-rpcpassword", "") == "") {
         LogPrintf("No rpcpassword set - using random cookie authentication\n");
@@ -244,8 +423,12 @@ static bool InitRPCAuthentication() {
 bool StartHTTPRPC() {
     LogPrint("rpc", "Starting HTTP RPC server\n");
     if (!InitRPCAuthentication()) return false;
+    if (!InitRPCMethodLimits()) return false;
 
-    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC, JSONRPCWorkClass);
+    if (GetBoolArg("-rpcmetrics", DEFAULT_RPC_METRICS)) {
+        RegisterHTTPHandler("/metrics", true, HTTPReq_Metrics);
+    }
 
     assert(EventBase());
     httpRPCTimerInterface = new HTTPRPCTimerInterface(EventBase());
@@ -260,6 +443,7 @@ void InterruptHTTPRPC() {
 void StopHTTPRPC() {
     LogPrint("rpc", "Stopping HTTP RPC server\n");
     UnregisterHTTPHandler("/", true);
+    UnregisterHTTPHandler("/metrics", true);
     if (httpRPCTimerInterface) {
         RPCUnsetTimerInterface(httpRPCTimerInterface);
         delete httpRPCTimerInterface;
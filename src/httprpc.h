@@ -22,6 +22,13 @@ void InterruptHTTPRPC();
  */
 void StopHTTPRPC();
 
+/**
+ * Find the method of a single JSON-RPC call in the start of its body,
+ * without parsing all of it. Returns false for batches, and when the method
+ * isn't there or isn't a plain string.
+ */
+bool PeekJSONRPCMethod(const std::string &strBody, std::string &strMethod);
+
 /** Start HTTP REST subsystem.
  * Precondition; HTTP and RPC has been started.
  */
@@ -11,12 +11,14 @@
 #include "sync.h"
 #include "ui_interface.h"
 #include "util.h"
+#include "utilstrencodings.h"
 
 #include <signal.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
 #include <event2/buffer.h>
+#include <event2/bufferevent.h>
 #include <event2/event.h>
 #include <event2/http.h>
 #include <event2/keyvalq_struct.h>
@@ -33,7 +35,9 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <future>
+#include <map>
 
 /** Maximum size of http request (request line + headers) */
 static const size_t MAX_HEADERS_SIZE = 8192;
@@ -57,13 +61,27 @@ private:
 
 /** Simple work queue for distributing work over multiple threads.
  * Work items are simply callable objects.
+ *
+ * Items can name the method they run for. A method with a limit has at most
+ * that many items running at once, its other items wait in the queue while
+ * the threads go on with the items after them.
  */
 template <typename WorkItem> class WorkQueue {
 private:
+    /** A queued item and the method it runs for */
+    struct Entry {
+        std::unique_ptr<WorkItem> item;
+        std::string strMethod;
+    };
+
     /** Mutex protects entire object */
     std::mutex cs;
     std::condition_variable cond;
-    std::deque<std::unique_ptr<WorkItem>> queue;
+    std::deque<Entry> queue;
+    //! Most items of a method that may run at once
+    std::map<std::string, int> mapLimit;
+    //! Items of each limited method that are running
+    std::map<std::string, int> mapRunning;
     bool running;
     size_t maxDepth;
     int numThreads;
@@ -83,6 +101,18 @@ private:
         }
     };
 
+    /** The first item that may start now, or queue.end() */
+    typename std::deque<Entry>::iterator NextRunnable() {
+        for (auto it = queue.begin(); it != queue.end(); ++it) {
+            auto limit = mapLimit.find(it->strMethod);
+            if (limit == mapLimit.end() ||
+                mapRunning[it->strMethod] < limit->second) {
+                return it;
+            }
+        }
+        return queue.end();
+    }
+
 public:
     WorkQueue(size_t _maxDepth)
         : running(true), maxDepth(_maxDepth), numThreads(0) {}
@@ -90,30 +120,52 @@ public:
      * (call WaitExit)
      */
     ~WorkQueue() {}
-    /** Enqueue a work item */
-    bool Enqueue(WorkItem *item) {
+    /** Enqueue a work item, for strMethod if not empty */
+    bool Enqueue(WorkItem *item, const std::string &strMethod = "") {
         std::unique_lock<std::mutex> lock(cs);
         if (queue.size() >= maxDepth) {
             return false;
         }
-        queue.emplace_back(std::unique_ptr<WorkItem>(item));
+        Entry entry;
+        entry.item.reset(item);
+        entry.strMethod = strMethod;
+        queue.push_back(std::move(entry));
         cond.notify_one();
         return true;
     }
+    /** Let at most nMax items of strMethod run at once */
+    void SetLimit(const std::string &strMethod, int nMax) {
+        std::unique_lock<std::mutex> lock(cs);
+        mapLimit[strMethod] = std::max(nMax, 1);
+        cond.notify_all();
+    }
     /** Thread function */
     void Run() {
         ThreadCounter count(*this);
         while (true) {
-            std::unique_ptr<WorkItem> i;
+            Entry entry;
+            bool fLimited;
             {
                 std::unique_lock<std::mutex> lock(cs);
-                while (running && queue.empty())
+                typename std::deque<Entry>::iterator it;
+                while (running && (it = NextRunnable()) == queue.end())
                     cond.wait(lock);
                 if (!running) break;
-                i = std::move(queue.front());
-                queue.pop_front();
+                entry = std::move(*it);
+                queue.erase(it);
+                fLimited = mapLimit.count(entry.strMethod) > 0;
+                if (fLimited) {
+                    mapRunning[entry.strMethod]++;
+                }
+            }
+            (*entry.item)();
+            entry.item.reset();
+            if (fLimited) {
+                // Items of the method that waited may start now.
+                std::unique_lock<std::mutex> lock(cs);
+                mapRunning[entry.strMethod]--;
+                cond.notify_all();
             }
-            (*i)();
         }
     }
     /** Interrupt and exit loops */
@@ -139,11 +191,78 @@ public:
 struct HTTPPathHandler {
     HTTPPathHandler() {}
     HTTPPathHandler(std::string _prefix, bool _exactMatch,
-                    HTTPRequestHandler _handler)
-        : prefix(_prefix), exactMatch(_exactMatch), handler(_handler) {}
+                    HTTPRequestHandler _handler,
+                    HTTPRequestClassifier _classifier)
+        : prefix(_prefix), exactMatch(_exactMatch), handler(_handler),
+          classifier(_classifier) {}
     std::string prefix;
     bool exactMatch;
     HTTPRequestHandler handler;
+    HTTPRequestClassifier classifier;
+};
+
+/** A lane of the work queue, and how many threads it gets */
+struct HTTPLaneInfo {
+    const char *name;
+    const char *threadsArg;
+    int defaultThreads;
+};
+
+static const HTTPLaneInfo httpLanes[HTTP_LANE_COUNT] = {
+    {"chain", "-rpcthreads", DEFAULT_HTTP_THREADS},
+    {"mining", "-rpcminingthreads", DEFAULT_HTTP_MINING_THREADS},
+    {"wallet", "-rpcwalletthreads", DEFAULT_HTTP_WALLET_THREADS},
+    {"events", "-rpceventthreads", DEFAULT_HTTP_EVENT_THREADS},
+};
+
+/**
+ * State of a chunked reply, shared by the worker thread writing it and the
+ * callbacks of the main http thread sending it.
+ */
+struct HTTPChunkedReply {
+    std::mutex cs;
+    std::condition_variable cond;
+    //! Bytes of chunks handed to the main http thread, not on the connection
+    //! yet
+    size_t nQueued;
+    //! Bytes on the connection that aren't sent yet
+    size_t nPending;
+    //! Whether the connection is gone
+    bool fClosed;
+
+    HTTPChunkedReply() : nQueued(0), nPending(0), fClosed(false) {}
+
+    void SetPending(size_t nChunk, size_t nPendingIn) {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            nQueued -= nChunk;
+            nPending = nPendingIn;
+        }
+        cond.notify_all();
+    }
+
+    void SetClosed() {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            fClosed = true;
+        }
+        cond.notify_all();
+    }
+};
+
+/**
+ * State of a connection that outlives its requests, for keep-alive
+ * connections that carry many of them. Created on the main http thread with
+ * the first request, and dropped there when the connection closes.
+ */
+struct HTTPConnection {
+    std::mutex cs;
+    //! The Authorization header of a request that was authorized, and the
+    //! user it was authorized as
+    std::string strAuth;
+    std::string strAuthUser;
+    //! The chunked reply being written, only used on the main http thread
+    std::shared_ptr<HTTPChunkedReply> chunkedReply;
 };
 
 /** HTTP module state */
@@ -154,10 +273,14 @@ static struct event_base *eventBase = 0;
 struct evhttp *eventHTTP = 0;
 //! List of subnets to allow RPC connections from
 static std::vector<CSubNet> rpc_allow_subnets;
-//! Work queue for handling longer requests off the event loop thread
-static WorkQueue<HTTPClosure> *workQueue = 0;
+//! Work queues for handling longer requests off the event loop thread, one
+//! for each lane
+static WorkQueue<HTTPClosure> *workQueues[HTTP_LANE_COUNT] = {};
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
+//! Open connections, only used on the main http thread
+static std::map<struct evhttp_connection *, std::shared_ptr<HTTPConnection>>
+    httpConnections;
 //! Bound listening sockets
 std::vector<evhttp_bound_socket *> boundSockets;
 
@@ -225,11 +348,80 @@ static std::string RequestMethodString(HTTPRequest::RequestMethod m) {
     }
 }
 
+/** The connection closed, drop its state */
+static void http_connection_close_cb(struct evhttp_connection *evcon, void *) {
+    auto it = httpConnections.find(evcon);
+    if (it == httpConnections.end()) {
+        return;
+    }
+    if (it->second->chunkedReply) {
+        it->second->chunkedReply->SetClosed();
+    }
+    httpConnections.erase(it);
+}
+
+/** The state of the connection of req, new for its first request */
+static std::shared_ptr<HTTPConnection>
+GetHTTPConnection(struct evhttp_request *req) {
+    struct evhttp_connection *evcon = evhttp_request_get_connection(req);
+    if (!evcon) {
+        return nullptr;
+    }
+    std::shared_ptr<HTTPConnection> &connection = httpConnections[evcon];
+    if (!connection) {
+        connection = std::make_shared<HTTPConnection>();
+    }
+    // Set every time, in case the connection reuses the address of one whose
+    // state wasn't dropped. Its state can only hold credentials that are
+    // valid anyway.
+    evhttp_connection_set_closecb(evcon, http_connection_close_cb, nullptr);
+    return connection;
+}
+
+/**
+ * Whether reading is stopped while a request is handled. libevent 2.1.6 up
+ * to 2.2.0 may take what the client sends meanwhile, the next request of a
+ * pipeline, for the connection closing, and free the request that is
+ * handled. The next request waits in the connection's buffer instead, and is
+ * read after the reply is sent.
+ */
+static bool HTTPPauseReading() {
+#if LIBEVENT_VERSION_NUMBER >= 0x02010600
+    return event_get_version_number() >= 0x02010600 &&
+           event_get_version_number() < 0x02020001;
+#else
+    return false;
+#endif
+}
+
+/** Read from the connection of req again, on the main http thread */
+static void HTTPResumeReading(struct evhttp_request *req) {
+#if LIBEVENT_VERSION_NUMBER >= 0x02010600
+    if (!HTTPPauseReading()) {
+        return;
+    }
+    struct evhttp_connection *evcon = evhttp_request_get_connection(req);
+    if (evcon) {
+        bufferevent_enable(evhttp_connection_get_bufferevent(evcon),
+                           EV_READ | EV_WRITE);
+    }
+#endif
+}
+
 /** HTTP request callback */
 static void http_request_cb(struct evhttp_request *req, void *arg) {
     Config &config = *reinterpret_cast<Config *>(arg);
 
-    std::unique_ptr<HTTPRequest> hreq(new HTTPRequest(req));
+#if LIBEVENT_VERSION_NUMBER >= 0x02010600
+    struct evhttp_connection *evcon = evhttp_request_get_connection(req);
+    if (evcon && HTTPPauseReading()) {
+        bufferevent_disable(evhttp_connection_get_bufferevent(evcon),
+                            EV_READ);
+    }
+#endif
+
+    std::unique_ptr<HTTPRequest> hreq(
+        new HTTPRequest(req, GetHTTPConnection(req)));
 
     LogPrint("http", "Received a %s request for %s from %s\n",
              RequestMethodString(hreq->GetRequestMethod()), hreq->GetURI(),
@@ -267,16 +459,22 @@ static void http_request_cb(struct evhttp_request *req, void *arg) {
 
     // Dispatch to worker thread.
     if (i != iend) {
+        HTTPWorkClass workClass;
+        if (i->classifier) {
+            workClass = i->classifier(hreq.get(), path);
+        }
         std::unique_ptr<HTTPWorkItem> item(
             new HTTPWorkItem(config, std::move(hreq), path, i->handler));
+        WorkQueue<HTTPClosure> *workQueue = workQueues[workClass.lane];
         assert(workQueue);
-        if (workQueue->Enqueue(item.get())) {
+        if (workQueue->Enqueue(item.get(), workClass.strMethod)) {
             /* if true, queue took ownership */
             item.release();
         } else {
             LogPrintf("WARNING: request rejected because http work queue depth "
-                      "exceeded, it can be increased with the -rpcworkqueue= "
-                      "setting\n");
+                      "exceeded in the %s lane, it can be increased with the "
+                      "-rpcworkqueue= setting\n",
+                      httpLanes[workClass.lane].name);
             item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
         }
     } else {
@@ -350,8 +548,9 @@ static bool HTTPBindAddresses(struct evhttp *http) {
 }
 
 /** Simple wrapper to set thread name and run work queue */
-static void HTTPWorkQueueRun(WorkQueue<HTTPClosure> *queue) {
-    RenameThread("bitcoin-httpworker");
+static void HTTPWorkQueueRun(WorkQueue<HTTPClosure> *queue,
+                             const std::string &strLane) {
+    RenameThread(("bitcoin-httpworker-" + strLane).c_str());
     queue->Run();
 }
 
@@ -430,9 +629,11 @@ bool InitHTTPServer(Config &config) {
     LogPrint("http", "Initialized HTTP server\n");
     int workQueueDepth =
         std::max((long)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
-    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
+    LogPrintf("HTTP: creating work queues of depth %d\n", workQueueDepth);
 
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
+    for (WorkQueue<HTTPClosure> *&workQueue : workQueues) {
+        workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
+    }
     eventBase = base;
     eventHTTP = http;
     return true;
@@ -443,16 +644,21 @@ std::future<bool> threadResult;
 
 bool StartHTTPServer() {
     LogPrint("http", "Starting HTTP server\n");
-    int rpcThreads =
-        std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
-    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
     std::packaged_task<bool(event_base *, evhttp *)> task(ThreadHTTP);
     threadResult = task.get_future();
     threadHTTP = std::thread(std::move(task), eventBase, eventHTTP);
 
-    for (int i = 0; i < rpcThreads; i++) {
-        std::thread rpc_worker(HTTPWorkQueueRun, workQueue);
-        rpc_worker.detach();
+    for (int lane = 0; lane < HTTP_LANE_COUNT; lane++) {
+        const HTTPLaneInfo &info = httpLanes[lane];
+        int rpcThreads = std::max(
+            (long)GetArg(info.threadsArg, info.defaultThreads), 1L);
+        LogPrintf("HTTP: starting %d worker threads for the %s lane\n",
+                  rpcThreads, info.name);
+        for (int i = 0; i < rpcThreads; i++) {
+            std::thread rpc_worker(HTTPWorkQueueRun, workQueues[lane],
+                                   std::string(info.name));
+            rpc_worker.detach();
+        }
     }
     return true;
 }
@@ -467,15 +673,20 @@ void InterruptHTTPServer() {
         // Reject requests on current connections
         evhttp_set_gencb(eventHTTP, http_reject_request_cb, nullptr);
     }
-    if (workQueue) workQueue->Interrupt();
+    for (WorkQueue<HTTPClosure> *workQueue : workQueues) {
+        if (workQueue) workQueue->Interrupt();
+    }
 }
 
 void StopHTTPServer() {
     LogPrint("http", "Stopping HTTP server\n");
-    if (workQueue) {
-        LogPrint("http", "Waiting for HTTP worker threads to exit\n");
-        workQueue->WaitExit();
-        delete workQueue;
+    LogPrint("http", "Waiting for HTTP worker threads to exit\n");
+    for (WorkQueue<HTTPClosure> *&workQueue : workQueues) {
+        if (workQueue) {
+            workQueue->WaitExit();
+            delete workQueue;
+            workQueue = 0;
+        }
     }
     if (eventBase) {
         LogPrint("http", "Waiting for HTTP event thread to exit\n");
@@ -503,6 +714,7 @@ void StopHTTPServer() {
         event_base_free(eventBase);
         eventBase = 0;
     }
+    httpConnections.clear();
     LogPrint("http", "Stopped HTTP server\n");
 }
 
@@ -535,10 +747,15 @@ void HTTPEvent::trigger(struct timeval *tv) {
         evtimer_add(ev, tv);
     }
 }
-HTTPRequest::HTTPRequest(struct evhttp_request *_req)
-    : req(_req), replySent(false) {}
+HTTPRequest::HTTPRequest(struct evhttp_request *_req,
+                         std::shared_ptr<HTTPConnection> _connection)
+    : req(_req), replySent(false), connection(std::move(_connection)) {}
 HTTPRequest::~HTTPRequest() {
-    if (!replySent) {
+    if (chunkedReply) {
+        // Whatever went wrong, the status went out already.
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        EndChunkedReply();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -576,6 +793,16 @@ std::string HTTPRequest::ReadBody() {
     return rv;
 }
 
+std::string HTTPRequest::PeekBody(size_t nMax) {
+    struct evbuffer *buf = evhttp_request_get_input_buffer(req);
+    if (!buf) return "";
+    std::string rv(std::min(evbuffer_get_length(buf), nMax), '\0');
+    if (rv.empty() || evbuffer_copyout(buf, &rv[0], rv.size()) < 0) {
+        return "";
+    }
+    return rv;
+}
+
 void HTTPRequest::WriteHeader(const std::string &hdr,
                               const std::string &value) {
     struct evkeyvalq *headers = evhttp_request_get_output_headers(req);
@@ -593,16 +820,140 @@ void HTTPRequest::WriteReply(int nStatus, const std::string &strReply) {
     struct evbuffer *evb = evhttp_request_get_output_buffer(req);
     assert(evb);
     evbuffer_add(evb, strReply.data(), strReply.size());
-    HTTPEvent *ev =
-        new HTTPEvent(eventBase, true, std::bind(evhttp_send_reply, req,
-                                                 nStatus, (const char *)nullptr,
-                                                 (struct evbuffer *)nullptr));
+    struct evhttp_request *r = req;
+    HTTPEvent *ev = new HTTPEvent(eventBase, true, [r, nStatus]() {
+        HTTPResumeReading(r);
+        evhttp_send_reply(r, nStatus, nullptr, nullptr);
+    });
     ev->trigger(0);
     replySent = true;
     // transferred back to main thread.
     req = 0;
 }
 
+/** The connection sent everything that was queued on it */
+static void http_chunks_sent_cb(struct evhttp_connection *, void *arg) {
+    static_cast<HTTPChunkedReply *>(arg)->SetPending(0, 0);
+}
+
+/**
+ * The chunked reply functions send events to the main http thread like
+ * WriteReply, the events run in order. The reply is on its connection until
+ * the event that ends it, which also replaces the sent callback, so the shared
+ * state outlives the callbacks.
+ */
+void HTTPRequest::StartChunkedReply(int nStatus) {
+    assert(!replySent && req && !chunkedReply);
+    chunkedReply = std::make_shared<HTTPChunkedReply>();
+    std::shared_ptr<HTTPChunkedReply> reply = chunkedReply;
+    std::shared_ptr<HTTPConnection> conn = connection;
+    struct evhttp_request *r = req;
+    HTTPEvent *ev = new HTTPEvent(eventBase, true, [r, nStatus, reply, conn]() {
+        if (!conn || !evhttp_request_get_connection(r)) {
+            reply->SetClosed();
+            return;
+        }
+        conn->chunkedReply = reply;
+        evhttp_send_reply_start(r, nStatus, nullptr);
+    });
+    ev->trigger(0);
+}
+
+bool HTTPRequest::WriteReplyChunk(const std::string &strChunk) {
+    assert(req && chunkedReply);
+    std::shared_ptr<HTTPChunkedReply> reply = chunkedReply;
+    {
+        std::unique_lock<std::mutex> lock(reply->cs);
+        reply->cond.wait(lock, [&reply] {
+            return reply->fClosed ||
+                   reply->nQueued + reply->nPending <
+                       HTTP_MAX_PENDING_CHUNKS_SIZE;
+        });
+        if (reply->fClosed) {
+            return false;
+        }
+        if (strChunk.empty()) {
+            // An empty chunk would end the reply.
+            return true;
+        }
+        reply->nQueued += strChunk.size();
+    }
+
+    struct evbuffer *evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    const size_t nChunk = strChunk.size();
+    struct evhttp_request *r = req;
+    HTTPEvent *ev = new HTTPEvent(eventBase, true, [r, evb, nChunk, reply]() {
+        struct evhttp_connection *evcon = evhttp_request_get_connection(r);
+        if (!evcon) {
+            evbuffer_free(evb);
+            reply->SetClosed();
+            return;
+        }
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+        evhttp_send_reply_chunk_with_cb(r, evb, http_chunks_sent_cb,
+                                        reply.get());
+        evbuffer_free(evb);
+        struct bufferevent *bev = evhttp_connection_get_bufferevent(evcon);
+        reply->SetPending(nChunk,
+                          evbuffer_get_length(bufferevent_get_output(bev)));
+#else
+        // No way to learn when the chunk is sent, the connection buffers
+        // whatever the client doesn't read yet.
+        evhttp_send_reply_chunk(r, evb);
+        evbuffer_free(evb);
+        reply->SetPending(nChunk, 0);
+#endif
+    });
+    ev->trigger(0);
+    return true;
+}
+
+void HTTPRequest::EndChunkedReply() {
+    assert(req && chunkedReply);
+    std::shared_ptr<HTTPConnection> conn = connection;
+    struct evhttp_request *r = req;
+    HTTPEvent *ev = new HTTPEvent(eventBase, true, [r, conn]() {
+        if (conn) {
+            // The connection may stay open for the next request.
+            conn->chunkedReply.reset();
+        }
+        HTTPResumeReading(r);
+        // This replaces the sent callback too.
+        evhttp_send_reply_end(r);
+    });
+    ev->trigger(0);
+    chunkedReply.reset();
+    replySent = true;
+    // transferred back to main thread.
+    req = 0;
+}
+
+bool HTTPRequest::GetConnectionAuth(const std::string &strAuth,
+                                    std::string &strUserOut) {
+    if (!connection) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(connection->cs);
+    if (connection->strAuth.empty() ||
+        !TimingResistantEqual(strAuth, connection->strAuth)) {
+        return false;
+    }
+    strUserOut = connection->strAuthUser;
+    return true;
+}
+
+void HTTPRequest::SetConnectionAuth(const std::string &strAuth,
+                                    const std::string &strUser) {
+    if (!connection) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(connection->cs);
+    connection->strAuth = strAuth;
+    connection->strAuthUser = strUser;
+}
+
 CService HTTPRequest::GetPeer() {
     evhttp_connection *con = evhttp_request_get_connection(req);
     CService peer;
@@ -641,10 +992,20 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod() {
 }
 
 void RegisterHTTPHandler(const std::string &prefix, bool exactMatch,
-                         const HTTPRequestHandler &handler) {
+                         const HTTPRequestHandler &handler,
+                         const HTTPRequestClassifier &classifier) {
     LogPrint("http", "Registering HTTP handler for %s (exactmatch %d)\n",
              prefix, exactMatch);
-    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+    pathHandlers.push_back(
+        HTTPPathHandler(prefix, exactMatch, handler, classifier));
+}
+
+void SetHTTPMethodLimit(const std::string &strMethod, int nMax) {
+    LogPrint("http", "Limiting %s to %d requests at once\n", strMethod, nMax);
+    for (WorkQueue<HTTPClosure> *workQueue : workQueues) {
+        assert(workQueue);
+        workQueue->SetLimit(strMethod, nMax);
+    }
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch) {
@@ -5,13 +5,20 @@
 #ifndef BITCOIN_HTTPSERVER_H
 #define BITCOIN_HTTPSERVER_H
 
+#include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <string>
 
 static const int DEFAULT_HTTP_THREADS = 4;
+static const int DEFAULT_HTTP_MINING_THREADS = 2;
+static const int DEFAULT_HTTP_WALLET_THREADS = 2;
+static const int DEFAULT_HTTP_EVENT_THREADS = 8;
 static const int DEFAULT_HTTP_WORKQUEUE = 16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT = 30;
+/** Bytes of a chunked reply that may wait to be sent before its writer waits */
+static const size_t HTTP_MAX_PENDING_CHUNKS_SIZE = 256 * 1024;
 
 struct evhttp_request;
 struct event_base;
@@ -19,6 +26,8 @@ struct event_base;
 class Config;
 class CService;
 class HTTPRequest;
+struct HTTPChunkedReply;
+struct HTTPConnection;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -38,15 +47,56 @@ void StopHTTPServer();
 typedef std::function<bool(Config &config, HTTPRequest *req,
                            const std::string &)>
     HTTPRequestHandler;
+
+/**
+ * Lanes of the work queue. Each lane has a queue of its own, of depth
+ * -rpcworkqueue, and threads of its own, so slow requests in one lane don't
+ * hold up those in another.
+ */
+enum HTTPWorkLane {
+    //! Read only chain queries, REST and whatever isn't in another lane
+    HTTP_LANE_CHAIN,
+    HTTP_LANE_MINING,
+    HTTP_LANE_WALLET,
+    //! Calls that wait for events, each holds its thread while it waits
+    HTTP_LANE_EVENTS,
+    HTTP_LANE_COUNT
+};
+
+/** Where a request is queued */
+struct HTTPWorkClass {
+    HTTPWorkClass() : lane(HTTP_LANE_CHAIN) {}
+    HTTPWorkLane lane;
+    //! The method the limits of SetHTTPMethodLimit look up, if any
+    std::string strMethod;
+};
+
+/**
+ * Picks the work class of a request to a certain HTTP path. Runs on the
+ * event thread before the request is queued, so it should be quick, and it
+ * must leave the body for the handler.
+ */
+typedef std::function<HTTPWorkClass(HTTPRequest *req, const std::string &)>
+    HTTPRequestClassifier;
+
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
- * be invoked.
+ * be invoked. Without a classifier its requests go to the chain lane.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch,
-                         const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(
+    const std::string &prefix, bool exactMatch,
+    const HTTPRequestHandler &handler,
+    const HTTPRequestClassifier &classifier = HTTPRequestClassifier());
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
+/**
+ * Let at most nMax requests classified as strMethod run at once. The others
+ * wait in their queue while the lane's other threads go on with the requests
+ * behind them. Call this between InitHTTPServer and StartHTTPServer.
+ */
+void SetHTTPMethodLimit(const std::string &strMethod, int nMax);
+
 /** Return evhttp event base. This can be used by submodules to
  * queue timers or custom events.
  */
@@ -59,9 +109,14 @@ class HTTPRequest {
 private:
     struct evhttp_request *req;
     bool replySent;
+    //! Set while a chunked reply is being written
+    std::shared_ptr<HTTPChunkedReply> chunkedReply;
+    //! The connection the request came on, with its other requests
+    std::shared_ptr<HTTPConnection> connection;
 
 public:
-    HTTPRequest(struct evhttp_request *req);
+    HTTPRequest(struct evhttp_request *req,
+                std::shared_ptr<HTTPConnection> connection = nullptr);
     ~HTTPRequest();
 
     enum RequestMethod { UNKNOWN, GET, POST, HEAD, PUT };
@@ -70,6 +125,19 @@ public:
      */
     std::string GetURI();
 
+    /**
+     * Whether an earlier request on the same connection was authorized with
+     * the Authorization header strAuth, and the user it was authorized as.
+     * Saves checking the credentials of every request on a keep-alive
+     * connection again.
+     */
+    bool GetConnectionAuth(const std::string &strAuth,
+                           std::string &strUserOut);
+
+    /** Remember that strAuth authorized strUser on this connection */
+    void SetConnectionAuth(const std::string &strAuth,
+                           const std::string &strUser);
+
     /** Get CService (address:ip) for the origin of the http request.
      */
     CService GetPeer();
@@ -92,6 +160,11 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * The first nMax bytes of the request body, without consuming them.
+     */
+    std::string PeekBody(size_t nMax);
+
     /**
      * Write output header.
      *
@@ -110,6 +183,31 @@ public:
      * this.
      */
     void WriteReply(int nStatus, const std::string &strReply = "");
+
+    /**
+     * Start a reply whose body follows in chunks, with chunked transfer
+     * encoding, for bodies too big to hold in memory at once. Write the body
+     * with WriteReplyChunk and finish with EndChunkedReply, instead of
+     * WriteReply.
+     *
+     * @note Write the headers before, the status can't change anymore.
+     */
+    void StartChunkedReply(int nStatus);
+
+    /**
+     * Send the next chunk of the body. Waits while more than
+     * HTTP_MAX_PENDING_CHUNKS_SIZE of what came before waits to be sent,
+     * memory doesn't grow with the body when the client reads slowly.
+     * Returns false once the connection is gone, there is no use in writing
+     * more then.
+     */
+    bool WriteReplyChunk(const std::string &strChunk);
+
+    /**
+     * Finish a chunked reply. Like WriteReply, this gives the request back to
+     * the main thread.
+     */
+    void EndChunkedReply();
 };
 
 /** Event handler closure.
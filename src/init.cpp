@@ -9,32 +9,51 @@
 
 #include "init.h"
 
+#include "addressindex.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockcompress.h"
+#include "blockfilterindex.h"
+#include "blockstatsindex.h"
+#include "blockpruner.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "config.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
+#include "ethash/ethash.h"
+#include "ethash/sha3.h"
+#include "ethashcache.h"
+#include "ethashproof.h"
 #include "httprpc.h"
 #include "httpserver.h"
 #include "key.h"
+#include "metrics.h"
 #include "miner.h"
 #include "net.h"
 #include "net_processing.h"
 #include "netbase.h"
 #include "policy/policy.h"
+#include "pow.h"
+#include "replaystats.h"
+#include "rpc/events.h"
 #include "rpc/register.h"
 #include "rpc/server.h"
+#include "rpc/stats.h"
 #include "scheduler.h"
 #include "script/scriptcache.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
+#include "stratum.h"
 #include "timedata.h"
 #include "torcontrol.h"
 #include "txdb.h"
+#include "txindex.h"
 #include "txmempool.h"
+#include "txreconciliation.h"
+#include "txskeleton.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
@@ -48,6 +67,7 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <future>
 #include <memory>
 
 #ifndef WIN32
@@ -172,6 +192,7 @@ void Interrupt(boost::thread_group &threadGroup) {
     InterruptRPC();
     InterruptREST();
     InterruptTorControl();
+    InterruptStratumServer();
     if (g_connman) g_connman->Interrupt();
     threadGroup.interrupt_all();
 }
@@ -189,10 +210,15 @@ void Shutdown() {
     RenameThread("bitcoin-shutoff");
     mempool.AddTransactionsUpdated(1);
 
+    // Once the scheduler thread has stopped, deliver what it left over, also
+    // to the RPC calls waiting for it.
+    GetMainSignals().FlushBackgroundCallbacks();
+
     StopHTTPRPC();
     StopREST();
     StopRPC();
     StopHTTPServer();
+    SetRPCStatsScheduler(nullptr);
 #ifdef ENABLE_WALLET
     if (pwalletMain) pwalletMain->Flush(false);
 #endif
@@ -200,8 +226,15 @@ void Shutdown() {
     UnregisterValidationInterface(peerLogic.get());
     peerLogic.reset();
     g_connman.reset();
+    g_txindex.reset();
+    g_addressindex.reset();
+    g_blockfilterindex.reset();
+    g_blockstatsindex.reset();
+    g_blockpruner.reset();
+    g_ethashprover.reset();
 
     StopTorControl();
+    StopStratumServer();
     UnregisterNodeSignals(GetNodeSignals());
     if (fDumpMempoolLater) DumpMempool();
 
@@ -218,20 +251,30 @@ void Shutdown() {
         fFeeEstimatesInitialized = false;
     }
 
+    // Before the flush, which empties the coins cache.
+    DumpHotCoins();
+
     {
         LOCK(cs_main);
         if (pcoinsTip != nullptr) {
             FlushStateToDisk();
+            WriteBlockIndexSnapshot();
+            WriteVerifiedBlocks();
         }
+        StopReplayStats();
         delete pcoinsTip;
         pcoinsTip = nullptr;
         delete pcoinscatcher;
         pcoinscatcher = nullptr;
+        delete pcoinsWriter;
+        pcoinsWriter = nullptr;
         delete pcoinsdbview;
         pcoinsdbview = nullptr;
         delete pblocktree;
         pblocktree = nullptr;
     }
+    GetMainSignals().FlushBackgroundCallbacks();
+    GetMainSignals().UnregisterBackgroundSignalScheduler();
 #ifdef ENABLE_WALLET
     if (pwalletMain) pwalletMain->Flush(true);
 #endif
@@ -259,6 +302,7 @@ void Shutdown() {
     globalVerifyHandle.reset();
     ECC_Stop();
     LogPrintf("%s: done\n", __func__);
+    StopLogThread();
 }
 
 /**
@@ -283,11 +327,13 @@ static bool Bind(CConnman &connman, const CService &addr, unsigned int flags) {
 }
 void OnRPCStarted() {
     uiInterface.NotifyBlockTip.connect(&RPCNotifyBlockChange);
+    StartRPCEvents();
 }
 
 void OnRPCStopped() {
     uiInterface.NotifyBlockTip.disconnect(&RPCNotifyBlockChange);
     RPCNotifyBlockChange(false, nullptr);
+    StopRPCEvents();
     cvBlockChange.notify_all();
     LogPrint("rpc", "RPC stopped.\n");
 }
@@ -319,6 +365,12 @@ std::string HelpMessage(HelpMessageMode mode) {
     strUsage += HelpMessageOpt("-blocknotify=<cmd>",
                                _("Execute command when the best block changes "
                                  "(%s in cmd is replaced by block hash)"));
+    strUsage += HelpMessageOpt(
+        "-blockcompression",
+        strprintf(_("Compress blocks written to the blk*.dat files. Blocks "
+                    "already on disk stay as they are, both kinds can be read "
+                    "either way (default: %d)"),
+                  DEFAULT_BLOCK_COMPRESSION));
     if (showDebug)
         strUsage += HelpMessageOpt(
             "-blocksonly",
@@ -357,6 +409,12 @@ std::string HelpMessage(HelpMessageMode mode) {
             "-feefilter", strprintf("Tell other nodes to filter invs to us by "
                                     "our mempool min fee (default: %d)",
                                     DEFAULT_FEEFILTER));
+    strUsage += HelpMessageOpt(
+        "-hotcoins=<n>",
+        strprintf(_("Save the <n> most recently used coins of the cache on "
+                    "shutdown and read them back in the background on "
+                    "startup, 0 to disable (default: %d)"),
+                  DEFAULT_HOT_COINS));
     strUsage += HelpMessageOpt(
         "-loadblock=<file>",
         _("Imports blocks from external blk000??.dat file on startup"));
@@ -364,10 +422,20 @@ std::string HelpMessage(HelpMessageMode mode) {
         "-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable "
                                         "transactions in memory (default: %u)"),
                                       DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt(
+        "-maxorphantxsize=<n>",
+        strprintf(_("Keep unconnectable transactions, content included, below "
+                    "<n> megabytes (default: %u)"),
+                  DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE));
     strUsage += HelpMessageOpt("-maxmempool=<n>",
                                strprintf(_("Keep the transaction memory pool "
                                            "below <n> megabytes (default: %u)"),
                                          DEFAULT_MAX_MEMPOOL_SIZE));
+    strUsage += HelpMessageOpt(
+        "-maxmempoolcontent=<n>",
+        strprintf(_("Keep the content carried by memory pool transactions "
+                    "below <n> megabytes (default: %u)"),
+                  DEFAULT_MAX_MEMPOOL_CONTENT_SIZE));
     strUsage +=
         HelpMessageOpt("-mempoolexpiry=<n>",
                        strprintf(_("Do not keep transactions in the mempool "
@@ -396,28 +464,80 @@ std::string HelpMessage(HelpMessageMode mode) {
               "old blocks. This allows the pruneblockchain RPC to be called to "
               "delete specific blocks, and enables automatic pruning of old "
               "blocks if a target size in MiB is provided. This mode is "
-              "incompatible with -txindex and -rescan. "
+              "incompatible with -txindex, -addressindex and -rescan. "
               "Warning: Reverting this setting requires re-downloading the "
               "entire blockchain. "
               "(default: 0 = disable pruning blocks, 1 = allow manual pruning "
               "via RPC, >%u = automatically prune block files to stay under "
               "the specified target size in MiB)"),
             MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+    strUsage += HelpMessageOpt(
+        "-prunedepth=<n>",
+        strprintf(_("In prune mode, keep the blocks and undo data of the last "
+                    "<n> blocks, for reorganizations that deep (minimum and "
+                    "default: %u)"),
+                  MIN_BLOCKS_TO_KEEP));
+    strUsage += HelpMessageOpt(
+        "-contentarchive",
+        strprintf(_("In prune mode, keep the contents of the unspent outputs "
+                    "of pruned blocks, to still answer content lookups "
+                    "(default: %d)"),
+                  DEFAULT_CONTENTARCHIVE));
     strUsage += HelpMessageOpt(
         "-reindex-chainstate",
         _("Rebuild chain state from the currently indexed blocks"));
     strUsage +=
         HelpMessageOpt("-reindex", _("Rebuild chain state and block index from "
                                      "the blk*.dat files on disk"));
+    strUsage += HelpMessageOpt(
+        "-schedulerthreads=<n>",
+        strprintf(_("Set the number of threads to run background tasks, such "
+                    "as address dumps and wallet notifications (1 to %d, "
+                    "default: %d)"),
+                  MAX_SCHEDULER_THREADS, DEFAULT_SCHEDULER_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt(
         "-sysperms",
         _("Create new files with system default permissions, instead of umask "
           "077 (only effective with disabled wallet functionality)"));
 #endif
+    strUsage += HelpMessageOpt(
+        "-addressindex",
+        strprintf(_("Maintain an index of the outputs and history of each "
+                    "address, used by the getaddressbalance, getaddressutxos "
+                    "and getaddresshistory rpc calls. It is built in the "
+                    "background, and dropped when this is turned off "
+                    "(default: %d)"),
+                  DEFAULT_ADDRESSINDEX));
+    strUsage += HelpMessageOpt(
+        "-blockfilterindex",
+        strprintf(_("Maintain the BIP 158 filters of the blocks, which speed "
+                    "up wallet rescans. It is built in the background, and "
+                    "dropped when this is turned off (default: %d)"),
+                  DEFAULT_BLOCKFILTERINDEX));
+    strUsage += HelpMessageOpt(
+        "-blockstatsindex",
+        strprintf(_("Maintain the statistics of the blocks, used by the "
+                    "getblockstats rpc call. It is built in the background, "
+                    "and dropped when this is turned off (default: %d)"),
+                  DEFAULT_BLOCKSTATSINDEX));
+    strUsage += HelpMessageOpt(
+        "-powproofs",
+        strprintf(_("Build the ethash DAG of the current epoch in the "
+                    "background and commit to it, to serve proofs of work of "
+                    "headers to light clients with getpowproof (default: %d)"),
+                  DEFAULT_POW_PROOFS));
+    strUsage += HelpMessageOpt(
+        "-depositindex",
+        strprintf(_("Maintain an index of the locked deposit outputs by "
+                    "unlock height, used by the getdepositunlocks rpc call "
+                    "(default: %d)"),
+                  DEFAULT_DEPOSITINDEX));
     strUsage += HelpMessageOpt(
         "-txindex", strprintf(_("Maintain a full transaction index, used by "
-                                "the getrawtransaction rpc call (default: %d)"),
+                                "the getrawtransaction rpc call. It is built "
+                                "in the background, and dropped when this is "
+                                "turned off (default: %d)"),
                               DEFAULT_TXINDEX));
     strUsage += HelpMessageOpt(
         "-usecashaddr", _("Use Cash Address for destination encoding instead "
@@ -454,6 +574,13 @@ std::string HelpMessage(HelpMessageMode mode) {
                       "addresses (default: 1 unless -connect/-noconnect)"));
     strUsage += HelpMessageOpt("-externalip=<ip>",
                                _("Specify your own public address"));
+    strUsage += HelpMessageOpt(
+        "-fastblockrelay",
+        strprintf(_("Offer compact blocks to peers, and relay new blocks that "
+                    "build on the tip to high-bandwidth compact block peers "
+                    "once their proof of work and transactions are checked, "
+                    "before connecting them (default: %d)"),
+                  DEFAULT_FAST_BLOCK_RELAY));
     strUsage += HelpMessageOpt(
         "-forcednsseed",
         strprintf(
@@ -470,6 +597,11 @@ std::string HelpMessage(HelpMessageMode mode) {
         "-maxconnections=<n>",
         strprintf(_("Maintain at most <n> connections to peers (default: %u)"),
                   DEFAULT_MAX_PEER_CONNECTIONS));
+    strUsage += HelpMessageOpt(
+        "-msghandlerthreads=<n>",
+        strprintf(_("Set the number of peer message handler threads (1 to %d, "
+                    "default: %d)"),
+                  MAX_MSGHANDLER_THREADS, DEFAULT_MSGHANDLER_THREADS));
     strUsage +=
         HelpMessageOpt("-maxreceivebuffer=<n>",
                        strprintf(_("Maximum per-connection receive buffer, "
@@ -502,6 +634,11 @@ std::string HelpMessage(HelpMessageMode mode) {
         strprintf(_("Support filtering of blocks and transaction with bloom "
                     "filters (default: %d)"),
                   DEFAULT_PEERBLOOMFILTERS));
+    strUsage += HelpMessageOpt(
+        "-peerblockfilters",
+        strprintf(_("Serve BIP 157 block filters to peers, needs "
+                    "-blockfilterindex (default: %d)"),
+                  DEFAULT_PEERBLOCKFILTERS));
     strUsage += HelpMessageOpt(
         "-port=<port>",
         strprintf(
@@ -528,6 +665,18 @@ std::string HelpMessage(HelpMessageMode mode) {
                                          DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>",
                                _("Tor control port password (default: empty)"));
+    strUsage += HelpMessageOpt(
+        "-txreconciliation",
+        strprintf(_("Announce transactions to peers that support it by set "
+                    "reconciliation rather than inv flooding (default: %d)"),
+                  DEFAULT_TXRECONCILIATION));
+    strUsage += HelpMessageOpt(
+        "-txskeletonrelay",
+        strprintf(_("Exchange transactions with much content with peers that "
+                    "support it as skeletons, fetching the content only once "
+                    "the rest passes the fee and policy checks, in chunks from "
+                    "any peer that has it (default: %d)"),
+                  DEFAULT_TXSKELETONRELAY));
 #ifdef USE_UPNP
 #if USE_UPNP
     strUsage +=
@@ -583,6 +732,22 @@ std::string HelpMessage(HelpMessageMode mode) {
     strUsage +=
         HelpMessageOpt("-zmqpubrawtx=<address>",
                        _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubminingjob=<address>",
+                               _("Enable publish mining job in <address>"));
+    strUsage += HelpMessageOpt(
+        "-zmqpubmempoolremoved=<address>",
+        _("Enable publish transaction removed from the mempool in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubdeposit=<address>",
+                               _("Enable publish new deposit in <address>"));
+    strUsage += HelpMessageOpt(
+        "-zmqpubdepositmatured=<address>",
+        _("Enable publish unlocked deposit in <address> (requires "
+          "-depositindex)"));
+    strUsage += HelpMessageOpt(
+        "-zmqpubhwm=<n>",
+        strprintf(_("Set the outbound message high water mark, the messages "
+                    "kept for a subscriber before dropping more (default: %d)"),
+                  DEFAULT_ZMQ_SNDHWM));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -592,7 +757,8 @@ std::string HelpMessage(HelpMessageMode mode) {
         strUsage += HelpMessageOpt(
             "-checkblocks=<n>",
             strprintf(
-                _("How many blocks to check at startup (default: %u, 0 = all)"),
+                _("How many blocks to check at startup, not counting those "
+                  "checked before a clean shutdown (default: %u, 0 = all)"),
                 DEFAULT_CHECKBLOCKS));
         strUsage +=
             HelpMessageOpt("-checklevel=<n>",
@@ -615,6 +781,11 @@ std::string HelpMessage(HelpMessageMode mode) {
             "-checkpoints", strprintf("Disable expensive verification for "
                                       "known chain history (default: %d)",
                                       DEFAULT_CHECKPOINTS_ENABLED));
+        strUsage += HelpMessageOpt(
+            "-fullpowcheck",
+            strprintf("Recompute the ethash result of every new header "
+                      "instead of trusting its mix hash (default: %d)",
+                      DEFAULT_FULL_POW_CHECK));
         strUsage += HelpMessageOpt(
             "-disablesafemode", strprintf("Disable safemode, override a real "
                                           "safe mode event (default: %d)",
@@ -678,15 +849,30 @@ std::string HelpMessage(HelpMessageMode mode) {
     strUsage += HelpMessageOpt(
         "-help-debug",
         _("Show all debugging options (usage: --help -help-debug)"));
+    strUsage += HelpMessageOpt(
+        "-logasync",
+        strprintf(_("Write debug.log on a thread of its own, the messages "
+                    "still queued are lost on a crash (default: %d)"),
+                  DEFAULT_LOGASYNC));
     strUsage += HelpMessageOpt(
         "-logips",
         strprintf(_("Include IP addresses in debug output (default: %d)"),
                   DEFAULT_LOGIPS));
+    strUsage += HelpMessageOpt(
+        "-lograte=<n>",
+        strprintf(_("Log at most <n> messages a second of each debugging "
+                    "category, 0 for no limit (default: %d)"),
+                  DEFAULT_LOGRATE));
     strUsage += HelpMessageOpt(
         "-logtimestamps",
         strprintf(_("Prepend debug output with timestamp (default: %d)"),
                   DEFAULT_LOGTIMESTAMPS));
     if (showDebug) {
+        strUsage += HelpMessageOpt(
+            "-lockstats",
+            strprintf("Record how long the locks taken at each site are "
+                      "waited for and held, for getlockstats (default: %d)",
+                      DEFAULT_LOCK_STATS));
         strUsage += HelpMessageOpt(
             "-logtimemicros",
             strprintf(
@@ -695,6 +881,14 @@ std::string HelpMessage(HelpMessageMode mode) {
         strUsage += HelpMessageOpt(
             "-mocktime=<n>",
             "Replace actual time with <n> seconds since epoch (default: 0)");
+        strUsage += HelpMessageOpt(
+            "-replaystats=<file>",
+            "Time the phases of block validation, appending a JSON line of "
+            "the times to <file> every -replaystatsinterval blocks connected");
+        strUsage += HelpMessageOpt(
+            "-replaystatsinterval=<n>",
+            strprintf("Blocks per -replaystats line (default: %u)",
+                      DEFAULT_REPLAY_STATS_INTERVAL));
         strUsage += HelpMessageOpt(
             "-limitfreerelay=<n>",
             strprintf("Continuously rate-limit free transactions to <n>*1000 "
@@ -713,6 +907,16 @@ std::string HelpMessage(HelpMessageMode mode) {
             "-maxscriptcachesize=<n>",
             strprintf("Limit size of script cache to <n> MiB (default: %u)",
                       DEFAULT_MAX_SCRIPT_CACHE_SIZE));
+        strUsage += HelpMessageOpt(
+            "-maxpowcachesize=<n>",
+            strprintf("Limit size of verified header cache to <n> MiB "
+                      "(default: %u)",
+                      DEFAULT_MAX_POW_CACHE_SIZE));
+        strUsage += HelpMessageOpt(
+            "-maxethashcaches=<n>",
+            strprintf("Keep at most <n> ethash light caches (one per epoch) "
+                      "in memory (default: %u)",
+                      DEFAULT_MAX_ETHASH_LIGHT_CACHES));
         strUsage += HelpMessageOpt(
             "-maxtipage=<n>",
             strprintf("Maximum tip age in seconds to consider node in initial "
@@ -725,6 +929,12 @@ std::string HelpMessage(HelpMessageMode mode) {
             _("Fees (in %s/kB) smaller than this are considered zero fee for "
               "relaying, mining and transaction creation (default: %s)"),
             CURRENCY_UNIT, FormatMoney(DEFAULT_MIN_RELAY_TX_FEE)));
+    strUsage += HelpMessageOpt(
+        "-contentminrelaytxfee=<amt>",
+        strprintf(_("Fees (in %s/kB) transactions carrying content must pay "
+                    "to be relayed, regardless of priority (default: %s)"),
+                  CURRENCY_UNIT,
+                  FormatMoney(DEFAULT_CONTENT_MIN_RELAY_TX_FEE)));
     strUsage += HelpMessageOpt(
         "-maxtxfee=<amt>",
         strprintf(_("Maximum total fees (in %s) to use in a single wallet "
@@ -792,16 +1002,100 @@ std::string HelpMessage(HelpMessageMode mode) {
         strprintf(_("Set maximum percentage of a block reserved to "
                     "high-priority/low-fee transactions (default: %d)"),
                   DEFAULT_BLOCK_PRIORITY_PERCENTAGE));
+    strUsage += HelpMessageOpt(
+        "-blockcontentpercentage=<n>",
+        strprintf(_("Set maximum percentage of a block transactions carrying "
+                    "content may take (default: %d)"),
+                  DEFAULT_BLOCK_CONTENT_PERCENTAGE));
     strUsage += HelpMessageOpt(
         "-blockmintxfee=<amt>",
         strprintf(_("Set lowest fee rate (in %s/kB) for transactions to be "
                     "included in block creation. (default: %s)"),
                   CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)));
+    strUsage += HelpMessageOpt(
+        "-blockbuildbudget=<n>",
+        strprintf(_("Milliseconds the first mining template after a new tip "
+                    "may spend adding transactions, it is completed right "
+                    "after (0 = no limit, default: %d)"),
+                  DEFAULT_BLOCK_BUILD_BUDGET));
+    strUsage += HelpMessageOpt(
+        "-dagthreads=<n>",
+        strprintf(_("Set the number of threads used to generate the ethash "
+                    "DAG (0 = one per core, default: %d)"),
+                  DEFAULT_DAG_THREADS));
+    strUsage += HelpMessageOpt(
+        "-dagpregenerate=<n>",
+        strprintf(_("Start building the DAG of the next ethash epoch this "
+                    "many blocks before it begins (default: %d)"),
+                  DEFAULT_DAG_PREGENERATE_BLOCKS));
+    strUsage += HelpMessageOpt(
+        "-dagdir=<dir>",
+        _("Directory of the ethash DAG files (default: ~/.platopia/)"));
+    strUsage += HelpMessageOpt(
+        "-daghugepages=<n>",
+        strprintf(_("Keep the mining DAG in huge pages: 0 = off, 1 = 2MB "
+                    "pages, 2 = 1GB pages. Uses transparent huge pages if "
+                    "none are reserved (default: %d)"),
+                  DEFAULT_DAG_HUGEPAGES));
+    strUsage += HelpMessageOpt(
+        "-dagprefault",
+        strprintf(_("Read the whole mining DAG into memory before hashing "
+                    "(default: %u)"),
+                  DEFAULT_DAG_PREFAULT));
+    strUsage += HelpMessageOpt(
+        "-daglock",
+        strprintf(_("Lock the mining DAG in memory, implies -dagprefault "
+                    "(default: %u)"),
+                  DEFAULT_DAG_LOCK));
+    strUsage += HelpMessageOpt(
+        "-dagnuma",
+        strprintf(_("Keep a copy of the mining DAG on each NUMA node and pin "
+                    "mining threads to the nodes (default: %u)"),
+                  DEFAULT_DAG_NUMA));
+    strUsage += HelpMessageOpt(
+        "-minermemory=<n>",
+        strprintf(_("Keep the ethash DAGs and light caches of the miner "
+                    "under <n> MiB. Epochs whose DAG doesn't fit are mined "
+                    "from the light cache, far slower (0 = no limit, "
+                    "default: %d)"),
+                  DEFAULT_MINER_MEMORY));
+    strUsage += HelpMessageOpt(
+        "-opencl",
+        strprintf(_("Mine on OpenCL GPUs besides the CPU mining threads, if "
+                    "built with --enable-opencl (default: %u)"),
+                  DEFAULT_OPENCL_MINING));
+    strUsage += HelpMessageOpt(
+        "-opencldevices=<list>",
+        _("OpenCL GPUs to mine on, numbered across platforms, e.g. 0,2-3 "
+          "(default: all)"));
     if (showDebug)
         strUsage +=
             HelpMessageOpt("-blockversion=<n>",
                            "Override block version to test forking scenarios");
 
+    strUsage += HelpMessageGroup(_("Stratum server options:"));
+    strUsage += HelpMessageOpt(
+        "-stratum", strprintf(_("Accept Stratum (EthereumStratum/1.0.0) "
+                                "mining connections (default: %d)"),
+                              DEFAULT_STRATUM_ENABLE));
+    strUsage += HelpMessageOpt(
+        "-stratumbind=<addr>",
+        _("Bind the Stratum server to the given address (default: 0.0.0.0)"));
+    strUsage += HelpMessageOpt(
+        "-stratumport=<port>",
+        strprintf(_("Listen for Stratum connections on <port> (default: %u)"),
+                  DEFAULT_STRATUM_PORT));
+    strUsage += HelpMessageOpt(
+        "-stratummaxclients=<n>",
+        strprintf(_("Maximum number of Stratum clients (default: %u)"),
+                  DEFAULT_STRATUM_MAX_CLIENTS));
+    strUsage += HelpMessageOpt(
+        "-stratumshareinterval=<n>",
+        strprintf(_("Seconds between the shares of each Stratum client the "
+                    "share difficulty is set for, 0 to only take blocks "
+                    "(default: %d)"),
+                  DEFAULT_STRATUM_SHARE_INTERVAL));
+
     strUsage += HelpMessageGroup(_("RPC server options:"));
     strUsage += HelpMessageOpt("-server",
                                _("Accept command line and JSON-RPC commands"));
@@ -840,15 +1134,51 @@ std::string HelpMessage(HelpMessageMode mode) {
           "are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. "
           "1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This "
           "option can be specified multiple times"));
+    strUsage += HelpMessageOpt(
+        "-rpcbatchthreads=<n>",
+        strprintf(_("Set the number of threads that help run the read only "
+                    "calls of a JSON-RPC batch in parallel, up to %d (default: "
+                    "%d)"),
+                  MAX_RPC_BATCH_THREADS, DEFAULT_RPC_BATCH_THREADS));
+    strUsage += HelpMessageOpt(
+        "-rpceventthreads=<n>",
+        strprintf(_("Set the number of threads to service RPC calls that wait "
+                    "for events, each waiting call takes one (default: %d)"),
+                  DEFAULT_HTTP_EVENT_THREADS));
+    strUsage += HelpMessageOpt(
+        "-rpcmetrics",
+        strprintf(_("Serve metrics of the node in the Prometheus text format "
+                    "at /metrics, with the same authentication as RPC: block "
+                    "connection and coins flush times, the coins cache, the "
+                    "mempool, bytes by message command, mining and the RPC "
+                    "calls as getrpcstats returns them (default: %d)"),
+                  DEFAULT_RPC_METRICS));
+    strUsage += HelpMessageOpt(
+        "-rpcmethodlimit=<method>:<n>",
+        _("Run at most <n> calls of <method> at once, 0 for no limit. Some "
+          "slow calls run one at a time by default. This option can be "
+          "specified multiple times"));
+    strUsage += HelpMessageOpt(
+        "-rpcminingthreads=<n>",
+        strprintf(_("Set the number of threads to service mining RPC calls "
+                    "(default: %d)"),
+                  DEFAULT_HTTP_MINING_THREADS));
     strUsage += HelpMessageOpt(
         "-rpcthreads=<n>",
-        strprintf(
-            _("Set the number of threads to service RPC calls (default: %d)"),
-            DEFAULT_HTTP_THREADS));
+        strprintf(_("Set the number of threads to service RPC calls other "
+                    "than mining and wallet calls, and REST requests "
+                    "(default: %d)"),
+                  DEFAULT_HTTP_THREADS));
+    strUsage += HelpMessageOpt(
+        "-rpcwalletthreads=<n>",
+        strprintf(_("Set the number of threads to service wallet RPC calls "
+                    "(default: %d)"),
+                  DEFAULT_HTTP_WALLET_THREADS));
     if (showDebug) {
         strUsage += HelpMessageOpt(
-            "-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to "
-                                           "service RPC calls (default: %d)",
+            "-rpcworkqueue=<n>", strprintf("Set the depth of each work queue "
+                                           "to service RPC calls (default: "
+                                           "%d)",
                                            DEFAULT_HTTP_WORKQUEUE));
         strUsage += HelpMessageOpt(
             "-rpcservertimeout=<n>",
@@ -1063,6 +1393,33 @@ bool InitSanityCheck(void) {
     return true;
 }
 
+/** Register the gauges of /metrics that are read when it is scraped */
+static void RegisterNodeMetrics() {
+    metrics.Gauge("platopia_mempool_transactions",
+                  "Transactions in the mempool.",
+                  []() { return double(mempool.size()); });
+    metrics.Gauge("platopia_mempool_size_bytes",
+                  "Serialized size of the transactions in the mempool.",
+                  []() { return double(mempool.GetTotalTxSize()); });
+    metrics.Gauge("platopia_mempool_usage_bytes",
+                  "Memory used by the mempool, in bytes.",
+                  []() { return double(mempool.DynamicMemoryUsage()); });
+    metrics.Gauge("platopia_mining_hashrate",
+                  "Hashes per second of the local mining threads.", []() {
+                      return mineworker ? mineworker->GetHashRate() : 0.0;
+                  });
+    metrics.Gauge("platopia_ethash_dag_bytes",
+                  "Size of the ethash DAGs held by the miner.", []() {
+                      return mineworker
+                                 ? double(mineworker->GetStats().nDagBytes)
+                                 : 0.0;
+                  });
+    metrics.Gauge("platopia_ethash_light_cache_bytes",
+                  "Size of the ethash light caches used to verify blocks.",
+                  []() { return double(EthashLightCache().MemoryUsage()); });
+    metrics.Collector([]() { return rpcStats.ToPrometheus(); });
+}
+
 static bool AppInitServers(Config &config, boost::thread_group &threadGroup) {
     RPCServer::OnStarted(&OnRPCStarted);
     RPCServer::OnStopped(&OnRPCStopped);
@@ -1180,6 +1537,8 @@ void InitLogging() {
     fLogTimestamps = GetBoolArg("-logtimestamps", DEFAULT_LOGTIMESTAMPS);
     fLogTimeMicros = GetBoolArg("-logtimemicros", DEFAULT_LOGTIMEMICROS);
     fLogIPs = GetBoolArg("-logips", DEFAULT_LOGIPS);
+    SetLogRateLimit(GetArg("-lograte", DEFAULT_LOGRATE));
+    fLockStats = GetBoolArg("-lockstats", DEFAULT_LOCK_STATS);
 
     LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     LogPrintf("%s version %s\n", CLIENT_NAME, FormatFullVersion());
@@ -1275,6 +1634,15 @@ bool AppInitParameterInteraction(Config &config) {
     if (GetArg("-prune", 0)) {
         if (GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+            return InitError(
+                _("Prune mode is incompatible with -addressindex."));
+        if (GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(
+                _("Prune mode is incompatible with -blockfilterindex."));
+        if (GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX))
+            return InitError(
+                _("Prune mode is incompatible with -blockstatsindex."));
     }
 
     // if space reserved for high priority transactions is misconfigured
@@ -1298,11 +1666,15 @@ bool AppInitParameterInteraction(Config &config) {
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
     // Trim requested connection counts, to fit into system limitations
+#ifdef USE_EPOLL
+    nMaxConnections = std::max(nMaxConnections, 0);
+#else
     nMaxConnections =
         std::max(std::min(nMaxConnections,
                           (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS -
                                 MAX_ADDNODE_CONNECTIONS)),
                  0);
+#endif
     nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS +
                                    MAX_ADDNODE_CONNECTIONS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
@@ -1365,6 +1737,10 @@ bool AppInitParameterInteraction(Config &config) {
         GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled =
         GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
+    fFullPowCheck = GetBoolArg("-fullpowcheck", DEFAULT_FULL_POW_CHECK);
+    fBlockCompression =
+        GetBoolArg("-blockcompression", DEFAULT_BLOCK_COMPRESSION);
 
     hashAssumeValid = uint256S(
         GetArg("-assumevalid",
@@ -1446,6 +1822,15 @@ bool AppInitParameterInteraction(Config &config) {
                   nPruneTarget / 1024 / 1024);
         fPruneMode = true;
     }
+    nPruneDepth = GetArg("-prunedepth", MIN_BLOCKS_TO_KEEP);
+    if (nPruneDepth < int(MIN_BLOCKS_TO_KEEP)) {
+        return InitError(strprintf(_("-prunedepth must be at least %u."),
+                                   MIN_BLOCKS_TO_KEEP));
+    }
+    if (!fPruneMode &&
+        GetBoolArg("-contentarchive", DEFAULT_CONTENTARCHIVE)) {
+        return InitError(_("-contentarchive needs -prune."));
+    }
 
     RegisterAllRPCCommands(tableRPC);
 #ifdef ENABLE_WALLET
@@ -1476,6 +1861,15 @@ bool AppInitParameterInteraction(Config &config) {
             ::minRelayTxFee.ToString());
     }
 
+    if (IsArgSet("-contentminrelaytxfee")) {
+        CAmount n(0);
+        if (!ParseMoney(GetArg("-contentminrelaytxfee", ""), n)) {
+            return InitError(AmountErrMsg("contentminrelaytxfee",
+                                          GetArg("-contentminrelaytxfee", "")));
+        }
+        ::contentMinRelayTxFee = CFeeRate(n);
+    }
+
     // Sanity check argument for min fee for including tx in block
     // TODO: Harmonize which arguments need sanity checking and where that
     // happens.
@@ -1520,6 +1914,13 @@ bool AppInitParameterInteraction(Config &config) {
     if (GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
 
+    if (GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS)) {
+        if (!GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+            return InitError(_("-peerblockfilters needs -blockfilterindex."));
+        }
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_FILTERS);
+    }
+
     // Signal Bitcoin Cash support.
     // TODO: remove some time after the hardfork when no longer needed
     // to differentiate the network nodes.
@@ -1608,6 +2009,9 @@ static bool LockDataDirectory(bool probeOnly) {
 bool AppInitSanityChecks() {
     // Step 4: sanity checks
 
+    // Pick the SHA-256 implementation before anything hashes in parallel
+    SHA256SelectImplementation();
+
     // Initialize elliptic curve code
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1647,6 +2051,9 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
 
     if (fPrintToDebugLog) {
         OpenDebugLog();
+        if (GetBoolArg("-logasync", DEFAULT_LOGASYNC)) {
+            StartLogThread();
+        }
     }
 
     if (!fLogTimestamps) {
@@ -1664,19 +2071,42 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
     InitSignatureCache();
     InitScriptExecutionCache();
 
+    LogPrintf("Using %s SHA256 implementation\n", SHA256SelectImplementation());
+    LogPrintf("Using %s kernels and %s Keccak for ethash\n",
+              ethash_select_kernels(), ethash_select_keccak());
+    InitEthashLightCache();
+    InitProofOfWorkCache();
+
     LogPrintf("Using %u threads for script verification\n",
               nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i = 0; i < nScriptCheckThreads - 1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
         }
+        for (int i = 0; i < nScriptCheckThreads - 1; i++) {
+            threadGroup.create_thread(&ThreadHeaderCheck);
+        }
+        for (int i = 0; i < nScriptCheckThreads - 1; i++) {
+            threadGroup.create_thread(&ThreadCoinPrefetch);
+        }
+        for (int i = 0; i < nScriptCheckThreads - 1; i++) {
+            threadGroup.create_thread(&ThreadDisconnectRead);
+        }
     }
 
-    // Start the lightweight task scheduler thread
+    // Start the lightweight task scheduler threads
+    int nSchedulerThreads = std::max(
+        1, std::min<int>(GetArg("-schedulerthreads", DEFAULT_SCHEDULER_THREADS),
+                         MAX_SCHEDULER_THREADS));
     CScheduler::Function serviceLoop =
         boost::bind(&CScheduler::serviceQueue, &scheduler);
-    threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>,
-                                          "scheduler", serviceLoop));
+    for (int i = 0; i < nSchedulerThreads; i++) {
+        threadGroup.create_thread(boost::bind(
+            &TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    }
+
+    GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
+    SetRPCStatsScheduler(&scheduler);
 
     /* Start the RPC server already.  It will be started in "warmup" mode
      * and not really process calls already (but it will signify connections
@@ -1685,6 +2115,7 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
      */
     if (GetBoolArg("-server", false)) {
         uiInterface.InitMessage.connect(SetRPCWarmupStatus);
+        RegisterNodeMetrics();
         if (!AppInitServers(config, threadGroup)) {
             return InitError(
                 _("Unable to start HTTP server. See debug log for details."));
@@ -1870,6 +2301,20 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
 
     // Step 7: load block chain
 
+    // Neither the addresses and bans of the network nor the fee estimates
+    // depend on the chain: read them while the block index loads. Both are
+    // waited for before their first use below, or when returning early.
+    std::future<void> addressesLoaded = std::async(
+        std::launch::async, [&connman]() { connman.LoadAddresses(); });
+    std::future<void> feeEstimatesLoaded = std::async(std::launch::async, []() {
+        boost::filesystem::path est_path =
+            GetDataDir() / FEE_ESTIMATES_FILENAME;
+        CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK,
+                             CLIENT_VERSION);
+        // Allowed to fail as this file IS missing on first startup.
+        if (!est_filein.IsNull()) mempool.ReadFeeEstimates(est_filein);
+    });
+
     fReindex = GetBoolArg("-reindex", false);
     bool fReindexChainState = GetBoolArg("-reindex-chainstate", false);
 
@@ -1912,11 +2357,16 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
     // total cache cannot be greater than nMaxDbcache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20);
     int64_t nBlockTreeDBCache = nTotalCache / 8;
+    const bool fBlockTreeIndex =
+        GetBoolArg("-txindex", DEFAULT_TXINDEX) ||
+        GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) ||
+        GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX) ||
+        GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX);
     nBlockTreeDBCache =
-        std::min(nBlockTreeDBCache, (GetBoolArg("-txindex", DEFAULT_TXINDEX)
-                                         ? nMaxBlockDBAndTxIndexCache
-                                         : nMaxBlockDBCache)
-                                        << 20);
+        std::min(nBlockTreeDBCache,
+                 (fBlockTreeIndex ? nMaxBlockDBAndTxIndexCache
+                                  : nMaxBlockDBCache)
+                     << 20);
     nTotalCache -= nBlockTreeDBCache;
     // use 25%-50% of the remainder for disk cache
     int64_t nCoinDBCache =
@@ -1950,16 +2400,19 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
             try {
                 UnloadBlockIndex();
                 delete pcoinsTip;
-                delete pcoinsdbview;
                 delete pcoinscatcher;
+                delete pcoinsWriter;
+                delete pcoinsdbview;
                 delete pblocktree;
 
                 pblocktree =
                     new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false,
                                                 fReindex || fReindexChainState);
-                pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
+                pcoinsWriter = new CCoinsViewAsyncWrite(pcoinsdbview);
+                pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsWriter);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                pcoinsTip->TrackStats();
 
                 if (fReindex) {
                     pblocktree->WriteReindexing(true);
@@ -1995,13 +2448,30 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
                     break;
                 }
 
-                // Check for changed -txindex state
-                if (fTxIndex != GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
-                    strLoadError = _("You need to rebuild the database using "
-                                     "-reindex-chainstate to change -txindex");
+                // Check for changed -depositindex state
+                if (fDepositIndex !=
+                    GetBoolArg("-depositindex", DEFAULT_DEPOSITINDEX)) {
+                    strLoadError =
+                        _("You need to rebuild the database using -reindex to "
+                          "change -depositindex");
                     break;
                 }
 
+                // Check for a UTXO snapshot that was only partly loaded, the
+                // chainstate then has coins from blocks it hasn't connected.
+                bool fLoadingSnapshot = false;
+                pblocktree->ReadFlag("loadingtxoutset", fLoadingSnapshot);
+                if (fLoadingSnapshot) {
+                    if (!fReindexChainState) {
+                        strLoadError =
+                            _("Loading a UTXO snapshot was interrupted. You "
+                              "need to rebuild the database using "
+                              "-reindex-chainstate.");
+                        break;
+                    }
+                    pblocktree->WriteFlag("loadingtxoutset", false);
+                }
+
                 // Check for changed -prune state.  What we are concerned about
                 // is a user who has pruned blocks in the past, but is now
                 // trying to run unpruned.
@@ -2049,9 +2519,9 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
                 }
 
                 if (!CVerifyDB().VerifyDB(
-                        config, pcoinsdbview,
+                        config, pcoinsWriter,
                         GetArg("-checklevel", DEFAULT_CHECKLEVEL),
-                        GetArg("-checkblocks", DEFAULT_CHECKBLOCKS))) {
+                        GetArg("-checkblocks", DEFAULT_CHECKBLOCKS), true)) {
                     strLoadError = _("Corrupted block database detected");
                     break;
                 }
@@ -2099,11 +2569,7 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
-    boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
-    CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK,
-                         CLIENT_VERSION);
-    // Allowed to fail as this file IS missing on first startup.
-    if (!est_filein.IsNull()) mempool.ReadFeeEstimates(est_filein);
+    feeEstimatesLoaded.get();
     fFeeEstimatesInitialized = true;
 
     // Encoded addresses using cashaddr instead of base58
@@ -2120,11 +2586,23 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
 
     // Step 9: data directory maintenance
 
-    // if pruning, unset the service bit and perform the initial blockstore
-    // prune after any wallet rescanning has taken place.
+    // if pruning, unset the service bit, start the pruner and perform the
+    // initial blockstore prune after any wallet rescanning has taken place.
     if (fPruneMode) {
         LogPrintf("Unsetting NODE_NETWORK on prune mode\n");
         nLocalServices = ServiceFlags(nLocalServices & ~NODE_NETWORK);
+        const bool fContentArchive =
+            GetBoolArg("-contentarchive", DEFAULT_CONTENTARCHIVE);
+        bool fHadContentArchive = false;
+        pblocktree->ReadFlag("contentarchive", fHadContentArchive);
+        if (fContentArchive && !fHadContentArchive && fHavePruned) {
+            return InitError(
+                _("Blocks were pruned before -contentarchive was turned on, "
+                  "you need to rebuild the database using -reindex to build "
+                  "the content archive."));
+        }
+        g_blockpruner = std::unique_ptr<CBlockPruner>(new CBlockPruner(
+            config, fContentArchive, fHadContentArchive && !fContentArchive));
         if (!fReindex) {
             uiInterface.InitMessage(_("Pruning blockstore..."));
             PruneAndFlush();
@@ -2149,6 +2627,60 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
     if (IsArgSet("-blocknotify"))
         uiInterface.NotifyBlockTip.connect(BlockNotifyCallback);
 
+    // The transaction index is built, caught up or dropped in the background,
+    // turning -txindex on or off takes no reindex.
+    bool fHadTxIndex = false;
+    pblocktree->ReadFlag("txindex", fHadTxIndex);
+    if (fTxIndex || fHadTxIndex) {
+        g_txindex =
+            std::unique_ptr<CTxIndex>(new CTxIndex(config, !fTxIndex));
+    }
+
+    // Likewise the address index.
+    const bool fAddressIndex =
+        GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    bool fHadAddressIndex = false;
+    pblocktree->ReadFlag("addressindex", fHadAddressIndex);
+    if (fAddressIndex || fHadAddressIndex) {
+        g_addressindex = std::unique_ptr<CAddressIndex>(
+            new CAddressIndex(config, !fAddressIndex));
+    }
+
+    // And the block filter index.
+    const bool fBlockFilterIndex =
+        GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX);
+    bool fHadBlockFilterIndex = false;
+    pblocktree->ReadFlag("blockfilterindex", fHadBlockFilterIndex);
+    if (fBlockFilterIndex || fHadBlockFilterIndex) {
+        g_blockfilterindex = std::unique_ptr<CBlockFilterIndex>(
+            new CBlockFilterIndex(config, !fBlockFilterIndex));
+    }
+
+    // And the block stats index.
+    const bool fBlockStatsIndex =
+        GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX);
+    bool fHadBlockStatsIndex = false;
+    pblocktree->ReadFlag("blockstatsindex", fHadBlockStatsIndex);
+    if (fBlockStatsIndex || fHadBlockStatsIndex) {
+        g_blockstatsindex = std::unique_ptr<CBlockStatsIndex>(
+            new CBlockStatsIndex(config, !fBlockStatsIndex));
+    }
+
+    if (GetBoolArg("-powproofs", DEFAULT_POW_PROOFS)) {
+        g_ethashprover =
+            std::unique_ptr<CEthashProver>(new CEthashProver(config));
+    }
+
+    if (IsArgSet("-replaystats")) {
+        std::string strFile = GetArg("-replaystats", "");
+        if (!StartReplayStats(strFile,
+                              GetArg("-replaystatsinterval",
+                                     DEFAULT_REPLAY_STATS_INTERVAL))) {
+            return InitError(
+                strprintf(_("Cannot write to -replaystats file %s"), strFile));
+        }
+    }
+
     std::vector<boost::filesystem::path> vImportFiles;
     if (mapMultiArgs.count("-loadblock")) {
         for (const std::string &strFile : mapMultiArgs.at("-loadblock")) {
@@ -2156,6 +2688,11 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
         }
     }
 
+    // Alongside the import and the mempool reload, with which it shares
+    // cs_main a batch at a time.
+    if (!fReindex && GetArg("-hotcoins", DEFAULT_HOT_COINS) > 0) {
+        threadGroup.create_thread(&ThreadLoadHotCoins);
+    }
     threadGroup.create_thread(
         boost::bind(&ThreadImport, std::ref(config), vImportFiles));
 
@@ -2177,6 +2714,12 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
         StartTorControl(threadGroup, scheduler);
     }
 
+    if (GetBoolArg("-stratum", DEFAULT_STRATUM_ENABLE) &&
+        !StartStratumServer()) {
+        return InitError(_("Unable to start the Stratum server. See debug "
+                           "log for details."));
+    }
+
     Discover(threadGroup);
 
     // Map ports with UPnP
@@ -2200,7 +2743,12 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
 
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
+    connOptions.nMessageHandlerThreads =
+        std::max(1, std::min(int(GetArg("-msghandlerthreads",
+                                        DEFAULT_MSGHANDLER_THREADS)),
+                             MAX_MSGHANDLER_THREADS));
 
+    addressesLoaded.get();
     if (!connman.Start(scheduler, strNodeError, connOptions)) {
         return InitError(strNodeError);
     }
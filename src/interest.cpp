@@ -0,0 +1,268 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "interest.h"
+
+#include "crypto/common.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+
+//! 64x64 to 128-bit multiplication
+void Mul64(uint64_t a, uint64_t b, uint64_t &nHigh, uint64_t &nLow) {
+#ifdef __SIZEOF_INT128__
+    const unsigned __int128 r = (unsigned __int128)a * b;
+    nHigh = uint64_t(r >> 64);
+    nLow = uint64_t(r);
+#else
+    const uint64_t aLo = uint32_t(a), aHi = a >> 32;
+    const uint64_t bLo = uint32_t(b), bHi = b >> 32;
+    const uint64_t ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo;
+    const uint64_t hh = aHi * bHi;
+    const uint64_t mid = (ll >> 32) + uint32_t(lh) + uint32_t(hl);
+    nLow = (mid << 32) | uint32_t(ll);
+    nHigh = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+#endif
+}
+
+} // namespace
+
+CInterestMultiplier::CInterestMultiplier(double d) : nMantissa(0), nExponent(0) {
+    assert(d >= 0 && std::isfinite(d));
+    if (d != 0) {
+        int nExp;
+        const double f = std::frexp(d, &nExp);
+        nMantissa = static_cast<uint64_t>(std::ldexp(f, 53));
+        nExponent = nExp - 53;
+    }
+}
+
+double CInterestMultiplier::ToDouble() const {
+    return std::ldexp(static_cast<double>(nMantissa), nExponent);
+}
+
+void CInterestMultiplier::Normalize(uint64_t nHigh, uint64_t nLow,
+                                    int nExponentIn, bool fSticky) {
+    const int nBits = nHigh != 0 ? 64 + CountBits(nHigh) : CountBits(nLow);
+    if (nBits == 0) {
+        nMantissa = 0;
+        nExponent = 0;
+        return;
+    }
+    if (nBits <= 53) {
+        nMantissa = nLow << (53 - nBits);
+        nExponent = nExponentIn - (53 - nBits);
+        return;
+    }
+
+    // Shift right by nShift, keeping the last bit shifted out apart and
+    // whether any below it were set.
+    const int nShift = nBits - 53;
+    uint64_t nKept, nRoundBit;
+    bool fBelow = fSticky;
+    if (nShift < 64) {
+        nKept = (nLow >> nShift) | (nShift > 0 ? nHigh << (64 - nShift) : 0);
+        nRoundBit = (nLow >> (nShift - 1)) & 1;
+        fBelow |= nShift > 1 && (nLow << (65 - nShift)) != 0;
+    } else {
+        nKept = nHigh >> (nShift - 64);
+        nRoundBit = nShift > 64 ? (nHigh >> (nShift - 65)) & 1 : nLow >> 63;
+        fBelow |= (nShift > 64 ? nLow : nLow << 1) != 0 ||
+                  (nShift > 65 && (nHigh << (129 - nShift)) != 0);
+    }
+
+    nMantissa = nKept;
+    nExponent = nExponentIn + nShift;
+    if (nRoundBit && (fBelow || (nMantissa & 1))) {
+        if (++nMantissa == (uint64_t(1) << 53)) {
+            nMantissa >>= 1;
+            nExponent++;
+        }
+    }
+}
+
+CInterestMultiplier CInterestMultiplier::
+operator*(const CInterestMultiplier &b) const {
+    CInterestMultiplier r;
+    if (!IsZero() && !b.IsZero()) {
+        uint64_t nHigh, nLow;
+        Mul64(nMantissa, b.nMantissa, nHigh, nLow);
+        r.Normalize(nHigh, nLow, nExponent + b.nExponent, false);
+    }
+    return r;
+}
+
+CInterestMultiplier CInterestMultiplier::operator/(uint32_t n) const {
+    assert(n != 0);
+    CInterestMultiplier r;
+    if (IsZero()) {
+        return r;
+    }
+    // Long division of nMantissa * 2^64, 32 bits at a time.
+    const uint32_t vDigits[4] = {uint32_t(nMantissa >> 32),
+                                 uint32_t(nMantissa), 0, 0};
+    uint32_t vQuotient[4];
+    uint64_t nRem = 0;
+    for (int i = 0; i < 4; i++) {
+        const uint64_t x = (nRem << 32) | vDigits[i];
+        vQuotient[i] = uint32_t(x / n);
+        nRem = x % n;
+    }
+    r.Normalize((uint64_t(vQuotient[0]) << 32) | vQuotient[1],
+                (uint64_t(vQuotient[2]) << 32) | vQuotient[3], nExponent - 64,
+                nRem != 0);
+    return r;
+}
+
+CAmount CInterestMultiplier::Apply(CAmount principal) const {
+    if (principal == 0 || IsZero()) {
+        return 0;
+    }
+    const bool fNegative = principal < 0;
+    const uint64_t nAbs =
+        fNegative ? uint64_t(0) - uint64_t(principal) : uint64_t(principal);
+
+    // Like the double expression, round the principal to 53 bits first.
+    const CInterestMultiplier product = CInterestMultiplier(nAbs) * *this;
+
+    // Then round half away from zero, like round() does.
+    uint64_t nResult;
+    if (product.nExponent >= 0) {
+        nResult = product.nMantissa << product.nExponent;
+    } else if (product.nExponent < -53) {
+        nResult = 0;
+    } else {
+        const int nShift = -product.nExponent;
+        nResult = (product.nMantissa >> nShift) +
+                  ((product.nMantissa >> (nShift - 1)) & 1);
+    }
+    return fNegative ? -CAmount(nResult) : CAmount(nResult);
+}
+
+CInterestTable::CInterestTable(const Consensus::Params &params) {
+    CAmount nStart = params.nTotalInterest;
+    if (nStart > 0) {
+        vPeriodStart.push_back(nStart);
+        // Below 10 a tenth rounds to nothing, so that is the last period.
+        do {
+            decayByOneTenth(nStart);
+            vPeriodStart.push_back(nStart);
+        } while (nStart >= 10);
+    }
+
+    const size_t nLevels =
+        sizeof(params.nLockInterestRate) / sizeof(params.nLockInterestRate[0]);
+    vLevelBlocks.assign(params.nLockInterestBlocksThreshould,
+                        params.nLockInterestBlocksThreshould + nLevels);
+    vRates.resize(nLevels);
+    for (size_t nLevel = 0; nLevel < nLevels; nLevel++) {
+        // Decay one period at a time, giving the very same doubles as
+        // multiplying by the ratio while walking the periods.
+        double rate = params.nLockInterestRate[nLevel];
+        for (size_t nPeriod = 0; nPeriod < vPeriodStart.size(); nPeriod++) {
+            vRates[nLevel].push_back(rate);
+            rate *= params.nDecayRatio;
+        }
+    }
+
+    // Same as CChainParams::BlocksInterestInterval()
+    const uint32_t nInterval = params.nBlocksPerDay * 100;
+    const CInterestMultiplier decay(params.nDecayRatio);
+    const size_t nLocks = sizeof(params.nLockInterestBlocksThreshould) /
+                          sizeof(params.nLockInterestBlocksThreshould[0]);
+    vLockBlocks.assign(params.nLockInterestBlocksThreshould,
+                       params.nLockInterestBlocksThreshould + nLocks);
+    vMultipliers.resize(nLocks);
+    for (size_t nLock = 0; nLock < nLocks; nLock++) {
+        const int nLevel = GetLevel(vLockBlocks[nLock]);
+        const CInterestMultiplier lockBlocks(uint64_t(vLockBlocks[nLock]));
+        CInterestMultiplier rate;
+        if (nLevel >= 0) {
+            rate = CInterestMultiplier(params.nLockInterestRate[nLevel]);
+        }
+        for (size_t nPeriod = 0; nPeriod < vPeriodStart.size(); nPeriod++) {
+            vMultipliers[nLock].push_back(rate * lockBlocks / nInterval);
+            rate = rate * decay;
+        }
+    }
+}
+
+size_t CInterestTable::GetPeriod(CAmount nInterestLeft) const {
+    if (vPeriodStart.empty()) {
+        return 0;
+    }
+    // A period has begun once the interest left is down to its start.
+    return std::partition_point(vPeriodStart.begin() + 1, vPeriodStart.end(),
+                                [nInterestLeft](CAmount nStart) {
+                                    return nInterestLeft <= nStart;
+                                }) -
+           vPeriodStart.begin() - 1;
+}
+
+int CInterestTable::GetLevel(uint32_t nLockBlocks) const {
+    return std::upper_bound(vLevelBlocks.begin(), vLevelBlocks.end(),
+                            int(nLockBlocks)) -
+           vLevelBlocks.begin() - 1;
+}
+
+CAmount CInterestTable::GetInterest(CAmount principal, uint32_t nLockBlocks,
+                                    size_t nPeriod) const {
+    const int nLock = std::upper_bound(vLockBlocks.begin(), vLockBlocks.end(),
+                                       int(nLockBlocks)) -
+                      vLockBlocks.begin() - 1;
+    if (nLock < 0 || nPeriod >= vMultipliers[nLock].size()) {
+        return 0;
+    }
+    return vMultipliers[nLock][nPeriod].Apply(principal);
+}
+
+const int CInterestHistory::NO_PERIOD;
+
+void CInterestHistory::Append(uint64_t nChainInterest) {
+    vChainInterest.push_back(nChainInterest);
+    const CAmount nInterestLeft = nTotalInterest - CAmount(nChainInterest);
+    const int nPeriod =
+        nInterestLeft > 0 ? int(table.GetPeriod(nInterestLeft)) : NO_PERIOD;
+    if (vPeriodStarts.empty() || vPeriodStarts.back().nPeriod != nPeriod) {
+        vPeriodStarts.push_back({Height() + 1, nPeriod});
+    }
+}
+
+void CInterestHistory::Truncate(int nHeight) {
+    if (nHeight >= Height()) {
+        return;
+    }
+    vChainInterest.resize(std::max(nHeight + 1, 0));
+    // The start at nHeight + 1 comes from the block at nHeight, which stays.
+    while (!vPeriodStarts.empty() &&
+           vPeriodStarts.back().nHeight > nHeight + 1) {
+        vPeriodStarts.pop_back();
+    }
+}
+
+bool CInterestHistory::GetChainInterest(int nHeight,
+                                        uint64_t &nChainInterest) const {
+    if (nHeight < 0 || nHeight > Height()) {
+        return false;
+    }
+    nChainInterest = vChainInterest[nHeight];
+    return true;
+}
+
+bool CInterestHistory::GetPeriod(int nHeight, PeriodStart &start) const {
+    if (nHeight > Height() + 1) {
+        return false;
+    }
+    const std::vector<PeriodStart>::const_iterator it = std::upper_bound(
+        vPeriodStarts.begin(), vPeriodStarts.end(), nHeight,
+        [](int n, const PeriodStart &s) { return n < s.nHeight; });
+    if (it == vPeriodStarts.begin()) {
+        return false;
+    }
+    start = *(it - 1);
+    return true;
+}
@@ -0,0 +1,147 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INTEREST_H
+#define BITCOIN_INTEREST_H
+
+#include "amount.h"
+#include "consensus/params.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Positive binary floating point number with a 53-bit mantissa, evaluated
+ * with integer arithmetic only.
+ *
+ * Every operation rounds to nearest, ties to even, exactly like IEEE 754
+ * double precision does, so it gives the very same results as the double
+ * arithmetic interest used to be computed with, on any platform and with any
+ * compiler flags. Values are assumed to stay far from the double limits.
+ */
+class CInterestMultiplier {
+public:
+    CInterestMultiplier() : nMantissa(0), nExponent(0) {}
+    explicit CInterestMultiplier(double d);
+    explicit CInterestMultiplier(uint64_t n) { Normalize(0, n, 0, false); }
+
+    bool IsZero() const { return nMantissa == 0; }
+    double ToDouble() const;
+
+    CInterestMultiplier operator*(const CInterestMultiplier &b) const;
+    CInterestMultiplier operator/(uint32_t n) const;
+
+    /** round(principal * this), as the double expression would give it */
+    CAmount Apply(CAmount principal) const;
+
+private:
+    //! Zero, or in [2^52, 2^53)
+    uint64_t nMantissa;
+    int nExponent;
+
+    /**
+     * Round (nHigh * 2^64 + nLow) * 2^nExponentIn to 53 bits. fSticky tells
+     * that nonzero bits below nLow were dropped already.
+     */
+    void Normalize(uint64_t nHigh, uint64_t nLow, int nExponentIn,
+                   bool fSticky);
+};
+
+/**
+ * Lock interest decay periods, derived once from the consensus params.
+ *
+ * Period 0 starts with the total interest, and every period starts when the
+ * interest left drops to nine tenths of the previous start. Each period
+ * multiplies the lock interest rates by the decay ratio once more.
+ */
+class CInterestTable {
+public:
+    CInterestTable() {}
+    explicit CInterestTable(const Consensus::Params &params);
+
+    /** Period of the interest left, which must be positive */
+    size_t GetPeriod(CAmount nInterestLeft) const;
+    /** Interest left when nPeriod started */
+    CAmount GetPeriodStart(size_t nPeriod) const {
+        return vPeriodStart[nPeriod];
+    }
+    /** Rate level of a lock, -1 if it is too short to earn interest */
+    int GetLevel(uint32_t nLockBlocks) const;
+    /** Interest rate of a rate level in nPeriod */
+    double GetRate(int nLevel, size_t nPeriod) const {
+        return vRates[nLevel][nPeriod];
+    }
+    /** Interest earned by locking principal for nLockBlocks in nPeriod */
+    CAmount GetInterest(CAmount principal, uint32_t nLockBlocks,
+                        size_t nPeriod) const;
+
+private:
+    //! Interest left at the start of each period, descending
+    std::vector<CAmount> vPeriodStart;
+    //! Lock blocks needed for each rate level, ascending
+    std::vector<int> vLevelBlocks;
+    //! Rates of each level, by period
+    std::vector<std::vector<double>> vRates;
+    //! Lock blocks interest is paid for, ascending. A lock earns interest for
+    //! the longest one it reaches.
+    std::vector<int> vLockBlocks;
+    //! Interest per unit of principal for each entry of vLockBlocks, by
+    //! period: rate * lock blocks / blocks per interest interval
+    std::vector<std::vector<CInterestMultiplier>> vMultipliers;
+};
+
+/**
+ * The interest paid out up to every block of a chain, by height, and the
+ * heights the decay periods start at, so that questions about past blocks
+ * are a lookup rather than a walk of the block index.
+ *
+ * The rates of a block come from the interest left after its parent, so a
+ * period starts at the block after the one that brought the interest left
+ * down to its start. Blocks are appended and dropped at the tip only.
+ */
+class CInterestHistory {
+public:
+    /** Period of the blocks once all interest is paid out */
+    static const int NO_PERIOD = -1;
+
+    struct PeriodStart {
+        //! First block paying the rates of nPeriod
+        int nHeight;
+        //! The period, or NO_PERIOD
+        int nPeriod;
+    };
+
+    CInterestHistory(const CInterestTable &tableIn, CAmount nTotalInterestIn)
+        : table(tableIn), nTotalInterest(nTotalInterestIn) {}
+
+    /** Height of the last block, -1 without one */
+    int Height() const { return int(vChainInterest.size()) - 1; }
+
+    /** Append the block at Height() + 1 */
+    void Append(uint64_t nChainInterest);
+
+    /** Drop the blocks above nHeight */
+    void Truncate(int nHeight);
+
+    /** Interest paid out up to and including the block at nHeight */
+    bool GetChainInterest(int nHeight, uint64_t &nChainInterest) const;
+
+    /** Period whose rates the block at nHeight pays, Height() + 1 included */
+    bool GetPeriod(int nHeight, PeriodStart &start) const;
+
+    const std::vector<PeriodStart> &GetPeriodStarts() const {
+        return vPeriodStarts;
+    }
+
+    const CInterestTable &GetTable() const { return table; }
+
+private:
+    const CInterestTable &table;
+    const CAmount nTotalInterest;
+    std::vector<uint64_t> vChainInterest;
+    //! Ascending, one entry per change of period
+    std::vector<PeriodStart> vPeriodStarts;
+};
+
+#endif // BITCOIN_INTEREST_H
@@ -6,11 +6,13 @@
 #define BITCOIN_MEMUSAGE_H
 
 #include "indirectmap.h"
+#include "support/allocators/pool.h"
 
 #include <cstdlib>
 
 #include <map>
 #include <set>
+#include <string>
 #include <vector>
 
 #include <unordered_map>
@@ -107,6 +109,16 @@ static inline size_t DynamicUsage(const std::vector<X> &v) {
     return MallocUsage(v.capacity() * sizeof(X));
 }
 
+static inline size_t DynamicUsage(const std::string &s) {
+    // Short strings are stored inside the object itself.
+    const char *p = s.data();
+    if (p >= reinterpret_cast<const char *>(&s) &&
+        p < reinterpret_cast<const char *>(&s + 1)) {
+        return 0;
+    }
+    return MallocUsage(s.capacity() + 1);
+}
+
 template <unsigned int N, typename X, typename S, typename D>
 static inline size_t DynamicUsage(const prevector<N, X, S, D> &v) {
     return MallocUsage(v.allocated_memory());
@@ -172,12 +184,32 @@ static inline size_t DynamicUsage(const std::unordered_set<X, Y> &s) {
            MallocUsage(sizeof(void *) * s.bucket_count());
 }
 
-template <typename X, typename Y, typename Z>
-static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z> &m) {
+template <typename X, typename Y, typename Z, typename E>
+static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z, E> &m) {
     return MallocUsage(sizeof(unordered_node<std::pair<const X, Y>>)) *
                m.size() +
            MallocUsage(sizeof(void *) * m.bucket_count());
 }
+
+template <typename X, typename Y, typename Z, typename E,
+          size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+static inline size_t DynamicUsage(
+    const std::unordered_map<
+        X, Y, Z, E,
+        PoolAllocator<std::pair<const X, Y>, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>>
+        &m) {
+    auto *pResource = m.get_allocator().resource();
+    if (pResource == nullptr) {
+        return MallocUsage(sizeof(unordered_node<std::pair<const X, Y>>)) *
+                   m.size() +
+               MallocUsage(sizeof(void *) * m.bucket_count());
+    }
+    // The pool less what is free in it. Freed nodes are held on to, but are
+    // reused before the pool grows again.
+    return MallocUsage(pResource->ChunkSizeBytes()) * pResource->NumChunks() -
+           pResource->NumFreeBytes() +
+           MallocUsage(sizeof(void *) * m.bucket_count());
+}
 }
 
 #endif // BITCOIN_MEMUSAGE_H
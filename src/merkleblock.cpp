@@ -6,9 +6,66 @@
 #include "merkleblock.h"
 
 #include "consensus/consensus.h"
+#include "core_memusage.h"
 #include "hash.h"
+#include "memusage.h"
 #include "utilstrencodings.h"
 
+static std::vector<uint256> GetTxids(const CBlock &block) {
+    std::vector<uint256> vTxid;
+    vTxid.reserve(block.vtx.size());
+    for (const CTransactionRef &tx : block.vtx) {
+        vTxid.push_back(tx->GetId());
+    }
+    return vTxid;
+}
+
+CMerkleTreeLevels::CMerkleTreeLevels(const std::vector<uint256> &vTxid) {
+    vLevels.push_back(vTxid);
+    // Each level up, a node hashes its two children, or its only child twice
+    // at the end of an odd level.
+    while (vLevels.back().size() > 1) {
+        const std::vector<uint256> &vBelow = vLevels.back();
+        std::vector<uint256> vLevel;
+        vLevel.reserve((vBelow.size() + 1) / 2);
+        for (size_t i = 0; i < vBelow.size(); i += 2) {
+            const uint256 &left = vBelow[i];
+            const uint256 &right = i + 1 < vBelow.size() ? vBelow[i + 1] : left;
+            vLevel.push_back(
+                Hash(BEGIN(left), END(left), BEGIN(right), END(right)));
+        }
+        vLevels.push_back(std::move(vLevel));
+    }
+}
+
+size_t CMerkleTreeLevels::DynamicMemoryUsage() const {
+    size_t nUsage = memusage::DynamicUsage(vLevels);
+    for (const std::vector<uint256> &vLevel : vLevels) {
+        nUsage += memusage::DynamicUsage(vLevel);
+    }
+    return nUsage;
+}
+
+CFilterableBlock::CFilterableBlock(const CBlock &block)
+    : header(block.GetBlockHeader()), vtx(block.vtx), levels(GetTxids(block)) {
+    vElements.reserve(vtx.size());
+    for (const CTransactionRef &tx : vtx) {
+        vElements.emplace_back(*tx);
+    }
+}
+
+size_t CFilterableBlock::DynamicMemoryUsage() const {
+    size_t nUsage = memusage::DynamicUsage(vtx) + levels.DynamicMemoryUsage() +
+                    memusage::DynamicUsage(vElements);
+    for (const CTransactionRef &tx : vtx) {
+        nUsage += RecursiveDynamicUsage(tx);
+    }
+    for (const CBloomTxElements &elements : vElements) {
+        nUsage += elements.DynamicMemoryUsage();
+    }
+    return nUsage;
+}
+
 CMerkleBlock::CMerkleBlock(const CBlock &block, CBloomFilter &filter) {
     header = block.GetBlockHeader();
 
@@ -31,6 +88,22 @@ CMerkleBlock::CMerkleBlock(const CBlock &block, CBloomFilter &filter) {
     txn = CPartialMerkleTree(vHashes, vMatch);
 }
 
+CMerkleBlock::CMerkleBlock(const CFilterableBlock &block,
+                           CBloomFilter &filter) {
+    header = block.header;
+
+    std::vector<bool> vMatch(block.vtx.size(), false);
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        if (filter.IsRelevantAndUpdate(block.vElements[i])) {
+            vMatch[i] = true;
+            vMatchedTxn.push_back(
+                std::make_pair(i, block.levels.GetHash(0, i)));
+        }
+    }
+
+    txn = CPartialMerkleTree(block.levels, vMatch);
+}
+
 CMerkleBlock::CMerkleBlock(const CBlock &block,
                            const std::set<uint256> &txids) {
     header = block.GetBlockHeader();
@@ -94,6 +167,23 @@ void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos,
     }
 }
 
+void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos,
+                                          const CMerkleTreeLevels &levels,
+                                          const std::vector<bool> &vMatch) {
+    bool fParentOfMatch = false;
+    for (unsigned int p = pos << height;
+         p < (pos + 1) << height && p < nTransactions; p++)
+        fParentOfMatch |= vMatch[p];
+    vBits.push_back(fParentOfMatch);
+    if (height == 0 || !fParentOfMatch) {
+        vHash.push_back(levels.GetHash(height, pos));
+    } else {
+        TraverseAndBuild(height - 1, pos * 2, levels, vMatch);
+        if (pos * 2 + 1 < CalcTreeWidth(height - 1))
+            TraverseAndBuild(height - 1, pos * 2 + 1, levels, vMatch);
+    }
+}
+
 uint256 CPartialMerkleTree::TraverseAndExtract(
     int height, unsigned int pos, unsigned int &nBitsUsed,
     unsigned int &nHashUsed, std::vector<uint256> &vMatch,
@@ -157,6 +247,12 @@ CPartialMerkleTree::CPartialMerkleTree(const std::vector<uint256> &vTxid,
     TraverseAndBuild(nHeight, 0, vTxid, vMatch);
 }
 
+CPartialMerkleTree::CPartialMerkleTree(const CMerkleTreeLevels &levels,
+                                       const std::vector<bool> &vMatch)
+    : nTransactions(levels.GetTransactionCount()), fBad(false) {
+    TraverseAndBuild(levels.GetHeight(), 0, levels, vMatch);
+}
+
 CPartialMerkleTree::CPartialMerkleTree() : nTransactions(0), fBad(true) {}
 
 uint256 CPartialMerkleTree::ExtractMatches(std::vector<uint256> &vMatch,
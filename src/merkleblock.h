@@ -13,6 +13,27 @@
 
 #include <vector>
 
+/**
+ * Every node hash of the merkle tree of a block, the txids at height 0, so
+ * that the partial merkle trees of the block for many filters can be built
+ * without hashing again.
+ */
+class CMerkleTreeLevels {
+public:
+    explicit CMerkleTreeLevels(const std::vector<uint256> &vTxid);
+
+    unsigned int GetTransactionCount() const { return vLevels[0].size(); }
+    int GetHeight() const { return vLevels.size() - 1; }
+    const uint256 &GetHash(int height, unsigned int pos) const {
+        return vLevels[height][pos];
+    }
+
+    size_t DynamicMemoryUsage() const;
+
+private:
+    std::vector<std::vector<uint256>> vLevels;
+};
+
 /**
  * Data structure that represents a partial merkle tree.
  *
@@ -79,6 +100,10 @@ protected:
     void TraverseAndBuild(int height, unsigned int pos,
                           const std::vector<uint256> &vTxid,
                           const std::vector<bool> &vMatch);
+    /** The same, taking the hashes from levels. */
+    void TraverseAndBuild(int height, unsigned int pos,
+                          const CMerkleTreeLevels &levels,
+                          const std::vector<bool> &vMatch);
 
     /**
      * Recursive function that traverses tree nodes, consuming the bits and
@@ -118,6 +143,9 @@ public:
      * mask that selects a subset of them. */
     CPartialMerkleTree(const std::vector<uint256> &vTxid,
                        const std::vector<bool> &vMatch);
+    /** The same, from every node hash of the tree. */
+    CPartialMerkleTree(const CMerkleTreeLevels &levels,
+                       const std::vector<bool> &vMatch);
 
     CPartialMerkleTree();
 
@@ -130,6 +158,21 @@ public:
                            std::vector<unsigned int> &vnIndex);
 };
 
+/**
+ * A block prepared to be filtered for many peers: its merkle tree is hashed,
+ * and the elements filters match are taken out of its transactions.
+ */
+struct CFilterableBlock {
+    CBlockHeader header;
+    std::vector<CTransactionRef> vtx;
+    CMerkleTreeLevels levels;
+    std::vector<CBloomTxElements> vElements;
+
+    explicit CFilterableBlock(const CBlock &block);
+
+    size_t DynamicMemoryUsage() const;
+};
+
 /**
  * Used to relay blocks as header + vector<merkle branch>
  * to filtered nodes.
@@ -150,9 +193,15 @@ public:
      * transaction, thus the filter will likely be modified.
      */
     CMerkleBlock(const CBlock &block, CBloomFilter &filter);
+    /** The same, from a block prepared for it. */
+    CMerkleBlock(const CFilterableBlock &block, CBloomFilter &filter);
 
     // Create from a CBlock, matching the txids in the set.
     CMerkleBlock(const CBlock &block, const std::set<uint256> &txids);
+    /** Create from the merkle tree of a block, matching vMatch. */
+    CMerkleBlock(const CBlockHeader &headerIn, const CMerkleTreeLevels &levels,
+                 const std::vector<bool> &vMatch)
+        : header(headerIn), txn(levels, vMatch) {}
 
     CMerkleBlock() {}
 
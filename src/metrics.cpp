@@ -0,0 +1,145 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "metrics.h"
+
+#include "tinyformat.h"
+
+#include <algorithm>
+#include <cassert>
+
+CMetricsRegistry metrics;
+
+CMetricHistogram::CMetricHistogram(const std::vector<int64_t> &vBoundsIn)
+    : vBounds(vBoundsIn),
+      vCounts(new std::atomic<uint64_t>[vBoundsIn.size() + 1]), nSumMicros(0) {
+    for (size_t i = 0; i <= vBounds.size(); i++) {
+        vCounts[i] = 0;
+    }
+}
+
+void CMetricHistogram::Observe(int64_t nMicros) {
+    const size_t nBucket =
+        std::lower_bound(vBounds.begin(), vBounds.end(), nMicros) -
+        vBounds.begin();
+    vCounts[nBucket].fetch_add(1, std::memory_order_relaxed);
+    nSumMicros.fetch_add(nMicros, std::memory_order_relaxed);
+}
+
+std::string CMetricHistogram::ToPrometheus(const std::string &strName) const {
+    std::string str;
+    uint64_t nCount = 0;
+    for (size_t i = 0; i < vBounds.size(); i++) {
+        nCount += vCounts[i].load(std::memory_order_relaxed);
+        str += strprintf("%s_bucket{le=\"%.6f\"} %u\n", strName,
+                         vBounds[i] / 1e6, nCount);
+    }
+    nCount += vCounts[vBounds.size()].load(std::memory_order_relaxed);
+    str += strprintf("%s_bucket{le=\"+Inf\"} %u\n", strName, nCount);
+    str += strprintf("%s_sum %.6f\n", strName,
+                     nSumMicros.load(std::memory_order_relaxed) / 1e6);
+    str += strprintf("%s_count %u\n", strName, nCount);
+    return str;
+}
+
+std::vector<int64_t> GetShortLatencyBounds() {
+    return {100,    250,    500,     1000,    2500,    5000,    10000,
+            25000,  50000,  100000,  250000,  500000,  1000000, 2500000,
+            5000000, 10000000};
+}
+
+CMetricsRegistry::Family &
+CMetricsRegistry::GetFamily(const std::string &strName, Type type,
+                            const std::string &strHelp) {
+    auto it = mapFamilies.find(strName);
+    if (it == mapFamilies.end()) {
+        it = mapFamilies.emplace(strName, Family()).first;
+        it->second.type = type;
+        it->second.strHelp = strHelp;
+    }
+    assert(it->second.type == type);
+    return it->second;
+}
+
+CMetricValue &CMetricsRegistry::Value(Type type, const std::string &strName,
+                                      const std::string &strHelp,
+                                      const std::string &strLabels) {
+    assert(type != HISTOGRAM);
+    std::lock_guard<std::mutex> lock(cs);
+    Family &family = GetFamily(strName, type, strHelp);
+    std::unique_ptr<CMetricValue> &value = family.mapValues[strLabels];
+    if (!value) {
+        value.reset(new CMetricValue());
+    }
+    return *value;
+}
+
+CMetricHistogram &
+CMetricsRegistry::Histogram(const std::string &strName,
+                            const std::string &strHelp,
+                            const std::vector<int64_t> &vBounds) {
+    std::lock_guard<std::mutex> lock(cs);
+    Family &family = GetFamily(strName, HISTOGRAM, strHelp);
+    if (!family.histogram) {
+        family.histogram.reset(new CMetricHistogram(vBounds));
+    }
+    return *family.histogram;
+}
+
+void CMetricsRegistry::Gauge(const std::string &strName,
+                             const std::string &strHelp,
+                             std::function<double()> fn) {
+    std::lock_guard<std::mutex> lock(cs);
+    GetFamily(strName, GAUGE, strHelp).fnGauge = std::move(fn);
+}
+
+void CMetricsRegistry::Collector(std::function<std::string()> fn) {
+    std::lock_guard<std::mutex> lock(cs);
+    vCollectors.push_back(std::move(fn));
+}
+
+std::string CMetricsRegistry::ToPrometheus() const {
+    static const char *const TYPE_NAMES[] = {"counter", "gauge", "histogram"};
+
+    // Gauge functions and collectors are called without the lock, they may
+    // take others.
+    std::vector<std::pair<std::string, std::function<double()>>> vParts;
+    std::vector<std::function<std::string()>> vCollect;
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        for (const auto &it : mapFamilies) {
+            const Family &family = it.second;
+            std::string str =
+                strprintf("# HELP %s %s\n# TYPE %s %s\n", it.first,
+                          family.strHelp, it.first, TYPE_NAMES[family.type]);
+            if (family.histogram) {
+                str += family.histogram->ToPrometheus(it.first);
+            }
+            for (const auto &value : family.mapValues) {
+                str += value.first.empty()
+                           ? strprintf("%s %d\n", it.first,
+                                       value.second->Get())
+                           : strprintf("%s{%s} %d\n", it.first, value.first,
+                                       value.second->Get());
+            }
+            if (family.fnGauge) {
+                str += it.first + " ";
+            }
+            vParts.emplace_back(std::move(str), family.fnGauge);
+        }
+        vCollect = vCollectors;
+    }
+
+    std::string str;
+    for (const auto &part : vParts) {
+        str += part.first;
+        if (part.second) {
+            str += strprintf("%.15g\n", part.second());
+        }
+    }
+    for (const auto &fn : vCollect) {
+        str += fn();
+    }
+    return str;
+}
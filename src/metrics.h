@@ -0,0 +1,105 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_METRICS_H
+#define BITCOIN_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * A number /metrics exports. Counters only ever grow, gauges are set to
+ * what they measure.
+ */
+class CMetricValue {
+public:
+    CMetricValue() : nValue(0) {}
+
+    void Add(int64_t n = 1) { nValue.fetch_add(n, std::memory_order_relaxed); }
+    void Set(int64_t n) { nValue.store(n, std::memory_order_relaxed); }
+    int64_t Get() const { return nValue.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> nValue;
+};
+
+/** Durations counted in buckets, with their sum */
+class CMetricHistogram {
+public:
+    //! vBoundsIn are the upper bounds of the buckets in microseconds, sorted
+    explicit CMetricHistogram(const std::vector<int64_t> &vBoundsIn);
+
+    void Observe(int64_t nMicros);
+    /** The samples in the Prometheus text format */
+    std::string ToPrometheus(const std::string &strName) const;
+
+private:
+    const std::vector<int64_t> vBounds;
+    //! One per bound and one for the rest, not cumulative
+    std::unique_ptr<std::atomic<uint64_t>[]> vCounts;
+    std::atomic<int64_t> nSumMicros;
+};
+
+/** Bounds of the histograms of short operations, from 100us to 10s */
+std::vector<int64_t> GetShortLatencyBounds();
+
+/**
+ * The metrics of the node, that /metrics serves in the Prometheus text
+ * format.
+ *
+ * Counters and histograms are updated where things happen, with a relaxed
+ * atomic add. Values that are cheap to read when scraped, like the size of
+ * the mempool, are gauges computed by a function instead. Metrics are
+ * registered once and never removed, so the references handed out stay
+ * valid.
+ */
+class CMetricsRegistry {
+public:
+    enum Type { COUNTER, GAUGE, HISTOGRAM };
+
+    /**
+     * The counter or gauge strName with the labels strLabels, like
+     * command="tx", registered on first use.
+     */
+    CMetricValue &Value(Type type, const std::string &strName,
+                        const std::string &strHelp,
+                        const std::string &strLabels = "");
+    CMetricHistogram &Histogram(const std::string &strName,
+                                const std::string &strHelp,
+                                const std::vector<int64_t> &vBounds);
+    /** A gauge that is the value of fn when scraped */
+    void Gauge(const std::string &strName, const std::string &strHelp,
+               std::function<double()> fn);
+    /** Metrics written by fn, in the Prometheus text format */
+    void Collector(std::function<std::string()> fn);
+
+    std::string ToPrometheus() const;
+
+private:
+    struct Family {
+        Type type;
+        std::string strHelp;
+        //! By labels
+        std::map<std::string, std::unique_ptr<CMetricValue>> mapValues;
+        std::unique_ptr<CMetricHistogram> histogram;
+        std::function<double()> fnGauge;
+    };
+
+    mutable std::mutex cs;
+    std::map<std::string, Family> mapFamilies;
+    std::vector<std::function<std::string()>> vCollectors;
+
+    Family &GetFamily(const std::string &strName, Type type,
+                      const std::string &strHelp);
+};
+
+extern CMetricsRegistry metrics;
+
+#endif // BITCOIN_METRICS_H
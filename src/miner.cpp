@@ -5,6 +5,7 @@
 
 #include "miner.h"
 
+#include "affinity.h"
 #include "amount.h"
 #include "chain.h"
 #include "chainparams.h"
@@ -13,6 +14,8 @@
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "core_memusage.h"
+#include "ethashcache.h"
 #include "hash.h"
 #include "net.h"
 #include "policy/policy.h"
@@ -20,6 +23,7 @@
 #include "primitives/transaction.h"
 #include "script/standard.h"
 #include "timedata.h"
+#include "trace.h"
 #include "txmempool.h"
 #include "base58.h"
 #include "util.h"
@@ -37,9 +41,21 @@
 
 #include "wallet/wallet.h"
 
+TRACE_SEMAPHORE(mining, create_new_block);
+TRACE_SEMAPHORE(mining, add_work);
+TRACE_SEMAPHORE(mining, submit_work);
+TRACE_SEMAPHORE(mining, dag_progress);
+
 using namespace std;
 
 static const int MAX_COINBASE_SCRIPTSIG_SIZE = 100;
+/** Milliseconds over which each mining thread measures its hashrate */
+static const int64_t MINER_HASHRATE_WINDOW = 4000;
+/** Seconds after which an eth_submitHashrate report no longer counts */
+static const int64_t EXTERNAL_HASHRATE_TIMEOUT = 120;
+
+//! Progress of the DAG being generated, for getmininginfo
+static std::atomic<unsigned> nDagProgress(0);
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -106,6 +122,13 @@ static uint64_t ComputeMaxGeneratedBlockSize(const Config &config,
     return nMaxGeneratedBlockSize;
 }
 
+static uint64_t ComputeMaxBlockContentSize(uint64_t nMaxGeneratedBlockSize) {
+    uint64_t nPercentage = std::min<int64_t>(
+        100, std::max<int64_t>(0, GetArg("-blockcontentpercentage",
+                                         DEFAULT_BLOCK_CONTENT_PERCENTAGE)));
+    return nMaxGeneratedBlockSize * nPercentage / 100;
+}
+
 BlockAssembler::BlockAssembler(const Config &_config,
                                const CChainParams &_chainparams)
     : chainparams(_chainparams), config(&_config) {
@@ -120,6 +143,7 @@ BlockAssembler::BlockAssembler(const Config &_config,
     LOCK(cs_main);
     nMaxGeneratedBlockSize =
         ComputeMaxGeneratedBlockSize(*config, chainActive.Tip());
+    nMaxBlockContentSize = ComputeMaxBlockContentSize(nMaxGeneratedBlockSize);
 }
 
 void BlockAssembler::resetBlock() {
@@ -127,15 +151,27 @@ void BlockAssembler::resetBlock() {
 
     // Reserve space for coinbase tx.
     nBlockSize = 1000;
+    nBlockContentSize = 0;
     nBlockSigOps = 100;
 
     // These counters do not include coinbase tx.
     nBlockTx = 0;
     nFees = CAmount(0);
     nInterest = CAmount(0);
+    nInterestLeft = CAmount(0);
 
     lastFewTxs = 0;
     blockFinished = false;
+
+    nDeadline = 0;
+    fPartial = false;
+}
+
+bool BlockAssembler::BudgetExceeded() {
+    if (nDeadline != 0 && GetTimeMicros() > nDeadline) {
+        fPartial = true;
+    }
+    return fPartial;
 }
 
 static const std::vector<uint8_t>
@@ -147,10 +183,14 @@ getExcessiveBlockSizeSig(const Config &config) {
 }
 
 std::unique_ptr<CBlockTemplate>
-BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
+BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn,
+                               int64_t nBudgetMicros) {
     int64_t nTimeStart = GetTimeMicros();
 
     resetBlock();
+    if (nBudgetMicros > 0) {
+        nDeadline = nTimeStart + nBudgetMicros;
+    }
 
     pblocktemplate.reset(new CBlockTemplate());
     if (!pblocktemplate.get()) {
@@ -170,6 +210,9 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
     LOCK2(cs_main, mempool.cs);
     CBlockIndex *pindexPrev = chainActive.Tip();
     nHeight = pindexPrev->nHeight + 1;
+    nInterestLeft = std::max<CAmount>(
+        0, CAmount(chainparams.TotalInterest()) -
+               CAmount(pindexPrev->nChainInterest));
 
     pblock->nVersion =
         ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
@@ -182,6 +225,7 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
     pblock->nTime = GetAdjustedTime();
     pblock->nBlockHeight = chainActive.Height() + 1;
     nMaxGeneratedBlockSize = ComputeMaxGeneratedBlockSize(*config, pindexPrev);
+    nMaxBlockContentSize = ComputeMaxBlockContentSize(nMaxGeneratedBlockSize);
 
     nLockTimeCutoff = pblock->GetBlockTime();
 
@@ -219,6 +263,11 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
 
     LogPrintf("CreateNewBlock(): total size: %u txs: %u fees: %ld sigops %d\n",
               nSerializeSize, nBlockTx, nFees, nBlockSigOps);
+    if (fPartial) {
+        LogPrint("miner", "CreateNewBlock(): stopped adding transactions "
+                          "after %dus\n",
+                 nBudgetMicros);
+    }
 
     // Fill in header.
     pblock->hashPrevBlock = pindexPrev->GetBlockHash();
@@ -229,6 +278,9 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
 
     pblocktemplate->vTxSigOpsCount[0] =
         GetSigOpCountWithoutP2SH(*pblock->vtx[0]);
+    // Only the coinbase changes from a job to the next, the rest of the tree
+    // is hashed once here.
+    pblocktemplate->vCoinbaseMerkleBranch = BlockMerkleBranch(*pblock, 0);
 
     CValidationState state;
     if (!TestBlockValidity(*config, state, *pblock, pindexPrev, false, false)) {
@@ -244,6 +296,8 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
              0.001 * (nTime1 - nTimeStart), nPackagesSelected,
              nDescendantsUpdated, 0.001 * (nTime2 - nTime1),
              0.001 * (nTime2 - nTimeStart));
+    TRACE6(mining, create_new_block, nHeight, nBlockTx, nSerializeSize, nFees,
+           nTime1 - nTimeStart, nTime2 - nTimeStart);
 
     return std::move(pblocktemplate);
 }
@@ -257,19 +311,26 @@ bool BlockAssembler::isStillDependent(CTxMemPool::txiter iter) {
     return false;
 }
 
-void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries &testSet) {
-    for (CTxMemPool::setEntries::iterator iit = testSet.begin();
-         iit != testSet.end();) {
-        // Only test txs not already in the block.
-        if (inBlock.count(*iit)) {
-            testSet.erase(iit++);
-        } else {
-            iit++;
+void BlockAssembler::CalculateUnconfirmedAncestors(
+    CTxMemPool::txiter iter, CTxMemPool::setEntries &ancestors) {
+    // Every ancestor of an inBlock entry is inBlock too, as packages are added
+    // with all their ancestors and priority txs only once their parents are.
+    // So the walk can stop at inBlock parents, which keeps it proportional to
+    // the package instead of the whole in-mempool ancestry.
+    std::vector<CTxMemPool::txiter> vToVisit(1, iter);
+    while (!vToVisit.empty()) {
+        CTxMemPool::txiter entry = vToVisit.back();
+        vToVisit.pop_back();
+        for (CTxMemPool::txiter parent : mempool.GetMemPoolParents(entry)) {
+            if (!inBlock.count(parent) && ancestors.insert(parent).second) {
+                vToVisit.push_back(parent);
+            }
         }
     }
 }
 
-bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOps) {
+bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOps,
+                                 CAmount packageInterest) {
     auto blockSizeWithPackage = nBlockSize + packageSize;
     if (blockSizeWithPackage >= nMaxGeneratedBlockSize) {
         return false;
@@ -278,24 +339,35 @@ bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOps) {
         GetMaxBlockSigOpsCount(blockSizeWithPackage)) {
         return false;
     }
+    // The mempool keeps the interest of each entry valid for the next block,
+    // only the total left is checked here.
+    if (nInterest + packageInterest > nInterestLeft) {
+        return false;
+    }
     return true;
 }
 
 // Perform transaction-level checks before adding to block:
 // - transaction finality (locktime)
 // - serialized size (in case -blockmaxsize is in use)
+// - content share (-blockcontentpercentage)
 bool BlockAssembler::TestPackageTransactions(
     const CTxMemPool::setEntries &package) {
     uint64_t nPotentialBlockSize = nBlockSize;
+    uint64_t nPotentialContentSize = nBlockContentSize;
     for (const CTxMemPool::txiter it : package) {
+        nPotentialContentSize += it->GetContentSize();
+        if (nPotentialContentSize > nMaxBlockContentSize) {
+            return false;
+        }
+
         CValidationState state;
         if (!ContextualCheckTransaction(*config, it->GetTx(), state, nHeight,
                                         nLockTimeCutoff)) {
             return false;
         }
 
-        uint64_t nTxSize =
-            ::GetSerializeSize(it->GetTx(), SER_NETWORK, PROTOCOL_VERSION);
+        uint64_t nTxSize = it->GetTx().GetTotalSize();
         if (nPotentialBlockSize + nTxSize >= nMaxGeneratedBlockSize) {
             return false;
         }
@@ -307,9 +379,7 @@ bool BlockAssembler::TestPackageTransactions(
 }
 
 bool BlockAssembler::TestForBlock(CTxMemPool::txiter it) {
-    auto blockSizeWithTx =
-        nBlockSize +
-        ::GetSerializeSize(it->GetTx(), SER_NETWORK, PROTOCOL_VERSION);
+    auto blockSizeWithTx = nBlockSize + it->GetTx().GetTotalSize();
     if (blockSizeWithTx >= nMaxGeneratedBlockSize) {
         if (nBlockSize > nMaxGeneratedBlockSize - 100 || lastFewTxs > 50) {
             blockFinished = true;
@@ -336,6 +406,10 @@ bool BlockAssembler::TestForBlock(CTxMemPool::txiter it) {
         return false;
     }
 
+    if (nInterest + it->GetInterest() > nInterestLeft) {
+        return false;
+    }
+
     // Must check that lock times are still valid. This can be removed once MTP
     // is always enforced as long as reorgs keep the mempool consistent.
     CValidationState state;
@@ -352,6 +426,7 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter) {
     pblocktemplate->vTxFees.push_back(iter->GetFee());
     pblocktemplate->vTxSigOpsCount.push_back(iter->GetSigOpCount());
     nBlockSize += iter->GetTxSize();
+    nBlockContentSize += iter->GetContentSize();
     ++nBlockTx;
     nBlockSigOps += iter->GetSigOpCount();
     nFees += iter->GetFee();
@@ -389,6 +464,7 @@ int BlockAssembler::UpdatePackagesForAdded(
                 modEntry.nSizeWithAncestors -= it->GetTxSize();
                 modEntry.nModFeesWithAncestors -= it->GetModifiedFee();
                 modEntry.nSigOpCountWithAncestors -= it->GetSigOpCount();
+                modEntry.nInterestWithAncestors -= it->GetInterest();
                 mapModifiedTx.insert(modEntry);
             } else {
                 mapModifiedTx.modify(mit, update_for_parent_inclusion(it));
@@ -461,6 +537,10 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected,
 
     while (mi != mempool.mapTx.get<ancestor_score>().end() ||
            !mapModifiedTx.empty()) {
+        if (BudgetExceeded()) {
+            return;
+        }
+
         // First try to find a new transaction in mapTx to evaluate.
         if (mi != mempool.mapTx.get<ancestor_score>().end() &&
             SkipMapTxEntry(mempool.mapTx.project<0>(mi), mapModifiedTx,
@@ -501,10 +581,12 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected,
         uint64_t packageSize = iter->GetSizeWithAncestors();
         CAmount packageFees = iter->GetModFeesWithAncestors();
         int64_t packageSigOps = iter->GetSigOpCountWithAncestors();
+        CAmount packageInterest = iter->GetInterestWithAncestors();
         if (fUsingModified) {
             packageSize = modit->nSizeWithAncestors;
             packageFees = modit->nModFeesWithAncestors;
             packageSigOps = modit->nSigOpCountWithAncestors;
+            packageInterest = modit->nInterestWithAncestors;
         }
 
         if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
@@ -512,7 +594,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected,
             return;
         }
 
-        if (!TestPackage(packageSize, packageSigOps)) {
+        if (!TestPackage(packageSize, packageSigOps, packageInterest)) {
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx, we
                 // must erase failed entries so that we can consider the next
@@ -532,13 +614,19 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected,
             continue;
         }
 
-        CTxMemPool::setEntries ancestors;
-        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
-        std::string dummy;
-        mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit,
-                                          nNoLimit, nNoLimit, dummy, false);
+        // Once the content share is used up, fail content packages before
+        // walking their ancestors.
+        if (nBlockContentSize + iter->GetContentSize() >
+            nMaxBlockContentSize) {
+            if (fUsingModified) {
+                mapModifiedTx.get<ancestor_score>().erase(modit);
+                failedTx.insert(iter);
+            }
+            continue;
+        }
 
-        onlyUnconfirmed(ancestors);
+        CTxMemPool::setEntries ancestors;
+        CalculateUnconfirmedAncestors(iter, ancestors);
         ancestors.insert(iter);
 
         // Test if all tx's are Final.
@@ -604,7 +692,7 @@ void BlockAssembler::addPriorityTxs() {
 
     // Add a tx from priority queue to fill the part of block reserved to
     // priority transactions.
-    while (!vecPriority.empty() && !blockFinished) {
+    while (!vecPriority.empty() && !blockFinished && !BudgetExceeded()) {
         iter = vecPriority.front().second;
         actualPriority = vecPriority.front().first;
         std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
@@ -617,6 +705,12 @@ void BlockAssembler::addPriorityTxs() {
             continue;
         }
 
+        // Coin age says nothing about the cost of content, which must win
+        // its place on feerate.
+        if (iter->GetContentSize() > 0) {
+            continue;
+        }
+
         // If tx is dependent on other mempool txs which haven't yet been
         // included then put it in the waitSet.
         if (isStillDependent(iter)) {
@@ -655,6 +749,14 @@ void BlockAssembler::addPriorityTxs() {
 void IncrementExtraNonce(const Config &config, CBlock *pblock,
                          const CBlockIndex *pindexPrev,
                          unsigned int &nExtraNonce) {
+    IncrementExtraNonce(config, pblock, pindexPrev, nExtraNonce,
+                        BlockMerkleBranch(*pblock, 0));
+}
+
+void IncrementExtraNonce(const Config &config, CBlock *pblock,
+                         const CBlockIndex *pindexPrev,
+                         unsigned int &nExtraNonce,
+                         const std::vector<uint256> &vCoinbaseMerkleBranch) {
     // Update nExtraNonce
     static uint256 hashPrevBlock;
     if (hashPrevBlock != pblock->hashPrevBlock) {
@@ -672,7 +774,8 @@ void IncrementExtraNonce(const Config &config, CBlock *pblock,
 //    assert(txCoinbase.vin[0].scriptSig.size() <= MAX_COINBASE_SCRIPTSIG_SIZE);
 
 //    pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
-    pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
+    pblock->hashMerkleRoot = ComputeMerkleRootFromBranch(
+        pblock->vtx[0]->GetId(), vCoinbaseMerkleBranch, 0);
 }
 
 CCriticalSection cs_miner;
@@ -686,27 +789,47 @@ MineWorker::MineWorker(const Config &_config):config(&_config)
     fPoolMiningFinished = true;
 
     nThreads      = -1;
-    dHashesPerSec = 0.0;
+    fGpuBackendsCreated = false;
+
+    nJobs               = 0;
+    nStaleJobs          = 0;
+    nBlocksFound        = 0;
+    nBlocksRejected     = 0;
+    nDagEpochGenerating = -1;
 
     currentTemplate = NULL;
+    nTemplateTransactionsUpdated = 0;
+    nTemplateTime   = 0;
+    fTemplatePartial = false;
     minerThreads    = NULL;
     workDispatcher  = NULL;
     dagGenerator    = NULL;
 
-    mapEpochLight.clear();
-    mapEpochLight.clear();
-    listWork.clear();
+    nTipHeight = -1;
+    nEvents    = 0;
+
+    mapEpochFull.clear();
+    nMemoryBudget = uint64_t(std::max<int64_t>(0, GetArg("-minermemory", DEFAULT_MINER_MEMORY))) << 20;
+    if (GetBoolArg("-dagnuma", DEFAULT_DAG_NUMA)) {
+        vNumaCpus = GetNumaNodeCpus();
+    }
+    if (vNumaCpus.size() < 2) {
+        vNumaCpus.clear();
+    }
+
+    RegisterValidationInterface(this);
 }
 
 MineWorker::~MineWorker()
 {
+    UnregisterValidationInterface(this);
+
     if (currentTemplate){
         delete currentTemplate;
         currentTemplate = NULL;
     }
 
     DestroyEthashFull();
-    DestroyEthashLight();
 }
 
 /*
@@ -724,6 +847,36 @@ CBitcoinAddress MineWorker::GetMinerAddress()
 }
 */
 
+void MineWorker::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    // Hashing threads poll nTipHeight, so they drop stale work right away
+    nTipHeight = pindexNew->nHeight;
+    NotifyEvent();
+}
+
+void MineWorker::NotifyEvent()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs_events);
+        nEvents++;
+    }
+    cvEvents.notify_all();
+}
+
+uint64_t MineWorker::GetEventCount()
+{
+    boost::unique_lock<boost::mutex> lock(cs_events);
+    return nEvents;
+}
+
+uint64_t MineWorker::WaitForEvent(uint64_t nSeen, int64_t nTimeoutMs)
+{
+    boost::unique_lock<boost::mutex> lock(cs_events);
+    cvEvents.timed_wait(lock, boost::posix_time::milliseconds(nTimeoutMs),
+                        [&]{ return nEvents != nSeen || !fGenerate; });
+    return nEvents;
+}
+
 int MineWorker::GetThreads()
 {
     return nThreads;
@@ -772,6 +925,7 @@ void MineWorker::PlatopiaMinerPoolStart(uint64_t nMaxTries)
     LogPrintf("PlatoPiaMinerPoolStart \n");
 
     fGenerate = true;
+    nTipHeight = chainActive.Height();
     if (nThreads < 0) {
         // In regtest threads defaults to 1
         if (Params().DefaultMinerThreads())
@@ -787,18 +941,35 @@ void MineWorker::PlatopiaMinerPoolStart(uint64_t nMaxTries)
         delete minerThreads; minerThreads = NULL;
     }
 
-    if (nThreads == 0 || !fGenerate) {
+    if (!fGpuBackendsCreated) {
+        vGpuBackends = CreateGpuMinerBackends();
+        fGpuBackendsCreated = true;
+    }
+
+    if ((nThreads == 0 && vGpuBackends.empty()) || !fGenerate) {
         fGenerate = false;
         LogPrintf("nThreads: %d\tfGenerate: %s\n", nThreads, fGenerate ? "true":"false");
         return;
     }
-    dHashesPerSec = 0.0;
 
-    LogPrintf("PlatopiaMinerPoolStart threads %d\n", nThreads);
+    LogPrintf("PlatopiaMinerPoolStart threads %d gpus %u\n", nThreads, vGpuBackends.size());
+    if (!vNumaCpus.empty()) {
+        LogPrintf("Spreading mining threads over %u NUMA nodes\n", vNumaCpus.size());
+    }
 
+    LOCK(cs_stats);
+    vThreadStats.clear();
     minerThreads = new boost::thread_group();
+    std::shared_ptr<CMinerBackend> cpu = std::make_shared<CCpuMinerBackend>();
     for (int i = 0; i < nThreads; i++) {
-        minerThreads->create_thread(boost::bind(&(MineWorker::doWork), this, nMaxTries));
+        int nNode = vNumaCpus.empty() ? -1 : i % vNumaCpus.size();
+        vThreadStats.push_back(std::make_shared<MinerThreadStats>(cpu->GetName()));
+        minerThreads->create_thread(boost::bind(&(MineWorker::doWork), this, nMaxTries, nNode, cpu, vThreadStats.back()));
+    }
+    // One thread drives each GPU, on the first node's DAG
+    for (const auto &gpu : vGpuBackends) {
+        vThreadStats.push_back(std::make_shared<MinerThreadStats>(gpu->GetName()));
+        minerThreads->create_thread(boost::bind(&(MineWorker::doWork), this, nMaxTries, -1, gpu, vThreadStats.back()));
     }
 
     return;
@@ -808,14 +979,28 @@ void MineWorker::dagGeneratorWork(MineWorker *worker)
 {
     RenameThread("dagGeneratorWork");
 
+    const int64_t nPregenerate = GetArg("-dagpregenerate", DEFAULT_DAG_PREGENERATE_BLOCKS);
+    const int64_t nEpochLength = ethash_get_epoch_length();
+    uint64_t nEvent = worker->GetEventCount();
     while (worker->fGenerate) {
-        if (worker->GetEthashFull(chainActive.Height()) == NULL) worker->AppendEthashFull(chainActive.Height());
-
-        if (chainActive.Height() % ETHASH_EPOCH_LENGTH > 20000) {
-            worker->AppendEthashFull(chainActive.Height() + ETHASH_EPOCH_LENGTH);
+        // Work is always for the block after the tip
+        const uint32_t nHeight = worker->nTipHeight + 1;
+        const int64_t nEpoch = nHeight / nEpochLength;
+
+        // Nothing can be mined without the current DAG, everything else
+        // only competes with the hashing threads. Old epochs go first, so
+        // that they don't count against -minermemory.
+        SetThreadPriority(THREAD_PRIORITY_NORMAL);
+        worker->EvictEthashFull(nEpoch);
+        worker->AppendEthashFull(nHeight);
+
+        if (nEpochLength - nHeight % nEpochLength <= nPregenerate) {
+            SetThreadPriority(THREAD_PRIORITY_LOWEST);
+            worker->AppendEthashFull(nHeight + nEpochLength, true);
         }
 
-        MilliSleep(10 * 1000);
+        // Only a new tip can move us into the next epoch
+        nEvent = worker->WaitForEvent(nEvent, 10 * 1000);
     }
 }
 
@@ -826,104 +1011,246 @@ void MineWorker::PlatoPiaMinerPoolStop()
         minerThreads->interrupt_all();
         fPoolMiningFinished = true;
         delete minerThreads; minerThreads = NULL;
-        dHashesPerSec = 0;
+    }
+    {
+        LOCK(cs_stats);
+        vThreadStats.clear();
     }
 
     fGenerate = false;
+    NotifyEvent();
 }
 
-bool MineWorker::AppendEthashFull(uint32_t nBlockHeight)
+unsigned GetDagThreads()
 {
-    if (mapEpochFull.find(nBlockHeight/ ETHASH_EPOCH_LENGTH) != mapEpochFull.end()) {
-        return true;
+    int nDagThreads = GetArg("-dagthreads", DEFAULT_DAG_THREADS);
+    if (nDagThreads <= 0) {
+        nDagThreads = boost::thread::hardware_concurrency();
     }
+    return std::max(nDagThreads, 1);
+}
 
-    {
-        LOCK(cs_ethash);
-        ethash_light_t plight = GetEthashLight(nBlockHeight);
-        ethash_full_t  pfull  = ethash_full_new(plight, dagCallbackShim);
-
-        int64_t nEpochs = nBlockHeight / ETHASH_EPOCH_LENGTH;
-        mapEpochFull.insert(make_pair(nEpochs, pfull));
-    }
+ethash_full_t NewEthashFull(ethash_light_t light, ethash_callback_t callback)
+{
+    // The miner and the PoW prover may want the same epoch: the second one
+    // reuses the file the first one wrote instead of writing it too.
+    static boost::mutex csDagFiles;
+    boost::lock_guard<boost::mutex> lock(csDagFiles);
+    std::string strDagDir = GetArg("-dagdir", "");
+    return ethash_full_new_dir(strDagDir.empty() ? NULL : strDagDir.c_str(), light, callback, GetDagThreads());
+}
 
-    return true;
+int MineWorker::dagCallbackShim(unsigned _p)
+{
+    LogPrintf("Generating DAG file. Progress: %u%% \n", _p);
+    nDagProgress = _p;
+    TRACE1(mining, dag_progress, _p);
+    return s_dagCallback ? s_dagCallback(_p) : 0;
 }
 
-ethash_full_t MineWorker::GetEthashFull(uint32_t nBlockHeight) const
+uint64_t MineWorker::GetEthashMemoryUsage(int64_t nEpoch) const
 {
-    if (mapEpochFull.find(nBlockHeight/ ETHASH_EPOCH_LENGTH) != mapEpochFull.end()) {
-        return mapEpochFull.at(nBlockHeight / ETHASH_EPOCH_LENGTH);
+    LOCK(cs_ethash);
+    uint64_t nBytes = 0;
+    for (const auto &epoch : mapEpochFull) {
+        if (epoch.first != nEpoch) {
+            nBytes += epoch.second.size() * ethash_get_datasize(epoch.first * ethash_get_epoch_length());
+        }
     }
-
-    return NULL;
+    for (const auto &epoch : mapEpochLight) {
+        if (epoch.first != nEpoch) {
+            nBytes += ethash_get_cachesize(epoch.first * ethash_get_epoch_length());
+        }
+    }
+    return nBytes;
 }
 
-bool MineWorker::EraseEthashFull(uint32_t nBlockHeight)
+bool MineWorker::CheckMemoryBudget(uint32_t nBlockHeight, std::string &strError) const
 {
-    if (mapEpochFull.find(nBlockHeight/ ETHASH_EPOCH_LENGTH) == mapEpochFull.end()) return true;
-
-    ethash_full_t pfull = mapEpochFull.at(nBlockHeight / ETHASH_EPOCH_LENGTH);
-    ethash_full_delete(pfull);
-    mapEpochFull.erase(nBlockHeight / ETHASH_EPOCH_LENGTH);
-
+    if (nMemoryBudget == 0) {
+        return true;
+    }
+    const int64_t nEpoch = nBlockHeight / ethash_get_epoch_length();
+    const uint64_t nCacheSize = ethash_get_cachesize(nBlockHeight);
+    if (GetEthashMemoryUsage(nEpoch) + nCacheSize > nMemoryBudget) {
+        strError = strprintf("-minermemory=%u is too small for the %u MiB light cache of epoch %d",
+                             nMemoryBudget >> 20, nCacheSize >> 20, nEpoch);
+        return false;
+    }
     return true;
 }
 
-void MineWorker::DestroyEthashFull()
+bool MineWorker::AppendEthashFull(uint32_t nBlockHeight, bool fPregenerate)
 {
-    for(std::map<int64_t, ethash_full_t>::iterator it = mapEpochFull.begin(); it != mapEpochFull.end(); it++) {
-        ethash_full_t pfull = it->second;
-        ethash_full_delete(pfull);
+    const int64_t nEpoch = nBlockHeight / ethash_get_epoch_length();
+    {
+        LOCK(cs_ethash);
+        if (mapEpochFull.count(nEpoch) || mapEpochLight.count(nEpoch)) {
+            return true;
+        }
     }
 
-    mapEpochFull.clear();
-}
+    if (nMemoryBudget != 0) {
+        // The light cache is needed to build the DAG as well
+        const uint64_t nCopies = std::max<size_t>(vNumaCpus.size(), 1);
+        const uint64_t nInUse = GetEthashMemoryUsage(nEpoch) + ethash_get_cachesize(nBlockHeight);
+        const uint64_t nDagSize = nCopies * ethash_get_datasize(nBlockHeight);
+        if (nInUse + nDagSize > nMemoryBudget) {
+            if (fPregenerate) {
+                return false;
+            }
+            std::string strError;
+            if (!CheckMemoryBudget(nBlockHeight, strError)) {
+                return error("%s: %s", __func__, strError);
+            }
+            LogPrintf("The DAG for epoch %u doesn't fit in -minermemory, mining from the light cache\n", nEpoch);
+            EthashLightRef light = EthashLightCache().Get(nBlockHeight);
+            if (!light) {
+                return error("%s: no light cache for height %u", __func__, nBlockHeight);
+            }
+            {
+                LOCK(cs_ethash);
+                mapEpochLight.insert(make_pair(nEpoch, light));
+            }
+            NotifyEvent();
+            return true;
+        }
+    }
 
-bool MineWorker::AppendEthashLight(uint32_t nBlockHeight)
-{
-    if (mapEpochLight.find(nBlockHeight/ ETHASH_EPOCH_LENGTH) != mapEpochLight.end()) {
-        return true;
+    // Only the DAG generator thread adds DAGs, so generating without holding
+    // cs_ethash can't race with another generation of the same epoch.
+    int64_t nStart = GetTimeMillis();
+    LogPrintf("Generating DAG for epoch %u with %u threads\n", nEpoch, GetDagThreads());
+
+    // The light cache is only needed while the DAG is being computed
+    EthashLightRef light = EthashLightCache().Get(nBlockHeight);
+    if (!light) {
+        return error("%s: no light cache for height %u", __func__, nBlockHeight);
     }
+    nDagProgress = 0;
+    nDagEpochGenerating = nEpoch;
+    ethash_full_t  pfull  = NewEthashFull(light.get(), dagCallbackShim);
+    nDagEpochGenerating = -1;
+    if (pfull == NULL) {
+        return error("%s: DAG generation failed for height %u", __func__, nBlockHeight);
+    }
+    LogPrintf("DAG for epoch %u ready in %dms\n", nEpoch, GetTimeMillis() - nStart);
 
+    std::vector<EthashFullRef> vFull = PlaceEthashFull(pfull);
     {
         LOCK(cs_ethash);
-        ethash_light_t plight  = ethash_light_new(nBlockHeight);
-        int64_t        nEpochs = nBlockHeight / ETHASH_EPOCH_LENGTH;
-        mapEpochLight.insert(make_pair(nEpochs, plight));
+        mapEpochFull.insert(make_pair(nEpoch, vFull));
     }
+    NotifyEvent();
 
     return true;
 }
 
-ethash_light_t MineWorker::GetEthashLight(uint32_t nBlockHeight)
+EthashFullRef MineWorker::GetEthashFull(uint32_t nBlockHeight, int nNode) const
 {
-    if (mapEpochLight.find(nBlockHeight/ ETHASH_EPOCH_LENGTH) != mapEpochLight.end()) {
-        return mapEpochLight.at(nBlockHeight / ETHASH_EPOCH_LENGTH);
+    LOCK(cs_ethash);
+    auto it = mapEpochFull.find(nBlockHeight / ethash_get_epoch_length());
+    if (it == mapEpochFull.end()) {
+        return nullptr;
     }
 
-    AppendEthashLight(nBlockHeight);
-    return mapEpochLight.at(nBlockHeight / ETHASH_EPOCH_LENGTH);
+    const std::vector<EthashFullRef> &vFull = it->second;
+    return nNode >= 0 && nNode < (int)vFull.size() ? vFull[nNode] : vFull[0];
+}
+
+EthashLightRef MineWorker::GetEthashLight(uint32_t nBlockHeight) const
+{
+    LOCK(cs_ethash);
+    auto it = mapEpochLight.find(nBlockHeight / ethash_get_epoch_length());
+    return it == mapEpochLight.end() ? nullptr : it->second;
 }
 
-bool MineWorker::EraseEthashLight(uint32_t nBlockHeight)
+std::vector<EthashFullRef> MineWorker::PlaceEthashFull(ethash_full_t pfull) const
 {
-    if (mapEpochLight.find(nBlockHeight/ ETHASH_EPOCH_LENGTH) == mapEpochLight.end()) return true;
+    // Random DAG reads miss the TLB all the time, huge pages make that a lot
+    // cheaper. The file mapping can't use them, so copy the DAG out of it.
+    ethash_page_size pageSize = (ethash_page_size)std::max(0, std::min(2, (int)GetArg("-daghugepages", DEFAULT_DAG_HUGEPAGES)));
+    std::vector<ethash_full_t> vCopies;
+    if (!vNumaCpus.empty()) {
+        // Each copy is allocated by a thread on its node, so the hashing
+        // threads pinned there only read local memory.
+        vCopies.resize(vNumaCpus.size(), NULL);
+        boost::thread_group copyThreads;
+        for (size_t i = 0; i < vNumaCpus.size(); i++) {
+            copyThreads.create_thread([&, i]() {
+                SetThreadAffinity(vNumaCpus[i]);
+                vCopies[i] = ethash_full_clone(pfull, pageSize);
+            });
+        }
+        copyThreads.join_all();
 
-    ethash_light_t plight = mapEpochLight.at(nBlockHeight / ETHASH_EPOCH_LENGTH);
-    ethash_light_delete(plight);
-    mapEpochLight.erase(nBlockHeight / ETHASH_EPOCH_LENGTH);
+        if (std::find(vCopies.begin(), vCopies.end(), (ethash_full_t)NULL) != vCopies.end()) {
+            LogPrintf("Could not copy the DAG to every NUMA node, using a single one\n");
+            for (ethash_full_t pcopy : vCopies) {
+                if (pcopy) ethash_full_delete(pcopy);
+            }
+            vCopies.clear();
+        }
+    } else if (pageSize != ETHASH_PAGES_DEFAULT) {
+        ethash_full_t pcopy = ethash_full_clone(pfull, pageSize);
+        if (pcopy) {
+            vCopies.push_back(pcopy);
+        } else {
+            LogPrintf("Could not move the DAG to huge pages\n");
+        }
+    }
 
-    return true;
+    if (vCopies.empty()) {
+        vCopies.push_back(pfull);
+    } else {
+        // The DAG file stays on disk for the next start.
+        ethash_full_delete(pfull);
+    }
+
+    bool fLock = GetBoolArg("-daglock", DEFAULT_DAG_LOCK);
+    std::vector<EthashFullRef> vFull;
+    for (ethash_full_t pcopy : vCopies) {
+        if (fLock || GetBoolArg("-dagprefault", DEFAULT_DAG_PREFAULT)) {
+            ethash_full_prefault(pcopy);
+        }
+        if (fLock && !ethash_full_lock(pcopy)) {
+            LogPrintf("Could not lock the DAG in memory, see ulimit -l\n");
+        }
+        vFull.push_back(EthashFullRef(pcopy, ethash_full_delete));
+    }
+    return vFull;
 }
 
-void MineWorker::DestroyEthashLight()
+void MineWorker::EvictEthashFull(int64_t nEpoch)
 {
-    for(std::map<int64_t, ethash_light_t>::iterator it = mapEpochLight.begin(); it != mapEpochLight.end(); it++) {
-        ethash_light_t plight = it->second;
-        ethash_light_delete(plight);
+    {
+        // Hashing threads still on an old epoch keep their reference until
+        // they notice the new tip.
+        LOCK(cs_ethash);
+        while (!mapEpochFull.empty() && mapEpochFull.begin()->first < nEpoch) {
+            LogPrintf("Dropping the DAG for epoch %d\n", mapEpochFull.begin()->first);
+            mapEpochFull.erase(mapEpochFull.begin());
+        }
+        while (!mapEpochLight.empty() && mapEpochLight.begin()->first < nEpoch) {
+            mapEpochLight.erase(mapEpochLight.begin());
+        }
+    }
+
+    // Keep the file of the previous epoch around in case of a reorg across
+    // the epoch boundary.
+    static int64_t nEpochFilesEvicted = 0;
+    std::string strDagDir = GetArg("-dagdir", "");
+    for (; nEpochFilesEvicted < nEpoch - 1; nEpochFilesEvicted++) {
+        if (ethash_remove_dag_file(strDagDir.empty() ? NULL : strDagDir.c_str(), nEpochFilesEvicted * ethash_get_epoch_length())) {
+            LogPrintf("Removed the DAG file of epoch %d\n", nEpochFilesEvicted);
+        }
     }
+}
 
+void MineWorker::DestroyEthashFull()
+{
+    LOCK(cs_ethash);
+    mapEpochFull.clear();
     mapEpochLight.clear();
 }
 
@@ -938,8 +1265,10 @@ void MineWorker::dispatchSingleWork(MineWorker *worker, std::shared_ptr<CReserve
         worker->CleanWork();
         Work work = worker->GenNewWork(coinbaseScript->reserveScript);
         //Work work = worker->GenNewWork(worker->scriptPubKey);
-        auto pwork = worker->AddWork(work.block, work.boundary);
+        auto pwork = worker->AddWork(work);
+        worker->nJobs++;
 
+        uint64_t nEvent = worker->GetEventCount();
         while (worker->fGenerate && nBlocks) {
             if (pwork->done) {
                 SetThreadPriority(THREAD_PRIORITY_NORMAL);
@@ -962,7 +1291,7 @@ void MineWorker::dispatchSingleWork(MineWorker *worker, std::shared_ptr<CReserve
                 LogPrintf("hashmeter %6.3f khash/s\n", worker->GetHashRate()/1000.0);
             }
 
-            MilliSleep(1000);
+            nEvent = worker->WaitForEvent(nEvent, 30 * 1000);
         }
     }
 }
@@ -975,15 +1304,18 @@ void MineWorker::dispatchWork(MineWorker *worker)
 
     while (worker->fGenerate) {
         Work work = worker->GenNewWork(worker->scriptPubKey);
-        auto pwork = worker->AddWork(work.block, work.boundary);
+        auto pwork = worker->AddWork(work);
+        worker->nJobs++;
 
+        uint64_t nEvent = worker->GetEventCount();
         while (worker->fGenerate) {
             if(chainActive.Height() >= pwork->block.nBlockHeight)
             {
+                worker->nStaleJobs++;
                 pwork->deprecated = true;
                 while(pwork->miningThreads != 0)
                 {
-                    MilliSleep(1000);
+                    nEvent = worker->WaitForEvent(nEvent, 1000);
                 }
 
                 worker->RemoveWork(pwork->blockEthash);
@@ -997,7 +1329,7 @@ void MineWorker::dispatchWork(MineWorker *worker)
                     worker->ProcessBlockFound(worker->config, &(pwork->block), *pwalletMain);
                     while(pwork->miningThreads != 0)
                     {
-                        MilliSleep(1000);
+                        nEvent = worker->WaitForEvent(nEvent, 1000);
                     }
 
                     worker->RemoveWork(pwork->blockEthash);
@@ -1005,6 +1337,27 @@ void MineWorker::dispatchWork(MineWorker *worker)
                     break;
                 }
 
+                if (worker->IsTemplatePartial())
+                {
+                    // The job was built within -blockbuildbudget. Publish the
+                    // full template before retiring it, so the hashing threads
+                    // move straight over to the newest work.
+                    auto pworkFull = worker->AddWork(worker->GenNewWork(worker->scriptPubKey));
+                    worker->nJobs++;
+                    pwork->deprecated = true;
+                    while(pwork->miningThreads != 0)
+                    {
+                        nEvent = worker->WaitForEvent(nEvent, 1000);
+                    }
+                    if (pwork->done)
+                    {
+                        worker->ProcessBlockFound(worker->config, &(pwork->block), *pwalletMain);
+                    }
+                    worker->RemoveWork(pwork->blockEthash);
+                    pwork = pworkFull;
+                    continue;
+                }
+
                 static int64_t nLogTime;
                 if (GetTime() - nLogTime > 1 * 30) {
                     nLogTime = GetTime();
@@ -1012,20 +1365,25 @@ void MineWorker::dispatchWork(MineWorker *worker)
                 }
             }
 
-            MilliSleep(1000);
+            nEvent = worker->WaitForEvent(nEvent, 30 * 1000);
         }
     }
 
 }
 
-void MineWorker::doWork(MineWorker *worker, uint64_t nMaxTries)
+void MineWorker::doWork(MineWorker *worker, uint64_t nMaxTries, int nNode, std::shared_ptr<CMinerBackend> backend, std::shared_ptr<MinerThreadStats> stats)
 {
     RenameThread("doWork");
+    if (nNode >= 0 && !SetThreadAffinity(worker->vNumaCpus[nNode])) {
+        LogPrintf("Could not pin mining thread to NUMA node %d\n", nNode);
+    }
 
+    uint64_t nEvent = worker->GetEventCount();
     while (worker->fGenerate) {
         auto work = worker->GetWork();
-        if (work == NULL || work->done || work->deprecated) {
-            MilliSleep(1000);
+        if (work == NULL || work->done || work->deprecated || (int64_t)work->block.nBlockHeight <= worker->nTipHeight) {
+            stats->SetIdle();
+            nEvent = worker->WaitForEvent(nEvent, 1000);
             continue;
         }
 
@@ -1037,12 +1395,12 @@ void MineWorker::doWork(MineWorker *worker, uint64_t nMaxTries)
         uint32_t nBlockHeight = work->block.nBlockHeight;
         ethash_h256_t blockEthash = work->blockEthash;
         ethash_h256_t boundary    = work->boundary;
-        LogPrintf("Work on: %s\n", ethash_h256_encode(blockEthash));
+        LogPrint("miner", "Work on: %s\n", ethash_h256_encode(blockEthash));
 
         ethash_h256_t mixHash = {0};
         uint64_t nNonce = 0;
         SetThreadPriority(THREAD_PRIORITY_LOWEST);
-        if(worker->MinePlatopia(&(work->done), &(work->deprecated), blockEthash, nBlockHeight, boundary, &mixHash, &nNonce, nMaxTries))
+        if(worker->MinePlatopia(&(work->done), &(work->deprecated), blockEthash, nBlockHeight, boundary, &mixHash, &nNonce, nMaxTries, nNode, *backend, *stats))
         {
             work->block.nNonce  = nNonce;
             work->block.hashMix = mixHash;
@@ -1052,6 +1410,7 @@ void MineWorker::doWork(MineWorker *worker, uint64_t nMaxTries)
             LOCK(cs_miner);
             work->miningThreads--;
         }
+        worker->NotifyEvent();
         SetThreadPriority(THREAD_PRIORITY_LOWEST);
         if (!worker->fGenerate)
         {
@@ -1061,184 +1420,285 @@ void MineWorker::doWork(MineWorker *worker, uint64_t nMaxTries)
 
 }
 
-inline bool MineWorker::MinePlatopia(bool *fDone, bool *deprecated, ethash_h256_t blockEthash, uint64_t nBlockHeight, ethash_h256_t boundary, ethash_h256_t *mixHashOut, uint64_t *nonceOut, uint64_t nMaxTries)
+inline bool MineWorker::MinePlatopia(bool *fDone, bool *deprecated, ethash_h256_t blockEthash, uint64_t nBlockHeight, ethash_h256_t boundary, ethash_h256_t *mixHashOut, uint64_t *nonceOut, uint64_t nMaxTries, int nNode, CMinerBackend &backend, MinerThreadStats &stats)
 {
 
-    ethash_full_t pfull = GetEthashFull(nBlockHeight);
+    // Without the DAG, backends that can't hash from the light cache wait
+    // for the next epoch.
+    uint64_t nEvent = GetEventCount();
+    EthashFullRef pfull = GetEthashFull(nBlockHeight, nNode);
+    EthashLightRef light;
     while (pfull == NULL) {
-        if (!fGenerate) return false;
-        pfull = GetEthashFull(nBlockHeight);
-        MilliSleep(1000);
+        if (backend.SupportsLight()) {
+            light = GetEthashLight(nBlockHeight);
+            if (light) break;
+        }
+        if (!fGenerate || *deprecated || (int64_t)nBlockHeight <= nTipHeight) return false;
+        nEvent = WaitForEvent(nEvent, 1000);
+        pfull = GetEthashFull(nBlockHeight, nNode);
     }
     uint64_t nNonce = GetRand(0xffffffffffffffff);
 
     uint64_t nTryCount      = 0;
-    uint64_t nHashCount     = 0;
-    int64_t  nHPSTimerStart = 0;
 
-    while(fGenerate && !*fDone && !*deprecated) {
-        ethash_return_value_t ret = ethash_full_compute(pfull, blockEthash, nNonce);
-        if (ethash_quick_check_difficulty( &blockEthash, nNonce, &(ret.mix_hash), &boundary )) {
+    while(fGenerate && !*fDone && !*deprecated && (int64_t)nBlockHeight > nTipHeight) {
+        uint64_t nBatch = light ? LIGHT_NONCE_BATCH : backend.GetBatchSize();
+        if (nMaxTries != 0) {
+            if (nTryCount >= nMaxTries) {
+                break;
+            }
+            nBatch = std::min(nBatch, nMaxTries - nTryCount);
+        }
+
+        uint64_t nFound;
+        ethash_h256_t mixHash;
+        bool fFound = light ? backend.SearchLight(light, blockEthash, boundary, nNonce, nBatch, nFound, mixHash)
+                            : backend.Search(pfull, blockEthash, boundary, nNonce, nBatch, nFound, mixHash);
+        if (fFound) {
             // Found a solution
             SetThreadPriority(THREAD_PRIORITY_NORMAL);
             LogPrintf("PlatopiaMiner:\n");
-            LogPrintf("proof-of-work found  \n");
+            LogPrintf("proof-of-work found on %s\n", backend.GetName());
             LogPrintf("   Ethash: %s\n", ethash_h256_encode(blockEthash));
             LogPrintf("   Target: %s\n", ethash_h256_encode(boundary));
-            LogPrintf("   Nonce: %llu\n", nNonce);
-            LogPrintf("   MixHash: %s\n", ethash_h256_encode(ret.mix_hash));
-            *mixHashOut = ret.mix_hash;
-            *nonceOut = nNonce;
+            LogPrintf("   Nonce: %llu\n", nFound);
+            LogPrintf("   MixHash: %s\n", ethash_h256_encode(mixHash));
+            *mixHashOut = mixHash;
+            *nonceOut = nFound;
             // In regression test mode, stop mining after a block is found.
             return true;
         }
 
-        nHashCount += 1;
-        nNonce     += 1;
+        nNonce     += nBatch;
+        nTryCount  += nBatch;
+        stats.AddHashes(nBatch);
+    }
 
-        if(nMaxTries != 0) {
-            nTryCount  += 1;
+    return false;
+}
 
-            if(nTryCount > nMaxTries) {
-                break;
-            }
-        }
+void MinerThreadStats::AddHashes(uint64_t nCount)
+{
+    int64_t nNow = GetTimeMillis();
+    nHashes += nCount;
+    if (nWindowStart == 0) {
+        // Coming back from idle, the first batch only starts the window
+        nWindowStart  = nNow;
+        nWindowHashes = 0;
+        return;
+    }
 
-        if (GetTimeMillis() - nHPSTimerStart > 4000) {
-            static CCriticalSection cs;
-            {
-                LOCK(cs);
-                dHashesPerSec = (double)(1000.0 * nHashCount / (GetTimeMillis() - nHPSTimerStart));
-            }
-            nHPSTimerStart = GetTimeMillis();
-            nHashCount = 0;
-        }
+    nWindowHashes += nCount;
+    if (nNow - nWindowStart >= MINER_HASHRATE_WINDOW) {
+        nHashRate     = 1000 * nWindowHashes / (nNow - nWindowStart);
+        nWindowStart  = nNow;
+        nWindowHashes = 0;
     }
+}
 
-    return false;
+void MinerThreadStats::SetIdle()
+{
+    nHashRate    = 0;
+    nWindowStart = 0;
 }
 
 double MineWorker::GetHashRate() const
 {
-    if (nThreads <= 1) return dHashesPerSec;
-    return dHashesPerSec * nThreads;
+    LOCK(cs_stats);
+    uint64_t nRate = 0;
+    for (const auto &stats : vThreadStats) {
+        nRate += stats->nHashRate;
+    }
+    return nRate;
 }
 
-void MineWorker::SetHashRate(double dRate)
+void MineWorker::SubmitHashRate(const std::string &strId, uint64_t nRate)
 {
-    dHashesPerSec = dRate;
+    LOCK(cs_stats);
+    mapExternalHashRates[strId] = std::make_pair(nRate, GetTime());
 
-    static int64_t nLogTime;
-    if (GetTime() - nLogTime > 1 * 30) {
-        nLogTime = GetTime();
-        LogPrintf("hashmeter %6.3f khash/s\n", GetHashRate()/1000.0);
+    // Forget miners that stopped reporting
+    for (auto it = mapExternalHashRates.begin(); it != mapExternalHashRates.end();) {
+        if (GetTime() - it->second.second > EXTERNAL_HASHRATE_TIMEOUT) {
+            it = mapExternalHashRates.erase(it);
+        } else {
+            ++it;
+        }
     }
 }
 
-Work MineWorker::GenNewWork(const CScript &scriptPubKeyIn)
+MinerStats MineWorker::GetStats() const
 {
-    unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler((*config), Params()).CreateNewBlock(scriptPubKeyIn));
-
-    if (!pblocktemplate.get()) throw error("CreateBlock Failed\n");
-
-    CBlock *pblock = &pblocktemplate->block;
-
-    unsigned int nExtraNonce = 0;
+    MinerStats stats;
+    stats.nLocalHashRate    = 0;
+    stats.nExternalHashRate = 0;
     {
-        LOCK(cs_main);
-        IncrementExtraNonce(*config, pblock, chainActive.Tip(), nExtraNonce);
+        LOCK(cs_stats);
+        for (const auto &thread : vThreadStats) {
+            stats.vThreadHashRates.push_back(std::make_pair(thread->strBackend, uint64_t(thread->nHashRate)));
+            stats.nLocalHashRate += thread->nHashRate;
+        }
+        for (const auto &report : mapExternalHashRates) {
+            if (GetTime() - report.second.second <= EXTERNAL_HASHRATE_TIMEOUT) {
+                stats.nExternalHashRate += report.second.first;
+            }
+        }
     }
 
-    arith_uint256 hashTarget  = arith_uint256().SetCompact(pblock->nBits);
-    ethash_h256_t boundary    = hashTarget.ToEthashH256();
-    ethash_h256_t blockEthash = CBlockHeaderBase(*pblock).GetEthash();
+    stats.nJobs           = nJobs;
+    stats.nStaleJobs      = nStaleJobs;
+    stats.nBlocksFound    = nBlocksFound;
+    stats.nBlocksRejected = nBlocksRejected;
 
-    return {*pblock, blockEthash, boundary, false, 0, false};
-}
-
-std::shared_ptr<Work>
-MineWorker::AddWork(CBlock &block, ethash_h256_t boundary)
-{
-    ethash_h256_t blockEthash = CBlockHeaderBase(block).GetEthash();
-    for (auto it = listWork.begin(); it != listWork.end(); it++) {
-        if (EthashEquals((*it)->blockEthash, blockEthash) && EthashEquals(boundary, (*it)->boundary)) {
-            return *it;
+    stats.nDagBytes = 0;
+    {
+        LOCK(cs_ethash);
+        for (const auto &epoch : mapEpochFull) {
+            stats.vDagEpochs.push_back(epoch.first);
+            stats.nDagBytes += epoch.second.size() *
+                               ethash_get_datasize(epoch.first * ethash_get_epoch_length());
+        }
+        for (const auto &epoch : mapEpochLight) {
+            stats.vLightEpochs.push_back(epoch.first);
         }
     }
+    stats.nDagEpochGenerating = nDagEpochGenerating;
+    stats.nDagProgress        = stats.nDagEpochGenerating < 0 ? 0 : nDagProgress.load();
 
-    LogPrintf("Add a new work %s\n", ethash_h256_encode(blockEthash));
-    std::shared_ptr<Work> newWork(new Work{block, blockEthash, boundary, false, 0, false});
-    listWork.push_back(newWork);
-    return listWork.back();
+    stats.nWorkBytes = workTable.DynamicMemoryUsage();
+    {
+        LOCK(cs_template);
+        stats.nTemplateAge = currentTemplate ? GetTime() - nTemplateTime : -1;
+        if (currentTemplate) {
+            stats.nWorkBytes += RecursiveDynamicUsage(currentTemplate->block);
+        }
+    }
+    return stats;
 }
 
-std::shared_ptr<Work> MineWorker::GetWork() const
+Work MineWorker::GenNewWork(const CScript &scriptPubKeyIn)
 {
-    for (auto it : listWork) {
-        if (it->done) continue;
+    CBlock block;
+    {
+        LOCK2(cs_main, cs_template);
+
+        // CreateNewBlock walks the whole mempool and runs TestBlockValidity, so
+        // only rebuild the template for a new tip or payout script, or once the
+        // mempool changed and the template is a few seconds old. Otherwise the
+        // cached block just gets a fresh time and extranonce.
+        const CBlockIndex *pindexPrev = chainActive.Tip();
+        const unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+        const bool fNewTip = !currentTemplate ||
+            currentTemplate->block.hashPrevBlock != pindexPrev->GetBlockHash();
+        if (fNewTip || fTemplatePartial ||
+            templateScript != scriptPubKeyIn ||
+            (nTemplateTransactionsUpdated != nTransactionsUpdated &&
+             GetTime() - nTemplateTime > TEMPLATE_MEMPOOL_REFRESH_INTERVAL))
+        {
+            // Get a job out quickly after a new tip, dispatchWork replaces it
+            // with the full template right after.
+            const int64_t nBudgetMicros = fNewTip
+                ? GetArg("-blockbuildbudget", DEFAULT_BLOCK_BUILD_BUDGET) * 1000
+                : 0;
+            BlockAssembler assembler(*config, Params());
+            unique_ptr<CBlockTemplate> pblocktemplate(assembler.CreateNewBlock(scriptPubKeyIn, nBudgetMicros));
+
+            if (!pblocktemplate.get()) throw error("CreateBlock Failed\n");
+
+            delete currentTemplate;
+            currentTemplate = pblocktemplate.release();
+            templateScript = scriptPubKeyIn;
+            nTemplateTransactionsUpdated = nTransactionsUpdated;
+            nTemplateTime = GetTime();
+            fTemplatePartial = assembler.IsPartial();
+        }
+        else
+        {
+            LogPrint("miner", "%s: reusing template for height %u\n", __func__,
+                     currentTemplate->block.nBlockHeight);
+        }
+
+        block = currentTemplate->block;
+        ::UpdateTime(&block, *config, pindexPrev);
 
-        return it;
+        unsigned int nExtraNonce = 0;
+        IncrementExtraNonce(*config, &block, pindexPrev, nExtraNonce,
+                            currentTemplate->vCoinbaseMerkleBranch);
     }
 
-    LogPrintf("GetWork no work\n");
-    return NULL;
+    arith_uint256 hashTarget  = arith_uint256().SetCompact(block.nBits);
+    ethash_h256_t boundary    = hashTarget.ToEthashH256();
+    ethash_h256_t blockEthash = block.GetBaseEthash();
+
+    return {block, blockEthash, boundary, false, 0, false};
 }
 
-std::shared_ptr<Work> MineWorker::GetWork(ethash_h256_t &blockEthash) const
+bool MineWorker::IsTemplatePartial() const
 {
-    for (auto it : listWork) {
-        if (EthashEquals(it->blockEthash, blockEthash)) return it;
-    }
+    LOCK(cs_template);
+    return fTemplatePartial;
+}
 
-    return NULL;
+std::shared_ptr<Work>
+MineWorker::AddWork(const Work &work)
+{
+    // A full table stays the same size when a job is added
+    const bool fNew = !workTable.Get(work.blockEthash);
+    std::shared_ptr<Work> pwork = workTable.Add(work.block, work.blockEthash, work.boundary);
+    if (fNew) {
+        LogPrintf("Add a new work %s\n", ethash_h256_encode(pwork->blockEthash));
+        GetMainSignals().NewMiningWork(*pwork);
+    }
+    TRACE3(mining, add_work, pwork->blockEthash.b, pwork->block.nBlockHeight,
+           fNew);
+    NotifyEvent();
+    return pwork;
 }
 
-void MineWorker::UpdateWork(ethash_h256_t &blockEthash, uint64_t &nonce, ethash_h256_t &hashMix)
+std::shared_ptr<Work> MineWorker::GetWork() const
 {
-    for (auto it : listWork) {
-        if (EthashEquals(it->blockEthash, blockEthash)) {
-            it->block.nNonce  = nonce;
-            it->block.hashMix = hashMix;
-        }
-    }
+    std::shared_ptr<Work> pwork = workTable.GetNewest();
+    if (!pwork) LogPrint("miner", "GetWork no work\n");
+    return pwork;
 }
 
-void MineWorker::RemoveWork(const ethash_h256_t &blockEthash)
+std::shared_ptr<Work> MineWorker::GetWork(const ethash_h256_t &blockEthash) const
 {
-    LogPrintf("RemoveWork: %s\n", ethash_h256_encode_big(blockEthash));
-    listWork.remove_if(([&, blockEthash](std::shared_ptr<Work> work){ return EthashEquals(work->blockEthash, blockEthash ); }));
+    return workTable.Get(blockEthash);
 }
 
-void MineWorker::RemoveWork(uint32_t nBlockHeight)
+void MineWorker::RemoveWork(const ethash_h256_t &blockEthash)
 {
-    LogPrintf("RemoveWork: %u\n", nBlockHeight);
-    listWork.remove_if(([&, nBlockHeight](std::shared_ptr<Work> work){ return work->block.nBlockHeight == nBlockHeight ; }));
+    LogPrintf("RemoveWork: %s\n", ethash_h256_encode_big(blockEthash));
+    workTable.Remove(blockEthash);
 }
 
-void MineWorker::SetWorkDone(ethash_h256_t &blockEthash)
+void MineWorker::RemoveWorkUpToHeight(uint32_t nBlockHeight)
 {
-    for (auto it : listWork) {
-        if (EthashEquals(it->blockEthash, blockEthash)) {
-            it->done = true;
-        }
-    }
+    LogPrintf("RemoveWork: up to %u\n", nBlockHeight);
+    workTable.RemoveUpToHeight(nBlockHeight);
 }
 
 void MineWorker::ShowWorkList() const
 {
+    if (!LogAcceptCategory("miner")) return;
     int i = 0;
-    for (auto it : listWork) {
-        LogPrintf("Work Index:%d, BlockEthash: %s, Height: %ld, Done: %s\n", i++, ethash_h256_encode_big(it->blockEthash), it->block.nBlockHeight, it->done ? "true":"false");
+    for (auto it : workTable.GetAll()) {
+        LogPrint("miner", "Work Index:%d, BlockEthash: %s, Height: %ld, Done: %s\n", i++, ethash_h256_encode_big(it->blockEthash), it->block.nBlockHeight, it->done ? "true":"false");
     }
 }
 
 void MineWorker::CleanWork()
 {
-    listWork.clear();
+    workTable.Clear();
 }
 
 bool MineWorker::ProcessBlockFound(const Config *config, const CBlock* pblock, CWallet& wallet)
 {
+    // The block is done, hash it once for everything below.
+    std::shared_ptr<CBlock> shared_pblock = std::make_shared<CBlock>(*pblock);
+    shared_pblock->CacheHash();
+    pblock = shared_pblock.get();
 
     LogPrintf("%s\n", pblock->ToString());
     LogPrintf("generated %s\n", FormatMoney(pblock->vtx[0]->GetValueOut()));
@@ -1246,8 +1706,10 @@ bool MineWorker::ProcessBlockFound(const Config *config, const CBlock* pblock, C
     // Found a solution
     {
         LOCK(cs_main);
-        if (pblock->hashPrevBlock != chainActive.Tip()->GetBlockHash())
+        if (pblock->hashPrevBlock != chainActive.Tip()->GetBlockHash()) {
+            nBlocksRejected++;
             return error("PlatopiaMiner : generated block is stale");
+        }
     }
 
     // Track how many getdata requests this block gets
@@ -1258,9 +1720,11 @@ bool MineWorker::ProcessBlockFound(const Config *config, const CBlock* pblock, C
 
     // Process this block the same as if we had received it from another node
     bool fNewBlock = false;
-    std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(*pblock);
-    if (!ProcessNewBlock(*config, shared_pblock, true, &fNewBlock))
+    if (!ProcessNewBlock(*config, shared_pblock, true, &fNewBlock)) {
+        nBlocksRejected++;
         return error("Platopia Miner : ProcessNewBlock, block not accepted");
+    }
+    nBlocksFound++;
 
     uint256 blockhash = pblock->GetHash();
     LogPrintf("NotifyBlockMined block hash %s", blockhash.ToString());
@@ -1321,20 +1785,17 @@ std::shared_ptr<Work> MineWorker::GetLastNewWork(std::shared_ptr<CReserveScript>
     if (!pwork) {
         Work work = GenNewWork(scriptPubKey);
         LogPrintf("Gen NewWork NULL\n");
-        pwork = AddWork(work.block, work.boundary);
+        pwork = AddWork(work);
     }
 
-    if(prune)
+    if(prune && (int)pwork->block.nBlockHeight <= chainActive.Height())
     {
-        while(pwork->block.nBlockHeight <= chainActive.Height())
-        {
-            RemoveWork(pwork->block.nBlockHeight);
-            pwork = GetWork();
-            if (!pwork) {
-                Work work = GenNewWork(scriptPubKey);
-                LogPrintf("Gen NewWork Height\n");
-                pwork = AddWork(work.block, work.boundary);
-            }
+        RemoveWorkUpToHeight(chainActive.Height());
+        pwork = GetWork();
+        if (!pwork) {
+            Work work = GenNewWork(scriptPubKey);
+            LogPrintf("Gen NewWork Height\n");
+            pwork = AddWork(work);
         }
     }
 
@@ -1344,15 +1805,49 @@ std::shared_ptr<Work> MineWorker::GetLastNewWork(std::shared_ptr<CReserveScript>
 
 bool MineWorker::SubmitWork(ethash_h256_t blockEthash, uint64_t nNonce, ethash_h256_t mixHash)
 {
-    SetWorkDone(blockEthash);
-    UpdateWork(blockEthash, nNonce, mixHash);
-    auto pwork = GetWork(blockEthash);
-    if (pwork == NULL) {
+    const int64_t nStart =
+        TRACE_ACTIVE(mining, submit_work) ? GetTimeMicros() : 0;
+    // Turn stale, repeated and bogus solutions down before the block is
+    // copied or cs_main is taken, and leave the job to the hashing threads
+    // until the block is accepted.
+    bool fDuplicate = false;
+    auto pwork = workTable.AddShare(blockEthash, nNonce, fDuplicate);
+    if (pwork == NULL || pwork->done || pwork->deprecated) {
         LogPrintf("no such Work %s\n", ethash_h256_encode(blockEthash));
+        TRACE5(mining, submit_work, blockEthash.b, nNonce, false, false,
+               GetTimeMicros() - nStart);
+        return false;
+    }
+    if (fDuplicate ||
+        !ethash_quick_check_difficulty(&blockEthash, nNonce, &mixHash,
+                                       &pwork->boundary)) {
+        LogPrint("miner", "%s: %s solution for work %s\n", __func__,
+                 fDuplicate ? "duplicate" : "invalid",
+                 ethash_h256_encode(blockEthash));
+        TRACE5(mining, submit_work, blockEthash.b, nNonce, false, false,
+               GetTimeMicros() - nStart);
+        return false;
+    }
+
+    CBlock block = pwork->block;
+    block.nNonce = nNonce;
+    block.hashMix = mixHash;
+    // The mix hash only gets recomputed from the light cache with
+    // -fullpowcheck, the result is cached for ProcessNewBlock.
+    if (fFullPowCheck && !CheckProofOfWork(block, *config)) {
+        LogPrint("miner", "%s: wrong mix hash for work %s\n", __func__,
+                 ethash_h256_encode(blockEthash));
+        TRACE5(mining, submit_work, blockEthash.b, nNonce, false, false,
+               GetTimeMicros() - nStart);
         return false;
     }
 
-    if (ProcessBlockFound(config, &(pwork->block), *pwalletMain)) {
+    const bool fAccepted = ProcessBlockFound(config, &block, *pwalletMain);
+    TRACE5(mining, submit_work, blockEthash.b, nNonce, true, fAccepted,
+           GetTimeMicros() - nStart);
+    if (fAccepted) {
+        workTable.SetSolution(blockEthash, nNonce, mixHash);
+        NotifyEvent();
         return true;
     }
 
@@ -6,13 +6,19 @@
 #ifndef BITCOIN_MINER_H
 #define BITCOIN_MINER_H
 
+#include "ethashcache.h"
+#include "minerbackend.h"
 #include "primitives/block.h"
+#include "sync.h"
 #include "txmempool.h"
 #include "util.h"
+#include "validationinterface.h"
+#include "worktable.h"
 
 #include "boost/multi_index/ordered_index.hpp"
 #include "boost/multi_index_container.hpp"
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <boost/thread.hpp>
@@ -25,11 +31,38 @@ class CScript;
 class CWallet;
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Threads used to build the ethash DAG, 0 means one per core */
+static const int DEFAULT_DAG_THREADS = 0;
+/** Default for -daghugepages, see ethash_page_size */
+static const int DEFAULT_DAG_HUGEPAGES = 0;
+/** Default for -dagprefault */
+static const bool DEFAULT_DAG_PREFAULT = false;
+/** Default for -daglock */
+static const bool DEFAULT_DAG_LOCK = false;
+/** Default for -dagnuma */
+static const bool DEFAULT_DAG_NUMA = false;
+/** Default for -dagpregenerate, blocks before an epoch its DAG is built */
+static const int DEFAULT_DAG_PREGENERATE_BLOCKS = 160000;
+/** Default for -minermemory, in MiB, 0 for no limit */
+static const int64_t DEFAULT_MINER_MEMORY = 0;
+/**
+ * Seconds a cached mining template is kept after the mempool changed, as for
+ * getblocktemplate. A new tip or payout script always rebuilds it.
+ */
+static const int64_t TEMPLATE_MEMPOOL_REFRESH_INTERVAL = 5;
+/**
+ * Default for -blockbuildbudget, milliseconds the first mining template after a
+ * new tip may spend adding transactions, 0 means no limit
+ */
+static const int64_t DEFAULT_BLOCK_BUILD_BUDGET = 0;
 
 struct CBlockTemplate {
     CBlock block;
     std::vector<CAmount> vTxFees;
     std::vector<int64_t> vTxSigOpsCount;
+    //! Merkle branch of the coinbase, which stays the same when only the
+    //! coinbase changes
+    std::vector<uint256> vCoinbaseMerkleBranch;
 };
 
 // Container for tracking updates to ancestor feerate as we include (parent)
@@ -40,12 +73,14 @@ struct CTxMemPoolModifiedEntry {
         nSizeWithAncestors = entry->GetSizeWithAncestors();
         nModFeesWithAncestors = entry->GetModFeesWithAncestors();
         nSigOpCountWithAncestors = entry->GetSigOpCountWithAncestors();
+        nInterestWithAncestors = entry->GetInterestWithAncestors();
     }
 
     CTxMemPool::txiter iter;
     uint64_t nSizeWithAncestors;
     CAmount nModFeesWithAncestors;
     int64_t nSigOpCountWithAncestors;
+    CAmount nInterestWithAncestors;
 };
 
 /**
@@ -121,6 +156,7 @@ struct update_for_parent_inclusion {
         e.nModFeesWithAncestors -= iter->GetFee();
         e.nSizeWithAncestors -= iter->GetTxSize();
         e.nSigOpCountWithAncestors -= iter->GetSigOpCount();
+        e.nInterestWithAncestors -= iter->GetInterest();
     }
 
     CTxMemPool::txiter iter;
@@ -136,14 +172,19 @@ private:
 
     // Configuration parameters for the block size
     uint64_t nMaxGeneratedBlockSize;
+    uint64_t nMaxBlockContentSize;
     CFeeRate blockMinFeeRate;
 
     // Information on the current status of the block
     uint64_t nBlockSize;
+    uint64_t nBlockContentSize;
     uint64_t nBlockTx;
     uint64_t nBlockSigOps;
     CAmount nFees;
     CAmount nInterest;
+    // Interest left to pay out after the previous block, which the block's
+    // interest may not exceed
+    CAmount nInterestLeft;
     CTxMemPool::setEntries inBlock;
 
     // Chain context for the block
@@ -157,13 +198,24 @@ private:
     int lastFewTxs;
     bool blockFinished;
 
+    // Time budget for adding transactions, in GetTimeMicros() time, 0 for none
+    int64_t nDeadline;
+    // Whether transactions were left out because the budget ran out
+    bool fPartial;
+
 public:
     BlockAssembler(const Config &_config, const CChainParams &chainparams);
-    /** Construct a new block template with coinbase to scriptPubKeyIn */
+    /**
+     * Construct a new block template with coinbase to scriptPubKeyIn. With a
+     * positive nBudgetMicros, stop adding transactions once it is spent and
+     * return the template built so far.
+     */
     std::unique_ptr<CBlockTemplate>
-    CreateNewBlock(const CScript &scriptPubKeyIn);
+    CreateNewBlock(const CScript &scriptPubKeyIn, int64_t nBudgetMicros = 0);
 
     uint64_t GetMaxGeneratedBlockSize() const { return nMaxGeneratedBlockSize; }
+    /** Whether the last template was cut short by its time budget */
+    bool IsPartial() const { return fPartial; }
 
 private:
     // utility functions
@@ -171,6 +223,8 @@ private:
     void resetBlock();
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
+    /** Whether the time budget is spent, marking the template partial */
+    bool BudgetExceeded();
 
     // Methods for how to add transactions to a block.
     /** Add transactions based on tx "priority" */
@@ -187,12 +241,14 @@ private:
     bool isStillDependent(CTxMemPool::txiter iter);
 
     // helper functions for addPackageTxs()
-    /** Remove confirmed (inBlock) entries from given set */
-    void onlyUnconfirmed(CTxMemPool::setEntries &testSet);
+    /** Add the in-mempool ancestors of iter not yet inBlock to ancestors */
+    void CalculateUnconfirmedAncestors(CTxMemPool::txiter iter,
+                                       CTxMemPool::setEntries &ancestors);
     /** Test if a new package would "fit" in the block */
-    bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost);
+    bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost,
+                     CAmount packageInterest);
     /** Perform checks on each transaction in a package:
-      * locktime, serialized size (if necessary)
+      * locktime, serialized size (if necessary), content share
       * These checks should always succeed, and they're here
       * only as an extra check in case of suboptimal node configuration */
     bool TestPackageTransactions(const CTxMemPool::setEntries &package);
@@ -216,8 +272,23 @@ private:
 void IncrementExtraNonce(const Config &config, CBlock *pblock,
                          const CBlockIndex *pindexPrev,
                          unsigned int &nExtraNonce);
+/**
+ * Same as above for a block of a template, whose merkle root is recomputed
+ * from the coinbase branch of the template in O(log n) hashes.
+ */
+void IncrementExtraNonce(const Config &config, CBlock *pblock,
+                         const CBlockIndex *pindexPrev,
+                         unsigned int &nExtraNonce,
+                         const std::vector<uint256> &vCoinbaseMerkleBranch);
 int64_t UpdateTime(CBlockHeader *pblock, const Config &config,
                    const CBlockIndex *pindexPrev);
+/** Number of threads to build ethash DAGs with, from -dagthreads */
+unsigned GetDagThreads();
+/**
+ * Build the DAG of the light cache's epoch in -dagdir. One DAG is built at a
+ * time.
+ */
+ethash_full_t NewEthashFull(ethash_light_t light, ethash_callback_t callback);
 
 class CBlock;
 class CBlockHeader;
@@ -229,23 +300,77 @@ struct CBlockTemplate;
 
 static std::function<int(unsigned)> s_dagCallback;
 
-struct Work {
-    CBlock block;
-    ethash_h256_t blockEthash;
-    ethash_h256_t boundary;
-    bool done;
-    int  miningThreads;  //number of threads
-    bool deprecated;     //mined by others
+/** Hashing counters of one mining thread, only written by that thread */
+struct MinerThreadStats {
+    //! Name of the backend the thread hashes on
+    const std::string strBackend;
+    std::atomic<uint64_t> nHashes;
+    //! Hashes per second over the last few seconds, 0 while idle
+    std::atomic<uint64_t> nHashRate;
+    int64_t  nWindowStart;
+    uint64_t nWindowHashes;
+
+    MinerThreadStats(const std::string &strBackendIn) : strBackend(strBackendIn), nHashes(0), nHashRate(0), nWindowStart(0), nWindowHashes(0) {}
+
+    /** Count hashes, refreshing nHashRate every few seconds */
+    void AddHashes(uint64_t nCount);
+    /** The thread has no work, its rate drops to 0 */
+    void SetIdle();
 };
 
-class MineWorker
+/** Snapshot of the miner's state, for getmininginfo */
+struct MinerStats {
+    //! Backend name and hashrate of each mining thread
+    std::vector<std::pair<std::string, uint64_t>> vThreadHashRates;
+    uint64_t nLocalHashRate;
+    //! Sum of the recent eth_submitHashrate reports
+    uint64_t nExternalHashRate;
+    //! Jobs handed to the hashing threads and how many a new tip made stale
+    uint64_t nJobs;
+    uint64_t nStaleJobs;
+    uint64_t nBlocksFound;
+    uint64_t nBlocksRejected;
+    std::vector<int64_t> vDagEpochs;
+    //! Epochs mined from the light cache, their DAG over -minermemory
+    std::vector<int64_t> vLightEpochs;
+    //! Epoch whose DAG is being built, -1 if none
+    int64_t  nDagEpochGenerating;
+    unsigned nDagProgress;
+    //! Seconds since the cached block template was built, -1 if there is none
+    int64_t  nTemplateAge;
+    //! Memory of the DAGs, counting each NUMA copy, and of the cached
+    //! template and the outstanding jobs
+    uint64_t nDagBytes;
+    uint64_t nWorkBytes;
+};
+
+
+class MineWorker : public CValidationInterface
 {
 private:
     int    nThreads;
-    double dHashesPerSec;
     bool   fPoolMiningFinished;
 
+    //! Counters of the running hashing threads, guarded by cs_stats
+    std::vector<std::shared_ptr<MinerThreadStats>> vThreadStats;
+    //! eth_submitHashrate reports by client id, with the time they came in
+    std::map<std::string, std::pair<uint64_t, int64_t>> mapExternalHashRates;
+    mutable CCriticalSection cs_stats;
+    std::atomic<uint64_t> nJobs;
+    std::atomic<uint64_t> nStaleJobs;
+    std::atomic<uint64_t> nBlocksFound;
+    std::atomic<uint64_t> nBlocksRejected;
+    std::atomic<int64_t>  nDagEpochGenerating;
+
+    //! Last template from CreateNewBlock, reused by GenNewWork, guarded by cs_template
     CBlockTemplate *currentTemplate;
+    CScript        templateScript;
+    unsigned int   nTemplateTransactionsUpdated;
+    int64_t        nTemplateTime;
+    //! Whether currentTemplate was cut short by -blockbuildbudget
+    bool           fTemplatePartial;
+    mutable CCriticalSection cs_template;
+
     CScript        scriptPubKey;
     //std::shared_ptr<CReserveScript> coinbaseScript;
 
@@ -253,12 +378,30 @@ private:
     boost::thread *workDispatcher;
     boost::thread *dagGenerator;
 
-    CCriticalSection cs_ethash;
+    //! Guards mapEpochFull and mapEpochLight, never held while a DAG is
+    //! generated
+    mutable CCriticalSection cs_ethash;
     CCriticalSection cs_work;
 
-    std::list<std::shared_ptr<Work>> listWork;
-    std::map<int64_t, ethash_light_t> mapEpochLight;
-    std::map<int64_t, ethash_full_t>  mapEpochFull;
+    CWorkTable workTable;
+    //! DAGs by epoch, one per NUMA node with -dagnuma
+    std::map<int64_t, std::vector<EthashFullRef>>  mapEpochFull;
+    //! Light caches of the epochs whose DAG doesn't fit in nMemoryBudget
+    std::map<int64_t, EthashLightRef> mapEpochLight;
+    //! -minermemory in bytes, 0 for no limit
+    uint64_t nMemoryBudget;
+    //! CPUs of each NUMA node the DAG is replicated on, empty without -dagnuma
+    std::vector<std::vector<int>> vNumaCpus;
+    //! GPUs mined on besides the CPU threads, set up on the first pool start
+    std::vector<std::shared_ptr<CMinerBackend>> vGpuBackends;
+    bool fGpuBackendsCreated;
+
+    //! Height of the active tip, hashing threads give up on work below it
+    std::atomic<int> nTipHeight;
+    //! Signalled on new tips, new or finished work, new DAGs and on stop
+    boost::mutex cs_events;
+    boost::condition_variable cvEvents;
+    uint64_t nEvents;
 
     const Config *config;
 
@@ -266,6 +409,9 @@ public:
     MineWorker (const Config &_config);
     ~MineWorker();
 
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
+
     bool fGenerate;
 
 public:
@@ -278,8 +424,11 @@ public:
     std::shared_ptr<Work> GetLastNewWork(std::shared_ptr<CReserveScript> coinbaseScript, bool keepScript, bool prune);
     bool SubmitWork(ethash_h256_t blockEthash, uint64_t nNonce, ethash_h256_t mixHash);
 
+    /** Hashes per second of the local mining threads */
     double GetHashRate() const;
-    void   SetHashRate(double dRate);
+    /** Record the hashrate an external miner reports for itself */
+    void   SubmitHashRate(const std::string &strId, uint64_t nRate);
+    MinerStats GetStats() const;
 
     int  GetThreads();
     void SetThreads(int threadCount);
@@ -287,33 +436,53 @@ public:
     void RunWorker();
     void StopWorker();
 
+    /**
+     * Whether the block at nBlockHeight can be mined within -minermemory,
+     * with its DAG or at least its light cache. strError says why not.
+     */
+    bool CheckMemoryBudget(uint32_t nBlockHeight, std::string &strError) const;
+
 private:
-    bool AppendEthashLight(uint32_t nBlockHeight);
-    ethash_light_t GetEthashLight(uint32_t nBlockHeight);
-    bool EraseEthashLight(uint32_t nBlockHeight);
-    void DestroyEthashLight();
-
-    bool AppendEthashFull(uint32_t nBlockHeight);
-    ethash_full_t GetEthashFull(uint32_t nBlockHeight) const;
-    bool EraseEthashFull(uint32_t nBlockHeight);
+    /**
+     * Make the epoch of nBlockHeight minable: build its DAG if it fits in
+     * -minermemory along with the epochs kept, fall back on its light cache
+     * otherwise. Pregenerated epochs only get a DAG, and only if it fits.
+     */
+    bool AppendEthashFull(uint32_t nBlockHeight, bool fPregenerate = false);
+    EthashFullRef GetEthashFull(uint32_t nBlockHeight, int nNode = 0) const;
+    EthashLightRef GetEthashLight(uint32_t nBlockHeight) const;
+    /** Bytes of the DAGs and light caches kept for epochs other than nEpoch */
+    uint64_t GetEthashMemoryUsage(int64_t nEpoch) const;
+    std::vector<EthashFullRef> PlaceEthashFull(ethash_full_t pfull) const;
+    /**
+     * Drop the DAGs and light caches of epochs before nEpoch, and the DAG
+     * files before nEpoch - 1
+     */
+    void EvictEthashFull(int64_t nEpoch);
     void DestroyEthashFull();
 
     Work GenNewWork(const CScript& scriptPubKeyIn);
-    std::shared_ptr<Work> AddWork(CBlock &block, ethash_h256_t boundary);
+    /** Whether the last template still lacks transactions for lack of time */
+    bool IsTemplatePartial() const;
+    std::shared_ptr<Work> AddWork(const Work &work);
     std::shared_ptr<Work> GetWork() const;
-    std::shared_ptr<Work> GetWork(ethash_h256_t &blockEthash) const;
-    void UpdateWork(ethash_h256_t &blockEthash, uint64_t &nonce, ethash_h256_t &hashMix);
+    std::shared_ptr<Work> GetWork(const ethash_h256_t &blockEthash) const;
     void RemoveWork(const ethash_h256_t &blockEthash);
-    void RemoveWork(uint32_t nBlockHeight);
+    void RemoveWorkUpToHeight(uint32_t nBlockHeight);
     void CleanWork();
-    void SetWorkDone(ethash_h256_t &blockEthash);
     void ShowWorkList() const;
 
-    static int dagCallbackShim(unsigned _p)
-    {
-        LogPrintf("Generating DAG file. Progress: %u%% \n", _p);
-        return s_dagCallback ? s_dagCallback(_p) : 0;
-    }
+    /** Wake up every thread waiting in WaitForEvent() */
+    void NotifyEvent();
+    /** Number of events so far, to pass to WaitForEvent() */
+    uint64_t GetEventCount();
+    /**
+     * Wait until an event newer than nSeen happens, mining stops or
+     * nTimeoutMs passes. Returns the current event count.
+     */
+    uint64_t WaitForEvent(uint64_t nSeen, int64_t nTimeoutMs);
+
+    static int dagCallbackShim(unsigned _p);
 
     /** Modify the extranonce in a block */
     void UpdateTime(CBlockHeader* block, const CBlockIndex* pindexPrev);
@@ -331,9 +500,9 @@ private:
     void PlatopiaMinerPoolStart(uint64_t nMaxTries = 0);
     void PlatoPiaMinerPoolStop();
 
-    inline bool MinePlatopia(bool *fDone, bool *deprecated, ethash_h256_t blockEthash, uint64_t nBlockHeight, ethash_h256_t boundary, ethash_h256_t *mixHashOut, uint64_t *nonceOut, uint64_t nMaxTries);
+    inline bool MinePlatopia(bool *fDone, bool *deprecated, ethash_h256_t blockEthash, uint64_t nBlockHeight, ethash_h256_t boundary, ethash_h256_t *mixHashOut, uint64_t *nonceOut, uint64_t nMaxTries, int nNode, CMinerBackend &backend, MinerThreadStats &stats);
 
-    static void doWork(MineWorker *worker, uint64_t nMaxTries);
+    static void doWork(MineWorker *worker, uint64_t nMaxTries, int nNode, std::shared_ptr<CMinerBackend> backend, std::shared_ptr<MinerThreadStats> stats);
     static void dispatchWork(MineWorker *worker);
     static void dispatchSingleWork(MineWorker *worker, std::shared_ptr<CReserveScript> coinbaseScript,
                                        int nBlocks, bool keepScript, std::vector<uint256> *vHashes);
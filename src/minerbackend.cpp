@@ -0,0 +1,71 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#include "minerbackend.h"
+
+#include "ethash/internal.h"
+#include "util.h"
+
+#if ENABLE_OPENCL
+#include "openclminer.h"
+#endif
+
+/** Nonces per CPU search call, a few milliseconds of hashing */
+static const uint64_t CPU_NONCE_BATCH = 1024;
+
+std::string CCpuMinerBackend::GetName() const {
+    return "cpu";
+}
+
+uint64_t CCpuMinerBackend::GetBatchSize() const {
+    return CPU_NONCE_BATCH;
+}
+
+bool CCpuMinerBackend::Search(const EthashFullRef &full,
+                              const ethash_h256_t &header,
+                              const ethash_h256_t &boundary, uint64_t nStart,
+                              uint64_t nCount, uint64_t &nNonce,
+                              ethash_h256_t &mixHash) {
+    ethash_return_value_t ret;
+    if (!ethash_full_search(full.get(), header, boundary, nStart, nCount,
+                            &nNonce, &ret)) {
+        return false;
+    }
+    mixHash = ret.mix_hash;
+    return true;
+}
+
+bool CCpuMinerBackend::SearchLight(const EthashLightRef &light,
+                                   const ethash_h256_t &header,
+                                   const ethash_h256_t &boundary,
+                                   uint64_t nStart, uint64_t nCount,
+                                   uint64_t &nNonce, ethash_h256_t &mixHash) {
+    for (uint64_t i = 0; i < nCount; i++) {
+        ethash_return_value_t ret =
+            ethash_light_compute(light.get(), header, nStart + i);
+        if (ret.success && ethash_check_difficulty(&ret.result, &boundary)) {
+            nNonce = nStart + i;
+            mixHash = ret.mix_hash;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::shared_ptr<CMinerBackend>> CreateGpuMinerBackends() {
+    std::vector<std::shared_ptr<CMinerBackend>> vBackends;
+    if (!GetBoolArg("-opencl", DEFAULT_OPENCL_MINING)) {
+        return vBackends;
+    }
+#if ENABLE_OPENCL
+    vBackends = CreateOpenCLMinerBackends();
+#else
+    LogPrintf("-opencl is set, but this build has no OpenCL support\n");
+#endif
+    return vBackends;
+}
@@ -0,0 +1,85 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MINERBACKEND_H
+#define BITCOIN_MINERBACKEND_H
+
+#include "ethashcache.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/** Default for -opencl */
+static const bool DEFAULT_OPENCL_MINING = false;
+/** Nonces per SearchLight() call, each hash computes its DAG items */
+static const uint64_t LIGHT_NONCE_BATCH = 16;
+
+/**
+ * A device the MineWorker searches nonces on. Each backend is driven by one
+ * mining thread at a time.
+ */
+class CMinerBackend {
+public:
+    virtual ~CMinerBackend() {}
+
+    /** Name for logs and getmininginfo, e.g. "cpu" or the GPU model */
+    virtual std::string GetName() const = 0;
+
+    /** Nonces per Search() call, small enough to notice new work quickly */
+    virtual uint64_t GetBatchSize() const = 0;
+
+    /**
+     * Search nCount nonces from nStart for one whose hash meets the boundary,
+     * in the given DAG. Backends that keep their own copy of the DAG refresh
+     * it when a different one is passed.
+     */
+    virtual bool Search(const EthashFullRef &full, const ethash_h256_t &header,
+                        const ethash_h256_t &boundary, uint64_t nStart,
+                        uint64_t nCount, uint64_t &nNonce,
+                        ethash_h256_t &mixHash) = 0;
+
+    /** Whether SearchLight() is implemented */
+    virtual bool SupportsLight() const { return false; }
+
+    /**
+     * Like Search(), from the light cache of the epoch instead of its DAG,
+     * for epochs whose DAG doesn't fit in -minermemory.
+     */
+    virtual bool SearchLight(const EthashLightRef &light,
+                             const ethash_h256_t &header,
+                             const ethash_h256_t &boundary, uint64_t nStart,
+                             uint64_t nCount, uint64_t &nNonce,
+                             ethash_h256_t &mixHash) {
+        return false;
+    }
+};
+
+/**
+ * Hash on the calling CPU thread with ethash_full_search(), or
+ * ethash_light_compute() without a DAG
+ */
+class CCpuMinerBackend : public CMinerBackend {
+public:
+    std::string GetName() const override;
+    uint64_t GetBatchSize() const override;
+    bool Search(const EthashFullRef &full, const ethash_h256_t &header,
+                const ethash_h256_t &boundary, uint64_t nStart,
+                uint64_t nCount, uint64_t &nNonce,
+                ethash_h256_t &mixHash) override;
+    bool SupportsLight() const override { return true; }
+    bool SearchLight(const EthashLightRef &light, const ethash_h256_t &header,
+                     const ethash_h256_t &boundary, uint64_t nStart,
+                     uint64_t nCount, uint64_t &nNonce,
+                     ethash_h256_t &mixHash) override;
+};
+
+/**
+ * One backend per OpenCL GPU, if built with OpenCL support and -opencl is
+ * set. Devices that fail to initialize are logged and left out.
+ */
+std::vector<std::shared_ptr<CMinerBackend>> CreateGpuMinerBackends();
+
+#endif // BITCOIN_MINERBACKEND_H
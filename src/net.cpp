@@ -17,9 +17,11 @@
 #include "crypto/common.h"
 #include "crypto/sha256.h"
 #include "hash.h"
+#include "metrics.h"
 #include "netbase.h"
 #include "primitives/transaction.h"
 #include "scheduler.h"
+#include "trace.h"
 #include "ui_interface.h"
 #include "utilstrencodings.h"
 
@@ -27,6 +29,7 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_UPNP
@@ -61,12 +64,91 @@
 #endif
 #endif
 
+TRACE_SEMAPHORE(net, outbound_message);
+
 static const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
+namespace {
+/** Bytes sent and received over all peers by message command, for /metrics */
+class CNetMessageMetrics {
+public:
+    CNetMessageMetrics() {
+        std::vector<std::string> vCommands = getAllNetMessageTypes();
+        vCommands.push_back(NET_MESSAGE_COMMAND_OTHER);
+        for (const std::string &strCommand : vCommands) {
+            const std::string strLabels =
+                strprintf("command=\"%s\"", strCommand);
+            mapReceived[strCommand] = &metrics.Value(
+                CMetricsRegistry::COUNTER, "platopia_net_received_bytes_total",
+                "Bytes of messages received, with their headers.", strLabels);
+            mapSent[strCommand] = &metrics.Value(
+                CMetricsRegistry::COUNTER, "platopia_net_sent_bytes_total",
+                "Bytes of messages queued to send, with their headers.",
+                strLabels);
+        }
+    }
+
+    void Received(const std::string &strCommand, uint64_t nBytes) {
+        Find(mapReceived, strCommand).Add(nBytes);
+    }
+    void Sent(const std::string &strCommand, uint64_t nBytes) {
+        Find(mapSent, strCommand).Add(nBytes);
+    }
+
+private:
+    // Only written by the constructor, so lookups need no lock.
+    std::map<std::string, CMetricValue *> mapReceived;
+    std::map<std::string, CMetricValue *> mapSent;
+
+    static CMetricValue &Find(const std::map<std::string, CMetricValue *> &map,
+                              const std::string &strCommand) {
+        auto it = map.find(strCommand);
+        if (it == map.end()) {
+            it = map.find(NET_MESSAGE_COMMAND_OTHER);
+        }
+        return *it->second;
+    }
+};
+}
+
+static CNetMessageMetrics &NetMessageMetrics() {
+    static CNetMessageMetrics netMessageMetrics;
+    return netMessageMetrics;
+}
+
 // SHA256("netgroup")[0:8]
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL;
 // SHA256("localhostnonce")[0:8]
 static const uint64_t RANDOMIZER_ID_LOCALHOSTNONCE = 0xd93e69e2bbfa5735ULL;
+
+// How long to wait for socket readiness, which is also how often the send
+// buffers are polled.
+static const int SOCKET_EVENTS_TIMEOUT_MS = 50;
+#ifdef USE_EPOLL
+// Readiness events fetched per epoll_wait, the rest are seen on the next call.
+static const int MAX_EPOLL_EVENTS = 1024;
+#endif
+#ifndef WIN32
+// Queued messages handed to a single sendmsg call, a header and a payload
+// each.
+static const size_t MAX_SEND_MSGS = 32;
+#else
+static const size_t MAX_SEND_MSGS = 1;
+#endif
+// Receive buffers grow by this much at a time, so a peer can't make us
+// allocate a large buffer by only sending the header of a large message.
+static const unsigned int RECV_CHUNK_SIZE = 256 * 1024;
+
+CBufferPool<std::vector<uint8_t>> &SendBufferPool() {
+    static CBufferPool<std::vector<uint8_t>> pool(NET_BUFFER_POOL_DEPTH);
+    return pool;
+}
+
+CBufferPool<CSerializeData> &RecvBufferPool() {
+    static CBufferPool<CSerializeData> pool(NET_BUFFER_POOL_DEPTH);
+    return pool;
+}
+
 //
 // Global state variables
 //
@@ -379,22 +461,7 @@ CNode *CConnman::ConnectNode(CAddress addrConnect, const char *pszDest,
         }
 
         addrman.Attempt(addrConnect, fCountFailure);
-
-        // Add node
-        NodeId id = GetNewNodeId();
-        uint64_t nonce =
-            GetDeterministicRandomizer(RANDOMIZER_ID_LOCALHOSTNONCE)
-                .Write(id)
-                .Finalize();
-        CNode *pnode =
-            new CNode(id, nLocalServices, GetBestHeight(), hSocket, addrConnect,
-                      CalculateKeyedNetGroup(addrConnect), nonce,
-                      pszDest ? pszDest : "", false);
-        pnode->nServicesExpected =
-            ServiceFlags(addrConnect.nServices & nRelevantServices);
-        pnode->AddRef();
-
-        return pnode;
+        return CreateOutboundNode(hSocket, addrConnect, pszDest);
     } else if (!proxyConnectionFailed) {
         // If connecting to the node failed, and failure is not caused by a
         // problem connecting to the proxy, mark this as an attempt.
@@ -404,6 +471,22 @@ CNode *CConnman::ConnectNode(CAddress addrConnect, const char *pszDest,
     return nullptr;
 }
 
+CNode *CConnman::CreateOutboundNode(SOCKET hSocket, const CAddress &addrConnect,
+                                    const char *pszDest) {
+    NodeId id = GetNewNodeId();
+    uint64_t nonce = GetDeterministicRandomizer(RANDOMIZER_ID_LOCALHOSTNONCE)
+                         .Write(id)
+                         .Finalize();
+    CNode *pnode =
+        new CNode(id, nLocalServices, GetBestHeight(), hSocket, addrConnect,
+                  CalculateKeyedNetGroup(addrConnect), nonce,
+                  pszDest ? pszDest : "", false);
+    pnode->nServicesExpected =
+        ServiceFlags(addrConnect.nServices & nRelevantServices);
+    pnode->AddRef();
+    return pnode;
+}
+
 void CConnman::DumpBanlist() {
     // Clean unused entries (if bantime has expired)
     SweepBanned();
@@ -438,6 +521,7 @@ void CConnman::ClearBanned() {
     {
         LOCK(cs_setBanned);
         setBanned.clear();
+        banIndex.Clear();
         setBannedIsDirty = true;
     }
 
@@ -450,19 +534,7 @@ void CConnman::ClearBanned() {
 
 bool CConnman::IsBanned(CNetAddr ip) {
     LOCK(cs_setBanned);
-
-    bool fResult = false;
-    for (banmap_t::iterator it = setBanned.begin(); it != setBanned.end();
-         it++) {
-        CSubNet subNet = (*it).first;
-        CBanEntry banEntry = (*it).second;
-
-        if (subNet.Match(ip) && GetTime() < banEntry.nBanUntil) {
-            fResult = true;
-        }
-    }
-
-    return fResult;
+    return banIndex.IsBanned(ip, GetTime());
 }
 
 bool CConnman::IsBanned(CSubNet subnet) {
@@ -500,6 +572,7 @@ void CConnman::Ban(const CSubNet &subNet, const BanReason &banReason,
         LOCK(cs_setBanned);
         if (setBanned[subNet].nBanUntil < banEntry.nBanUntil) {
             setBanned[subNet] = banEntry;
+            banIndex.Add(subNet, banEntry.nBanUntil);
             setBannedIsDirty = true;
         } else {
             return;
@@ -536,6 +609,7 @@ bool CConnman::Unban(const CSubNet &subNet) {
         if (!setBanned.erase(subNet)) {
             return false;
         }
+        banIndex.Remove(subNet);
         setBannedIsDirty = true;
     }
 
@@ -559,6 +633,7 @@ void CConnman::GetBanned(banmap_t &banMap) {
 void CConnman::SetBanned(const banmap_t &banMap) {
     LOCK(cs_setBanned);
     setBanned = banMap;
+    banIndex.Rebuild(setBanned);
     setBannedIsDirty = true;
 }
 
@@ -572,6 +647,7 @@ void CConnman::SweepBanned() {
         CBanEntry banEntry = (*it).second;
         if (now > banEntry.nBanUntil) {
             setBanned.erase(it++);
+            banIndex.Remove(subNet);
             setBannedIsDirty = true;
             LogPrint("net",
                      "%s: Removed banned node ip/subnet from banlist.dat: %s\n",
@@ -663,6 +739,7 @@ void CNode::copyStats(CNodeStats &stats) {
         LOCK(cs_vSend);
         X(mapSendBytesPerMsgCmd);
         X(nSendBytes);
+        X(nSendQueueSize);
     }
     {
         LOCK(cs_vRecv);
@@ -744,6 +821,8 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes,
 
             assert(i != mapRecvBytesPerMsgCmd.end());
             i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
+            NetMessageMetrics().Received(
+                i->first, msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE);
 
             msg.nTime = nTimeMicros;
             complete = true;
@@ -804,6 +883,11 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes) {
         return -1;
     }
 
+    // Start from a pooled buffer big enough for the first chunk of data.
+    CSerializeData vch =
+        RecvBufferPool().Get(std::min(hdr.nMessageSize, RECV_CHUNK_SIZE));
+    vRecv.SwapData(vch);
+
     // switch state to reading message data
     in_data = true;
 
@@ -817,7 +901,8 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes) {
     if (vRecv.size() < nDataPos + nCopy) {
         // Allocate up to 256 KiB ahead, but never more than the total message
         // size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        vRecv.resize(
+            std::min(hdr.nMessageSize, nDataPos + nCopy + RECV_CHUNK_SIZE));
     }
 
     hasher.Write((const uint8_t *)pch, nCopy);
@@ -835,14 +920,67 @@ const uint256 &CNetMessage::GetMessageHash() const {
     return data_hash;
 }
 
+SendPriority GetSendPriority(const std::string &command) {
+    if (command == NetMsgType::BLOCK || command == NetMsgType::CMPCTBLOCK ||
+        command == NetMsgType::BLOCKTXN || command == NetMsgType::GETBLOCKTXN ||
+        command == NetMsgType::HEADERS) {
+        return SEND_PRIORITY_BLOCK;
+    }
+    if (command == NetMsgType::TX || command == NetMsgType::INV ||
+        command == NetMsgType::NOTFOUND || command == NetMsgType::SKETCH ||
+        command == NetMsgType::RECONCILDIFF) {
+        return SEND_PRIORITY_TX;
+    }
+    if (command == NetMsgType::ADDR) {
+        return SEND_PRIORITY_ADDR;
+    }
+    return SEND_PRIORITY_CONTROL;
+}
+
+std::string SendPriorityToString(int priority) {
+    switch (priority) {
+        case SEND_PRIORITY_BLOCK:
+            return "block";
+        case SEND_PRIORITY_CONTROL:
+            return "control";
+        case SEND_PRIORITY_TX:
+            return "tx";
+        case SEND_PRIORITY_ADDR:
+            return "addr";
+        default:
+            return "unknown";
+    }
+}
+
 // requires LOCK(cs_vSend)
 size_t CConnman::SocketSendData(CNode *pnode) const {
     AssertLockHeld(pnode->cs_vSend);
     size_t nSentSize = 0;
-    size_t nMsgCount = 0;
 
-    for (const auto &data : pnode->vSendMsg) {
-        assert(data.size() > pnode->nSendOffset);
+    while (pnode->nSendSize > 0) {
+        // The message partly sent has to be finished first, then the others go
+        // by priority.
+        CQueuedNetMsg *vMsgs[MAX_SEND_MSGS];
+        int vPriorities[MAX_SEND_MSGS];
+        size_t nMsgs = 0;
+        if (pnode->nSendOffset > 0) {
+            vMsgs[0] = &pnode->vSendMsg[pnode->nSendPriority].front();
+            vPriorities[0] = pnode->nSendPriority;
+            nMsgs++;
+        }
+        for (int p = 0; p < NUM_SEND_PRIORITIES && nMsgs < MAX_SEND_MSGS; p++) {
+            std::deque<CQueuedNetMsg> &queue = pnode->vSendMsg[p];
+            size_t i =
+                pnode->nSendOffset > 0 && p == pnode->nSendPriority ? 1 : 0;
+            for (; i < queue.size() && nMsgs < MAX_SEND_MSGS; i++) {
+                vMsgs[nMsgs] = &queue[i];
+                vPriorities[nMsgs] = p;
+                nMsgs++;
+            }
+        }
+        assert(nMsgs > 0 && vMsgs[0]->size() > pnode->nSendOffset);
+
+        size_t nRequested = 0;
         int nBytes = 0;
 
         {
@@ -851,10 +989,44 @@ size_t CConnman::SocketSendData(CNode *pnode) const {
                 break;
             }
 
-            nBytes = send(
-                pnode->hSocket, reinterpret_cast<const char *>(data.data()) +
-                                    pnode->nSendOffset,
-                data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+            const CQueuedNetMsg &msg = *vMsgs[0];
+            const bool fHeader = pnode->nSendOffset < msg.header.size();
+            const auto &data = fHeader ? msg.header : msg.data;
+            const size_t nOffset =
+                fHeader ? pnode->nSendOffset
+                        : pnode->nSendOffset - msg.header.size();
+            nRequested = data.size() - nOffset;
+            nBytes = send(pnode->hSocket,
+                          reinterpret_cast<const char *>(data.data()) + nOffset,
+                          nRequested, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            // Gather the messages into one call, so headers and payloads don't
+            // each cost a syscall.
+            struct iovec iov[2 * MAX_SEND_MSGS];
+            size_t nIov = 0;
+            size_t nOffset = pnode->nSendOffset;
+            for (size_t i = 0; i < nMsgs; i++) {
+                for (std::vector<uint8_t> *data :
+                     {&vMsgs[i]->header, &vMsgs[i]->data}) {
+                    if (nOffset >= data->size()) {
+                        // Sent already, or an empty payload.
+                        nOffset -= data->size();
+                        continue;
+                    }
+                    iov[nIov].iov_base = data->data() + nOffset;
+                    iov[nIov].iov_len = data->size() - nOffset;
+                    nRequested += iov[nIov].iov_len;
+                    nOffset = 0;
+                    nIov++;
+                }
+            }
+
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nIov;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
 
         if (nBytes == 0) {
@@ -877,25 +1049,40 @@ size_t CConnman::SocketSendData(CNode *pnode) const {
         assert(nBytes > 0);
         pnode->nLastSend = GetSystemTimeInSeconds();
         pnode->nSendBytes += nBytes;
-        pnode->nSendOffset += nBytes;
         nSentSize += nBytes;
-        if (pnode->nSendOffset != data.size()) {
-            // could not send full message; stop sending more
-            break;
+
+        // Retire the messages that went out in full, recycling their buffers.
+        // Each is the first of its queue by then.
+        size_t nLeft = nBytes;
+        for (size_t i = 0; i < nMsgs && nLeft > 0; i++) {
+            const int p = vPriorities[i];
+            CQueuedNetMsg &msg = pnode->vSendMsg[p].front();
+            const size_t nSize = msg.size();
+            size_t nChunk = std::min(nLeft, nSize - pnode->nSendOffset);
+            pnode->nSendOffset += nChunk;
+            nLeft -= nChunk;
+            if (pnode->nSendOffset != nSize) {
+                pnode->nSendPriority = p;
+                break;
+            }
+
+            pnode->nSendOffset = 0;
+            pnode->nSendSize -= nSize;
+            pnode->nSendQueueSize[p] -= nSize;
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            SendBufferPool().Put(std::move(msg.header));
+            SendBufferPool().Put(std::move(msg.data));
+            pnode->vSendMsg[p].pop_front();
         }
 
-        pnode->nSendOffset = 0;
-        pnode->nSendSize -= data.size();
-        pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-        nMsgCount++;
+        if (size_t(nBytes) != nRequested) {
+            // could not send everything; stop sending more
+            break;
+        }
     }
 
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(),
-                          pnode->vSendMsg.begin() + nMsgCount);
-
-    if (pnode->vSendMsg.empty()) {
+    if (pnode->nSendSize == 0) {
         assert(pnode->nSendOffset == 0);
-        assert(pnode->nSendSize == 0);
     }
 
     return nSentSize;
@@ -1199,6 +1386,199 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket) {
     }
 }
 
+void CConnman::WantedSocketEvents(CNode *pnode, bool &fRecv, bool &fSend) {
+    // Implement the following logic:
+    // * If there is data to send, wait for sending data. As this only happens
+    // when optimistic write failed, we choose to first drain the write buffer
+    // in this case before receiving more. This avoids needlessly queueing
+    // received data, if the remote peer is not themselves receiving data. This
+    // means properly utilizing TCP flow control signalling.
+    // * Otherwise, if there is space left in the receive buffer, wait for
+    // receiving data.
+    // * Hand off all complete messages to the processor, to be handled without
+    // blocking here.
+    {
+        LOCK(pnode->cs_vSend);
+        fSend = pnode->nSendSize > 0;
+    }
+    fRecv = !fSend && !pnode->fPauseRecv;
+}
+
+#ifdef USE_EPOLL
+bool CConnman::EpollSocketEvents(std::set<SOCKET> &recv_set,
+                                 std::set<SOCKET> &send_set,
+                                 std::set<SOCKET> &error_set) {
+    {
+        LOCK(cs_vNodes);
+        for (CNode *pnode : vNodes) {
+            bool fRecv, fSend;
+            WantedSocketEvents(pnode, fRecv, fSend);
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET) {
+                continue;
+            }
+
+            // Errors are always reported, so EPOLLERR also marks the socket
+            // as registered. Closing a socket drops it from the epoll set, and
+            // its descriptor is only reused by a new node.
+            uint32_t nEvents =
+                EPOLLERR | (fSend ? EPOLLOUT : 0) | (fRecv ? EPOLLIN : 0);
+            if (nEvents == pnode->nEpollEvents) {
+                continue;
+            }
+            struct epoll_event event = {};
+            event.events = nEvents;
+            event.data.fd = pnode->hSocket;
+            int op = pnode->nEpollEvents ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+            if (epoll_ctl(epollfd, op, pnode->hSocket, &event) == 0) {
+                pnode->nEpollEvents = nEvents;
+            } else {
+                LogPrintf("epoll_ctl failed for peer=%d: %s\n", pnode->id,
+                          NetworkErrorString(WSAGetLastError()));
+                error_set.insert(pnode->hSocket);
+            }
+        }
+    }
+
+    // Level triggered, as a socket is only read up to a buffer per iteration.
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(epollfd, events, MAX_EPOLL_EVENTS,
+                             SOCKET_EVENTS_TIMEOUT_MS);
+    if (interruptNet) {
+        return false;
+    }
+
+    if (nEvents < 0) {
+        if (errno != EINTR) {
+            LogPrintf("socket epoll error %s\n",
+                      NetworkErrorString(WSAGetLastError()));
+            return interruptNet.sleep_for(
+                std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT_MS));
+        }
+        return true;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+        SOCKET hSocket = events[i].data.fd;
+        if (events[i].events & EPOLLIN) {
+            recv_set.insert(hSocket);
+        }
+        if (events[i].events & EPOLLOUT) {
+            send_set.insert(hSocket);
+        }
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+            error_set.insert(hSocket);
+        }
+    }
+    return true;
+}
+#endif
+
+// IsSelectableSocket does not hold for the select() fallback under epoll.
+static bool FitsFdSet(SOCKET hSocket) {
+#ifdef WIN32
+    return true;
+#else
+    return hSocket < FD_SETSIZE;
+#endif
+}
+
+bool CConnman::SelectSocketEvents(std::set<SOCKET> &recv_set,
+                                  std::set<SOCKET> &send_set,
+                                  std::set<SOCKET> &error_set) {
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    // Frequency to poll pnode->vSend
+    timeout.tv_usec = SOCKET_EVENTS_TIMEOUT_MS * 1000;
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+    std::vector<SOCKET> vSockets;
+
+    for (const ListenSocket &hListenSocket : vhListenSocket) {
+        if (!FitsFdSet(hListenSocket.socket)) {
+            continue;
+        }
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hListenSocket.socket);
+        vSockets.push_back(hListenSocket.socket);
+        have_fds = true;
+    }
+
+    {
+        LOCK(cs_vNodes);
+        for (CNode *pnode : vNodes) {
+            bool fRecv, fSend;
+            WantedSocketEvents(pnode, fRecv, fSend);
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET ||
+                !FitsFdSet(pnode->hSocket)) {
+                continue;
+            }
+
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = std::max(hSocketMax, pnode->hSocket);
+            vSockets.push_back(pnode->hSocket);
+            have_fds = true;
+
+            if (fSend) {
+                FD_SET(pnode->hSocket, &fdsetSend);
+            }
+            if (fRecv) {
+                FD_SET(pnode->hSocket, &fdsetRecv);
+            }
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0, &fdsetRecv,
+                         &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet) {
+        return false;
+    }
+
+    if (nSelect == SOCKET_ERROR) {
+        if (have_fds) {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            recv_set.insert(vSockets.begin(), vSockets.end());
+        }
+        return interruptNet.sleep_for(
+            std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT_MS));
+    }
+
+    for (SOCKET hSocket : vSockets) {
+        if (FD_ISSET(hSocket, &fdsetRecv)) {
+            recv_set.insert(hSocket);
+        }
+        if (FD_ISSET(hSocket, &fdsetSend)) {
+            send_set.insert(hSocket);
+        }
+        if (FD_ISSET(hSocket, &fdsetError)) {
+            error_set.insert(hSocket);
+        }
+    }
+    return true;
+}
+
+bool CConnman::SocketEvents(std::set<SOCKET> &recv_set,
+                            std::set<SOCKET> &send_set,
+                            std::set<SOCKET> &error_set) {
+#ifdef USE_EPOLL
+    if (epollfd != -1) {
+        return EpollSocketEvents(recv_set, send_set, error_set);
+    }
+#endif
+    return SelectSocketEvents(recv_set, send_set, error_set);
+}
+
 void CConnman::ThreadSocketHandler() {
     unsigned int nPrevNodeCount = 0;
     while (!interruptNet) {
@@ -1265,95 +1645,19 @@ void CConnman::ThreadSocketHandler() {
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        // Frequency to poll pnode->vSend
-        timeout.tv_usec = 50000;
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (const ListenSocket &hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            for (CNode *pnode : vNodes) {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As
-                // this only happens when optimistic write failed, we choose to
-                // first drain the write buffer in this case before receiving
-                // more. This avoids needlessly queueing received data, if the
-                // remote peer is not themselves receiving data. This means
-                // properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer,
-                // select() for receiving data.
-                // * Hand off all complete messages to the processor, to be
-                // handled without blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
-
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET) {
-                    continue;
-                }
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0, &fdsetRecv,
-                             &fdsetSend, &fdsetError, &timeout);
-        if (interruptNet) {
+        std::set<SOCKET> recv_set;
+        std::set<SOCKET> send_set;
+        std::set<SOCKET> error_set;
+        if (!SocketEvents(recv_set, send_set, error_set)) {
             return;
         }
 
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++) {
-                    FD_SET(i, &fdsetRecv);
-                }
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(
-                    std::chrono::milliseconds(timeout.tv_usec / 1000))) {
-                return;
-            }
-        }
-
         //
         // Accept new connections
         //
         for (const ListenSocket &hListenSocket : vhListenSocket) {
             if (hListenSocket.socket != INVALID_SOCKET &&
-                FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
+                recv_set.count(hListenSocket.socket)) {
                 AcceptConnection(hListenSocket);
             }
         }
@@ -1385,9 +1689,9 @@ void CConnman::ThreadSocketHandler() {
                 if (pnode->hSocket == INVALID_SOCKET) {
                     continue;
                 }
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                recvSet = recv_set.count(pnode->hSocket);
+                sendSet = send_set.count(pnode->hSocket);
+                errorSet = error_set.count(pnode->hSocket);
             }
             if (recvSet || errorSet) {
                 // typical socket buffer is 8K-64K
@@ -1426,7 +1730,7 @@ void CConnman::ThreadSocketHandler() {
                             pnode->fPauseRecv =
                                 pnode->nProcessQueueSize > nReceiveFloodSize;
                         }
-                        WakeMessageHandler();
+                        WakeMessageHandler(pnode->GetId());
                     }
                 } else if (nBytes == 0) {
                     // socket closed gracefully
@@ -1503,11 +1807,21 @@ void CConnman::ThreadSocketHandler() {
 }
 
 void CConnman::WakeMessageHandler() {
-    {
-        std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+    std::lock_guard<std::mutex> lock(mutexMsgProc);
+    for (const std::unique_ptr<MessageHandler> &handler : vMessageHandlers) {
+        handler->fMsgProcWake = true;
+        handler->condMsgProc.notify_one();
+    }
+}
+
+void CConnman::WakeMessageHandler(NodeId id) {
+    std::lock_guard<std::mutex> lock(mutexMsgProc);
+    if (vMessageHandlers.empty()) {
+        return;
     }
-    condMsgProc.notify_one();
+    MessageHandler &handler = *vMessageHandlers[id % vMessageHandlers.size()];
+    handler.fMsgProcWake = true;
+    handler.condMsgProc.notify_one();
 }
 
 #ifdef USE_UPNP
@@ -1668,54 +1982,86 @@ void CConnman::ThreadDNSAddressSeed() {
     }
 
     const std::vector<CDNSSeedData> &vSeeds = Params().DNSSeeds();
-    int found = 0;
+    std::atomic<int> found(0);
 
     LogPrintf("Loading addresses from DNS seeds (could take a while)\n");
 
-    for (const CDNSSeedData &seed : vSeeds) {
-        if (HaveNameProxy()) {
+    if (HaveNameProxy()) {
+        for (const CDNSSeedData &seed : vSeeds) {
             AddOneShot(seed.host);
-        } else {
-            std::vector<CNetAddr> vIPs;
-            std::vector<CAddress> vAdd;
-            ServiceFlags requiredServiceBits = nRelevantServices;
-            if (LookupHost(GetDNSHost(seed, &requiredServiceBits).c_str(), vIPs,
-                           0, true)) {
-                for (const CNetAddr &ip : vIPs) {
-                    int nOneDay = 24 * 3600;
-                    CAddress addr =
-                        CAddress(CService(ip, Params().GetDefaultPort()),
-                                 requiredServiceBits);
-                    // Use a random age between 3 and 7 days old.
-                    addr.nTime = GetTime() - 3 * nOneDay - GetRand(4 * nOneDay);
-                    vAdd.push_back(addr);
-                    found++;
-                }
-            }
-            // TODO: The seed name resolve may fail, yielding an IP of [::],
-            // which results in addrman assigning the same source to results
-            // from different seeds. This should switch to a hard-coded stable
-            // dummy IP for each seed name, so that the resolve is not required
-            // at all.
-            if (!vIPs.empty()) {
-                CService seedSource;
-                Lookup(seed.name.c_str(), seedSource, 0, true);
-                addrman.Add(vAdd, seedSource);
-            }
         }
+        return;
     }
 
-    LogPrintf("%d addresses found from DNS seeds\n", found);
+    // The lookups block, so each seed is resolved on a thread of its own and
+    // its addresses go into addrman as soon as it answers, for
+    // ThreadOpenConnections to pick up, rather than after the seeds before
+    // it. A slow seed only holds up its own addresses.
+    std::vector<std::thread> vThreads;
+    for (const CDNSSeedData &seed : vSeeds) {
+        vThreads.emplace_back(
+            &TraceThread<std::function<void()>>, "dnsseed",
+            std::function<void()>([this, seed, &found]() {
+                std::vector<CNetAddr> vIPs;
+                std::vector<CAddress> vAdd;
+                ServiceFlags requiredServiceBits = nRelevantServices;
+                if (LookupHost(GetDNSHost(seed, &requiredServiceBits).c_str(),
+                               vIPs, 0, true)) {
+                    for (const CNetAddr &ip : vIPs) {
+                        int nOneDay = 24 * 3600;
+                        CAddress addr =
+                            CAddress(CService(ip, Params().GetDefaultPort()),
+                                     requiredServiceBits);
+                        // Use a random age between 3 and 7 days old.
+                        addr.nTime =
+                            GetTime() - 3 * nOneDay - GetRand(4 * nOneDay);
+                        vAdd.push_back(addr);
+                    }
+                }
+                // TODO: The seed name resolve may fail, yielding an IP of
+                // [::], which results in addrman assigning the same source to
+                // results from different seeds. This should switch to a
+                // hard-coded stable dummy IP for each seed name, so that the
+                // resolve is not required at all.
+                if (!vIPs.empty() && !interruptNet) {
+                    CService seedSource;
+                    Lookup(seed.name.c_str(), seedSource, 0, true);
+                    addrman.Add(vAdd, seedSource);
+                    found += vAdd.size();
+                    LogPrint("net", "%d addresses found from DNS seed %s\n",
+                             vAdd.size(), seed.host);
+                }
+            }));
+    }
+    for (std::thread &thread : vThreads) {
+        thread.join();
+    }
+    fDNSSeedsEmpty = !vSeeds.empty() && found == 0;
+
+    LogPrintf("%d addresses found from DNS seeds\n", found.load());
 }
 
 void CConnman::DumpAddresses() {
     int64_t nStart = GetTimeMillis();
 
-    CAddrDB adb;
-    adb.Write(addrman);
+    // Copy the table while holding its lock, then leave the disk to a thread
+    // of its own so the scheduler isn't held up behind it.
+    std::shared_ptr<CDataStream> ssPeers =
+        std::make_shared<CDataStream>(SER_DISK, CLIENT_VERSION);
+    CAddrDB::Snapshot(addrman, *ssPeers);
+    size_t nAddresses = addrman.size();
 
-    LogPrint("net", "Flushed %d addresses to peers.dat  %dms\n", addrman.size(),
-             GetTimeMillis() - nStart);
+    if (threadDumpAddresses.joinable()) {
+        threadDumpAddresses.join();
+    }
+    threadDumpAddresses = std::thread(
+        &TraceThread<std::function<void()>>, "addrdump",
+        std::function<void()>([ssPeers, nAddresses, nStart]() {
+            CAddrDB adb;
+            adb.Write(*ssPeers);
+            LogPrint("net", "Flushed %d addresses to peers.dat  %dms\n",
+                     nAddresses, GetTimeMillis() - nStart);
+        }));
 }
 
 void CConnman::DumpData() {
@@ -1784,7 +2130,8 @@ void CConnman::ThreadOpenConnections() {
         }
 
         // Add seed nodes if DNS seeds are all down (an infrastructure attack?).
-        if (addrman.size() == 0 && (GetTime() - nStart > 60)) {
+        if (addrman.size() == 0 &&
+            (GetTime() - nStart > 60 || fDNSSeedsEmpty)) {
             static bool done = false;
             if (!done) {
                 LogPrintf("Adding fixed seed nodes as DNS doesn't seem to be "
@@ -1822,6 +2169,16 @@ void CConnman::ThreadOpenConnections() {
                 }
             }
         }
+        {
+            // Connections still being established hold their slots already.
+            LOCK(cs_lPendingConnections);
+            for (const PendingConnection &pending : lPendingConnections) {
+                if (!pending.fAddnode) {
+                    setConnected.insert(pending.addr.GetGroup());
+                    nOutbound++;
+                }
+            }
+        }
 
         // Feeler Connections
         //
@@ -2040,9 +2397,12 @@ bool CConnman::OpenNetworkConnection(const CAddress &addrConnect,
     }
     if (!pszDest) {
         if (IsLocal(addrConnect) || FindNode((CNetAddr)addrConnect) ||
-            IsBanned(addrConnect) || FindNode(addrConnect.ToStringIPPort())) {
+            IsBanned(addrConnect) || FindNode(addrConnect.ToStringIPPort()) ||
+            IsConnectionPending(addrConnect)) {
             return false;
         }
+        return StartConnection(addrConnect, fCountFailure, grantOutbound,
+                               fOneShot, fFeeler, fAddnode);
     } else if (FindNode(std::string(pszDest))) {
         return false;
     }
@@ -2052,6 +2412,12 @@ bool CConnman::OpenNetworkConnection(const CAddress &addrConnect,
     if (!pnode) {
         return false;
     }
+    AddOutboundNode(pnode, grantOutbound, fOneShot, fFeeler, fAddnode);
+    return true;
+}
+
+void CConnman::AddOutboundNode(CNode *pnode, CSemaphoreGrant *grantOutbound,
+                               bool fOneShot, bool fFeeler, bool fAddnode) {
     if (grantOutbound) {
         grantOutbound->MoveTo(pnode->grantOutbound);
     }
@@ -2070,18 +2436,181 @@ bool CConnman::OpenNetworkConnection(const CAddress &addrConnect,
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
+}
+
+bool CConnman::StartConnection(const CAddress &addrConnect, bool fCountFailure,
+                               CSemaphoreGrant *grantOutbound, bool fOneShot,
+                               bool fFeeler, bool fAddnode) {
+    LogPrint("net", "trying connection %s lastseen=%.1fhrs\n",
+             addrConnect.ToString(),
+             (double)(GetAdjustedTime() - addrConnect.nTime) / 3600.0);
+
+    std::unique_ptr<CAsyncConnection> conn(new CAsyncConnection(addrConnect));
+    if (conn->GetStatus() == CAsyncConnection::FAILED) {
+        if (!conn->ProxyConnectionFailed()) {
+            addrman.Attempt(addrConnect, fCountFailure);
+        }
+        return false;
+    }
+    if (!IsSelectableSocket(conn->GetSocket())) {
+        LogPrintf("Cannot create connection: non-selectable socket created "
+                  "(fd >= FD_SETSIZE ?)\n");
+        return false;
+    }
 
+    LOCK(cs_lPendingConnections);
+    lPendingConnections.emplace_back();
+    PendingConnection &pending = lPendingConnections.back();
+    pending.conn = std::move(conn);
+    pending.addr = addrConnect;
+    pending.fCountFailure = fCountFailure;
+    pending.fOneShot = fOneShot;
+    pending.fFeeler = fFeeler;
+    pending.fAddnode = fAddnode;
+    if (grantOutbound) {
+        grantOutbound->MoveTo(pending.grantOutbound);
+    }
     return true;
 }
 
-void CConnman::ThreadMessageHandler() {
+bool CConnman::IsConnectionPending(const CService &addr) {
+    LOCK(cs_lPendingConnections);
+    for (const PendingConnection &pending : lPendingConnections) {
+        if (pending.conn->GetDestination() == addr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CConnman::FinishConnection(PendingConnection &pending) {
+    CAsyncConnection &conn = *pending.conn;
+    if (conn.GetStatus() == CAsyncConnection::FAILED) {
+        // If connecting to the node failed, and failure is not caused by a
+        // problem connecting to the proxy, mark this as an attempt.
+        if (!conn.ProxyConnectionFailed()) {
+            addrman.Attempt(pending.addr, pending.fCountFailure);
+        }
+        return;
+    }
+    if (interruptNet || !fNetworkActive || FindNode((CService)pending.addr)) {
+        return;
+    }
+
+    addrman.Attempt(pending.addr, pending.fCountFailure);
+    CNode *pnode = CreateOutboundNode(conn.Release(), pending.addr, nullptr);
+    AddOutboundNode(pnode, &pending.grantOutbound, pending.fOneShot,
+                    pending.fFeeler, pending.fAddnode);
+}
+
+/**
+ * Wait up to SOCKET_EVENTS_TIMEOUT_MS for any of the sockets to be ready,
+ * for writing if paired with true, for reading otherwise.
+ */
+static std::set<SOCKET>
+WaitConnectingSockets(const std::vector<std::pair<SOCKET, bool>> &vWait) {
+    std::set<SOCKET> setReady;
+#ifdef USE_EPOLL
+    std::vector<struct pollfd> vPollFds(vWait.size());
+    for (size_t i = 0; i < vWait.size(); i++) {
+        vPollFds[i].fd = vWait[i].first;
+        vPollFds[i].events = vWait[i].second ? POLLOUT : POLLIN;
+    }
+    if (poll(vPollFds.data(), vPollFds.size(), SOCKET_EVENTS_TIMEOUT_MS) > 0) {
+        for (const struct pollfd &pollfd : vPollFds) {
+            if (pollfd.revents) {
+                setReady.insert(pollfd.fd);
+            }
+        }
+    }
+#else
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    SOCKET hSocketMax = 0;
+    for (const std::pair<SOCKET, bool> &wait : vWait) {
+        FD_SET(wait.first, wait.second ? &fdsetSend : &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, wait.first);
+    }
+    struct timeval timeout = MillisToTimeval(SOCKET_EVENTS_TIMEOUT_MS);
+    if (select(hSocketMax + 1, &fdsetRecv, &fdsetSend, nullptr, &timeout) >
+        0) {
+        for (const std::pair<SOCKET, bool> &wait : vWait) {
+            if (FD_ISSET(wait.first, &fdsetRecv) ||
+                FD_ISSET(wait.first, &fdsetSend)) {
+                setReady.insert(wait.first);
+            }
+        }
+    }
+#endif
+    return setReady;
+}
+
+void CConnman::ThreadConnect() {
+    // Connections through a slow proxy such as Tor take seconds, which are
+    // spent here rather than in ThreadOpenConnections, so that many of them
+    // can be in flight at once.
+    while (!interruptNet) {
+        std::vector<std::pair<SOCKET, bool>> vWait;
+        {
+            LOCK(cs_lPendingConnections);
+            for (const PendingConnection &pending : lPendingConnections) {
+                vWait.emplace_back(pending.conn->GetSocket(),
+                                   pending.conn->WantWrite());
+            }
+        }
+        if (vWait.empty()) {
+            if (!interruptNet.sleep_for(
+                    std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT_MS))) {
+                return;
+            }
+            continue;
+        }
+
+        // Sockets are only closed by this thread, so those waited on still
+        // belong to the same connections.
+        std::set<SOCKET> setReady = WaitConnectingSockets(vWait);
+        if (interruptNet) {
+            return;
+        }
+
+        int64_t nTimeMillis = GetTimeMillis();
+        std::list<PendingConnection> lFinished;
+        {
+            LOCK(cs_lPendingConnections);
+            auto it = lPendingConnections.begin();
+            while (it != lPendingConnections.end()) {
+                CAsyncConnection &conn = *it->conn;
+                if (setReady.count(conn.GetSocket())) {
+                    conn.Step();
+                }
+                if (conn.CheckTimeout(nTimeMillis) ==
+                    CAsyncConnection::IN_PROGRESS) {
+                    ++it;
+                } else {
+                    lFinished.splice(lFinished.end(), lPendingConnections,
+                                     it++);
+                }
+            }
+        }
+        for (PendingConnection &pending : lFinished) {
+            FinishConnection(pending);
+        }
+    }
+}
+
+void CConnman::ThreadMessageHandler(size_t nHandler) {
+    MessageHandler &handler = *vMessageHandlers[nHandler];
+    const size_t nHandlers = vMessageHandlers.size();
     while (!flagInterruptMsgProc) {
         std::vector<CNode *> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode *pnode : vNodesCopy) {
-                pnode->AddRef();
+            for (CNode *pnode : vNodes) {
+                if (size_t(pnode->GetId()) % nHandlers == nHandler) {
+                    vNodesCopy.push_back(pnode->AddRef());
+                }
             }
         }
 
@@ -2120,11 +2649,13 @@ void CConnman::ThreadMessageHandler() {
 
         std::unique_lock<std::mutex> lock(mutexMsgProc);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() +
-                                             std::chrono::milliseconds(100),
-                                   [this] { return fMsgProcWake; });
+            handler.condMsgProc.wait_until(
+                lock,
+                std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(100),
+                [&handler] { return handler.fMsgProcWake; });
         }
-        fMsgProcWake = false;
+        handler.fMsgProcWake = false;
     }
 }
 
@@ -2320,6 +2851,7 @@ void CConnman::SetNetworkActive(bool active) {
 CConnman::CConnman(const Config &configIn, uint64_t nSeed0In, uint64_t nSeed1In)
     : config(&configIn), nSeed0(nSeed0In), nSeed1(nSeed1In) {
     fNetworkActive = true;
+    fDNSSeedsEmpty = false;
     setBannedIsDirty = false;
     fAddressesInitialized = false;
     nLastNodeId = 0;
@@ -2333,38 +2865,16 @@ CConnman::CConnman(const Config &configIn, uint64_t nSeed0In, uint64_t nSeed1In)
     nBestHeight = 0;
     clientInterface = nullptr;
     flagInterruptMsgProc = false;
+#ifdef USE_EPOLL
+    epollfd = -1;
+#endif
 }
 
 NodeId CConnman::GetNewNodeId() {
     return nLastNodeId.fetch_add(1, std::memory_order_relaxed);
 }
 
-bool CConnman::Start(CScheduler &scheduler, std::string &strNodeError,
-                     Options connOptions) {
-    nTotalBytesRecv = 0;
-    nTotalBytesSent = 0;
-    nMaxOutboundTotalBytesSentInCycle = 0;
-    nMaxOutboundCycleStartTime = 0;
-
-    nRelevantServices = connOptions.nRelevantServices;
-    nLocalServices = connOptions.nLocalServices;
-    nMaxConnections = connOptions.nMaxConnections;
-    nMaxOutbound = std::min((connOptions.nMaxOutbound), nMaxConnections);
-    nMaxAddnode = connOptions.nMaxAddnode;
-    nMaxFeeler = connOptions.nMaxFeeler;
-
-    nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
-    nReceiveFloodSize = connOptions.nReceiveFloodSize;
-
-    nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
-    nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
-
-    SetBestHeight(connOptions.nBestHeight);
-
-    clientInterface = connOptions.uiInterface;
-    if (clientInterface) {
-        clientInterface->InitMessage(_("Loading addresses..."));
-    }
+void CConnman::LoadAddresses() {
     // Load addresses from peers.dat
     int64_t nStart = GetTimeMillis();
     {
@@ -2379,9 +2889,6 @@ bool CConnman::Start(CScheduler &scheduler, std::string &strNodeError,
             DumpAddresses();
         }
     }
-    if (clientInterface) {
-        clientInterface->InitMessage(_("Loading banlist..."));
-    }
     // Load addresses from banlist.dat
     nStart = GetTimeMillis();
     CBanDB bandb;
@@ -2404,9 +2911,40 @@ bool CConnman::Start(CScheduler &scheduler, std::string &strNodeError,
         DumpBanlist();
     }
 
-    uiInterface.InitMessage(_("Starting network threads..."));
-
     fAddressesInitialized = true;
+}
+
+bool CConnman::Start(CScheduler &scheduler, std::string &strNodeError,
+                     Options connOptions) {
+    nTotalBytesRecv = 0;
+    nTotalBytesSent = 0;
+    nMaxOutboundTotalBytesSentInCycle = 0;
+    nMaxOutboundCycleStartTime = 0;
+
+    nRelevantServices = connOptions.nRelevantServices;
+    nLocalServices = connOptions.nLocalServices;
+    nMaxConnections = connOptions.nMaxConnections;
+    nMaxOutbound = std::min((connOptions.nMaxOutbound), nMaxConnections);
+    nMaxAddnode = connOptions.nMaxAddnode;
+    nMaxFeeler = connOptions.nMaxFeeler;
+
+    nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
+    nReceiveFloodSize = connOptions.nReceiveFloodSize;
+
+    nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
+    nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
+
+    SetBestHeight(connOptions.nBestHeight);
+
+    clientInterface = connOptions.uiInterface;
+    if (!fAddressesInitialized) {
+        if (clientInterface) {
+            clientInterface->InitMessage(_("Loading addresses..."));
+        }
+        LoadAddresses();
+    }
+
+    uiInterface.InitMessage(_("Starting network threads..."));
 
     if (semOutbound == nullptr) {
         // initialize semaphore
@@ -2427,9 +2965,38 @@ bool CConnman::Start(CScheduler &scheduler, std::string &strNodeError,
 
     {
         std::unique_lock<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = false;
+        vMessageHandlers.clear();
+        for (int i = 0; i < std::max(connOptions.nMessageHandlerThreads, 1);
+             i++) {
+            vMessageHandlers.emplace_back(new MessageHandler());
+            vMessageHandlers.back()->strName = strprintf("msghand%d", i);
+        }
     }
 
+#ifdef USE_EPOLL
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollfd == -1) {
+        LogPrintf("epoll_create1 failed, falling back to select: %s\n",
+                  NetworkErrorString(WSAGetLastError()));
+    }
+    for (const ListenSocket &hListenSocket : vhListenSocket) {
+        if (epollfd == -1) {
+            break;
+        }
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = hListenSocket.socket;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, hListenSocket.socket, &event) !=
+            0) {
+            LogPrintf("epoll_ctl failed for listening socket, falling back to "
+                      "select: %s\n",
+                      NetworkErrorString(WSAGetLastError()));
+            close(epollfd);
+            epollfd = -1;
+        }
+    }
+#endif
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(
         &TraceThread<std::function<void()>>, "net",
@@ -2458,17 +3025,25 @@ bool CConnman::Start(CScheduler &scheduler, std::string &strNodeError,
             std::thread(&TraceThread<std::function<void()>>, "opencon",
                         std::function<void()>(
                             std::bind(&CConnman::ThreadOpenConnections, this)));
+        threadConnect =
+            std::thread(&TraceThread<std::function<void()>>, "connect",
+                        std::function<void()>(
+                            std::bind(&CConnman::ThreadConnect, this)));
     }
 
     // Process messages
-    threadMessageHandler =
-        std::thread(&TraceThread<std::function<void()>>, "msghand",
-                    std::function<void()>(
-                        std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (size_t i = 0; i < vMessageHandlers.size(); i++) {
+        MessageHandler &handler = *vMessageHandlers[i];
+        handler.thread = std::thread(
+            &TraceThread<std::function<void()>>, handler.strName.c_str(),
+            std::function<void()>(
+                std::bind(&CConnman::ThreadMessageHandler, this, i)));
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(boost::bind(&CConnman::DumpData, this),
-                            DUMP_ADDRESSES_INTERVAL);
+                            DUMP_ADDRESSES_INTERVAL, "dumpaddresses",
+                            CScheduler::PRIORITY_LOW);
 
     return true;
 }
@@ -2489,8 +3064,11 @@ void CConnman::Interrupt() {
     {
         std::lock_guard<std::mutex> lock(mutexMsgProc);
         flagInterruptMsgProc = true;
+        for (const std::unique_ptr<MessageHandler> &handler :
+             vMessageHandlers) {
+            handler->condMsgProc.notify_all();
+        }
     }
-    condMsgProc.notify_all();
 
     interruptNet();
     InterruptSocks5(true);
@@ -2509,12 +3087,17 @@ void CConnman::Interrupt() {
 }
 
 void CConnman::Stop() {
-    if (threadMessageHandler.joinable()) {
-        threadMessageHandler.join();
+    for (const std::unique_ptr<MessageHandler> &handler : vMessageHandlers) {
+        if (handler->thread.joinable()) {
+            handler->thread.join();
+        }
     }
     if (threadOpenConnections.joinable()) {
         threadOpenConnections.join();
     }
+    if (threadConnect.joinable()) {
+        threadConnect.join();
+    }
     if (threadOpenAddedConnections.joinable()) {
         threadOpenAddedConnections.join();
     }
@@ -2524,11 +3107,20 @@ void CConnman::Stop() {
     if (threadSocketHandler.joinable()) {
         threadSocketHandler.join();
     }
+#ifdef USE_EPOLL
+    if (epollfd != -1) {
+        close(epollfd);
+        epollfd = -1;
+    }
+#endif
 
     if (fAddressesInitialized) {
         DumpData();
         fAddressesInitialized = false;
     }
+    if (threadDumpAddresses.joinable()) {
+        threadDumpAddresses.join();
+    }
 
     // Close sockets
     for (CNode *pnode : vNodes) {
@@ -2553,6 +3145,10 @@ void CConnman::Stop() {
     vNodes.clear();
     vNodesDisconnected.clear();
     vhListenSocket.clear();
+    {
+        LOCK(cs_lPendingConnections);
+        lPendingConnections.clear();
+    }
     delete semOutbound;
     semOutbound = nullptr;
     delete semAddnode;
@@ -2823,7 +3419,9 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn,
     fDisconnect = false;
     nRefCount = 0;
     nSendSize = 0;
+    nSendQueueSize.fill(0);
     nSendOffset = 0;
+    nSendPriority = SEND_PRIORITY_BLOCK;
     hashContinue = uint256();
     nStartingHeight = -1;
     filterInventoryKnown.reset();
@@ -2849,6 +3447,9 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn,
     fPauseRecv = false;
     fPauseSend = false;
     nProcessQueueSize = 0;
+#ifdef USE_EPOLL
+    nEpollEvents = 0;
+#endif
 
     for (const std::string &msg : getAllNetMessageTypes()) {
         mapRecvBytesPerMsgCmd[msg] = 0;
@@ -2923,8 +3524,8 @@ void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
     LogPrint("net", "sending %s (%d bytes) peer=%d\n",
              SanitizeString(msg.command.c_str()), nMessageSize, pnode->id);
 
-    std::vector<uint8_t> serializedHeader;
-    serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
+    std::vector<uint8_t> serializedHeader =
+        SendBufferPool().Get(CMessageHeader::HEADER_SIZE);
     uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
     CMessageHeader hdr(Params().NetMagic(), msg.command.c_str(), nMessageSize);
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
@@ -2934,19 +3535,22 @@ void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
     size_t nBytesSent = 0;
     {
         LOCK(pnode->cs_vSend);
-        bool optimisticSend(pnode->vSendMsg.empty());
+        bool optimisticSend(pnode->nSendSize == 0);
+        const SendPriority priority = pnode->fSuccessfullyConnected
+                                          ? GetSendPriority(msg.command)
+                                          : SEND_PRIORITY_BLOCK;
 
         // log total amount of bytes per command
         pnode->mapSendBytesPerMsgCmd[msg.command] += nTotalSize;
         pnode->nSendSize += nTotalSize;
+        pnode->nSendQueueSize[priority] += nTotalSize;
+        NetMessageMetrics().Sent(msg.command, nTotalSize);
 
         if (pnode->nSendSize > nSendBufferMaxSize) {
             pnode->fPauseSend = true;
         }
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize) {
-            pnode->vSendMsg.push_back(std::move(msg.data));
-        }
+        pnode->vSendMsg[priority].push_back(
+            CQueuedNetMsg{std::move(serializedHeader), std::move(msg.data)});
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true) {
@@ -2956,6 +3560,11 @@ void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
     if (nBytesSent) {
         RecordBytesSent(nBytesSent);
     }
+    if (TRACE_ACTIVE(net, outbound_message)) {
+        const std::string strAddr = pnode->addr.ToString();
+        TRACE5(net, outbound_message, pnode->id, strAddr.c_str(),
+               msg.command.c_str(), nMessageSize, nBytesSent);
+    }
 }
 
 bool CConnman::ForNode(NodeId id, std::function<bool(CNode *pnode)> func) {
@@ -10,12 +10,15 @@
 #include "addrdb.h"
 #include "addrman.h"
 #include "amount.h"
+#include "banindex.h"
 #include "bloom.h"
+#include "bufferpool.h"
 #include "chainparams.h"
 #include "compat.h"
 #include "hash.h"
 #include "limitedmap.h"
 #include "netaddress.h"
+#include "netbase.h"
 #include "protocol.h"
 #include "random.h"
 #include "streams.h"
@@ -23,11 +26,13 @@
 #include "threadinterrupt.h"
 #include "uint256.h"
 
+#include <array>
 #include <atomic>
 #include <condition_variable>
 #include <cstdint>
 #include <deque>
 #include <memory>
+#include <set>
 #include <thread>
 
 #ifndef WIN32
@@ -87,6 +92,12 @@ static const uint64_t DEFAULT_MAX_UPLOAD_TARGET = 0;
 static const uint64_t MAX_UPLOAD_TIMEFRAME = 60 * 60 * 24;
 /** Default for blocks only*/
 static const bool DEFAULT_BLOCKSONLY = false;
+/** Default for -msghandlerthreads, peers are split between them by id. */
+static const int DEFAULT_MSGHANDLER_THREADS = 4;
+/** Maximum number of message handler threads. */
+static const int MAX_MSGHANDLER_THREADS = 16;
+/** Free buffers kept per size class by each of the message buffer pools. */
+static const size_t NET_BUFFER_POOL_DEPTH = 64;
 
 // Force DNS seed use ahead of UAHF fork, to ensure peers are found
 // as long as seeders are working.
@@ -114,6 +125,37 @@ class CTransaction;
 class CNodeStats;
 class CClientUIInterface;
 
+/** Buffers for outgoing message headers and payloads, shared by all peers. */
+CBufferPool<std::vector<uint8_t>> &SendBufferPool();
+/** Buffers for received message payloads, shared by all peers. */
+CBufferPool<CSerializeData> &RecvBufferPool();
+
+/**
+ * The send queues of a peer, in the order SocketSendData drains them: block
+ * propagation first, so that it doesn't wait behind transactions with large
+ * content queued to the same peer, and addresses last.
+ */
+enum SendPriority {
+    SEND_PRIORITY_BLOCK,
+    SEND_PRIORITY_CONTROL,
+    SEND_PRIORITY_TX,
+    SEND_PRIORITY_ADDR,
+    NUM_SEND_PRIORITIES
+};
+
+/** The send queue messages of command go to */
+SendPriority GetSendPriority(const std::string &command);
+/** The name of priority, as getpeerinfo reports it */
+std::string SendPriorityToString(int priority);
+
+/** A message queued to be sent, its header and payload (empty if none) */
+struct CQueuedNetMsg {
+    std::vector<uint8_t> header;
+    std::vector<uint8_t> data;
+
+    size_t size() const { return header.size() + data.size(); }
+};
+
 struct CSerializedNetMsg {
     CSerializedNetMsg() = default;
     CSerializedNetMsg(CSerializedNetMsg &&) = default;
@@ -148,9 +190,16 @@ public:
         unsigned int nReceiveFloodSize = 0;
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
+        int nMessageHandlerThreads = 1;
     };
     CConnman(const Config &configIn, uint64_t seed0, uint64_t seed1);
     ~CConnman();
+    /**
+     * Read peers.dat and banlist.dat. Start() does it if it wasn't done yet,
+     * but nothing here depends on the chain: it can run on a thread of its
+     * own while the block index loads, as long as it finishes before Start().
+     */
+    void LoadAddresses();
     bool Start(CScheduler &scheduler, std::string &strNodeError,
                Options options);
     void Stop();
@@ -159,6 +208,10 @@ public:
                         bool fWhitelisted = false);
     bool GetNetworkActive() const { return fNetworkActive; };
     void SetNetworkActive(bool active);
+    /**
+     * Connect to strDest, or to addrConnect if none. The latter only starts
+     * the connection, which ThreadConnect then establishes.
+     */
     bool OpenNetworkConnection(const CAddress &addrConnect, bool fCountFailure,
                                CSemaphoreGrant *grantOutbound = nullptr,
                                const char *strDest = nullptr,
@@ -286,6 +339,7 @@ public:
     unsigned int GetReceiveFloodSize() const;
 
     void WakeMessageHandler();
+    void WakeMessageHandler(NodeId id);
 
 private:
     struct ListenSocket {
@@ -299,11 +353,46 @@ private:
     void ThreadOpenAddedConnections();
     void ProcessOneShot();
     void ThreadOpenConnections();
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(size_t nHandler);
     void AcceptConnection(const ListenSocket &hListenSocket);
+    void WantedSocketEvents(CNode *pnode, bool &fRecv, bool &fSend);
+#ifdef USE_EPOLL
+    bool EpollSocketEvents(std::set<SOCKET> &recv_set,
+                           std::set<SOCKET> &send_set,
+                           std::set<SOCKET> &error_set);
+#endif
+    bool SelectSocketEvents(std::set<SOCKET> &recv_set,
+                            std::set<SOCKET> &send_set,
+                            std::set<SOCKET> &error_set);
+    /**
+     * Wait up to SOCKET_EVENTS_TIMEOUT_MS for socket readiness. Returns false
+     * if interrupted.
+     */
+    bool SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set,
+                      std::set<SOCKET> &error_set);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
+    /**
+     * An outbound connection ThreadConnect is establishing, and what to make
+     * of the node once it is.
+     */
+    struct PendingConnection {
+        std::unique_ptr<CAsyncConnection> conn;
+        CAddress addr;
+        bool fCountFailure = false;
+        bool fOneShot = false;
+        bool fFeeler = false;
+        bool fAddnode = false;
+        CSemaphoreGrant grantOutbound;
+    };
+    bool StartConnection(const CAddress &addrConnect, bool fCountFailure,
+                         CSemaphoreGrant *grantOutbound, bool fOneShot,
+                         bool fFeeler, bool fAddnode);
+    bool IsConnectionPending(const CService &addr);
+    void FinishConnection(PendingConnection &pending);
+    void ThreadConnect();
+
     uint64_t CalculateKeyedNetGroup(const CAddress &ad) const;
 
     CNode *FindNode(const CNetAddr &ip);
@@ -314,6 +403,10 @@ private:
     bool AttemptToEvictConnection();
     CNode *ConnectNode(CAddress addrConnect, const char *pszDest,
                        bool fCountFailure);
+    CNode *CreateOutboundNode(SOCKET hSocket, const CAddress &addrConnect,
+                              const char *pszDest);
+    void AddOutboundNode(CNode *pnode, CSemaphoreGrant *grantOutbound,
+                         bool fOneShot, bool fFeeler, bool fAddnode);
     bool IsWhitelistedRange(const CNetAddr &addr);
 
     void DeleteNode(CNode *pnode);
@@ -361,8 +454,17 @@ private:
     unsigned int nReceiveFloodSize;
 
     std::vector<ListenSocket> vhListenSocket;
+#ifdef USE_EPOLL
+    // Set of all listening and peer sockets, -1 to fall back to select().
+    int epollfd;
+#endif
     std::atomic<bool> fNetworkActive;
+    //! Whether all DNS seeds answered without a single address, so that the
+    //! fixed seeds needn't wait.
+    std::atomic<bool> fDNSSeedsEmpty;
     banmap_t setBanned;
+    //! setBanned by netmask, for IsBanned(CNetAddr)
+    CBanIndex banIndex;
     CCriticalSection cs_setBanned;
     bool setBannedIsDirty;
     bool fAddressesInitialized;
@@ -374,6 +476,8 @@ private:
     std::vector<CNode *> vNodes;
     std::list<CNode *> vNodesDisconnected;
     mutable CCriticalSection cs_vNodes;
+    std::list<PendingConnection> lPendingConnections;
+    CCriticalSection cs_lPendingConnections;
     std::atomic<NodeId> nLastNodeId;
 
     /** Services this instance offers */
@@ -394,10 +498,20 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /**
+     * A message handler thread, which processes the peers whose id modulo the
+     * number of handlers is its index. One slow peer then only delays the
+     * peers sharing its handler.
+     */
+    struct MessageHandler {
+        std::string strName;
+        std::thread thread;
+        std::condition_variable condMsgProc;
+        /** flag for waking the message processor, guarded by mutexMsgProc. */
+        bool fMsgProcWake = false;
+    };
+    std::vector<std::unique_ptr<MessageHandler>> vMessageHandlers;
 
-    std::condition_variable condMsgProc;
     std::mutex mutexMsgProc;
     std::atomic<bool> flagInterruptMsgProc;
 
@@ -407,7 +521,9 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::thread threadConnect;
+    //! writes the latest peers.dat snapshot, see DumpAddresses
+    std::thread threadDumpAddresses;
 };
 extern std::unique_ptr<CConnman> g_connman;
 void Discover(boost::thread_group &threadGroup);
@@ -512,6 +628,7 @@ public:
     int nStartingHeight;
     uint64_t nSendBytes;
     mapMsgCmdSize mapSendBytesPerMsgCmd;
+    std::array<size_t, NUM_SEND_PRIORITIES> nSendQueueSize;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
     bool fWhitelisted;
@@ -555,6 +672,16 @@ public:
         nTime = 0;
     }
 
+    CNetMessage(CNetMessage &&) = default;
+    CNetMessage &operator=(CNetMessage &&) = default;
+
+    // Hand the payload buffer back for the next message to use.
+    ~CNetMessage() {
+        CSerializeData vch;
+        vRecv.SwapData(vch);
+        RecvBufferPool().Put(std::move(vch));
+    }
+
     bool complete() const {
         if (!in_data) {
             return false;
@@ -586,13 +713,24 @@ public:
     SOCKET hSocket;
     // Total size of all vSendMsg entries.
     size_t nSendSize;
-    // Offset inside the first vSendMsg already sent.
+    // Size of the entries of each of vSendMsg.
+    std::array<size_t, NUM_SEND_PRIORITIES> nSendQueueSize;
+    // Offset inside the message partly sent, the first of
+    // vSendMsg[nSendPriority]. 0 if none is.
     size_t nSendOffset;
+    int nSendPriority;
     uint64_t nSendBytes;
-    std::deque<std::vector<uint8_t>> vSendMsg;
+    // Messages waiting to be sent, by SendPriority. Until the handshake is done
+    // they all go to the first, so that nothing gets ahead of version and
+    // verack.
+    std::deque<CQueuedNetMsg> vSendMsg[NUM_SEND_PRIORITIES];
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
+#ifdef USE_EPOLL
+    // Events hSocket is registered for with CConnman's epoll set, 0 if none.
+    uint32_t nEpollEvents;
+#endif
 
     CCriticalSection cs_vProcessMsg;
     std::list<CNetMessage> vProcessMsg;
@@ -656,6 +794,9 @@ public:
     std::atomic<int> nStartingHeight;
 
     // flood relay
+    // Guards vAddrToSend and addrKnown, as other peers' message handler
+    // threads relay addresses to this node.
+    CCriticalSection cs_addrToSend;
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
     bool fGetAddr;
@@ -761,6 +902,7 @@ public:
     void Release() { nRefCount--; }
 
     void AddAddressKnown(const CAddress &_addr) {
+        LOCK(cs_addrToSend);
         addrKnown.insert(_addr.GetKey());
     }
 
@@ -768,6 +910,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(cs_addrToSend);
         if (_addr.IsValid() && !addrKnown.contains(_addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand.randrange(vAddrToSend.size())] =
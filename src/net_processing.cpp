@@ -8,6 +8,8 @@
 #include "addrman.h"
 #include "arith_uint256.h"
 #include "blockencodings.h"
+#include "blockfilter.h"
+#include "blockfilterindex.h"
 #include "chainparams.h"
 #include "config.h"
 #include "consensus/validation.h"
@@ -23,7 +25,12 @@
 #include "primitives/transaction.h"
 #include "random.h"
 #include "tinyformat.h"
+#include "trace.h"
 #include "txmempool.h"
+#include "txorphanage.h"
+#include "txreconciliation.h"
+#include "txrelay.h"
+#include "txskeleton.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
@@ -38,26 +45,12 @@
 #error "Bitcoin cannot be compiled without assertions."
 #endif
 
+TRACE_SEMAPHORE(net, inbound_message);
+
 // Used only to inform the wallet of when we last received a block.
 std::atomic<int64_t> nTimeBestReceived(0);
 
-struct IteratorComparator {
-    template <typename I> bool operator()(const I &a, const I &b) {
-        return &(*a) < &(*b);
-    }
-};
-
-struct COrphanTx {
-    // When modifying, adapt the copy of this definition in tests/DoS_tests.
-    CTransactionRef tx;
-    NodeId fromPeer;
-    int64_t nTimeExpire;
-};
-std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(cs_main);
-std::map<COutPoint,
-         std::set<std::map<uint256, COrphanTx>::iterator, IteratorComparator>>
-    mapOrphanTransactionsByPrev GUARDED_BY(cs_main);
-void EraseOrphansFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+static CTxOrphanage orphanage;
 
 static size_t vExtraTxnForCompactIt = 0;
 static std::vector<std::pair<uint256, CTransactionRef>>
@@ -71,6 +64,38 @@ namespace {
 /** Number of nodes with fSyncStarted. */
 int nSyncStarted = 0;
 
+/**
+ * A stretch of the header chain between two checkpoints, fetched from a peer
+ * of its own while the main header sync is still behind it. Headers that don't
+ * connect to the block index yet are held until the chain below them is
+ * linked. Protected by cs_main.
+ */
+struct HeaderRange {
+    //! The checkpoint the range starts after.
+    uint256 hashAnchor;
+    //! The last header received for the range, hashAnchor at first.
+    uint256 hashLast;
+    //! The checkpoint ending the range, null past the last checkpoint.
+    uint256 hashStop;
+    //! Height a peer needs to have to serve the whole range.
+    int nStopHeight;
+    //! Received headers not yet in the block index.
+    std::vector<CBlockHeader> vHeaders;
+    //! Peer that sent all of vHeaders, -1 if several did.
+    NodeId nodeidSource;
+    //! Peer fetching the range, -1 if none.
+    NodeId nodeid;
+    //! Last peer the range timed out on, so it goes to someone else.
+    NodeId nodeidStalled;
+    //! When the range was last requested or delivered, in seconds.
+    int64_t nLastProgress;
+    bool fComplete;
+};
+std::vector<HeaderRange> vHeaderRanges;
+bool fHeaderRangesInit = false;
+/** Headers held across all of vHeaderRanges. */
+size_t nHeaderRangeBuffered = 0;
+
 /**
  * Sources of received blocks, saved to be able to send them reject messages or
  * ban them when processing happens afterwards. Protected by cs_main.
@@ -110,6 +135,8 @@ struct QueuedBlock {
     bool fValidatedHeaders;
     //!< Optional, used for CMPCTBLOCK downloads
     std::unique_ptr<PartiallyDownloadedBlock> partialBlock;
+    //!< When the block was requested, in microseconds.
+    int64_t nTimeRequested;
 };
 std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator>>
     mapBlocksInFlight;
@@ -123,12 +150,39 @@ int nPreferredDownload = 0;
 /** Number of peers from which we're downloading blocks. */
 int nPeersWithValidatedDownloads = 0;
 
+/** Transactions waiting to be announced to peers. */
+CTxRelay txRelay;
+
+/** Number of outbound reconciling peers we still flood to. */
+int nReconFloodPeers = 0;
+
 /** Relay map, protected by cs_main. */
 typedef std::map<uint256, CTransactionRef> MapRelay;
 MapRelay mapRelay;
 /** Expiration-time ordered list of (expire time, relay map entry) pairs,
  * protected by cs_main). */
 std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration;
+
+/** The content of a transaction being fetched after its skeleton. */
+struct TxAssembly {
+    CPartialContentTx partial;
+    //! The peer that sent the skeleton, whose chunk hashes we go by.
+    NodeId nodeSkeleton;
+    //! Peers we can fetch the content from: the skeleton's sender and those
+    //! that announced the transaction since.
+    std::vector<NodeId> vSources;
+    //! Chunks requested, by index, with the peer and when (in seconds).
+    std::map<size_t, std::pair<NodeId, int64_t>> mapInFlight;
+    int64_t nStarted;
+
+    TxAssembly(const CTxSkeleton &skeleton, NodeId nodeid)
+        : partial(skeleton), nodeSkeleton(nodeid), vSources(1, nodeid),
+          nStarted(GetTime()) {}
+};
+/** Transactions whose content we're fetching, by id, protected by cs_main. */
+std::map<uint256, TxAssembly> mapTxAssemblies;
+/** When to next look for timed out content requests, protected by cs_main. */
+int64_t nNextTxAssemblyCheck = 0;
 } // namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -177,6 +231,33 @@ struct CNodeState {
     int nUnconnectingHeaders;
     //! Whether we've started headers synchronization with this peer.
     bool fSyncStarted;
+    //! Index in vHeaderRanges of the range this peer is fetching, or -1.
+    int nHeaderRange;
+    //! This peer's slot in txRelay, and how far it has read the queue.
+    int nTxRelaySlot;
+    uint64_t nTxRelayCursor;
+    //! The salt we sent in sendrecon, 0 if we didn't offer reconciliation.
+    uint64_t nReconLocalSalt;
+    //! Whether transactions are announced to this peer by reconciliation.
+    bool fReconcile;
+    //! Whether we flood transactions to it nonetheless.
+    bool fReconFlood;
+    //! Salt of the short ids used with this peer.
+    uint256 reconSalt;
+    //! Transactions for the next reconciliation, by short id.
+    std::map<uint32_t, uint256> mapReconSet;
+    //! Transactions in the last sketch we sent, until the peer answers it.
+    std::map<uint32_t, uint256> mapReconSnapshot;
+    //! When we next ask this peer for a sketch (outbound peers only), in
+    //! seconds, and whether we are waiting for one.
+    int64_t nNextReconRequest;
+    bool fReconRequested;
+    //! Whether we sent sendtxskel, and whether the peer did too, so that we
+    //! relay transactions with much content to it as skeletons.
+    bool fTxSkelOffered;
+    bool fTxSkeleton;
+    //! Content chunks we requested from this peer and are waiting for.
+    int nContentInFlight;
     //! Since when we're stalling block download progress (in microseconds), or
     //! 0.
     int64_t nStallingSince;
@@ -186,6 +267,12 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! Moving averages of the rate (bytes per second) and size of the blocks
+    //! this peer delivered, 0 until it delivered one.
+    double dBlockBytesPerSec;
+    double dAvgBlockBytes;
+    //! When this peer last delivered a requested block (in microseconds).
+    int64_t nLastBlockReceived;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block
@@ -207,6 +294,13 @@ struct CNodeState {
      * non-witnesses in cmpctblocks/blocktxns.
      */
     bool fSupportsDesiredCmpctVersion;
+    //! Compact blocks from this peer we tried to reconstruct.
+    int nCmpctBlocksReceived;
+    //! How many of those needed a getblocktxn round trip.
+    int nCmpctBlockRoundTrips;
+    //! Transactions in those blocks, and how many of them we already had.
+    uint64_t nCmpctBlockTxCount;
+    uint64_t nCmpctBlockTxAvailable;
 
     CNodeState(CAddress addrIn, std::string addrNameIn)
         : address(addrIn), name(addrNameIn) {
@@ -219,15 +313,33 @@ struct CNodeState {
         pindexBestHeaderSent = nullptr;
         nUnconnectingHeaders = 0;
         fSyncStarted = false;
+        nHeaderRange = -1;
+        nTxRelaySlot = -1;
+        nTxRelayCursor = 0;
+        nReconLocalSalt = 0;
+        fReconcile = false;
+        fReconFlood = false;
+        nNextReconRequest = 0;
+        fReconRequested = false;
+        fTxSkelOffered = false;
+        fTxSkeleton = false;
+        nContentInFlight = 0;
         nStallingSince = 0;
         nDownloadingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        dBlockBytesPerSec = 0;
+        dAvgBlockBytes = 0;
+        nLastBlockReceived = 0;
         fPreferredDownload = false;
         fPreferHeaders = false;
         fPreferHeaderAndIDs = false;
         fProvidesHeaderAndIDs = false;
         fSupportsDesiredCmpctVersion = false;
+        nCmpctBlocksReceived = 0;
+        nCmpctBlockRoundTrips = 0;
+        nCmpctBlockTxCount = 0;
+        nCmpctBlockTxAvailable = 0;
     }
 };
 
@@ -244,6 +356,96 @@ CNodeState *State(NodeId pnode) {
     return &it->second;
 }
 
+// Requires cs_main.
+void RemoveTxAssemblySource(TxAssembly &assembly, NodeId nodeid) {
+    assembly.vSources.erase(std::remove(assembly.vSources.begin(),
+                                        assembly.vSources.end(), nodeid),
+                            assembly.vSources.end());
+    for (auto it = assembly.mapInFlight.begin();
+         it != assembly.mapInFlight.end();) {
+        if (it->second.first == nodeid) {
+            State(nodeid)->nContentInFlight--;
+            assembly.mapInFlight.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Requires cs_main.
+void EraseTxAssembly(std::map<uint256, TxAssembly>::iterator it) {
+    for (const auto &entry : it->second.mapInFlight) {
+        State(entry.second.first)->nContentInFlight--;
+    }
+    mapTxAssemblies.erase(it);
+}
+
+/**
+ * Request the chunks of assembly that are neither there nor in flight, each
+ * of the source with the fewest chunks in flight. Requires cs_main.
+ */
+void RequestContentChunks(TxAssembly &assembly, CConnman &connman) {
+    const CPartialContentTx &partial = assembly.partial;
+    for (size_t i = 0; i < partial.GetChunkCount(); i++) {
+        if (partial.HaveChunk(i) || assembly.mapInFlight.count(i)) {
+            continue;
+        }
+        NodeId nodeBest = -1;
+        int nBest = MAX_CONTENT_CHUNKS_IN_FLIGHT;
+        for (NodeId nodeid : assembly.vSources) {
+            if (State(nodeid)->nContentInFlight < nBest) {
+                nodeBest = nodeid;
+                nBest = State(nodeid)->nContentInFlight;
+            }
+        }
+        if (nodeBest < 0) {
+            // All sources are busy, more is requested as chunks arrive.
+            return;
+        }
+        const CPartialContentTx::Chunk &chunk = partial.GetChunk(i);
+        connman.ForNode(nodeBest, [&connman, &partial, &chunk](CNode *pnode) {
+            connman.PushMessage(
+                pnode, CNetMsgMaker(pnode->GetSendVersion())
+                           .Make(NetMsgType::GETCONTENT, partial.GetId(),
+                                 chunk.nOutput, chunk.nOffset));
+            return true;
+        });
+        assembly.mapInFlight[i] = std::make_pair(nodeBest, GetTime());
+        State(nodeBest)->nContentInFlight++;
+    }
+}
+
+/**
+ * Request the chunks peers didn't deliver in time of other sources, and give
+ * up on the transactions whose content takes too long. Requires cs_main.
+ */
+void CheckTxAssemblies(CConnman &connman) {
+    const int64_t nNow = GetTime();
+    for (auto it = mapTxAssemblies.begin(); it != mapTxAssemblies.end();) {
+        TxAssembly &assembly = it->second;
+        std::vector<NodeId> vSlow;
+        for (const auto &entry : assembly.mapInFlight) {
+            if (entry.second.second + TXCONTENT_CHUNK_TIMEOUT < nNow) {
+                vSlow.push_back(entry.second.first);
+            }
+        }
+        for (NodeId nodeid : vSlow) {
+            LogPrint("net", "content of %s timed out, peer=%d\n",
+                     it->first.ToString(), nodeid);
+            RemoveTxAssemblySource(assembly, nodeid);
+        }
+        if (assembly.vSources.empty() ||
+            assembly.nStarted + TXASSEMBLY_TIMEOUT < nNow) {
+            LogPrint("net", "giving up on the content of %s\n",
+                     it->first.ToString());
+            EraseTxAssembly(it++);
+            continue;
+        }
+        RequestContentChunks(assembly, connman);
+        ++it;
+    }
+}
+
 void UpdatePreferredDownload(CNode *node, CNodeState *state) {
     nPreferredDownload -= state->fPreferredDownload;
 
@@ -293,10 +495,12 @@ void InitializeNode(const Config &config, CNode *pnode, CConnman &connman) {
     NodeId nodeid = pnode->GetId();
     {
         LOCK(cs_main);
-        mapNodeState.emplace_hint(
+        auto it = mapNodeState.emplace_hint(
             mapNodeState.end(), std::piecewise_construct,
             std::forward_as_tuple(nodeid),
             std::forward_as_tuple(addr, std::move(addrName)));
+        CNodeState &state = it->second;
+        state.nTxRelaySlot = txRelay.AddPeer(state.nTxRelayCursor);
     }
 
     if (!pnode->fInbound) {
@@ -312,6 +516,11 @@ void FinalizeNode(NodeId nodeid, bool &fUpdateConnectionTime) {
     if (state->fSyncStarted) {
         nSyncStarted--;
     }
+    if (state->nHeaderRange >= 0) {
+        vHeaderRanges[state->nHeaderRange].nodeid = -1;
+    }
+    txRelay.RemovePeer(state->nTxRelaySlot);
+    nReconFloodPeers -= state->fReconFlood;
 
     if (state->nMisbehavior == 0 && state->fCurrentlyConnected) {
         fUpdateConnectionTime = true;
@@ -336,7 +545,18 @@ void FinalizeNode(NodeId nodeid, bool &fUpdateConnectionTime) {
         }
     }
 
-    EraseOrphansFor(nodeid);
+    orphanage.EraseForPeer(nodeid);
+    // The chunks it had in flight are requested of other sources the next
+    // time the assemblies are checked.
+    for (auto it = mapTxAssemblies.begin(); it != mapTxAssemblies.end();) {
+        RemoveTxAssemblySource(it->second, nodeid);
+        if (it->second.vSources.empty()) {
+            EraseTxAssembly(it++);
+        } else {
+            ++it;
+        }
+    }
+    nNextTxAssemblyCheck = 0;
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
@@ -348,6 +568,8 @@ void FinalizeNode(NodeId nodeid, bool &fUpdateConnectionTime) {
         assert(mapBlocksInFlight.empty());
         assert(nPreferredDownload == 0);
         assert(nPeersWithValidatedDownloads == 0);
+        assert(nReconFloodPeers == 0);
+        assert(mapTxAssemblies.empty());
     }
 }
 
@@ -413,7 +635,8 @@ MarkBlockAsInFlight(const Config &config, NodeId nodeid, const uint256 &hash,
         state->vBlocksInFlight.end(),
         {hash, pindex, pindex != nullptr,
          std::unique_ptr<PartiallyDownloadedBlock>(
-             pit ? new PartiallyDownloadedBlock(config, &mempool) : nullptr)});
+             pit ? new PartiallyDownloadedBlock(config, &mempool) : nullptr),
+         GetTimeMicros()});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -436,6 +659,47 @@ MarkBlockAsInFlight(const Config &config, NodeId nodeid, const uint256 &hash,
     return true;
 }
 
+// Requires cs_main.
+// Update the download rate of a peer that delivered a block we requested from
+// it. Requests are answered in order, so the transfer started when the block
+// was requested or when the previous one arrived, whichever is later.
+static void RecordBlockDownload(NodeId nodeid, const uint256 &hash,
+                                size_t nBytes) {
+    auto itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() ||
+        itInFlight->second.first != nodeid) {
+        return;
+    }
+    CNodeState *state = State(nodeid);
+    int64_t nNow = GetTimeMicros();
+    int64_t nStart = std::max(itInFlight->second.second->nTimeRequested,
+                              state->nLastBlockReceived);
+    state->nLastBlockReceived = nNow;
+    double dRate = nBytes * 1000000.0 / std::max<int64_t>(nNow - nStart, 1000);
+    if (state->dBlockBytesPerSec == 0) {
+        state->dBlockBytesPerSec = dRate;
+        state->dAvgBlockBytes = nBytes;
+    } else {
+        state->dBlockBytesPerSec =
+            0.75 * state->dBlockBytesPerSec + 0.25 * dRate;
+        state->dAvgBlockBytes = 0.75 * state->dAvgBlockBytes + 0.25 * nBytes;
+    }
+}
+
+// Requires cs_main.
+// How many blocks to keep requested from a peer: enough to keep it busy for
+// BLOCK_DOWNLOAD_TARGET_SECONDS once its rate is known.
+static int BlocksInTransitLimit(const CNodeState *state) {
+    if (state->dBlockBytesPerSec == 0 || state->dAvgBlockBytes == 0) {
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    }
+    double dBlocks = state->dBlockBytesPerSec * BLOCK_DOWNLOAD_TARGET_SECONDS /
+                     state->dAvgBlockBytes;
+    return std::max<int>(
+        MIN_ADAPTIVE_BLOCKS_IN_TRANSIT,
+        std::min<double>(dBlocks, MAX_ADAPTIVE_BLOCKS_IN_TRANSIT));
+}
+
 /** Check whether the last unknown block a peer advertised is not yet known. */
 void ProcessBlockAvailability(NodeId nodeid) {
     CNodeState *state = State(nodeid);
@@ -564,8 +828,24 @@ const CBlockIndex *LastCommonAncestor(const CBlockIndex *pa,
     return pa;
 }
 
+// Requires cs_main.
+// Whether the in-flight block pindex has waited long enough on a peer that is
+// less than half as fast as the one with the given state.
+static bool IsStraggler(const CNodeState *state, const CBlockIndex *pindex) {
+    auto itInFlight = mapBlocksInFlight.find(pindex->GetBlockHash());
+    if (state->dBlockBytesPerSec == 0 ||
+        itInFlight == mapBlocksInFlight.end()) {
+        return false;
+    }
+    const CNodeState *stateWaiting = State(itInFlight->second.first);
+    return GetTimeMicros() - itInFlight->second.second->nTimeRequested >
+               BLOCK_STRAGGLER_TIMEOUT * 1000000 &&
+           state->dBlockBytesPerSec >= 2 * stateWaiting->dBlockBytesPerSec;
+}
+
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to
- * vBlocks, until it has at most count entries. */
+ * vBlocks, until it has at most count entries. A block holding back the
+ * download window may be taken over from a much slower peer. */
 void FindNextBlocksToDownload(NodeId nodeid, unsigned int count,
                               std::vector<const CBlockIndex *> &vBlocks,
                               NodeId &nodeStaller,
@@ -614,6 +894,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count,
     int nMaxHeight =
         std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    const CBlockIndex *pindexWaitingFor = nullptr;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed)
         // successors of pindexWalk (towards pindexBestKnownBlock) into
@@ -650,8 +931,14 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count,
                     // We reached the end of the window.
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if
-                        // the download window was one larger.
-                        nodeStaller = waitingfor;
+                        // the download window was one larger. Ask for the
+                        // block holding it back ourselves if we are much
+                        // faster, otherwise the peer it waits for stalls.
+                        if (IsStraggler(state, pindexWaitingFor)) {
+                            vBlocks.push_back(pindexWaitingFor);
+                        } else {
+                            nodeStaller = waitingfor;
+                        }
                     }
                     return;
                 }
@@ -662,6 +949,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count,
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -686,6 +974,11 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
         }
     }
+    stats.dBlockBytesPerSec = state->dBlockBytesPerSec;
+    stats.nCmpctBlocksReceived = state->nCmpctBlocksReceived;
+    stats.nCmpctBlockRoundTrips = state->nCmpctBlockRoundTrips;
+    stats.nCmpctBlockTxCount = state->nCmpctBlockTxCount;
+    stats.nCmpctBlockTxAvailable = state->nCmpctBlockTxAvailable;
     return true;
 }
 
@@ -705,7 +998,7 @@ void UnregisterNodeSignals(CNodeSignals &nodeSignals) {
 
 //////////////////////////////////////////////////////////////////////////////
 //
-// mapOrphanTransactions
+// vExtraTxnForCompact
 //
 
 void AddToCompactExtraTransactions(const CTransactionRef &tx) {
@@ -724,120 +1017,6 @@ void AddToCompactExtraTransactions(const CTransactionRef &tx) {
     vExtraTxnForCompactIt = (vExtraTxnForCompactIt + 1) % max_extra_txn;
 }
 
-bool AddOrphanTx(const CTransactionRef &tx, NodeId peer)
-    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
-    const uint256 &txid = tx->GetId();
-    if (mapOrphanTransactions.count(txid)) {
-        return false;
-    }
-
-    // Ignore big transactions, to avoid a send-big-orphans memory exhaustion
-    // attack. If a peer has a legitimate large transaction with a missing
-    // parent then we assume it will rebroadcast it later, after the parent
-    // transaction(s) have been mined or received.
-    // 100 orphans, each of which is at most 99,999 bytes big is at most 10
-    // megabytes of orphans and somewhat more byprev index (in the worst case):
-    unsigned int sz = GetTransactionSize(*tx);
-    if (sz >= MAX_STANDARD_TX_SIZE) {
-        LogPrint("mempool", "ignoring large orphan tx (size: %u, hash: %s)\n",
-                 sz, txid.ToString());
-        return false;
-    }
-
-    auto ret = mapOrphanTransactions.emplace(
-        txid, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME});
-    assert(ret.second);
-    for (const CTxIn &txin : tx->vin) {
-        mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
-    }
-
-    AddToCompactExtraTransactions(tx);
-
-    LogPrint("mempool", "stored orphan tx %s (mapsz %u outsz %u)\n",
-             txid.ToString(), mapOrphanTransactions.size(),
-             mapOrphanTransactionsByPrev.size());
-    return true;
-}
-
-static int EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
-    std::map<uint256, COrphanTx>::iterator it =
-        mapOrphanTransactions.find(hash);
-    if (it == mapOrphanTransactions.end()) {
-        return 0;
-    }
-    for (const CTxIn &txin : it->second.tx->vin) {
-        auto itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
-        if (itPrev == mapOrphanTransactionsByPrev.end()) {
-            continue;
-        }
-        itPrev->second.erase(it);
-        if (itPrev->second.empty()) {
-            mapOrphanTransactionsByPrev.erase(itPrev);
-        }
-    }
-    mapOrphanTransactions.erase(it);
-    return 1;
-}
-
-void EraseOrphansFor(NodeId peer) {
-    int nErased = 0;
-    std::map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end()) {
-        // Increment to avoid iterator becoming invalid.
-        std::map<uint256, COrphanTx>::iterator maybeErase = iter++;
-        if (maybeErase->second.fromPeer == peer) {
-            nErased += EraseOrphanTx(maybeErase->second.tx->GetId());
-        }
-    }
-    if (nErased > 0) {
-        LogPrint("mempool", "Erased %d orphan tx from peer=%d\n", nErased,
-                 peer);
-    }
-}
-
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
-    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
-    unsigned int nEvicted = 0;
-    static int64_t nNextSweep;
-    int64_t nNow = GetTime();
-    if (nNextSweep <= nNow) {
-        // Sweep out expired orphan pool entries:
-        int nErased = 0;
-        int64_t nMinExpTime =
-            nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
-        std::map<uint256, COrphanTx>::iterator iter =
-            mapOrphanTransactions.begin();
-        while (iter != mapOrphanTransactions.end()) {
-            std::map<uint256, COrphanTx>::iterator maybeErase = iter++;
-            if (maybeErase->second.nTimeExpire <= nNow) {
-                nErased += EraseOrphanTx(maybeErase->second.tx->GetId());
-            } else {
-                nMinExpTime =
-                    std::min(maybeErase->second.nTimeExpire, nMinExpTime);
-            }
-        }
-        // Sweep again 5 minutes after the next entry that expires in order to
-        // batch the linear scan.
-        nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
-        if (nErased > 0) {
-            LogPrint("mempool", "Erased %d orphan tx due to expiration\n",
-                     nErased);
-        }
-    }
-    while (mapOrphanTransactions.size() > nMaxOrphans) {
-        // Evict a random orphan:
-        uint256 randomhash = GetRandHash();
-        std::map<uint256, COrphanTx>::iterator it =
-            mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end()) {
-            it = mapOrphanTransactions.begin();
-        }
-        EraseOrphanTx(it->first);
-        ++nEvicted;
-    }
-    return nEvicted;
-}
-
 // Requires cs_main.
 void Misbehaving(NodeId pnode, int howmuch, const std::string &reason) {
     if (howmuch == 0) {
@@ -876,45 +1055,78 @@ static void Misbehaving(CNode *node, int howmuch, const std::string &reason) {
 //
 
 PeerLogicValidation::PeerLogicValidation(CConnman *connmanIn)
-    : connman(connmanIn) {
+    : connman(connmanIn),
+      fFastBlockRelay(GetBoolArg("-fastblockrelay", DEFAULT_FAST_BLOCK_RELAY)) {
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
 }
 
-void PeerLogicValidation::SyncTransaction(const CTransaction &tx,
-                                          const CBlockIndex *pindex,
-                                          int nPosInBlock) {
-    if (nPosInBlock == CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK) {
+/**
+ * Content transactions we first saw within the last CMPCT_PREFILL_WINDOW
+ * seconds. Peers may not have them yet, and a missing one costs the receiver
+ * of a compact block a getblocktxn round trip for up to a megabyte, so they
+ * are sent in full instead.
+ */
+static CCriticalSection cs_recentContentTx;
+static std::map<uint256, int64_t>
+    mapRecentContentTx GUARDED_BY(cs_recentContentTx);
+static const int64_t CMPCT_PREFILL_WINDOW = 10;
+/** Bound on the content transaction bytes prefilled into one compact block. */
+static const size_t CMPCT_PREFILL_MAX_BYTES = 2 * 1000 * 1000;
+
+static void AddRecentContentTx(const CTransaction &tx) {
+    bool fContent = false;
+    for (const CTxOut &txout : tx.vout) {
+        fContent |= !txout.strContent.empty();
+    }
+    if (!fContent) {
         return;
     }
 
-    LOCK(cs_main);
+    int64_t nNow = GetTime();
+    LOCK(cs_recentContentTx);
+    auto it = mapRecentContentTx.begin();
+    while (it != mapRecentContentTx.end()) {
+        if (it->second < nNow - CMPCT_PREFILL_WINDOW) {
+            it = mapRecentContentTx.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    mapRecentContentTx.emplace(tx.GetId(), nNow);
+}
 
-    std::vector<uint256> vOrphanErase;
-    // Which orphan pool entries must we evict?
-    for (size_t j = 0; j < tx.vin.size(); j++) {
-        auto itByPrev = mapOrphanTransactionsByPrev.find(tx.vin[j].prevout);
-        if (itByPrev == mapOrphanTransactionsByPrev.end()) {
-            continue;
+static CBlockHeaderAndShortTxIDs MakeCompactBlock(const CBlock &block) {
+    int64_t nNow = GetTime();
+    size_t nPrefilledBytes = 0;
+    LOCK(cs_recentContentTx);
+    return CBlockHeaderAndShortTxIDs(block, [&](const CTransaction &tx) {
+        auto it = mapRecentContentTx.find(tx.GetId());
+        if (it == mapRecentContentTx.end() ||
+            it->second < nNow - CMPCT_PREFILL_WINDOW) {
+            return false;
         }
-        for (auto mi = itByPrev->second.begin(); mi != itByPrev->second.end();
-             ++mi) {
-            const CTransaction &orphanTx = *(*mi)->second.tx;
-            const uint256 &orphanId = orphanTx.GetId();
-            vOrphanErase.push_back(orphanId);
+        size_t nSize = GetTransactionSize(tx);
+        if (nPrefilledBytes + nSize > CMPCT_PREFILL_MAX_BYTES) {
+            return false;
         }
+        nPrefilledBytes += nSize;
+        return true;
+    });
+}
+
+void PeerLogicValidation::SyncTransaction(const CTransactionRef &ptx,
+                                          const CBlockIndex *pindex,
+                                          int nPosInBlock) {
+    const CTransaction &tx = *ptx;
+    if (nPosInBlock == CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK) {
+        // Added to the mempool.
+        AddRecentContentTx(tx);
+        return;
     }
 
     // Erase orphan transactions include or precluded by this block
-    if (vOrphanErase.size()) {
-        int nErased = 0;
-        for (uint256 &orphanId : vOrphanErase) {
-            nErased += EraseOrphanTx(orphanId);
-        }
-        LogPrint("mempool",
-                 "Erased %d orphan tx included or conflicted by block\n",
-                 nErased);
-    }
+    orphanage.EraseForBlockTx(tx);
 }
 
 static CCriticalSection cs_most_recent_block;
@@ -926,7 +1138,8 @@ static uint256 most_recent_block_hash;
 void PeerLogicValidation::NewPoWValidBlock(
     const CBlockIndex *pindex, const std::shared_ptr<const CBlock> &pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock =
-        std::make_shared<const CBlockHeaderAndShortTxIDs>(*pblock);
+        std::make_shared<const CBlockHeaderAndShortTxIDs>(
+            MakeCompactBlock(*pblock));
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
 
     LOCK(cs_main);
@@ -946,10 +1159,18 @@ void PeerLogicValidation::NewPoWValidBlock(
         most_recent_compact_block = pcmpctblock;
     }
 
+    // Otherwise it is announced once connected, from the recent block above.
+    if (!fFastBlockRelay) {
+        return;
+    }
+
     connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker,
                           &hashBlock](CNode *pnode) {
         // TODO: Avoid the repeated-serialization here
-        if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect) {
+        // No INVALID_CB_NO_BAN_VERSION check: peers of this network are
+        // below it, yet none punishes the sender of a compact block that
+        // turns out invalid. -fastblockrelay stands in for it.
+        if (pnode->fDisconnect) {
             return;
         }
         ProcessBlockAvailability(pnode->GetId());
@@ -1073,7 +1294,7 @@ static bool AlreadyHave(const CInv &inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
             // diminishing returns with 2 onward.
             return recentRejects->contains(inv.hash) ||
                    mempool.exists(inv.hash) ||
-                   mapOrphanTransactions.count(inv.hash) ||
+                   orphanage.HaveTx(inv.hash) ||
                    pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0, 0)) ||
                    pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1, 0));
         }
@@ -1084,9 +1305,14 @@ static bool AlreadyHave(const CInv &inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     return true;
 }
 
-static void RelayTransaction(const CTransaction &tx, CConnman &connman) {
-    CInv inv(MSG_TX, tx.GetId());
-    connman.ForEachNode([&inv](CNode *pnode) { pnode->PushInventory(inv); });
+// Requires cs_main.
+static void RelayTransaction(const CTransaction &tx, NodeId nodeidFrom) {
+    txRelay.Announce(tx.GetId(), GetTime());
+    // No need to tell the peer it came from.
+    CNodeState *state = State(nodeidFrom);
+    if (state) {
+        txRelay.MarkKnown(state->nTxRelaySlot, tx.GetId());
+    }
 }
 
 static void RelayAddress(const CAddress &addr, bool fReachable,
@@ -1131,10 +1357,234 @@ static void RelayAddress(const CAddress &addr, bool fReachable,
     connman.ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
-static void ProcessGetData(const Config &config, CNode *pfrom,
-                           const Consensus::Params &consensusParams,
-                           CConnman &connman,
-                           const std::atomic<bool> &interruptMsgProc) {
+/**
+ * A requested block, looked up under cs_main but read from disk and sent after
+ * releasing it, so that serving blocks does not stall validation or the other
+ * message handler threads.
+ */
+struct GetDataBlock {
+    CInv inv;
+    CDiskBlockPos pos;
+    uint256 hash;
+    bool fCmpctAllowed = false;
+    // Set if the peer should be told our tip to continue its getblocks.
+    uint256 hashContinueTip;
+};
+
+/**
+ * Blocks recently served to peers, in the form T they are served from, least
+ * recently used first out once they take more than nMaxBytes.
+ */
+template <typename T> class BlockCache {
+public:
+    typedef std::shared_ptr<const T> BlockRef;
+
+    explicit BlockCache(size_t nMaxBytesIn)
+        : nMaxBytes(nMaxBytesIn), nBytes(0) {}
+
+    BlockRef Get(const uint256 &hash) {
+        LOCK(cs);
+        auto it = mapBlocks.find(hash);
+        if (it == mapBlocks.end()) {
+            return nullptr;
+        }
+        lruBlocks.splice(lruBlocks.begin(), lruBlocks, it->second);
+        return it->second->block;
+    }
+
+    void Insert(const uint256 &hash, const BlockRef &block, size_t nSize) {
+        LOCK(cs);
+        if (nSize > nMaxBytes || mapBlocks.count(hash)) {
+            return;
+        }
+        lruBlocks.push_front(Entry{hash, block, nSize});
+        mapBlocks.emplace(hash, lruBlocks.begin());
+        nBytes += nSize;
+        while (nBytes > nMaxBytes) {
+            nBytes -= lruBlocks.back().nSize;
+            mapBlocks.erase(lruBlocks.back().hash);
+            lruBlocks.pop_back();
+        }
+    }
+
+private:
+    struct Entry {
+        uint256 hash;
+        BlockRef block;
+        size_t nSize;
+    };
+    typedef std::list<Entry> BlockList;
+
+    CCriticalSection cs;
+    const size_t nMaxBytes;
+    size_t nBytes;
+    // Most recently used first.
+    BlockList lruBlocks;
+    std::unordered_map<uint256, typename BlockList::iterator, BlockHasher>
+        mapBlocks;
+};
+
+/**
+ * Blocks as stored in the block files. Peers in initial block download tend
+ * to request the same blocks, which can then be sent without reading and
+ * deserializing them again.
+ */
+typedef BlockCache<std::vector<uint8_t>> RawBlockCache;
+static const size_t RAW_BLOCK_CACHE_SIZE = 64 * 1000 * 1000;
+static RawBlockCache rawBlockCache(RAW_BLOCK_CACHE_SIZE);
+
+/**
+ * Blocks prepared to be filtered for BIP 37 peers. SPV wallets ask for the
+ * same recent blocks, each with a filter of its own, which is then matched
+ * without parsing the scripts nor hashing the merkle tree again.
+ */
+typedef BlockCache<CFilterableBlock> FilterableBlockCache;
+static const size_t FILTERABLE_BLOCK_CACHE_SIZE = 64 * 1000 * 1000;
+static FilterableBlockCache filterableBlockCache(FILTERABLE_BLOCK_CACHE_SIZE);
+
+std::shared_ptr<const std::vector<uint8_t>>
+GetRawBlock(const Config &config, const uint256 &hash,
+            const CDiskBlockPos &pos) {
+    RawBlockCache::BlockRef rawBlock = rawBlockCache.Get(hash);
+    if (rawBlock) {
+        return rawBlock;
+    }
+    auto raw = std::make_shared<std::vector<uint8_t>>();
+    if (!ReadRawBlockFromDisk(*raw, pos, config.GetChainParams().DiskMagic())) {
+        return nullptr;
+    }
+    rawBlock = std::move(raw);
+    rawBlockCache.Insert(hash, rawBlock, rawBlock->size());
+    return rawBlock;
+}
+
+static void SendGetDataBlock(const Config &config, CNode *pfrom,
+                             CConnman &connman, const GetDataBlock &toSend) {
+    const CInv &inv = toSend.inv;
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+
+    // Full blocks are sent as stored, filtered blocks from the cache when
+    // they are there, the other types need the CBlock.
+    RawBlockCache::BlockRef rawBlock;
+    FilterableBlockCache::BlockRef filterableBlock;
+    CBlock block;
+    bool fRead;
+    if (inv.type == MSG_BLOCK) {
+        rawBlock = GetRawBlock(config, toSend.hash, toSend.pos);
+        fRead = rawBlock != nullptr;
+    } else if (inv.type == MSG_FILTERED_BLOCK &&
+               (filterableBlock = filterableBlockCache.Get(toSend.hash))) {
+        fRead = true;
+    } else {
+        fRead = ReadBlockFromDisk(block, toSend.pos, config) &&
+                block.GetHash() == toSend.hash;
+    }
+    if (!fRead) {
+        // Pruning may have removed the file since cs_main was released.
+        LogPrint("net", "cannot load block %s from disk, disconnect peer=%d\n",
+                 toSend.hash.ToString(), pfrom->GetId());
+        pfrom->fDisconnect = true;
+        return;
+    }
+
+    if (inv.type == MSG_BLOCK) {
+        CSerializedNetMsg msg;
+        msg.command = NetMsgType::BLOCK;
+        msg.data = *rawBlock;
+        connman.PushMessage(pfrom, std::move(msg));
+    } else if (inv.type == MSG_FILTERED_BLOCK) {
+        if (!filterableBlock) {
+            auto prepared = std::make_shared<const CFilterableBlock>(block);
+            filterableBlockCache.Insert(toSend.hash, prepared,
+                                        prepared->DynamicMemoryUsage());
+            filterableBlock = std::move(prepared);
+        }
+        bool sendMerkleBlock = false;
+        CMerkleBlock merkleBlock;
+        {
+            LOCK(pfrom->cs_filter);
+            if (pfrom->pfilter) {
+                sendMerkleBlock = true;
+                merkleBlock = CMerkleBlock(*filterableBlock, *pfrom->pfilter);
+            }
+        }
+        if (sendMerkleBlock) {
+            connman.PushMessage(
+                pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
+            // CMerkleBlock just contains hashes, so also push any transactions
+            // in the block the client did not see. This avoids hurting
+            // performance by pointlessly requiring a round-trip. Note that
+            // there is currently no way for a node to request any single
+            // transactions we didn't send here - they must either disconnect
+            // and retry or request the full block. Thus, the protocol spec
+            // specified allows for us to provide duplicate txn here, however we
+            // MUST always provide at least what the remote peer needs.
+            typedef std::pair<unsigned int, uint256> PairType;
+            for (PairType &pair : merkleBlock.vMatchedTxn) {
+                connman.PushMessage(
+                    pfrom, msgMaker.Make(NetMsgType::TX,
+                                         *filterableBlock->vtx[pair.first]));
+            }
+        }
+        // else
+        // no response
+    } else if (inv.type == MSG_CMPCT_BLOCK) {
+        // If a peer is asking for old blocks, we're almost guaranteed they
+        // won't have a useful mempool to match against a compact block, and we
+        // don't feel like constructing the object for them, so instead we
+        // respond with the full, non-compact block.
+        int nSendFlags = 0;
+        if (toSend.fCmpctAllowed) {
+            CBlockHeaderAndShortTxIDs cmpctblock = MakeCompactBlock(block);
+            connman.PushMessage(pfrom, msgMaker.Make(nSendFlags,
+                                                     NetMsgType::CMPCTBLOCK,
+                                                     cmpctblock));
+        } else {
+            connman.PushMessage(
+                pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, block));
+        }
+    }
+
+    // Trigger the peer node to send a getblocks request for the next batch of
+    // inventory.
+    if (!toSend.hashContinueTip.IsNull()) {
+        // Bypass PushInventory, this must send even if redundant, and we want
+        // it right after the last block so they don't wait for other stuff
+        // first.
+        std::vector<CInv> vInv;
+        vInv.push_back(CInv(MSG_BLOCK, toSend.hashContinueTip));
+        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+        pfrom->hashContinue.SetNull();
+    }
+}
+
+/**
+ * The transaction txid we may send pfrom, from relay memory or, if it could
+ * have been announced in reply to a mempool message, from the mempool.
+ * Requires cs_main.
+ */
+static CTransactionRef FindRelayTransaction(CNode *pfrom,
+                                            const uint256 &txid) {
+    auto mi = mapRelay.find(txid);
+    if (mi != mapRelay.end()) {
+        return mi->second;
+    }
+    if (pfrom->timeLastMempoolReq) {
+        auto txinfo = mempool.info(txid);
+        // To protect privacy, do not answer getdata using the mempool when
+        // that TX couldn't have been INVed in reply to a MEMPOOL request.
+        if (txinfo.tx && txinfo.nTime <= pfrom->timeLastMempoolReq) {
+            return txinfo.tx;
+        }
+    }
+    return nullptr;
+}
+
+static void ProcessGetDataLocked(const Config &config, CNode *pfrom,
+                                 const Consensus::Params &consensusParams,
+                                 CConnman &connman,
+                                 const std::atomic<bool> &interruptMsgProc,
+                                 GetDataBlock &blockToSend) {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
     std::vector<CInv> vNotFound;
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
@@ -1226,112 +1676,30 @@ static void ProcessGetData(const Config &config, CNode *pfrom,
                 // Pruned nodes may have deleted the block, so check whether
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, config)) {
-                        assert(!"cannot load block from disk");
-                    }
-
-                    if (inv.type == MSG_BLOCK) {
-                        connman.PushMessage(
-                            pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
-                    } else if (inv.type == MSG_FILTERED_BLOCK) {
-                        bool sendMerkleBlock = false;
-                        CMerkleBlock merkleBlock;
-                        {
-                            LOCK(pfrom->cs_filter);
-                            if (pfrom->pfilter) {
-                                sendMerkleBlock = true;
-                                merkleBlock =
-                                    CMerkleBlock(block, *pfrom->pfilter);
-                            }
-                        }
-                        if (sendMerkleBlock) {
-                            connman.PushMessage(
-                                pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK,
-                                                     merkleBlock));
-                            // CMerkleBlock just contains hashes, so also push
-                            // any transactions in the block the client did not
-                            // see. This avoids hurting performance by
-                            // pointlessly requiring a round-trip. Note that
-                            // there is currently no way for a node to request
-                            // any single transactions we didn't send here -
-                            // they must either disconnect and retry or request
-                            // the full block. Thus, the protocol spec specified
-                            // allows for us to provide duplicate txn here,
-                            // however we MUST always provide at least what the
-                            // remote peer needs.
-                            typedef std::pair<unsigned int, uint256> PairType;
-                            for (PairType &pair : merkleBlock.vMatchedTxn) {
-                                connman.PushMessage(
-                                    pfrom,
-                                    msgMaker.Make(NetMsgType::TX,
-                                                  *block.vtx[pair.first]));
-                            }
-                        }
-                        // else
-                        // no response
-                    } else if (inv.type == MSG_CMPCT_BLOCK) {
-                        // If a peer is asking for old blocks, we're almost
-                        // guaranteed they won't have a useful mempool to match
-                        // against a compact block, and we don't feel like
-                        // constructing the object for them, so instead we
-                        // respond with the full, non-compact block.
-                        int nSendFlags = 0;
-                        if (CanDirectFetch(consensusParams) &&
-                            mi->second->nHeight >=
-                                chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
-                            CBlockHeaderAndShortTxIDs cmpctblock(block);
-                            connman.PushMessage(
-                                pfrom, msgMaker.Make(nSendFlags,
-                                                     NetMsgType::CMPCTBLOCK,
-                                                     cmpctblock));
-                        } else {
-                            connman.PushMessage(
-                                pfrom, msgMaker.Make(nSendFlags,
-                                                     NetMsgType::BLOCK, block));
-                        }
-                    }
-
-                    // Trigger the peer node to send a getblocks request for the
-                    // next batch of inventory.
+                    blockToSend.inv = inv;
+                    blockToSend.pos = mi->second->GetBlockPos();
+                    blockToSend.hash = mi->second->GetBlockHash();
+                    blockToSend.fCmpctAllowed =
+                        CanDirectFetch(consensusParams) &&
+                        mi->second->nHeight >=
+                            chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
                     if (inv.hash == pfrom->hashContinue) {
-                        // Bypass PushInventory, this must send even if
-                        // redundant, and we want it right after the last block
-                        // so they don't wait for other stuff first.
-                        std::vector<CInv> vInv;
-                        vInv.push_back(
-                            CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
-                        connman.PushMessage(
-                            pfrom, msgMaker.Make(NetMsgType::INV, vInv));
-                        pfrom->hashContinue.SetNull();
+                        blockToSend.hashContinueTip =
+                            chainActive.Tip()->GetBlockHash();
                     }
                 }
             } else if (inv.type == MSG_TX) {
-                // Send stream from relay memory
-                bool push = false;
-                auto mi = mapRelay.find(inv.hash);
-                int nSendFlags = 0;
-                if (mi != mapRelay.end()) {
-                    connman.PushMessage(
-                        pfrom,
-                        msgMaker.Make(nSendFlags, NetMsgType::TX, *mi->second));
-                    push = true;
-                } else if (pfrom->timeLastMempoolReq) {
-                    auto txinfo = mempool.info(inv.hash);
-                    // To protect privacy, do not answer getdata using the
-                    // mempool when that TX couldn't have been INVed in reply to
-                    // a MEMPOOL request.
-                    if (txinfo.tx &&
-                        txinfo.nTime <= pfrom->timeLastMempoolReq) {
-                        connman.PushMessage(pfrom, msgMaker.Make(nSendFlags,
-                                                                 NetMsgType::TX,
-                                                                 *txinfo.tx));
-                        push = true;
-                    }
-                }
-                if (!push) {
+                CTransactionRef ptx = FindRelayTransaction(pfrom, inv.hash);
+                if (!ptx) {
                     vNotFound.push_back(inv);
+                } else if (State(pfrom->GetId())->fTxSkeleton &&
+                           IsRelayedAsSkeleton(*ptx)) {
+                    connman.PushMessage(pfrom,
+                                        msgMaker.Make(NetMsgType::TXSKEL,
+                                                      CTxSkeleton(*ptx)));
+                } else {
+                    connman.PushMessage(pfrom,
+                                        msgMaker.Make(NetMsgType::TX, *ptx));
                 }
             }
 
@@ -1361,32 +1729,557 @@ static void ProcessGetData(const Config &config, CNode *pfrom,
     }
 }
 
+static void ProcessGetData(const Config &config, CNode *pfrom,
+                           const Consensus::Params &consensusParams,
+                           CConnman &connman,
+                           const std::atomic<bool> &interruptMsgProc) {
+    GetDataBlock blockToSend;
+    ProcessGetDataLocked(config, pfrom, consensusParams, connman,
+                         interruptMsgProc, blockToSend);
+    if (!blockToSend.hash.IsNull()) {
+        SendGetDataBlock(config, pfrom, connman, blockToSend);
+    }
+}
+
+static void RecordCmpctBlockStats(CNodeState *nodestate, size_t nTxCount,
+                                  size_t nMissing) {
+    nodestate->nCmpctBlocksReceived++;
+    if (nMissing > 0) {
+        nodestate->nCmpctBlockRoundTrips++;
+    }
+    nodestate->nCmpctBlockTxCount += nTxCount;
+    nodestate->nCmpctBlockTxAvailable += nTxCount - nMissing;
+}
+
+// Requires cs_main.
+static void ReleaseHeaderRange(CNodeState *state) {
+    if (state->nHeaderRange >= 0) {
+        vHeaderRanges[state->nHeaderRange].nodeid = -1;
+        state->nHeaderRange = -1;
+    }
+}
+
+// Requires cs_main.
+static void InitHeaderRanges(const CChainParams &chainparams) {
+    fHeaderRangesInit = true;
+
+    // Each checkpoint ahead of the best header starts a range, which ends at
+    // the next checkpoint. The main sync covers everything before the first.
+    const MapCheckpoints &checkpoints =
+        chainparams.Checkpoints().mapCheckpoints;
+    for (auto it = checkpoints.begin(); it != checkpoints.end(); ++it) {
+        if (it->second.IsNull() || it->first <= pindexBestHeader->nHeight) {
+            continue;
+        }
+
+        HeaderRange range;
+        range.hashAnchor = range.hashLast = it->second;
+        auto itNext = std::next(it);
+        if (itNext != checkpoints.end()) {
+            range.hashStop = itNext->second;
+            range.nStopHeight = itNext->first;
+        } else {
+            range.nStopHeight = it->first + 1;
+        }
+        range.nodeidSource = range.nodeid = range.nodeidStalled = -1;
+        range.nLastProgress = 0;
+        range.fComplete = false;
+        vHeaderRanges.push_back(std::move(range));
+    }
+
+    if (!vHeaderRanges.empty()) {
+        LogPrint("net", "fetching %u header ranges ahead of height %d\n",
+                 vHeaderRanges.size(), pindexBestHeader->nHeight);
+    }
+}
+
+// Requires cs_main.
+static void AssignHeaderRange(CNode *pto, CNodeState &state,
+                              CConnman &connman, const CNetMsgMaker &msgMaker) {
+    if (!fHeaderRangesInit) {
+        InitHeaderRanges(Params());
+    }
+
+    int64_t nNow = GetTime();
+    if (state.nHeaderRange >= 0) {
+        HeaderRange &range = vHeaderRanges[state.nHeaderRange];
+        if (range.nLastProgress < nNow - HEADER_RANGE_TIMEOUT) {
+            LogPrint("net", "header range after %s timed out, peer=%d\n",
+                     range.hashAnchor.ToString(), pto->id);
+            range.nodeidStalled = pto->GetId();
+            ReleaseHeaderRange(&state);
+        }
+        return;
+    }
+
+    if (nHeaderRangeBuffered >= MAX_HEADER_RANGE_BUFFER) {
+        return;
+    }
+
+    for (size_t i = 0; i < vHeaderRanges.size(); i++) {
+        HeaderRange &range = vHeaderRanges[i];
+        if (range.fComplete || range.nodeid >= 0 ||
+            range.nodeidStalled == pto->GetId()) {
+            continue;
+        }
+        if (!range.hashStop.IsNull() && mapBlockIndex.count(range.hashStop)) {
+            // The main sync got there first.
+            range.fComplete = true;
+            continue;
+        }
+        if (pto->nStartingHeight < range.nStopHeight) {
+            continue;
+        }
+
+        range.nodeid = pto->GetId();
+        range.nLastProgress = nNow;
+        state.nHeaderRange = i;
+        LogPrint("net", "getheaders after %s to peer=%d (startheight:%d)\n",
+                 range.hashLast.ToString(), pto->id, pto->nStartingHeight);
+        connman.PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS,
+                                               CBlockLocator({range.hashLast}),
+                                               range.hashStop));
+        return;
+    }
+}
+
+/**
+ * Take in headers that continue one of the header ranges, and ask their peer
+ * for more if it is fetching that range. Returns false if they don't belong to
+ * any range, leaving them to the usual headers handling.
+ */
+static bool ProcessHeaderRange(CNode *pfrom,
+                               const std::vector<CBlockHeader> &headers,
+                               CConnman &connman,
+                               const CNetMsgMaker &msgMaker) {
+    LOCK(cs_main);
+    size_t i = 0;
+    while (i < vHeaderRanges.size() &&
+           (vHeaderRanges[i].fComplete ||
+            vHeaderRanges[i].hashLast != headers[0].hashPrevBlock)) {
+        i++;
+    }
+    if (i == vHeaderRanges.size()) {
+        return false;
+    }
+    HeaderRange &range = vHeaderRanges[i];
+
+    uint256 hashLast = range.hashLast;
+    for (const CBlockHeader &header : headers) {
+        if (header.hashPrevBlock != hashLast) {
+            Misbehaving(pfrom, 20, "disconnected-header");
+            return true;
+        }
+        hashLast = header.GetHash();
+    }
+
+    if (range.vHeaders.empty()) {
+        range.nodeidSource = pfrom->GetId();
+    } else if (range.nodeidSource != pfrom->GetId()) {
+        range.nodeidSource = -1;
+    }
+    range.vHeaders.insert(range.vHeaders.end(), headers.begin(), headers.end());
+    nHeaderRangeBuffered += headers.size();
+    range.hashLast = hashLast;
+    UpdateBlockAvailability(pfrom->GetId(), hashLast);
+
+    if (range.nodeid != pfrom->GetId()) {
+        return true;
+    }
+
+    CNodeState *nodestate = State(pfrom->GetId());
+    range.nLastProgress = GetTime();
+    if (hashLast == range.hashStop || headers.size() < MAX_HEADERS_RESULTS) {
+        // Either the range is done, or this peer has no more of it.
+        range.fComplete = hashLast == range.hashStop || range.hashStop.IsNull();
+        ReleaseHeaderRange(nodestate);
+    } else if (nHeaderRangeBuffered >= MAX_HEADER_RANGE_BUFFER) {
+        // Pick the range up again once the chain below has been linked.
+        ReleaseHeaderRange(nodestate);
+    } else {
+        connman.PushMessage(
+            pfrom, msgMaker.Make(NetMsgType::GETHEADERS,
+                                 CBlockLocator({hashLast}), range.hashStop));
+    }
+    return true;
+}
+
+/**
+ * Accept the buffered headers of every range the block index now reaches, in
+ * chain order, since linking one range may connect the next.
+ */
+static void LinkHeaderRanges(const Config &config) {
+    while (true) {
+        std::vector<CBlockHeader> headers;
+        NodeId nodeidSource = -1;
+        size_t nRange = 0;
+        {
+            LOCK(cs_main);
+            while (nRange < vHeaderRanges.size() &&
+                   (vHeaderRanges[nRange].vHeaders.empty() ||
+                    !mapBlockIndex.count(
+                        vHeaderRanges[nRange].vHeaders[0].hashPrevBlock))) {
+                nRange++;
+            }
+            if (nRange == vHeaderRanges.size()) {
+                return;
+            }
+            HeaderRange &range = vHeaderRanges[nRange];
+            headers.swap(range.vHeaders);
+            nHeaderRangeBuffered -= headers.size();
+            nodeidSource = range.nodeidSource;
+        }
+
+        CValidationState state;
+        if (ProcessNewBlockHeaders(config, headers, state)) {
+            continue;
+        }
+
+        // Start the range over, from a different peer if it came from one.
+        LOCK(cs_main);
+        HeaderRange &range = vHeaderRanges[nRange];
+        int nDoS;
+        if (state.IsInvalid(nDoS) && nDoS > 0 && nodeidSource >= 0) {
+            Misbehaving(nodeidSource, nDoS, state.GetRejectReason());
+            range.nodeidStalled = nodeidSource;
+        }
+        LogPrint("net", "invalid headers in range after %s: %s\n",
+                 range.hashAnchor.ToString(), state.GetRejectReason());
+        nHeaderRangeBuffered -= range.vHeaders.size();
+        range.vHeaders.clear();
+        range.hashLast = range.hashAnchor;
+        range.fComplete = false;
+        if (range.nodeid >= 0) {
+            CNodeState *nodestate = State(range.nodeid);
+            if (nodestate) {
+                ReleaseHeaderRange(nodestate);
+            }
+        }
+    }
+}
+
+static void PushTxInvs(CNode *pto, const std::vector<uint256> &vTxid,
+                       CConnman &connman, const CNetMsgMaker &msgMaker) {
+    std::vector<CInv> vInv;
+    for (const uint256 &txid : vTxid) {
+        vInv.push_back(CInv(MSG_TX, txid));
+        if (vInv.size() == MAX_INV_SZ) {
+            connman.PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+            vInv.clear();
+        }
+    }
+    if (!vInv.empty()) {
+        connman.PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+    }
+}
+
+/** Most filters a getcfilters asks for, and filter hashes a getcfheaders */
+static const uint32_t MAX_GETCFILTERS_SIZE = 1000;
+static const uint32_t MAX_GETCFHEADERS_SIZE = 2000;
+/** Heights between the filter headers of a cfcheckpt */
+static const int CFCHECKPT_INTERVAL = 1000;
+
+/**
+ * The stop block of a BIP 157 request for at most nMaxBlocks filters from
+ * nStartHeight on, nullptr if it isn't served. Peers asking for filters this
+ * node doesn't serve, of a block it doesn't know or for too many blocks are
+ * disconnected. Filters the index has yet to build are left unanswered.
+ */
+static const CBlockIndex *
+PrepareBlockFilterRequest(CNode *pfrom, uint8_t nFilterType,
+                          uint32_t nStartHeight, const uint256 &hashStop,
+                          uint32_t nMaxBlocks) {
+    if (!(pfrom->GetLocalServices() & NODE_COMPACT_FILTERS) ||
+        nFilterType != BLOCK_FILTER_BASIC || !g_blockfilterindex ||
+        g_blockfilterindex->IsDropping()) {
+        LogPrint("net", "peer=%d asked for block filters we don't serve, "
+                        "disconnecting\n",
+                 pfrom->id);
+        pfrom->fDisconnect = true;
+        return nullptr;
+    }
+
+    const CBlockIndex *pindexStop = nullptr;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hashStop);
+        if (it != mapBlockIndex.end()) {
+            pindexStop = it->second;
+        }
+    }
+    if (!pindexStop || uint32_t(pindexStop->nHeight) < nStartHeight ||
+        uint32_t(pindexStop->nHeight) - nStartHeight >= nMaxBlocks) {
+        LogPrint("net", "peer=%d sent a bad block filter request, "
+                        "disconnecting\n",
+                 pfrom->id);
+        pfrom->fDisconnect = true;
+        return nullptr;
+    }
+
+    const CBlockIndex *pindexBest = g_blockfilterindex->GetBestBlock();
+    if (!pindexBest || pindexBest->GetAncestor(pindexStop->nHeight) !=
+                           pindexStop) {
+        LogPrint("net", "block filters up to %s aren't built yet, peer=%d\n",
+                 hashStop.ToString(), pfrom->id);
+        return nullptr;
+    }
+    return pindexStop;
+}
+
+/** The blocks from nStartHeight up to pindexStop, in order */
+static std::vector<const CBlockIndex *>
+GetBlockFilterRange(const CBlockIndex *pindexStop, uint32_t nStartHeight) {
+    std::vector<const CBlockIndex *> vBlocks(pindexStop->nHeight -
+                                             nStartHeight + 1);
+    const CBlockIndex *pindex = pindexStop;
+    for (size_t i = vBlocks.size(); i-- > 0; pindex = pindex->pprev) {
+        vBlocks[i] = pindex;
+    }
+    return vBlocks;
+}
+
 uint32_t GetFetchFlags(CNode *pfrom, const CBlockIndex *pprev,
                        const Consensus::Params &chainparams) {
     uint32_t nFetchFlags = 0;
     return nFetchFlags;
 }
 
-inline static void SendBlockTransactions(const CBlock &block,
-                                         const BlockTransactionsRequest &req,
-                                         CNode *pfrom, CConnman &connman) {
-    BlockTransactions resp(req);
-    for (size_t i = 0; i < req.indexes.size(); i++) {
-        if (req.indexes[i] >= block.vtx.size()) {
-            LOCK(cs_main);
-            Misbehaving(pfrom, 100, "out-of-bound-tx-index");
-            LogPrintf(
-                "Peer %d sent us a getblocktxn with out-of-bounds tx indices",
-                pfrom->id);
-            return;
+inline static void SendBlockTransactions(const CBlock &block,
+                                         const BlockTransactionsRequest &req,
+                                         CNode *pfrom, CConnman &connman) {
+    BlockTransactions resp(req);
+    for (size_t i = 0; i < req.indexes.size(); i++) {
+        if (req.indexes[i] >= block.vtx.size()) {
+            LOCK(cs_main);
+            Misbehaving(pfrom, 100, "out-of-bound-tx-index");
+            LogPrintf(
+                "Peer %d sent us a getblocktxn with out-of-bounds tx indices",
+                pfrom->id);
+            return;
+        }
+        resp.txn[i] = block.vtx[req.indexes[i]];
+    }
+    LOCK(cs_main);
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    int nSendFlags = 0;
+    connman.PushMessage(pfrom,
+                        msgMaker.Make(nSendFlags, NetMsgType::BLOCKTXN, resp));
+}
+
+/**
+ * Resubmit up to MAX_ORPHANS_PER_BATCH orphans that transactions from peer
+ * made connectable, under a single cs_main hold. The children of those
+ * accepted are left for the next batch, so that a long chain of orphans
+ * doesn't keep cs_main for all of its length.
+ */
+static void ProcessOrphanTxs(const Config &config, NodeId peer) {
+    std::vector<CTxOrphanage::Orphan> vOrphans =
+        orphanage.GetTxToReconsider(peer, MAX_ORPHANS_PER_BATCH);
+    if (vOrphans.empty()) {
+        return;
+    }
+
+    LOCK(cs_main);
+    std::set<NodeId> setMisbehaving;
+    std::list<CTransactionRef> lRemovedTxn;
+    for (const CTxOrphanage::Orphan &orphan : vOrphans) {
+        const CTransaction &orphanTx = *orphan.tx;
+        const uint256 &orphanId = orphanTx.GetId();
+        bool fMissingInputs = false;
+        // Use a dummy CValidationState so someone can't setup nodes to
+        // counter-DoS based on orphan resolution (that is, feeding people an
+        // invalid transaction based on LegitTxX in order to get anyone
+        // relaying LegitTxX banned)
+        CValidationState stateDummy;
+
+        if (setMisbehaving.count(orphan.fromPeer)) {
+            continue;
+        }
+        if (AcceptToMemoryPool(config, mempool, stateDummy, orphan.tx, true,
+                               &fMissingInputs, &lRemovedTxn)) {
+            LogPrint("mempool", "   accepted orphan tx %s\n",
+                     orphanId.ToString());
+            RelayTransaction(orphanTx, orphan.fromPeer);
+            orphanage.AddChildrenToWorkSet(orphanTx, peer);
+            orphanage.EraseTx(orphanId);
+        } else if (!fMissingInputs) {
+            int nDos = 0;
+            if (stateDummy.IsInvalid(nDos) && nDos > 0) {
+                // Punish peer that gave us an invalid orphan tx
+                Misbehaving(orphan.fromPeer, nDos, "invalid-orphan-tx");
+                setMisbehaving.insert(orphan.fromPeer);
+                LogPrint("mempool", "   invalid orphan tx %s\n",
+                         orphanId.ToString());
+            }
+            // Has inputs but not accepted to mempool
+            // Probably non-standard or insufficient fee/priority
+            LogPrint("mempool", "   removed orphan tx %s\n",
+                     orphanId.ToString());
+            orphanage.EraseTx(orphanId);
+            if (!stateDummy.CorruptionPossible()) {
+                // Do not use rejection cache for witness transactions or
+                // witness-stripped transactions, as they can have been
+                // malleated. See https://github.com/bitcoin/bitcoin/issues/8279
+                // for details.
+                assert(recentRejects);
+                recentRejects->insert(orphanId);
+            }
+        }
+        mempool.check(pcoinsTip);
+    }
+
+    for (const CTransactionRef &removedTx : lRemovedTxn) {
+        AddToCompactExtraTransactions(removedTx);
+    }
+}
+
+/**
+ * Try to accept ptx, a transaction pfrom sent us, to the mempool, and relay
+ * it, keep it as an orphan or reject it. Requires cs_main.
+ */
+static void ProcessTransaction(const Config &config, CNode *pfrom,
+                               const CTransactionRef &ptx,
+                               CConnman &connman) {
+    AssertLockHeld(cs_main);
+    const CTransaction &tx = *ptx;
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    const CInv inv(MSG_TX, tx.GetId());
+
+    bool fMissingInputs = false;
+    CValidationState state;
+
+    pfrom->setAskFor.erase(inv.hash);
+    mapAlreadyAskedFor.erase(inv.hash);
+
+    std::list<CTransactionRef> lRemovedTxn;
+
+    if (!AlreadyHave(inv) &&
+        AcceptToMemoryPool(config, mempool, state, ptx, true,
+                           &fMissingInputs, &lRemovedTxn)) {
+        mempool.check(pcoinsTip);
+        RelayTransaction(tx, pfrom->GetId());
+        orphanage.AddChildrenToWorkSet(tx, pfrom->GetId());
+
+        pfrom->nLastTXTime = GetTime();
+
+        LogPrint("mempool", "AcceptToMemoryPool: peer=%d: accepted %s "
+                            "(poolsz %u txn, %u kB)\n",
+                 pfrom->id, tx.GetId().ToString(), mempool.size(),
+                 mempool.DynamicMemoryUsage() / 1000);
+
+        // Resubmit the orphan transactions that depended on this one, a
+        // first batch now, the rest before the next message of this peer.
+        ProcessOrphanTxs(config, pfrom->GetId());
+    } else if (fMissingInputs) {
+        // It may be the case that the orphans parents have all been
+        // rejected.
+        bool fRejectedParents = false;
+        for (const CTxIn &txin : tx.vin) {
+            if (recentRejects->contains(txin.prevout.hash)) {
+                fRejectedParents = true;
+                break;
+            }
+        }
+        if (!fRejectedParents) {
+            uint32_t nFetchFlags =
+                GetFetchFlags(pfrom, chainActive.Tip(),
+                              config.GetChainParams().GetConsensus());
+            for (const CTxIn &txin : tx.vin) {
+                CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
+                pfrom->AddInventoryKnown(_inv);
+                if (!AlreadyHave(_inv)) {
+                    pfrom->AskFor(_inv);
+                }
+            }
+            if (orphanage.AddTx(ptx, pfrom->GetId())) {
+                AddToCompactExtraTransactions(ptx);
+            }
+
+            // DoS prevention: do not allow the orphan pool to grow
+            // unbounded
+            unsigned int nMaxOrphanTx = (unsigned int)std::max(
+                int64_t(0),
+                GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+            uint64_t nMaxOrphanBytes =
+                std::max(int64_t(0),
+                         GetArg("-maxorphantxsize",
+                                DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE)) *
+                1000000;
+            unsigned int nEvicted =
+                orphanage.Limit(nMaxOrphanTx, nMaxOrphanBytes);
+            if (nEvicted > 0) {
+                LogPrint("mempool", "mapOrphan overflow, removed %u tx\n",
+                         nEvicted);
+            }
+        } else {
+            LogPrint("mempool",
+                     "not keeping orphan with rejected parents %s\n",
+                     tx.GetId().ToString());
+            // We will continue to reject this tx since it has rejected
+            // parents so avoid re-requesting it from other peers.
+            recentRejects->insert(tx.GetId());
+        }
+    } else {
+        if (!state.CorruptionPossible()) {
+            // Do not use rejection cache for witness transactions or
+            // witness-stripped transactions, as they can have been
+            // malleated. See https://github.com/bitcoin/bitcoin/issues/8279
+            // for details.
+            assert(recentRejects);
+            recentRejects->insert(tx.GetId());
+            if (RecursiveDynamicUsage(*ptx) < 100000) {
+                AddToCompactExtraTransactions(ptx);
+            }
+        }
+
+        if (pfrom->fWhitelisted &&
+            GetBoolArg("-whitelistforcerelay",
+                       DEFAULT_WHITELISTFORCERELAY)) {
+            // Always relay transactions received from whitelisted peers,
+            // even if they were already in the mempool or rejected from it
+            // due to policy, allowing the node to function as a gateway for
+            // nodes hidden behind it.
+            //
+            // Never relay transactions that we would assign a non-zero DoS
+            // score for, as we expect peers to do the same with us in that
+            // case.
+            int nDoS = 0;
+            if (!state.IsInvalid(nDoS) || nDoS == 0) {
+                LogPrintf("Force relaying tx %s from whitelisted peer=%d\n",
+                          tx.GetId().ToString(), pfrom->id);
+                RelayTransaction(tx, pfrom->GetId());
+            } else {
+                LogPrintf("Not relaying invalid transaction %s from "
+                          "whitelisted peer=%d (%s)\n",
+                          tx.GetId().ToString(), pfrom->id,
+                          FormatStateMessage(state));
+            }
+        }
+    }
+
+    for (const CTransactionRef &removedTx : lRemovedTxn) {
+        AddToCompactExtraTransactions(removedTx);
+    }
+
+    int nDoS = 0;
+    if (state.IsInvalid(nDoS)) {
+        LogPrint("mempoolrej", "%s from peer=%d was not accepted: %s\n",
+                 tx.GetId().ToString(), pfrom->id,
+                 FormatStateMessage(state));
+        // Never send AcceptToMemoryPool's internal codes over P2P.
+        if (state.GetRejectCode() < REJECT_INTERNAL) {
+            connman.PushMessage(
+                pfrom, msgMaker.Make(NetMsgType::REJECT,
+                                     std::string(NetMsgType::TX),
+                                     uint8_t(state.GetRejectCode()),
+                                     state.GetRejectReason().substr(
+                                         0, MAX_REJECT_MESSAGE_LENGTH),
+                                     inv.hash));
+        }
+        if (nDoS > 0) {
+            Misbehaving(pfrom, nDoS, state.GetRejectReason());
         }
-        resp.txn[i] = block.vtx[req.indexes[i]];
     }
-    LOCK(cs_main);
-    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
-    int nSendFlags = 0;
-    connman.PushMessage(pfrom,
-                        msgMaker.Make(nSendFlags, NetMsgType::BLOCKTXN, resp));
 }
 
 static bool ProcessMessage(const Config &config, CNode *pfrom,
@@ -1656,7 +2549,11 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
             // nodes)
             connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDHEADERS));
         }
-        if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
+        // Peers of this network are below SHORT_IDS_BLOCKS_VERSION, but
+        // understand compact blocks all the same. -fastblockrelay offers them,
+        // so that peers can ask us to announce new blocks with them.
+        if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION ||
+            GetBoolArg("-fastblockrelay", DEFAULT_FAST_BLOCK_RELAY)) {
             // Tell our peer we are willing to provide version 1 or 2
             // cmpctblocks. However, we do not request new block announcements
             // using cmpctblock messages. We send this to non-NODE NETWORK peers
@@ -1667,6 +2564,26 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
                                                      fAnnounceUsingCMPCTBLOCK,
                                                      nCMPCTBLOCKVersion));
         }
+        if (fRelayTxes &&
+            GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION)) {
+            uint64_t nSalt = GetRand(std::numeric_limits<uint64_t>::max()) | 1;
+            {
+                LOCK(cs_main);
+                State(pfrom->GetId())->nReconLocalSalt = nSalt;
+            }
+            connman.PushMessage(pfrom,
+                                msgMaker.Make(NetMsgType::SENDRECON,
+                                              TXRECONCILIATION_VERSION, nSalt));
+        }
+        if (fRelayTxes &&
+            GetBoolArg("-txskeletonrelay", DEFAULT_TXSKELETONRELAY)) {
+            {
+                LOCK(cs_main);
+                State(pfrom->GetId())->fTxSkelOffered = true;
+            }
+            connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDTXSKEL,
+                                                     TXSKELETON_VERSION));
+        }
         pfrom->fSuccessfullyConnected = true;
     }
 
@@ -1754,6 +2671,251 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         }
     }
 
+    else if (strCommand == NetMsgType::SENDRECON) {
+        uint32_t nReconVersion = 0;
+        uint64_t nRemoteSalt = 0;
+        vRecv >> nReconVersion >> nRemoteSalt;
+
+        LOCK(cs_main);
+        CNodeState *nodestate = State(pfrom->GetId());
+        // Only if we offered it too, and just once.
+        if (nodestate->nReconLocalSalt == 0 || nodestate->fReconcile ||
+            nReconVersion != TXRECONCILIATION_VERSION) {
+            return true;
+        }
+
+        nodestate->reconSalt =
+            ComputeReconSalt(nodestate->nReconLocalSalt, nRemoteSalt);
+        nodestate->fReconcile = true;
+        // The side that opened the connection asks for the sketches.
+        if (!pfrom->fInbound) {
+            nodestate->nNextReconRequest = GetTime() + RECON_REQUEST_INTERVAL;
+            if (nReconFloodPeers < RECON_FLOOD_OUTBOUND_PEERS) {
+                nodestate->fReconFlood = true;
+                nReconFloodPeers++;
+            }
+        }
+        LogPrint("net", "reconciling transactions with peer=%d%s\n", pfrom->id,
+                 nodestate->fReconFlood ? " (flooding)" : "");
+    }
+
+    else if (strCommand == NetMsgType::SENDTXSKEL) {
+        uint32_t nSkelVersion = 0;
+        vRecv >> nSkelVersion;
+
+        LOCK(cs_main);
+        CNodeState *nodestate = State(pfrom->GetId());
+        if (nodestate->fTxSkelOffered && nSkelVersion == TXSKELETON_VERSION &&
+            !nodestate->fTxSkeleton) {
+            nodestate->fTxSkeleton = true;
+            LogPrint("net", "relaying transaction skeletons with peer=%d\n",
+                     pfrom->id);
+        }
+    }
+
+    else if (strCommand == NetMsgType::REQRECON) {
+        uint32_t nTheirSetSize = 0;
+        vRecv >> nTheirSetSize;
+
+        LOCK(cs_main);
+        CNodeState *nodestate = State(pfrom->GetId());
+        if (!nodestate->fReconcile || !pfrom->fInbound) {
+            LogPrint("net", "unexpected reqrecon from peer=%d\n", pfrom->id);
+            return true;
+        }
+
+        // What the peer never answered from the last round goes into this one.
+        nodestate->mapReconSet.insert(nodestate->mapReconSnapshot.begin(),
+                                      nodestate->mapReconSnapshot.end());
+        nodestate->mapReconSnapshot.clear();
+
+        CReconSketch sketch(GetReconSketchCells(
+            nodestate->mapReconSet.size(),
+            std::min<size_t>(nTheirSetSize, MAX_RECON_SET_SIZE)));
+        for (const auto &entry : nodestate->mapReconSet) {
+            sketch.Insert(entry.first);
+        }
+        nodestate->mapReconSnapshot.swap(nodestate->mapReconSet);
+        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::SKETCH, sketch));
+    }
+
+    else if (strCommand == NetMsgType::SKETCH) {
+        CReconSketch theirSketch;
+        vRecv >> theirSketch;
+
+        LOCK(cs_main);
+        CNodeState *nodestate = State(pfrom->GetId());
+        if (!nodestate->fReconcile || pfrom->fInbound ||
+            !nodestate->fReconRequested) {
+            LogPrint("net", "unexpected sketch from peer=%d\n", pfrom->id);
+            return true;
+        }
+        nodestate->fReconRequested = false;
+
+        if (!theirSketch.IsWellFormed() ||
+            theirSketch.GetCells() > MAX_RECON_SKETCH_CELLS) {
+            Misbehaving(pfrom, 20, "bad-sketch");
+            return error("sketch of %u cells from peer=%d",
+                         theirSketch.GetCells(), pfrom->id);
+        }
+
+        CReconSketch sketch(theirSketch.GetCells());
+        for (const auto &entry : nodestate->mapReconSet) {
+            sketch.Insert(entry.first);
+        }
+        std::vector<uint32_t> vOurs, vTheirs;
+        bool fSuccess =
+            sketch.Subtract(theirSketch) && sketch.Decode(vOurs, vTheirs);
+
+        // Announce what the peer is missing; if the difference couldn't be
+        // decoded, that is everything, and the peer does the same.
+        std::vector<uint256> vTxid;
+        if (fSuccess) {
+            for (uint32_t nShortId : vOurs) {
+                auto it = nodestate->mapReconSet.find(nShortId);
+                if (it != nodestate->mapReconSet.end()) {
+                    vTxid.push_back(it->second);
+                }
+            }
+        } else {
+            for (const auto &entry : nodestate->mapReconSet) {
+                vTxid.push_back(entry.second);
+            }
+            vTheirs.clear();
+            LogPrint("net", "reconciliation with peer=%d failed, %u cells\n",
+                     pfrom->id, theirSketch.GetCells());
+        }
+        nodestate->mapReconSet.clear();
+
+        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::RECONCILDIFF,
+                                                 fSuccess, vTheirs));
+        PushTxInvs(pfrom, vTxid, connman, msgMaker);
+    }
+
+    else if (strCommand == NetMsgType::RECONCILDIFF) {
+        bool fSuccess = false;
+        std::vector<uint32_t> vRequested;
+        vRecv >> fSuccess >> vRequested;
+
+        LOCK(cs_main);
+        CNodeState *nodestate = State(pfrom->GetId());
+        if (!nodestate->fReconcile || !pfrom->fInbound) {
+            LogPrint("net", "unexpected reconcildiff from peer=%d\n",
+                     pfrom->id);
+            return true;
+        }
+        if (vRequested.size() > MAX_RECON_SKETCH_CELLS) {
+            Misbehaving(pfrom, 20, "oversized-reconcildiff");
+            return error("reconcildiff size() = %u", vRequested.size());
+        }
+
+        std::vector<uint256> vTxid;
+        if (fSuccess) {
+            for (uint32_t nShortId : vRequested) {
+                auto it = nodestate->mapReconSnapshot.find(nShortId);
+                if (it != nodestate->mapReconSnapshot.end()) {
+                    vTxid.push_back(it->second);
+                }
+            }
+        } else {
+            for (const auto &entry : nodestate->mapReconSnapshot) {
+                vTxid.push_back(entry.second);
+            }
+        }
+        nodestate->mapReconSnapshot.clear();
+        PushTxInvs(pfrom, vTxid, connman, msgMaker);
+    }
+
+    else if (strCommand == NetMsgType::GETCFILTERS) {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        const CBlockIndex *pindexStop =
+            PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight,
+                                      hashStop, MAX_GETCFILTERS_SIZE);
+        if (!pindexStop) {
+            return true;
+        }
+        for (const CBlockIndex *pindex :
+             GetBlockFilterRange(pindexStop, nStartHeight)) {
+            CBlockFilter filter;
+            if (!g_blockfilterindex->LookupFilter(pindex, filter)) {
+                return error("failed to read the filter of block %s",
+                             pindex->GetBlockHash().ToString());
+            }
+            connman.PushMessage(
+                pfrom, msgMaker.Make(NetMsgType::CFILTER, nFilterType,
+                                     pindex->GetBlockHash(),
+                                     filter.GetEncodedFilter()));
+        }
+    }
+
+    else if (strCommand == NetMsgType::GETCFHEADERS) {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        const CBlockIndex *pindexStop =
+            PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight,
+                                      hashStop, MAX_GETCFHEADERS_SIZE);
+        if (!pindexStop) {
+            return true;
+        }
+        const std::vector<const CBlockIndex *> vBlocks =
+            GetBlockFilterRange(pindexStop, nStartHeight);
+        uint256 hashPrevHeader;
+        if (vBlocks.front()->pprev &&
+            !g_blockfilterindex->LookupFilterHeader(vBlocks.front()->pprev,
+                                                    hashPrevHeader)) {
+            return error("failed to read the filter header of block %s",
+                         vBlocks.front()->pprev->GetBlockHash().ToString());
+        }
+        std::vector<uint256> vFilterHashes;
+        vFilterHashes.reserve(vBlocks.size());
+        for (const CBlockIndex *pindex : vBlocks) {
+            CBlockFilter filter;
+            if (!g_blockfilterindex->LookupFilter(pindex, filter)) {
+                return error("failed to read the filter of block %s",
+                             pindex->GetBlockHash().ToString());
+            }
+            vFilterHashes.push_back(filter.GetHash());
+        }
+        connman.PushMessage(pfrom,
+                            msgMaker.Make(NetMsgType::CFHEADERS, nFilterType,
+                                          hashStop, hashPrevHeader,
+                                          vFilterHashes));
+    }
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT) {
+        uint8_t nFilterType;
+        uint256 hashStop;
+        vRecv >> nFilterType >> hashStop;
+
+        const CBlockIndex *pindexStop = PrepareBlockFilterRequest(
+            pfrom, nFilterType, 0, hashStop,
+            std::numeric_limits<uint32_t>::max());
+        if (!pindexStop) {
+            return true;
+        }
+        std::vector<uint256> vHeaders(pindexStop->nHeight /
+                                      CFCHECKPT_INTERVAL);
+        for (size_t i = 0; i < vHeaders.size(); i++) {
+            const CBlockIndex *pindex =
+                pindexStop->GetAncestor((i + 1) * CFCHECKPT_INTERVAL);
+            if (!g_blockfilterindex->LookupFilterHeader(pindex,
+                                                        vHeaders[i])) {
+                return error("failed to read the filter header of block %s",
+                             pindex->GetBlockHash().ToString());
+            }
+        }
+        connman.PushMessage(pfrom,
+                            msgMaker.Make(NetMsgType::CFCHECKPT, nFilterType,
+                                          hashStop, vHeaders));
+    }
+
     else if (strCommand == NetMsgType::INV) {
         std::vector<CInv> vInv;
         vRecv >> vInv;
@@ -1816,10 +2978,27 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
                 }
             } else {
                 pfrom->AddInventoryKnown(inv);
+                CNodeState *nodestate = State(pfrom->GetId());
+                txRelay.MarkKnown(nodestate->nTxRelaySlot, inv.hash);
+                if (nodestate->fReconcile) {
+                    nodestate->mapReconSet.erase(
+                        GetReconShortId(nodestate->reconSalt, inv.hash));
+                }
+                auto itAssembly = mapTxAssemblies.find(inv.hash);
                 if (fBlocksOnly) {
                     LogPrint("net", "transaction (%s) inv sent in violation of "
                                     "protocol peer=%d\n",
                              inv.hash.ToString(), pfrom->id);
+                } else if (itAssembly != mapTxAssemblies.end()) {
+                    // Its content is being fetched, from this peer too if it
+                    // serves content.
+                    std::vector<NodeId> &vSources = itAssembly->second.vSources;
+                    if (nodestate->fTxSkeleton &&
+                        std::find(vSources.begin(), vSources.end(),
+                                  pfrom->GetId()) == vSources.end()) {
+                        vSources.push_back(pfrom->GetId());
+                        RequestContentChunks(itAssembly->second, connman);
+                    }
                 } else if (!fAlreadyHave && !fImporting && !fReindex &&
                            !IsInitialBlockDownload()) {
                     pfrom->AskFor(inv);
@@ -1991,7 +3170,9 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         vRecv >> locator >> hashStop;
         LogPrint("net", "Receive HashStop: %s\n", hashStop.GetHex());
 
-        LOCK(cs_main);
+        // The headers are read from a snapshot of the chain without cs_main,
+        // which only the node state needs.
+        const std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
         if (IsInitialBlockDownload() && !pfrom->fWhitelisted) {
             LogPrint("net", "Ignoring getheaders from peer=%d because node is "
                             "in initial block download\n",
@@ -1999,21 +3180,19 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
             return true;
         }
 
-        CNodeState *nodestate = State(pfrom->GetId());
         const CBlockIndex *pindex = nullptr;
         if (locator.IsNull()) {
             LogPrintf("locator.IsNull\n");
             // If locator is null, return the hashStop block
-            BlockMap::iterator mi = mapBlockIndex.find(hashStop);
-            if (mi == mapBlockIndex.end()) {
+            pindex = LookupBlockIndex(hashStop);
+            if (!pindex) {
                 return true;
             }
-            pindex = (*mi).second;
         } else {
             // Find the last block the caller has in the main chain
-            pindex = FindForkInGlobalIndex(chainActive, locator);
+            pindex = FindForkInGlobalIndex(*chain, locator);
             if (pindex) {
-                pindex = chainActive.Next(pindex);
+                pindex = chain->Next(pindex);
             }
             if (pindex == NULL) {
                 LogPrint("net", "pindex be null, cann't find the last block the caller has in the main chain\n");
@@ -2027,7 +3206,7 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         LogPrint("net", "getheaders %d to %s from peer=%d\n",
                  (pindex ? pindex->nHeight : -1),
                  hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom->id);
-        for (; pindex; pindex = chainActive.Next(pindex)) {
+        for (; pindex; pindex = chain->Next(pindex)) {
             vHeaders.push_back(pindex->GetBlockHeader());
             if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop) {
                 break;
@@ -2045,7 +3224,11 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         // without the new block. By resetting the BestHeaderSent, we ensure we
         // will re-announce the new block via headers (or compact blocks again)
         // in the SendMessages logic.
-        nodestate->pindexBestHeaderSent = pindex ? pindex : chainActive.Tip();
+        {
+            LOCK(cs_main);
+            CNodeState *nodestate = State(pfrom->GetId());
+            nodestate->pindexBestHeaderSent = pindex ? pindex : chain->Tip();
+        }
         connman.PushMessage(pfrom,
                             msgMaker.Make(NetMsgType::HEADERS, vHeaders));
     }
@@ -2063,196 +3246,57 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
             return true;
         }
 
-        std::deque<COutPoint> vWorkQueue;
-        std::vector<uint256> vEraseQueue;
         CTransactionRef ptx;
         vRecv >> ptx;
-        const CTransaction &tx = *ptx;
 
-        CInv inv(MSG_TX, tx.GetId());
-        pfrom->AddInventoryKnown(inv);
+        pfrom->AddInventoryKnown(CInv(MSG_TX, ptx->GetId()));
 
         LOCK(cs_main);
+        ProcessTransaction(config, pfrom, ptx, connman);
+    }
 
-        bool fMissingInputs = false;
-        CValidationState state;
-
-        pfrom->setAskFor.erase(inv.hash);
-        mapAlreadyAskedFor.erase(inv.hash);
-
-        std::list<CTransactionRef> lRemovedTxn;
-
-        if (!AlreadyHave(inv) &&
-            AcceptToMemoryPool(config, mempool, state, ptx, true,
-                               &fMissingInputs, &lRemovedTxn)) {
-            mempool.check(pcoinsTip);
-            RelayTransaction(tx, connman);
-            for (size_t i = 0; i < tx.vout.size(); i++) {
-                vWorkQueue.emplace_back(inv.hash, i, tx.vout[i].nValue);
-            }
-
-            pfrom->nLastTXTime = GetTime();
-
-            LogPrint("mempool", "AcceptToMemoryPool: peer=%d: accepted %s "
-                                "(poolsz %u txn, %u kB)\n",
-                     pfrom->id, tx.GetId().ToString(), mempool.size(),
-                     mempool.DynamicMemoryUsage() / 1000);
-
-            // Recursively process any orphan transactions that depended on this
-            // one
-            std::set<NodeId> setMisbehaving;
-            while (!vWorkQueue.empty()) {
-                auto itByPrev =
-                    mapOrphanTransactionsByPrev.find(vWorkQueue.front());
-                vWorkQueue.pop_front();
-                if (itByPrev == mapOrphanTransactionsByPrev.end()) {
-                    continue;
-                }
-                for (auto mi = itByPrev->second.begin();
-                     mi != itByPrev->second.end(); ++mi) {
-                    const CTransactionRef &porphanTx = (*mi)->second.tx;
-                    const CTransaction &orphanTx = *porphanTx;
-                    const uint256 &orphanId = orphanTx.GetId();
-                    NodeId fromPeer = (*mi)->second.fromPeer;
-                    bool fMissingInputs2 = false;
-                    // Use a dummy CValidationState so someone can't setup nodes
-                    // to counter-DoS based on orphan resolution (that is,
-                    // feeding people an invalid transaction based on LegitTxX
-                    // in order to get anyone relaying LegitTxX banned)
-                    CValidationState stateDummy;
-
-                    if (setMisbehaving.count(fromPeer)) {
-                        continue;
-                    }
-                    if (AcceptToMemoryPool(config, mempool, stateDummy,
-                                           porphanTx, true, &fMissingInputs2,
-                                           &lRemovedTxn)) {
-                        LogPrint("mempool", "   accepted orphan tx %s\n",
-                                 orphanId.ToString());
-                        RelayTransaction(orphanTx, connman);
-                        for (size_t i = 0; i < orphanTx.vout.size(); i++) {
-                            vWorkQueue.emplace_back(orphanId, i, orphanTx.vout[i].nValue);
-                        }
-                        vEraseQueue.push_back(orphanId);
-                    } else if (!fMissingInputs2) {
-                        int nDos = 0;
-                        if (stateDummy.IsInvalid(nDos) && nDos > 0) {
-                            // Punish peer that gave us an invalid orphan tx
-                            Misbehaving(fromPeer, nDos, "invalid-orphan-tx");
-                            setMisbehaving.insert(fromPeer);
-                            LogPrint("mempool", "   invalid orphan tx %s\n",
-                                     orphanId.ToString());
-                        }
-                        // Has inputs but not accepted to mempool
-                        // Probably non-standard or insufficient fee/priority
-                        LogPrint("mempool", "   removed orphan tx %s\n",
-                                 orphanId.ToString());
-                        vEraseQueue.push_back(orphanId);
-                        if (!stateDummy.CorruptionPossible()) {
-                            // Do not use rejection cache for witness
-                            // transactions or witness-stripped transactions, as
-                            // they can have been malleated. See
-                            // https://github.com/bitcoin/bitcoin/issues/8279
-                            // for details.
-                            assert(recentRejects);
-                            recentRejects->insert(orphanId);
-                        }
-                    }
-                    mempool.check(pcoinsTip);
-                }
-            }
+    else if (strCommand == NetMsgType::TXSKEL) {
+        if (!fRelayTxes &&
+            (!pfrom->fWhitelisted ||
+             !GetBoolArg("-whitelistrelay", DEFAULT_WHITELISTRELAY))) {
+            LogPrint("net",
+                     "transaction sent in violation of protocol peer=%d\n",
+                     pfrom->id);
+            return true;
+        }
 
-            for (uint256 hash : vEraseQueue) {
-                EraseOrphanTx(hash);
-            }
-        } else if (fMissingInputs) {
-            // It may be the case that the orphans parents have all been
-            // rejected.
-            bool fRejectedParents = false;
-            for (const CTxIn &txin : tx.vin) {
-                if (recentRejects->contains(txin.prevout.hash)) {
-                    fRejectedParents = true;
-                    break;
-                }
-            }
-            if (!fRejectedParents) {
-                uint32_t nFetchFlags = GetFetchFlags(
-                    pfrom, chainActive.Tip(), chainparams.GetConsensus());
-                for (const CTxIn &txin : tx.vin) {
-                    CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
-                    pfrom->AddInventoryKnown(_inv);
-                    if (!AlreadyHave(_inv)) {
-                        pfrom->AskFor(_inv);
-                    }
-                }
-                AddOrphanTx(ptx, pfrom->GetId());
-
-                // DoS prevention: do not allow mapOrphanTransactions to grow
-                // unbounded
-                unsigned int nMaxOrphanTx = (unsigned int)std::max(
-                    int64_t(0),
-                    GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-                if (nEvicted > 0) {
-                    LogPrint("mempool", "mapOrphan overflow, removed %u tx\n",
-                             nEvicted);
-                }
-            } else {
-                LogPrint("mempool",
-                         "not keeping orphan with rejected parents %s\n",
-                         tx.GetId().ToString());
-                // We will continue to reject this tx since it has rejected
-                // parents so avoid re-requesting it from other peers.
-                recentRejects->insert(tx.GetId());
-            }
-        } else {
-            if (!state.CorruptionPossible()) {
-                // Do not use rejection cache for witness transactions or
-                // witness-stripped transactions, as they can have been
-                // malleated. See https://github.com/bitcoin/bitcoin/issues/8279
-                // for details.
-                assert(recentRejects);
-                recentRejects->insert(tx.GetId());
-                if (RecursiveDynamicUsage(*ptx) < 100000) {
-                    AddToCompactExtraTransactions(ptx);
-                }
-            }
+        CTxSkeleton skeleton;
+        vRecv >> skeleton;
 
-            if (pfrom->fWhitelisted &&
-                GetBoolArg("-whitelistforcerelay",
-                           DEFAULT_WHITELISTFORCERELAY)) {
-                // Always relay transactions received from whitelisted peers,
-                // even if they were already in the mempool or rejected from it
-                // due to policy, allowing the node to function as a gateway for
-                // nodes hidden behind it.
-                //
-                // Never relay transactions that we would assign a non-zero DoS
-                // score for, as we expect peers to do the same with us in that
-                // case.
-                int nDoS = 0;
-                if (!state.IsInvalid(nDoS) || nDoS == 0) {
-                    LogPrintf("Force relaying tx %s from whitelisted peer=%d\n",
-                              tx.GetId().ToString(), pfrom->id);
-                    RelayTransaction(tx, connman);
-                } else {
-                    LogPrintf("Not relaying invalid transaction %s from "
-                              "whitelisted peer=%d (%s)\n",
-                              tx.GetId().ToString(), pfrom->id,
-                              FormatStateMessage(state));
-                }
-            }
+        LOCK(cs_main);
+        if (!State(pfrom->GetId())->fTxSkeleton) {
+            LogPrint("net", "unexpected txskel from peer=%d\n", pfrom->id);
+            return true;
+        }
+        if (!skeleton.IsValid()) {
+            Misbehaving(pfrom, 100, "bad-txskel");
+            return true;
         }
 
-        for (const CTransactionRef &removedTx : lRemovedTxn) {
-            AddToCompactExtraTransactions(removedTx);
+        const CInv inv(MSG_TX, skeleton.txid);
+        pfrom->AddInventoryKnown(inv);
+        pfrom->setAskFor.erase(inv.hash);
+        mapAlreadyAskedFor.erase(inv.hash);
+        if (AlreadyHave(inv) || mapTxAssemblies.count(inv.hash)) {
+            return true;
         }
 
-        int nDoS = 0;
-        if (state.IsInvalid(nDoS)) {
-            LogPrint("mempoolrej", "%s from peer=%d was not accepted: %s\n",
-                     tx.GetId().ToString(), pfrom->id,
+        // The id is only claimed until the content is there, so unlike whole
+        // transactions rejected skeletons don't go into recentRejects: another
+        // announcement of the id fetches it again.
+        CValidationState state;
+        if (!PreCheckTxWithoutContent(config, mempool, state,
+                                      *skeleton.GetTransaction(),
+                                      skeleton.GetContentSize())) {
+            LogPrint("mempoolrej",
+                     "skeleton of %s from peer=%d was not accepted: %s\n",
+                     inv.hash.ToString(), pfrom->id,
                      FormatStateMessage(state));
-            // Never send AcceptToMemoryPool's internal codes over P2P.
             if (state.GetRejectCode() < REJECT_INTERNAL) {
                 connman.PushMessage(
                     pfrom, msgMaker.Make(NetMsgType::REJECT, strCommand,
@@ -2261,10 +3305,103 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
                                              0, MAX_REJECT_MESSAGE_LENGTH),
                                          inv.hash));
             }
-            if (nDoS > 0) {
+            int nDoS = 0;
+            if (state.IsInvalid(nDoS) && nDoS > 0) {
                 Misbehaving(pfrom, nDoS, state.GetRejectReason());
             }
+            return true;
+        }
+
+        if (mapTxAssemblies.size() >= MAX_TX_ASSEMBLIES) {
+            LogPrint("net", "too much content in flight, dropping %s "
+                            "peer=%d\n",
+                     inv.hash.ToString(), pfrom->id);
+            return true;
+        }
+        LogPrint("net", "fetching %u bytes of content of %s peer=%d\n",
+                 skeleton.GetContentSize(), inv.hash.ToString(), pfrom->id);
+        auto it = mapTxAssemblies
+                      .emplace(inv.hash, TxAssembly(skeleton, pfrom->GetId()))
+                      .first;
+        RequestContentChunks(it->second, connman);
+    }
+
+    else if (strCommand == NetMsgType::GETCONTENT) {
+        uint256 txid;
+        uint32_t nOutput = 0;
+        uint32_t nOffset = 0;
+        vRecv >> txid >> nOutput >> nOffset;
+
+        LOCK(cs_main);
+        CTransactionRef ptx = FindRelayTransaction(pfrom, txid);
+        if (!ptx) {
+            connman.PushMessage(
+                pfrom, msgMaker.Make(NetMsgType::NOTFOUND,
+                                     std::vector<CInv>(1, CInv(MSG_TX, txid))));
+            return true;
+        }
+        if (nOutput >= ptx->vout.size() ||
+            nOffset >= ptx->vout[nOutput].strContent.size()) {
+            Misbehaving(pfrom, 10, "bad-getcontent");
+            return true;
+        }
+        connman.PushMessage(
+            pfrom, msgMaker.Make(NetMsgType::CONTENT, txid, nOutput, nOffset,
+                                 ptx->vout[nOutput].strContent.substr(
+                                     nOffset, TXCONTENT_CHUNK_SIZE)));
+    }
+
+    else if (strCommand == NetMsgType::CONTENT) {
+        uint256 txid;
+        uint32_t nOutput = 0;
+        uint32_t nOffset = 0;
+        std::string strChunk;
+        vRecv >> txid >> nOutput >> nOffset >>
+            LIMITED_STRING(strChunk, TXCONTENT_CHUNK_SIZE);
+
+        LOCK(cs_main);
+        auto it = mapTxAssemblies.find(txid);
+        if (it == mapTxAssemblies.end()) {
+            return true;
+        }
+        TxAssembly &assembly = it->second;
+        const int nChunk = assembly.partial.FindChunk(nOutput, nOffset);
+        auto itFlight = assembly.mapInFlight.find(nChunk);
+        if (nChunk < 0 || itFlight == assembly.mapInFlight.end() ||
+            itFlight->second.first != pfrom->GetId()) {
+            // Not asked of this peer, or it was too slow.
+            return true;
+        }
+        assembly.mapInFlight.erase(itFlight);
+        State(pfrom->GetId())->nContentInFlight--;
+
+        if (!assembly.partial.FillChunk(nChunk, strChunk)) {
+            // Either this peer or the skeleton's sender is wrong.
+            if (pfrom->GetId() == assembly.nodeSkeleton) {
+                Misbehaving(pfrom, 100, "bad-content");
+            }
+            RemoveTxAssemblySource(assembly, pfrom->GetId());
+            RequestContentChunks(assembly, connman);
+            return true;
+        }
+        if (!assembly.partial.IsComplete()) {
+            RequestContentChunks(assembly, connman);
+            return true;
+        }
+
+        CTransactionRef ptx = assembly.partial.GetTransaction();
+        const NodeId nodeSkeleton = assembly.nodeSkeleton;
+        EraseTxAssembly(it);
+        // The sources that are freed can take chunks of other transactions.
+        nNextTxAssemblyCheck = 0;
+        if (ptx->GetId() != txid) {
+            // All of the content matched its hashes, the id was wrong.
+            LogPrint("net", "content of %s makes %s\n", txid.ToString(),
+                     ptx->GetId().ToString());
+            Misbehaving(nodeSkeleton, 100, "bad-txskel-id");
+            return true;
         }
+        ProcessTransaction(config, pfrom, ptx, connman);
     }
 
     // Ignore blocks received while importing
@@ -2427,6 +3564,8 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
                             req.indexes.push_back(i);
                         }
                     }
+                    RecordCmpctBlockStats(nodestate, cmpctblock.BlockTxCount(),
+                                          req.indexes.size());
                     if (req.indexes.empty()) {
                         // Dirty hack to jump to BLOCKTXN code (TODO: move
                         // message handling into their own functions)
@@ -2451,6 +3590,12 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
                         // TODO: don't ignore failures
                         return true;
                     }
+                    size_t nMissing = 0;
+                    for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                        nMissing += !tempBlock.IsTxAvailable(i);
+                    }
+                    RecordCmpctBlockStats(nodestate, cmpctblock.BlockTxCount(),
+                                          nMissing);
                     std::vector<CTransactionRef> dummy;
                     status = tempBlock.FillBlock(*pblock, dummy);
                     if (status == READ_STATUS_OK) {
@@ -2633,6 +3778,11 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
             return true;
         }
 
+        if (ProcessHeaderRange(pfrom, headers, connman, msgMaker)) {
+            LinkHeaderRanges(config);
+            return true;
+        }
+
         const CBlockIndex *pindexLast = nullptr;
         {
             LOCK(cs_main);
@@ -2702,6 +3852,8 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
             }
         }
 
+        LinkHeaderRanges(config);
+
         {
             LOCK(cs_main);
             CNodeState *nodestate = State(pfrom->GetId());
@@ -2717,17 +3869,20 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
 
             if (nCount == MAX_HEADERS_RESULTS) {
                 // Headers message had its maximum size; the peer may have more
-                // headers.
-                // TODO: optimize: if pindexLast is an ancestor of
-                // chainActive.Tip or pindexBestHeader, continue from there
-                // instead.
+                // headers. If header ranges linked behind pindexLast have
+                // moved pindexBestHeader past it, continue from there.
+                const CBlockIndex *pindexNext = pindexLast;
+                if (pindexBestHeader->GetAncestor(pindexLast->nHeight) ==
+                    pindexLast) {
+                    pindexNext = pindexBestHeader;
+                }
                 LogPrint(
                     "net",
                     "more getheaders (%d) to end to peer=%d (startheight:%d)\n",
-                    pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
+                    pindexNext->nHeight, pfrom->id, pfrom->nStartingHeight);
                 connman.PushMessage(
                     pfrom, msgMaker.Make(NetMsgType::GETHEADERS,
-                                         chainActive.GetLocator(pindexLast),
+                                         chainActive.GetLocator(pindexNext),
                                          uint256()));
             }
 
@@ -2808,6 +3963,7 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
              !fReindex) // Ignore blocks received while importing
     {
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        size_t nBlockBytes = vRecv.size();
         vRecv >> *pblock;
 
         LogPrint("net", "received block %s peer=%d\n",
@@ -2823,6 +3979,7 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
             LOCK(cs_main);
             // Also always process if we requested the block explicitly, as we
             // may need it even though it is not a candidate for a new best tip.
+            RecordBlockDownload(pfrom->GetId(), hash, nBlockBytes);
             forceProcessing |= MarkBlockAsReceived(hash);
             // mapBlockSource is only used for sending reject messages and DoS
             // scores, so the race between here and cs_main in ProcessNewBlock
@@ -2859,7 +4016,10 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_addrToSend);
+            pfrom->vAddrToSend.clear();
+        }
         std::vector<CAddress> vAddr = connman.GetAddresses();
         FastRandomContext insecure_rand;
         for (const CAddress &addr : vAddr) {
@@ -3108,6 +4268,15 @@ bool ProcessMessages(const Config &config, CNode *pfrom, CConnman &connman,
         return true;
     }
 
+    // Orphans made connectable by the transactions of this peer come before
+    // its next message.
+    if (orphanage.HaveTxToReconsider(pfrom->GetId())) {
+        ProcessOrphanTxs(config, pfrom->GetId());
+        if (orphanage.HaveTxToReconsider(pfrom->GetId())) {
+            return true;
+        }
+    }
+
     // Don't bother if send buffer is too full to respond anyway
     if (pfrom->fPauseSend) {
         return false;
@@ -3170,6 +4339,8 @@ bool ProcessMessages(const Config &config, CNode *pfrom, CConnman &connman,
 
     // Process message
     bool fRet = false;
+    const int64_t nProcessStart =
+        TRACE_ACTIVE(net, inbound_message) ? GetTimeMicros() : 0;
     try {
         fRet = ProcessMessage(config, pfrom, strCommand, vRecv, msg.nTime,
                               chainparams, connman, interruptMsgProc);
@@ -3211,6 +4382,13 @@ bool ProcessMessages(const Config &config, CNode *pfrom, CConnman &connman,
         LogPrintf("%s(%s, %u bytes) FAILED peer=%d\n", __func__,
                   SanitizeString(strCommand), nMessageSize, pfrom->id);
     }
+    if (TRACE_ACTIVE(net, inbound_message)) {
+        // How long the message waited to be processed, and took.
+        const std::string strAddr = pfrom->addr.ToString();
+        TRACE6(net, inbound_message, pfrom->id, strAddr.c_str(),
+               strCommand.c_str(), nMessageSize, nProcessStart - msg.nTime,
+               GetTimeMicros() - nProcessStart);
+    }
 
     LOCK(cs_main);
     SendRejectsAndCheckIfBanned(pfrom, connman);
@@ -3301,6 +4479,7 @@ bool SendMessages(const Config &config, CNode *pto, CConnman &connman,
     if (pto->nNextAddrSend < nNow) {
         pto->nNextAddrSend =
             PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
+        LOCK(pto->cs_addrToSend);
         std::vector<CAddress> vAddr;
         vAddr.reserve(pto->vAddrToSend.size());
         for (const CAddress &addr : pto->vAddrToSend) {
@@ -3367,6 +4546,13 @@ bool SendMessages(const Config &config, CNode *pto, CConnman &connman,
         }
     }
 
+    // While a single peer syncs headers far behind, fetch the ranges between
+    // the checkpoints ahead of it from the others.
+    if (!state.fSyncStarted && nSyncStarted > 0 && !pto->fClient &&
+        !fImporting && !fReindex) {
+        AssignHeaderRange(pto, state, connman, msgMaker);
+    }
+
     // Resend wallet transactions that haven't gotten in a block yet
     // Except during reindex, importing and IBD, when old wallet transactions
     // become unconfirmed and spams other nodes.
@@ -3459,8 +4645,8 @@ bool SendMessages(const Config &config, CNode *pto, CConnman &connman,
                 {
                     LOCK(cs_most_recent_block);
                     if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                        CBlockHeaderAndShortTxIDs cmpctblock(
-                            *most_recent_block);
+                        CBlockHeaderAndShortTxIDs cmpctblock =
+                            MakeCompactBlock(*most_recent_block);
                         connman.PushMessage(
                             pto,
                             msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
@@ -3472,7 +4658,8 @@ bool SendMessages(const Config &config, CNode *pto, CConnman &connman,
                     CBlock block;
                     bool ret = ReadBlockFromDisk(block, pBestIndex, config);
                     assert(ret);
-                    CBlockHeaderAndShortTxIDs cmpctblock(block);
+                    CBlockHeaderAndShortTxIDs cmpctblock =
+                        MakeCompactBlock(block);
                     connman.PushMessage(
                         pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
                                            cmpctblock));
@@ -3558,6 +4745,15 @@ bool SendMessages(const Config &config, CNode *pto, CConnman &connman,
                 nNow, INVENTORY_BROADCAST_INTERVAL >> !pto->fInbound);
         }
 
+        // Pick up what was relayed since the last trickle.
+        if (fSendTrickle) {
+            std::vector<uint256> vRelayTxid;
+            txRelay.GetAnnouncements(state.nTxRelaySlot, state.nTxRelayCursor,
+                                     vRelayTxid);
+            pto->setInventoryTxToSend.insert(vRelayTxid.begin(),
+                                             vRelayTxid.end());
+        }
+
         // Time to send but the peer has requested we not relay transactions.
         if (fSendTrickle) {
             LOCK(pto->cs_filter);
@@ -3605,14 +4801,29 @@ bool SendMessages(const Config &config, CNode *pto, CConnman &connman,
 
         // Determine transactions to relay
         if (fSendTrickle) {
-            // Produce a vector with all candidates for sending
+            // Transactions for reconciling peers wait in their set instead.
+            const bool fReconcileTx = state.fReconcile && !state.fReconFlood;
+            // Drop what the peer already knows, checking all of it against
+            // the filter at once, and produce a vector with the candidates
+            // left for sending.
+            const std::vector<uint256> vToSend(
+                pto->setInventoryTxToSend.begin(),
+                pto->setInventoryTxToSend.end());
+            const std::vector<bool> vKnown =
+                pto->filterInventoryKnown.contains(vToSend);
             std::vector<std::set<uint256>::iterator> vInvTx;
             vInvTx.reserve(pto->setInventoryTxToSend.size());
+            size_t i = 0;
             for (std::set<uint256>::iterator it =
                      pto->setInventoryTxToSend.begin();
-                 it != pto->setInventoryTxToSend.end(); it++) {
-                vInvTx.push_back(it);
+                 it != pto->setInventoryTxToSend.end(); i++) {
+                if (vKnown[i]) {
+                    it = pto->setInventoryTxToSend.erase(it);
+                } else {
+                    vInvTx.push_back(it++);
+                }
             }
+            std::vector<uint256> vSent;
             CAmount filterrate(0);
             {
                 LOCK(pto->cs_feeFilter);
@@ -3639,10 +4850,6 @@ bool SendMessages(const Config &config, CNode *pto, CConnman &connman,
                 uint256 hash = *it;
                 // Remove it from the to-be-sent set
                 pto->setInventoryTxToSend.erase(it);
-                // Check if not in the filter already
-                if (pto->filterInventoryKnown.contains(hash)) {
-                    continue;
-                }
                 // Not in the mempool anymore? don't bother sending it.
                 auto txinfo = mempool.info(hash);
                 if (!txinfo.tx) {
@@ -3656,8 +4863,14 @@ bool SendMessages(const Config &config, CNode *pto, CConnman &connman,
                     !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) {
                     continue;
                 }
-                // Send
-                vInv.push_back(CInv(MSG_TX, hash));
+                // Send, or leave it to the next reconciliation
+                if (fReconcileTx &&
+                    state.mapReconSet.size() < MAX_RECON_SET_SIZE) {
+                    state.mapReconSet.emplace(
+                        GetReconShortId(state.reconSalt, hash), hash);
+                } else {
+                    vInv.push_back(CInv(MSG_TX, hash));
+                }
                 nRelayedTransactions++;
                 {
                     // Expire old relay messages
@@ -3679,14 +4892,32 @@ bool SendMessages(const Config &config, CNode *pto, CConnman &connman,
                                         msgMaker.Make(NetMsgType::INV, vInv));
                     vInv.clear();
                 }
-                pto->filterInventoryKnown.insert(hash);
+                vSent.push_back(hash);
             }
+            pto->filterInventoryKnown.insert(vSent);
         }
     }
     if (!vInv.empty()) {
         connman.PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
     }
 
+    // Ask outbound reconciling peers for a sketch of their set now and then.
+    if (state.fReconcile && !pto->fInbound &&
+        state.nNextReconRequest <= GetTime()) {
+        state.nNextReconRequest = GetTime() + RECON_REQUEST_INTERVAL;
+        state.fReconRequested = true;
+        connman.PushMessage(
+            pto, msgMaker.Make(NetMsgType::REQRECON,
+                               uint32_t(state.mapReconSet.size())));
+    }
+
+    // Request the content chunks of transactions that timed out of other
+    // peers.
+    if (nNextTxAssemblyCheck <= GetTime()) {
+        nNextTxAssemblyCheck = GetTime() + 1;
+        CheckTxAssemblies(connman);
+    }
+
     // Detect whether we're stalling
     nNow = GetTimeMicros();
     if (state.nStallingSince &&
@@ -3729,12 +4960,13 @@ bool SendMessages(const Config &config, CNode *pto, CConnman &connman,
     // Message: getdata (blocks)
     //
     std::vector<CInv> vGetData;
+    int nMaxInTransit = BlocksInTransitLimit(&state);
     if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) &&
-        state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        state.nBlocksInFlight < nMaxInTransit) {
         std::vector<const CBlockIndex *> vToDownload;
         NodeId staller = -1;
-        FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER -
-                                                   state.nBlocksInFlight,
+        FindNextBlocksToDownload(pto->GetId(),
+                                 nMaxInTransit - state.nBlocksInFlight,
                                  vToDownload, staller, consensusParams);
         for (const CBlockIndex *pindex : vToDownload) {
             uint32_t nFetchFlags =
@@ -3829,13 +5061,3 @@ bool SendMessages(const Config &config, CNode *pto, CConnman &connman,
     }
     return true;
 }
-
-class CNetProcessingCleanup {
-public:
-    CNetProcessingCleanup() {}
-    ~CNetProcessingCleanup() {
-        // orphan transactions
-        mapOrphanTransactions.clear();
-        mapOrphanTransactionsByPrev.clear();
-    }
-} instance_of_cnetprocessingcleanup;
@@ -10,17 +10,21 @@
 #include "validationinterface.h"
 
 class Config;
+struct CDiskBlockPos;
 
 /** Default for -maxorphantx, maximum number of orphan transactions kept in
  * memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
-/** Expiration time for orphan transactions in seconds */
-static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
-/** Minimum time between orphan transactions expire time checks in seconds */
-static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+/** Default for -maxorphantxsize, maximum size of the orphan transactions kept
+ * in memory, content included, in megabytes */
+static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE = 5;
+/** Maximum number of orphan transactions resubmitted under one cs_main hold */
+static const size_t MAX_ORPHANS_PER_BATCH = 20;
 /** Default number of orphan+recently-replaced txn to keep around for block
  * reconstruction */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
+/** Default for -fastblockrelay */
+static const bool DEFAULT_FAST_BLOCK_RELAY = false;
 
 /** Register with a network node to receive its signals */
 void RegisterNodeSignals(CNodeSignals &nodeSignals);
@@ -30,11 +34,13 @@ void UnregisterNodeSignals(CNodeSignals &nodeSignals);
 class PeerLogicValidation : public CValidationInterface {
 private:
     CConnman *connman;
+    //! Announce blocks to high-bandwidth peers before connecting them
+    const bool fFastBlockRelay;
 
 public:
     PeerLogicValidation(CConnman *connmanIn);
 
-    virtual void SyncTransaction(const CTransaction &tx,
+    virtual void SyncTransaction(const CTransactionRef &ptx,
                                  const CBlockIndex *pindex,
                                  int nPosInBlock) override;
     virtual void UpdatedBlockTip(const CBlockIndex *pindexNew,
@@ -52,8 +58,21 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    double dBlockBytesPerSec;
+    int nCmpctBlocksReceived;
+    int nCmpctBlockRoundTrips;
+    uint64_t nCmpctBlockTxCount;
+    uint64_t nCmpctBlockTxAvailable;
 };
 
+/**
+ * The block with hash at pos as stored, from the cache of blocks recently
+ * served to peers, or read from disk into it. nullptr if it can't be read.
+ */
+std::shared_ptr<const std::vector<uint8_t>>
+GetRawBlock(const Config &config, const uint256 &hash,
+            const CDiskBlockPos &pos);
+
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 /** Increase a node's misbehavior score. */
@@ -587,6 +587,18 @@ bool CSubNet::Match(const CNetAddr &addr) const {
     return true;
 }
 
+CSubNet CSubNet::GetSubNetOf(const CNetAddr &addr) const {
+    CSubNet subnet(*this);
+    subnet.valid = valid && addr.IsValid();
+    for (int x = 0; x < 16; ++x)
+        subnet.network.ip[x] = addr.ip[x] & netmask[x];
+    return subnet;
+}
+
+bool CSubNet::HasSameNetmask(const CSubNet &other) const {
+    return memcmp(netmask, other.netmask, sizeof(netmask)) == 0;
+}
+
 static inline int NetmaskBits(uint8_t x) {
     switch (x) {
         case 0x00:
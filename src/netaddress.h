@@ -127,6 +127,12 @@ public:
     explicit CSubNet(const CNetAddr &addr);
 
     bool Match(const CNetAddr &addr) const;
+    /**
+     * The subnet of addr with the netmask of this one: addr matches this
+     * subnet if and only if it is equal to it.
+     */
+    CSubNet GetSubNetOf(const CNetAddr &addr) const;
+    bool HasSameNetmask(const CSubNet &other) const;
 
     std::string ToString() const;
     bool IsValid() const;
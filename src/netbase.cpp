@@ -232,12 +232,20 @@ static bool InterruptibleRecv(char *data, size_t len, int timeout,
                 if (!IsSelectableSocket(hSocket)) {
                     return false;
                 }
+#ifdef USE_EPOLL
+                struct pollfd pollfd = {};
+                pollfd.fd = hSocket;
+                pollfd.events = POLLIN;
+                int nRet =
+                    poll(&pollfd, 1, std::min(endTime - curTime, maxWait));
+#else
                 struct timeval tval =
                     MillisToTimeval(std::min(endTime - curTime, maxWait));
                 fd_set fdset;
                 FD_ZERO(&fdset);
                 FD_SET(hSocket, &fdset);
                 int nRet = select(hSocket + 1, &fdset, nullptr, nullptr, &tval);
+#endif
                 if (nRet == SOCKET_ERROR) {
                     return false;
                 }
@@ -251,11 +259,6 @@ static bool InterruptibleRecv(char *data, size_t len, int timeout,
     return len == 0;
 }
 
-struct ProxyCredentials {
-    std::string username;
-    std::string password;
-};
-
 std::string Socks5ErrorString(int err) {
     switch (err) {
         case 0x01:
@@ -279,15 +282,8 @@ std::string Socks5ErrorString(int err) {
     }
 }
 
-/** Connect using SOCKS5 (as described in RFC1928) */
-static bool Socks5(const std::string &strDest, int port,
-                   const ProxyCredentials *auth, SOCKET &hSocket) {
-    LogPrint("net", "SOCKS5 connecting %s\n", strDest);
-    if (strDest.size() > 255) {
-        CloseSocket(hSocket);
-        return error("Hostname too long");
-    }
-    // Accepted authentication methods
+/** SOCKS5 greeting, with the accepted authentication methods */
+static std::vector<uint8_t> Socks5Greeting(const ProxyCredentials *auth) {
     std::vector<uint8_t> vSocks5Init;
     vSocks5Init.push_back(0x05);
     if (auth) {
@@ -303,6 +299,51 @@ static bool Socks5(const std::string &strDest, int port,
         // X'00' NO AUTHENTICATION REQUIRED
         vSocks5Init.push_back(0x00);
     }
+    return vSocks5Init;
+}
+
+/** Username/password authentication request (as described in RFC1929) */
+static bool Socks5Authentication(const ProxyCredentials &auth,
+                                 std::vector<uint8_t> &vAuth) {
+    if (auth.username.size() > 255 || auth.password.size() > 255) {
+        return false;
+    }
+    vAuth.push_back(0x01);
+    vAuth.push_back(auth.username.size());
+    vAuth.insert(vAuth.end(), auth.username.begin(), auth.username.end());
+    vAuth.push_back(auth.password.size());
+    vAuth.insert(vAuth.end(), auth.password.begin(), auth.password.end());
+    return true;
+}
+
+/** SOCKS5 CONNECT request, strDest must be at most 255 characters */
+static std::vector<uint8_t> Socks5Request(const std::string &strDest,
+                                          int port) {
+    std::vector<uint8_t> vSocks5;
+    // VER protocol version
+    vSocks5.push_back(0x05);
+    // CMD CONNECT
+    vSocks5.push_back(0x01);
+    // RSV Reserved
+    vSocks5.push_back(0x00);
+    // ATYP DOMAINNAME
+    vSocks5.push_back(0x03);
+    vSocks5.push_back(strDest.size());
+    vSocks5.insert(vSocks5.end(), strDest.begin(), strDest.end());
+    vSocks5.push_back((port >> 8) & 0xFF);
+    vSocks5.push_back((port >> 0) & 0xFF);
+    return vSocks5;
+}
+
+/** Connect using SOCKS5 (as described in RFC1928) */
+static bool Socks5(const std::string &strDest, int port,
+                   const ProxyCredentials *auth, SOCKET &hSocket) {
+    LogPrint("net", "SOCKS5 connecting %s\n", strDest);
+    if (strDest.size() > 255) {
+        CloseSocket(hSocket);
+        return error("Hostname too long");
+    }
+    std::vector<uint8_t> vSocks5Init = Socks5Greeting(auth);
     ssize_t ret = send(hSocket, (const char *)vSocks5Init.data(),
                        vSocks5Init.size(), MSG_NOSIGNAL);
     if (ret != (ssize_t)vSocks5Init.size()) {
@@ -322,15 +363,9 @@ static bool Socks5(const std::string &strDest, int port,
         return error("Proxy failed to initialize");
     }
     if (pchRet1[1] == 0x02 && auth) {
-        // Perform username/password authentication (as described in RFC1929)
         std::vector<uint8_t> vAuth;
-        vAuth.push_back(0x01);
-        if (auth->username.size() > 255 || auth->password.size() > 255)
+        if (!Socks5Authentication(*auth, vAuth))
             return error("Proxy username or password too long");
-        vAuth.push_back(auth->username.size());
-        vAuth.insert(vAuth.end(), auth->username.begin(), auth->username.end());
-        vAuth.push_back(auth->password.size());
-        vAuth.insert(vAuth.end(), auth->password.begin(), auth->password.end());
         ret = send(hSocket, (const char *)vAuth.data(), vAuth.size(),
                    MSG_NOSIGNAL);
         if (ret != (ssize_t)vAuth.size()) {
@@ -355,20 +390,7 @@ static bool Socks5(const std::string &strDest, int port,
         return error("Proxy requested wrong authentication method %02x",
                      pchRet1[1]);
     }
-    std::vector<uint8_t> vSocks5;
-    // VER protocol version
-    vSocks5.push_back(0x05);
-    // CMD CONNECT
-    vSocks5.push_back(0x01);
-    // RSV Reserved
-    vSocks5.push_back(0x00);
-    // ATYP DOMAINNAME
-    vSocks5.push_back(0x03);
-    // Length<=255 is checked at beginning of function
-    vSocks5.push_back(strDest.size());
-    vSocks5.insert(vSocks5.end(), strDest.begin(), strDest.end());
-    vSocks5.push_back((port >> 8) & 0xFF);
-    vSocks5.push_back((port >> 0) & 0xFF);
+    std::vector<uint8_t> vSocks5 = Socks5Request(strDest, port);
     ret = send(hSocket, (const char *)vSocks5.data(), vSocks5.size(),
                MSG_NOSIGNAL);
     if (ret != (ssize_t)vSocks5.size()) {
@@ -430,9 +452,14 @@ static bool Socks5(const std::string &strDest, int port,
     return true;
 }
 
-static bool ConnectSocketDirectly(const CService &addrConnect,
-                                  SOCKET &hSocketRet, int nTimeout) {
+/**
+ * Create a non-blocking socket and start connecting it to addrConnect.
+ * fInProgressRet is set when the connection is still being established.
+ */
+static bool StartConnectSocket(const CService &addrConnect, SOCKET &hSocketRet,
+                               bool &fInProgressRet) {
     hSocketRet = INVALID_SOCKET;
+    fInProgressRet = false;
 
     struct sockaddr_storage sockaddr;
     socklen_t len = sizeof(sockaddr);
@@ -461,55 +488,19 @@ static bool ConnectSocketDirectly(const CService &addrConnect,
 #endif
 
     // Set to non-blocking
-    if (!SetSocketNonBlocking(hSocket, true))
+    if (!SetSocketNonBlocking(hSocket, true)) {
+        CloseSocket(hSocket);
         return error("ConnectSocketDirectly: Setting socket to non-blocking "
                      "failed, error %s\n",
                      NetworkErrorString(WSAGetLastError()));
+    }
 
     if (connect(hSocket, (struct sockaddr *)&sockaddr, len) == SOCKET_ERROR) {
         int nErr = WSAGetLastError();
         // WSAEINVAL is here because some legacy version of winsock uses it
         if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK ||
             nErr == WSAEINVAL) {
-            struct timeval timeout = MillisToTimeval(nTimeout);
-            fd_set fdset;
-            FD_ZERO(&fdset);
-            FD_SET(hSocket, &fdset);
-            int nRet = select(hSocket + 1, nullptr, &fdset, nullptr, &timeout);
-            if (nRet == 0) {
-                LogPrint("net", "connection to %s timeout\n",
-                         addrConnect.ToString());
-                CloseSocket(hSocket);
-                return false;
-            }
-            if (nRet == SOCKET_ERROR) {
-                LogPrintf("select() for %s failed: %s\n",
-                          addrConnect.ToString(),
-                          NetworkErrorString(WSAGetLastError()));
-                CloseSocket(hSocket);
-                return false;
-            }
-            socklen_t nRetSize = sizeof(nRet);
-#ifdef WIN32
-            if (getsockopt(hSocket, SOL_SOCKET, SO_ERROR, (char *)(&nRet),
-                           &nRetSize) == SOCKET_ERROR)
-#else
-            if (getsockopt(hSocket, SOL_SOCKET, SO_ERROR, &nRet, &nRetSize) ==
-                SOCKET_ERROR)
-#endif
-            {
-                LogPrintf("getsockopt() for %s failed: %s\n",
-                          addrConnect.ToString(),
-                          NetworkErrorString(WSAGetLastError()));
-                CloseSocket(hSocket);
-                return false;
-            }
-            if (nRet != 0) {
-                LogPrintf("connect() to %s failed after select(): %s\n",
-                          addrConnect.ToString(), NetworkErrorString(nRet));
-                CloseSocket(hSocket);
-                return false;
-            }
+            fInProgressRet = true;
         }
 #ifdef WIN32
         else if (WSAGetLastError() != WSAEISCONN)
@@ -528,6 +519,78 @@ static bool ConnectSocketDirectly(const CService &addrConnect,
     return true;
 }
 
+/**
+ * Check how the connection started by StartConnectSocket went, once hSocket
+ * is writable. The socket is closed if it failed.
+ */
+static bool FinishConnectSocket(const CService &addrConnect, SOCKET &hSocket) {
+    int nRet;
+    socklen_t nRetSize = sizeof(nRet);
+#ifdef WIN32
+    if (getsockopt(hSocket, SOL_SOCKET, SO_ERROR, (char *)(&nRet),
+                   &nRetSize) == SOCKET_ERROR)
+#else
+    if (getsockopt(hSocket, SOL_SOCKET, SO_ERROR, &nRet, &nRetSize) ==
+        SOCKET_ERROR)
+#endif
+    {
+        LogPrintf("getsockopt() for %s failed: %s\n", addrConnect.ToString(),
+                  NetworkErrorString(WSAGetLastError()));
+        CloseSocket(hSocket);
+        return false;
+    }
+    if (nRet != 0) {
+        LogPrintf("connect() to %s failed after select(): %s\n",
+                  addrConnect.ToString(), NetworkErrorString(nRet));
+        CloseSocket(hSocket);
+        return false;
+    }
+    return true;
+}
+
+static bool ConnectSocketDirectly(const CService &addrConnect,
+                                  SOCKET &hSocketRet, int nTimeout) {
+    SOCKET hSocket;
+    bool fInProgress;
+    if (!StartConnectSocket(addrConnect, hSocket, fInProgress)) {
+        hSocketRet = INVALID_SOCKET;
+        return false;
+    }
+
+    if (fInProgress) {
+#ifdef USE_EPOLL
+        struct pollfd pollfd = {};
+        pollfd.fd = hSocket;
+        pollfd.events = POLLOUT;
+        int nRet = poll(&pollfd, 1, nTimeout);
+#else
+        struct timeval timeout = MillisToTimeval(nTimeout);
+        fd_set fdset;
+        FD_ZERO(&fdset);
+        FD_SET(hSocket, &fdset);
+        int nRet = select(hSocket + 1, nullptr, &fdset, nullptr, &timeout);
+#endif
+        if (nRet == 0) {
+            LogPrint("net", "connection to %s timeout\n",
+                     addrConnect.ToString());
+            CloseSocket(hSocket);
+            return false;
+        }
+        if (nRet == SOCKET_ERROR) {
+            LogPrintf("select() for %s failed: %s\n", addrConnect.ToString(),
+                      NetworkErrorString(WSAGetLastError()));
+            CloseSocket(hSocket);
+            return false;
+        }
+        if (!FinishConnectSocket(addrConnect, hSocket)) {
+            return false;
+        }
+    }
+
+    hSocketRet = hSocket;
+    return true;
+}
+
 bool SetProxy(enum Network net, const proxyType &addrProxy) {
     assert(net >= 0 && net < NET_MAX);
     if (!addrProxy.IsValid()) return false;
@@ -571,6 +634,14 @@ bool IsProxy(const CNetAddr &addr) {
     return false;
 }
 
+/** Credentials unique to each connection, for Tor stream isolation */
+static ProxyCredentials RandomProxyCredentials() {
+    static std::atomic_int counter;
+    ProxyCredentials random_auth;
+    random_auth.username = random_auth.password = strprintf("%i", counter++);
+    return random_auth;
+}
+
 static bool ConnectThroughProxy(const proxyType &proxy,
                                 const std::string &strDest, int port,
                                 SOCKET &hSocketRet, int nTimeout,
@@ -583,10 +654,7 @@ static bool ConnectThroughProxy(const proxyType &proxy,
     }
     // do socks negotiation
     if (proxy.randomize_credentials) {
-        ProxyCredentials random_auth;
-        static std::atomic_int counter;
-        random_auth.username = random_auth.password =
-            strprintf("%i", counter++);
+        ProxyCredentials random_auth = RandomProxyCredentials();
         if (!Socks5(strDest, (unsigned short)port, &random_auth, hSocket))
             return false;
     } else {
@@ -748,3 +816,212 @@ bool SetSocketNonBlocking(SOCKET &hSocket, bool fNonBlocking) {
 void InterruptSocks5(bool interrupt) {
     interruptSocks5Recv = interrupt;
 }
+
+CAsyncConnection::CAsyncConnection(const CService &addrDestIn)
+    : addrDest(addrDestIn), hSocket(INVALID_SOCKET), status(IN_PROGRESS),
+      stage(STAGE_CONNECT), nDeadline(GetTimeMillis() + nConnectTimeout),
+      fProxy(false), fProxyConnectionFailed(false), nSendPos(0),
+      nRecvSize(0) {
+    proxyType proxy;
+    if (GetProxy(addrDest.GetNetwork(), proxy)) {
+        fProxy = true;
+        addrProxy = proxy.proxy;
+        if (proxy.randomize_credentials) {
+            auth.reset(new ProxyCredentials(RandomProxyCredentials()));
+        }
+    }
+
+    // Even when connected at once, the socket is only handled from Step(),
+    // where it is writable straight away.
+    bool fInProgress;
+    if (!StartConnectSocket(fProxy ? addrProxy : addrDest, hSocket,
+                            fInProgress)) {
+        fProxyConnectionFailed = fProxy;
+        Fail();
+    }
+}
+
+CAsyncConnection::~CAsyncConnection() {
+    if (hSocket != INVALID_SOCKET) {
+        CloseSocket(hSocket);
+    }
+}
+
+bool CAsyncConnection::WantWrite() const {
+    return stage == STAGE_CONNECT || nSendPos < vSend.size();
+}
+
+void CAsyncConnection::Expect(Stage stageIn, size_t nSize,
+                              std::vector<uint8_t> vMessage) {
+    stage = stageIn;
+    vSend = std::move(vMessage);
+    nSendPos = 0;
+    vRecv.clear();
+    nRecvSize = nSize;
+}
+
+CAsyncConnection::Status CAsyncConnection::Fail() {
+    if (hSocket != INVALID_SOCKET) {
+        CloseSocket(hSocket);
+    }
+    status = FAILED;
+    return status;
+}
+
+CAsyncConnection::Status CAsyncConnection::Step() {
+    if (status != IN_PROGRESS) {
+        return status;
+    }
+
+    if (stage == STAGE_CONNECT) {
+        if (!FinishConnectSocket(fProxy ? addrProxy : addrDest, hSocket)) {
+            fProxyConnectionFailed = fProxy;
+            return Fail();
+        }
+        if (!fProxy) {
+            status = CONNECTED;
+            return status;
+        }
+        LogPrint("net", "SOCKS5 connecting %s\n", addrDest.ToStringIP());
+        Expect(STAGE_SOCKS5_METHOD, 2, Socks5Greeting(auth.get()));
+        nDeadline = GetTimeMillis() + SOCKS5_RECV_TIMEOUT;
+    }
+
+    // Send what is queued then read the reply to it, as far as the socket
+    // allows without blocking.
+    while (status == IN_PROGRESS) {
+        if (nSendPos < vSend.size()) {
+            ssize_t ret =
+                send(hSocket, (const char *)&vSend[nSendPos],
+                     vSend.size() - nSendPos, MSG_NOSIGNAL);
+            if (ret < 0) {
+                int nErr = WSAGetLastError();
+                if (nErr == WSAEWOULDBLOCK || nErr == WSAEINPROGRESS) {
+                    break;
+                }
+                LogPrintf("Error sending to proxy: %s\n",
+                          NetworkErrorString(nErr));
+                return Fail();
+            }
+            nSendPos += ret;
+            continue;
+        }
+
+        size_t nHave = vRecv.size();
+        vRecv.resize(nRecvSize);
+        ssize_t ret =
+            recv(hSocket, (char *)&vRecv[nHave], nRecvSize - nHave, 0);
+        if (ret <= 0) {
+            vRecv.resize(nHave);
+            int nErr = WSAGetLastError();
+            if (ret < 0 &&
+                (nErr == WSAEWOULDBLOCK || nErr == WSAEINPROGRESS)) {
+                break;
+            }
+            LogPrintf("Socks5() connect to %s failed: error reading from "
+                      "proxy\n",
+                      addrDest.ToString());
+            return Fail();
+        }
+        vRecv.resize(nHave + ret);
+        if (vRecv.size() == nRecvSize) {
+            ProcessReply();
+        }
+    }
+    return status;
+}
+
+void CAsyncConnection::ProcessReply() {
+    switch (stage) {
+        case STAGE_SOCKS5_METHOD:
+            if (vRecv[0] != 0x05) {
+                error("Proxy failed to initialize");
+                Fail();
+            } else if (vRecv[1] == 0x02 && auth) {
+                std::vector<uint8_t> vAuth;
+                if (!Socks5Authentication(*auth, vAuth)) {
+                    error("Proxy username or password too long");
+                    Fail();
+                    break;
+                }
+                LogPrint("proxy", "SOCKS5 sending proxy authentication %s:%s\n",
+                         auth->username, auth->password);
+                Expect(STAGE_SOCKS5_AUTH, 2, std::move(vAuth));
+            } else if (vRecv[1] == 0x00) {
+                Expect(STAGE_SOCKS5_REPLY, 4,
+                       Socks5Request(addrDest.ToStringIP(),
+                                     addrDest.GetPort()));
+            } else {
+                error("Proxy requested wrong authentication method %02x",
+                      vRecv[1]);
+                Fail();
+            }
+            break;
+        case STAGE_SOCKS5_AUTH:
+            if (vRecv[0] != 0x01 || vRecv[1] != 0x00) {
+                error("Proxy authentication unsuccessful");
+                Fail();
+                break;
+            }
+            Expect(STAGE_SOCKS5_REPLY, 4,
+                   Socks5Request(addrDest.ToStringIP(), addrDest.GetPort()));
+            break;
+        case STAGE_SOCKS5_REPLY:
+            if (vRecv[0] != 0x05) {
+                error("Proxy failed to accept request");
+                Fail();
+            } else if (vRecv[1] != 0x00) {
+                // Failures to connect to a peer that are not proxy errors
+                LogPrintf("Socks5() connect to %s failed: %s\n",
+                          addrDest.ToString(), Socks5ErrorString(vRecv[1]));
+                Fail();
+            } else if (vRecv[2] != 0x00) {
+                error("Error: malformed proxy response");
+                Fail();
+            } else if (vRecv[3] == 0x01) {
+                // IPv4 address and port
+                Expect(STAGE_SOCKS5_BOUND_ADDRESS, 4 + 2);
+            } else if (vRecv[3] == 0x04) {
+                // IPv6 address and port
+                Expect(STAGE_SOCKS5_BOUND_ADDRESS, 16 + 2);
+            } else if (vRecv[3] == 0x03) {
+                Expect(STAGE_SOCKS5_BOUND_LENGTH, 1);
+            } else {
+                error("Error: malformed proxy response");
+                Fail();
+            }
+            break;
+        case STAGE_SOCKS5_BOUND_LENGTH:
+            // Domain name and port
+            Expect(STAGE_SOCKS5_BOUND_ADDRESS, vRecv[0] + 2);
+            break;
+        case STAGE_SOCKS5_BOUND_ADDRESS:
+            LogPrint("net", "SOCKS5 connected %s\n", addrDest.ToStringIP());
+            status = CONNECTED;
+            break;
+        case STAGE_CONNECT:
+            assert(false);
+    }
+}
+
+CAsyncConnection::Status CAsyncConnection::CheckTimeout(int64_t nTimeMillis) {
+    if (status != IN_PROGRESS || nTimeMillis < nDeadline) {
+        return status;
+    }
+    if (stage == STAGE_CONNECT) {
+        LogPrint("net", "connection to %s timeout\n",
+                 (fProxy ? addrProxy : addrDest).ToString());
+        fProxyConnectionFailed = fProxy;
+    } else {
+        LogPrintf("Socks5() connect to %s failed: proxy timeout\n",
+                  addrDest.ToString());
+    }
+    return Fail();
+}
+
+SOCKET CAsyncConnection::Release() {
+    assert(status == CONNECTED);
+    SOCKET hSocketRet = hSocket;
+    hSocket = INVALID_SOCKET;
+    return hSocketRet;
+}
@@ -14,6 +14,7 @@
 #include "serialize.h"
 
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -37,6 +38,11 @@ public:
     bool randomize_credentials;
 };
 
+struct ProxyCredentials {
+    std::string username;
+    std::string password;
+};
+
 enum Network ParseNetwork(std::string net);
 std::string GetNetworkName(enum Network net);
 void SplitHostPort(std::string in, int &portOut, std::string &hostOut);
@@ -71,4 +77,69 @@ bool SetSocketNonBlocking(SOCKET &hSocket, bool fNonBlocking);
 struct timeval MillisToTimeval(int64_t nTimeout);
 void InterruptSocks5(bool interrupt);
 
+/**
+ * A connection to addrDest, directly or through the SOCKS5 proxy set for its
+ * network, made without blocking: the owner waits for the socket to become
+ * writable if WantWrite(), readable otherwise, and then calls Step(), until
+ * the status is no longer IN_PROGRESS. Many of them can thus be waited on by
+ * a single thread, however slow the proxy is.
+ */
+class CAsyncConnection {
+public:
+    enum Status { IN_PROGRESS, CONNECTED, FAILED };
+
+    explicit CAsyncConnection(const CService &addrDestIn);
+    ~CAsyncConnection();
+
+    CAsyncConnection(const CAsyncConnection &) = delete;
+    CAsyncConnection &operator=(const CAsyncConnection &) = delete;
+
+    Status GetStatus() const { return status; }
+    SOCKET GetSocket() const { return hSocket; }
+    const CService &GetDestination() const { return addrDest; }
+    bool WantWrite() const;
+    //! Whether it failed to reach the proxy, rather than addrDest
+    bool ProxyConnectionFailed() const { return fProxyConnectionFailed; }
+
+    //! Make progress once the socket is ready
+    Status Step();
+    //! Fail if the current stage has not completed by its deadline
+    Status CheckTimeout(int64_t nTimeMillis);
+    //! Hand the connected socket over to the caller
+    SOCKET Release();
+
+private:
+    enum Stage {
+        STAGE_CONNECT,
+        STAGE_SOCKS5_METHOD,
+        STAGE_SOCKS5_AUTH,
+        STAGE_SOCKS5_REPLY,
+        STAGE_SOCKS5_BOUND_LENGTH,
+        STAGE_SOCKS5_BOUND_ADDRESS,
+    };
+
+    CService addrDest;
+    SOCKET hSocket;
+    Status status;
+    Stage stage;
+    int64_t nDeadline;
+
+    bool fProxy;
+    bool fProxyConnectionFailed;
+    CService addrProxy;
+    std::unique_ptr<ProxyCredentials> auth;
+
+    //! Message for the proxy and how much of it was sent
+    std::vector<uint8_t> vSend;
+    size_t nSendPos;
+    //! Reply from the proxy and how long it is expected to be
+    std::vector<uint8_t> vRecv;
+    size_t nRecvSize;
+
+    void Expect(Stage stageIn, size_t nSize,
+                std::vector<uint8_t> vMessage = std::vector<uint8_t>());
+    void ProcessReply();
+    Status Fail();
+};
+
 #endif // BITCOIN_NETBASE_H
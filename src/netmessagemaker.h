@@ -18,6 +18,8 @@ public:
                            Args &&... args) const {
         CSerializedNetMsg msg;
         msg.command = std::move(sCommand);
+        msg.data = SendBufferPool().Get(
+            GetSerializeSizeMany(SER_NETWORK, nFlags | nVersion, args...));
         CVectorWriter{SER_NETWORK, nFlags | nVersion, msg.data, 0,
                       std::forward<Args>(args)...};
         return msg;
@@ -0,0 +1,262 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "openclminer.h"
+
+#include "affinity.h"
+#include "ethash/internal.h"
+#include "tinyformat.h"
+#include "util.h"
+
+#include "ethash/ethash.cl.h"
+
+#include <algorithm>
+
+/** Candidate slots in the output buffer, as CL_MAX_OUTPUTS in ethash.cl */
+static const unsigned int OPENCL_MAX_OUTPUTS = 4;
+/** Bytes of a DAG page, what the kernel indexes the DAG by */
+static const uint64_t OPENCL_DAG_PAGE_BYTES = 128;
+
+static uint64_t ReadBE64(const uint8_t *p) {
+    uint64_t x = 0;
+    for (int i = 0; i < 8; i++) {
+        x = (x << 8) | p[i];
+    }
+    return x;
+}
+
+COpenCLMinerBackend::COpenCLMinerBackend(cl_device_id deviceIn,
+                                         const std::string &strNameIn)
+    : device(deviceIn), context(nullptr), queue(nullptr), program(nullptr),
+      kernel(nullptr), dagBuffer(nullptr), headerBuffer(nullptr),
+      outputBuffer(nullptr), nDagPages(0), strName(strNameIn) {}
+
+COpenCLMinerBackend::~COpenCLMinerBackend() {
+    if (dagBuffer) clReleaseMemObject(dagBuffer);
+    if (headerBuffer) clReleaseMemObject(headerBuffer);
+    if (outputBuffer) clReleaseMemObject(outputBuffer);
+    if (kernel) clReleaseKernel(kernel);
+    if (program) clReleaseProgram(program);
+    if (queue) clReleaseCommandQueue(queue);
+    if (context) clReleaseContext(context);
+}
+
+bool COpenCLMinerBackend::Init() {
+    cl_int err;
+    context = clCreateContext(nullptr, 1, &device, nullptr, nullptr, &err);
+    if (err != CL_SUCCESS) {
+        return error("%s: %s: clCreateContext failed: %d", __func__, strName,
+                     err);
+    }
+    queue = clCreateCommandQueue(context, device, 0, &err);
+    if (err != CL_SUCCESS) {
+        return error("%s: %s: clCreateCommandQueue failed: %d", __func__,
+                     strName, err);
+    }
+
+    const char *source = (const char *)ethash_cl;
+    const size_t nSourceLength = sizeof(ethash_cl);
+    program =
+        clCreateProgramWithSource(context, 1, &source, &nSourceLength, &err);
+    if (err != CL_SUCCESS) {
+        return error("%s: %s: clCreateProgramWithSource failed: %d", __func__,
+                     strName, err);
+    }
+    err = clBuildProgram(program, 1, &device, "", nullptr, nullptr);
+    if (err != CL_SUCCESS) {
+        size_t nLogSize = 0;
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0,
+                              nullptr, &nLogSize);
+        std::string strLog(nLogSize, '\0');
+        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, nLogSize,
+                              &strLog[0], nullptr);
+        return error("%s: %s: could not build the kernel: %d\n%s", __func__,
+                     strName, err, strLog);
+    }
+    kernel = clCreateKernel(program, "ethash_search", &err);
+    if (err != CL_SUCCESS) {
+        return error("%s: %s: clCreateKernel failed: %d", __func__, strName,
+                     err);
+    }
+
+    headerBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY,
+                                  sizeof(ethash_h256_t), nullptr, &err);
+    if (err != CL_SUCCESS) {
+        return error("%s: %s: could not allocate the header buffer: %d",
+                     __func__, strName, err);
+    }
+    outputBuffer =
+        clCreateBuffer(context, CL_MEM_READ_WRITE,
+                       (1 + 2 * OPENCL_MAX_OUTPUTS) * sizeof(cl_uint), nullptr,
+                       &err);
+    if (err != CL_SUCCESS) {
+        return error("%s: %s: could not allocate the output buffer: %d",
+                     __func__, strName, err);
+    }
+    return true;
+}
+
+bool COpenCLMinerBackend::UploadDag(const EthashFullRef &full) {
+    if (dagBuffer) {
+        clReleaseMemObject(dagBuffer);
+        dagBuffer = nullptr;
+    }
+    dagUploaded.reset();
+
+    const uint64_t nSize = ethash_full_dag_size(full.get());
+    cl_ulong nMaxAlloc = 0;
+    clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(nMaxAlloc),
+                    &nMaxAlloc, nullptr);
+    if (nSize > nMaxAlloc) {
+        return error("%s: %s: the %u MiB DAG is larger than the %u MiB the "
+                     "device can allocate",
+                     __func__, strName, nSize >> 20, nMaxAlloc >> 20);
+    }
+
+    cl_int err;
+    dagBuffer =
+        clCreateBuffer(context, CL_MEM_READ_ONLY, nSize, nullptr, &err);
+    if (err != CL_SUCCESS) {
+        return error("%s: %s: could not allocate the DAG: %d", __func__,
+                     strName, err);
+    }
+    err = clEnqueueWriteBuffer(queue, dagBuffer, CL_TRUE, 0, nSize,
+                               ethash_full_dag(full.get()), 0, nullptr,
+                               nullptr);
+    if (err != CL_SUCCESS) {
+        clReleaseMemObject(dagBuffer);
+        dagBuffer = nullptr;
+        return error("%s: %s: could not copy the DAG: %d", __func__, strName,
+                     err);
+    }
+
+    nDagPages = nSize / OPENCL_DAG_PAGE_BYTES;
+    dagUploaded = full;
+    LogPrintf("%s: copied the %u MiB DAG to the device\n", strName,
+              nSize >> 20);
+    return true;
+}
+
+std::string COpenCLMinerBackend::GetName() const {
+    return strName;
+}
+
+uint64_t COpenCLMinerBackend::GetBatchSize() const {
+    return uint64_t(1) << OPENCL_NONCE_BATCH_BITS;
+}
+
+bool COpenCLMinerBackend::Search(const EthashFullRef &full,
+                                 const ethash_h256_t &header,
+                                 const ethash_h256_t &boundary,
+                                 uint64_t nStart, uint64_t nCount,
+                                 uint64_t &nNonce, ethash_h256_t &mixHash) {
+    LOCK(cs_device);
+    if (dagUploaded.lock() != full) {
+        if (dagFailed.lock() == full || !UploadDag(full)) {
+            // Don't spin on a device that can't hold this epoch's DAG
+            dagFailed = full;
+            MilliSleep(1000);
+            return false;
+        }
+    }
+
+    const cl_uint vZero[1 + 2 * OPENCL_MAX_OUTPUTS] = {0};
+    cl_int err = clEnqueueWriteBuffer(queue, headerBuffer, CL_FALSE, 0,
+                                      sizeof(header), &header, 0, nullptr,
+                                      nullptr);
+    err |= clEnqueueWriteBuffer(queue, outputBuffer, CL_FALSE, 0,
+                                sizeof(vZero), vZero, 0, nullptr, nullptr);
+
+    const cl_uint nPages = nDagPages;
+    const cl_ulong nStartNonce = nStart;
+    const cl_ulong nTarget = ReadBE64(boundary.b);
+    err |= clSetKernelArg(kernel, 0, sizeof(dagBuffer), &dagBuffer);
+    err |= clSetKernelArg(kernel, 1, sizeof(nPages), &nPages);
+    err |= clSetKernelArg(kernel, 2, sizeof(headerBuffer), &headerBuffer);
+    err |= clSetKernelArg(kernel, 3, sizeof(nStartNonce), &nStartNonce);
+    err |= clSetKernelArg(kernel, 4, sizeof(nTarget), &nTarget);
+    err |= clSetKernelArg(kernel, 5, sizeof(outputBuffer), &outputBuffer);
+
+    const size_t nGlobalSize = nCount;
+    err |= clEnqueueNDRangeKernel(queue, kernel, 1, nullptr, &nGlobalSize,
+                                  nullptr, 0, nullptr, nullptr);
+    cl_uint vOutput[1 + 2 * OPENCL_MAX_OUTPUTS];
+    err |= clEnqueueReadBuffer(queue, outputBuffer, CL_TRUE, 0,
+                               sizeof(vOutput), vOutput, 0, nullptr, nullptr);
+    if (err != CL_SUCCESS) {
+        return error("%s: %s: kernel launch failed", __func__, strName);
+    }
+
+    // The device only compared the first 64 bits of the hash
+    const unsigned int nCandidates =
+        std::min<unsigned int>(vOutput[0], OPENCL_MAX_OUTPUTS);
+    for (unsigned int i = 0; i < nCandidates; i++) {
+        const uint64_t nCandidate =
+            vOutput[1 + 2 * i] | (uint64_t(vOutput[2 + 2 * i]) << 32);
+        ethash_return_value_t ret =
+            ethash_full_compute(full.get(), header, nCandidate);
+        if (ret.success && ethash_check_difficulty(&ret.result, &boundary)) {
+            nNonce = nCandidate;
+            mixHash = ret.mix_hash;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::shared_ptr<CMinerBackend>> CreateOpenCLMinerBackends() {
+    std::vector<std::shared_ptr<CMinerBackend>> vBackends;
+
+    std::vector<int> vSelected;
+    const std::string strDevices =
+        GetArg("-opencldevices", DEFAULT_OPENCL_DEVICES);
+    if (!strDevices.empty() && !ParseCpuList(strDevices, vSelected)) {
+        LogPrintf("Invalid -opencldevices '%s', not mining on GPUs\n",
+                  strDevices);
+        return vBackends;
+    }
+
+    cl_uint nPlatforms = 0;
+    if (clGetPlatformIDs(0, nullptr, &nPlatforms) != CL_SUCCESS ||
+        nPlatforms == 0) {
+        LogPrintf("No OpenCL platforms found\n");
+        return vBackends;
+    }
+    std::vector<cl_platform_id> vPlatforms(nPlatforms);
+    clGetPlatformIDs(nPlatforms, vPlatforms.data(), nullptr);
+
+    // GPUs are numbered across all platforms, in the order they report them
+    int nIndex = 0;
+    for (cl_platform_id platform : vPlatforms) {
+        cl_uint nDevices = 0;
+        if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 0, nullptr,
+                           &nDevices) != CL_SUCCESS) {
+            continue;
+        }
+        std::vector<cl_device_id> vDevices(nDevices);
+        clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, nDevices,
+                       vDevices.data(), nullptr);
+
+        for (cl_device_id device : vDevices) {
+            const int nDevice = nIndex++;
+            if (!vSelected.empty() &&
+                std::find(vSelected.begin(), vSelected.end(), nDevice) ==
+                    vSelected.end()) {
+                continue;
+            }
+
+            char szName[256] = {0};
+            clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(szName) - 1,
+                            szName, nullptr);
+            auto backend = std::make_shared<COpenCLMinerBackend>(
+                device, strprintf("opencl%d (%s)", nDevice, szName));
+            if (!backend->Init()) {
+                continue;
+            }
+            LogPrintf("Mining on %s\n", backend->GetName());
+            vBackends.push_back(backend);
+        }
+    }
+    return vBackends;
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_OPENCLMINER_H
+#define BITCOIN_OPENCLMINER_H
+
+#include "minerbackend.h"
+#include "sync.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// clCreateCommandQueue is deprecated from 2.0 but works everywhere
+#define CL_TARGET_OPENCL_VERSION 120
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+/** Default for -opencldevices, all GPUs */
+static const char *const DEFAULT_OPENCL_DEVICES = "";
+/** log2 of the nonces per kernel launch, about 100ms on a mid range GPU */
+static const int OPENCL_NONCE_BATCH_BITS = 20;
+
+/**
+ * Search nonces on one OpenCL GPU with the kernel in ethash/ethash.cl. The
+ * DAG is copied to the device whenever Search() is handed a different one,
+ * and every candidate the device reports is verified on the CPU.
+ */
+class COpenCLMinerBackend : public CMinerBackend {
+private:
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;
+    cl_program program;
+    cl_kernel kernel;
+    cl_mem dagBuffer;
+    cl_mem headerBuffer;
+    cl_mem outputBuffer;
+    uint64_t nDagPages;
+    std::string strName;
+
+    //! DAG the device holds, expired once the epoch is dropped
+    std::weak_ptr<struct ethash_full> dagUploaded;
+    //! DAG that did not fit on the device, not retried
+    std::weak_ptr<struct ethash_full> dagFailed;
+    //! Threads of a stopped pool may still be in Search()
+    CCriticalSection cs_device;
+
+    bool UploadDag(const EthashFullRef &full);
+
+public:
+    COpenCLMinerBackend(cl_device_id deviceIn, const std::string &strNameIn);
+    ~COpenCLMinerBackend();
+
+    /** Build the kernel and allocate buffers, false if the device is unusable */
+    bool Init();
+
+    std::string GetName() const override;
+    uint64_t GetBatchSize() const override;
+    bool Search(const EthashFullRef &full, const ethash_h256_t &header,
+                const ethash_h256_t &boundary, uint64_t nStart,
+                uint64_t nCount, uint64_t &nNonce,
+                ethash_h256_t &mixHash) override;
+};
+
+/** Set up every GPU on every platform, or those listed in -opencldevices */
+std::vector<std::shared_ptr<CMinerBackend>> CreateOpenCLMinerBackends();
+
+#endif // BITCOIN_OPENCLMINER_H
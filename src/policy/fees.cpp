@@ -330,6 +330,14 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash) {
         return false;
     }
 
+    // Txs that entered at the current height sit in the one unconfirmed slot
+    // no estimate reads, except while the height is still small enough for
+    // the slot arithmetic in EstimateMedianVal to wrap.
+    if (pos->second.blockHeight != nBestSeenHeight ||
+        nBestSeenHeight < feeStats.GetMaxConfirms()) {
+        InvalidateMedianCache();
+    }
+
     feeStats.removeTx(pos->second.blockHeight, nBestSeenHeight,
                       pos->second.bucketIndex);
     mapMemPoolTxs.erase(hash);
@@ -386,6 +394,11 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry &entry,
     mapMemPoolTxs[txid].blockHeight = txHeight;
     mapMemPoolTxs[txid].bucketIndex =
         feeStats.NewTx(txHeight, double(feeRate.GetFeePerK()));
+
+    // See removeTx, the same holds for a tx entering the current slot.
+    if (nBestSeenHeight < feeStats.GetMaxConfirms()) {
+        InvalidateMedianCache();
+    }
 }
 
 bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight,
@@ -430,6 +443,7 @@ void CBlockPolicyEstimator::processBlock(
     // removeTx (via processBlockTx) correctly calculate age of unconfirmed txs
     // to remove from tracking.
     nBestSeenHeight = nBlockHeight;
+    InvalidateMedianCache();
 
     // Clear the current block state and update unconfirmed circular buffer
     feeStats.ClearCurrent(nBlockHeight);
@@ -463,8 +477,7 @@ CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget) {
         return CFeeRate(CAmount(0));
     }
 
-    double median = feeStats.EstimateMedianVal(
-        confTarget, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+    double median = CachedMedianVal(confTarget);
 
     if (median < 0) {
         return CFeeRate(CAmount(0));
@@ -493,9 +506,7 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget,
     double median = -1;
     while (median < 0 &&
            (unsigned int)confTarget <= feeStats.GetMaxConfirms()) {
-        median =
-            feeStats.EstimateMedianVal(confTarget++, SUFFICIENT_FEETXS,
-                                       MIN_SUCCESS_PCT, true, nBestSeenHeight);
+        median = CachedMedianVal(confTarget++);
     }
 
     if (answerFoundAtTarget) {
@@ -542,6 +553,20 @@ double CBlockPolicyEstimator::estimateSmartPriority(int confTarget,
     return -1;
 }
 
+double CBlockPolicyEstimator::CachedMedianVal(int confTarget) {
+    if (medianCache.empty()) {
+        medianCache.assign(feeStats.GetMaxConfirms() + 1, MEDIAN_UNCACHED);
+    }
+
+    double &median = medianCache[confTarget];
+    if (median == MEDIAN_UNCACHED) {
+        median = feeStats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS,
+                                            MIN_SUCCESS_PCT, true,
+                                            nBestSeenHeight);
+    }
+    return median;
+}
+
 void CBlockPolicyEstimator::Write(CAutoFile &fileout) {
     fileout << nBestSeenHeight;
     feeStats.Write(fileout);
@@ -552,6 +577,7 @@ void CBlockPolicyEstimator::Read(CAutoFile &filein, int nFileVersion) {
     filein >> nFileBestSeenHeight;
     feeStats.Read(filein);
     nBestSeenHeight = nFileBestSeenHeight;
+    InvalidateMedianCache();
     if (nFileVersion < 139900) {
         TxConfirmStats priStats;
         priStats.Read(filein);
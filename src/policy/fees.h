@@ -197,6 +197,9 @@ static const double MIN_SUCCESS_PCT = .95;
  * significance */
 static const double SUFFICIENT_FEETXS = 1;
 
+/** Marks an uncached median; EstimateMedianVal never returns less than -1 */
+static const double MEDIAN_UNCACHED = -2;
+
 // Minimum and Maximum values for tracking feerates
 static constexpr CAmount MIN_FEERATE(10);
 static const CAmount MAX_FEERATE(int64_t(1e7));
@@ -272,9 +275,23 @@ public:
     void Read(CAutoFile &filein, int nFileVersion);
 
 private:
+    /**
+     * Return feeStats' median for confTarget, computing it only on the
+     * first request since the estimates last changed.
+     */
+    double CachedMedianVal(int confTarget);
+
+    /**
+     * Forget all cached medians. Called whenever data an estimate reads has
+     * changed.
+     */
+    void InvalidateMedianCache() { medianCache.clear(); }
+
     //!< Passed to constructor to avoid dependency on main
     CFeeRate minTrackedFee;
     unsigned int nBestSeenHeight;
+    //!< Medians by confirmation target, MEDIAN_UNCACHED where not computed
+    std::vector<double> medianCache;
     struct TxStatsInfo {
         unsigned int blockHeight;
         unsigned int bucketIndex;
@@ -20,6 +20,9 @@ static const uint64_t DEFAULT_MAX_GENERATED_BLOCK_SIZE = 1750000;
 /** Default for -blockprioritypercentage, define the amount of block space
  * reserved to high priority transactions **/
 static const uint64_t DEFAULT_BLOCK_PRIORITY_PERCENTAGE = 5;
+/** Default for -blockcontentpercentage, the most block space transactions
+ * carrying content may take, keeping the rest for payments **/
+static const uint64_t DEFAULT_BLOCK_CONTENT_PERCENTAGE = 50;
 /** Default for -blockmintxfee, which sets the minimum feerate for a transaction
  * in blocks created by mining code **/
 static const CAmount DEFAULT_BLOCK_MIN_TX_FEE(1000);
@@ -32,6 +35,9 @@ static const unsigned int MAX_P2SH_SIGOPS = 15;
 static const unsigned int MAX_STANDARD_TX_SIGOPS = MAX_TX_SIGOPS_COUNT / 5;
 /** Default for -maxmempool, maximum megabytes of mempool memory usage */
 static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
+/** Default for -maxmempoolcontent, maximum megabytes of content held by
+ * mempool transactions */
+static const unsigned int DEFAULT_MAX_MEMPOOL_CONTENT_SIZE = 100;
 /** Default for -incrementalrelayfee, which sets the minimum feerate increase
  * for mempool limiting or BIP 125 replacement **/
 static const CAmount DEFAULT_INCREMENTAL_RELAY_FEE(1000);
@@ -11,7 +11,13 @@
 #include "chainparams.h"
 #include "config.h"
 #include "consensus/params.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
+#include "ethashcache.h"
 #include "primitives/block.h"
+#include "random.h"
+#include "replaystats.h"
+#include "script/sigcache.h"
 #include "uint256.h"
 #include "util.h"
 #include "validation.h"
@@ -19,6 +25,142 @@
 #include "ethash/internal.h"
 #include "ethash/ethash.h"
 
+#include <boost/thread.hpp>
+
+#include <mutex>
+
+bool fFullPowCheck = DEFAULT_FULL_POW_CHECK;
+
+namespace {
+
+/**
+ * Headers whose ethash result has been fully computed and found valid, so
+ * that re-announcements, reorgs and re-reads from disk don't compute it again.
+ */
+class CProofOfWorkCache {
+private:
+    //! Entries are SHA256(nonce || block hash)
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_powcache;
+
+public:
+    CProofOfWorkCache() { GetRandBytes(nonce.begin(), 32); }
+
+    void ComputeEntry(uint256 &entry, const uint256 &hash) {
+        CSHA256()
+            .Write(nonce.begin(), 32)
+            .Write(hash.begin(), 32)
+            .Finalize(entry.begin());
+    }
+
+    bool Get(const uint256 &entry) {
+        boost::shared_lock<boost::shared_mutex> lock(cs_powcache);
+        return setValid.contains(entry, false);
+    }
+
+    void Set(uint256 &entry) {
+        boost::unique_lock<boost::shared_mutex> lock(cs_powcache);
+        setValid.insert(entry);
+    }
+    uint32_t setup_bytes(size_t n) { return setValid.setup_bytes(n); }
+};
+
+static CProofOfWorkCache powCache;
+
+/**
+ * The nBits required of the children of the last few blocks, as far as it
+ * doesn't depend on the child's own header. The header, the block and every
+ * template built on a tip all need the same one, and computing it can walk
+ * back a whole difficulty interval.
+ *
+ * Entries are keyed by block hash, which fixes all the ancestors, and by the
+ * consensus parameters they were computed with.
+ */
+class CNextWorkCache {
+private:
+    static const size_t SIZE = 8;
+
+    struct Entry {
+        uint256 hash;
+        const Consensus::Params *params;
+        uint32_t nBits;
+    };
+
+    std::mutex cs;
+    Entry entries[SIZE];
+    size_t nNext;
+
+public:
+    CNextWorkCache() : nNext(0) {
+        for (Entry &entry : entries) {
+            entry.params = nullptr;
+        }
+    }
+
+    template <typename Compute>
+    uint32_t Get(const CBlockIndex *pindexPrev,
+                 const Consensus::Params &params, Compute compute) {
+        // Indexes without a hash, made up by the tests, aren't cached.
+        if (!pindexPrev->phashBlock) {
+            return compute();
+        }
+        const uint256 &hash = *pindexPrev->phashBlock;
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            for (const Entry &entry : entries) {
+                if (entry.params == &params && entry.hash == hash) {
+                    return entry.nBits;
+                }
+            }
+        }
+
+        // Computed without the lock, the ancestors of a block never change.
+        uint32_t nBits = compute();
+        std::lock_guard<std::mutex> lock(cs);
+        entries[nNext] = {hash, &params, nBits};
+        nNext = (nNext + 1) % SIZE;
+        return nBits;
+    }
+};
+
+static CNextWorkCache nextWorkCache;
+static CNextWorkCache nextCashWorkCache;
+}
+
+void InitProofOfWorkCache() {
+    size_t nMaxCacheSize =
+        std::min(std::max(int64_t(0), GetArg("-maxpowcachesize",
+                                             DEFAULT_MAX_POW_CACHE_SIZE)),
+                 MAX_MAX_POW_CACHE_SIZE) *
+        (size_t(1) << 20);
+    size_t nElems = powCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for proof-of-work cache, "
+              "able to store %zu elements\n",
+              (nElems * sizeof(uint256)) >> 20, nMaxCacheSize >> 20, nElems);
+}
+
+/** The nBits of the block after pindexPrev, a retargeting height */
+static uint32_t GetRetargetWorkRequired(const CBlockIndex *pindexPrev,
+                                        const Config &config) {
+    const Consensus::Params &params = config.GetChainParams().GetConsensus();
+
+    // Bitcoin: This fixes an issue where a 51% attack can change difficulty at will.
+    // Go back the full period unless it's the first retarget after genesis. Code courtesy of Art Forz
+    int blockstogoback = params.DifficultyAdjustmentInterval() - 1;
+    if ((pindexPrev->nHeight+1) != params.DifficultyAdjustmentInterval())
+        blockstogoback = params.DifficultyAdjustmentInterval();
+
+    // Go back by what we want to be 14 days worth of blocks
+    const CBlockIndex* pindexFirst = pindexPrev;
+    for (int i = 0; pindexFirst && i < blockstogoback; i++)
+        pindexFirst = pindexFirst->pprev;
+    assert(pindexFirst);
+
+    return CalculateNextWorkRequired(pindexPrev, pindexFirst->GetBlockTime(), config);
+}
+
 uint32_t GetNextWorkRequired(const CBlockIndex *pindexPrev,
                              const CBlockHeader *pblock, const Config &config) {
     const Consensus::Params &params = config.GetChainParams().GetConsensus();
@@ -46,28 +188,20 @@ uint32_t GetNextWorkRequired(const CBlockIndex *pindexPrev,
             else
             {
                 // Return the last non-special-min-difficulty-rules-block
-                const CBlockIndex* pindex = pindexPrev;
-                while (pindex->pprev && pindex->nHeight % params.DifficultyAdjustmentInterval() != 0 && pindex->nBits == UintToArith256(params.powLimit).GetCompact())
-                    pindex = pindex->pprev;
-                return pindex->nBits;
+                return nextWorkCache.Get(pindexPrev, params, [&]() {
+                    const CBlockIndex* pindex = pindexPrev;
+                    while (pindex->pprev && pindex->nHeight % params.DifficultyAdjustmentInterval() != 0 && pindex->nBits == UintToArith256(params.powLimit).GetCompact())
+                        pindex = pindex->pprev;
+                    return pindex->nBits;
+                });
             }
         }
         return pindexPrev->nBits;
     }
 
-    // Bitcoin: This fixes an issue where a 51% attack can change difficulty at will.
-    // Go back the full period unless it's the first retarget after genesis. Code courtesy of Art Forz
-    int blockstogoback = params.DifficultyAdjustmentInterval() - 1;
-    if ((pindexPrev->nHeight+1) != params.DifficultyAdjustmentInterval())
-        blockstogoback = params.DifficultyAdjustmentInterval();
-
-    // Go back by what we want to be 14 days worth of blocks
-    const CBlockIndex* pindexFirst = pindexPrev;
-    for (int i = 0; pindexFirst && i < blockstogoback; i++)
-        pindexFirst = pindexFirst->pprev;
-    assert(pindexFirst);
-
-    return CalculateNextWorkRequired(pindexPrev, pindexFirst->GetBlockTime(), config);
+    return nextWorkCache.Get(pindexPrev, params, [&]() {
+        return GetRetargetWorkRequired(pindexPrev, config);
+    });
 }
 
 uint32_t CalculateNextWorkRequired(const CBlockIndex *pindexPrev,
@@ -110,14 +244,15 @@ uint32_t CalculateNextWorkRequired(const CBlockIndex *pindexPrev,
     return bnNew.GetCompact();
 }
 
-bool CheckProofOfWork(const CBlockHeader &blockHeader, const Config &config) {
-    CBlockHeaderBase block(blockHeader);
-
+static bool CheckProofOfWorkQuick(const CBlockHeader &blockHeader,
+                                  const Config &config,
+                                  ethash_h256_t &ethBlockHash,
+                                  ethash_h256_t &boundary) {
     bool fNegative;
     bool fOverflow;
     arith_uint256 bnTarget;
 
-    bnTarget.SetCompact(block.nBits, &fNegative, &fOverflow);
+    bnTarget.SetCompact(blockHeader.nBits, &fNegative, &fOverflow);
 
     // Check range
     if (fNegative || bnTarget == 0 || fOverflow ||
@@ -126,11 +261,74 @@ bool CheckProofOfWork(const CBlockHeader &blockHeader, const Config &config) {
         return false;
     }
 
-    ethash_h256_t boundary = bnTarget.ToEthashH256();
-    ethash_h256 ethBlockHash = block.GetEthash();
+    boundary = bnTarget.ToEthashH256();
+    ethBlockHash = blockHeader.GetBaseEthash();
     return ethash_quick_check_difficulty(&ethBlockHash, blockHeader.nNonce, &(blockHeader.hashMix), &boundary);
 }
 
+bool CheckProofOfWorkQuick(const CBlockHeader &blockHeader,
+                           const Config &config) {
+    ethash_h256_t ethBlockHash;
+    ethash_h256_t boundary;
+    return CheckProofOfWorkQuick(blockHeader, config, ethBlockHash, boundary);
+}
+
+bool CheckProofOfWork(const CBlockHeader &blockHeader, const Config &config) {
+    CReplayTimer timer(ReplayPhase::POW);
+    // Headers and then their blocks are checked more than once, a verified
+    // header doesn't need its ethash header hash again.
+    uint256 entry;
+    if (fFullPowCheck) {
+        powCache.ComputeEntry(entry, blockHeader.GetHash());
+        if (powCache.Get(entry)) {
+            return true;
+        }
+    }
+
+    ethash_h256_t ethBlockHash;
+    ethash_h256_t boundary;
+    // The quick check is cheap and rejects most garbage before we look at the
+    // light cache.
+    if (!CheckProofOfWorkQuick(blockHeader, config, ethBlockHash, boundary)) {
+        return false;
+    }
+    if (!fFullPowCheck) {
+        return true;
+    }
+
+    EthashLightRef light = EthashLightCache().Get(blockHeader.nBlockHeight);
+    if (!light) {
+        return error("%s: no ethash light cache for height %u", __func__,
+                     blockHeader.nBlockHeight);
+    }
+    ethash_return_value_t ret =
+        ethash_light_compute(light.get(), ethBlockHash, blockHeader.nNonce);
+    if (!ret.success ||
+        memcmp(&ret.mix_hash, &blockHeader.hashMix, sizeof(ret.mix_hash)) !=
+            0 ||
+        !ethash_check_difficulty(&ret.result, &boundary)) {
+        return false;
+    }
+
+    powCache.Set(entry);
+    return true;
+}
+
+bool CheckStoredProofOfWork(const CBlockHeader &blockHeader,
+                            const Config &config) {
+    ethash_h256_t ethBlockHash;
+    ethash_h256_t boundary;
+    if (!CheckProofOfWorkQuick(blockHeader, config, ethBlockHash, boundary)) {
+        return false;
+    }
+    if (fFullPowCheck) {
+        uint256 entry;
+        powCache.ComputeEntry(entry, blockHeader.GetHash());
+        powCache.Set(entry);
+    }
+    return true;
+}
+
 /**
  * Compute a target based on the work done between 2 blocks and the time
  * required to produce that work.
@@ -202,6 +400,35 @@ static const CBlockIndex *GetSuitableBlock(const CBlockIndex *pindex) {
     return blocks[1];
 }
 
+/** The part of GetNextCashWorkRequired not depending on the new block */
+static uint32_t ComputeNextCashWorkRequired(const CBlockIndex *pindexPrev,
+                                            const Consensus::Params &params) {
+    // Compute the difficulty based on the full adjustment interval.
+    const uint32_t nHeight = pindexPrev->nHeight;
+    assert(nHeight >= params.DifficultyAdjustmentInterval());
+
+    // Get the last suitable block of the difficulty interval.
+    const CBlockIndex *pindexLast = GetSuitableBlock(pindexPrev);
+    assert(pindexLast);
+
+    // Get the first suitable block of the difficulty interval.
+    uint32_t nHeightFirst = nHeight - 144;
+    const CBlockIndex *pindexFirst =
+        GetSuitableBlock(pindexPrev->GetAncestor(nHeightFirst));
+    assert(pindexFirst);
+
+    // Compute the target based on time and work done during the interval.
+    const arith_uint256 nextTarget =
+        ComputeTarget(pindexFirst, pindexLast, params);
+
+    const arith_uint256 powLimit = UintToArith256(params.powLimit);
+    if (nextTarget > powLimit) {
+        return powLimit.GetCompact();
+    }
+
+    return nextTarget.GetCompact();
+}
+
 /**
  * Compute the next required proof of work using a weighted average of the
  * estimated hashrate per block.
@@ -228,28 +455,7 @@ uint32_t GetNextCashWorkRequired(const CBlockIndex *pindexPrev,
         return UintToArith256(params.powLimit).GetCompact();
     }
 
-    // Compute the difficulty based on the full adjustment interval.
-    const uint32_t nHeight = pindexPrev->nHeight;
-    assert(nHeight >= params.DifficultyAdjustmentInterval());
-
-    // Get the last suitable block of the difficulty interval.
-    const CBlockIndex *pindexLast = GetSuitableBlock(pindexPrev);
-    assert(pindexLast);
-
-    // Get the first suitable block of the difficulty interval.
-    uint32_t nHeightFirst = nHeight - 144;
-    const CBlockIndex *pindexFirst =
-        GetSuitableBlock(pindexPrev->GetAncestor(nHeightFirst));
-    assert(pindexFirst);
-
-    // Compute the target based on time and work done during the interval.
-    const arith_uint256 nextTarget =
-        ComputeTarget(pindexFirst, pindexLast, params);
-
-    const arith_uint256 powLimit = UintToArith256(params.powLimit);
-    if (nextTarget > powLimit) {
-        return powLimit.GetCompact();
-    }
-
-    return nextTarget.GetCompact();
+    return nextCashWorkCache.Get(pindexPrev, params, [&]() {
+        return ComputeNextCashWorkRequired(pindexPrev, params);
+    });
 }
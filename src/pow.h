@@ -13,6 +13,19 @@ class CBlockIndex;
 class Config;
 class uint256;
 
+/** Default for -fullpowcheck */
+static const bool DEFAULT_FULL_POW_CHECK = true;
+/** Default for -maxpowcachesize, in MiB */
+static const unsigned int DEFAULT_MAX_POW_CACHE_SIZE = 8;
+/** Maximum -maxpowcachesize allowed */
+static const int64_t MAX_MAX_POW_CACHE_SIZE = 1024;
+
+/**
+ * Whether CheckProofOfWork recomputes the ethash mix with the light cache
+ * instead of only trusting the header-supplied hashMix.
+ */
+extern bool fFullPowCheck;
+
 uint32_t GetNextWorkRequired(const CBlockIndex *pindexPrev,
                              const CBlockHeader *pblock, const Config &config);
 uint32_t CalculateNextWorkRequired(const CBlockIndex *pindexPrev,
@@ -21,10 +34,34 @@ uint32_t CalculateNextWorkRequired(const CBlockIndex *pindexPrev,
 
 /**
  * Check whether a block hash satisfies the proof-of-work requirement specified
- * by nBits
+ * by nBits. With fFullPowCheck the ethash result is recomputed from the light
+ * cache, headers that pass are remembered so they are only computed once.
+ *
+ * The light cache is picked by the header's nBlockHeight, so headers from the
+ * network must have their height checked against their parent first.
  */
 bool CheckProofOfWork(const CBlockHeader &blockHeader, const Config &config);
 
+/**
+ * Check the proof-of-work without the light cache: nBits is in range and the
+ * header-supplied hashMix meets it. Cheap and free of context, for the checks
+ * that run before the header's height is known to be right.
+ */
+bool CheckProofOfWorkQuick(const CBlockHeader &blockHeader,
+                           const Config &config);
+
+/**
+ * Check the proof-of-work of a header we fully verified before, e.g. one read
+ * back from our own block index. Only the quick check is run, and the header
+ * is added to the verified header cache so later CheckProofOfWork calls for it
+ * are free.
+ */
+bool CheckStoredProofOfWork(const CBlockHeader &blockHeader,
+                            const Config &config);
+
+/** To be called once in AppInitMain to size the verified header cache */
+void InitProofOfWorkCache();
+
 /**
  * Bitcoin cash's difficulty adjustment mechanism.
  */
@@ -6,11 +6,13 @@
 #define _BITCOIN_PREVECTOR_H_
 
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 
 #include <iterator>
+#include <type_traits>
 
 #pragma pack(push, 1)
 /**
@@ -295,16 +297,32 @@ private:
         return is_direct() ? direct_ptr(pos) : indirect_ptr(pos);
     }
 
+    // Construct into storage that is already counted in _size. Done in one
+    // loop over a plain pointer rather than element by element through
+    // item_ptr(), so that for bytes it compiles to memset or memcpy.
+    void fill(T *dst, ptrdiff_t count, const T &value = T()) {
+        for (ptrdiff_t i = 0; i < count; i++) {
+            new (static_cast<void *>(dst + i)) T(value);
+        }
+    }
+
+    template <typename InputIterator>
+    void fill(T *dst, InputIterator first, InputIterator last) {
+        while (first != last) {
+            new (static_cast<void *>(dst)) T(*first);
+            ++dst;
+            ++first;
+        }
+    }
+
 public:
     void assign(size_type n, const T &val) {
         clear();
         if (capacity() < n) {
             change_capacity(n);
         }
-        while (size() < n) {
-            _size++;
-            new (static_cast<void *>(item_ptr(size() - 1))) T(val);
-        }
+        _size += n;
+        fill(item_ptr(0), n, val);
     }
 
     template <typename InputIterator>
@@ -314,11 +332,8 @@ public:
         if (capacity() < n) {
             change_capacity(n);
         }
-        while (first != last) {
-            _size++;
-            new (static_cast<void *>(item_ptr(size() - 1))) T(*first);
-            ++first;
-        }
+        _size += n;
+        fill(item_ptr(0), first, last);
     }
 
     prevector() : _size(0) {}
@@ -327,47 +342,36 @@ public:
 
     explicit prevector(size_type n, const T &val = T()) : _size(0) {
         change_capacity(n);
-        while (size() < n) {
-            _size++;
-            new (static_cast<void *>(item_ptr(size() - 1))) T(val);
-        }
+        _size += n;
+        fill(item_ptr(0), n, val);
     }
 
     template <typename InputIterator>
     prevector(InputIterator first, InputIterator last) : _size(0) {
         size_type n = last - first;
         change_capacity(n);
-        while (first != last) {
-            _size++;
-            new (static_cast<void *>(item_ptr(size() - 1))) T(*first);
-            ++first;
-        }
+        _size += n;
+        fill(item_ptr(0), first, last);
     }
 
     prevector(const prevector<N, T, Size, Diff> &other) : _size(0) {
-        change_capacity(other.size());
-        const_iterator it = other.begin();
-        while (it != other.end()) {
-            _size++;
-            new (static_cast<void *>(item_ptr(size() - 1))) T(*it);
-            ++it;
-        }
+        size_type n = other.size();
+        change_capacity(n);
+        _size += n;
+        fill(item_ptr(0), other.begin(), other.end());
     }
 
     prevector(prevector<N, T, Size, Diff> &&other) : _size(0) { swap(other); }
 
+    /**
+     * Copies into the storage this already has when it is large enough, so
+     * assigning to a script that was used before doesn't allocate.
+     */
     prevector &operator=(const prevector<N, T, Size, Diff> &other) {
         if (&other == this) {
             return *this;
         }
-        resize(0);
-        change_capacity(other.size());
-        const_iterator it = other.begin();
-        while (it != other.end()) {
-            _size++;
-            new (static_cast<void *>(item_ptr(size() - 1))) T(*it);
-            ++it;
-        }
+        assign(other.begin(), other.end());
         return *this;
     }
 
@@ -407,16 +411,38 @@ public:
     const T &operator[](size_type pos) const { return *item_ptr(pos); }
 
     void resize(size_type new_size) {
-        if (size() > new_size) {
+        size_type cur_size = size();
+        if (cur_size == new_size) {
+            return;
+        }
+        if (cur_size > new_size) {
             erase(item_ptr(new_size), end());
+            return;
         }
         if (new_size > capacity()) {
             change_capacity(new_size);
         }
-        while (size() < new_size) {
-            _size++;
-            new (static_cast<void *>(item_ptr(size() - 1))) T();
+        ptrdiff_t increase = new_size - cur_size;
+        fill(item_ptr(cur_size), increase);
+        _size += increase;
+    }
+
+    /**
+     * As resize(), but the elements it adds are left uninitialized, for the
+     * caller to write, as deserialization does. Only for trivial types.
+     */
+    void resize_uninitialized(size_type new_size) {
+        static_assert(std::is_trivial<T>::value,
+                      "the elements would be left unconstructed");
+        size_type cur_size = size();
+        if (new_size <= cur_size) {
+            resize(new_size);
+            return;
+        }
+        if (new_size > capacity()) {
+            change_capacity(new_size);
         }
+        _size += new_size - cur_size;
     }
 
     void reserve(size_type new_capacity) {
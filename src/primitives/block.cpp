@@ -10,15 +10,58 @@
 #include "tinyformat.h"
 #include "utilstrencodings.h"
 
+#include <cstring>
+
 uint256 CBlockHeader::GetHash() const {
+    if (IsHashCurrent()) {
+        return hashCached;
+    }
     return SerializeHash(*this);
 }
 
+void CBlockHeader::CacheHash() {
+    CacheHash(SerializeHash(*this));
+}
+
+void CBlockHeader::CacheHash(const uint256 &hash) {
+    hashCached = hash;
+    hashed.nVersion = nVersion;
+    hashed.hashPrevBlock = hashPrevBlock;
+    hashed.hashMerkleRoot = hashMerkleRoot;
+    hashed.nBlockHeight = nBlockHeight;
+    hashed.nTime = nTime;
+    hashed.nChainInterest = nChainInterest;
+    hashed.nBits = nBits;
+    hashed.hashMix = hashMix;
+    hashed.nNonce = nNonce;
+    fHashCached = true;
+}
+
+bool CBlockHeader::IsHashCurrent() const {
+    // Far cheaper than the double SHA256.
+    return fHashCached && hashed.nNonce == nNonce && hashed.nTime == nTime &&
+           hashed.hashMerkleRoot == hashMerkleRoot &&
+           hashed.hashPrevBlock == hashPrevBlock &&
+           hashed.nVersion == nVersion &&
+           hashed.nBlockHeight == nBlockHeight &&
+           hashed.nChainInterest == nChainInterest && hashed.nBits == nBits &&
+           memcmp(&hashed.hashMix, &hashMix, sizeof(hashMix)) == 0;
+}
+
 ethash_h256 CBlockHeader::GetEthash() const
 {
     return SerializeEthash(*this);
 }
 
+ethash_h256 CBlockHeader::GetBaseEthash() const
+{
+    // The fields of CBlockHeaderBase::SerializationOp
+    CEthashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << nVersion << hashPrevBlock << hashMerkleRoot << nBlockHeight << nTime
+       << nChainInterest << nBits;
+    return ss.GetEthash();
+}
+
 uint256 CBlockHeaderBase::GetHash() const
 {
     return SerializeHash(*this);
@@ -50,6 +50,11 @@ public:
         READWRITE(nBits);
         READWRITE(FLATDATA(hashMix));
         READWRITE(nNonce);
+        // Nearly every header that is read is hashed, most of them several
+        // times.
+        if (ser_action.ForRead()) {
+            CacheHash();
+        }
     }
 
     void SetNull() {
@@ -62,15 +67,58 @@ public:
         nBits = 0;
         hashMix = {0};
         nNonce = 0;
+        fHashCached = false;
     }
 
     bool IsNull() const { return (nBits == 0); }
 
+    /**
+     * The block hash. The cached one while the fields are the ones it was
+     * cached for, see CacheHash.
+     */
     uint256 GetHash() const;
 
+    /**
+     * Compute the hash of the header as it is and keep it for GetHash. A
+     * header is cached when it is deserialized. Not const, so a header that
+     * is shared between threads is only read.
+     */
+    void CacheHash();
+    /** Keep hash, which must be the hash of the header as it is */
+    void CacheHash(const uint256 &hash);
+
     ethash_h256 GetEthash() const;
 
+    /**
+     * The ethash header hash that is mined on, over every field but hashMix
+     * and nNonce. Same as CBlockHeaderBase(*this).GetEthash(), without the
+     * copy.
+     */
+    ethash_h256 GetBaseEthash() const;
+
     int64_t GetBlockTime() const { return (int64_t)nTime; }
+
+private:
+    //! The fields a cached hash was computed over
+    struct HashedFields {
+        int32_t nVersion;
+        uint256 hashPrevBlock;
+        uint256 hashMerkleRoot;
+        uint32_t nBlockHeight;
+        uint32_t nTime;
+        uint64_t nChainInterest;
+        uint32_t nBits;
+        ethash_h256_t hashMix;
+        uint64_t nNonce;
+    };
+
+    //! Whether the fields still are hashed, so hashCached is the hash
+    bool IsHashCurrent() const;
+
+    // memory only
+    bool fHashCached;
+    uint256 hashCached;
+    HashedFields hashed;
 };
 
 class CBlockHeaderBase {
@@ -158,19 +206,8 @@ public:
         fChecked = false;
     }
 
-    CBlockHeader GetBlockHeader() const {
-        CBlockHeader block;
-        block.nVersion       = nVersion;
-        block.hashPrevBlock  = hashPrevBlock;
-        block.hashMerkleRoot = hashMerkleRoot;
-        block.nBlockHeight   = nBlockHeight;
-        block.nTime          = nTime;
-        block.nChainInterest = nChainInterest;
-        block.nBits          = nBits;
-        block.hashMix        = hashMix;
-        block.nNonce         = nNonce;
-        return block;
-    }
+    /** The header, with its cached hash */
+    CBlockHeader GetBlockHeader() const { return *this; }
 
     std::string ToString() const;
 };
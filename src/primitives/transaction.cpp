@@ -6,6 +6,7 @@
 #include "primitives/transaction.h"
 
 #include "hash.h"
+#include "script/interpreter.h"
 #include "tinyformat.h"
 #include "utilstrencodings.h"
 
@@ -37,22 +38,9 @@ std::string CTxIn::ToString() const {
 }
 
 CTxOut::CTxOut(const CAmount& nValueIn, CScript scriptPubKeyIn,string strContentIn,uint32_t nLockTimeIn, const CAmount& nPrincipalIn)
-{
-    nValue = nValueIn;
-    nPrincipal = nPrincipalIn;
-    scriptPubKey = scriptPubKeyIn;
-    strContent=strContentIn;
-    nLockTime=nLockTimeIn;
-}
-
-CTxOut::CTxOut(const CTxOut &txout)
-{
-    nValue = txout.nValue;
-    nPrincipal = txout.nPrincipal;
-    scriptPubKey = txout.scriptPubKey;
-    strContent = txout.strContent;
-    nLockTime = txout.nLockTime;
-}
+    : nValue(nValueIn), nPrincipal(nPrincipalIn),
+      scriptPubKey(std::move(scriptPubKeyIn)),
+      strContent(std::move(strContentIn)), nLockTime(nLockTimeIn) {}
 
 std::string CTxOut::ToString() const {
     return strprintf("CTxOut(nValue=%d.%08d, scriptPubKey=%s,"
@@ -83,19 +71,41 @@ uint256 CTransaction::ComputeHash() const {
     return SerializeHash(*this, SER_GETHASH, 0);
 }
 
+unsigned int CTransaction::ComputeTotalSize() const {
+    return ::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION);
+}
+
+uint64_t CTransaction::ComputeSigOpCount() const {
+    uint64_t nSigOps = 0;
+    for (const CTxIn &txin : vin) {
+        nSigOps += txin.scriptSig.GetSigOpCount(false);
+    }
+    for (const CTxOut &txout : vout) {
+        nSigOps += txout.scriptPubKey.GetSigOpCount(false);
+    }
+    return nSigOps;
+}
+
 /**
  * For backward compatibility, the hash is initialized to 0.
  * TODO: remove the need for this default constructor entirely.
  */
 CTransaction::CTransaction()
     : nVersion(CTransaction::CURRENT_VERSION), nFlags(TX_FLAGS_NORMAL), vin(), vout(),
-      hash() {}
+      hash(), nTotalSize(ComputeTotalSize()), nSigOpCount(0) {}
 CTransaction::CTransaction(const CMutableTransaction &tx)
     : nVersion(tx.nVersion), nFlags(tx.nFlags), vin(tx.vin), vout(tx.vout),
-      hash(ComputeHash()) {}
+      hash(ComputeHash()), nTotalSize(ComputeTotalSize()),
+      nSigOpCount(ComputeSigOpCount()) {}
 CTransaction::CTransaction(CMutableTransaction &&tx)
     : nVersion(tx.nVersion), nFlags(tx.nFlags), vin(std::move(tx.vin)), vout(std::move(tx.vout)),
-      hash(ComputeHash()) {}
+      hash(ComputeHash()), nTotalSize(ComputeTotalSize()),
+      nSigOpCount(ComputeSigOpCount()) {}
+CTransaction::CTransaction(CMutableTransaction &&tx, const uint256 &hashIn,
+                           unsigned int nTotalSizeIn, uint64_t nSigOpCountIn)
+    : nVersion(tx.nVersion), nFlags(tx.nFlags), vin(std::move(tx.vin)),
+      vout(std::move(tx.vout)), hash(hashIn), nTotalSize(nTotalSizeIn),
+      nSigOpCount(nSigOpCountIn) {}
 
 CTransaction& CTransaction::operator=(const CTransaction &tx) {
     *const_cast<int*>(&nVersion) = tx.nVersion;
@@ -104,6 +114,8 @@ CTransaction& CTransaction::operator=(const CTransaction &tx) {
     *const_cast<std::vector<CTxOut>*>(&vout) = tx.vout;
     //*const_cast<unsigned int*>(&nLockTime) = tx.nLockTime;
     *const_cast<uint256*>(&hash) = tx.hash;
+    *const_cast<unsigned int*>(&nTotalSize) = tx.nTotalSize;
+    *const_cast<uint64_t*>(&nSigOpCount) = tx.nSigOpCount;
     return *this;
 }
 
@@ -173,10 +185,6 @@ unsigned int CTransaction::CalculateModifiedSize(unsigned int nTxSize) const {
     return nTxSize;
 }
 
-unsigned int CTransaction::GetTotalSize() const {
-    return ::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION);
-}
-
 std::string CTransaction::ToString() const {
     std::string str;
     str += strprintf("CTransaction(hash=%s, ver=%d, flags=%i,vin.size=%u, vout.size=%u)\n",
@@ -203,28 +211,43 @@ void CTransaction::ClearContent(CTransaction& newTx) const {
     newTx = CTransaction(mtx);
 }
 
-int64_t GetTransactionSize(const CTransaction &tx) {
-    return ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+bool CTransaction::HasContent() const {
+    for (const CTxOut &out : vout) {
+        if (!out.strContent.empty()) {
+            return true;
+        }
+    }
+    return false;
 }
 
-uint256 GetPrevoutHash(const CTransaction& txTo) {
-    CHashWriter ss(SER_GETHASH, 0);
-    for (unsigned int n = 0; n < txTo.vin.size(); n++) {
-        ss << txTo.vin[n].prevout;
+CTransaction CTransaction::WithoutContent() const {
+    // Not copied at all, the content is what the copy is meant to save.
+    CMutableTransaction mtx;
+    mtx.nVersion = nVersion;
+    mtx.nFlags = nFlags;
+    mtx.vin = vin;
+    mtx.vout.reserve(vout.size());
+    for (const CTxOut &out : vout) {
+        mtx.vout.emplace_back(out.nValue, out.scriptPubKey, "", out.nLockTime,
+                              out.nPrincipal);
     }
-    return ss.GetHash();
+    // The size is that of the transaction, like the id.
+    return CTransaction(std::move(mtx), hash, nTotalSize, nSigOpCount);
 }
 
-uint256 GetOutputsHash(const CTransaction& txTo) {
-    CHashWriter ss(SER_GETHASH, 0);
-    for (unsigned int n = 0; n < txTo.vout.size(); n++) {
-        ss << txTo.vout[n];
-    }
-    return ss.GetHash();
+int64_t GetTransactionSize(const CTransaction &tx) {
+    return tx.GetTotalSize();
 }
 
 PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
 {
-    hashPrevouts = GetPrevoutHash(txTo);
-    hashOutputs = GetOutputsHash(txTo);
+    Init(txTo);
+}
+
+void PrecomputedTransactionData::Init(const CTransaction& txTo)
+{
+    if (txTo.vin.size() > 1) {
+        sighash = std::make_shared<const PrecomputedSignatureHash>(txTo);
+    }
+    ready = true;
 }
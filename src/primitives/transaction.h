@@ -10,11 +10,15 @@
 #include "script/script.h"
 #include "serialize.h"
 #include "uint256.h"
+#include <memory>
 #include <string>
 using std::string;
 
 static const int SERIALIZE_TRANSACTION = 0x00;
 
+/** The longest content an output can have */
+static const size_t MAX_TX_OUT_CONTENT_SIZE = 1050000;
+
 /**
  * A TxId is the identifier of a transaction. Currently identical to TxHash but
  * differentiated for type safety.
@@ -127,7 +131,6 @@ public:
     CTxOut() { SetNull(); }
 
     CTxOut(const CAmount& nValueIn, CScript scriptPubKeyIn, string strContentIn="",uint32_t nLockTime=0, const CAmount& nPrincipalIn=0);
-    CTxOut(const CTxOut &txout);
 
     ADD_SERIALIZE_METHODS;
 
@@ -136,7 +139,7 @@ public:
         READWRITE(VARINT(nValue));
         READWRITE(VARINT(nPrincipal));
         READWRITE(*(CScriptBase *)(&scriptPubKey));
-        READWRITE(LIMITED_STRING(strContent,1050000));
+        READWRITE(LIMITED_STRING(strContent,MAX_TX_OUT_CONTENT_SIZE));
         READWRITE(VARINT(nLockTime));
     }
 
@@ -188,6 +191,13 @@ public:
         return !(a == b);
     }
 
+    //! Coins drop the content, so compare them with this instead of ==.
+    bool EqualsWithoutContent(const CTxOut &other) const {
+        return (nValue == other.nValue && nPrincipal == other.nPrincipal &&
+                scriptPubKey == other.scriptPubKey &&
+                nLockTime == other.nLockTime);
+    }
+
     std::string ToString() const;
 };
 
@@ -207,11 +217,6 @@ public:
         CTxOut(txout), txid(txid), n(n), height(height)
     {
     }
-
-    CTxOutVerbose(const CTxOutVerbose &txout):
-        CTxOut(txout), txid(txout.txid), n(txout.n), height(txout.height)
-    {
-    }
 };
 
 class CMutableTransaction;
@@ -236,6 +241,37 @@ inline void UnserializeTransaction(TxType &tx, Stream &s) {
     s >> tx.vout;
 }
 
+/**
+ * Read a serialized transaction up to the content of output n, skipping the
+ * content of the outputs before it. Sets nSize to the content's size, the
+ * content itself is next in the stream. Returns false if there is no output n.
+ */
+template <typename Stream>
+bool SkipToOutputContent(Stream &s, uint32_t n, uint64_t &nSize) {
+    int32_t nVersion, nFlags;
+    s >> VARINT(nVersion);
+    s >> VARINT(nFlags);
+    std::vector<CTxIn> vin;
+    s >> vin;
+    if (n >= ReadCompactSize(s)) {
+        return false;
+    }
+    for (uint32_t i = 0;; i++) {
+        CAmount nValue, nPrincipal;
+        s >> VARINT(nValue);
+        s >> VARINT(nPrincipal);
+        // scriptPubKey
+        s.ignore(ReadCompactSize(s));
+        nSize = ReadCompactSize(s);
+        if (i == n) {
+            return true;
+        }
+        s.ignore(nSize);
+        uint32_t nLockTime;
+        s >> VARINT(nLockTime);
+    }
+}
+
 template <typename Stream, typename TxType>
 inline void SerializeTransaction(const TxType &tx, Stream &s) {
     s << VARINT(tx.nVersion);
@@ -278,8 +314,22 @@ public:
 private:
     /** Memory only. */
     const uint256 hash;
+    /** Memory only, the serialized size GetTotalSize returns. */
+    const unsigned int nTotalSize;
+    /** Memory only, the legacy sigop count GetSigOpCount returns. */
+    const uint64_t nSigOpCount;
 
     uint256 ComputeHash() const;
+    unsigned int ComputeTotalSize() const;
+    uint64_t ComputeSigOpCount() const;
+
+    /**
+     * For WithoutContent and CTxSkeleton: the fields of tx with the id hashIn,
+     * the size nTotalSizeIn and the sigop count nSigOpCountIn
+     */
+    CTransaction(CMutableTransaction &&tx, const uint256 &hashIn,
+                 unsigned int nTotalSizeIn, uint64_t nSigOpCountIn);
+    friend class CTxSkeleton;
 
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
@@ -319,6 +369,17 @@ public:
 
     void ClearContent(CTransaction& newTx) const;
 
+    /** Whether any of the outputs carries content */
+    bool HasContent() const;
+
+    /**
+     * A copy without the content of the outputs that keeps the id of this
+     * transaction, for holders that read the content from where the full
+     * transaction is stored when they need it. The copy doesn't hash to its
+     * id, so it must not be serialized, relayed or validated.
+     */
+    CTransaction WithoutContent() const;
+
     // Compute priority, given priority of inputs and (optionally) tx size
     double ComputePriority(double dPriorityInputs,
                            unsigned int nTxSize = 0) const;
@@ -328,10 +389,16 @@ public:
     unsigned int CalculateModifiedSize(unsigned int nTxSize = 0) const;
 
     /**
-     * Get the total transaction size in bytes.
+     * Get the total transaction size in bytes, computed once on construction.
      * @return Total transaction size in bytes
      */
-    unsigned int GetTotalSize() const;
+    unsigned int GetTotalSize() const { return nTotalSize; }
+
+    /**
+     * The signature operations of the scripts of the transaction, counted
+     * without the P2SH redeem scripts of its inputs, once on construction.
+     */
+    uint64_t GetSigOpCount() const { return nSigOpCount; }
 
     bool IsCoinBase() const {
         return nFlags&TX_FLAGS_COINBASE;
@@ -401,18 +468,24 @@ static inline CTransactionRef MakeTransactionRef(Tx &&txIn) {
 /** Compute the size of a transaction */
 int64_t GetTransactionSize(const CTransaction &tx);
 
+class PrecomputedSignatureHash;
+
 /** Precompute sighash midstate to avoid quadratic hashing */
 struct PrecomputedTransactionData {
-    uint256 hashPrevouts, hashOutputs;
+    //! Shared by the script checks of the inputs, null for a single input,
+    //! whose signature hash is computed only once anyway
+    std::shared_ptr<const PrecomputedSignatureHash> sighash;
+    //! Whether the hashes have been computed, see Init
+    bool ready;
 
-    PrecomputedTransactionData()
-        : hashPrevouts(), hashOutputs() {}
+    PrecomputedTransactionData() : ready(false) {}
 
     PrecomputedTransactionData(const PrecomputedTransactionData &txdata)
-        : hashPrevouts(txdata.hashPrevouts),
-          hashOutputs(txdata.hashOutputs) {}
+        : sighash(txdata.sighash), ready(txdata.ready) {}
 
     PrecomputedTransactionData(const CTransaction &tx);
+
+    void Init(const CTransaction &tx);
 };
 
 #endif // BITCOIN_PRIMITIVES_TRANSACTION_H
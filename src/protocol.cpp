@@ -39,6 +39,20 @@ const char *SENDCMPCT = "sendcmpct";
 const char *CMPCTBLOCK = "cmpctblock";
 const char *GETBLOCKTXN = "getblocktxn";
 const char *BLOCKTXN = "blocktxn";
+const char *SENDRECON = "sendrecon";
+const char *REQRECON = "reqrecon";
+const char *SKETCH = "sketch";
+const char *RECONCILDIFF = "reconcildiff";
+const char *GETCFILTERS = "getcfilters";
+const char *CFILTER = "cfilter";
+const char *GETCFHEADERS = "getcfheaders";
+const char *CFHEADERS = "cfheaders";
+const char *GETCFCHECKPT = "getcfcheckpt";
+const char *CFCHECKPT = "cfcheckpt";
+const char *SENDTXSKEL = "sendtxskel";
+const char *TXSKEL = "txskel";
+const char *GETCONTENT = "getcontent";
+const char *CONTENT = "content";
 };
 
 /**
@@ -54,7 +68,12 @@ static const std::string allNetMessageTypes[] = {
     NetMsgType::NOTFOUND,    NetMsgType::FILTERLOAD, NetMsgType::FILTERADD,
     NetMsgType::FILTERCLEAR, NetMsgType::REJECT,     NetMsgType::SENDHEADERS,
     NetMsgType::FEEFILTER,   NetMsgType::SENDCMPCT,  NetMsgType::CMPCTBLOCK,
-    NetMsgType::GETBLOCKTXN, NetMsgType::BLOCKTXN,
+    NetMsgType::GETBLOCKTXN, NetMsgType::BLOCKTXN,   NetMsgType::SENDRECON,
+    NetMsgType::REQRECON,    NetMsgType::SKETCH,     NetMsgType::RECONCILDIFF,
+    NetMsgType::GETCFILTERS, NetMsgType::CFILTER,    NetMsgType::GETCFHEADERS,
+    NetMsgType::CFHEADERS,   NetMsgType::GETCFCHECKPT, NetMsgType::CFCHECKPT,
+    NetMsgType::SENDTXSKEL,  NetMsgType::TXSKEL,     NetMsgType::GETCONTENT,
+    NetMsgType::CONTENT,
 };
 static const std::vector<std::string>
     allNetMessageTypesVec(allNetMessageTypes,
@@ -242,6 +242,80 @@ extern const char *GETBLOCKTXN;
  * @since protocol version 70014 as described by BIP 152
  */
 extern const char *BLOCKTXN;
+/**
+ * Contains a 4-byte version and an 8-byte salt. Offers to announce
+ * transactions through set reconciliation instead of inv flooding, which is
+ * used once both sides have sent it with the same version.
+ */
+extern const char *SENDRECON;
+/**
+ * Contains the 4-byte size of the sender's reconciliation set. Asks the
+ * receiving peer, which must have accepted the connection, for a "sketch" of
+ * its own set.
+ */
+extern const char *REQRECON;
+/**
+ * Contains a CReconSketch of the sender's reconciliation set, in response to
+ * a "reqrecon" message.
+ */
+extern const char *SKETCH;
+/**
+ * Contains a 1-byte success flag and the short ids the sender wants announced,
+ * in response to a "sketch" message. On failure the peer announces its whole
+ * set instead.
+ */
+extern const char *RECONCILDIFF;
+/**
+ * Contains a 1-byte filter type, a 4-byte start height and a stop hash. Asks
+ * for the filters of the blocks from the start height up to the stop block,
+ * which come in "cfilter" messages.
+ * @since BIP 157, only with service bit NODE_COMPACT_FILTERS
+ */
+extern const char *GETCFILTERS;
+/**
+ * Contains a filter type, a block hash and the filter of the block.
+ */
+extern const char *CFILTER;
+/**
+ * Like "getcfilters", asks for the filter headers instead.
+ */
+extern const char *GETCFHEADERS;
+/**
+ * Contains a filter type, the stop hash, the filter header before the start
+ * height and the hashes of the filters.
+ */
+extern const char *CFHEADERS;
+/**
+ * Contains a filter type and a stop hash. Asks for the filter headers at each
+ * 1000th height up to the stop block.
+ */
+extern const char *GETCFCHECKPT;
+/**
+ * Contains a filter type, the stop hash and the filter headers.
+ */
+extern const char *CFCHECKPT;
+/**
+ * Contains a 4-byte version. Offers to answer "getdata" for transactions with
+ * much content with a "txskel" message, which is done once both sides have
+ * sent it with the same version.
+ */
+extern const char *SENDTXSKEL;
+/**
+ * Contains a CTxSkeleton, a transaction without the content of its outputs,
+ * in response to a "getdata" message.
+ */
+extern const char *TXSKEL;
+/**
+ * Contains a txid, a 4-byte output index and a 4-byte offset. Asks for the
+ * chunk of content of the output at the offset, which comes in a "content"
+ * message, or a "notfound" for the transaction.
+ */
+extern const char *GETCONTENT;
+/**
+ * Contains a txid, a 4-byte output index, a 4-byte offset and the chunk of
+ * content there, in response to a "getcontent" message.
+ */
+extern const char *CONTENT;
 };
 
 /* Get a vector of all valid message types (see above) */
@@ -277,6 +351,9 @@ enum ServiceFlags : uint64_t {
     // TODO: remove (free up) the NODE_BITCOIN_CASH service bit once no longer
     // needed.
     NODE_BITCOIN_CASH = (1 << 5),
+    // NODE_COMPACT_FILTERS means the node serves the basic block filters of
+    // BIP 157 and 158.
+    NODE_COMPACT_FILTERS = (1 << 6),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
@@ -0,0 +1,122 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "replaystats.h"
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "tinyformat.h"
+#include "util.h"
+#include "validation.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <mutex>
+
+std::atomic<bool> fReplayStats(false);
+
+namespace {
+
+const int REPLAY_PHASES = static_cast<int>(ReplayPhase::COUNT);
+
+//! Keys of the phase times in the JSON lines, in ReplayPhase order
+const char *const REPLAY_PHASE_NAMES[REPLAY_PHASES] = {
+    "deserialize_us",   "checkblock_us", "pow_us",
+    "inputfetch_us",    "scripts_us",    "interest_us",
+    "updatecoins_us",   "flush_us",      "undowrite_us",
+};
+
+std::atomic<int64_t> vPhaseMicros[REPLAY_PHASES];
+
+std::mutex csReplayStats;
+FILE *fileReplayStats = nullptr;
+int nReplayInterval = DEFAULT_REPLAY_STATS_INTERVAL;
+
+//! Since the last line was written
+int nBlocks = 0;
+uint64_t nTransactions = 0;
+uint64_t nInputs = 0;
+int64_t nLineStart = 0;
+int nLastHeight = -1;
+
+void WriteLine() {
+    int64_t nNow = GetTimeMicros();
+    std::string strLine = strprintf(
+        "{\"height\":%d,\"blocks\":%d,\"txs\":%u,\"inputs\":%u,"
+        "\"elapsed_us\":%d",
+        nLastHeight, nBlocks, nTransactions, nInputs, nNow - nLineStart);
+    // Each line has the phase times of its blocks only.
+    for (int i = 0; i < REPLAY_PHASES; i++) {
+        strLine += strprintf(",\"%s\":%d", REPLAY_PHASE_NAMES[i],
+                             vPhaseMicros[i].exchange(0));
+    }
+    size_t nCacheUsage = pcoinsTip ? pcoinsTip->DynamicMemoryUsage() : 0;
+    strLine += strprintf(",\"coinscache_bytes\":%u}\n", nCacheUsage);
+    fwrite(strLine.data(), 1, strLine.size(), fileReplayStats);
+    fflush(fileReplayStats);
+
+    nBlocks = 0;
+    nTransactions = 0;
+    nInputs = 0;
+    nLineStart = nNow;
+}
+
+} // namespace
+
+void RecordReplayPhase(ReplayPhase phase, int64_t nMicros) {
+    vPhaseMicros[static_cast<int>(phase)].fetch_add(nMicros,
+                                                    std::memory_order_relaxed);
+}
+
+bool StartReplayStats(const std::string &strFile, int nInterval) {
+    std::lock_guard<std::mutex> lock(csReplayStats);
+    assert(!fileReplayStats);
+    fileReplayStats = fopen(strFile.c_str(), "a");
+    if (!fileReplayStats) {
+        return false;
+    }
+    nReplayInterval = std::max(nInterval, 1);
+    for (std::atomic<int64_t> &nMicros : vPhaseMicros) {
+        nMicros = 0;
+    }
+    nLineStart = GetTimeMicros();
+    fReplayStats = true;
+    LogPrintf("Writing validation phase times every %d blocks to %s\n",
+              nReplayInterval, strFile);
+    return true;
+}
+
+void ReplayStatsBlockConnected(const CBlock &block, const CBlockIndex *pindex) {
+    if (!fReplayStats.load(std::memory_order_relaxed)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(csReplayStats);
+    if (!fileReplayStats) {
+        return;
+    }
+    nBlocks++;
+    nTransactions += block.vtx.size();
+    for (const auto &tx : block.vtx) {
+        nInputs += tx->vin.size();
+    }
+    nLastHeight = pindex->nHeight;
+    if (nBlocks >= nReplayInterval) {
+        WriteLine();
+    }
+}
+
+void StopReplayStats() {
+    std::lock_guard<std::mutex> lock(csReplayStats);
+    if (!fileReplayStats) {
+        return;
+    }
+    fReplayStats = false;
+    // The final flush at shutdown goes with the last blocks.
+    if (nBlocks > 0 || vPhaseMicros[static_cast<int>(ReplayPhase::FLUSH)]) {
+        WriteLine();
+    }
+    fclose(fileReplayStats);
+    fileReplayStats = nullptr;
+}
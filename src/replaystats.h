@@ -0,0 +1,80 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_REPLAYSTATS_H
+#define BITCOIN_REPLAYSTATS_H
+
+#include "utiltime.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+class CBlock;
+class CBlockIndex;
+
+static const int DEFAULT_REPLAY_STATS_INTERVAL = 1000;
+
+/** The phases of block validation that -replaystats times */
+enum class ReplayPhase {
+    //! Reading and deserializing blocks from block files
+    DESERIALIZE,
+    //! CheckBlock, without the proof of work
+    CHECK_BLOCK,
+    //! Checking the proof of work of headers
+    POW,
+    //! Loading the spent coins into the coins cache
+    INPUT_FETCH,
+    //! Queueing script checks and waiting for the checker threads
+    SCRIPT_CHECKS,
+    //! Computing the interest of deposits
+    INTEREST,
+    UPDATE_COINS,
+    //! FlushStateToDisk, whether or not it wrote anything
+    FLUSH,
+    //! Serializing and writing undo data
+    UNDO_WRITE,
+    COUNT,
+};
+
+/**
+ * Whether the validation phases are timed, -replaystats. Costs two clock
+ * reads per timed section.
+ */
+extern std::atomic<bool> fReplayStats;
+
+void RecordReplayPhase(ReplayPhase phase, int64_t nMicros);
+
+/** Adds the time until it goes out of scope to a phase, with fReplayStats */
+class CReplayTimer {
+private:
+    ReplayPhase phase;
+    int64_t nStart;
+
+public:
+    explicit CReplayTimer(ReplayPhase phaseIn)
+        : phase(phaseIn),
+          nStart(fReplayStats.load(std::memory_order_relaxed) ? GetTimeMicros()
+                                                              : 0) {}
+    ~CReplayTimer() {
+        if (nStart != 0) {
+            RecordReplayPhase(phase, GetTimeMicros() - nStart);
+        }
+    }
+
+    CReplayTimer(const CReplayTimer &) = delete;
+    CReplayTimer &operator=(const CReplayTimer &) = delete;
+};
+
+/**
+ * Start timing the validation phases, writing a JSON line of the times to
+ * strFile every nInterval blocks connected.
+ */
+bool StartReplayStats(const std::string &strFile, int nInterval);
+/** Count a block connected to the tip, cs_main held */
+void ReplayStatsBlockConnected(const CBlock &block, const CBlockIndex *pindex);
+/** Write the blocks connected since the last line, and close the file */
+void StopReplayStats();
+
+#endif // BITCOIN_REPLAYSTATS_H
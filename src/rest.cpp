@@ -10,21 +10,30 @@
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "rpc/blockchain.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "rpc/tojson.h"
 #include "streams.h"
 #include "sync.h"
 #include "txmempool.h"
+#include "util.h"
 #include "utilstrencodings.h"
 #include "validation.h"
 #include "version.h"
 
+#include <limits>
+
 #include <boost/algorithm/string.hpp>
 
 #include <univalue.h>
 
 // Allow a max of 15 outpoints to be queried at once.
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15;
+// Most blocks and coins the range endpoints send in one reply.
+static const int MAX_REST_BLOCKS_RANGE = 10000;
+static const int MAX_REST_UTXOS_RANGE = 1000000;
+// Bytes the range endpoints collect before they send a chunk.
+static const size_t REST_RANGE_CHUNK_SIZE = 64 * 1024;
 
 enum RetFormat {
     RF_UNDEF,
@@ -60,6 +69,7 @@ struct CCoin {
 
 extern UniValue mempoolInfoToJSON();
 extern UniValue mempoolToJSON(bool fVerbose = false);
+extern void mempoolToJSON(bool fVerbose, CJSONStreamWriter &stream);
 
 static bool RESTERR(HTTPRequest *req, enum HTTPStatusCode status,
                     std::string message) {
@@ -68,6 +78,40 @@ static bool RESTERR(HTTPRequest *req, enum HTTPStatusCode status,
     return false;
 }
 
+/**
+ * Send a JSON reply in chunks, as write produces it, for replies too big to
+ * build in memory first.
+ */
+static bool RESTStreamJSON(
+    HTTPRequest *req, const std::function<void(CJSONStreamWriter &)> &write) {
+    req->WriteHeader("Content-Type", "application/json");
+    req->StartChunkedReply(HTTP_OK);
+    CJSONStreamWriter stream([req](const std::string &strChunk) {
+        return req->WriteReplyChunk(strChunk);
+    });
+    write(stream);
+    if (stream.Flush()) {
+        req->WriteReplyChunk("\n");
+    }
+    req->EndChunkedReply();
+    return true;
+}
+
+/**
+ * Send strChunk once it is REST_RANGE_CHUNK_SIZE long, or with fFlush
+ * whatever it has. Returns false once the client is gone.
+ */
+static bool RESTWriteRangeChunk(HTTPRequest *req, std::string &strChunk,
+                                bool fFlush = false) {
+    if (strChunk.empty() ||
+        (!fFlush && strChunk.size() < REST_RANGE_CHUNK_SIZE)) {
+        return true;
+    }
+    const bool fWritten = req->WriteReplyChunk(strChunk);
+    strChunk.clear();
+    return fWritten;
+}
+
 static enum RetFormat ParseDataFormat(std::string &param,
                                       const std::string &strReq) {
     const std::string::size_type pos = strReq.rfind('.');
@@ -266,12 +310,9 @@ static bool rest_block(const Config &config, HTTPRequest *req,
         }
 
         case RF_JSON: {
-            UniValue objBlock =
-                blockToJSON(config, block, pblockindex, showTxDetails);
-            std::string strJSON = objBlock.write() + "\n";
-            req->WriteHeader("Content-Type", "application/json");
-            req->WriteReply(HTTP_OK, strJSON);
-            return true;
+            return RESTStreamJSON(req, [&](CJSONStreamWriter &stream) {
+                blockToJSON(config, block, pblockindex, showTxDetails, stream);
+            });
         }
 
         default: {
@@ -296,6 +337,83 @@ static bool rest_block_notxdetails(Config &config, HTTPRequest *req,
     return rest_block(config, req, strURIPart, false);
 }
 
+static bool rest_blocks(Config &config, HTTPRequest *req,
+                        const std::string &strURIPart) {
+    if (!CheckWarmup(req)) {
+        return false;
+    }
+
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 2) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected "
+                                              "/rest/blocks/<start>/"
+                                              "<count>.bin.");
+    }
+    int32_t nStart;
+    if (!ParseInt32(path[0], &nStart) || nStart < 0) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + path[0]);
+    }
+    int32_t nCount;
+    if (!ParseInt32(path[1], &nCount) || nCount < 1 ||
+        nCount > MAX_REST_BLOCKS_RANGE) {
+        return RESTERR(req, HTTP_BAD_REQUEST,
+                       "Block count out of range: " + path[1]);
+    }
+    if (rf != RF_BINARY) {
+        return RESTERR(req, HTTP_NOT_FOUND,
+                       "output format not found (available: .bin)");
+    }
+
+    // Up to the tip. The blocks are read without cs_main, by position.
+    std::vector<CDiskBlockPos> vPos;
+    {
+        LOCK(cs_main);
+        if (nStart > chainActive.Height()) {
+            return RESTERR(req, HTTP_NOT_FOUND,
+                           "Block height out of range: " + path[0]);
+        }
+        const int nEnd = std::min(chainActive.Height() + 1, nStart + nCount);
+        vPos.reserve(nEnd - nStart);
+        for (int nHeight = nStart; nHeight < nEnd; nHeight++) {
+            const CBlockIndex *pindex = chainActive[nHeight];
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA)) {
+                return RESTERR(req, HTTP_NOT_FOUND,
+                               strprintf("Block %d not available (pruned "
+                                         "data)",
+                                         nHeight));
+            }
+            vPos.push_back(pindex->GetBlockPos());
+        }
+    }
+
+    // The blocks as stored, one after the other, without deserializing them.
+    req->WriteHeader("Content-Type", "application/octet-stream");
+    req->StartChunkedReply(HTTP_OK);
+    std::string strChunk;
+    std::vector<uint8_t> vBlock;
+    for (const CDiskBlockPos &pos : vPos) {
+        if (!ReadRawBlockFromDisk(vBlock, pos,
+                                  config.GetChainParams().DiskMagic())) {
+            // Pruned meanwhile. The status went out already, the reply can
+            // only be cut short.
+            LogPrintf("%s: failed to read block at %s, reply cut short\n",
+                      __func__, pos.ToString());
+            break;
+        }
+        strChunk.append(vBlock.begin(), vBlock.end());
+        if (!RESTWriteRangeChunk(req, strChunk)) {
+            break;
+        }
+    }
+    RESTWriteRangeChunk(req, strChunk, true);
+    req->EndChunkedReply();
+    return true;
+}
+
 static bool rest_chaininfo(Config &config, HTTPRequest *req,
                            const std::string &strURIPart) {
     if (!CheckWarmup(req)) {
@@ -366,12 +484,9 @@ static bool rest_mempool_contents(Config &config, HTTPRequest *req,
 
     switch (rf) {
         case RF_JSON: {
-            UniValue mempoolObject = mempoolToJSON(true);
-
-            std::string strJSON = mempoolObject.write() + "\n";
-            req->WriteHeader("Content-Type", "application/json");
-            req->WriteReply(HTTP_OK, strJSON);
-            return true;
+            return RESTStreamJSON(req, [](CJSONStreamWriter &stream) {
+                mempoolToJSON(true, stream);
+            });
         }
         default: {
             return RESTERR(req, HTTP_NOT_FOUND,
@@ -443,6 +558,105 @@ static bool rest_tx(Config &config, HTTPRequest *req,
     return true;
 }
 
+/**
+ * Parse a Range header of the form "bytes=first-" or "bytes=first-last". Other
+ * forms are treated as no range, so the whole content is sent.
+ */
+static bool ParseByteRange(const std::string &strRange, uint64_t &nOffset,
+                           uint64_t &nLength) {
+    const std::string strPrefix = "bytes=";
+    if (strRange.compare(0, strPrefix.size(), strPrefix) != 0) {
+        return false;
+    }
+
+    const std::string strSpec = strRange.substr(strPrefix.size());
+    const std::string::size_type pos = strSpec.find('-');
+    if (pos == std::string::npos || pos == 0 ||
+        strSpec.find(',') != std::string::npos) {
+        return false;
+    }
+    if (!ParseUInt64(strSpec.substr(0, pos), &nOffset)) {
+        return false;
+    }
+    nLength = std::numeric_limits<uint64_t>::max();
+    if (pos + 1 < strSpec.size()) {
+        uint64_t nLast;
+        if (!ParseUInt64(strSpec.substr(pos + 1), &nLast) || nLast < nOffset ||
+            nLast == std::numeric_limits<uint64_t>::max()) {
+            return false;
+        }
+        nLength = nLast - nOffset + 1;
+    }
+    return true;
+}
+
+static bool rest_content(Config &config, HTTPRequest *req,
+                         const std::string &strURIPart) {
+    if (!CheckWarmup(req)) {
+        return false;
+    }
+
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 2) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected "
+                                              "/rest/content/<txid>/<n>.");
+    }
+
+    uint256 hash;
+    if (!ParseHashStr(path[0], hash)) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + path[0]);
+    }
+    uint32_t n;
+    if (!ParseUInt32(path[1], &n)) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid output: " + path[1]);
+    }
+    if (rf != RF_UNDEF && rf != RF_BINARY && rf != RF_HEX) {
+        return RESTERR(req, HTTP_NOT_FOUND,
+                       "output format not found (available: .bin, .hex)");
+    }
+
+    uint64_t nOffset = 0;
+    uint64_t nLength = std::numeric_limits<uint64_t>::max();
+    std::pair<bool, std::string> range = req->GetHeader("Range");
+    const bool fRange =
+        range.first && ParseByteRange(range.second, nOffset, nLength);
+
+    std::string strData;
+    uint64_t nSize;
+    if (!ReadOutputContent(config, COutPoint(hash, n), nOffset, nLength,
+                           strData, nSize)) {
+        return RESTERR(req, HTTP_NOT_FOUND,
+                       path[0] + "/" + path[1] + " not found");
+    }
+
+    int nStatus = HTTP_OK;
+    if (fRange) {
+        if (nOffset >= nSize) {
+            req->WriteHeader("Content-Range", strprintf("bytes */%u", nSize));
+            return RESTERR(req, HTTP_RANGE_NOT_SATISFIABLE,
+                           "Range not satisfiable");
+        }
+        nStatus = HTTP_PARTIAL_CONTENT;
+        req->WriteHeader("Content-Range",
+                         strprintf("bytes %u-%u/%u", nOffset,
+                                   nOffset + strData.size() - 1, nSize));
+    }
+    req->WriteHeader("Accept-Ranges", "bytes");
+
+    if (rf == RF_HEX) {
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(nStatus, HexStr(strData.begin(), strData.end()) + "\n");
+    } else {
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(nStatus, strData);
+    }
+    return true;
+}
+
 static bool rest_getutxos(Config &config, HTTPRequest *req,
                           const std::string &strURIPart) {
     if (!CheckWarmup(req)) {
@@ -665,19 +879,114 @@ static bool rest_getutxos(Config &config, HTTPRequest *req,
     return true;
 }
 
+static bool rest_utxos_range(Config &config, HTTPRequest *req,
+                             const std::string &strURIPart) {
+    if (!CheckWarmup(req)) {
+        return false;
+    }
+
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 1 && path.size() != 3) {
+        return RESTERR(req, HTTP_BAD_REQUEST,
+                       "Invalid URI format. Expected "
+                       "/rest/utxos/range/<count>[/<txid>/<n>].bin.");
+    }
+    int32_t nCount;
+    if (!ParseInt32(path[0], &nCount) || nCount < 1 ||
+        nCount > MAX_REST_UTXOS_RANGE) {
+        return RESTERR(req, HTTP_BAD_REQUEST,
+                       "Coin count out of range: " + path[0]);
+    }
+    COutPoint after;
+    const bool fAfter = path.size() == 3;
+    if (fAfter) {
+        uint256 txid;
+        uint32_t n;
+        if (!ParseHashStr(path[1], txid)) {
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + path[1]);
+        }
+        if (!ParseUInt32(path[2], &n)) {
+            return RESTERR(req, HTTP_BAD_REQUEST,
+                           "Invalid output: " + path[2]);
+        }
+        after = COutPoint(txid, n);
+    }
+    if (rf != RF_BINARY) {
+        return RESTERR(req, HTTP_NOT_FOUND,
+                       "output format not found (available: .bin)");
+    }
+
+    // The coins as of the last flush of the coins database, which the
+    // cursor's best block tells.
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    int32_t nHeight = -1;
+    {
+        LOCK(cs_main);
+        pcursor.reset(pcoinsTip->Cursor());
+        BlockMap::const_iterator it =
+            mapBlockIndex.find(pcursor->GetBestBlock());
+        if (it != mapBlockIndex.end()) {
+            nHeight = it->second->nHeight;
+        }
+    }
+    if (fAfter) {
+        COutPoint key;
+        if (!pcursor->Seek(after)) {
+            return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR,
+                           "Coins can't be looked up by outpoint");
+        }
+        if (pcursor->Valid() && pcursor->GetKey(key) && key == after) {
+            pcursor->Next();
+        }
+    }
+
+    // Like getutxos: the height and hash of the block the coins are at, then
+    // each coin after its outpoint, in the order of the database. A reply
+    // with fewer than <count> coins is the last one.
+    req->WriteHeader("Content-Type", "application/octet-stream");
+    req->StartChunkedReply(HTTP_OK);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << nHeight << pcursor->GetBestBlock();
+    std::string strChunk = ss.str();
+    for (int i = 0; i < nCount && pcursor->Valid(); i++, pcursor->Next()) {
+        COutPoint key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || !pcursor->GetValue(coin)) {
+            LogPrintf("%s: unable to read coin, reply cut short\n", __func__);
+            break;
+        }
+        ss.clear();
+        ss << key << CCoin(std::move(coin));
+        strChunk.append(ss.begin(), ss.end());
+        if (!RESTWriteRangeChunk(req, strChunk)) {
+            break;
+        }
+    }
+    RESTWriteRangeChunk(req, strChunk, true);
+    req->EndChunkedReply();
+    return true;
+}
+
 static const struct {
     const char *prefix;
     bool (*handler)(Config &config, HTTPRequest *req,
                     const std::string &strReq);
 } uri_prefixes[] = {
     {"/rest/tx/", rest_tx},
+    {"/rest/content/", rest_content},
     {"/rest/block/notxdetails/", rest_block_notxdetails},
     {"/rest/block/", rest_block_extended},
+    {"/rest/blocks/", rest_blocks},
     {"/rest/chaininfo", rest_chaininfo},
     {"/rest/mempool/info", rest_mempool_info},
     {"/rest/mempool/contents", rest_mempool_contents},
     {"/rest/headers/", rest_headers},
     {"/rest/getutxos", rest_getutxos},
+    {"/rest/utxos/range/", rest_utxos_range},
 };
 
 bool StartREST() {
@@ -5,25 +5,35 @@
 
 #include "rpc/blockchain.h"
 
+#include "addressindex.h"
 #include "amount.h"
+#include "blockstats.h"
+#include "blockstatsindex.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
+#include "clientversion.h"
 #include "coins.h"
 #include "config.h"
 #include "consensus/validation.h"
+#include "dstencode.h"
+#include "ethashproof.h"
 #include "hash.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "rpc/tojson.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "utxosnapshot.h"
 #include "validation.h"
 
+#include <boost/filesystem.hpp>
 #include <boost/thread/thread.hpp> // boost::thread::interrupt
 
 #include <condition_variable>
@@ -67,12 +77,13 @@ double GetDifficulty(const CBlockIndex *blockindex) {
 }
 
 UniValue blockheaderToJSON(const CBlockIndex *blockindex) {
+    const std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex)) {
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
+    if (chain->Contains(blockindex)) {
+        confirmations = chain->Height() - blockindex->nHeight + 1;
     }
     result.push_back(Pair("confirmations", confirmations));
     result.push_back(Pair("height", blockindex->nHeight));
@@ -94,61 +105,102 @@ UniValue blockheaderToJSON(const CBlockIndex *blockindex) {
         result.push_back(Pair("previousblockhash",
                               blockindex->pprev->GetBlockHash().GetHex()));
     }
-    CBlockIndex *pnext = chainActive.Next(blockindex);
+    const CBlockIndex *pnext = chain->Next(blockindex);
     if (pnext) {
         result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
     }
     return result;
 }
 
-UniValue blockToJSON(const Config &config, const CBlock &block,
-                     const CBlockIndex *blockindex, bool txDetails) {
-    UniValue result(UniValue::VOBJ);
-    result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
+/**
+ * The fields of blockToJSON, but for the transactions. They go in front of and
+ * after "tx".
+ */
+static void blockFieldsToJSON(const CBlock &block,
+                              const CBlockIndex *blockindex, UniValue &head,
+                              UniValue &tail) {
+    const std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
+    head.setObject();
+    head.reserve(9);
+    head.pushKVEnd("hash", blockindex->GetBlockHash().GetHex());
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex)) {
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
-    }
-    result.push_back(Pair("confirmations", confirmations));
-    result.push_back(Pair(
-        "size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
-    result.push_back(Pair("height", blockindex->nHeight));
-    result.push_back(Pair("version", block.nVersion));
-    result.push_back(Pair("versionHex", strprintf("%08x", block.nVersion)));
-    result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
-    result.push_back(Pair("chaininterest", block.nChainInterest));
-    UniValue txs(UniValue::VARR);
-    for (const auto &tx : block.vtx) {
-        if (txDetails) {
-            UniValue objTx(UniValue::VOBJ);
-            TxToJSON(config, *tx, uint256(), objTx);
-            txs.push_back(objTx);
-        } else {
-            txs.push_back(tx->GetId().GetHex());
-        }
-    }
-    result.push_back(Pair("tx", txs));
-    result.push_back(Pair("time", block.GetBlockTime()));
-    result.push_back(
-        Pair("mediantime", int64_t(blockindex->GetMedianTimePast())));
-    result.push_back(Pair("nonce", uint64_t(block.nNonce)));
-    result.push_back(Pair("mixhash", ethash_h256_encode(block.hashMix)));
-    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+    if (chain->Contains(blockindex)) {
+        confirmations = chain->Height() - blockindex->nHeight + 1;
+    }
+    head.pushKVEnd("confirmations", confirmations);
+    head.pushKVEnd(
+        "size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    head.pushKVEnd("height", blockindex->nHeight);
+    head.pushKVEnd("version", block.nVersion);
+    head.pushKVEnd("versionHex", strprintf("%08x", block.nVersion));
+    head.pushKVEnd("merkleroot", block.hashMerkleRoot.GetHex());
+    head.pushKVEnd("chaininterest", block.nChainInterest);
+
+    tail.setObject();
+    tail.reserve(9);
+    tail.pushKVEnd("time", block.GetBlockTime());
+    tail.pushKVEnd("mediantime", int64_t(blockindex->GetMedianTimePast()));
+    tail.pushKVEnd("nonce", uint64_t(block.nNonce));
+    tail.pushKVEnd("mixhash", ethash_h256_encode(block.hashMix));
+    tail.pushKVEnd("bits", strprintf("%08x", block.nBits));
+    tail.pushKVEnd("difficulty", GetDifficulty(blockindex));
+    tail.pushKVEnd("chainwork", blockindex->nChainWork.GetHex());
 
     if (blockindex->pprev) {
-        result.push_back(Pair("previousblockhash",
-                              blockindex->pprev->GetBlockHash().GetHex()));
+        tail.pushKVEnd("previousblockhash",
+                       blockindex->pprev->GetBlockHash().GetHex());
     }
-    CBlockIndex *pnext = chainActive.Next(blockindex);
+    const CBlockIndex *pnext = chain->Next(blockindex);
     if (pnext) {
-        result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+        tail.pushKVEnd("nextblockhash", pnext->GetBlockHash().GetHex());
     }
+}
+
+static UniValue blockTxToJSON(const Config &config, const CTransaction &tx,
+                              bool txDetails) {
+    if (!txDetails) {
+        return tx.GetId().GetHex();
+    }
+    UniValue objTx(UniValue::VOBJ);
+    TxToJSON(config, tx, uint256(), objTx);
+    return objTx;
+}
+
+UniValue blockToJSON(const Config &config, const CBlock &block,
+                     const CBlockIndex *blockindex, bool txDetails) {
+    UniValue result, tail;
+    blockFieldsToJSON(block, blockindex, result, tail);
+    UniValue txs(UniValue::VARR);
+    txs.reserve(block.vtx.size());
+    for (const auto &tx : block.vtx) {
+        txs.push_back(blockTxToJSON(config, *tx, txDetails));
+    }
+    result.pushKVEnd("tx", std::move(txs));
+    result.pushKVs(tail);
     return result;
 }
 
+void blockToJSON(const Config &config, const CBlock &block,
+                 const CBlockIndex *blockindex, bool txDetails,
+                 CJSONStreamWriter &stream) {
+    UniValue head, tail;
+    blockFieldsToJSON(block, blockindex, head, tail);
+    stream.BeginObject();
+    stream.Entries(head);
+    stream.Key("tx");
+    stream.BeginArray();
+    for (const auto &tx : block.vtx) {
+        if (stream.Failed()) {
+            break;
+        }
+        stream.Value(blockTxToJSON(config, *tx, txDetails));
+    }
+    stream.EndArray();
+    stream.Entries(tail);
+    stream.EndObject();
+}
+
 UniValue getblockcount(const Config &config, const JSONRPCRequest &request) {
     if (request.fHelp || request.params.size() != 0) {
         throw std::runtime_error(
@@ -161,8 +213,7 @@ UniValue getblockcount(const Config &config, const JSONRPCRequest &request) {
             HelpExampleRpc("getblockcount", ""));
     }
 
-    LOCK(cs_main);
-    return chainActive.Height();
+    return GetChainSnapshot()->Height();
 }
 
 UniValue getbestblockhash(const Config &config, const JSONRPCRequest &request) {
@@ -178,8 +229,7 @@ UniValue getbestblockhash(const Config &config, const JSONRPCRequest &request) {
             HelpExampleRpc("getbestblockhash", ""));
     }
 
-    LOCK(cs_main);
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    return GetChainSnapshot()->Tip()->GetBlockHash().GetHex();
 }
 
 void RPCNotifyBlockChange(bool ibd, const CBlockIndex *pindex) {
@@ -404,22 +454,20 @@ std::string EntryDescriptionString() {
 void entryToJSON(UniValue &info, const CTxMemPoolEntry &e) {
     AssertLockHeld(mempool.cs);
 
-    info.push_back(Pair("size", (int)e.GetTxSize()));
-    info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-    info.push_back(Pair("modifiedfee", ValueFromAmount(e.GetModifiedFee())));
-    info.push_back(Pair("time", e.GetTime()));
-    info.push_back(Pair("height", (int)e.GetHeight()));
-    info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-    info.push_back(
-        Pair("currentpriority", e.GetPriority(chainActive.Height())));
-    info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
-    info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
-    info.push_back(
-        Pair("descendantfees", e.GetModFeesWithDescendants()));
-    info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
-    info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
-    info.push_back(
-        Pair("ancestorfees", e.GetModFeesWithAncestors()));
+    info.reserve(14);
+    info.pushKVEnd("size", (int)e.GetTxSize());
+    info.pushKVEnd("fee", ValueFromAmount(e.GetFee()));
+    info.pushKVEnd("modifiedfee", ValueFromAmount(e.GetModifiedFee()));
+    info.pushKVEnd("time", e.GetTime());
+    info.pushKVEnd("height", (int)e.GetHeight());
+    info.pushKVEnd("startingpriority", e.GetPriority(e.GetHeight()));
+    info.pushKVEnd("currentpriority", e.GetPriority(chainActive.Height()));
+    info.pushKVEnd("descendantcount", e.GetCountWithDescendants());
+    info.pushKVEnd("descendantsize", e.GetSizeWithDescendants());
+    info.pushKVEnd("descendantfees", e.GetModFeesWithDescendants());
+    info.pushKVEnd("ancestorcount", e.GetCountWithAncestors());
+    info.pushKVEnd("ancestorsize", e.GetSizeWithAncestors());
+    info.pushKVEnd("ancestorfees", e.GetModFeesWithAncestors());
     const CTransaction &tx = e.GetTx();
     std::set<std::string> setDepends;
     for (const CTxIn &txin : tx.vin) {
@@ -429,22 +477,25 @@ void entryToJSON(UniValue &info, const CTxMemPoolEntry &e) {
     }
 
     UniValue depends(UniValue::VARR);
+    depends.reserve(setDepends.size());
     for (const std::string &dep : setDepends) {
         depends.push_back(dep);
     }
 
-    info.push_back(Pair("depends", depends));
+    info.pushKVEnd("depends", std::move(depends));
 }
 
 UniValue mempoolToJSON(bool fVerbose = false) {
     if (fVerbose) {
         LOCK(mempool.cs);
         UniValue o(UniValue::VOBJ);
+        o.reserve(mempool.mapTx.size());
         for (const CTxMemPoolEntry &e : mempool.mapTx) {
             const uint256 &txid = e.GetTx().GetId();
             UniValue info(UniValue::VOBJ);
             entryToJSON(info, e);
-            o.push_back(Pair(txid.ToString(), info));
+            // Each txid is there once, no need to look for it in o.
+            o.pushKVEnd(txid.ToString(), std::move(info));
         }
         return o;
     } else {
@@ -452,6 +503,7 @@ UniValue mempoolToJSON(bool fVerbose = false) {
         mempool.queryHashes(vtxids);
 
         UniValue a(UniValue::VARR);
+        a.reserve(vtxids.size());
         for (const uint256 &txid : vtxids) {
             a.push_back(txid.ToString());
         }
@@ -460,15 +512,61 @@ UniValue mempoolToJSON(bool fVerbose = false) {
     }
 }
 
+/** Entries mempoolToJSON looks up at a time when it writes to a stream */
+static const size_t MEMPOOL_JSON_BATCH = 1000;
+
+/**
+ * mempoolToJSON, written to stream. mempool.cs is taken for a batch of entries
+ * at a time, not while writing, entries that leave the mempool in between are
+ * left out.
+ */
+void mempoolToJSON(bool fVerbose, CJSONStreamWriter &stream) {
+    std::vector<uint256> vtxids;
+    mempool.queryHashes(vtxids);
+    if (!fVerbose) {
+        stream.BeginArray();
+        for (const uint256 &txid : vtxids) {
+            stream.Value(txid.ToString());
+        }
+        stream.EndArray();
+        return;
+    }
+
+    stream.BeginObject();
+    for (size_t i = 0; i < vtxids.size() && !stream.Failed();
+         i += MEMPOOL_JSON_BATCH) {
+        const size_t nEnd = std::min(i + MEMPOOL_JSON_BATCH, vtxids.size());
+        UniValue batch(UniValue::VOBJ);
+        {
+            LOCK(mempool.cs);
+            for (size_t j = i; j < nEnd; j++) {
+                CTxMemPool::txiter it = mempool.mapTx.find(vtxids[j]);
+                if (it == mempool.mapTx.end()) {
+                    continue;
+                }
+                UniValue info(UniValue::VOBJ);
+                entryToJSON(info, *it);
+                batch.pushKVEnd(vtxids[j].ToString(), std::move(info));
+            }
+        }
+        stream.Entries(batch);
+    }
+    stream.EndObject();
+}
+
 UniValue getrawmempool(const Config &config, const JSONRPCRequest &request) {
-    if (request.fHelp || request.params.size() > 1) {
+    if (request.fHelp || request.params.size() > 2) {
         throw std::runtime_error(
-            "getrawmempool ( verbose )\n"
+            "getrawmempool ( verbose mempool_sequence )\n"
             "\nReturns all transaction ids in memory pool as a json array of "
             "string transaction ids.\n"
             "\nArguments:\n"
             "1. verbose (boolean, optional, default=false) True for a json "
             "object, false for array of transaction ids\n"
+            "2. mempool_sequence (boolean, optional, default=false) With "
+            "verbose = false, return the\n"
+            "   mempool sequence the ids are at as well, for "
+            "getmempooldelta\n"
             "\nResult: (for verbose = false):\n"
             "[                     (json array of string)\n"
             "  \"transactionid\"     (string) The transaction id\n"
@@ -477,10 +575,19 @@ UniValue getrawmempool(const Config &config, const JSONRPCRequest &request) {
             "\nResult: (for verbose = true):\n"
             "{                           (json object)\n"
             "  \"transactionid\" : {       (json object)\n" +
-            EntryDescriptionString() + "  }, ...\n"
-                                       "}\n"
-                                       "\nExamples:\n" +
+            EntryDescriptionString() +
+            "  }, ...\n"
+            "}\n"
+            "\nResult: (for verbose = false and mempool_sequence = true):\n"
+            "{\n"
+            "  \"txids\" : [ \"transactionid\", ... ],  (array) The "
+            "transaction ids\n"
+            "  \"mempool_sequence\" : n    (numeric) The mempool sequence "
+            "they are at\n"
+            "}\n"
+            "\nExamples:\n" +
             HelpExampleCli("getrawmempool", "true") +
+            HelpExampleCli("getrawmempool", "false true") +
             HelpExampleRpc("getrawmempool", "true"));
     }
 
@@ -488,10 +595,125 @@ UniValue getrawmempool(const Config &config, const JSONRPCRequest &request) {
     if (request.params.size() > 0) {
         fVerbose = request.params[0].get_bool();
     }
+    if (request.params.size() > 1 && !request.params[1].isNull() &&
+        request.params[1].get_bool()) {
+        if (fVerbose) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER,
+                               "Verbose results cannot contain the mempool "
+                               "sequence");
+        }
+        std::vector<uint256> vtxids;
+        uint64_t nSequence;
+        mempool.queryHashes(vtxids, &nSequence);
+        UniValue txids(UniValue::VARR);
+        txids.reserve(vtxids.size());
+        for (const uint256 &txid : vtxids) {
+            txids.push_back(txid.ToString());
+        }
+        UniValue ret(UniValue::VOBJ);
+        ret.push_back(Pair("txids", txids));
+        ret.push_back(Pair("mempool_sequence", nSequence));
+        return ret;
+    }
 
+    if (request.pStream) {
+        mempoolToJSON(fVerbose, *request.pStream);
+        return NullUniValue;
+    }
     return mempoolToJSON(fVerbose);
 }
 
+/** Changes getmempooldelta returns when not given a count */
+static const int DEFAULT_MEMPOOL_DELTA_COUNT = 10000;
+
+UniValue getmempooldelta(const Config &config,
+                         const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 ||
+        request.params.size() > 2) {
+        throw std::runtime_error(
+            "getmempooldelta since ( count )\n"
+            "\nReturns the transactions that entered and left the mempool "
+            "after mempool\n"
+            "sequence since, in order, for mirrors of the mempool to follow "
+            "it without\n"
+            "fetching all of it. Start from getrawmempool false true, and "
+            "pass the\n"
+            "sequence of each result to the next call. The latest " +
+            std::to_string(MEMPOOL_EVENTS_SIZE) +
+            " changes are kept.\n"
+            "\nArguments:\n"
+            "1. since    (numeric, required) The mempool sequence of the "
+            "previous result\n"
+            "2. count    (numeric, optional, default=" +
+            std::to_string(DEFAULT_MEMPOOL_DELTA_COUNT) +
+            ") The most changes to return\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"sequence\" : n,       (numeric) The sequence to pass next\n"
+            "  \"reset\" : true|false, (boolean) Whether changes after since "
+            "were dropped\n"
+            "                        already, or since is of an earlier "
+            "run. Nothing is\n"
+            "                        returned then, start over from "
+            "getrawmempool.\n"
+            "  \"changes\" : [         (array) The changes in order\n"
+            "    {\n"
+            "      \"sequence\" : n,   (numeric) The sequence of the change\n"
+            "      \"txid\" : \"id\",    (string) The transaction id\n"
+            "      \"action\" : \"added\"|\"removed\",\n"
+            "      \"reason\" : \"...\"  (string) Why it was removed, if it "
+            "was\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getmempooldelta", "1526651423000042") +
+            HelpExampleRpc("getmempooldelta", "1526651423000042, 1000"));
+    }
+
+    const int64_t nSince = request.params[0].get_int64();
+    if (nSince < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative sequence");
+    }
+    int nCount = DEFAULT_MEMPOOL_DELTA_COUNT;
+    if (request.params.size() > 1 && !request.params[1].isNull()) {
+        nCount = request.params[1].get_int();
+        if (nCount < 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+        }
+    }
+
+    std::vector<CMemPoolEvent> vEvents;
+    const bool fReset = !mempool.GetEventsSince(nSince, nCount, vEvents);
+
+    UniValue changes(UniValue::VARR);
+    changes.reserve(vEvents.size());
+    for (const CMemPoolEvent &event : vEvents) {
+        UniValue change(UniValue::VOBJ);
+        change.push_back(Pair("sequence", event.nSequence));
+        change.push_back(Pair("txid", event.txid.GetHex()));
+        change.push_back(Pair("action", event.fAdded ? "added" : "removed"));
+        if (!event.fAdded) {
+            change.push_back(
+                Pair("reason", RemovalReasonToString(event.reason)));
+        }
+        changes.push_back(std::move(change));
+    }
+
+    uint64_t nSequence = nSince;
+    if (fReset) {
+        nSequence = mempool.GetSequence();
+    } else if (!vEvents.empty()) {
+        nSequence = vEvents.back().nSequence;
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("sequence", nSequence));
+    ret.push_back(Pair("reset", fReset));
+    ret.push_back(Pair("changes", changes));
+    return ret;
+}
+
 UniValue getmempoolancestors(const Config &config,
                              const JSONRPCRequest &request) {
     if (request.fHelp || request.params.size() < 1 ||
@@ -673,14 +895,14 @@ UniValue getblockhash(const Config &config, const JSONRPCRequest &request) {
             HelpExampleRpc("getblockhash", "1000"));
     }
 
-    LOCK(cs_main);
+    const std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
 
     int nHeight = request.params[0].get_int();
-    if (nHeight < 0 || nHeight > chainActive.Height()) {
+    if (nHeight < 0 || nHeight > chain->Height()) {
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
     }
 
-    CBlockIndex *pblockindex = chainActive[nHeight];
+    const CBlockIndex *pblockindex = (*chain)[nHeight];
     return pblockindex->GetBlockHash().GetHex();
 }
 
@@ -734,8 +956,6 @@ UniValue getblockheader(const Config &config, const JSONRPCRequest &request) {
                                              "\""));
     }
 
-    LOCK(cs_main);
-
     std::string strHash = request.params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -744,12 +964,11 @@ UniValue getblockheader(const Config &config, const JSONRPCRequest &request) {
         fVerbose = request.params[1].get_bool();
     }
 
-    if (mapBlockIndex.count(hash) == 0) {
+    const CBlockIndex *pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
     }
 
-    CBlockIndex *pblockindex = mapBlockIndex[hash];
-
     if (!fVerbose) {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
         ssBlock << pblockindex->GetBlockHeader();
@@ -760,6 +979,117 @@ UniValue getblockheader(const Config &config, const JSONRPCRequest &request) {
     return blockheaderToJSON(pblockindex);
 }
 
+UniValue getpowproof(const Config &config, const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 ||
+        request.params.size() > 2) {
+        throw std::runtime_error(
+            "getpowproof \"hash\" ( verbose )\n"
+            "\nReturns the DAG pages the ethash of block header 'hash' "
+            "reads, with their Merkle branches to the DAG root of its epoch.\n"
+            "A light client that trusts the DAG root checks the proof of "
+            "work of the header with them, without the ethash light cache.\n"
+            "Needs -powproofs. The DAG is built in the background for the "
+            "epoch of the tip, and kept for the previous one.\n"
+            "\nArguments:\n"
+            "1. \"hash\"          (string, required) The block hash\n"
+            "2. verbose         (boolean, optional, default=true) true for a "
+            "json object, false for the hex encoded proof\n"
+            "\nResult (for verbose = true):\n"
+            "{\n"
+            "  \"hash\" : \"hash\",     (string) the block hash\n"
+            "  \"height\" : n,        (numeric) the block height\n"
+            "  \"epoch\" : n,         (numeric) the ethash epoch\n"
+            "  \"datasize\" : n,      (numeric) the size of the DAG in "
+            "bytes\n"
+            "  \"dagroot\" : \"hash\",  (string) the root of the Merkle tree "
+            "over the double SHA256 of the DAG pages\n"
+            "  \"pages\" : [          (array) the pages read, in order\n"
+            "    {\n"
+            "      \"index\" : n,     (numeric) the index of the page\n"
+            "      \"data\" : \"hex\",  (string) the page\n"
+            "      \"branch\" : [     (array) its Merkle branch, bottom up\n"
+            "        \"hash\",...\n"
+            "      ]\n"
+            "    },...\n"
+            "  ]\n"
+            "}\n"
+            "\nResult (for verbose=false):\n"
+            "\"data\"             (string) A string that is serialized, "
+            "hex-encoded data for the proof.\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getpowproof", "\"00000000c937983704a73af28acdec3"
+                                          "7b049d214adbda81d7e2a3dd146f6ed09"
+                                          "\"") +
+            HelpExampleRpc("getpowproof", "\"00000000c937983704a73af28acdec3"
+                                          "7b049d214adbda81d7e2a3dd146f6ed09"
+                                          "\""));
+    }
+
+    if (!g_ethashprover) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "Proofs of work are only served with -powproofs");
+    }
+
+    uint256 hash(uint256S(request.params[0].get_str()));
+
+    bool fVerbose = true;
+    if (request.params.size() > 1) {
+        fVerbose = request.params[1].get_bool();
+    }
+
+    const CBlockIndex *pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    }
+    const CBlockHeader header = pblockindex->GetBlockHeader();
+
+    const int64_t nEpoch = header.nBlockHeight / ethash_get_epoch_length();
+    std::shared_ptr<const CEthashProver::Epoch> epoch =
+        g_ethashprover->GetEpoch(nEpoch);
+    if (!epoch) {
+        throw JSONRPCError(
+            RPC_MISC_ERROR,
+            strprintf("The DAG of epoch %d is not available", nEpoch));
+    }
+
+    CEthashProof proof;
+    ethash_return_value_t ret = epoch->commitment->Prove(
+        header.GetBaseEthash(), header.nNonce, proof);
+    if (!ret.success ||
+        memcmp(&ret.mix_hash, &header.hashMix, sizeof(ret.mix_hash)) != 0) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR,
+                           "The mix hash of the header doesn't match");
+    }
+
+    if (!fVerbose) {
+        CDataStream ssProof(SER_NETWORK, PROTOCOL_VERSION);
+        ssProof << proof;
+        return HexStr(ssProof.begin(), ssProof.end());
+    }
+
+    UniValue pages(UniValue::VARR);
+    for (const CEthashPageProof &page : proof.vPages) {
+        UniValue branch(UniValue::VARR);
+        for (const uint256 &node : page.vBranch) {
+            branch.push_back(node.GetHex());
+        }
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("index", uint64_t(page.nIndex)));
+        entry.push_back(Pair("data", HexStr(page.vchPage)));
+        entry.push_back(Pair("branch", branch));
+        pages.push_back(entry);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("hash", hash.GetHex()));
+    result.push_back(Pair("height", pblockindex->nHeight));
+    result.push_back(Pair("epoch", nEpoch));
+    result.push_back(Pair("datasize", ethash_full_dag_size(epoch->full.get())));
+    result.push_back(Pair("dagroot", epoch->commitment->GetRoot().GetHex()));
+    result.push_back(Pair("pages", pages));
+    return result;
+}
+
 UniValue getblock(const Config &config, const JSONRPCRequest &request) {
     if (request.fHelp || request.params.size() < 1 ||
         request.params.size() > 2) {
@@ -813,8 +1143,6 @@ UniValue getblock(const Config &config, const JSONRPCRequest &request) {
                                        "214adbda81d7e2a3dd146f6ed09\""));
     }
 
-    LOCK(cs_main);
-
     std::string strHash = request.params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -823,18 +1151,21 @@ UniValue getblock(const Config &config, const JSONRPCRequest &request) {
         fVerbose = request.params[1].get_bool();
     }
 
-    if (mapBlockIndex.count(hash) == 0) {
+    CBlock block;
+    const CBlockIndex *pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
     }
-
-    CBlock block;
-    CBlockIndex *pblockindex = mapBlockIndex[hash];
-
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) &&
-        pblockindex->nTx > 0) {
-        throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+    if (fHavePruned) {
+        LOCK(cs_main);
+        if (!(pblockindex->nStatus & BLOCK_HAVE_DATA) &&
+            pblockindex->nTx > 0) {
+            throw JSONRPCError(RPC_MISC_ERROR,
+                               "Block not available (pruned data)");
+        }
     }
 
+    // The block is read without cs_main, reads don't wait for each other.
     if (!ReadBlockFromDisk(block, pblockindex, config)) {
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
@@ -847,10 +1178,15 @@ UniValue getblock(const Config &config, const JSONRPCRequest &request) {
         CDataStream ssBlock(SER_NETWORK,
                             PROTOCOL_VERSION | RPCSerializationFlags());
         ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+        std::string strHex =
+            HexStr(ssBlock.data(), ssBlock.data() + ssBlock.size());
         return strHex;
     }
 
+    if (request.pStream) {
+        blockToJSON(config, block, pblockindex, false, *request.pStream);
+        return NullUniValue;
+    }
     return blockToJSON(config, block, pblockindex);
 }
 
@@ -863,10 +1199,11 @@ struct CCoinsStats {
     uint256 hashSerialized;
     uint64_t nDiskSize;
     CAmount nTotalAmount;
+    CAmount nTotalPrincipal;
 
     CCoinsStats()
         : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0),
-          nDiskSize(0), nTotalAmount(0) {}
+          nDiskSize(0), nTotalAmount(0), nTotalPrincipal(0) {}
 };
 
 static void ApplyStats(CCoinsStats &stats, CHashWriter &ss, const uint256 &hash,
@@ -882,6 +1219,7 @@ static void ApplyStats(CCoinsStats &stats, CHashWriter &ss, const uint256 &hash,
         ss << VARINT(output.second.GetTxOut().nValue);
         stats.nTransactionOutputs++;
         stats.nTotalAmount += output.second.GetTxOut().nValue;
+        stats.nTotalPrincipal += output.second.GetTxOut().nPrincipal;
         stats.nBogoSize +=
             32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ +
             8 /* amount */ + 2 /* scriptPubKey len */ +
@@ -949,41 +1287,47 @@ UniValue pruneblockchain(const Config &config, const JSONRPCRequest &request) {
             "Cannot prune blocks because node is not in prune mode.");
     }
 
-    LOCK(cs_main);
+    // Not held while the pruner prunes, it needs it.
+    unsigned int height;
+    {
+        LOCK(cs_main);
 
-    int heightParam = request.params[0].get_int();
-    if (heightParam < 0) {
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative block height.");
-    }
+        int heightParam = request.params[0].get_int();
+        if (heightParam < 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER,
+                               "Negative block height.");
+        }
 
-    // Height value more than a billion is too high to be a block height, and
-    // too low to be a block time (corresponds to timestamp from Sep 2001).
-    if (heightParam > 1000000000) {
-        // Add a 2 hour buffer to include blocks which might have had old
-        // timestamps
-        CBlockIndex *pindex =
-            chainActive.FindEarliestAtLeast(heightParam - 7200);
-        if (!pindex) {
+        // Height value more than a billion is too high to be a block height,
+        // and too low to be a block time (corresponds to timestamp from Sep
+        // 2001).
+        if (heightParam > 1000000000) {
+            // Add a 2 hour buffer to include blocks which might have had old
+            // timestamps
+            CBlockIndex *pindex =
+                chainActive.FindEarliestAtLeast(heightParam - 7200);
+            if (!pindex) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER,
+                                   "Could not find block with at least the "
+                                   "specified timestamp.");
+            }
+            heightParam = pindex->nHeight;
+        }
+
+        height = (unsigned int)heightParam;
+        unsigned int chainHeight = (unsigned int)chainActive.Height();
+        if (chainHeight < Params().PruneAfterHeight()) {
+            throw JSONRPCError(RPC_MISC_ERROR,
+                               "Blockchain is too short for pruning.");
+        } else if (height > chainHeight) {
             throw JSONRPCError(
                 RPC_INVALID_PARAMETER,
-                "Could not find block with at least the specified timestamp.");
+                "Blockchain is shorter than the attempted prune height.");
+        } else if (height > chainHeight - nPruneDepth) {
+            LogPrint("rpc", "Attempt to prune blocks close to the tip.  "
+                            "Retaining the -prunedepth blocks.");
+            height = chainHeight - nPruneDepth;
         }
-        heightParam = pindex->nHeight;
-    }
-
-    unsigned int height = (unsigned int)heightParam;
-    unsigned int chainHeight = (unsigned int)chainActive.Height();
-    if (chainHeight < Params().PruneAfterHeight()) {
-        throw JSONRPCError(RPC_MISC_ERROR,
-                           "Blockchain is too short for pruning.");
-    } else if (height > chainHeight) {
-        throw JSONRPCError(
-            RPC_INVALID_PARAMETER,
-            "Blockchain is shorter than the attempted prune height.");
-    } else if (height > chainHeight - MIN_BLOCKS_TO_KEEP) {
-        LogPrint("rpc", "Attempt to prune blocks close to the tip.  Retaining "
-                        "the minimum number of blocks.");
-        height = chainHeight - MIN_BLOCKS_TO_KEEP;
     }
 
     PruneBlockFilesManual(height);
@@ -991,32 +1335,74 @@ UniValue pruneblockchain(const Config &config, const JSONRPCRequest &request) {
 }
 
 UniValue gettxoutsetinfo(const Config &config, const JSONRPCRequest &request) {
-    if (request.fHelp || request.params.size() != 0) {
+    if (request.fHelp || request.params.size() > 1) {
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time with hash_serialized.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"       (string, optional, default=\"muhash\") "
+            "Which UTXO set hash to give, \"muhash\" which is kept up to "
+            "date\n"
+            "                     as blocks are connected, or "
+            "\"hash_serialized\" which needs a scan of the set\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"transactions\": n,      (numeric) The number of "
+            "transactions, with hash_serialized only\n"
             "  \"txouts\": n,            (numeric) The number of output "
             "transactions\n"
             "  \"bogosize\": n,          (numeric) A database-independent "
             "metric for UTXO set size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"muhash\": \"hash\",     (string) The MuHash of the "
+            "outpoints and coins, with muhash\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized "
+            "hash, with hash_serialized\n"
             "  \"disk_size\": n,         (numeric) The estimated size of the "
             "chainstate on disk\n"
-            "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"total_amount\": x.xxx,         (numeric) The total amount\n"
+            "  \"total_principal\": x.xxx       (numeric) The total "
+            "principal\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("gettxoutsetinfo", "") +
+            HelpExampleCli("gettxoutsetinfo", "\"hash_serialized\"") +
             HelpExampleRpc("gettxoutsetinfo", ""));
     }
 
+    std::string strHashType = "muhash";
+    if (request.params.size() > 0 && !request.params[0].isNull()) {
+        strHashType = request.params[0].get_str();
+    }
+
     UniValue ret(UniValue::VOBJ);
 
+    if (strHashType == "muhash") {
+        LOCK(cs_main);
+        CUTXOStats stats;
+        if (!pcoinsTip->GetStats(stats)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR,
+                               "UTXO set statistics are unknown");
+        }
+        ret.push_back(Pair("height", int64_t(chainActive.Height())));
+        ret.push_back(Pair("bestblock", pcoinsTip->GetBestBlock().GetHex()));
+        ret.push_back(Pair("txouts", stats.nCoins));
+        ret.push_back(Pair("bogosize", stats.nBogoSize));
+        ret.push_back(Pair("muhash", stats.GetHash().GetHex()));
+        ret.push_back(Pair("disk_size", uint64_t(pcoinsTip->EstimateSize())));
+        ret.push_back(
+            Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        ret.push_back(
+            Pair("total_principal", ValueFromAmount(stats.nTotalPrincipal)));
+        return ret;
+    }
+    if (strHashType != "hash_serialized") {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           "Unknown hash_type " + strHashType);
+    }
+
     CCoinsStats stats;
     FlushStateToDisk();
     if (GetUTXOStats(pcoinsTip, stats)) {
@@ -1029,23 +1415,166 @@ UniValue gettxoutsetinfo(const Config &config, const JSONRPCRequest &request) {
         ret.push_back(Pair("disk_size", stats.nDiskSize));
         ret.push_back(
             Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        ret.push_back(
+            Pair("total_principal", ValueFromAmount(stats.nTotalPrincipal)));
     } else {
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
     }
     return ret;
 }
 
+UniValue dumptxoutset(const Config &config, const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite a snapshot of the unspent transaction output set to "
+            "a file, which loadtxoutset can\n"
+            "bootstrap another node from.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) The file to write, relative "
+            "to the data directory\n"
+            "               unless absolute. It must not exist yet.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_written\": n,     (numeric) The number of coins "
+            "written\n"
+            "  \"base_hash\": \"hash\",  (string) The block the snapshot was "
+            "taken at\n"
+            "  \"base_height\": n,       (numeric) The height of that block\n"
+            "  \"hash\": \"hash\",       (string) The hash committing to "
+            "the snapshot\n"
+            "  \"path\": \"path\"        (string) The file written\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("dumptxoutset", "\"utxo.dat\"") +
+            HelpExampleRpc("dumptxoutset", "\"utxo.dat\""));
+    }
+
+    boost::filesystem::path path = boost::filesystem::absolute(
+        request.params[0].get_str(), GetDataDir());
+    boost::filesystem::path pathTmp = path.string() + ".incomplete";
+    if (boost::filesystem::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           path.string() + " already exists");
+    }
+
+    CAutoFile file(fopen(pathTmp.string().c_str(), "wb"), SER_DISK,
+                   CLIENT_VERSION);
+    if (file.IsNull()) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "Couldn't open " + pathTmp.string());
+    }
+
+    // No block may be connected between the flush and taking the cursor.
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    SnapshotMetadata metadata;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        pcursor.reset(pcoinsTip->Cursor());
+        const CBlockIndex *pindex =
+            mapBlockIndex.find(pcursor->GetBestBlock())->second;
+        metadata.hashBase = pindex->GetBlockHash();
+        metadata.nHeight = pindex->nHeight;
+        metadata.nChainTx = pindex->nChainTx;
+        metadata.nChainInterest = pindex->nChainInterest;
+    }
+
+    uint256 hash;
+    std::string strError;
+    if (!WriteUTXOSnapshot(*pcursor, metadata, file, hash, strError)) {
+        file.fclose();
+        boost::filesystem::remove(pathTmp);
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    }
+    FileCommit(file.Get());
+    file.fclose();
+    if (!RenameOver(pathTmp, path)) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "Couldn't rename " + pathTmp.string());
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("coins_written", metadata.nCoins));
+    ret.push_back(Pair("base_hash", metadata.hashBase.GetHex()));
+    ret.push_back(Pair("base_height", metadata.nHeight));
+    ret.push_back(Pair("hash", hash.GetHex()));
+    ret.push_back(Pair("path", path.string()));
+    return ret;
+}
+
+UniValue loadtxoutset(const Config &config, const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "loadtxoutset \"path\"\n"
+            "\nReplace the chainstate with a snapshot written by "
+            "dumptxoutset, and continue syncing\n"
+            "from its base block. The node must be at the genesis block, have "
+            "the header of the\n"
+            "base block in its best header chain, and run with -prune: the "
+            "blocks below the base\n"
+            "are never downloaded or validated, so only load snapshots you "
+            "trust.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) The snapshot file, relative "
+            "to the data directory\n"
+            "               unless absolute.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_loaded\": n,      (numeric) The number of coins "
+            "loaded\n"
+            "  \"base_hash\": \"hash\",  (string) The new tip\n"
+            "  \"base_height\": n,       (numeric) The height of the new "
+            "tip\n"
+            "  \"path\": \"path\"        (string) The file read\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("loadtxoutset", "\"utxo.dat\"") +
+            HelpExampleRpc("loadtxoutset", "\"utxo.dat\""));
+    }
+
+    boost::filesystem::path path = boost::filesystem::absolute(
+        request.params[0].get_str(), GetDataDir());
+    CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK,
+                   CLIENT_VERSION);
+    if (file.IsNull()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           "Couldn't open " + path.string());
+    }
+
+    SnapshotMetadata metadata;
+    std::string strError;
+    if (!ReadUTXOSnapshotMetadata(file, metadata, strError)) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strError);
+    }
+    if (!ActivateUTXOSnapshot(config, file, metadata, strError)) {
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("coins_loaded", metadata.nCoins));
+    ret.push_back(Pair("base_hash", metadata.hashBase.GetHex()));
+    ret.push_back(Pair("base_height", metadata.nHeight));
+    ret.push_back(Pair("path", path.string()));
+    return ret;
+}
+
 UniValue gettxout(const Config &config, const JSONRPCRequest &request) {
     if (request.fHelp || request.params.size() < 2 ||
-        request.params.size() > 3) {
+        request.params.size() > 4) {
         throw std::runtime_error(
-            "gettxout \"txid\" n ( include_mempool )\n"
+            "gettxout \"txid\" n ( include_mempool include_content )\n"
             "\nReturns details about an unspent transaction output.\n"
             "\nArguments:\n"
             "1. \"txid\"       (string, required) The transaction id\n"
             "2. n              (numeric, required) vout number\n"
             "3. include_mempool  (boolean, optional) Whether to include the "
             "mempool\n"
+            "4. include_content  (boolean, optional, default=false) Whether to "
+            "include the output's content, which is read from the "
+            "transaction\n"
             "\nResult:\n"
             "{\n"
             "  \"bestblock\" : \"hash\",    (string) the block hash\n"
@@ -1068,6 +1597,8 @@ UniValue gettxout(const Config &config, const JSONRPCRequest &request) {
             "     ]\n"
             "  },\n"
             "  \"coinbase\" : true|false   (boolean) Coinbase or not\n"
+            "  \"content\" : \"hex\"         (string) The content, with "
+            "include_content\n"
             "}\n"
 
             "\nExamples:\n"
@@ -1078,8 +1609,6 @@ UniValue gettxout(const Config &config, const JSONRPCRequest &request) {
             HelpExampleRpc("gettxout", "\"txid\", 1"));
     }
 
-    LOCK(cs_main);
-
     UniValue ret(UniValue::VOBJ);
 
     std::string strHash = request.params[0].get_str();
@@ -1090,23 +1619,33 @@ UniValue gettxout(const Config &config, const JSONRPCRequest &request) {
     if (request.params.size() > 2) {
         fMempool = request.params[2].get_bool();
     }
+    bool fContent = false;
+    if (request.params.size() > 3) {
+        fContent = request.params[3].get_bool();
+    }
 
+    // Lookups fill the coins cache, which only cs_main guards. The lock is
+    // held for the lookup alone, the rest is built from what it found.
     Coin coin;
-    if (fMempool) {
-        LOCK(mempool.cs);
-        CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoin(out, coin) || mempool.isSpent(out)) {
-            // TODO: this should be done by the CCoinsViewMemPool
-            return NullUniValue;
-        }
-    } else {
-        if (!pcoinsTip->GetCoin(out, coin)) {
-            return NullUniValue;
+    uint256 hashBest;
+    {
+        LOCK(cs_main);
+        if (fMempool) {
+            LOCK(mempool.cs);
+            CCoinsViewMemPool view(pcoinsTip, mempool);
+            if (!view.GetCoin(out, coin) || mempool.isSpent(out)) {
+                // TODO: this should be done by the CCoinsViewMemPool
+                return NullUniValue;
+            }
+        } else {
+            if (!pcoinsTip->GetCoin(out, coin)) {
+                return NullUniValue;
+            }
         }
+        hashBest = pcoinsTip->GetBestBlock();
     }
 
-    BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
-    CBlockIndex *pindex = it->second;
+    const CBlockIndex *pindex = LookupBlockIndex(hashBest);
     ret.push_back(Pair("bestblock", pindex->GetBlockHash().GetHex()));
     if (coin.GetHeight() == MEMPOOL_HEIGHT) {
         ret.push_back(Pair("confirmations", 0));
@@ -1122,6 +1661,279 @@ UniValue gettxout(const Config &config, const JSONRPCRequest &request) {
     ret.push_back(Pair("scriptPubKey", o));
     ret.push_back(Pair("coinbase", coin.IsCoinBase()));
 
+    std::string strContent;
+    if (fContent) {
+        if (!GetCoinContent(config, out, strContent)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR,
+                               "Unable to read the output's content, use "
+                               "-txindex");
+        }
+        if (strContent.size() > MAX_STANDARD_TX_SIZE) {
+            ret.push_back(Pair("contentlen", (int)strContent.size()));
+        } else {
+            ret.push_back(Pair("content",
+                               HexStr(strContent.begin(), strContent.end())));
+        }
+    }
+
+    return ret;
+}
+
+UniValue getdepositunlocks(const Config &config,
+                           const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 ||
+        request.params.size() > 3) {
+        throw std::runtime_error(
+            "getdepositunlocks minheight ( maxheight verbose )\n"
+            "\nReturns the deposits of the active chain which unlock at "
+            "heights\n"
+            "between minheight and maxheight, with the principal and the "
+            "interest\n"
+            "paid to them. Needs -depositindex.\n"
+            "\nArguments:\n"
+            "1. minheight      (numeric, required) The first unlock height\n"
+            "2. maxheight      (numeric, optional, default=minheight) The last "
+            "unlock height\n"
+            "3. verbose        (boolean, optional, default=false) Whether to "
+            "list the deposits of each height\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"deposits\": n,         (numeric) The number of deposits\n"
+            "  \"principal\": x.xxx,    (numeric) Their total principal\n"
+            "  \"interest\": x.xxx,     (numeric) Their total interest\n"
+            "  \"heights\": [           (array) The heights with deposits\n"
+            "    {\n"
+            "      \"height\": n,       (numeric) The unlock height\n"
+            "      \"deposits\": n,     (numeric) The number of deposits\n"
+            "      \"principal\": x.xxx,  (numeric) Their total principal\n"
+            "      \"interest\": x.xxx,   (numeric) Their total interest\n"
+            "      \"outputs\": [       (array) With verbose\n"
+            "        {\n"
+            "          \"txid\": \"txid\",\n"
+            "          \"vout\": n,\n"
+            "          \"principal\": x.xxx,\n"
+            "          \"interest\": x.xxx\n"
+            "        }, ...\n"
+            "      ]\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getdepositunlocks", "20000 20959") +
+            HelpExampleCli("getdepositunlocks", "20000 20000 true") +
+            HelpExampleRpc("getdepositunlocks", "20000, 20959"));
+    }
+
+    int nMinHeight = request.params[0].get_int();
+    int nMaxHeight = nMinHeight;
+    if (request.params.size() > 1 && !request.params[1].isNull()) {
+        nMaxHeight = request.params[1].get_int();
+    }
+    bool fVerbose = false;
+    if (request.params.size() > 2 && !request.params[2].isNull()) {
+        fVerbose = request.params[2].get_bool();
+    }
+    if (nMinHeight < 0 || nMaxHeight < nMinHeight) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid height range");
+    }
+
+    LOCK(cs_main);
+    if (!fDepositIndex) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "The deposit index is disabled, use "
+                           "-depositindex");
+    }
+
+    DepositIndexEntries entries;
+    if (!pblocktree->ReadDepositIndex(nMinHeight, uint32_t(nMaxHeight) + 1,
+                                      entries)) {
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read deposit index");
+    }
+
+    UniValue heights(UniValue::VARR);
+    size_t nStart = 0;
+    CAmount nTotalPrincipal = 0;
+    CAmount nTotalInterest = 0;
+    while (nStart < entries.size()) {
+        const uint32_t nHeight = entries[nStart].first.nUnlockHeight;
+        UniValue outputs(UniValue::VARR);
+        CAmount nPrincipal = 0;
+        CAmount nInterest = 0;
+        size_t nEnd = nStart;
+        for (; nEnd < entries.size() &&
+               entries[nEnd].first.nUnlockHeight == nHeight;
+             nEnd++) {
+            const CDepositIndexValue &value = entries[nEnd].second;
+            nPrincipal += value.nPrincipal;
+            nInterest += value.nInterest;
+            if (fVerbose) {
+                const COutPoint &outpoint = entries[nEnd].first.outpoint;
+                UniValue output(UniValue::VOBJ);
+                output.push_back(Pair("txid", outpoint.hash.GetHex()));
+                output.push_back(Pair("vout", int64_t(outpoint.n)));
+                output.push_back(
+                    Pair("principal", ValueFromAmount(value.nPrincipal)));
+                output.push_back(
+                    Pair("interest", ValueFromAmount(value.nInterest)));
+                outputs.push_back(output);
+            }
+        }
+
+        UniValue height(UniValue::VOBJ);
+        height.push_back(Pair("height", int64_t(nHeight)));
+        height.push_back(Pair("deposits", uint64_t(nEnd - nStart)));
+        height.push_back(Pair("principal", ValueFromAmount(nPrincipal)));
+        height.push_back(Pair("interest", ValueFromAmount(nInterest)));
+        if (fVerbose) {
+            height.push_back(Pair("outputs", outputs));
+        }
+        heights.push_back(height);
+        nTotalPrincipal += nPrincipal;
+        nTotalInterest += nInterest;
+        nStart = nEnd;
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("deposits", uint64_t(entries.size())));
+    ret.push_back(Pair("principal", ValueFromAmount(nTotalPrincipal)));
+    ret.push_back(Pair("interest", ValueFromAmount(nTotalInterest)));
+    ret.push_back(Pair("heights", heights));
+    return ret;
+}
+
+static UniValue BlockStatsToJSON(const CBlockIndex *pindex,
+                                 const CBlockStats &stats) {
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", pindex->nHeight));
+    ret.push_back(Pair("hash", pindex->GetBlockHash().GetHex()));
+    ret.push_back(Pair("time", pindex->GetBlockTime()));
+    ret.push_back(Pair("txs", uint64_t(stats.nTxs)));
+    ret.push_back(Pair("ins", uint64_t(stats.nInputs)));
+    ret.push_back(Pair("outs", uint64_t(stats.nOutputs)));
+    ret.push_back(Pair("size", stats.nSize));
+    ret.push_back(Pair("contentoutputs", uint64_t(stats.nContentOutputs)));
+    ret.push_back(Pair("contentbytes", stats.nContentBytes));
+    ret.push_back(Pair("totalout", ValueFromAmount(stats.nTotalOut)));
+    ret.push_back(Pair("totalfee", ValueFromAmount(stats.nFees)));
+    ret.push_back(Pair("interest", ValueFromAmount(stats.nInterest)));
+    ret.push_back(Pair("deposits", uint64_t(stats.nDeposits)));
+    ret.push_back(
+        Pair("depositprincipal", ValueFromAmount(stats.nDepositPrincipal)));
+    ret.push_back(Pair("withdrawals", uint64_t(stats.nWithdrawals)));
+    ret.push_back(Pair("withdrawnprincipal",
+                       ValueFromAmount(stats.nWithdrawnPrincipal)));
+    ret.push_back(Pair("minfeerate", ValueFromAmount(stats.nMinFeeRate)));
+    ret.push_back(Pair("maxfeerate", ValueFromAmount(stats.nMaxFeeRate)));
+    UniValue percentiles(UniValue::VARR);
+    for (const CAmount nFeeRate : stats.vFeeRatePercentiles) {
+        percentiles.push_back(ValueFromAmount(nFeeRate));
+    }
+    ret.push_back(Pair("feeratepercentiles", percentiles));
+    return ret;
+}
+
+UniValue getblockstats(const Config &config, const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 ||
+        request.params.size() > 2) {
+        throw std::runtime_error(
+            "getblockstats startheight ( endheight )\n"
+            "\nReturns the statistics of the blocks of the active chain "
+            "from startheight\n"
+            "to endheight, at most " +
+            std::to_string(MAX_BLOCKSTATS_RANGE) +
+            " of them. Needs -blockstatsindex.\n"
+            "Only txs, outs, size and the content counts include the "
+            "coinbase.\n"
+            "\nArguments:\n"
+            "1. startheight     (numeric, required) The first height\n"
+            "2. endheight       (numeric, optional, default=startheight) The "
+            "last height\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"height\": n,             (numeric) The block height\n"
+            "    \"hash\": \"hash\",          (string) The block hash\n"
+            "    \"time\": n,               (numeric) The block time\n"
+            "    \"txs\": n,                (numeric) The number of "
+            "transactions\n"
+            "    \"ins\": n,                (numeric) The number of inputs\n"
+            "    \"outs\": n,               (numeric) The number of outputs\n"
+            "    \"size\": n,               (numeric) The block size\n"
+            "    \"contentoutputs\": n,     (numeric) The number of outputs "
+            "with content\n"
+            "    \"contentbytes\": n,       (numeric) Their content bytes\n"
+            "    \"totalout\": x.xxx,       (numeric) The value of the "
+            "outputs\n"
+            "    \"totalfee\": x.xxx,       (numeric) The fees\n"
+            "    \"interest\": x.xxx,       (numeric) The interest the "
+            "deposits earn\n"
+            "    \"deposits\": n,           (numeric) The number of deposits "
+            "locked\n"
+            "    \"depositprincipal\": x.xxx, (numeric) Their principal\n"
+            "    \"withdrawals\": n,        (numeric) The number of deposits "
+            "spent\n"
+            "    \"withdrawnprincipal\": x.xxx, (numeric) Their principal\n"
+            "    \"minfeerate\": x.xxx,     (numeric) The lowest fee rate, "
+            "per kB\n"
+            "    \"maxfeerate\": x.xxx,     (numeric) The highest fee rate, "
+            "per kB\n"
+            "    \"feeratepercentiles\": [  (array) The fee rates at the "
+            "10th, 25th, 50th,\n"
+            "      x.xxx, ...               75th and 90th percentiles of "
+            "the block bytes\n"
+            "    ]\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getblockstats", "20000") +
+            HelpExampleCli("getblockstats", "20000 20959") +
+            HelpExampleRpc("getblockstats", "20000, 20959"));
+    }
+
+    int nStartHeight = request.params[0].get_int();
+    int nEndHeight = nStartHeight;
+    if (request.params.size() > 1 && !request.params[1].isNull()) {
+        nEndHeight = request.params[1].get_int();
+    }
+    if (nStartHeight < 0 || nEndHeight < nStartHeight) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid height range");
+    }
+    if (nEndHeight - nStartHeight >= MAX_BLOCKSTATS_RANGE) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Height range too large");
+    }
+    if (!g_blockstatsindex || g_blockstatsindex->IsDropping()) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "The block stats index is disabled, use "
+                           "-blockstatsindex");
+    }
+
+    std::vector<const CBlockIndex *> vBlocks;
+    {
+        LOCK(cs_main);
+        if (nEndHeight > chainActive.Height()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER,
+                               "Block height out of range");
+        }
+        vBlocks.reserve(nEndHeight - nStartHeight + 1);
+        for (int nHeight = nStartHeight; nHeight <= nEndHeight; nHeight++) {
+            vBlocks.push_back(chainActive[nHeight]);
+        }
+    }
+
+    // Stats are kept by block hash, they are right even if the blocks were
+    // disconnected meanwhile.
+    UniValue ret(UniValue::VARR);
+    ret.reserve(vBlocks.size());
+    for (const CBlockIndex *pindex : vBlocks) {
+        CBlockStats stats;
+        if (!g_blockstatsindex->LookupStats(pindex, stats)) {
+            throw JSONRPCError(
+                RPC_MISC_ERROR,
+                strprintf("The stats of block %d are not indexed yet",
+                          pindex->nHeight));
+        }
+        ret.push_back(BlockStatsToJSON(pindex, stats));
+    }
     return ret;
 }
 
@@ -1393,7 +2205,9 @@ UniValue getchaintips(const Config &config, const JSONRPCRequest &request) {
             HelpExampleRpc("getchaintips", ""));
     }
 
-    LOCK(cs_main);
+    // The chain is the snapshot, the tips are found under the lookup lock
+    // alone. Validity is read as it is at that moment.
+    const std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
 
     /**
      * Idea:  the set of chain tips is chainActive.tip, plus orphan blocks which
@@ -1409,10 +2223,14 @@ UniValue getchaintips(const Config &config, const JSONRPCRequest &request) {
     std::set<const CBlockIndex *> setOrphans;
     std::set<const CBlockIndex *> setPrevs;
 
-    for (const std::pair<const uint256, CBlockIndex *> &item : mapBlockIndex) {
-        if (!chainActive.Contains(item.second)) {
-            setOrphans.insert(item.second);
-            setPrevs.insert(item.second->pprev);
+    {
+        LOCK(cs_blockIndexLookup);
+        for (const std::pair<const uint256, CBlockIndex *> &item :
+             mapBlockIndex) {
+            if (!chain->Contains(item.second)) {
+                setOrphans.insert(item.second);
+                setPrevs.insert(item.second->pprev);
+            }
         }
     }
 
@@ -1424,7 +2242,7 @@ UniValue getchaintips(const Config &config, const JSONRPCRequest &request) {
     }
 
     // Always report the currently active tip.
-    setTips.insert(chainActive.Tip());
+    setTips.insert(chain->Tip());
 
     /* Construct the output array.  */
     UniValue res(UniValue::VARR);
@@ -1433,12 +2251,11 @@ UniValue getchaintips(const Config &config, const JSONRPCRequest &request) {
         obj.push_back(Pair("height", block->nHeight));
         obj.push_back(Pair("hash", block->phashBlock->GetHex()));
 
-        const int branchLen =
-            block->nHeight - chainActive.FindFork(block)->nHeight;
+        const int branchLen = block->nHeight - chain->FindFork(block)->nHeight;
         obj.push_back(Pair("branchlen", branchLen));
 
         std::string status;
-        if (chainActive.Contains(block)) {
+        if (chain->Contains(block)) {
             // This block is part of the currently active chain.
             status = "active";
         } else if (block->nStatus & BLOCK_FAILED_MASK) {
@@ -1473,6 +2290,8 @@ UniValue mempoolInfoToJSON() {
     UniValue ret(UniValue::VOBJ);
     ret.push_back(Pair("size", (int64_t)mempool.size()));
     ret.push_back(Pair("bytes", (int64_t)mempool.GetTotalTxSize()));
+    ret.push_back(
+        Pair("contentbytes", (int64_t)mempool.GetTotalContentSize()));
     ret.push_back(Pair("usage", (int64_t)mempool.DynamicMemoryUsage()));
     size_t maxmempool =
         GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
@@ -1493,6 +2312,8 @@ UniValue getmempoolinfo(const Config &config, const JSONRPCRequest &request) {
             "{\n"
             "  \"size\": xxxxx,               (numeric) Current tx count\n"
             "  \"bytes\": xxxxx,              (numeric) Transaction size.\n"
+            "  \"contentbytes\": xxxxx,       (numeric) Content carried by "
+            "the transactions\n"
             "  \"usage\": xxxxx,              (numeric) Total memory usage for "
             "the mempool\n"
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage "
@@ -1628,25 +2449,327 @@ UniValue reconsiderblock(const Config &config, const JSONRPCRequest &request) {
     return NullUniValue;
 }
 
+/** The address index hash of an address, or of a hex scriptPubKey */
+static uint160 ParseAddressIndexScript(const UniValue &param) {
+    const std::string &str = param.get_str();
+    CTxDestination dest = DecodeDestination(str);
+    CScript script;
+    if (IsValidDestination(dest)) {
+        script = GetScriptForDestination(dest);
+    } else if (!str.empty() && IsHex(str)) {
+        std::vector<uint8_t> data(ParseHex(str));
+        script = CScript(data.begin(), data.end());
+    } else {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                           "Invalid address or script: " + str);
+    }
+    return GetAddressIndexHash(script);
+}
+
+/**
+ * The height the address index is complete up to. Entries read after are of
+ * that block, or of a later one when it moves on meanwhile.
+ */
+static int GetAddressIndexHeight() {
+    if (!g_addressindex || g_addressindex->IsDropping()) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "The address index is disabled, use "
+                           "-addressindex");
+    }
+    const CBlockIndex *pindex = g_addressindex->GetBestBlock();
+    return pindex ? pindex->nHeight : -1;
+}
+
+/** The height a deposit output can be spent from, 0 if it isn't one */
+static uint32_t GetAddressIndexUnlockHeight(const CAddressIndexValue &value) {
+    if (value.fCoinBase || value.nLockTime == 0 ||
+        value.nLockTime >= LOCKTIME_THRESHOLD) {
+        return 0;
+    }
+    return value.nHeight + value.nLockTime + 1;
+}
+
+UniValue getaddressbalance(const Config &config,
+                           const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "getaddressbalance \"address\"\n"
+            "\nReturns the balance of an address, the sum of its unspent "
+            "outputs\n"
+            "in the active chain, with the principal and interest of its "
+            "deposits.\n"
+            "Needs -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"     (string, required) The address, or a "
+            "scriptPubKey in hex\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": x.xxx,    (numeric) The value of the unspent "
+            "outputs\n"
+            "  \"principal\": x.xxx,  (numeric) The principal of the "
+            "deposits among them\n"
+            "  \"interest\": x.xxx,   (numeric) The interest of the deposits\n"
+            "  \"locked\": x.xxx,     (numeric) The value of the deposits "
+            "that can't be\n"
+            "                         spent in the next block yet\n"
+            "  \"utxos\": n,          (numeric) The number of unspent "
+            "outputs\n"
+            "  \"height\": n,         (numeric) The height the index is "
+            "complete up to\n"
+            "  \"synced\": true|false (boolean) Whether the index has "
+            "caught up with the\n"
+            "                         active chain\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance",
+                           "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"") +
+            HelpExampleRpc("getaddressbalance",
+                           "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\""));
+    }
+
+    const uint160 scriptHash = ParseAddressIndexScript(request.params[0]);
+    const int nHeight = GetAddressIndexHeight();
+    AddressUnspentEntries entries;
+    if (!pblocktree->ReadAddressUnspent(scriptHash, entries)) {
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index");
+    }
+
+    CAmount nBalance = 0;
+    CAmount nPrincipal = 0;
+    CAmount nInterest = 0;
+    CAmount nLocked = 0;
+    for (const auto &entry : entries) {
+        const CAddressIndexValue &value = entry.second;
+        nBalance += value.nValue;
+        nPrincipal += value.nPrincipal;
+        nInterest += value.nInterest;
+        if (GetAddressIndexUnlockHeight(value) > uint32_t(nHeight + 1)) {
+            nLocked += value.nValue;
+        }
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("balance", ValueFromAmount(nBalance)));
+    ret.push_back(Pair("principal", ValueFromAmount(nPrincipal)));
+    ret.push_back(Pair("interest", ValueFromAmount(nInterest)));
+    ret.push_back(Pair("locked", ValueFromAmount(nLocked)));
+    ret.push_back(Pair("utxos", uint64_t(entries.size())));
+    ret.push_back(Pair("height", nHeight));
+    ret.push_back(Pair("synced", g_addressindex->IsSynced()));
+    return ret;
+}
+
+UniValue getaddressutxos(const Config &config,
+                         const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "getaddressutxos \"address\"\n"
+            "\nReturns the unspent outputs of an address in the active "
+            "chain.\n"
+            "Needs -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"     (string, required) The address, or a "
+            "scriptPubKey in hex\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\": n,       (numeric) The height the index is "
+            "complete up to\n"
+            "  \"utxos\": [         (array) The unspent outputs\n"
+            "    {\n"
+            "      \"txid\": \"txid\",\n"
+            "      \"vout\": n,\n"
+            "      \"value\": x.xxx,\n"
+            "      \"principal\": x.xxx,   (numeric) Of a deposit\n"
+            "      \"interest\": x.xxx,    (numeric) Of a deposit\n"
+            "      \"height\": n,          (numeric) The height of its "
+            "block\n"
+            "      \"unlockheight\": n,    (numeric) Of a deposit, the "
+            "height it can be\n"
+            "                              spent from\n"
+            "      \"coinbase\": true|false\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos",
+                           "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"") +
+            HelpExampleRpc("getaddressutxos",
+                           "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\""));
+    }
+
+    const uint160 scriptHash = ParseAddressIndexScript(request.params[0]);
+    const int nHeight = GetAddressIndexHeight();
+    AddressUnspentEntries entries;
+    if (!pblocktree->ReadAddressUnspent(scriptHash, entries)) {
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index");
+    }
+
+    UniValue utxos(UniValue::VARR);
+    utxos.reserve(entries.size());
+    for (const auto &entry : entries) {
+        const COutPoint &outpoint = entry.first.outpoint;
+        const CAddressIndexValue &value = entry.second;
+        UniValue utxo(UniValue::VOBJ);
+        utxo.push_back(Pair("txid", outpoint.hash.GetHex()));
+        utxo.push_back(Pair("vout", int64_t(outpoint.n)));
+        utxo.push_back(Pair("value", ValueFromAmount(value.nValue)));
+        const uint32_t nUnlockHeight = GetAddressIndexUnlockHeight(value);
+        if (nUnlockHeight) {
+            utxo.push_back(
+                Pair("principal", ValueFromAmount(value.nPrincipal)));
+            utxo.push_back(Pair("interest", ValueFromAmount(value.nInterest)));
+        }
+        utxo.push_back(Pair("height", int64_t(value.nHeight)));
+        if (nUnlockHeight) {
+            utxo.push_back(Pair("unlockheight", int64_t(nUnlockHeight)));
+        }
+        utxo.push_back(Pair("coinbase", value.fCoinBase));
+        utxos.push_back(std::move(utxo));
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", nHeight));
+    ret.push_back(Pair("utxos", std::move(utxos)));
+    return ret;
+}
+
+UniValue getaddresshistory(const Config &config,
+                           const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 ||
+        request.params.size() > 4) {
+        throw std::runtime_error(
+            "getaddresshistory \"address\" ( startheight skip count )\n"
+            "\nReturns the history of an address in the active chain, in "
+            "height order:\n"
+            "the outputs paying to it and the inputs spending those. Needs\n"
+            "-addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"     (string, required) The address, or a "
+            "scriptPubKey in hex\n"
+            "2. startheight     (numeric, optional, default=0) The first "
+            "height\n"
+            "3. skip            (numeric, optional, default=0) The entries "
+            "to skip from there\n"
+            "4. count           (numeric, optional, default=" +
+            std::to_string(DEFAULT_ADDRESS_HISTORY_COUNT) +
+            ") The most entries to\n"
+            "                   return, up to " +
+            std::to_string(MAX_ADDRESS_HISTORY_COUNT) +
+            "\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\": n,       (numeric) The height the index is "
+            "complete up to\n"
+            "  \"history\": [       (array) The entries, fewer than count "
+            "at the end\n"
+            "    {\n"
+            "      \"txid\": \"txid\",     (string) The transaction "
+            "paying or spending\n"
+            "      \"height\": n,          (numeric) The height of its "
+            "block\n"
+            "      \"vout\": n,            (numeric) The output paying, "
+            "or\n"
+            "      \"vin\": n,             (numeric) the input spending\n"
+            "      \"value\": x.xxx,       (numeric) Received, negative if "
+            "spent\n"
+            "      \"principal\": x.xxx,   (numeric) Of a deposit\n"
+            "      \"interest\": x.xxx     (numeric) Of a deposit\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresshistory",
+                           "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"") +
+            HelpExampleCli("getaddresshistory",
+                           "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\" 20000 "
+                           "100 100") +
+            HelpExampleRpc("getaddresshistory",
+                           "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\", 20000"));
+    }
+
+    const uint160 scriptHash = ParseAddressIndexScript(request.params[0]);
+    int nStartHeight = 0;
+    if (request.params.size() > 1 && !request.params[1].isNull()) {
+        nStartHeight = request.params[1].get_int();
+    }
+    int nSkip = 0;
+    if (request.params.size() > 2 && !request.params[2].isNull()) {
+        nSkip = request.params[2].get_int();
+    }
+    int nCount = DEFAULT_ADDRESS_HISTORY_COUNT;
+    if (request.params.size() > 3 && !request.params[3].isNull()) {
+        nCount = request.params[3].get_int();
+    }
+    if (nStartHeight < 0 || nSkip < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           "Negative start height or skip");
+    }
+    if (nCount < 0 || nCount > MAX_ADDRESS_HISTORY_COUNT) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Count out of range");
+    }
+
+    const int nHeight = GetAddressIndexHeight();
+    AddressHistoryEntries entries;
+    if (!pblocktree->ReadAddressHistory(scriptHash, nStartHeight, nSkip,
+                                        nCount, entries)) {
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index");
+    }
+
+    UniValue history(UniValue::VARR);
+    history.reserve(entries.size());
+    for (const auto &entry : entries) {
+        const CAddressHistoryKey &key = entry.first;
+        const CAddressIndexValue &value = entry.second;
+        UniValue item(UniValue::VOBJ);
+        item.push_back(Pair("txid", key.txid.GetHex()));
+        item.push_back(Pair("height", int64_t(key.nHeight)));
+        item.push_back(
+            Pair(key.fSpending ? "vin" : "vout", int64_t(key.nIndex)));
+        item.push_back(Pair("value", ValueFromAmount(key.fSpending
+                                                         ? -value.nValue
+                                                         : value.nValue)));
+        if (GetAddressIndexUnlockHeight(value)) {
+            item.push_back(
+                Pair("principal", ValueFromAmount(value.nPrincipal)));
+            item.push_back(Pair("interest", ValueFromAmount(value.nInterest)));
+        }
+        history.push_back(std::move(item));
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", nHeight));
+    ret.push_back(Pair("history", std::move(history)));
+    return ret;
+}
+
 // clang-format off
 static const CRPCCommand commands[] = {
-    //  category            name                      actor (function)        okSafe argNames
+    //  category            name                      actor (function)        okSafe argNames, concurrent
     //  ------------------- ------------------------  ----------------------  ------ ----------
     { "blockchain",         "getblockchaininfo",      getblockchaininfo,      true,  {} },
-    { "blockchain",         "getbestblockhash",       getbestblockhash,       true,  {} },
-    { "blockchain",         "getblockcount",          getblockcount,          true,  {} },
-    { "blockchain",         "getblock",               getblock,               true,  {"blockhash","verbose"} },
-    { "blockchain",         "getblockhash",           getblockhash,           true,  {"height"} },
-    { "blockchain",         "getblockheader",         getblockheader,         true,  {"blockhash","verbose"} },
+    { "blockchain",         "getbestblockhash",       getbestblockhash,       true,  {}, true },
+    { "blockchain",         "getblockcount",          getblockcount,          true,  {}, true },
+    { "blockchain",         "getblock",               getblock,               true,  {"blockhash","verbose"}, true },
+    { "blockchain",         "getblockhash",           getblockhash,           true,  {"height"}, true },
+    { "blockchain",         "getblockheader",         getblockheader,         true,  {"blockhash","verbose"}, true },
+    { "blockchain",         "getpowproof",            getpowproof,            true,  {"hash","verbose"}, true },
     { "blockchain",         "getchaintips",           getchaintips,           true,  {} },
     { "blockchain",         "getdifficulty",          getdifficulty,          true,  {} },
     { "blockchain",         "getmempoolancestors",    getmempoolancestors,    true,  {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  getmempooldescendants,  true,  {"txid","verbose"} },
-    { "blockchain",         "getmempoolentry",        getmempoolentry,        true,  {"txid"} },
+    { "blockchain",         "getmempoolentry",        getmempoolentry,        true,  {"txid"}, true },
     { "blockchain",         "getmempoolinfo",         getmempoolinfo,         true,  {} },
-    { "blockchain",         "getrawmempool",          getrawmempool,          true,  {"verbose"} },
-    { "blockchain",         "gettxout",               gettxout,               true,  {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "getrawmempool",          getrawmempool,          true,  {"verbose","mempool_sequence"} },
+    { "blockchain",         "getmempooldelta",        getmempooldelta,        true,  {"since","count"}, true },
+    { "blockchain",         "gettxout",               gettxout,               true,  {"txid","n","include_mempool","include_content"}, true },
+    { "blockchain",         "getdepositunlocks",      getdepositunlocks,      true,  {"minheight","maxheight","verbose"} },
+    { "blockchain",         "getblockstats",          getblockstats,          true,  {"startheight","endheight"}, true },
+    { "blockchain",         "getaddressbalance",      getaddressbalance,      true,  {"address"}, true },
+    { "blockchain",         "getaddressutxos",        getaddressutxos,        true,  {"address"}, true },
+    { "blockchain",         "getaddresshistory",      getaddresshistory,      true,  {"address","startheight","skip","count"}, true },
+    { "blockchain",         "gettxoutsetinfo",        gettxoutsetinfo,        true,  {"hash_type"} },
+    { "blockchain",         "dumptxoutset",           dumptxoutset,           true,  {"path"} },
+    { "blockchain",         "loadtxoutset",           loadtxoutset,           true,  {"path"} },
     { "blockchain",         "pruneblockchain",        pruneblockchain,        true,  {"height"} },
     { "blockchain",         "verifychain",            verifychain,            true,  {"checklevel","nblocks"} },
     { "blockchain",         "preciousblock",          preciousblock,          true,  {"blockhash"} },
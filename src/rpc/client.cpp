@@ -72,6 +72,7 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"sendmany", 1, "amounts"},
     {"sendmany", 2, "minconf"},
     {"sendmany", 4, "subtractfeefrom"},
+    {"sendmany", 5, "lockdays"},
     {"deposittoaddress", 0, "lockdays"},
     {"deposittoaddress", 1, "principal"},
     {"addmultisigaddress", 0, "nrequired"},
@@ -83,19 +84,48 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"listunspent", 2, "addresses"},
     {"getblock", 1, "verbose"},
     {"getblockheader", 1, "verbose"},
+    {"getpowproof", 1, "verbose"},
     {"gettransaction", 1, "include_watchonly"},
     {"getrawtransaction", 1, "verbose"},
     {"createrawtransaction", 0, "inputs"},
     {"createrawtransaction", 1, "outputs"},
     {"signrawtransaction", 1, "prevtxs"},
     {"signrawtransaction", 2, "privkeys"},
+    {"signrawtransactions", 0, "hexstrings"},
+    {"signrawtransactions", 1, "prevtxs"},
+    {"signrawtransactions", 2, "privkeys"},
     {"sendrawtransaction", 1, "allowhighfees"},
+    {"sendrawtransactions", 0, "hexstrings"},
+    {"sendrawtransactions", 1, "allowhighfees"},
     {"getlockinterest", 0, "lockdays"},
     {"getlockinterest", 1, "principal"},
+    {"getinterestlist", 0, "count"},
+    {"getinterestlist", 1, "skip"},
+    {"getinterestlist", 2, "minheight"},
+    {"getinterestlist", 3, "maxheight"},
+    {"getinterestpaid", 0, "startheight"},
+    {"getinterestpaid", 1, "endheight"},
+    {"getinterestperiods", 0, "height"},
+    {"waitforevents", 0, "cursor"},
+    {"waitforevents", 1, "timeout"},
+    {"waitforevents", 2, "types"},
+    {"getrpcstats", 0, "reset"},
+    {"getlockstats", 0, "reset"},
     {"fundrawtransaction", 1, "options"},
     {"gettxout", 1, "n"},
+    {"getdepositunlocks", 0, "minheight"},
+    {"getdepositunlocks", 1, "maxheight"},
+    {"getdepositunlocks", 2, "verbose"},
+    {"getblockstats", 0, "startheight"},
+    {"getblockstats", 1, "endheight"},
+    {"getaddresshistory", 1, "startheight"},
+    {"getaddresshistory", 2, "skip"},
+    {"getaddresshistory", 3, "count"},
     {"gettxout", 2, "include_mempool"},
+    {"gettxout", 3, "include_content"},
     {"gettxoutproof", 0, "txids"},
+    {"gettxoutproofs", 0, "txids"},
+    {"gettxoutproofs", 1, "separate"},
     {"lockunspent", 0, "unlock"},
     {"lockunspent", 1, "transactions"},
     {"importprivkey", 2, "rescan"},
@@ -109,6 +139,9 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"pruneblockchain", 0, "height"},
     {"keypoolrefill", 0, "newsize"},
     {"getrawmempool", 0, "verbose"},
+    {"getrawmempool", 1, "mempool_sequence"},
+    {"getmempooldelta", 0, "since"},
+    {"getmempooldelta", 1, "count"},
     {"estimatefee", 0, "nblocks"},
     {"estimatepriority", 0, "nblocks"},
     {"estimatesmartfee", 0, "nblocks"},
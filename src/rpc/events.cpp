@@ -0,0 +1,279 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/events.h"
+
+#include "chain.h"
+#include "config.h"
+#include "rpc/server.h"
+#include "txmempool.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+#include "validation.h"
+#include "validationinterface.h"
+#include "worktable.h"
+
+#include <chrono>
+#include <iterator>
+
+CRPCEventLog rpcEventLog;
+
+std::string RPCEventTypeName(RPCEventType type) {
+    switch (type) {
+        case RPC_EVENT_TIP:
+            return "tip";
+        case RPC_EVENT_WORK:
+            return "work";
+        case RPC_EVENT_MEMPOOL:
+            return "mempool";
+        default:
+            return "";
+    }
+}
+
+CRPCEventLog::CRPCEventLog(size_t nMaxEventsIn)
+    : nMaxEvents(nMaxEventsIn), fStopped(false) {
+    nLast = nDropped = GetTimeMicros();
+    for (uint64_t &nLastType : nLastOfType) {
+        nLastType = nLast;
+    }
+}
+
+void CRPCEventLog::Add(RPCEventType type, UniValue event) {
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        Entry entry;
+        entry.nSeq = ++nLast;
+        entry.type = type;
+        entry.event.setObject();
+        entry.event.reserve(event.size() + 2);
+        entry.event.pushKVEnd("type", RPCEventTypeName(type));
+        entry.event.pushKVEnd("seq", (int64_t)entry.nSeq);
+        for (size_t i = 0; i < event.size(); i++) {
+            entry.event.pushKVEnd(event.getKeys()[i], event[i]);
+        }
+        events.push_back(std::move(entry));
+        nLastOfType[type] = nLast;
+        while (events.size() > nMaxEvents) {
+            nDropped = events.front().nSeq;
+            events.pop_front();
+        }
+    }
+    cond.notify_all();
+}
+
+uint64_t CRPCEventLog::GetCursor() {
+    std::lock_guard<std::mutex> lock(cs);
+    return nLast;
+}
+
+uint64_t CRPCEventLog::Wait(uint64_t nCursor, unsigned int nTypes,
+                            int64_t nTimeoutMs, std::vector<UniValue> &vEvents,
+                            bool &fReset) {
+    std::unique_lock<std::mutex> lock(cs);
+    cond.wait_for(lock, std::chrono::milliseconds(nTimeoutMs), [&] {
+        if (fStopped || nCursor < nDropped || nCursor > nLast) {
+            return true;
+        }
+        for (int type = 0; type < RPC_EVENT_TYPES; type++) {
+            if ((nTypes & (1u << type)) && nLastOfType[type] > nCursor) {
+                return true;
+            }
+        }
+        return false;
+    });
+
+    fReset = nCursor < nDropped || nCursor > nLast;
+    if (fReset) {
+        return nLast;
+    }
+    std::deque<Entry>::const_iterator it = events.end();
+    while (it != events.begin() && std::prev(it)->nSeq > nCursor) {
+        --it;
+    }
+    for (; it != events.end(); ++it) {
+        if (nTypes & (1u << it->type)) {
+            vEvents.push_back(it->event);
+        }
+    }
+    return nLast;
+}
+
+void CRPCEventLog::Start() {
+    std::lock_guard<std::mutex> lock(cs);
+    fStopped = false;
+}
+
+void CRPCEventLog::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStopped = true;
+    }
+    cond.notify_all();
+}
+
+/** Records new tips and mining jobs */
+class CRPCEventListener : public CValidationInterface {
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew,
+                         const CBlockIndex *pindexFork,
+                         bool fInitialDownload) override {
+        UniValue event(UniValue::VOBJ);
+        event.pushKVEnd("hash", pindexNew->GetBlockHash().GetHex());
+        event.pushKVEnd("height", pindexNew->nHeight);
+        rpcEventLog.Add(RPC_EVENT_TIP, std::move(event));
+    }
+
+    void NewMiningWork(const Work &work) override {
+        // The same as eth_getWork returns, and the height.
+        UniValue event(UniValue::VOBJ);
+        event.pushKVEnd("header", ethash_h256_encode(work.blockEthash));
+        event.pushKVEnd("seed", ethash_h256_encode(ethash_get_seedhash(
+                                    work.block.nBlockHeight)));
+        event.pushKVEnd("boundary", ethash_h256_encode(work.boundary));
+        event.pushKVEnd("height", (int64_t)work.block.nBlockHeight);
+        rpcEventLog.Add(RPC_EVENT_WORK, std::move(event));
+    }
+};
+
+static CRPCEventListener rpcEventListener;
+
+static void RPCEventMempoolAdded(CTransactionRef tx) {
+    UniValue event(UniValue::VOBJ);
+    event.pushKVEnd("action", "added");
+    event.pushKVEnd("txid", tx->GetId().GetHex());
+    rpcEventLog.Add(RPC_EVENT_MEMPOOL, std::move(event));
+}
+
+static void RPCEventMempoolRemoved(CTransactionRef tx,
+                                   MemPoolRemovalReason reason) {
+    // The tip event stands for the transactions of the new block, there can
+    // be thousands of them.
+    if (reason == MemPoolRemovalReason::BLOCK) {
+        return;
+    }
+    UniValue event(UniValue::VOBJ);
+    event.pushKVEnd("action", "removed");
+    event.pushKVEnd("txid", tx->GetId().GetHex());
+    event.pushKVEnd("reason", RemovalReasonToString(reason));
+    rpcEventLog.Add(RPC_EVENT_MEMPOOL, std::move(event));
+}
+
+void StartRPCEvents() {
+    rpcEventLog.Start();
+    RegisterValidationInterface(&rpcEventListener);
+    mempool.NotifyEntryAdded.connect(&RPCEventMempoolAdded);
+    mempool.NotifyEntryRemoved.connect(&RPCEventMempoolRemoved);
+}
+
+void StopRPCEvents() {
+    mempool.NotifyEntryRemoved.disconnect(&RPCEventMempoolRemoved);
+    mempool.NotifyEntryAdded.disconnect(&RPCEventMempoolAdded);
+    UnregisterValidationInterface(&rpcEventListener);
+    rpcEventLog.Stop();
+}
+
+static UniValue waitforevents(const Config &config,
+                              const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() > 3) {
+        throw std::runtime_error(
+            "waitforevents ( cursor timeout [\"type\",...] )\n"
+            "\nWaits for events after cursor and returns them, instead of "
+            "polling for changes.\n"
+            "Without a cursor, returns the cursor to start from right away. "
+            "Pass the cursor of each result to the next call.\n"
+            "\nArguments:\n"
+            "1. cursor   (numeric, optional) The cursor of the previous "
+            "result\n"
+            "2. timeout  (numeric, optional, default=" +
+            std::to_string(DEFAULT_RPC_EVENT_TIMEOUT) +
+            ") Time in milliseconds to wait for an event\n"
+            "3. types    (array, optional, default=all) The types of events "
+            "to wait for and return:\n"
+            "     \"tip\"      the active chain has a new tip: hash, height\n"
+            "     \"work\"     there is a new mining job: header, seed, "
+            "boundary as eth_getWork returns them, height\n"
+            "     \"mempool\"  a transaction entered the mempool, or left it "
+            "other than for a block: action (\"added\" or \"removed\"), "
+            "txid, reason if removed\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"cursor\" : n,         (numeric) The cursor to pass next\n"
+            "  \"reset\" : true|false, (boolean) Whether events after cursor "
+            "were dropped already, or cursor is of an earlier run. Nothing is "
+            "returned then, start over from the current state.\n"
+            "  \"events\" : [          (array) The events in order, each "
+            "with its type and seq besides the fields above\n"
+            "    { \"type\" : \"tip\", \"seq\" : n, ... },\n"
+            "    ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("waitforevents", "") +
+            HelpExampleCli("waitforevents", "1526651423000042 30000 "
+                                            "'[\"tip\",\"work\"]'") +
+            HelpExampleRpc("waitforevents", "1526651423000042, 30000"));
+    }
+
+    UniValue result(UniValue::VOBJ);
+    std::vector<UniValue> vEvents;
+    bool fReset = false;
+    uint64_t nCursor;
+    if (request.params.size() < 1 || request.params[0].isNull()) {
+        nCursor = rpcEventLog.GetCursor();
+    } else {
+        int64_t nTimeout = DEFAULT_RPC_EVENT_TIMEOUT;
+        if (request.params.size() > 1 && !request.params[1].isNull()) {
+            nTimeout = request.params[1].get_int64();
+            if (nTimeout < 0) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER,
+                                   "Negative timeout");
+            }
+        }
+        unsigned int nTypes = (1u << RPC_EVENT_TYPES) - 1;
+        if (request.params.size() > 2 && !request.params[2].isNull()) {
+            nTypes = 0;
+            const UniValue &types = request.params[2].get_array();
+            for (const UniValue &type : types.getValues()) {
+                int n = 0;
+                while (n < RPC_EVENT_TYPES &&
+                       RPCEventTypeName(RPCEventType(n)) != type.get_str()) {
+                    n++;
+                }
+                if (n == RPC_EVENT_TYPES) {
+                    throw JSONRPCError(RPC_INVALID_PARAMETER,
+                                       "Unknown event type " + type.get_str());
+                }
+                nTypes |= 1u << n;
+            }
+        }
+        const int64_t nStart = request.params[0].get_int64();
+        if (nStart < 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative cursor");
+        }
+        nCursor = rpcEventLog.Wait(nStart, nTypes, nTimeout, vEvents, fReset);
+    }
+
+    result.pushKVEnd("cursor", (int64_t)nCursor);
+    result.pushKVEnd("reset", fReset);
+    UniValue events(UniValue::VARR);
+    events.reserve(vEvents.size());
+    for (UniValue &event : vEvents) {
+        events.push_back(std::move(event));
+    }
+    result.pushKVEnd("events", std::move(events));
+    return result;
+}
+
+static const CRPCCommand commands[] = {
+    //  category            name                      actor (function)        okSafe argNames
+    //  ------------------- ------------------------  ----------------------  ------ ----------
+    { "events",             "waitforevents",          waitforevents,          true,  {"cursor","timeout","types"} },
+};
+
+void RegisterEventsRPCCommands(CRPCTable &t) {
+    for (unsigned int vcidx = 0; vcidx < ARRAYLEN(commands); vcidx++) {
+        t.appendCommand(commands[vcidx].name, &commands[vcidx]);
+    }
+}
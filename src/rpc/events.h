@@ -0,0 +1,95 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPCEVENTS_H
+#define BITCOIN_RPCEVENTS_H
+
+#include <univalue.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** Events kept for waitforevents, for clients that fall behind */
+static const size_t RPC_EVENT_LOG_SIZE = 10000;
+/** Milliseconds waitforevents waits for an event by default */
+static const int64_t DEFAULT_RPC_EVENT_TIMEOUT = 30000;
+
+enum RPCEventType {
+    //! The active chain has a new tip
+    RPC_EVENT_TIP,
+    //! There is a new mining job
+    RPC_EVENT_WORK,
+    //! A transaction entered or left the mempool
+    RPC_EVENT_MEMPOOL,
+    RPC_EVENT_TYPES
+};
+
+/** The name of an event type, as waitforevents takes and returns it */
+std::string RPCEventTypeName(RPCEventType type);
+
+/**
+ * The latest events, numbered in order, for clients that wait for the next
+ * ones instead of polling. A client keeps the cursor of the last call and
+ * gets what happened since. Numbers start from the time the log was made, so
+ * a cursor of an earlier run of the node is behind all of them.
+ */
+class CRPCEventLog {
+public:
+    explicit CRPCEventLog(size_t nMaxEventsIn = RPC_EVENT_LOG_SIZE);
+
+    /** Add an event, with its "type" and "seq" added to it */
+    void Add(RPCEventType type, UniValue event);
+
+    /** The cursor that has all events up to now behind it */
+    uint64_t GetCursor();
+
+    /**
+     * Wait up to nTimeoutMs for events after nCursor whose type is in the
+     * mask nTypes, 1 << type for each, and add them to vEvents. Returns the
+     * cursor to wait from next. fReset tells that some events after nCursor
+     * were dropped already, or that nCursor isn't one of this log. Nothing
+     * is returned then, the client should start over from the state the
+     * events are about.
+     */
+    uint64_t Wait(uint64_t nCursor, unsigned int nTypes, int64_t nTimeoutMs,
+                  std::vector<UniValue> &vEvents, bool &fReset);
+
+    /** Let calls wait, after Stop */
+    void Start();
+    /** Wake the calls that wait and return right away from now on */
+    void Stop();
+
+private:
+    struct Entry {
+        uint64_t nSeq;
+        RPCEventType type;
+        UniValue event;
+    };
+
+    const size_t nMaxEvents;
+    std::mutex cs;
+    std::condition_variable cond;
+    std::deque<Entry> events;
+    //! Number of the last event, and of the last one dropped
+    uint64_t nLast;
+    uint64_t nDropped;
+    //! Number of the last event of each type
+    uint64_t nLastOfType[RPC_EVENT_TYPES];
+    bool fStopped;
+};
+
+/** The events of the node */
+extern CRPCEventLog rpcEventLog;
+
+/** Start recording the events of the node in rpcEventLog */
+void StartRPCEvents();
+/** Stop recording them, and wake up the calls that wait */
+void StopRPCEvents();
+
+#endif // BITCOIN_RPCEVENTS_H
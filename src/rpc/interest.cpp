@@ -14,6 +14,7 @@
 #include "net.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "rpc/tojson.h"
 #include "script/script.h"
@@ -29,6 +30,7 @@
 #endif
 #include "validation.h"
 #include <cstdint>
+#include <limits>
 #include <univalue.h>
 
 static UniValue getinterestinfo(const Config &config,
@@ -88,6 +90,117 @@ static UniValue getinterestinfo(const Config &config,
     return results;
 }
 
+static UniValue getinterestpaid(const Config &config,
+                                const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 ||
+        request.params.size() > 2) {
+        throw std::runtime_error(
+            "getinterestpaid startheight ( endheight )\n"
+            "\nReturns the interest paid out by the blocks of the active "
+            "chain from startheight to endheight.\n"
+            "\nArguments:\n"
+            "1. startheight    (numeric, required) The first block\n"
+            "2. endheight      (numeric, optional) The last block, the tip "
+            "by default\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"startheight\": n,       (numeric) The first block\n"
+            "  \"endheight\": n,         (numeric) The last block\n"
+            "  \"interest\": xxx,        (numeric) Interest paid out by the "
+            "blocks\n"
+            "  \"chaininterest\": xxx    (numeric) Interest paid out up to "
+            "and including the last block\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getinterestpaid", "1000 2000") +
+            HelpExampleRpc("getinterestpaid", "1000, 2000"));
+    }
+
+    const int nStart = request.params[0].get_int();
+    int nEnd = GetChainSnapshot()->Height();
+    if (request.params.size() > 1 && !request.params[1].isNull()) {
+        nEnd = request.params[1].get_int();
+    }
+    if (nStart < 0 || nEnd < nStart) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid height range");
+    }
+
+    uint64_t nEndInterest, nBeforeInterest = 0;
+    if (!GetChainInterestAt(nEnd, nEndInterest) ||
+        (nStart > 0 && !GetChainInterestAt(nStart - 1, nBeforeInterest))) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+    }
+
+    UniValue results(UniValue::VOBJ);
+    results.pushKVEnd("startheight", nStart);
+    results.pushKVEnd("endheight", nEnd);
+    results.pushKVEnd("interest",
+                      ValueFromAmount(CAmount(nEndInterest - nBeforeInterest)));
+    results.pushKVEnd("chaininterest", ValueFromAmount(CAmount(nEndInterest)));
+    return results;
+}
+
+/** The getinterestperiods entry of a period */
+static UniValue PeriodToJSON(const CInterestHistory::PeriodStart &start) {
+    UniValue item(UniValue::VOBJ);
+    item.pushKVEnd("startheight", start.nHeight);
+    item.pushKVEnd("period", start.nPeriod);
+    if (start.nPeriod != CInterestHistory::NO_PERIOD) {
+        const CInterestTable &table = Params().InterestTable();
+        item.pushKVEnd("interestleft",
+                       ValueFromAmount(table.GetPeriodStart(start.nPeriod)));
+        item.pushKVEnd("minrate", table.GetRate(0, start.nPeriod));
+    }
+    return item;
+}
+
+static UniValue getinterestperiods(const Config &config,
+                                   const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() > 1) {
+        throw std::runtime_error(
+            "getinterestperiods ( height )\n"
+            "\nReturns the interest decay periods of the active chain and the "
+            "heights they start at, the first block paying their rates. Once "
+            "all interest is paid out the period is -1.\n"
+            "\nArguments:\n"
+            "1. height         (numeric, optional) Only the period of the "
+            "block at this height, up to the one after the tip\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"startheight\": n,     (numeric) First block of the period\n"
+            "    \"period\": n,          (numeric) The period\n"
+            "    \"interestleft\": xxx,  (numeric) Interest left when the "
+            "period starts\n"
+            "    \"minrate\": x.xxx      (numeric) Rate of the shortest lock "
+            "per 100 days\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+            "\nWith a height, the object of its period only.\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getinterestperiods", "") +
+            HelpExampleCli("getinterestperiods", "1000") +
+            HelpExampleRpc("getinterestperiods", "1000"));
+    }
+
+    if (request.params.size() > 0 && !request.params[0].isNull()) {
+        CInterestHistory::PeriodStart start;
+        if (!GetInterestPeriodAtHeight(request.params[0].get_int(), start)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER,
+                               "Block height out of range");
+        }
+        return PeriodToJSON(start);
+    }
+
+    UniValue results(UniValue::VARR);
+    for (const CInterestHistory::PeriodStart &start :
+         GetInterestPeriodStarts()) {
+        results.push_back(PeriodToJSON(start));
+    }
+    return results;
+}
+
 static UniValue getmyinterest(const Config &config,
                                   const JSONRPCRequest &request) {
     if (request.fHelp || request.params.size() != 0) {
@@ -114,33 +227,63 @@ static UniValue getmyinterest(const Config &config,
     }
 
 
-    CAmount principal(0);
-    CAmount interest(0);
-    int currentHeight = chainActive.Height();
-
-    std::vector<CTxOutVerbose> vDepositItem;
-    pwalletMain->GetAllDeposit(vDepositItem);
-    for(std::vector<CTxOutVerbose>::iterator i = vDepositItem.begin(); i != vDepositItem.end(); ++i)
-    {
-        if(currentHeight - i->height + 1 <= i->nLockTime)
-        {
-            principal += i->nPrincipal;
-            interest += i->nValue - i->nPrincipal;
-        }
-    }
+    // Only deposits still locked at the tip, kept up with the balances.
+    const CWalletBalances balances = pwalletMain->GetBalances();
     UniValue results(UniValue::VOBJ);
-    results.push_back(Pair("LockedPrincipal", ValueFromAmount(principal)));
-    results.push_back(Pair("LockedInterest", ValueFromAmount(interest)));
+    results.push_back(
+        Pair("LockedPrincipal", ValueFromAmount(balances.nLockedPrincipal)));
+    results.push_back(
+        Pair("LockedInterest", ValueFromAmount(balances.nLockedInterest)));
     return results;
 }
 
+/** Blocks until a deposit unlocks, 0 or less once it has */
+static int DepositRemainingBlocks(const CTxOutVerbose &deposit,
+                                  int currentHeight) {
+    return deposit.nLockTime - (currentHeight - deposit.height + 1) + 1;
+}
+
+/** The getinterestlist entry of a deposit */
+static UniValue DepositToJSON(const CTxOutVerbose &deposit,
+                              int currentHeight) {
+    const int remianBlocks = DepositRemainingBlocks(deposit, currentHeight);
+    UniValue item(UniValue::VOBJ);
+    item.reserve(7);
+    item.pushKVEnd("txid", deposit.txid.GetHex());
+    item.pushKVEnd("vout", deposit.n);
+    if (remianBlocks > 0) {
+        const int remainDays = (remianBlocks + (Params().BlocksPerDay() - 1)) /
+                               Params().BlocksPerDay();
+        item.pushKVEnd("remianBlocks", remianBlocks);
+        item.pushKVEnd("remainDays", remainDays);
+    }
+    char interestRateStr[20] = {0};
+    sprintf(interestRateStr, "%.5f%%",
+            GetInterestRate(deposit.nLockTime, deposit.height) * 100);
+    item.pushKVEnd("interestRatePer100Days", interestRateStr);
+    item.pushKVEnd("principal", ValueFromAmount(deposit.nPrincipal));
+    item.pushKVEnd("interest",
+                   ValueFromAmount(deposit.nValue - deposit.nPrincipal));
+    return item;
+}
+
 static UniValue getinterestlist(const Config &config,
         const JSONRPCRequest &request) {
 
-    if (request.fHelp || request.params.size() != 0) {
+    if (request.fHelp || request.params.size() > 4) {
         throw std::runtime_error(
-            "getinterestlist\n"
-            "\nReturns all interest list.\n"
+            "getinterestlist ( count skip minheight maxheight )\n"
+            "\nReturns all interest list, in unlock height order. Deposits not "
+            "in a block yet come last.\n"
+            "\nArguments:\n"
+            "1. count          (numeric, optional) The number of deposits to "
+            "return, all by default\n"
+            "2. skip           (numeric, optional, default=0) The number of "
+            "deposits to skip\n"
+            "3. minheight      (numeric, optional, default=0) Only deposits "
+            "unlocking at this height or later\n"
+            "4. maxheight      (numeric, optional) Only deposits unlocking at "
+            "this height or earlier\n"
             "\nResult:\n"
             "{\n"
             "  \"lockedDeposit\":       locked deposit transactions\n"
@@ -170,51 +313,80 @@ static UniValue getinterestlist(const Config &config,
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getinterestlist", "") +
-            HelpExampleRpc("getinterestlist", ""));
+            "\nThe first 100 deposits unlocking from height 20000 on\n" +
+            HelpExampleCli("getinterestlist", "100 0 20000") +
+            HelpExampleRpc("getinterestlist", "100, 0, 20000"));
     }
 
-    const int currentHeight = chainActive.Height();
+    int nCount = std::numeric_limits<int>::max();
+    if (request.params.size() > 0 && !request.params[0].isNull()) {
+        nCount = request.params[0].get_int();
+    }
+    int nFrom = 0;
+    if (request.params.size() > 1 && !request.params[1].isNull()) {
+        nFrom = request.params[1].get_int();
+    }
+    int nMinHeight = 0;
+    if (request.params.size() > 2 && !request.params[2].isNull()) {
+        nMinHeight = request.params[2].get_int();
+    }
+    int nMaxHeight = std::numeric_limits<int>::max();
+    if (request.params.size() > 3 && !request.params[3].isNull()) {
+        nMaxHeight = request.params[3].get_int();
+    }
+    if (nCount < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+    }
+    if (nFrom < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative skip");
+    }
+
+    const int currentHeight = GetChainSnapshot()->Height();
 
     std::vector<CTxOutVerbose> vDepositItem;
-    pwalletMain->GetAllDeposit(vDepositItem);
+    pwalletMain->GetAllDeposit(vDepositItem, nMinHeight, nMaxHeight);
+    if (nFrom > (int)vDepositItem.size()) {
+        nFrom = vDepositItem.size();
+    }
+    if (nCount > (int)vDepositItem.size() - nFrom) {
+        nCount = vDepositItem.size() - nFrom;
+    }
+    const std::vector<CTxOutVerbose>::const_iterator first =
+        vDepositItem.begin() + nFrom;
+    const std::vector<CTxOutVerbose>::const_iterator last = first + nCount;
+
+    if (request.pStream) {
+        // The locked deposits in one pass and the finished ones in another.
+        CJSONStreamWriter &stream = *request.pStream;
+        stream.BeginObject();
+        for (bool fLocked : {true, false}) {
+            stream.Key(fLocked ? "lockedDeposit" : "finishedDeposit");
+            stream.BeginArray();
+            for (auto i = first; i != last && !stream.Failed(); ++i) {
+                if ((DepositRemainingBlocks(*i, currentHeight) > 0) ==
+                    fLocked) {
+                    stream.Value(DepositToJSON(*i, currentHeight));
+                }
+            }
+            stream.EndArray();
+        }
+        stream.EndObject();
+        return NullUniValue;
+    }
+
     UniValue lockedArray(UniValue::VARR);
     UniValue releasedArray(UniValue::VARR);
-    for(std::vector<CTxOutVerbose>::iterator i = vDepositItem.begin(); i != vDepositItem.end(); ++i)
-    {
-        int remianBlocks = i->nLockTime - (currentHeight - i->height + 1) + 1;
-        int remainDays = (remianBlocks + (Params().BlocksPerDay() - 1)) / Params().BlocksPerDay();
-        UniValue item(UniValue::VOBJ);
-        if(remianBlocks <= 0)
-        {
-            item.push_back(Pair("txid", i->txid.GetHex()));
-            item.push_back(Pair("vout", i->n));
-            char interestRateStr[20] = {0};
-            sprintf(interestRateStr, "%.5f%%", GetInterestRate(i->nLockTime, i->height) * 100);
-            item.push_back(Pair("interestRatePer100Days", interestRateStr));
-            item.push_back(Pair("principal", ValueFromAmount(i->nPrincipal)));
-            item.push_back(Pair("interest", ValueFromAmount(i->nValue - i->nPrincipal)));
-
-            releasedArray.push_back(item);
-        }
-        else
-        {
-            item.push_back(Pair("txid", i->txid.GetHex()));
-            item.push_back(Pair("vout", i->n));
-            item.push_back(Pair("remianBlocks", remianBlocks));
-            item.push_back(Pair("remainDays", remainDays));
-            char interestRateStr[20] = {0};
-            sprintf(interestRateStr, "%.5f%%", GetInterestRate(i->nLockTime, i->height) * 100);
-            item.push_back(Pair("interestRatePer100Days", interestRateStr));
-            item.push_back(Pair("principal", ValueFromAmount(i->nPrincipal)));
-            item.push_back(Pair("interest", ValueFromAmount(i->nValue - i->nPrincipal)));
-
-            lockedArray.push_back(item);
+    for (auto i = first; i != last; ++i) {
+        if (DepositRemainingBlocks(*i, currentHeight) > 0) {
+            lockedArray.push_back(DepositToJSON(*i, currentHeight));
+        } else {
+            releasedArray.push_back(DepositToJSON(*i, currentHeight));
         }
     }
 
     UniValue results(UniValue::VOBJ);
-    results.push_back(Pair("lockedDeposit", lockedArray));
-    results.push_back(Pair("finishedDeposit", releasedArray));
+    results.pushKVEnd("lockedDeposit", std::move(lockedArray));
+    results.pushKVEnd("finishedDeposit", std::move(releasedArray));
     return results;
 }
 
@@ -266,8 +438,10 @@ static const CRPCCommand commands[] = {
     //  category            name                      actor (function)        okSafeMode
     //  ------------------- ------------------------  ----------------------  ----------
     { "interest",   "getinterestinfo",      getinterestinfo,    true,   {} },
+    { "interest",   "getinterestpaid",      getinterestpaid,    true,   {"startheight", "endheight"} },
+    { "interest",   "getinterestperiods",   getinterestperiods, true,   {"height"} },
     { "interest",   "getmyinterest",        getmyinterest,      false,  {} },
-    { "interest",   "getinterestlist",      getinterestlist,    false,  {} },
+    { "interest",   "getinterestlist",      getinterestlist,    false,  {"count", "skip", "minheight", "maxheight"} },
     { "interest",   "getlockinterest",      getlockinterest,    true,   {"lockdays", "principal"} },
 };
 
@@ -0,0 +1,94 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonstream.h"
+
+#include <univalue.h>
+
+#include <cassert>
+
+CJSONStreamWriter::CJSONStreamWriter(const Sink &sinkIn, size_t nChunkSizeIn)
+    : sink(sinkIn), nChunkSize(nChunkSizeIn), fAfterKey(false),
+      fWritten(false), fFailed(false) {
+    strBuffer.reserve(nChunkSize);
+}
+
+void CJSONStreamWriter::Separate() {
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (vHasEntries.empty()) {
+        return;
+    }
+    if (vHasEntries.back()) {
+        Append(",");
+    }
+    vHasEntries.back() = true;
+}
+
+void CJSONStreamWriter::Append(const std::string &str) {
+    fWritten = true;
+    if (fFailed) {
+        return;
+    }
+    strBuffer += str;
+    if (strBuffer.size() >= nChunkSize) {
+        Flush();
+    }
+}
+
+void CJSONStreamWriter::BeginObject() {
+    Separate();
+    Append("{");
+    vHasEntries.push_back(false);
+}
+
+void CJSONStreamWriter::EndObject() {
+    assert(!vHasEntries.empty() && !fAfterKey);
+    vHasEntries.pop_back();
+    Append("}");
+}
+
+void CJSONStreamWriter::BeginArray() {
+    Separate();
+    Append("[");
+    vHasEntries.push_back(false);
+}
+
+void CJSONStreamWriter::EndArray() {
+    assert(!vHasEntries.empty() && !fAfterKey);
+    vHasEntries.pop_back();
+    Append("]");
+}
+
+void CJSONStreamWriter::Key(const std::string &strKey) {
+    assert(!vHasEntries.empty() && !fAfterKey);
+    Separate();
+    Append(UniValue(strKey).write());
+    Append(":");
+    fAfterKey = true;
+}
+
+void CJSONStreamWriter::Value(const UniValue &value) {
+    Separate();
+    Append(value.write());
+}
+
+void CJSONStreamWriter::Entries(const UniValue &obj) {
+    const std::vector<std::string> &keys = obj.getKeys();
+    const std::vector<UniValue> &values = obj.getValues();
+    for (size_t i = 0; i < keys.size(); i++) {
+        Key(keys[i]);
+        Value(values[i]);
+    }
+}
+
+bool CJSONStreamWriter::Flush() {
+    if (!fFailed && !strBuffer.empty() && !sink(strBuffer)) {
+        fFailed = true;
+    }
+    strBuffer.clear();
+    return !fFailed;
+}
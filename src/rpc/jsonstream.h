@@ -0,0 +1,69 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPCJSONSTREAM_H
+#define BITCOIN_RPCJSONSTREAM_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+class UniValue;
+
+/** Bytes a CJSONStreamWriter collects before it passes them on */
+static const size_t JSON_STREAM_CHUNK_SIZE = 64 * 1024;
+
+/**
+ * Writes a JSON value piece by piece and passes the text on in chunks, for
+ * results too big to build as one UniValue and serialize first. Arrays and
+ * objects are opened and closed explicitly, what goes in them is written as
+ * UniValues, one at a time.
+ *
+ * The text is the same UniValue::write() gives for the whole value.
+ */
+class CJSONStreamWriter {
+public:
+    /** Takes the next chunk, returns false when it can't go anywhere anymore */
+    typedef std::function<bool(const std::string &)> Sink;
+
+    CJSONStreamWriter(const Sink &sinkIn,
+                      size_t nChunkSizeIn = JSON_STREAM_CHUNK_SIZE);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    /** The key of the next value, in an object */
+    void Key(const std::string &strKey);
+    void Value(const UniValue &value);
+    /** A key and value for each of the entries of the object obj */
+    void Entries(const UniValue &obj);
+
+    /** Pass on what is left. Returns false if the sink failed. */
+    bool Flush();
+
+    /** Whether nothing was written yet */
+    bool Empty() const { return !fWritten; }
+    /**
+     * Whether the sink failed. What is written from then on is dropped, long
+     * loops can check this to stop early.
+     */
+    bool Failed() const { return fFailed; }
+
+private:
+    void Separate();
+    void Append(const std::string &str);
+
+    const Sink sink;
+    const size_t nChunkSize;
+    std::string strBuffer;
+    //! For each open array or object, whether anything is in it yet
+    std::vector<bool> vHasEntries;
+    bool fAfterKey;
+    bool fWritten;
+    bool fFailed;
+};
+
+#endif // BITCOIN_RPCJSONSTREAM_H
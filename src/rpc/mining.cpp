@@ -12,6 +12,7 @@
 #include "consensus/validation.h"
 #include "core_io.h"
 #include "dstencode.h"
+#include "ethashcache.h"
 #include "init.h"
 #include "miner.h"
 #include "net.h"
@@ -120,9 +121,11 @@ static UniValue generateBlocks(const Config &config,
     int nHeightEnd = 0;
     int nHeight = 0;
 
-    ethash_light_t light_ethash = NULL;
-    ethash_full_t full_ethash = NULL;
-    int epochs = 0;
+    // The DAG is only valid for one epoch and is rebuilt when we cross into
+    // the next one. The light cache is shared with the rest of the node.
+    std::unique_ptr<ethash_full, decltype(&ethash_full_delete)> full_ethash(
+        nullptr, ethash_full_delete);
+    int64_t nEpoch = -1;
 
     {
         // Don't keep cs_main locked.
@@ -132,10 +135,6 @@ static UniValue generateBlocks(const Config &config,
         nHeightEnd   = nHeightStart + nGenerate;
     }
 
-    if (light_ethash == NULL) {
-        light_ethash = ethash_light_new(nHeight);
-    }
-
     unsigned int nExtraNonce = 0;
     UniValue blockHashes(UniValue::VARR);
     while (nHeight < nHeightEnd) {
@@ -147,36 +146,37 @@ static UniValue generateBlocks(const Config &config,
             throw JSONRPCError(RPC_INTERNAL_ERROR, "Couldn't create new block");
         }
 
-        if (epochs != chainActive.Height() / ETHASH_EPOCH_LENGTH) {
-            light_ethash = ethash_light_new(chainActive.Height());
-            full_ethash = ethash_full_new(light_ethash, NULL);
-            epochs = chainActive.Height() / ETHASH_EPOCH_LENGTH;
-        }
-        if (full_ethash == NULL) {
-            full_ethash = ethash_full_new(light_ethash, NULL);
-            if (full_ethash == NULL) {
-                LogPrintf("full_ethash init failed\n");
-                continue;
+        const uint64_t nBlockHeight = pblocktemplate->block.nBlockHeight;
+        if (!full_ethash ||
+            nEpoch != int64_t(nBlockHeight / ethash_get_epoch_length())) {
+            full_ethash.reset();
+            EthashLightRef light = EthashLightCache().Get(nBlockHeight);
+            if (light) {
+                full_ethash.reset(NewEthashFull(light.get(), NULL));
             }
+            if (!full_ethash) {
+                throw JSONRPCError(RPC_INTERNAL_ERROR,
+                                   "Couldn't generate the ethash DAG");
+            }
+            nEpoch = nBlockHeight / ethash_get_epoch_length();
         }
 
         CBlock *pblock = &pblocktemplate->block;
 
         {
             LOCK(cs_main);
-            IncrementExtraNonce(config, pblock, chainActive.Tip(), nExtraNonce);
+            IncrementExtraNonce(config, pblock, chainActive.Tip(), nExtraNonce,
+                                pblocktemplate->vCoinbaseMerkleBranch);
         }
 
         ethash_h256_t thash;
 
-        CBlockHeaderBase bBlock(*pblock);
-
         bool fNegative;
         bool fOverflow;
 
         arith_uint256 bnTarget;
 
-        bnTarget.SetCompact(bBlock.nBits, &fNegative, &fOverflow);
+        bnTarget.SetCompact(pblock->nBits, &fNegative, &fOverflow);
 
         // Check range
         if (fNegative || bnTarget == 0 || fOverflow ||
@@ -186,29 +186,18 @@ static UniValue generateBlocks(const Config &config,
         }
 
         ethash_h256_t boundary = bnTarget.ToEthashH256();
-        thash = bBlock.GetEthash();
-
-        while (true) {
-            // Yes, there is a chance every nonce could fail to satisfy the -regtest
-            // target -- 1 in 2^(2^32). That ain't gonna happen.
-            if (full_ethash == NULL) {
-                LogPrintf("full_ethash invalid\n");
-                break;
-            }
-            ethash_return_value_t ret = ethash_full_compute(full_ethash, thash, pblock->nNonce);
-
-            if (ethash_quick_check_difficulty( &thash, pblock->nNonce, &(ret.mix_hash), &boundary )) {
-                // Found a solution
-                pblock->hashMix = ret.mix_hash;
-                break;
-            }
-            ++pblock->nNonce;
-            --nMaxTries;
-        }
+        thash = pblock->GetBaseEthash();
 
-        if (nMaxTries == 0) {
+        uint64_t nFound;
+        ethash_return_value_t ret;
+        if (!ethash_full_search(full_ethash.get(), thash, boundary,
+                                pblock->nNonce, nMaxTries, &nFound, &ret)) {
             break;
         }
+        // Found a solution
+        nMaxTries -= nFound - pblock->nNonce;
+        pblock->nNonce = nFound;
+        pblock->hashMix = ret.mix_hash;
 
         if (pblock->nNonce == nInnerLoopCount) {
             continue;
@@ -233,6 +222,22 @@ static UniValue generateBlocks(const Config &config,
     return blockHashes;
 }
 
+/**
+ * Refuse to mine when not even the light cache of the next block fits in
+ * -minermemory, rather than leave the hashing threads waiting.
+ */
+static void CheckMinerMemoryBudget() {
+    int nHeight;
+    {
+        LOCK(cs_main);
+        nHeight = chainActive.Height() + 1;
+    }
+    std::string strError;
+    if (!mineworker->CheckMemoryBudget(nHeight, strError)) {
+        throw JSONRPCError(RPC_OUT_OF_MEMORY, strError);
+    }
+}
+
 static UniValue generate(const Config &config, const JSONRPCRequest &request) {
     if (request.fHelp || request.params.size() < 1 ||
         request.params.size() > 2) {
@@ -274,7 +279,7 @@ static UniValue generate(const Config &config, const JSONRPCRequest &request) {
             RPC_INTERNAL_ERROR,
             "No coinbase script available (mining requires a wallet)");
     }
-
+    CheckMinerMemoryBudget();
 
     UniValue blockHashes(UniValue::VARR);
     //std::vector<uint256> hashes = mineworker->MineBlocks(nGenerate);
@@ -323,6 +328,7 @@ static UniValue generatetoaddress(const Config &config,
 
     std::shared_ptr<CReserveScript> coinbaseScript(new CReserveScript());
     coinbaseScript->reserveScript = GetScriptForDestination(destination);
+    CheckMinerMemoryBudget();
 
     UniValue blockHashes(UniValue::VARR);
     //std::vector<uint256> hashes = mineworker->MineBlocks(nGenerate);
@@ -354,6 +360,36 @@ static UniValue getmininginfo(const Config &config,
             "  \"pooledtx\": n              (numeric) The size of the mempool\n"
             "  \"chain\": \"xxxx\",           (string) current network name as "
             "defined in BIP70 (main, test, regtest)\n"
+            "  \"localhashps\": nnn,        (numeric) Hashes per second of "
+            "the local mining threads\n"
+            "  \"threads\": [             (array) Mining threads\n"
+            "    {\n"
+            "      \"backend\": \"xxxx\",    (string) \"cpu\" or the GPU "
+            "it drives\n"
+            "      \"hashps\": nnn          (numeric) Hashes per second\n"
+            "    },...\n"
+            "  ],\n"
+            "  \"externalhashps\": nnn,     (numeric) Hashrate reported by "
+            "external miners through eth_submitHashrate\n"
+            "  \"jobs\": nnn,               (numeric) Jobs handed to the "
+            "mining threads\n"
+            "  \"stalejobs\": nnn,          (numeric) Jobs a new tip made "
+            "stale before they were solved\n"
+            "  \"blocksfound\": nnn,        (numeric) Mined blocks that were "
+            "accepted\n"
+            "  \"blocksrejected\": nnn,     (numeric) Mined blocks that were "
+            "stale or invalid\n"
+            "  \"dag\": {                   (json object) Ethash DAGs\n"
+            "    \"epochs\": [n,...],       (array) Epochs with a DAG ready\n"
+            "    \"lightepochs\": [n,...],  (array) Epochs mined from the "
+            "light cache, their DAG doesn't fit in -minermemory\n"
+            "    \"generating\": n,         (numeric, optional) Epoch whose "
+            "DAG is being built\n"
+            "    \"progress\": n            (numeric, optional) Percentage "
+            "of that DAG built so far\n"
+            "  },\n"
+            "  \"templateage\": n           (numeric, optional) Seconds since "
+            "the mining block template was built\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getmininginfo", "") +
@@ -374,6 +410,44 @@ static UniValue getmininginfo(const Config &config,
     obj.push_back(Pair("networkhashps", getnetworkhashps(config, request)));
     obj.push_back(Pair("pooledtx", uint64_t(mempool.size())));
     obj.push_back(Pair("chain", Params().NetworkIDString()));
+
+    if (mineworker) {
+        const MinerStats stats = mineworker->GetStats();
+        UniValue threads(UniValue::VARR);
+        for (const auto &thread : stats.vThreadHashRates) {
+            UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("backend", thread.first));
+            entry.push_back(Pair("hashps", thread.second));
+            threads.push_back(entry);
+        }
+        obj.push_back(Pair("localhashps", stats.nLocalHashRate));
+        obj.push_back(Pair("threads", threads));
+        obj.push_back(Pair("externalhashps", stats.nExternalHashRate));
+        obj.push_back(Pair("jobs", stats.nJobs));
+        obj.push_back(Pair("stalejobs", stats.nStaleJobs));
+        obj.push_back(Pair("blocksfound", stats.nBlocksFound));
+        obj.push_back(Pair("blocksrejected", stats.nBlocksRejected));
+
+        UniValue dag(UniValue::VOBJ);
+        UniValue epochs(UniValue::VARR);
+        for (int64_t nEpoch : stats.vDagEpochs) {
+            epochs.push_back(nEpoch);
+        }
+        dag.push_back(Pair("epochs", epochs));
+        UniValue lightepochs(UniValue::VARR);
+        for (int64_t nEpoch : stats.vLightEpochs) {
+            lightepochs.push_back(nEpoch);
+        }
+        dag.push_back(Pair("lightepochs", lightepochs));
+        if (stats.nDagEpochGenerating >= 0) {
+            dag.push_back(Pair("generating", stats.nDagEpochGenerating));
+            dag.push_back(Pair("progress", uint64_t(stats.nDagProgress)));
+        }
+        obj.push_back(Pair("dag", dag));
+        if (stats.nTemplateAge >= 0) {
+            obj.push_back(Pair("templateage", stats.nTemplateAge));
+        }
+    }
     return obj;
 }
 
@@ -450,6 +524,509 @@ std::string gbt_vb_name(const Consensus::DeploymentPos pos) {
     return s;
 }
 
+static UniValue getblocktemplate(const Config &config,
+                                 const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() > 1) {
+        throw std::runtime_error(
+            "getblocktemplate ( TemplateRequest )\n"
+            "\nIf the request parameters include a 'mode' key, that is used "
+            "to explicitly select between the default 'template' request or "
+            "a 'proposal'.\n"
+            "It returns data needed to construct a block to work on.\n"
+            "For full specification, see BIPs 22, 23 and 9:\n"
+            "    https://github.com/bitcoin/bips/blob/master/"
+            "bip-0022.mediawiki\n"
+            "    https://github.com/bitcoin/bips/blob/master/"
+            "bip-0023.mediawiki\n"
+            "    https://github.com/bitcoin/bips/blob/master/"
+            "bip-0009.mediawiki#getblocktemplate_changes\n"
+            "The header also commits to the block height and the chain "
+            "interest, and is solved with ethash: seedhash and boundary are "
+            "the ones eth_getWork returns for it.\n"
+
+            "\nArguments:\n"
+            "1. template_request         (json object, optional) A json "
+            "object in the following spec\n"
+            "     {\n"
+            "       \"mode\":\"template\"    (string, optional) This must be "
+            "set to \"template\", \"proposal\" (see BIP 23), or omitted\n"
+            "       \"capabilities\":[     (array, optional) A list of "
+            "strings\n"
+            "           \"support\"          (string) client side supported "
+            "feature, 'longpoll', 'coinbasetxn', 'coinbasevalue', "
+            "'proposal', 'serverlist', 'workid'\n"
+            "           ,...\n"
+            "       ],\n"
+            "       \"longpollid\":\"xxxx\"  (string, optional) Wait until "
+            "the tip changes, or the mempool does and a minute passed, before "
+            "returning the template\n"
+            "     }\n"
+            "\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"version\" : n,                    (numeric) The preferred "
+            "block version\n"
+            "  \"rules\" : [ \"rulename\", ... ],    (array of strings) "
+            "specific block rules that are to be enforced\n"
+            "  \"vbavailable\" : {                 (json object) set of "
+            "pending, supported versionbit (BIP 9) softfork deployments\n"
+            "      \"rulename\" : bitnumber          (numeric) identifies the "
+            "bit number as indicating acceptance and readiness for the named "
+            "softfork rule\n"
+            "      ,...\n"
+            "  },\n"
+            "  \"vbrequired\" : n,                 (numeric) bit mask of "
+            "versionbits the server requires set in submissions\n"
+            "  \"previousblockhash\" : \"xxxx\",     (string) The hash of "
+            "current highest block\n"
+            "  \"transactions\" : [                (array) contents of "
+            "non-coinbase transactions that should be included in the next "
+            "block\n"
+            "      {\n"
+            "         \"data\" : \"xxxx\",             (string) transaction "
+            "data encoded in hexadecimal (byte-for-byte)\n"
+            "         \"txid\" : \"xxxx\",             (string) transaction "
+            "id encoded in little-endian hexadecimal\n"
+            "         \"hash\" : \"xxxx\",             (string) hash encoded "
+            "in little-endian hexadecimal\n"
+            "         \"depends\" : [                (array) array of "
+            "numbers\n"
+            "             n                          (numeric) transactions "
+            "before this one (by 1-based index in 'transactions' list) that "
+            "must be present in the final block if this one is\n"
+            "             ,...\n"
+            "         ],\n"
+            "         \"fee\": n,                    (numeric) difference in "
+            "value between transaction inputs and outputs (in Satoshis); for "
+            "coinbase transactions, this is a negative Number of the total "
+            "collected block fees (ie, not including the block subsidy); if "
+            "key is not present, fee is unknown and clients MUST NOT assume "
+            "there isn't one\n"
+            "         \"sigops\" : n,                (numeric) total SigOps "
+            "cost, as counted for purposes of block limits; if key is not "
+            "present, sigop cost is unknown and clients MUST NOT assume it is "
+            "zero\n"
+            "      }\n"
+            "      ,...\n"
+            "  ],\n"
+            "  \"coinbaseaux\" : {                 (json object) data that "
+            "should be included in the coinbase's scriptSig content\n"
+            "      \"flags\" : \"xx\"                  (string) key name is "
+            "to be ignored, and value included in scriptSig\n"
+            "  },\n"
+            "  \"coinbasevalue\" : n,              (numeric) maximum "
+            "allowable input to coinbase transaction, including the "
+            "generation award and transaction fees (in Satoshis)\n"
+            "  \"longpollid\" : \"str\",             (string) an id to "
+            "include with a request to longpoll on an update to this "
+            "template\n"
+            "  \"target\" : \"xxxx\",                (string) The hash "
+            "target\n"
+            "  \"mintime\" : xxx,                  (numeric) The minimum "
+            "timestamp appropriate for next block time in seconds since epoch "
+            "(Jan 1 1970 GMT)\n"
+            "  \"mutable\" : [                     (array of string) list of "
+            "ways the block template may be changed\n"
+            "     \"value\"                          (string) A way the block "
+            "template may be changed, e.g. 'time', 'transactions', "
+            "'prevblock'\n"
+            "     ,...\n"
+            "  ],\n"
+            "  \"noncerange\" : \"00000000ffffffff\",(string) A range of "
+            "valid nonces\n"
+            "  \"sigoplimit\" : n,                 (numeric) limit of "
+            "sigops in blocks\n"
+            "  \"sizelimit\" : n,                  (numeric) limit of block "
+            "size\n"
+            "  \"curtime\" : ttt,                  (numeric) current "
+            "timestamp in seconds since epoch (Jan 1 1970 GMT)\n"
+            "  \"bits\" : \"xxxxxxxx\",              (string) compressed "
+            "target of next block\n"
+            "  \"height\" : n,                     (numeric) The height of "
+            "the next block\n"
+            "  \"blockheight\" : n,                (numeric) The header's "
+            "nBlockHeight, which selects the ethash epoch\n"
+            "  \"chaininterest\" : n,              (numeric) The header's "
+            "nChainInterest, which commits to the interest of the "
+            "transactions\n"
+            "  \"seedhash\" : \"0x...\",             (string) The ethash seed "
+            "hash of the block's epoch\n"
+            "  \"boundary\" : \"0x...\"              (string) The ethash "
+            "boundary the block's hash must be below\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getblocktemplate", "") +
+            HelpExampleRpc("getblocktemplate", ""));
+    }
+
+    LOCK(cs_main);
+
+    std::string strMode = "template";
+    UniValue lpval = NullUniValue;
+    if (request.params.size() > 0) {
+        const UniValue &oparam = request.params[0].get_obj();
+        const UniValue &modeval = find_value(oparam, "mode");
+        if (modeval.isStr()) {
+            strMode = modeval.get_str();
+        } else if (!modeval.isNull()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
+        }
+        lpval = find_value(oparam, "longpollid");
+
+        if (strMode == "proposal") {
+            const UniValue &dataval = find_value(oparam, "data");
+            if (!dataval.isStr()) {
+                throw JSONRPCError(RPC_TYPE_ERROR,
+                                   "Missing data String key for proposal");
+            }
+
+            CBlock block;
+            if (!DecodeHexBlk(block, dataval.get_str())) {
+                throw JSONRPCError(RPC_DESERIALIZATION_ERROR,
+                                   "Block decode failed");
+            }
+
+            uint256 hash = block.GetHash();
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
+            if (mi != mapBlockIndex.end()) {
+                CBlockIndex *pindex = mi->second;
+                if (pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
+                    return "duplicate";
+                }
+                if (pindex->nStatus & BLOCK_FAILED_MASK) {
+                    return "duplicate-invalid";
+                }
+                return "duplicate-inconclusive";
+            }
+
+            CBlockIndex *const pindexPrev = chainActive.Tip();
+            // TestBlockValidity only supports blocks built on the current Tip
+            if (block.hashPrevBlock != pindexPrev->GetBlockHash()) {
+                return "inconclusive-not-best-prevblk";
+            }
+            CValidationState state;
+            TestBlockValidity(config, state, block, pindexPrev, false, true);
+            return BIP22ValidationResult(config, state);
+        }
+    }
+
+    if (strMode != "template") {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
+    }
+
+    if (!g_connman) {
+        throw JSONRPCError(
+            RPC_CLIENT_P2P_DISABLED,
+            "Error: Peer-to-peer functionality missing or disabled");
+    }
+
+    if (g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) == 0) {
+        throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED,
+                           "Platopia is not connected!");
+    }
+
+    if (IsInitialBlockDownload()) {
+        throw JSONRPCError(RPC_CLIENT_IN_INITIAL_DOWNLOAD,
+                           "Platopia is downloading blocks...");
+    }
+
+    static unsigned int nTransactionsUpdatedLast;
+
+    if (!lpval.isNull()) {
+        // Wait to respond until either the best block changes, OR a minute has
+        // passed and there are more transactions
+        uint256 hashWatchedChain;
+        boost::system_time checktxtime;
+        unsigned int nTransactionsUpdatedLastLP;
+
+        if (lpval.isStr()) {
+            // Format: <hashBestChain><nTransactionsUpdatedLast>
+            std::string lpstr = lpval.get_str();
+
+            hashWatchedChain.SetHex(lpstr.substr(0, 64));
+            nTransactionsUpdatedLastLP = atoi64(lpstr.substr(64));
+        } else {
+            // NOTE: Spec does not specify behaviour for non-string longpollid,
+            // but this makes testing easier
+            hashWatchedChain = chainActive.Tip()->GetBlockHash();
+            nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
+        }
+
+        // Release the main lock while waiting
+        LEAVE_CRITICAL_SECTION(cs_main);
+        {
+            checktxtime =
+                boost::get_system_time() + boost::posix_time::minutes(1);
+
+            boost::unique_lock<boost::mutex> lock(csBestBlock);
+            while (chainActive.Tip()->GetBlockHash() == hashWatchedChain &&
+                   IsRPCRunning()) {
+                if (!cvBlockChange.timed_wait(lock, checktxtime)) {
+                    // Timeout: Check transactions for update
+                    if (mempool.GetTransactionsUpdated() !=
+                        nTransactionsUpdatedLastLP) {
+                        break;
+                    }
+                    checktxtime += boost::posix_time::seconds(10);
+                }
+            }
+        }
+        ENTER_CRITICAL_SECTION(cs_main);
+
+        if (!IsRPCRunning()) {
+            throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Shutting down");
+        }
+    }
+
+    // Update block
+    static CBlockIndex *pindexPrev;
+    static int64_t nStart;
+    static std::unique_ptr<CBlockTemplate> pblocktemplate;
+    if (pindexPrev != chainActive.Tip() ||
+        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast &&
+         GetTime() - nStart > 5)) {
+        // Clear pindexPrev so future calls make a new block, despite any
+        // failures from here on
+        pindexPrev = nullptr;
+
+        // Store the pindexBest used before CreateNewBlock, to avoid races
+        nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+        CBlockIndex *pindexPrevNew = chainActive.Tip();
+        nStart = GetTime();
+
+        // Create new block. The pool builds its own coinbase.
+        CScript scriptDummy = CScript() << OP_TRUE;
+        pblocktemplate =
+            BlockAssembler(config, Params()).CreateNewBlock(scriptDummy);
+        if (!pblocktemplate) {
+            throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
+        }
+
+        // Need to update only after we know CreateNewBlock succeeded
+        pindexPrev = pindexPrevNew;
+    }
+
+    // pointer for convenience
+    CBlock *pblock = &pblocktemplate->block;
+    const Consensus::Params &consensusParams =
+        config.GetChainParams().GetConsensus();
+
+    // Update nTime
+    UpdateTime(pblock, config, pindexPrev);
+    pblock->nNonce = 0;
+
+    UniValue aCaps(UniValue::VARR);
+    aCaps.push_back("proposal");
+
+    UniValue transactions(UniValue::VARR);
+    std::map<uint256, int64_t> setTxIndex;
+    int i = 0;
+    for (const auto &it : pblock->vtx) {
+        const CTransaction &tx = *it;
+        uint256 txId = tx.GetId();
+        setTxIndex[txId] = i++;
+
+        if (tx.IsCoinBase()) {
+            continue;
+        }
+
+        UniValue entry(UniValue::VOBJ);
+
+        entry.push_back(Pair("data", EncodeHexTx(tx)));
+        entry.push_back(Pair("txid", txId.GetHex()));
+        entry.push_back(Pair("hash", tx.GetHash().GetHex()));
+
+        UniValue deps(UniValue::VARR);
+        for (const CTxIn &in : tx.vin) {
+            if (setTxIndex.count(in.prevout.hash)) {
+                deps.push_back(setTxIndex[in.prevout.hash]);
+            }
+        }
+        entry.push_back(Pair("depends", deps));
+
+        int index_in_template = i - 1;
+        entry.push_back(
+            Pair("fee", pblocktemplate->vTxFees[index_in_template]));
+        entry.push_back(
+            Pair("sigops", pblocktemplate->vTxSigOpsCount[index_in_template]));
+
+        transactions.push_back(entry);
+    }
+
+    UniValue aux(UniValue::VOBJ);
+    aux.push_back(
+        Pair("flags", HexStr(COINBASE_FLAGS.begin(), COINBASE_FLAGS.end())));
+
+    arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
+
+    UniValue aMutable(UniValue::VARR);
+    aMutable.push_back("time");
+    aMutable.push_back("transactions");
+    aMutable.push_back("prevblock");
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("capabilities", aCaps));
+
+    UniValue aRules(UniValue::VARR);
+    UniValue vbavailable(UniValue::VOBJ);
+    for (int j = 0; j < (int)Consensus::MAX_VERSION_BITS_DEPLOYMENTS; ++j) {
+        Consensus::DeploymentPos pos = Consensus::DeploymentPos(j);
+        ThresholdState state = VersionBitsState(pindexPrev, consensusParams,
+                                                pos, versionbitscache);
+        switch (state) {
+            case THRESHOLD_DEFINED:
+            case THRESHOLD_FAILED:
+                // Not exposed to GBT at all
+                break;
+            case THRESHOLD_LOCKED_IN:
+                // Ensure bit is set in block version
+                pblock->nVersion |= VersionBitsMask(consensusParams, pos);
+            // FALLTHROUGH
+            // to get vbavailable set...
+            case THRESHOLD_STARTED: {
+                vbavailable.push_back(Pair(
+                    gbt_vb_name(pos), consensusParams.vDeployments[pos].bit));
+                break;
+            }
+            case THRESHOLD_ACTIVE: {
+                // Add to rules only
+                aRules.push_back(gbt_vb_name(pos));
+                break;
+            }
+        }
+    }
+    result.push_back(Pair("version", pblock->nVersion));
+    result.push_back(Pair("rules", aRules));
+    result.push_back(Pair("vbavailable", vbavailable));
+    result.push_back(Pair("vbrequired", int(0)));
+
+    result.push_back(Pair("previousblockhash", pblock->hashPrevBlock.GetHex()));
+    result.push_back(Pair("transactions", transactions));
+    result.push_back(Pair("coinbaseaux", aux));
+    result.push_back(
+        Pair("coinbasevalue", int64_t(pblock->vtx[0]->vout[0].nValue)));
+    result.push_back(Pair("longpollid",
+                          chainActive.Tip()->GetBlockHash().GetHex() +
+                              i64tostr(nTransactionsUpdatedLast)));
+    result.push_back(Pair("target", hashTarget.GetHex()));
+    result.push_back(
+        Pair("mintime", int64_t(pindexPrev->GetMedianTimePast()) + 1));
+    result.push_back(Pair("mutable", aMutable));
+    result.push_back(Pair("noncerange", "0000000000000000ffffffffffffffff"));
+    const uint64_t nMaxBlockSize = config.GetMaxBlockSize();
+    result.push_back(
+        Pair("sigoplimit", GetMaxBlockSigOpsCount(nMaxBlockSize)));
+    result.push_back(Pair("sizelimit", nMaxBlockSize));
+    result.push_back(Pair("curtime", pblock->GetBlockTime()));
+    result.push_back(Pair("bits", strprintf("%08x", pblock->nBits)));
+    result.push_back(Pair("height", int64_t(pindexPrev->nHeight) + 1));
+    result.push_back(Pair("blockheight", uint64_t(pblock->nBlockHeight)));
+    result.push_back(Pair("chaininterest", pblock->nChainInterest));
+    result.push_back(Pair("seedhash", ethash_h256_encode(ethash_get_seedhash(
+                                          pblock->nBlockHeight))));
+    result.push_back(
+        Pair("boundary", ethash_h256_encode(hashTarget.ToEthashH256())));
+
+    return result;
+}
+
+class submitblock_StateCatcher : public CValidationInterface {
+public:
+    uint256 hash;
+    bool found;
+    CValidationState state;
+
+    submitblock_StateCatcher(const uint256 &hashIn)
+        : hash(hashIn), found(false), state() {}
+
+protected:
+    void BlockChecked(const CBlock &block,
+                      const CValidationState &stateIn) override {
+        if (block.GetHash() != hash) {
+            return;
+        }
+
+        found = true;
+        state = stateIn;
+    }
+};
+
+static UniValue submitblock(const Config &config,
+                            const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 ||
+        request.params.size() > 2) {
+        throw std::runtime_error(
+            "submitblock \"hexdata\" ( \"jsonparametersobject\" )\n"
+            "\nAttempts to submit new block to network.\n"
+            "The 'jsonparametersobject' parameter is currently ignored.\n"
+            "See https://en.bitcoin.it/wiki/BIP_0022 for full "
+            "specification.\n"
+
+            "\nArguments\n"
+            "1. \"hexdata\"        (string, required) the hex-encoded block "
+            "data to submit, solved: nNonce and hashMix set\n"
+            "2. \"parameters\"     (string, optional) object of optional "
+            "parameters\n"
+            "    {\n"
+            "      \"workid\" : \"id\"    (string, optional) if the server "
+            "provided a workid, it MUST be included with submissions\n"
+            "    }\n"
+            "\nResult:\n"
+            "\nExamples:\n" +
+            HelpExampleCli("submitblock", "\"mydata\"") +
+            HelpExampleRpc("submitblock", "\"mydata\""));
+    }
+
+    std::shared_ptr<CBlock> blockptr = std::make_shared<CBlock>();
+    CBlock &block = *blockptr;
+    if (!DecodeHexBlk(block, request.params[0].get_str())) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Block decode failed");
+    }
+
+    if (block.vtx.empty() || !block.vtx[0]->IsCoinBase()) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR,
+                           "Block does not start with a coinbase");
+    }
+
+    uint256 hash = block.GetHash();
+    bool fBlockPresent = false;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        if (mi != mapBlockIndex.end()) {
+            CBlockIndex *pindex = mi->second;
+            if (pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
+                return "duplicate";
+            }
+            if (pindex->nStatus & BLOCK_FAILED_MASK) {
+                return "duplicate-invalid";
+            }
+            // Otherwise, we might only have the header - process the block
+            // before returning
+            fBlockPresent = true;
+        }
+    }
+
+    submitblock_StateCatcher sc(block.GetHash());
+    RegisterValidationInterface(&sc);
+    bool fAccepted = ProcessNewBlock(config, blockptr, true, nullptr);
+    UnregisterValidationInterface(&sc);
+    if (fBlockPresent) {
+        if (fAccepted && !sc.found) {
+            return "duplicate-inconclusive";
+        }
+        return "duplicate";
+    }
+
+    if (!sc.found) {
+        return "inconclusive";
+    }
+
+    return BIP22ValidationResult(config, sc.state);
+}
+
 static UniValue estimatefee(const Config &config,
                             const JSONRPCRequest &request) {
     if (request.fHelp || request.params.size() != 1) {
@@ -685,7 +1262,11 @@ static UniValue eth_submitHashrate(const Config &config, const JSONRPCRequest &r
 {
     if (request.fHelp || request.params.size() < 2) {
         throw std::runtime_error(
-            "eth_submitHashrate hashrate\n"
+            "eth_submitHashrate hashrate id\n"
+            "\nReport the hashrate of an external miner. Reports of the "
+            "same id replace each other, the\n"
+            "ones of the last two minutes show up in getmininginfo as "
+            "externalhashps.\n"
         );
     }
 
@@ -696,7 +1277,7 @@ static UniValue eth_submitHashrate(const Config &config, const JSONRPCRequest &r
     sRate << std::hex << hexHashRate.substr(2, hexHashRate.size()-2);
     sRate >> hashRate;
 
-    mineworker->SetHashRate(hashRate);
+    mineworker->SubmitHashRate(request.params[1].get_str(), hashRate);
     return true;
 }
 
@@ -706,7 +1287,9 @@ static const CRPCCommand commands[] = {
     //  ---------- ------------------------ ---------------------- ----------
     {"mining",     "eth_getWork",           eth_getWork,           true, {}},
     {"mining",     "eth_submitWork",        eth_submitWork,        true, {"hexnonce", "blockheaderHash", "hexhashmix"}},
-    {"mining",     "eth_submitHashrate",    eth_submitHashrate,    true, {"hashrate"}},
+    {"mining",     "eth_submitHashrate",    eth_submitHashrate,    true, {"hashrate", "id"}},
+    {"mining",     "getblocktemplate",      getblocktemplate,      true, {"template_request"}},
+    {"mining",     "submitblock",           submitblock,           true, {"hexdata", "parameters"}},
     {"mining",     "getnetworkhashps",      getnetworkhashps,      true, {"nblocks", "height"}},
     {"mining",     "getmininginfo",         getmininginfo,         true, {}},
     {"mining",     "prioritisetransaction", prioritisetransaction, true, {"txid", "priority_delta", "fee_delta"}},
@@ -7,13 +7,21 @@
 #include "base58.h"
 #include "clientversion.h"
 #include "config.h"
+#include "core_memusage.h"
 #include "dstencode.h"
+#include "ethashcache.h"
 #include "init.h"
+#include "memusage.h"
+#include "miner.h"
 #include "net.h"
 #include "netbase.h"
+#include "policy/policy.h"
 #include "rpc/blockchain.h"
 #include "rpc/server.h"
+#include "script/scriptcache.h"
+#include "script/sigcache.h"
 #include "timedata.h"
+#include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
 #include "validation.h"
@@ -535,15 +543,109 @@ static UniValue RPCLockedMemoryInfo() {
     return obj;
 }
 
+/** An entry of the detailed memory usage, with its bytes added to nTotal */
+static UniValue MemoryUsageEntry(uint64_t nBytes, uint64_t &nTotal) {
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("bytes", nBytes));
+    nTotal += nBytes;
+    return obj;
+}
+
+static UniValue RPCDetailedMemoryInfo() {
+    UniValue obj(UniValue::VOBJ);
+    uint64_t nTotal = 0;
+    {
+        LOCK(cs_main);
+        UniValue coins = MemoryUsageEntry(
+            pcoinsTip ? pcoinsTip->DynamicMemoryUsage() : 0, nTotal);
+        coins.push_back(Pair(
+            "entries", uint64_t(pcoinsTip ? pcoinsTip->GetCacheSize() : 0)));
+        coins.push_back(Pair("limit", nCoinCacheUsage));
+        obj.push_back(Pair("coinscache", coins));
+
+        UniValue index = MemoryUsageEntry(BlockIndexMemoryUsage(), nTotal);
+        index.push_back(Pair("entries", uint64_t(mapBlockIndex.size())));
+        obj.push_back(Pair("blockindex", index));
+    }
+
+    UniValue pool = MemoryUsageEntry(mempool.DynamicMemoryUsage(), nTotal);
+    pool.push_back(Pair("transactions", uint64_t(mempool.size())));
+    pool.push_back(Pair("content_bytes", mempool.GetTotalContentSize()));
+    pool.push_back(Pair(
+        "limit", GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000));
+    obj.push_back(Pair("mempool", pool));
+
+    obj.push_back(Pair("sigcache",
+                       MemoryUsageEntry(SignatureCacheMemoryUsage(), nTotal)));
+    obj.push_back(Pair("scriptcache", MemoryUsageEntry(
+                                          ScriptExecutionCacheMemoryUsage(),
+                                          nTotal)));
+
+    UniValue light =
+        MemoryUsageEntry(EthashLightCache().MemoryUsage(), nTotal);
+    light.push_back(Pair("epochs", uint64_t(EthashLightCache().Size())));
+    obj.push_back(Pair("ethashlight", light));
+
+    if (mineworker) {
+        const MinerStats stats = mineworker->GetStats();
+        UniValue dag = MemoryUsageEntry(stats.nDagBytes, nTotal);
+        dag.push_back(Pair("epochs", uint64_t(stats.vDagEpochs.size())));
+        obj.push_back(Pair("ethashdag", dag));
+        obj.push_back(
+            Pair("miningwork", MemoryUsageEntry(stats.nWorkBytes, nTotal)));
+    }
+
+#ifdef ENABLE_WALLET
+    if (pwalletMain) {
+        LOCK(pwalletMain->cs_wallet);
+        uint64_t nBytes = memusage::DynamicUsage(pwalletMain->mapWallet);
+        for (const auto &it : pwalletMain->mapWallet) {
+            nBytes += RecursiveDynamicUsage(it.second.tx);
+        }
+        UniValue wallet = MemoryUsageEntry(nBytes, nTotal);
+        wallet.push_back(
+            Pair("transactions", uint64_t(pwalletMain->mapWallet.size())));
+        obj.push_back(Pair("wallet", wallet));
+    }
+#endif
+
+    if (g_connman) {
+        // The messages queued to send and those received but not processed
+        // yet, which the buffer limits bound.
+        uint64_t nSendBytes = 0, nReceiveBytes = 0, nPeers = 0;
+        g_connman->ForEachNode([&](CNode *pnode) {
+            nPeers++;
+            {
+                LOCK(pnode->cs_vSend);
+                nSendBytes += pnode->nSendSize;
+            }
+            LOCK(pnode->cs_vProcessMsg);
+            nReceiveBytes += pnode->nProcessQueueSize;
+        });
+        UniValue peers = MemoryUsageEntry(nSendBytes + nReceiveBytes, nTotal);
+        peers.push_back(Pair("send_bytes", nSendBytes));
+        peers.push_back(Pair("receive_bytes", nReceiveBytes));
+        peers.push_back(Pair("peers", nPeers));
+        obj.push_back(Pair("peers", peers));
+    }
+
+    obj.push_back(Pair("total", nTotal));
+    return obj;
+}
+
 static UniValue getmemoryinfo(const Config &config,
                               const JSONRPCRequest &request) {
     /* Please, avoid using the word "pool" here in the RPC interface or help,
      * as users will undoubtedly confuse it with the other "memory pool"
      */
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw std::runtime_error(
-            "getmemoryinfo\n"
+            "getmemoryinfo ( \"mode\" )\n"
             "Returns an object containing information about memory usage.\n"
+            "\nArguments:\n"
+            "1. \"mode\"    (string, optional, default: \"stats\") \"stats\" "
+            "for the locked memory manager only, \"detailed\" to also break "
+            "the memory of the node down by subsystem\n"
             "\nResult:\n"
             "{\n"
             "  \"locked\": {               (json object) Information about "
@@ -559,13 +661,50 @@ static UniValue getmemoryinfo(const Config &config,
             "disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"detailed\": {             (json object) Only in \"detailed\" "
+            "mode. Each entry has the bytes it takes, \"bytes\", and the "
+            "number of its elements\n"
+            "    \"coinscache\": {...},    (json object) The coins cache, "
+            "with its \"entries\" and -dbcache \"limit\"\n"
+            "    \"blockindex\": {...},    (json object) The block index\n"
+            "    \"mempool\": {...},       (json object) The mempool, with "
+            "the \"content_bytes\" of its content payloads and -maxmempool "
+            "\"limit\"\n"
+            "    \"sigcache\": {...},      (json object) The signature "
+            "cache\n"
+            "    \"scriptcache\": {...},   (json object) The script "
+            "execution cache\n"
+            "    \"ethashlight\": {...},   (json object) The ethash light "
+            "caches of the epochs verified\n"
+            "    \"ethashdag\": {...},     (json object) The DAGs of the "
+            "miner, counting each NUMA copy, if mining is set up\n"
+            "    \"miningwork\": {...},    (json object) The block template "
+            "and mining jobs\n"
+            "    \"wallet\": {...},        (json object) The wallet "
+            "transactions, if the wallet is enabled\n"
+            "    \"peers\": {...},         (json object) The messages queued "
+            "to send to peers and received but not processed\n"
+            "    \"total\": xxxxx          (numeric) The sum of the bytes "
+            "above\n"
             "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getmemoryinfo", "") +
-            HelpExampleRpc("getmemoryinfo", ""));
+            HelpExampleCli("getmemoryinfo", "\"detailed\"") +
+            HelpExampleRpc("getmemoryinfo", "\"detailed\""));
+
+    const std::string strMode =
+        request.params.size() > 0 ? request.params[0].get_str() : "stats";
+    if (strMode != "stats" && strMode != "detailed") {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           "Unknown mode " + strMode);
+    }
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+    if (strMode == "detailed") {
+        obj.push_back(Pair("detailed", RPCDetailedMemoryInfo()));
+    }
     return obj;
 }
 
@@ -587,7 +726,7 @@ static const CRPCCommand commands[] = {
     //  category            name                      actor (function)        okSafeMode
     //  ------------------- ------------------------  ----------------------  ----------
     { "control",            "getinfo",                getinfo,                true,  {} }, /* uses wallet if enabled */
-    { "control",            "getmemoryinfo",          getmemoryinfo,          true,  {} },
+    { "control",            "getmemoryinfo",          getmemoryinfo,          true,  {"mode"} },
     { "util",               "validateaddress",        validateaddress,        true,  {"address"} }, /* uses wallet if enabled */
     { "util",               "createmultisig",         createmultisig,         true,  {"nrequired","keys"} },
     { "util",               "verifymessage",          verifymessage,          true,  {"address","signature","message"} },
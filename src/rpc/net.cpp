@@ -120,8 +120,28 @@ static UniValue getpeerinfo(const Config &config,
             "we're currently asking from this peer\n"
             "       ...\n"
             "    ],\n"
+            "    \"blockdownloadrate\": n,  (numeric) Average bytes per "
+            "second of the blocks this peer delivered\n"
+            "    \"compactblocks\": {\n"
+            "       \"received\": n,          (numeric) Compact blocks from "
+            "this peer we tried to reconstruct\n"
+            "       \"roundtrips\": n,        (numeric) How many of those "
+            "needed a getblocktxn round trip\n"
+            "       \"txhitrate\": x.xxx,     (numeric) Fraction of their "
+            "transactions we already had\n"
+            "    },\n"
             "    \"whitelisted\": true|false, (boolean) Whether the peer is "
             "whitelisted\n"
+            "    \"sendqueue\": {             (json object) Bytes queued to "
+            "be sent, by send priority\n"
+            "       \"block\": n,             (numeric) Blocks, compact "
+            "blocks and headers, sent first\n"
+            "       \"control\": n,           (numeric) Other messages\n"
+            "       \"tx\": n,                (numeric) Transactions and "
+            "inventory\n"
+            "       \"addr\": n               (numeric) Addresses, sent "
+            "last\n"
+            "    },\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes sent "
             "aggregated by message type\n"
@@ -194,9 +214,29 @@ static UniValue getpeerinfo(const Config &config,
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(
+                Pair("blockdownloadrate", statestats.dBlockBytesPerSec));
+            UniValue cmpct(UniValue::VOBJ);
+            cmpct.push_back(Pair("received", statestats.nCmpctBlocksReceived));
+            cmpct.push_back(
+                Pair("roundtrips", statestats.nCmpctBlockRoundTrips));
+            cmpct.push_back(Pair(
+                "txhitrate",
+                statestats.nCmpctBlockTxCount
+                    ? double(statestats.nCmpctBlockTxAvailable) /
+                          statestats.nCmpctBlockTxCount
+                    : 0.0));
+            obj.push_back(Pair("compactblocks", cmpct));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
+        UniValue sendQueue(UniValue::VOBJ);
+        for (int p = 0; p < NUM_SEND_PRIORITIES; p++) {
+            sendQueue.push_back(
+                Pair(SendPriorityToString(p), stats.nSendQueueSize[p]));
+        }
+        obj.push_back(Pair("sendqueue", sendQueue));
+
         UniValue sendPerMsgCmd(UniValue::VOBJ);
         for (const mapMsgCmdSize::value_type &i : stats.mapSendBytesPerMsgCmd) {
             if (i.second > 0) {
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "blockview.h"
 #include "chain.h"
 #include "coins.h"
 #include "config.h"
@@ -22,6 +23,7 @@
 #include "script/script_error.h"
 #include "script/sign.h"
 #include "script/standard.h"
+#include "txindex.h"
 #include "txmempool.h"
 #include "uint256.h"
 #include "utilstrencodings.h"
@@ -31,6 +33,7 @@
 #endif
 
 #include <cstdint>
+#include <memory>
 
 #include <univalue.h>
 
@@ -40,26 +43,26 @@ void ScriptPubKeyToJSON(const Config &config, const CScript &scriptPubKey,
     std::vector<CTxDestination> addresses;
     int nRequired;
 
-    out.push_back(Pair("asm", ScriptToAsmStr(scriptPubKey)));
+    out.pushKVEnd("asm", ScriptToAsmStr(scriptPubKey));
     if (fIncludeHex) {
-        out.push_back(
-            Pair("hex", HexStr(scriptPubKey.begin(), scriptPubKey.end())));
+        out.pushKVEnd("hex", HexStr(scriptPubKey.begin(), scriptPubKey.end()));
     }
 
     if (!ExtractDestinations(scriptPubKey, type, addresses, nRequired)) {
-        out.push_back(Pair("type", GetTxnOutputType(type)));
+        out.pushKVEnd("type", GetTxnOutputType(type));
         return;
     }
 
-    out.push_back(Pair("reqSigs", nRequired));
-    out.push_back(Pair("type", GetTxnOutputType(type)));
+    out.pushKVEnd("reqSigs", nRequired);
+    out.pushKVEnd("type", GetTxnOutputType(type));
 
     UniValue a(UniValue::VARR);
+    a.reserve(addresses.size());
     for (const CTxDestination &addr : addresses) {
         a.push_back(EncodeDestination(addr));
     }
 
-    out.push_back(Pair("addresses", a));
+    out.pushKVEnd("addresses", std::move(a));
 }
 
 std::string GetBinaryContent(const std::string& content)
@@ -69,82 +72,85 @@ std::string GetBinaryContent(const std::string& content)
 
 void TxToJSON(const Config &config, const CTransaction &tx,
               const uint256 hashBlock, UniValue &entry) {
-    entry.push_back(Pair("txid", tx.GetId().GetHex()));
-    entry.push_back(Pair("hash", tx.GetHash().GetHex()));
-    entry.push_back(Pair(
-        "size", (int)::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION)));
-    entry.push_back(Pair("version", tx.nVersion));
-    entry.push_back(Pair("flags", tx.nFlags));
+    // The keys are new to entry, children are moved in once they are built.
+    entry.pushKVEnd("txid", tx.GetId().GetHex());
+    entry.pushKVEnd("hash", tx.GetHash().GetHex());
+    entry.pushKVEnd("size", (int)tx.GetTotalSize());
+    entry.pushKVEnd("version", tx.nVersion);
+    entry.pushKVEnd("flags", tx.nFlags);
 
     UniValue vin(UniValue::VARR);
+    vin.reserve(tx.vin.size());
     UniValue arrAddresses(UniValue::VARR);
     for (unsigned int i = 0; i < tx.vin.size(); i++) {
         const CTxIn &txin = tx.vin[i];
         UniValue in(UniValue::VOBJ);
+        in.reserve(5);
 //        if (tx.IsCoinBase()) {
 //            in.push_back(Pair("coinbase", HexStr(txin.scriptSig.begin(),
 //                                                 txin.scriptSig.end())));
 //        } else {
-            in.push_back(Pair("txid", txin.prevout.hash.GetHex()));
-            in.push_back(Pair("vout", (int64_t)txin.prevout.n));
-            in.push_back(Pair("value", ValueFromAmount(txin.prevout.nValue)));
-            in.push_back(Pair("satoshi", txin.prevout.nValue));
+            in.pushKVEnd("txid", txin.prevout.hash.GetHex());
+            in.pushKVEnd("vout", (int64_t)txin.prevout.n);
+            in.pushKVEnd("value", ValueFromAmount(txin.prevout.nValue));
+            in.pushKVEnd("satoshi", txin.prevout.nValue);
             UniValue o(UniValue::VOBJ);
-            o.push_back(Pair("asm", ScriptToAsmStr(txin.scriptSig, true)));
-            o.push_back(Pair(
-                "hex", HexStr(txin.scriptSig.begin(), txin.scriptSig.end())));
-            in.push_back(Pair("scriptSig", o));
+            o.pushKVEnd("asm", ScriptToAsmStr(txin.scriptSig, true));
+            o.pushKVEnd("hex",
+                        HexStr(txin.scriptSig.begin(), txin.scriptSig.end()));
+            in.pushKVEnd("scriptSig", std::move(o));
 //        }
 
-        vin.push_back(in);
+        vin.push_back(std::move(in));
     }
 
-    entry.push_back(Pair("vin", vin));
+    entry.pushKVEnd("vin", std::move(vin));
     UniValue vout(UniValue::VARR);
+    vout.reserve(tx.vout.size());
     for (unsigned int i = 0; i < tx.vout.size(); i++) {
         const CTxOut &txout = tx.vout[i];
         UniValue out(UniValue::VOBJ);
-        out.push_back(Pair("value", ValueFromAmount(txout.nValue)));
-        out.push_back(Pair("n", (int64_t)i));
-        out.push_back(Pair("principal", ValueFromAmount(txout.nPrincipal)));
+        out.reserve(7);
+        out.pushKVEnd("value", ValueFromAmount(txout.nValue));
+        out.pushKVEnd("n", (int64_t)i);
+        out.pushKVEnd("principal", ValueFromAmount(txout.nPrincipal));
         if((int)txout.strContent.size()>MAX_STANDARD_TX_SIZE)
-            out.push_back(Pair("contentlen", (int)txout.strContent.size()));
+            out.pushKVEnd("contentlen", (int)txout.strContent.size());
         else
         {
-            out.push_back(Pair("content", HexStr(txout.strContent.begin(), txout.strContent.end())));
-            out.push_back(Pair("contentText", GetBinaryContent(txout.strContent)));
+            out.pushKVEnd("content", HexStr(txout.strContent.begin(), txout.strContent.end()));
+            out.pushKVEnd("contentText", GetBinaryContent(txout.strContent));
         }
-        out.push_back(Pair("locktime", (int64_t)txout.nLockTime));
+        out.pushKVEnd("locktime", (int64_t)txout.nLockTime);
         UniValue o(UniValue::VOBJ);
         ScriptPubKeyToJSON(config, txout.scriptPubKey, o, true);
-        out.push_back(Pair("scriptPubKey", o));
 
-        UniValue addrs(UniValue::VARR);
-        addrs = find_value(o, "addresses");
+        const UniValue &addrs = find_value(o, "addresses");
         if (!addrs.isNull()) {
             for (int i = 0; i < addrs.size(); i++) {
                 if (!arrAddresses.exists(addrs[i].getValStr()))
                     arrAddresses.push_back(addrs[i]);
             }
         }
+        out.pushKVEnd("scriptPubKey", std::move(o));
 
-        vout.push_back(out);
+        vout.push_back(std::move(out));
     }
 
-    entry.push_back(Pair("vout", vout));
-    entry.push_back(Pair("ids",arrAddresses));
+    entry.pushKVEnd("vout", std::move(vout));
+    entry.pushKVEnd("ids", std::move(arrAddresses));
     if (!hashBlock.IsNull()) {
-        entry.push_back(Pair("blockhash", hashBlock.GetHex()));
+        entry.pushKVEnd("blockhash", hashBlock.GetHex());
         BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end() && (*mi).second) {
             CBlockIndex *pindex = (*mi).second;
             if (chainActive.Contains(pindex)) {
-                entry.push_back(Pair("confirmations", 1 + chainActive.Height() -
-                                                          pindex->nHeight));
-                entry.push_back(Pair("time", pindex->GetBlockTime()));
-                entry.push_back(Pair("blocktime", pindex->GetBlockTime()));
+                entry.pushKVEnd("confirmations",
+                                1 + chainActive.Height() - pindex->nHeight);
+                entry.pushKVEnd("time", pindex->GetBlockTime());
+                entry.pushKVEnd("blocktime", pindex->GetBlockTime());
             } else {
-                entry.push_back(Pair("confirmations", 0));
+                entry.pushKVEnd("confirmations", 0);
             }
         }
     }
@@ -236,8 +242,6 @@ static UniValue getrawtransaction(const Config &config,
             HelpExampleRpc("getrawtransaction", "\"mytxid\", true"));
     }
 
-    LOCK(cs_main);
-
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
     // Accept either a bool (true) or a num (>=1) to indicate verbose output.
@@ -261,12 +265,16 @@ static UniValue getrawtransaction(const Config &config,
     CTransactionRef tx;
     uint256 hashBlock;
     if (!GetTransaction(config, hash, tx, hashBlock, true)) {
-        throw JSONRPCError(
-            RPC_INVALID_ADDRESS_OR_KEY,
-            std::string(fTxIndex ? "No such mempool or blockchain transaction"
-                                 : "No such mempool transaction. Use -txindex "
-                                   "to enable blockchain transaction queries") +
-                ". Use gettransaction for wallet transactions.");
+        std::string strError =
+            fTxIndex ? "No such mempool or blockchain transaction"
+                     : "No such mempool transaction. Use -txindex to enable "
+                       "blockchain transaction queries";
+        if (fTxIndex && g_txindex && !g_txindex->IsSynced()) {
+            strError += ". The transaction index is still being built";
+        }
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                           strError +
+                               ". Use gettransaction for wallet transactions.");
     }
 
     std::string strHex = EncodeHexTx(*tx, RPCSerializationFlags());
@@ -275,6 +283,7 @@ static UniValue getrawtransaction(const Config &config,
         return strHex;
     }
 
+    LOCK(cs_main);
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hex", strHex));
     TxToJSON(config, *tx, hashBlock, result);
@@ -386,10 +395,158 @@ static UniValue gettxoutproof(const Config &config,
     CDataStream ssMB(SER_NETWORK, PROTOCOL_VERSION);
     CMerkleBlock mb(block, setTxids);
     ssMB << mb;
-    std::string strHex = HexStr(ssMB.begin(), ssMB.end());
+    std::string strHex = HexStr(ssMB.data(), ssMB.data() + ssMB.size());
     return strHex;
 }
 
+static UniValue gettxoutproofs(const Config &config,
+                               const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 ||
+        request.params.size() > 2) {
+        throw std::runtime_error(
+            "gettxoutproofs [\"txid\",...] ( separate )\n"
+            "\nReturns hex-encoded proofs that the transactions were included "
+            "in blocks, like\n"
+            "gettxoutproof, for transactions in any number of blocks. Each "
+            "block is read once,\n"
+            "and its merkle tree hashed once for all of its proofs.\n"
+            "\nNOTE: Transactions whose outputs are all spent are only found "
+            "with -txindex.\n"
+            "\nArguments:\n"
+            "1. \"txids\"       (string, required) A json array of txids\n"
+            "    [\n"
+            "      \"txid\"     (string) A transaction hash\n"
+            "      ,...\n"
+            "    ]\n"
+            "2. separate      (boolean, optional, default=false) Whether to "
+            "prove each transaction\n"
+            "                 on its own, rather than all those of a block in "
+            "one proof\n"
+            "\nResult:\n"
+            "[                (array) By block height, then position in the "
+            "block\n"
+            "  {\n"
+            "    \"blockhash\" : \"hash\",  (string) The block\n"
+            "    \"txids\" : [\"txid\",...], (array) The transactions the "
+            "proof is for\n"
+            "    \"proof\" : \"data\"       (string) The proof, as "
+            "gettxoutproof returns it\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("gettxoutproofs", "'[\"txid\",...]' true") +
+            HelpExampleRpc("gettxoutproofs", "[\"txid\",...], true"));
+    }
+
+    std::set<uint256> setTxids;
+    const UniValue &txids = request.params[0].get_array();
+    for (size_t idx = 0; idx < txids.size(); idx++) {
+        const UniValue &txid = txids[idx];
+        if (txid.get_str().length() != 64 || !IsHex(txid.get_str())) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER,
+                               std::string("Invalid txid ") + txid.get_str());
+        }
+        if (!setTxids.insert(uint256S(txid.get_str())).second) {
+            throw JSONRPCError(
+                RPC_INVALID_PARAMETER,
+                std::string("Invalid parameter, duplicated txid: ") +
+                    txid.get_str());
+        }
+    }
+    const bool fSeparate =
+        request.params.size() > 1 && !request.params[1].isNull() &&
+        request.params[1].get_bool();
+
+    // Group the txids by block, through the unspent outputs where they can
+    // be, the transaction index otherwise. Blocks are keyed by height first.
+    std::map<std::pair<int, const CBlockIndex *>, std::set<uint256>>
+        mapBlockTxids;
+    std::vector<uint256> vIndexed;
+    {
+        LOCK(cs_main);
+        for (const uint256 &txid : setTxids) {
+            const Coin &coin = AccessByTxid(*pcoinsTip, txid);
+            if (!coin.IsSpent() && coin.GetHeight() > 0 &&
+                int64_t(coin.GetHeight()) <= chainActive.Height()) {
+                const CBlockIndex *pindex = chainActive[coin.GetHeight()];
+                mapBlockTxids[std::make_pair(pindex->nHeight, pindex)].insert(
+                    txid);
+            } else {
+                vIndexed.push_back(txid);
+            }
+        }
+    }
+    for (const uint256 &txid : vIndexed) {
+        CTransactionRef tx;
+        uint256 hashBlock;
+        if (!GetTransaction(config, txid, tx, hashBlock, false) ||
+            hashBlock.IsNull()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                               "Transaction " + txid.GetHex() +
+                                   " not yet in block");
+        }
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hashBlock);
+        if (it == mapBlockIndex.end()) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Transaction index corrupt");
+        }
+        const CBlockIndex *pindex = it->second;
+        mapBlockTxids[std::make_pair(pindex->nHeight, pindex)].insert(txid);
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const auto &entry : mapBlockTxids) {
+        const CBlockIndex *pindex = entry.first.second;
+        const std::set<uint256> &setBlockTxids = entry.second;
+        // The transactions are only looked at for their ids.
+        CBlockView view;
+        if (!ReadBlockViewFromDisk(view, pindex, config)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR,
+                               "Can't read block from disk");
+        }
+
+        const std::vector<CTransactionView> &vtx = view.GetTransactions();
+        std::vector<uint256> vTxid;
+        std::vector<size_t> vFound;
+        vTxid.reserve(vtx.size());
+        for (size_t i = 0; i < vtx.size(); i++) {
+            vTxid.push_back(vtx[i].GetId());
+            if (setBlockTxids.count(vTxid.back())) {
+                vFound.push_back(i);
+            }
+        }
+        if (vFound.size() != setBlockTxids.size()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                               "(Not all) transactions not found in block " +
+                                   pindex->GetBlockHash().GetHex());
+        }
+
+        const CMerkleTreeLevels levels(vTxid);
+        std::vector<bool> vMatch(vTxid.size(), false);
+        UniValue proofTxids(UniValue::VARR);
+        for (size_t n = 0; n < vFound.size(); n++) {
+            vMatch[vFound[n]] = true;
+            proofTxids.push_back(vTxid[vFound[n]].GetHex());
+            if (fSeparate || n + 1 == vFound.size()) {
+                CDataStream ssMB(SER_NETWORK, PROTOCOL_VERSION);
+                ssMB << CMerkleBlock(view.GetHeader(), levels, vMatch);
+                UniValue proof(UniValue::VOBJ);
+                proof.push_back(
+                    Pair("blockhash", pindex->GetBlockHash().GetHex()));
+                proof.push_back(Pair("txids", proofTxids));
+                proof.push_back(Pair(
+                    "proof", HexStr(ssMB.data(), ssMB.data() + ssMB.size())));
+                result.push_back(proof);
+                if (fSeparate) {
+                    vMatch[vFound[n]] = false;
+                    proofTxids = UniValue(UniValue::VARR);
+                }
+            }
+        }
+    }
+    return result;
+}
+
 static UniValue verifytxoutproof(const Config &config,
                                  const JSONRPCRequest &request) {
     if (request.fHelp || request.params.size() != 1) {
@@ -763,105 +920,13 @@ static void TxInErrorToJSON(const CTxIn &txin, UniValue &vErrorsRet,
     vErrorsRet.push_back(entry);
 }
 
-static UniValue signrawtransaction(const Config &config,
-                                   const JSONRPCRequest &request) {
-    if (request.fHelp || request.params.size() < 1 ||
-        request.params.size() > 4) {
-        throw std::runtime_error(
-            "signrawtransaction \"hexstring\" ( "
-            "[{\"txid\":\"id\",\"vout\":n,\"scriptPubKey\":\"hex\","
-            "\"redeemScript\":\"hex\",\"amount\":x.xx},...] [\"privatekey1\",...] sighashtype "
-            ")\n"
-            "\nSign inputs for raw transaction (serialized, hex-encoded).\n"
-            "The second optional argument (may be null) is an array of "
-            "previous transaction outputs that\n"
-            "this transaction depends on but may not yet be in the block "
-            "chain.\n"
-            "The third optional argument (may be null) is an array of "
-            "base58-encoded private\n"
-            "keys that, if given, will be the only keys used to sign the "
-            "transaction.\n"
-#ifdef ENABLE_WALLET
-            + HelpRequiringPassphrase() +
-            "\n"
-#endif
-
-            "\nArguments:\n"
-            "1. \"hexstring\"     (string, required) The transaction hex "
-            "string\n"
-            "2. \"prevtxs\"       (string, optional) An json array of previous "
-            "dependent transaction outputs\n"
-            "     [               (json array of json objects, or 'null' if "
-            "none provided)\n"
-            "       {\n"
-            "         \"txid\":\"id\",             (string, required) The "
-            "transaction id\n"
-            "         \"vout\":n,                  (numeric, required) The "
-            "output number\n"
-            "         \"scriptPubKey\": \"hex\",   (string, required) script "
-            "key\n"
-            "         \"redeemScript\": \"hex\",   (string, required for P2SH "
-            "or P2WSH) redeem script\n"
-            "         \"amount\": value            (numeric, required) The "
-            "amount spent\n"
-            "       }\n"
-            "       ,...\n"
-            "    ]\n"
-            "3. \"privkeys\"     (string, optional) A json array of "
-            "base58-encoded private keys for signing\n"
-            "    [                  (json array of strings, or 'null' if none "
-            "provided)\n"
-            "      \"privatekey\"   (string) private key in base58-encoding\n"
-            "      ,...\n"
-            "    ]\n"
-            "4. \"sighashtype\"     (string, optional, default=ALL) The "
-            "signature hash type. Must be one of\n"
-            "       \"ALL\"\n"
-            "       \"NONE\"\n"
-            "       \"SINGLE\"\n"
-            "       \"ALL|ANYONECANPAY\"\n"
-            "       \"NONE|ANYONECANPAY\"\n"
-            "       \"SINGLE|ANYONECANPAY\"\n"
-
-            "\nResult:\n"
-            "{\n"
-            "  \"hex\" : \"value\",           (string) The hex-encoded raw "
-            "transaction with signature(s)\n"
-            "  \"complete\" : true|false,   (boolean) If the transaction has a "
-            "complete set of signatures\n"
-            "  \"errors\" : [                 (json array of objects) Script "
-            "verification errors (if there are any)\n"
-            "    {\n"
-            "      \"txid\" : \"hash\",           (string) The hash of the "
-            "referenced, previous transaction\n"
-            "      \"vout\" : n,                (numeric) The index of the "
-            "output to spent and used as input\n"
-            "      \"scriptSig\" : \"hex\",       (string) The hex-encoded "
-            "signature script\n"
-            "      \"sequence\" : n,            (numeric) Script sequence "
-            "number\n"
-            "      \"error\" : \"text\"           (string) Verification or "
-            "signing error related to the input\n"
-            "    }\n"
-            "    ,...\n"
-            "  ]\n"
-            "}\n"
-
-            "\nExamples:\n" +
-            HelpExampleCli("signrawtransaction", "\"myhex\"") +
-            HelpExampleRpc("signrawtransaction", "\"myhex\""));
-    }
-
-#ifdef ENABLE_WALLET
-    LOCK2(cs_main, pwalletMain ? &pwalletMain->cs_wallet : nullptr);
-#else
-    LOCK(cs_main);
-#endif
-    RPCTypeCheck(
-        request.params,
-        {UniValue::VSTR, UniValue::VARR, UniValue::VARR, UniValue::VSTR}, true);
-
-    std::vector<uint8_t> txData(ParseHexV(request.params[0], "argument 1"));
+/**
+ * The variants of a transaction to merge the signatures of, as
+ * signrawtransaction takes them. strWhere is added to the errors.
+ */
+static std::vector<CMutableTransaction>
+DecodeTxVariants(const std::vector<uint8_t> &txData,
+                 const std::string &strWhere) {
     CDataStream ssData(txData, SER_NETWORK, PROTOCOL_VERSION);
     std::vector<CMutableTransaction> txVariants;
     while (!ssData.empty()) {
@@ -870,17 +935,33 @@ static UniValue signrawtransaction(const Config &config,
             ssData >> tx;
             txVariants.push_back(tx);
         } catch (const std::exception &) {
-            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "TX decode failed");
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR,
+                               "TX decode failed" + strWhere);
         }
     }
 
     if (txVariants.empty()) {
-        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Missing transaction");
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR,
+                           "Missing transaction" + strWhere);
     }
+    return txVariants;
+}
 
-    // mergedTx will end up with all the signatures; it starts as a clone of the
-    // rawtx:
-    CMutableTransaction mergedTx(txVariants[0]);
+/**
+ * Signs what it can of each of the transactions of vTxVariants, with the
+ * prevtxs, privkeys and sighashtype of params as signrawtransaction takes
+ * them, and returns an array with the signrawtransaction result of each.
+ * The inputs of all of the transactions are signed in parallel.
+ */
+static UniValue SignRawTransactions(
+    const std::vector<std::vector<CMutableTransaction>> &vTxVariants,
+    const UniValue &params) {
+    // vMergedTx will end up with all the signatures; each starts as a clone
+    // of its rawtx:
+    std::vector<CMutableTransaction> vMergedTx;
+    for (const std::vector<CMutableTransaction> &txVariants : vTxVariants) {
+        vMergedTx.push_back(txVariants[0]);
+    }
 
     // Fetch previous transactions (inputs):
     CCoinsView viewDummy;
@@ -892,9 +973,11 @@ static UniValue signrawtransaction(const Config &config,
         // Temporarily switch cache backend to db+mempool view.
         view.SetBackend(viewMempool);
 
-        for (const CTxIn &txin : mergedTx.vin) {
-            // Load entries from viewChain into view; can fail.
-            view.AccessCoin(txin.prevout);
+        for (const CMutableTransaction &mergedTx : vMergedTx) {
+            for (const CTxIn &txin : mergedTx.vin) {
+                // Load entries from viewChain into view; can fail.
+                view.AccessCoin(txin.prevout);
+            }
         }
 
         // Switch back to avoid locking mempool for too long.
@@ -903,9 +986,9 @@ static UniValue signrawtransaction(const Config &config,
 
     bool fGivenKeys = false;
     CBasicKeyStore tempKeystore;
-    if (request.params.size() > 2 && !request.params[2].isNull()) {
+    if (params.size() > 2 && !params[2].isNull()) {
         fGivenKeys = true;
-        UniValue keys = request.params[2].get_array();
+        UniValue keys = params[2].get_array();
         for (size_t idx = 0; idx < keys.size(); idx++) {
             UniValue k = keys[idx];
             CBitcoinSecret vchSecret;
@@ -930,8 +1013,8 @@ static UniValue signrawtransaction(const Config &config,
     }
 
     // Add previous txouts given in the RPC call:
-    if (request.params.size() > 1 && !request.params[1].isNull()) {
-        UniValue prevTxs = request.params[1].get_array();
+    if (params.size() > 1 && !params[1].isNull()) {
+        UniValue prevTxs = params[1].get_array();
         for (size_t idx = 0; idx < prevTxs.size(); idx++) {
             const UniValue &p = prevTxs[idx];
             if (!p.isObject()) {
@@ -1026,7 +1109,7 @@ static UniValue signrawtransaction(const Config &config,
 #endif
 
     int nHashType = SIGHASH_ALL;
-    if (request.params.size() > 3 && !request.params[3].isNull()) {
+    if (params.size() > 3 && !params[3].isNull()) {
         static std::map<std::string, int> mapSigHashValues = {
             {"ALL", SIGHASH_ALL},
             {"ALL|ANYONECANPAY", SIGHASH_ALL | SIGHASH_ANYONECANPAY},
@@ -1035,7 +1118,7 @@ static UniValue signrawtransaction(const Config &config,
             {"SINGLE", SIGHASH_SINGLE},
             {"SINGLE|ANYONECANPAY", SIGHASH_SINGLE | SIGHASH_ANYONECANPAY},
         };
-        std::string strHashType = request.params[3].get_str();
+        std::string strHashType = params[3].get_str();
         if (!mapSigHashValues.count(strHashType)) {
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid sighash param");
         }
@@ -1045,62 +1128,263 @@ static UniValue signrawtransaction(const Config &config,
         ((nHashType & ~(SIGHASH_ANYONECANPAY)) ==
          SIGHASH_SINGLE);
 
-    // Script verification errors.
-    UniValue vErrors(UniValue::VARR);
+    // Use CTransaction for the constant parts of the transactions to avoid
+    // rehashing, and share the work of their signature hashes between their
+    // inputs. The coins are looked up before signing, the view isn't safe to
+    // use from several threads.
+    std::vector<CTransactionRef> vTxConst;
+    std::vector<std::unique_ptr<PrecomputedSignatureHash>> vSighashData;
+    std::vector<std::pair<size_t, size_t>> vInputs;
+    std::vector<const Coin *> vCoins;
+    for (size_t t = 0; t < vMergedTx.size(); t++) {
+        vTxConst.push_back(MakeTransactionRef(vMergedTx[t]));
+        vSighashData.emplace_back(new PrecomputedSignatureHash(*vTxConst[t]));
+        for (size_t i = 0; i < vMergedTx[t].vin.size(); i++) {
+            const Coin &coin = view.AccessCoin(vMergedTx[t].vin[i].prevout);
+            vInputs.emplace_back(t, i);
+            vCoins.push_back(coin.IsSpent() ? nullptr : &coin);
+        }
+    }
 
-    // Use CTransaction for the constant parts of the transaction to avoid
-    // rehashing.
-    const CTransaction txConst(mergedTx);
     // Sign what we can:
-    for (size_t i = 0; i < mergedTx.vin.size(); i++) {
-        CTxIn &txin = mergedTx.vin[i];
-        const Coin &coin = view.AccessCoin(txin.prevout);
-        if (coin.IsSpent()) {
-            TxInErrorToJSON(txin, vErrors, "Input not found or already spent");
-            continue;
+    std::vector<std::string> vInputErrors(vInputs.size());
+    ForEachInputParallel(vInputs.size(), [&](size_t nInput) {
+        const size_t t = vInputs[nInput].first, i = vInputs[nInput].second;
+        if (!vCoins[nInput]) {
+            vInputErrors[nInput] = "Input not found or already spent";
+            return;
         }
 
-        const CScript &prevPubKey = coin.GetTxOut().scriptPubKey;
-        const CAmount amount = coin.GetTxOut().nValue;
+        const CTransaction &txConst = *vTxConst[t];
+        const PrecomputedSignatureHash *sighashData = vSighashData[t].get();
+        const CScript &prevPubKey = vCoins[nInput]->GetTxOut().scriptPubKey;
+        const CAmount amount = vCoins[nInput]->GetTxOut().nValue;
 
         SignatureData sigdata;
         // Only sign SIGHASH_SINGLE if there's a corresponding output:
-        if (!fHashSingle || (i < mergedTx.vout.size())) {
-            ProduceSignature(MutableTransactionSignatureCreator(
-                                 &keystore, &mergedTx, i, amount, nHashType),
+        if (!fHashSingle || (i < txConst.vout.size())) {
+            ProduceSignature(TransactionSignatureCreator(&keystore, &txConst,
+                                                         i, amount, nHashType,
+                                                         sighashData),
                              prevPubKey, sigdata);
         }
 
         // ... and merge in other signatures:
-        for (const CMutableTransaction &txv : txVariants) {
+        for (const CMutableTransaction &txv : vTxVariants[t]) {
             if (txv.vin.size() > i) {
                 sigdata = CombineSignatures(
                     prevPubKey,
-                    TransactionSignatureChecker(&txConst, i), sigdata,
-                    DataFromTransaction(txv, i));
+                    TransactionSignatureChecker(&txConst, i, sighashData),
+                    sigdata, DataFromTransaction(txv, i));
             }
         }
 
-        UpdateTransaction(mergedTx, i, sigdata);
+        UpdateTransaction(vMergedTx[t], i, sigdata);
 
         ScriptError serror = SCRIPT_ERR_OK;
         if (!VerifyScript(
-                txin.scriptSig, prevPubKey, STANDARD_SCRIPT_VERIFY_FLAGS,
-                TransactionSignatureChecker(&txConst, i), &serror)) {
-            TxInErrorToJSON(txin, vErrors, ScriptErrorString(serror));
+                sigdata.scriptSig, prevPubKey, STANDARD_SCRIPT_VERIFY_FLAGS,
+                TransactionSignatureChecker(&txConst, i, sighashData),
+                &serror)) {
+            vInputErrors[nInput] = ScriptErrorString(serror);
+        }
+    });
+
+    UniValue results(UniValue::VARR);
+    size_t nInput = 0;
+    for (const CMutableTransaction &mergedTx : vMergedTx) {
+        // Script verification errors.
+        UniValue vErrors(UniValue::VARR);
+        for (const CTxIn &txin : mergedTx.vin) {
+            if (!vInputErrors[nInput].empty()) {
+                TxInErrorToJSON(txin, vErrors, vInputErrors[nInput]);
+            }
+            nInput++;
         }
+
+        bool fComplete = vErrors.empty();
+
+        UniValue result(UniValue::VOBJ);
+        result.push_back(Pair("hex", EncodeHexTx(mergedTx)));
+        result.push_back(Pair("complete", fComplete));
+        if (!vErrors.empty()) {
+            result.push_back(Pair("errors", vErrors));
+        }
+        results.push_back(result);
     }
 
-    bool fComplete = vErrors.empty();
+    return results;
+}
 
-    UniValue result(UniValue::VOBJ);
-    result.push_back(Pair("hex", EncodeHexTx(mergedTx)));
-    result.push_back(Pair("complete", fComplete));
-    if (!vErrors.empty()) {
-        result.push_back(Pair("errors", vErrors));
+
+static UniValue signrawtransaction(const Config &config,
+                                   const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 ||
+        request.params.size() > 4) {
+        throw std::runtime_error(
+            "signrawtransaction \"hexstring\" ( "
+            "[{\"txid\":\"id\",\"vout\":n,\"scriptPubKey\":\"hex\","
+            "\"redeemScript\":\"hex\",\"amount\":x.xx},...] [\"privatekey1\",...] sighashtype "
+            ")\n"
+            "\nSign inputs for raw transaction (serialized, hex-encoded).\n"
+            "The second optional argument (may be null) is an array of "
+            "previous transaction outputs that\n"
+            "this transaction depends on but may not yet be in the block "
+            "chain.\n"
+            "The third optional argument (may be null) is an array of "
+            "base58-encoded private\n"
+            "keys that, if given, will be the only keys used to sign the "
+            "transaction.\n"
+#ifdef ENABLE_WALLET
+            + HelpRequiringPassphrase() +
+            "\n"
+#endif
+
+            "\nArguments:\n"
+            "1. \"hexstring\"     (string, required) The transaction hex "
+            "string\n"
+            "2. \"prevtxs\"       (string, optional) An json array of previous "
+            "dependent transaction outputs\n"
+            "     [               (json array of json objects, or 'null' if "
+            "none provided)\n"
+            "       {\n"
+            "         \"txid\":\"id\",             (string, required) The "
+            "transaction id\n"
+            "         \"vout\":n,                  (numeric, required) The "
+            "output number\n"
+            "         \"scriptPubKey\": \"hex\",   (string, required) script "
+            "key\n"
+            "         \"redeemScript\": \"hex\",   (string, required for P2SH "
+            "or P2WSH) redeem script\n"
+            "         \"amount\": value            (numeric, required) The "
+            "amount spent\n"
+            "       }\n"
+            "       ,...\n"
+            "    ]\n"
+            "3. \"privkeys\"     (string, optional) A json array of "
+            "base58-encoded private keys for signing\n"
+            "    [                  (json array of strings, or 'null' if none "
+            "provided)\n"
+            "      \"privatekey\"   (string) private key in base58-encoding\n"
+            "      ,...\n"
+            "    ]\n"
+            "4. \"sighashtype\"     (string, optional, default=ALL) The "
+            "signature hash type. Must be one of\n"
+            "       \"ALL\"\n"
+            "       \"NONE\"\n"
+            "       \"SINGLE\"\n"
+            "       \"ALL|ANYONECANPAY\"\n"
+            "       \"NONE|ANYONECANPAY\"\n"
+            "       \"SINGLE|ANYONECANPAY\"\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"hex\" : \"value\",           (string) The hex-encoded raw "
+            "transaction with signature(s)\n"
+            "  \"complete\" : true|false,   (boolean) If the transaction has a "
+            "complete set of signatures\n"
+            "  \"errors\" : [                 (json array of objects) Script "
+            "verification errors (if there are any)\n"
+            "    {\n"
+            "      \"txid\" : \"hash\",           (string) The hash of the "
+            "referenced, previous transaction\n"
+            "      \"vout\" : n,                (numeric) The index of the "
+            "output to spent and used as input\n"
+            "      \"scriptSig\" : \"hex\",       (string) The hex-encoded "
+            "signature script\n"
+            "      \"sequence\" : n,            (numeric) Script sequence "
+            "number\n"
+            "      \"error\" : \"text\"           (string) Verification or "
+            "signing error related to the input\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("signrawtransaction", "\"myhex\"") +
+            HelpExampleRpc("signrawtransaction", "\"myhex\""));
     }
 
-    return result;
+#ifdef ENABLE_WALLET
+    LOCK2(cs_main, pwalletMain ? &pwalletMain->cs_wallet : nullptr);
+#else
+    LOCK(cs_main);
+#endif
+    RPCTypeCheck(
+        request.params,
+        {UniValue::VSTR, UniValue::VARR, UniValue::VARR, UniValue::VSTR}, true);
+
+    std::vector<std::vector<CMutableTransaction>> vTxVariants(
+        1, DecodeTxVariants(ParseHexV(request.params[0], "argument 1"), ""));
+    return SignRawTransactions(vTxVariants, request.params)[0];
+}
+
+static UniValue signrawtransactions(const Config &config,
+                                    const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 ||
+        request.params.size() > 4) {
+        throw std::runtime_error(
+            "signrawtransactions [\"hexstring\",...] ( "
+            "[{\"txid\":\"id\",\"vout\":n,\"scriptPubKey\":\"hex\","
+            "\"redeemScript\":\"hex\",\"amount\":x.xx},...] [\"privatekey1\",...] sighashtype "
+            ")\n"
+            "\nSign inputs for a list of raw transactions (serialized, "
+            "hex-encoded) in one call.\n"
+            "Each is signed as signrawtransaction would, with the same "
+            "previous outputs, keys and\n"
+            "signature hash type for all of them.\n"
+#ifdef ENABLE_WALLET
+            + HelpRequiringPassphrase() +
+            "\n"
+#endif
+
+            "\nArguments:\n"
+            "1. \"hexstrings\"    (array, required) The transaction hex "
+            "strings\n"
+            "2. \"prevtxs\"       (string, optional) The previous outputs "
+            "as for signrawtransaction\n"
+            "3. \"privkeys\"      (string, optional) The private keys as for "
+            "signrawtransaction\n"
+            "4. \"sighashtype\"   (string, optional, default=ALL) The "
+            "signature hash type as for signrawtransaction\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"hex\" : \"value\",         (string) The hex-encoded raw "
+            "transaction with signature(s)\n"
+            "    \"complete\" : true|false, (boolean) If the transaction has "
+            "a complete set of signatures\n"
+            "    \"errors\" : [...]         (json array of objects) Script "
+            "verification errors, as for signrawtransaction\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("signrawtransactions",
+                           "\"[\\\"myhex1\\\",\\\"myhex2\\\"]\"") +
+            HelpExampleRpc("signrawtransactions", "[\"myhex1\",\"myhex2\"]"));
+    }
+
+#ifdef ENABLE_WALLET
+    LOCK2(cs_main, pwalletMain ? &pwalletMain->cs_wallet : nullptr);
+#else
+    LOCK(cs_main);
+#endif
+    RPCTypeCheck(
+        request.params,
+        {UniValue::VARR, UniValue::VARR, UniValue::VARR, UniValue::VSTR}, true);
+
+    const UniValue &hexstrings = request.params[0].get_array();
+    std::vector<std::vector<CMutableTransaction>> vTxVariants;
+    for (size_t i = 0; i < hexstrings.size(); i++) {
+        vTxVariants.push_back(DecodeTxVariants(
+            ParseHexV(hexstrings[i], strprintf("hexstrings[%u]", i)),
+            strprintf(" at index %u", i)));
+    }
+    return SignRawTransactions(vTxVariants, request.params);
 }
 
 static UniValue sendrawtransaction(const Config &config,
@@ -1194,18 +1478,141 @@ static UniValue sendrawtransaction(const Config &config,
     return txid.GetHex();
 }
 
+static UniValue sendrawtransactions(const Config &config,
+                                    const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 ||
+        request.params.size() > 2) {
+        throw std::runtime_error(
+            "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits a list of raw transactions (serialized, hex-encoded) to "
+            "local node and network.\n"
+            "Transactions are accepted in the given order under a single lock, "
+            "so a child may spend outputs of a parent earlier in the list.\n"
+            "\nArguments:\n"
+            "1. \"hexstrings\"   (array, required) The hex strings of the raw "
+            "transactions, parents before children\n"
+            "2. allowhighfees    (boolean, optional, default=false) Allow high "
+            "fees\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\" : \"hash\",     (string) The transaction hash in hex\n"
+            "    \"accepted\" : true|false, (boolean) If the transaction is "
+            "in the mempool\n"
+            "    \"error\" : \"text\"     (string, optional) The reject "
+            "reason\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("sendrawtransactions",
+                           "\"[\\\"parenthex\\\",\\\"childhex\\\"]\"") +
+            HelpExampleRpc("sendrawtransactions",
+                           "[\"parenthex\",\"childhex\"]"));
+    }
+
+    RPCTypeCheck(request.params, {UniValue::VARR, UniValue::VBOOL});
+
+    // Decode everything before taking cs_main.
+    const UniValue &hexstrings = request.params[0].get_array();
+    std::vector<CTransactionRef> vtx;
+    vtx.reserve(hexstrings.size());
+    for (size_t i = 0; i < hexstrings.size(); i++) {
+        CMutableTransaction mtx;
+        if (!hexstrings[i].isStr() ||
+            !DecodeHexTx(mtx, hexstrings[i].get_str())) {
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR,
+                               strprintf("TX decode failed at index %u", i));
+        }
+        vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    CAmount nMaxRawTxFee = maxTxFee;
+    if (request.params.size() > 1 && request.params[1].get_bool()) {
+        nMaxRawTxFee = CAmount(0);
+    }
+
+    if (!g_connman) {
+        throw JSONRPCError(
+            RPC_CLIENT_P2P_DISABLED,
+            "Error: Peer-to-peer functionality missing or disabled");
+    }
+
+    UniValue results(UniValue::VARR);
+    std::vector<uint256> vRelay;
+    {
+        LOCK(cs_main);
+        CCoinsViewCache &view = *pcoinsTip;
+        for (CTransactionRef &tx : vtx) {
+            const uint256 txid = tx->GetId();
+            UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("txid", txid.GetHex()));
+
+            bool fHaveChain = false;
+            for (size_t o = 0; !fHaveChain && o < tx->vout.size(); o++) {
+                const Coin &existingCoin = view.AccessCoin(
+                    COutPoint(txid, o, tx->vout[o].nValue));
+                fHaveChain = !existingCoin.IsSpent();
+            }
+
+            if (fHaveChain) {
+                entry.push_back(Pair("accepted", false));
+                entry.push_back(
+                    Pair("error", "transaction already in block chain"));
+            } else if (mempool.exists(txid)) {
+                entry.push_back(Pair("accepted", true));
+                vRelay.push_back(txid);
+            } else {
+                // Earlier entries are already in the mempool, so their
+                // outputs are visible to later ones through the mempool view.
+                CValidationState state;
+                bool fMissingInputs;
+                if (AcceptToMemoryPool(config, mempool, state, std::move(tx),
+                                       true, &fMissingInputs, nullptr, false,
+                                       nMaxRawTxFee)) {
+                    entry.push_back(Pair("accepted", true));
+                    vRelay.push_back(txid);
+                } else {
+                    entry.push_back(Pair("accepted", false));
+                    if (state.IsInvalid()) {
+                        entry.push_back(Pair(
+                            "error", strprintf("%i: %s", state.GetRejectCode(),
+                                               state.GetRejectReason())));
+                    } else if (fMissingInputs) {
+                        entry.push_back(Pair("error", "Missing inputs"));
+                    } else {
+                        entry.push_back(
+                            Pair("error", state.GetRejectReason()));
+                    }
+                }
+            }
+            results.push_back(entry);
+        }
+    }
+
+    g_connman->ForEachNode([&vRelay](CNode *pnode) {
+        for (const uint256 &txid : vRelay) {
+            pnode->PushInventory(CInv(MSG_TX, txid));
+        }
+    });
+    return results;
+}
+
 // clang-format off
 static const CRPCCommand commands[] = {
-    //  category            name                      actor (function)        okSafeMode
+    //  category            name                      actor (function)        okSafeMode, argNames, concurrent
     //  ------------------- ------------------------  ----------------------  ----------
-    { "rawtransactions",    "getrawtransaction",      getrawtransaction,      true,  {"txid","verbose"} },
-    { "rawtransactions",    "createrawtransaction",   createrawtransaction,   true,  {"inputs","outputs"} },
-    { "rawtransactions",    "decoderawtransaction",   decoderawtransaction,   true,  {"hexstring"} },
-    { "rawtransactions",    "decodescript",           decodescript,           true,  {"hexstring"} },
+    { "rawtransactions",    "getrawtransaction",      getrawtransaction,      true,  {"txid","verbose"}, true },
+    { "rawtransactions",    "createrawtransaction",   createrawtransaction,   true,  {"inputs","outputs"}, true },
+    { "rawtransactions",    "decoderawtransaction",   decoderawtransaction,   true,  {"hexstring"}, true },
+    { "rawtransactions",    "decodescript",           decodescript,           true,  {"hexstring"}, true },
     { "rawtransactions",    "sendrawtransaction",     sendrawtransaction,     false, {"hexstring","allowhighfees"} },
+    { "rawtransactions",    "sendrawtransactions",    sendrawtransactions,    false, {"hexstrings","allowhighfees"} },
     { "rawtransactions",    "signrawtransaction",     signrawtransaction,     false, {"hexstring","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
+    { "rawtransactions",    "signrawtransactions",    signrawtransactions,    false, {"hexstrings","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
 
     { "blockchain",         "gettxoutproof",          gettxoutproof,          true,  {"txids", "blockhash"} },
+    { "blockchain",         "gettxoutproofs",         gettxoutproofs,         true,  {"txids", "separate"} },
     { "blockchain",         "verifytxoutproof",       verifytxoutproof,       true,  {"proof"} },
 };
 // clang-format on
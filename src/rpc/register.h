@@ -21,6 +21,10 @@ void RegisterMiningRPCCommands(CRPCTable &tableRPC);
 void RegisterRawTransactionRPCCommands(CRPCTable &tableRPC);
 /** Register interest RPC commands */
 void RegisterInterestRPCCommands(CRPCTable &tableRPC);
+/** Register event RPC commands */
+void RegisterEventsRPCCommands(CRPCTable &tableRPC);
+/** Register RPC statistics commands */
+void RegisterStatsRPCCommands(CRPCTable &tableRPC);
 
 static inline void RegisterAllRPCCommands(CRPCTable &t) {
     RegisterBlockchainRPCCommands(t);
@@ -29,6 +33,8 @@ static inline void RegisterAllRPCCommands(CRPCTable &t) {
     RegisterMiningRPCCommands(t);
     RegisterRawTransactionRPCCommands(t);
     RegisterInterestRPCCommands(t);
+    RegisterEventsRPCCommands(t);
+    RegisterStatsRPCCommands(t);
 }
 
 #endif
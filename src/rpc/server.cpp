@@ -9,10 +9,12 @@
 #include "config.h"
 #include "init.h"
 #include "random.h"
+#include "rpc/stats.h"
 #include "sync.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "validationinterface.h"
 
 #include <univalue.h>
 
@@ -22,8 +24,13 @@
 #include <boost/signals2/signal.hpp>
 #include <boost/thread.hpp>
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory> // for unique_ptr
+#include <mutex>
 #include <set>
+#include <thread>
 #include <unordered_map>
 
 static bool fRPCRunning = false;
@@ -299,8 +306,115 @@ bool CRPCTable::appendCommand(const std::string &name,
     return true;
 }
 
+namespace {
+
+/**
+ * Threads that help with the calls of batches. The thread that got a batch
+ * works on it too, so a batch never waits for one of these to be free.
+ */
+class CRPCBatchExecutor {
+public:
+    CRPCBatchExecutor() : fStop(false) {}
+
+    void Start(int nThreads) {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = false;
+        for (int i = 0; i < nThreads; i++) {
+            threads.emplace_back(&TraceThread<std::function<void()>>,
+                                 "rpcbatch",
+                                 std::function<void()>(std::bind(
+                                     &CRPCBatchExecutor::ThreadWork, this)));
+        }
+        nThreadsRunning = nThreads;
+    }
+
+    void Stop() {
+        std::vector<std::thread> threadsStopping;
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            fStop = true;
+            queue.clear();
+            threadsStopping.swap(threads);
+            nThreadsRunning = 0;
+        }
+        cond.notify_all();
+        for (std::thread &thread : threadsStopping) {
+            thread.join();
+        }
+    }
+
+    int Threads() const { return nThreadsRunning; }
+
+    void Submit(const std::function<void()> &work) {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            if (fStop) {
+                return;
+            }
+            queue.push_back(work);
+        }
+        cond.notify_one();
+    }
+
+private:
+    void ThreadWork() {
+        while (true) {
+            std::function<void()> work;
+            {
+                std::unique_lock<std::mutex> lock(cs);
+                cond.wait(lock, [this] { return fStop || !queue.empty(); });
+                if (fStop) {
+                    return;
+                }
+                work = std::move(queue.front());
+                queue.pop_front();
+            }
+            work();
+        }
+    }
+
+    std::mutex cs;
+    std::condition_variable cond;
+    std::deque<std::function<void()>> queue;
+    bool fStop;
+    std::atomic<int> nThreadsRunning{0};
+    std::vector<std::thread> threads;
+};
+
+/**
+ * Calls of a batch that may run in parallel, handed out one at a time to the
+ * threads working on them. A thread that starts after all are handed out
+ * finds nothing left to do.
+ */
+struct CRPCBatchRun {
+    Config &config;
+    const UniValue &vReq;
+    const size_t nBegin;
+    std::vector<UniValue> vResults;
+
+    std::atomic<size_t> nNext;
+    std::mutex cs;
+    std::condition_variable cond;
+    size_t nDone;
+
+    CRPCBatchRun(Config &configIn, const UniValue &vReqIn, size_t nBeginIn,
+                 size_t nEnd)
+        : config(configIn), vReq(vReqIn), nBegin(nBeginIn),
+          vResults(nEnd - nBeginIn), nNext(0), nDone(0) {}
+
+    void Work();
+};
+
+} // namespace
+
+static CRPCBatchExecutor rpcBatchExecutor;
+
 bool StartRPC() {
     LogPrint("rpc", "Starting RPC\n");
+    rpcBatchExecutor.Start(
+        std::max(0, std::min<int>(GetArg("-rpcbatchthreads",
+                                         DEFAULT_RPC_BATCH_THREADS),
+                                  MAX_RPC_BATCH_THREADS)));
     fRPCRunning = true;
     g_rpcSignals.Started();
     return true;
@@ -315,6 +429,7 @@ void InterruptRPC() {
 void StopRPC() {
     LogPrint("rpc", "Stopping RPC\n");
     deadlineTimers.clear();
+    rpcBatchExecutor.Stop();
     DeleteAuthCookie();
     g_rpcSignals.Stopped();
 }
@@ -390,10 +505,63 @@ static UniValue JSONRPCExecOne(Config &config, const UniValue &req) {
     return rpc_result;
 }
 
+void CRPCBatchRun::Work() {
+    size_t nCompleted = 0;
+    for (size_t i; (i = nNext++) < vResults.size(); nCompleted++) {
+        vResults[i] = JSONRPCExecOne(config, vReq[nBegin + i]);
+    }
+    if (nCompleted > 0) {
+        std::lock_guard<std::mutex> lock(cs);
+        nDone += nCompleted;
+        cond.notify_all();
+    }
+}
+
+static bool IsConcurrentRequest(const UniValue &req) {
+    if (!req.isObject()) {
+        return false;
+    }
+    const UniValue &method = find_value(req.get_obj(), "method");
+    if (!method.isStr()) {
+        return false;
+    }
+    const CRPCCommand *pcmd = tableRPC[method.get_str()];
+    return pcmd && pcmd->fConcurrent;
+}
+
 std::string JSONRPCExecBatch(Config &config, const UniValue &vReq) {
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++) {
-        ret.push_back(JSONRPCExecOne(config, vReq[reqIdx]));
+    for (size_t reqIdx = 0; reqIdx < vReq.size();) {
+        // Other calls run on their own, after the ones before them and
+        // before the ones after them, as they would without threads.
+        size_t reqEnd = reqIdx;
+        while (reqEnd < vReq.size() && IsConcurrentRequest(vReq[reqEnd])) {
+            reqEnd++;
+        }
+        if (reqEnd - reqIdx < 2 || rpcBatchExecutor.Threads() == 0) {
+            ret.push_back(JSONRPCExecOne(config, vReq[reqIdx]));
+            reqIdx++;
+            continue;
+        }
+
+        std::shared_ptr<CRPCBatchRun> run =
+            std::make_shared<CRPCBatchRun>(config, vReq, reqIdx, reqEnd);
+        const int nHelpers = std::min<int>(rpcBatchExecutor.Threads(),
+                                           reqEnd - reqIdx - 1);
+        for (int i = 0; i < nHelpers; i++) {
+            rpcBatchExecutor.Submit([run]() { run->Work(); });
+        }
+        run->Work();
+        {
+            std::unique_lock<std::mutex> lock(run->cs);
+            run->cond.wait(lock, [&run] {
+                return run->nDone == run->vResults.size();
+            });
+        }
+        for (UniValue &result : run->vResults) {
+            ret.push_back(std::move(result));
+        }
+        reqIdx = reqEnd;
     }
 
     return ret.write() + "\n";
@@ -457,6 +625,14 @@ UniValue CRPCTable::execute(Config &config,
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    // The wallet gets validation notifications asynchronously, let it see
+    // everything that happened before the call.
+    if (pcmd->category == "wallet") {
+        SyncWithValidationInterfaceQueue();
+    }
+
+    // For getrpcstats.
+    CRPCCallTimer timer(pcmd->name);
     try {
         // Execute, convert arguments to array if necessary
         if (request.params.isObject()) {
@@ -19,6 +19,10 @@
 #include <univalue.h>
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
+/** Default for -rpcbatchthreads, 0 runs the calls of a batch one by one */
+static const int DEFAULT_RPC_BATCH_THREADS = 0;
+/** Maximum number of threads running the calls of batches */
+static const int MAX_RPC_BATCH_THREADS = 64;
 
 class CRPCCommand;
 
@@ -30,6 +34,7 @@ void OnPostCommand(std::function<void(const CRPCCommand &)> slot);
 } // namespace RPCServer
 
 class CBlockIndex;
+class CJSONStreamWriter;
 class Config;
 class CNetAddr;
 
@@ -50,11 +55,20 @@ public:
     bool fHelp;
     std::string URI;
     std::string authUser;
+    /**
+     * Where handlers of big results may write them, as they go, instead of
+     * returning them. Only set when the caller can take a result that way,
+     * handlers return it as usual otherwise. A handler that writes to it
+     * returns NullUniValue, and should throw its errors before it writes
+     * anything.
+     */
+    CJSONStreamWriter *pStream;
 
     JSONRPCRequest() {
         id = NullUniValue;
         params = NullUniValue;
         fHelp = false;
+        pStream = nullptr;
     }
 
     void parse(const UniValue &valRequest);
@@ -151,11 +165,18 @@ public:
     rpcfn_type actor;
     bool okSafeMode;
     std::vector<std::string> argNames;
+    /**
+     * Whether calls only read, without holding cs_main for long, so that the
+     * calls of a batch can run in parallel and in any order.
+     */
+    bool fConcurrent;
 
     CRPCCommand(std::string _category, std::string _name, rpcfn_type _actor,
-                bool _okSafeMode, std::vector<std::string> _argNames)
+                bool _okSafeMode, std::vector<std::string> _argNames,
+                bool _fConcurrent = false)
         : category{std::move(_category)}, name{std::move(_name)}, actor{_actor},
-          okSafeMode{_okSafeMode}, argNames{std::move(_argNames)} {}
+          okSafeMode{_okSafeMode}, argNames{std::move(_argNames)},
+          fConcurrent{_fConcurrent} {}
 
     /**
      * It is safe to cast from void(const int*) to void(int*) but C++ do not
@@ -164,10 +185,10 @@ public:
      */
     CRPCCommand(std::string _category, std::string _name,
                 const_rpcfn_type _actor, bool _okSafeMode,
-                std::vector<std::string> _argNames)
+                std::vector<std::string> _argNames, bool _fConcurrent = false)
         : category{std::move(_category)}, name{std::move(_name)},
           actor{reinterpret_cast<rpcfn_type>(_actor)}, okSafeMode{_okSafeMode},
-          argNames{std::move(_argNames)} {}
+          argNames{std::move(_argNames)}, fConcurrent{_fConcurrent} {}
 };
 
 /**
@@ -230,6 +251,10 @@ extern void EnsureWalletIsUnlocked();
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
+/**
+ * Execute the calls of a batch. Runs of calls to concurrent commands are
+ * spread over the -rpcbatchthreads, the results stay in request order.
+ */
 std::string JSONRPCExecBatch(Config &config, const UniValue &vReq);
 void RPCNotifyBlockChange(bool ibd, const CBlockIndex *);
 
@@ -0,0 +1,418 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/stats.h"
+
+#include "rpc/server.h"
+#include "scheduler.h"
+#include "tinyformat.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+
+#include <univalue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <exception>
+
+CRPCStats rpcStats;
+
+/** Bounds of the buckets /metrics shows, powers of two microseconds */
+static const int PROMETHEUS_LATENCY_BOUNDS[] = {10, 13, 15, 17, 20, 23, 26};
+
+int GetRPCLatencyBucket(int64_t nMicros) {
+    if (nMicros < 4) {
+        return std::max<int64_t>(nMicros, 0);
+    }
+    int nLog = 2;
+    while (nLog < 62 && (nMicros >> (nLog + 1)) != 0) {
+        nLog++;
+    }
+    const int nSub = (nMicros >> (nLog - 2)) & 3;
+    return std::min(4 * (nLog - 1) + nSub, RPC_LATENCY_BUCKETS - 1);
+}
+
+int64_t GetRPCLatencyBucketMax(int nBucket) {
+    if (nBucket < 4) {
+        return nBucket;
+    }
+    const int nShift = nBucket / 4 - 1;
+    return (int64_t(4 + nBucket % 4) << nShift) + (int64_t(1) << nShift) - 1;
+}
+
+CRPCMethodStats::CRPCMethodStats()
+    : nCalls(0), nErrors(0), nTotalMicros(0), nMaxMicros(0),
+      nMainWaitMicros(0), nWalletWaitMicros(0), nReplies(0), nReplyBytes(0),
+      nMaxReplyBytes(0) {
+    memset(vLatency, 0, sizeof(vLatency));
+}
+
+int64_t CRPCMethodStats::GetLatencyPercentile(double dFraction) const {
+    const uint64_t nRank =
+        std::max<uint64_t>(1, uint64_t(std::ceil(dFraction * nCalls)));
+    uint64_t nCount = 0;
+    for (int i = 0; i < RPC_LATENCY_BUCKETS; i++) {
+        nCount += vLatency[i];
+        if (nCount >= nRank) {
+            return std::min(GetRPCLatencyBucketMax(i), nMaxMicros);
+        }
+    }
+    return nMaxMicros;
+}
+
+CRPCStats::CRPCStats() : nStartTime(GetTime()) {}
+
+void CRPCStats::AddCall(const std::string &strMethod, int64_t nMicros,
+                        const LockWaitTimes &waits, bool fError) {
+    std::lock_guard<std::mutex> lock(cs);
+    CRPCMethodStats &stats = mapStats[strMethod];
+    stats.nCalls++;
+    stats.nErrors += fError;
+    stats.nTotalMicros += nMicros;
+    stats.nMaxMicros = std::max(stats.nMaxMicros, nMicros);
+    stats.nMainWaitMicros += waits.nMainMicros;
+    stats.nWalletWaitMicros += waits.nWalletMicros;
+    stats.vLatency[GetRPCLatencyBucket(nMicros)]++;
+}
+
+void CRPCStats::AddReply(const std::string &strMethod, size_t nBytes) {
+    std::lock_guard<std::mutex> lock(cs);
+    CRPCMethodStats &stats = mapStats[strMethod];
+    stats.nReplies++;
+    stats.nReplyBytes += nBytes;
+    stats.nMaxReplyBytes = std::max<uint64_t>(stats.nMaxReplyBytes, nBytes);
+}
+
+std::map<std::string, CRPCMethodStats> CRPCStats::GetStats() const {
+    std::lock_guard<std::mutex> lock(cs);
+    return mapStats;
+}
+
+int64_t CRPCStats::GetStartTime() const {
+    std::lock_guard<std::mutex> lock(cs);
+    return nStartTime;
+}
+
+void CRPCStats::Reset() {
+    std::lock_guard<std::mutex> lock(cs);
+    mapStats.clear();
+    nStartTime = GetTime();
+}
+
+std::string CRPCStats::ToPrometheus() const {
+    const std::map<std::string, CRPCMethodStats> stats = GetStats();
+    std::string str;
+    str += "# HELP platopia_rpc_calls_total RPC calls, by method.\n"
+           "# TYPE platopia_rpc_calls_total counter\n";
+    for (const auto &it : stats) {
+        str += strprintf("platopia_rpc_calls_total{method=\"%s\"} %u\n",
+                         it.first, it.second.nCalls);
+    }
+    str += "# HELP platopia_rpc_errors_total RPC calls that failed.\n"
+           "# TYPE platopia_rpc_errors_total counter\n";
+    for (const auto &it : stats) {
+        str += strprintf("platopia_rpc_errors_total{method=\"%s\"} %u\n",
+                         it.first, it.second.nErrors);
+    }
+    str += "# HELP platopia_rpc_latency_seconds Time RPC calls took.\n"
+           "# TYPE platopia_rpc_latency_seconds histogram\n";
+    for (const auto &it : stats) {
+        const CRPCMethodStats &method = it.second;
+        // The bounds are bucket bounds, the counts exact.
+        int nBucket = 0;
+        uint64_t nCount = 0;
+        for (int nLog : PROMETHEUS_LATENCY_BOUNDS) {
+            const int64_t nBound = int64_t(1) << nLog;
+            for (; GetRPCLatencyBucketMax(nBucket) < nBound; nBucket++) {
+                nCount += method.vLatency[nBucket];
+            }
+            str += strprintf("platopia_rpc_latency_seconds_bucket{method="
+                             "\"%s\",le=\"%.6f\"} %u\n",
+                             it.first, nBound / 1e6, nCount);
+        }
+        str += strprintf("platopia_rpc_latency_seconds_bucket{method=\"%s\","
+                         "le=\"+Inf\"} %u\n",
+                         it.first, method.nCalls);
+        str += strprintf(
+            "platopia_rpc_latency_seconds_sum{method=\"%s\"} %.6f\n",
+            it.first, method.nTotalMicros / 1e6);
+        str += strprintf("platopia_rpc_latency_seconds_count{method=\"%s\"} "
+                         "%u\n",
+                         it.first, method.nCalls);
+    }
+    str += "# HELP platopia_rpc_lock_wait_seconds_total Time RPC calls waited "
+           "for locks other threads held.\n"
+           "# TYPE platopia_rpc_lock_wait_seconds_total counter\n";
+    for (const auto &it : stats) {
+        str += strprintf("platopia_rpc_lock_wait_seconds_total{method=\"%s\","
+                         "lock=\"cs_main\"} %.6f\n",
+                         it.first, it.second.nMainWaitMicros / 1e6);
+        str += strprintf("platopia_rpc_lock_wait_seconds_total{method=\"%s\","
+                         "lock=\"cs_wallet\"} %.6f\n",
+                         it.first, it.second.nWalletWaitMicros / 1e6);
+    }
+    str += "# HELP platopia_rpc_reply_bytes_total Size of the RPC replies, "
+           "but those to batches.\n"
+           "# TYPE platopia_rpc_reply_bytes_total counter\n";
+    for (const auto &it : stats) {
+        str += strprintf("platopia_rpc_reply_bytes_total{method=\"%s\"} %u\n",
+                         it.first, it.second.nReplyBytes);
+    }
+    return str;
+}
+
+CRPCCallTimer::CRPCCallTimer(const std::string &strMethodIn)
+    : strMethod(strMethodIn), nStart(GetTimeMicros()) {
+    pwaitsOuter = SetLockWaitTimes(&waits);
+}
+
+CRPCCallTimer::~CRPCCallTimer() {
+    SetLockWaitTimes(pwaitsOuter);
+    rpcStats.AddCall(strMethod, GetTimeMicros() - nStart, waits,
+                     std::uncaught_exception());
+}
+
+static UniValue getrpcstats(const Config &config,
+                            const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() > 1) {
+        throw std::runtime_error(
+            "getrpcstats ( reset )\n"
+            "\nReturns how often each RPC method was called since the start, "
+            "or the last\n"
+            "reset, and how long the calls took. Latencies are in "
+            "microseconds, the\n"
+            "percentiles within a quarter.\n"
+            "\nArguments:\n"
+            "1. reset    (boolean, optional, default=false) Start over "
+            "after returning the counts\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"since\": n,                (numeric) Unix time the counts "
+            "start from\n"
+            "  \"methods\": {\n"
+            "    \"method\": {\n"
+            "      \"calls\": n,            (numeric) Calls made\n"
+            "      \"errors\": n,           (numeric) Calls that failed\n"
+            "      \"mean_us\": n,          (numeric) Mean latency\n"
+            "      \"p50_us\": n,           (numeric) Median latency\n"
+            "      \"p99_us\": n,           (numeric) 99th percentile "
+            "latency\n"
+            "      \"max_us\": n,           (numeric) Longest latency\n"
+            "      \"cs_main_wait_us\": n,  (numeric) Time waited for "
+            "cs_main other threads held\n"
+            "      \"cs_wallet_wait_us\": n,(numeric) Time waited for "
+            "cs_wallet other threads held\n"
+            "      \"replies\": n,          (numeric) Replies counted, those "
+            "to batches aren't\n"
+            "      \"reply_bytes\": n,      (numeric) Their total size\n"
+            "      \"max_reply_bytes\": n   (numeric) The largest of them\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getrpcstats", "") +
+            HelpExampleCli("getrpcstats", "true") +
+            HelpExampleRpc("getrpcstats", ""));
+    }
+
+    bool fReset = false;
+    if (request.params.size() > 0 && !request.params[0].isNull()) {
+        fReset = request.params[0].get_bool();
+    }
+
+    const int64_t nSince = rpcStats.GetStartTime();
+    const std::map<std::string, CRPCMethodStats> stats = rpcStats.GetStats();
+    if (fReset) {
+        rpcStats.Reset();
+    }
+
+    UniValue methods(UniValue::VOBJ);
+    for (const auto &it : stats) {
+        const CRPCMethodStats &method = it.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKVEnd("calls", method.nCalls);
+        obj.pushKVEnd("errors", method.nErrors);
+        const int64_t nCalls = method.nCalls;
+        obj.pushKVEnd("mean_us", nCalls ? method.nTotalMicros / nCalls : 0);
+        obj.pushKVEnd("p50_us", method.GetLatencyPercentile(0.5));
+        obj.pushKVEnd("p99_us", method.GetLatencyPercentile(0.99));
+        obj.pushKVEnd("max_us", method.nMaxMicros);
+        obj.pushKVEnd("cs_main_wait_us", method.nMainWaitMicros);
+        obj.pushKVEnd("cs_wallet_wait_us", method.nWalletWaitMicros);
+        obj.pushKVEnd("replies", method.nReplies);
+        obj.pushKVEnd("reply_bytes", method.nReplyBytes);
+        obj.pushKVEnd("max_reply_bytes", method.nMaxReplyBytes);
+        methods.pushKVEnd(it.first, std::move(obj));
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKVEnd("since", nSince);
+    result.pushKVEnd("methods", std::move(methods));
+    return result;
+}
+
+static std::atomic<CScheduler *> pschedulerStats(nullptr);
+
+void SetRPCStatsScheduler(CScheduler *pscheduler) {
+    pschedulerStats = pscheduler;
+}
+
+static UniValue getschedulerstats(const Config &config,
+                                  const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 0) {
+        throw std::runtime_error(
+            "getschedulerstats\n"
+            "\nReturns how long the background tasks took since the start, "
+            "and how late\n"
+            "they started, by task. Times are in microseconds.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"queued\": n,              (numeric) Tasks waiting to run\n"
+            "  \"tasks\": {\n"
+            "    \"task\": {\n"
+            "      \"runs\": n,            (numeric) Times the task ran\n"
+            "      \"mean_us\": n,         (numeric) Mean runtime\n"
+            "      \"max_us\": n,          (numeric) Longest runtime\n"
+            "      \"mean_late_us\": n,    (numeric) Mean delay past the "
+            "time it was due\n"
+            "      \"max_late_us\": n      (numeric) Longest delay\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getschedulerstats", "") +
+            HelpExampleRpc("getschedulerstats", ""));
+    }
+
+    CScheduler *pscheduler = pschedulerStats;
+    if (!pscheduler) {
+        throw JSONRPCError(RPC_MISC_ERROR, "No scheduler is running");
+    }
+
+    boost::chrono::system_clock::time_point first, last;
+    const size_t nQueued = pscheduler->getQueueInfo(first, last);
+    const std::map<std::string, CSchedulerTaskStats> stats =
+        pscheduler->getTaskStats();
+
+    UniValue tasks(UniValue::VOBJ);
+    for (const auto &it : stats) {
+        const CSchedulerTaskStats &task = it.second;
+        const int64_t nRuns = task.nRuns;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKVEnd("runs", task.nRuns);
+        obj.pushKVEnd("mean_us", nRuns ? task.nTotalMicros / nRuns : 0);
+        obj.pushKVEnd("max_us", task.nMaxMicros);
+        obj.pushKVEnd("mean_late_us",
+                      nRuns ? task.nTotalLateMicros / nRuns : 0);
+        obj.pushKVEnd("max_late_us", task.nMaxLateMicros);
+        tasks.pushKVEnd(it.first.empty() ? "other" : it.first,
+                        std::move(obj));
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKVEnd("queued", uint64_t(nQueued));
+    result.pushKVEnd("tasks", std::move(tasks));
+    return result;
+}
+
+static UniValue LockHistogram(const uint64_t *vCounts) {
+    UniValue histogram(UniValue::VARR);
+    for (int i = 0; i < LOCK_STATS_BUCKETS; i++) {
+        histogram.push_back(vCounts[i]);
+    }
+    return histogram;
+}
+
+static UniValue getlockstats(const Config &config,
+                             const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() > 1) {
+        throw std::runtime_error(
+            "getlockstats ( reset )\n"
+            "\nReturns how long the locks taken at each LOCK site were "
+            "waited for and\n"
+            "held since the start, or the last reset, longest waits first. "
+            "Requires\n"
+            "-lockstats. Times are in microseconds, entry i of the "
+            "histograms counts\n"
+            "those below 2^i, the last entry the longer ones.\n"
+            "\nArguments:\n"
+            "1. reset    (boolean, optional, default=false) Start over "
+            "after returning the counts\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"lock\": \"name\",        (string) The lock, as the site "
+            "names it\n"
+            "    \"site\": \"file:line\",   (string) Where it is taken\n"
+            "    \"acquired\": n,          (numeric) Times it was taken\n"
+            "    \"contended\": n,         (numeric) Times another thread "
+            "held it\n"
+            "    \"wait_us\": n,           (numeric) Total time waited\n"
+            "    \"max_wait_us\": n,       (numeric) Longest wait\n"
+            "    \"hold_us\": n,           (numeric) Total time held\n"
+            "    \"max_hold_us\": n,       (numeric) Longest hold\n"
+            "    \"wait_histogram\": [n,...], (array) The waits by length\n"
+            "    \"hold_histogram\": [n,...]  (array) The holds by length\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getlockstats", "") +
+            HelpExampleCli("getlockstats", "true") +
+            HelpExampleRpc("getlockstats", ""));
+    }
+
+    if (!fLockStats) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "Lock statistics are off, start with -lockstats");
+    }
+
+    bool fReset = false;
+    if (request.params.size() > 0 && !request.params[0].isNull()) {
+        fReset = request.params[0].get_bool();
+    }
+
+    std::vector<LockSiteStats> vStats = GetLockStats();
+    if (fReset) {
+        ResetLockStats();
+    }
+    std::sort(vStats.begin(), vStats.end(),
+              [](const LockSiteStats &a, const LockSiteStats &b) {
+                  return a.nWaitMicros > b.nWaitMicros;
+              });
+
+    UniValue result(UniValue::VARR);
+    for (const LockSiteStats &stats : vStats) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKVEnd("lock", stats.pszName);
+        obj.pushKVEnd("site", strprintf("%s:%d", stats.pszFile, stats.nLine));
+        obj.pushKVEnd("acquired", stats.nAcquired);
+        obj.pushKVEnd("contended", stats.nContended);
+        obj.pushKVEnd("wait_us", stats.nWaitMicros);
+        obj.pushKVEnd("max_wait_us", stats.nMaxWaitMicros);
+        obj.pushKVEnd("hold_us", stats.nHoldMicros);
+        obj.pushKVEnd("max_hold_us", stats.nMaxHoldMicros);
+        obj.pushKVEnd("wait_histogram", LockHistogram(stats.vWait));
+        obj.pushKVEnd("hold_histogram", LockHistogram(stats.vHold));
+        result.push_back(std::move(obj));
+    }
+    return result;
+}
+
+// clang-format off
+static const CRPCCommand commands[] = {
+    //  category            name                      actor (function)        okSafe argNames
+    //  ------------------- ------------------------  ----------------------  ------ ----------
+    { "control",            "getrpcstats",            getrpcstats,            true,  {"reset"}, true },
+    { "control",            "getschedulerstats",      getschedulerstats,      true,  {}, true },
+    { "control",            "getlockstats",           getlockstats,           true,  {"reset"}, true },
+};
+// clang-format on
+
+void RegisterStatsRPCCommands(CRPCTable &t) {
+    for (unsigned int vcidx = 0; vcidx < ARRAYLEN(commands); vcidx++) {
+        t.appendCommand(commands[vcidx].name, &commands[vcidx]);
+    }
+}
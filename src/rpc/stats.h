@@ -0,0 +1,97 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPCSTATS_H
+#define BITCOIN_RPCSTATS_H
+
+#include "sync.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+/**
+ * Buckets of the RPC latency histograms. Four per power of two microseconds,
+ * so a percentile is within a quarter of the latency it stands for.
+ */
+static const int RPC_LATENCY_BUCKETS = 160;
+static const bool DEFAULT_RPC_METRICS = false;
+
+/** What getrpcstats tells of the calls of a method */
+struct CRPCMethodStats {
+    uint64_t nCalls;
+    uint64_t nErrors;
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+    //! Time the calls waited for cs_main and cs_wallet, other threads held
+    int64_t nMainWaitMicros;
+    int64_t nWalletWaitMicros;
+    //! Replies counted, replies to batches aren't, and their size
+    uint64_t nReplies;
+    uint64_t nReplyBytes;
+    uint64_t nMaxReplyBytes;
+    uint64_t vLatency[RPC_LATENCY_BUCKETS];
+
+    CRPCMethodStats();
+
+    /** The latency fraction of the calls took at most, in microseconds */
+    int64_t GetLatencyPercentile(double dFraction) const;
+};
+
+/** The bucket of the latency histograms nMicros is counted in */
+int GetRPCLatencyBucket(int64_t nMicros);
+/** The longest latency counted in bucket nBucket */
+int64_t GetRPCLatencyBucketMax(int nBucket);
+
+/** Counts and latencies of the RPC calls, by method */
+class CRPCStats {
+public:
+    CRPCStats();
+
+    void AddCall(const std::string &strMethod, int64_t nMicros,
+                 const LockWaitTimes &waits, bool fError);
+    void AddReply(const std::string &strMethod, size_t nBytes);
+
+    std::map<std::string, CRPCMethodStats> GetStats() const;
+    /** Unix time the counts start from */
+    int64_t GetStartTime() const;
+    void Reset();
+
+    /** The counts in the Prometheus text format, for /metrics */
+    std::string ToPrometheus() const;
+
+private:
+    mutable std::mutex cs;
+    std::map<std::string, CRPCMethodStats> mapStats;
+    int64_t nStartTime;
+};
+
+extern CRPCStats rpcStats;
+
+class CScheduler;
+
+/** The scheduler getschedulerstats reports on, none with nullptr */
+void SetRPCStatsScheduler(CScheduler *pscheduler);
+
+/**
+ * Times the RPC call it lives through on the current thread, with the time
+ * the call waits for cs_main and cs_wallet, and adds it to rpcStats. A call
+ * that ends in an exception counts as an error.
+ */
+class CRPCCallTimer {
+public:
+    explicit CRPCCallTimer(const std::string &strMethodIn);
+    ~CRPCCallTimer();
+
+private:
+    const std::string strMethod;
+    const int64_t nStart;
+    LockWaitTimes waits;
+    //! Of a call this one is made from
+    LockWaitTimes *pwaitsOuter;
+};
+
+#endif // BITCOIN_RPCSTATS_H
@@ -9,6 +9,7 @@
 
 #include <univalue.h>
 
+class CJSONStreamWriter;
 class CScript;
 
 void ScriptPubKeyToJSON(const Config &config, const CScript &scriptPubKey,
@@ -17,6 +18,13 @@ void TxToJSON(const Config &config, const CTransaction &tx,
               const uint256 hashBlock, UniValue &entry);
 UniValue blockToJSON(const Config &config, const CBlock &block,
                      const CBlockIndex *blockindex, bool txDetails = false);
+/**
+ * blockToJSON, written to stream one transaction at a time. What comes from
+ * the chain is read from GetChainSnapshot, without cs_main.
+ */
+void blockToJSON(const Config &config, const CBlock &block,
+                 const CBlockIndex *blockindex, bool txDetails,
+                 CJSONStreamWriter &stream);
 UniValue blockheaderToJSON(const CBlockIndex *blockindex);
 
 #endif // BITCOIN_RPCTOJSON_H
@@ -7,7 +7,9 @@
 #include "reverselock.h"
 
 #include <boost/bind.hpp>
+#include <algorithm>
 #include <cassert>
+#include <iterator>
 #include <utility>
 
 CScheduler::CScheduler()
@@ -67,15 +69,47 @@ void CScheduler::serviceQueue() {
             // waiting (another thread may service the task we were waiting on).
             if (shouldStop() || taskQueue.empty()) continue;
 
-            Function f = taskQueue.begin()->second;
-            taskQueue.erase(taskQueue.begin());
+            // That thread may also have left a task which is not due yet.
+            boost::chrono::system_clock::time_point now =
+                boost::chrono::system_clock::now();
+            if (taskQueue.begin()->first > now) continue;
 
+            // Of the tasks that are due, the earliest with the highest
+            // priority.
+            auto itTask = taskQueue.begin();
+            for (auto it = std::next(itTask);
+                 it != taskQueue.end() && it->first <= now; ++it) {
+                if (it->second.priority > itTask->second.priority) {
+                    itTask = it;
+                }
+            }
+            Task task = std::move(itTask->second);
+            int64_t nLateMicros =
+                boost::chrono::duration_cast<boost::chrono::microseconds>(
+                    now - itTask->first)
+                    .count();
+            taskQueue.erase(itTask);
+
+            int64_t nMicros;
             {
                 // Unlock before calling f, so it can reschedule itself or
                 // another task without deadlocking:
                 reverse_lock<boost::unique_lock<boost::mutex>> rlock(lock);
-                f();
+                boost::chrono::steady_clock::time_point start =
+                    boost::chrono::steady_clock::now();
+                task.f();
+                nMicros =
+                    boost::chrono::duration_cast<boost::chrono::microseconds>(
+                        boost::chrono::steady_clock::now() - start)
+                        .count();
             }
+
+            CSchedulerTaskStats &stats = mapTaskStats[task.strName];
+            stats.nRuns++;
+            stats.nTotalMicros += nMicros;
+            stats.nMaxMicros = std::max(stats.nMaxMicros, nMicros);
+            stats.nTotalLateMicros += nLateMicros;
+            stats.nMaxLateMicros = std::max(stats.nMaxLateMicros, nLateMicros);
         } catch (...) {
             --nThreadsServicingQueue;
             throw;
@@ -97,27 +131,38 @@ void CScheduler::stop(bool drain) {
 }
 
 void CScheduler::schedule(CScheduler::Function f,
-                          boost::chrono::system_clock::time_point t) {
+                          boost::chrono::system_clock::time_point t,
+                          const std::string &strName, Priority priority) {
     {
         boost::unique_lock<boost::mutex> lock(newTaskMutex);
-        taskQueue.insert(std::make_pair(t, f));
+        taskQueue.insert(std::make_pair(t, Task{f, strName, priority}));
     }
     newTaskScheduled.notify_one();
 }
 
-void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaSeconds) {
-    schedule(f, boost::chrono::system_clock::now() +
-                    boost::chrono::seconds(deltaSeconds));
+void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaSeconds,
+                                 const std::string &strName,
+                                 Priority priority) {
+    schedule(f,
+             boost::chrono::system_clock::now() +
+                 boost::chrono::seconds(deltaSeconds),
+             strName, priority);
 }
 
-static void Repeat(CScheduler *s, CScheduler::Function f,
-                   int64_t deltaSeconds) {
+static void Repeat(CScheduler *s, CScheduler::Function f, int64_t deltaSeconds,
+                   const std::string &strName, CScheduler::Priority priority) {
     f();
-    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaSeconds), deltaSeconds);
+    s->scheduleFromNow(
+        boost::bind(&Repeat, s, f, deltaSeconds, strName, priority),
+        deltaSeconds, strName, priority);
 }
 
-void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaSeconds) {
-    scheduleFromNow(boost::bind(&Repeat, this, f, deltaSeconds), deltaSeconds);
+void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaSeconds,
+                               const std::string &strName,
+                               Priority priority) {
+    scheduleFromNow(boost::bind(&Repeat, this, f, deltaSeconds, strName,
+                                priority),
+                    deltaSeconds, strName, priority);
 }
 
 size_t
@@ -131,3 +176,85 @@ CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
     }
     return result;
 }
+
+bool CScheduler::AreThreadsServicingQueue() const {
+    boost::unique_lock<boost::mutex> lock(newTaskMutex);
+    return nThreadsServicingQueue;
+}
+
+std::map<std::string, CSchedulerTaskStats> CScheduler::getTaskStats() const {
+    boost::unique_lock<boost::mutex> lock(newTaskMutex);
+    return mapTaskStats;
+}
+
+void SingleThreadedSchedulerClient::MaybeScheduleProcessQueue() {
+    {
+        std::lock_guard<std::mutex> lock(m_cs_callbacks_pending);
+        // Try to avoid scheduling too many copies here, but if we
+        // accidentally have two ProcessQueue's scheduled at once its
+        // not a big deal.
+        if (m_are_callbacks_running) return;
+        if (m_callbacks_pending.empty()) return;
+    }
+    m_pscheduler->schedule(
+        std::bind(&SingleThreadedSchedulerClient::ProcessQueue, this),
+        boost::chrono::system_clock::now(), m_name, CScheduler::PRIORITY_HIGH);
+}
+
+void SingleThreadedSchedulerClient::ProcessQueue() {
+    std::function<void(void)> callback;
+    {
+        std::lock_guard<std::mutex> lock(m_cs_callbacks_pending);
+        if (m_are_callbacks_running) return;
+        if (m_callbacks_pending.empty()) return;
+        m_are_callbacks_running = true;
+
+        callback = std::move(m_callbacks_pending.front());
+        m_callbacks_pending.pop_front();
+    }
+
+    // RAII the setting of m_are_callbacks_running and calling
+    // MaybeScheduleProcessQueue to ensure both happen safely even if a
+    // callback throws.
+    struct RAIICallbacksRunning {
+        SingleThreadedSchedulerClient *instance;
+        RAIICallbacksRunning(SingleThreadedSchedulerClient *_instance)
+            : instance(_instance) {}
+        ~RAIICallbacksRunning() {
+            {
+                std::lock_guard<std::mutex> lock(
+                    instance->m_cs_callbacks_pending);
+                instance->m_are_callbacks_running = false;
+            }
+            instance->MaybeScheduleProcessQueue();
+        }
+    } raiicallbacksrunning(this);
+
+    callback();
+}
+
+void SingleThreadedSchedulerClient::AddToProcessQueue(
+    std::function<void(void)> func) {
+    assert(m_pscheduler);
+
+    {
+        std::lock_guard<std::mutex> lock(m_cs_callbacks_pending);
+        m_callbacks_pending.emplace_back(std::move(func));
+    }
+    MaybeScheduleProcessQueue();
+}
+
+void SingleThreadedSchedulerClient::EmptyQueue() {
+    assert(!m_pscheduler->AreThreadsServicingQueue());
+    bool should_continue = true;
+    while (should_continue) {
+        ProcessQueue();
+        std::lock_guard<std::mutex> lock(m_cs_callbacks_pending);
+        should_continue = !m_callbacks_pending.empty();
+    }
+}
+
+size_t SingleThreadedSchedulerClient::CallbacksPending() {
+    std::lock_guard<std::mutex> lock(m_cs_callbacks_pending);
+    return m_callbacks_pending.size();
+}
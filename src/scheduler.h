@@ -12,7 +12,22 @@
 //
 #include <boost/chrono/chrono.hpp>
 #include <boost/thread.hpp>
+#include <list>
 #include <map>
+#include <mutex>
+#include <string>
+
+static const int DEFAULT_SCHEDULER_THREADS = 2;
+static const int MAX_SCHEDULER_THREADS = 16;
+
+/** How long the runs of the tasks of a name took, and how late they started */
+struct CSchedulerTaskStats {
+    uint64_t nRuns = 0;
+    int64_t nTotalMicros = 0;
+    int64_t nMaxMicros = 0;
+    int64_t nTotalLateMicros = 0;
+    int64_t nMaxLateMicros = 0;
+};
 
 //
 // Simple class for background tasks that should be run periodically or once
@@ -26,6 +41,10 @@
 // boost::thread* t = new boost::thread(boost::bind(CScheduler::serviceQueue,
 // s));
 //
+// Several threads can run serviceQueue. Of the tasks that are due, they run
+// those of higher priority first. Tasks that must not run concurrently or out
+// of order go through a SingleThreadedSchedulerClient.
+//
 // ... then at program shutdown, clean up the thread running serviceQueue:
 // t->interrupt();
 // t->join();
@@ -40,17 +59,25 @@ public:
 
     typedef std::function<void(void)> Function;
 
-    // Call func at/after time t
-    void schedule(Function f, boost::chrono::system_clock::time_point t);
+    enum Priority { PRIORITY_LOW, PRIORITY_NORMAL, PRIORITY_HIGH };
+
+    // Call func at/after time t. The runs of tasks are counted by strName.
+    void schedule(Function f, boost::chrono::system_clock::time_point t,
+                  const std::string &strName = "",
+                  Priority priority = PRIORITY_NORMAL);
 
     // Convenience method: call f once deltaSeconds from now
-    void scheduleFromNow(Function f, int64_t deltaSeconds);
+    void scheduleFromNow(Function f, int64_t deltaSeconds,
+                         const std::string &strName = "",
+                         Priority priority = PRIORITY_NORMAL);
 
     // Another convenience method: call f approximately every deltaSeconds
     // forever, starting deltaSeconds from now. To be more precise: every time f
     // is finished, it is rescheduled to run deltaSeconds later. If you need
     // more accurate scheduling, don't use this method.
-    void scheduleEvery(Function f, int64_t deltaSeconds);
+    void scheduleEvery(Function f, int64_t deltaSeconds,
+                       const std::string &strName = "",
+                       Priority priority = PRIORITY_NORMAL);
 
     // To keep things as simple as possible, there is no unschedule.
 
@@ -68,8 +95,21 @@ public:
     size_t getQueueInfo(boost::chrono::system_clock::time_point &first,
                         boost::chrono::system_clock::time_point &last) const;
 
+    // Returns true if there are threads actively running in serviceQueue()
+    bool AreThreadsServicingQueue() const;
+
+    // Returns the runtime and lateness of the tasks run so far, by name
+    std::map<std::string, CSchedulerTaskStats> getTaskStats() const;
+
 private:
-    std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue;
+    struct Task {
+        Function f;
+        std::string strName;
+        Priority priority;
+    };
+
+    std::multimap<boost::chrono::system_clock::time_point, Task> taskQueue;
+    std::map<std::string, CSchedulerTaskStats> mapTaskStats;
     boost::condition_variable newTaskScheduled;
     mutable boost::mutex newTaskMutex;
     int nThreadsServicingQueue;
@@ -80,4 +120,39 @@ private:
     }
 };
 
+/**
+ * Runs callbacks on a CScheduler one at a time, in the order they were added,
+ * even when several threads service the scheduler. Each callback is a
+ * scheduler task of its own, so a backlog does not hold up the other tasks.
+ */
+class SingleThreadedSchedulerClient {
+private:
+    CScheduler *m_pscheduler;
+    //! Name the callbacks are counted by in the scheduler's statistics. They
+    //! run at high priority, as callers may wait for them.
+    std::string m_name;
+
+    std::mutex m_cs_callbacks_pending;
+    std::list<std::function<void(void)>> m_callbacks_pending;
+    bool m_are_callbacks_running = false;
+
+    void MaybeScheduleProcessQueue();
+    void ProcessQueue();
+
+public:
+    SingleThreadedSchedulerClient(CScheduler *pschedulerIn,
+                                  const std::string &strNameIn = "callbacks")
+        : m_pscheduler(pschedulerIn), m_name(strNameIn) {}
+
+    // Add a callback to be executed. Callbacks are executed serially and
+    // memory is released after execution.
+    void AddToProcessQueue(std::function<void(void)> func);
+
+    // Run all callbacks on the calling thread. Only for use at shutdown, once
+    // no thread services the scheduler anymore.
+    void EmptyQueue();
+
+    size_t CallbacksPending();
+};
+
 #endif
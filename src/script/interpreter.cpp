@@ -11,6 +11,7 @@
 #include "crypto/sha256.h"
 #include "pubkey.h"
 #include "script/script.h"
+#include "streams.h"
 #include "uint256.h"
 
 using namespace std;
@@ -959,6 +960,29 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
 
 namespace {
 
+/** Serialize scriptCode, skipping OP_CODESEPARATORs */
+template<typename S>
+void SerializeScriptCode(S &s, const CScript& scriptCode) {
+    CScript::const_iterator it = scriptCode.begin();
+    CScript::const_iterator itBegin = it;
+    opcodetype opcode;
+    unsigned int nCodeSeparators = 0;
+    while (scriptCode.GetOp(it, opcode)) {
+        if (opcode == OP_CODESEPARATOR)
+            nCodeSeparators++;
+    }
+    ::WriteCompactSize(s, scriptCode.size() - nCodeSeparators);
+    it = itBegin;
+    while (scriptCode.GetOp(it, opcode)) {
+        if (opcode == OP_CODESEPARATOR) {
+            s.write((char*)&itBegin[0], it-itBegin-1);
+            itBegin = it;
+        }
+    }
+    if (itBegin != scriptCode.end())
+        s.write((char*)&itBegin[0], it-itBegin);
+}
+
 /**
  * Wrapper that serializes like CTransaction, but with the modifications
  *  required for the signature hash done in-place
@@ -979,29 +1003,6 @@ public:
         fHashSingle((nHashTypeIn & 0x1f) == SIGHASH_SINGLE),
         fHashNone((nHashTypeIn & 0x1f) == SIGHASH_NONE) {}
 
-    /** Serialize the passed scriptCode, skipping OP_CODESEPARATORs */
-    template<typename S>
-    void SerializeScriptCode(S &s) const {
-        CScript::const_iterator it = scriptCode.begin();
-        CScript::const_iterator itBegin = it;
-        opcodetype opcode;
-        unsigned int nCodeSeparators = 0;
-        while (scriptCode.GetOp(it, opcode)) {
-            if (opcode == OP_CODESEPARATOR)
-                nCodeSeparators++;
-        }
-        ::WriteCompactSize(s, scriptCode.size() - nCodeSeparators);
-        it = itBegin;
-        while (scriptCode.GetOp(it, opcode)) {
-            if (opcode == OP_CODESEPARATOR) {
-                s.write((char*)&itBegin[0], it-itBegin-1);
-                itBegin = it;
-            }
-        }
-        if (itBegin != scriptCode.end())
-            s.write((char*)&itBegin[0], it-itBegin);
-    }
-
     /** Serialize an input of txTo */
     template<typename S>
     void SerializeInput(S &s, unsigned int nInput) const {
@@ -1015,7 +1016,7 @@ public:
             // Blank out other inputs' signatures
             ::Serialize(s, CScriptBase());
         else
-            SerializeScriptCode(s);
+            SerializeScriptCode(s, scriptCode);
         // Serialize the nSequence
     }
 
@@ -1075,6 +1076,77 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     return ss.GetHash();
 }
 
+PrecomputedSignatureHash::PrecomputedSignatureHash(const CTransaction& txTo)
+{
+    // A script code for no input, so that every input is blanked.
+    const CScript scriptCode;
+    const CTransactionSignatureSerializer txTmp(txTo, scriptCode, txTo.vin.size(), SIGHASH_ALL);
+
+    CVectorWriter header(SER_GETHASH, 0, vchHeader, 0);
+    header << VARINT(txTo.nVersion) << VARINT(txTo.nFlags);
+
+    CHashWriter ss(SER_GETHASH, 0);
+    ss.write((const char*)vchHeader.data(), vchHeader.size());
+    ::WriteCompactSize(ss, txTo.vin.size());
+    CVectorWriter inputs(SER_GETHASH, 0, vchInputs, 0);
+    vMidstates.reserve(txTo.vin.size());
+    vInputPos.reserve(txTo.vin.size() + 1);
+    for (unsigned int nInput = 0; nInput < txTo.vin.size(); nInput++) {
+        vMidstates.push_back(ss);
+        vInputPos.push_back(vchInputs.size());
+        txTmp.SerializeInput(inputs, nInput);
+        ss.write((const char*)&vchInputs[vInputPos.back()], vchInputs.size() - vInputPos.back());
+    }
+    vInputPos.push_back(vchInputs.size());
+
+    CVectorWriter outputs(SER_GETHASH, 0, vchOutputs, 0);
+    ::WriteCompactSize(outputs, txTo.vout.size());
+    vOutputPos.reserve(txTo.vout.size() + 1);
+    for (unsigned int nOutput = 0; nOutput < txTo.vout.size(); nOutput++) {
+        vOutputPos.push_back(vchOutputs.size());
+        txTmp.SerializeOutput(outputs, nOutput);
+    }
+    vOutputPos.push_back(vchOutputs.size());
+}
+
+uint256 PrecomputedSignatureHash::GetHash(const CScript& scriptCode, unsigned int nIn, int nHashType) const
+{
+    static const uint256 one(uint256S("0000000000000000000000000000000000000000000000000000000000000001"));
+    const size_t nInputs = vMidstates.size();
+    const size_t nOutputs = vOutputPos.size() - 1;
+    const bool fAnyoneCanPay = !!(nHashType & SIGHASH_ANYONECANPAY);
+    const bool fHashSingle = (nHashType & 0x1f) == SIGHASH_SINGLE;
+    const bool fHashNone = (nHashType & 0x1f) == SIGHASH_NONE;
+    if (nIn >= nInputs || (fHashSingle && nIn >= nOutputs))
+        return one;
+
+    // The input being signed is only serialized with its prevout, followed
+    // by the script code instead of the empty script of the blanked input.
+    CHashWriter ss = fAnyoneCanPay ? CHashWriter(SER_GETHASH, 0) : vMidstates[nIn];
+    if (fAnyoneCanPay) {
+        ss.write((const char*)vchHeader.data(), vchHeader.size());
+        ::WriteCompactSize(ss, 1);
+    }
+    ss.write((const char*)vchInputs.data() + vInputPos[nIn], vInputPos[nIn + 1] - vInputPos[nIn] - 1);
+    SerializeScriptCode(ss, scriptCode);
+    if (!fAnyoneCanPay)
+        ss.write((const char*)vchInputs.data() + vInputPos[nIn + 1], vchInputs.size() - vInputPos[nIn + 1]);
+
+    if (fHashNone) {
+        ::WriteCompactSize(ss, 0);
+    } else if (fHashSingle) {
+        // Do not lock-in the txout payee at other indices as txin
+        ::WriteCompactSize(ss, nIn + 1);
+        for (unsigned int nOutput = 0; nOutput < nIn; nOutput++)
+            ss << CTxOut();
+        ss.write((const char*)vchOutputs.data() + vOutputPos[nIn], vOutputPos[nIn + 1] - vOutputPos[nIn]);
+    } else {
+        ss.write((const char*)vchOutputs.data(), vchOutputs.size());
+    }
+    ss << nHashType;
+    return ss.GetHash();
+}
+
 
 bool CheckCompactSig(const uint256 hash,const vector<unsigned char> vchSig,const CKeyID keyID)
 {
@@ -1087,6 +1159,19 @@ bool CheckCompactSig(const uint256 hash,const vector<unsigned char> vchSig,const
     return (pubkey.GetID() == keyID);
 }
 
+uint256 TransactionSignatureChecker::GetSignatureHash(const CScript& scriptCode, int nHashType) const
+{
+    // The hash covers the whole transaction, strContent included, so don't
+    // compute it again for every signature and key of the same input.
+    if (!fSighashCached || nHashType != nCachedHashType || scriptCode != cachedScriptCode) {
+        cachedSighash = sighashData ? sighashData->GetHash(scriptCode, nIn, nHashType) : SignatureHash(scriptCode, *txTo, nIn, nHashType);
+        cachedScriptCode = scriptCode;
+        nCachedHashType = nHashType;
+        fSighashCached = true;
+    }
+    return cachedSighash;
+}
+
 bool TransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     return pubkey.Verify(sighash, vchSig);
@@ -1105,7 +1190,7 @@ bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
     int nHashType = vchSig.back();
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 sighash = GetSignatureHash(scriptCode, nHashType);
 
     if (!VerifySignature(vchSig, pubkey, sighash))
         return false;
@@ -1116,7 +1201,7 @@ bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
 bool TransactionSignatureChecker::RecoverPubKey(const std::vector<unsigned char>& vchSigIn, std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const
 {
     int nHashType = vchSigIn.back();
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 sighash = GetSignatureHash(scriptCode, nHashType);
     CPubKey rPubKey;
     std::vector<unsigned char> vchSigCompact;
         vchSigCompact = vchSigIn;
@@ -1128,6 +1213,166 @@ bool TransactionSignatureChecker::RecoverPubKey(const std::vector<unsigned char>
     return true;
 }
 
+/**
+ * Fast paths for the standard templates.
+ *
+ * Most spends are of a P2PKH output, or of a P2SH output with a multisig
+ * redeem script, by a scriptSig of nothing but data pushes. These evaluate
+ * such spends directly, in the order EvalScript would, with the same
+ * signature checks and the same errors. Anything out of the ordinary, a push
+ * EvalScript would fail on or a stack of an unexpected depth, is left to the
+ * generic interpreter, so that it reports it.
+ *
+ * Locked deposit outputs are covered as well: their lock is nLockTime on the
+ * output, checked with the inputs, not a script of their own.
+ */
+namespace {
+
+/**
+ * The data pushed by scriptSig, at most nMaxPushes of them. False if it has
+ * anything but data pushes, or a push EvalScript would fail on.
+ */
+bool GetDataPushes(const CScript& scriptSig, unsigned int flags, size_t nMaxPushes, vector<valtype>& vPushes)
+{
+    if (scriptSig.size() > MAX_SCRIPT_SIZE)
+        return false;
+    bool fRequireMinimal = (flags & SCRIPT_VERIFY_MINIMALDATA) != 0;
+    CScript::const_iterator pc = scriptSig.begin();
+    opcodetype opcode;
+    valtype vchPushValue;
+    while (pc < scriptSig.end()) {
+        if (vPushes.size() == nMaxPushes)
+            return false;
+        if (!scriptSig.GetOp(pc, opcode, vchPushValue) || opcode > OP_PUSHDATA4)
+            return false;
+        if (vchPushValue.size() > MAX_SCRIPT_ELEMENT_SIZE)
+            return false;
+        if (fRequireMinimal && !CheckMinimalPush(vchPushValue, opcode))
+            return false;
+        vPushes.push_back(vchPushValue);
+    }
+    return true;
+}
+
+//! The result of a spend that got as far as its final stack, of one element.
+bool SetFinalResult(bool fSuccess, unsigned int flags, ScriptError* serror)
+{
+    if (!fSuccess)
+        return set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+    if ((flags & SCRIPT_VERIFY_CLEANSTACK) != 0)
+        assert((flags & SCRIPT_VERIFY_P2SH) != 0);
+    return set_success(serror);
+}
+
+/**
+ * OP_DUP OP_HASH160 <hash> OP_EQUALVERIFY OP_CHECKSIG spent by <sig> <pubkey>.
+ * Returns false if the spend isn't of that form, with fResult and serror
+ * left alone.
+ */
+bool VerifyPayToPubKeyHash(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror, bool& fResult)
+{
+    if (scriptPubKey.size() != 25 || scriptPubKey[0] != OP_DUP ||
+        scriptPubKey[1] != OP_HASH160 || scriptPubKey[2] != 20 ||
+        scriptPubKey[23] != OP_EQUALVERIFY || scriptPubKey[24] != OP_CHECKSIG)
+        return false;
+    vector<valtype> vPushes;
+    if (!GetDataPushes(scriptSig, flags, 2, vPushes) || vPushes.size() != 2)
+        return false;
+    const valtype& vchSig = vPushes[0];
+    const valtype& vchPubKey = vPushes[1];
+
+    uint160 hash;
+    CHash160().Write(vchPubKey.data(), vchPubKey.size()).Finalize(hash.begin());
+    if (!std::equal(hash.begin(), hash.end(), scriptPubKey.begin() + 3)) {
+        fResult = set_error(serror, SCRIPT_ERR_EQUALVERIFY);
+        return true;
+    }
+    if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, serror)) {
+        fResult = false;
+        return true;
+    }
+    // The whole scriptPubKey, there is no code separator.
+    bool fSuccess = checker.CheckSig(vchSig, vchPubKey, scriptPubKey);
+    fResult = SetFinalResult(fSuccess, flags, serror);
+    return true;
+}
+
+/**
+ * OP_HASH160 <hash> OP_EQUAL, with the redeem script
+ * <m> <pubkey>... <n> OP_CHECKMULTISIG, spent by OP_0 <sig>... <redeem script>.
+ * Returns false if the spend isn't of that form, with fResult and serror
+ * left alone.
+ */
+bool VerifyPayToScriptHashMultisig(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror, bool& fResult)
+{
+    if ((flags & SCRIPT_VERIFY_P2SH) == 0 || !scriptPubKey.IsPayToScriptHash())
+        return false;
+    // At most 16 signatures, the dummy and the redeem script.
+    vector<valtype> vPushes;
+    if (!GetDataPushes(scriptSig, flags, 18, vPushes) || vPushes.size() < 3)
+        return false;
+    const valtype& vchRedeemScript = vPushes.back();
+
+    // The redeem script, pushing the keys minimally.
+    const CScript redeemScript(vchRedeemScript.begin(), vchRedeemScript.end());
+    CScript::const_iterator pc = redeemScript.begin();
+    opcodetype opcode;
+    valtype vchPushValue;
+    if (!redeemScript.GetOp(pc, opcode) || opcode < OP_1 || opcode > OP_16)
+        return false;
+    const int nRequired = CScript::DecodeOP_N(opcode);
+    vector<valtype> vPubKeys;
+    while (redeemScript.GetOp(pc, opcode, vchPushValue) && opcode <= OP_PUSHDATA4) {
+        if ((vchPushValue.size() != 33 && vchPushValue.size() != 65) || opcode != vchPushValue.size())
+            return false;
+        vPubKeys.push_back(vchPushValue);
+    }
+    if (opcode < OP_1 || opcode > OP_16 || CScript::DecodeOP_N(opcode) != (int)vPubKeys.size())
+        return false;
+    if (!redeemScript.GetOp(pc, opcode) || opcode != OP_CHECKMULTISIG || pc != redeemScript.end())
+        return false;
+    if (nRequired > (int)vPubKeys.size() || vPushes.size() != (size_t)nRequired + 2)
+        return false;
+
+    uint160 hash;
+    CHash160().Write(vchRedeemScript.data(), vchRedeemScript.size()).Finalize(hash.begin());
+    if (!std::equal(hash.begin(), hash.end(), scriptPubKey.begin() + 2)) {
+        fResult = set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+        return true;
+    }
+
+    // As OP_CHECKMULTISIG does it: from the top of the stack down, so from
+    // the last signature and the last key.
+    CScript scriptCode(redeemScript);
+    for (int k = nRequired; k > 0; k--)
+        scriptCode.FindAndDelete(CScript(vPushes[k]));
+    int isig = nRequired;
+    int ikey = vPubKeys.size() - 1;
+    bool fSuccess = true;
+    while (fSuccess && isig > 0) {
+        const valtype& vchSig = vPushes[isig];
+        const valtype& vchPubKey = vPubKeys[ikey];
+        if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, serror)) {
+            fResult = false;
+            return true;
+        }
+        if (checker.CheckSig(vchSig, vchPubKey, scriptCode))
+            isig--;
+        ikey--;
+        // More signatures left than keys left.
+        if (isig > ikey + 1)
+            fSuccess = false;
+    }
+    if ((flags & SCRIPT_VERIFY_NULLDUMMY) && vPushes[0].size()) {
+        fResult = set_error(serror, SCRIPT_ERR_SIG_NULLDUMMY);
+        return true;
+    }
+    fResult = SetFinalResult(fSuccess, flags, serror);
+    return true;
+}
+
+} // anon namespace
+
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
@@ -1136,6 +1381,11 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigne
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
 
+    bool fResult;
+    if (VerifyPayToPubKeyHash(scriptSig, scriptPubKey, flags, checker, serror, fResult) ||
+        VerifyPayToScriptHashMultisig(scriptSig, scriptPubKey, flags, checker, serror, fResult))
+        return fResult;
+
     vector<vector<unsigned char> > stack, stackCopy;
     if (!EvalScript(stack, scriptSig, flags, checker, serror))  // Check whether input script is legal
         // serror is set
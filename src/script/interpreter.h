@@ -6,6 +6,7 @@
 #ifndef BITCOIN_SCRIPT_INTERPRETER_H
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
+#include "hash.h"
 #include "script_error.h"
 #include "primitives/transaction.h"
 
@@ -86,6 +87,38 @@ enum
 };
 
 uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+
+/**
+ * The signature hashes of the inputs of a transaction, with the work they
+ * share done once: the hash midstate after the blanked inputs before each
+ * input, and the blanked inputs after it and the outputs serialized. Every
+ * hash type is served from them, as the blanked inputs don't depend on it.
+ * The input being signed comes before the outputs, so the outputs, content
+ * included, are still hashed for every input that signs them all.
+ *
+ * The transaction isn't referenced: the signature scripts of its inputs
+ * aren't part of the hashes, they may change after this is built.
+ */
+class PrecomputedSignatureHash
+{
+private:
+    //! The version and flags serialized, for SIGHASH_ANYONECANPAY
+    std::vector<uint8_t> vchHeader;
+    //! The hash state after the blanked inputs before each input
+    std::vector<CHashWriter> vMidstates;
+    //! The blanked inputs serialized and where each of them starts
+    std::vector<uint8_t> vchInputs;
+    std::vector<size_t> vInputPos;
+    //! The outputs serialized, after their count, and where each of them starts
+    std::vector<uint8_t> vchOutputs;
+    std::vector<size_t> vOutputPos;
+
+public:
+    explicit PrecomputedSignatureHash(const CTransaction& txTo);
+    //! The same as SignatureHash(scriptCode, txTo, nIn, nHashType)
+    uint256 GetHash(const CScript& scriptCode, unsigned int nIn, int nHashType) const;
+};
+
 bool CheckCompactSig(const uint256 hash,const std::vector<unsigned char> vchSig,const CKeyID keyID);
 class BaseSignatureChecker
 {
@@ -108,12 +141,21 @@ class TransactionSignatureChecker : public BaseSignatureChecker
 private:
     const CTransaction* txTo;
     unsigned int nIn;
+    const PrecomputedSignatureHash* sighashData;
+
+    //! The last signature hash, a CHECKMULTISIG tries each sig against several keys
+    mutable bool fSighashCached;
+    mutable int nCachedHashType;
+    mutable CScript cachedScriptCode;
+    mutable uint256 cachedSighash;
+
+    uint256 GetSignatureHash(const CScript& scriptCode, int nHashType) const;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn) {}
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const PrecomputedSignatureHash* sighashDataIn = nullptr) : txTo(txToIn), nIn(nInIn), sighashData(sighashDataIn), fSighashCached(false), nCachedHashType(0) {}
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
     bool RecoverPubKey(const std::vector<unsigned char>& scriptSig, std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
 };
@@ -127,6 +169,8 @@ public:
     MutableTransactionSignatureChecker(const CMutableTransaction* txToIn, unsigned int nInIn) : TransactionSignatureChecker(&txTo, nInIn), txTo(*txToIn) {}
 };
 
+bool CastToBool(const valtype& vch);
+
 bool CheckSignatureEncoding(const valtype &vchSig, unsigned int flags, ScriptError* serror);
 
 bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
@@ -381,7 +381,16 @@ private:
     int64_t m_value;
 };
 
-typedef prevector<28, uint8_t> CScriptBase;
+/**
+ * Bytes of a script that are stored inline, larger scripts go to the heap. Each
+ * CScript takes this plus 4 bytes, in every coin and input, so it is set to
+ * what most scriptPubKeys need: P2PKH takes 25 bytes and P2SH 23. A scriptSig
+ * spends a signature and usually a public key, over 100 bytes, and would need
+ * the inline storage of every output to grow fourfold to fit.
+ */
+static const unsigned int SCRIPT_INLINE_SIZE = 28;
+
+typedef prevector<SCRIPT_INLINE_SIZE, uint8_t> CScriptBase;
 
 /** Serialized script, used inside transaction inputs and outputs */
 class CScript : public CScriptBase {
@@ -9,12 +9,17 @@
 #include "primitives/transaction.h"
 #include "random.h"
 #include "script/sigcache.h"
+#include "streams.h"
 #include "sync.h"
 #include "util.h"
 #include "validation.h"
 
+#include <atomic>
+
 static CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
 static uint256 scriptExecutionCacheNonce(GetRandHash());
+//! Bytes of the entries allocated by InitScriptExecutionCache
+static std::atomic<size_t> nScriptExecutionCacheBytes(0);
 
 void InitScriptExecutionCache() {
     // nMaxCacheSize is unsigned. If -maxscriptcachesize is set to zero,
@@ -25,11 +30,16 @@ void InitScriptExecutionCache() {
                  MAX_MAX_SCRIPT_CACHE_SIZE) *
         (size_t(1) << 20);
     size_t nElems = scriptExecutionCache.setup_bytes(nMaxCacheSize);
+    nScriptExecutionCacheBytes = nElems * sizeof(uint256);
     LogPrintf("Using %zu MiB out of %zu requested for script execution cache, "
               "able to store %zu elements\n",
               (nElems * sizeof(uint256)) >> 20, nMaxCacheSize >> 20, nElems);
 }
 
+size_t ScriptExecutionCacheMemoryUsage() {
+    return nScriptExecutionCacheBytes;
+}
+
 uint256 GetScriptCacheKey(const CTransaction &tx, uint32_t flags) {
     uint256 key;
     // We only use the first 19 bytes of nonce to avoid a second SHA round -
@@ -58,3 +68,26 @@ void AddKeyInScriptCache(uint256 key) {
     AssertLockHeld(cs_main);
     scriptExecutionCache.insert(key);
 }
+
+void DumpScriptExecutionCache(CAutoFile &file) {
+    AssertLockHeld(cs_main);
+    std::vector<uint256> entries;
+    scriptExecutionCache.for_each_live(
+        [&entries](const uint256 &entry) { entries.push_back(entry); });
+    file << scriptExecutionCacheNonce;
+    file << entries;
+}
+
+size_t LoadScriptExecutionCache(CAutoFile &file) {
+    AssertLockHeld(cs_main);
+    uint256 nonce;
+    std::vector<uint256> entries;
+    file >> nonce;
+    file >> entries;
+
+    scriptExecutionCacheNonce = nonce;
+    for (uint256 &entry : entries) {
+        scriptExecutionCache.insert(entry);
+    }
+    return entries.size();
+}
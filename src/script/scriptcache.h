@@ -9,6 +9,7 @@
 
 #include <cstdint>
 
+class CAutoFile;
 class CTransaction;
 
 // DoS prevention: limit cache size to 32MB (over 1000000 entries on 64-bit
@@ -21,6 +22,9 @@ static const int64_t MAX_MAX_SCRIPT_CACHE_SIZE = 16384;
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
+/** Bytes taken by the script execution cache, all allocated up front. */
+size_t ScriptExecutionCacheMemoryUsage();
+
 /** Compute the cache key for a given transaction and flags. */
 uint256 GetScriptCacheKey(const CTransaction &tx, uint32_t flags);
 
@@ -30,4 +34,13 @@ bool IsKeyInScriptCache(uint256 key, bool erase);
 /** Add an entry in the cache. */
 void AddKeyInScriptCache(uint256 key);
 
+/** Write the cache nonce and its live entries to file. */
+void DumpScriptExecutionCache(CAutoFile &file);
+
+/**
+ * Replace the cache nonce with the one in file and insert the saved entries.
+ * Returns the number of entries read.
+ */
+size_t LoadScriptExecutionCache(CAutoFile &file);
+
 #endif // BITCOIN_SCRIPT_SCRIPTCACHE_H
@@ -9,9 +9,12 @@
 #include "memusage.h"
 #include "pubkey.h"
 #include "random.h"
+#include "streams.h"
 #include "uint256.h"
 #include "util.h"
 
+#include <atomic>
+
 #include <boost/thread.hpp>
 
 namespace {
@@ -53,6 +56,34 @@ public:
         setValid.insert(entry);
     }
     uint32_t setup_bytes(size_t n) { return setValid.setup_bytes(n); }
+
+    void Dump(CAutoFile &file) {
+        std::vector<uint256> entries;
+        {
+            boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+            setValid.for_each_live(
+                [&entries](const uint256 &entry) { entries.push_back(entry); });
+        }
+        file << nonce;
+        file << entries;
+    }
+
+    size_t Load(CAutoFile &file) {
+        uint256 nonceIn;
+        std::vector<uint256> entries;
+        file >> nonceIn;
+        file >> entries;
+
+        // Entries are only meaningful under the nonce they were computed
+        // with. Anything cached since startup becomes unreachable and ages
+        // out like any other entry.
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonce = nonceIn;
+        for (uint256 &entry : entries) {
+            setValid.insert(entry);
+        }
+        return entries.size();
+    }
 };
 
 /**
@@ -63,6 +94,8 @@ public:
  * signatureCache could be made local to VerifySignature.
  */
 static CSignatureCache signatureCache;
+//! Bytes of the entries allocated by InitSignatureCache
+static std::atomic<size_t> nSignatureCacheBytes(0);
 }
 
 // To be called once in AppInit2/TestingSetup to initialize the signatureCache
@@ -75,11 +108,24 @@ void InitSignatureCache() {
                  MAX_MAX_SIG_CACHE_SIZE) *
         (size_t(1) << 20);
     size_t nElems = signatureCache.setup_bytes(nMaxCacheSize);
+    nSignatureCacheBytes = nElems * sizeof(uint256);
     LogPrintf("Using %zu MiB out of %zu requested for signature cache, able to "
               "store %zu elements\n",
               (nElems * sizeof(uint256)) >> 20, nMaxCacheSize >> 20, nElems);
 }
 
+size_t SignatureCacheMemoryUsage() {
+    return nSignatureCacheBytes;
+}
+
+void DumpSignatureCache(CAutoFile &file) {
+    signatureCache.Dump(file);
+}
+
+size_t LoadSignatureCache(CAutoFile &file) {
+    return signatureCache.Load(file);
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(
     const std::vector<uint8_t> &vchSig, const CPubKey &pubkey,
     const uint256 &sighash) const {
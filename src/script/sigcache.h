@@ -17,6 +17,7 @@ static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
 
+class CAutoFile;
 class CPubKey;
 
 /**
@@ -44,10 +45,10 @@ private:
     bool store;
 
 public:
-    CachingTransactionSignatureChecker(const CTransaction *txToIn,
-                                       unsigned int nInIn,
-                                       bool storeIn)
-        : TransactionSignatureChecker(txToIn, nInIn),
+    CachingTransactionSignatureChecker(
+        const CTransaction *txToIn, unsigned int nInIn, bool storeIn,
+        const PrecomputedSignatureHash *sighashDataIn = nullptr)
+        : TransactionSignatureChecker(txToIn, nInIn, sighashDataIn),
           store(storeIn) {}
 
     bool VerifySignature(const std::vector<uint8_t> &vchSig,
@@ -57,4 +58,17 @@ public:
 
 void InitSignatureCache();
 
+/** Bytes taken by the signature cache, all allocated up front. */
+size_t SignatureCacheMemoryUsage();
+
+/** Write the signature cache nonce and its live entries to file. */
+void DumpSignatureCache(CAutoFile &file);
+
+/**
+ * Replace the signature cache nonce with the one in file and insert the saved
+ * entries. Must not run concurrently with signature checks, as ComputeEntry
+ * reads the nonce without a lock. Returns the number of entries read.
+ */
+size_t LoadSignatureCache(CAutoFile &file);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -12,13 +12,18 @@
 #include "script/standard.h"
 #include "uint256.h"
 
+#include <algorithm>
+#include <thread>
+
 typedef std::vector<uint8_t> valtype;
 
 TransactionSignatureCreator::TransactionSignatureCreator(
     const CKeyStore *keystoreIn, const CTransaction *txToIn, unsigned int nInIn,
-    const CAmount amountIn, uint32_t nHashTypeIn)
+    const CAmount amountIn, uint32_t nHashTypeIn,
+    const PrecomputedSignatureHash *sighashDataIn)
     : BaseSignatureCreator(keystoreIn), txTo(txToIn), nIn(nInIn),
-      amount(amountIn), nHashType(nHashTypeIn), checker(txTo, nIn) {}
+      amount(amountIn), nHashType(nHashTypeIn), sighashData(sighashDataIn),
+      checker(txTo, nIn, sighashData) {}
 
 bool TransactionSignatureCreator::CreateSig(std::vector<uint8_t> &vchSig,
                                             const CKeyID &address,
@@ -28,7 +33,9 @@ bool TransactionSignatureCreator::CreateSig(std::vector<uint8_t> &vchSig,
         return false;
     }
 
-    uint256 hash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 hash = sighashData
+                       ? sighashData->GetHash(scriptCode, nIn, nHashType)
+                       : SignatureHash(scriptCode, *txTo, nIn, nHashType);
     if (!key.Sign(hash, vchSig)) {
         return false;
     }
@@ -207,6 +214,33 @@ bool SignSignature(const CKeyStore &keystore, const CTransaction &txFrom,
                          nHashType);
 }
 
+void ForEachInputParallel(size_t nInputs,
+                          const std::function<void(size_t)> &fSign) {
+    const int nThreads =
+        nInputs < SIGN_PARALLEL_MIN_INPUTS
+            ? 1
+            : std::max(1, std::min<int>(MAX_SIGN_THREADS,
+                                        std::thread::hardware_concurrency()));
+    if (nThreads == 1) {
+        for (size_t i = 0; i < nInputs; i++) {
+            fSign(i);
+        }
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    for (int nThread = 0; nThread < nThreads; nThread++) {
+        threads.emplace_back([&, nThread]() {
+            for (size_t i = nThread; i < nInputs; i += nThreads) {
+                fSign(i);
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
 static std::vector<valtype> CombineMultisig(
     const CScript &scriptPubKey, const BaseSignatureChecker &checker,
     const std::vector<valtype> &vSolutions, const std::vector<valtype> &sigs1,
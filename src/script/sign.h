@@ -8,12 +8,19 @@
 
 #include "script/interpreter.h"
 
+#include <functional>
+
 class CKeyID;
 class CKeyStore;
 class CMutableTransaction;
 class CScript;
 class CTransaction;
 
+/** Inputs a transaction needs for them to be signed in parallel */
+static const size_t SIGN_PARALLEL_MIN_INPUTS = 16;
+/** Threads that sign the inputs of a transaction at most */
+static const int MAX_SIGN_THREADS = 16;
+
 /** Virtual base class for signature creators. */
 class BaseSignatureCreator {
 protected:
@@ -36,13 +43,19 @@ class TransactionSignatureCreator : public BaseSignatureCreator {
     unsigned int nIn;
     CAmount amount;
     uint32_t nHashType;
+    const PrecomputedSignatureHash *sighashData;
     const TransactionSignatureChecker checker;
 
 public:
-    TransactionSignatureCreator(const CKeyStore *keystoreIn,
-                                const CTransaction *txToIn, unsigned int nInIn,
-                                const CAmount amountIn,
-                                uint32_t nHashTypeIn = SIGHASH_ALL);
+    /**
+     * With sighashData, the signature hashes are computed from it rather than
+     * from scratch. It must be of *txToIn and outlive the creator.
+     */
+    TransactionSignatureCreator(
+        const CKeyStore *keystoreIn, const CTransaction *txToIn,
+        unsigned int nInIn, const CAmount amountIn,
+        uint32_t nHashTypeIn = SIGHASH_ALL,
+        const PrecomputedSignatureHash *sighashDataIn = nullptr);
     const BaseSignatureChecker &Checker() const override { return checker; }
     bool CreateSig(std::vector<uint8_t> &vchSig, const CKeyID &keyid,
                    const CScript &scriptCode) const override;
@@ -90,6 +103,15 @@ bool SignSignature(const CKeyStore &keystore, const CTransaction &txFrom,
                    CMutableTransaction &txTo, unsigned int nIn,
                    uint32_t nHashType);
 
+/**
+ * Call fSign for each input in [0, nInputs), on several threads when there
+ * are enough of them. The keystore is locked for each key taken from it, so
+ * the caller must not hold its lock. fSign may only change what belongs to
+ * its own input.
+ */
+void ForEachInputParallel(size_t nInputs,
+                          const std::function<void(size_t)> &fSign);
+
 /** Combine two script signatures using a generic signature checker,
  * intelligently, possibly with OP_0 placeholders. */
 SignatureData CombineSignatures(const CScript &scriptPubKey,
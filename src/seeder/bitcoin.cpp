@@ -6,9 +6,13 @@
 #include "serialize.h"
 #include "streams.h"
 #include "uint256.h"
+#include "utiltime.h"
 
 #include <algorithm>
 
+#include <netinet/tcp.h>
+#include <poll.h>
+
 // Weither we are on testnet or mainnet.
 bool fTestNet;
 
@@ -19,8 +23,28 @@ CMessageHeader::MessageMagic netMagic = {0xfc, 0xf0, 0xed, 0xee};
 
 static const uint32_t allones(-1);
 
+/**
+ * One probe of a node. Its socket is non-blocking and the caller polls it,
+ * handing over what happened to HandleEvents(), until IsDone().
+ */
 class CSeederNode {
+    enum State {
+        //! Waiting for the TCP connection, to the node or its proxy
+        CONNECTING,
+        //! Waiting for the proxy to accept SOCKS5 without authentication
+        SOCKS_METHOD,
+        //! Waiting for the proxy to connect to the node
+        SOCKS_CONNECT,
+        //! Talking to the node
+        OPEN,
+    };
+
     SOCKET sock;
+    State state;
+    bool fProxy;
+    //! Milliseconds by which the node must have said something
+    int64_t nDeadline;
+    bool fFailed;
     CDataStream vSend;
     CDataStream vRecv;
     uint32_t nHeaderStart;
@@ -83,15 +107,95 @@ class CSeederNode {
         if (vSend.empty()) {
             return;
         }
-        int nBytes = send(sock, &vSend[0], vSend.size(), 0);
+        int nBytes = send(sock, &vSend[0], vSend.size(), MSG_NOSIGNAL);
         if (nBytes > 0) {
             vSend.erase(vSend.begin(), vSend.begin() + nBytes);
+        } else if (nBytes < 0 && WSAGetLastError() == WSAEWOULDBLOCK) {
+            // Sent once the socket is writable again.
         } else {
+            Fail();
+        }
+    }
+
+    void Fail() {
+        fFailed = true;
+        if (sock != INVALID_SOCKET) {
             close(sock);
             sock = INVALID_SOCKET;
         }
     }
 
+    void SetTimeout(int64_t nNowMs, int64_t nTimeoutMs) {
+        nDeadline = nNowMs + nTimeoutMs;
+    }
+
+    void SendSocks5Connect() {
+        // Let the proxy resolve the name, as .onion addresses need.
+        const std::string strDest = you.ToStringIP();
+        if (strDest.size() > 255) {
+            Fail();
+            return;
+        }
+        const uint16_t nPort = you.GetPort();
+        std::vector<uint8_t> vch = {0x05, 0x01, 0x00, 0x03,
+                                    uint8_t(strDest.size())};
+        vch.insert(vch.end(), strDest.begin(), strDest.end());
+        vch.push_back(nPort >> 8);
+        vch.push_back(nPort & 0xff);
+        vSend.write((const char *)vch.data(), vch.size());
+    }
+
+    //! Whether the proxy's replies are complete, failing if they are wrong
+    bool ProcessSocks5() {
+        if (state == SOCKS_METHOD) {
+            if (vRecv.size() < 2) {
+                return false;
+            }
+            if (vRecv[0] != 0x05 || vRecv[1] != 0x00) {
+                Fail();
+                return false;
+            }
+            vRecv.ignore(2);
+            SendSocks5Connect();
+            state = SOCKS_CONNECT;
+        }
+        // Version, reply, reserved, address type, then the bound address.
+        if (vRecv.size() < 5) {
+            return false;
+        }
+        if (vRecv[0] != 0x05 || vRecv[1] != 0x00) {
+            Fail();
+            return false;
+        }
+        size_t nSize;
+        switch (vRecv[3]) {
+            case 0x01:
+                nSize = 4 + 4 + 2;
+                break;
+            case 0x03:
+                nSize = 4 + 1 + uint8_t(vRecv[4]) + 2;
+                break;
+            case 0x04:
+                nSize = 4 + 16 + 2;
+                break;
+            default:
+                Fail();
+                return false;
+        }
+        if (vRecv.size() < nSize) {
+            return false;
+        }
+        vRecv.ignore(nSize);
+        return true;
+    }
+
+    //! The node can be talked to
+    void Open(int64_t nNowMs) {
+        state = OPEN;
+        SetTimeout(nNowMs, GetTimeout() * 1000);
+        PushVersion();
+    }
+
     void PushVersion() {
         int64_t nTime = time(nullptr);
         uint64_t nLocalNonce = BITCOIN_SEED_NONCE;
@@ -242,8 +346,11 @@ class CSeederNode {
 
 public:
     CSeederNode(const CService &ip, std::vector<CAddress> *vAddrIn)
-        : vSend(SER_NETWORK, 0), vRecv(SER_NETWORK, 0), nHeaderStart(-1),
-          nMessageStart(-1), nVersion(0), vAddr(vAddrIn), ban(0), doneAfter(0),
+        : sock(INVALID_SOCKET), state(CONNECTING), fProxy(false),
+          nDeadline(0), fFailed(false), vSend(SER_NETWORK, 0),
+          vRecv(SER_NETWORK, 0), nHeaderStart(-1), nMessageStart(-1),
+          nVersion(0), nStartingHeight(0), vAddr(vAddrIn), ban(0),
+          doneAfter(0),
           you(ip, ServiceFlags(NODE_NETWORK | NODE_BITCOIN_CASH)) {
         if (time(nullptr) > 1329696000) {
             vSend.SetVersion(209);
@@ -251,61 +358,121 @@ public:
         }
     }
 
-    bool Run() {
-        bool proxyConnectionFailed = false;
-        if (!ConnectSocket(you, sock, nConnectTimeout,
-                           &proxyConnectionFailed)) {
+    ~CSeederNode() {
+        if (sock != INVALID_SOCKET) {
+            close(sock);
+        }
+    }
+
+    //! Start connecting, without waiting for it. False if that failed already.
+    bool Connect(int64_t nNowMs) {
+        proxyType proxy;
+        fProxy = GetProxy(you.GetNetwork(), proxy);
+        const CService &dest = fProxy ? proxy.proxy : you;
+        struct sockaddr_storage sockaddr;
+        socklen_t len = sizeof(sockaddr);
+        if (!dest.GetSockAddr((struct sockaddr *)&sockaddr, &len)) {
+            fFailed = true;
+            return false;
+        }
+        sock = socket(((struct sockaddr *)&sockaddr)->sa_family, SOCK_STREAM,
+                      IPPROTO_TCP);
+        if (sock == INVALID_SOCKET) {
+            fFailed = true;
             return false;
         }
+        int set = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (void *)&set, sizeof(int));
+        if (!SetSocketNonBlocking(sock, true) ||
+            (connect(sock, (struct sockaddr *)&sockaddr, len) == SOCKET_ERROR &&
+             WSAGetLastError() != WSAEINPROGRESS)) {
+            Fail();
+            return false;
+        }
+        SetTimeout(nNowMs, nConnectTimeout);
+        return true;
+    }
 
-        PushVersion();
-        Send();
+    SOCKET GetSocket() const { return sock; }
 
-        bool res = true;
-        int64_t now;
-        while (now = time(nullptr), ban == 0 &&
-                                        (doneAfter == 0 || doneAfter > now) &&
-                                        sock != INVALID_SOCKET) {
-            char pchBuf[0x10000];
-            fd_set set;
-            FD_ZERO(&set);
-            FD_SET(sock, &set);
-            struct timeval wa;
-            if (doneAfter) {
-                wa.tv_sec = doneAfter - now;
-                wa.tv_usec = 0;
-            } else {
-                wa.tv_sec = GetTimeout();
-                wa.tv_usec = 0;
-            }
-            int ret = select(sock + 1, &set, nullptr, &set, &wa);
-            if (ret != 1) {
-                if (!doneAfter) res = false;
-                break;
+    //! What to poll() the socket for
+    short GetEvents() const {
+        if (state == CONNECTING) {
+            return POLLOUT;
+        }
+        return vSend.empty() ? POLLIN : POLLIN | POLLOUT;
+    }
+
+    //! Act on what poll() returned for the socket
+    void HandleEvents(short revents, int64_t nNowMs) {
+        if (sock == INVALID_SOCKET) {
+            return;
+        }
+        if (state == CONNECTING) {
+            int nErr = 0;
+            socklen_t nErrSize = sizeof(nErr);
+            if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &nErr, &nErrSize) ==
+                    SOCKET_ERROR ||
+                nErr != 0) {
+                Fail();
+                return;
             }
-            int nBytes = recv(sock, pchBuf, sizeof(pchBuf), 0);
-            int nPos = vRecv.size();
-            if (nBytes > 0) {
-                vRecv.resize(nPos + nBytes);
-                memcpy(&vRecv[nPos], pchBuf, nBytes);
-            } else if (nBytes == 0) {
-                // printf("%s: BAD (connection closed prematurely)\n",
-                // ToString(you).c_str());
-                res = false;
-                break;
+            if (fProxy) {
+                static const char pchSocks5Init[] = {0x05, 0x01, 0x00};
+                vSend.write(pchSocks5Init, sizeof(pchSocks5Init));
+                state = SOCKS_METHOD;
+                SetTimeout(nNowMs, GetTimeout() * 1000);
             } else {
-                // printf("%s: BAD (connection error)\n",
-                // ToString(you).c_str());
-                res = false;
-                break;
+                Open(nNowMs);
             }
-            ProcessMessages();
             Send();
+            return;
+        }
+
+        if (revents & POLLOUT) {
+            Send();
+        }
+        if (!(revents & (POLLIN | POLLERR | POLLHUP)) ||
+            sock == INVALID_SOCKET) {
+            return;
+        }
+        char pchBuf[0x10000];
+        int nBytes = recv(sock, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+        if (nBytes < 0 && WSAGetLastError() == WSAEWOULDBLOCK) {
+            return;
+        }
+        if (nBytes <= 0) {
+            // printf("%s: BAD (connection closed or error)\n",
+            // ToString(you).c_str());
+            Fail();
+            return;
+        }
+        vRecv.write(pchBuf, nBytes);
+        if (state != OPEN) {
+            if (ProcessSocks5()) {
+                Open(nNowMs);
+            }
+        } else {
+            SetTimeout(nNowMs, GetTimeout() * 1000);
+            ProcessMessages();
         }
-        if (sock == INVALID_SOCKET) res = false;
-        close(sock);
-        sock = INVALID_SOCKET;
-        return (ban == 0) && res;
+        Send();
+    }
+
+    //! When to give up waiting on the socket, in milliseconds
+    int64_t GetDeadline() const {
+        return doneAfter ? doneAfter * 1000 : nDeadline;
+    }
+
+    //! Whether the probe is over
+    bool IsDone(int64_t nNowMs) const {
+        return fFailed || ban != 0 || nNowMs >= GetDeadline();
+    }
+
+    //! Whether the node turned out good, once IsDone()
+    bool IsGood() const {
+        // Running out of time is only fine once the node said enough.
+        return !fFailed && ban == 0 && doneAfter != 0;
     }
 
     int GetBan() { return ban; }
@@ -317,24 +484,85 @@ public:
     int GetStartingHeight() { return nStartingHeight; }
 };
 
-bool TestNode(const CService &cip, int &ban, int &clientV,
-              std::string &clientSV, int &blocks,
-              std::vector<CAddress> *vAddr) {
-    try {
-        CSeederNode node(cip, vAddr);
-        bool ret = node.Run();
-        if (!ret) {
-            ban = node.GetBan();
-        } else {
-            ban = 0;
-        }
-        clientV = node.GetClientVersion();
-        clientSV = node.GetClientSubVersion();
-        blocks = node.GetStartingHeight();
-        //  printf("%s: %s!!!\n", cip.ToString().c_str(), ret ? "GOOD" : "BAD");
-        return ret;
-    } catch (std::ios_base::failure &e) {
-        ban = 0;
-        return false;
+struct CSeederCrawler::CProbe {
+    CServiceResult res;
+    std::vector<CAddress> vAddr;
+    CSeederNode node;
+
+    CProbe(const CServiceResult &resIn, bool fGetAddr)
+        : res(resIn), node(res.service, fGetAddr ? &vAddr : nullptr) {}
+};
+
+CSeederCrawler::CSeederCrawler(size_t nMaxProbesIn)
+    : nMaxProbes(nMaxProbesIn) {}
+
+CSeederCrawler::~CSeederCrawler() {}
+
+size_t CSeederCrawler::GetFree() const {
+    return nMaxProbes - vProbes.size();
+}
+
+void CSeederCrawler::Add(const CServiceResult &res, bool fGetAddr) {
+    vProbes.emplace_back(new CProbe(res, fGetAddr));
+    vProbes.back()->node.Connect(GetTimeMillis());
+}
+
+void CSeederCrawler::Poll(int64_t nMaxWaitMs,
+                          std::vector<CServiceResult> &vDone,
+                          std::vector<CAddress> &vAddr) {
+    int64_t nNowMs = GetTimeMillis();
+    int64_t nWakeMs = nNowMs + nMaxWaitMs;
+    std::vector<struct pollfd> vPollFds(vProbes.size());
+    for (size_t i = 0; i < vProbes.size(); i++) {
+        const CSeederNode &node = vProbes[i]->node;
+        // Negative descriptors are skipped by poll().
+        vPollFds[i].fd = node.IsDone(nNowMs) ? -1 : node.GetSocket();
+        vPollFds[i].events = node.GetEvents();
+        vPollFds[i].revents = 0;
+        nWakeMs = std::min(nWakeMs, node.GetDeadline());
+    }
+    if (poll(vPollFds.data(), vPollFds.size(),
+             std::max<int64_t>(nWakeMs - nNowMs, 0)) > 0) {
+        nNowMs = GetTimeMillis();
+        for (size_t i = 0; i < vProbes.size(); i++) {
+            if (vPollFds[i].revents == 0) {
+                continue;
+            }
+            CSeederNode &node = vProbes[i]->node;
+            try {
+                node.HandleEvents(vPollFds[i].revents, nNowMs);
+            } catch (std::ios_base::failure &e) {
+                // A message that doesn't parse is a failed probe, but not a
+                // reason to ban the node.
+                vProbes[i]->res.fGood = false;
+                vProbes[i]->res.nBanTime = 0;
+                vDone.push_back(vProbes[i]->res);
+                vProbes[i].reset();
+            }
+        }
+    }
+
+    nNowMs = GetTimeMillis();
+    size_t nKept = 0;
+    for (size_t i = 0; i < vProbes.size(); i++) {
+        if (!vProbes[i]) {
+            continue;
+        }
+        CProbe &probe = *vProbes[i];
+        if (!probe.node.IsDone(nNowMs)) {
+            std::swap(vProbes[nKept++], vProbes[i]);
+            continue;
+        }
+        CServiceResult &res = probe.res;
+        res.fGood = probe.node.IsGood();
+        res.nBanTime = res.fGood ? 0 : probe.node.GetBan();
+        res.nClientV = probe.node.GetClientVersion();
+        res.strClientV = probe.node.GetClientSubVersion();
+        res.nHeight = probe.node.GetStartingHeight();
+        // printf("%s: %s!!!\n", res.service.ToString().c_str(),
+        //        res.fGood ? "GOOD" : "BAD");
+        vDone.push_back(res);
+        vAddr.insert(vAddr.end(), probe.vAddr.begin(), probe.vAddr.end());
     }
+    vProbes.resize(nKept);
 }
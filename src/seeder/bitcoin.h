@@ -3,6 +3,8 @@
 
 #include "protocol.h"
 
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -19,7 +21,37 @@ static inline unsigned short GetDefaultPort(const bool testnet = fTestNet) {
 // The network magic to use.
 extern CMessageHeader::MessageMagic netMagic;
 
-bool TestNode(const CService &cip, int &ban, int &client, std::string &clientSV,
-              int &blocks, std::vector<CAddress> *vAddr);
+struct CServiceResult;
+
+/**
+ * Tests nodes many at a time from one thread. Each probe is a non-blocking
+ * socket with its own deadline, and a single poll() waits on all of them, so
+ * how many are in flight is bounded by file descriptors rather than threads.
+ */
+class CSeederCrawler {
+public:
+    explicit CSeederCrawler(size_t nMaxProbesIn);
+    ~CSeederCrawler();
+
+    //! How many more probes can be started
+    size_t GetFree() const;
+    bool IsEmpty() const { return vProbes.empty(); }
+
+    //! Start testing res.service, asking it for addresses if fGetAddr
+    void Add(const CServiceResult &res, bool fGetAddr);
+
+    /**
+     * Wait at most nMaxWaitMs for the probes to move on, then hand the
+     * finished ones over in vDone and the addresses they got in vAddr.
+     */
+    void Poll(int64_t nMaxWaitMs, std::vector<CServiceResult> &vDone,
+              std::vector<CAddress> &vAddr);
+
+private:
+    struct CProbe;
+
+    size_t nMaxProbes;
+    std::vector<std::unique_ptr<CProbe>> vProbes;
+};
 
 #endif
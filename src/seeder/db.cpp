@@ -34,7 +34,7 @@ void CAddrInfo::Update(bool good) {
     //  stat1W.weight), stat1W.count);
 }
 
-bool CAddrDb::Get_(CServiceResult &ip, int &wait) {
+bool CAddrDbShard::Get_(CServiceResult &ip, int &wait) {
     int64_t now = time(nullptr);
     size_t tot = unkId.size() + ourId.size();
     if (tot == 0) {
@@ -72,13 +72,13 @@ bool CAddrDb::Get_(CServiceResult &ip, int &wait) {
     return true;
 }
 
-int CAddrDb::Lookup_(const CService &ip) {
+int CAddrDbShard::Lookup_(const CService &ip) {
     if (ipToId.count(ip)) return ipToId[ip];
     return -1;
 }
 
-void CAddrDb::Good_(const CService &addr, int clientV, std::string clientSV,
-                    int blocks) {
+void CAddrDbShard::Good_(const CService &addr, int clientV,
+                         std::string clientSV, int blocks) {
     int id = Lookup_(addr);
     if (id == -1) return;
     unkId.erase(id);
@@ -97,7 +97,7 @@ void CAddrDb::Good_(const CService &addr, int clientV, std::string clientSV,
     ourId.push_back(id);
 }
 
-void CAddrDb::Bad_(const CService &addr, int ban) {
+void CAddrDbShard::Bad_(const CService &addr, int ban) {
     int id = Lookup_(addr);
     if (id == -1) return;
     unkId.erase(id);
@@ -126,7 +126,7 @@ void CAddrDb::Bad_(const CService &addr, int ban) {
     nDirty++;
 }
 
-void CAddrDb::Skipped_(const CService &addr) {
+void CAddrDbShard::Skipped_(const CService &addr) {
     int id = Lookup_(addr);
     if (id == -1) return;
     unkId.erase(id);
@@ -135,7 +135,7 @@ void CAddrDb::Skipped_(const CService &addr) {
     nDirty++;
 }
 
-void CAddrDb::Add_(const CAddress &addr, bool force) {
+void CAddrDbShard::Add_(const CAddress &addr, bool force) {
     if (!force && !addr.IsRoutable()) {
         return;
     }
@@ -176,52 +176,167 @@ void CAddrDb::Add_(const CAddress &addr, bool force) {
     nDirty++;
 }
 
-void CAddrDb::GetIPs_(std::set<CNetAddr> &ips, uint64_t requestedFlags,
-                      uint32_t max, const bool *nets) {
-    if (goodId.size() == 0) {
-        int id = -1;
-        if (ourId.size() == 0) {
-            if (unkId.size() == 0) {
-                return;
+void CAddrDbShard::Load_(const CAddrInfo &info) {
+    if (info.GetBanTime()) {
+        return;
+    }
+    int id = nId++;
+    idToInfo[id] = info;
+    ipToId[info.ip] = id;
+    if (info.ourLastTry) {
+        ourId.push_back(id);
+        if (info.IsGood()) goodId.insert(id);
+    } else {
+        unkId.insert(id);
+    }
+    nDirty++;
+}
+
+void CAddrDbShard::GetGood_(std::vector<CService> &ips,
+                            uint64_t requestedFlags) {
+    for (auto &id : goodId) {
+        const CAddrInfo &info = idToInfo[id];
+        if ((info.services & requestedFlags) == requestedFlags) {
+            ips.push_back(info.ip);
+        }
+    }
+}
+
+bool CAddrDbShard::GetFallback_(CService &ip, uint64_t requestedFlags) {
+    int id = -1;
+    if (ourId.size() == 0) {
+        if (unkId.size() == 0) {
+            return false;
+        }
+        id = *unkId.begin();
+    } else {
+        id = *ourId.begin();
+    }
+
+    if ((idToInfo[id].services & requestedFlags) != requestedFlags) {
+        return false;
+    }
+    ip = idToInfo[id].ip;
+    return true;
+}
+
+void CAddrDbShard::GetStats_(CAddrDbStats &stats, int64_t now) {
+    stats.nBanned += banned.size();
+    stats.nAvail += idToInfo.size();
+    stats.nTracked += ourId.size();
+    stats.nGood += goodId.size();
+    stats.nNew += unkId.size();
+    if (ourId.size() > 0) {
+        int age = now - idToInfo[ourId[0]].ourLastTry;
+        if (age > stats.nAge) {
+            stats.nAge = age;
+        }
+    }
+}
+
+void CAddrDbShard::Snapshot_(std::vector<CAddrInfo> &infos,
+                             std::map<CService, int64_t> &bans) {
+    for (std::deque<int>::const_iterator it = ourId.begin();
+         it != ourId.end(); it++) {
+        infos.push_back(idToInfo[*it]);
+    }
+    for (std::set<int>::const_iterator it = unkId.begin(); it != unkId.end();
+         it++) {
+        infos.push_back(idToInfo[*it]);
+    }
+    bans.insert(banned.begin(), banned.end());
+}
+
+void CAddrDb::GetStats(CAddrDbStats &stats) {
+    stats = CAddrDbStats();
+    int64_t now = time(nullptr);
+    for (CAddrDbShard &shard : shards) {
+        LOCK(shard.cs);
+        shard.GetStats_(stats, now);
+    }
+}
+
+std::vector<CAddrReport> CAddrDb::GetAll() {
+    std::vector<CAddrReport> ret;
+    for (CAddrDbShard &shard : shards) {
+        LOCK(shard.cs);
+        for (std::deque<int>::const_iterator it = shard.ourId.begin();
+             it != shard.ourId.end(); it++) {
+            const CAddrInfo &info = shard.idToInfo[*it];
+            if (info.success > 0) {
+                ret.push_back(info.GetReport());
             }
-            id = *unkId.begin();
-        } else {
-            id = *ourId.begin();
         }
+    }
+    return ret;
+}
 
-        if (id >= 0 &&
-            (idToInfo[id].services & requestedFlags) == requestedFlags) {
-            ips.insert(idToInfo[id].ip);
+void CAddrDb::GetMany(std::vector<CServiceResult> &ips, int max, int &wait) {
+    // Take one node from each shard in turn, so that all of them get crawled
+    // at the same pace, and start where the previous call started plus one.
+    unsigned int nStart = nNextShard++;
+    bool fAny = true;
+    while (max > 0 && fAny) {
+        fAny = false;
+        for (int i = 0; i < ADDRDB_SHARDS && max > 0; i++) {
+            CAddrDbShard &shard = shards[(nStart + i) % ADDRDB_SHARDS];
+            CServiceResult ip = {};
+            {
+                LOCK(shard.cs);
+                if (!shard.Get_(ip, wait)) {
+                    continue;
+                }
+            }
+            ips.push_back(ip);
+            max--;
+            fAny = true;
         }
-        return;
+    }
+}
+
+void CAddrDb::GetIPs(std::set<CNetAddr> &ips, uint64_t requestedFlags,
+                     uint32_t max, const bool *nets) {
+    // Copy the candidates out shard by shard, and pick among them without
+    // holding any lock.
+    std::vector<CService> goodFiltered;
+    size_t nGood = 0;
+    for (CAddrDbShard &shard : shards) {
+        LOCK(shard.cs);
+        nGood += shard.goodId.size();
+        shard.GetGood_(goodFiltered, requestedFlags);
     }
 
-    std::vector<int> goodIdFiltered;
-    for (auto &id : goodId) {
-        if ((idToInfo[id].services & requestedFlags) == requestedFlags) {
-            goodIdFiltered.push_back(id);
+    if (nGood == 0) {
+        for (CAddrDbShard &shard : shards) {
+            LOCK(shard.cs);
+            CService ip;
+            if (shard.GetFallback_(ip, requestedFlags)) {
+                ips.insert(ip);
+                return;
+            }
         }
+        return;
     }
 
-    if (!goodIdFiltered.size()) {
+    if (!goodFiltered.size()) {
         return;
     }
 
-    if (max > goodIdFiltered.size() / 2) {
-        max = goodIdFiltered.size() / 2;
+    if (max > goodFiltered.size() / 2) {
+        max = goodFiltered.size() / 2;
     }
 
     if (max < 1) {
         max = 1;
     }
 
-    std::set<int> ids;
-    while (ids.size() < max) {
-        ids.insert(goodIdFiltered[rand() % goodIdFiltered.size()]);
+    std::set<size_t> indexes;
+    while (indexes.size() < max) {
+        indexes.insert(rand() % goodFiltered.size());
     }
 
-    for (auto &id : ids) {
-        CService &ip = idToInfo[id].ip;
+    for (auto &i : indexes) {
+        const CService &ip = goodFiltered[i];
         if (nets[ip.GetNetwork()]) {
             ips.insert(ip);
         }
@@ -8,6 +8,7 @@
 #include "util.h"
 #include "version.h"
 
+#include <atomic>
 #include <cmath>
 #include <cstdint>
 #include <deque>
@@ -178,6 +179,7 @@ public:
     void Update(bool good);
 
     friend class CAddrDb;
+    friend class CAddrDbShard;
 
     ADD_SERIALIZE_METHODS;
 
@@ -234,7 +236,12 @@ struct CServiceResult {
     int64_t ourLastSuccess;
 };
 
+//! Number of independently locked parts of the address database
+static const int ADDRDB_SHARDS = 16;
+
 /**
+ * The addresses whose hash falls in one shard of CAddrDb, with their own lock.
+ *
  *             seen nodes
  *            /          \
  * (a) banned nodes       available nodes--------------
@@ -243,7 +250,7 @@ struct CServiceResult {
  *              /           \
  *     (d) good nodes   (c) non-good nodes
  */
-class CAddrDb {
+class CAddrDbShard {
 private:
     mutable CCriticalSection cs;
     // number of address id's
@@ -258,16 +265,18 @@ private:
     std::set<int> unkId;
     // set of good nodes  (d, good e)
     std::set<int> goodId;
+    // nodes that are banned, with their unban time (a)
+    std::map<CService, int64_t> banned;
     int nDirty;
 
-protected:
     // internal routines that assume proper locks are acquired
     // add an address
     void Add_(const CAddress &addr, bool force);
+    // add an address read from disk
+    void Load_(const CAddrInfo &info);
     // get an IP to test (must call Good_, Bad_, or Skipped_ on result
     // afterwards)
     bool Get_(CServiceResult &ip, int &wait);
-    bool GetMany_(std::vector<CServiceResult> &ips, int max, int &wait);
     // mark an IP as good (must have been returned by Get_)
     void Good_(const CService &ip, int clientV, std::string clientSV,
                int blocks);
@@ -278,167 +287,162 @@ protected:
     void Skipped_(const CService &ip);
     // look up id of an IP
     int Lookup_(const CService &ip);
-    // get a random set of IPs (shared lock only)
-    void GetIPs_(std::set<CNetAddr> &ips, uint64_t requestedFlags, uint32_t max,
-                 const bool *nets);
+    // append the good nodes with all of requestedFlags
+    void GetGood_(std::vector<CService> &ips, uint64_t requestedFlags);
+    // get a node to hand out when none is good yet
+    bool GetFallback_(CService &ip, uint64_t requestedFlags);
+    // add up the statistics
+    void GetStats_(CAddrDbStats &stats, int64_t now);
+    // copy the nodes to dump, tried ones first, and the banned ones
+    void Snapshot_(std::vector<CAddrInfo> &infos,
+                   std::map<CService, int64_t> &bans);
 
 public:
-    // nodes that are banned, with their unban time (a)
-    std::map<CService, int64_t> banned;
+    CAddrDbShard() : nId(0), nDirty(0) {}
+
+    friend class CAddrDb;
+};
 
-    void GetStats(CAddrDbStats &stats) {
-        LOCK(cs);
-        stats.nBanned = banned.size();
-        stats.nAvail = idToInfo.size();
-        stats.nTracked = ourId.size();
-        stats.nGood = goodId.size();
-        stats.nNew = unkId.size();
-        stats.nAge = time(nullptr) - idToInfo[ourId[0]].ourLastTry;
+/**
+ * The seeder's address database. Addresses are spread over ADDRDB_SHARDS
+ * shards by hash, so the crawler threads, the DNS threads, the dumper and the
+ * stats only contend when they touch the same shard, and each lock covers a
+ * fraction of the addresses.
+ */
+class CAddrDb {
+private:
+    CAddrDbShard shards[ADDRDB_SHARDS];
+    // shard GetMany starts with, to take turns between them
+    std::atomic<unsigned int> nNextShard;
+
+    CAddrDbShard &GetShard(const CService &ip) {
+        return shards[ip.GetHash() % ADDRDB_SHARDS];
     }
 
-    void ResetIgnores() {
-        for (std::map<int, CAddrInfo>::iterator it = idToInfo.begin();
-             it != idToInfo.end(); it++) {
-            (*it).second.ignoreTill = 0;
+public:
+    CAddrDb() : nNextShard(0) {}
+
+    void GetStats(CAddrDbStats &stats);
+
+    void ClearBanned() {
+        for (CAddrDbShard &shard : shards) {
+            LOCK(shard.cs);
+            shard.banned.clear();
         }
     }
 
-    std::vector<CAddrReport> GetAll() {
-        std::vector<CAddrReport> ret;
-        LOCK(cs);
-        for (std::deque<int>::const_iterator it = ourId.begin();
-             it != ourId.end(); it++) {
-            const CAddrInfo &info = idToInfo[*it];
-            if (info.success > 0) {
-                ret.push_back(info.GetReport());
+    void ResetIgnores() {
+        for (CAddrDbShard &shard : shards) {
+            LOCK(shard.cs);
+            for (std::map<int, CAddrInfo>::iterator it =
+                     shard.idToInfo.begin();
+                 it != shard.idToInfo.end(); it++) {
+                (*it).second.ignoreTill = 0;
             }
         }
-        return ret;
     }
 
+    std::vector<CAddrReport> GetAll();
+
     // serialization code
     // format:
     //   nVersion (0 for now)
     //   n (number of ips in (b,c,d))
     //   CAddrInfo[n]
     //   banned
-    // acquires a shared lock (this does not suffice for read mode, but we
-    // assume that only happens at startup, single-threaded) this way, dumping
-    // does not interfere with GetIPs_, which is called from the DNS thread
+    // the shards are copied one at a time and written without holding any
+    // lock, so dumping does not hold up the crawler and the DNS threads
+    // (reading is assumed to only happen at startup, single-threaded)
     template <typename Stream> void Serialize(Stream &s) const {
-        LOCK(cs);
+        std::vector<CAddrInfo> infos;
+        std::map<CService, int64_t> bans;
+        CAddrDb *db = const_cast<CAddrDb *>(this);
+        for (CAddrDbShard &shard : db->shards) {
+            LOCK(shard.cs);
+            shard.Snapshot_(infos, bans);
+        }
 
         int nVersion = 0;
         s << nVersion;
 
-        CAddrDb *db = const_cast<CAddrDb *>(this);
-        int n = ourId.size() + unkId.size();
+        int n = infos.size();
         s << n;
-        for (std::deque<int>::const_iterator it = ourId.begin();
-             it != ourId.end(); it++) {
-            std::map<int, CAddrInfo>::iterator ci = db->idToInfo.find(*it);
-            s << (*ci).second;
-        }
-        for (std::set<int>::const_iterator it = unkId.begin();
-             it != unkId.end(); it++) {
-            std::map<int, CAddrInfo>::iterator ci = db->idToInfo.find(*it);
-            s << (*ci).second;
+        for (const CAddrInfo &info : infos) {
+            s << info;
         }
-        s << banned;
+        s << bans;
     }
 
     template <typename Stream> void Unserialize(Stream &s) {
-        LOCK(cs);
-
         int nVersion;
         s >> nVersion;
 
-        CAddrDb *db = const_cast<CAddrDb *>(this);
-        db->nId = 0;
         int n;
         s >> n;
         for (int i = 0; i < n; i++) {
             CAddrInfo info;
             s >> info;
-            if (!info.GetBanTime()) {
-                int id = db->nId++;
-                db->idToInfo[id] = info;
-                db->ipToId[info.ip] = id;
-                if (info.ourLastTry) {
-                    db->ourId.push_back(id);
-                    if (info.IsGood()) db->goodId.insert(id);
-                } else {
-                    db->unkId.insert(id);
-                }
-            }
+            CAddrDbShard &shard = GetShard(info.ip);
+            LOCK(shard.cs);
+            shard.Load_(info);
         }
-        db->nDirty++;
 
-        s >> banned;
+        std::map<CService, int64_t> bans;
+        s >> bans;
+        for (const std::pair<CService, int64_t> &ban : bans) {
+            CAddrDbShard &shard = GetShard(ban.first);
+            LOCK(shard.cs);
+            shard.banned.insert(ban);
+        }
     }
 
     void Add(const CAddress &addr, bool fForce = false) {
-        LOCK(cs);
-        Add_(addr, fForce);
+        CAddrDbShard &shard = GetShard(addr);
+        LOCK(shard.cs);
+        shard.Add_(addr, fForce);
     }
 
     void Add(const std::vector<CAddress> &vAddr, bool fForce = false) {
-        LOCK(cs);
         for (size_t i = 0; i < vAddr.size(); i++) {
-            Add_(vAddr[i], fForce);
+            Add(vAddr[i], fForce);
         }
     }
 
     void Good(const CService &addr, int clientVersion,
               std::string clientSubVersion, int blocks) {
-        LOCK(cs);
-        Good_(addr, clientVersion, clientSubVersion, blocks);
+        CAddrDbShard &shard = GetShard(addr);
+        LOCK(shard.cs);
+        shard.Good_(addr, clientVersion, clientSubVersion, blocks);
     }
 
     void Skipped(const CService &addr) {
-        LOCK(cs);
-        Skipped_(addr);
+        CAddrDbShard &shard = GetShard(addr);
+        LOCK(shard.cs);
+        shard.Skipped_(addr);
     }
 
     void Bad(const CService &addr, int ban = 0) {
-        LOCK(cs);
-        Bad_(addr, ban);
-    }
-
-    bool Get(CServiceResult &ip, int &wait) {
-        LOCK(cs);
-        return Get_(ip, wait);
+        CAddrDbShard &shard = GetShard(addr);
+        LOCK(shard.cs);
+        shard.Bad_(addr, ban);
     }
 
-    void GetMany(std::vector<CServiceResult> &ips, int max, int &wait) {
-        LOCK(cs);
-        while (max > 0) {
-            CServiceResult ip = {};
-            if (!Get_(ip, wait)) {
-                return;
-            }
-            ips.push_back(ip);
-            max--;
-        }
-    }
+    void GetMany(std::vector<CServiceResult> &ips, int max, int &wait);
 
     void ResultMany(const std::vector<CServiceResult> &ips) {
-        LOCK(cs);
         for (size_t i = 0; i < ips.size(); i++) {
             if (ips[i].fGood) {
-                Good_(ips[i].service, ips[i].nClientV, ips[i].strClientV,
-                      ips[i].nHeight);
+                Good(ips[i].service, ips[i].nClientV, ips[i].strClientV,
+                     ips[i].nHeight);
             } else {
-                Bad_(ips[i].service, ips[i].nBanTime);
+                Bad(ips[i].service, ips[i].nBanTime);
             }
         }
     }
 
+    // get a random set of IPs
     void GetIPs(std::set<CNetAddr> &ips, uint64_t requestedFlags, uint32_t max,
-                const bool *nets) {
-        LOCK(cs);
-        GetIPs_(ips, requestedFlags, max, nets);
-    }
+                const bool *nets);
 };
 
 #endif
@@ -304,7 +304,199 @@ error:
     return error;
 }
 
-static ssize_t dnshandle(dns_opt_t *opt, const uint8_t *inbuf, size_t insize,
+// Writes the answer and authority sections for a question about name, of type
+// typ and class cls, whose name is at offset in the packet, and counts the
+// records written in *nanswer and *nauth.
+static void write_answer(dns_opt_t *opt, const char *name, int offset, int typ,
+                         int cls, uint8_t **outpos, uint8_t *outend,
+                         uint8_t *nanswer, uint8_t *nauth) {
+    int have_ns = 0;
+    int max_auth_size = 0;
+    *nanswer = 0;
+    *nauth = 0;
+
+    // calculate max size of authority section
+
+    if (!((typ == TYPE_NS || typ == QTYPE_ANY) &&
+          (cls == CLASS_IN || cls == QCLASS_ANY))) {
+        // authority section will be necessary, either NS or SOA
+        uint8_t *newpos = *outpos;
+        write_record_ns(&newpos, outend, "", offset, CLASS_IN, 0, opt->ns);
+        max_auth_size = newpos - *outpos;
+
+        newpos = *outpos;
+        write_record_soa(&newpos, outend, "", offset, CLASS_IN, opt->nsttl,
+                         opt->ns, opt->mbox, time(NULL), 604800, 86400,
+                         2592000, 604800);
+        if (max_auth_size < newpos - *outpos)
+            max_auth_size = newpos - *outpos;
+        //    printf("Authority section will claim %i bytes max\n",
+        //    max_auth_size);
+    }
+
+    // Answer section
+
+    // NS records
+    if ((typ == TYPE_NS || typ == QTYPE_ANY) &&
+        (cls == CLASS_IN || cls == QCLASS_ANY)) {
+        int ret2 = write_record_ns(outpos, outend - max_auth_size, "", offset,
+                                   CLASS_IN, opt->nsttl, opt->ns);
+        //    printf("wrote NS record: %i\n", ret2);
+        if (!ret2) {
+            (*nanswer)++;
+            have_ns++;
+        }
+    }
+
+    // SOA records
+    if ((typ == TYPE_SOA || typ == QTYPE_ANY) &&
+        (cls == CLASS_IN || cls == QCLASS_ANY) && opt->mbox) {
+        int ret2 = write_record_soa(outpos, outend - max_auth_size, "", offset,
+                                    CLASS_IN, opt->nsttl, opt->ns, opt->mbox,
+                                    time(NULL), 604800, 86400, 2592000, 604800);
+        //    printf("wrote SOA record: %i\n", ret2);
+        if (!ret2) {
+            (*nanswer)++;
+        }
+    }
+
+    // A/AAAA records
+    if ((typ == TYPE_A || typ == TYPE_AAAA || typ == QTYPE_ANY) &&
+        (cls == CLASS_IN || cls == QCLASS_ANY)) {
+        addr_t addr[32];
+        int naddr = opt->cb((void *)opt, (char *)name, addr, 32,
+                            typ == TYPE_A || typ == QTYPE_ANY,
+                            typ == TYPE_AAAA || typ == QTYPE_ANY);
+        int n = 0;
+        while (n < naddr) {
+            int ret = 1;
+            if (addr[n].v == 4) {
+                ret = write_record_a(outpos, outend - max_auth_size, "", offset,
+                                     CLASS_IN, opt->datattl, &addr[n]);
+            } else if (addr[n].v == 6) {
+                ret = write_record_aaaa(outpos, outend - max_auth_size, "",
+                                        offset, CLASS_IN, opt->datattl,
+                                        &addr[n]);
+            }
+
+            //      printf("wrote A record: %i\n", ret);
+            if (ret) {
+                break;
+            }
+
+            n++;
+            (*nanswer)++;
+        }
+    }
+
+    // Authority section
+    if (!have_ns && *nanswer) {
+        int ret2 = write_record_ns(outpos, outend, "", offset, CLASS_IN,
+                                   opt->nsttl, opt->ns);
+        //    printf("wrote NS record: %i\n", ret2);
+        if (!ret2) {
+            (*nauth)++;
+        }
+    } else if (!*nanswer) {
+        // Didn't include any answers, so reply with SOA as this is a
+        // negative response. If we replied with NS above we'd create a bad
+        // horizontal referral loop, as the NS response indicates where the
+        // resolver should try next.
+        int ret2 = write_record_soa(outpos, outend, "", offset, CLASS_IN,
+                                    opt->nsttl, opt->ns, opt->mbox, time(NULL),
+                                    604800, 86400, 2592000, 604800);
+        //    printf("wrote SOA record: %i\n", ret2);
+        if (!ret2) {
+            (*nauth)++;
+        }
+    }
+}
+
+// Address queries are answered from sections written ahead of time, so that
+// serving one is copying bytes rather than picking addresses and writing
+// records. Each name and type gets a few differently shuffled answers, handed
+// out in turn, so clients still see different nodes. An answer is rewritten
+// when it is handed out more than ANSWER_REFRESH seconds after it was written,
+// so no query costs more than it did before, even for names never asked again.
+#define ANSWER_CACHE_SIZE 16
+#define ANSWER_VARIANTS 8
+#define ANSWER_REFRESH 10
+
+typedef struct {
+    uint8_t data[BUFLEN];
+    int size;
+    uint8_t nanswer;
+    uint8_t nauth;
+    time_t built;
+} answer_t;
+
+typedef struct {
+    // lower case, as resolvers may randomize the case of queries
+    char name[256];
+    int typ;
+    // room left after the question, the same for all queries of name unless
+    // they compress it oddly
+    int space;
+    int next;
+    answer_t variant[ANSWER_VARIANTS];
+} answer_cache_entry_t;
+
+typedef struct {
+    answer_cache_entry_t entry[ANSWER_CACHE_SIZE];
+    int nentry;
+    int evict;
+} answer_cache_t;
+
+static const answer_t *get_answer(answer_cache_t *cache, dns_opt_t *opt,
+                                  const char *name, int offset, int typ,
+                                  int space) {
+    char lname[256];
+    size_t i = 0;
+    for (; name[i] != 0; i++) {
+        lname[i] = tolower((unsigned char)name[i]);
+    }
+    lname[i] = 0;
+
+    answer_cache_entry_t *entry = NULL;
+    for (int n = 0; n < cache->nentry; n++) {
+        answer_cache_entry_t *e = &cache->entry[n];
+        if (e->typ == typ && e->space == space && !strcmp(e->name, lname)) {
+            entry = e;
+            break;
+        }
+    }
+
+    time_t now = time(NULL);
+    if (entry == NULL) {
+        if (cache->nentry < ANSWER_CACHE_SIZE) {
+            entry = &cache->entry[cache->nentry++];
+        } else {
+            entry = &cache->entry[cache->evict];
+            cache->evict = (cache->evict + 1) % ANSWER_CACHE_SIZE;
+        }
+        strcpy(entry->name, lname);
+        entry->typ = typ;
+        entry->space = space;
+        entry->next = 0;
+        for (int v = 0; v < ANSWER_VARIANTS; v++) {
+            entry->variant[v].built = 0;
+        }
+    }
+
+    answer_t *ans = &entry->variant[entry->next];
+    entry->next = (entry->next + 1) % ANSWER_VARIANTS;
+    if (now - ans->built >= ANSWER_REFRESH) {
+        uint8_t *outpos = ans->data;
+        write_answer(opt, lname, offset, typ, CLASS_IN, &outpos,
+                     ans->data + space, &ans->nanswer, &ans->nauth);
+        ans->size = outpos - ans->data;
+        ans->built = now;
+    }
+    return ans;
+}
+
+static ssize_t dnshandle(dns_opt_t *opt, answer_cache_t *cache,
+                         const uint8_t *inbuf, size_t insize,
                          uint8_t *outbuf) {
     int error = 0;
     if (insize < 12) {
@@ -313,8 +505,6 @@ static ssize_t dnshandle(dns_opt_t *opt, const uint8_t *inbuf, size_t insize,
     }
 
     // Predeclare various variables to avoid jumping over declarations.
-    int have_ns = 0;
-    int max_auth_size = 0;
     int nquestion = 0;
 
     // copy id
@@ -410,102 +600,17 @@ static ssize_t dnshandle(dns_opt_t *opt, const uint8_t *inbuf, size_t insize,
         //   printf("DNS: Request host='%s' type=%i class=%i\n", name, typ,
         //   cls);
 
-        // calculate max size of authority section
-
-        if (!((typ == TYPE_NS || typ == QTYPE_ANY) &&
-              (cls == CLASS_IN || cls == QCLASS_ANY))) {
-            // authority section will be necessary, either NS or SOA
-            uint8_t *newpos = outpos;
-            write_record_ns(&newpos, outend, "", offset, CLASS_IN, 0, opt->ns);
-            max_auth_size = newpos - outpos;
-
-            newpos = outpos;
-            write_record_soa(&newpos, outend, "", offset, CLASS_IN, opt->nsttl,
-                             opt->ns, opt->mbox, time(NULL), 604800, 86400,
-                             2592000, 604800);
-            if (max_auth_size < newpos - outpos)
-                max_auth_size = newpos - outpos;
-            //    printf("Authority section will claim %i bytes max\n",
-            //    max_auth_size);
-        }
-
-        // Answer section
-
-        // NS records
-        if ((typ == TYPE_NS || typ == QTYPE_ANY) &&
-            (cls == CLASS_IN || cls == QCLASS_ANY)) {
-            int ret2 = write_record_ns(&outpos, outend - max_auth_size, "",
-                                       offset, CLASS_IN, opt->nsttl, opt->ns);
-            //    printf("wrote NS record: %i\n", ret2);
-            if (!ret2) {
-                outbuf[7]++;
-                have_ns++;
-            }
-        }
-
-        // SOA records
-        if ((typ == TYPE_SOA || typ == QTYPE_ANY) &&
-            (cls == CLASS_IN || cls == QCLASS_ANY) && opt->mbox) {
-            int ret2 =
-                write_record_soa(&outpos, outend - max_auth_size, "", offset,
-                                 CLASS_IN, opt->nsttl, opt->ns, opt->mbox,
-                                 time(NULL), 604800, 86400, 2592000, 604800);
-            //    printf("wrote SOA record: %i\n", ret2);
-            if (!ret2) {
-                outbuf[7]++;
-            }
-        }
-
-        // A/AAAA records
         if ((typ == TYPE_A || typ == TYPE_AAAA || typ == QTYPE_ANY) &&
             (cls == CLASS_IN || cls == QCLASS_ANY)) {
-            addr_t addr[32];
-            int naddr = opt->cb((void *)opt, name, addr, 32,
-                                typ == TYPE_A || typ == QTYPE_ANY,
-                                typ == TYPE_AAAA || typ == QTYPE_ANY);
-            int n = 0;
-            while (n < naddr) {
-                int ret = 1;
-                if (addr[n].v == 4) {
-                    ret = write_record_a(&outpos, outend - max_auth_size, "",
-                                         offset, CLASS_IN, opt->datattl,
-                                         &addr[n]);
-                } else if (addr[n].v == 6) {
-                    ret = write_record_aaaa(&outpos, outend - max_auth_size, "",
-                                            offset, CLASS_IN, opt->datattl,
-                                            &addr[n]);
-                }
-
-                //      printf("wrote A record: %i\n", ret);
-                if (ret) {
-                    break;
-                }
-
-                n++;
-                outbuf[7]++;
-            }
-        }
-
-        // Authority section
-        if (!have_ns && outbuf[7]) {
-            int ret2 = write_record_ns(&outpos, outend, "", offset, CLASS_IN,
-                                       opt->nsttl, opt->ns);
-            //    printf("wrote NS record: %i\n", ret2);
-            if (!ret2) {
-                outbuf[9]++;
-            }
-        } else if (!outbuf[7]) {
-            // Didn't include any answers, so reply with SOA as this is a
-            // negative response. If we replied with NS above we'd create a bad
-            // horizontal referral loop, as the NS response indicates where the
-            // resolver should try next.
-            int ret2 = write_record_soa(
-                &outpos, outend, "", offset, CLASS_IN, opt->nsttl, opt->ns,
-                opt->mbox, time(NULL), 604800, 86400, 2592000, 604800);
-            //    printf("wrote SOA record: %i\n", ret2);
-            if (!ret2) {
-                outbuf[9]++;
-            }
+            const answer_t *ans =
+                get_answer(cache, opt, name, offset, typ, outend - outpos);
+            memcpy(outpos, ans->data, ans->size);
+            outpos += ans->size;
+            outbuf[7] = ans->nanswer;
+            outbuf[9] = ans->nauth;
+        } else {
+            write_answer(opt, name, offset, typ, cls, &outpos, outend,
+                         &outbuf[7], &outbuf[9]);
         }
 
         // set AA
@@ -529,35 +634,57 @@ error:
     return 12;
 }
 
-static int listenSocket = -1;
+// Room for bursts of queries, which are dropped once the buffer is full
+#define SOCKET_RCVBUF (4 * 1024 * 1024)
+
+static int open_socket(int port) {
+    int sock = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock == -1) {
+        return -1;
+    }
+    int sockopt = 1;
+    setsockopt(sock, IPPROTO_IPV6, DSTADDR_SOCKOPT, &sockopt, sizeof sockopt);
+#ifdef SO_REUSEPORT
+    // Every thread binds its own socket to the port, and the kernel spreads
+    // the queries over them.
+    setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &sockopt, sizeof sockopt);
+#endif
+    int rcvbuf = SOCKET_RCVBUF;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+    struct sockaddr_in6 si_me;
+    memset((char *)&si_me, 0, sizeof(si_me));
+    si_me.sin6_family = AF_INET6;
+    si_me.sin6_port = htons(port);
+    si_me.sin6_addr = in6addr_any;
+    if (bind(sock, (struct sockaddr *)&si_me, sizeof(si_me)) == -1) {
+        close(sock);
+        return -2;
+    }
+    return sock;
+}
+
+#ifndef SO_REUSEPORT
+// Without SO_REUSEPORT the threads share one socket.
+static int sharedSocket = -1;
+#endif
 
 int dnsserver(dns_opt_t *opt) {
     struct sockaddr_in6 si_other;
-    int senderSocket = -1;
-    senderSocket = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
-    if (senderSocket == -1) return -3;
-
-    int replySocket;
-    if (listenSocket == -1) {
-        struct sockaddr_in6 si_me;
-        if ((listenSocket = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP)) == -1) {
-            listenSocket = -1;
-            return -1;
-        }
-        replySocket = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
-        if (replySocket == -1) {
-            close(listenSocket);
-            return -1;
-        }
-        int sockopt = 1;
-        setsockopt(listenSocket, IPPROTO_IPV6, DSTADDR_SOCKOPT, &sockopt,
-                   sizeof sockopt);
-        memset((char *)&si_me, 0, sizeof(si_me));
-        si_me.sin6_family = AF_INET6;
-        si_me.sin6_port = htons(opt->port);
-        si_me.sin6_addr = in6addr_any;
-        if (bind(listenSocket, (struct sockaddr *)&si_me, sizeof(si_me)) == -1)
-            return -2;
+#ifdef SO_REUSEPORT
+    int listenSocket = open_socket(opt->port);
+#else
+    if (sharedSocket == -1) {
+        sharedSocket = open_socket(opt->port);
+    }
+    int listenSocket = sharedSocket;
+#endif
+    if (listenSocket < 0) {
+        return listenSocket;
+    }
+
+    answer_cache_t *cache = (answer_cache_t *)calloc(1, sizeof(answer_cache_t));
+    if (cache == NULL) {
+        return -3;
     }
 
     uint8_t inbuf[BUFLEN], outbuf[BUFLEN];
@@ -584,7 +711,7 @@ int dnsserver(dns_opt_t *opt) {
         //    addr[3], ntohs(si_other.sin_port), (int)insize);
         if (insize <= 0) continue;
 
-        ssize_t ret = dnshandle(opt, inbuf, insize, outbuf);
+        ssize_t ret = dnshandle(opt, cache, inbuf, insize, outbuf);
         if (ret <= 0) continue;
 
         bool handled = false;
@@ -13,10 +13,12 @@
 #include <getopt.h>
 #include <pthread.h>
 #include <signal.h>
+#include <sys/resource.h>
 
 class CDnsSeedOpts {
 public:
     int nThreads;
+    int nProbes;
     int nPort;
     int nDnsThreads;
     int fUseTestNet;
@@ -31,23 +33,24 @@ public:
     std::set<uint64_t> filter_whitelist;
 
     CDnsSeedOpts()
-        : nThreads(96), nPort(53), nDnsThreads(4), fUseTestNet(false),
-          fWipeBan(false), fWipeIgnore(false), mbox(nullptr), ns(nullptr),
-          host(nullptr), tor(nullptr), ipv4_proxy(nullptr),
-          ipv6_proxy(nullptr) {}
+        : nThreads(1), nProbes(1000), nPort(53), nDnsThreads(4),
+          fUseTestNet(false), fWipeBan(false), fWipeIgnore(false),
+          mbox(nullptr), ns(nullptr), host(nullptr), tor(nullptr),
+          ipv4_proxy(nullptr), ipv6_proxy(nullptr) {}
 
     void ParseCommandLine(int argc, char **argv) {
         static const char *help =
             "Bitcoin-cash-seeder\n"
-            "Usage: %s -h <host> -n <ns> [-m <mbox>] [-t <threads>] [-p "
-            "<port>]\n"
+            "Usage: %s -h <host> -n <ns> [-m <mbox>] [-t <threads>] [-c "
+            "<probes>] [-p <port>]\n"
             "\n"
             "Options:\n"
             "-h <host>       Hostname of the DNS seed\n"
             "-n <ns>         Hostname of the nameserver\n"
             "-m <mbox>       E-Mail address reported in SOA records\n"
-            "-t <threads>    Number of crawlers to run in parallel (default "
-            "96)\n"
+            "-t <threads>    Number of crawler threads (default 1)\n"
+            "-c <probes>     Number of nodes each crawler tests at once "
+            "(default 1000)\n"
             "-d <threads>    Number of DNS server threads (default 4)\n"
             "-p <port>       UDP port to listen on (default 53)\n"
             "-o <ip:port>    Tor proxy IP/Port\n"
@@ -67,6 +70,7 @@ public:
                 {"ns", required_argument, 0, 'n'},
                 {"mbox", required_argument, 0, 'm'},
                 {"threads", required_argument, 0, 't'},
+                {"probes", required_argument, 0, 'c'},
                 {"dnsthreads", required_argument, 0, 'd'},
                 {"port", required_argument, 0, 'p'},
                 {"onion", required_argument, 0, 'o'},
@@ -79,7 +83,7 @@ public:
                 {"help", no_argument, 0, 'h'},
                 {0, 0, 0, 0}};
             int option_index = 0;
-            int c = getopt_long(argc, argv, "h:n:m:t:p:d:o:i:k:w:",
+            int c = getopt_long(argc, argv, "h:n:m:t:c:p:d:o:i:k:w:",
                                 long_options, &option_index);
             if (c == -1) break;
             switch (c) {
@@ -104,6 +108,12 @@ public:
                     break;
                 }
 
+                case 'c': {
+                    int n = strtol(optarg, nullptr, 10);
+                    if (n > 0 && n < 100000) nProbes = n;
+                    break;
+                }
+
                 case 'd': {
                     int n = strtol(optarg, nullptr, 10);
                     if (n > 0 && n < 1000) nDnsThreads = n;
@@ -169,38 +179,62 @@ extern "C" {
 CAddrDb db;
 
 extern "C" void *ThreadCrawler(void *data) {
-    int *nThreads = (int *)data;
+    const CDnsSeedOpts *opts = (const CDnsSeedOpts *)data;
+    CSeederCrawler crawler(opts->nProbes);
     do {
-        std::vector<CServiceResult> ips;
         int wait = 5;
-        db.GetMany(ips, 16, wait);
-        int64_t now = time(nullptr);
-        if (ips.empty()) {
+        if (crawler.GetFree() > 0) {
+            std::vector<CServiceResult> ips;
+            db.GetMany(ips, crawler.GetFree(), wait);
+            int64_t now = time(nullptr);
+            for (CServiceResult &res : ips) {
+                res.nBanTime = 0;
+                res.nClientV = 0;
+                res.nHeight = 0;
+                res.strClientV = "";
+                bool getaddr = res.ourLastSuccess + 86400 < now;
+                crawler.Add(res, getaddr);
+            }
+        }
+        if (crawler.IsEmpty()) {
             wait *= 1000;
-            wait += rand() % (500 * *nThreads);
+            wait += rand() % (500 * opts->nThreads);
             Sleep(wait);
             continue;
         }
 
+        // Come back for more nodes at least once a second, the database may
+        // have some by then.
+        std::vector<CServiceResult> ips;
         std::vector<CAddress> addr;
-        for (size_t i = 0; i < ips.size(); i++) {
-            CServiceResult &res = ips[i];
-            res.nBanTime = 0;
-            res.nClientV = 0;
-            res.nHeight = 0;
-            res.strClientV = "";
-            bool getaddr = res.ourLastSuccess + 86400 < now;
-            res.fGood = TestNode(res.service, res.nBanTime, res.nClientV,
-                                 res.strClientV, res.nHeight,
-                                 getaddr ? &addr : nullptr);
+        crawler.Poll(1000, ips, addr);
+        if (!ips.empty()) {
+            db.ResultMany(ips);
+        }
+        if (!addr.empty()) {
+            db.Add(addr);
         }
-
-        db.ResultMany(ips);
-        db.Add(addr);
     } while (1);
     return nullptr;
 }
 
+/**
+ * Allow nWanted descriptors, as far as the hard limit goes, and return how
+ * many are allowed.
+ */
+static int RaiseFileLimit(int nWanted) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == -1) {
+        return nWanted;
+    }
+    if (limit.rlim_cur < (rlim_t)nWanted) {
+        limit.rlim_cur = std::min<rlim_t>(nWanted, limit.rlim_max);
+        setrlimit(RLIMIT_NOFILE, &limit);
+        getrlimit(RLIMIT_NOFILE, &limit);
+    }
+    return std::min<rlim_t>(limit.rlim_cur, nWanted);
+}
+
 extern "C" uint32_t GetIPList(void *thread, char *requestedHostname,
                               addr_t *addr, uint32_t max, uint32_t ipv4,
                               uint32_t ipv6);
@@ -525,7 +559,7 @@ int main(int argc, char **argv) {
         printf("Loading dnsseed.dat...");
         CAutoFile cf(f, SER_DISK, CLIENT_VERSION);
         cf >> db;
-        if (opts.fWipeBan) db.banned.clear();
+        if (opts.fWipeBan) db.ClearBanned();
         if (opts.fWipeIgnore) db.ResetIgnores();
         printf("done\n");
     }
@@ -545,15 +579,22 @@ int main(int argc, char **argv) {
     printf("Starting seeder...");
     pthread_create(&threadSeed, nullptr, ThreadSeeder, nullptr);
     printf("done\n");
-    printf("Starting %i crawler threads...", opts.nThreads);
-    pthread_attr_t attr_crawler;
-    pthread_attr_init(&attr_crawler);
-    pthread_attr_setstacksize(&attr_crawler, 0x20000);
+    // Every probe holds a socket; leave some descriptors for the rest.
+    static const int RESERVED_FDS = 64;
+    int nMaxProbes =
+        RaiseFileLimit(opts.nThreads * opts.nProbes + RESERVED_FDS) -
+        RESERVED_FDS;
+    if (nMaxProbes < opts.nThreads * opts.nProbes) {
+        opts.nProbes = std::max(1, nMaxProbes / opts.nThreads);
+        printf("File descriptor limit allows %i probes per crawler.\n",
+               opts.nProbes);
+    }
+    printf("Starting %i crawler threads testing %i nodes each...",
+           opts.nThreads, opts.nProbes);
     for (int i = 0; i < opts.nThreads; i++) {
         pthread_t thread;
-        pthread_create(&thread, &attr_crawler, ThreadCrawler, &opts.nThreads);
+        pthread_create(&thread, nullptr, ThreadCrawler, &opts);
     }
-    pthread_attr_destroy(&attr_crawler);
     printf("done\n");
     pthread_create(&threadStats, nullptr, ThreadStats, nullptr);
     pthread_create(&threadDump, nullptr, ThreadDumper, nullptr);
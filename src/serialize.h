@@ -605,7 +605,7 @@ void Unserialize_impl(Stream &is, prevector<N, T> &v, const uint8_t &) {
     while (i < nSize) {
         unsigned int blk =
             std::min(nSize - i, (unsigned int)(1 + 4999999 / sizeof(T)));
-        v.resize(i + blk);
+        v.resize_uninitialized(i + blk);
         is.read((char *)&v[i], blk * sizeof(T));
         i += blk;
     }
@@ -891,4 +891,11 @@ size_t GetSerializeSize(const S &s, const T &t) {
     return (CSizeComputer(s.GetType(), s.GetVersion()) << t).size();
 }
 
+template <typename... T>
+size_t GetSerializeSizeMany(int nType, int nVersion, const T &... t) {
+    CSizeComputer sc(nType, nVersion);
+    ::SerializeMany(sc, t...);
+    return sc.size();
+}
+
 #endif // BITCOIN_SERIALIZE_H
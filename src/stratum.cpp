@@ -0,0 +1,659 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "stratum.h"
+
+#include "arith_uint256.h"
+#include "chain.h"
+#include "ethashcache.h"
+#include "miner.h"
+#include "netbase.h"
+#include "script/script.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "validation.h"
+#include "validationinterface.h"
+
+#include "ethash/ethash.h"
+#include "ethash/internal.h"
+
+#include <univalue.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+
+#include <boost/thread.hpp>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+
+bool ParseStratumNonce(const std::string &strNonce, uint16_t nExtranonce,
+                       uint64_t &nNonce) {
+    std::string strHex = strNonce;
+    if (strHex.size() > 2 && strHex[0] == '0' &&
+        (strHex[1] == 'x' || strHex[1] == 'X')) {
+        strHex = strHex.substr(2);
+    }
+    const size_t nPrefixDigits = 2 * STRATUM_EXTRANONCE_SIZE;
+    if ((strHex.size() != 16 && strHex.size() != 16 - nPrefixDigits) ||
+        !IsHex(strHex)) {
+        return false;
+    }
+
+    std::vector<uint8_t> vch = ParseHex(strHex);
+    uint64_t n = 0;
+    for (uint8_t ch : vch) {
+        n = (n << 8) | ch;
+    }
+    const unsigned int nShift = 64 - 8 * STRATUM_EXTRANONCE_SIZE;
+    if (vch.size() == 8) {
+        // The client sent the whole nonce, it has to be in its own range.
+        if ((n >> nShift) != nExtranonce) {
+            return false;
+        }
+        nNonce = n;
+    } else {
+        nNonce = (uint64_t(nExtranonce) << nShift) | n;
+    }
+    return true;
+}
+
+double GetStratumDifficulty(uint32_t nBits) {
+    arith_uint256 target;
+    target.SetCompact(nBits);
+    if (target == 0) {
+        return 0;
+    }
+    const arith_uint256 diff1 = arith_uint256(0xffff) << 208;
+    return diff1.getdouble() / target.getdouble();
+}
+
+arith_uint256 GetStratumTarget(double dDifficulty) {
+    // diff1 / dDifficulty, as a 32-bit fraction and a power of two.
+    int nExp;
+    const double dFrac = std::frexp(1 / dDifficulty, &nExp);
+    arith_uint256 target = arith_uint256(0xffff) << (208 - 32);
+    target *= uint32_t(std::ldexp(dFrac, 32));
+    if (nExp < 0) {
+        return target >> -nExp;
+    }
+    if (target.bits() + nExp > 256) {
+        return ~arith_uint256();
+    }
+    return target << nExp;
+}
+
+double GetNextShareDifficulty(double dDifficulty, uint64_t nShares,
+                              int64_t nElapsed, int64_t nInterval) {
+    const double dFactor =
+        double(nShares) * nInterval / std::max<int64_t>(nElapsed, 1);
+    return dDifficulty * std::min(std::max(dFactor, 0.25), 4.0);
+}
+
+namespace {
+
+/** Stratum error codes, as used by the common pool implementations */
+enum StratumError {
+    STRATUM_ERR_OTHER = 20,
+    STRATUM_ERR_JOB_NOT_FOUND = 21,
+    STRATUM_ERR_DUPLICATE_SHARE = 22,
+    STRATUM_ERR_LOW_DIFFICULTY = 23,
+    STRATUM_ERR_UNAUTHORIZED = 24,
+    STRATUM_ERR_NOT_SUBSCRIBED = 25,
+};
+
+struct StratumJob {
+    ethash_h256_t blockEthash;
+    ethash_h256_t boundary;
+    uint32_t nBlockHeight;
+    uint32_t nBits;
+    //! Nonces submitted for the job, up to MAX_WORK_SHARES
+    std::set<uint64_t> setNonces;
+};
+
+struct StratumClient {
+    std::string strAddr;
+    uint16_t nExtranonce;
+    bool fSubscribed;
+    bool fAuthorized;
+    std::string strWorker;
+    //! Share difficulty, 0 until the first job, never above the block's
+    double dDifficulty;
+    //! Shares since the difficulty was last retargeted, and when that was
+    uint64_t nRetargetShares;
+    int64_t nRetargetTime;
+    //! For pool accounting: shares taken and turned down, and the sum of the
+    //! difficulties of those taken
+    uint64_t nShares;
+    uint64_t nRejectedShares;
+    double dShareWork;
+};
+
+/** Forwards new tips to the event loop of the Stratum server */
+class CStratumNotifier : public CValidationInterface {
+public:
+    explicit CStratumNotifier(struct event *evIn) : ev(evIn) {}
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew,
+                         const CBlockIndex *pindexFork,
+                         bool fInitialDownload) override {
+        if (!fInitialDownload) {
+            event_active(ev, 0, 0);
+        }
+    }
+
+private:
+    struct event *ev;
+};
+
+/**
+ * All state below is only touched from the event loop thread, the only
+ * thing other threads do is activate evNewJob.
+ */
+class CStratumServer {
+public:
+    explicit CStratumServer(struct event_base *baseIn)
+        : base(baseIn), listener(nullptr),
+          evNewJob(nullptr), nMaxClients(DEFAULT_STRATUM_MAX_CLIENTS),
+          nShareInterval(DEFAULT_STRATUM_SHARE_INTERVAL), nNextExtranonce(0),
+          nNextJobId(0) {}
+
+    ~CStratumServer() {
+        if (notifier) {
+            UnregisterValidationInterface(notifier.get());
+        }
+        for (auto &it : mapClients) {
+            bufferevent_free(it.first);
+        }
+        if (listener) {
+            evconnlistener_free(listener);
+        }
+        if (evNewJob) {
+            event_free(evNewJob);
+        }
+    }
+
+    bool Start() {
+        nMaxClients = std::max<int64_t>(
+            GetArg("-stratummaxclients", DEFAULT_STRATUM_MAX_CLIENTS), 1);
+        nShareInterval = std::max<int64_t>(
+            GetArg("-stratumshareinterval", DEFAULT_STRATUM_SHARE_INTERVAL),
+            0);
+
+        int port = GetArg("-stratumport", DEFAULT_STRATUM_PORT);
+        std::string strBind = GetArg("-stratumbind", "0.0.0.0");
+        CService addrBind;
+        if (!Lookup(strBind.c_str(), addrBind, port, false)) {
+            return error("stratum: cannot resolve -stratumbind address: '%s'",
+                         strBind);
+        }
+        struct sockaddr_storage sockaddr;
+        socklen_t len = sizeof(sockaddr);
+        if (!addrBind.GetSockAddr((struct sockaddr *)&sockaddr, &len)) {
+            return error("stratum: bind address family for %s not supported",
+                         addrBind.ToString());
+        }
+        listener = evconnlistener_new_bind(
+            base, &CStratumServer::AcceptCallback, this,
+            LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, -1,
+            (struct sockaddr *)&sockaddr, len);
+        if (!listener) {
+            return error("stratum: unable to bind to %s",
+                         addrBind.ToString());
+        }
+
+        evNewJob =
+            event_new(base, -1, 0, &CStratumServer::NewJobCallback, this);
+        notifier.reset(new CStratumNotifier(evNewJob));
+        RegisterValidationInterface(notifier.get());
+
+        LogPrintf("Stratum server listening on %s\n", addrBind.ToString());
+        return true;
+    }
+
+    void Interrupt() {
+        if (listener) {
+            evconnlistener_disable(listener);
+        }
+    }
+
+private:
+    struct event_base *base;
+    struct evconnlistener *listener;
+    struct event *evNewJob;
+    std::unique_ptr<CStratumNotifier> notifier;
+    size_t nMaxClients;
+    //! Seconds between the shares of a client aimed for, 0 for blocks only
+    int64_t nShareInterval;
+
+    std::map<struct bufferevent *, StratumClient> mapClients;
+    uint16_t nNextExtranonce;
+
+    //! Recent jobs by id, so late solutions for them are still accepted
+    std::map<std::string, StratumJob> mapJobs;
+    std::deque<std::string> dequeJobs;
+    std::string strCurrentJob;
+    uint32_t nNextJobId;
+
+    static void AcceptCallback(struct evconnlistener *, evutil_socket_t fd,
+                               struct sockaddr *addr, int socklen,
+                               void *ctx) {
+        static_cast<CStratumServer *>(ctx)->Accept(fd, addr, socklen);
+    }
+
+    static void ReadCallback(struct bufferevent *bev, void *ctx) {
+        static_cast<CStratumServer *>(ctx)->Read(bev);
+    }
+
+    static void EventCallback(struct bufferevent *bev, short what,
+                              void *ctx) {
+        if (what & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
+            static_cast<CStratumServer *>(ctx)->Disconnect(bev);
+        }
+    }
+
+    static void NewJobCallback(evutil_socket_t, short, void *ctx) {
+        static_cast<CStratumServer *>(ctx)->UpdateJob();
+    }
+
+    void Accept(evutil_socket_t fd, struct sockaddr *addr, int socklen) {
+        CService service;
+        service.SetSockAddr(addr);
+        if (mapClients.size() >= nMaxClients) {
+            LogPrint("stratum", "stratum: too many clients, dropping %s\n",
+                     service.ToString());
+            evutil_closesocket(fd);
+            return;
+        }
+
+        struct bufferevent *bev =
+            bufferevent_socket_new(base, fd, BEV_OPT_CLOSE_ON_FREE);
+        if (!bev) {
+            evutil_closesocket(fd);
+            return;
+        }
+        // Value-initialized, the rest of the client starts out zero.
+        mapClients[bev].strAddr = service.ToString();
+        bufferevent_setcb(bev, &CStratumServer::ReadCallback, nullptr,
+                          &CStratumServer::EventCallback, this);
+        bufferevent_enable(bev, EV_READ | EV_WRITE);
+        LogPrint("stratum", "stratum: new client %s\n", service.ToString());
+    }
+
+    void Disconnect(struct bufferevent *bev) {
+        auto it = mapClients.find(bev);
+        if (it != mapClients.end()) {
+            const StratumClient &client = it->second;
+            LogPrint("stratum", "stratum: client %s (%s) disconnected after "
+                                "%u shares, %u rejected, work %g\n",
+                     client.strAddr, client.strWorker, client.nShares,
+                     client.nRejectedShares, client.dShareWork);
+            mapClients.erase(it);
+        }
+        bufferevent_free(bev);
+    }
+
+    void Read(struct bufferevent *bev) {
+        struct evbuffer *input = bufferevent_get_input(bev);
+        size_t nRead = 0;
+        char *line;
+        while ((line = evbuffer_readln(input, &nRead, EVBUFFER_EOL_CRLF)) !=
+               nullptr) {
+            std::string strLine(line, nRead);
+            free(line);
+            if (!strLine.empty() && !HandleLine(bev, strLine)) {
+                Disconnect(bev);
+                return;
+            }
+        }
+        // Whatever is left is an incomplete line, don't let it grow forever.
+        if (evbuffer_get_length(input) > MAX_STRATUM_LINE_LENGTH) {
+            Disconnect(bev);
+        }
+    }
+
+    void Send(struct bufferevent *bev, const UniValue &msg) {
+        std::string str = msg.write() + "\n";
+        bufferevent_write(bev, str.data(), str.size());
+    }
+
+    void Reply(struct bufferevent *bev, const UniValue &id,
+               const UniValue &result) {
+        UniValue reply(UniValue::VOBJ);
+        reply.push_back(Pair("id", id));
+        reply.push_back(Pair("result", result));
+        reply.push_back(Pair("error", NullUniValue));
+        Send(bev, reply);
+    }
+
+    void ReplyError(struct bufferevent *bev, const UniValue &id, int code,
+                    const std::string &strMessage) {
+        UniValue error(UniValue::VARR);
+        error.push_back(code);
+        error.push_back(strMessage);
+        error.push_back(NullUniValue);
+        UniValue reply(UniValue::VOBJ);
+        reply.push_back(Pair("id", id));
+        reply.push_back(Pair("result", NullUniValue));
+        reply.push_back(Pair("error", error));
+        Send(bev, reply);
+    }
+
+    void Notify(struct bufferevent *bev, const std::string &strMethod,
+                const UniValue &params) {
+        UniValue msg(UniValue::VOBJ);
+        msg.push_back(Pair("id", NullUniValue));
+        msg.push_back(Pair("method", strMethod));
+        msg.push_back(Pair("params", params));
+        Send(bev, msg);
+    }
+
+    /**
+     * Retarget the share difficulty of client once there is enough to go on,
+     * keeping it between STRATUM_MIN_SHARE_DIFFICULTY and the difficulty of
+     * the block of job.
+     */
+    void RetargetShares(StratumClient &client, const StratumJob &job) {
+        const double dBlockDifficulty = GetStratumDifficulty(job.nBits);
+        const int64_t nNow = GetTime();
+        if (nShareInterval == 0 || client.dDifficulty == 0) {
+            // Start from the block difficulty, or stay there.
+            client.dDifficulty = dBlockDifficulty;
+            client.nRetargetShares = 0;
+            client.nRetargetTime = nNow;
+            return;
+        }
+
+        const int64_t nElapsed = nNow - client.nRetargetTime;
+        if (nElapsed >= nShareInterval ||
+            client.nRetargetShares >= STRATUM_RETARGET_SHARES) {
+            client.dDifficulty =
+                GetNextShareDifficulty(client.dDifficulty,
+                                       client.nRetargetShares, nElapsed,
+                                       nShareInterval);
+            client.nRetargetShares = 0;
+            client.nRetargetTime = nNow;
+        }
+        client.dDifficulty =
+            std::max(std::min(client.dDifficulty, dBlockDifficulty),
+                     std::min(STRATUM_MIN_SHARE_DIFFICULTY, dBlockDifficulty));
+    }
+
+    void SendJob(struct bufferevent *bev) {
+        auto it = mapJobs.find(strCurrentJob);
+        if (it == mapJobs.end()) {
+            return;
+        }
+        const StratumJob &job = it->second;
+        StratumClient &client = mapClients.at(bev);
+        RetargetShares(client, job);
+
+        UniValue difficulty(UniValue::VARR);
+        difficulty.push_back(client.dDifficulty);
+        Notify(bev, "mining.set_difficulty", difficulty);
+
+        UniValue params(UniValue::VARR);
+        params.push_back(strCurrentJob);
+        params.push_back(
+            ethash_h256_encode(ethash_get_seedhash(job.nBlockHeight)));
+        params.push_back(ethash_h256_encode(job.blockEthash));
+        // Every job is for a new tip, older jobs are useless.
+        params.push_back(true);
+        Notify(bev, "mining.notify", params);
+    }
+
+    /** Fetch the current template from the MineWorker and push it */
+    void UpdateJob() {
+        if (!mineworker) {
+            return;
+        }
+
+        std::shared_ptr<CReserveScript> coinbaseScript;
+        GetMainSignals().ScriptForMining(coinbaseScript);
+        if (!coinbaseScript || coinbaseScript->reserveScript.empty()) {
+            LogPrintf("stratum: no coinbase script available, not sending "
+                      "jobs\n");
+            return;
+        }
+
+        std::shared_ptr<Work> pwork;
+        try {
+            pwork = mineworker->GetLastNewWork(coinbaseScript, true, true);
+        } catch (...) {
+            LogPrintf("stratum: failed to create a block template\n");
+            return;
+        }
+        if (!pwork) {
+            return;
+        }
+
+        auto it = mapJobs.find(strCurrentJob);
+        if (it != mapJobs.end() &&
+            EthashEquals(it->second.blockEthash, pwork->blockEthash)) {
+            return;
+        }
+
+        strCurrentJob = strprintf("%x", ++nNextJobId);
+        mapJobs[strCurrentJob] = StratumJob{
+            pwork->blockEthash, pwork->boundary, pwork->block.nBlockHeight,
+            pwork->block.nBits, std::set<uint64_t>()};
+        dequeJobs.push_back(strCurrentJob);
+        while (dequeJobs.size() > DEFAULT_MAX_RETAINED_WORK) {
+            mapJobs.erase(dequeJobs.front());
+            dequeJobs.pop_front();
+        }
+
+        LogPrint("stratum", "stratum: new job %s for height %u\n",
+                 strCurrentJob, pwork->block.nBlockHeight);
+        for (auto &client : mapClients) {
+            if (client.second.fAuthorized) {
+                SendJob(client.first);
+            }
+        }
+    }
+
+    /** Returns false if the client should be disconnected */
+    bool HandleLine(struct bufferevent *bev, const std::string &strLine) {
+        StratumClient &client = mapClients.at(bev);
+
+        UniValue request;
+        if (!request.read(strLine) || !request.isObject()) {
+            LogPrint("stratum", "stratum: malformed request from %s\n",
+                     client.strAddr);
+            return false;
+        }
+        const UniValue &id = find_value(request, "id");
+        const UniValue &method = find_value(request, "method");
+        const UniValue &params = find_value(request, "params");
+        if (!method.isStr()) {
+            return false;
+        }
+        const std::string &strMethod = method.get_str();
+
+        if (strMethod == "mining.subscribe") {
+            if (!client.fSubscribed) {
+                client.fSubscribed = true;
+                client.nExtranonce = nNextExtranonce++;
+            }
+            const std::string strExtranonce =
+                strprintf("%04x", client.nExtranonce);
+            UniValue subscription(UniValue::VARR);
+            subscription.push_back("mining.notify");
+            subscription.push_back(strExtranonce);
+            subscription.push_back("EthereumStratum/1.0.0");
+            UniValue result(UniValue::VARR);
+            result.push_back(subscription);
+            result.push_back(strExtranonce);
+            Reply(bev, id, result);
+        } else if (strMethod == "mining.extranonce.subscribe") {
+            Reply(bev, id, true);
+        } else if (strMethod == "mining.authorize") {
+            if (!client.fSubscribed) {
+                ReplyError(bev, id, STRATUM_ERR_NOT_SUBSCRIBED,
+                           "Not subscribed");
+                return true;
+            }
+            client.fAuthorized = true;
+            if (params.isArray() && params.size() > 0 && params[0].isStr()) {
+                client.strWorker = params[0].get_str();
+            }
+            Reply(bev, id, true);
+            if (strCurrentJob.empty()) {
+                UpdateJob();
+            } else {
+                SendJob(bev);
+            }
+        } else if (strMethod == "mining.submit") {
+            HandleSubmit(bev, client, id, params);
+        } else {
+            ReplyError(bev, id, STRATUM_ERR_OTHER, "Method not found");
+        }
+        return true;
+    }
+
+    void HandleSubmit(struct bufferevent *bev, StratumClient &client,
+                      const UniValue &id, const UniValue &params) {
+        if (!client.fAuthorized) {
+            ReplyError(bev, id, STRATUM_ERR_UNAUTHORIZED, "Unauthorized worker");
+            return;
+        }
+        // [worker, job id, nonce]
+        if (!params.isArray() || params.size() < 3 || !params[1].isStr() ||
+            !params[2].isStr()) {
+            ReplyError(bev, id, STRATUM_ERR_OTHER, "Invalid parameters");
+            return;
+        }
+        auto it = mapJobs.find(params[1].get_str());
+        if (it == mapJobs.end()) {
+            ReplyError(bev, id, STRATUM_ERR_JOB_NOT_FOUND, "Job not found");
+            return;
+        }
+        StratumJob &job = it->second;
+        // Older jobs are kept for solutions that crossed a new job on the
+        // way, but shares for them don't count.
+        if (job.nBlockHeight < mapJobs.at(strCurrentJob).nBlockHeight) {
+            client.nRejectedShares++;
+            ReplyError(bev, id, STRATUM_ERR_JOB_NOT_FOUND, "Stale share");
+            return;
+        }
+        uint64_t nNonce;
+        if (!ParseStratumNonce(params[2].get_str(), client.nExtranonce,
+                               nNonce)) {
+            ReplyError(bev, id, STRATUM_ERR_OTHER, "Invalid nonce");
+            return;
+        }
+        if (job.setNonces.count(nNonce)) {
+            client.nRejectedShares++;
+            ReplyError(bev, id, STRATUM_ERR_DUPLICATE_SHARE,
+                       "Duplicate share");
+            return;
+        }
+        if (job.setNonces.size() < MAX_WORK_SHARES) {
+            job.setNonces.insert(nNonce);
+        }
+
+        // Clients don't send the mix hash, recompute it with the light cache.
+        EthashLightRef light = EthashLightCache().Get(job.nBlockHeight);
+        if (!light) {
+            ReplyError(bev, id, STRATUM_ERR_OTHER, "Internal error");
+            return;
+        }
+        ethash_return_value_t ret =
+            ethash_light_compute(light.get(), job.blockEthash, nNonce);
+        const double dDifficulty = client.dDifficulty > 0
+                                       ? client.dDifficulty
+                                       : GetStratumDifficulty(job.nBits);
+        const ethash_h256_t shareBoundary =
+            GetStratumTarget(dDifficulty).ToEthashH256();
+        if (!ret.success ||
+            !ethash_check_difficulty(&ret.result, &shareBoundary)) {
+            client.nRejectedShares++;
+            ReplyError(bev, id, STRATUM_ERR_LOW_DIFFICULTY,
+                       "Low difficulty share");
+            return;
+        }
+        client.nShares++;
+        client.dShareWork += dDifficulty;
+        client.nRetargetShares++;
+        LogPrint("stratum", "stratum: share at difficulty %g for job %s from "
+                            "%s (%s)\n",
+                 dDifficulty, it->first, client.strWorker, client.strAddr);
+        if (client.nRetargetShares >= STRATUM_RETARGET_SHARES) {
+            // Coming in too fast, the new difficulty goes with the job.
+            SendJob(bev);
+        }
+        if (!ethash_check_difficulty(&ret.result, &job.boundary)) {
+            Reply(bev, id, true);
+            return;
+        }
+
+        LogPrintf("stratum: solution for job %s from %s (%s)\n",
+                  it->first, client.strWorker, client.strAddr);
+        if (!mineworker->SubmitWork(job.blockEthash, nNonce, ret.mix_hash)) {
+            ReplyError(bev, id, STRATUM_ERR_OTHER, "Block rejected");
+            return;
+        }
+        Reply(bev, id, true);
+    }
+};
+
+static struct event_base *stratumBase = nullptr;
+static std::unique_ptr<CStratumServer> stratumServer;
+static boost::thread stratumThread;
+
+static void StratumThread() {
+    event_base_dispatch(stratumBase);
+}
+}
+
+bool StartStratumServer() {
+    assert(!stratumBase);
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+    stratumBase = event_base_new();
+    if (!stratumBase) {
+        return error("stratum: unable to create event_base");
+    }
+
+    stratumServer.reset(new CStratumServer(stratumBase));
+    if (!stratumServer->Start()) {
+        stratumServer.reset();
+        event_base_free(stratumBase);
+        stratumBase = nullptr;
+        return false;
+    }
+
+    stratumThread = boost::thread(boost::bind(
+        &TraceThread<void (*)()>, "stratum", &StratumThread));
+    return true;
+}
+
+void InterruptStratumServer() {
+    if (stratumBase) {
+        LogPrintf("stratum: Thread interrupt\n");
+        stratumServer->Interrupt();
+        event_base_loopbreak(stratumBase);
+    }
+}
+
+void StopStratumServer() {
+    if (stratumBase) {
+        stratumThread.join();
+        stratumServer.reset();
+        event_base_free(stratumBase);
+        stratumBase = nullptr;
+    }
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/**
+ * Built-in Stratum (EthereumStratum/1.0.0) server, so mining rigs and pool
+ * proxies get new jobs pushed to them instead of polling eth_getWork.
+ */
+#ifndef BITCOIN_STRATUM_H
+#define BITCOIN_STRATUM_H
+
+#include <cstdint>
+#include <string>
+
+/** Default for -stratum */
+static const bool DEFAULT_STRATUM_ENABLE = false;
+/** Default for -stratumport */
+static const int DEFAULT_STRATUM_PORT = 3333;
+/** Default for -stratummaxclients */
+static const unsigned int DEFAULT_STRATUM_MAX_CLIENTS = 1024;
+/** Maximum length of a single request line, longer ones drop the client */
+static const size_t MAX_STRATUM_LINE_LENGTH = 4096;
+/** Bytes of nonce prefix assigned to each subscribed client */
+static const unsigned int STRATUM_EXTRANONCE_SIZE = 2;
+/** Default for -stratumshareinterval, in seconds */
+static const int64_t DEFAULT_STRATUM_SHARE_INTERVAL = 10;
+/** Shares after which a client's difficulty is retargeted early */
+static const uint64_t STRATUM_RETARGET_SHARES = 30;
+/** Lowest share difficulty handed to a client */
+static const double STRATUM_MIN_SHARE_DIFFICULTY = 1.0 / (1 << 20);
+
+class arith_uint256;
+
+/** Start listening for Stratum clients, from -stratumbind and -stratumport */
+bool StartStratumServer();
+/** Stop accepting requests */
+void InterruptStratumServer();
+/** Disconnect all clients and free the server */
+void StopStratumServer();
+
+/**
+ * Build the full 64-bit nonce from a mining.submit nonce. Clients either send
+ * the full 16 hex digits, which must start with their extranonce, or only the
+ * remaining digits after it.
+ */
+bool ParseStratumNonce(const std::string &strNonce, uint16_t nExtranonce,
+                       uint64_t &nNonce);
+
+/**
+ * Stratum difficulty of a compact target, relative to the usual difficulty 1
+ * target of 0x00000000ffff0000...
+ */
+double GetStratumDifficulty(uint32_t nBits);
+
+/** The target of a Stratum difficulty, the highest one if it is too low */
+arith_uint256 GetStratumTarget(double dDifficulty);
+
+/**
+ * The next share difficulty of a client that found nShares shares at
+ * dDifficulty in nElapsed seconds, for one share every nInterval seconds. It
+ * moves by a factor of 4 at most at a time.
+ */
+double GetNextShareDifficulty(double dDifficulty, uint64_t nShares,
+                              int64_t nElapsed, int64_t nInterval);
+
+#endif // BITCOIN_STRATUM_H
@@ -120,6 +120,43 @@ private:
     size_t nPos;
 };
 
+/**
+ * XOR nSize bytes at p with key, repeated. Keys whose size divides 8, such as
+ * the 8 byte database obfuscation keys, are applied a 64 bit word at a time,
+ * in a loop compilers can vectorize; the others a byte at a time.
+ */
+inline void XorWithKey(uint8_t *p, size_t nSize, const uint8_t *key,
+                       size_t nKeySize) {
+    if (nKeySize == 0) {
+        return;
+    }
+
+    size_t i = 0;
+    if (8 % nKeySize == 0) {
+        uint8_t keyWord[8];
+        for (size_t j = 0; j < 8; j++) {
+            keyWord[j] = key[j % nKeySize];
+        }
+        uint64_t nKeyWord;
+        memcpy(&nKeyWord, keyWord, 8);
+        // memcpy as the data needn't be aligned, it compiles to plain loads
+        // and stores.
+        for (; i + 8 <= nSize; i += 8) {
+            uint64_t nWord;
+            memcpy(&nWord, p + i, 8);
+            nWord ^= nKeyWord;
+            memcpy(p + i, &nWord, 8);
+        }
+    }
+
+    // The tail, which starts at a multiple of the key size after the words.
+    for (size_t j = 0; i < nSize; i++) {
+        p[i] ^= key[j++];
+        // Not a %, which would be a division per byte.
+        if (j == nKeySize) j = 0;
+    }
+}
+
 /**
  * Double ended buffer combining vector and stream-like interfaces.
  *
@@ -305,6 +342,15 @@ public:
         return true;
     }
 
+    /**
+     * Exchange the underlying buffer with vchOther, so its allocation can be
+     * reused. Reading starts over at the beginning of the new contents.
+     */
+    void SwapData(vector_type &vchOther) {
+        vch.swap(vchOther);
+        nReadPos = 0;
+    }
+
     //
     // Stream subset
     //
@@ -393,15 +439,55 @@ public:
             return;
         }
 
-        for (size_type i = 0, j = 0; i != size(); i++) {
-            vch[i] ^= key[j++];
+        XorWithKey(reinterpret_cast<uint8_t *>(vch.data()), size(), key.data(),
+                   key.size());
+    }
+};
 
-            // This potentially acts on very many bytes of data, so it's
-            // important that we calculate `j`, i.e. the `key` index in this way
-            // instead of doing a %, which would effectively be a division for
-            // each byte Xor'd -- much slower than need be.
-            if (j == key.size()) j = 0;
+/**
+ * Deserialize straight out of memory owned by someone else, such as a mapped
+ * file. The caller keeps [pbegin, pend) alive while the reader is in use.
+ */
+class CSpanReader {
+private:
+    const int nType;
+    const int nVersion;
+
+    const uint8_t *pcur;
+    const uint8_t *const pend;
+
+public:
+    CSpanReader(int nTypeIn, int nVersionIn, const uint8_t *pbeginIn,
+                const uint8_t *pendIn)
+        : nType(nTypeIn), nVersion(nVersionIn), pcur(pbeginIn), pend(pendIn) {}
+
+    int GetType() const { return nType; }
+    int GetVersion() const { return nVersion; }
+
+    size_t size() const { return pend - pcur; }
+    bool empty() const { return pcur == pend; }
+    //! Where the next read starts
+    const uint8_t *data() const { return pcur; }
+
+    void read(char *pch, size_t nSize) {
+        if (nSize > size()) {
+            throw std::ios_base::failure("CSpanReader::read: end of data");
+        }
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+    }
+
+    void ignore(size_t nSize) {
+        if (nSize > size()) {
+            throw std::ios_base::failure("CSpanReader::ignore: end of data");
         }
+        pcur += nSize;
+    }
+
+    template <typename T> CSpanReader &operator>>(T &obj) {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
     }
 };
 
@@ -0,0 +1,173 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_ARENA_H
+#define BITCOIN_SUPPORT_ALLOCATORS_ARENA_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Memory for objects that all die together, like those made while connecting
+ * a block.
+ *
+ * Allocations are bumped off the current chunk and never given back one by
+ * one; Release() frees them all at once. The memory is kept for the next round
+ * in a single chunk, grown to what the last round took, so that once a round
+ * fits, allocating from the arena never calls ::operator new. Unlike Arena in
+ * lockedpool.h it isn't locked memory, and it doesn't track allocations.
+ */
+class MonotonicArena {
+    std::vector<void *> vChunks;
+    size_t nChunkSizeBytes;
+    //! Bytes of all the chunks
+    size_t nTotalBytes;
+
+    //! Unused part of the newest chunk
+    uintptr_t nAvailable;
+    uintptr_t nAvailableEnd;
+
+    static uintptr_t AlignUp(uintptr_t n, size_t nAlignment) {
+        return (n + nAlignment - 1) & ~uintptr_t(nAlignment - 1);
+    }
+
+    void AllocateChunk(size_t nBytes) {
+        void *p = ::operator new(nBytes);
+        vChunks.push_back(p);
+        nTotalBytes += nBytes;
+        nAvailable = reinterpret_cast<uintptr_t>(p);
+        nAvailableEnd = nAvailable + nBytes;
+    }
+
+    void FreeChunks() {
+        for (void *p : vChunks) {
+            ::operator delete(p);
+        }
+        vChunks.clear();
+        nTotalBytes = 0;
+        nAvailable = nAvailableEnd = 0;
+    }
+
+public:
+    explicit MonotonicArena(size_t nChunkSizeBytesIn = 256 * 1024)
+        : nChunkSizeBytes(nChunkSizeBytesIn), nTotalBytes(0), nAvailable(0),
+          nAvailableEnd(0) {}
+
+    MonotonicArena(const MonotonicArena &) = delete;
+    MonotonicArena &operator=(const MonotonicArena &) = delete;
+
+    ~MonotonicArena() { FreeChunks(); }
+
+    void *Allocate(size_t nBytes, size_t nAlignment) {
+        assert((nAlignment & (nAlignment - 1)) == 0 &&
+               nAlignment <= alignof(std::max_align_t));
+        uintptr_t p = AlignUp(nAvailable, nAlignment);
+        if (nAvailable == 0 || p > nAvailableEnd ||
+            nBytes > nAvailableEnd - p) {
+            AllocateChunk(std::max(nChunkSizeBytes, nBytes));
+            p = nAvailable;
+        }
+        nAvailable = p + nBytes;
+        return reinterpret_cast<void *>(p);
+    }
+
+    void Deallocate(void *p, size_t nBytes, size_t nAlignment) {}
+
+    /**
+     * Free everything allocated so far. What the arena took is kept as one
+     * chunk, so the next round doesn't need more.
+     */
+    void Release() {
+        if (vChunks.size() > 1) {
+            nChunkSizeBytes = nTotalBytes;
+            FreeChunks();
+            AllocateChunk(nChunkSizeBytes);
+            return;
+        }
+        if (!vChunks.empty()) {
+            nAvailable = reinterpret_cast<uintptr_t>(vChunks[0]);
+        }
+    }
+
+    size_t NumChunks() const { return vChunks.size(); }
+    size_t ChunkSizeBytes() const { return nChunkSizeBytes; }
+    //! Bytes of the chunks, used or not
+    size_t TotalBytes() const { return nTotalBytes; }
+
+    /** Release()s the arena when it goes out of scope */
+    class Scope {
+    public:
+        explicit Scope(MonotonicArena &arenaIn) : arena(arenaIn) {}
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+        ~Scope() { arena.Release(); }
+
+    private:
+        MonotonicArena &arena;
+    };
+};
+
+/**
+ * Allocator drawing from a MonotonicArena. A default constructed one has no
+ * arena and uses ::operator new for everything.
+ */
+template <typename T> class ArenaAllocator {
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    template <typename U> struct rebind { typedef ArenaAllocator<U> other; };
+
+    ArenaAllocator() noexcept : pArena(nullptr) {}
+    explicit ArenaAllocator(MonotonicArena *pArenaIn) noexcept
+        : pArena(pArenaIn) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) noexcept
+        : pArena(other.arena()) {}
+
+    T *allocate(size_t n) {
+        if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        if (pArena == nullptr) {
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T *>(pArena->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, size_t n) noexcept {
+        if (pArena == nullptr) {
+            ::operator delete(p);
+            return;
+        }
+        pArena->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    MonotonicArena *arena() const noexcept { return pArena; }
+
+private:
+    MonotonicArena *pArena;
+};
+
+template <typename T1, typename T2>
+bool operator==(const ArenaAllocator<T1> &a,
+                const ArenaAllocator<T2> &b) noexcept {
+    return a.arena() == b.arena();
+}
+
+template <typename T1, typename T2>
+bool operator!=(const ArenaAllocator<T1> &a,
+                const ArenaAllocator<T2> &b) noexcept {
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_ARENA_H
@@ -0,0 +1,203 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Memory for many small allocations of a few sizes, like the nodes of a
+ * node-based container.
+ *
+ * Allocations of up to MAX_BLOCK_SIZE_BYTES are carved out of large chunks,
+ * and kept in a free list per size once deallocated. The chunks are only given
+ * back when the pool is destroyed. Larger allocations use ::operator new.
+ */
+template <size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES> class PoolResource {
+    struct ListNode {
+        ListNode *pNext;
+    };
+
+    static const size_t ELEM_ALIGN_BYTES =
+        ALIGN_BYTES > alignof(ListNode) ? ALIGN_BYTES : alignof(ListNode);
+    static_assert((ELEM_ALIGN_BYTES & (ELEM_ALIGN_BYTES - 1)) == 0,
+                  "ELEM_ALIGN_BYTES must be a power of two");
+    static_assert(ELEM_ALIGN_BYTES <= alignof(std::max_align_t),
+                  "chunks from ::operator new aren't aligned enough");
+    static_assert(sizeof(ListNode) <= ELEM_ALIGN_BYTES,
+                  "free list nodes must fit in the smallest block");
+
+    //! Blocks are multiples of ELEM_ALIGN_BYTES, vFreeLists[n] has n of them
+    ListNode *vFreeLists[MAX_BLOCK_SIZE_BYTES / ELEM_ALIGN_BYTES + 2];
+    std::vector<void *> vChunks;
+    const size_t nChunkSizeBytes;
+    //! Bytes sitting in the free lists
+    size_t nFreeBytes;
+
+    //! Unused part of the newest chunk
+    char *pAvailable;
+    char *pAvailableEnd;
+
+    static size_t NumElemAlignBytes(size_t nBytes) {
+        return (nBytes + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES +
+               (nBytes == 0);
+    }
+
+    static bool IsFreeListUsable(size_t nBytes, size_t nAlignment) {
+        return nAlignment <= ELEM_ALIGN_BYTES &&
+               nBytes <= MAX_BLOCK_SIZE_BYTES;
+    }
+
+    void PushFree(void *p, size_t nIndex) {
+        ListNode *node = new (p) ListNode;
+        node->pNext = vFreeLists[nIndex];
+        vFreeLists[nIndex] = node;
+        nFreeBytes += nIndex * ELEM_ALIGN_BYTES;
+    }
+
+    void AllocateChunk() {
+        // The rest of the current chunk is smaller than the block asked for,
+        // so keep it for smaller ones.
+        if (pAvailable != pAvailableEnd) {
+            PushFree(pAvailable, (pAvailableEnd - pAvailable) /
+                                     ELEM_ALIGN_BYTES);
+        }
+        void *p = ::operator new(nChunkSizeBytes);
+        vChunks.push_back(p);
+        pAvailable = static_cast<char *>(p);
+        pAvailableEnd = pAvailable + nChunkSizeBytes;
+    }
+
+public:
+    explicit PoolResource(size_t nChunkSizeBytesIn = 256 * 1024)
+        : nChunkSizeBytes(nChunkSizeBytesIn -
+                          nChunkSizeBytesIn % ELEM_ALIGN_BYTES),
+          nFreeBytes(0), pAvailable(nullptr), pAvailableEnd(nullptr) {
+        assert(nChunkSizeBytes >= MAX_BLOCK_SIZE_BYTES + ELEM_ALIGN_BYTES);
+        std::fill(std::begin(vFreeLists), std::end(vFreeLists), nullptr);
+    }
+
+    PoolResource(const PoolResource &) = delete;
+    PoolResource &operator=(const PoolResource &) = delete;
+
+    ~PoolResource() {
+        for (void *p : vChunks) {
+            ::operator delete(p);
+        }
+    }
+
+    void *Allocate(size_t nBytes, size_t nAlignment) {
+        if (!IsFreeListUsable(nBytes, nAlignment)) {
+            return ::operator new(nBytes);
+        }
+
+        const size_t nIndex = NumElemAlignBytes(nBytes);
+        if (vFreeLists[nIndex] != nullptr) {
+            ListNode *node = vFreeLists[nIndex];
+            vFreeLists[nIndex] = node->pNext;
+            nFreeBytes -= nIndex * ELEM_ALIGN_BYTES;
+            return node;
+        }
+
+        const size_t nBlockBytes = nIndex * ELEM_ALIGN_BYTES;
+        if (size_t(pAvailableEnd - pAvailable) < nBlockBytes) {
+            AllocateChunk();
+        }
+        void *p = pAvailable;
+        pAvailable += nBlockBytes;
+        return p;
+    }
+
+    void Deallocate(void *p, size_t nBytes, size_t nAlignment) {
+        if (!IsFreeListUsable(nBytes, nAlignment)) {
+            ::operator delete(p);
+            return;
+        }
+        PushFree(p, NumElemAlignBytes(nBytes));
+    }
+
+    size_t NumChunks() const { return vChunks.size(); }
+    size_t ChunkSizeBytes() const { return nChunkSizeBytes; }
+    //! Bytes of the chunks that can be handed out without growing the pool
+    size_t NumFreeBytes() const {
+        return nFreeBytes + (pAvailableEnd - pAvailable);
+    }
+};
+
+/**
+ * Allocator drawing from a PoolResource. A default constructed one has no
+ * resource and uses ::operator new for everything.
+ */
+template <typename T, size_t MAX_BLOCK_SIZE_BYTES,
+          size_t ALIGN_BYTES = alignof(T)>
+class PoolAllocator {
+public:
+    typedef T value_type;
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    template <typename U> struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    PoolAllocator() noexcept : pResource(nullptr) {}
+    explicit PoolAllocator(ResourceType *pResourceIn) noexcept
+        : pResource(pResourceIn) {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>
+                      &other) noexcept
+        : pResource(other.resource()) {}
+
+    T *allocate(size_t n) {
+        if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        if (pResource == nullptr) {
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T *>(
+            pResource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, size_t n) noexcept {
+        if (pResource == nullptr) {
+            ::operator delete(p);
+            return;
+        }
+        pResource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    ResourceType *resource() const noexcept { return pResource; }
+
+private:
+    ResourceType *pResource;
+};
+
+template <typename T1, typename T2, size_t MAX_BLOCK_SIZE_BYTES,
+          size_t ALIGN_BYTES>
+bool operator==(
+    const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> &a,
+    const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> &b) noexcept {
+    return a.resource() == b.resource();
+}
+
+template <typename T1, typename T2, size_t MAX_BLOCK_SIZE_BYTES,
+          size_t ALIGN_BYTES>
+bool operator!=(
+    const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> &a,
+    const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> &b) noexcept {
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
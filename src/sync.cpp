@@ -7,7 +7,10 @@
 #include "util.h"
 #include "utilstrencodings.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
+#include <mutex>
 
 #include <boost/thread.hpp>
 
@@ -18,6 +21,181 @@ void PrintLockContention(const char *pszName, const char *pszFile, int nLine) {
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+//! Not owned, the thread that sets it does.
+static boost::thread_specific_ptr<LockWaitTimes>
+    lockWaitTimes([](LockWaitTimes *) {});
+
+LockWaitTimes *SetLockWaitTimes(LockWaitTimes *times) {
+    LockWaitTimes *prev = lockWaitTimes.release();
+    lockWaitTimes.reset(times);
+    return prev;
+}
+
+int64_t LockWaitStart() {
+    return lockWaitTimes.get() ? GetTimeMicros() : 0;
+}
+
+void RecordLockWait(const char *pszName, int64_t nStart) {
+    LockWaitTimes *times = lockWaitTimes.get();
+    if (!times || nStart == 0) {
+        return;
+    }
+    const int64_t nMicros = GetTimeMicros() - nStart;
+    // By the name it is locked by, e.g. pwalletMain->cs_wallet.
+    if (strcmp(pszName, "cs_main") == 0) {
+        times->nMainMicros += nMicros;
+    } else if (strstr(pszName, "cs_wallet")) {
+        times->nWalletMicros += nMicros;
+    } else {
+        times->nOtherMicros += nMicros;
+    }
+}
+
+std::atomic<bool> fLockStats(false);
+
+/**
+ * Sites are found in a fixed table by hashing where they are, without taking
+ * a lock. Only adding one does, once.
+ */
+static const size_t LOCK_SITES = 2048;
+
+class CLockSite {
+public:
+    //! Set last, once the site is added
+    std::atomic<const char *> pszFile;
+    const char *pszName;
+    int nLine;
+
+    std::atomic<uint64_t> nAcquired;
+    std::atomic<uint64_t> nContended;
+    std::atomic<int64_t> nWaitMicros;
+    std::atomic<int64_t> nMaxWaitMicros;
+    std::atomic<int64_t> nHoldMicros;
+    std::atomic<int64_t> nMaxHoldMicros;
+    std::atomic<uint64_t> vWait[LOCK_STATS_BUCKETS];
+    std::atomic<uint64_t> vHold[LOCK_STATS_BUCKETS];
+};
+
+//! Zero initialized, as static storage
+static CLockSite lockSites[LOCK_SITES];
+static std::mutex csLockSites;
+
+static size_t LockSiteHash(const char *pszName, const char *pszFile,
+                           int nLine) {
+    uint64_t n = (uint64_t(uintptr_t(pszFile)) ^ uint64_t(nLine)) *
+                     0x9e3779b97f4a7c15ULL ^
+                 uint64_t(uintptr_t(pszName));
+    return (n * 0x9e3779b97f4a7c15ULL) >> 32;
+}
+
+//! Adding with fAdd, which requires csLockSites
+static CLockSite *FindLockSite(const char *pszName, const char *pszFile,
+                               int nLine, bool fAdd) {
+    const size_t nStart = LockSiteHash(pszName, pszFile, nLine);
+    for (size_t i = 0; i < LOCK_SITES; i++) {
+        CLockSite &site = lockSites[(nStart + i) % LOCK_SITES];
+        const char *pszSiteFile = site.pszFile.load(std::memory_order_acquire);
+        if (pszSiteFile == nullptr) {
+            if (!fAdd) {
+                return nullptr;
+            }
+            site.pszName = pszName;
+            site.nLine = nLine;
+            site.pszFile.store(pszFile, std::memory_order_release);
+            return &site;
+        }
+        if (pszSiteFile == pszFile && site.nLine == nLine &&
+            site.pszName == pszName) {
+            return &site;
+        }
+    }
+    return nullptr;
+}
+
+CLockSite *GetLockSite(const char *pszName, const char *pszFile, int nLine) {
+    CLockSite *psite = FindLockSite(pszName, pszFile, nLine, false);
+    if (psite) {
+        return psite;
+    }
+    // Not there yet, look again with only this thread adding.
+    std::lock_guard<std::mutex> lock(csLockSites);
+    return FindLockSite(pszName, pszFile, nLine, true);
+}
+
+static int LockStatsBucket(int64_t nMicros) {
+    int nBucket = 0;
+    while (nBucket < LOCK_STATS_BUCKETS - 1 &&
+           nMicros >= (int64_t(1) << nBucket)) {
+        nBucket++;
+    }
+    return nBucket;
+}
+
+static void UpdateMax(std::atomic<int64_t> &nMax, int64_t n) {
+    int64_t nPrev = nMax.load(std::memory_order_relaxed);
+    while (n > nPrev &&
+           !nMax.compare_exchange_weak(nPrev, n, std::memory_order_relaxed)) {
+    }
+}
+
+void RecordLockSiteWait(CLockSite *psite, int64_t nMicros) {
+    psite->nContended.fetch_add(1, std::memory_order_relaxed);
+    psite->nWaitMicros.fetch_add(nMicros, std::memory_order_relaxed);
+    UpdateMax(psite->nMaxWaitMicros, nMicros);
+    psite->vWait[LockStatsBucket(nMicros)].fetch_add(
+        1, std::memory_order_relaxed);
+}
+
+void RecordLockSiteHold(CLockSite *psite, int64_t nMicros) {
+    psite->nAcquired.fetch_add(1, std::memory_order_relaxed);
+    psite->nHoldMicros.fetch_add(nMicros, std::memory_order_relaxed);
+    UpdateMax(psite->nMaxHoldMicros, nMicros);
+    psite->vHold[LockStatsBucket(nMicros)].fetch_add(
+        1, std::memory_order_relaxed);
+}
+
+std::vector<LockSiteStats> GetLockStats() {
+    std::vector<LockSiteStats> vStats;
+    for (CLockSite &site : lockSites) {
+        const char *pszFile = site.pszFile.load(std::memory_order_acquire);
+        if (pszFile == nullptr) {
+            continue;
+        }
+        LockSiteStats stats;
+        stats.pszName = site.pszName;
+        stats.pszFile = pszFile;
+        stats.nLine = site.nLine;
+        stats.nAcquired = site.nAcquired;
+        stats.nContended = site.nContended;
+        stats.nWaitMicros = site.nWaitMicros;
+        stats.nMaxWaitMicros = site.nMaxWaitMicros;
+        stats.nHoldMicros = site.nHoldMicros;
+        stats.nMaxHoldMicros = site.nMaxHoldMicros;
+        for (int i = 0; i < LOCK_STATS_BUCKETS; i++) {
+            stats.vWait[i] = site.vWait[i];
+            stats.vHold[i] = site.vHold[i];
+        }
+        vStats.push_back(stats);
+    }
+    return vStats;
+}
+
+void ResetLockStats() {
+    // Sites stay, locks held meanwhile may count partly.
+    for (CLockSite &site : lockSites) {
+        site.nAcquired = 0;
+        site.nContended = 0;
+        site.nWaitMicros = 0;
+        site.nMaxWaitMicros = 0;
+        site.nHoldMicros = 0;
+        site.nMaxHoldMicros = 0;
+        for (int i = 0; i < LOCK_STATS_BUCKETS; i++) {
+            site.vWait[i] = 0;
+            site.vHold[i] = 0;
+        }
+    }
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
@@ -7,6 +7,11 @@
 #define BITCOIN_SYNC_H
 
 #include "threadsafety.h"
+#include "utiltime.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
@@ -102,27 +107,103 @@ typedef boost::condition_variable CConditionVariable;
 void PrintLockContention(const char *pszName, const char *pszFile, int nLine);
 #endif
 
+/** Time a thread waited for locks other threads held, see SetLockWaitTimes */
+struct LockWaitTimes {
+    int64_t nMainMicros;
+    int64_t nWalletMicros;
+    int64_t nOtherMicros;
+
+    LockWaitTimes() : nMainMicros(0), nWalletMicros(0), nOtherMicros(0) {}
+};
+
+/**
+ * Add the time the current thread waits for locks other threads hold to
+ * times, until it is called again. Returns where it was added to before, to
+ * be set back. Taking a free lock costs nothing more.
+ */
+LockWaitTimes *SetLockWaitTimes(LockWaitTimes *times);
+//! When the current thread starts to wait for a lock, 0 if nothing records it
+int64_t LockWaitStart();
+//! Record the wait for lock pszName that started at nStart
+void RecordLockWait(const char *pszName, int64_t nStart);
+
+static const bool DEFAULT_LOCK_STATS = false;
+/** Histogram buckets of lock times, one per power of two microseconds */
+static const int LOCK_STATS_BUCKETS = 24;
+
+/** Where locks are taken, see GetLockSite */
+class CLockSite;
+
+/** What getlockstats tells of the locks taken at a LOCK site */
+struct LockSiteStats {
+    const char *pszName;
+    const char *pszFile;
+    int nLine;
+    uint64_t nAcquired;
+    //! Times the lock was held by another thread and had to be waited for
+    uint64_t nContended;
+    int64_t nWaitMicros;
+    int64_t nMaxWaitMicros;
+    int64_t nHoldMicros;
+    int64_t nMaxHoldMicros;
+    //! Bucket i counts the times below 2^i microseconds, the last the others
+    uint64_t vWait[LOCK_STATS_BUCKETS];
+    uint64_t vHold[LOCK_STATS_BUCKETS];
+};
+
+/**
+ * Whether each LOCK site records how long locks were waited for and held,
+ * -lockstats. Costs a clock read when a lock is taken and released.
+ */
+extern std::atomic<bool> fLockStats;
+
+//! The statistics of lock pszName taken at pszFile:nLine, nullptr if there
+//! are too many sites to keep them
+CLockSite *GetLockSite(const char *pszName, const char *pszFile, int nLine);
+void RecordLockSiteWait(CLockSite *psite, int64_t nMicros);
+void RecordLockSiteHold(CLockSite *psite, int64_t nMicros);
+std::vector<LockSiteStats> GetLockStats();
+void ResetLockStats();
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template <typename Mutex> class SCOPED_LOCKABLE CMutexLock {
 private:
     boost::unique_lock<Mutex> lock;
+    //! With fLockStats, where the lock was taken and when
+    CLockSite *psite = nullptr;
+    int64_t nLockedAt = 0;
 
     void Enter(const char *pszName, const char *pszFile, int nLine) {
         EnterCritical(pszName, pszFile, nLine, (void *)(lock.mutex()));
-#ifdef DEBUG_LOCKCONTENTION
+        if (fLockStats.load(std::memory_order_relaxed)) {
+            psite = GetLockSite(pszName, pszFile, nLine);
+        }
         if (!lock.try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
             PrintLockContention(pszName, pszFile, nLine);
 #endif
+            const int64_t nStart = LockWaitStart();
+            const int64_t nSiteStart = psite ? GetTimeMicros() : 0;
             lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+            RecordLockWait(pszName, nStart);
+            if (psite) {
+                nLockedAt = GetTimeMicros();
+                RecordLockSiteWait(psite, nLockedAt - nSiteStart);
+            }
+        } else if (psite) {
+            nLockedAt = GetTimeMicros();
         }
-#endif
     }
 
     bool TryEnter(const char *pszName, const char *pszFile, int nLine) {
         EnterCritical(pszName, pszFile, nLine, (void *)(lock.mutex()), true);
         lock.try_lock();
-        if (!lock.owns_lock()) LeaveCritical();
+        if (!lock.owns_lock()) {
+            LeaveCritical();
+        } else if (fLockStats.load(std::memory_order_relaxed)) {
+            psite = GetLockSite(pszName, pszFile, nLine);
+            nLockedAt = GetTimeMicros();
+        }
         return lock.owns_lock();
     }
 
@@ -148,7 +229,12 @@ public:
     }
 
     ~CMutexLock() UNLOCK_FUNCTION() {
-        if (lock.owns_lock()) LeaveCritical();
+        if (lock.owns_lock()) {
+            LeaveCritical();
+            if (psite) {
+                RecordLockSiteHold(psite, GetTimeMicros() - nLockedAt);
+            }
+        }
     }
 
     operator bool() { return lock.owns_lock(); }
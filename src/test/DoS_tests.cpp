@@ -6,11 +6,9 @@
 
 #include "chainparams.h"
 #include "config.h"
-#include "keystore.h"
 #include "net.h"
 #include "net_processing.h"
 #include "pow.h"
-#include "script/sign.h"
 #include "serialize.h"
 #include "util.h"
 #include "validation.h"
@@ -22,17 +20,6 @@
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/test/unit_test.hpp>
 
-// Tests these internal-to-net_processing.cpp methods:
-extern bool AddOrphanTx(const CTransactionRef &tx, NodeId peer);
-extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
-struct COrphanTx {
-    CTransactionRef tx;
-    NodeId fromPeer;
-    int64_t nTimeExpire;
-};
-extern std::map<uint256, COrphanTx> mapOrphanTransactions;
-
 CService ip(uint32_t i) {
     struct in_addr s;
     s.s_addr = i;
@@ -134,88 +121,4 @@ BOOST_AUTO_TEST_CASE(DoS_bantime) {
     BOOST_CHECK(!connman->IsBanned(addr));
 }
 
-CTransactionRef RandomOrphan() {
-    std::map<uint256, COrphanTx>::iterator it;
-    it = mapOrphanTransactions.lower_bound(GetRandHash());
-    if (it == mapOrphanTransactions.end()) it = mapOrphanTransactions.begin();
-    return it->second.tx;
-}
-
-BOOST_AUTO_TEST_CASE(DoS_mapOrphans) {
-    CKey key;
-    key.MakeNewKey(true);
-    CBasicKeyStore keystore;
-    keystore.AddKey(key);
-
-    // 50 orphan transactions:
-    for (int i = 0; i < 50; i++) {
-        CMutableTransaction tx;
-        tx.vin.resize(1);
-        tx.vin[0].prevout.n = 0;
-        tx.vin[0].prevout.hash = GetRandHash();
-        tx.vin[0].scriptSig << OP_1;
-        tx.vout.resize(1);
-        tx.vout[0].nValue = 1 * CENT;
-        tx.vout[0].scriptPubKey =
-            GetScriptForDestination(key.GetPubKey().GetID());
-
-        AddOrphanTx(MakeTransactionRef(tx), i);
-    }
-
-    // ... and 50 that depend on other orphans:
-    for (int i = 0; i < 50; i++) {
-        CTransactionRef txPrev = RandomOrphan();
-
-        CMutableTransaction tx;
-        tx.vin.resize(1);
-        tx.vin[0].prevout.n = 0;
-        tx.vin[0].prevout.hash = txPrev->GetId();
-        tx.vout.resize(1);
-        tx.vout[0].nValue = 1 * CENT;
-        tx.vout[0].scriptPubKey =
-            GetScriptForDestination(key.GetPubKey().GetID());
-        SignSignature(keystore, *txPrev, tx, 0, SIGHASH_ALL);
-
-        AddOrphanTx(MakeTransactionRef(tx), i);
-    }
-
-    // This really-big orphan should be ignored:
-    for (int i = 0; i < 10; i++) {
-        CTransactionRef txPrev = RandomOrphan();
-
-        CMutableTransaction tx;
-        tx.vout.resize(1);
-        tx.vout[0].nValue = 1 * CENT;
-        tx.vout[0].scriptPubKey =
-            GetScriptForDestination(key.GetPubKey().GetID());
-        tx.vin.resize(2777);
-        for (unsigned int j = 0; j < tx.vin.size(); j++) {
-            tx.vin[j].prevout.n = j;
-            tx.vin[j].prevout.hash = txPrev->GetId();
-        }
-        SignSignature(keystore, *txPrev, tx, 0, SIGHASH_ALL);
-        // Re-use same signature for other inputs
-        // (they don't have to be valid for this test)
-        for (unsigned int j = 1; j < tx.vin.size(); j++)
-            tx.vin[j].scriptSig = tx.vin[0].scriptSig;
-
-        BOOST_CHECK(!AddOrphanTx(MakeTransactionRef(tx), i));
-    }
-
-    // Test EraseOrphansFor:
-    for (NodeId i = 0; i < 3; i++) {
-        size_t sizeBefore = mapOrphanTransactions.size();
-        EraseOrphansFor(i);
-        BOOST_CHECK(mapOrphanTransactions.size() < sizeBefore);
-    }
-
-    // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
-    BOOST_CHECK(mapOrphanTransactions.empty());
-}
-
 BOOST_AUTO_TEST_SUITE_END()
@@ -192,6 +192,30 @@ BOOST_AUTO_TEST_CASE(addrman_select) {
     BOOST_CHECK_EQUAL(ports.size(), 3);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_select_moved) {
+    CAddrManTest addrman;
+
+    // Set addrman addr placement to be deterministic.
+    addrman.MakeDeterministic();
+
+    CNetAddr source = ResolveIP("252.2.2.2");
+    std::set<std::string> addrs;
+    for (int i = 1; i <= 10; i++) {
+        CService addr = ResolveService("250.1.1." + std::to_string(i), 8333);
+        addrman.Add(CAddress(addr, NODE_NONE), source);
+        addrman.Good(CAddress(addr, NODE_NONE));
+        addrs.insert(addr.ToString());
+    }
+
+    // Test: Every address moved to tried, so the new table has nothing left
+    // to select and the tried table only what was moved there.
+    BOOST_CHECK(addrman.size() == 10);
+    BOOST_CHECK(addrman.Select(true).ToString() == "[::]:0");
+    for (int i = 0; i < 50; i++) {
+        BOOST_CHECK(addrs.count(addrman.Select().ToString()) == 1);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(addrman_new_collisions) {
     CAddrManTest addrman;
 
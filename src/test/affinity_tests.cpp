@@ -0,0 +1,35 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "affinity.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(affinity_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(cpulist_parse) {
+    std::vector<int> vCpus;
+    BOOST_CHECK(ParseCpuList("0-3,8,10-11", vCpus));
+    BOOST_CHECK(vCpus == std::vector<int>({0, 1, 2, 3, 8, 10, 11}));
+    BOOST_CHECK(ParseCpuList("5", vCpus));
+    BOOST_CHECK(vCpus == std::vector<int>({5}));
+
+    BOOST_CHECK(!ParseCpuList("", vCpus));
+    BOOST_CHECK(!ParseCpuList("3-1", vCpus));
+    BOOST_CHECK(!ParseCpuList("0-1-2", vCpus));
+    BOOST_CHECK(!ParseCpuList("0,,1", vCpus));
+    BOOST_CHECK(!ParseCpuList("-1", vCpus));
+    BOOST_CHECK(!ParseCpuList("a-b", vCpus));
+}
+
+BOOST_AUTO_TEST_CASE(numa_nodes) {
+    // Whatever the machine looks like, every node must have CPUs.
+    for (const std::vector<int> &vCpus : GetNumaNodeCpus()) {
+        BOOST_CHECK(!vCpus.empty());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
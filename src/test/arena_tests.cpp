@@ -0,0 +1,92 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "support/allocators/arena.h"
+
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(arena_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(arena_allocations_dont_overlap) {
+    MonotonicArena arena(256);
+    std::vector<std::pair<uint8_t *, size_t>> vAllocations;
+    for (int i = 0; i < 1000; i++) {
+        const size_t nSize = insecure_rand() % 300;
+        const size_t nAlignment = size_t(1) << (insecure_rand() % 4);
+        uint8_t *p = static_cast<uint8_t *>(arena.Allocate(nSize, nAlignment));
+        BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(p) % nAlignment, 0U);
+        memset(p, i, nSize);
+        vAllocations.emplace_back(p, nSize);
+    }
+    for (size_t i = 0; i < vAllocations.size(); i++) {
+        const uint8_t *p = vAllocations[i].first;
+        for (size_t j = 0; j < vAllocations[i].second; j++) {
+            BOOST_CHECK_EQUAL(p[j], uint8_t(i));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(arena_release_keeps_one_chunk) {
+    MonotonicArena arena(1024);
+    BOOST_CHECK_EQUAL(arena.NumChunks(), 0U);
+
+    void *a = arena.Allocate(100, 8);
+    arena.Allocate(100, 8);
+    BOOST_CHECK_EQUAL(arena.NumChunks(), 1U);
+
+    // Released, the same memory is handed out again.
+    arena.Release();
+    BOOST_CHECK(arena.Allocate(100, 8) == a);
+
+    // A round that takes more chunks leaves one as large as all of them.
+    for (int i = 0; i < 30; i++) {
+        arena.Allocate(100, 8);
+    }
+    // Larger than a chunk.
+    arena.Allocate(5000, 8);
+    BOOST_CHECK(arena.NumChunks() > 1);
+    const size_t nTotalBytes = arena.TotalBytes();
+    {
+        const MonotonicArena::Scope scope(arena);
+    }
+    BOOST_CHECK_EQUAL(arena.NumChunks(), 1U);
+    BOOST_CHECK_EQUAL(arena.TotalBytes(), nTotalBytes);
+
+    // The same round fits in it now.
+    for (int i = 0; i < 30; i++) {
+        arena.Allocate(100, 8);
+    }
+    arena.Allocate(5000, 8);
+    BOOST_CHECK_EQUAL(arena.NumChunks(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(arena_allocator) {
+    MonotonicArena arena(1024);
+    {
+        std::vector<int, ArenaAllocator<int>> v((ArenaAllocator<int>(&arena)));
+        for (int i = 0; i < 1000; i++) {
+            v.push_back(i);
+        }
+        for (int i = 0; i < 1000; i++) {
+            BOOST_CHECK_EQUAL(v[i], i);
+        }
+        BOOST_CHECK(arena.NumChunks() > 0);
+    }
+    arena.Release();
+
+    // Without an arena, it is the default allocator.
+    std::vector<int, ArenaAllocator<int>> v;
+    v.assign(100, 7);
+    BOOST_CHECK_EQUAL(v[99], 7);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
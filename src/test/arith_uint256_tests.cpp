@@ -4,6 +4,7 @@
 
 #include "arith_uint256.h"
 #include "test/test_bitcoin.h"
+#include "test/test_random.h"
 #include "uint256.h"
 #include "version.h"
 #include <boost/test/unit_test.hpp>
@@ -426,6 +427,52 @@ BOOST_AUTO_TEST_CASE(divide) {
     BOOST_CHECK_THROW(R2L / ZeroL, uint_error);
 }
 
+static arith_uint256 RandomArith256(unsigned int nBits) {
+    arith_uint256 r;
+    for (int i = 0; i < 8; i++) {
+        r = (r << 32) | insecure_rand();
+    }
+    return nBits >= 256 ? r : r >> (256 - nBits);
+}
+
+/** Long division a bit at a time, to check the limb based one against. */
+static arith_uint256 DivideBitwise(arith_uint256 num,
+                                   const arith_uint256 &div) {
+    arith_uint256 q;
+    const int shift = num.bits() - div.bits();
+    if (shift < 0) {
+        return q;
+    }
+    arith_uint256 d = div << shift;
+    for (int i = shift; i >= 0; i--) {
+        if (num >= d) {
+            num -= d;
+            q |= arith_uint256(1) << i;
+        }
+        d >>= 1;
+    }
+    return q;
+}
+
+BOOST_AUTO_TEST_CASE(divide_random) {
+    for (int i = 0; i < 2000; i++) {
+        const arith_uint256 a = RandomArith256(1 + insecure_rand() % 256);
+        arith_uint256 b = RandomArith256(1 + insecure_rand() % 256);
+        if (b == 0) {
+            b = 1;
+        }
+        const arith_uint256 q = a / b;
+        BOOST_CHECK(q == DivideBitwise(a, b));
+        const arith_uint256 r = a - q * b;
+        BOOST_CHECK(r < b);
+        BOOST_CHECK(q * b + r == a);
+        // Top limb of the divisor only one bit wide, the worst case for
+        // estimating quotient digits.
+        const arith_uint256 c = (arith_uint256(1) << 192) | (b >> 64);
+        BOOST_CHECK(a / c == DivideBitwise(a, c));
+    }
+}
+
 bool almostEqual(double d1, double d2) {
     return fabs(d1 - d2) <=
            4 * fabs(d1) * std::numeric_limits<double>::epsilon();
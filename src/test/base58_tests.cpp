@@ -11,12 +11,15 @@
 #include "key.h"
 #include "script/script.h"
 #include "test/test_bitcoin.h"
+#include "test/test_random.h"
 #include "uint256.h"
 #include "util.h"
 #include "utilstrencodings.h"
 
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+
 #include <univalue.h>
 
 extern UniValue read_json(const std::string &jsondata);
@@ -82,6 +85,28 @@ BOOST_AUTO_TEST_CASE(base58_DecodeBase58) {
                                   expected.begin(), expected.end());
 }
 
+// Lengths on either side of the limb boundaries, with and without leading
+// zeroes.
+BOOST_AUTO_TEST_CASE(base58_roundtrip) {
+    for (size_t nSize = 0; nSize < 100; nSize++) {
+        for (size_t nZeroes = 0; nZeroes < 3 && nZeroes <= nSize; nZeroes++) {
+            std::vector<uint8_t> vch(nSize);
+            for (size_t i = nZeroes; i < nSize; i++) {
+                vch[i] = uint8_t(insecure_rand());
+            }
+            // The largest value of that size.
+            std::vector<uint8_t> vchMax(nSize, 0xff);
+            std::fill(vchMax.begin(), vchMax.begin() + nZeroes, 0);
+
+            std::vector<uint8_t> result;
+            BOOST_CHECK(DecodeBase58(EncodeBase58(vch), result));
+            BOOST_CHECK(result == vch);
+            BOOST_CHECK(DecodeBase58(EncodeBase58(vchMax), result));
+            BOOST_CHECK(result == vchMax);
+        }
+    }
+}
+
 // Visitor to check address type
 class TestAddrTypeVisitor : public boost::static_visitor<bool> {
 private:
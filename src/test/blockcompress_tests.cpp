@@ -0,0 +1,106 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcompress.h"
+
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcompress_tests, BasicTestingSetup)
+
+/** Something shaped like a block: P2PKH spends with random hashes. */
+static std::vector<uint8_t> MakeBlockLike(size_t nInputs) {
+    std::vector<uint8_t> v(80, 0x11);
+    for (size_t i = 0; i < nInputs; i++) {
+        for (int j = 0; j < 32; j++) {
+            v.push_back(insecure_rand());
+        }
+        const uint8_t spk[] = {0x19, 0x76, 0xa9, 0x14};
+        v.insert(v.end(), spk, spk + sizeof(spk));
+        for (int j = 0; j < 20; j++) {
+            v.push_back(insecure_rand());
+        }
+        const uint8_t tail[] = {0x88, 0xac, 0x00, 0xff, 0xff, 0xff, 0xff};
+        v.insert(v.end(), tail, tail + sizeof(tail));
+    }
+    // Long runs need the extended length encoding.
+    v.insert(v.end(), 1000, 0);
+    return v;
+}
+
+BOOST_AUTO_TEST_CASE(compress_roundtrip) {
+    for (size_t nInputs : {0, 1, 10, 1000}) {
+        std::vector<uint8_t> vBlock = MakeBlockLike(nInputs);
+        std::vector<uint8_t> vRecord, vOut;
+        BOOST_REQUIRE(CompressBlock(vBlock.data(), vBlock.size(), vRecord));
+        BOOST_CHECK(vRecord.size() < vBlock.size());
+        BOOST_CHECK_EQUAL(vRecord[0], BLOCK_COMPRESSION_FORMAT);
+        BOOST_REQUIRE(DecompressBlock(vRecord.data(), vRecord.size(), vOut));
+        BOOST_CHECK(vOut == vBlock);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compress_incompressible) {
+    std::vector<uint8_t> vBlock(1000), vRecord;
+    for (uint8_t &b : vBlock) {
+        b = insecure_rand();
+    }
+    BOOST_CHECK(!CompressBlock(vBlock.data(), vBlock.size(), vRecord));
+    BOOST_CHECK(!CompressBlock(vBlock.data(), 0, vRecord));
+}
+
+BOOST_AUTO_TEST_CASE(decompress_corrupt) {
+    std::vector<uint8_t> vBlock = MakeBlockLike(10);
+    std::vector<uint8_t> vRecord, vOut;
+    BOOST_REQUIRE(CompressBlock(vBlock.data(), vBlock.size(), vRecord));
+
+    // Every truncation is caught by the size in front.
+    for (size_t n = 0; n < vRecord.size(); n++) {
+        BOOST_CHECK(!DecompressBlock(vRecord.data(), n, vOut));
+    }
+
+    std::vector<uint8_t> vBad = vRecord;
+    vBad[0] = BLOCK_COMPRESSION_FORMAT + 1;
+    BOOST_CHECK(!DecompressBlock(vBad.data(), vBad.size(), vOut));
+
+    // Whatever the damage, decompressing stays within bounds.
+    for (size_t i = 5; i < vRecord.size(); i++) {
+        vBad = vRecord;
+        vBad[i] ^= 1 + insecure_rand() % 255;
+        if (DecompressBlock(vBad.data(), vBad.size(), vOut)) {
+            BOOST_CHECK_EQUAL(vOut.size(), vBlock.size());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(decompressed_block_cache) {
+    CDecompressedBlockCache cache(250);
+    std::shared_ptr<const std::vector<uint8_t>> block =
+        std::make_shared<const std::vector<uint8_t>>(100, 1);
+
+    cache.Put(CDiskBlockPos(0, 8), block);
+    cache.Put(CDiskBlockPos(0, 200), block);
+    BOOST_CHECK(cache.Get(CDiskBlockPos(0, 8)) == block);
+    BOOST_CHECK(cache.Get(CDiskBlockPos(1, 8)) == nullptr);
+
+    // The least recently used block goes first.
+    cache.Put(CDiskBlockPos(1, 8), block);
+    BOOST_CHECK(cache.Get(CDiskBlockPos(0, 200)) == nullptr);
+    BOOST_CHECK(cache.Get(CDiskBlockPos(0, 8)) == block);
+    BOOST_CHECK(cache.Get(CDiskBlockPos(1, 8)) == block);
+
+    cache.EraseFile(0);
+    BOOST_CHECK(cache.Get(CDiskBlockPos(0, 8)) == nullptr);
+    BOOST_CHECK(cache.Get(CDiskBlockPos(1, 8)) == block);
+
+    // Blocks bigger than the whole cache aren't kept.
+    cache.Put(CDiskBlockPos(2, 8),
+              std::make_shared<const std::vector<uint8_t>>(300, 1));
+    BOOST_CHECK(cache.Get(CDiskBlockPos(2, 8)) == nullptr);
+    BOOST_CHECK(cache.Get(CDiskBlockPos(1, 8)) == block);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
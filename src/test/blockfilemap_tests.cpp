@@ -0,0 +1,76 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+#include "crypto/common.h"
+#include "streams.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemap_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(span_reader) {
+    const uint8_t data[] = {1, 2, 0, 3, 0, 0, 0};
+    CSpanReader reader(SER_DISK, 0, data, data + sizeof(data));
+
+    uint8_t a, b;
+    uint32_t c;
+    reader >> a >> b;
+    BOOST_CHECK_EQUAL(a, 1);
+    BOOST_CHECK_EQUAL(b, 2);
+    reader.ignore(1);
+    BOOST_CHECK_EQUAL(reader.size(), 4);
+    reader >> c;
+    BOOST_CHECK_EQUAL(c, 3);
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK_THROW(reader >> a, std::ios_base::failure);
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(map_block_file) {
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() /
+                                   boost::filesystem::unique_path();
+    {
+        CAutoFile file(fopen(path.string().c_str(), "wb"), SER_DISK, 0);
+        for (uint32_t i = 0; i < 1000; i++) {
+            file << i;
+        }
+    }
+
+    CBlockFileMap map(1);
+    std::shared_ptr<const CMappedBlockFile> mapped = map.Get(0, path);
+    BOOST_REQUIRE(mapped);
+    BOOST_CHECK_EQUAL(mapped->size(), 4000);
+    BOOST_CHECK(map.Get(0, path) == mapped);
+
+    // Read it front to back, as a rescan would.
+    for (uint32_t i = 0; i < 1000; i++) {
+        const uint8_t *p = mapped->Get(4 * i, 4);
+        BOOST_REQUIRE(p);
+        uint32_t n;
+        CSpanReader(SER_DISK, 0, p, p + 4) >> n;
+        BOOST_CHECK_EQUAL(n, i);
+    }
+    BOOST_CHECK(mapped->Get(3999, 1));
+    BOOST_CHECK(!mapped->Get(3999, 2));
+    BOOST_CHECK(!mapped->Get(4001, 0));
+
+    // Only one mapping is kept, the other file takes its place.
+    BOOST_CHECK(!map.Get(1, path / "missing"));
+    std::shared_ptr<const CMappedBlockFile> mapped2 = map.Get(2, path);
+    BOOST_REQUIRE(mapped2);
+    BOOST_CHECK(map.Get(0, path) != mapped);
+
+    // Mappings stay valid after being dropped and the file deleted.
+    map.Erase(0);
+    map.Erase(2);
+    boost::filesystem::remove(path);
+    BOOST_CHECK_EQUAL(ReadLE32(mapped->Get(4 * 7, 4)), 7);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
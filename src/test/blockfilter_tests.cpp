@@ -0,0 +1,109 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "crypto/common.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "undo.h"
+#include "utilstrencodings.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <ios>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(gcsfilter_match) {
+    CGCSFilter::ElementSet included, excluded;
+    for (int i = 0; i < 100; i++) {
+        included.insert(CGCSFilter::Element(32, i));
+        excluded.insert(CGCSFilter::Element(33, i));
+    }
+
+    const CGCSFilter filter(0, 0, BASIC_FILTER_P, BASIC_FILTER_M, included);
+    BOOST_CHECK_EQUAL(filter.GetN(), 100U);
+    for (const CGCSFilter::Element &element : included) {
+        BOOST_CHECK(filter.Match(element));
+        CGCSFilter::ElementSet query = excluded;
+        query.insert(element);
+        BOOST_CHECK(filter.MatchAny(query));
+    }
+    BOOST_CHECK(!filter.MatchAny(excluded));
+    BOOST_CHECK(!filter.MatchAny(CGCSFilter::ElementSet()));
+
+    // Decoded, it is the same.
+    const CGCSFilter decoded(0, 0, BASIC_FILTER_P, BASIC_FILTER_M,
+                             filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), 100U);
+    for (const CGCSFilter::Element &element : included) {
+        BOOST_CHECK(decoded.Match(element));
+    }
+
+    // A filter that is cut short is rejected.
+    std::vector<uint8_t> vchTruncated = filter.GetEncoded();
+    vchTruncated.resize(vchTruncated.size() / 2);
+    BOOST_CHECK_THROW(CGCSFilter(0, 0, BASIC_FILTER_P, BASIC_FILTER_M,
+                                 vchTruncated),
+                      std::ios_base::failure);
+
+    BOOST_CHECK(CGCSFilter().GetEncoded() == std::vector<uint8_t>(1, 0));
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_bip158_vector) {
+    // The filter of block 0 of testnet in the BIP 158 test vectors.
+    const uint256 hashBlock = uint256S(
+        "000000000933ea01ad0ee984209779baaec3ced90fa3f408719526f8d77f4943");
+    CGCSFilter::ElementSet elements;
+    elements.insert(ParseHex(
+        "4104678afdb0fe5548271967f1a67130b7105cd6a828e03909a67962e0ea1f61deb6"
+        "49f6bc3f4cef38c4f35504e51ec112de5c384df7ba0b8d578a4c702b6bf11d5fac"));
+    const CGCSFilter filter(ReadLE64(hashBlock.begin()),
+                            ReadLE64(hashBlock.begin() + 8), BASIC_FILTER_P,
+                            BASIC_FILTER_M, elements);
+    BOOST_CHECK_EQUAL(HexStr(filter.GetEncoded()), "019dfca8");
+
+    const CBlockFilter blockFilter(hashBlock, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(
+        blockFilter.ComputeHeader(uint256()).GetHex(),
+        "21584579b7eb08997773e5aeff3a7f932700042d0ed2a6129012b7d7ae81b750");
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic) {
+    const CScript paid = CScript() << OP_1 << OP_DROP << OP_1;
+    const CScript spent = CScript() << OP_2 << OP_DROP << OP_1;
+    const CScript data = CScript() << OP_RETURN << ParseHex("0102");
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(3);
+    tx.vout[0].scriptPubKey = paid;
+    tx.vout[1].scriptPubKey = data;
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx));
+
+    CBlockUndo blockUndo;
+    blockUndo.vtxundo.resize(1);
+    blockUndo.vtxundo[0].vprevout.emplace_back(CTxOut(0, spent), 1, false);
+
+    const CBlockFilter filter(block, blockUndo);
+    BOOST_CHECK(filter.GetBlockHash() == block.GetHash());
+    // The empty script and the data carrier aren't in it.
+    BOOST_CHECK_EQUAL(filter.GetFilter().GetN(), 2U);
+    BOOST_CHECK(filter.GetFilter().Match(
+        CGCSFilter::Element(paid.begin(), paid.end())));
+    BOOST_CHECK(filter.GetFilter().Match(
+        CGCSFilter::Element(spent.begin(), spent.end())));
+    BOOST_CHECK(!filter.GetFilter().Match(
+        CGCSFilter::Element(data.begin(), data.end())));
+
+    const CBlockFilter decoded(block.GetHash(), filter.GetEncodedFilter());
+    BOOST_CHECK(decoded.GetHash() == filter.GetHash());
+    BOOST_CHECK(decoded.ComputeHeader(uint256()) ==
+                filter.ComputeHeader(uint256()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
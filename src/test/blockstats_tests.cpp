@@ -0,0 +1,95 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstats.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "script/script.h"
+#include "undo.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockstats_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(feerate_percentiles) {
+    std::vector<std::pair<CAmount, int64_t>> vFeeRates;
+    BOOST_CHECK(GetFeeRatePercentiles(vFeeRates) ==
+                std::vector<CAmount>(NUM_BLOCK_STATS_PERCENTILES, 0));
+
+    // Weighted by size: the large transaction at 1000 has half of the bytes.
+    vFeeRates = {{3000, 100}, {1000, 500}, {2000, 200}, {5000, 200}};
+    const std::vector<CAmount> vExpected = {1000, 1000, 1000, 3000, 5000};
+    BOOST_CHECK(GetFeeRatePercentiles(vFeeRates) == vExpected);
+    BOOST_CHECK_EQUAL(vFeeRates.front().first, 1000);
+    BOOST_CHECK_EQUAL(vFeeRates.back().first, 5000);
+
+    vFeeRates = {{4000, 250}};
+    BOOST_CHECK(GetFeeRatePercentiles(vFeeRates) ==
+                std::vector<CAmount>(NUM_BLOCK_STATS_PERCENTILES, 4000));
+}
+
+BOOST_AUTO_TEST_CASE(block_stats) {
+    const CScript script = CScript() << OP_TRUE;
+    CBlock block;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << OP_0 << OP_0;
+    coinbase.vout.emplace_back(50 * COIN, script, "coinbase content");
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    // Withdraws a deposit of 10 + 1 interest and a coin of 5, and locks a
+    // new deposit of 8 earning 2 interest, with content, paying 0.5 in fees.
+    CMutableTransaction tx;
+    tx.vin.resize(2);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0, 11 * COIN);
+    tx.vin[1].prevout = COutPoint(GetRandHash(), 1, 5 * COIN);
+    tx.vout.emplace_back(10 * COIN, script, "", 1000, 8 * COIN);
+    tx.vout.emplace_back(COIN / 2, script, "content");
+    tx.vout.emplace_back(7 * COIN, script);
+    block.vtx.push_back(MakeTransactionRef(tx));
+
+    CBlockUndo blockUndo;
+    blockUndo.vtxundo.resize(1);
+    blockUndo.vtxundo[0].vprevout.emplace_back(
+        CTxOut(11 * COIN, script, "", 500, 10 * COIN), 100, false);
+    blockUndo.vtxundo[0].vprevout.emplace_back(CTxOut(5 * COIN, script), 100,
+                                               false);
+
+    const CBlockStats stats(block, blockUndo);
+    BOOST_CHECK_EQUAL(stats.nTxs, 2U);
+    BOOST_CHECK_EQUAL(stats.nInputs, 2U);
+    BOOST_CHECK_EQUAL(stats.nOutputs, 4U);
+    BOOST_CHECK_EQUAL(stats.nContentOutputs, 2U);
+    BOOST_CHECK_EQUAL(stats.nContentBytes, 23U);
+    BOOST_CHECK_EQUAL(stats.nTotalOut, 17 * COIN + COIN / 2);
+    BOOST_CHECK_EQUAL(stats.nFees, COIN / 2);
+    BOOST_CHECK_EQUAL(stats.nInterest, 2 * COIN);
+    BOOST_CHECK_EQUAL(stats.nDeposits, 1U);
+    BOOST_CHECK_EQUAL(stats.nDepositPrincipal, 8 * COIN);
+    BOOST_CHECK_EQUAL(stats.nWithdrawals, 1U);
+    BOOST_CHECK_EQUAL(stats.nWithdrawnPrincipal, 10 * COIN);
+
+    const int64_t nTxSize = GetTransactionSize(*block.vtx[1]);
+    const CAmount nFeeRate = COIN / 2 * 1000 / nTxSize;
+    BOOST_CHECK_EQUAL(stats.nMinFeeRate, nFeeRate);
+    BOOST_CHECK_EQUAL(stats.nMaxFeeRate, nFeeRate);
+    BOOST_CHECK(stats.vFeeRatePercentiles ==
+                std::vector<CAmount>(NUM_BLOCK_STATS_PERCENTILES, nFeeRate));
+
+    // A block with only a coinbase.
+    block.vtx.resize(1);
+    blockUndo.vtxundo.clear();
+    const CBlockStats empty(block, blockUndo);
+    BOOST_CHECK_EQUAL(empty.nTxs, 1U);
+    BOOST_CHECK_EQUAL(empty.nFees, 0);
+    BOOST_CHECK_EQUAL(empty.nContentBytes, 16U);
+    BOOST_CHECK(empty.vFeeRatePercentiles ==
+                std::vector<CAmount>(NUM_BLOCK_STATS_PERCENTILES, 0));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
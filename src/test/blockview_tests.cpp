@@ -0,0 +1,103 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockview.h"
+#include "clientversion.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "streams.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <ios>
+#include <memory>
+#include <string>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(blockview_tests, BasicTestingSetup)
+
+static std::shared_ptr<std::vector<uint8_t>>
+SerializeBlock(const CBlock &block) {
+    std::shared_ptr<std::vector<uint8_t>> vch =
+        std::make_shared<std::vector<uint8_t>>();
+    CVectorWriter(SER_DISK, CLIENT_VERSION, *vch, 0, block);
+    return vch;
+}
+
+BOOST_AUTO_TEST_CASE(blockview_matches_block) {
+    CMutableTransaction coinbase;
+    coinbase.nFlags = TX_FLAGS_COINBASE;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << OP_0 << OP_0;
+    coinbase.vout.emplace_back(50 * COIN, CScript() << OP_TRUE);
+
+    CMutableTransaction tx;
+    tx.vin.resize(2);
+    tx.vin[0].prevout = COutPoint(coinbase.GetId(), 0);
+    tx.vin[1].prevout = COutPoint(uint256S("01"), 7);
+    tx.vin[1].scriptSig = CScript() << OP_1;
+    tx.vout.emplace_back(COIN, CScript() << OP_2, std::string(300, 'x'), 5);
+    tx.vout.emplace_back(2 * COIN, CScript());
+
+    CBlock block;
+    block.nBlockHeight = 1;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.vtx.push_back(MakeTransactionRef(tx));
+
+    std::shared_ptr<std::vector<uint8_t>> vch = SerializeBlock(block);
+    const CBlockView view(vch, vch->data(), vch->data() + vch->size());
+    BOOST_CHECK(view.GetHeader().GetHash() == block.GetHash());
+    BOOST_REQUIRE_EQUAL(view.GetTransactions().size(), block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &txBlock = *block.vtx[i];
+        const CTransactionView &txView = view.GetTransactions()[i];
+        BOOST_CHECK(txView.GetId() == txBlock.GetId());
+        BOOST_CHECK(*txView.Get() == txBlock);
+
+        BOOST_REQUIRE_EQUAL(txView.GetPrevouts().size(), txBlock.vin.size());
+        for (size_t j = 0; j < txBlock.vin.size(); j++) {
+            BOOST_CHECK(txView.GetPrevouts()[j] == txBlock.vin[j].prevout);
+        }
+
+        BOOST_REQUIRE_EQUAL(txView.GetOutputs().size(), txBlock.vout.size());
+        for (size_t j = 0; j < txBlock.vout.size(); j++) {
+            const CTxOut &out = txBlock.vout[j];
+            const CTxOutView &outView = txView.GetOutputs()[j];
+            BOOST_CHECK_EQUAL(outView.nValue, out.nValue);
+            BOOST_CHECK_EQUAL(outView.nPrincipal, out.nPrincipal);
+            BOOST_CHECK_EQUAL(outView.nLockTime, out.nLockTime);
+            BOOST_CHECK(CScript(outView.scriptPubKey.begin(),
+                                outView.scriptPubKey.end()) ==
+                        out.scriptPubKey);
+            BOOST_CHECK(std::string(outView.content.begin(),
+                                    outView.content.end()) == out.strContent);
+        }
+    }
+
+    // The spans point into the buffer the view keeps alive.
+    const CByteSpan &script =
+        view.GetTransactions()[1].GetOutputs()[0].scriptPubKey;
+    BOOST_CHECK(script.begin() > vch->data() &&
+                script.end() < vch->data() + vch->size());
+    const std::weak_ptr<std::vector<uint8_t>> weak = vch;
+    vch.reset();
+    BOOST_CHECK(!weak.expired());
+}
+
+BOOST_AUTO_TEST_CASE(blockview_truncated) {
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.emplace_back(COIN, CScript() << OP_TRUE, std::string(100, 'x'));
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx));
+
+    const std::shared_ptr<std::vector<uint8_t>> vch = SerializeBlock(block);
+    BOOST_CHECK_THROW(
+        CBlockView(vch, vch->data(), vch->data() + vch->size() - 1),
+        std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
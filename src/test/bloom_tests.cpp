@@ -9,6 +9,7 @@
 #include "key.h"
 #include "merkleblock.h"
 #include "random.h"
+#include "script/standard.h"
 #include "serialize.h"
 #include "streams.h"
 #include "test/test_bitcoin.h"
@@ -256,6 +257,97 @@ static std::vector<uint8_t> RandomData() {
     return std::vector<uint8_t>(r.begin(), r.end());
 }
 
+static std::vector<uint8_t> SerializeFilter(const CBloomFilter &filter) {
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << filter;
+    return std::vector<uint8_t>(stream.begin(), stream.end());
+}
+
+BOOST_AUTO_TEST_CASE(bloom_match_elements) {
+    CKey key1, key2;
+    key1.MakeNewKey(true);
+    key2.MakeNewKey(false);
+    const CPubKey pubkey1 = key1.GetPubKey(), pubkey2 = key2.GetPubKey();
+
+    // Outputs of every kind the update flags tell apart.
+    CMutableTransaction mtx;
+    mtx.vin.resize(2);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 3, 5 * COIN);
+    mtx.vin[0].scriptSig = CScript() << std::vector<uint8_t>(71, 0x30)
+                                     << ToByteVector(pubkey1);
+    mtx.vin[1].prevout = COutPoint(GetRandHash(), 0, 2 * COIN);
+    mtx.vin[1].scriptSig = CScript() << OP_0 << std::vector<uint8_t>(72, 0x30);
+    mtx.vout.resize(4);
+    mtx.vout[0].scriptPubKey = GetScriptForDestination(pubkey1.GetID());
+    mtx.vout[1].scriptPubKey = GetScriptForRawPubKey(pubkey2);
+    mtx.vout[2].scriptPubKey =
+        GetScriptForMultisig(1, std::vector<CPubKey>{pubkey1, pubkey2});
+    mtx.vout[3].scriptPubKey = CScript() << OP_RETURN << RandomData();
+    for (unsigned int i = 0; i < mtx.vout.size(); i++) {
+        mtx.vout[i].nValue = (i + 1) * COIN;
+    }
+    const CTransaction tx(mtx);
+
+    CMutableTransaction mspend;
+    mspend.vin.resize(1);
+    mspend.vout.resize(1);
+    mspend.vout[0].scriptPubKey = CScript() << OP_TRUE;
+
+    std::vector<std::vector<uint8_t>> vElements;
+    vElements.push_back(std::vector<uint8_t>(tx.GetId().begin(),
+                                             tx.GetId().end()));
+    vElements.push_back(ToByteVector(pubkey1));
+    vElements.push_back(ToByteVector(pubkey1.GetID()));
+    vElements.push_back(ToByteVector(pubkey2));
+    vElements.push_back(std::vector<uint8_t>(71, 0x30));
+    vElements.push_back(RandomData());
+
+    const CBloomTxElements elements(tx);
+    for (uint8_t nFlags : {BLOOM_UPDATE_NONE, BLOOM_UPDATE_ALL,
+                           BLOOM_UPDATE_P2PUBKEY_ONLY}) {
+        for (const std::vector<uint8_t> &element : vElements) {
+            CBloomFilter filter1(10, 0.000001, 0, nFlags);
+            filter1.insert(element);
+            CBloomFilter filter2(filter1);
+            BOOST_CHECK_EQUAL(filter1.IsRelevantAndUpdate(tx),
+                              filter2.IsRelevantAndUpdate(elements));
+            // The same outputs were added.
+            BOOST_CHECK(SerializeFilter(filter1) == SerializeFilter(filter2));
+            for (unsigned int i = 0; i < tx.vout.size(); i++) {
+                mspend.vin[0].prevout =
+                    COutPoint(tx.GetId(), i, tx.vout[i].nValue);
+                const CTransaction spend(mspend);
+                BOOST_CHECK_EQUAL(
+                    filter1.IsRelevantAndUpdate(spend),
+                    filter2.IsRelevantAndUpdate(CBloomTxElements(spend)));
+            }
+        }
+    }
+
+    // A filtered block from prepared elements is the same.
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx));
+    for (int i = 0; i < 6; i++) {
+        mspend.vin[0].prevout = COutPoint(GetRandHash(), i);
+        block.vtx.push_back(MakeTransactionRef(mspend));
+    }
+    mspend.vin[0].prevout = COutPoint(tx.GetId(), 1, tx.vout[1].nValue);
+    block.vtx.push_back(MakeTransactionRef(mspend));
+    const CFilterableBlock filterable(block);
+    CBloomFilter filter1(10, 0.000001, 0, BLOOM_UPDATE_P2PUBKEY_ONLY);
+    filter1.insert(ToByteVector(pubkey2));
+    CBloomFilter filter2(filter1);
+    CMerkleBlock merkleBlock1(block, filter1);
+    CMerkleBlock merkleBlock2(filterable, filter2);
+    BOOST_CHECK_EQUAL(merkleBlock2.vMatchedTxn.size(), 2);
+    BOOST_CHECK(merkleBlock1.vMatchedTxn == merkleBlock2.vMatchedTxn);
+    CDataStream stream1(SER_NETWORK, PROTOCOL_VERSION);
+    CDataStream stream2(SER_NETWORK, PROTOCOL_VERSION);
+    stream1 << merkleBlock1;
+    stream2 << merkleBlock2;
+    BOOST_CHECK(stream1.str() == stream2.str());
+}
+
 BOOST_AUTO_TEST_CASE(rolling_bloom) {
     // last-100-entry, 1% false positive:
     CRollingBloomFilter rb1(100, 0.01);
@@ -328,4 +420,34 @@ BOOST_AUTO_TEST_CASE(rolling_bloom) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(rolling_bloom_batch) {
+    CRollingBloomFilter rb1(100, 0.01);
+    CRollingBloomFilter rb2(100, 0.01);
+
+    // Inserting a batch rolls the generations over the same way as inserting
+    // one at a time, so the last 100 are kept.
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 399; i++) {
+        vHashes.push_back(GetRandHash());
+        rb1.insert(vHashes.back());
+    }
+    rb2.insert(vHashes);
+    for (int i = 299; i < 399; i++) {
+        BOOST_CHECK(rb2.contains(vHashes[i]));
+    }
+
+    for (int i = 0; i < 1000; i++) {
+        vHashes.push_back(GetRandHash());
+    }
+    const std::vector<bool> vContains1 = rb1.contains(vHashes);
+    const std::vector<bool> vContains2 = rb2.contains(vHashes);
+    BOOST_REQUIRE_EQUAL(vContains1.size(), vHashes.size());
+    BOOST_REQUIRE_EQUAL(vContains2.size(), vHashes.size());
+    for (size_t i = 0; i < vHashes.size(); i++) {
+        BOOST_CHECK_EQUAL(vContains1[i], rb1.contains(vHashes[i]));
+        BOOST_CHECK_EQUAL(vContains2[i], rb2.contains(vHashes[i]));
+    }
+    BOOST_CHECK(rb1.contains(std::vector<uint256>()).empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
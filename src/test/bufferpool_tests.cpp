@@ -0,0 +1,72 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bufferpool.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(bufferpool_tests, BasicTestingSetup)
+
+typedef CBufferPool<std::vector<uint8_t>> BytePool;
+
+BOOST_AUTO_TEST_CASE(bufferpool_reuse) {
+    BytePool pool(2);
+
+    std::vector<uint8_t> buf = pool.Get(100);
+    BOOST_CHECK(buf.empty());
+    BOOST_CHECK(buf.capacity() >= 128);
+    BOOST_CHECK_EQUAL(pool.GetMisses(), 1);
+
+    buf.resize(100, 0xff);
+    const uint8_t *pAlloc = buf.data();
+    pool.Put(std::move(buf));
+
+    // Any request in the same class gets the same allocation back, emptied.
+    std::vector<uint8_t> again = pool.Get(70);
+    BOOST_CHECK(again.empty());
+    BOOST_CHECK(again.data() == pAlloc);
+    BOOST_CHECK_EQUAL(pool.GetHits(), 1);
+
+    // A bigger class misses.
+    std::vector<uint8_t> bigger = pool.Get(129);
+    BOOST_CHECK(bigger.capacity() >= 256);
+    BOOST_CHECK_EQUAL(pool.GetMisses(), 2);
+
+    // A buffer is filed under the largest class it can fully serve.
+    std::vector<uint8_t> odd;
+    odd.reserve(200);
+    pool.Put(std::move(odd));
+    BOOST_CHECK(pool.Get(200).capacity() >= 256);
+    BOOST_CHECK_EQUAL(pool.GetMisses(), 3);
+    BOOST_CHECK_EQUAL(pool.Get(128).capacity(), 200);
+    BOOST_CHECK_EQUAL(pool.GetHits(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(bufferpool_bounds) {
+    BytePool pool(2);
+
+    // Only two buffers are kept per class.
+    for (int i = 0; i < 3; i++) {
+        std::vector<uint8_t> buf;
+        buf.reserve(64);
+        pool.Put(std::move(buf));
+    }
+    for (int i = 0; i < 3; i++) {
+        pool.Get(64);
+    }
+    BOOST_CHECK_EQUAL(pool.GetHits(), 2);
+    BOOST_CHECK_EQUAL(pool.GetMisses(), 1);
+
+    // Oversized buffers are allocated as requested and never kept.
+    std::vector<uint8_t> huge = pool.Get(BytePool::MAX_CLASS_SIZE + 1);
+    BOOST_CHECK(huge.capacity() > BytePool::MAX_CLASS_SIZE);
+    pool.Put(std::move(huge));
+    pool.Get(BytePool::MAX_CLASS_SIZE);
+    BOOST_CHECK_EQUAL(pool.GetHits(), 2);
+    BOOST_CHECK_EQUAL(pool.GetMisses(), 3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
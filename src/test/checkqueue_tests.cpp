@@ -0,0 +1,88 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+
+#include <atomic>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+namespace {
+std::atomic<int> nChecked;
+
+struct FakeCheck {
+    bool fOk;
+    FakeCheck() : fOk(true) {}
+    explicit FakeCheck(bool fOkIn) : fOk(fOkIn) {}
+    bool operator()() {
+        nChecked++;
+        return fOk;
+    }
+    void swap(FakeCheck &x) { std::swap(fOk, x.fOk); }
+};
+} // namespace
+
+/**
+ * Runs rounds of checks of random sizes, added a random number at a time, and
+ * checks that all of them run and a failure anywhere fails the round.
+ */
+template <typename Queue>
+static void CheckQueueRounds(Queue &queue, int nThreads) {
+    boost::thread_group tg;
+    for (int i = 0; i < nThreads; i++) {
+        tg.create_thread([&] { queue.Thread(); });
+    }
+
+    for (int nRound = 0; nRound < 200; nRound++) {
+        int nTotal = insecure_rand() % 1000;
+        int nFail = nRound % 3 == 0 && nTotal > 0 ? insecure_rand() % nTotal
+                                                  : -1;
+        nChecked = 0;
+        bool fOk;
+        {
+            CCheckQueueControl<FakeCheck, Queue> control(&queue);
+            int nAdded = 0;
+            while (nAdded < nTotal) {
+                int nAdd = std::min<int>(nTotal - nAdded,
+                                         1 + insecure_rand() % 50);
+                std::vector<FakeCheck> vChecks;
+                for (int i = 0; i < nAdd; i++) {
+                    vChecks.emplace_back(nAdded + i != nFail);
+                }
+                control.Add(vChecks);
+                nAdded += nAdd;
+            }
+            fOk = control.Wait();
+        }
+        BOOST_CHECK_EQUAL(fOk, nFail < 0);
+        // After a failure, the rest of the round may be skipped.
+        if (nFail < 0) {
+            BOOST_CHECK_EQUAL(nChecked, nTotal);
+        }
+        BOOST_CHECK(queue.IsIdle());
+    }
+
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_rounds) {
+    CCheckQueue<FakeCheck> queue(16);
+    CheckQueueRounds(queue, 3);
+}
+
+BOOST_AUTO_TEST_CASE(workstealing_checkqueue_rounds) {
+    for (int nThreads : {0, 1, 3, 8}) {
+        CWorkStealingCheckQueue<FakeCheck> queue(16, 4);
+        CheckQueueRounds(queue, nThreads);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,7 @@
 #include "script/standard.h"
 #include "test/test_bitcoin.h"
 #include "test/test_random.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "undo.h"
 #include "utilstrencodings.h"
@@ -33,8 +34,11 @@ bool operator==(const Coin &a, const Coin &b) {
 class CCoinsViewTest : public CCoinsView {
     uint256 hashBestBlock_;
     std::map<COutPoint, Coin> map_;
+    std::unique_ptr<CUTXOStats> stats_;
 
 public:
+    CCoinsViewTest() : stats_(new CUTXOStats()) {}
+
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override {
         std::map<COutPoint, Coin>::const_iterator it = map_.find(outpoint);
         if (it == map_.end()) {
@@ -55,7 +59,16 @@ public:
 
     uint256 GetBestBlock() const override { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override {
+    bool GetStats(CUTXOStats &stats) const override {
+        if (!stats_) {
+            return false;
+        }
+        stats = *stats_;
+        return true;
+    }
+
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                    const CUTXOStats *pstats) override {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
                 // Same optimization used in CCoinsViewDB is to only write dirty
@@ -71,6 +84,7 @@ public:
         if (!hashBlock.IsNull()) {
             hashBestBlock_ = hashBlock;
         }
+        stats_.reset(pstats ? new CUTXOStats(*pstats) : nullptr);
         return true;
     }
 };
@@ -133,6 +147,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test) {
     std::vector<CCoinsViewCacheTest *> stack;
     // Start with one cache.
     stack.push_back(new CCoinsViewCacheTest(&base));
+    stack.back()->TrackStats();
 
     // Use a limited set of random transaction ids, so we do test overwriting
     // entries.
@@ -189,6 +204,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test) {
 
         // Once every 1000 iterations and at the end, verify the full cache.
         if (insecure_rand() % 1000 == 1 || i == NUM_SIMULATION_ITERATIONS - 1) {
+            CUTXOStats stats;
             for (auto it = result.begin(); it != result.end(); it++) {
                 bool have = stack.back()->HaveCoin(it->first);
                 const Coin &coin = stack.back()->AccessCoin(it->first);
@@ -199,11 +215,19 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test) {
                 } else {
                     BOOST_CHECK(stack.back()->HaveCoinInCache(it->first));
                     found_an_entry = true;
+                    stats.AddCoin(it->first, coin);
                 }
             }
             for (const CCoinsViewCacheTest *test : stack) {
                 test->SelfTest();
             }
+            // The tracked statistics match the ones of the whole set.
+            CUTXOStats statsTracked;
+            BOOST_CHECK(stack.back()->GetStats(statsTracked));
+            BOOST_CHECK_EQUAL(statsTracked.nCoins, stats.nCoins);
+            BOOST_CHECK_EQUAL(statsTracked.nTotalAmount, stats.nTotalAmount);
+            BOOST_CHECK_EQUAL(statsTracked.nBogoSize, stats.nBogoSize);
+            BOOST_CHECK(statsTracked.GetHash() == stats.GetHash());
         }
 
         // Every 100 iterations, flush an intermediate cache
@@ -231,6 +255,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test) {
                     removed_all_caches = true;
                 }
                 stack.push_back(new CCoinsViewCacheTest(tip));
+                stack.back()->TrackStats();
                 if (stack.size() == 4) {
                     reached_4_caches = true;
                 }
@@ -619,7 +644,7 @@ void GetCoinMapEntry(const CCoinsMap &map, CAmount &value, char &flags) {
 void WriteCoinViewEntry(CCoinsView &view, const CAmount value, char flags) {
     CCoinsMap map;
     InsertCoinMapEntry(map, value, flags);
-    view.BatchWrite(map, {});
+    view.BatchWrite(map, {}, nullptr);
 }
 
 class SingleEntryCacheTest {
@@ -651,6 +676,38 @@ void CheckAccessCoin(const CAmount base_value, const CAmount cache_value,
     BOOST_CHECK_EQUAL(result_flags, expected_flags);
 }
 
+BOOST_AUTO_TEST_CASE(coin_content_dropped) {
+    CScript scriptPubKey = GetScriptForDestination(CKeyID(
+        uint160(ParseHex("816115944e077fe7c803cfa57f29b36bf87c1d35"))));
+    CTxOut txout(60000000000LL, scriptPubKey, std::string(1000, 'x'), 20,
+                 50000000000LL);
+
+    Coin coin(txout, 203998, false);
+    BOOST_CHECK(coin.GetTxOut().strContent.empty());
+
+    // A record written while coins still kept the content.
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    uint32_t nCode = 203998 * 2 + 1;
+    ss << VARINT(nCode);
+    ss << CTxOutCompressor(txout);
+    size_t nFatSize = ss.size();
+    Coin c;
+    ss >> c;
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK(c.GetTxOut().strContent.empty());
+    BOOST_CHECK_EQUAL(c.IsCoinBase(), true);
+    BOOST_CHECK_EQUAL(c.GetHeight(), 203998U);
+    BOOST_CHECK_EQUAL(c.GetTxOut().nValue, txout.nValue);
+    BOOST_CHECK_EQUAL(c.GetTxOut().nLockTime, txout.nLockTime);
+    BOOST_CHECK_EQUAL(c.GetTxOut().nPrincipal, txout.nPrincipal);
+    BOOST_CHECK(c.GetTxOut().scriptPubKey == scriptPubKey);
+
+    // Written back without it, as the chainstate upgrade does.
+    CDataStream ss2(SER_DISK, CLIENT_VERSION);
+    ss2 << c;
+    BOOST_CHECK_EQUAL(ss2.size(), nFatSize - 1000 - 2);
+}
+
 BOOST_AUTO_TEST_CASE(coin_access) {
     /* Check AccessCoin behavior, requesting a coin from a cache view layered on
      * top of a base view, and checking the resulting entry in the cache after
@@ -903,4 +960,118 @@ BOOST_AUTO_TEST_CASE(coin_write) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(coin_add_fetched) {
+    CCoinsView root;
+    CCoinsViewCacheTest cache(&root);
+    COutPoint outpoint(GetRandHash(), 0);
+    CScript script = CScript() << std::vector<uint8_t>(100, 1);
+
+    cache.AddFetchedCoin(outpoint, Coin(CTxOut(10, script), 5, false));
+    BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+    BOOST_CHECK_EQUAL(cache.AccessCoin(outpoint).GetTxOut().nValue, 10);
+    cache.SelfTest();
+
+    // Neither dirty nor fresh, just like a coin fetched through the cache.
+    BOOST_CHECK_EQUAL(cache.map().at(outpoint).flags, 0);
+
+    // What's cached already wins.
+    cache.AddFetchedCoin(outpoint, Coin(CTxOut(20, script), 5, false));
+    BOOST_CHECK_EQUAL(cache.AccessCoin(outpoint).GetTxOut().nValue, 10);
+    cache.SelfTest();
+}
+
+BOOST_AUTO_TEST_CASE(coins_flush_partial) {
+    CCoinsView root;
+    CCoinsViewCache base(&root);
+    CCoinsViewCache cache(&base);
+    COutPoint outpoint1(GetRandHash(), 0);
+    COutPoint outpoint2(GetRandHash(), 0);
+    CScript script = CScript() << std::vector<uint8_t>(100, 1);
+
+    cache.AddCoin(outpoint1, Coin(CTxOut(10, script), 1, false), false);
+    cache.SetBestBlock(GetRandHash());
+    cache.AddCoin(outpoint2, Coin(CTxOut(20, script), 2, false), false);
+    cache.SetBestBlock(GetRandHash());
+
+    // Everything is written, and kept while there is room.
+    BOOST_CHECK(cache.FlushPartial(cache.DynamicMemoryUsage()));
+    BOOST_CHECK(base.HaveCoinInCache(outpoint1));
+    BOOST_CHECK(base.HaveCoinInCache(outpoint2));
+    BOOST_CHECK(cache.HaveCoinInCache(outpoint1));
+    BOOST_CHECK(cache.HaveCoinInCache(outpoint2));
+    BOOST_CHECK(cache.GetBestBlock() == base.GetBestBlock());
+
+    // The coin unused for longer goes first.
+    cache.Trim(cache.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(!cache.HaveCoinInCache(outpoint1));
+    BOOST_CHECK(cache.HaveCoinInCache(outpoint2));
+
+    // Spent coins are written and dropped.
+    BOOST_CHECK(cache.SpendCoin(outpoint2));
+    BOOST_CHECK(cache.FlushPartial(cache.DynamicMemoryUsage()));
+    BOOST_CHECK(!cache.HaveCoinInCache(outpoint2));
+    BOOST_CHECK(!base.HaveCoin(outpoint2));
+    BOOST_CHECK(cache.HaveCoin(outpoint1));
+}
+
+BOOST_AUTO_TEST_CASE(coins_hot) {
+    CCoinsView root;
+    CCoinsViewCache cache(&root);
+    COutPoint outpoint1(GetRandHash(), 0);
+    COutPoint outpoint2(GetRandHash(), 0);
+    COutPoint outpoint3(GetRandHash(), 0);
+    CScript script = CScript() << std::vector<uint8_t>(100, 1);
+
+    cache.AddCoin(outpoint1, Coin(CTxOut(10, script), 1, false), false);
+    cache.SetBestBlock(GetRandHash());
+    cache.AddCoin(outpoint2, Coin(CTxOut(20, script), 2, false), false);
+    cache.AddCoin(outpoint3, Coin(CTxOut(30, script), 2, false), false);
+    cache.SetBestBlock(GetRandHash());
+    BOOST_CHECK(cache.SpendCoin(outpoint3));
+
+    // Spent coins are left out, the most recently used come first.
+    std::vector<COutPoint> vOutPoints;
+    cache.GetHotCoins(10, vOutPoints);
+    BOOST_CHECK_EQUAL(vOutPoints.size(), 2U);
+    vOutPoints.clear();
+    cache.GetHotCoins(1, vOutPoints);
+    BOOST_CHECK(vOutPoints == std::vector<COutPoint>{outpoint2});
+    vOutPoints.clear();
+    cache.GetHotCoins(0, vOutPoints);
+    BOOST_CHECK(vOutPoints.empty());
+}
+
+BOOST_AUTO_TEST_CASE(coins_async_write) {
+    CCoinsViewDB db(1 << 20, true);
+    CCoinsViewAsyncWrite writer(&db);
+    CCoinsViewCache cache(&writer);
+    COutPoint outpoint1(GetRandHash(), 0);
+    COutPoint outpoint2(GetRandHash(), 0);
+    CScript script = CScript() << std::vector<uint8_t>(100, 1);
+    uint256 hashBlock1 = GetRandHash();
+    uint256 hashBlock2 = GetRandHash();
+
+    cache.AddCoin(outpoint1, Coin(CTxOut(10, script), 1, false), false);
+    cache.SetBestBlock(hashBlock1);
+    BOOST_CHECK(cache.Flush());
+
+    // The flushed state is visible whether or not it reached the database.
+    BOOST_CHECK(writer.HaveCoin(outpoint1));
+    BOOST_CHECK(writer.GetBestBlock() == hashBlock1);
+
+    // A second flush waits for the first write and then shadows it.
+    BOOST_CHECK(cache.SpendCoin(outpoint1));
+    cache.AddCoin(outpoint2, Coin(CTxOut(20, script), 2, false), false);
+    cache.SetBestBlock(hashBlock2);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!cache.HaveCoin(outpoint1));
+    BOOST_CHECK(cache.HaveCoin(outpoint2));
+    BOOST_CHECK(cache.GetBestBlock() == hashBlock2);
+
+    BOOST_CHECK(writer.Sync());
+    BOOST_CHECK(!db.HaveCoin(outpoint1));
+    BOOST_CHECK(db.HaveCoin(outpoint2));
+    BOOST_CHECK(db.GetBestBlock() == hashBlock2);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
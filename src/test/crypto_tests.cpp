@@ -6,11 +6,14 @@
 #include "crypto/chacha20.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/muhash.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
+#include "hash.h"
 #include "random.h"
+#include "streams.h"
 #include "test/test_bitcoin.h"
 #include "test/test_random.h"
 #include "utilstrencodings.h"
@@ -315,6 +318,58 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
         "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64) {
+    for (int i = 0; i <= 16; i++) {
+        std::vector<uint8_t> in(64 * i);
+        for (auto &b : in) {
+            b = insecure_rand();
+        }
+        std::vector<uint8_t> expected(32 * i);
+        for (int j = 0; j < i; j++) {
+            CHash256().Write(&in[64 * j], 64).Finalize(&expected[32 * j]);
+        }
+        std::vector<uint8_t> out(32 * i);
+        SHA256D64(out.data(), in.data(), i);
+        BOOST_CHECK(out == expected);
+        // In place, as used for merkle tree levels.
+        SHA256D64(in.data(), in.data(), i);
+        in.resize(32 * i);
+        BOOST_CHECK(in == expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256_implementations) {
+    const std::string previous = SHA256SelectImplementation();
+
+    std::vector<uint8_t> in(64 * 19);
+    for (auto &b : in) {
+        b = insecure_rand();
+    }
+    BOOST_REQUIRE(SHA256SetImplementation("standard"));
+    std::vector<uint8_t> expected(32 * 19);
+    SHA256D64(expected.data(), in.data(), 19);
+
+    for (const char *name : {"standard", "sse4.1", "avx2", "shani"}) {
+        if (!SHA256SetImplementation(name)) {
+            // not available on this CPU
+            continue;
+        }
+        TestSHA256(
+            "abc",
+            "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        TestSHA256(
+            std::string(1000000, 'a'),
+            "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+        std::vector<uint8_t> out(32 * 19);
+        SHA256D64(out.data(), in.data(), 19);
+        BOOST_CHECK(out == expected);
+    }
+
+    BOOST_CHECK(!SHA256SetImplementation("unknown"));
+    BOOST_CHECK(SHA256SetImplementation(previous));
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512(
         "", "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -607,6 +662,110 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector) {
         "38407a6deb3ab78fab78c9");
 }
 
+static Num3072 Num3072FromLowBytes(uint8_t nFill, uint32_t nLow) {
+    std::vector<uint8_t> data(Num3072::BYTE_SIZE, nFill);
+    data[0] = nLow;
+    data[1] = nLow >> 8;
+    data[2] = nLow >> 16;
+    return Num3072(data.data());
+}
+
+static std::vector<uint8_t> Num3072ToBytes(const Num3072 &n) {
+    std::vector<uint8_t> data(Num3072::BYTE_SIZE);
+    n.ToBytes(data.data());
+    return data;
+}
+
+BOOST_AUTO_TEST_CASE(num3072_arithmetic) {
+    const std::vector<uint8_t> vZero(Num3072::BYTE_SIZE, 0);
+    std::vector<uint8_t> vOne = vZero;
+    vOne[0] = 1;
+
+    // The modulus 2^3072 - 1103717 is reduced to 0, 2^3072 - 1 to 1103716.
+    BOOST_CHECK(Num3072ToBytes(Num3072FromLowBytes(0xff, 0xef289b)) == vZero);
+    std::vector<uint8_t> vExpected = vZero;
+    vExpected[0] = 0x64;
+    vExpected[1] = 0xd7;
+    vExpected[2] = 0x10;
+    BOOST_CHECK(Num3072ToBytes(Num3072FromLowBytes(0xff, 0xffffff)) ==
+                vExpected);
+
+    // (p - 1)^2 = 1
+    Num3072 n = Num3072FromLowBytes(0xff, 0xef289a);
+    n.Multiply(n);
+    BOOST_CHECK(Num3072ToBytes(n) == vOne);
+
+    // Dividing undoes multiplying.
+    std::vector<uint8_t> vA(Num3072::BYTE_SIZE), vB(Num3072::BYTE_SIZE);
+    for (size_t i = 0; i < vA.size(); i++) {
+        vA[i] = insecure_rand();
+        vB[i] = insecure_rand();
+    }
+    Num3072 a(vA.data()), b(vB.data());
+    Num3072 c = a;
+    c.Multiply(b);
+    BOOST_CHECK(Num3072ToBytes(c) != vA);
+    c.Divide(b);
+    BOOST_CHECK(Num3072ToBytes(c) == vA);
+    c.Divide(a);
+    BOOST_CHECK(Num3072ToBytes(c) == vOne);
+}
+
+static std::vector<uint8_t> MuHashFinalize(MuHash3072 muhash) {
+    std::vector<uint8_t> hash(MuHash3072::OUTPUT_SIZE);
+    muhash.Finalize(hash.data());
+    return hash;
+}
+
+BOOST_AUTO_TEST_CASE(muhash_set_hash) {
+    std::vector<std::vector<uint8_t>> vElements;
+    for (int i = 0; i < 4; i++) {
+        std::vector<uint8_t> vElement(1 + insecure_rand() % 64);
+        for (uint8_t &c : vElement) {
+            c = insecure_rand();
+        }
+        vElements.push_back(vElement);
+    }
+
+    MuHash3072 acc1, acc2;
+    for (size_t i = 0; i < vElements.size(); i++) {
+        acc1.Insert(vElements[i].data(), vElements[i].size());
+        const std::vector<uint8_t> &v = vElements[vElements.size() - 1 - i];
+        acc2.Insert(v.data(), v.size());
+    }
+    // Order doesn't matter, contents do.
+    BOOST_CHECK(MuHashFinalize(acc1) == MuHashFinalize(acc2));
+    BOOST_CHECK(MuHashFinalize(acc1) != MuHashFinalize(MuHash3072()));
+
+    // Removing everything gives the empty set hash, removals may come first.
+    MuHash3072 acc3;
+    for (const std::vector<uint8_t> &v : vElements) {
+        acc3.Remove(v.data(), v.size());
+    }
+    acc3 *= acc1;
+    BOOST_CHECK(MuHashFinalize(acc3) == MuHashFinalize(MuHash3072()));
+
+    // Sets combine.
+    MuHash3072 accLow, accHigh;
+    accLow.Insert(vElements[0].data(), vElements[0].size());
+    accLow.Insert(vElements[1].data(), vElements[1].size());
+    accHigh.Insert(vElements[2].data(), vElements[2].size());
+    accHigh.Insert(vElements[3].data(), vElements[3].size());
+    MuHash3072 accUnion = accLow;
+    accUnion *= accHigh;
+    BOOST_CHECK(MuHashFinalize(accUnion) == MuHashFinalize(acc1));
+    accUnion /= accLow;
+    BOOST_CHECK(MuHashFinalize(accUnion) == MuHashFinalize(accHigh));
+
+    // The state serializes, pending division included.
+    CDataStream ss(SER_DISK, 0);
+    ss << acc3;
+    BOOST_CHECK_EQUAL(ss.size(), 2 * Num3072::BYTE_SIZE);
+    MuHash3072 accRead;
+    ss >> accRead;
+    BOOST_CHECK(MuHashFinalize(accRead) == MuHashFinalize(acc3));
+}
+
 BOOST_AUTO_TEST_CASE(countbits_tests) {
     FastRandomContext ctx;
     for (int i = 0; i <= 64; ++i) {
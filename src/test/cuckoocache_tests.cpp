@@ -370,4 +370,43 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations) {
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+/**
+ * Test that for_each_live yields exactly the elements which are still in the
+ * cache and not erased, so a dumped cache reloads to the same contents.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_for_each_live) {
+    insecure_rand = FastRandomContext(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup(1 << 10);
+    std::vector<uint256> hashes(256);
+    for (auto &h : hashes) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    for (size_t i = 0; i < hashes.size(); i += 2) {
+        cc.contains(hashes[i], true);
+    }
+
+    std::vector<uint256> live;
+    cc.for_each_live([&live](const uint256 &h) { live.push_back(h); });
+    std::sort(live.begin(), live.end());
+
+    std::vector<uint256> expected;
+    for (size_t i = 1; i < hashes.size(); i += 2) {
+        if (cc.contains(hashes[i], false)) expected.push_back(hashes[i]);
+    }
+    std::sort(expected.begin(), expected.end());
+    BOOST_CHECK(!expected.empty());
+    BOOST_CHECK(live == expected);
+
+    CuckooCache::cache<uint256, SignatureCacheHasher> reloaded{};
+    reloaded.setup(1 << 10);
+    for (const auto &h : live) {
+        reloaded.insert(h);
+    }
+    for (const auto &h : expected) {
+        BOOST_CHECK(reloaded.contains(h, false));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,93 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "ethash/internal.h"
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+// Build the OpenCL search kernel as plain host code, so its result can be
+// compared with the C implementation without a GPU.
+namespace cl_kernel {
+typedef uint64_t ulong;
+typedef uint32_t uint;
+#define __kernel
+#define __global
+#define __constant static const
+static size_t nGlobalId = 0;
+static size_t get_global_id(unsigned) {
+    return nGlobalId;
+}
+static uint atomic_inc(volatile uint *p) {
+    return (*p)++;
+}
+#include "ethash/ethash.cl"
+#undef __kernel
+#undef __global
+#undef __constant
+} // namespace cl_kernel
+
+BOOST_FIXTURE_TEST_SUITE(ethash_cl_tests, BasicTestingSetup)
+
+static const uint64_t TEST_CACHE_BYTES = 64 * 1024;
+static const uint64_t TEST_FULL_BYTES = 128 * 20000;
+
+static uint64_t ReadBE64(const uint8_t *p) {
+    uint64_t x = 0;
+    for (int i = 0; i < 8; i++) {
+        x = (x << 8) | p[i];
+    }
+    return x;
+}
+
+BOOST_AUTO_TEST_CASE(kernel_matches_full_compute) {
+    ethash_h256_t seed;
+    memset(&seed, 0x5a, sizeof(seed));
+    ethash_light_t light = ethash_light_new_internal(TEST_CACHE_BYTES, &seed);
+    BOOST_REQUIRE(light != nullptr);
+
+    std::vector<node> data(TEST_FULL_BYTES / sizeof(node));
+    BOOST_CHECK(ethash_compute_full_data(data.data(), TEST_FULL_BYTES, light,
+                                         nullptr));
+    ethash_light_delete(light);
+    struct ethash_full full = {nullptr, TEST_FULL_BYTES, data.data(),
+                               data.data(), TEST_FULL_BYTES};
+
+    ethash_h256_t header;
+    for (int i = 0; i < 32; i++) {
+        header.b[i] = i * 7 + 1;
+    }
+    uint64_t vHeader[4];
+    memcpy(vHeader, &header, sizeof(vHeader));
+
+    const uint64_t nStart = 0x0123456789abcdefULL;
+    for (uint64_t n = 0; n < 64; n++) {
+        ethash_return_value_t expected =
+            ethash_full_compute(&full, header, nStart + n);
+        const uint64_t nPrefix = ReadBE64(expected.result.b);
+
+        // A target equal to the hash prefix reports the nonce...
+        uint32_t vOutput[1 + 2 * CL_MAX_OUTPUTS] = {0};
+        cl_kernel::nGlobalId = n;
+        cl_kernel::ethash_search((const uint32_t *)data.data(),
+                                 TEST_FULL_BYTES / 128, vHeader, nStart,
+                                 nPrefix, vOutput);
+        BOOST_CHECK_EQUAL(vOutput[0], 1U);
+        BOOST_CHECK_EQUAL(vOutput[1] | (uint64_t(vOutput[2]) << 32),
+                          nStart + n);
+
+        // ... one below doesn't.
+        if (nPrefix > 0) {
+            memset(vOutput, 0, sizeof(vOutput));
+            cl_kernel::ethash_search((const uint32_t *)data.data(),
+                                     TEST_FULL_BYTES / 128, vHeader, nStart,
+                                     nPrefix - 1, vOutput);
+            BOOST_CHECK_EQUAL(vOutput[0], 0U);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
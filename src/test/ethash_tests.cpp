@@ -0,0 +1,409 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "ethash/internal.h"
+#include "ethash/sha3.h"
+#include "ethashcache.h"
+#include "ethashproof.h"
+#include "hash.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+#include "utilstrencodings.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(ethash_tests, BasicTestingSetup)
+
+namespace {
+// A tiny cache/DAG pair so the tests don't need the real gigabyte sizes.
+const uint64_t TEST_CACHE_BYTES = 64 * 1024;
+const uint64_t TEST_FULL_BYTES = 128 * 20000;
+
+struct TestLight {
+    ethash_light_t light;
+    TestLight() {
+        ethash_h256_t seed;
+        memset(&seed, 0x5a, sizeof(seed));
+        light = ethash_light_new_internal(TEST_CACHE_BYTES, &seed);
+    }
+    ~TestLight() { ethash_light_delete(light); }
+};
+
+unsigned nLastProgress = 0;
+int RecordProgress(unsigned progress) {
+    // progress must never go backwards, even with several workers
+    BOOST_CHECK(progress >= nLastProgress);
+    nLastProgress = progress;
+    return 0;
+}
+
+int AbortAtTenPercent(unsigned progress) {
+    return progress >= 10 ? 1 : 0;
+}
+
+int nLightsCreated = 0;
+ethash_light_t NewTestLight(uint64_t nBlockNumber) {
+    ++nLightsCreated;
+    ethash_h256_t seed = ethash_get_seedhash(nBlockNumber);
+    ethash_light_t light = ethash_light_new_internal(TEST_CACHE_BYTES, &seed);
+    light->block_number = nBlockNumber;
+    return light;
+}
+} // namespace
+
+BOOST_AUTO_TEST_CASE(parallel_dag_matches_serial) {
+    TestLight test;
+    BOOST_REQUIRE(test.light != nullptr);
+
+    std::vector<node> serial(TEST_FULL_BYTES / sizeof(node));
+    BOOST_CHECK(ethash_compute_full_data(serial.data(), TEST_FULL_BYTES,
+                                         test.light, nullptr));
+
+    for (unsigned nThreads : {0, 1, 2, 3, 8}) {
+        std::vector<node> parallel(TEST_FULL_BYTES / sizeof(node));
+        nLastProgress = 0;
+        BOOST_CHECK(ethash_compute_full_data_parallel(
+            parallel.data(), TEST_FULL_BYTES, test.light, RecordProgress,
+            nThreads));
+        BOOST_CHECK(memcmp(serial.data(), parallel.data(), TEST_FULL_BYTES) ==
+                    0);
+    }
+    BOOST_CHECK_EQUAL(nLastProgress, 100U);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_dag_abort) {
+    TestLight test;
+    BOOST_REQUIRE(test.light != nullptr);
+
+    std::vector<node> full(TEST_FULL_BYTES / sizeof(node));
+    BOOST_CHECK(!ethash_compute_full_data_parallel(
+        full.data(), TEST_FULL_BYTES, test.light, AbortAtTenPercent, 4));
+}
+
+BOOST_AUTO_TEST_CASE(kernels_match_scalar) {
+    TestLight test;
+    BOOST_REQUIRE(test.light != nullptr);
+
+    ethash_h256_t header;
+    memset(&header, 0x33, sizeof(header));
+    const char *previous = ethash_select_kernels();
+
+    BOOST_REQUIRE(ethash_set_kernels("scalar"));
+    std::vector<node> reference(TEST_FULL_BYTES / sizeof(node));
+    BOOST_CHECK(ethash_compute_full_data(reference.data(), TEST_FULL_BYTES,
+                                         test.light, nullptr));
+    ethash_return_value_t expected = ethash_light_compute_internal(
+        test.light, TEST_FULL_BYTES, header, 42);
+    BOOST_CHECK(expected.success);
+
+    for (const char *name : {"sse4.1", "avx2", "neon"}) {
+        if (!ethash_set_kernels(name)) {
+            // not available on this CPU
+            continue;
+        }
+        std::vector<node> full(TEST_FULL_BYTES / sizeof(node));
+        BOOST_CHECK(ethash_compute_full_data(full.data(), TEST_FULL_BYTES,
+                                             test.light, nullptr));
+        BOOST_CHECK(memcmp(reference.data(), full.data(), TEST_FULL_BYTES) ==
+                    0);
+
+        ethash_return_value_t ret = ethash_light_compute_internal(
+            test.light, TEST_FULL_BYTES, header, 42);
+        BOOST_CHECK(ret.success);
+        BOOST_CHECK(EthashEquals(ret.result, expected.result));
+        BOOST_CHECK(EthashEquals(ret.mix_hash, expected.mix_hash));
+    }
+
+    BOOST_CHECK(!ethash_set_kernels("unknown"));
+    BOOST_CHECK(ethash_set_kernels(previous));
+}
+
+BOOST_AUTO_TEST_CASE(keccak_matches_generic) {
+    TestLight test;
+    BOOST_REQUIRE(test.light != nullptr);
+    const char *previous = ethash_select_keccak();
+
+    std::vector<uint8_t> vInput(300);
+    for (size_t i = 0; i < vInput.size(); i++) {
+        vInput[i] = i * 13 + 7;
+    }
+
+    BOOST_REQUIRE(ethash_set_keccak("generic"));
+    std::vector<std::vector<uint8_t>> vExpected;
+    for (size_t nLen = 0; nLen < vInput.size(); nLen++) {
+        std::vector<uint8_t> vHash(64 + 32);
+        SHA3_512(vHash.data(), vInput.data(), nLen);
+        SHA3_256((ethash_h256_t *)&vHash[64], vInput.data(), nLen);
+        vExpected.push_back(vHash);
+    }
+    std::vector<node> reference(TEST_FULL_BYTES / sizeof(node));
+    BOOST_CHECK(ethash_compute_full_data(reference.data(), TEST_FULL_BYTES,
+                                         test.light, nullptr));
+
+    for (const char *name : {"generic", "opt64", "avx2", "armv8-sha3"}) {
+        if (!ethash_set_keccak(name)) {
+            // not available on this CPU
+            continue;
+        }
+
+        // Keccak-256 with the original 0x01 padding, not FIPS 202 SHA3-256
+        ethash_h256_t empty;
+        SHA3_256(&empty, nullptr, 0);
+        BOOST_CHECK_EQUAL(HexStr(empty.b, empty.b + 32),
+                          "c5d2460186f7233c927e7db2dcc703c0"
+                          "e500b653ca82273b7bfad8045d85a470");
+
+        for (size_t nLen = 0; nLen < vInput.size(); nLen++) {
+            std::vector<uint8_t> vHash(64 + 32);
+            SHA3_512(vHash.data(), vInput.data(), nLen);
+            SHA3_256((ethash_h256_t *)&vHash[64], vInput.data(), nLen);
+            BOOST_CHECK(vHash == vExpected[nLen]);
+        }
+
+        // Four at a time, in place, across the one block limit
+        for (size_t nLen : {0, 40, 64, 71, 72, 100}) {
+            std::vector<uint8_t> vBuffers(4 * 100);
+            uint8_t *out[4];
+            const uint8_t *in[4];
+            for (int k = 0; k < 4; k++) {
+                memcpy(&vBuffers[k * 100], &vInput[k * 20], 100);
+                out[k] = &vBuffers[k * 100];
+                in[k] = &vBuffers[k * 100];
+            }
+            sha3_512_x4(out, in, nLen);
+            for (int k = 0; k < 4; k++) {
+                uint8_t expected[64];
+                SHA3_512(expected, &vInput[k * 20], nLen);
+                BOOST_CHECK(memcmp(out[k], expected, 64) == 0);
+            }
+        }
+
+        std::vector<node> full(TEST_FULL_BYTES / sizeof(node));
+        BOOST_CHECK(ethash_compute_full_data(full.data(), TEST_FULL_BYTES,
+                                             test.light, nullptr));
+        BOOST_CHECK(memcmp(reference.data(), full.data(), TEST_FULL_BYTES) ==
+                    0);
+    }
+
+    BOOST_CHECK(!ethash_set_keccak("unknown"));
+    BOOST_CHECK(ethash_set_keccak(previous));
+}
+
+BOOST_AUTO_TEST_CASE(full_search_matches_compute) {
+    TestLight test;
+    BOOST_REQUIRE(test.light != nullptr);
+
+    std::vector<node> data(TEST_FULL_BYTES / sizeof(node));
+    BOOST_CHECK(ethash_compute_full_data(data.data(), TEST_FULL_BYTES,
+                                         test.light, nullptr));
+    struct ethash_full full = {nullptr, TEST_FULL_BYTES, data.data(),
+                               data.data(), TEST_FULL_BYTES};
+
+    ethash_h256_t header;
+    memset(&header, 0x44, sizeof(header));
+    // Roughly one nonce in 64 meets this boundary.
+    ethash_h256_t boundary;
+    memset(&boundary, 0xff, sizeof(boundary));
+    boundary.b[0] = 0x03;
+
+    // The first nonce from 1000 on that meets the boundary, one at a time.
+    uint64_t nExpected = 1000;
+    ethash_return_value_t expected;
+    while (true) {
+        expected = ethash_full_compute(&full, header, nExpected);
+        if (ethash_check_difficulty(&expected.result, &boundary)) {
+            break;
+        }
+        nExpected++;
+    }
+
+    // The search must find the same nonce whatever lane it lands in.
+    for (uint64_t nStart = 1000; nStart <= nExpected; nStart++) {
+        uint64_t nNonce = 0;
+        ethash_return_value_t ret;
+        BOOST_CHECK(ethash_full_search(&full, header, boundary, nStart,
+                                       nExpected - nStart + 1, &nNonce, &ret));
+        BOOST_CHECK_EQUAL(nNonce, nExpected);
+        BOOST_CHECK(EthashEquals(ret.result, expected.result));
+        BOOST_CHECK(EthashEquals(ret.mix_hash, expected.mix_hash));
+    }
+
+    // Stopping one nonce short finds nothing.
+    uint64_t nNonce = 0;
+    ethash_return_value_t ret;
+    BOOST_CHECK(!ethash_full_search(&full, header, boundary, 1000,
+                                    nExpected - 1000, &nNonce, &ret));
+    BOOST_CHECK(!ethash_full_search(&full, header, boundary, 1000, 0, &nNonce,
+                                    &ret));
+}
+
+BOOST_AUTO_TEST_CASE(dag_commitment_proof) {
+    TestLight test;
+    BOOST_REQUIRE(test.light != nullptr);
+
+    std::vector<node> data(TEST_FULL_BYTES / sizeof(node));
+    BOOST_CHECK(ethash_compute_full_data(data.data(), TEST_FULL_BYTES,
+                                         test.light, nullptr));
+    struct ethash_full full = {nullptr, TEST_FULL_BYTES, data.data(),
+                               data.data(), TEST_FULL_BYTES};
+    const uint8_t *pDag = data[0].bytes;
+    const uint64_t nPages = TEST_FULL_BYTES / ETHASH_MIX_BYTES;
+
+    // Over more pages than a chunk, the commitment is the Merkle tree of the
+    // page hashes, whatever the chunk size.
+    std::vector<uint256> vLeaves;
+    for (uint64_t i = 0; i < nPages; i++) {
+        vLeaves.push_back(DagPageHash(pDag + i * ETHASH_MIX_BYTES));
+    }
+    CDagCommitment commitment(pDag, nPages);
+    CDagCommitment small(pDag, nPages, 4);
+    BOOST_CHECK(commitment.GetRoot() == ComputeMerkleRoot(vLeaves));
+    BOOST_CHECK(small.GetRoot() == commitment.GetRoot());
+    for (uint32_t nIndex : {0, 1, 15, 16, 1025, int(nPages) - 1}) {
+        std::vector<uint256> vBranch = ComputeMerkleBranch(vLeaves, nIndex);
+        BOOST_CHECK(commitment.GetBranch(nIndex) == vBranch);
+        BOOST_CHECK(small.GetBranch(nIndex) == vBranch);
+        BOOST_CHECK_EQUAL(vBranch.size(), DagCommitmentDepth(nPages));
+    }
+
+    ethash_h256_t header;
+    memset(&header, 0x44, sizeof(header));
+    const uint64_t nNonce = 7;
+    ethash_return_value_t expected = ethash_full_compute(&full, header, nNonce);
+    CEthashProof proof;
+    ethash_return_value_t ret = commitment.Prove(header, nNonce, proof);
+    BOOST_CHECK(ret.success);
+    BOOST_CHECK(EthashEquals(ret.result, expected.result));
+    BOOST_CHECK(EthashEquals(ret.mix_hash, expected.mix_hash));
+    BOOST_REQUIRE_EQUAL(proof.vPages.size(), ETHASH_ACCESSES);
+
+    // The client gets the proof serialized.
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << proof;
+    CEthashProof received;
+    ss >> received;
+    const uint256 &root = commitment.GetRoot();
+    BOOST_CHECK(VerifyEthashProof(received, root, TEST_FULL_BYTES, header,
+                                  nNonce, ret));
+    BOOST_CHECK(EthashEquals(ret.result, expected.result));
+    BOOST_CHECK(EthashEquals(ret.mix_hash, expected.mix_hash));
+
+    // Another nonce reads other pages.
+    BOOST_CHECK(!VerifyEthashProof(received, root, TEST_FULL_BYTES, header,
+                                   nNonce + 1, ret));
+    // Another DAG.
+    BOOST_CHECK(!VerifyEthashProof(received, uint256(), TEST_FULL_BYTES,
+                                   header, nNonce, ret));
+
+    CEthashProof tampered = received;
+    tampered.vPages[10].vchPage[0] ^= 1;
+    BOOST_CHECK(!VerifyEthashProof(tampered, root, TEST_FULL_BYTES, header,
+                                   nNonce, ret));
+    tampered = received;
+    tampered.vPages[10].vBranch.pop_back();
+    BOOST_CHECK(!VerifyEthashProof(tampered, root, TEST_FULL_BYTES, header,
+                                   nNonce, ret));
+    tampered = received;
+    tampered.vPages.pop_back();
+    BOOST_CHECK(!VerifyEthashProof(tampered, root, TEST_FULL_BYTES, header,
+                                   nNonce, ret));
+}
+
+BOOST_AUTO_TEST_CASE(network_params) {
+    // The default sizes come from the precomputed tables.
+    BOOST_CHECK_EQUAL(ethash_get_epoch_length(), ETHASH_EPOCH_LENGTH);
+    BOOST_CHECK_EQUAL(ethash_get_cachesize(0), 16776896U);
+    BOOST_CHECK_EQUAL(ethash_get_datasize(ETHASH_EPOCH_LENGTH), 1082130304U);
+
+    // Those of regtest are computed the same way: the largest prime number
+    // of items below the size of the epoch.
+    SelectParams(CBaseChainParams::REGTEST);
+    const Consensus::Params &params = Params().GetConsensus();
+    BOOST_CHECK_EQUAL(ethash_get_epoch_length(), params.nEthashEpochLength);
+    BOOST_CHECK_EQUAL(ethash_get_cachesize(0), 13U * ETHASH_HASH_BYTES);
+    BOOST_CHECK_EQUAL(ethash_get_cachesize(params.nEthashEpochLength),
+                      17U * ETHASH_HASH_BYTES);
+    BOOST_CHECK_EQUAL(ethash_get_datasize(0), 251U * ETHASH_MIX_BYTES);
+    BOOST_CHECK_EQUAL(ethash_get_datasize(params.nEthashEpochLength - 1),
+                      251U * ETHASH_MIX_BYTES);
+
+    // The regtest genesis block is mined against them.
+    const CBlock &genesis = Params().GenesisBlock();
+    ethash_light_t light = ethash_light_new(0);
+    BOOST_REQUIRE(light);
+    ethash_return_value_t ret = ethash_light_compute(
+        light, genesis.GetBaseEthash(), genesis.nNonce);
+    ethash_light_delete(light);
+    BOOST_CHECK(ret.success);
+    BOOST_CHECK(memcmp(&ret.mix_hash, &genesis.hashMix,
+                       sizeof(ret.mix_hash)) == 0);
+
+    SelectParams(CBaseChainParams::MAIN);
+    BOOST_CHECK_EQUAL(ethash_get_epoch_length(), ETHASH_EPOCH_LENGTH);
+    BOOST_CHECK_EQUAL(ethash_get_cachesize(0), 16776896U);
+}
+
+BOOST_AUTO_TEST_CASE(light_cache_shares_epochs) {
+    CEthashLightCache cache(2, NewTestLight);
+    nLightsCreated = 0;
+
+    EthashLightRef first = cache.Get(1);
+    BOOST_REQUIRE(first);
+    BOOST_CHECK_EQUAL(first->block_number, 0U);
+    // Any height in the same epoch maps to the same cache
+    BOOST_CHECK(cache.Get(ethash_get_epoch_length() - 1) == first);
+    BOOST_CHECK(cache.GetIfCached(0) == first);
+    BOOST_CHECK_EQUAL(nLightsCreated, 1);
+
+    EthashLightRef second = cache.Get(ethash_get_epoch_length());
+    BOOST_CHECK(second && second != first);
+    BOOST_CHECK_EQUAL(second->block_number, ethash_get_epoch_length());
+    BOOST_CHECK_EQUAL(cache.Size(), 2U);
+    BOOST_CHECK_EQUAL(nLightsCreated, 2);
+}
+
+BOOST_AUTO_TEST_CASE(light_cache_lru_eviction) {
+    CEthashLightCache cache(2, NewTestLight);
+    nLightsCreated = 0;
+
+    EthashLightRef epoch0 = cache.Get(0);
+    cache.Get(ethash_get_epoch_length());
+    // Touch epoch 0 so that epoch 1 becomes the least recently used
+    cache.Get(0);
+    cache.Get(2 * ethash_get_epoch_length());
+    BOOST_CHECK_EQUAL(cache.Size(), 2U);
+    BOOST_CHECK(cache.GetIfCached(0));
+    BOOST_CHECK(!cache.GetIfCached(ethash_get_epoch_length()));
+    BOOST_CHECK(cache.GetIfCached(2 * ethash_get_epoch_length()));
+
+    // An evicted cache stays valid for whoever still references it
+    cache.SetMaxEpochs(1);
+    BOOST_CHECK_EQUAL(cache.Size(), 1U);
+    BOOST_CHECK(!cache.GetIfCached(0));
+    BOOST_CHECK_EQUAL(epoch0->block_number, 0U);
+    BOOST_CHECK(epoch0->cache != nullptr);
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+    BOOST_CHECK_EQUAL(nLightsCreated, 3);
+}
+
+BOOST_AUTO_TEST_CASE(light_cache_failure_not_cached) {
+    int nCalls = 0;
+    CEthashLightCache cache(2, [&nCalls](uint64_t) -> ethash_light_t {
+        ++nCalls;
+        return nullptr;
+    });
+    BOOST_CHECK(!cache.Get(0));
+    BOOST_CHECK(!cache.Get(0));
+    BOOST_CHECK_EQUAL(nCalls, 2);
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
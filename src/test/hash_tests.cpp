@@ -3,6 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "hash.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "streams.h"
 #include "test/test_bitcoin.h"
 #include "utilstrencodings.h"
 
@@ -198,4 +201,77 @@ BOOST_AUTO_TEST_CASE(hashverifier_tests) {
     BOOST_CHECK(h1.GetHash() != checksum);
 }
 
+BOOST_AUTO_TEST_CASE(ethashwriter_tests) {
+    // Any split of the input gives the one shot hash, including splits
+    // right at the 136 byte rate.
+    std::vector<uint8_t> data(500);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = i * 31 + 5;
+    }
+    for (size_t nLen : {0, 1, 135, 136, 137, 272, 500}) {
+        ethash_h256_t expected;
+        SHA3_256(&expected, data.data(), nLen);
+        for (size_t nChunk : {1, 7, 136, 500}) {
+            CEthashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+            for (size_t i = 0; i < nLen; i += nChunk) {
+                ss.write((const char *)&data[i], std::min(nChunk, nLen - i));
+            }
+            BOOST_CHECK(EthashEquals(ss.GetEthash(), expected));
+        }
+    }
+
+    CBlockHeader header;
+    header.nVersion = 0x20000000;
+    header.hashPrevBlock = GetRandHash();
+    header.hashMerkleRoot = GetRandHash();
+    header.nBlockHeight = 12345;
+    header.nTime = 1514764800;
+    header.nChainInterest = 987654321;
+    header.nBits = 0x1d00ffff;
+    header.hashMix = {{0xab}};
+    header.nNonce = 0x0123456789abcdefULL;
+
+    CDataStream ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << header;
+    ethash_h256_t expected;
+    SHA3_256(&expected, (const uint8_t *)ss.data(), ss.size());
+    BOOST_CHECK(EthashEquals(header.GetEthash(), expected));
+
+    // The mined header hash leaves out hashMix and nNonce
+    const ethash_h256_t base = header.GetBaseEthash();
+    BOOST_CHECK(EthashEquals(base, CBlockHeaderBase(header).GetEthash()));
+    header.nNonce++;
+    header.hashMix = {{0xcd}};
+    BOOST_CHECK(EthashEquals(header.GetBaseEthash(), base));
+    header.nTime++;
+    BOOST_CHECK(!EthashEquals(header.GetBaseEthash(), base));
+}
+
+BOOST_AUTO_TEST_CASE(block_header_cached_hash) {
+    CBlockHeader header;
+    header.nBits = 0x1d00ffff;
+    header.nNonce = 42;
+    header.hashMerkleRoot = GetRandHash();
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << header;
+    CBlockHeader read;
+    ss >> read;
+    BOOST_CHECK(read.GetHash() == SerializeHash(header));
+
+    // A field that changes after the hash was cached is hashed again.
+    read.nNonce++;
+    header.nNonce++;
+    BOOST_CHECK(read.GetHash() == SerializeHash(header));
+    read.hashMix.b[0] ^= 1;
+    header.hashMix.b[0] ^= 1;
+    BOOST_CHECK(read.GetHash() == SerializeHash(header));
+
+    // Copies keep it.
+    read.CacheHash();
+    const CBlock block(read);
+    BOOST_CHECK(block.GetHash() == SerializeHash(header));
+    BOOST_CHECK(block.GetBlockHeader().GetHash() == SerializeHash(header));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,193 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "interest.h"
+#include "random.h"
+
+#include "test/test_bitcoin.h"
+
+#include <cmath>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(interest_tests, BasicTestingSetup)
+
+// Walk the decay periods one by one, the way the rates used to be found.
+static double SlowInterestRate(const CChainParams &params, int nLevel,
+                               CAmount nInterestLeft, CAmount &nPeriodStart) {
+    double rate = params.LockInterestRate(nLevel);
+    CAmount nTarget = params.TotalInterest();
+    nPeriodStart = nTarget;
+    decayByOneTenth(nTarget);
+    while (nInterestLeft <= nTarget) {
+        rate *= params.DecayRatio();
+        nPeriodStart = nTarget;
+        decayByOneTenth(nTarget);
+    }
+    return rate;
+}
+
+BOOST_AUTO_TEST_CASE(interest_table_matches_decay) {
+    const CChainParams &params = Params();
+    const CInterestTable &table = params.InterestTable();
+
+    std::vector<CAmount> vLeft;
+    CAmount nStart = params.TotalInterest();
+    while (nStart >= 1000) {
+        vLeft.push_back(nStart);
+        vLeft.push_back(nStart - 1);
+        vLeft.push_back(nStart + 1);
+        vLeft.push_back(nStart / 2 + nStart / 3);
+        decayByOneTenth(nStart);
+    }
+    for (CAmount nLeft : vLeft) {
+        if (nLeft > CAmount(params.TotalInterest())) {
+            continue;
+        }
+        size_t nPeriod = table.GetPeriod(nLeft);
+        for (int nLevel = 0; nLevel < 7; nLevel++) {
+            CAmount nPeriodStart;
+            double rate = SlowInterestRate(params, nLevel, nLeft, nPeriodStart);
+            BOOST_CHECK_EQUAL(table.GetRate(nLevel, nPeriod), rate);
+            BOOST_CHECK_EQUAL(table.GetPeriodStart(nPeriod), nPeriodStart);
+        }
+    }
+    BOOST_CHECK_EQUAL(table.GetPeriod(params.TotalInterest()), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(interest_history) {
+    const CChainParams &params = Params();
+    const CInterestTable &table = params.InterestTable();
+    const CAmount nTotal = params.TotalInterest();
+    CInterestHistory history(table, nTotal);
+    BOOST_CHECK_EQUAL(history.Height(), -1);
+
+    // Blocks 0 and 1 pay nothing, block 2 brings the interest left to the
+    // start of period 1 and block 3 pays out the rest.
+    const uint64_t nPeriod1 = nTotal - table.GetPeriodStart(1);
+    history.Append(0);
+    history.Append(0);
+    history.Append(nPeriod1);
+    history.Append(nTotal);
+    BOOST_CHECK_EQUAL(history.Height(), 3);
+
+    uint64_t nChainInterest;
+    BOOST_CHECK(history.GetChainInterest(2, nChainInterest));
+    BOOST_CHECK_EQUAL(nChainInterest, nPeriod1);
+    BOOST_CHECK(!history.GetChainInterest(4, nChainInterest));
+    BOOST_CHECK(!history.GetChainInterest(-1, nChainInterest));
+
+    const std::vector<CInterestHistory::PeriodStart> &vStarts =
+        history.GetPeriodStarts();
+    BOOST_CHECK_EQUAL(vStarts.size(), 3U);
+    CInterestHistory::PeriodStart start;
+    BOOST_CHECK(!history.GetPeriod(0, start));
+    BOOST_CHECK(history.GetPeriod(2, start));
+    BOOST_CHECK_EQUAL(start.nHeight, 1);
+    BOOST_CHECK_EQUAL(start.nPeriod, 0);
+    BOOST_CHECK(history.GetPeriod(3, start));
+    BOOST_CHECK_EQUAL(start.nHeight, 3);
+    BOOST_CHECK_EQUAL(start.nPeriod, 1);
+    BOOST_CHECK(history.GetPeriod(4, start));
+    BOOST_CHECK_EQUAL(start.nPeriod, CInterestHistory::NO_PERIOD);
+    BOOST_CHECK(!history.GetPeriod(5, start));
+
+    // Disconnecting block 2 takes the start of period 1 along.
+    history.Truncate(1);
+    BOOST_CHECK_EQUAL(history.Height(), 1);
+    BOOST_CHECK_EQUAL(history.GetPeriodStarts().size(), 1U);
+    BOOST_CHECK(history.GetPeriod(2, start));
+    BOOST_CHECK_EQUAL(start.nPeriod, 0);
+}
+
+BOOST_AUTO_TEST_CASE(interest_table_levels) {
+    const CChainParams &params = Params();
+    const CInterestTable &table = params.InterestTable();
+
+    BOOST_CHECK_EQUAL(table.GetLevel(0), -1);
+    BOOST_CHECK_EQUAL(
+        table.GetLevel(params.LockInterestBlocksThreshould(0) - 1), -1);
+    for (int nLevel = 0; nLevel < 7; nLevel++) {
+        int nBlocks = params.LockInterestBlocksThreshould(nLevel);
+        BOOST_CHECK_EQUAL(table.GetLevel(nBlocks), nLevel);
+        if (nLevel < 6) {
+            BOOST_CHECK_EQUAL(
+                table.GetLevel(params.LockInterestBlocksThreshould(nLevel + 1) -
+                               1),
+                nLevel);
+        }
+    }
+    BOOST_CHECK_EQUAL(table.GetLevel(100000000), 6);
+}
+
+BOOST_AUTO_TEST_CASE(interest_multiplier_rounding) {
+    FastRandomContext rand(true);
+    for (int i = 0; i < 100000; i++) {
+        // Random doubles well inside the normal range.
+        const double a = std::ldexp(double(rand.randbits(53) | 1),
+                                    int(rand.randrange(80)) - 120);
+        const double b = std::ldexp(double(rand.randbits(53) | 1),
+                                    int(rand.randrange(80)) - 120);
+        const uint32_t n = rand.rand32() | 1;
+        const uint64_t m = rand.rand64() >> rand.randrange(64);
+
+        BOOST_CHECK_EQUAL(CInterestMultiplier(a).ToDouble(), a);
+        BOOST_CHECK_EQUAL(
+            (CInterestMultiplier(a) * CInterestMultiplier(b)).ToDouble(),
+            a * b);
+        BOOST_CHECK_EQUAL((CInterestMultiplier(a) / n).ToDouble(), a / n);
+        BOOST_CHECK_EQUAL(CInterestMultiplier(m).ToDouble(), double(m));
+
+        const CAmount principal = rand.rand64() >> (8 + rand.randrange(56));
+        const double u = std::ldexp(double(rand.randbits(53) | 1),
+                                    -52 - int(rand.randrange(60)));
+        BOOST_CHECK_EQUAL(CInterestMultiplier(u).Apply(principal),
+                          static_cast<CAmount>(std::round(principal * u)));
+        BOOST_CHECK_EQUAL(CInterestMultiplier(u).Apply(-principal),
+                          static_cast<CAmount>(std::round(-principal * u)));
+    }
+
+    // Exact halves round away from zero.
+    BOOST_CHECK_EQUAL(CInterestMultiplier(0.5).Apply(1), 1);
+    BOOST_CHECK_EQUAL(CInterestMultiplier(0.5).Apply(3), 2);
+    BOOST_CHECK_EQUAL(CInterestMultiplier(0.5).Apply(-3), -2);
+    BOOST_CHECK_EQUAL(CInterestMultiplier(0.25).Apply(1), 0);
+    BOOST_CHECK_EQUAL(CInterestMultiplier(0.0).Apply(COIN), 0);
+}
+
+BOOST_AUTO_TEST_CASE(interest_matches_double) {
+    FastRandomContext rand(true);
+    for (const std::string &chain :
+         {CBaseChainParams::MAIN, CBaseChainParams::REGTEST}) {
+        const CChainParams &params = Params(chain);
+        // Regtest pays no interest, but its rates are the largest.
+        Consensus::Params consensus = params.GetConsensus();
+        consensus.nTotalInterest = Params(CBaseChainParams::MAIN).TotalInterest();
+        const CInterestTable table(consensus);
+
+        for (size_t nPeriod = 0; nPeriod < 300; nPeriod += 7) {
+            for (int i = 0; i < 1000; i++) {
+                const CAmount principal =
+                    rand.randrange(MAX_MONEY >> (7 + rand.randrange(40))) + 1;
+                const uint32_t nLock = rand.randrange(
+                    params.LockInterestBlocksThreshould(7) * 2);
+
+                // The double arithmetic interest used to be computed with
+                const int nAdjusted =
+                    params.AdjustToLockInterestThreshold(nLock);
+                const int nLevel = table.GetLevel(nAdjusted);
+                const double rate =
+                    nLevel < 0 ? 0 : table.GetRate(nLevel, nPeriod);
+                const double unitInterest = rate * uint32_t(nAdjusted) /
+                                            params.BlocksInterestInterval();
+                BOOST_CHECK_EQUAL(
+                    table.GetInterest(principal, nLock, nPeriod),
+                    static_cast<CAmount>(std::round(principal * unitInterest)));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,6 +2,8 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chain.h"
+#include "chainparams.h"
 #include "policy/policy.h"
 #include "txmempool.h"
 #include "util.h"
@@ -136,6 +138,65 @@ BOOST_AUTO_TEST_CASE(MempoolClearTest) {
     BOOST_CHECK_EQUAL(testPool.vTxHashes.size(), 0UL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolEventsTest) {
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = CAmount(33000LL);
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txParent.GetId();
+    txChild.vin[0].prevout.n = 0;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = CAmount(11000LL);
+
+    CTxMemPool testPool(CFeeRate(CAmount(0)));
+    const uint64_t nStart = testPool.GetSequence();
+    std::vector<CMemPoolEvent> vEvents;
+    BOOST_CHECK(testPool.GetEventsSince(nStart, 10, vEvents));
+    BOOST_CHECK(vEvents.empty());
+
+    testPool.addUnchecked(txParent.GetId(), entry.FromTx(txParent));
+    testPool.addUnchecked(txChild.GetId(), entry.FromTx(txChild));
+    std::vector<uint256> vtxid;
+    uint64_t nSequence;
+    testPool.queryHashes(vtxid, &nSequence);
+    BOOST_CHECK_EQUAL(vtxid.size(), 2UL);
+    BOOST_CHECK_EQUAL(nSequence, nStart + 2);
+
+    // Removing the parent takes the child with it.
+    testPool.removeRecursive(txParent, MemPoolRemovalReason::CONFLICT);
+    BOOST_CHECK(testPool.GetEventsSince(nStart, 10, vEvents));
+    BOOST_REQUIRE_EQUAL(vEvents.size(), 4UL);
+    BOOST_CHECK(vEvents[0].fAdded && vEvents[0].txid == txParent.GetId());
+    BOOST_CHECK(vEvents[1].fAdded && vEvents[1].txid == txChild.GetId());
+    for (size_t i = 0; i < vEvents.size(); i++) {
+        BOOST_CHECK_EQUAL(vEvents[i].nSequence, nStart + i + 1);
+    }
+    BOOST_CHECK(!vEvents[2].fAdded && !vEvents[3].fAdded);
+    BOOST_CHECK(vEvents[3].reason == MemPoolRemovalReason::CONFLICT);
+
+    // From the middle, and up to a count.
+    vEvents.clear();
+    BOOST_CHECK(testPool.GetEventsSince(nSequence, 1, vEvents));
+    BOOST_REQUIRE_EQUAL(vEvents.size(), 1UL);
+    BOOST_CHECK_EQUAL(vEvents[0].nSequence, nSequence + 1);
+
+    // Numbers that aren't of this mempool, or from before a clear.
+    vEvents.clear();
+    BOOST_CHECK(!testPool.GetEventsSince(nStart - 1, 10, vEvents));
+    BOOST_CHECK(!testPool.GetEventsSince(nStart + 5, 10, vEvents));
+    testPool.clear();
+    BOOST_CHECK(!testPool.GetEventsSince(nStart, 10, vEvents));
+    BOOST_CHECK(testPool.GetEventsSince(testPool.GetSequence(), 10, vEvents));
+    BOOST_CHECK(vEvents.empty());
+}
+
 template <typename name>
 void CheckSort(CTxMemPool &pool, std::vector<std::string> &sortedOrder) {
     BOOST_CHECK_EQUAL(pool.size(), sortedOrder.size());
@@ -147,6 +208,69 @@ void CheckSort(CTxMemPool &pool, std::vector<std::string> &sortedOrder) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(MempoolContentUsageTest) {
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx.vout[0].nValue = CAmount(33000LL);
+
+    CTxMemPool pool(CFeeRate(CAmount(0)));
+    pool.addUnchecked(tx.GetId(), entry.FromTx(tx));
+    size_t nUsage = pool.DynamicMemoryUsage();
+    pool.clear();
+
+    // The content of the outputs counts towards the pool's memory.
+    tx.vout[0].strContent = std::string(100000, 'x');
+    pool.addUnchecked(tx.GetId(), entry.FromTx(tx));
+    BOOST_CHECK_GE(pool.DynamicMemoryUsage(), nUsage + 100000);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolContentLimitTest) {
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool(CFeeRate(CAmount(0)));
+
+    // Two uploads at different feerates and a payment paying less than both.
+    CMutableTransaction txCheap;
+    txCheap.vin.resize(1);
+    txCheap.vin[0].scriptSig = CScript() << OP_11;
+    txCheap.vout.resize(1);
+    txCheap.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txCheap.vout[0].nValue = 10 * COIN;
+    txCheap.vout[0].strContent = std::string(10000, 'x');
+    pool.addUnchecked(txCheap.GetId(),
+                      entry.Fee(CAmount(20000LL)).FromTx(txCheap));
+
+    CMutableTransaction txDear = txCheap;
+    txDear.vin[0].scriptSig = CScript() << OP_12;
+    pool.addUnchecked(txDear.GetId(),
+                      entry.Fee(CAmount(50000LL)).FromTx(txDear));
+
+    CMutableTransaction txPayment;
+    txPayment.vin.resize(1);
+    txPayment.vin[0].scriptSig = CScript() << OP_13;
+    txPayment.vout.resize(1);
+    txPayment.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txPayment.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(txPayment.GetId(),
+                      entry.Fee(CAmount(1000LL)).FromTx(txPayment));
+    BOOST_CHECK_EQUAL(pool.GetTotalContentSize(), 20000UL);
+
+    // Within the limit nothing goes.
+    pool.TrimContentToSize(20000);
+    BOOST_CHECK_EQUAL(pool.size(), 3UL);
+
+    // Over it the cheapest upload goes, the payment stays.
+    pool.TrimContentToSize(15000);
+    BOOST_CHECK_EQUAL(pool.size(), 2UL);
+    BOOST_CHECK(!pool.exists(txCheap.GetId()));
+    BOOST_CHECK(pool.exists(txDear.GetId()));
+    BOOST_CHECK(pool.exists(txPayment.GetId()));
+    BOOST_CHECK_EQUAL(pool.GetTotalContentSize(), 10000UL);
+}
+
 BOOST_AUTO_TEST_CASE(MempoolIndexingTest) {
     CTxMemPool pool(CFeeRate(CAmount(0)));
     TestMemPoolEntryHelper entry;
@@ -479,6 +603,64 @@ BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest) {
     CheckSort<ancestor_score>(pool, sortedOrder);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolInterestPeriodTest) {
+    TestMemPoolEntryHelper entry;
+    // A deposit claiming interest, a child spending it, and an unrelated
+    // transaction without interest.
+    CMutableTransaction txDeposit;
+    txDeposit.vin.resize(1);
+    txDeposit.vin[0].scriptSig = CScript() << OP_11;
+    txDeposit.vout.resize(1);
+    txDeposit.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txDeposit.vout[0].nPrincipal = 10 * COIN;
+    txDeposit.vout[0].nValue = 11 * COIN;
+    txDeposit.vout[0].nLockTime = 1000;
+
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txDeposit.GetId();
+    txChild.vin[0].prevout.n = 0;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 11 * COIN;
+
+    CMutableTransaction txPlain;
+    txPlain.vin.resize(1);
+    txPlain.vin[0].scriptSig = CScript() << OP_12;
+    txPlain.vout.resize(1);
+    txPlain.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txPlain.vout[0].nValue = 10 * COIN;
+
+    CTxMemPool pool(CFeeRate(CAmount(0)));
+    pool.addUnchecked(txDeposit.GetId(), entry.FromTx(txDeposit));
+    pool.addUnchecked(txChild.GetId(), entry.FromTx(txChild));
+    pool.addUnchecked(txPlain.GetId(), entry.FromTx(txPlain));
+    BOOST_CHECK_EQUAL(pool.size(), 3UL);
+
+    // The child's package claims the interest of its parent.
+    const CAmount nDepositInterest = CTransaction(txDeposit).GetInterest();
+    BOOST_CHECK(nDepositInterest > 0);
+    BOOST_CHECK_EQUAL(
+        pool.mapTx.find(txChild.GetId())->GetInterestWithAncestors(),
+        nDepositInterest);
+    BOOST_CHECK_EQUAL(
+        pool.mapTx.find(txPlain.GetId())->GetInterestWithAncestors(), 0);
+
+    // Once all interest is paid out, the deposit can't be mined anymore and
+    // goes with its child.
+    CBlockIndex index;
+    index.nChainInterest = Params().TotalInterest();
+    pool.UpdateForInterestPeriod(&index);
+    BOOST_CHECK_EQUAL(pool.size(), 1UL);
+    BOOST_CHECK(pool.exists(txPlain.GetId()));
+
+    // Entries are only revalued when the interest period changes.
+    pool.addUnchecked(txDeposit.GetId(), entry.FromTx(txDeposit));
+    pool.UpdateForInterestPeriod(&index);
+    BOOST_CHECK(pool.exists(txDeposit.GetId()));
+}
+
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest) {
     CTxMemPool pool(CFeeRate(CAmount(1000)));
     TestMemPoolEntryHelper entry;
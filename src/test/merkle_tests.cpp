@@ -158,4 +158,30 @@ BOOST_AUTO_TEST_CASE(merkle_test) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(merkle_coinbase_branch) {
+    // The branch of the coinbase doesn't depend on the coinbase, the miner
+    // reuses it for every coinbase of a template.
+    for (int ntx = 1; ntx <= 17; ntx++) {
+        CBlock block;
+        block.vtx.resize(ntx);
+        for (int j = 0; j < ntx; j++) {
+            CMutableTransaction mtx;
+            mtx.vin.resize(1);
+            mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+            mtx.vin[0].scriptSig = CScript() << 0;
+            mtx.vout.resize(1);
+            mtx.vout[0].scriptPubKey = CScript() << 0;
+            mtx.vout[0].nValue = 1 * COIN;
+            block.vtx[j] = MakeTransactionRef(std::move(mtx));
+        }
+        const std::vector<uint256> vBranch = BlockMerkleBranch(block, 0);
+
+        CMutableTransaction coinbase(*block.vtx[0]);
+        coinbase.vin[0].scriptSig = CScript() << ntx;
+        block.vtx[0] = MakeTransactionRef(std::move(coinbase));
+        BOOST_CHECK(ComputeMerkleRootFromBranch(block.vtx[0]->GetId(), vBranch,
+                                                0) == BlockMerkleRoot(block));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
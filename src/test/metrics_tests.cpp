@@ -0,0 +1,57 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "metrics.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(metrics_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(metrics_histogram) {
+    CMetricHistogram histogram({1000, 10000});
+    histogram.Observe(500);
+    histogram.Observe(1000);
+    histogram.Observe(5000);
+    histogram.Observe(20000);
+
+    // Buckets are cumulative, a sample on a bound counts in its bucket.
+    BOOST_CHECK_EQUAL(histogram.ToPrometheus("t"),
+                      "t_bucket{le=\"0.001000\"} 2\n"
+                      "t_bucket{le=\"0.010000\"} 3\n"
+                      "t_bucket{le=\"+Inf\"} 4\n"
+                      "t_sum 0.026500\n"
+                      "t_count 4\n");
+}
+
+BOOST_AUTO_TEST_CASE(metrics_registry) {
+    CMetricsRegistry registry;
+    CMetricValue &tx = registry.Value(CMetricsRegistry::COUNTER, "bytes_total",
+                                      "Bytes.", "command=\"tx\"");
+    tx.Add(10);
+    tx.Add();
+    // The same name and labels give the same value.
+    BOOST_CHECK_EQUAL(&registry.Value(CMetricsRegistry::COUNTER,
+                                      "bytes_total", "Bytes.",
+                                      "command=\"tx\""),
+                      &tx);
+    registry.Value(CMetricsRegistry::COUNTER, "bytes_total", "Bytes.",
+                   "command=\"block\"")
+        .Add(5);
+    registry.Gauge("size", "Size.", []() { return 2.5; });
+    registry.Collector([]() { return std::string("other 1\n"); });
+
+    BOOST_CHECK_EQUAL(registry.ToPrometheus(),
+                      "# HELP bytes_total Bytes.\n"
+                      "# TYPE bytes_total counter\n"
+                      "bytes_total{command=\"block\"} 5\n"
+                      "bytes_total{command=\"tx\"} 11\n"
+                      "# HELP size Size.\n"
+                      "# TYPE size gauge\n"
+                      "size 2.5\n"
+                      "other 1\n");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -168,6 +168,21 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test) {
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(send_priority) {
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::CMPCTBLOCK),
+                      SEND_PRIORITY_BLOCK);
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::BLOCKTXN),
+                      SEND_PRIORITY_BLOCK);
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::HEADERS),
+                      SEND_PRIORITY_BLOCK);
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::PING),
+                      SEND_PRIORITY_CONTROL);
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::TX), SEND_PRIORITY_TX);
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::INV), SEND_PRIORITY_TX);
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::ADDR), SEND_PRIORITY_ADDR);
+    BOOST_CHECK_EQUAL(SendPriorityToString(SEND_PRIORITY_BLOCK), "block");
+}
+
 BOOST_AUTO_TEST_CASE(test_getSubVersionEB) {
     BOOST_CHECK_EQUAL(getSubVersionEB(13800000000), "13800.0");
     BOOST_CHECK_EQUAL(getSubVersionEB(3800000000), "3800.0");
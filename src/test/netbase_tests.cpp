@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "netbase.h"
+#include "banindex.h"
 #include "test/test_bitcoin.h"
 
 #include <string>
@@ -311,4 +312,55 @@ BOOST_AUTO_TEST_CASE(netbase_getgroup) {
         Vec8({NET_IPV6, 32, 1, 32, 1}));
 }
 
+BOOST_AUTO_TEST_CASE(ban_index) {
+    const char *bans[] = {"1.2.3.4",           "10.0.0.0/8",
+                          "192.168.1.0/24",    "172.16.0.0/255.255.0.255",
+                          "2001:db8::/32",     "2001:db9::1",
+                          "2001:dba::/ffff::"};
+    const char *ips[] = {"1.2.3.4",       "1.2.3.5",       "10.255.0.1",
+                         "11.0.0.1",      "192.168.1.200", "192.168.2.1",
+                         "172.16.9.0",    "172.16.9.1",    "2001:db8::1",
+                         "2001:db9::1",   "2001:db9::2",   "2001:ffff::1",
+                         "2002::1",       "::ffff:1.2.3.4"};
+
+    // Same as a match against each ban.
+    banmap_t banMap;
+    CBanIndex index;
+    for (const char *ban : bans) {
+        CBanEntry entry;
+        entry.nBanUntil = 1000;
+        banMap[ResolveSubNet(ban)] = entry;
+        index.Add(ResolveSubNet(ban), 1000);
+    }
+    BOOST_CHECK_EQUAL(index.Size(), banMap.size());
+    for (const char *ip : ips) {
+        CNetAddr addr = ResolveIP(ip);
+        bool fMatch = false;
+        for (const auto &ban : banMap) {
+            fMatch |= ban.first.Match(addr);
+        }
+        BOOST_CHECK_MESSAGE(index.IsBanned(addr, 999) == fMatch, ip);
+        // Expired
+        BOOST_CHECK(!index.IsBanned(addr, 1000));
+    }
+    BOOST_CHECK(!index.IsBanned(CNetAddr(), 0));
+
+    // A longer ban is kept, a shorter one doesn't shorten it.
+    index.Add(ResolveSubNet("10.0.0.0/8"), 2000);
+    index.Add(ResolveSubNet("10.0.0.0/8"), 1500);
+    BOOST_CHECK(index.IsBanned(ResolveIP("10.1.1.1"), 1999));
+    BOOST_CHECK(!index.IsBanned(ResolveIP("10.1.1.1"), 2000));
+
+    index.Remove(ResolveSubNet("10.0.0.0/8"));
+    BOOST_CHECK(!index.IsBanned(ResolveIP("10.1.1.1"), 0));
+    BOOST_CHECK(index.IsBanned(ResolveIP("1.2.3.4"), 0));
+    BOOST_CHECK_EQUAL(index.Size(), banMap.size() - 1);
+
+    index.Rebuild(banMap);
+    BOOST_CHECK(index.IsBanned(ResolveIP("10.1.1.1"), 0));
+    index.Clear();
+    BOOST_CHECK_EQUAL(index.Size(), 0);
+    BOOST_CHECK(!index.IsBanned(ResolveIP("1.2.3.4"), 0));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -79,6 +79,11 @@ BOOST_AUTO_TEST_CASE(pmt_test1) {
             CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
             ss << pmt1;
 
+            // the same tree from precomputed levels
+            CDataStream ssLevels(SER_NETWORK, PROTOCOL_VERSION);
+            ssLevels << CPartialMerkleTree(CMerkleTreeLevels(vTxid), vMatch);
+            BOOST_CHECK(ss.str() == ssLevels.str());
+
             // verify CPartialMerkleTree's size guarantees
             unsigned int n =
                 std::min<unsigned int>(nTx, 1 + vMatchTxid1.size() * nHeight);
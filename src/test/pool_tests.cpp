@@ -0,0 +1,112 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "support/allocators/pool.h"
+
+#include "coins.h"
+#include "memusage.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(pool_reuses_blocks) {
+    PoolResource<32, 8> resource(1024);
+
+    void *a = resource.Allocate(8, 8);
+    void *b = resource.Allocate(8, 8);
+    BOOST_CHECK(a != b);
+    BOOST_CHECK_EQUAL(resource.NumChunks(), 1U);
+
+    BOOST_CHECK_EQUAL(resource.NumFreeBytes(), 1024U - 16);
+
+    // Freed blocks come back first, for the same size only.
+    resource.Deallocate(a, 8, 8);
+    BOOST_CHECK_EQUAL(resource.NumFreeBytes(), 1024U - 8);
+    void *c = resource.Allocate(16, 8);
+    BOOST_CHECK(c != a);
+    BOOST_CHECK(resource.Allocate(8, 8) == a);
+
+    // Too large for the pool.
+    void *d = resource.Allocate(64, 8);
+    resource.Deallocate(d, 64, 8);
+    BOOST_CHECK_EQUAL(resource.NumChunks(), 1U);
+
+    resource.Deallocate(b, 8, 8);
+    resource.Deallocate(c, 16, 8);
+}
+
+BOOST_AUTO_TEST_CASE(pool_blocks_dont_overlap) {
+    PoolResource<64, 8> resource(256);
+    std::vector<std::pair<uint8_t *, size_t>> vBlocks;
+    std::set<uint8_t *> setBlocks;
+    for (int i = 0; i < 1000; i++) {
+        size_t nSize = 1 + insecure_rand() % 64;
+        uint8_t *p = static_cast<uint8_t *>(resource.Allocate(nSize, 8));
+        BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(p) % 8, 0U);
+        BOOST_CHECK(setBlocks.insert(p).second);
+        memset(p, i, nSize);
+        vBlocks.emplace_back(p, nSize);
+
+        if (insecure_rand() % 2) {
+            size_t n = insecure_rand() % vBlocks.size();
+            std::pair<uint8_t *, size_t> block = vBlocks[n];
+            vBlocks.erase(vBlocks.begin() + n);
+            setBlocks.erase(block.first);
+            resource.Deallocate(block.first, block.second, 8);
+        }
+    }
+
+    // Nothing written later to another block overwrote a live one.
+    for (size_t i = 0; i < vBlocks.size(); i++) {
+        uint8_t *p = vBlocks[i].first;
+        for (size_t j = 1; j < vBlocks[i].second; j++) {
+            BOOST_CHECK_EQUAL(p[j], p[0]);
+        }
+        resource.Deallocate(p, vBlocks[i].second, 8);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(pool_coins_map) {
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map(0, SaltedOutpointHasher(), CCoinsMap::key_equal(),
+                  CCoinsMapAllocator(&resource));
+    BOOST_CHECK_EQUAL(resource.NumChunks(), 0U);
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        CCoinsCacheEntry &entry = map[COutPoint(GetRandHash(), i)];
+        entry.coin = Coin(CTxOut(i, CScript()), 1, false);
+    }
+    BOOST_CHECK_EQUAL(map.size(), 1000U);
+    size_t nChunks = resource.NumChunks();
+    BOOST_CHECK(nChunks > 0);
+    size_t nUsage = memusage::DynamicUsage(map);
+    BOOST_CHECK(nUsage >= 1000 * sizeof(CCoinsMap::value_type));
+
+    // Nodes freed by clear() no longer count, and are reused.
+    map.clear();
+    BOOST_CHECK(memusage::DynamicUsage(map) <
+                nUsage - 1000 * sizeof(CCoinsMap::value_type));
+    for (uint32_t i = 0; i < 1000; i++) {
+        map[COutPoint(GetRandHash(), i)];
+    }
+    BOOST_CHECK_EQUAL(resource.NumChunks(), nChunks);
+
+    // Without a resource the map allocates as usual.
+    CCoinsMap mapPlain;
+    mapPlain[COutPoint(GetRandHash(), 0)];
+    BOOST_CHECK(mapPlain.get_allocator().resource() == nullptr);
+    BOOST_CHECK(memusage::DynamicUsage(mapPlain) > 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
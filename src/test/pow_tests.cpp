@@ -6,6 +6,8 @@
 #include "chain.h"
 #include "chainparams.h"
 #include "config.h"
+#include "ethashcache.h"
+#include "primitives/block.h"
 #include "random.h"
 #include "test/test_bitcoin.h"
 #include "util.h"
@@ -365,4 +367,95 @@ BOOST_AUTO_TEST_CASE(cash_difficulty_test) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(full_pow_check) {
+    SelectParams(CBaseChainParams::REGTEST);
+    GlobalConfig config;
+    const arith_uint256 powLimit =
+        UintToArith256(config.GetChainParams().GetConsensus().powLimit);
+
+    CBlockHeader header;
+    header.nBlockHeight = 1;
+    header.nTime = 1512403200;
+    header.nBits = powLimit.GetCompact();
+    header.hashMix = {{0xab}};
+
+    // Regtest accepts nearly any hash, so a made up mix passes the quick
+    // check but not the full one.
+    while (!CheckProofOfWork(header, config)) {
+        ++header.nNonce;
+    }
+    fFullPowCheck = true;
+    BOOST_CHECK(!CheckProofOfWork(header, config));
+    // Failures are not cached.
+    BOOST_CHECK(!CheckProofOfWork(header, config));
+
+    EthashLightRef light = EthashLightCache().Get(header.nBlockHeight);
+    BOOST_REQUIRE(light);
+    ethash_h256_t ethBlockHash = header.GetBaseEthash();
+    ethash_return_value_t ret;
+    do {
+        ++header.nNonce;
+        ret = ethash_light_compute(light.get(), ethBlockHash, header.nNonce);
+        BOOST_REQUIRE(ret.success);
+        header.hashMix = ret.mix_hash;
+    } while (!CheckProofOfWork(header, config));
+    // The second check is served from the verified header cache.
+    BOOST_CHECK(CheckProofOfWork(header, config));
+
+    // A header from our own index is trusted without the light cache.
+    CBlockHeader stored = header;
+    stored.hashMix = {{0xcd}};
+    while (!CheckStoredProofOfWork(stored, config)) {
+        ++stored.nNonce;
+    }
+    BOOST_CHECK(CheckProofOfWork(stored, config));
+
+    fFullPowCheck = false;
+    SelectParams(CBaseChainParams::MAIN);
+}
+
+BOOST_AUTO_TEST_CASE(next_work_cache) {
+    SelectParams(CBaseChainParams::MAIN);
+    GlobalConfig config;
+    const Consensus::Params &params = config.GetChainParams().GetConsensus();
+    arith_uint256 initialPow = UintToArith256(params.powLimit) >> 4;
+    uint32_t initialBits = initialPow.GetCompact();
+
+    // Blocks at irregular intervals, so that the difficulty changes. The
+    // blocks of a real index have a hash, which results are cached by.
+    std::vector<CBlockIndex> blocks(2100);
+    std::vector<uint256> hashes(blocks.size());
+    blocks[0].nTime = 1512403200;
+    blocks[0].nBits = initialBits;
+    blocks[0].nChainWork = GetBlockProof(blocks[0]);
+    for (size_t i = 1; i < blocks.size(); i++) {
+        blocks[i] = GetBlockIndex(&blocks[i - 1], 30 + i % 120, initialBits);
+    }
+    for (size_t i = 0; i < blocks.size(); i++) {
+        hashes[i] = ArithToUint256(arith_uint256(i + 1));
+        blocks[i].phashBlock = &hashes[i];
+    }
+
+    // Computed, then found in the cache, the same as without a hash.
+    CBlockHeader header;
+    for (size_t i : {959, 1919, 2000}) {
+        CBlockIndex unhashed = blocks[i];
+        unhashed.phashBlock = nullptr;
+        uint32_t nBits = GetNextWorkRequired(&unhashed, &header, config);
+        BOOST_CHECK_EQUAL(GetNextWorkRequired(&blocks[i], &header, config),
+                          nBits);
+        BOOST_CHECK_EQUAL(GetNextWorkRequired(&blocks[i], &header, config),
+                          nBits);
+    }
+    for (size_t i : {1000, 2099}) {
+        CBlockIndex unhashed = blocks[i];
+        unhashed.phashBlock = nullptr;
+        uint32_t nBits = GetNextCashWorkRequired(&unhashed, &header, config);
+        BOOST_CHECK_EQUAL(
+            GetNextCashWorkRequired(&blocks[i], &header, config), nBits);
+        BOOST_CHECK_EQUAL(
+            GetNextCashWorkRequired(&blocks[i], &header, config), nBits);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
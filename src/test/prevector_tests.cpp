@@ -151,6 +151,26 @@ public:
         pre_vector.assign(n, value);
     }
 
+    void resize_uninitialized(realtype values) {
+        size_t r = values.size();
+        size_t s = real_vector.size() / 2;
+        if (real_vector.capacity() < s + r) {
+            real_vector.reserve(s + r);
+        }
+        real_vector.resize(s);
+        pre_vector.resize_uninitialized(s);
+        for (auto v : values) {
+            real_vector.push_back(v);
+        }
+        auto p = pre_vector.size();
+        pre_vector.resize_uninitialized(p + r);
+        for (auto v : values) {
+            pre_vector[p] = v;
+            ++p;
+        }
+        test();
+    }
+
     Size size() { return real_vector.size(); }
 
     Size capacity() { return pre_vector.capacity(); }
@@ -261,6 +281,13 @@ BOOST_AUTO_TEST_CASE(PrevectorTestInt) {
             if (((r >> 15) % 32) == 18) {
                 test.move();
             }
+            if (insecure_rand() % 4 == 0) {
+                std::vector<int> values(insecure_rand() % 32);
+                for (int &v : values) {
+                    v = insecure_rand();
+                }
+                test.resize_uninitialized(values);
+            }
         }
     }
 }
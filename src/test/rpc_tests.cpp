@@ -3,11 +3,16 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "rpc/client.h"
+#include "rpc/events.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
+#include "rpc/stats.h"
 
 #include "base58.h"
 #include "config.h"
+#include "httprpc.h"
 #include "netbase.h"
+#include "validation.h"
 
 #include "test/test_bitcoin.h"
 
@@ -440,4 +445,224 @@ BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress) {
     BOOST_CHECK_EQUAL(result[2].get_int(), 9);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_batch_threads) {
+    GlobalConfig config;
+    ForceSetArg("-rpcbatchthreads", "4");
+    SetRPCWarmupFinished();
+    StartRPC();
+
+    UniValue vReq(UniValue::VARR);
+    for (int i = 0; i < 20; i++) {
+        // Every fifth call isn't concurrent and runs on its own.
+        const bool fConcurrent = i % 5 != 4;
+        UniValue req(UniValue::VOBJ);
+        req.push_back(Pair("id", i));
+        req.push_back(
+            Pair("method", fConcurrent ? "getblockhash" : "getchaintips"));
+        UniValue params(UniValue::VARR);
+        if (fConcurrent) {
+            params.push_back(0);
+        }
+        req.push_back(Pair("params", params));
+        vReq.push_back(req);
+    }
+
+    UniValue ret;
+    BOOST_REQUIRE(ret.read(JSONRPCExecBatch(config, vReq)));
+    BOOST_REQUIRE_EQUAL(ret.size(), 20);
+    for (int i = 0; i < 20; i++) {
+        BOOST_CHECK_EQUAL(find_value(ret[i], "id").get_int(), i);
+        BOOST_CHECK(find_value(ret[i], "error").isNull());
+        if (i % 5 != 4) {
+            BOOST_CHECK_EQUAL(find_value(ret[i], "result").get_str(),
+                              chainActive.Genesis()->GetBlockHash().GetHex());
+        }
+    }
+
+    StopRPC();
+    ForceSetArg("-rpcbatchthreads", "0");
+}
+
+BOOST_AUTO_TEST_CASE(rpc_json_stream) {
+    UniValue inner(UniValue::VOBJ);
+    inner.push_back(Pair("a\"b", 1));
+    inner.push_back(Pair("list", UniValue(UniValue::VARR)));
+    UniValue value(UniValue::VARR);
+    value.push_back(inner);
+    value.push_back("text");
+    value.push_back(UniValue(UniValue::VOBJ));
+
+    std::vector<std::string> vChunks;
+    CJSONStreamWriter stream(
+        [&vChunks](const std::string &strChunk) {
+            vChunks.push_back(strChunk);
+            return true;
+        },
+        8);
+    BOOST_CHECK(stream.Empty());
+    stream.BeginArray();
+    stream.BeginObject();
+    stream.Entries(inner);
+    stream.EndObject();
+    stream.Value("text");
+    stream.BeginObject();
+    stream.EndObject();
+    stream.EndArray();
+    BOOST_CHECK(!stream.Empty());
+    BOOST_CHECK(stream.Flush());
+
+    // Chunks are passed on once they are full, only the last one is short.
+    BOOST_REQUIRE(vChunks.size() > 1);
+    std::string strAll;
+    for (size_t i = 0; i < vChunks.size(); i++) {
+        BOOST_CHECK(i + 1 == vChunks.size() || vChunks[i].size() >= 8);
+        strAll += vChunks[i];
+    }
+    BOOST_CHECK_EQUAL(strAll, value.write());
+
+    // Nothing more goes to a sink that failed.
+    int nCalls = 0;
+    CJSONStreamWriter failing(
+        [&nCalls](const std::string &) {
+            nCalls++;
+            return false;
+        },
+        8);
+    failing.Value(value);
+    failing.Value(value);
+    BOOST_CHECK(failing.Failed());
+    BOOST_CHECK(!failing.Flush());
+    BOOST_CHECK_EQUAL(nCalls, 1);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_json_stream_getblock) {
+    GlobalConfig config;
+    SetRPCWarmupFinished();
+    const std::string strHash = chainActive.Tip()->GetBlockHash().GetHex();
+    const UniValue expected = CallRPC("getblock " + strHash);
+
+    std::string strStreamed;
+    CJSONStreamWriter stream([&strStreamed](const std::string &strChunk) {
+        strStreamed += strChunk;
+        return true;
+    });
+    JSONRPCRequest request;
+    request.strMethod = "getblock";
+    request.params = UniValue(UniValue::VARR);
+    request.params.push_back(strHash);
+    request.pStream = &stream;
+    BOOST_CHECK(tableRPC.execute(config, request).isNull());
+    BOOST_CHECK(stream.Flush());
+    BOOST_CHECK_EQUAL(strStreamed, expected.write());
+}
+
+BOOST_AUTO_TEST_CASE(rpc_peek_method) {
+    std::string strMethod;
+    BOOST_CHECK(PeekJSONRPCMethod(
+        "{\"method\":\"eth_getWork\",\"params\":[]}", strMethod));
+    BOOST_CHECK_EQUAL(strMethod, "eth_getWork");
+    BOOST_CHECK(PeekJSONRPCMethod(
+        " {\"id\": 1, \"method\" : \"getblock\", \"params\"", strMethod));
+    BOOST_CHECK_EQUAL(strMethod, "getblock");
+
+    // Batches, cut off or escaped methods and other values aren't looked into.
+    BOOST_CHECK(!PeekJSONRPCMethod("[{\"method\":\"getblock\"}]", strMethod));
+    BOOST_CHECK(!PeekJSONRPCMethod("{\"method\":\"getbl", strMethod));
+    BOOST_CHECK(
+        !PeekJSONRPCMethod("{\"method\":\"get\\u0062lock\"}", strMethod));
+    BOOST_CHECK(!PeekJSONRPCMethod("{\"params\":[\"method\"]}", strMethod));
+    BOOST_CHECK(!PeekJSONRPCMethod("{\"method\":1}", strMethod));
+    BOOST_CHECK(!PeekJSONRPCMethod("", strMethod));
+}
+
+BOOST_AUTO_TEST_CASE(rpc_event_log) {
+    CRPCEventLog log(3);
+    std::vector<UniValue> vEvents;
+    bool fReset;
+    const uint64_t nStart = log.GetCursor();
+    const unsigned int nAll = (1u << RPC_EVENT_TYPES) - 1;
+
+    // Nothing happened yet.
+    BOOST_CHECK_EQUAL(log.Wait(nStart, nAll, 0, vEvents, fReset), nStart);
+    BOOST_CHECK(!fReset && vEvents.empty());
+
+    UniValue event(UniValue::VOBJ);
+    event.pushKV("height", 1);
+    log.Add(RPC_EVENT_TIP, event);
+    log.Add(RPC_EVENT_MEMPOOL, UniValue(UniValue::VOBJ));
+    uint64_t nCursor = log.Wait(nStart, nAll, 0, vEvents, fReset);
+    BOOST_CHECK_EQUAL(nCursor, nStart + 2);
+    BOOST_CHECK(!fReset);
+    BOOST_CHECK_EQUAL(vEvents.size(), 2U);
+    BOOST_CHECK_EQUAL(vEvents[0].write(),
+                      strprintf("{\"type\":\"tip\",\"seq\":%d,\"height\":1}",
+                                nStart + 1));
+    BOOST_CHECK_EQUAL(vEvents[1]["type"].get_str(), "mempool");
+
+    // Only the types asked for, the cursor passes the others.
+    vEvents.clear();
+    BOOST_CHECK_EQUAL(log.Wait(nStart, 1u << RPC_EVENT_MEMPOOL, 0, vEvents,
+                               fReset),
+                      nCursor);
+    BOOST_CHECK_EQUAL(vEvents.size(), 1U);
+    vEvents.clear();
+    BOOST_CHECK_EQUAL(log.Wait(nCursor, nAll, 0, vEvents, fReset), nCursor);
+    BOOST_CHECK(!fReset && vEvents.empty());
+
+    // A cursor whose next events were dropped, or that isn't of the log.
+    log.Add(RPC_EVENT_WORK, UniValue(UniValue::VOBJ));
+    log.Add(RPC_EVENT_WORK, UniValue(UniValue::VOBJ));
+    BOOST_CHECK_EQUAL(log.Wait(nStart, nAll, 0, vEvents, fReset), nStart + 4);
+    BOOST_CHECK(fReset && vEvents.empty());
+    BOOST_CHECK_EQUAL(log.Wait(nStart + 1, nAll, 0, vEvents, fReset),
+                      nStart + 4);
+    BOOST_CHECK(!fReset);
+    BOOST_CHECK_EQUAL(vEvents.size(), 3U);
+    vEvents.clear();
+    log.Wait(nStart + 5, nAll, 0, vEvents, fReset);
+    BOOST_CHECK(fReset && vEvents.empty());
+
+    // A stopped log doesn't wait.
+    log.Stop();
+    BOOST_CHECK_EQUAL(log.Wait(nStart + 4, nAll, 60000, vEvents, fReset),
+                      nStart + 4);
+    BOOST_CHECK(!fReset && vEvents.empty());
+}
+
+BOOST_AUTO_TEST_CASE(rpc_latency_buckets) {
+    // Each bucket starts right after the one before it ends.
+    BOOST_CHECK_EQUAL(GetRPCLatencyBucket(0), 0);
+    for (int i = 1; i < RPC_LATENCY_BUCKETS; i++) {
+        const int64_t nMax = GetRPCLatencyBucketMax(i - 1);
+        BOOST_CHECK_EQUAL(GetRPCLatencyBucket(nMax), i - 1);
+        BOOST_CHECK_EQUAL(GetRPCLatencyBucket(nMax + 1), i);
+    }
+    BOOST_CHECK_EQUAL(GetRPCLatencyBucket(-5), 0);
+    BOOST_CHECK_EQUAL(GetRPCLatencyBucket(INT64_MAX),
+                      RPC_LATENCY_BUCKETS - 1);
+
+    // Percentiles are within a quarter, and never above the maximum.
+    CRPCStats stats;
+    for (int64_t n = 1; n <= 1000; n++) {
+        stats.AddCall("test", n * 1000, LockWaitTimes(), n == 1000);
+    }
+    const CRPCMethodStats method = stats.GetStats()["test"];
+    BOOST_CHECK_EQUAL(method.nCalls, 1000);
+    BOOST_CHECK_EQUAL(method.nErrors, 1);
+    BOOST_CHECK_EQUAL(method.nMaxMicros, 1000000);
+    const int64_t nMedian = method.GetLatencyPercentile(0.5);
+    BOOST_CHECK(nMedian >= 500000 && nMedian <= 625000);
+    const int64_t nP99 = method.GetLatencyPercentile(0.99);
+    BOOST_CHECK(nP99 >= 990000 && nP99 <= 1000000);
+    BOOST_CHECK_EQUAL(method.GetLatencyPercentile(1), 1000000);
+
+    const std::string strMetrics = stats.ToPrometheus();
+    BOOST_CHECK(strMetrics.find(
+                    "platopia_rpc_calls_total{method=\"test\"} 1000\n") !=
+                std::string::npos);
+    BOOST_CHECK(strMetrics.find("platopia_rpc_latency_seconds_bucket{method="
+                                "\"test\",le=\"+Inf\"} 1000\n") !=
+                std::string::npos);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
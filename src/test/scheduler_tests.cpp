@@ -126,4 +126,84 @@ BOOST_AUTO_TEST_CASE(manythreads) {
     BOOST_CHECK_EQUAL(counterSum, 200);
 }
 
+BOOST_AUTO_TEST_CASE(scheduler_priority) {
+    CScheduler scheduler;
+    std::vector<std::string> order;
+
+    // All due by the time the thread starts
+    boost::chrono::system_clock::time_point now =
+        boost::chrono::system_clock::now();
+    scheduler.schedule([&order] { order.push_back("low"); },
+                       now - boost::chrono::seconds(2), "low",
+                       CScheduler::PRIORITY_LOW);
+    scheduler.schedule([&order] { order.push_back("normal1"); },
+                       now - boost::chrono::seconds(1), "normal");
+    scheduler.schedule([&order] { order.push_back("high"); }, now, "high",
+                       CScheduler::PRIORITY_HIGH);
+    scheduler.schedule([&order] { order.push_back("normal2"); }, now,
+                       "normal");
+
+    boost::thread thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+    scheduler.stop(true);
+    thread.join();
+
+    std::vector<std::string> expected = {"high", "normal1", "normal2", "low"};
+    BOOST_CHECK(order == expected);
+
+    std::map<std::string, CSchedulerTaskStats> stats =
+        scheduler.getTaskStats();
+    BOOST_CHECK_EQUAL(stats.size(), 3);
+    BOOST_CHECK_EQUAL(stats["normal"].nRuns, 2);
+    BOOST_CHECK_EQUAL(stats["low"].nRuns, 1);
+    // It waited for the three others
+    BOOST_CHECK(stats["low"].nMaxLateMicros >= 2000000);
+}
+
+BOOST_AUTO_TEST_CASE(singlethreadedscheduler_ordered) {
+    CScheduler scheduler;
+
+    // each queue should be well ordered with respect to itself but not other
+    // queues
+    SingleThreadedSchedulerClient queue1(&scheduler);
+    SingleThreadedSchedulerClient queue2(&scheduler);
+
+    // create more threads than queues
+    // if the queues only permit execution of one task at once then
+    // the extra threads should effectively be doing nothing
+    // if they don't we'll get out of order behaviour
+    boost::thread_group threads;
+    for (int i = 0; i < 5; ++i) {
+        threads.create_thread(boost::bind(&CScheduler::serviceQueue,
+                                          &scheduler));
+    }
+
+    // these are not atomic, if SingleThreadedSchedulerClient prevents
+    // parallel execution at the queue level no synchronization should be
+    // required here
+    int counter1 = 0;
+    int counter2 = 0;
+
+    // just simply count up on each queue - if execution is properly ordered
+    // then the callbacks should run in exactly the order in which they were
+    // enqueued
+    for (int i = 0; i < 100; ++i) {
+        queue1.AddToProcessQueue([i, &counter1]() {
+            bool expectation = i == counter1++;
+            assert(expectation);
+        });
+
+        queue2.AddToProcessQueue([i, &counter2]() {
+            bool expectation = i == counter2++;
+            assert(expectation);
+        });
+    }
+
+    // finish up
+    scheduler.stop(true);
+    threads.join_all();
+
+    BOOST_CHECK_EQUAL(counter1, 100);
+    BOOST_CHECK_EQUAL(counter2, 100);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
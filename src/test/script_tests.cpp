@@ -1291,6 +1291,167 @@ BOOST_AUTO_TEST_CASE(script_CHECKMULTISIG23) {
                         ScriptErrorString(err));
 }
 
+/**
+ * VerifyScript through EvalScript alone, as it was before the fast paths for
+ * the standard templates.
+ */
+static bool VerifyScriptGeneric(const CScript &scriptSig,
+                                const CScript &scriptPubKey,
+                                unsigned int flags,
+                                const BaseSignatureChecker &checker,
+                                ScriptError *serror) {
+    if ((flags & SCRIPT_VERIFY_SIGPUSHONLY) && !scriptSig.IsPushOnly()) {
+        *serror = SCRIPT_ERR_SIG_PUSHONLY;
+        return false;
+    }
+    std::vector<std::vector<uint8_t>> stack, stackCopy;
+    if (!EvalScript(stack, scriptSig, flags, checker, serror)) {
+        return false;
+    }
+    stackCopy = stack;
+    if (!EvalScript(stack, scriptPubKey, flags, checker, serror)) {
+        return false;
+    }
+    if (stack.empty() || !CastToBool(stack.back())) {
+        *serror = SCRIPT_ERR_EVAL_FALSE;
+        return false;
+    }
+    if ((flags & SCRIPT_VERIFY_P2SH) && scriptPubKey.IsPayToScriptHash()) {
+        if (!scriptSig.IsPushOnly()) {
+            *serror = SCRIPT_ERR_SIG_PUSHONLY;
+            return false;
+        }
+        stack = stackCopy;
+        CScript redeemScript(stack.back().begin(), stack.back().end());
+        stack.pop_back();
+        if (!EvalScript(stack, redeemScript, flags, checker, serror)) {
+            return false;
+        }
+        if (stack.empty() || !CastToBool(stack.back())) {
+            *serror = SCRIPT_ERR_EVAL_FALSE;
+            return false;
+        }
+    }
+    if ((flags & SCRIPT_VERIFY_CLEANSTACK) && stack.size() != 1) {
+        *serror = SCRIPT_ERR_CLEANSTACK;
+        return false;
+    }
+    *serror = SCRIPT_ERR_OK;
+    return true;
+}
+
+static void CheckSameAsGeneric(const CScript &scriptSig,
+                               const CScript &scriptPubKey,
+                               const CMutableTransaction &txTo) {
+    static const unsigned int vFlags[] = {
+        SCRIPT_VERIFY_NONE,
+        SCRIPT_VERIFY_P2SH,
+        SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC,
+        SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_DERSIG |
+            SCRIPT_VERIFY_LOW_S | SCRIPT_VERIFY_NULLDUMMY |
+            SCRIPT_VERIFY_MINIMALDATA | SCRIPT_VERIFY_CLEANSTACK,
+    };
+    for (unsigned int nFlags : vFlags) {
+        ScriptError err, errGeneric;
+        bool fResult = VerifyScript(
+            scriptSig, scriptPubKey, nFlags,
+            MutableTransactionSignatureChecker(&txTo, 0), &err);
+        bool fGeneric = VerifyScriptGeneric(
+            scriptSig, scriptPubKey, nFlags,
+            MutableTransactionSignatureChecker(&txTo, 0), &errGeneric);
+        BOOST_CHECK_EQUAL(fResult, fGeneric);
+        BOOST_CHECK_MESSAGE(err == errGeneric,
+                            std::string(ScriptErrorString(err)) + " where " +
+                                ScriptErrorString(errGeneric) + " expected: " +
+                                ScriptToAsmStr(scriptSig));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(script_standard_fast_paths) {
+    CKey key1, key2, key3;
+    key1.MakeNewKey(true);
+    key2.MakeNewKey(false);
+    key3.MakeNewKey(true);
+    const std::vector<uint8_t> vchPubKey1 = ToByteVector(key1.GetPubKey());
+    const std::vector<uint8_t> vchPubKey2 = ToByteVector(key2.GetPubKey());
+
+    // P2PKH
+    CScript scriptPubKey = GetScriptForDestination(key1.GetPubKey().GetID());
+    CMutableTransaction txFrom =
+        BuildCreditingTransaction(scriptPubKey, CAmount(0));
+    CMutableTransaction txTo = BuildSpendingTransaction(CScript(), txFrom);
+    uint256 hash = SignatureHash(scriptPubKey, txTo, 0, SIGHASH_ALL);
+    std::vector<uint8_t> vchSig, vchSigHighS, vchSigOther;
+    BOOST_CHECK(key1.Sign(hash, vchSig));
+    vchSig.push_back(uint8_t(SIGHASH_ALL));
+    vchSigHighS = vchSig;
+    vchSigHighS.pop_back();
+    NegateSignatureS(vchSigHighS);
+    vchSigHighS.push_back(uint8_t(SIGHASH_ALL));
+    BOOST_CHECK(key3.Sign(hash, vchSigOther));
+    vchSigOther.push_back(uint8_t(SIGHASH_ALL));
+
+    std::vector<CScript> vScriptSigs = {
+        CScript() << vchSig << vchPubKey1,
+        CScript() << vchSigOther << vchPubKey1,
+        CScript() << vchSigHighS << vchPubKey1,
+        CScript() << std::vector<uint8_t>(72, 0x30) << vchPubKey1,
+        CScript() << OP_0 << vchPubKey1,
+        CScript() << vchSig << vchPubKey2,
+        CScript() << vchSig << std::vector<uint8_t>(33, 0x05),
+        CScript() << vchPubKey1,
+        CScript() << OP_0 << vchSig << vchPubKey1,
+        CScript() << vchSig << OP_DUP << OP_DROP << vchPubKey1,
+        CScript() << vchSig << OP_1,
+    };
+    for (const CScript &scriptSig : vScriptSigs) {
+        CheckSameAsGeneric(scriptSig, scriptPubKey, txTo);
+    }
+    ScriptError err;
+    BOOST_CHECK(VerifyScript(vScriptSigs[0], scriptPubKey, flags,
+                             MutableTransactionSignatureChecker(&txTo, 0),
+                             &err));
+    BOOST_CHECK_EQUAL(err, SCRIPT_ERR_OK);
+
+    // P2SH 2-of-3 multisig
+    CScript redeemScript;
+    redeemScript << OP_2 << vchPubKey1 << vchPubKey2
+                 << ToByteVector(key3.GetPubKey()) << OP_3 << OP_CHECKMULTISIG;
+    scriptPubKey = GetScriptForDestination(CScriptID(redeemScript));
+    txFrom = BuildCreditingTransaction(scriptPubKey, CAmount(0));
+    txTo = BuildSpendingTransaction(CScript(), txFrom);
+    const std::vector<uint8_t> vchRedeemScript(redeemScript.begin(),
+                                               redeemScript.end());
+    std::vector<CScript> vSigs = {
+        sign_multisig(redeemScript, {key1, key2}, txTo),
+        sign_multisig(redeemScript, {key1, key3}, txTo),
+        sign_multisig(redeemScript, {key2, key1}, txTo),
+        sign_multisig(redeemScript, {key2, key2}, txTo),
+        sign_multisig(redeemScript, {key1}, txTo),
+        sign_multisig(redeemScript, {key1, key2, key3}, txTo),
+        sign_multisig(redeemScript, std::vector<CKey>(), txTo),
+    };
+    // A dummy that isn't null.
+    CScript scriptSig = vSigs[0];
+    scriptSig[0] = OP_1;
+    vSigs.push_back(scriptSig);
+    vSigs.push_back(CScript() << OP_0 << OP_0 << OP_0);
+    for (const CScript &sigs : vSigs) {
+        scriptSig = sigs;
+        CheckSameAsGeneric(scriptSig << vchRedeemScript, scriptPubKey, txTo);
+    }
+    // Another redeem script
+    scriptSig = vSigs[0];
+    scriptSig << ToByteVector(CScript() << OP_1 << vchPubKey1 << OP_1
+                                        << OP_CHECKMULTISIG);
+    CheckSameAsGeneric(scriptSig, scriptPubKey, txTo);
+    scriptSig = vSigs[0];
+    BOOST_CHECK(VerifyScript(scriptSig << vchRedeemScript, scriptPubKey, flags,
+                             MutableTransactionSignatureChecker(&txTo, 0),
+                             &err));
+    BOOST_CHECK_EQUAL(err, SCRIPT_ERR_OK);
+}
+
 BOOST_AUTO_TEST_CASE(script_combineSigs) {
     // Test the CombineSignatures function
     CAmount amount(0);
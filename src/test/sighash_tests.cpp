@@ -17,6 +17,7 @@
 #include "version.h"
 
 #include <iostream>
+#include <memory>
 
 #include <boost/test/unit_test.hpp>
 
@@ -154,6 +155,46 @@ BOOST_AUTO_TEST_CASE(sighash_test) {
 #endif
 }
 
+BOOST_AUTO_TEST_CASE(sighash_precomputed) {
+    seed_insecure_rand(false);
+
+    for (int i = 0; i < 1000; i++) {
+        int nHashType = insecure_rand();
+
+        CMutableTransaction txTo;
+        RandomTransaction(txTo, (nHashType & 0x1f) == SIGHASH_SINGLE);
+        for (CTxOut &txout : txTo.vout) {
+            txout.strContent = std::string(insecure_rand() % 100, 'c');
+        }
+        const CTransaction tx(txTo);
+        const PrecomputedSignatureHash sighashData(tx);
+        CScript scriptCode;
+        RandomScript(scriptCode);
+
+        // The same as from scratch for every input, with or without
+        // SIGHASH_ALL.
+        for (unsigned int nIn = 0; nIn <= tx.vin.size(); nIn++) {
+            BOOST_CHECK(sighashData.GetHash(scriptCode, nIn, nHashType) ==
+                        SignatureHash(scriptCode, tx, nIn, nHashType));
+            BOOST_CHECK(sighashData.GetHash(scriptCode, nIn, SIGHASH_ALL) ==
+                        SignatureHash(scriptCode, tx, nIn, SIGHASH_ALL));
+        }
+
+        // The transaction isn't needed anymore, and the signature scripts
+        // can change.
+        std::unique_ptr<PrecomputedSignatureHash> sighashCopy(
+            new PrecomputedSignatureHash(CTransaction(txTo)));
+        for (CTxIn &txin : txTo.vin) {
+            RandomScript(txin.scriptSig);
+        }
+        const CTransaction txSigned(txTo);
+        for (unsigned int nIn = 0; nIn < txSigned.vin.size(); nIn++) {
+            BOOST_CHECK(sighashCopy->GetHash(scriptCode, nIn, nHashType) ==
+                        SignatureHash(scriptCode, txSigned, nIn, nHashType));
+        }
+    }
+}
+
 // Goal: check that SignatureHash generates correct hash
 BOOST_AUTO_TEST_CASE(sighash_from_data) {
     UniValue tests = read_json(
@@ -8,6 +8,7 @@
 #include "pubkey.h"
 #include "script/script.h"
 #include "script/standard.h"
+#include "streams.h"
 #include "test/test_bitcoin.h"
 #include "uint256.h"
 #include "validation.h"
@@ -141,6 +142,32 @@ BOOST_AUTO_TEST_CASE(GetTxSigOpCost) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(tx_sigop_count) {
+    CMutableTransaction mtx;
+    mtx.vin.resize(2);
+    mtx.vin[0].scriptSig = CScript() << OP_CHECKSIG << OP_CHECKMULTISIG;
+    mtx.vin[1].scriptSig = CScript() << OP_0;
+    mtx.vout.resize(2);
+    mtx.vout[0].scriptPubKey = CScript() << OP_CHECKSIGVERIFY;
+    mtx.vout[1].scriptPubKey = CScript() << OP_CHECKMULTISIGVERIFY;
+    mtx.vout[1].strContent = "content";
+
+    // Counted on construction, kept by copies.
+    const CTransaction tx(mtx);
+    BOOST_CHECK_EQUAL(tx.GetSigOpCount(), 42U);
+    BOOST_CHECK_EQUAL(GetSigOpCountWithoutP2SH(tx), 42U);
+    CTransaction txCopy;
+    BOOST_CHECK_EQUAL(txCopy.GetSigOpCount(), 0U);
+    txCopy = tx;
+    BOOST_CHECK_EQUAL(txCopy.GetSigOpCount(), 42U);
+    BOOST_CHECK_EQUAL(tx.WithoutContent().GetSigOpCount(), 42U);
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << tx;
+    const CTransaction txRead(deserialize, ss);
+    BOOST_CHECK_EQUAL(txRead.GetSigOpCount(), 42U);
+}
+
 BOOST_AUTO_TEST_CASE(test_consensus_sigops_limit) {
     BOOST_CHECK_EQUAL(GetMaxBlockSigOpsCount(1), MAX_BLOCK_SIGOPS_PER_MB);
     BOOST_CHECK_EQUAL(GetMaxBlockSigOpsCount(123456), MAX_BLOCK_SIGOPS_PER_MB);
@@ -161,4 +161,83 @@ BOOST_AUTO_TEST_CASE(findearliestatleast_test) {
         BOOST_CHECK(vBlocksMain[r].GetAncestor(ret->nHeight) == ret);
     }
 }
+BOOST_AUTO_TEST_CASE(blockindex_arena_test) {
+    CBlockIndexArena arena;
+    BOOST_CHECK_EQUAL(arena.Size(), 0);
+
+    // Build a chain spanning a few chunks, as loading the index would.
+    const size_t nCount = 2 * BLOCK_INDEX_ARENA_CHUNK + 10;
+    std::vector<CBlockIndex *> vIndex;
+    for (size_t i = 0; i < nCount; i++) {
+        CBlockIndex *pindex = arena.Create();
+        BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(pindex) % 64, 0);
+        BOOST_CHECK(pindex->pprev == nullptr && pindex->nHeight == 0);
+        pindex->nHeight = i;
+        pindex->pprev = i ? vIndex.back() : nullptr;
+        pindex->BuildSkip();
+        vIndex.push_back(pindex);
+    }
+    BOOST_CHECK_EQUAL(arena.Size(), nCount);
+
+    // Entries don't overlap or move as the arena grows.
+    for (size_t i = 0; i < nCount; i++) {
+        BOOST_CHECK_EQUAL(vIndex[i]->nHeight, int(i));
+        BOOST_CHECK(vIndex[nCount - 1]->GetAncestor(i) == vIndex[i]);
+    }
+
+    CBlockHeader header;
+    header.nTime = 1234;
+    BOOST_CHECK_EQUAL(arena.Create(header)->nTime, 1234);
+
+    arena.Clear();
+    BOOST_CHECK_EQUAL(arena.Size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(chain_snapshot_test) {
+    // A main chain, and a branch splitting off it at block 599.
+    std::vector<CBlockIndex> vBlocksMain(1000);
+    std::vector<CBlockIndex> vBlocksSide(500);
+    for (size_t i = 0; i < vBlocksMain.size(); i++) {
+        vBlocksMain[i].nHeight = i;
+        vBlocksMain[i].pprev = i ? &vBlocksMain[i - 1] : nullptr;
+        vBlocksMain[i].nChainInterest = 10 * i;
+        vBlocksMain[i].BuildSkip();
+    }
+    for (size_t i = 0; i < vBlocksSide.size(); i++) {
+        vBlocksSide[i].nHeight = i + 600;
+        vBlocksSide[i].pprev = i ? &vBlocksSide[i - 1] : &vBlocksMain[599];
+        vBlocksSide[i].BuildSkip();
+    }
+
+    CChain chain;
+    chain.SetTip(&vBlocksMain.back());
+    const CChainSnapshot snapshot(chain.Tip());
+    BOOST_CHECK(snapshot.Tip() == chain.Tip());
+    BOOST_CHECK_EQUAL(snapshot.Height(), chain.Height());
+    BOOST_CHECK_EQUAL(snapshot.GetChainInterest(), 9990);
+    BOOST_CHECK(snapshot[-1] == nullptr && snapshot[1000] == nullptr);
+
+    // Answers as the chain it was taken of does.
+    for (int n = 0; n < 200; n++) {
+        int r = insecure_rand() % 1500;
+        const CBlockIndex *pindex =
+            (r < 1000) ? &vBlocksMain[r] : &vBlocksSide[r - 1000];
+        BOOST_CHECK(snapshot[r % 1000] == chain[r % 1000]);
+        BOOST_CHECK_EQUAL(snapshot.Contains(pindex), chain.Contains(pindex));
+        BOOST_CHECK(snapshot.Next(pindex) == chain.Next(pindex));
+        BOOST_CHECK(snapshot.FindFork(pindex) == chain.FindFork(pindex));
+    }
+
+    // And goes on doing so after the chain moved to the branch.
+    chain.SetTip(&vBlocksSide.back());
+    BOOST_CHECK(snapshot.Contains(&vBlocksMain[999]));
+    BOOST_CHECK(!snapshot.Contains(&vBlocksSide[0]));
+    BOOST_CHECK(snapshot.FindFork(&vBlocksSide.back()) == &vBlocksMain[599]);
+
+    const CChainSnapshot empty(nullptr);
+    BOOST_CHECK_EQUAL(empty.Height(), -1);
+    BOOST_CHECK_EQUAL(empty.GetChainInterest(), 0);
+    BOOST_CHECK(!empty.Contains(&vBlocksMain[0]));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,60 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "stratum.h"
+
+#include "arith_uint256.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(stratum_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(stratum_nonce) {
+    uint64_t nNonce = 0;
+
+    // Only the part after the extranonce.
+    BOOST_CHECK(ParseStratumNonce("0123456789ab", 0xbeef, nNonce));
+    BOOST_CHECK_EQUAL(nNonce, 0xbeef0123456789abULL);
+    BOOST_CHECK(ParseStratumNonce("0x0123456789ab", 0xbeef, nNonce));
+    BOOST_CHECK_EQUAL(nNonce, 0xbeef0123456789abULL);
+
+    // The full nonce, which has to stay in the client's range.
+    BOOST_CHECK(ParseStratumNonce("beef0123456789ab", 0xbeef, nNonce));
+    BOOST_CHECK_EQUAL(nNonce, 0xbeef0123456789abULL);
+    BOOST_CHECK(!ParseStratumNonce("dead0123456789ab", 0xbeef, nNonce));
+
+    BOOST_CHECK(!ParseStratumNonce("", 0, nNonce));
+    BOOST_CHECK(!ParseStratumNonce("0123456789", 0, nNonce));
+    BOOST_CHECK(!ParseStratumNonce("0123456789xy", 0, nNonce));
+    BOOST_CHECK(!ParseStratumNonce("000000000123456789ab", 0, nNonce));
+}
+
+BOOST_AUTO_TEST_CASE(stratum_difficulty) {
+    BOOST_CHECK_EQUAL(GetStratumDifficulty(0x1d00ffff), 1.0);
+    BOOST_CHECK_EQUAL(GetStratumDifficulty(0x1c00ffff), 256.0);
+    BOOST_CHECK_EQUAL(GetStratumDifficulty(0x1e00ffff), 1.0 / 256);
+    BOOST_CHECK_EQUAL(GetStratumDifficulty(0), 0.0);
+
+    arith_uint256 target;
+    target.SetCompact(0x1c00ffff);
+    BOOST_CHECK(GetStratumTarget(256) == target);
+    target.SetCompact(0x1e00ffff);
+    BOOST_CHECK(GetStratumTarget(1.0 / 256) == target);
+    BOOST_CHECK(GetStratumTarget(1e-80) == ~arith_uint256());
+}
+
+BOOST_AUTO_TEST_CASE(stratum_vardiff) {
+    // On target, too slow, too fast.
+    BOOST_CHECK_EQUAL(GetNextShareDifficulty(8, 6, 60, 10), 8.0);
+    BOOST_CHECK_EQUAL(GetNextShareDifficulty(8, 3, 60, 10), 4.0);
+    BOOST_CHECK_EQUAL(GetNextShareDifficulty(8, 12, 60, 10), 16.0);
+    // By a factor of 4 at most.
+    BOOST_CHECK_EQUAL(GetNextShareDifficulty(8, 0, 60, 10), 2.0);
+    BOOST_CHECK_EQUAL(GetNextShareDifficulty(8, 30, 1, 10), 32.0);
+    BOOST_CHECK_EQUAL(GetNextShareDifficulty(8, 30, 0, 10), 32.0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
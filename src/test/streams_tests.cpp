@@ -118,6 +118,33 @@ BOOST_AUTO_TEST_CASE(streams_serializedata_xor) {
                       std::string(ds.begin(), ds.end()));
 }
 
+BOOST_AUTO_TEST_CASE(streams_xor_with_key) {
+    // Word-wise keys, the others and tails of every length, at any alignment,
+    // against a byte-wise XOR.
+    std::vector<uint8_t> data(100);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = uint8_t(i * 37 + 11);
+    }
+    for (size_t nKeySize : {1, 2, 3, 4, 5, 8, 9}) {
+        std::vector<uint8_t> key(nKeySize);
+        for (size_t i = 0; i < nKeySize; i++) {
+            key[i] = uint8_t(0xa5 ^ (i * 53));
+        }
+        for (size_t nOffset = 0; nOffset < 8; nOffset++) {
+            for (size_t nSize = 0; nOffset + nSize <= data.size(); nSize++) {
+                std::vector<uint8_t> expected(data);
+                for (size_t i = 0; i < nSize; i++) {
+                    expected[nOffset + i] ^= key[i % nKeySize];
+                }
+                std::vector<uint8_t> result(data);
+                XorWithKey(result.data() + nOffset, nSize, key.data(),
+                           nKeySize);
+                BOOST_CHECK(result == expected);
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(streams_empty_vector) {
     std::vector<char> in;
     CDataStream ds(in, 0, 0);
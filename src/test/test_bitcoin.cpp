@@ -10,9 +10,11 @@
 #include "config.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
 #include "key.h"
 #include "miner.h"
 #include "net_processing.h"
+#include "pow.h"
 #include "pubkey.h"
 #include "random.h"
 #include "rpc/register.h"
@@ -47,11 +49,15 @@ extern bool fPrintToConsole;
 extern void noui_connect();
 
 BasicTestingSetup::BasicTestingSetup(const std::string &chainName) {
+    SHA256SelectImplementation();
     ECC_Start();
     SetupEnvironment();
     SetupNetworking();
     InitSignatureCache();
     InitScriptExecutionCache();
+    InitProofOfWorkCache();
+    // Blocks in unit tests are only mined against the quick check.
+    fFullPowCheck = false;
     // Don't want to write to debug.log file.
     fPrintToDebugLog = false;
     fCheckBlockIndex = true;
@@ -84,7 +90,9 @@ TestingSetup::TestingSetup(const std::string &chainName)
     mempool.setSanityCheck(1.0);
     pblocktree = new CBlockTreeDB(1 << 20, true);
     pcoinsdbview = new CCoinsViewDB(1 << 23, true);
-    pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+    pcoinsWriter = new CCoinsViewAsyncWrite(pcoinsdbview);
+    pcoinsTip = new CCoinsViewCache(pcoinsWriter);
+    pcoinsTip->TrackStats();
     InitBlockIndex(config);
     {
         CValidationState state;
@@ -94,6 +102,7 @@ TestingSetup::TestingSetup(const std::string &chainName)
     nScriptCheckThreads = 3;
     for (int i = 0; i < nScriptCheckThreads - 1; i++) {
         threadGroup.create_thread(&ThreadScriptCheck);
+        threadGroup.create_thread(&ThreadCoinPrefetch);
     }
 
     // Deterministic randomness for tests.
@@ -108,6 +117,7 @@ TestingSetup::~TestingSetup() {
     threadGroup.join_all();
     UnloadBlockIndex();
     delete pcoinsTip;
+    delete pcoinsWriter;
     delete pcoinsdbview;
     delete pblocktree;
     boost::filesystem::remove_all(pathTemp);
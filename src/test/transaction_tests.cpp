@@ -387,6 +387,61 @@ BOOST_AUTO_TEST_CASE(test_witness) {
     CheckWithFlag(output1, input1, STANDARD_SCRIPT_VERIFY_FLAGS, true);
 }
 
+BOOST_AUTO_TEST_CASE(test_SkipToOutputContent) {
+    CMutableTransaction mtx;
+    mtx.vin.resize(2);
+    mtx.vin[0].scriptSig = CScript() << OP_1 << std::vector<uint8_t>(100, 1);
+    mtx.vout.resize(3);
+    for (size_t i = 0; i < mtx.vout.size(); i++) {
+        mtx.vout[i].nValue = 1000 * (i + 1);
+        mtx.vout[i].scriptPubKey = CScript() << OP_TRUE;
+        mtx.vout[i].strContent = std::string(300 * i, 'a' + i);
+    }
+    mtx.vout[2].nLockTime = 1234;
+
+    for (uint32_t n = 0; n < mtx.vout.size(); n++) {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << CTransaction(mtx);
+        uint64_t nSize;
+        BOOST_CHECK(SkipToOutputContent(ss, n, nSize));
+        BOOST_CHECK_EQUAL(nSize, mtx.vout[n].strContent.size());
+        std::string strContent(nSize, '\0');
+        ss.read(&strContent[0], nSize);
+        BOOST_CHECK(strContent == mtx.vout[n].strContent);
+    }
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CTransaction(mtx);
+    uint64_t nSize;
+    BOOST_CHECK(!SkipToOutputContent(ss, 3, nSize));
+}
+
+BOOST_AUTO_TEST_CASE(test_GetTotalSize) {
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vout.resize(2);
+    mtx.vout[1].strContent = std::string(1000, 'a');
+
+    const CTransaction tx(mtx);
+    BOOST_CHECK_EQUAL(tx.GetTotalSize(),
+                      ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION));
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << tx;
+    const CTransaction txRead(deserialize, ss);
+    BOOST_CHECK_EQUAL(txRead.GetTotalSize(), tx.GetTotalSize());
+
+    CTransaction txAssigned;
+    BOOST_CHECK_EQUAL(txAssigned.GetTotalSize(),
+                      ::GetSerializeSize(txAssigned, SER_NETWORK,
+                                         PROTOCOL_VERSION));
+    txAssigned = tx;
+    BOOST_CHECK_EQUAL(txAssigned.GetTotalSize(), tx.GetTotalSize());
+
+    // Like the id, the size is that of the transaction with its content.
+    BOOST_CHECK_EQUAL(tx.WithoutContent().GetTotalSize(), tx.GetTotalSize());
+}
+
 BOOST_AUTO_TEST_CASE(test_IsStandard) {
     LOCK(cs_main);
     CBasicKeyStore keystore;
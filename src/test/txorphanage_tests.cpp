@@ -0,0 +1,181 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txorphanage.h"
+
+#include "keystore.h"
+#include "policy/policy.h"
+#include "random.h"
+#include "script/sign.h"
+#include "script/standard.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <limits>
+
+BOOST_FIXTURE_TEST_SUITE(txorphanage_tests, BasicTestingSetup)
+
+/** A transaction spending output n of parent, with content of nContent bytes */
+static CTransactionRef Spend(const uint256 &parent, uint32_t n,
+                             size_t nContent = 0) {
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(parent, n, 1 * CENT);
+    tx.vin[0].scriptSig << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1 * CENT;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[0].strContent = std::string(nContent, 'c');
+    return MakeTransactionRef(tx);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_mapOrphans) {
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+
+    CTxOrphanage orphanage;
+    std::vector<CTransactionRef> vOrphans;
+
+    // 50 orphan transactions:
+    for (int i = 0; i < 50; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].prevout.hash = GetRandHash();
+        tx.vin[0].scriptSig << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1 * CENT;
+        tx.vout[0].scriptPubKey =
+            GetScriptForDestination(key.GetPubKey().GetID());
+
+        vOrphans.push_back(MakeTransactionRef(tx));
+        BOOST_CHECK(orphanage.AddTx(vOrphans.back(), i));
+    }
+
+    // ... and 50 that depend on other orphans:
+    for (int i = 0; i < 50; i++) {
+        CTransactionRef txPrev = vOrphans[GetRand(vOrphans.size())];
+
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].prevout.hash = txPrev->GetId();
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1 * CENT;
+        tx.vout[0].scriptPubKey =
+            GetScriptForDestination(key.GetPubKey().GetID());
+        SignSignature(keystore, *txPrev, tx, 0, SIGHASH_ALL);
+
+        vOrphans.push_back(MakeTransactionRef(tx));
+        BOOST_CHECK(orphanage.AddTx(vOrphans.back(), i));
+    }
+    BOOST_CHECK_EQUAL(orphanage.Size(), 100);
+    // Only once.
+    BOOST_CHECK(!orphanage.AddTx(vOrphans[0], 0));
+
+    // This really-big orphan should be ignored:
+    for (int i = 0; i < 10; i++) {
+        CTransactionRef txPrev = vOrphans[GetRand(vOrphans.size())];
+
+        CMutableTransaction tx;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1 * CENT;
+        tx.vout[0].scriptPubKey =
+            GetScriptForDestination(key.GetPubKey().GetID());
+        tx.vin.resize(2777);
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            tx.vin[j].prevout.n = j;
+            tx.vin[j].prevout.hash = txPrev->GetId();
+        }
+        SignSignature(keystore, *txPrev, tx, 0, SIGHASH_ALL);
+        // Re-use same signature for other inputs
+        // (they don't have to be valid for this test)
+        for (unsigned int j = 1; j < tx.vin.size(); j++)
+            tx.vin[j].scriptSig = tx.vin[0].scriptSig;
+
+        BOOST_CHECK(!orphanage.AddTx(MakeTransactionRef(tx), i));
+    }
+
+    // Test EraseForPeer:
+    for (NodeId i = 0; i < 3; i++) {
+        size_t sizeBefore = orphanage.Size();
+        orphanage.EraseForPeer(i);
+        BOOST_CHECK(orphanage.Size() < sizeBefore);
+    }
+
+    // Test Limit() function:
+    orphanage.Limit(40, std::numeric_limits<uint64_t>::max());
+    BOOST_CHECK(orphanage.Size() <= 40);
+    orphanage.Limit(10, std::numeric_limits<uint64_t>::max());
+    BOOST_CHECK(orphanage.Size() <= 10);
+    orphanage.Limit(0, std::numeric_limits<uint64_t>::max());
+    BOOST_CHECK_EQUAL(orphanage.Size(), 0);
+    BOOST_CHECK_EQUAL(orphanage.TotalBytes(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(orphanage_size_limit) {
+    CTxOrphanage orphanage;
+    uint64_t nBytes = 0;
+    for (int i = 0; i < 20; i++) {
+        CTransactionRef tx = Spend(GetRandHash(), 0, 10000);
+        nBytes += GetTransactionSize(*tx);
+        BOOST_CHECK(orphanage.AddTx(tx, 0));
+    }
+    // Content is counted.
+    BOOST_CHECK_EQUAL(orphanage.TotalBytes(), nBytes);
+    BOOST_CHECK(nBytes > 20 * 10000);
+
+    orphanage.Limit(100, 50000);
+    BOOST_CHECK(orphanage.TotalBytes() <= 50000);
+    BOOST_CHECK(orphanage.Size() <= 4);
+    BOOST_CHECK(orphanage.Size() >= 1);
+}
+
+BOOST_AUTO_TEST_CASE(orphanage_work_set) {
+    CTxOrphanage orphanage;
+    CTransactionRef parent = Spend(GetRandHash(), 0);
+
+    // A chain of orphans on the parent, and an unrelated one, from peer 1.
+    CTransactionRef child = Spend(parent->GetId(), 0);
+    CTransactionRef grandchild = Spend(child->GetId(), 0);
+    CTransactionRef unrelated = Spend(GetRandHash(), 0);
+    BOOST_CHECK(orphanage.AddTx(child, 1));
+    BOOST_CHECK(orphanage.AddTx(grandchild, 1));
+    BOOST_CHECK(orphanage.AddTx(unrelated, 1));
+    BOOST_CHECK(!orphanage.HaveTxToReconsider(2));
+
+    // Peer 2 sends the parent: only its child is connectable yet.
+    orphanage.AddChildrenToWorkSet(*parent, 2);
+    BOOST_CHECK(orphanage.HaveTxToReconsider(2));
+    BOOST_CHECK(!orphanage.HaveTxToReconsider(1));
+    std::vector<CTxOrphanage::Orphan> vWork =
+        orphanage.GetTxToReconsider(2, 10);
+    BOOST_REQUIRE_EQUAL(vWork.size(), 1);
+    BOOST_CHECK(vWork[0].tx == child);
+    BOOST_CHECK_EQUAL(vWork[0].fromPeer, 1);
+    BOOST_CHECK(!orphanage.HaveTxToReconsider(2));
+    // Still an orphan until the caller erases it.
+    BOOST_CHECK(orphanage.HaveTx(child->GetId()));
+
+    // The child is accepted, the grandchild follows in the next batch.
+    orphanage.AddChildrenToWorkSet(*child, 2);
+    BOOST_CHECK_EQUAL(orphanage.EraseTx(child->GetId()), 1);
+    BOOST_CHECK_EQUAL(orphanage.EraseTx(child->GetId()), 0);
+    vWork = orphanage.GetTxToReconsider(2, 10);
+    BOOST_REQUIRE_EQUAL(vWork.size(), 1);
+    BOOST_CHECK(vWork[0].tx == grandchild);
+
+    // Orphans erased while in a work set are skipped.
+    orphanage.AddChildrenToWorkSet(*child, 2);
+    orphanage.EraseForBlockTx(*Spend(child->GetId(), 0));
+    BOOST_CHECK(!orphanage.HaveTx(grandchild->GetId()));
+    BOOST_CHECK(orphanage.GetTxToReconsider(2, 10).empty());
+    BOOST_CHECK_EQUAL(orphanage.Size(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
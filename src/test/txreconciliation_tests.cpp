@@ -0,0 +1,98 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txreconciliation.h"
+
+#include "random.h"
+#include "streams.h"
+#include "version.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(recon_salt) {
+    // Both sides of a connection derive the same salt.
+    BOOST_CHECK(ComputeReconSalt(1, 2) == ComputeReconSalt(2, 1));
+    BOOST_CHECK(ComputeReconSalt(1, 2) != ComputeReconSalt(1, 3));
+
+    uint256 salt = ComputeReconSalt(1, 2);
+    uint256 txid = GetRandHash();
+    BOOST_CHECK_EQUAL(GetReconShortId(salt, txid),
+                      GetReconShortId(salt, txid));
+    BOOST_CHECK(GetReconShortId(salt, txid) !=
+                GetReconShortId(ComputeReconSalt(1, 3), txid));
+}
+
+BOOST_AUTO_TEST_CASE(recon_sketch_decode) {
+    FastRandomContext insecure_rand(true);
+
+    // Two sets sharing most of their elements.
+    std::vector<uint32_t> vCommon, vOnlyOurs, vOnlyTheirs;
+    for (int i = 0; i < 1000; i++) {
+        vCommon.push_back(insecure_rand.rand32());
+    }
+    for (int i = 0; i < 40; i++) {
+        vOnlyOurs.push_back(insecure_rand.rand32());
+    }
+    for (int i = 0; i < 25; i++) {
+        vOnlyTheirs.push_back(insecure_rand.rand32());
+    }
+
+    size_t nCells = GetReconSketchCells(vCommon.size() + vOnlyOurs.size(),
+                                        vCommon.size() + vOnlyTheirs.size());
+    CReconSketch ours(nCells), theirs(nCells);
+    BOOST_CHECK(ours.IsWellFormed());
+    for (uint32_t n : vCommon) {
+        ours.Insert(n);
+        theirs.Insert(n);
+    }
+    for (uint32_t n : vOnlyOurs) {
+        ours.Insert(n);
+    }
+    for (uint32_t n : vOnlyTheirs) {
+        theirs.Insert(n);
+    }
+
+    // The sketch goes over the wire.
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << theirs;
+    CReconSketch received;
+    stream >> received;
+    BOOST_CHECK_EQUAL(received.GetCells(), ours.GetCells());
+
+    BOOST_CHECK(ours.Subtract(received));
+    std::vector<uint32_t> vOurs, vTheirs;
+    BOOST_CHECK(ours.Decode(vOurs, vTheirs));
+    std::sort(vOurs.begin(), vOurs.end());
+    std::sort(vTheirs.begin(), vTheirs.end());
+    std::sort(vOnlyOurs.begin(), vOnlyOurs.end());
+    std::sort(vOnlyTheirs.begin(), vOnlyTheirs.end());
+    BOOST_CHECK(vOurs == vOnlyOurs);
+    BOOST_CHECK(vTheirs == vOnlyTheirs);
+}
+
+BOOST_AUTO_TEST_CASE(recon_sketch_overflow) {
+    FastRandomContext insecure_rand(true);
+
+    // Far more differences than cells can't be decoded, and say so.
+    CReconSketch ours(30), theirs(30);
+    for (int i = 0; i < 200; i++) {
+        ours.Insert(insecure_rand.rand32());
+    }
+    BOOST_CHECK(ours.Subtract(theirs));
+    std::vector<uint32_t> vOurs, vTheirs;
+    BOOST_CHECK(!ours.Decode(vOurs, vTheirs));
+
+    // Sketches of different sizes don't combine.
+    CReconSketch other(60);
+    BOOST_CHECK(!ours.Subtract(other));
+    BOOST_CHECK(!CReconSketch().IsWellFormed());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,113 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txrelay.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txrelay_tests, BasicTestingSetup)
+
+static uint256 TxId(uint8_t n) {
+    uint256 txid;
+    *txid.begin() = n;
+    return txid;
+}
+
+BOOST_AUTO_TEST_CASE(txrelay_fanout) {
+    CTxRelay relay(60, 100);
+    uint64_t nCursorA, nCursorB;
+    int nSlotA = relay.AddPeer(nCursorA);
+    int nSlotB = relay.AddPeer(nCursorB);
+    BOOST_CHECK(nSlotA != nSlotB);
+
+    relay.Announce(TxId(1), 1000);
+    relay.Announce(TxId(2), 1000);
+    // Queued once, however often it is relayed.
+    relay.Announce(TxId(1), 1000);
+    BOOST_CHECK_EQUAL(relay.Size(), 2);
+
+    // Peer A sent us the second one, so only B hears about it.
+    relay.MarkKnown(nSlotA, TxId(2));
+
+    std::vector<uint256> vTxid;
+    relay.GetAnnouncements(nSlotA, nCursorA, vTxid);
+    BOOST_CHECK(vTxid == std::vector<uint256>({TxId(1)}));
+    vTxid.clear();
+    relay.GetAnnouncements(nSlotB, nCursorB, vTxid);
+    BOOST_CHECK(vTxid == std::vector<uint256>({TxId(1), TxId(2)}));
+
+    // Each peer only sees what was queued since its last visit.
+    relay.Announce(TxId(3), 1001);
+    vTxid.clear();
+    relay.GetAnnouncements(nSlotA, nCursorA, vTxid);
+    BOOST_CHECK(vTxid == std::vector<uint256>({TxId(3)}));
+    vTxid.clear();
+    relay.GetAnnouncements(nSlotA, nCursorA, vTxid);
+    BOOST_CHECK(vTxid.empty());
+
+    // A new peer starts at the end of the queue.
+    uint64_t nCursorC;
+    relay.AddPeer(nCursorC);
+    relay.GetAnnouncements(2, nCursorC, vTxid);
+    BOOST_CHECK(vTxid.empty());
+}
+
+BOOST_AUTO_TEST_CASE(txrelay_slots) {
+    CTxRelay relay(60, 100);
+    uint64_t nCursor;
+    std::vector<int> vSlots;
+    for (int i = 0; i < 130; i++) {
+        vSlots.push_back(relay.AddPeer(nCursor));
+        BOOST_CHECK_EQUAL(vSlots.back(), i);
+    }
+
+    // Slots past the first word of the bitset work the same.
+    relay.Announce(TxId(1), 1000);
+    relay.MarkKnown(129, TxId(1));
+    std::vector<uint256> vTxid;
+    uint64_t nCursor129 = 0, nCursor128 = 0;
+    relay.GetAnnouncements(129, nCursor129, vTxid);
+    BOOST_CHECK(vTxid.empty());
+    relay.GetAnnouncements(128, nCursor128, vTxid);
+    BOOST_CHECK_EQUAL(vTxid.size(), 1);
+
+    // A freed slot is reused, without what its previous peer knew.
+    relay.RemovePeer(129);
+    BOOST_CHECK_EQUAL(relay.AddPeer(nCursor), 129);
+    vTxid.clear();
+    nCursor129 = 0;
+    relay.GetAnnouncements(129, nCursor129, vTxid);
+    BOOST_CHECK_EQUAL(vTxid.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(txrelay_expiry) {
+    CTxRelay relay(60, 2);
+    uint64_t nCursorSlow, nCursorFast;
+    int nSlow = relay.AddPeer(nCursorSlow);
+    int nFast = relay.AddPeer(nCursorFast);
+
+    relay.Announce(TxId(1), 1000);
+    relay.Announce(TxId(2), 1000);
+    std::vector<uint256> vTxid;
+    relay.GetAnnouncements(nFast, nCursorFast, vTxid);
+    BOOST_CHECK_EQUAL(vTxid.size(), 2);
+
+    // The queue is full, so the oldest entry goes.
+    relay.Announce(TxId(3), 1010);
+    BOOST_CHECK_EQUAL(relay.Size(), 2);
+    // And entries older than the window go too.
+    relay.Announce(TxId(4), 1061);
+    BOOST_CHECK_EQUAL(relay.Size(), 2);
+
+    vTxid.clear();
+    relay.GetAnnouncements(nSlow, nCursorSlow, vTxid);
+    BOOST_CHECK(vTxid == std::vector<uint256>({TxId(3), TxId(4)}));
+    vTxid.clear();
+    relay.GetAnnouncements(nFast, nCursorFast, vTxid);
+    BOOST_CHECK(vTxid == std::vector<uint256>({TxId(3), TxId(4)}));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
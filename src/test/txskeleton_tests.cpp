@@ -0,0 +1,140 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txskeleton.h"
+
+#include "random.h"
+#include "script/script.h"
+#include "streams.h"
+#include "version.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txskeleton_tests, BasicTestingSetup)
+
+static CTransaction MakeContentTx() {
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0, 10 * COIN);
+    mtx.vin[0].scriptSig = CScript() << OP_0;
+    const CScript script = CScript() << OP_TRUE;
+    // Two and a half chunks, then an output without content and one chunk.
+    mtx.vout.emplace_back(COIN, script,
+                          std::string(2 * TXCONTENT_CHUNK_SIZE + 100, 'a'));
+    mtx.vout.emplace_back(COIN, script);
+    mtx.vout.emplace_back(COIN, script, std::string(1000, 'b'));
+    return CTransaction(mtx);
+}
+
+BOOST_AUTO_TEST_CASE(skeleton_roundtrip) {
+    const CTransaction tx = MakeContentTx();
+    BOOST_CHECK(IsRelayedAsSkeleton(tx));
+
+    const CTxSkeleton skeleton(tx);
+    BOOST_CHECK(skeleton.IsValid());
+    BOOST_CHECK_EQUAL(skeleton.vContent.size(), 2U);
+    BOOST_CHECK_EQUAL(skeleton.vContent[0].nOutput, 0U);
+    BOOST_CHECK_EQUAL(skeleton.vContent[0].vChunkHashes.size(), 3U);
+    BOOST_CHECK_EQUAL(skeleton.vContent[1].nOutput, 2U);
+    BOOST_CHECK_EQUAL(skeleton.GetContentSize(),
+                      2 * TXCONTENT_CHUNK_SIZE + 1100U);
+
+    // Far smaller than the transaction, and the same after a round trip.
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << skeleton;
+    BOOST_CHECK(ss.size() < 1000);
+    CTxSkeleton skeleton2;
+    ss >> skeleton2;
+    BOOST_CHECK(skeleton2.txid == tx.GetId());
+    BOOST_CHECK(skeleton2.IsValid());
+
+    // The transaction without content has the id and size with it.
+    CTransactionRef ptxNoContent = skeleton2.GetTransaction();
+    BOOST_CHECK(ptxNoContent->GetId() == tx.GetId());
+    BOOST_CHECK_EQUAL(ptxNoContent->GetTotalSize(), tx.GetTotalSize());
+    BOOST_CHECK_EQUAL(ptxNoContent->GetSigOpCount(), tx.GetSigOpCount());
+    BOOST_CHECK(!ptxNoContent->HasContent());
+
+    // Too little content for a skeleton.
+    CMutableTransaction mtx(tx);
+    mtx.vout[0].strContent.clear();
+    BOOST_CHECK(!IsRelayedAsSkeleton(CTransaction(mtx)));
+}
+
+BOOST_AUTO_TEST_CASE(skeleton_invalid) {
+    const CTxSkeleton skeleton(MakeContentTx());
+
+    CTxSkeleton bad = skeleton;
+    bad.vContent.clear();
+    BOOST_CHECK(!bad.IsValid());
+
+    bad = skeleton;
+    bad.vContent[1].nOutput = 3;
+    BOOST_CHECK(!bad.IsValid());
+
+    bad = skeleton;
+    std::swap(bad.vContent[0], bad.vContent[1]);
+    BOOST_CHECK(!bad.IsValid());
+
+    bad = skeleton;
+    bad.vContent[0].vChunkHashes.pop_back();
+    BOOST_CHECK(!bad.IsValid());
+
+    bad = skeleton;
+    bad.vContent[1].nSize = MAX_TX_OUT_CONTENT_SIZE + 1;
+    BOOST_CHECK(!bad.IsValid());
+
+    bad = skeleton;
+    bad.tx.vout[1].strContent = "content";
+    BOOST_CHECK(!bad.IsValid());
+}
+
+BOOST_AUTO_TEST_CASE(partial_content) {
+    const CTransaction tx = MakeContentTx();
+    const CTxSkeleton skeleton(tx);
+    CPartialContentTx partial(skeleton);
+    BOOST_CHECK(partial.GetId() == tx.GetId());
+    BOOST_CHECK_EQUAL(partial.GetChunkCount(), 4U);
+    BOOST_CHECK(!partial.IsComplete());
+
+    BOOST_CHECK_EQUAL(partial.FindChunk(0, 0), 0);
+    BOOST_CHECK_EQUAL(partial.FindChunk(0, 2 * TXCONTENT_CHUNK_SIZE), 2);
+    BOOST_CHECK_EQUAL(partial.FindChunk(2, 0), 3);
+    BOOST_CHECK_EQUAL(partial.FindChunk(0, 1), -1);
+    BOOST_CHECK_EQUAL(partial.FindChunk(1, 0), -1);
+    BOOST_CHECK_EQUAL(partial.GetChunk(2).nLength, 100U);
+
+    // Chunks that don't match their hash are refused, in any order the
+    // others are taken.
+    BOOST_CHECK(!partial.FillChunk(3, std::string(1000, 'c')));
+    BOOST_CHECK(!partial.FillChunk(3, std::string(999, 'b')));
+    BOOST_CHECK(!partial.HaveChunk(3));
+    for (size_t i : {3, 1, 0, 2}) {
+        const CPartialContentTx::Chunk &chunk = partial.GetChunk(i);
+        BOOST_CHECK(partial.FillChunk(
+            i, tx.vout[chunk.nOutput].strContent.substr(chunk.nOffset,
+                                                        chunk.nLength)));
+        BOOST_CHECK(partial.HaveChunk(i));
+    }
+    BOOST_CHECK(partial.IsComplete());
+    BOOST_CHECK(*partial.GetTransaction() == tx);
+    BOOST_CHECK(partial.GetTransaction()->GetId() == tx.GetId());
+
+    // A skeleton claiming another id puts together a transaction that shows
+    // it.
+    CTxSkeleton lying = skeleton;
+    lying.txid = GetRandHash();
+    CPartialContentTx partialLying(lying);
+    for (size_t i = 0; i < partialLying.GetChunkCount(); i++) {
+        const CPartialContentTx::Chunk &chunk = partialLying.GetChunk(i);
+        partialLying.FillChunk(i, tx.vout[chunk.nOutput].strContent.substr(
+                                      chunk.nOffset, chunk.nLength));
+    }
+    BOOST_CHECK(partialLying.IsComplete());
+    BOOST_CHECK(partialLying.GetTransaction()->GetId() != lying.txid);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -88,6 +88,50 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup) {
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+static void SignFirstInput(CMutableTransaction &tx,
+                           const CScript &scriptPubKey, const CKey &key) {
+    std::vector<uint8_t> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back(uint8_t(SIGHASH_ALL));
+    tx.vin[0].scriptSig << vchSig;
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_mempool_content_parent, TestChain100Setup) {
+    // The coins of the mempool leave the content of their output out, a
+    // child spending a content output of an unconfirmed parent must not
+    // trip over that.
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey())
+                                     << OP_CHECKSIG;
+
+    CMutableTransaction parent;
+    parent.nVersion = 1;
+    parent.vin.resize(1);
+    parent.vin[0].prevout.hash = coinbaseTxns[0].GetId();
+    parent.vin[0].prevout.n = 0;
+    parent.vout.resize(1);
+    parent.vout[0].nValue = 11 * CENT;
+    parent.vout[0].scriptPubKey = scriptPubKey;
+    parent.vout[0].strContent = std::string(1000, 'c');
+
+    CMutableTransaction child;
+    child.nVersion = 1;
+    child.vin.resize(1);
+    child.vout.resize(1);
+    child.vout[0].nValue = 10 * CENT;
+    child.vout[0].scriptPubKey = scriptPubKey;
+
+    SignFirstInput(parent, scriptPubKey, coinbaseKey);
+    child.vin[0].prevout.hash = parent.GetId();
+    child.vin[0].prevout.n = 0;
+    SignFirstInput(child, scriptPubKey, coinbaseKey);
+
+    BOOST_CHECK(ToMemPool(parent));
+    BOOST_CHECK(ToMemPool(child));
+    BOOST_CHECK_EQUAL(mempool.size(), 2);
+    mempool.clear();
+}
+
 // Run CheckInputs (using pcoinsTip) on the given transaction, for all script
 // flags. Test that CheckInputs passes for all flags that don't overlap with the
 // failing_flags argument, but otherwise fails.
@@ -98,4 +98,65 @@ BOOST_AUTO_TEST_CASE(connect_utxo_extblock) {
     BOOST_CHECK(HasSpendableCoin(view, prevTx0.GetId()));
 }
 
+BOOST_AUTO_TEST_CASE(undo_without_content) {
+    CCoinsView coinsDummy;
+    CCoinsViewCache view(&coinsDummy);
+
+    CBlock block;
+    block.hashPrevBlock = GetRandHash();
+    view.SetBestBlock(block.hashPrevBlock);
+
+    // The block spends a content output and creates another.
+    CMutableTransaction tx;
+    tx.nFlags = TX_FLAGS_COINBASE;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = CAmount(42);
+    block.vtx.push_back(MakeTransactionRef(tx));
+
+    tx.nFlags = TX_FLAGS_NORMAL;
+    tx.nVersion = 2;
+    tx.vin[0].prevout.hash = GetRandHash();
+    tx.vin[0].prevout.n = 0;
+    tx.vin[0].scriptSig.resize(0);
+    tx.vout[0].nValue = COIN;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[0].strContent = std::string(100000, 'x');
+    const CTransaction prevTx(tx);
+    AddCoins(view, prevTx, 100);
+
+    tx.vin[0].prevout.hash = prevTx.GetId();
+    block.vtx.push_back(MakeTransactionRef(tx));
+    const CTransaction &spendTx = *block.vtx.back();
+
+    CBlockUndo blockundo;
+    UpdateUTXOSet(block, view, blockundo, Params(), 123456);
+    BOOST_CHECK(HasSpendableCoin(view, spendTx.GetId()));
+    BOOST_CHECK(!HasSpendableCoin(view, prevTx.GetId()));
+
+    // The record of the spent content output holds no content.
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << blockundo;
+    BOOST_CHECK_LT(ss.size(), 100U);
+    CBlockUndo blockundoRead;
+    ss >> blockundoRead;
+    BOOST_REQUIRE_EQUAL(blockundoRead.vtxundo.size(), 1U);
+    const Coin &coin = blockundoRead.vtxundo[0].vprevout[0];
+    BOOST_CHECK(coin.GetTxOut().strContent.empty());
+
+    // Disconnecting is clean all the same: the coins of the block are
+    // compared to its outputs without the content, and the spent one comes
+    // back without it, as the coins of the chainstate are.
+    CBlockIndex index;
+    index.nHeight = 123456;
+    BOOST_CHECK_EQUAL(ApplyBlockUndo(blockundoRead, block, &index, view),
+                      DISCONNECT_OK);
+    BOOST_CHECK(view.GetBestBlock() == block.hashPrevBlock);
+    BOOST_CHECK(!HasSpendableCoin(view, spendTx.GetId()));
+    BOOST_CHECK(HasSpendableCoin(view, prevTx.GetId()));
+    BOOST_CHECK(view.AccessCoin(COutPoint(prevTx.GetId(), 0)).GetTxOut() ==
+                CTxOut(COIN, CScript() << OP_TRUE));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
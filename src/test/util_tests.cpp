@@ -12,6 +12,7 @@
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <vector>
 
@@ -103,6 +104,25 @@ BOOST_AUTO_TEST_CASE(util_DateTimeStrFormat) {
         "Fri, 30 Sep 2011 23:36:17 +0000");
 }
 
+BOOST_AUTO_TEST_CASE(util_LogRateLimited) {
+    BOOST_CHECK(!LogRateLimited("test"));
+
+    SetLogRateLimit(2);
+    // Keep clear of the end of a second, where the limit starts over.
+    while (GetTimeMillis() % 1000 > 500) {
+        MilliSleep(10);
+    }
+    BOOST_CHECK(!LogRateLimited("test"));
+    BOOST_CHECK(!LogRateLimited("test"));
+    BOOST_CHECK(LogRateLimited("test"));
+    // Each category has its own limit, uncategorized messages have none.
+    BOOST_CHECK(!LogRateLimited("other"));
+    BOOST_CHECK(!LogRateLimited(nullptr));
+
+    SetLogRateLimit(0);
+    BOOST_CHECK(!LogRateLimited("test"));
+}
+
 BOOST_AUTO_TEST_CASE(util_ParseParameters) {
     const char *argv_test[] = {"-ignored",      "-a", "-b",  "-ccc=argument",
                                "-ccc=multiple", "f",  "-d=e"};
@@ -241,6 +261,45 @@ BOOST_AUTO_TEST_CASE(util_IsHex) {
     BOOST_CHECK(!IsHex("0x0000"));
 }
 
+BOOST_AUTO_TEST_CASE(util_hex_long) {
+    // Long enough for the vectorized code, with a tail it leaves over.
+    std::vector<uint8_t> vch(1000);
+    std::string strExpected;
+    static const char hexmap[] = "0123456789abcdef";
+    for (size_t i = 0; i < vch.size(); i++) {
+        vch[i] = uint8_t(i * 7 + 3);
+        strExpected += hexmap[vch[i] >> 4];
+        strExpected += hexmap[vch[i] & 15];
+    }
+    const std::string strHex = HexStr(vch);
+    BOOST_CHECK_EQUAL(strHex, strExpected);
+    BOOST_CHECK_EQUAL(HexStr(vch.data(), vch.data() + vch.size()), strHex);
+    BOOST_CHECK_EQUAL(HexStr(std::string(vch.begin(), vch.end())), strHex);
+
+    BOOST_CHECK(ParseHex(strHex) == vch);
+    BOOST_CHECK(IsHex(strHex));
+    std::string strUpper = strHex;
+    std::transform(strUpper.begin(), strUpper.end(), strUpper.begin(),
+                   ::toupper);
+    BOOST_CHECK(ParseHex(strUpper) == vch);
+    BOOST_CHECK(IsHex(strUpper));
+
+    // A char that isn't a hex digit stops the parse right there, wherever it
+    // is. Whitespace between bytes is skipped.
+    for (size_t nPos : {0, 1, 63, 64, 65, 1000, 1999}) {
+        for (char c : {'g', 'G', '/', ':', '@', '`', '\x80', '\xff'}) {
+            std::string str = strHex;
+            str[nPos] = c;
+            BOOST_CHECK(!IsHex(str));
+            BOOST_CHECK(ParseHex(str) ==
+                        std::vector<uint8_t>(vch.begin(),
+                                             vch.begin() + nPos / 2));
+        }
+    }
+    BOOST_CHECK(ParseHex(strHex.substr(0, 100) + " \n" +
+                         strHex.substr(100)) == vch);
+}
+
 BOOST_AUTO_TEST_CASE(util_seed_insecure_rand) {
     seed_insecure_rand(true);
     for (int mod = 2; mod < 11; mod++) {
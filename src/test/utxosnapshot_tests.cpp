@@ -0,0 +1,192 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "utxosnapshot.h"
+
+#include "clientversion.h"
+#include "coins.h"
+#include "random.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+
+#include <cstdio>
+#include <map>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace {
+//! Cursor over a map, which is ordered like the coins database.
+class CCoinsMapCursor : public CCoinsViewCursor {
+public:
+    CCoinsMapCursor(const std::map<COutPoint, Coin> &mapIn,
+                    const uint256 &hashBlockIn)
+        : CCoinsViewCursor(hashBlockIn), map(mapIn), it(mapIn.begin()) {}
+
+    bool GetKey(COutPoint &key) const override {
+        key = it->first;
+        return true;
+    }
+    bool GetValue(Coin &coin) const override {
+        coin = it->second;
+        return true;
+    }
+    unsigned int GetValueSize() const override { return 0; }
+
+    bool Valid() const override { return it != map.end(); }
+    void Next() override { ++it; }
+
+private:
+    const std::map<COutPoint, Coin> &map;
+    std::map<COutPoint, Coin>::const_iterator it;
+};
+
+//! Cache with no backend, which keeps everything it is flushed.
+class CCoinsViewMap : public CCoinsView {
+public:
+    std::map<COutPoint, Coin> map;
+
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                    const CUTXOStats *pstats) override {
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();
+             it = mapCoins.erase(it)) {
+            map[it->first] = std::move(it->second.coin);
+        }
+        return true;
+    }
+};
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(utxosnapshot_tests, BasicTestingSetup)
+
+static boost::filesystem::path WriteSnapshot(
+    const std::map<COutPoint, Coin> &mapCoins, SnapshotMetadata &metadata,
+    uint256 &hash) {
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() /
+                                   boost::filesystem::unique_path();
+    CAutoFile file(fopen(path.string().c_str(), "wb"), SER_DISK,
+                   CLIENT_VERSION);
+    CCoinsMapCursor cursor(mapCoins, metadata.hashBase);
+    std::string strError;
+    BOOST_CHECK(WriteUTXOSnapshot(cursor, metadata, file, hash, strError));
+    return path;
+}
+
+static bool LoadSnapshot(const boost::filesystem::path &path,
+                         CCoinsViewMap &backend, std::string &strError) {
+    CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK,
+                   CLIENT_VERSION);
+    SnapshotMetadata metadata;
+    if (!ReadUTXOSnapshotMetadata(file, metadata, strError)) {
+        return false;
+    }
+    // Small enough to flush a few times on the way.
+    CCoinsViewCache view(&backend);
+    uint256 hash;
+    bool fLoaded =
+        LoadUTXOSnapshotCoins(file, metadata, view, 16 * 1024, hash, strError);
+    view.Flush();
+    return fLoaded;
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_roundtrip) {
+    std::map<COutPoint, Coin> mapCoins;
+    for (uint32_t i = 0; i < 500; i++) {
+        CScript script = CScript() << OP_DUP << i;
+        mapCoins[COutPoint(GetRandHash(), insecure_rand() % 8)] =
+            Coin(CTxOut(i + 1, script), 1 + insecure_rand() % 100, i % 7 == 0);
+    }
+
+    SnapshotMetadata metadata;
+    metadata.hashBase = GetRandHash();
+    metadata.nHeight = 100;
+    metadata.nChainTx = 1234;
+    metadata.nChainInterest = 5678;
+    uint256 hash;
+    boost::filesystem::path path = WriteSnapshot(mapCoins, metadata, hash);
+    BOOST_CHECK_EQUAL(metadata.nCoins, mapCoins.size());
+
+    // The header is written again with the coin count.
+    {
+        CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK,
+                       CLIENT_VERSION);
+        SnapshotMetadata metadataRead;
+        std::string strError;
+        BOOST_CHECK(ReadUTXOSnapshotMetadata(file, metadataRead, strError));
+        BOOST_CHECK(metadataRead.hashBase == metadata.hashBase);
+        BOOST_CHECK_EQUAL(metadataRead.nHeight, 100);
+        BOOST_CHECK_EQUAL(metadataRead.nChainTx, 1234U);
+        BOOST_CHECK_EQUAL(metadataRead.nChainInterest, 5678U);
+        BOOST_CHECK_EQUAL(metadataRead.nCoins, mapCoins.size());
+    }
+
+    CCoinsViewMap backend;
+    std::string strError;
+    BOOST_CHECK(LoadSnapshot(path, backend, strError));
+    BOOST_CHECK_EQUAL(backend.map.size(), mapCoins.size());
+    for (const auto &entry : mapCoins) {
+        const Coin &coin = backend.map[entry.first];
+        BOOST_CHECK(coin.GetTxOut() == entry.second.GetTxOut());
+        BOOST_CHECK_EQUAL(coin.GetHeight(), entry.second.GetHeight());
+        BOOST_CHECK_EQUAL(coin.IsCoinBase(), entry.second.IsCoinBase());
+    }
+
+    // Any changed byte breaks the commitment or the format.
+    uintmax_t nSize = boost::filesystem::file_size(path);
+    for (int i = 0; i < 10; i++) {
+        long nPos = 6 + insecure_rand() % (nSize - 6);
+        FILE *f = fopen(path.string().c_str(), "rb+");
+        fseek(f, nPos, SEEK_SET);
+        int c = fgetc(f);
+        fseek(f, nPos, SEEK_SET);
+        fputc(c ^ 0x20, f);
+        fclose(f);
+
+        CCoinsViewMap backendBad;
+        BOOST_CHECK(!LoadSnapshot(path, backendBad, strError));
+
+        f = fopen(path.string().c_str(), "rb+");
+        fseek(f, nPos, SEEK_SET);
+        fputc(c, f);
+        fclose(f);
+    }
+
+    // Truncated
+    boost::filesystem::resize_file(path, nSize - 1);
+    CCoinsViewMap backendTruncated;
+    BOOST_CHECK(!LoadSnapshot(path, backendTruncated, strError));
+    BOOST_CHECK_EQUAL(strError, "Snapshot file is truncated");
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_metadata_checks) {
+    std::map<COutPoint, Coin> mapCoins;
+    mapCoins[COutPoint(GetRandHash(), 0)] = Coin(CTxOut(1, CScript()), 5, false);
+
+    // A coin from after the base block.
+    SnapshotMetadata metadata;
+    metadata.nHeight = 4;
+    uint256 hash;
+    boost::filesystem::path path = WriteSnapshot(mapCoins, metadata, hash);
+    CCoinsViewMap backend;
+    std::string strError;
+    BOOST_CHECK(!LoadSnapshot(path, backend, strError));
+    boost::filesystem::remove(path);
+
+    metadata = SnapshotMetadata();
+    metadata.nMagic = 0;
+    path = WriteSnapshot(mapCoins, metadata, hash);
+    BOOST_CHECK(!LoadSnapshot(path, backend, strError));
+    BOOST_CHECK_EQUAL(strError, "Not a UTXO snapshot");
+    boost::filesystem::remove(path);
+
+    metadata = SnapshotMetadata();
+    metadata.nVersion = SNAPSHOT_VERSION + 1;
+    path = WriteSnapshot(mapCoins, metadata, hash);
+    BOOST_CHECK(!LoadSnapshot(path, backend, strError));
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,10 +4,16 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "validation.h"
+#include "addressindex.h"
 #include "chainparams.h"
 #include "config.h"
 #include "consensus/consensus.h"
+#include "consensus/validation.h"
+#include "pow.h"
 #include "primitives/transaction.h"
+#include "script/interpreter.h"
+#include "txdb.h"
+#include "txindex.h"
 #include "test/test_bitcoin.h"
 #include "util.h"
 
@@ -76,4 +82,223 @@ BOOST_AUTO_TEST_CASE(validation_load_external_block_file) {
     BOOST_CHECK_NO_THROW({ LoadExternalBlockFile(config, fp, 0); });
 }
 
+BOOST_FIXTURE_TEST_CASE(validation_block_index_snapshot, TestChain100Setup) {
+    const CChainParams &chainparams = GetConfig().GetChainParams();
+    FlushStateToDisk();
+
+    // Start from an index loaded from the database.
+    UnloadBlockIndex();
+    BOOST_CHECK(LoadBlockIndex(chainparams));
+    const uint256 hashTip = chainActive.Tip()->GetBlockHash();
+    const size_t nEntries = mapBlockIndex.size();
+    BOOST_CHECK(WriteBlockIndexSnapshot());
+
+    // The next load comes from the snapshot and rebuilds the same chain.
+    uint64_t nId;
+    BOOST_CHECK(pblocktree->ReadIndexSnapshotId(nId));
+    UnloadBlockIndex();
+    BOOST_CHECK(LoadBlockIndex(chainparams));
+    BOOST_CHECK(!pblocktree->ReadIndexSnapshotId(nId));
+    BOOST_CHECK_EQUAL(mapBlockIndex.size(), nEntries);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == hashTip);
+    BOOST_CHECK(chainActive.Tip()->nChainWork > 0);
+    for (const std::pair<uint256, CBlockIndex *> &item : mapBlockIndex) {
+        BOOST_CHECK(item.second->GetBlockHash() == item.first);
+        BOOST_CHECK(item.second->pprev || item.second->nHeight == 0);
+    }
+
+    // Having been used, it is not trusted again.
+    UnloadBlockIndex();
+    BOOST_CHECK(LoadBlockIndex(chainparams));
+    BOOST_CHECK_EQUAL(mapBlockIndex.size(), nEntries);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == hashTip);
+}
+
+BOOST_FIXTURE_TEST_CASE(validation_verified_blocks, TestChain100Setup) {
+    const Config &config = GetConfig();
+    FlushStateToDisk();
+    const int nHeight = chainActive.Height();
+
+    BOOST_CHECK(CVerifyDB().VerifyDB(config, pcoinsTip, 3, 10, true));
+    BOOST_CHECK(WriteVerifiedBlocks());
+    CVerifiedBlocks verified;
+    BOOST_CHECK(pblocktree->ReadVerifiedBlocks(verified));
+    BOOST_CHECK(verified.hashTip == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(verified.nHeight, nHeight - 10);
+    BOOST_CHECK_EQUAL(verified.nCheckLevel, 3);
+
+    // The next verification uses up the record, and keeps its range when it
+    // covers the blocks asked for.
+    BOOST_CHECK(CVerifyDB().VerifyDB(config, pcoinsTip, 3, 5, true));
+    BOOST_CHECK(!pblocktree->ReadVerifiedBlocks(verified));
+    BOOST_CHECK(WriteVerifiedBlocks());
+    BOOST_CHECK(pblocktree->ReadVerifiedBlocks(verified));
+    BOOST_CHECK_EQUAL(verified.nHeight, nHeight - 10);
+
+    // A deeper level checks the blocks again.
+    BOOST_CHECK(CVerifyDB().VerifyDB(config, pcoinsTip, 4, 5, true));
+    BOOST_CHECK(WriteVerifiedBlocks());
+    BOOST_CHECK(pblocktree->ReadVerifiedBlocks(verified));
+    BOOST_CHECK_EQUAL(verified.nHeight, nHeight - 5);
+    BOOST_CHECK_EQUAL(verified.nCheckLevel, 4);
+}
+
+BOOST_FIXTURE_TEST_CASE(validation_header_height, TestChain100Setup) {
+    const Config &config = GetConfig();
+    CBlockHeader header;
+    {
+        LOCK(cs_main);
+        header.hashPrevBlock = chainActive.Tip()->GetBlockHash();
+        header.nTime = chainActive.Tip()->GetMedianTimePast() + 1;
+        header.nBits = GetNextWorkRequired(chainActive.Tip(), &header, config);
+    }
+
+    // A height far from the parent's would make the light check build the
+    // cache of a distant epoch, the header is refused before that.
+    header.nBlockHeight = 0xFFFFFFF0;
+    while (!CheckProofOfWorkQuick(header, config)) {
+        ++header.nNonce;
+    }
+    CValidationState state;
+    BOOST_CHECK(!ProcessNewBlockHeaders(config, {header, header}, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-blk-height");
+    BOOST_CHECK(mapBlockIndex.count(header.GetHash()) == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(validation_disconnect_content, TestChain100Setup) {
+    const Config &config = GetConfig();
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey())
+                                     << OP_CHECKSIG;
+
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.hash = coinbaseTxns[0].GetId();
+    tx.vin[0].prevout.n = 0;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 11 * CENT;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+    tx.vout[0].strContent = std::string(1000, 'c');
+    std::vector<uint8_t> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back(uint8_t(SIGHASH_ALL));
+    tx.vin[0].scriptSig << vchSig;
+
+    CBlock block = CreateAndProcessBlock({tx}, scriptPubKey);
+    BOOST_REQUIRE(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    const COutPoint outpoint(tx.GetId(), 0);
+    BOOST_CHECK(!pcoinsTip->AccessCoin(outpoint).IsSpent());
+
+    // The coin lacks the content the block holds, disconnecting is still
+    // clean.
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(InvalidateBlock(config, state, chainActive.Tip()));
+    }
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.hashPrevBlock);
+    BOOST_CHECK(pcoinsTip->AccessCoin(outpoint).IsSpent());
+    BOOST_CHECK(!pcoinsTip->AccessCoin(tx.vin[0].prevout).IsSpent());
+}
+
+BOOST_FIXTURE_TEST_CASE(validation_txindex, TestChain100Setup) {
+    const Config &config = GetConfig();
+    fTxIndex = true;
+
+    // The index catches up with the chain on its own thread.
+    {
+        CTxIndex txindex(config, false);
+        for (int i = 0; i < 1000 && !txindex.IsSynced(); i++) {
+            MilliSleep(10);
+        }
+        BOOST_REQUIRE(txindex.IsSynced());
+    }
+    uint256 hashBest;
+    BOOST_CHECK(pblocktree->ReadTxIndexBestBlock(hashBest));
+    BOOST_CHECK(hashBest == chainActive.Tip()->GetBlockHash());
+
+    CTransactionRef tx;
+    uint256 hashBlock;
+    BOOST_CHECK(
+        GetTransaction(config, coinbaseTxns[50].GetId(), tx, hashBlock, false));
+    BOOST_CHECK(tx->GetId() == coinbaseTxns[50].GetId());
+    BOOST_CHECK(hashBlock == chainActive[51]->GetBlockHash());
+
+    // An id that only starts like an indexed one finds nothing.
+    uint256 txidOther = coinbaseTxns[50].GetId();
+    *(txidOther.end() - 1) ^= 1;
+    std::vector<CDiskTxPos> vPos;
+    BOOST_CHECK(pblocktree->ReadTxIndex(txidOther, vPos));
+    BOOST_CHECK(!GetTransaction(config, txidOther, tx, hashBlock, false));
+
+    // Dropping erases every entry.
+    {
+        CTxIndex txindex(config, true);
+        for (int i = 0; i < 1000 && !txindex.IsSynced(); i++) {
+            MilliSleep(10);
+        }
+        BOOST_REQUIRE(txindex.IsSynced());
+    }
+    size_t nErased;
+    BOOST_CHECK(pblocktree->EraseTxIndex(1, nErased));
+    BOOST_CHECK_EQUAL(nErased, 0);
+    BOOST_CHECK(!pblocktree->ReadTxIndexBestBlock(hashBest));
+
+    fTxIndex = false;
+}
+
+/** Wait for the address index to catch up with the active chain */
+static bool SyncAddressIndex(const CAddressIndex &addressindex) {
+    for (int i = 0; i < 1000; i++) {
+        {
+            LOCK(cs_main);
+            if (addressindex.GetBestBlock() == chainActive.Tip()) {
+                return true;
+            }
+        }
+        MilliSleep(10);
+    }
+    return false;
+}
+
+BOOST_FIXTURE_TEST_CASE(validation_addressindex, TestChain100Setup) {
+    const Config &config = GetConfig();
+    const uint160 scriptHash = GetAddressIndexHash(
+        CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG);
+
+    CAddressIndex addressindex(config, false);
+    BOOST_REQUIRE(SyncAddressIndex(addressindex));
+
+    // The coinbase of each block but the genesis block pays to the key.
+    AddressUnspentEntries unspent;
+    BOOST_CHECK(pblocktree->ReadAddressUnspent(scriptHash, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), 100);
+    AddressHistoryEntries history;
+    BOOST_CHECK(
+        pblocktree->ReadAddressHistory(scriptHash, 0, 0, 1000, history));
+    BOOST_REQUIRE_EQUAL(history.size(), 100);
+    BOOST_CHECK_EQUAL(history[0].first.nHeight, 1);
+    BOOST_CHECK(history[50].first.txid == coinbaseTxns[50].GetId());
+    BOOST_CHECK(!history[50].first.fSpending);
+    BOOST_CHECK(history[50].second.fCoinBase);
+
+    history.clear();
+    BOOST_CHECK(pblocktree->ReadAddressHistory(scriptHash, 90, 5, 3, history));
+    BOOST_REQUIRE_EQUAL(history.size(), 3);
+    BOOST_CHECK_EQUAL(history[0].first.nHeight, 95);
+
+    // A disconnected block takes its entries along.
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(InvalidateBlock(config, state, chainActive.Tip()));
+    }
+    BOOST_CHECK(ActivateBestChain(config, state));
+    BOOST_REQUIRE(SyncAddressIndex(addressindex));
+    unspent.clear();
+    BOOST_CHECK(pblocktree->ReadAddressUnspent(scriptHash, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), 99);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,104 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "worktable.h"
+
+#include "hash.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(worktable_tests, BasicTestingSetup)
+
+static CBlock MakeBlock(uint32_t nHeight, uint32_t nTime) {
+    CBlock block;
+    block.nBlockHeight = nHeight;
+    block.nTime = nTime;
+    return block;
+}
+
+static const ethash_h256_t boundary = {{0xff}};
+
+BOOST_AUTO_TEST_CASE(worktable_lookup) {
+    CWorkTable table;
+    CBlock block = MakeBlock(10, 1);
+    auto work = table.Add(block, boundary);
+    BOOST_CHECK_EQUAL(table.Size(), 1);
+
+    // Adding the same template again returns the existing job.
+    BOOST_CHECK(table.Add(block, boundary) == work);
+    BOOST_CHECK_EQUAL(table.Size(), 1);
+
+    BOOST_CHECK(table.Get(work->blockEthash) == work);
+    BOOST_CHECK(table.GetNewest() == work);
+    ethash_h256_t unknown = {{0x42}};
+    BOOST_CHECK(table.Get(unknown) == nullptr);
+    BOOST_CHECK(table.SetSolution(unknown, 1, unknown) == nullptr);
+
+    // Submissions are remembered, without touching the job.
+    bool fDuplicate = true;
+    BOOST_CHECK(table.AddShare(unknown, 1234, fDuplicate) == nullptr);
+    BOOST_CHECK(table.AddShare(work->blockEthash, 1234, fDuplicate) == work);
+    BOOST_CHECK(!fDuplicate);
+    BOOST_CHECK(table.AddShare(work->blockEthash, 1234, fDuplicate) == work);
+    BOOST_CHECK(fDuplicate);
+    BOOST_CHECK(table.AddShare(work->blockEthash, 1235, fDuplicate) == work);
+    BOOST_CHECK(!fDuplicate);
+    BOOST_CHECK(!work->done);
+
+    ethash_h256_t mix = {{0x01, 0x02}};
+    BOOST_CHECK(table.SetSolution(work->blockEthash, 1234, mix) == work);
+    BOOST_CHECK(work->done);
+    BOOST_CHECK_EQUAL(work->block.nNonce, 1234);
+    BOOST_CHECK(EthashEquals(work->block.hashMix, mix));
+    // Done jobs are still found by hash, but not handed out.
+    BOOST_CHECK(table.Get(work->blockEthash) == work);
+    BOOST_CHECK(table.GetNewest() == nullptr);
+
+    table.Remove(work->blockEthash);
+    BOOST_CHECK(table.Get(work->blockEthash) == nullptr);
+    BOOST_CHECK_EQUAL(table.Size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(worktable_retention) {
+    CWorkTable table(3);
+    std::vector<std::shared_ptr<Work>> vWork;
+    for (uint32_t i = 0; i < 5; i++) {
+        vWork.push_back(table.Add(MakeBlock(10, i), boundary));
+    }
+    BOOST_CHECK_EQUAL(table.Size(), 3);
+
+    // The oldest templates were evicted, the recent ones still resolve.
+    BOOST_CHECK(table.Get(vWork[0]->blockEthash) == nullptr);
+    BOOST_CHECK(table.Get(vWork[1]->blockEthash) == nullptr);
+    for (size_t i = 2; i < vWork.size(); i++) {
+        BOOST_CHECK(table.Get(vWork[i]->blockEthash) == vWork[i]);
+    }
+    BOOST_CHECK(table.GetNewest() == vWork.back());
+
+    std::vector<std::shared_ptr<Work>> vAll = table.GetAll();
+    BOOST_CHECK(vAll == std::vector<std::shared_ptr<Work>>(vWork.begin() + 2,
+                                                           vWork.end()));
+}
+
+BOOST_AUTO_TEST_CASE(worktable_remove_height) {
+    CWorkTable table;
+    auto work10a = table.Add(MakeBlock(10, 1), boundary);
+    auto work10b = table.Add(MakeBlock(10, 2), boundary);
+    auto work11 = table.Add(MakeBlock(11, 1), boundary);
+    auto work12 = table.Add(MakeBlock(12, 1), boundary);
+
+    table.RemoveUpToHeight(11);
+    BOOST_CHECK_EQUAL(table.Size(), 1);
+    BOOST_CHECK(table.Get(work10a->blockEthash) == nullptr);
+    BOOST_CHECK(table.Get(work10b->blockEthash) == nullptr);
+    BOOST_CHECK(table.Get(work11->blockEthash) == nullptr);
+    BOOST_CHECK(table.Get(work12->blockEthash) == work12);
+
+    table.Clear();
+    BOOST_CHECK_EQUAL(table.Size(), 0);
+    BOOST_CHECK(table.GetNewest() == nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,97 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TRACE_H
+#define BITCOIN_TRACE_H
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+/**
+ * Statically defined tracepoints (USDT), see doc/tracing.md.
+ *
+ * A tracepoint is a nop until bpftrace or perf attaches to it. Its arguments
+ * are only evaluated while something is attached: each tracepoint has a
+ * semaphore, defined once with TRACE_SEMAPHORE in the file that fires it,
+ * that the tracer raises when attaching. TRACE_ACTIVE tests it, so that work
+ * only done for a tracepoint, like timing, can be skipped too.
+ *
+ * Without ENABLE_TRACING, none of this compiles to anything.
+ */
+#ifdef ENABLE_TRACING
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define TRACE_SEMAPHORE(context, event)                                        \
+    unsigned short context##_##event##_semaphore                               \
+        __attribute__((section(".probes")))
+#define TRACE_ACTIVE(context, event) (context##_##event##_semaphore > 0)
+
+#define TRACE(context, event)                                                  \
+    do {                                                                       \
+        if (TRACE_ACTIVE(context, event)) DTRACE_PROBE(context, event);        \
+    } while (0)
+#define TRACE1(context, event, a)                                              \
+    do {                                                                       \
+        if (TRACE_ACTIVE(context, event)) DTRACE_PROBE1(context, event, a);    \
+    } while (0)
+#define TRACE2(context, event, a, b)                                           \
+    do {                                                                       \
+        if (TRACE_ACTIVE(context, event))                                      \
+            DTRACE_PROBE2(context, event, a, b);                               \
+    } while (0)
+#define TRACE3(context, event, a, b, c)                                        \
+    do {                                                                       \
+        if (TRACE_ACTIVE(context, event))                                      \
+            DTRACE_PROBE3(context, event, a, b, c);                            \
+    } while (0)
+#define TRACE4(context, event, a, b, c, d)                                     \
+    do {                                                                       \
+        if (TRACE_ACTIVE(context, event))                                      \
+            DTRACE_PROBE4(context, event, a, b, c, d);                         \
+    } while (0)
+#define TRACE5(context, event, a, b, c, d, e)                                  \
+    do {                                                                       \
+        if (TRACE_ACTIVE(context, event))                                      \
+            DTRACE_PROBE5(context, event, a, b, c, d, e);                      \
+    } while (0)
+#define TRACE6(context, event, a, b, c, d, e, f)                               \
+    do {                                                                       \
+        if (TRACE_ACTIVE(context, event))                                      \
+            DTRACE_PROBE6(context, event, a, b, c, d, e, f);                   \
+    } while (0)
+
+#else
+
+#define TRACE_SEMAPHORE(context, event) static_assert(true, "")
+#define TRACE_ACTIVE(context, event) false
+
+// The arguments are still seen by the compiler, so that values only computed
+// for a tracepoint don't warn as unused, but never evaluated.
+#define TRACE(context, event)                                                  \
+    do {                                                                       \
+    } while (0)
+#define TRACE1(context, event, a)                                              \
+    do {                                                                       \
+        if (false) {                                                           \
+            (void)(a);                                                         \
+        }                                                                      \
+    } while (0)
+#define TRACE2(context, event, a, b)                                           \
+    TRACE1(context, event, ((void)(a), (b)))
+#define TRACE3(context, event, a, b, c)                                        \
+    TRACE1(context, event, ((void)(a), (void)(b), (c)))
+#define TRACE4(context, event, a, b, c, d)                                     \
+    TRACE1(context, event, ((void)(a), (void)(b), (void)(c), (d)))
+#define TRACE5(context, event, a, b, c, d, e)                                  \
+    TRACE1(context, event, ((void)(a), (void)(b), (void)(c), (void)(d), (e)))
+#define TRACE6(context, event, a, b, c, d, e, f)                               \
+    TRACE1(context, event,                                                     \
+           ((void)(a), (void)(b), (void)(c), (void)(d), (void)(e), (f)))
+
+#endif // ENABLE_TRACING
+
+#endif // BITCOIN_TRACE_H
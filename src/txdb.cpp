@@ -18,13 +18,30 @@
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
+//! Transaction index entries by full txid, as written by older versions.
 static const char DB_TXINDEX = 't';
+static const char DB_TXINDEX_COMPACT = 'x';
+static const char DB_DEPOSITINDEX = 'd';
+static const char DB_ADDRESSHISTORY = 'a';
+static const char DB_ADDRESSUNSPENT = 'u';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_CONTENT_DROPPED = 'D';
+static const char DB_UTXO_STATS = 'S';
+static const char DB_INDEX_SNAPSHOT = 'I';
+static const char DB_VERIFIED_BLOCKS = 'V';
+static const char DB_TXINDEX_BEST_BLOCK = 'X';
+static const char DB_ADDRESSINDEX_BEST_BLOCK = 'A';
+static const char DB_BLOCKFILTER = 'g';
+static const char DB_BLOCKFILTERINDEX_BEST_BLOCK = 'G';
+static const char DB_BLOCKSTATS = 'k';
+static const char DB_BLOCKSTATSINDEX_BEST_BLOCK = 'K';
+static const char DB_ARCHIVED_CONTENT = 'o';
+static const char DB_CONTENTARCHIVE_BEST_BLOCK = 'O';
 
 namespace {
 
@@ -46,10 +63,28 @@ struct CoinEntry {
         s >> VARINT(outpoint->n);
     }
 };
+
+/** Coin record as written before coins dropped the output's content */
+struct CoinWithContent {
+    uint32_t nHeightAndIsCoinBase;
+    CTxOut out;
+
+    template <typename Stream> void Unserialize(Stream &s) {
+        ::Unserialize(s, VARINT(nHeightAndIsCoinBase));
+        ::Unserialize(s, REF(CTxOutCompressor(out)));
+    }
+};
+}
+
+static CDBOptions GetCoinsDBOptions() {
+    CDBOptions dbOptions;
+    dbOptions.nMaxFileSize = COINS_DB_MAX_FILE_SIZE;
+    return dbOptions;
 }
 
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe)
-    : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) {}
+    : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true,
+         GetCoinsDBOptions()) {}
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     return db.Read(CoinEntry(&outpoint), coin);
@@ -65,27 +100,69 @@ uint256 CCoinsViewDB::GetBestBlock() const {
     return hashBestChain;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+bool CCoinsViewDB::GetStats(CUTXOStats &stats) const {
+    if (GetBestBlock().IsNull()) {
+        // An empty chainstate
+        stats = CUTXOStats();
+        return true;
+    }
+    return db.Read(DB_UTXO_STATS, stats);
+}
+
+/** Queue a dirty cache entry in batch. Returns whether it was dirty. */
+static bool BatchCoin(CDBBatch &batch, const CCoinsMap::value_type &entry) {
+    if (!(entry.second.flags & CCoinsCacheEntry::DIRTY)) {
+        return false;
+    }
+    CoinEntry key(&entry.first);
+    if (entry.second.coin.IsSpent()) {
+        batch.Erase(key);
+    } else {
+        batch.Write(key, entry.second.coin);
+    }
+    return true;
+}
+
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                              const CUTXOStats *pstats) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
-        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            CoinEntry entry(&it->first);
-            if (it->second.coin.IsSpent()) {
-                batch.Erase(entry);
-            } else {
-                batch.Write(entry, it->second.coin);
-            }
+        if (BatchCoin(batch, *it)) {
             changed++;
         }
         count++;
         CCoinsMap::iterator itOld = it++;
         mapCoins.erase(itOld);
     }
+    return CommitCoins(batch, hashBlock, pstats, count, changed);
+}
+
+bool CCoinsViewDB::WriteSnapshot(const CCoinsMap &mapCoins,
+                                 const uint256 &hashBlock,
+                                 const CUTXOStats *pstats) {
+    CDBBatch batch(db);
+    size_t changed = 0;
+    for (const CCoinsMap::value_type &entry : mapCoins) {
+        if (BatchCoin(batch, entry)) {
+            changed++;
+        }
+    }
+    return CommitCoins(batch, hashBlock, pstats, mapCoins.size(), changed);
+}
+
+bool CCoinsViewDB::CommitCoins(CDBBatch &batch, const uint256 &hashBlock,
+                               const CUTXOStats *pstats, size_t count,
+                               size_t changed) {
     if (!hashBlock.IsNull()) {
         batch.Write(DB_BEST_BLOCK, hashBlock);
     }
+    if (pstats) {
+        batch.Write(DB_UTXO_STATS, *pstats);
+    } else {
+        batch.Erase(DB_UTXO_STATS);
+    }
 
     bool ret = db.WriteBatch(batch);
     LogPrint("coindb", "Committed %u changed transaction outputs (out of %u) "
@@ -98,6 +175,176 @@ size_t CCoinsViewDB::EstimateSize() const {
     return db.EstimateSize(DB_COIN, char(DB_COIN + 1));
 }
 
+CCoinsViewAsyncWrite::CCoinsViewAsyncWrite(CCoinsViewDB *dbIn)
+    : db(dbIn), fWriting(false), fFailed(false), fStop(false),
+      mapSnapshot(0, SaltedOutpointHasher(), CCoinsMap::key_equal(),
+                  CCoinsMapAllocator(&snapshotResource)),
+      nSnapshotCoinsUsage(0) {
+    threadWrite = std::thread(
+        &TraceThread<std::function<void()>>, "coinswrite",
+        std::function<void()>(
+            std::bind(&CCoinsViewAsyncWrite::ThreadWrite, this)));
+}
+
+CCoinsViewAsyncWrite::~CCoinsViewAsyncWrite() {
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+    }
+    condWrite.notify_all();
+    // A pending snapshot is still written before the thread exits.
+    threadWrite.join();
+}
+
+bool CCoinsViewAsyncWrite::GetCoin(const COutPoint &outpoint,
+                                   Coin &coin) const {
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (fWriting) {
+            CCoinsMap::const_iterator it = mapSnapshot.find(outpoint);
+            if (it != mapSnapshot.end()) {
+                coin = it->second.coin;
+                return !coin.IsSpent();
+            }
+        }
+    }
+    return db->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewAsyncWrite::HaveCoin(const COutPoint &outpoint) const {
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (fWriting) {
+            CCoinsMap::const_iterator it = mapSnapshot.find(outpoint);
+            if (it != mapSnapshot.end()) {
+                return !it->second.coin.IsSpent();
+            }
+        }
+    }
+    return db->HaveCoin(outpoint);
+}
+
+uint256 CCoinsViewAsyncWrite::GetBestBlock() const {
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (fWriting && !hashSnapshot.IsNull()) {
+            return hashSnapshot;
+        }
+    }
+    return db->GetBestBlock();
+}
+
+uint256 CCoinsViewAsyncWrite::GetBestBlockOnDisk() const {
+    return db->GetBestBlock();
+}
+
+bool CCoinsViewAsyncWrite::GetStats(CUTXOStats &stats) const {
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (fWriting) {
+            // The write replaces the stored statistics, or erases them.
+            if (!pstatsSnapshot) {
+                return false;
+            }
+            stats = *pstatsSnapshot;
+            return true;
+        }
+    }
+    return db->GetStats(stats);
+}
+
+bool CCoinsViewAsyncWrite::BatchWrite(CCoinsMap &mapCoins,
+                                      const uint256 &hashBlock,
+                                      const CUTXOStats *pstats) {
+    std::unique_lock<std::mutex> lock(cs);
+    condWrite.wait(lock, [this] { return !fWriting || fFailed; });
+    if (fFailed) {
+        return false;
+    }
+
+    // Only dirty entries need writing; the rest are dropped like a flush
+    // into the database would drop them.
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            nSnapshotCoinsUsage += it->second.coin.DynamicMemoryUsage();
+            CCoinsCacheEntry &entry = mapSnapshot[it->first];
+            entry.coin = std::move(it->second.coin);
+            entry.flags = CCoinsCacheEntry::DIRTY;
+        }
+        CCoinsMap::iterator itOld = it++;
+        mapCoins.erase(itOld);
+    }
+    hashSnapshot = hashBlock;
+    pstatsSnapshot.reset(pstats ? new CUTXOStats(*pstats) : nullptr);
+    fWriting = true;
+    condWrite.notify_all();
+    return true;
+}
+
+CCoinsViewCursor *CCoinsViewAsyncWrite::Cursor() const {
+    Sync();
+    return db->Cursor();
+}
+
+size_t CCoinsViewAsyncWrite::EstimateSize() const {
+    return db->EstimateSize();
+}
+
+bool CCoinsViewAsyncWrite::Sync() const {
+    std::unique_lock<std::mutex> lock(cs);
+    condWrite.wait(lock, [this] { return !fWriting || fFailed; });
+    return !fFailed;
+}
+
+size_t CCoinsViewAsyncWrite::DynamicMemoryUsage() const {
+    std::lock_guard<std::mutex> lock(cs);
+    return memusage::DynamicUsage(mapSnapshot) + nSnapshotCoinsUsage;
+}
+
+void CCoinsViewAsyncWrite::ResetSnapshot() {
+    // Nodes go back to the pool, not to the system, so replace both.
+    mapSnapshot.~CCoinsMap();
+    snapshotResource.~CCoinsMapMemoryResource();
+    ::new (&snapshotResource) CCoinsMapMemoryResource();
+    ::new (&mapSnapshot)
+        CCoinsMap(0, SaltedOutpointHasher(), CCoinsMap::key_equal(),
+                  CCoinsMapAllocator(&snapshotResource));
+    nSnapshotCoinsUsage = 0;
+    hashSnapshot.SetNull();
+    pstatsSnapshot.reset();
+}
+
+void CCoinsViewAsyncWrite::ThreadWrite() {
+    std::unique_lock<std::mutex> lock(cs);
+    while (true) {
+        condWrite.wait(lock,
+                       [this] { return fStop || (fWriting && !fFailed); });
+        if (!fWriting || fFailed) {
+            return;
+        }
+
+        // The snapshot isn't changed while fWriting is set, so it can be
+        // read without the lock, which the readers in front need.
+        lock.unlock();
+        bool fOk = false;
+        try {
+            fOk = db->WriteSnapshot(mapSnapshot, hashSnapshot,
+                                    pstatsSnapshot.get());
+        } catch (const std::runtime_error &e) {
+            LogPrintf("Error writing to coin database: %s\n", e.what());
+        }
+        lock.lock();
+
+        if (fOk) {
+            ResetSnapshot();
+            fWriting = false;
+        } else {
+            fFailed = true;
+        }
+        condWrite.notify_all();
+    }
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe)
     : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory,
                  fWipe) {}
@@ -118,6 +365,30 @@ bool CBlockTreeDB::ReadReindexing(bool &fReindexing) {
     return true;
 }
 
+bool CBlockTreeDB::WriteIndexSnapshotId(uint64_t nId) {
+    return Write(DB_INDEX_SNAPSHOT, nId, true);
+}
+
+bool CBlockTreeDB::ReadIndexSnapshotId(uint64_t &nId) {
+    return Read(DB_INDEX_SNAPSHOT, nId);
+}
+
+bool CBlockTreeDB::EraseIndexSnapshotId() {
+    return Erase(DB_INDEX_SNAPSHOT, true);
+}
+
+bool CBlockTreeDB::WriteVerifiedBlocks(const CVerifiedBlocks &verified) {
+    return Write(DB_VERIFIED_BLOCKS, verified, true);
+}
+
+bool CBlockTreeDB::ReadVerifiedBlocks(CVerifiedBlocks &verified) {
+    return Read(DB_VERIFIED_BLOCKS, verified);
+}
+
+bool CBlockTreeDB::EraseVerifiedBlocks() {
+    return Erase(DB_VERIFIED_BLOCKS, true);
+}
+
 bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
     return Read(DB_LAST_BLOCK, nFile);
 }
@@ -166,6 +437,16 @@ bool CCoinsViewDBCursor::Valid() const {
 
 void CCoinsViewDBCursor::Next() {
     pcursor->Next();
+    ReadKey();
+}
+
+bool CCoinsViewDBCursor::Seek(const COutPoint &key) {
+    pcursor->Seek(CoinEntry(&key));
+    ReadKey();
+    return true;
+}
+
+void CCoinsViewDBCursor::ReadKey() {
     CoinEntry entry(&keyTmp.second);
     if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
         // Invalidate cached key after last record so that Valid() and GetKey()
@@ -195,20 +476,307 @@ bool CBlockTreeDB::WriteBatchSync(
     return WriteBatch(batch, true);
 }
 
-bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
-    return Read(std::make_pair(DB_TXINDEX, txid), pos);
+bool CBlockTreeDB::ReadTxIndex(const uint256 &txid,
+                               std::vector<CDiskTxPos> &vPos) {
+    const uint64_t nShortId = txid.GetCheapHash();
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_TXINDEX_COMPACT, nShortId));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, CTxIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_TXINDEX_COMPACT ||
+            key.second.nShortId != nShortId) {
+            break;
+        }
+        vPos.push_back(key.second.pos);
+    }
+    return !vPos.empty();
 }
 
 bool CBlockTreeDB::WriteTxIndex(
-    const std::vector<std::pair<uint256, CDiskTxPos>> &vect) {
+    const std::vector<std::pair<uint256, CDiskTxPos>> &list,
+    const uint256 &hashBlock) {
+    CDBBatch batch(*this);
+    for (const auto &entry : list) {
+        batch.Write(std::make_pair(DB_TXINDEX_COMPACT,
+                                   CTxIndexKey(entry.first.GetCheapHash(),
+                                               entry.second)),
+                    '1');
+    }
+    batch.Write(DB_TXINDEX_BEST_BLOCK, hashBlock);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadTxIndexBestBlock(uint256 &hashBlock) {
+    return Read(DB_TXINDEX_BEST_BLOCK, hashBlock);
+}
+
+bool CBlockTreeDB::EraseTxIndexBestBlock() {
+    return Erase(DB_TXINDEX_BEST_BLOCK, true);
+}
+
+/** Queue up to nMax of the keys starting with chKey for erasing. */
+template <typename K>
+static size_t EraseKeys(CDBIterator &cursor, CDBBatch &batch, char chKey,
+                        size_t nMax) {
+    size_t nErased = 0;
+    for (cursor.Seek(chKey); nErased < nMax && cursor.Valid(); cursor.Next()) {
+        std::pair<char, K> key;
+        if (!cursor.GetKey(key) || key.first != chKey) {
+            break;
+        }
+        batch.Erase(key);
+        nErased++;
+    }
+    return nErased;
+}
+
+bool CBlockTreeDB::EraseTxIndex(size_t nMax, size_t &nErased) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    CDBBatch batch(*this);
+    nErased = EraseKeys<uint256>(*pcursor, batch, DB_TXINDEX, nMax);
+    nErased += EraseKeys<CTxIndexKey>(*pcursor, batch, DB_TXINDEX_COMPACT,
+                                      nMax - nErased);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::UpdateAddressIndex(const CAddressIndexUpdate &update,
+                                      const uint256 &hashBlock) {
+    CDBBatch batch(*this);
+    for (const auto &entry : update.vHistory) {
+        batch.Write(std::make_pair(DB_ADDRESSHISTORY, entry.first),
+                    entry.second);
+    }
+    for (const auto &entry : update.vUnspent) {
+        batch.Write(std::make_pair(DB_ADDRESSUNSPENT, entry.first),
+                    entry.second);
+    }
+    for (const CAddressHistoryKey &key : update.vHistoryErased) {
+        batch.Erase(std::make_pair(DB_ADDRESSHISTORY, key));
+    }
+    for (const CAddressUnspentKey &key : update.vUnspentErased) {
+        batch.Erase(std::make_pair(DB_ADDRESSUNSPENT, key));
+    }
+    batch.Write(DB_ADDRESSINDEX_BEST_BLOCK, hashBlock);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndexBestBlock(uint256 &hashBlock) {
+    return Read(DB_ADDRESSINDEX_BEST_BLOCK, hashBlock);
+}
+
+bool CBlockTreeDB::EraseAddressIndexBestBlock() {
+    return Erase(DB_ADDRESSINDEX_BEST_BLOCK, true);
+}
+
+bool CBlockTreeDB::EraseAddressIndex(size_t nMax, size_t &nErased) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    CDBBatch batch(*this);
+    nErased = EraseKeys<CAddressHistoryKey>(*pcursor, batch,
+                                            DB_ADDRESSHISTORY, nMax);
+    nErased += EraseKeys<CAddressUnspentKey>(*pcursor, batch,
+                                             DB_ADDRESSUNSPENT, nMax - nErased);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressHistory(const uint160 &scriptHash,
+                                      uint32_t nStartHeight, size_t nSkip,
+                                      size_t nCount,
+                                      AddressHistoryEntries &list) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    CAddressHistoryKey start(scriptHash, nStartHeight, uint256(), 0, false);
+    pcursor->Seek(std::make_pair(DB_ADDRESSHISTORY, start));
+    for (; pcursor->Valid() && list.size() < nCount; pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressHistoryKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSHISTORY ||
+            key.second.scriptHash != scriptHash) {
+            break;
+        }
+        if (nSkip > 0) {
+            nSkip--;
+            continue;
+        }
+        CAddressIndexValue value;
+        if (!pcursor->GetValue(value)) {
+            return error("%s: failed to read value", __func__);
+        }
+        list.emplace_back(key.second, value);
+    }
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressUnspent(const uint160 &scriptHash,
+                                      AddressUnspentEntries &list) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENT, scriptHash));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressUnspentKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSUNSPENT ||
+            key.second.scriptHash != scriptHash) {
+            break;
+        }
+        CAddressIndexValue value;
+        if (!pcursor->GetValue(value)) {
+            return error("%s: failed to read value", __func__);
+        }
+        list.emplace_back(key.second, value);
+    }
+    return true;
+}
+
+bool CBlockTreeDB::WriteBlockFilters(
+    const std::vector<std::pair<uint256, CBlockFilterEntry>> &list,
+    const uint256 &hashBlock) {
+    CDBBatch batch(*this);
+    for (const auto &entry : list) {
+        batch.Write(std::make_pair(DB_BLOCKFILTER, entry.first), entry.second);
+    }
+    batch.Write(DB_BLOCKFILTERINDEX_BEST_BLOCK, hashBlock);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadBlockFilter(const uint256 &hashBlock,
+                                   CBlockFilterEntry &entry) {
+    return Read(std::make_pair(DB_BLOCKFILTER, hashBlock), entry);
+}
+
+bool CBlockTreeDB::WriteBlockFilterIndexBestBlock(const uint256 &hashBlock) {
+    return Write(DB_BLOCKFILTERINDEX_BEST_BLOCK, hashBlock);
+}
+
+bool CBlockTreeDB::ReadBlockFilterIndexBestBlock(uint256 &hashBlock) {
+    return Read(DB_BLOCKFILTERINDEX_BEST_BLOCK, hashBlock);
+}
+
+bool CBlockTreeDB::EraseBlockFilterIndexBestBlock() {
+    return Erase(DB_BLOCKFILTERINDEX_BEST_BLOCK, true);
+}
+
+bool CBlockTreeDB::EraseBlockFilterIndex(size_t nMax, size_t &nErased) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    CDBBatch batch(*this);
+    nErased = EraseKeys<uint256>(*pcursor, batch, DB_BLOCKFILTER, nMax);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::WriteBlockStats(
+    const std::vector<std::pair<uint256, CBlockStats>> &list,
+    const uint256 &hashBlock) {
+    CDBBatch batch(*this);
+    for (const auto &entry : list) {
+        batch.Write(std::make_pair(DB_BLOCKSTATS, entry.first), entry.second);
+    }
+    batch.Write(DB_BLOCKSTATSINDEX_BEST_BLOCK, hashBlock);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadBlockStats(const uint256 &hashBlock,
+                                  CBlockStats &stats) {
+    return Read(std::make_pair(DB_BLOCKSTATS, hashBlock), stats);
+}
+
+bool CBlockTreeDB::WriteBlockStatsIndexBestBlock(const uint256 &hashBlock) {
+    return Write(DB_BLOCKSTATSINDEX_BEST_BLOCK, hashBlock);
+}
+
+bool CBlockTreeDB::ReadBlockStatsIndexBestBlock(uint256 &hashBlock) {
+    return Read(DB_BLOCKSTATSINDEX_BEST_BLOCK, hashBlock);
+}
+
+bool CBlockTreeDB::EraseBlockStatsIndexBestBlock() {
+    return Erase(DB_BLOCKSTATSINDEX_BEST_BLOCK, true);
+}
+
+bool CBlockTreeDB::EraseBlockStatsIndex(size_t nMax, size_t &nErased) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    CDBBatch batch(*this);
+    nErased = EraseKeys<uint256>(*pcursor, batch, DB_BLOCKSTATS, nMax);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::UpdateContentArchive(const CContentArchiveUpdate &update,
+                                        const uint256 &hashBlock) {
+    CDBBatch batch(*this);
+    for (const auto &entry : update.vAdded) {
+        batch.Write(std::make_pair(DB_ARCHIVED_CONTENT,
+                                   std::make_pair(entry.first.hash,
+                                                  entry.first.n)),
+                    entry.second);
+    }
+    for (const COutPoint &outpoint : update.vErased) {
+        batch.Erase(std::make_pair(DB_ARCHIVED_CONTENT,
+                                   std::make_pair(outpoint.hash, outpoint.n)));
+    }
+    batch.Write(DB_CONTENTARCHIVE_BEST_BLOCK, hashBlock);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadArchivedContent(const COutPoint &outpoint,
+                                       std::string &strContent) {
+    return Read(std::make_pair(DB_ARCHIVED_CONTENT,
+                               std::make_pair(outpoint.hash, outpoint.n)),
+                strContent);
+}
+
+bool CBlockTreeDB::HaveArchivedContent(const COutPoint &outpoint) {
+    return Exists(std::make_pair(DB_ARCHIVED_CONTENT,
+                                 std::make_pair(outpoint.hash, outpoint.n)));
+}
+
+bool CBlockTreeDB::ReadContentArchiveBestBlock(uint256 &hashBlock) {
+    return Read(DB_CONTENTARCHIVE_BEST_BLOCK, hashBlock);
+}
+
+bool CBlockTreeDB::EraseContentArchiveBestBlock() {
+    return Erase(DB_CONTENTARCHIVE_BEST_BLOCK, true);
+}
+
+bool CBlockTreeDB::EraseContentArchive(size_t nMax, size_t &nErased) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    CDBBatch batch(*this);
+    nErased = EraseKeys<std::pair<uint256, uint32_t>>(
+        *pcursor, batch, DB_ARCHIVED_CONTENT, nMax);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::WriteDepositIndex(const DepositIndexEntries &list) {
+    CDBBatch batch(*this);
+    for (const auto &entry : list) {
+        batch.Write(std::make_pair(DB_DEPOSITINDEX, entry.first), entry.second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseDepositIndex(const DepositIndexEntries &list) {
     CDBBatch batch(*this);
-    for (std::vector<std::pair<uint256, CDiskTxPos>>::const_iterator it =
-             vect.begin();
-         it != vect.end(); it++)
-        batch.Write(std::make_pair(DB_TXINDEX, it->first), it->second);
+    for (const auto &entry : list) {
+        batch.Erase(std::make_pair(DB_DEPOSITINDEX, entry.first));
+    }
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadDepositIndex(uint32_t nStartHeight, uint32_t nEndHeight,
+                                    DepositIndexEntries &list) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    CDepositIndexKey start(nStartHeight, COutPoint(uint256(), 0));
+    pcursor->Seek(std::make_pair(DB_DEPOSITINDEX, start));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CDepositIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_DEPOSITINDEX ||
+            key.second.nUnlockHeight >= nEndHeight) {
+            break;
+        }
+        CDepositIndexValue value;
+        if (!pcursor->GetValue(value)) {
+            return error("%s: failed to read value", __func__);
+        }
+        list.emplace_back(key.second, value);
+    }
+    return true;
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -258,8 +826,9 @@ bool CBlockTreeDB::LoadBlockIndexGuts(
         pindexNew->nTx = diskindex.nTx;
         pindexNew->nChainInterest = diskindex.nChainInterest;
 
-        if (!CheckProofOfWork(pindexNew->GetBlockHeader(),
-                              config)) {
+        // Headers in the index were fully checked when they were accepted,
+        // only redo the cheap check and seed the verified header cache.
+        if (!CheckStoredProofOfWork(pindexNew->GetBlockHeader(), config)) {
             return error("LoadBlockIndex(): CheckProofOfWork failed: %s",
                          pindexNew->ToString());
         }
@@ -324,16 +893,93 @@ public:
 };
 }
 
+/**
+ * Rewrite the coins that still have their output's content inline. Safe to
+ * interrupt, the coins already rewritten are skipped next time.
+ */
+bool CCoinsViewDB::UpgradeContent() {
+    if (db.Exists(DB_CONTENT_DROPPED)) {
+        return true;
+    }
+
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(DB_COIN);
+    size_t batch_size = 1 << 24;
+    size_t nDropped = 0;
+    CDBBatch batch(db);
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        COutPoint outpoint;
+        CoinEntry entry(&outpoint);
+        if (!pcursor->GetKey(entry) || entry.key != DB_COIN) {
+            break;
+        }
+
+        CoinWithContent coin;
+        if (!pcursor->GetValue(coin)) {
+            return error("%s: cannot parse coin record", __func__);
+        }
+        if (coin.out.strContent.empty()) {
+            continue;
+        }
+
+        if (nDropped++ == 0) {
+            LogPrintf("Dropping output content from the chainstate...\n");
+        }
+        batch.Write(entry, Coin(std::move(coin.out),
+                                coin.nHeightAndIsCoinBase >> 1,
+                                coin.nHeightAndIsCoinBase & 1));
+        if (batch.SizeEstimate() > batch_size) {
+            db.WriteBatch(batch);
+            batch.Clear();
+        }
+    }
+
+    batch.Write(DB_CONTENT_DROPPED, true);
+    if (!db.WriteBatch(batch)) {
+        return false;
+    }
+    if (nDropped > 0) {
+        LogPrintf("Dropped the content of %u coins\n", nDropped);
+    }
+    return true;
+}
+
+bool CCoinsViewDB::UpgradeStats() {
+    if (GetBestBlock().IsNull() || db.Exists(DB_UTXO_STATS)) {
+        return true;
+    }
+
+    LogPrintf("Computing UTXO set statistics...\n");
+    CUTXOStats stats;
+    std::unique_ptr<CCoinsViewCursor> pcursor(Cursor());
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        COutPoint outpoint;
+        Coin coin;
+        if (!pcursor->GetKey(outpoint) || !pcursor->GetValue(coin)) {
+            return error("%s: unable to read value", __func__);
+        }
+        stats.AddCoin(outpoint, coin);
+    }
+    return db.Write(DB_UTXO_STATS, stats);
+}
+
 /**
  * Upgrade the database from older formats.
  *
- * Currently implemented: from the per-tx utxo model (0.8..0.14.x) to per-txout.
+ * Currently implemented: from the per-tx utxo model (0.8..0.14.x) to per-txout,
+ * dropping output content from coins, and adding the UTXO set statistics.
  */
 bool CCoinsViewDB::Upgrade() {
+    if (!UpgradeContent()) {
+        return false;
+    }
+
     std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
     pcursor->Seek(std::make_pair(DB_COINS, uint256()));
     if (!pcursor->Valid()) {
-        return true;
+        return UpgradeStats();
     }
 
     LogPrintf("Upgrading database...\n");
@@ -373,5 +1019,5 @@ bool CCoinsViewDB::Upgrade() {
     }
 
     db.WriteBatch(batch);
-    return true;
+    return UpgradeStats();
 }
@@ -6,12 +6,19 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "blockfilter.h"
+#include "blockstats.h"
 #include "chain.h"
 #include "coins.h"
+#include "crypto/common.h"
 #include "dbwrapper.h"
 
+#include <condition_variable>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -25,6 +32,9 @@ static constexpr int DB_PEAK_USAGE_FACTOR = 2;
 static constexpr int MAX_BLOCK_COINSDB_USAGE = 200 * DB_PEAK_USAGE_FACTOR;
 //! Always periodic flush if less than this much space still available.
 static constexpr int MIN_BLOCK_COINSDB_USAGE = 50 * DB_PEAK_USAGE_FACTOR;
+//! Share of the coins cache limit (%) that flushes for memory or time keep,
+//! holding on to the coins used most recently.
+static constexpr int COINS_CACHE_KEEP_PERCENT = 50;
 //! -dbcache default (MiB)
 static const int64_t nDefaultDbCache = 450;
 //! max. -dbcache (MiB)
@@ -40,6 +50,9 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Table file size of the coin database. It grows to several GiB, so LevelDB's
+//! 2 MiB files would be far more than the open file limit can hold.
+static const size_t COINS_DB_MAX_FILE_SIZE = 32 << 20;
 
 struct CDiskTxPos : public CDiskBlockPos {
     unsigned int nTxOffset; // after header
@@ -63,7 +76,225 @@ struct CDiskTxPos : public CDiskBlockPos {
     }
 };
 
+/**
+ * A transaction in the transaction index, by the first 8 bytes of its id.
+ * Transactions sharing those each have a key of their own, readers tell them
+ * apart by the full id of the transaction at pos.
+ */
+struct CTxIndexKey {
+    uint64_t nShortId;
+    CDiskTxPos pos;
+
+    CTxIndexKey() : nShortId(0) {}
+    CTxIndexKey(uint64_t nShortIdIn, const CDiskTxPos &posIn)
+        : nShortId(nShortIdIn), pos(posIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(nShortId);
+        READWRITE(pos);
+    }
+};
+
+/**
+ * A deposit output in the deposit index, by the height it unlocks at. The
+ * height is big endian so the entries are in height order.
+ */
+struct CDepositIndexKey {
+    uint32_t nUnlockHeight;
+    COutPoint outpoint;
+
+    CDepositIndexKey() : nUnlockHeight(0) {}
+    CDepositIndexKey(uint32_t nUnlockHeightIn, const COutPoint &outpointIn)
+        : nUnlockHeight(nUnlockHeightIn), outpoint(outpointIn) {}
+
+    template <typename Stream> void Serialize(Stream &s) const {
+        uint8_t buf[4];
+        WriteBE32(buf, nUnlockHeight);
+        s.write((const char *)buf, sizeof(buf));
+        s << outpoint.hash;
+        s << VARINT(outpoint.n);
+    }
+
+    template <typename Stream> void Unserialize(Stream &s) {
+        uint8_t buf[4];
+        s.read((char *)buf, sizeof(buf));
+        nUnlockHeight = ReadBE32(buf);
+        s >> outpoint.hash;
+        s >> VARINT(outpoint.n);
+    }
+};
+
+struct CDepositIndexValue {
+    CAmount nPrincipal;
+    CAmount nInterest;
+
+    CDepositIndexValue() : nPrincipal(0), nInterest(0) {}
+    CDepositIndexValue(CAmount nPrincipalIn, CAmount nInterestIn)
+        : nPrincipal(nPrincipalIn), nInterest(nInterestIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(VARINT(nPrincipal));
+        READWRITE(VARINT(nInterest));
+    }
+};
+
+typedef std::vector<std::pair<CDepositIndexKey, CDepositIndexValue>>
+    DepositIndexEntries;
+
+/**
+ * An entry of the history of a script in the address index: an output paying
+ * to it, or an input spending one of those. Scripts are known by the hash of
+ * their scriptPubKey, their entries are in height order, big endian.
+ */
+struct CAddressHistoryKey {
+    uint160 scriptHash;
+    uint32_t nHeight;
+    uint256 txid;
+    //! The output, or with fSpending the input, of txid
+    uint32_t nIndex;
+    bool fSpending;
+
+    CAddressHistoryKey() : nHeight(0), nIndex(0), fSpending(false) {}
+    CAddressHistoryKey(const uint160 &scriptHashIn, uint32_t nHeightIn,
+                       const uint256 &txidIn, uint32_t nIndexIn,
+                       bool fSpendingIn)
+        : scriptHash(scriptHashIn), nHeight(nHeightIn), txid(txidIn),
+          nIndex(nIndexIn), fSpending(fSpendingIn) {}
+
+    template <typename Stream> void Serialize(Stream &s) const {
+        uint8_t buf[4];
+        s << scriptHash;
+        WriteBE32(buf, nHeight);
+        s.write((const char *)buf, sizeof(buf));
+        s << txid;
+        WriteBE32(buf, nIndex);
+        s.write((const char *)buf, sizeof(buf));
+        s << fSpending;
+    }
+
+    template <typename Stream> void Unserialize(Stream &s) {
+        uint8_t buf[4];
+        s >> scriptHash;
+        s.read((char *)buf, sizeof(buf));
+        nHeight = ReadBE32(buf);
+        s >> txid;
+        s.read((char *)buf, sizeof(buf));
+        nIndex = ReadBE32(buf);
+        s >> fSpending;
+    }
+};
+
+/**
+ * The output an address index entry is about, the one paid or spent. The
+ * interest is the part of nValue a locked deposit earned over nPrincipal.
+ */
+struct CAddressIndexValue {
+    CAmount nValue;
+    CAmount nPrincipal;
+    CAmount nInterest;
+    //! Height of the block the output is in, and its lock time
+    uint32_t nHeight;
+    uint32_t nLockTime;
+    bool fCoinBase;
+
+    CAddressIndexValue()
+        : nValue(0), nPrincipal(0), nInterest(0), nHeight(0), nLockTime(0),
+          fCoinBase(false) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(VARINT(nValue));
+        READWRITE(VARINT(nPrincipal));
+        READWRITE(VARINT(nInterest));
+        READWRITE(VARINT(nHeight));
+        READWRITE(VARINT(nLockTime));
+        READWRITE(fCoinBase);
+    }
+};
+
+/** An unspent output of a script in the address index */
+struct CAddressUnspentKey {
+    uint160 scriptHash;
+    COutPoint outpoint;
+
+    CAddressUnspentKey() {}
+    CAddressUnspentKey(const uint160 &scriptHashIn,
+                       const COutPoint &outpointIn)
+        : scriptHash(scriptHashIn), outpoint(outpointIn) {}
+
+    template <typename Stream> void Serialize(Stream &s) const {
+        uint8_t buf[4];
+        s << scriptHash;
+        s << outpoint.hash;
+        WriteBE32(buf, outpoint.n);
+        s.write((const char *)buf, sizeof(buf));
+    }
+
+    template <typename Stream> void Unserialize(Stream &s) {
+        uint8_t buf[4];
+        s >> scriptHash;
+        s >> outpoint.hash;
+        s.read((char *)buf, sizeof(buf));
+        outpoint.n = ReadBE32(buf);
+    }
+};
+
+typedef std::vector<std::pair<CAddressHistoryKey, CAddressIndexValue>>
+    AddressHistoryEntries;
+typedef std::vector<std::pair<CAddressUnspentKey, CAddressIndexValue>>
+    AddressUnspentEntries;
+
+/**
+ * Changes to the address index. The entries are written before the erased
+ * ones are erased, so an output both added and erased is gone.
+ */
+struct CAddressIndexUpdate {
+    AddressHistoryEntries vHistory;
+    std::vector<CAddressHistoryKey> vHistoryErased;
+    AddressUnspentEntries vUnspent;
+    std::vector<CAddressUnspentKey> vUnspentErased;
+};
+
+/**
+ * Changes to the content archive: the contents of the outputs created, and
+ * the outputs spent. The contents are written before the spent outputs are
+ * erased.
+ */
+struct CContentArchiveUpdate {
+    std::vector<std::pair<COutPoint, std::string>> vAdded;
+    std::vector<COutPoint> vErased;
+};
+
 /** CCoinsView backed by the coin database (chainstate/) */
+/**
+ * The blocks of the best chain that CVerifyDB checked, from hashTip down to
+ * nHeight, at nCheckLevel.
+ */
+struct CVerifiedBlocks {
+    uint256 hashTip;
+    int32_t nHeight;
+    int32_t nCheckLevel;
+
+    CVerifiedBlocks() : nHeight(0), nCheckLevel(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(hashTip);
+        READWRITE(nHeight);
+        READWRITE(nCheckLevel);
+    }
+};
+
 class CCoinsViewDB final : public CCoinsView {
 protected:
     CDBWrapper db;
@@ -74,13 +305,82 @@ public:
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool GetStats(CUTXOStats &stats) const override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                    const CUTXOStats *pstats) override;
+    //! Write like BatchWrite, but leave mapCoins alone so that it can still be
+    //! read from while the write is in progress.
+    bool WriteSnapshot(const CCoinsMap &mapCoins, const uint256 &hashBlock,
+                       const CUTXOStats *pstats);
     CCoinsViewCursor *Cursor() const override;
 
     //! Attempt to update from an older database format.
     //! Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
+
+private:
+    bool CommitCoins(CDBBatch &batch, const uint256 &hashBlock,
+                     const CUTXOStats *pstats, size_t count, size_t changed);
+    bool UpgradeContent();
+    bool UpgradeStats();
+};
+
+/**
+ * Writes to the coin database, moved off the thread that flushes.
+ *
+ * BatchWrite moves the dirty entries it is given into a snapshot and returns
+ * at once. A thread of its own then writes the snapshot, best block and
+ * statistics to the database in a single batch. Until that batch is committed
+ * the snapshot answers reads in front of the database, so the views above
+ * see the flushed state all along. A BatchWrite that comes while the previous
+ * write is still going waits for it.
+ */
+class CCoinsViewAsyncWrite final : public CCoinsView {
+public:
+    explicit CCoinsViewAsyncWrite(CCoinsViewDB *dbIn);
+    ~CCoinsViewAsyncWrite();
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    bool HaveCoin(const COutPoint &outpoint) const override;
+    uint256 GetBestBlock() const override;
+    bool GetStats(CUTXOStats &stats) const override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                    const CUTXOStats *pstats) override;
+    //! Waits for the write in progress, so the database is complete.
+    CCoinsViewCursor *Cursor() const override;
+    size_t EstimateSize() const override;
+
+    //! Wait for the write in progress. Returns false if a write failed.
+    bool Sync() const;
+    //! The block the database is written up to, not counting the write in
+    //! progress.
+    uint256 GetBestBlockOnDisk() const;
+    //! Memory held by the snapshot that is being written.
+    size_t DynamicMemoryUsage() const;
+
+private:
+    void ThreadWrite();
+    //! Drop the written snapshot and give its memory back. Requires cs.
+    void ResetSnapshot();
+
+    CCoinsViewDB *db;
+
+    mutable std::mutex cs;
+    mutable std::condition_variable condWrite;
+    //! Set while the snapshot is not yet on disk.
+    bool fWriting;
+    //! Set once a write failed. The snapshot is then kept, so reads stay
+    //! right, and no more writes are taken.
+    bool fFailed;
+    bool fStop;
+    CCoinsMapMemoryResource snapshotResource;
+    CCoinsMap mapSnapshot;
+    uint256 hashSnapshot;
+    std::unique_ptr<CUTXOStats> pstatsSnapshot;
+    size_t nSnapshotCoinsUsage;
+
+    std::thread threadWrite;
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -94,10 +394,14 @@ public:
 
     bool Valid() const override;
     void Next() override;
+    bool Seek(const COutPoint &key) override;
 
 private:
     CCoinsViewDBCursor(CDBIterator *pcursorIn, const uint256 &hashBlockIn)
         : CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+    //! Cache the key pcursor is at
+    void ReadKey();
+
     std::unique_ptr<CDBIterator> pcursor;
     std::pair<char, COutPoint> keyTmp;
 
@@ -121,10 +425,83 @@ public:
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
-    bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
-    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>> &list);
+    //! Positions of the transactions whose id starts like txid's.
+    bool ReadTxIndex(const uint256 &txid, std::vector<CDiskTxPos> &vPos);
+    //! Add entries to the transaction index, which is then complete up to
+    //! hashBlock.
+    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>> &list,
+                      const uint256 &hashBlock);
+    bool ReadTxIndexBestBlock(uint256 &hashBlock);
+    bool EraseTxIndexBestBlock();
+    //! Erase up to nMax transaction index entries, also of the old format.
+    //! Sets nErased to how many there were.
+    bool EraseTxIndex(size_t nMax, size_t &nErased);
+    bool WriteDepositIndex(const DepositIndexEntries &list);
+    bool EraseDepositIndex(const DepositIndexEntries &list);
+    //! Read the deposits unlocking at heights in [nStartHeight, nEndHeight)
+    bool ReadDepositIndex(uint32_t nStartHeight, uint32_t nEndHeight,
+                          DepositIndexEntries &list);
+    //! Apply update to the address index, which is then complete up to
+    //! hashBlock.
+    bool UpdateAddressIndex(const CAddressIndexUpdate &update,
+                            const uint256 &hashBlock);
+    bool ReadAddressIndexBestBlock(uint256 &hashBlock);
+    bool EraseAddressIndexBestBlock();
+    //! Erase up to nMax address index entries. Sets nErased to how many
+    //! there were.
+    bool EraseAddressIndex(size_t nMax, size_t &nErased);
+    //! Read up to nCount history entries of scriptHash from nStartHeight on,
+    //! after skipping nSkip of them.
+    bool ReadAddressHistory(const uint160 &scriptHash, uint32_t nStartHeight,
+                            size_t nSkip, size_t nCount,
+                            AddressHistoryEntries &list);
+    //! Read the unspent outputs of scriptHash.
+    bool ReadAddressUnspent(const uint160 &scriptHash,
+                            AddressUnspentEntries &list);
+    //! Write the filters of blocks, the block filter index is then complete
+    //! up to hashBlock.
+    bool WriteBlockFilters(
+        const std::vector<std::pair<uint256, CBlockFilterEntry>> &list,
+        const uint256 &hashBlock);
+    bool ReadBlockFilter(const uint256 &hashBlock, CBlockFilterEntry &entry);
+    bool WriteBlockFilterIndexBestBlock(const uint256 &hashBlock);
+    bool ReadBlockFilterIndexBestBlock(uint256 &hashBlock);
+    bool EraseBlockFilterIndexBestBlock();
+    //! Erase up to nMax block filters. Sets nErased to how many there were.
+    bool EraseBlockFilterIndex(size_t nMax, size_t &nErased);
+    //! Write the stats of blocks, the block stats index is then complete up
+    //! to hashBlock.
+    bool WriteBlockStats(
+        const std::vector<std::pair<uint256, CBlockStats>> &list,
+        const uint256 &hashBlock);
+    bool ReadBlockStats(const uint256 &hashBlock, CBlockStats &stats);
+    bool WriteBlockStatsIndexBestBlock(const uint256 &hashBlock);
+    bool ReadBlockStatsIndexBestBlock(uint256 &hashBlock);
+    bool EraseBlockStatsIndexBestBlock();
+    //! Erase up to nMax block stats. Sets nErased to how many there were.
+    bool EraseBlockStatsIndex(size_t nMax, size_t &nErased);
+    //! Apply update to the content archive, which is then complete up to
+    //! hashBlock.
+    bool UpdateContentArchive(const CContentArchiveUpdate &update,
+                              const uint256 &hashBlock);
+    bool ReadArchivedContent(const COutPoint &outpoint,
+                             std::string &strContent);
+    bool HaveArchivedContent(const COutPoint &outpoint);
+    bool ReadContentArchiveBestBlock(uint256 &hashBlock);
+    bool EraseContentArchiveBestBlock();
+    //! Erase up to nMax archived contents. Sets nErased to how many there
+    //! were.
+    bool EraseContentArchive(size_t nMax, size_t &nErased);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
+    //! Id of the block index snapshot that matches the database, if any.
+    bool WriteIndexSnapshotId(uint64_t nId);
+    bool ReadIndexSnapshotId(uint64_t &nId);
+    bool EraseIndexSnapshotId();
+    //! Blocks verified before a clean shutdown, if any.
+    bool WriteVerifiedBlocks(const CVerifiedBlocks &verified);
+    bool ReadVerifiedBlocks(CVerifiedBlocks &verified);
+    bool EraseVerifiedBlocks();
     bool LoadBlockIndexGuts(
         std::function<CBlockIndex *(const uint256 &)> insertBlockIndex);
 };
@@ -0,0 +1,67 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txindex.h"
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "txdb.h"
+#include "util.h"
+#include "validation.h"
+
+#include <utility>
+#include <vector>
+
+std::unique_ptr<CTxIndex> g_txindex;
+
+CTxIndex::CTxIndex(const Config &configIn, bool fDrop)
+    : CBaseIndex(configIn, fDrop, "txindex", "transaction index", "txindex") {
+    Start();
+}
+
+CTxIndex::~CTxIndex() {
+    Stop();
+}
+
+bool CTxIndex::ReadBestBlock(uint256 &hashBest) {
+    return pblocktree->ReadTxIndexBestBlock(hashBest);
+}
+
+bool CTxIndex::EraseBestBlock() {
+    return pblocktree->EraseTxIndexBestBlock();
+}
+
+bool CTxIndex::EraseEntries(size_t nBatch, size_t &nErased) {
+    return pblocktree->EraseTxIndex(nBatch, nErased);
+}
+
+bool CTxIndex::WriteBlocks(const std::vector<const CBlockIndex *> &vBlocks) {
+    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
+    for (const CBlockIndex *pindex : vBlocks) {
+        if (IsStopped()) {
+            return false;
+        }
+        // The outputs of the genesis block can't be spent.
+        if (pindex->nHeight == 0) {
+            continue;
+        }
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, config)) {
+            return error("%s: failed to read block %s", __func__,
+                         pindex->GetBlockHash().ToString());
+        }
+        CDiskTxPos pos(pindex->GetBlockPos(),
+                       GetSizeOfCompactSize(block.vtx.size()));
+        for (const auto &tx : block.vtx) {
+            vPos.push_back(std::make_pair(tx->GetId(), pos));
+            // The same size on disk as on the network.
+            pos.nTxOffset += tx->GetTotalSize();
+        }
+    }
+
+    if (!pblocktree->WriteTxIndex(vPos, vBlocks.back()->GetBlockHash())) {
+        return error("%s: failed to write the transaction index", __func__);
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXINDEX_H
+#define BITCOIN_TXINDEX_H
+
+#include "baseindex.h"
+
+#include <cstddef>
+#include <memory>
+
+class Config;
+
+/** Transactions the transaction index writes in one batch, at the least */
+static const size_t TXINDEX_BATCH_TRANSACTIONS = 100000;
+/** Entries erased in one batch when the transaction index is dropped */
+static const size_t TXINDEX_ERASE_BATCH = 100000;
+
+/**
+ * Maintains the transaction index, the position on disk of the transactions
+ * of the active chain by id. Entries of blocks that are disconnected stay,
+ * readers check the transaction they find against the chain.
+ */
+class CTxIndex : public CBaseIndex {
+public:
+    CTxIndex(const Config &configIn, bool fDrop);
+    ~CTxIndex();
+
+protected:
+    bool ReadBestBlock(uint256 &hashBest) override;
+    bool EraseBestBlock() override;
+    bool EraseEntries(size_t nBatch, size_t &nErased) override;
+    size_t GetEraseBatch() const override { return TXINDEX_ERASE_BATCH; }
+    bool IsBatchFull(size_t nBlocks, size_t nTransactions) const override {
+        return nTransactions >= TXINDEX_BATCH_TRANSACTIONS;
+    }
+    bool WriteBlocks(const std::vector<const CBlockIndex *> &vBlocks) override;
+    bool Rewind(const CBlockIndex *pindexFork) override { return true; }
+};
+
+/** The transaction index thread, building the index with -txindex or dropping
+ * it without */
+extern std::unique_ptr<CTxIndex> g_txindex;
+
+#endif // BITCOIN_TXINDEX_H
@@ -19,8 +19,31 @@
 #include "validation.h"
 #include "version.h"
 
+#include <algorithm>
+
 #include <boost/range/adaptor/reversed.hpp>
 
+std::string RemovalReasonToString(MemPoolRemovalReason reason) {
+    switch (reason) {
+        case MemPoolRemovalReason::EXPIRY:
+            return "expiry";
+        case MemPoolRemovalReason::SIZELIMIT:
+            return "sizelimit";
+        case MemPoolRemovalReason::REORG:
+            return "reorg";
+        case MemPoolRemovalReason::BLOCK:
+            return "block";
+        case MemPoolRemovalReason::CONFLICT:
+            return "conflict";
+        case MemPoolRemovalReason::REPLACED:
+            return "replaced";
+        case MemPoolRemovalReason::INTEREST:
+            return "interest";
+        default:
+            return "unknown";
+    }
+}
+
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef &_tx, const CAmount _nFee,
                                  int64_t _nTime, double _entryPriority,
                                  unsigned int _entryHeight,
@@ -28,12 +51,16 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef &_tx, const CAmount _nFee
                                  bool _spendsCoinbase, int64_t _sigOpsCount,
                                  LockPoints lp)
     : tx(_tx), nFee(_nFee), nTime(_nTime), entryPriority(_entryPriority),
-      entryHeight(_entryHeight), inChainInputValue(_inChainInputValue),
+      inChainInputValue(_inChainInputValue), entryHeight(_entryHeight),
       spendsCoinbase(_spendsCoinbase), sigOpCount(_sigOpsCount),
-      lockPoints(lp) {
+      lockPoints(lp), pindexInputsChecked(nullptr) {
     nTxSize = GetTransactionSize(*tx);
     nModSize = tx->CalculateModifiedSize(GetTxSize());
     nInterest = tx->GetInterest();
+    nContentSize = 0;
+    for (const CTxOut &txout : tx->vout) {
+        nContentSize += txout.strContent.size();
+    }
     nUsageSize = RecursiveDynamicUsage(*tx) + memusage::DynamicUsage(tx);
 
     nCountWithDescendants = 1;
@@ -48,6 +75,7 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef &_tx, const CAmount _nFee
     nSizeWithAncestors = GetTxSize();
     nModFeesWithAncestors = nFee;
     nSigOpCountWithAncestors = sigOpCount;
+    nInterestWithAncestors = nInterest;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry &other) {
@@ -82,14 +110,15 @@ void CTxMemPoolEntry::UpdateLockPoints(const LockPoints &lp) {
 void CTxMemPool::UpdateForDescendants(txiter updateIt,
                                       cacheMap &cachedDescendants,
                                       const std::set<uint256> &setExclude) {
-    setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
+    const linkEntries &children = GetMemPoolChildren(updateIt);
+    setEntries stageEntries(children.begin(), children.end());
+    setEntries setAllDescendants;
 
     while (!stageEntries.empty()) {
         const txiter cit = *stageEntries.begin();
         setAllDescendants.insert(cit);
         stageEntries.erase(cit);
-        const setEntries &setChildren = GetMemPoolChildren(cit);
+        const linkEntries &setChildren = GetMemPoolChildren(cit);
         for (const txiter childEntry : setChildren) {
             cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
             if (cacheIt != cachedDescendants.end()) {
@@ -119,7 +148,8 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt,
             mapTx.modify(cit,
                          update_ancestor_state(updateIt->GetTxSize(),
                                                updateIt->GetModifiedFee(), 1,
-                                               updateIt->GetSigOpCount()));
+                                               updateIt->GetSigOpCount(),
+                                               updateIt->GetInterest()));
         }
     }
     mapTx.modify(updateIt,
@@ -208,7 +238,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(
         // If we're not searching for parents, we require this to be an entry in
         // the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        const linkEntries &parents = GetMemPoolParents(it);
+        parentHashes.insert(parents.begin(), parents.end());
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
@@ -241,7 +272,7 @@ bool CTxMemPool::CalculateMemPoolAncestors(
             return false;
         }
 
-        const setEntries &setMemPoolParents = GetMemPoolParents(stageit);
+        const linkEntries &setMemPoolParents = GetMemPoolParents(stageit);
         for (const txiter &phash : setMemPoolParents) {
             // If this is a new ancestor, add it.
             if (setAncestors.count(phash) == 0) {
@@ -262,7 +293,7 @@ bool CTxMemPool::CalculateMemPoolAncestors(
 
 void CTxMemPool::UpdateAncestorsOf(bool add, txiter it,
                                    setEntries &setAncestors) {
-    setEntries parentIters = GetMemPoolParents(it);
+    linkEntries parentIters = GetMemPoolParents(it);
     // add or remove this tx as a child of each parent
     for (txiter piter : parentIters) {
         UpdateChild(piter, it, add);
@@ -282,17 +313,19 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it,
     int64_t updateSize = 0;
     CAmount updateFee(0);
     int64_t updateSigOpsCount = 0;
+    CAmount updateInterest(0);
     for (txiter ancestorIt : setAncestors) {
         updateSize += ancestorIt->GetTxSize();
         updateFee += ancestorIt->GetModifiedFee();
         updateSigOpsCount += ancestorIt->GetSigOpCount();
+        updateInterest += ancestorIt->GetInterest();
     }
     mapTx.modify(it, update_ancestor_state(updateSize, updateFee, updateCount,
-                                           updateSigOpsCount));
+                                           updateSigOpsCount, updateInterest));
 }
 
 void CTxMemPool::UpdateChildrenForRemoval(txiter it) {
-    const setEntries &setMemPoolChildren = GetMemPoolChildren(it);
+    const linkEntries &setMemPoolChildren = GetMemPoolChildren(it);
     for (txiter updateIt : setMemPoolChildren) {
         UpdateParent(updateIt, it, false);
     }
@@ -316,9 +349,11 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove,
             int64_t modifySize = -((int64_t)removeIt->GetTxSize());
             CAmount modifyFee = -1 * removeIt->GetModifiedFee();
             int modifySigOps = -removeIt->GetSigOpCount();
+            CAmount modifyInterest = -1 * removeIt->GetInterest();
             for (txiter dit : setDescendants) {
                 mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee,
-                                                        -1, modifySigOps));
+                                                        -1, modifySigOps,
+                                                        modifyInterest));
             }
         }
     }
@@ -370,7 +405,8 @@ void CTxMemPoolEntry::UpdateDescendantState(int64_t modifySize,
 
 void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
                                           int64_t modifyCount,
-                                          int modifySigOps) {
+                                          int modifySigOps,
+                                          CAmount modifyInterest) {
     nSizeWithAncestors += modifySize;
     assert(int64_t(nSizeWithAncestors) > 0);
     nModFeesWithAncestors += modifyFee;
@@ -378,10 +414,12 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
     assert(int64_t(nCountWithAncestors) > 0);
     nSigOpCountWithAncestors += modifySigOps;
     assert(int(nSigOpCountWithAncestors) >= 0);
+    nInterestWithAncestors += modifyInterest;
+    assert(nInterestWithAncestors >= 0);
 }
 
 CTxMemPool::CTxMemPool(const CFeeRate &_minReasonableRelayFee)
-    : nTransactionsUpdated(0) {
+    : nTransactionsUpdated(0), nSequence(GetTimeMicros()) {
     // lock free clear
     _clear();
 
@@ -412,6 +450,37 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n) {
     nTransactionsUpdated += n;
 }
 
+void CTxMemPool::AddEvent(const uint256 &txid, bool fAdded,
+                          MemPoolRemovalReason reason) {
+    AssertLockHeld(cs);
+    events.push_back(CMemPoolEvent{++nSequence, txid, fAdded, reason});
+    if (events.size() > MEMPOOL_EVENTS_SIZE) {
+        nSequenceDropped = events.front().nSequence;
+        events.pop_front();
+    }
+}
+
+uint64_t CTxMemPool::GetSequence() const {
+    LOCK(cs);
+    return nSequence;
+}
+
+bool CTxMemPool::GetEventsSince(uint64_t nSince, size_t nMax,
+                                std::vector<CMemPoolEvent> &vEvents) const {
+    LOCK(cs);
+    if (nSince < nSequenceDropped || nSince > nSequence) {
+        return false;
+    }
+    // Events are numbered one after the other, the first is right after the
+    // last one dropped.
+    std::deque<CMemPoolEvent>::const_iterator it =
+        events.begin() + (nSince - nSequenceDropped);
+    for (; it != events.end() && vEvents.size() < nMax; ++it) {
+        vEvents.push_back(*it);
+    }
+    return true;
+}
+
 bool CTxMemPool::addUnchecked(const uint256 &hash, const CTxMemPoolEntry &entry,
                               setEntries &setAncestors, bool validFeeEstimate) {
     NotifyEntryAdded(entry.GetSharedTx());
@@ -463,11 +532,17 @@ bool CTxMemPool::addUnchecked(const uint256 &hash, const CTxMemPoolEntry &entry,
 
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
+    totalContentSize += entry.GetContentSize();
     minerPolicyEstimator->processTransaction(entry, validFeeEstimate);
 
     vTxHashes.emplace_back(tx.GetHash(), newit);
     newit->vTxHashesIdx = vTxHashes.size() - 1;
 
+    if (entry.GetInterest() > 0) {
+        setInterestEntries.insert(newit);
+    }
+
+    AddEvent(tx.GetId(), true, MemPoolRemovalReason::UNKNOWN);
     return true;
 }
 
@@ -490,13 +565,16 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason) {
     }
 
     totalTxSize -= it->GetTxSize();
+    totalContentSize -= it->GetContentSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
     cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) +
                         memusage::DynamicUsage(mapLinks[it].children);
     mapLinks.erase(it);
+    setInterestEntries.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
     minerPolicyEstimator->removeTx(txid);
+    AddEvent(txid, false, reason);
 }
 
 // Calculates descendants of entry that are not already in setDescendants, and
@@ -519,7 +597,7 @@ void CTxMemPool::CalculateDescendants(txiter entryit,
         setDescendants.insert(it);
         stage.erase(it);
 
-        const setEntries &setChildren = GetMemPoolChildren(it);
+        const linkEntries &setChildren = GetMemPoolChildren(it);
         for (const txiter &childiter : setChildren) {
             if (!setDescendants.count(childiter)) {
                 stage.insert(childiter);
@@ -631,7 +709,8 @@ void CTxMemPool::removeConflicts(const CTransaction &tx) {
  * fee estimator.
  */
 void CTxMemPool::removeForBlock(const std::vector<CTransactionRef> &vtx,
-                                unsigned int nBlockHeight) {
+                                unsigned int nBlockHeight,
+                                const CBlockIndex *pindexBlock) {
     LOCK(cs);
     std::vector<const CTxMemPoolEntry *> entries;
     for (const auto &tx : vtx) {
@@ -657,21 +736,58 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef> &vtx,
         ClearPrioritisation(tx->GetId());
     }
 
+    if (pindexBlock) {
+        UpdateForInterestPeriod(pindexBlock);
+    }
+
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = true;
 }
 
+void CTxMemPool::UpdateForInterestPeriod(const CBlockIndex *pindexPrev) {
+    LOCK(cs);
+    size_t nPeriod;
+    if (!GetInterestPeriodAfter(pindexPrev, nPeriod)) {
+        nPeriod = std::numeric_limits<size_t>::max();
+    }
+    if (fInterestPeriodValued && nPeriod == nInterestPeriod) {
+        return;
+    }
+
+    setEntries stage;
+    for (txiter it : setInterestEntries) {
+        if (it->GetInterest() > GetTxInterest(it->GetTx(), pindexPrev)) {
+            CalculateDescendants(it, stage);
+        }
+    }
+    if (!stage.empty()) {
+        LogPrint("mempool", "Removing %u transactions claiming too much "
+                            "interest after height %d\n",
+                 stage.size(), pindexPrev->nHeight);
+    }
+    RemoveStaged(stage, false, MemPoolRemovalReason::INTEREST);
+
+    fInterestPeriodValued = true;
+    nInterestPeriod = nPeriod;
+}
+
 void CTxMemPool::_clear() {
     mapLinks.clear();
+    setInterestEntries.clear();
+    fInterestPeriodValued = false;
     mapTx.clear();
     mapNextTx.clear();
     vTxHashes.clear();
     totalTxSize = 0;
+    totalContentSize = 0;
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
+    // Nothing tells what was cleared, mirrors have to start over.
+    events.clear();
+    nSequenceDropped = nSequence;
 }
 
 void CTxMemPool::clear() {
@@ -692,6 +808,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
              (unsigned int)mapTx.size(), (unsigned int)mapNextTx.size());
 
     uint64_t checkTotal = 0;
+    uint64_t checkContentTotal = 0;
     uint64_t innerUsage = 0;
 
     CCoinsViewCache mempoolDuplicate(const_cast<CCoinsViewCache *>(pcoins));
@@ -703,6 +820,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
          it != mapTx.end(); it++) {
         unsigned int i = 0;
         checkTotal += it->GetTxSize();
+        checkContentTotal += it->GetContentSize();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction &tx = it->GetTx();
         txlinksMap::const_iterator linksiter = mapLinks.find(it);
@@ -710,6 +828,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
         const TxLinks &links = linksiter->second;
         innerUsage += memusage::DynamicUsage(links.parents) +
                       memusage::DynamicUsage(links.children);
+        assert(setInterestEntries.count(it) == (it->GetInterest() > 0));
         bool fDependsWait = false;
         setEntries setParentCheck;
         int64_t parentSizes = 0;
@@ -738,7 +857,8 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
             assert(it3->second == &tx);
             i++;
         }
-        assert(setParentCheck == GetMemPoolParents(it));
+        assert(setParentCheck == setEntries(links.parents.begin(),
+                                            links.parents.end()));
         // Verify ancestor state is correct.
         setEntries setAncestors;
         uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -749,17 +869,20 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
         uint64_t nSizeCheck = it->GetTxSize();
         CAmount nFeesCheck = it->GetModifiedFee();
         int64_t nSigOpCheck = it->GetSigOpCount();
+        CAmount nInterestCheck = it->GetInterest();
 
         for (txiter ancestorIt : setAncestors) {
             nSizeCheck += ancestorIt->GetTxSize();
             nFeesCheck += ancestorIt->GetModifiedFee();
             nSigOpCheck += ancestorIt->GetSigOpCount();
+            nInterestCheck += ancestorIt->GetInterest();
         }
 
         assert(it->GetCountWithAncestors() == nCountCheck);
         assert(it->GetSizeWithAncestors() == nSizeCheck);
         assert(it->GetSigOpCountWithAncestors() == nSigOpCheck);
         assert(it->GetModFeesWithAncestors() == nFeesCheck);
+        assert(it->GetInterestWithAncestors() == nInterestCheck);
 
         // Check children against mapNextTx
         CTxMemPool::setEntries setChildrenCheck;
@@ -775,7 +898,8 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
                 childSizes += childit->GetTxSize();
             }
         }
-        assert(setChildrenCheck == GetMemPoolChildren(it));
+        assert(setChildrenCheck == setEntries(links.children.begin(),
+                                              links.children.end()));
         // Also check to make sure size is greater than sum with immediate
         // children. Just a sanity check, not definitive that this calc is
         // correct...
@@ -822,6 +946,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
     }
 
     assert(totalTxSize == checkTotal);
+    assert(totalContentSize == checkContentTotal);
     assert(innerUsage == cachedInnerUsage);
 }
 
@@ -875,8 +1000,12 @@ CTxMemPool::GetSortedDepthAndScore() const {
     return iters;
 }
 
-void CTxMemPool::queryHashes(std::vector<uint256> &vtxid) {
+void CTxMemPool::queryHashes(std::vector<uint256> &vtxid,
+                             uint64_t *pnSequence) {
     LOCK(cs);
+    if (pnSequence) {
+        *pnSequence = nSequence;
+    }
     auto iters = GetSortedDepthAndScore();
 
     vtxid.clear();
@@ -1013,7 +1142,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash,
             setDescendants.erase(it);
             for (txiter descendantIt : setDescendants) {
                 mapTx.modify(descendantIt,
-                             update_ancestor_state(0, nFeeDelta, 0, 0));
+                             update_ancestor_state(0, nFeeDelta, 0, 0, 0));
             }
         }
     }
@@ -1085,6 +1214,7 @@ size_t CTxMemPool::DynamicMemoryUsage() const {
            memusage::DynamicUsage(mapNextTx) +
            memusage::DynamicUsage(mapDeltas) +
            memusage::DynamicUsage(mapLinks) +
+           memusage::DynamicUsage(setInterestEntries) +
            memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
 }
 
@@ -1127,25 +1257,31 @@ bool CTxMemPool::addUnchecked(const uint256 &hash, const CTxMemPoolEntry &entry,
     return addUnchecked(hash, entry, setAncestors, validFeeEstimate);
 }
 
-void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add) {
-    setEntries s;
-    if (add && mapLinks[entry].children.insert(child).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].children.erase(child)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+void CTxMemPool::UpdateLink(linkEntries &links, txiter it, bool add) {
+    cachedInnerUsage -= memusage::DynamicUsage(links);
+    linkEntries::iterator pos = std::lower_bound(
+        links.begin(), links.end(), it, CompareIteratorByHash());
+    bool fFound = pos != links.end() && *pos == it;
+    if (add && !fFound) {
+        links.insert(pos, it);
+    } else if (!add && fFound) {
+        links.erase(pos);
+        if (links.empty()) {
+            linkEntries().swap(links);
+        }
     }
+    cachedInnerUsage += memusage::DynamicUsage(links);
+}
+
+void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add) {
+    UpdateLink(mapLinks[entry].children, child, add);
 }
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add) {
-    setEntries s;
-    if (add && mapLinks[entry].parents.insert(parent).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].parents.erase(parent)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
-    }
+    UpdateLink(mapLinks[entry].parents, parent, add);
 }
 
-const CTxMemPool::setEntries &
+const CTxMemPool::linkEntries &
 CTxMemPool::GetMemPoolParents(txiter entry) const {
     assert(entry != mapTx.end());
     txlinksMap::const_iterator it = mapLinks.find(entry);
@@ -1153,7 +1289,7 @@ CTxMemPool::GetMemPoolParents(txiter entry) const {
     return it->second.parents;
 }
 
-const CTxMemPool::setEntries &
+const CTxMemPool::linkEntries &
 CTxMemPool::GetMemPoolChildren(txiter entry) const {
     assert(entry != mapTx.end());
     txlinksMap::const_iterator it = mapLinks.find(entry);
@@ -1223,27 +1359,7 @@ void CTxMemPool::TrimToSize(size_t sizelimit,
         setEntries stage;
         CalculateDescendants(mapTx.project<0>(it), stage);
         nTxnRemoved += stage.size();
-
-        std::vector<CTransaction> txn;
-        if (pvNoSpendsRemaining) {
-            txn.reserve(stage.size());
-            for (txiter iter : stage) {
-                txn.push_back(iter->GetTx());
-            }
-        }
-        RemoveStaged(stage, false, MemPoolRemovalReason::SIZELIMIT);
-        if (pvNoSpendsRemaining) {
-            for (const CTransaction &tx : txn) {
-                for (const CTxIn &txin : tx.vin) {
-                    if (exists(txin.prevout.hash)) {
-                        continue;
-                    }
-                    if (!mapNextTx.count(txin.prevout)) {
-                        pvNoSpendsRemaining->push_back(txin.prevout);
-                    }
-                }
-            }
-        }
+        RemoveStagedForLimit(stage, pvNoSpendsRemaining);
     }
 
     if (maxFeeRateRemoved > CFeeRate(CAmount(0))) {
@@ -1253,6 +1369,68 @@ void CTxMemPool::TrimToSize(size_t sizelimit,
     }
 }
 
+void CTxMemPool::TrimContentToSize(
+    size_t sizelimit, std::vector<COutPoint> *pvNoSpendsRemaining) {
+    LOCK(cs);
+
+    if (totalContentSize <= sizelimit) {
+        return;
+    }
+
+    // Gather the worst content packages in one pass. The rolling minimum fee
+    // is left alone: it gates every transaction, and a content flood must
+    // not price payments out of the mempool.
+    uint64_t nContentRemoved = 0;
+    setEntries stage;
+    indexed_transaction_set::index<descendant_score>::type::iterator it =
+        mapTx.get<descendant_score>().begin();
+    for (; it != mapTx.get<descendant_score>().end() &&
+           totalContentSize - nContentRemoved > sizelimit;
+         ++it) {
+        txiter entry = mapTx.project<0>(it);
+        if (it->GetContentSize() == 0 || stage.count(entry)) {
+            continue;
+        }
+
+        setEntries descendants;
+        CalculateDescendants(entry, descendants);
+        for (txiter descendant : descendants) {
+            if (stage.insert(descendant).second) {
+                nContentRemoved += descendant->GetContentSize();
+            }
+        }
+    }
+
+    size_t nTxnRemoved = stage.size();
+    RemoveStagedForLimit(stage, pvNoSpendsRemaining);
+    LogPrint("mempool", "Removed %u txn for %u content bytes over the limit\n",
+             nTxnRemoved, nContentRemoved);
+}
+
+void CTxMemPool::RemoveStagedForLimit(
+    setEntries &stage, std::vector<COutPoint> *pvNoSpendsRemaining) {
+    std::vector<CTransaction> txn;
+    if (pvNoSpendsRemaining) {
+        txn.reserve(stage.size());
+        for (txiter iter : stage) {
+            txn.push_back(iter->GetTx());
+        }
+    }
+    RemoveStaged(stage, false, MemPoolRemovalReason::SIZELIMIT);
+    if (pvNoSpendsRemaining) {
+        for (const CTransaction &tx : txn) {
+            for (const CTxIn &txin : tx.vin) {
+                if (exists(txin.prevout.hash)) {
+                    continue;
+                }
+                if (!mapNextTx.count(txin.prevout)) {
+                    pvNoSpendsRemaining->push_back(txin.prevout);
+                }
+            }
+        }
+    }
+}
+
 bool CTxMemPool::TransactionWithinChainLimit(const uint256 &txid,
                                              size_t chainLimit) const {
     LOCK(cs);
@@ -8,6 +8,7 @@
 
 #include "amount.h"
 #include "coins.h"
+#include "core_memusage.h"
 #include "indirectmap.h"
 #include "primitives/transaction.h"
 #include "random.h"
@@ -15,9 +16,11 @@
 
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index_container.hpp>
 #include <boost/signals2/signal.hpp>
 
+#include <deque>
 #include <map>
 #include <memory>
 #include <set>
@@ -85,6 +88,8 @@ private:
     CAmount nInterest;
     //!< ... and avoid recomputing tx size
     size_t nTxSize;
+    //!< ... and the content bytes of its outputs
+    size_t nContentSize;
     //!< ... and modified size for priority
     size_t nModSize;
     //!< ... and total memory usage
@@ -93,10 +98,10 @@ private:
     int64_t nTime;
     //!< Priority when entering the mempool
     double entryPriority;
-    //!< Chain height when entering the mempool
-    unsigned int entryHeight;
     //!< Sum of all txin values that are already in blockchain
     CAmount inChainInputValue;
+    //!< Chain height when entering the mempool
+    unsigned int entryHeight;
     //!< keep track of transactions that spend a coinbase
     bool spendsCoinbase;
     //!< Total sigop plus P2SH sigops count
@@ -106,6 +111,8 @@ private:
     CAmount feeDelta;
     //!< Track the height and time at which tx was final
     LockPoints lockPoints;
+    //!< Tip whose coins all the inputs were checked against, if any
+    const CBlockIndex *pindexInputsChecked;
 
     // Information about descendants of this transaction that are in the
     // mempool; if we remove this transaction we must remove all of these
@@ -124,6 +131,8 @@ private:
     uint64_t nSizeWithAncestors;
     CAmount nModFeesWithAncestors;
     int64_t nSigOpCountWithAncestors;
+    //!< Interest claimed with ancestors, so templates can budget it per package
+    CAmount nInterestWithAncestors;
 
 public:
     CTxMemPoolEntry(const CTransactionRef &_tx, const CAmount _nFee,
@@ -143,19 +152,31 @@ public:
     const CAmount GetFee() const { return nFee; }
     const CAmount GetInterest() const {return nInterest;}
     size_t GetTxSize() const { return nTxSize; }
+    size_t GetContentSize() const { return nContentSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return entryHeight; }
+    double GetEntryPriority() const { return entryPriority; }
+    CAmount GetInChainInputValue() const { return inChainInputValue; }
     int64_t GetSigOpCount() const { return sigOpCount; }
     CAmount GetModifiedFee() const { return nFee + feeDelta; }
     size_t DynamicMemoryUsage() const { return nUsageSize; }
     const LockPoints &GetLockPoints() const { return lockPoints; }
+    const CBlockIndex *GetInputsChecked() const { return pindexInputsChecked; }
+    /**
+     * Records that all the inputs were confirmed coins at pindex and passed
+     * the checks there, so a block built on it can reuse the fee and sigops.
+     */
+    void SetInputsChecked(const CBlockIndex *pindex) {
+        pindexInputsChecked = pindex;
+    }
 
     // Adjusts the descendant state, if this entry is not dirty.
     void UpdateDescendantState(int64_t modifySize, CAmount modifyFee,
                                int64_t modifyCount);
     // Adjusts the ancestor state
     void UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
-                             int64_t modifyCount, int modifySigOps);
+                             int64_t modifyCount, int modifySigOps,
+                             CAmount modifyInterest);
     // Updates the fee delta used for mining priority score, and the
     // modified fees with descendants.
     void UpdateFeeDelta(CAmount feeDelta);
@@ -174,6 +195,7 @@ public:
     int64_t GetSigOpCountWithAncestors() const {
         return nSigOpCountWithAncestors;
     }
+    CAmount GetInterestWithAncestors() const { return nInterestWithAncestors; }
 
     //!< Index in mempool's vTxHashes
     mutable size_t vTxHashesIdx;
@@ -198,13 +220,15 @@ private:
 
 struct update_ancestor_state {
     update_ancestor_state(int64_t _modifySize, CAmount _modifyFee,
-                          int64_t _modifyCount, int64_t _modifySigOpsCost)
+                          int64_t _modifyCount, int64_t _modifySigOpsCost,
+                          CAmount _modifyInterest)
         : modifySize(_modifySize), modifyFee(_modifyFee),
-          modifyCount(_modifyCount), modifySigOpsCost(_modifySigOpsCost) {}
+          modifyCount(_modifyCount), modifySigOpsCost(_modifySigOpsCost),
+          modifyInterest(_modifyInterest) {}
 
     void operator()(CTxMemPoolEntry &e) {
         e.UpdateAncestorState(modifySize, modifyFee, modifyCount,
-                              modifySigOpsCost);
+                              modifySigOpsCost, modifyInterest);
     }
 
 private:
@@ -212,6 +236,7 @@ private:
     CAmount modifyFee;
     int64_t modifyCount;
     int64_t modifySigOpsCost;
+    CAmount modifyInterest;
 };
 
 struct update_fee_delta {
@@ -238,6 +263,10 @@ struct mempoolentry_txid {
     result_type operator()(const CTxMemPoolEntry &entry) const {
         return entry.GetTx().GetId();
     }
+
+    result_type operator()(const CTransactionRef &tx) const {
+        return tx->GetId();
+    }
 };
 
 /** \class CompareTxMemPoolEntryByDescendantScore
@@ -330,6 +359,7 @@ struct descendant_score {};
 struct entry_time {};
 struct mining_score {};
 struct ancestor_score {};
+struct insertion_order {};
 
 class CBlockPolicyEstimator;
 
@@ -368,7 +398,24 @@ enum class MemPoolRemovalReason {
     //! Removed for conflict with in-block transaction
     CONFLICT,
     //! Removed for replacement
-    REPLACED
+    REPLACED,
+    //! Removed as its outputs claim more interest than now allowed
+    INTEREST
+};
+
+/** The name of reason, as notifications report it */
+std::string RemovalReasonToString(MemPoolRemovalReason reason);
+
+/** Mempool events kept for getmempooldelta, for mirrors that fall behind */
+static const size_t MEMPOOL_EVENTS_SIZE = 100000;
+
+/** A transaction entering or leaving the mempool, numbered in order */
+struct CMemPoolEvent {
+    uint64_t nSequence;
+    uint256 txid;
+    //! Whether it entered the mempool rather than left it
+    bool fAdded;
+    MemPoolRemovalReason reason;
 };
 
 class SaltedTxidHasher {
@@ -473,6 +520,8 @@ private:
 
     //!< sum of all mempool tx's virtual sizes.
     uint64_t totalTxSize;
+    //!< sum of all mempool tx's content sizes.
+    uint64_t totalContentSize;
     //!< sum of dynamic memory usage of all the map elements (NOT the maps
     //! themselves)
     uint64_t cachedInnerUsage;
@@ -482,7 +531,17 @@ private:
     //!< minimum fee to get into the pool, decreases exponentially
     mutable double rollingMinimumFeeRate;
 
+    //!< Number of the last event, and of the last one dropped. They start
+    //! from the time the mempool was made, so that numbers of an earlier run
+    //! are behind all of them.
+    uint64_t nSequence;
+    uint64_t nSequenceDropped;
+    //!< The latest events, up to MEMPOOL_EVENTS_SIZE
+    std::deque<CMemPoolEvent> events;
+
     void trackPackageRemoved(const CFeeRate &rate);
+    void AddEvent(const uint256 &txid, bool fAdded,
+                  MemPoolRemovalReason reason);
 
 public:
     // public only for testing
@@ -528,21 +587,42 @@ public:
         }
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
+    /**
+     * Direct in-mempool parents or children of an entry, sorted by txid.
+     * Almost every entry has zero or one of each, so a vector costs nothing
+     * or one small allocation where a std::set would pay a tree node per
+     * link.
+     */
+    typedef std::vector<txiter> linkEntries;
 
-    const setEntries &GetMemPoolParents(txiter entry) const;
-    const setEntries &GetMemPoolChildren(txiter entry) const;
+    const linkEntries &GetMemPoolParents(txiter entry) const;
+    const linkEntries &GetMemPoolChildren(txiter entry) const;
 
 private:
     typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
     struct TxLinks {
-        setEntries parents;
-        setEntries children;
+        linkEntries parents;
+        linkEntries children;
     };
 
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
     txlinksMap mapLinks;
 
+    //!< Entries whose outputs claim interest
+    setEntries setInterestEntries;
+    //!< Whether setInterestEntries was valued at nInterestPeriod
+    bool fInterestPeriodValued;
+    //!< Interest period of the last valuation, max() once interest ran out
+    size_t nInterestPeriod;
+
+    void UpdateLink(linkEntries &links, txiter it, bool add);
+    /**
+     * Remove a staged set evicted for a size limit, adding the outpoints
+     * left without spends in the mempool to pvNoSpendsRemaining if set.
+     */
+    void RemoveStagedForLimit(setEntries &stage,
+                              std::vector<COutPoint> *pvNoSpendsRemaining);
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
@@ -584,14 +664,39 @@ public:
     void removeForReorg(const Config &config, const CCoinsViewCache *pcoins,
                         unsigned int nMemPoolHeight);
     void removeConflicts(const CTransaction &tx);
+    /**
+     * Remove the transactions of a newly connected block and their conflicts.
+     * If pindexBlock is the block's index, entries claiming more interest
+     * than allowed on top of it are removed too.
+     */
     void removeForBlock(const std::vector<CTransactionRef> &vtx,
-                        unsigned int nBlockHeight);
+                        unsigned int nBlockHeight,
+                        const CBlockIndex *pindexBlock = nullptr);
+    /**
+     * Revalue the entries claiming interest for a new tip. As the interest
+     * allowed only depends on the interest period, this does nothing unless
+     * the period changed since the last call. Entries claiming more than now
+     * allowed, which can't be mined anymore, are removed with their
+     * descendants, which keeps the package aggregates correct.
+     */
+    void UpdateForInterestPeriod(const CBlockIndex *pindexPrev);
 
     void clear();
     // lock free
     void _clear();
     bool CompareDepthAndScore(const uint256 &hasha, const uint256 &hashb);
-    void queryHashes(std::vector<uint256> &vtxid);
+    /** The txids, and the number of the last event if pnSequence is set */
+    void queryHashes(std::vector<uint256> &vtxid,
+                     uint64_t *pnSequence = nullptr);
+    /** The number of the last event */
+    uint64_t GetSequence() const;
+    /**
+     * Add up to nMax events after nSince to vEvents. Returns false if some of
+     * them were dropped already, or nSince isn't of this mempool: a mirror
+     * should start over from queryHashes then.
+     */
+    bool GetEventsSince(uint64_t nSince, size_t nMax,
+                        std::vector<CMemPoolEvent> &vEvents) const;
     bool isSpent(const COutPoint &outpoint);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
@@ -676,6 +781,15 @@ public:
     void TrimToSize(size_t sizelimit,
                     std::vector<COutPoint> *pvNoSpendsRemaining = nullptr);
 
+    /**
+     * Remove content-carrying transactions, lowest descendant score first,
+     * until the content bytes in the mempool are <= sizelimit. Transactions
+     * without content are only removed as descendants of evicted ones.
+     * pvNoSpendsRemaining is populated as for TrimToSize.
+     */
+    void TrimContentToSize(
+        size_t sizelimit, std::vector<COutPoint> *pvNoSpendsRemaining = nullptr);
+
     /** Expire all transaction (and their dependencies) in the mempool older
      * than time. Return the number of removed transactions. */
     int Expire(int64_t time);
@@ -695,6 +809,11 @@ public:
         return totalTxSize;
     }
 
+    uint64_t GetTotalContentSize() {
+        LOCK(cs);
+        return totalContentSize;
+    }
+
     bool exists(uint256 hash) const {
         LOCK(cs);
         return mapTx.count(hash) != 0;
@@ -812,4 +931,88 @@ struct TxCoinAgePriorityCompare {
     }
 };
 
+/**
+ * DisconnectedBlockTransactions
+ *
+ * During the reorg, it's desirable to re-add previously confirmed transactions
+ * to the mempool, so that anything not re-confirmed in the new chain is
+ * available to be mined. However, it's more efficient to wait until the reorg
+ * is complete and process all still-unconfirmed transactions at that time,
+ * since we expect most confirmed transactions to (typically) still be
+ * confirmed in the new chain, and re-accepting to the memory pool is expensive
+ * (and therefore better to not do in the middle of reorg-processing).
+ * Instead, store the disconnected transactions (in order!) as we go, remove any
+ * that are included in blocks in the new chain, and then process the remaining
+ * still-unconfirmed transactions at the end.
+ */
+// multi_index tag names
+struct txid_index {};
+
+struct DisconnectedBlockTransactions {
+    typedef boost::multi_index_container<
+        CTransactionRef, boost::multi_index::indexed_by<
+                             // sorted by txid
+                             boost::multi_index::hashed_unique<
+                                 boost::multi_index::tag<txid_index>,
+                                 mempoolentry_txid, SaltedTxidHasher>,
+                             // sorted by order in the blockchain
+                             boost::multi_index::sequenced<
+                                 boost::multi_index::tag<insertion_order>>>>
+        indexed_disconnected_transactions;
+
+    // It's almost certainly a logic bug if we don't clear out queuedTx before
+    // destruction, as we add to it while disconnecting blocks, and then we
+    // need to re-process remaining transactions to ensure mempool consistency.
+    // For now, assert() that we've emptied out this object on destruction.
+    // This assert() can always be removed if the reorg-processing code were
+    // to be refactored such that this assumption is no longer true (for
+    // instance if there was some other way we cleaned up the mempool after a
+    // reorg, besides draining this object).
+    ~DisconnectedBlockTransactions() { assert(queuedTx.empty()); }
+
+    indexed_disconnected_transactions queuedTx;
+    uint64_t cachedInnerUsage = 0;
+
+    // Estimate the overhead of queuedTx to be 6 pointers + an allocation, as
+    // no exact formula for boost::multi_index_contained is implemented.
+    size_t DynamicMemoryUsage() const {
+        return memusage::MallocUsage(sizeof(CTransactionRef) +
+                                     6 * sizeof(void *)) *
+                   queuedTx.size() +
+               cachedInnerUsage;
+    }
+
+    void addTransaction(const CTransactionRef &tx) {
+        queuedTx.insert(tx);
+        cachedInnerUsage += RecursiveDynamicUsage(tx);
+    }
+
+    // Remove entries based on txid_index, and update memory usage.
+    void removeForBlock(const std::vector<CTransactionRef> &vtx) {
+        // Short-circuit in the common case of a block being added to the tip
+        if (queuedTx.empty()) {
+            return;
+        }
+        for (auto const &tx : vtx) {
+            auto it = queuedTx.find(tx->GetId());
+            if (it != queuedTx.end()) {
+                cachedInnerUsage -= RecursiveDynamicUsage(*it);
+                queuedTx.erase(it);
+            }
+        }
+    }
+
+    // Remove an entry by insertion_order index, and update memory usage.
+    void removeEntry(indexed_disconnected_transactions::index<
+                     insertion_order>::type::iterator entry) {
+        cachedInnerUsage -= RecursiveDynamicUsage(*entry);
+        queuedTx.get<insertion_order>().erase(entry);
+    }
+
+    void clear() {
+        cachedInnerUsage = 0;
+        queuedTx.clear();
+    }
+};
+
 #endif // BITCOIN_TXMEMPOOL_H
@@ -0,0 +1,217 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txorphanage.h"
+
+#include "policy/policy.h"
+#include "random.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <cassert>
+
+bool CTxOrphanage::AddTx(const CTransactionRef &tx, NodeId peer) {
+    LOCK(cs);
+    const uint256 &txid = tx->GetId();
+    if (mapOrphans.count(txid)) {
+        return false;
+    }
+
+    // Ignore big transactions, to avoid a send-big-orphans memory exhaustion
+    // attack. If a peer has a legitimate large transaction with a missing
+    // parent then we assume it will rebroadcast it later, after the parent
+    // transaction(s) have been mined or received.
+    int64_t nSize = GetTransactionSize(*tx);
+    if (nSize >= MAX_STANDARD_TX_SIZE) {
+        LogPrint("mempool", "ignoring large orphan tx (size: %u, hash: %s)\n",
+                 nSize, txid.ToString());
+        return false;
+    }
+
+    auto ret = mapOrphans.emplace(
+        txid, Entry{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME,
+                    uint32_t(nSize), vOrphanList.size()});
+    assert(ret.second);
+    vOrphanList.push_back(ret.first);
+    for (const CTxIn &txin : tx->vin) {
+        mapOrphansByPrev[txin.prevout].insert(ret.first);
+    }
+    nTotalBytes += nSize;
+
+    LogPrint("mempool", "stored orphan tx %s (mapsz %u outsz %u bytes %u)\n",
+             txid.ToString(), mapOrphans.size(), mapOrphansByPrev.size(),
+             nTotalBytes);
+    return true;
+}
+
+bool CTxOrphanage::HaveTx(const uint256 &txid) const {
+    LOCK(cs);
+    return mapOrphans.count(txid) > 0;
+}
+
+int CTxOrphanage::EraseTx(const uint256 &txid) {
+    LOCK(cs);
+    return EraseTxLocked(txid);
+}
+
+int CTxOrphanage::EraseTxLocked(const uint256 &txid) {
+    auto it = mapOrphans.find(txid);
+    if (it == mapOrphans.end()) {
+        return 0;
+    }
+    for (const CTxIn &txin : it->second.tx->vin) {
+        auto itPrev = mapOrphansByPrev.find(txin.prevout);
+        if (itPrev == mapOrphansByPrev.end()) {
+            continue;
+        }
+        itPrev->second.erase(it);
+        if (itPrev->second.empty()) {
+            mapOrphansByPrev.erase(itPrev);
+        }
+    }
+
+    // Move the last orphan of the list in the place of this one.
+    size_t nPos = it->second.nListPos;
+    vOrphanList[nPos] = vOrphanList.back();
+    vOrphanList[nPos]->second.nListPos = nPos;
+    vOrphanList.pop_back();
+
+    nTotalBytes -= it->second.nSize;
+    mapOrphans.erase(it);
+    return 1;
+}
+
+void CTxOrphanage::EraseForPeer(NodeId peer) {
+    LOCK(cs);
+    mapWorkSet.erase(peer);
+    int nErased = 0;
+    auto iter = mapOrphans.begin();
+    while (iter != mapOrphans.end()) {
+        // Increment to avoid iterator becoming invalid.
+        auto maybeErase = iter++;
+        if (maybeErase->second.fromPeer == peer) {
+            nErased += EraseTxLocked(maybeErase->first);
+        }
+    }
+    if (nErased > 0) {
+        LogPrint("mempool", "Erased %d orphan tx from peer=%d\n", nErased,
+                 peer);
+    }
+}
+
+void CTxOrphanage::EraseForBlockTx(const CTransaction &tx) {
+    LOCK(cs);
+    std::vector<uint256> vOrphanErase;
+    for (const CTxIn &txin : tx.vin) {
+        auto itByPrev = mapOrphansByPrev.find(txin.prevout);
+        if (itByPrev == mapOrphansByPrev.end()) {
+            continue;
+        }
+        for (const Iter &mi : itByPrev->second) {
+            vOrphanErase.push_back(mi->first);
+        }
+    }
+
+    if (vOrphanErase.size()) {
+        int nErased = 0;
+        for (const uint256 &orphanId : vOrphanErase) {
+            nErased += EraseTxLocked(orphanId);
+        }
+        LogPrint("mempool",
+                 "Erased %d orphan tx included or conflicted by block\n",
+                 nErased);
+    }
+}
+
+unsigned int CTxOrphanage::Limit(unsigned int nMaxOrphans,
+                                 uint64_t nMaxBytes) {
+    LOCK(cs);
+    unsigned int nEvicted = 0;
+    int64_t nNow = GetTime();
+    if (nNextSweep <= nNow) {
+        // Sweep out expired orphan pool entries:
+        int nErased = 0;
+        int64_t nMinExpTime =
+            nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
+        auto iter = mapOrphans.begin();
+        while (iter != mapOrphans.end()) {
+            auto maybeErase = iter++;
+            if (maybeErase->second.nTimeExpire <= nNow) {
+                nErased += EraseTxLocked(maybeErase->first);
+            } else {
+                nMinExpTime =
+                    std::min(maybeErase->second.nTimeExpire, nMinExpTime);
+            }
+        }
+        // Sweep again 5 minutes after the next entry that expires in order to
+        // batch the linear scan.
+        nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
+        if (nErased > 0) {
+            LogPrint("mempool", "Erased %d orphan tx due to expiration\n",
+                     nErased);
+        }
+    }
+    FastRandomContext rng;
+    while (mapOrphans.size() > nMaxOrphans || nTotalBytes > nMaxBytes) {
+        // Evict a random orphan:
+        EraseTxLocked(vOrphanList[rng.randrange(vOrphanList.size())]->first);
+        ++nEvicted;
+    }
+    return nEvicted;
+}
+
+void CTxOrphanage::AddChildrenToWorkSet(const CTransaction &tx, NodeId peer) {
+    LOCK(cs);
+    const uint256 &txid = tx.GetId();
+    for (size_t i = 0; i < tx.vout.size(); i++) {
+        auto itByPrev =
+            mapOrphansByPrev.find(COutPoint(txid, i, tx.vout[i].nValue));
+        if (itByPrev == mapOrphansByPrev.end()) {
+            continue;
+        }
+        std::set<uint256> &setWork = mapWorkSet[peer];
+        for (const Iter &mi : itByPrev->second) {
+            setWork.insert(mi->first);
+        }
+    }
+}
+
+bool CTxOrphanage::HaveTxToReconsider(NodeId peer) const {
+    LOCK(cs);
+    return mapWorkSet.count(peer) > 0;
+}
+
+std::vector<CTxOrphanage::Orphan>
+CTxOrphanage::GetTxToReconsider(NodeId peer, size_t nMax) {
+    LOCK(cs);
+    std::vector<Orphan> vOrphans;
+    auto itWork = mapWorkSet.find(peer);
+    if (itWork == mapWorkSet.end()) {
+        return vOrphans;
+    }
+    std::set<uint256> &setWork = itWork->second;
+    while (!setWork.empty() && vOrphans.size() < nMax) {
+        // Orphans may have been erased since they were added to the set.
+        auto it = mapOrphans.find(*setWork.begin());
+        setWork.erase(setWork.begin());
+        if (it != mapOrphans.end()) {
+            vOrphans.push_back(Orphan{it->second.tx, it->second.fromPeer});
+        }
+    }
+    if (setWork.empty()) {
+        mapWorkSet.erase(itWork);
+    }
+    return vOrphans;
+}
+
+size_t CTxOrphanage::Size() const {
+    LOCK(cs);
+    return mapOrphans.size();
+}
+
+uint64_t CTxOrphanage::TotalBytes() const {
+    LOCK(cs);
+    return nTotalBytes;
+}
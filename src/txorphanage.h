@@ -0,0 +1,113 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXORPHANAGE_H
+#define BITCOIN_TXORPHANAGE_H
+
+#include "net.h"
+#include "primitives/transaction.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+
+/** Expiration time for orphan transactions in seconds */
+static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+/** Minimum time between orphan transactions expire time checks in seconds */
+static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+
+/**
+ * Transactions received with inputs we don't know yet, waiting for their
+ * parents.
+ *
+ * The pool has its own lock, so that the message handlers don't need cs_main
+ * to look it up. When a parent is accepted, the orphans spending it are put in
+ * the work set of the peer that sent the parent, and resubmitted from there in
+ * batches, rather than all at once while the parent is being processed.
+ *
+ * The pool is bounded by a number of orphans and by their size, content
+ * included. Orphans over the bounds are evicted at random, in constant time.
+ */
+class CTxOrphanage {
+public:
+    struct Orphan {
+        CTransactionRef tx;
+        NodeId fromPeer;
+    };
+
+    CTxOrphanage() : nTotalBytes(0), nNextSweep(0) {}
+
+    /**
+     * Add tx, sent by peer. False if it is already there, or too large to be
+     * kept.
+     */
+    bool AddTx(const CTransactionRef &tx, NodeId peer);
+    bool HaveTx(const uint256 &txid) const;
+    /** Remove the orphan txid, return how many were removed (0 or 1). */
+    int EraseTx(const uint256 &txid);
+    /** Remove the orphans sent by peer, and its work set. */
+    void EraseForPeer(NodeId peer);
+    /**
+     * Remove the orphans spending an input of tx, a transaction just
+     * included in a block: they are either in the block too, or conflict
+     * with it.
+     */
+    void EraseForBlockTx(const CTransaction &tx);
+
+    /**
+     * Remove expired orphans, then evict random ones until there are at most
+     * nMaxOrphans, taking at most nMaxBytes. Return how many were evicted.
+     */
+    unsigned int Limit(unsigned int nMaxOrphans, uint64_t nMaxBytes);
+
+    /**
+     * tx was accepted: add the orphans spending its outputs to the work set
+     * of peer, which sent it.
+     */
+    void AddChildrenToWorkSet(const CTransaction &tx, NodeId peer);
+    bool HaveTxToReconsider(NodeId peer) const;
+    /**
+     * Take up to nMax orphans out of the work set of peer. They stay in the
+     * pool until the caller erases them.
+     */
+    std::vector<Orphan> GetTxToReconsider(NodeId peer, size_t nMax);
+
+    size_t Size() const;
+    /** Serialized size of the orphans, content included */
+    uint64_t TotalBytes() const;
+
+private:
+    struct Entry {
+        CTransactionRef tx;
+        NodeId fromPeer;
+        int64_t nTimeExpire;
+        uint32_t nSize;
+        //! Position in vOrphanList
+        size_t nListPos;
+    };
+    typedef std::map<uint256, Entry>::iterator Iter;
+
+    struct IterComparator {
+        bool operator()(const Iter &a, const Iter &b) const {
+            return &(*a) < &(*b);
+        }
+    };
+
+    // Requires cs.
+    int EraseTxLocked(const uint256 &txid);
+
+    mutable CCriticalSection cs;
+    std::map<uint256, Entry> mapOrphans;
+    std::map<COutPoint, std::set<Iter, IterComparator>> mapOrphansByPrev;
+    //! Every orphan, in no order, to pick one at random
+    std::vector<Iter> vOrphanList;
+    std::map<NodeId, std::set<uint256>> mapWorkSet;
+    uint64_t nTotalBytes;
+    int64_t nNextSweep;
+};
+
+#endif // BITCOIN_TXORPHANAGE_H
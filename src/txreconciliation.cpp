@@ -0,0 +1,126 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txreconciliation.h"
+
+#include "hash.h"
+
+#include <algorithm>
+
+uint256 ComputeReconSalt(uint64_t nSalt1, uint64_t nSalt2) {
+    CHashWriter hasher(SER_GETHASH, 0);
+    hasher << std::string("Tx Relay Salting") << std::min(nSalt1, nSalt2)
+           << std::max(nSalt1, nSalt2);
+    return hasher.GetHash();
+}
+
+uint32_t GetReconShortId(const uint256 &salt, const uint256 &txid) {
+    return SipHashUint256(salt.GetUint64(0), salt.GetUint64(1), txid);
+}
+
+size_t GetReconSketchCells(size_t nOurs, size_t nTheirs) {
+    size_t nDiff = std::max(nOurs, nTheirs) - std::min(nOurs, nTheirs) +
+                   std::min(nOurs, nTheirs) / 4 + 1;
+    // Three subtables peel reliably at about 1.5 cells per difference, the
+    // constant covers the odd failures of very small sketches.
+    size_t nCells = nDiff * 3 / 2 + 6;
+    return std::min(nCells, MAX_RECON_SKETCH_CELLS);
+}
+
+// splitmix64 finalizer; the ids are already salted hashes, so this only needs
+// to spread them differently for each subtable.
+static uint64_t Mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+CReconSketch::CReconSketch(size_t nCells)
+    : vCells((std::max<size_t>(nCells, 3) + 2) / 3 * 3) {}
+
+size_t CReconSketch::GetCell(uint32_t nShortId, size_t nTable) const {
+    const size_t nTableSize = vCells.size() / 3;
+    return nTable * nTableSize +
+           Mix(uint64_t(nShortId) | (uint64_t(nTable) << 32)) % nTableSize;
+}
+
+uint32_t CReconSketch::CheckSum(uint32_t nShortId) {
+    return Mix(uint64_t(nShortId) | (uint64_t(3) << 32));
+}
+
+void CReconSketch::Update(uint32_t nShortId, int32_t nDelta) {
+    const uint32_t nCheckSum = CheckSum(nShortId);
+    for (size_t nTable = 0; nTable < 3; nTable++) {
+        Cell &cell = vCells[GetCell(nShortId, nTable)];
+        cell.nCount += nDelta;
+        cell.nKeySum ^= nShortId;
+        cell.nCheckSum ^= nCheckSum;
+    }
+}
+
+bool CReconSketch::Subtract(const CReconSketch &other) {
+    if (other.vCells.size() != vCells.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < vCells.size(); i++) {
+        vCells[i].nCount -= other.vCells[i].nCount;
+        vCells[i].nKeySum ^= other.vCells[i].nKeySum;
+        vCells[i].nCheckSum ^= other.vCells[i].nCheckSum;
+    }
+    return true;
+}
+
+bool CReconSketch::IsPure(size_t nCell) const {
+    const Cell &cell = vCells[nCell];
+    return (cell.nCount == 1 || cell.nCount == -1) &&
+           cell.nCheckSum == CheckSum(cell.nKeySum);
+}
+
+bool CReconSketch::Decode(std::vector<uint32_t> &vOurs,
+                          std::vector<uint32_t> &vTheirs) const {
+    if (!IsWellFormed()) {
+        return false;
+    }
+
+    CReconSketch sketch(*this);
+    std::vector<size_t> vPure;
+    for (size_t i = 0; i < sketch.vCells.size(); i++) {
+        if (sketch.IsPure(i)) {
+            vPure.push_back(i);
+        }
+    }
+
+    // Peel the ids off one pure cell at a time, which may leave others pure.
+    while (!vPure.empty()) {
+        size_t nCell = vPure.back();
+        vPure.pop_back();
+        if (!sketch.IsPure(nCell)) {
+            continue;
+        }
+
+        // A difference this size can't have been decoded anyway, and a
+        // crafted sketch could otherwise keep us peeling.
+        if (vOurs.size() + vTheirs.size() >= sketch.vCells.size()) {
+            return false;
+        }
+
+        const uint32_t nShortId = sketch.vCells[nCell].nKeySum;
+        const int32_t nCount = sketch.vCells[nCell].nCount;
+        (nCount > 0 ? vOurs : vTheirs).push_back(nShortId);
+        sketch.Update(nShortId, -nCount);
+        for (size_t nTable = 0; nTable < 3; nTable++) {
+            size_t nOther = sketch.GetCell(nShortId, nTable);
+            if (sketch.IsPure(nOther)) {
+                vPure.push_back(nOther);
+            }
+        }
+    }
+
+    for (const Cell &cell : sketch.vCells) {
+        if (!cell.IsEmpty()) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,115 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXRECONCILIATION_H
+#define BITCOIN_TXRECONCILIATION_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <cstdint>
+#include <vector>
+
+/** Default for -txreconciliation */
+static const bool DEFAULT_TXRECONCILIATION = false;
+/** Version of the reconciliation protocol announced in sendrecon */
+static const uint32_t TXRECONCILIATION_VERSION = 1;
+/** Outbound reconciling peers that still get transactions flooded to them, so
+ * they keep propagating quickly. */
+static const int RECON_FLOOD_OUTBOUND_PEERS = 2;
+/** Seconds between reconciliations we start with each outbound peer */
+static const int64_t RECON_REQUEST_INTERVAL = 4;
+/** Transactions kept for reconciliation with one peer; past this they are
+ * announced with a plain inv. */
+static const size_t MAX_RECON_SET_SIZE = 3000;
+/** Largest sketch we send or accept, in cells */
+static const size_t MAX_RECON_SKETCH_CELLS = 3 * MAX_RECON_SET_SIZE;
+
+/**
+ * Salt for the short ids of a reconciling pair of peers, from the salts each
+ * side sent in sendrecon. It doesn't depend on which side is which.
+ */
+uint256 ComputeReconSalt(uint64_t nSalt1, uint64_t nSalt2);
+/** The 32-bit id a transaction goes by in the pair's sketches */
+uint32_t GetReconShortId(const uint256 &salt, const uint256 &txid);
+/**
+ * Sketch size, in cells, that should decode the difference between two sets
+ * of the given sizes. The difference is estimated as the size difference
+ * plus a quarter of the smaller set.
+ */
+size_t GetReconSketchCells(size_t nOurs, size_t nTheirs);
+
+/**
+ * Invertible Bloom lookup table over 32-bit short ids.
+ *
+ * Each id is added to one cell in each of three equal subtables. Subtracting
+ * the sketch of another set leaves only the ids in one set and not the other,
+ * which can be read back as long as there are not many more of them than
+ * about two thirds of the cells.
+ */
+class CReconSketch {
+public:
+    struct Cell {
+        int32_t nCount;
+        uint32_t nKeySum;
+        uint32_t nCheckSum;
+
+        Cell() : nCount(0), nKeySum(0), nCheckSum(0) {}
+
+        bool IsEmpty() const {
+            return nCount == 0 && nKeySum == 0 && nCheckSum == 0;
+        }
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream &s, Operation ser_action) {
+            READWRITE(nCount);
+            READWRITE(nKeySum);
+            READWRITE(nCheckSum);
+        }
+    };
+
+    CReconSketch() {}
+    /** nCells is rounded up to a multiple of three. */
+    explicit CReconSketch(size_t nCells);
+
+    void Insert(uint32_t nShortId) { Update(nShortId, 1); }
+    void Erase(uint32_t nShortId) { Update(nShortId, -1); }
+
+    /** Subtract another sketch of the same size. Returns false otherwise. */
+    bool Subtract(const CReconSketch &other);
+
+    /**
+     * Read back the ids inserted here but not in the subtracted sketch
+     * (vOurs), and the other way around (vTheirs). Returns false if the
+     * difference is too big for the sketch, in which case the outputs are
+     * incomplete.
+     */
+    bool Decode(std::vector<uint32_t> &vOurs,
+                std::vector<uint32_t> &vTheirs) const;
+
+    size_t GetCells() const { return vCells.size(); }
+    /** Whether the size is one we built and can combine with. */
+    bool IsWellFormed() const {
+        return !vCells.empty() && vCells.size() % 3 == 0;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(vCells);
+    }
+
+private:
+    void Update(uint32_t nShortId, int32_t nDelta);
+    size_t GetCell(uint32_t nShortId, size_t nTable) const;
+    static uint32_t CheckSum(uint32_t nShortId);
+    bool IsPure(size_t nCell) const;
+
+    std::vector<Cell> vCells;
+};
+
+#endif // BITCOIN_TXRECONCILIATION_H
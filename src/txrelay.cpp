@@ -0,0 +1,99 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txrelay.h"
+
+#include <algorithm>
+
+CTxRelay::CTxRelay(int64_t nWindowIn, size_t nMaxEntriesIn)
+    : nWindow(nWindowIn), nMaxEntries(std::max<size_t>(nMaxEntriesIn, 1)),
+      nFirstSequence(0) {}
+
+int CTxRelay::AddPeer(uint64_t &nCursor) {
+    LOCK(cs);
+    nCursor = nFirstSequence + vEntries.size();
+    auto it = std::find(vSlotUsed.begin(), vSlotUsed.end(), false);
+    if (it != vSlotUsed.end()) {
+        *it = true;
+        return it - vSlotUsed.begin();
+    }
+    vSlotUsed.push_back(true);
+    return vSlotUsed.size() - 1;
+}
+
+void CTxRelay::RemovePeer(int nSlot) {
+    LOCK(cs);
+    vSlotUsed[nSlot] = false;
+    // The next peer in this slot must not inherit what this one knew.
+    const size_t nWord = nSlot / 64;
+    const uint64_t nMask = ~(uint64_t(1) << (nSlot % 64));
+    for (Entry &entry : vEntries) {
+        if (nWord < entry.vKnown.size()) {
+            entry.vKnown[nWord] &= nMask;
+        }
+    }
+}
+
+void CTxRelay::Announce(const uint256 &txid, int64_t nNow) {
+    LOCK(cs);
+    Expire(nNow);
+    if (mapSequence.count(txid)) {
+        return;
+    }
+
+    if (vEntries.size() >= nMaxEntries) {
+        mapSequence.erase(vEntries.front().txid);
+        vEntries.pop_front();
+        nFirstSequence++;
+    }
+    mapSequence.emplace(txid, nFirstSequence + vEntries.size());
+    vEntries.push_back(Entry{txid, nNow, {}});
+}
+
+void CTxRelay::MarkKnown(int nSlot, const uint256 &txid) {
+    LOCK(cs);
+    auto it = mapSequence.find(txid);
+    if (it == mapSequence.end()) {
+        return;
+    }
+
+    Entry &entry = vEntries[it->second - nFirstSequence];
+    const size_t nWord = nSlot / 64;
+    if (entry.vKnown.size() <= nWord) {
+        entry.vKnown.resize(nWord + 1);
+    }
+    entry.vKnown[nWord] |= uint64_t(1) << (nSlot % 64);
+}
+
+void CTxRelay::GetAnnouncements(int nSlot, uint64_t &nCursor,
+                                std::vector<uint256> &vTxid) const {
+    LOCK(cs);
+    // Entries dropped before this peer got to them are missed.
+    size_t i = nCursor > nFirstSequence ? nCursor - nFirstSequence : 0;
+    for (; i < vEntries.size(); i++) {
+        if (!IsKnown(vEntries[i], nSlot)) {
+            vTxid.push_back(vEntries[i].txid);
+        }
+    }
+    nCursor = nFirstSequence + vEntries.size();
+}
+
+size_t CTxRelay::Size() const {
+    LOCK(cs);
+    return vEntries.size();
+}
+
+void CTxRelay::Expire(int64_t nNow) {
+    while (!vEntries.empty() && vEntries.front().nTime < nNow - nWindow) {
+        mapSequence.erase(vEntries.front().txid);
+        vEntries.pop_front();
+        nFirstSequence++;
+    }
+}
+
+bool CTxRelay::IsKnown(const Entry &entry, int nSlot) {
+    const size_t nWord = nSlot / 64;
+    return nWord < entry.vKnown.size() &&
+           (entry.vKnown[nWord] >> (nSlot % 64)) & 1;
+}
@@ -0,0 +1,84 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXRELAY_H
+#define BITCOIN_TXRELAY_H
+
+#include "sync.h"
+#include "txmempool.h"
+#include "uint256.h"
+
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+/** How long, in seconds, a relayed transaction waits for peers to pick it up */
+static const int64_t TX_RELAY_WINDOW = 2 * 60;
+/** Maximum number of transactions waiting to be announced */
+static const size_t MAX_TX_RELAY_ENTRIES = 100000;
+
+/**
+ * Transactions waiting to be announced to peers, shared by all of them.
+ *
+ * Relaying a transaction appends it here once, under a single lock, instead
+ * of queueing it with every peer. Each peer holds a slot and a cursor into the
+ * queue; when its inventory trickle is due it collects everything queued since
+ * its last visit. Which peers already know a transaction, because they sent
+ * or were sent it, is kept next to it as a bitset indexed by slot, so those
+ * peers skip it.
+ *
+ * Entries leave the queue after TX_RELAY_WINDOW seconds, which is far longer
+ * than any peer goes between trickles, or when the queue is full.
+ */
+class CTxRelay {
+public:
+    explicit CTxRelay(int64_t nWindowIn = TX_RELAY_WINDOW,
+                      size_t nMaxEntriesIn = MAX_TX_RELAY_ENTRIES);
+
+    /**
+     * Claim the lowest free slot for a new peer. Its cursor is set so it only
+     * sees transactions queued from now on.
+     */
+    int AddPeer(uint64_t &nCursor);
+    /** Free a slot, forgetting what its peer knew. */
+    void RemovePeer(int nSlot);
+
+    /** Queue txid for announcement to every peer that doesn't know it. */
+    void Announce(const uint256 &txid, int64_t nNow);
+    /** Record that the peer in nSlot knows txid, if it is queued. */
+    void MarkKnown(int nSlot, const uint256 &txid);
+    /**
+     * Append the transactions queued after nCursor that the peer in nSlot
+     * doesn't know to vTxid, and move nCursor past them.
+     */
+    void GetAnnouncements(int nSlot, uint64_t &nCursor,
+                          std::vector<uint256> &vTxid) const;
+
+    size_t Size() const;
+
+private:
+    struct Entry {
+        uint256 txid;
+        int64_t nTime;
+        //! Bit n is set if the peer in slot n knows the transaction.
+        std::vector<uint64_t> vKnown;
+    };
+
+    // Requires cs.
+    void Expire(int64_t nNow);
+    static bool IsKnown(const Entry &entry, int nSlot);
+
+    const int64_t nWindow;
+    const size_t nMaxEntries;
+
+    mutable CCriticalSection cs;
+    //! Queued entries in order; the first has sequence number nFirstSequence.
+    std::deque<Entry> vEntries;
+    uint64_t nFirstSequence;
+    std::unordered_map<uint256, uint64_t, SaltedTxidHasher> mapSequence;
+    std::vector<bool> vSlotUsed;
+};
+
+#endif // BITCOIN_TXRELAY_H
@@ -0,0 +1,144 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txskeleton.h"
+
+#include "consensus/consensus.h"
+#include "hash.h"
+#include "version.h"
+
+#include <algorithm>
+#include <cassert>
+
+static uint256 HashChunk(const std::string &str, size_t nOffset,
+                         size_t nLength) {
+    return Hash(str.begin() + nOffset, str.begin() + nOffset + nLength);
+}
+
+static size_t GetChunkCount(uint32_t nSize) {
+    return (uint64_t(nSize) + TXCONTENT_CHUNK_SIZE - 1) / TXCONTENT_CHUNK_SIZE;
+}
+
+CTxSkeleton::CTxSkeleton(const CTransaction &txIn)
+    : txid(txIn.GetId()), tx(txIn.WithoutContent()) {
+    for (size_t i = 0; i < txIn.vout.size(); i++) {
+        const std::string &strContent = txIn.vout[i].strContent;
+        if (strContent.empty()) {
+            continue;
+        }
+        CTxContentInfo info;
+        info.nOutput = i;
+        info.nSize = strContent.size();
+        for (size_t nOffset = 0; nOffset < strContent.size();
+             nOffset += TXCONTENT_CHUNK_SIZE) {
+            info.vChunkHashes.push_back(HashChunk(
+                strContent, nOffset,
+                std::min<size_t>(TXCONTENT_CHUNK_SIZE,
+                                 strContent.size() - nOffset)));
+        }
+        vContent.push_back(std::move(info));
+    }
+}
+
+bool CTxSkeleton::IsValid() const {
+    if (vContent.empty()) {
+        return false;
+    }
+    for (const CTxOut &out : tx.vout) {
+        if (!out.strContent.empty()) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < vContent.size(); i++) {
+        const CTxContentInfo &info = vContent[i];
+        if (info.nOutput >= tx.vout.size() ||
+            (i > 0 && info.nOutput <= vContent[i - 1].nOutput) ||
+            info.nSize == 0 || info.nSize > MAX_TX_OUT_CONTENT_SIZE ||
+            info.vChunkHashes.size() != GetChunkCount(info.nSize)) {
+            return false;
+        }
+    }
+    // The outputs are bounded by the message size, their content isn't.
+    return GetContentSize() <= MAX_TX_SIZE;
+}
+
+uint64_t CTxSkeleton::GetContentSize() const {
+    uint64_t nSize = 0;
+    for (const CTxContentInfo &info : vContent) {
+        nSize += info.nSize;
+    }
+    return nSize;
+}
+
+CTransactionRef CTxSkeleton::GetTransaction() const {
+    // Each content replaces the one byte an empty string takes.
+    uint64_t nTotalSize =
+        ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    for (const CTxContentInfo &info : vContent) {
+        nTotalSize += GetSizeOfCompactSize(info.nSize) + info.nSize - 1;
+    }
+    // Only the scripts count, which the skeleton has.
+    const uint64_t nSigOpCount = CTransaction(tx).GetSigOpCount();
+    return std::make_shared<const CTransaction>(
+        CTransaction(CMutableTransaction(tx), txid, nTotalSize, nSigOpCount));
+}
+
+bool IsRelayedAsSkeleton(const CTransaction &tx) {
+    uint64_t nContentSize = 0;
+    for (const CTxOut &out : tx.vout) {
+        nContentSize += out.strContent.size();
+    }
+    return nContentSize >= TXSKELETON_MIN_CONTENT;
+}
+
+CPartialContentTx::CPartialContentTx(const CTxSkeleton &skeleton)
+    : txid(skeleton.txid), tx(skeleton.tx) {
+    for (const CTxContentInfo &info : skeleton.vContent) {
+        tx.vout[info.nOutput].strContent.resize(info.nSize);
+        for (size_t i = 0; i < info.vChunkHashes.size(); i++) {
+            const uint32_t nOffset = i * TXCONTENT_CHUNK_SIZE;
+            vChunks.push_back(
+                {info.nOutput, nOffset,
+                 std::min(TXCONTENT_CHUNK_SIZE, info.nSize - nOffset)});
+            vHashes.push_back(info.vChunkHashes[i]);
+        }
+    }
+    vHave.assign(vChunks.size(), false);
+    nMissing = vChunks.size();
+}
+
+int CPartialContentTx::FindChunk(uint32_t nOutput, uint32_t nOffset) const {
+    // The chunks are ordered by output and offset.
+    auto it = std::lower_bound(
+        vChunks.begin(), vChunks.end(), std::make_pair(nOutput, nOffset),
+        [](const Chunk &chunk, const std::pair<uint32_t, uint32_t> &key) {
+            return std::make_pair(chunk.nOutput, chunk.nOffset) < key;
+        });
+    if (it == vChunks.end() || it->nOutput != nOutput ||
+        it->nOffset != nOffset) {
+        return -1;
+    }
+    return it - vChunks.begin();
+}
+
+bool CPartialContentTx::FillChunk(size_t i, const std::string &data) {
+    assert(i < vChunks.size());
+    const Chunk &chunk = vChunks[i];
+    if (data.size() != chunk.nLength ||
+        HashChunk(data, 0, data.size()) != vHashes[i]) {
+        return false;
+    }
+    if (!vHave[i]) {
+        std::copy(data.begin(), data.end(),
+                  tx.vout[chunk.nOutput].strContent.begin() + chunk.nOffset);
+        vHave[i] = true;
+        nMissing--;
+    }
+    return true;
+}
+
+CTransactionRef CPartialContentTx::GetTransaction() const {
+    assert(IsComplete());
+    return MakeTransactionRef(tx);
+}
@@ -0,0 +1,150 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXSKELETON_H
+#define BITCOIN_TXSKELETON_H
+
+#include "primitives/transaction.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** Default for -txskeletonrelay */
+static const bool DEFAULT_TXSKELETONRELAY = false;
+/** Version of the skeleton relay protocol announced in sendtxskel */
+static const uint32_t TXSKELETON_VERSION = 1;
+/** Transactions with less content than this are relayed whole */
+static const uint64_t TXSKELETON_MIN_CONTENT = 16 * 1024;
+/** Bytes of content in a chunk, each chunk is fetched with one getcontent */
+static const uint32_t TXCONTENT_CHUNK_SIZE = 64 * 1024;
+/** Chunks requested from one peer at a time */
+static const int MAX_CONTENT_CHUNKS_IN_FLIGHT = 4;
+/** Transactions whose content is fetched at a time */
+static const size_t MAX_TX_ASSEMBLIES = 64;
+/** Seconds a peer has to deliver a chunk before it is asked of another one */
+static const int64_t TXCONTENT_CHUNK_TIMEOUT = 10;
+/** Seconds the content of a transaction has to arrive in */
+static const int64_t TXASSEMBLY_TIMEOUT = 120;
+
+/** The content of an output a skeleton leaves out */
+struct CTxContentInfo {
+    uint32_t nOutput;
+    uint32_t nSize;
+    //! Hash of each TXCONTENT_CHUNK_SIZE bytes of the content, the last chunk
+    //! being shorter.
+    std::vector<uint256> vChunkHashes;
+
+    CTxContentInfo() : nOutput(0), nSize(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(nOutput);
+        READWRITE(nSize);
+        READWRITE(vChunkHashes);
+    }
+};
+
+/**
+ * A transaction without the content of its outputs, relayed in a "txskel"
+ * message so that the receiver only fetches the content, chunk by chunk and
+ * from any peer that has it, once the transaction passed the checks it can
+ * fail without it. The chunk hashes let each chunk be checked on arrival, the
+ * id only once all of them are there.
+ */
+class CTxSkeleton {
+public:
+    uint256 txid;
+    //! The transaction, its outputs with empty content
+    CMutableTransaction tx;
+    //! The outputs with content, in output order
+    std::vector<CTxContentInfo> vContent;
+
+    CTxSkeleton() {}
+    explicit CTxSkeleton(const CTransaction &txIn);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(tx);
+        READWRITE(vContent);
+    }
+
+    /**
+     * Whether the skeleton describes a transaction that can be put together:
+     * content in increasing existing outputs, none of it in tx, a hash per
+     * chunk and no more than MAX_TX_SIZE in all.
+     */
+    bool IsValid() const;
+
+    /** Bytes of content the skeleton leaves out */
+    uint64_t GetContentSize() const;
+
+    /**
+     * The transaction without content, with the id and the size with content
+     * the skeleton claims, for the checks that don't need the content. Like
+     * CTransaction::WithoutContent it must not be relayed or accepted. Only
+     * for skeletons that are IsValid.
+     */
+    CTransactionRef GetTransaction() const;
+};
+
+/**
+ * Whether tx has enough content, TXSKELETON_MIN_CONTENT, to be relayed as a
+ * skeleton to the peers that take them.
+ */
+bool IsRelayedAsSkeleton(const CTransaction &tx);
+
+/**
+ * The content of a transaction being fetched after its skeleton: the chunks
+ * of the skeleton, in order, and which of them arrived.
+ */
+class CPartialContentTx {
+public:
+    struct Chunk {
+        uint32_t nOutput;
+        uint32_t nOffset;
+        uint32_t nLength;
+    };
+
+    /** skeleton must be IsValid */
+    explicit CPartialContentTx(const CTxSkeleton &skeleton);
+
+    const uint256 &GetId() const { return txid; }
+    size_t GetChunkCount() const { return vChunks.size(); }
+    const Chunk &GetChunk(size_t i) const { return vChunks[i]; }
+    bool HaveChunk(size_t i) const { return vHave[i]; }
+    bool IsComplete() const { return nMissing == 0; }
+
+    /** The index of the chunk at nOffset of output nOutput, -1 if none */
+    int FindChunk(uint32_t nOutput, uint32_t nOffset) const;
+
+    /**
+     * Store data as chunk i. Returns false, storing nothing, if data isn't
+     * what the skeleton's hash says.
+     */
+    bool FillChunk(size_t i, const std::string &data);
+
+    /**
+     * The transaction, once IsComplete. Its id is the one the skeleton
+     * claimed only if the skeleton was honest, callers must compare them.
+     */
+    CTransactionRef GetTransaction() const;
+
+private:
+    uint256 txid;
+    CMutableTransaction tx;
+    std::vector<Chunk> vChunks;
+    std::vector<uint256> vHashes;
+    std::vector<bool> vHave;
+    size_t nMissing;
+};
+
+#endif // BITCOIN_TXSKELETON_H
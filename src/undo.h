@@ -25,6 +25,14 @@ class CValidationState;
  * or not, height). The serialization contains a dummy value of zero. This is be
  * compatible with older versions which expect to see the transaction version
  * there.
+ *
+ * The content of the output is not part of it, coins don't keep it, so the
+ * record of a content output is as small as any other. Disconnecting a block
+ * restores the coin without it and compares the outputs of the block to its
+ * coins with CTxOut::EqualsWithoutContent(). Those that need the content read
+ * it from the transaction that created the output with GetCoinContent().
+ * Records written when coins still kept it are read fine, the content is
+ * dropped.
  */
 class TxInUndoSerializer {
     const Coin *pcoin;
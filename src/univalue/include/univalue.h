@@ -44,11 +44,18 @@ public:
     UniValue(const std::string& val_) {
         setStr(val_);
     }
+    UniValue(std::string&& val_) {
+        setStr(std::move(val_));
+    }
     UniValue(const char *val_) {
         std::string s(val_);
-        setStr(s);
+        setStr(std::move(s));
     }
-    ~UniValue() {}
+    // Moving a value moves its children instead of copying them.
+    UniValue(const UniValue&) = default;
+    UniValue(UniValue&&) = default;
+    UniValue& operator=(const UniValue&) = default;
+    UniValue& operator=(UniValue&&) = default;
 
     void clear();
 
@@ -60,6 +67,7 @@ public:
     bool setInt(int val_) { return setInt((int64_t)val_); }
     bool setFloat(double val);
     bool setStr(const std::string& val);
+    bool setStr(std::string&& val);
     bool setArray();
     bool setObject();
 
@@ -68,6 +76,8 @@ public:
     bool empty() const { return (values.size() == 0); }
 
     size_t size() const { return values.size(); }
+    // Make room for n children of an array or object.
+    void reserve(size_t n);
 
     bool getBool() const { return isTrue(); }
     void getObjMap(std::map<std::string,UniValue>& kv) const;
@@ -86,6 +96,7 @@ public:
     bool isObject() const { return (typ == VOBJ); }
 
     bool push_back(const UniValue& val);
+    bool push_back(UniValue&& val);
     bool push_back(const std::string& val_) {
         UniValue tmpVal(VSTR, val_);
         return push_back(tmpVal);
@@ -113,7 +124,9 @@ public:
     bool push_backV(const std::vector<UniValue>& vec);
 
     void __pushKV(const std::string& key, const UniValue& val);
+    void __pushKV(std::string&& key, UniValue&& val);
     bool pushKV(const std::string& key, const UniValue& val);
+    bool pushKV(const std::string& key, UniValue&& val);
     bool pushKV(const std::string& key, const std::string& val_) {
         UniValue tmpVal(VSTR, val_);
         return pushKV(key, tmpVal);
@@ -139,6 +152,9 @@ public:
         return pushKV(key, tmpVal);
     }
     bool pushKVs(const UniValue& obj);
+    // Append a key the object doesn't have yet. Unlike pushKV this doesn't
+    // look for the key first, which takes as long as the object is big.
+    bool pushKVEnd(std::string key, UniValue val);
 
     std::string write(unsigned int prettyIndent = 0,
                       unsigned int indentLevel = 0) const;
@@ -156,6 +172,7 @@ private:
     std::vector<UniValue> values;
 
     bool findKey(const std::string& key, size_t& retIdx) const;
+    void writeTo(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
     void writeArray(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
     void writeObject(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
 
@@ -174,7 +191,14 @@ public:
 
     enum VType type() const { return getType(); }
     bool push_back(std::pair<std::string,UniValue> pear) {
-        return pushKV(pear.first, pear.second);
+        if (typ != VOBJ)
+            return false;
+        size_t idx;
+        if (findKey(pear.first, idx))
+            values[idx] = std::move(pear.second);
+        else
+            __pushKV(std::move(pear.first), std::move(pear.second));
+        return true;
     }
     friend const UniValue& find_value( const UniValue& obj, const std::string& name);
 };
@@ -185,62 +209,57 @@ public:
 //
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, const char *cVal)
 {
-    std::string key(cKey);
-    UniValue uVal(cVal);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::string(cKey), UniValue(cVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, std::string strVal)
 {
-    std::string key(cKey);
-    UniValue uVal(strVal);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::string(cKey), UniValue(std::move(strVal)));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, uint64_t u64Val)
 {
-    std::string key(cKey);
-    UniValue uVal(u64Val);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::string(cKey), UniValue(u64Val));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, int64_t i64Val)
 {
-    std::string key(cKey);
-    UniValue uVal(i64Val);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::string(cKey), UniValue(i64Val));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, bool iVal)
 {
-    std::string key(cKey);
-    UniValue uVal(iVal);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::string(cKey), UniValue(iVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, int iVal)
 {
-    std::string key(cKey);
-    UniValue uVal(iVal);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::string(cKey), UniValue(iVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, double dVal)
 {
-    std::string key(cKey);
-    UniValue uVal(dVal);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::string(cKey), UniValue(dVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(const char *cKey, const UniValue& uVal)
 {
-    std::string key(cKey);
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::string(cKey), uVal);
+}
+
+static inline std::pair<std::string,UniValue> Pair(const char *cKey, UniValue&& uVal)
+{
+    return std::make_pair(std::string(cKey), std::move(uVal));
 }
 
 static inline std::pair<std::string,UniValue> Pair(std::string key, const UniValue& uVal)
 {
-    return std::make_pair(key, uVal);
+    return std::make_pair(std::move(key), uVal);
+}
+
+static inline std::pair<std::string,UniValue> Pair(std::string key, UniValue&& uVal)
+{
+    return std::make_pair(std::move(key), std::move(uVal));
 }
 
 enum jtokentype {
@@ -54,22 +54,39 @@ bool UniValue::setNumStr(const std::string& val_)
     return true;
 }
 
-bool UniValue::setInt(uint64_t val_)
+// Integers are formatted by hand, they are always valid numbers and don't need
+// to go through a stream and the tokenizer.
+static void formatInt(uint64_t val_, bool negative, std::string& out)
 {
-    std::ostringstream oss;
-
-    oss << val_;
+    char buf[21];
+    char *p = buf + sizeof(buf);
+    do {
+        *--p = '0' + val_ % 10;
+        val_ /= 10;
+    } while (val_);
+    if (negative)
+        *--p = '-';
+    out.assign(p, buf + sizeof(buf));
+}
 
-    return setNumStr(oss.str());
+bool UniValue::setInt(uint64_t val_)
+{
+    clear();
+    typ = VNUM;
+    formatInt(val_, false, val);
+    return true;
 }
 
 bool UniValue::setInt(int64_t val_)
 {
-    std::ostringstream oss;
-
-    oss << val_;
-
-    return setNumStr(oss.str());
+    clear();
+    typ = VNUM;
+    // Negated as unsigned, INT64_MIN has no positive counterpart.
+    if (val_ < 0)
+        formatInt(-(uint64_t)val_, true, val);
+    else
+        formatInt(val_, false, val);
+    return true;
 }
 
 bool UniValue::setFloat(double val_)
@@ -91,6 +108,14 @@ bool UniValue::setStr(const std::string& val_)
     return true;
 }
 
+bool UniValue::setStr(std::string&& val_)
+{
+    clear();
+    typ = VSTR;
+    val = std::move(val_);
+    return true;
+}
+
 bool UniValue::setArray()
 {
     clear();
@@ -105,6 +130,13 @@ bool UniValue::setObject()
     return true;
 }
 
+void UniValue::reserve(size_t n)
+{
+    if (typ == VOBJ)
+        keys.reserve(n);
+    values.reserve(n);
+}
+
 bool UniValue::push_back(const UniValue& val_)
 {
     if (typ != VARR)
@@ -114,6 +146,15 @@ bool UniValue::push_back(const UniValue& val_)
     return true;
 }
 
+bool UniValue::push_back(UniValue&& val_)
+{
+    if (typ != VARR)
+        return false;
+
+    values.push_back(std::move(val_));
+    return true;
+}
+
 bool UniValue::push_backV(const std::vector<UniValue>& vec)
 {
     if (typ != VARR)
@@ -130,6 +171,12 @@ void UniValue::__pushKV(const std::string& key, const UniValue& val_)
     values.push_back(val_);
 }
 
+void UniValue::__pushKV(std::string&& key, UniValue&& val_)
+{
+    keys.push_back(std::move(key));
+    values.push_back(std::move(val_));
+}
+
 bool UniValue::pushKV(const std::string& key, const UniValue& val_)
 {
     if (typ != VOBJ)
@@ -143,6 +190,28 @@ bool UniValue::pushKV(const std::string& key, const UniValue& val_)
     return true;
 }
 
+bool UniValue::pushKV(const std::string& key, UniValue&& val_)
+{
+    if (typ != VOBJ)
+        return false;
+
+    size_t idx;
+    if (findKey(key, idx))
+        values[idx] = std::move(val_);
+    else
+        __pushKV(std::string(key), std::move(val_));
+    return true;
+}
+
+bool UniValue::pushKVEnd(std::string key, UniValue val_)
+{
+    if (typ != VOBJ)
+        return false;
+
+    __pushKV(std::move(key), std::move(val_));
+    return true;
+}
+
 bool UniValue::pushKVs(const UniValue& obj)
 {
     if (typ != VOBJ || obj.typ != VOBJ)
@@ -380,6 +380,40 @@ BOOST_AUTO_TEST_CASE(univalue_readwrite)
     BOOST_CHECK(!v.read("{} 42"));
 }
 
+BOOST_AUTO_TEST_CASE(univalue_move)
+{
+    UniValue inner(UniValue::VARR);
+    inner.reserve(3);
+    BOOST_CHECK(inner.push_back(UniValue("x")));
+    BOOST_CHECK(inner.push_back(UniValue((int64_t)-9223372036854775807LL - 1)));
+    BOOST_CHECK(inner.push_back(UniValue((uint64_t)18446744073709551615ULL)));
+    BOOST_CHECK_EQUAL(inner[1].getValStr(), "-9223372036854775808");
+    BOOST_CHECK_EQUAL(inner[2].getValStr(), "18446744073709551615");
+    BOOST_CHECK_EQUAL(UniValue(0).getValStr(), "0");
+
+    UniValue obj(UniValue::VOBJ);
+    obj.reserve(4);
+    BOOST_CHECK(obj.pushKV("a", std::move(inner)));
+    BOOST_CHECK(obj.push_back(Pair("b", UniValue(UniValue::VOBJ))));
+    BOOST_CHECK(obj.pushKVEnd("c", "text\n"));
+    BOOST_CHECK_EQUAL(obj.size(), 3);
+    BOOST_CHECK_EQUAL(obj["a"].size(), 3);
+
+    // pushKV replaces, pushKVEnd takes the caller's word for it.
+    BOOST_CHECK(obj.pushKV("c", 1));
+    BOOST_CHECK_EQUAL(obj.size(), 3);
+    BOOST_CHECK_EQUAL(obj["c"].getValStr(), "1");
+    BOOST_CHECK(!inner.pushKVEnd("d", 1));
+
+    UniValue moved(std::move(obj));
+    BOOST_CHECK_EQUAL(moved.write(),
+                      "{\"a\":[\"x\",-9223372036854775808,18446744073709551615],"
+                      "\"b\":{},\"c\":1}");
+    UniValue copied(moved);
+    BOOST_CHECK_EQUAL(copied.write(1), moved.write(1));
+    BOOST_CHECK_EQUAL(UniValue("\"q\"\t").write(), "\"\\\"q\\\"\\t\"");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 int main (int argc, char *argv[])
@@ -390,6 +424,7 @@ int main (int argc, char *argv[])
     univalue_array();
     univalue_object();
     univalue_readwrite();
+    univalue_move();
     return 0;
 }
 
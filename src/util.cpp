@@ -36,8 +36,11 @@
 #endif // __linux__
 
 #include <algorithm>
+#include <condition_variable>
 #include <fcntl.h>
+#include <mutex>
 #include <sys/resource.h>
+#include <thread>
 #include <sys/stat.h>
 
 #else
@@ -180,6 +183,42 @@ static FILE *fileout = nullptr;
 static boost::mutex *mutexDebugLog = nullptr;
 static std::list<std::string> *vMsgsBeforeOpenLog;
 
+/** The messages of a category in the current second, for -lograte */
+struct LogRateWindow {
+    int64_t nSecond;
+    int64_t nMessages;
+    uint64_t nSuppressed;
+};
+static std::atomic<int64_t> nLogRateLimit(DEFAULT_LOGRATE);
+static std::mutex *mutexLogRate = nullptr;
+static std::map<std::string, LogRateWindow> *mapLogRate = nullptr;
+
+/**
+ * Messages waiting for the log thread, each with the time it was logged at.
+ * The strings of the ring keep their buffers, so that queuing a message
+ * doesn't allocate once the ring has been around.
+ */
+struct LogQueue {
+    std::mutex cs;
+    std::condition_variable cond;
+    //! nCount messages from nHead on, wrapping around
+    std::vector<std::pair<int64_t, std::string>> vRing;
+    size_t nHead;
+    size_t nCount;
+    //! Messages dropped since the log thread last went through the ring
+    uint64_t nDropped;
+    bool fStop;
+
+    LogQueue()
+        : vRing(LOG_QUEUE_SIZE), nHead(0), nCount(0), nDropped(0),
+          fStop(false) {}
+};
+//! Leaked too, set while the log thread runs
+static std::atomic<LogQueue *> logQueue(nullptr);
+static std::thread *threadLog = nullptr;
+
+static std::atomic_bool fLogStartedNewLine(true);
+
 static int FileWriteStr(const std::string &str, FILE *fp) {
     return fwrite(str.data(), 1, str.size(), fp);
 }
@@ -188,6 +227,8 @@ static void DebugPrintInit() {
     assert(mutexDebugLog == nullptr);
     mutexDebugLog = new boost::mutex();
     vMsgsBeforeOpenLog = new std::list<std::string>;
+    mutexLogRate = new std::mutex();
+    mapLogRate = new std::map<std::string, LogRateWindow>;
 }
 
 void OpenDebugLog() {
@@ -249,13 +290,13 @@ bool LogAcceptCategory(const char *category) {
  * end in a newline. Initialize it to true, and hold it, in the calling context.
  */
 static std::string LogTimestampStr(const std::string &str,
+                                   int64_t nTimeMicros,
                                    std::atomic_bool *fStartedNewLine) {
     std::string strStamped;
 
     if (!fLogTimestamps) return str;
 
     if (*fStartedNewLine) {
-        int64_t nTimeMicros = GetLogTimeMicros();
         strStamped =
             DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTimeMicros / 1000000);
         if (fLogTimeMicros)
@@ -272,42 +313,171 @@ static std::string LogTimestampStr(const std::string &str,
     return strStamped;
 }
 
+bool LogRateLimited(const char *category) {
+    const int64_t nLimit = nLogRateLimit;
+    if (nLimit <= 0 || category == nullptr) {
+        return false;
+    }
+
+    // Not GetTime(), the windows must go on with a mock time.
+    const int64_t nSecond = GetTimeMillis() / 1000;
+    bool fLimited = false;
+    uint64_t nSuppressed = 0;
+    {
+        boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+        std::lock_guard<std::mutex> lock(*mutexLogRate);
+        LogRateWindow &window = (*mapLogRate)[category];
+        if (window.nSecond != nSecond) {
+            nSuppressed = window.nSuppressed;
+            window = {nSecond, 0, 0};
+        }
+        if (++window.nMessages > nLimit) {
+            window.nSuppressed++;
+            fLimited = true;
+        }
+    }
+    if (nSuppressed > 0) {
+        LogPrintStr(strprintf("Suppressed %u %s messages over -lograte=%d\n",
+                              nSuppressed, category, nLimit));
+    }
+    return fLimited;
+}
+
+void SetLogRateLimit(int64_t nMessages) {
+    nLogRateLimit = std::max<int64_t>(nMessages, 0);
+}
+
+/** Write timestamped messages to debug.log, or keep them until it's open */
+static int WriteDebugLog(const std::string &strTimestamped) {
+    boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+    boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+
+    // Buffer if we haven't opened the log yet.
+    if (fileout == nullptr) {
+        assert(vMsgsBeforeOpenLog);
+        vMsgsBeforeOpenLog->push_back(strTimestamped);
+        return strTimestamped.length();
+    }
+
+    // Reopen the log file, if requested.
+    if (fReopenDebugLog) {
+        fReopenDebugLog = false;
+        boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
+        if (freopen(pathDebug.string().c_str(), "a", fileout) != nullptr) {
+            // unbuffered.
+            setbuf(fileout, nullptr);
+        }
+    }
+
+    return FileWriteStr(strTimestamped, fileout);
+}
+
+static int QueueLogStr(LogQueue &queue, const std::string &str) {
+    const int64_t nTimeMicros = GetLogTimeMicros();
+    {
+        std::lock_guard<std::mutex> lock(queue.cs);
+        if (queue.nCount == queue.vRing.size()) {
+            queue.nDropped++;
+            return 0;
+        }
+        std::pair<int64_t, std::string> &slot =
+            queue.vRing[(queue.nHead + queue.nCount) % queue.vRing.size()];
+        slot.first = nTimeMicros;
+        slot.second.assign(str);
+        queue.nCount++;
+    }
+    queue.cond.notify_one();
+    return str.length();
+}
+
 int LogPrintStr(const std::string &str) {
     // Returns total number of characters written.
     int ret = 0;
-    static std::atomic_bool fStartedNewLine(true);
-
-    std::string strTimestamped = LogTimestampStr(str, &fStartedNewLine);
 
     if (fPrintToConsole) {
         // Print to console.
+        std::string strTimestamped =
+            LogTimestampStr(str, GetLogTimeMicros(), &fLogStartedNewLine);
         ret = fwrite(strTimestamped.data(), 1, strTimestamped.size(), stdout);
         fflush(stdout);
     } else if (fPrintToDebugLog) {
-        boost::call_once(&DebugPrintInit, debugPrintInitFlag);
-        boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
-
-        // Buffer if we haven't opened the log yet.
-        if (fileout == nullptr) {
-            assert(vMsgsBeforeOpenLog);
-            ret = strTimestamped.length();
-            vMsgsBeforeOpenLog->push_back(strTimestamped);
-        } else {
-            // Reopen the log file, if requested.
-            if (fReopenDebugLog) {
-                fReopenDebugLog = false;
-                boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
-                if (freopen(pathDebug.string().c_str(), "a", fileout) !=
-                    nullptr) {
-                    // unbuffered.
-                    setbuf(fileout, nullptr);
-                }
+        LogQueue *queue = logQueue;
+        if (queue != nullptr) {
+            return QueueLogStr(*queue, str);
+        }
+        ret = WriteDebugLog(
+            LogTimestampStr(str, GetLogTimeMicros(), &fLogStartedNewLine));
+    }
+    return ret;
+}
+
+static void ThreadLog(LogQueue *queue) {
+    RenameThread("bitcoin-log");
+    std::vector<std::pair<int64_t, std::string>> vBatch;
+    while (true) {
+        uint64_t nDropped;
+        {
+            std::unique_lock<std::mutex> lock(queue->cs);
+            queue->cond.wait(
+                lock, [queue] { return queue->fStop || queue->nCount > 0; });
+            if (queue->nCount == 0) {
+                // Stopped, and everything is written.
+                return;
             }
+            // Swap the strings so that the ring gets buffers back.
+            vBatch.resize(queue->nCount);
+            for (std::pair<int64_t, std::string> &message : vBatch) {
+                std::pair<int64_t, std::string> &slot =
+                    queue->vRing[queue->nHead];
+                message.first = slot.first;
+                message.second.swap(slot.second);
+                queue->nHead = (queue->nHead + 1) % queue->vRing.size();
+            }
+            queue->nCount = 0;
+            nDropped = queue->nDropped;
+            queue->nDropped = 0;
+        }
 
-            ret = FileWriteStr(strTimestamped, fileout);
+        // One write for the whole batch, debug.log is unbuffered.
+        std::string strBatch;
+        for (const std::pair<int64_t, std::string> &message : vBatch) {
+            strBatch += LogTimestampStr(message.second, message.first,
+                                        &fLogStartedNewLine);
+        }
+        if (nDropped > 0) {
+            strBatch += LogTimestampStr(
+                strprintf("Dropped %u log messages, the log queue was full\n",
+                          nDropped),
+                GetLogTimeMicros(), &fLogStartedNewLine);
         }
+        WriteDebugLog(strBatch);
     }
-    return ret;
+}
+
+void StartLogThread() {
+    if (threadLog != nullptr || fPrintToConsole || !fPrintToDebugLog) {
+        return;
+    }
+    LogQueue *queue = new LogQueue();
+    threadLog = new std::thread(ThreadLog, queue);
+    logQueue = queue;
+}
+
+void StopLogThread() {
+    if (threadLog == nullptr) {
+        return;
+    }
+    // Log on the calling thread again from here on, and let the log thread
+    // write what it has before it exits.
+    LogQueue *queue = logQueue.exchange(nullptr);
+    {
+        std::lock_guard<std::mutex> lock(queue->cs);
+        queue->fStop = true;
+    }
+    queue->cond.notify_one();
+    threadLog->join();
+    delete threadLog;
+    threadLog = nullptr;
 }
 
 /** Interpret string as boolean, for argument parsing */
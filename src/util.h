@@ -32,6 +32,11 @@
 static const bool DEFAULT_LOGTIMEMICROS = false;
 static const bool DEFAULT_LOGIPS = false;
 static const bool DEFAULT_LOGTIMESTAMPS = true;
+static const bool DEFAULT_LOGASYNC = false;
+/** Default for -lograte, 0 for no limit */
+static const int64_t DEFAULT_LOGRATE = 0;
+/** Messages the log thread can be behind by before new ones are dropped */
+static const size_t LOG_QUEUE_SIZE = 16384;
 
 /** Signals for translation. */
 class CTranslationInterface {
@@ -69,12 +74,27 @@ bool SetupNetworking();
 
 /** Return true if log accepts specified category */
 bool LogAcceptCategory(const char *category);
+/**
+ * Return true if category went over its -lograte messages in the current
+ * second, and counts the message as suppressed
+ */
+bool LogRateLimited(const char *category);
+/** Limit each category to nMessages a second, 0 for no limit */
+void SetLogRateLimit(int64_t nMessages);
 /** Send a string to the log output */
 int LogPrintStr(const std::string &str);
+/**
+ * Write debug.log on a thread of its own: LogPrintStr only queues the
+ * messages, they are timestamped and written in batches by the thread. To be
+ * called after OpenDebugLog.
+ */
+void StartLogThread();
+/** Write the queued messages and go back to writing on the calling thread */
+void StopLogThread();
 
 #define LogPrint(category, ...)                                                \
     do {                                                                       \
-        if (LogAcceptCategory((category))) {                                   \
+        if (LogAcceptCategory((category)) && !LogRateLimited((category))) {    \
             LogPrintStr(tfm::format(__VA_ARGS__));                             \
         }                                                                      \
     } while (0)
@@ -7,6 +7,7 @@
 
 #include "tinyformat.h"
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdlib>
 #include <cstring>
@@ -54,17 +55,231 @@ signed char HexDigit(char c) {
     return p_util_hexdigit[(uint8_t)c];
 }
 
+namespace {
+
+const char hexmap[16] = {'0', '1', '2', '3', '4', '5', '6', '7',
+                         '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
+
+void HexEncodeStandard(const uint8_t *pch, size_t len, char *out) {
+    for (size_t i = 0; i < len; i++) {
+        out[2 * i] = hexmap[pch[i] >> 4];
+        out[2 * i + 1] = hexmap[pch[i] & 15];
+    }
+}
+
+size_t HexDecodeStandard(const char *psz, size_t len, uint8_t *out) {
+    size_t i = 0;
+    for (; 2 * i + 2 <= len; i++) {
+        const signed char hi = HexDigit(psz[2 * i]);
+        const signed char lo = HexDigit(psz[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            break;
+        }
+        out[i] = (hi << 4) | lo;
+    }
+    return i;
+}
+
+} // namespace
+
+/*
+ * Like the SHA-256 ones, the vectorized variants are compiled with
+ * per-function target attributes and picked at runtime, so the library still
+ * runs on a baseline CPU.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__))
+#define HEX_X86 1
+#include <immintrin.h>
+
+namespace {
+
+__attribute__((target("ssse3"))) void
+HexEncodeSSSE3(const uint8_t *pch, size_t len, char *out) {
+    const __m128i lut = _mm_loadu_si128((const __m128i *)hexmap);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(pch + i));
+        const __m128i hi = _mm_shuffle_epi8(
+            lut, _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+        const __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, mask));
+        _mm_storeu_si128((__m128i *)(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *)(out + 2 * i + 16),
+                         _mm_unpackhi_epi8(hi, lo));
+    }
+    HexEncodeStandard(pch + i, len - i, out + 2 * i);
+}
+
+__attribute__((target("avx2"))) void HexEncodeAVX2(const uint8_t *pch,
+                                                   size_t len, char *out) {
+    const __m256i lut = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)hexmap));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(pch + i));
+        const __m256i hi = _mm256_shuffle_epi8(
+            lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+        const __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, mask));
+        // The unpacks interleave within each 128 bit lane.
+        const __m256i first = _mm256_unpacklo_epi8(hi, lo);
+        const __m256i second = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256((__m256i *)(out + 2 * i),
+                            _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256((__m256i *)(out + 2 * i + 32),
+                            _mm256_permute2x128_si256(first, second, 0x31));
+    }
+    HexEncodeStandard(pch + i, len - i, out + 2 * i);
+}
+
+/**
+ * The values of 16 hex digits. Returns false if any of the chars isn't one.
+ * Chars from 0x80 up are negative, and in neither range.
+ */
+__attribute__((target("ssse3"))) inline bool
+DecodeDigits16(__m128i v, __m128i &values) {
+    const __m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    const __m128i isDigit =
+        _mm_and_si128(_mm_cmpgt_epi8(digit, _mm_set1_epi8(-1)),
+                      _mm_cmpgt_epi8(_mm_set1_epi8(10), digit));
+    const __m128i letter = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)),
+                                        _mm_set1_epi8('a'));
+    const __m128i isLetter =
+        _mm_and_si128(_mm_cmpgt_epi8(letter, _mm_set1_epi8(-1)),
+                      _mm_cmpgt_epi8(_mm_set1_epi8(6), letter));
+    values = _mm_or_si128(
+        _mm_and_si128(isDigit, digit),
+        _mm_and_si128(isLetter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+    return _mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)) == 0xffff;
+}
+
+__attribute__((target("ssse3"))) size_t
+HexDecodeSSSE3(const char *psz, size_t len, uint8_t *out) {
+    // Each pair of values is multiplied by 16 and 1 and summed into a word.
+    const __m128i weights = _mm_set1_epi16(0x0110);
+    size_t i = 0;
+    for (; 2 * i + 32 <= len; i += 16) {
+        const __m128i *p = (const __m128i *)(psz + 2 * i);
+        __m128i first, second;
+        if (!DecodeDigits16(_mm_loadu_si128(p), first) ||
+            !DecodeDigits16(_mm_loadu_si128(p + 1), second)) {
+            break;
+        }
+        _mm_storeu_si128((__m128i *)(out + i),
+                         _mm_packus_epi16(_mm_maddubs_epi16(first, weights),
+                                          _mm_maddubs_epi16(second, weights)));
+    }
+    return i + HexDecodeStandard(psz + 2 * i, len - 2 * i, out + i);
+}
+
+/** DecodeDigits16 for 32 hex digits */
+__attribute__((target("avx2"))) inline bool
+DecodeDigits32(__m256i v, __m256i &values) {
+    const __m256i digit = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    const __m256i isDigit =
+        _mm256_and_si256(_mm256_cmpgt_epi8(digit, _mm256_set1_epi8(-1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8(10), digit));
+    const __m256i letter = _mm256_sub_epi8(
+        _mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    const __m256i isLetter =
+        _mm256_and_si256(_mm256_cmpgt_epi8(letter, _mm256_set1_epi8(-1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8(6), letter));
+    values = _mm256_or_si256(
+        _mm256_and_si256(isDigit, digit),
+        _mm256_and_si256(isLetter,
+                         _mm256_add_epi8(letter, _mm256_set1_epi8(10))));
+    return _mm256_movemask_epi8(_mm256_or_si256(isDigit, isLetter)) == -1;
+}
+
+__attribute__((target("avx2"))) size_t
+HexDecodeAVX2(const char *psz, size_t len, uint8_t *out) {
+    const __m256i weights = _mm256_set1_epi16(0x0110);
+    size_t i = 0;
+    for (; 2 * i + 64 <= len; i += 32) {
+        const __m256i *p = (const __m256i *)(psz + 2 * i);
+        __m256i first, second;
+        if (!DecodeDigits32(_mm256_loadu_si256(p), first) ||
+            !DecodeDigits32(_mm256_loadu_si256(p + 1), second)) {
+            break;
+        }
+        // The pack works within each 128 bit lane, the permute puts the
+        // quarters back in order.
+        const __m256i packed =
+            _mm256_packus_epi16(_mm256_maddubs_epi16(first, weights),
+                                _mm256_maddubs_epi16(second, weights));
+        _mm256_storeu_si256((__m256i *)(out + i),
+                            _mm256_permute4x64_epi64(packed, 0xd8));
+    }
+    return i + HexDecodeSSSE3(psz + 2 * i, len - 2 * i, out + i);
+}
+
+} // namespace
+#endif // x86
+
+namespace {
+
+/** A hex implementation selectable at runtime. */
+struct HexImplementation {
+    void (*encode)(const uint8_t *pch, size_t len, char *out);
+    size_t (*decode)(const char *psz, size_t len, uint8_t *out);
+};
+
+HexImplementation SelectHexImplementation() {
+#ifdef HEX_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {HexEncodeAVX2, HexDecodeAVX2};
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return {HexEncodeSSSE3, HexDecodeSSSE3};
+    }
+#endif
+    return {HexEncodeStandard, HexDecodeStandard};
+}
+
+const HexImplementation &GetHexImplementation() {
+    static const HexImplementation implementation = SelectHexImplementation();
+    return implementation;
+}
+
+} // namespace
+
+void HexEncode(const uint8_t *pch, size_t len, char *out) {
+    GetHexImplementation().encode(pch, len, out);
+}
+
+size_t HexDecode(const char *psz, size_t len, uint8_t *out) {
+    return GetHexImplementation().decode(psz, len, out);
+}
+
 bool IsHex(const std::string &str) {
-    for (std::string::const_iterator it(str.begin()); it != str.end(); ++it) {
-        if (HexDigit(*it) < 0) return false;
+    if (str.empty() || str.size() % 2 != 0) {
+        return false;
+    }
+    // Decoded into a scratch buffer a chunk at a time, vectorized.
+    uint8_t buf[256];
+    for (size_t nPos = 0; nPos < str.size(); nPos += 2 * sizeof(buf)) {
+        const size_t nChars = std::min(str.size() - nPos, 2 * sizeof(buf));
+        if (HexDecode(str.data() + nPos, nChars, buf) != nChars / 2) {
+            return false;
+        }
     }
-    return (str.size() > 0) && (str.size() % 2 == 0);
+    return true;
 }
 
-std::vector<uint8_t> ParseHex(const char *psz) {
-    // convert hex dump to vector
-    std::vector<uint8_t> vch;
+/** ParseHex of the len chars at psz, followed by a NUL */
+static std::vector<uint8_t> ParseHex(const char *psz, size_t len) {
+    // Sized for the most it can hold and cut to what was decoded.
+    std::vector<uint8_t> vch(len / 2);
+    const char *pend = psz + len;
+    size_t nOut = 0;
     while (true) {
+        // Runs of digits, which are all but whitespace separated dumps, are
+        // decoded at once. The NUL at pend ends the byte at a time part.
+        const size_t nDecoded = HexDecode(psz, pend - psz, vch.data() + nOut);
+        psz += 2 * nDecoded;
+        nOut += nDecoded;
         while (isspace(*psz))
             psz++;
         signed char c = HexDigit(*psz++);
@@ -73,13 +288,18 @@ std::vector<uint8_t> ParseHex(const char *psz) {
         c = HexDigit(*psz++);
         if (c == (signed char)-1) break;
         n |= c;
-        vch.push_back(n);
+        vch[nOut++] = n;
     }
+    vch.resize(nOut);
     return vch;
 }
 
+std::vector<uint8_t> ParseHex(const char *psz) {
+    return ParseHex(psz, strlen(psz));
+}
+
 std::vector<uint8_t> ParseHex(const std::string &str) {
-    return ParseHex(str.c_str());
+    return ParseHex(str.c_str(), str.size());
 }
 
 std::string EncodeBase64(const uint8_t *pch, size_t len) {
@@ -43,6 +43,17 @@ std::vector<uint8_t> ParseHex(const char *psz);
 std::vector<uint8_t> ParseHex(const std::string &str);
 signed char HexDigit(char c);
 bool IsHex(const std::string &str);
+/**
+ * Write the lower case hex of the len bytes at pch to out, which has room for
+ * 2 * len chars. Vectorized with SSSE3 or AVX2 where the CPU has them.
+ */
+void HexEncode(const uint8_t *pch, size_t len, char *out);
+/**
+ * Decode the pairs of hex digits at the start of the len chars at psz into
+ * out, up to the first char that isn't one. Returns the number of bytes
+ * written. Vectorized like HexEncode.
+ */
+size_t HexDecode(const char *psz, size_t len, uint8_t *out);
 std::vector<uint8_t> DecodeBase64(const char *p, bool *pfInvalid = nullptr);
 std::string DecodeBase64(const std::string &str);
 std::string EncodeBase64(const uint8_t *pch, size_t len);
@@ -95,8 +106,58 @@ bool ParseUInt64(const std::string &str, uint64_t *out);
  */
 bool ParseDouble(const std::string &str, double *out);
 
+/** HexEncode for any range of bytes, the contiguous ones vectorized */
+template <typename T> void HexEncodeRange(T itbegin, T itend, char *out) {
+    static const char hexmap[16] = {'0', '1', '2', '3', '4', '5', '6', '7',
+                                    '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
+    for (T it = itbegin; it < itend; ++it) {
+        uint8_t val = uint8_t(*it);
+        *out++ = hexmap[val >> 4];
+        *out++ = hexmap[val & 15];
+    }
+}
+inline void HexEncodeRange(const uint8_t *pbegin, const uint8_t *pend,
+                           char *out) {
+    HexEncode(pbegin, pend - pbegin, out);
+}
+inline void HexEncodeRange(uint8_t *pbegin, uint8_t *pend, char *out) {
+    HexEncode(pbegin, pend - pbegin, out);
+}
+inline void HexEncodeRange(const char *pbegin, const char *pend, char *out) {
+    HexEncode((const uint8_t *)pbegin, pend - pbegin, out);
+}
+inline void HexEncodeRange(char *pbegin, char *pend, char *out) {
+    HexEncode((const uint8_t *)pbegin, pend - pbegin, out);
+}
+inline void HexEncodeRange(std::vector<uint8_t>::const_iterator itbegin,
+                           std::vector<uint8_t>::const_iterator itend,
+                           char *out) {
+    HexEncode(itbegin == itend ? nullptr : &*itbegin, itend - itbegin, out);
+}
+inline void HexEncodeRange(std::vector<uint8_t>::iterator itbegin,
+                           std::vector<uint8_t>::iterator itend, char *out) {
+    HexEncode(itbegin == itend ? nullptr : &*itbegin, itend - itbegin, out);
+}
+inline void HexEncodeRange(std::string::const_iterator itbegin,
+                           std::string::const_iterator itend, char *out) {
+    HexEncode(itbegin == itend ? nullptr : (const uint8_t *)&*itbegin,
+              itend - itbegin, out);
+}
+inline void HexEncodeRange(std::string::iterator itbegin,
+                           std::string::iterator itend, char *out) {
+    HexEncode(itbegin == itend ? nullptr : (const uint8_t *)&*itbegin,
+              itend - itbegin, out);
+}
+
 template <typename T>
 std::string HexStr(const T itbegin, const T itend, bool fSpaces = false) {
+    if (!fSpaces) {
+        // Sized once and written in place.
+        std::string rv((itend - itbegin) * 2, '\0');
+        HexEncodeRange(itbegin, itend, &rv[0]);
+        return rv;
+    }
+
     std::string rv;
     static const char hexmap[16] = {'0', '1', '2', '3', '4', '5', '6', '7',
                                     '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
@@ -0,0 +1,123 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "utxosnapshot.h"
+
+#include "clientversion.h"
+#include "coins.h"
+#include "hash.h"
+#include "streams.h"
+#include "tinyformat.h"
+
+#include <boost/thread/thread.hpp> // boost::this_thread::interruption_point
+
+#include <cstdio>
+#include <vector>
+
+bool WriteUTXOSnapshot(CCoinsViewCursor &cursor, SnapshotMetadata &metadata,
+                       CAutoFile &file, uint256 &hash, std::string &strError) {
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    metadata.nCoins = 0;
+    try {
+        file << metadata;
+        for (; cursor.Valid(); cursor.Next()) {
+            boost::this_thread::interruption_point();
+            COutPoint outpoint;
+            Coin coin;
+            if (!cursor.GetKey(outpoint) || !cursor.GetValue(coin)) {
+                strError = "Unable to read UTXO set";
+                return false;
+            }
+            file << outpoint << coin;
+            hasher << outpoint << coin;
+            metadata.nCoins++;
+        }
+        hasher << metadata;
+        hash = hasher.GetHash();
+        file << hash;
+
+        // The header now has the right coin count.
+        if (fseek(file.Get(), 0, SEEK_SET) != 0) {
+            strError = "Unable to rewind snapshot file";
+            return false;
+        }
+        file << metadata;
+    } catch (const std::ios_base::failure &e) {
+        strError = strprintf("Unable to write snapshot: %s", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool ReadUTXOSnapshotMetadata(CAutoFile &file, SnapshotMetadata &metadata,
+                              std::string &strError) {
+    try {
+        file >> metadata;
+    } catch (const std::ios_base::failure &e) {
+        strError = "Snapshot file is truncated";
+        return false;
+    }
+    if (metadata.nMagic != SNAPSHOT_MAGIC) {
+        strError = "Not a UTXO snapshot";
+        return false;
+    }
+    if (metadata.nVersion != SNAPSHOT_VERSION) {
+        strError = strprintf("Unsupported snapshot version %d",
+                             metadata.nVersion);
+        return false;
+    }
+    return true;
+}
+
+bool LoadUTXOSnapshotCoins(CAutoFile &file, const SnapshotMetadata &metadata,
+                           CCoinsViewCache &view, size_t nCacheBytes,
+                           uint256 &hash, std::string &strError) {
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    try {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        std::vector<uint8_t> vPrevKey;
+        for (uint64_t i = 0; i < metadata.nCoins; i++) {
+            boost::this_thread::interruption_point();
+            COutPoint outpoint;
+            Coin coin;
+            file >> outpoint >> coin;
+            // Strictly increasing keys can't overwrite each other. The order
+            // is the coins database's, which isn't COutPoint's for large n.
+            ssKey.clear();
+            ssKey << outpoint.hash << VARINT(outpoint.n);
+            std::vector<uint8_t> vKey(ssKey.begin(), ssKey.end());
+            if (i > 0 && !(vPrevKey < vKey)) {
+                strError = "Snapshot coins are out of order";
+                return false;
+            }
+            vPrevKey.swap(vKey);
+            if (coin.IsSpent() ||
+                coin.GetHeight() > uint32_t(metadata.nHeight)) {
+                strError = strprintf("Invalid snapshot coin %s",
+                                     outpoint.ToString());
+                return false;
+            }
+            hasher << outpoint << coin;
+            view.AddCoin(outpoint, std::move(coin), false);
+
+            if (view.DynamicMemoryUsage() > nCacheBytes && !view.Flush()) {
+                strError = "Unable to write coins to the chainstate";
+                return false;
+            }
+        }
+        hasher << metadata;
+        hash = hasher.GetHash();
+
+        uint256 hashExpected;
+        file >> hashExpected;
+        if (hash != hashExpected) {
+            strError = "Snapshot hash mismatch";
+            return false;
+        }
+    } catch (const std::ios_base::failure &e) {
+        strError = "Snapshot file is truncated";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTXOSNAPSHOT_H
+#define BITCOIN_UTXOSNAPSHOT_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <cstdint>
+#include <string>
+
+class CAutoFile;
+class CCoinsViewCache;
+class CCoinsViewCursor;
+
+static const uint32_t SNAPSHOT_MAGIC = 0x6f787475; // "utxo" little endian
+static const uint16_t SNAPSHOT_VERSION = 1;
+
+/**
+ * Header of a UTXO set snapshot.
+ *
+ * The file is this header, nCoins (COutPoint, Coin) records in the key order
+ * of the coins database, using the compressed disk serialization of Coin, and
+ * the hash of the records followed by the header. All fields are fixed size so
+ * the coin count can be filled in once the records have been written.
+ */
+class SnapshotMetadata {
+public:
+    uint32_t nMagic;
+    uint16_t nVersion;
+    //! Block the snapshot was taken at, and what the chain looked like there
+    uint256 hashBase;
+    int32_t nHeight;
+    uint64_t nChainTx;
+    uint64_t nChainInterest;
+    uint64_t nCoins;
+
+    SnapshotMetadata()
+        : nMagic(SNAPSHOT_MAGIC), nVersion(SNAPSHOT_VERSION), nHeight(0),
+          nChainTx(0), nChainInterest(0), nCoins(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(nMagic);
+        READWRITE(nVersion);
+        READWRITE(hashBase);
+        READWRITE(nHeight);
+        READWRITE(nChainTx);
+        READWRITE(nChainInterest);
+        READWRITE(nCoins);
+    }
+};
+
+/**
+ * Write a snapshot of the coins behind cursor. metadata.nCoins is set to the
+ * number of coins written, and hash to the commitment in the trailer.
+ */
+bool WriteUTXOSnapshot(CCoinsViewCursor &cursor, SnapshotMetadata &metadata,
+                       CAutoFile &file, uint256 &hash, std::string &strError);
+
+//! Read and check the header of a snapshot.
+bool ReadUTXOSnapshotMetadata(CAutoFile &file, SnapshotMetadata &metadata,
+                              std::string &strError);
+
+/**
+ * Add the coins of a snapshot, whose header has just been read, to view.
+ * The view is flushed whenever it grows over nCacheBytes, so on failure its
+ * backend may hold part of the snapshot.
+ */
+bool LoadUTXOSnapshotCoins(CAutoFile &file, const SnapshotMetadata &metadata,
+                           CCoinsViewCache &view, size_t nCacheBytes,
+                           uint256 &hash, std::string &strError);
+
+#endif // BITCOIN_UTXOSNAPSHOT_H
@@ -7,6 +7,10 @@
 #include "validation.h"
 
 #include "arith_uint256.h"
+#include "blockcompress.h"
+#include "blockpruner.h"
+#include "blockview.h"
+#include "blockfilemap.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
@@ -14,20 +18,26 @@
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
 #include "hash.h"
 #include "init.h"
+#include "metrics.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
 #include "pow.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "random.h"
+#include "replaystats.h"
 #include "script/script.h"
 #include "script/scriptcache.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
+#include "streams.h"
+#include "support/allocators/arena.h"
 #include "timedata.h"
 #include "tinyformat.h"
+#include "trace.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -35,12 +45,21 @@
 #include "util.h"
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
+#include "utxosnapshot.h"
 #include "validationinterface.h"
 #include "versionbits.h"
 #include "warnings.h"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <mutex>
 #include <sstream>
+#include <thread>
+#include <unordered_set>
 
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/replace.hpp>
@@ -54,6 +73,11 @@
 #error "Bitcoin cannot be compiled without assertions."
 #endif
 
+TRACE_SEMAPHORE(validation, block_connect_start);
+TRACE_SEMAPHORE(validation, block_connected);
+TRACE_SEMAPHORE(validation, flush_coins);
+TRACE_SEMAPHORE(mempool, accept);
+
 /**
  * Global state
  */
@@ -61,22 +85,31 @@
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
+/** Storage of every CBlockIndex in mapBlockIndex */
+static CBlockIndexArena blockIndexArena;
+CCriticalSection cs_blockIndexLookup;
 CChain chainActive;
+/** chainActive as readers without cs_main see it, swapped atomically */
+static std::shared_ptr<const CChainSnapshot> chainSnapshot =
+    std::make_shared<const CChainSnapshot>(nullptr);
 CBlockIndex *pindexBestHeader = nullptr;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
 std::atomic_bool fImporting(false);
-bool fReindex = false;
+std::atomic_bool fReindex(false);
 bool fTxIndex = false;
+bool fDepositIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+bool fBlockCompression = DEFAULT_BLOCK_COMPRESSION;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
+int nPruneDepth = MIN_BLOCKS_TO_KEEP;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 
 MineWorker *mineworker = NULL;
@@ -84,11 +117,15 @@ MineWorker *mineworker = NULL;
 uint256 hashAssumeValid;
 
 CFeeRate minRelayTxFee = CFeeRate(DEFAULT_MIN_RELAY_TX_FEE);
+CFeeRate contentMinRelayTxFee = CFeeRate(DEFAULT_CONTENT_MIN_RELAY_TX_FEE);
 CAmount maxTxFee = DEFAULT_TRANSACTION_MAXFEE;
 
 CTxMemPool mempool(::minRelayTxFee);
 
 static void CheckBlockIndex(const Consensus::Params &consensusParams);
+static bool CheckMempoolInputs(const CTransaction &tx, CValidationState &state,
+                               const CCoinsViewCache &view, uint32_t flags,
+                               PrecomputedTransactionData &txdata);
 
 /** Constant stuff for coinbase transactions we create: */
 CScript COINBASE_FLAGS;
@@ -141,6 +178,11 @@ int nLastBlockFile = 0;
  * we're in prune mode.
  */
 bool fCheckForPruning = false;
+/**
+ * Set when pruning waits for the coin database to be written past the blocks
+ * to prune, so that the next flush writes it.
+ */
+static std::atomic<bool> fFlushForPrune(false);
 
 /**
  * Every received block is assigned a unique and increasing identifier, so we
@@ -192,7 +234,7 @@ public:
             &MemPoolConflictRemovalTracker::NotifyEntryRemoved, this, _1, _2));
         for (const auto &tx : conflictedTxs) {
             GetMainSignals().SyncTransaction(
-                *tx, nullptr, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
+                tx, nullptr, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
         }
         conflictedTxs.clear();
     }
@@ -214,7 +256,22 @@ CBlockIndex *FindForkInGlobalIndex(const CChain &chain,
     return chain.Genesis();
 }
 
+const CBlockIndex *FindForkInGlobalIndex(const CChainSnapshot &chain,
+                                         const CBlockLocator &locator) {
+    for (const uint256 &hash : locator.vHave) {
+        const CBlockIndex *pindex = LookupBlockIndex(hash);
+        if (pindex) {
+            if (chain.Contains(pindex)) return pindex;
+            if (pindex->GetAncestor(chain.Height()) == chain.Tip()) {
+                return chain.Tip();
+            }
+        }
+    }
+    return chain[0];
+}
+
 CCoinsViewCache *pcoinsTip = nullptr;
+CCoinsViewAsyncWrite *pcoinsWriter = nullptr;
 CBlockTreeDB *pblocktree = nullptr;
 
 enum FlushStateMode {
@@ -225,8 +282,7 @@ enum FlushStateMode {
 };
 
 // See definition for documentation
-static bool FlushStateToDisk(CValidationState &state, FlushStateMode mode,
-                             int nManualPruneHeight = 0);
+static bool FlushStateToDisk(CValidationState &state, FlushStateMode mode);
 static void FindFilesToPruneManual(std::set<int> &setFilesToPrune,
                                    int nManualPruneHeight);
 static uint32_t GetBlockScriptFlags(const CBlockIndex *pindex,
@@ -241,14 +297,7 @@ static bool IsFinalTx(const CTransaction &tx, int nBlockHeight,
 
 
 uint64_t GetSigOpCountWithoutP2SH(const CTransaction &tx) {
-    uint64_t nSigOps = 0;
-    for (const auto &txin : tx.vin) {
-        nSigOps += txin.scriptSig.GetSigOpCount(false);
-    }
-    for (const auto &txout : tx.vout) {
-        nSigOps += txout.scriptPubKey.GetSigOpCount(false);
-    }
-    return nSigOps;
+    return tx.GetSigOpCount();
 }
 
 uint64_t GetP2SHSigOpCount(const CTransaction &tx,
@@ -294,7 +343,7 @@ static bool CheckTransactionCommon(const CTransaction &tx,
     }
 
     // Size limit
-    if (::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION) > MAX_TX_SIZE) {
+    if (tx.GetTotalSize() > MAX_TX_SIZE) {
         return state.DoS(100, false, REJECT_INVALID, "bad-txns-oversize");
     }
 
@@ -360,22 +409,163 @@ bool CheckCoinbase(const CTransaction &tx, CValidationState &state,
     return true;
 }
 
+/**
+ * Interest decay period of the last block looked up, nearly always the tip.
+ * Reset whenever the tip changes.
+ */
+static CCriticalSection cs_interestPeriod;
+static const CBlockIndex *pindexInterestPeriod = nullptr;
+static const CInterestTable *ptableInterestPeriod = nullptr;
+static size_t nInterestPeriod = 0;
+
+static void ResetInterestPeriodCache() {
+    LOCK(cs_interestPeriod);
+    pindexInterestPeriod = nullptr;
+}
+
+/**
+ * Interest history of chainActive, following its tip. Built from scratch for
+ * a new interest table, as switching networks in the tests gives.
+ */
+static CCriticalSection cs_interestHistory;
+static std::unique_ptr<CInterestHistory> pinterestHistory;
+
+static void UpdateInterestHistory() {
+    AssertLockHeld(cs_main);
+    const CChainParams &params = Params();
+    LOCK(cs_interestHistory);
+    if (!pinterestHistory ||
+        &pinterestHistory->GetTable() != &params.InterestTable()) {
+        pinterestHistory.reset(new CInterestHistory(params.InterestTable(),
+                                                    params.TotalInterest()));
+    }
+    // The tip moves a block at a time, except when it is first loaded, so
+    // what is left below it after the truncation is on the chain.
+    pinterestHistory->Truncate(chainActive.Height());
+    for (int nHeight = pinterestHistory->Height() + 1;
+         nHeight <= chainActive.Height(); nHeight++) {
+        pinterestHistory->Append(chainActive[nHeight]->nChainInterest);
+    }
+}
+
+static void ResetInterestHistory() {
+    LOCK(cs_interestHistory);
+    pinterestHistory.reset();
+}
+
+bool GetChainInterestAt(int nHeight, uint64_t &nChainInterest) {
+    LOCK(cs_interestHistory);
+    return pinterestHistory &&
+           pinterestHistory->GetChainInterest(nHeight, nChainInterest);
+}
+
+bool GetInterestPeriodAtHeight(int nHeight,
+                               CInterestHistory::PeriodStart &start) {
+    LOCK(cs_interestHistory);
+    return pinterestHistory && pinterestHistory->GetPeriod(nHeight, start);
+}
+
+std::vector<CInterestHistory::PeriodStart> GetInterestPeriodStarts() {
+    LOCK(cs_interestHistory);
+    if (!pinterestHistory) {
+        return {};
+    }
+    return pinterestHistory->GetPeriodStarts();
+}
+
+/** Publish the tip of chainActive to readers without cs_main. */
+static void UpdateChainSnapshot() {
+    AssertLockHeld(cs_main);
+    std::atomic_store(&chainSnapshot, std::make_shared<const CChainSnapshot>(
+                                          chainActive.Tip()));
+}
+
+std::shared_ptr<const CChainSnapshot> GetChainSnapshot() {
+    return std::atomic_load(&chainSnapshot);
+}
+
+CBlockIndex *LookupBlockIndex(const uint256 &hash) {
+    LOCK(cs_blockIndexLookup);
+    BlockMap::const_iterator it = mapBlockIndex.find(hash);
+    return it != mapBlockIndex.end() ? it->second : nullptr;
+}
+
+/** Decay period of the interest left after pindex, which must be positive */
+static size_t GetInterestPeriod(const CBlockIndex *pindex) {
+    const CInterestTable &table = Params().InterestTable();
+    LOCK(cs_interestPeriod);
+    if (pindex != pindexInterestPeriod || &table != ptableInterestPeriod) {
+        nInterestPeriod = table.GetPeriod(Params().TotalInterest() -
+                                          pindex->nChainInterest);
+        pindexInterestPeriod = pindex;
+        ptableInterestPeriod = &table;
+    }
+    return nInterestPeriod;
+}
+
+/**
+ * Block whose interest left decides the interest rates at nBlockHeight.
+ * Falls back to the tip for heights not connected yet.
+ */
+static const CBlockIndex *GetInterestBlock(uint32_t nBlockHeight) {
+    // Read from the snapshot, which is chainActive for callers holding cs_main,
+    // so that RPCs such as getinterestlist need not take it.
+    const std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
+    //interest rate is calculated based on prev block, because the interest in current block is not fixed.
+    int preInterestBlockHeight = nBlockHeight - 1;
+    if (nBlockHeight > chain->Height() || nBlockHeight <= 0) {
+        preInterestBlockHeight = chain->Height();
+    }
+    return (*chain)[preInterestBlockHeight];
+}
+
+bool GetInterestPeriodAfter(const CBlockIndex *pindexPrev, size_t &nPeriod) {
+    CAmount nInterestLeft=Params().TotalInterest()-pindexPrev->nChainInterest;
+    if ( nInterestLeft<=0 ) {
+        return false;
+    }
+    nPeriod = GetInterestPeriod(pindexPrev);
+    return true;
+}
+
+/** Decay period at nBlockHeight, false if all interest is paid out */
+static bool GetInterestPeriodAt(uint32_t nBlockHeight, size_t &nPeriod) {
+    return GetInterestPeriodAfter(GetInterestBlock(nBlockHeight), nPeriod);
+}
+
 CAmount GetInterest(CAmount principal, uint32_t locktime, uint32_t blockHeight)
 {
     if(principal == 0)
     {
         return 0;
     }
-    locktime = Params().AdjustToLockInterestThreshold(locktime);
-    double interestRate = GetInterestRate(locktime, blockHeight);
-    double unitInterest = interestRate * locktime / Params().BlocksInterestInterval();
-    CAmount interest = static_cast<CAmount>(round(principal * unitInterest));
-    return interest;
+    size_t nPeriod;
+    if (!GetInterestPeriodAt(blockHeight, nPeriod)) {
+        return 0;
+    }
+    return Params().InterestTable().GetInterest(principal, locktime, nPeriod);
+}
+
+static bool HasLockInterest(const CTxOut &out) {
+    return out.nLockTime < LOCKTIME_THRESHOLD && out.nLockTime > 0;
+}
+
+/** Whether tx has an output earning interest, which needs the rates */
+static bool HasLockInterest(const CTransaction &tx) {
+    if (tx.IsCoinBase()) {
+        return false;
+    }
+    for (const CTxOut &out : tx.vout) {
+        if (HasLockInterest(out)) {
+            return true;
+        }
+    }
+    return false;
 }
 
 CAmount GetTxOutInterest ( const CTxOut out, uint32_t nBaseHeight )
 {
-    if ( out.nLockTime >= LOCKTIME_THRESHOLD || out.nLockTime <= 0 ) {
+    if (!HasLockInterest(out)) {
         return 0;
     }
     return GetInterest(out.nPrincipal, out.nLockTime, nBaseHeight);
@@ -383,40 +573,54 @@ CAmount GetTxOutInterest ( const CTxOut out, uint32_t nBaseHeight )
 
 CAmount GetTxInterest ( const CTransaction &tx, uint32_t nBaseHeight )
 {
-    if (tx.IsCoinBase())
+    if (!HasLockInterest(tx)) {
         return 0;
+    }
     if ( ( int ) nBaseHeight > chainActive.Height() ) {
         nBaseHeight = chainActive.Height() +1;
     }
+    return GetTxInterest(tx, GetInterestBlock(nBaseHeight));
+}
+
+CAmount GetTxInterest(const CTransaction &tx, const CBlockIndex *pindexPrev) {
+    if (!HasLockInterest(tx))
+        return 0;
+    CReplayTimer timer(ReplayPhase::INTEREST);
+
+    size_t nPeriod;
+    if (!GetInterestPeriodAfter(pindexPrev, nPeriod)) {
+        return 0;
+    }
 
+    //get lock interest, all outputs share the period
+    const CInterestTable &table = Params().InterestTable();
     CAmount nInterest=0;
-    //get lock interest
-    for ( unsigned int i = 0; i < tx.vout.size(); i++ ) {
-        nInterest += GetTxOutInterest ( tx.vout[i], nBaseHeight );
+    for (const CTxOut &out : tx.vout) {
+        if (HasLockInterest(out)) {
+            nInterest += table.GetInterest(out.nPrincipal, out.nLockTime,
+                                           nPeriod);
+        }
     }
     return nInterest;
 }
 
 bool GetCurrentInterestInfo(double &periodMinInterestRate, CAmount &periodTotal, CAmount &periodToken, CAmount &totalLeft)
 {
-    int nBlockHeight = chainActive.Height();
+    // Without cs_main, for getinterestinfo.
+    const std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
+    if (!chain->Tip()) {
+        return false;
+    }
     CAmount totalInterest = Params().TotalInterest();//2.4 billon
-    totalLeft = totalInterest - chainActive[nBlockHeight]->nChainInterest;
+    totalLeft = totalInterest - chain->GetChainInterest();
     if ( totalLeft <= 0 ) {
         return false;
     }
 
-    periodMinInterestRate = Params().LockInterestRate(0);
-    CAmount preTotalInterest = totalInterest;
-    decayByOneTenth(totalInterest);
-    while ( totalInterest != 0 ) {
-        if ( totalLeft > totalInterest ) {
-            break;
-        }
-        periodMinInterestRate *= Params().DecayRatio();
-        preTotalInterest = totalInterest;
-        decayByOneTenth(totalInterest);
-    }
+    const CInterestTable &table = Params().InterestTable();
+    size_t nPeriod = GetInterestPeriod(chain->Tip());
+    periodMinInterestRate = table.GetRate(0, nPeriod);
+    CAmount preTotalInterest = table.GetPeriodStart(nPeriod);
     periodTotal = preTotalInterest;
     takeOneTenth(periodTotal);
     periodToken = preTotalInterest - totalLeft;
@@ -425,37 +629,17 @@ bool GetCurrentInterestInfo(double &periodMinInterestRate, CAmount &periodTotal,
 
 double GetInterestRate ( uint32_t nLockBlocks,uint32_t nBlockHeight )
 {
-    //interest rate is calculated based on prev block, because the interest in current block is not fixed.
-    int preInterestBlockHeight = nBlockHeight - 1;
-    if(nBlockHeight > chainActive.Height() || nBlockHeight <= 0) {
-        preInterestBlockHeight = chainActive.Height();
-    }
-
-    int nLevel=0;
-    for ( nLevel=-1; nLevel<6; nLevel++ ) {
-        if ( ( int ) nLockBlocks<Params().LockInterestBlocksThreshould ( nLevel+1 ) ) {
-            break;
-        }
-    }
+    const CInterestTable &table = Params().InterestTable();
+    int nLevel = table.GetLevel(nLockBlocks);
     if ( nLevel<0 ) {
         return 0;
     }
 
-    double rate=Params().LockInterestRate ( nLevel );
-    CAmount nInterestTarget=Params().TotalInterest();
-    CAmount nInterestLeft=nInterestTarget-chainActive[preInterestBlockHeight]->nChainInterest;
-    if ( nInterestLeft<=0 ) {
+    size_t nPeriod;
+    if (!GetInterestPeriodAt(nBlockHeight, nPeriod)) {
         return 0;
     }
-    decayByOneTenth(nInterestTarget);
-    while ( nInterestTarget!=0 ) {
-        if ( nInterestLeft>nInterestTarget ) {
-            break;
-        }
-        rate*=Params().DecayRatio();
-        decayByOneTenth(nInterestTarget);
-    }
-    return rate;
+    return table.GetRate(nLevel, nPeriod);
 }
 
 //CAmount GetFee ( const CTransaction &tx,const CCoinsViewCache& view,uint32_t nBaseHeight )
@@ -492,6 +676,10 @@ void LimitMempoolSize(CTxMemPool &pool, size_t limit, unsigned long age) {
     }
 
     std::vector<COutPoint> vNoSpendsRemaining;
+    pool.TrimContentToSize(
+        GetArg("-maxmempoolcontent", DEFAULT_MAX_MEMPOOL_CONTENT_SIZE) *
+            1000000,
+        &vNoSpendsRemaining);
     pool.TrimToSize(limit, &vNoSpendsRemaining);
     for (const COutPoint &removed : vNoSpendsRemaining) {
         pcoinsTip->Uncache(removed);
@@ -553,11 +741,13 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction &tx,
         if (txFrom) {
             assert(txFrom->GetHash() == txin.prevout.hash);
             assert(txFrom->vout.size() > txin.prevout.n);
-            assert(txFrom->vout[txin.prevout.n] == coin.GetTxOut());
+            assert(txFrom->vout[txin.prevout.n].EqualsWithoutContent(
+                coin.GetTxOut()));
         } else {
             const Coin &coinFromDisk = pcoinsTip->AccessCoin(txin.prevout);
             assert(!coinFromDisk.IsSpent());
-            assert(coinFromDisk.GetTxOut() == coin.GetTxOut());
+            assert(coinFromDisk.GetTxOut().EqualsWithoutContent(
+                coin.GetTxOut()));
         }
     }
 
@@ -740,6 +930,15 @@ static bool AcceptToMemoryPoolWorker(
                              strprintf("%d < %d", nFees, mempoolRejectFee));
         }
 
+        // Content is priced on its own and never relayed for priority alone.
+        if (entry.GetContentSize() > 0 &&
+            nModifiedFees < ::contentMinRelayTxFee.GetFee(nSize)) {
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE,
+                             "content min relay fee not met", false,
+                             strprintf("%d < %d", nFees,
+                                       ::contentMinRelayTxFee.GetFee(nSize)));
+        }
+
         if (GetBoolArg("-relaypriority", DEFAULT_RELAYPRIORITY) &&
             nModifiedFees < ::minRelayTxFee.GetFee(nSize) &&
             !AllowFree(entry.GetPriority(chainActive.Height() + 1))) {
@@ -808,10 +1007,11 @@ static bool AcceptToMemoryPoolWorker(
         }
 
         // Check against previous transactions. This is done last to help
-        // prevent CPU exhaustion denial-of-service attacks.
-        PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false,
-                         txdata)) {
+        // prevent CPU exhaustion denial-of-service attacks. The precomputed
+        // data is shared by the checks below, and only filled in by the first
+        // one to miss the script cache.
+        PrecomputedTransactionData txdata;
+        if (!CheckMempoolInputs(tx, state, view, scriptVerifyFlags, txdata)) {
             // State filled in by CheckInputs.
             return false;
         }
@@ -863,8 +1063,14 @@ static bool AcceptToMemoryPoolWorker(
         // This transaction should only count for fee estimation if
         // the node is not behind and it is not dependent on any other
         // transactions in the mempool.
+        const bool fInputsInChain = pool.HasNoInputsOf(tx);
         bool validForFeeEstimation =
-            IsCurrentForFeeEstimation() && pool.HasNoInputsOf(tx);
+            IsCurrentForFeeEstimation() && fInputsInChain;
+
+        // ConnectBlock can then skip the input checks done above.
+        if (fInputsInChain) {
+            entry.SetInputsChecked(chainActive.Tip());
+        }
 
         // Store transaction in memory.
         pool.addUnchecked(txid, entry, setAncestors, validForFeeEstimation);
@@ -882,7 +1088,7 @@ static bool AcceptToMemoryPoolWorker(
     }
 
     GetMainSignals().SyncTransaction(
-        tx, nullptr, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
+        ptx, nullptr, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
 
     return true;
 }
@@ -892,10 +1098,17 @@ static bool AcceptToMemoryPoolWithTime(
     const CTransactionRef &tx, bool fLimitFree, bool *pfMissingInputs,
     int64_t nAcceptTime, std::list<CTransactionRef> *plTxnReplaced = nullptr,
     bool fOverrideMempoolLimit = false, const CAmount nAbsurdFee = CAmount(0)) {
+    const int64_t nStart = TRACE_ACTIVE(mempool, accept) ? GetTimeMicros() : 0;
     std::vector<COutPoint> coins_to_uncache;
     bool res = AcceptToMemoryPoolWorker(
         config, pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime,
         plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, coins_to_uncache);
+    if (TRACE_ACTIVE(mempool, accept)) {
+        const uint256 txid = tx->GetId();
+        const std::string strReason = state.GetRejectReason();
+        TRACE5(mempool, accept, txid.begin(), tx->GetTotalSize(), res,
+               strReason.c_str(), GetTimeMicros() - nStart);
+    }
     if (!res) {
         for (const COutPoint &outpoint : coins_to_uncache) {
             pcoinsTip->Uncache(outpoint);
@@ -919,6 +1132,77 @@ bool AcceptToMemoryPool(const Config &config, CTxMemPool &pool,
                                       fOverrideMempoolLimit, nAbsurdFee);
 }
 
+bool PreCheckTxWithoutContent(const Config &config, CTxMemPool &pool,
+                              CValidationState &state, const CTransaction &tx,
+                              uint64_t nContentSize) {
+    AssertLockHeld(cs_main);
+
+    if (!CheckRegularTransaction(tx, state, true)) {
+        return false;
+    }
+    std::string reason;
+    if (fRequireStandard && !IsStandardTx(tx, reason)) {
+        return state.DoS(0, false, REJECT_NONSTANDARD, reason);
+    }
+    CValidationState ctxState;
+    if (!ContextualCheckTransactionForCurrentBlock(config, tx, ctxState)) {
+        return state.DoS(0, false, REJECT_NONSTANDARD,
+                         ctxState.GetRejectReason());
+    }
+    if (pool.exists(tx.GetId())) {
+        return state.Invalid(false, REJECT_ALREADY_KNOWN,
+                             "txn-already-in-mempool");
+    }
+
+    CAmount nValueIn = 0;
+    {
+        LOCK(pool.cs);
+        for (const CTxIn &txin : tx.vin) {
+            if (pool.mapNextTx.count(txin.prevout)) {
+                return state.Invalid(false, REJECT_CONFLICT,
+                                     "txn-mempool-conflict");
+            }
+        }
+
+        // Left for AcceptToMemoryPool to sort out once the content is here,
+        // as the coins looked up only for this are left out of the cache.
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        for (const CTxIn &txin : tx.vin) {
+            const bool fCached = pcoinsTip->HaveCoinInCache(txin.prevout);
+            Coin coin;
+            const bool fHave = viewMemPool.GetCoin(txin.prevout, coin);
+            if (!fCached) {
+                pcoinsTip->Uncache(txin.prevout);
+            }
+            if (!fHave || coin.IsSpent()) {
+                return true;
+            }
+            nValueIn += coin.GetTxOut().nValue;
+        }
+    }
+
+    CAmount nFees = nValueIn - tx.GetValueOutWithoutInterest();
+    double nPriorityDummy = 0;
+    pool.ApplyDeltas(tx.GetId(), nPriorityDummy, nFees);
+    const unsigned int nSize = GetTransactionSize(tx);
+    CAmount mempoolRejectFee =
+        pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) *
+                       1000000)
+            .GetFee(nSize);
+    if (mempoolRejectFee > CAmount(0) && nFees < mempoolRejectFee) {
+        return state.DoS(0, false, REJECT_INSUFFICIENTFEE,
+                         "mempool min fee not met");
+    }
+    if (nContentSize > 0 && nFees < ::contentMinRelayTxFee.GetFee(nSize)) {
+        return state.DoS(0, false, REJECT_INSUFFICIENTFEE,
+                         "content min relay fee not met");
+    }
+    return true;
+}
+
+static bool ReadIndexedTransaction(const uint256 &txid, CTransactionRef &txOut,
+                                   uint256 &hashBlock);
+
 /** Return transaction in txOut, and if it was found inside a block, its hash is
  * placed in hashBlock */
 bool GetTransaction(const Config &config, const uint256 &txid,
@@ -926,37 +1210,20 @@ bool GetTransaction(const Config &config, const uint256 &txid,
                     bool fAllowSlow) {
     CBlockIndex *pindexSlow = nullptr;
 
-    LOCK(cs_main);
-
     CTransactionRef ptx = mempool.get(txid);
     if (ptx) {
         txOut = ptx;
         return true;
     }
 
-    if (fTxIndex) {
-        CDiskTxPos postx;
-        if (pblocktree->ReadTxIndex(txid, postx)) {
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK,
-                           CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
-            CBlockHeader header;
-            try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
-            } catch (const std::exception &e) {
-                return error("%s: Deserialize or I/O error - %s", __func__,
-                             e.what());
-            }
-            hashBlock = header.GetHash();
-            if (txOut->GetId() != txid)
-                return error("%s: txid mismatch", __func__);
-            return true;
-        }
+    // The transaction index and the blocks are read without cs_main, so that
+    // lookups don't wait for block validation or for each other.
+    if (fTxIndex && ReadIndexedTransaction(txid, txOut, hashBlock)) {
+        return true;
     }
 
+    LOCK(cs_main);
+
     // use coin database to locate block that contains transaction, and scan it
     if (fAllowSlow) {
         const Coin &coin = AccessByTxid(*pcoinsTip, txid);
@@ -981,32 +1248,258 @@ bool GetTransaction(const Config &config, const uint256 &txid,
     return false;
 }
 
+bool GetCoinContent(const Config &config, const COutPoint &outpoint,
+                    std::string &strContent) {
+    CTransactionRef tx;
+    uint256 hashBlock;
+    if (!GetTransaction(config, outpoint.hash, tx, hashBlock, true) ||
+        outpoint.n >= tx->vout.size()) {
+        // The block may be pruned, the content archive keeps what is unspent.
+        return g_blockpruner &&
+               g_blockpruner->LookupContent(outpoint, strContent);
+    }
+
+    strContent = tx->vout[outpoint.n].strContent;
+    return true;
+}
+
+bool ReadOutputContent(const Config &config, const COutPoint &outpoint,
+                       uint64_t nOffset, uint64_t nLength, std::string &strData,
+                       uint64_t &nSize) {
+    std::string strContent;
+    if (!GetCoinContent(config, outpoint, strContent)) {
+        return false;
+    }
+    nSize = strContent.size();
+    strData = nOffset < nSize ? strContent.substr(nOffset, nLength) : "";
+    return true;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // CBlock and CBlockIndex
 //
 
-bool WriteBlockToDisk(const CBlock &block, CDiskBlockPos &pos,
-                      const CMessageHeader::MessageMagic &messageStart) {
+bool MakeBlockRecord(const CBlock &block, std::vector<uint8_t> &vRecord) {
+    // Sized first, so that it is serialized without reallocating, and moved
+    // rather than copied when it isn't compressed.
+    std::vector<uint8_t> vBlock;
+    vBlock.reserve(::GetSerializeSize(block, SER_DISK, CLIENT_VERSION));
+    CVectorWriter(SER_DISK, CLIENT_VERSION, vBlock, 0, block);
+    if (fBlockCompression &&
+        CompressBlock(vBlock.data(), vBlock.size(), vRecord)) {
+        return true;
+    }
+    vRecord = std::move(vBlock);
+    return false;
+}
+
+/**
+ * Open the block file at pos to append a record of nSize, and write the index
+ * header in front of it. pos is set to where the record starts. Returns the
+ * file, or nullptr on failure.
+ */
+static FILE *OpenBlockRecord(CDiskBlockPos &pos, unsigned int nSize,
+                             const CMessageHeader::MessageMagic &messageStart) {
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull()) {
-        return error("WriteBlockToDisk: OpenBlockFile failed");
+        error("WriteBlockToDisk: OpenBlockFile failed");
+        return nullptr;
     }
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, block);
     fileout << FLATDATA(messageStart) << nSize;
 
-    // Write block
     long fileOutPos = ftell(fileout.Get());
     if (fileOutPos < 0) {
-        return error("WriteBlockToDisk: ftell failed");
+        error("WriteBlockToDisk: ftell failed");
+        return nullptr;
     }
-
     pos.nPos = (unsigned int)fileOutPos;
+    return fileout.release();
+}
+
+bool WriteBlockToDisk(const std::vector<uint8_t> &vRecord, bool fCompressed,
+                      CDiskBlockPos &pos,
+                      const CMessageHeader::MessageMagic &messageStart) {
+    unsigned int nSize = vRecord.size();
+    if (fCompressed) {
+        nSize |= BLOCK_COMPRESSED_FLAG;
+    }
+    CAutoFile fileout(OpenBlockRecord(pos, nSize, messageStart), SER_DISK,
+                      CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        return false;
+    }
+
+    // Write block
+    fileout.write((const char *)vRecord.data(), vRecord.size());
+    return true;
+}
+
+bool WriteBlockToDisk(const CBlock &block, CDiskBlockPos &pos,
+                      const CMessageHeader::MessageMagic &messageStart) {
+    const unsigned int nSize =
+        ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+    CAutoFile fileout(OpenBlockRecord(pos, nSize, messageStart), SER_DISK,
+                      CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        return false;
+    }
+
+    // Write block
     fileout << block;
+    return true;
+}
+
+static CBlockFileMap blockFileMap;
+static CDecompressedBlockCache decompressedBlockCache;
+
+/**
+ * Map the block file holding pos if it is finalized. The file still being
+ * appended to is read through stdio instead.
+ */
+static std::shared_ptr<const CMappedBlockFile>
+MapBlockFile(const CDiskBlockPos &pos) {
+    {
+        LOCK(cs_LastBlockFile);
+        if (pos.nFile >= nLastBlockFile) {
+            return nullptr;
+        }
+    }
+    return blockFileMap.Get(pos.nFile, GetBlockPosFilename(pos, "blk"));
+}
+
+/**
+ * Find the block record at pos, and the index header WriteBlockToDisk put in
+ * front of it, in a mapped block file.
+ */
+static bool GetMappedBlock(const CMappedBlockFile &file,
+                           const CDiskBlockPos &pos, const uint8_t *&pheader,
+                           const uint8_t *&precord, unsigned int &nSize,
+                           bool &fCompressed) {
+    const unsigned int nHeaderSize =
+        CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (pos.nPos < nHeaderSize) {
+        return false;
+    }
+    pheader = file.Get(pos.nPos - nHeaderSize, nHeaderSize);
+    if (!pheader) {
+        return false;
+    }
+    nSize = ReadLE32(pheader + CMessageHeader::MESSAGE_START_SIZE);
+    fCompressed = (nSize & BLOCK_COMPRESSED_FLAG) != 0;
+    nSize &= ~BLOCK_COMPRESSED_FLAG;
+    if (nSize > MAX_SIZE) {
+        return false;
+    }
+    precord = file.Get(pos.nPos, nSize);
+    return precord != nullptr;
+}
+
+/** Decompress the block record at pos, unless that was done recently. */
+static std::shared_ptr<const std::vector<uint8_t>>
+DecompressBlockRecord(const CDiskBlockPos &pos, const uint8_t *precord,
+                      size_t nSize) {
+    std::shared_ptr<std::vector<uint8_t>> block =
+        std::make_shared<std::vector<uint8_t>>();
+    if (!DecompressBlock(precord, nSize, *block)) {
+        return nullptr;
+    }
+    decompressedBlockCache.Put(pos, block);
+    return block;
+}
+
+namespace {
+
+/** A serialized block read from disk, and what keeps its bytes around. */
+struct CBlockData {
+    std::shared_ptr<const CMappedBlockFile> mapped;
+    std::shared_ptr<const std::vector<uint8_t>> buffer;
+    const uint8_t *pdata;
+    size_t nSize;
+};
+
+} // namespace
 
+/**
+ * Read the block at pos and the magic of its index header. A block that isn't
+ * compressed is used in place when its file is mapped.
+ */
+static bool ReadBlockData(const CDiskBlockPos &pos,
+                          CMessageHeader::MessageMagic &magic,
+                          CBlockData &data) {
+    // The index header written by WriteBlockToDisk precedes the block.
+    const unsigned int nHeaderSize =
+        CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (pos.nPos < nHeaderSize) {
+        return error("%s: no index header before %s", __func__,
+                     pos.ToString());
+    }
+
+    data.mapped = MapBlockFile(pos);
+    const uint8_t *pheader, *precord;
+    unsigned int nSize;
+    bool fCompressed;
+    if (data.mapped &&
+        GetMappedBlock(*data.mapped, pos, pheader, precord, nSize,
+                       fCompressed)) {
+        memcpy(magic.data(), pheader, CMessageHeader::MESSAGE_START_SIZE);
+        if (!fCompressed) {
+            data.pdata = precord;
+            data.nSize = nSize;
+            return true;
+        }
+        data.buffer = decompressedBlockCache.Get(pos);
+        if (!data.buffer) {
+            data.buffer = DecompressBlockRecord(pos, precord, nSize);
+        }
+        data.mapped.reset();
+    } else {
+        data.mapped.reset();
+        // Open history file to read
+        CAutoFile filein(
+            OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - nHeaderSize),
+                          true),
+            SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull()) {
+            return error("%s: OpenBlockFile failed for %s", __func__,
+                         pos.ToString());
+        }
+
+        try {
+            filein >> FLATDATA(magic) >> nSize;
+            fCompressed = (nSize & BLOCK_COMPRESSED_FLAG) != 0;
+            nSize &= ~BLOCK_COMPRESSED_FLAG;
+            if (nSize > MAX_SIZE) {
+                return error("%s: Block size %u too large at %s", __func__,
+                             nSize, pos.ToString());
+            }
+            if (fCompressed) {
+                data.buffer = decompressedBlockCache.Get(pos);
+            }
+            if (!data.buffer) {
+                std::shared_ptr<std::vector<uint8_t>> record =
+                    std::make_shared<std::vector<uint8_t>>(nSize);
+                filein.read((char *)record->data(), nSize);
+                data.buffer =
+                    fCompressed
+                        ? DecompressBlockRecord(pos, record->data(), nSize)
+                        : record;
+            }
+        } catch (const std::exception &e) {
+            return error("%s: Read from block file failed - %s at %s",
+                         __func__, e.what(), pos.ToString());
+        }
+    }
+
+    if (!data.buffer) {
+        return error("%s: Corrupt compressed block at %s", __func__,
+                     pos.ToString());
+    }
+    data.pdata = data.buffer->data();
+    data.nSize = data.buffer->size();
     return true;
 }
 
@@ -1014,19 +1507,21 @@ bool ReadBlockFromDisk(CBlock &block, const CDiskBlockPos &pos,
                        const Config &config) {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s",
+    CMessageHeader::MessageMagic magic;
+    CBlockData data;
+    if (!ReadBlockData(pos, magic, data)) {
+        return error("ReadBlockFromDisk: failed to read block at %s",
                      pos.ToString());
     }
 
-    // Read block
     try {
-        filein >> block;
+        CReplayTimer timer(ReplayPhase::DESERIALIZE);
+        CSpanReader reader(SER_DISK, CLIENT_VERSION, data.pdata,
+                           data.pdata + data.nSize);
+        reader >> block;
     } catch (const std::exception &e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__,
-                     e.what(), pos.ToString());
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(),
+                     pos.ToString());
     }
 
     // Check the header
@@ -1053,15 +1548,117 @@ bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex,
     return true;
 }
 
-CAmount GetBlockSubsidy(int nHeight, const Consensus::Params &consensusParams) {
-    double nSubsidy = ( double ) consensusParams.nBlockReward;
-    int halvings = ( nHeight - 1 ) / consensusParams.nSubsidyHalvingInterval;
-    for ( int i=0; i< halvings; i++ ) {
-        nSubsidy *= Params().DecayRatio();
+bool ReadBlockViewFromDisk(CBlockView &view, const CBlockIndex *pindex,
+                           const Config &config) {
+    const CDiskBlockPos pos = pindex->GetBlockPos();
+    CMessageHeader::MessageMagic magic;
+    CBlockData data;
+    if (!ReadBlockData(pos, magic, data)) {
+        return error("%s: failed to read block at %s", __func__,
+                     pos.ToString());
     }
 
-    // Subsidy is cut in half every 210,000 blocks which will occur
-    // approximately every 4 years.
+    // The view keeps whichever holds the block alive.
+    std::shared_ptr<const void> owner;
+    if (data.buffer) {
+        owner = data.buffer;
+    } else {
+        owner = data.mapped;
+    }
+    try {
+        view = CBlockView(std::move(owner), data.pdata,
+                          data.pdata + data.nSize);
+    } catch (const std::exception &e) {
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(),
+                     pos.ToString());
+    }
+
+    if (!CheckProofOfWork(view.GetHeader(), config)) {
+        return error("%s: Errors in block header at %s", __func__,
+                     pos.ToString());
+    }
+    if (view.GetHeader().GetHash() != pindex->GetBlockHash()) {
+        return error("%s: GetHash() doesn't match index for %s at %s",
+                     __func__, pindex->ToString(), pos.ToString());
+    }
+
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<uint8_t> &block,
+                          const CDiskBlockPos &pos,
+                          const CMessageHeader::MessageMagic &messageStart) {
+    CMessageHeader::MessageMagic magic;
+    CBlockData data;
+    if (!ReadBlockData(pos, magic, data)) {
+        return error("ReadRawBlockFromDisk: failed to read block at %s",
+                     pos.ToString());
+    }
+    if (magic != messageStart) {
+        return error("ReadRawBlockFromDisk: Block magic mismatch at %s",
+                     pos.ToString());
+    }
+
+    block.assign(data.pdata, data.pdata + data.nSize);
+    return true;
+}
+
+/**
+ * Look txid up in the transaction index. Transactions whose id only starts
+ * the same are skipped, and one in the active chain is preferred over a copy
+ * of it in a block that was disconnected.
+ */
+static bool ReadIndexedTransaction(const uint256 &txid, CTransactionRef &txOut,
+                                   uint256 &hashBlock) {
+    std::vector<CDiskTxPos> vPos;
+    if (!pblocktree->ReadTxIndex(txid, vPos)) {
+        return false;
+    }
+
+    bool fFound = false;
+    for (const CDiskTxPos &postx : vPos) {
+        CMessageHeader::MessageMagic magic;
+        CBlockData data;
+        if (!ReadBlockData(postx, magic, data)) {
+            continue;
+        }
+        CBlockHeader header;
+        CTransactionRef tx;
+        try {
+            CSpanReader reader(SER_DISK, CLIENT_VERSION, data.pdata,
+                               data.pdata + data.nSize);
+            reader >> header;
+            reader.ignore(postx.nTxOffset);
+            reader >> tx;
+        } catch (const std::exception &e) {
+            error("%s: Deserialize error - %s at %s", __func__, e.what(),
+                  postx.ToString());
+            continue;
+        }
+        if (tx->GetId() != txid) {
+            continue;
+        }
+        txOut = tx;
+        hashBlock = header.GetHash();
+        fFound = true;
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hashBlock);
+        if (it != mapBlockIndex.end() && chainActive.Contains(it->second)) {
+            break;
+        }
+    }
+    return fFound;
+}
+
+CAmount GetBlockSubsidy(int nHeight, const Consensus::Params &consensusParams) {
+    double nSubsidy = ( double ) consensusParams.nBlockReward;
+    int halvings = ( nHeight - 1 ) / consensusParams.nSubsidyHalvingInterval;
+    for ( int i=0; i< halvings; i++ ) {
+        nSubsidy *= Params().DecayRatio();
+    }
+
+    // Subsidy is cut in half every 210,000 blocks which will occur
+    // approximately every 4 years.
     return CAmount(nSubsidy);
 }
 
@@ -1070,18 +1667,17 @@ bool IsInitialBlockDownload() {
 
     // Once this function has returned false, it must remain false.
     static std::atomic<bool> latchToFalse{false};
-    // Optimization: pre-test latch before taking the lock.
     if (latchToFalse.load(std::memory_order_relaxed)) return false;
 
-    LOCK(cs_main);
-    if (latchToFalse.load(std::memory_order_relaxed)) return false;
+    // The tip as of the snapshot, which is chainActive's for callers holding
+    // cs_main. Others need not take it.
+    const CBlockIndex *pindexTip = GetChainSnapshot()->Tip();
     if (fImporting || fReindex) return true;
-    if (chainActive.Tip() == nullptr) return true;
-    if (chainActive.Tip()->nChainWork <
+    if (pindexTip == nullptr) return true;
+    if (pindexTip->nChainWork <
         UintToArith256(chainParams.GetConsensus().nMinimumChainWork))
         return true;
-    if (chainActive.Tip()->GetBlockTime() < (GetTime() - nMaxTipAge))
-        return true;
+    if (pindexTip->GetBlockTime() < (GetTime() - nMaxTipAge)) return true;
     latchToFalse.store(true, std::memory_order_relaxed);
     return false;
 }
@@ -1237,8 +1833,11 @@ void UpdateCoins(const CTransaction &tx, CCoinsViewCache &inputs, int nHeight) {
 
 bool CScriptCheck::operator()() {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
+    const PrecomputedSignatureHash *sighashData =
+        txdata ? txdata->sighash.get() : nullptr;
     if (!VerifyScript(scriptSig, scriptPubKey, nFlags,
-                      CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore),
+                      CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore,
+                                                         sighashData),
                       &error)) {
         return false;
     }
@@ -1323,34 +1922,18 @@ bool CheckTxInputs(const CTransaction &tx, CValidationState &state,
 }
 } // namespace Consensus
 
-bool CheckInputs(const CTransaction &tx, CValidationState &state,
-                 const CCoinsViewCache &inputs, bool fScriptChecks,
-                 uint32_t flags, bool sigCacheStore, bool scriptCacheStore,
-                 const PrecomputedTransactionData &txdata,
-                 std::vector<CScriptCheck> *pvChecks) {
-    assert(!tx.IsCoinBase());
-
-    if (!Consensus::CheckTxInputs(tx, state, inputs, GetSpendHeight(inputs))) {
-        return false;
-    }
-
-    if (pvChecks) {
-        pvChecks->reserve(tx.vin.size());
-    }
-
-    // The first loop above does all the inexpensive checks. Only if ALL inputs
-    // pass do we perform expensive ECDSA signature checks. Helps prevent CPU
-    // exhaustion attacks.
-
-    // Skip script verification when connecting blocks under the assumedvalid
-    // block. Assuming the assumedvalid block is valid this is safe because
-    // block merkle hashes are still computed and checked, of course, if an
-    // assumed valid block is invalid due to false scriptSigs this optimization
-    // would allow an invalid chain to be accepted.
-    if (!fScriptChecks) {
-        return true;
-    }
-
+/**
+ * The script half of CheckInputs, for inputs already known to pass
+ * Consensus::CheckTxInputs. txdata is only computed if a script has to run.
+ * pvChecks is a vector of CScriptCheck, with any allocator.
+ */
+template <typename Checks>
+static bool CheckInputScripts(const CTransaction &tx, CValidationState &state,
+                              const CCoinsViewCache &inputs, uint32_t flags,
+                              bool sigCacheStore, bool scriptCacheStore,
+                              PrecomputedTransactionData &txdata,
+                              Checks *pvChecks) {
+    CReplayTimer timer(ReplayPhase::SCRIPT_CHECKS);
     // First check if script executions have been cached with the same flags.
     // Note that this assumes that the inputs provided are correct (ie that the
     // transaction hash which is in tx's prevouts properly commits to the
@@ -1360,6 +1943,14 @@ bool CheckInputs(const CTransaction &tx, CValidationState &state,
         return true;
     }
 
+    if (!txdata.ready) {
+        txdata.Init(tx);
+    }
+
+    if (pvChecks) {
+        pvChecks->reserve(tx.vin.size());
+    }
+
     for (size_t i = 0; i < tx.vin.size(); i++) {
         const COutPoint &prevout = tx.vin[i].prevout;
         const Coin &coin = inputs.AccessCoin(prevout);
@@ -1419,34 +2010,71 @@ bool CheckInputs(const CTransaction &tx, CValidationState &state,
     return true;
 }
 
+bool CheckInputs(const CTransaction &tx, CValidationState &state,
+                 const CCoinsViewCache &inputs, bool fScriptChecks,
+                 uint32_t flags, bool sigCacheStore, bool scriptCacheStore,
+                 PrecomputedTransactionData &txdata,
+                 std::vector<CScriptCheck> *pvChecks) {
+    assert(!tx.IsCoinBase());
+
+    if (!Consensus::CheckTxInputs(tx, state, inputs, GetSpendHeight(inputs))) {
+        return false;
+    }
+
+    // The first loop above does all the inexpensive checks. Only if ALL inputs
+    // pass do we perform expensive ECDSA signature checks. Helps prevent CPU
+    // exhaustion attacks.
+
+    // Skip script verification when connecting blocks under the assumedvalid
+    // block. Assuming the assumedvalid block is valid this is safe because
+    // block merkle hashes are still computed and checked, of course, if an
+    // assumed valid block is invalid due to false scriptSigs this optimization
+    // would allow an invalid chain to be accepted.
+    if (!fScriptChecks) {
+        return true;
+    }
+
+    return CheckInputScripts(tx, state, inputs, flags, sigCacheStore,
+                             scriptCacheStore, txdata, pvChecks);
+}
+
 namespace {
 
-bool UndoWriteToDisk(const CBlockUndo &blockundo, CDiskBlockPos &pos,
-                     const uint256 &hashBlock,
-                     const CMessageHeader::MessageMagic &messageStart) {
+/** Checksum of serialized undo data, which UndoReadFromDisk verifies */
+static uint256 GetUndoChecksum(const std::vector<uint8_t> &vchUndo,
+                               const uint256 &hashBlock) {
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << hashBlock;
+    hasher.write((const char *)vchUndo.data(), vchUndo.size());
+    return hasher.GetHash();
+}
+
+static bool UndoWriteToDisk(const std::vector<uint8_t> &vchUndo,
+                            const uint256 &hashChecksum, CDiskBlockPos &pos,
+                            const CMessageHeader::MessageMagic &messageStart) {
+    CReplayTimer timer(ReplayPhase::UNDO_WRITE);
     // Open history file to append
     CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull()) return error("%s: OpenUndoFile failed", __func__);
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, blockundo);
+    unsigned int nSize = vchUndo.size();
     fileout << FLATDATA(messageStart) << nSize;
 
     // Write undo data
     long fileOutPos = ftell(fileout.Get());
     if (fileOutPos < 0) return error("%s: ftell failed", __func__);
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
+    fileout.write((const char *)vchUndo.data(), vchUndo.size());
 
-    // calculate & write checksum
-    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
-    hasher << hashBlock;
-    hasher << blockundo;
-    fileout << hasher.GetHash();
+    // write checksum
+    fileout << hashChecksum;
 
     return true;
 }
 
+} // namespace
+
 bool UndoReadFromDisk(CBlockUndo &blockundo, const CDiskBlockPos &pos,
                       const uint256 &hashBlock) {
     // Open history file to read
@@ -1475,6 +2103,8 @@ bool UndoReadFromDisk(CBlockUndo &blockundo, const CDiskBlockPos &pos,
     return true;
 }
 
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string &strMessage,
                const std::string &userMessage = "") {
@@ -1571,7 +2201,7 @@ DisconnectResult ApplyBlockUndo(const CBlockUndo &blockUndo,
         uint256 txid = tx.GetId();
 
         // Check that all outputs are available and match the outputs in the
-        // block itself exactly.
+        // block itself exactly, apart from the content coins do not keep.
         for (size_t o = 0; o < tx.vout.size(); o++) {
             if (tx.vout[o].scriptPubKey.IsUnspendable()) {
                 continue;
@@ -1580,7 +2210,8 @@ DisconnectResult ApplyBlockUndo(const CBlockUndo &blockUndo,
             COutPoint out(txid, o, tx.vout[o].nValue);
             Coin coin;
             bool is_spent = view.SpendCoin(out, &coin);
-            if (!is_spent || tx.vout[o] != coin.GetTxOut()) {
+            if (!is_spent ||
+                !tx.vout[o].EqualsWithoutContent(coin.GetTxOut())) {
                 // transaction output mismatch
                 fClean = false;
             }
@@ -1640,13 +2271,251 @@ static void FlushBlockFile(bool fFinalize = false) {
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
                  unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CWorkStealingCheckQueue<CScriptCheck>
+    scriptcheckqueue(128, MAX_SCRIPTCHECK_THREADS);
 
 void ThreadScriptCheck() {
     RenameThread("bitcoin-scriptch");
     scriptcheckqueue.Thread();
 }
 
+/**
+ * CheckInputs for AcceptToMemoryPoolWorker, with the scripts of a transaction
+ * spending several inputs verified on the script check threads. cs_main keeps
+ * other users off scriptcheckqueue meanwhile. The signatures are cached, so a
+ * failure is cheaply re-run serially to fill in the exact reject reason.
+ */
+static bool CheckMempoolInputs(const CTransaction &tx, CValidationState &state,
+                               const CCoinsViewCache &view, uint32_t flags,
+                               PrecomputedTransactionData &txdata) {
+    AssertLockHeld(cs_main);
+    if (nScriptCheckThreads == 0 || tx.vin.size() < 2) {
+        return CheckInputs(tx, state, view, true, flags, true, false, txdata);
+    }
+
+    std::vector<CScriptCheck> vChecks;
+    if (!CheckInputs(tx, state, view, true, flags, true, false, txdata,
+                     &vChecks)) {
+        return false;
+    }
+    CCheckQueueControl<CScriptCheck, CWorkStealingCheckQueue<CScriptCheck>>
+        control(&scriptcheckqueue);
+    control.Add(vChecks);
+    if (control.Wait()) {
+        return true;
+    }
+    return CheckInputs(tx, state, view, true, flags, true, false, txdata);
+}
+
+namespace {
+
+/** Closure representing one header whose proof-of-work has to be checked. */
+class CHeaderPowCheck {
+private:
+    const Config *config;
+    CBlockHeader header;
+
+public:
+    CHeaderPowCheck() : config(nullptr) {}
+    CHeaderPowCheck(const Config &configIn, const CBlockHeader &headerIn)
+        : config(&configIn), header(headerIn) {}
+
+    bool operator()() { return CheckProofOfWork(header, *config); }
+
+    void swap(CHeaderPowCheck &check) {
+        std::swap(config, check.config);
+        std::swap(header, check.header);
+    }
+};
+}
+
+static CCheckQueue<CHeaderPowCheck> headercheckqueue(16);
+//! Only one batch can use headercheckqueue at a time
+static CCriticalSection cs_headercheckqueue;
+
+void ThreadHeaderCheck() {
+    RenameThread("bitcoin-headerch");
+    headercheckqueue.Thread();
+}
+
+namespace {
+
+/** Closure reading one coin from the coins database ahead of ConnectBlock. */
+class CCoinPrefetch {
+private:
+    const CCoinsView *view;
+    COutPoint outpoint;
+    Coin *pcoin;
+
+public:
+    CCoinPrefetch() : view(nullptr), pcoin(nullptr) {}
+    CCoinPrefetch(const CCoinsView &viewIn, const COutPoint &outpointIn,
+                  Coin *pcoinIn)
+        : view(&viewIn), outpoint(outpointIn), pcoin(pcoinIn) {}
+
+    bool operator()() {
+        if (!view->GetCoin(outpoint, *pcoin)) {
+            pcoin->Clear();
+        }
+        return true;
+    }
+
+    void swap(CCoinPrefetch &check) {
+        std::swap(view, check.view);
+        std::swap(outpoint, check.outpoint);
+        std::swap(pcoin, check.pcoin);
+    }
+};
+}
+
+static CCheckQueue<CCoinPrefetch> prefetchqueue(16);
+
+void ThreadCoinPrefetch() {
+    RenameThread("bitcoin-prefetch");
+    prefetchqueue.Thread();
+}
+
+/**
+ * Load the coins spent by a block into pcoinsTip with parallel reads, so
+ * ConnectBlock doesn't read them from disk one by one.
+ */
+static void PrefetchInputs(const CBlock &block) {
+    AssertLockHeld(cs_main);
+    if (nScriptCheckThreads == 0) {
+        return;
+    }
+    CReplayTimer timer(ReplayPhase::INPUT_FETCH);
+
+    std::unordered_set<uint256, SaltedTxidHasher> setBlockTxids;
+    for (const auto &tx : block.vtx) {
+        setBlockTxids.insert(tx->GetId());
+    }
+
+    std::vector<COutPoint> vOutPoints;
+    for (const auto &tx : block.vtx) {
+        if (tx->IsCoinBase()) {
+            continue;
+        }
+        for (const CTxIn &txin : tx->vin) {
+            if (!setBlockTxids.count(txin.prevout.hash) &&
+                !pcoinsTip->HaveCoinInCache(txin.prevout)) {
+                vOutPoints.push_back(txin.prevout);
+            }
+        }
+    }
+    if (vOutPoints.size() < 2) {
+        return;
+    }
+
+    const CCoinsView &backend = *pcoinsTip->GetBackend();
+    std::vector<Coin> vCoins(vOutPoints.size());
+    std::vector<CCoinPrefetch> vChecks;
+    vChecks.reserve(vOutPoints.size());
+    for (size_t i = 0; i < vOutPoints.size(); i++) {
+        vChecks.emplace_back(backend, vOutPoints[i], &vCoins[i]);
+    }
+    CCheckQueueControl<CCoinPrefetch> control(&prefetchqueue);
+    control.Add(vChecks);
+    control.Wait();
+
+    for (size_t i = 0; i < vOutPoints.size(); i++) {
+        if (!vCoins[i].IsSpent()) {
+            pcoinsTip->AddFetchedCoin(vOutPoints[i], std::move(vCoins[i]));
+        }
+    }
+}
+
+namespace {
+
+/** A block about to be disconnected, together with its undo data. */
+struct DisconnectReadData {
+    const CBlockIndex *pindex;
+    CBlock block;
+    CBlockUndo blockUndo;
+    //! Whether block and blockUndo hold the data read from disk
+    bool fRead;
+    //! Whether to run CheckBlock on the block once read. If it passes, the
+    //! block is marked as checked, so the caller's own call returns at once.
+    bool fCheck;
+
+    DisconnectReadData(const CBlockIndex *pindexIn, bool fCheckIn)
+        : pindex(pindexIn), fRead(false), fCheck(fCheckIn) {}
+};
+
+/** Closure reading one block and its undo data ahead of DisconnectTip. */
+class CDisconnectRead {
+private:
+    const Config *config;
+    DisconnectReadData *pdata;
+
+public:
+    CDisconnectRead() : config(nullptr), pdata(nullptr) {}
+    CDisconnectRead(const Config &configIn, DisconnectReadData &dataIn)
+        : config(&configIn), pdata(&dataIn) {}
+
+    bool operator()() {
+        const CBlockIndex *pindex = pdata->pindex;
+        CDiskBlockPos pos = pindex->GetUndoPos();
+        pdata->fRead =
+            !pos.IsNull() && ReadBlockFromDisk(pdata->block, pindex, *config) &&
+            UndoReadFromDisk(pdata->blockUndo, pos,
+                             pindex->pprev->GetBlockHash());
+        if (pdata->fRead && pdata->fCheck) {
+            CValidationState state;
+            CheckBlock(*config, pdata->block, state);
+        }
+        return true;
+    }
+
+    void swap(CDisconnectRead &check) {
+        std::swap(config, check.config);
+        std::swap(pdata, check.pdata);
+    }
+};
+}
+
+static CCheckQueue<CDisconnectRead> disconnectreadqueue(1);
+
+void ThreadDisconnectRead() {
+    RenameThread("bitcoin-disconrd");
+    disconnectreadqueue.Thread();
+}
+
+/**
+ * Read the next blocks to be disconnected on the way down from pindexFrom to
+ * pindexFork, along with their undo data, with parallel reads. The genesis
+ * block, which has no undo data, is never included. Entries that could not be
+ * read have fRead unset, and callers read those themselves so that any error
+ * is reported the usual way. With fCheckBlocks, the read threads also run
+ * CheckBlock, see DisconnectReadData::fCheck.
+ */
+static std::vector<DisconnectReadData>
+ReadBlocksForDisconnect(const Config &config, const CBlockIndex *pindexFrom,
+                        const CBlockIndex *pindexFork,
+                        bool fCheckBlocks = false) {
+    AssertLockHeld(cs_main);
+    std::vector<DisconnectReadData> vData;
+    for (const CBlockIndex *pindex = pindexFrom;
+         pindex && pindex->pprev && pindex != pindexFork &&
+         vData.size() < DISCONNECT_READ_BATCH_SIZE;
+         pindex = pindex->pprev) {
+        vData.emplace_back(pindex, fCheckBlocks);
+    }
+    if (nScriptCheckThreads == 0 || vData.size() < 2) {
+        return vData;
+    }
+
+    std::vector<CDisconnectRead> vChecks;
+    vChecks.reserve(vData.size());
+    for (auto &data : vData) {
+        vChecks.emplace_back(config, data);
+    }
+    CCheckQueueControl<CDisconnectRead> control(&disconnectreadqueue);
+    control.Add(vChecks);
+    control.Wait();
+    return vData;
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -1732,12 +2601,111 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
+/** Deposit index entries of the locked outputs created by a block */
+static DepositIndexEntries GetDepositIndexEntries(const CBlock &block,
+                                                  int nHeight) {
+    DepositIndexEntries entries;
+    for (const auto &tx : block.vtx) {
+        // Coinbase outputs only wait for COINBASE_MATURITY.
+        if (tx->IsCoinBase()) {
+            continue;
+        }
+        for (size_t i = 0; i < tx->vout.size(); i++) {
+            const CTxOut &out = tx->vout[i];
+            if (!HasLockInterest(out)) {
+                continue;
+            }
+            // Spendable once confirmations exceed nLockTime, see
+            // CheckTxInputs.
+            uint32_t nUnlockHeight = nHeight + out.nLockTime + 1;
+            CAmount nInterest = 0;
+            if (out.nPrincipal > 0 && out.nValue > out.nPrincipal) {
+                nInterest = out.nValue - out.nPrincipal;
+            }
+            entries.emplace_back(
+                CDepositIndexKey(nUnlockHeight,
+                                 COutPoint(tx->GetId(), i, out.nValue)),
+                CDepositIndexValue(out.nPrincipal, nInterest));
+        }
+    }
+    return entries;
+}
+
+/**
+ * Tell the listeners about the deposits block creates, and those that unlock
+ * with it.
+ */
+static void NotifyBlockDeposits(const CBlockIndex *pindex,
+                                const CBlock &block) {
+    if (GetMainSignals().BlockDeposits.empty()) {
+        return;
+    }
+    // A deposit unlocking at the next height can go into the next block.
+    DepositIndexEntries unlocked;
+    if (fDepositIndex &&
+        !pblocktree->ReadDepositIndex(pindex->nHeight + 1,
+                                      pindex->nHeight + 2, unlocked)) {
+        LogPrintf("%s: failed to read the deposits unlocking at %d\n",
+                  __func__, pindex->nHeight + 1);
+        unlocked.clear();
+    }
+    GetMainSignals().BlockDeposits(
+        pindex, GetDepositIndexEntries(block, pindex->nHeight), unlocked);
+}
+
+namespace {
+//! Input checks of a block transaction that AcceptToMemoryPool already did.
+struct MempoolInputsCheck {
+    bool fChecked = false;
+    CAmount nFee = 0;
+    int64_t nSigOpsCount = 0;
+};
+} // namespace
+
+/**
+ * Finds which transactions of a block on top of pindexPrev had their inputs
+ * checked when they entered the mempool. Their coins were confirmed at an
+ * ancestor of pindexPrev, so the block spends the very same coins (those
+ * can't be spent and created again unless a txid repeats, which BIP30
+ * rules out), only deeper in the chain, which maturity checks can't fail.
+ */
+static std::vector<MempoolInputsCheck>
+GetMempoolInputsChecks(const CBlock &block, const CBlockIndex *pindexPrev) {
+    std::vector<MempoolInputsCheck> vChecks(block.vtx.size());
+    if (!pindexPrev) {
+        return vChecks;
+    }
+
+    LOCK(mempool.cs);
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        CTxMemPool::txiter it = mempool.mapTx.find(block.vtx[i]->GetId());
+        if (it == mempool.mapTx.end()) {
+            continue;
+        }
+        const CBlockIndex *pindexChecked = it->GetInputsChecked();
+        if (!pindexChecked ||
+            pindexPrev->GetAncestor(pindexChecked->nHeight) != pindexChecked) {
+            continue;
+        }
+        vChecks[i].fChecked = true;
+        vChecks[i].nFee = it->GetFee();
+        vChecks[i].nSigOpsCount = it->GetSigOpCount();
+    }
+    return vChecks;
+}
+
 /**
  * Apply the effects of this block (with given index) on the UTXO set
  * represented by coins. Validity checks that depend on the UTXO set are also
  * done; ConnectBlock() can fail if those validity checks fail (among other
  * reasons).
  */
+/**
+ * Memory for what ConnectBlock allocates per block, like the script checks,
+ * given back all at once when it returns. Guarded by cs_main.
+ */
+static MonotonicArena blockArena;
+
 static bool ConnectBlock(const Config &config, const CBlock &block,
                          CValidationState &state, CBlockIndex *pindex,
                          CCoinsViewCache &view, const CChainParams &chainparams,
@@ -1876,51 +2844,66 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
 
     CBlockUndo blockundo;
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks ? &scriptcheckqueue
-                                                           : nullptr);
+    // Declared first, so the arena is only released once control has waited
+    // for the checks.
+    const MonotonicArena::Scope arenaScope(blockArena);
+
+    // The script checks point into this, so it must outlive control.
+    std::vector<PrecomputedTransactionData,
+                ArenaAllocator<PrecomputedTransactionData>>
+        txdata(block.vtx.size(), PrecomputedTransactionData(),
+               ArenaAllocator<PrecomputedTransactionData>(&blockArena));
+    CCheckQueueControl<CScriptCheck, CWorkStealingCheckQueue<CScriptCheck>>
+        control(fScriptChecks ? &scriptcheckqueue : nullptr);
 
-    std::vector<int> prevheights;
     CAmount nFees(0);
     int nInputs = 0;
 
-    // Sigops counting. We need to do it again because of P2SH.
+    // Sigops counting. We need to do it again because of P2SH. The sigop
+    // limits are consensus rules, so unlike scripts they are checked in the
+    // assumed valid history too.
     uint64_t nSigOpsCount = 0;
-    const uint64_t currentBlockSize =
-        ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
-    const uint64_t nMaxSigOpsCount = GetMaxBlockSigOpsCount(currentBlockSize);
+    const uint64_t nMaxSigOpsCount = GetMaxBlockSigOpsCount(
+        ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+
+    // Interest is checked against the interest rates in the assumed valid
+    // history too: a block's nChainInterest only adds up the claims of its
+    // own transactions, it bounds nothing.
+    // GetTxInterest doesn't look the rates up for transactions without
+    // deposits, most of them.
+    // The view is at pindex->pprev, so this is GetSpendHeight(view).
+    const int nSpendHeight = pindex->nHeight;
 
-    CDiskTxPos pos(pindex->GetBlockPos(),
-                   GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
-    vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
 
+    const std::vector<MempoolInputsCheck> vMempoolChecks =
+        GetMempoolInputsChecks(block, pindex->pprev);
+
     CAmount totalInterest = 0;
     for (size_t i = 0; i < block.vtx.size(); i++) {
         const CTransaction &tx = *(block.vtx[i]);
+        const MempoolInputsCheck &mempoolCheck = vMempoolChecks[i];
 
         nInputs += tx.vin.size();
 
-        if (!tx.IsCoinBase()) {
-            if (!view.HaveInputs(tx)) {
-                return state.DoS(
-                    100, error("ConnectBlock(): inputs missing/spent"),
-                    REJECT_INVALID, "bad-txns-inputs-missingorspent");
-            }
-
-            // Check that transaction is BIP68 final BIP68 lock checks (as
-            // opposed to nLockTime checks) must be in ConnectBlock because they
-            // require the UTXO set.
-            prevheights.resize(tx.vin.size());
-            for (size_t j = 0; j < tx.vin.size(); j++) {
-                prevheights[j] = view.AccessCoin(tx.vin[j].prevout).GetHeight();
-            }
+        bool fHaveInputs;
+        {
+            CReplayTimer timer(ReplayPhase::INPUT_FETCH);
+            fHaveInputs = tx.IsCoinBase() || view.HaveInputs(tx);
+        }
+        if (!fHaveInputs) {
+            return state.DoS(100, error("ConnectBlock(): inputs missing/spent"),
+                             REJECT_INVALID, "bad-txns-inputs-missingorspent");
         }
 
         // GetTransactionSigOpCount counts 2 types of sigops:
         // * legacy (always)
         // * p2sh (when P2SH enabled in flags and excludes coinbase)
-        auto txSigOpsCount = GetTransactionSigOpCount(tx, view, flags);
+        // The mempool counted with STANDARD_SCRIPT_VERIFY_FLAGS, so with P2SH.
+        auto txSigOpsCount =
+            mempoolCheck.fChecked && (flags & SCRIPT_VERIFY_P2SH)
+                ? mempoolCheck.nSigOpsCount
+                : GetTransactionSigOpCount(tx, view, flags);
         if (txSigOpsCount > MAX_TX_SIGOPS_COUNT) {
             return state.DoS(100, false, REJECT_INVALID, "bad-txn-sigops");
         }
@@ -1932,17 +2915,36 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
         }
 
         if (!tx.IsCoinBase()) {
-            CAmount fee = view.GetValueIn(tx) - tx.GetValueOutWithoutInterest();
+            CAmount fee;
+            if (mempoolCheck.fChecked) {
+                // Only the interest depends on more than the coins' depth.
+                fee = mempoolCheck.nFee;
+                CAmount nValueIn = fee + tx.GetValueOutWithoutInterest();
+                if (nValueIn + GetTxInterest(tx, nSpendHeight) <
+                    tx.GetValueOut()) {
+                    return state.DoS(
+                        100, error("ConnectBlock(): value in below out"),
+                        REJECT_INVALID, "bad-txns-in-belowout");
+                }
+            } else {
+                if (!Consensus::CheckTxInputs(tx, state, view, nSpendHeight)) {
+                    return error(
+                        "ConnectBlock(): CheckInputs on %s failed with %s",
+                        tx.GetId().ToString(), FormatStateMessage(state));
+                }
+                fee = view.GetValueIn(tx) - tx.GetValueOutWithoutInterest();
+            }
             nFees += fee;
 
             // Don't cache results if we're actually connecting blocks (still
             // consult the cache, though).
             bool fCacheResults = fJustCheck;
 
-            std::vector<CScriptCheck> vChecks;
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags,
-                             fCacheResults, fCacheResults,
-                             PrecomputedTransactionData(tx), &vChecks)) {
+            std::vector<CScriptCheck, ArenaAllocator<CScriptCheck>> vChecks(
+                (ArenaAllocator<CScriptCheck>(&blockArena)));
+            if (fScriptChecks &&
+                !CheckInputScripts(tx, state, view, flags, fCacheResults,
+                                   fCacheResults, txdata[i], &vChecks)) {
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                              tx.GetId().ToString(), FormatStateMessage(state));
             }
@@ -1955,11 +2957,9 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
         }
+        CReplayTimer timer(ReplayPhase::UPDATE_COINS);
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(),
                     pindex->nHeight);
-
-        vPos.push_back(std::make_pair(tx.GetId(), pos));
-        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
 
     if ( pindex->pprev != NULL ) {
@@ -1989,7 +2989,29 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
                          REJECT_INVALID, "bad-cb-amount");
     }
 
-    if (!control.Wait()) {
+    // Serialize the undo data while the script checks are still running, it
+    // is only written once they pass. It is sized first so that it is
+    // serialized without reallocating.
+    const bool fWriteUndo = !fJustCheck && pindex->GetUndoPos().IsNull();
+    std::vector<uint8_t> vchUndo;
+    uint256 hashUndoChecksum;
+    if (fWriteUndo) {
+        CReplayTimer timer(ReplayPhase::UNDO_WRITE);
+        vchUndo.reserve(
+            ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION));
+        CVectorWriter(SER_DISK, CLIENT_VERSION, vchUndo, 0, blockundo);
+        if (pindex->nHeight > 0) {
+            hashUndoChecksum =
+                GetUndoChecksum(vchUndo, pindex->pprev->GetBlockHash());
+        }
+    }
+
+    bool fScriptsValid;
+    {
+        CReplayTimer timer(ReplayPhase::SCRIPT_CHECKS);
+        fScriptsValid = control.Wait();
+    }
+    if (!fScriptsValid) {
         return state.DoS(100, false, REJECT_INVALID, "blk-bad-inputs", false,
                          "parallel script check failed");
     }
@@ -2008,16 +3030,14 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() ||
         !pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
-        if (pindex->GetUndoPos().IsNull()) {
+        if (fWriteUndo) {
             CDiskBlockPos _pos;
-            if (!FindUndoPos(
-                    state, pindex->nFile, _pos,
-                    ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) +
-                        40)) {
+            if (!FindUndoPos(state, pindex->nFile, _pos,
+                             vchUndo.size() + 40)) {
                 return error("ConnectBlock(): FindUndoPos failed");
             }
             if (pindex->nHeight > 0) {
-                if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(),
+                if (!UndoWriteToDisk(vchUndo, hashUndoChecksum, _pos,
                                      chainparams.DiskMagic())) {
                     return AbortNode(state, "Failed to write undo data");
                 }
@@ -2032,8 +3052,9 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (fTxIndex && !pblocktree->WriteTxIndex(vPos)) {
-        return AbortNode(state, "Failed to write transaction index");
+    if (fDepositIndex && !pblocktree->WriteDepositIndex(GetDepositIndexEntries(
+                             block, pindex->nHeight))) {
+        return AbortNode(state, "Failed to write deposit index");
     }
 
     // add this block to the view's block chain
@@ -2057,40 +3078,84 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
     return true;
 }
 
+size_t BlockIndexMemoryUsage() {
+    AssertLockHeld(cs_main);
+    return blockIndexArena.DynamicMemoryUsage() +
+           memusage::DynamicUsage(mapBlockIndex);
+}
+
+/** Publish the counters of the coins cache to /metrics, cs_main held */
+static void UpdateCoinsCacheMetrics() {
+    static CMetricValue &hits = metrics.Value(
+        CMetricsRegistry::COUNTER, "platopia_coins_cache_hits_total",
+        "Coins looked up and found in the coins cache.");
+    static CMetricValue &misses = metrics.Value(
+        CMetricsRegistry::COUNTER, "platopia_coins_cache_misses_total",
+        "Coins looked up and read from the coins database.");
+    static CMetricValue &size = metrics.Value(
+        CMetricsRegistry::GAUGE, "platopia_coins_cache_size",
+        "Coins in the coins cache.");
+    static CMetricValue &bytes = metrics.Value(
+        CMetricsRegistry::GAUGE, "platopia_coins_cache_bytes",
+        "Memory used by the coins cache, in bytes.");
+    if (!pcoinsTip) {
+        return;
+    }
+    hits.Set(pcoinsTip->GetCacheHits());
+    misses.Set(pcoinsTip->GetCacheMisses());
+    size.Set(pcoinsTip->GetCacheSize());
+    bytes.Set(pcoinsTip->DynamicMemoryUsage());
+}
+
+/**
+ * Write the blocks and undo data, then the block file information and the
+ * block index entries that changed. Requires cs_main and cs_LastBlockFile.
+ */
+static bool WriteBlockIndex(CValidationState &state) {
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_LastBlockFile);
+    // Depend on nMinDiskSpace to ensure we can write block index
+    if (!CheckDiskSpace(0)) return state.Error("out of disk space");
+    // First make sure all block and undo data is flushed to disk.
+    FlushBlockFile();
+    // Then update all block file information (which may refer to block
+    // and undo files).
+    std::vector<std::pair<int, const CBlockFileInfo *>> vFiles;
+    vFiles.reserve(setDirtyFileInfo.size());
+    for (std::set<int>::iterator it = setDirtyFileInfo.begin();
+         it != setDirtyFileInfo.end();) {
+        vFiles.push_back(std::make_pair(*it, &vinfoBlockFile[*it]));
+        setDirtyFileInfo.erase(it++);
+    }
+    std::vector<const CBlockIndex *> vBlocks;
+    vBlocks.reserve(setDirtyBlockIndex.size());
+    for (std::set<CBlockIndex *>::iterator it = setDirtyBlockIndex.begin();
+         it != setDirtyBlockIndex.end();) {
+        vBlocks.push_back(*it);
+        setDirtyBlockIndex.erase(it++);
+    }
+    if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
+        return AbortNode(state, "Failed to write to block index database");
+    }
+    return true;
+}
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed depending on the mode we're called with if
- * they're too large, if it's been a while since the last write, or always and
- * in all cases if we're in prune mode and are deleting files.
+ * they're too large, if it's been a while since the last write, or always, and
+ * when the pruner waits for the coin database to get past the blocks to prune.
+ * Block files themselves are pruned by the pruner thread, which this wakes up.
  */
-static bool FlushStateToDisk(CValidationState &state, FlushStateMode mode,
-                             int nManualPruneHeight) {
+static bool FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
+    CReplayTimer timer(ReplayPhase::FLUSH);
     int64_t nMempoolUsage = mempool.DynamicMemoryUsage();
-    const CChainParams &chainparams = Params();
     LOCK2(cs_main, cs_LastBlockFile);
     static int64_t nLastWrite = 0;
     static int64_t nLastFlush = 0;
     static int64_t nLastSetChain = 0;
-    std::set<int> setFilesToPrune;
-    bool fFlushForPrune = false;
+    bool fFlushForPruneNow = fPruneMode && fFlushForPrune.exchange(false);
     try {
-        if (fPruneMode && (fCheckForPruning || nManualPruneHeight > 0) &&
-            !fReindex) {
-            if (nManualPruneHeight > 0) {
-                FindFilesToPruneManual(setFilesToPrune, nManualPruneHeight);
-            } else {
-                FindFilesToPrune(setFilesToPrune,
-                                 chainparams.PruneAfterHeight());
-                fCheckForPruning = false;
-            }
-            if (!setFilesToPrune.empty()) {
-                fFlushForPrune = true;
-                if (!fHavePruned) {
-                    pblocktree->WriteFlag("prunedblockfiles", true);
-                    fHavePruned = true;
-                }
-            }
-        }
         int64_t nNow = GetTimeMicros();
         // Avoid writing/flushing immediately after startup.
         if (nLastWrite == 0) {
@@ -2104,8 +3169,10 @@ static bool FlushStateToDisk(CValidationState &state, FlushStateMode mode,
         }
         int64_t nMempoolSizeMax =
             GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-        int64_t cacheSize =
-            pcoinsTip->DynamicMemoryUsage() * DB_PEAK_USAGE_FACTOR;
+        // A snapshot still being written takes memory as well.
+        int64_t cacheSize = (pcoinsTip->DynamicMemoryUsage() +
+                             pcoinsWriter->DynamicMemoryUsage()) *
+                            DB_PEAK_USAGE_FACTOR;
         int64_t nTotalSpace =
             nCoinCacheUsage +
             std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
@@ -2136,39 +3203,13 @@ static bool FlushStateToDisk(CValidationState &state, FlushStateMode mode,
             nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
         // Combine all conditions that result in a full cache flush.
         bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge ||
-                            fCacheCritical || fPeriodicFlush || fFlushForPrune;
+                            fCacheCritical || fPeriodicFlush ||
+                            fFlushForPruneNow;
         // Write blocks and block index to disk.
         if (fDoFullFlush || fPeriodicWrite) {
-            // Depend on nMinDiskSpace to ensure we can write block index
-            if (!CheckDiskSpace(0)) return state.Error("out of disk space");
-            // First make sure all block and undo data is flushed to disk.
-            FlushBlockFile();
-            // Then update all block file information (which may refer to block
-            // and undo files).
-            {
-                std::vector<std::pair<int, const CBlockFileInfo *>> vFiles;
-                vFiles.reserve(setDirtyFileInfo.size());
-                for (std::set<int>::iterator it = setDirtyFileInfo.begin();
-                     it != setDirtyFileInfo.end();) {
-                    vFiles.push_back(std::make_pair(*it, &vinfoBlockFile[*it]));
-                    setDirtyFileInfo.erase(it++);
-                }
-                std::vector<const CBlockIndex *> vBlocks;
-                vBlocks.reserve(setDirtyBlockIndex.size());
-                for (std::set<CBlockIndex *>::iterator it =
-                         setDirtyBlockIndex.begin();
-                     it != setDirtyBlockIndex.end();) {
-                    vBlocks.push_back(*it);
-                    setDirtyBlockIndex.erase(it++);
-                }
-                if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile,
-                                                vBlocks)) {
-                    return AbortNode(state,
-                                     "Failed to write to block index database");
-                }
+            if (!WriteBlockIndex(state)) {
+                return false;
             }
-            // Finally remove any pruned files
-            if (fFlushForPrune) UnlinkPrunedFiles(setFilesToPrune);
             nLastWrite = nNow;
         }
         // Flush best chain related state. This can only be done if the blocks /
@@ -2183,10 +3224,35 @@ static bool FlushStateToDisk(CValidationState &state, FlushStateMode mode,
                 return state.Error("out of disk space");
             }
             // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush()) {
-                return AbortNode(state, "Failed to write to coin database");
+            // It is written in the background, unless this has to be on disk
+            // when we return. The pruner only deletes the blocks that the
+            // write on disk doesn't need to be replayed.
+            bool fSync = mode == FLUSH_STATE_ALWAYS;
+            const size_t nCoins = pcoinsTip->GetCacheSize();
+            const size_t nCoinsUsage = pcoinsTip->DynamicMemoryUsage();
+            if (fSync) {
+                if (!pcoinsTip->Flush() || !pcoinsWriter->Sync()) {
+                    return AbortNode(state, "Failed to write to coin database");
+                }
+                pcoinsTip->ReallocateCache();
+            } else {
+                // Keep the coins used last, so the next blocks don't start
+                // from a cold cache.
+                size_t nKeepUsage = nTotalSpace / DB_PEAK_USAGE_FACTOR *
+                                    COINS_CACHE_KEEP_PERCENT / 100;
+                if (!pcoinsTip->FlushPartial(nKeepUsage)) {
+                    return AbortNode(state, "Failed to write to coin database");
+                }
             }
             nLastFlush = nNow;
+            const int64_t nFlushMicros = GetTimeMicros() - nNow;
+            static CMetricHistogram &flushTime = metrics.Histogram(
+                "platopia_coins_flush_seconds",
+                "Time to write the coins cache to the coins database.",
+                GetShortLatencyBounds());
+            flushTime.Observe(nFlushMicros);
+            TRACE5(validation, flush_coins, int(mode), fSync, nCoins,
+                   nCoinsUsage, nFlushMicros);
         }
         if (fDoFullFlush ||
             ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) &&
@@ -2200,6 +3266,10 @@ static bool FlushStateToDisk(CValidationState &state, FlushStateMode mode,
         return AbortNode(state, std::string("System error while flushing: ") +
                                     e.what());
     }
+    UpdateCoinsCacheMetrics();
+    if (fCheckForPruning && g_blockpruner) {
+        g_blockpruner->Wake();
+    }
     return true;
 }
 
@@ -2219,6 +3289,9 @@ static void UpdateTip(const Config &config, CBlockIndex *pindexNew) {
     const CChainParams &chainParams = config.GetChainParams();
 
     chainActive.SetTip(pindexNew);
+    UpdateChainSnapshot();
+    ResetInterestPeriodCache();
+    UpdateInterestHistory();
 
     // New best block
     mempool.AddTransactionsUpdated(1);
@@ -2298,26 +3371,40 @@ static void UpdateTip(const Config &config, CBlockIndex *pindexNew) {
 }
 
 /**
- * Disconnect chainActive's tip. You probably want to call
- * mempool.removeForReorg and manually re-limit mempool size after this, with
- * cs_main held.
+ * Disconnect chainActive's tip.
+ * After calling, the mempool will be in an inconsistent state, with
+ * transactions from disconnected blocks being added to disconnectpool. You
+ * should make the mempool consistent again by calling UpdateMempoolForReorg,
+ * with cs_main held.
+ *
+ * If disconnectpool is nullptr, then no disconnected transactions are added to
+ * disconnectpool (note that the caller is responsible for mempool consistency
+ * in any case). If pread holds the tip's block and undo data, as read by
+ * ReadBlocksForDisconnect, they are used instead of reading them again.
  */
 static bool DisconnectTip(const Config &config, CValidationState &state,
-                          bool fBare = false) {
+                          DisconnectedBlockTransactions *disconnectpool,
+                          const DisconnectReadData *pread = nullptr) {
     CBlockIndex *pindexDelete = chainActive.Tip();
     assert(pindexDelete);
+    assert(!pread || (pread->fRead && pread->pindex == pindexDelete));
 
-    // Read block from disk.
-    CBlock block;
-    if (!ReadBlockFromDisk(block, pindexDelete, config)) {
+    // Read block from disk, unless it was read ahead of time.
+    CBlock blockRead;
+    if (!pread && !ReadBlockFromDisk(blockRead, pindexDelete, config)) {
         return AbortNode(state, "Failed to read block");
     }
+    const CBlock &block = pread ? pread->block : blockRead;
 
     // Apply the block atomically to the chain state.
     int64_t nStart = GetTimeMicros();
     {
         CCoinsViewCache view(pcoinsTip);
-        if (DisconnectBlock(block, pindexDelete, view) != DISCONNECT_OK) {
+        view.TrackStats();
+        DisconnectResult res =
+            pread ? ApplyBlockUndo(pread->blockUndo, block, pindexDelete, view)
+                  : DisconnectBlock(block, pindexDelete, view);
+        if (res != DISCONNECT_OK) {
             return error("DisconnectTip(): DisconnectBlock %s failed",
                          pindexDelete->GetBlockHash().ToString());
         }
@@ -2326,6 +3413,13 @@ static bool DisconnectTip(const Config &config, CValidationState &state,
         assert(flushed);
     }
 
+    // Not in DisconnectBlock, which VerifyDB also runs on a scratch view.
+    if (fDepositIndex &&
+        !pblocktree->EraseDepositIndex(
+            GetDepositIndexEntries(block, pindexDelete->nHeight))) {
+        return AbortNode(state, "Failed to write deposit index");
+    }
+
     LogPrint("bench", "- Disconnect block: %.2fms\n",
              (GetTimeMicros() - nStart) * 0.001);
 
@@ -2334,27 +3428,19 @@ static bool DisconnectTip(const Config &config, CValidationState &state,
         return false;
     }
 
-    if (!fBare) {
-        // Resurrect mempool transactions from the disconnected block.
-        std::vector<uint256> vHashUpdate;
-        for (const auto &it : block.vtx) {
-            const CTransaction &tx = *it;
-            // ignore validation errors in resurrected transactions
-            CValidationState stateDummy;
-            if (tx.IsCoinBase() ||
-                !AcceptToMemoryPool(config, mempool, stateDummy, it, false,
-                                    nullptr, nullptr, true)) {
-                mempool.removeRecursive(tx, MemPoolRemovalReason::REORG);
-            } else if (mempool.exists(tx.GetId())) {
-                vHashUpdate.push_back(tx.GetId());
-            }
+    if (disconnectpool) {
+        // Save transactions to re-add to mempool at end of reorg
+        for (auto it = block.vtx.rbegin(); it != block.vtx.rend(); ++it) {
+            disconnectpool->addTransaction(*it);
+        }
+        while (disconnectpool->DynamicMemoryUsage() >
+               MAX_DISCONNECTED_TX_POOL_SIZE * 1000) {
+            // Drop the earliest entry, and remove its children from the
+            // mempool.
+            auto it = disconnectpool->queuedTx.get<insertion_order>().begin();
+            mempool.removeRecursive(**it, MemPoolRemovalReason::REORG);
+            disconnectpool->removeEntry(it);
         }
-        // AcceptToMemoryPool/addUnchecked all assume that new mempool entries
-        // have no in-mempool children, which is generally not true when adding
-        // previously-confirmed transactions back to the mempool.
-        // UpdateTransactionsFromBlock finds descendants of any transactions in
-        // this block that were added back and cleans up the mempool state.
-        mempool.UpdateTransactionsFromBlock(vHashUpdate);
     }
 
     // Update chainActive and related variables.
@@ -2363,12 +3449,67 @@ static bool DisconnectTip(const Config &config, CValidationState &state,
     // 0-confirmed or conflicted:
     for (const auto &tx : block.vtx) {
         GetMainSignals().SyncTransaction(
-            *tx, pindexDelete->pprev,
+            tx, pindexDelete->pprev,
             CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
     }
     return true;
 }
 
+/**
+ * Make mempool consistent after a reorg, by re-adding or recursively erasing
+ * disconnected block transactions from the mempool, and also removing any
+ * other transactions from the mempool that are no longer valid given the new
+ * tip/height.
+ *
+ * Note: we assume that disconnectpool only contains transactions that are NOT
+ * confirmed in the current chain nor already in the mempool (otherwise,
+ * in-mempool descendants of such transactions would be removed).
+ *
+ * Passing fAddToMempool=false will skip trying to add the transactions back,
+ * and instead just erase from the mempool as needed.
+ */
+static void UpdateMempoolForReorg(const Config &config,
+                                  DisconnectedBlockTransactions &disconnectpool,
+                                  bool fAddToMempool) {
+    AssertLockHeld(cs_main);
+    std::vector<uint256> vHashUpdate;
+    // disconnectpool's insertion_order index sorts the entries from oldest to
+    // newest, but the oldest entry will be the last tx from the latest mined
+    // block that was disconnected.
+    // Iterate disconnectpool in reverse, so that we add transactions back to
+    // the mempool starting with the earliest transaction that had been
+    // previously seen in a block.
+    auto it = disconnectpool.queuedTx.get<insertion_order>().rbegin();
+    while (it != disconnectpool.queuedTx.get<insertion_order>().rend()) {
+        // ignore validation errors in resurrected transactions
+        CValidationState stateDummy;
+        if (!fAddToMempool || (*it)->IsCoinBase() ||
+            !AcceptToMemoryPool(config, mempool, stateDummy, *it, false,
+                                nullptr, nullptr, true)) {
+            // If the transaction doesn't make it in to the mempool, remove any
+            // transactions that depend on it (which would now be orphans).
+            mempool.removeRecursive(**it, MemPoolRemovalReason::REORG);
+        } else if (mempool.exists((*it)->GetId())) {
+            vHashUpdate.push_back((*it)->GetId());
+        }
+        ++it;
+    }
+    disconnectpool.clear();
+    // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
+    // no in-mempool children, which is generally not true when adding
+    // previously-confirmed transactions back to the mempool.
+    // UpdateTransactionsFromBlock finds descendants of any transactions in the
+    // disconnectpool that were added back and cleans up the mempool state.
+    mempool.UpdateTransactionsFromBlock(vHashUpdate);
+
+    // We also need to remove any now-immature transactions
+    mempool.removeForReorg(config, pcoinsTip, chainActive.Tip()->nHeight + 1);
+    // Re-limit mempool size, in case we added any transactions
+    LimitMempoolSize(
+        mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000,
+        GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+}
+
 static int64_t nTimeReadFromDisk = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
@@ -2391,11 +3532,15 @@ struct ConnectTrace {
  * The block is always added to connectTrace (either after loading from disk or
  * by copying pblock) - if that is not intended, care must be taken to remove
  * the last entry in blocksConnected in case of failure.
+ *
+ * The block's transactions are removed from disconnectpool, as they are
+ * confirmed again and need not be resurrected.
  */
 static bool ConnectTip(const Config &config, CValidationState &state,
                        CBlockIndex *pindexNew,
                        const std::shared_ptr<const CBlock> &pblock,
-                       ConnectTrace &connectTrace) {
+                       ConnectTrace &connectTrace,
+                       DisconnectedBlockTransactions &disconnectpool) {
     const CChainParams &chainparams = config.GetChainParams();
     assert(pindexNew->pprev == chainActive.Tip());
     // Read block from disk.
@@ -2417,10 +3562,20 @@ static bool ConnectTip(const Config &config, CValidationState &state,
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n",
              (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    TRACE3(validation, block_connect_start, pindexNew->phashBlock->begin(),
+           pindexNew->nHeight, blockConnecting.vtx.size());
+    PrefetchInputs(blockConnecting);
+    int64_t nTimePrefetch = GetTimeMicros();
+    LogPrint("bench", "  - Prefetch inputs: %.2fms\n",
+             (nTimePrefetch - nTime2) * 0.001);
     {
         CCoinsViewCache view(pcoinsTip);
+        view.TrackStats();
         bool rv = ConnectBlock(config, blockConnecting, state, pindexNew, view,
                                chainparams);
+        TRACE5(validation, block_connected, pindexNew->phashBlock->begin(),
+               pindexNew->nHeight, blockConnecting.vtx.size(), rv,
+               GetTimeMicros() - nTime2);
         GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
             if (state.IsInvalid()) {
@@ -2433,6 +3588,7 @@ static bool ConnectTip(const Config &config, CValidationState &state,
         nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n",
                  (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
+        CReplayTimer timer(ReplayPhase::UPDATE_COINS);
         bool flushed = view.Flush();
         assert(flushed);
     }
@@ -2447,9 +3603,11 @@ static bool ConnectTip(const Config &config, CValidationState &state,
     LogPrint("bench", "  - Writing chainstate: %.2fms [%.2fs]\n",
              (nTime5 - nTime4) * 0.001, nTimeChainState * 0.000001);
     // Remove conflicting transactions from the mempool.;
-    mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
+    mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight, pindexNew);
+    disconnectpool.removeForBlock(blockConnecting.vtx);
     // Update chainActive & related variables.
     UpdateTip(config, pindexNew);
+    ReplayStatsBlockConnected(blockConnecting, pindexNew);
 
     int64_t nTime6 = GetTimeMicros();
     nTimePostConnect += nTime6 - nTime5;
@@ -2458,6 +3616,12 @@ static bool ConnectTip(const Config &config, CValidationState &state,
              (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
     LogPrint("bench", "- Connect block: %.2fms [%.2fs]\n",
              (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
+    static CMetricHistogram &connectTime = metrics.Histogram(
+        "platopia_block_connect_seconds",
+        "Time to connect a block to the tip, including writing the chain "
+        "state.",
+        GetShortLatencyBounds());
+    connectTime.Observe(nTime6 - nTime1);
     return true;
 }
 
@@ -2554,11 +3718,24 @@ static bool ActivateBestChainStep(const Config &config, CValidationState &state,
     const CBlockIndex *pindexOldTip = chainActive.Tip();
     const CBlockIndex *pindexFork = chainActive.FindFork(pindexMostWork);
 
-    // Disconnect active blocks which are no longer in the best chain.
+    // Disconnect active blocks which are no longer in the best chain. Blocks
+    // and undo data are read ahead in batches, and disconnected transactions
+    // are only resurrected into the mempool once the new chain is connected.
     bool fBlocksDisconnected = false;
+    DisconnectedBlockTransactions disconnectpool;
     while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
-        if (!DisconnectTip(config, state)) return false;
-        fBlocksDisconnected = true;
+        for (const DisconnectReadData &data :
+             ReadBlocksForDisconnect(config, chainActive.Tip(), pindexFork)) {
+            if (!DisconnectTip(config, state, &disconnectpool,
+                               data.fRead ? &data : nullptr)) {
+                // This is likely a fatal error, but keep the mempool
+                // consistent, just in case. Only remove from the mempool in
+                // this case.
+                UpdateMempoolForReorg(config, disconnectpool, false);
+                return false;
+            }
+            fBlocksDisconnected = true;
+        }
     }
 
     // Build list of new blocks to connect.
@@ -2585,7 +3762,7 @@ static bool ActivateBestChainStep(const Config &config, CValidationState &state,
                             pindexConnect == pindexMostWork
                                 ? pblock
                                 : std::shared_ptr<const CBlock>(),
-                            connectTrace)) {
+                            connectTrace, disconnectpool)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (!state.CorruptionPossible())
@@ -2600,6 +3777,9 @@ static bool ActivateBestChainStep(const Config &config, CValidationState &state,
                 } else {
                     // A system error occurred (disk space, database error,
                     // ...).
+                    // Make the mempool consistent with the current tip, just
+                    // in case any observers try to use it before shutdown.
+                    UpdateMempoolForReorg(config, disconnectpool, false);
                     return false;
                 }
             } else {
@@ -2616,11 +3796,9 @@ static bool ActivateBestChainStep(const Config &config, CValidationState &state,
     }
 
     if (fBlocksDisconnected) {
-        mempool.removeForReorg(config, pcoinsTip,
-                               chainActive.Tip()->nHeight + 1);
-        LimitMempoolSize(
-            mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000,
-            GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+        // If any blocks were disconnected, disconnectpool may be non empty. Add
+        // any disconnected transactions back to the mempool.
+        UpdateMempoolForReorg(config, disconnectpool, true);
     }
     mempool.check(pcoinsTip);
 
@@ -2727,8 +3905,9 @@ bool ActivateBestChain(const Config &config, CValidationState &state,
                 assert(pair.second);
                 const CBlock &block = *(pair.second);
                 for (unsigned int i = 0; i < block.vtx.size(); i++)
-                    GetMainSignals().SyncTransaction(*block.vtx[i], pair.first,
+                    GetMainSignals().SyncTransaction(block.vtx[i], pair.first,
                                                      i);
+                NotifyBlockDeposits(pair.first, block);
             }
         }
         // When we reach this point, we switched to a new tip (stored in
@@ -2794,6 +3973,7 @@ bool InvalidateBlock(const Config &config, CValidationState &state,
     setDirtyBlockIndex.insert(pindex);
     setBlockIndexCandidates.erase(pindex);
 
+    DisconnectedBlockTransactions disconnectpool;
     while (chainActive.Contains(pindex)) {
         CBlockIndex *pindexWalk = chainActive.Tip();
         pindexWalk->nStatus |= BLOCK_FAILED_CHILD;
@@ -2801,16 +3981,17 @@ bool InvalidateBlock(const Config &config, CValidationState &state,
         setBlockIndexCandidates.erase(pindexWalk);
         // ActivateBestChain considers blocks already in chainActive
         // unconditionally valid already, so force disconnect away from it.
-        if (!DisconnectTip(config, state)) {
-            mempool.removeForReorg(config, pcoinsTip,
-                                   chainActive.Tip()->nHeight + 1);
+        if (!DisconnectTip(config, state, &disconnectpool)) {
+            // It's probably hopeless to try to make the mempool consistent
+            // here if DisconnectTip failed, but we can try.
+            UpdateMempoolForReorg(config, disconnectpool, false);
             return false;
         }
     }
 
-    LimitMempoolSize(
-        mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000,
-        GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    // DisconnectTip will add transactions to disconnectpool; try to add these
+    // back to the mempool.
+    UpdateMempoolForReorg(config, disconnectpool, true);
 
     // The resulting new best tip may not be in setBlockIndexCandidates anymore,
     // so add it again.
@@ -2875,9 +4056,11 @@ CBlockIndex *AddToBlockIndex(const CBlockHeader &block) {
     BlockMap::iterator it = mapBlockIndex.find(hash);
     if (it != mapBlockIndex.end()) return it->second;
 
+    // Readers looking it up wait until it is complete.
+    LOCK(cs_blockIndexLookup);
+
     // Construct new block index object
-    CBlockIndex *pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex *pindexNew = blockIndexArena.Create(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -2913,6 +4096,42 @@ CBlockIndex *AddToBlockIndex(const CBlockHeader &block) {
  * Mark a block as having its data received and checked (up to
  * BLOCK_VALID_TRANSACTIONS).
  */
+/**
+ * Set nChainTx for pindexNew, whose parents all have it, and for the
+ * descendants that were only waiting on it, and make them candidates.
+ */
+static void LinkBlockDescendants(CBlockIndex *pindexNew) {
+    std::deque<CBlockIndex *> queue;
+    queue.push_back(pindexNew);
+
+    // Recursively process any descendant blocks that now may be eligible to
+    // be connected.
+    while (!queue.empty()) {
+        CBlockIndex *pindex = queue.front();
+        queue.pop_front();
+        pindex->nChainTx =
+            (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
+        {
+            LOCK(cs_nBlockSequenceId);
+            pindex->nSequenceId = nBlockSequenceId++;
+        }
+        if (chainActive.Tip() == nullptr ||
+            !setBlockIndexCandidates.value_comp()(pindex, chainActive.Tip())) {
+            setBlockIndexCandidates.insert(pindex);
+        }
+        std::pair<std::multimap<CBlockIndex *, CBlockIndex *>::iterator,
+                  std::multimap<CBlockIndex *, CBlockIndex *>::iterator>
+            range = mapBlocksUnlinked.equal_range(pindex);
+        while (range.first != range.second) {
+            std::multimap<CBlockIndex *, CBlockIndex *>::iterator it =
+                range.first;
+            queue.push_back(it->second);
+            range.first++;
+            mapBlocksUnlinked.erase(it);
+        }
+    }
+}
+
 bool ReceivedBlockTransactions(const CBlock &block, CValidationState &state,
                                CBlockIndex *pindexNew,
                                const CDiskBlockPos &pos) {
@@ -2928,36 +4147,7 @@ bool ReceivedBlockTransactions(const CBlock &block, CValidationState &state,
     if (pindexNew->pprev == nullptr || pindexNew->pprev->nChainTx) {
         // If pindexNew is the genesis block or all parents are
         // BLOCK_VALID_TRANSACTIONS.
-        std::deque<CBlockIndex *> queue;
-        queue.push_back(pindexNew);
-
-        // Recursively process any descendant blocks that now may be eligible to
-        // be connected.
-        while (!queue.empty()) {
-            CBlockIndex *pindex = queue.front();
-            queue.pop_front();
-            pindex->nChainTx =
-                (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
-            {
-                LOCK(cs_nBlockSequenceId);
-                pindex->nSequenceId = nBlockSequenceId++;
-            }
-            if (chainActive.Tip() == nullptr ||
-                !setBlockIndexCandidates.value_comp()(pindex,
-                                                      chainActive.Tip())) {
-                setBlockIndexCandidates.insert(pindex);
-            }
-            std::pair<std::multimap<CBlockIndex *, CBlockIndex *>::iterator,
-                      std::multimap<CBlockIndex *, CBlockIndex *>::iterator>
-                range = mapBlocksUnlinked.equal_range(pindex);
-            while (range.first != range.second) {
-                std::multimap<CBlockIndex *, CBlockIndex *>::iterator it =
-                    range.first;
-                queue.push_back(it->second);
-                range.first++;
-                mapBlocksUnlinked.erase(it);
-            }
-        }
+        LinkBlockDescendants(pindexNew);
     } else {
         if (pindexNew->pprev && pindexNew->pprev->IsValid(BLOCK_VALID_TREE)) {
             mapBlocksUnlinked.insert(
@@ -2968,6 +4158,131 @@ bool ReceivedBlockTransactions(const CBlock &block, CValidationState &state,
     return true;
 }
 
+bool ActivateUTXOSnapshot(const Config &config, CAutoFile &file,
+                          const SnapshotMetadata &metadata,
+                          std::string &strError) {
+    {
+        LOCK(cs_main);
+        if (!fPruneMode) {
+            strError = "Loading a snapshot requires -prune, the blocks below "
+                       "it are never downloaded";
+            return false;
+        }
+        if (fDepositIndex) {
+            strError = "The deposit index would miss the deposits of the "
+                       "blocks below the snapshot";
+            return false;
+        }
+        if (chainActive.Height() != 0) {
+            strError = "The chainstate must be at the genesis block";
+            return false;
+        }
+
+        BlockMap::iterator mi = mapBlockIndex.find(metadata.hashBase);
+        if (mi == mapBlockIndex.end()) {
+            strError = "Snapshot base block header not found";
+            return false;
+        }
+        CBlockIndex *pindexBase = mi->second;
+        if (pindexBase->nHeight != metadata.nHeight ||
+            pindexBase->nHeight <= 0 ||
+            (pindexBase->nStatus & BLOCK_FAILED_MASK) ||
+            pindexBestHeader->GetAncestor(pindexBase->nHeight) !=
+                pindexBase) {
+            strError = "Snapshot base block is not in the best header chain";
+            return false;
+        }
+        if (pindexBase->nChainInterest != metadata.nChainInterest) {
+            strError = "Snapshot interest doesn't match the base block";
+            return false;
+        }
+        if (metadata.nChainTx <= uint64_t(metadata.nHeight) ||
+            metadata.nChainTx > std::numeric_limits<unsigned int>::max()) {
+            strError = "Invalid snapshot transaction count";
+            return false;
+        }
+        std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsTip->Cursor());
+        if (pcursor->Valid()) {
+            strError = "The chainstate is not empty";
+            return false;
+        }
+        pcursor.reset();
+
+        // Until the block index points at the snapshot, the chainstate holds
+        // coins from blocks it hasn't connected, see AppInitMain.
+        if (!pblocktree->WriteFlag("loadingtxoutset", true)) {
+            strError = "Failed to write to the block index database";
+            return false;
+        }
+
+        int64_t nStart = GetTimeMillis();
+        uint256 hash;
+        if (!LoadUTXOSnapshotCoins(file, metadata, *pcoinsTip, nCoinCacheUsage,
+                                   hash, strError)) {
+            AbortNode(strprintf("Loading UTXO snapshot failed: %s", strError),
+                      _("Loading the UTXO snapshot failed. You need to "
+                        "rebuild the database using -reindex-chainstate."));
+            return false;
+        }
+        pcoinsTip->SetBestBlock(pindexBase->GetBlockHash());
+        if (!pcoinsTip->Flush()) {
+            AbortNode("Failed to write to coin database");
+            strError = "Failed to write to coin database";
+            return false;
+        }
+
+        // The blocks below the base get placeholder transaction counts, so
+        // their nChainTx is set and the base gets the snapshot's.
+        std::vector<CBlockIndex *> vChain;
+        for (CBlockIndex *pindex = pindexBase; pindex->pprev != nullptr;
+             pindex = pindex->pprev) {
+            vChain.push_back(pindex);
+        }
+        for (std::vector<CBlockIndex *>::reverse_iterator it = vChain.rbegin();
+             it != vChain.rend(); ++it) {
+            CBlockIndex *pindex = *it;
+            if (pindex->nTx == 0) {
+                pindex->nTx = 1;
+                if (pindex == pindexBase &&
+                    metadata.nChainTx > pindex->pprev->nChainTx) {
+                    pindex->nTx = metadata.nChainTx - pindex->pprev->nChainTx;
+                }
+            }
+            pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+            setDirtyBlockIndex.insert(pindex);
+            LinkBlockDescendants(pindex);
+        }
+
+        UpdateTip(config, pindexBase);
+        PruneBlockIndexCandidates();
+
+        // Like after pruning, there is no data for the blocks below the base.
+        fHavePruned = true;
+        pblocktree->WriteFlag("prunedblockfiles", true);
+        CValidationState state;
+        if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS)) {
+            strError = FormatStateMessage(state);
+            return false;
+        }
+        pblocktree->WriteFlag("loadingtxoutset", false);
+        CheckBlockIndex(config.GetChainParams().GetConsensus());
+
+        LogPrintf("Loaded UTXO snapshot of %u coins at %s (height %d), hash "
+                  "%s, in %dms\n",
+                  metadata.nCoins, pindexBase->GetBlockHash().ToString(),
+                  pindexBase->nHeight, hash.ToString(),
+                  GetTimeMillis() - nStart);
+    }
+
+    // Carry on with the blocks after the base.
+    CValidationState state;
+    if (!ActivateBestChain(config, state)) {
+        LogPrintf("%s: ActivateBestChain failed: %s\n", __func__,
+                  FormatStateMessage(state));
+    }
+    return true;
+}
+
 bool FindBlockPos(CValidationState &state, CDiskBlockPos &pos,
                   unsigned int nAddSize, unsigned int nHeight, uint64_t nTime,
                   bool fKnown = false) {
@@ -3068,8 +4383,10 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
 
 static bool CheckBlockHeader(const Config &config, const CBlockHeader &block,
                              CValidationState &state, bool fCheckPOW = true) {
-    // Check proof of work matches claimed amount
-    if (fCheckPOW && !CheckProofOfWork(block, config)) {
+    // Check proof of work matches claimed amount. Only the quick check, the
+    // light cache one needs the height, which ContextualCheckBlockHeader
+    // checks.
+    if (fCheckPOW && !CheckProofOfWorkQuick(block, config)) {
         return state.DoS(50, false, REJECT_INVALID, "high-hash", false,
                          "proof of work failed");
     }
@@ -3090,6 +4407,7 @@ bool CheckBlock(const Config &config, const CBlock &block,
     if (!CheckBlockHeader(config, block, state, fCheckPOW)) {
         return false;
     }
+    CReplayTimer timer(ReplayPhase::CHECK_BLOCK);
 
     // Check the merkle root.
     if (fCheckMerkleRoot) {
@@ -3216,18 +4534,30 @@ static bool ContextualCheckBlockHeader(const Config &config,
                                        const CBlockHeader &block,
                                        CValidationState &state,
                                        const CBlockIndex *pindexPrev,
-                                       int64_t nAdjustedTime) {
+                                       int64_t nAdjustedTime,
+                                       bool fCheckPOW = true) {
     const Consensus::Params &consensusParams =
         config.GetChainParams().GetConsensus();
 
     const int nHeight = pindexPrev == nullptr ? 0 : pindexPrev->nHeight + 1;
 
+    // The height picks the ethash epoch of the light cache, it has to be the
+    // right one before the proof-of-work is computed.
+    if (block.nBlockHeight != uint32_t(nHeight)) {
+        return state.DoS(100, false, REJECT_INVALID, "bad-blk-height", false,
+                         "incorrect block height");
+    }
+
     // Check proof of work
     if (block.nBits != GetNextWorkRequired(pindexPrev, &block, config)) {
         LogPrintf("bad bits after height: %d Need: %08X\n", pindexPrev->nHeight, GetNextWorkRequired(pindexPrev, &block, config));
         return state.DoS(100, false, REJECT_INVALID, "bad-diffbits", false,
                          "incorrect proof of work");
     }
+    if (fCheckPOW && !CheckProofOfWork(block, config)) {
+        return state.DoS(50, false, REJECT_INVALID, "high-hash", false,
+                         "proof of work failed");
+    }
 
     // Check timestamp against prev
     if (block.GetBlockTime() <= pindexPrev->GetMedianTimePast()) {
@@ -3396,11 +4726,79 @@ static bool AcceptBlockHeader(const Config &config, const CBlockHeader &block,
     return true;
 }
 
+/**
+ * Compute the proof-of-work of a batch of headers on the header check threads,
+ * without holding cs_main. Valid headers end up in the verified header cache,
+ * so the serial AcceptBlockHeader pass that follows doesn't redo the work.
+ * Invalid headers are simply left for AcceptBlockHeader to reject.
+ *
+ * Only the headers that connect to a valid known block, directly or through
+ * the headers before them, and carry the height and nBits expected there are
+ * computed: the light cache is picked by the height, which nothing checked
+ * before. The first header that doesn't ends the batch.
+ */
+static void PreCheckBlockHeadersPoW(const Config &config,
+                                    const std::vector<CBlockHeader> &headers) {
+    if (!fFullPowCheck || nScriptCheckThreads == 0 || headers.size() < 2) {
+        return;
+    }
+
+    std::vector<CHeaderPowCheck> vChecks;
+    vChecks.reserve(headers.size());
+    {
+        LOCK(cs_main);
+        // Stand-ins for the new headers of the batch, for GetNextWorkRequired
+        // on the ones after them. Reserved so that pprev pointers stay valid.
+        std::vector<CBlockIndex> vIndex;
+        vIndex.reserve(headers.size());
+        CBlockIndex *pindexPrev = nullptr;
+        uint256 hashPrev;
+        for (const CBlockHeader &header : headers) {
+            if (pindexPrev == nullptr || header.hashPrevBlock != hashPrev) {
+                BlockMap::iterator mi =
+                    mapBlockIndex.find(header.hashPrevBlock);
+                if (mi == mapBlockIndex.end()) {
+                    break;
+                }
+                pindexPrev = mi->second;
+            }
+            if ((pindexPrev->nStatus & BLOCK_FAILED_MASK) ||
+                header.nBlockHeight != uint32_t(pindexPrev->nHeight + 1) ||
+                header.nBits !=
+                    GetNextWorkRequired(pindexPrev, &header, config)) {
+                break;
+            }
+
+            hashPrev = header.GetHash();
+            BlockMap::iterator miSelf = mapBlockIndex.find(hashPrev);
+            if (miSelf != mapBlockIndex.end()) {
+                // Already accepted, nothing to compute.
+                pindexPrev = miSelf->second;
+                continue;
+            }
+            vIndex.emplace_back(header);
+            vIndex.back().pprev = pindexPrev;
+            vIndex.back().nHeight = pindexPrev->nHeight + 1;
+            pindexPrev = &vIndex.back();
+            vChecks.emplace_back(config, header);
+        }
+    }
+    if (vChecks.size() < 2) {
+        return;
+    }
+
+    LOCK(cs_headercheckqueue);
+    CCheckQueueControl<CHeaderPowCheck> control(&headercheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const Config &config,
                             const std::vector<CBlockHeader> &headers,
                             CValidationState &state,
                             const CBlockIndex **ppindex) {
+    PreCheckBlockHeadersPoW(config, headers);
     {
         LOCK(cs_main);
         for (const CBlockHeader &header : headers) {
@@ -3513,8 +4911,20 @@ static bool AcceptBlock(const Config &config,
 
     // Write block to history file
     try {
-        unsigned int nBlockSize =
-            ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        // A block that is already on disk may be stored compressed, in which
+        // case its file's size is overestimated until the next block in it.
+        // Without -blockcompression the block is serialized straight into
+        // the file instead of a record.
+        const bool fRecord = dbp == nullptr && fBlockCompression;
+        std::vector<uint8_t> vRecord;
+        bool fCompressed = false;
+        unsigned int nBlockSize;
+        if (fRecord) {
+            fCompressed = MakeBlockRecord(block, vRecord);
+            nBlockSize = vRecord.size();
+        } else {
+            nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        }
         CDiskBlockPos blockPos;
         if (dbp != nullptr) {
             blockPos = *dbp;
@@ -3524,7 +4934,12 @@ static bool AcceptBlock(const Config &config,
             return error("AcceptBlock(): FindBlockPos failed");
         }
         if (dbp == nullptr) {
-            if (!WriteBlockToDisk(block, blockPos, chainparams.DiskMagic())) {
+            const bool fWritten =
+                fRecord ? WriteBlockToDisk(vRecord, fCompressed, blockPos,
+                                           chainparams.DiskMagic())
+                        : WriteBlockToDisk(block, blockPos,
+                                           chainparams.DiskMagic());
+            if (!fWritten) {
                 AbortNode(state, "Failed to write block");
             }
         }
@@ -3602,7 +5017,7 @@ bool TestBlockValidity(const Config &config, CValidationState &state,
 
     // NOTE: CheckBlockHeader is called by CheckBlock
     if (!ContextualCheckBlockHeader(config, block, state, pindexPrev,
-                                    GetAdjustedTime())) {
+                                    GetAdjustedTime(), fCheckPOW)) {
         return error("%s: Consensus::ContextualCheckBlockHeader: %s", __func__,
                      FormatStateMessage(state));
     }
@@ -3676,6 +5091,8 @@ void UnlinkPrunedFiles(const std::set<int> &setFilesToPrune) {
     for (std::set<int>::iterator it = setFilesToPrune.begin();
          it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        blockFileMap.Erase(*it);
+        decompressedBlockCache.EraseFile(*it);
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -3696,10 +5113,10 @@ static void FindFilesToPruneManual(std::set<int> &setFilesToPrune,
     }
 
     // last block to prune is the lesser of (user-specified height,
-    // MIN_BLOCKS_TO_KEEP from the tip)
+    // nPruneDepth from the tip)
     unsigned int nLastBlockWeCanPrune =
         std::min((unsigned)nManualPruneHeight,
-                 chainActive.Tip()->nHeight - MIN_BLOCKS_TO_KEEP);
+                 (unsigned)(chainActive.Tip()->nHeight - nPruneDepth));
     int count = 0;
     for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
         if (vinfoBlockFile[fileNumber].nSize == 0 ||
@@ -3716,23 +5133,25 @@ static void FindFilesToPruneManual(std::set<int> &setFilesToPrune,
 
 /* This function is called from the RPC code for pruneblockchain */
 void PruneBlockFilesManual(int nManualPruneHeight) {
-    CValidationState state;
-    FlushStateToDisk(state, FLUSH_STATE_NONE, nManualPruneHeight);
+    // Written first, so that the coin database doesn't hold the blocks back.
+    FlushStateToDisk();
+    if (g_blockpruner) {
+        g_blockpruner->Prune(nManualPruneHeight);
+    }
 }
 
 /* Calculate the block/rev files that should be deleted to remain under target*/
-void FindFilesToPrune(std::set<int> &setFilesToPrune,
-                      uint64_t nPruneAfterHeight) {
+bool FindFilesToPrune(std::set<int> &setFilesToPrune,
+                      uint64_t nPruneAfterHeight, int nLastBlockWeCanPrune) {
     LOCK2(cs_main, cs_LastBlockFile);
     if (chainActive.Tip() == nullptr || nPruneTarget == 0) {
-        return;
+        return true;
     }
-    if (uint64_t(chainActive.Tip()->nHeight) <= nPruneAfterHeight) {
-        return;
+    if (uint64_t(chainActive.Tip()->nHeight) <= nPruneAfterHeight ||
+        nLastBlockWeCanPrune < 0) {
+        return true;
     }
 
-    unsigned int nLastBlockWeCanPrune =
-        chainActive.Tip()->nHeight - MIN_BLOCKS_TO_KEEP;
     uint64_t nCurrentUsage = CalculateCurrentUsage();
     // We don't check to prune until after we've allocated new space for files,
     // so we should leave a buffer under our target to account for another
@@ -3755,9 +5174,10 @@ void FindFilesToPrune(std::set<int> &setFilesToPrune,
                 break;
             }
 
-            // don't prune files that could have a block within
-            // MIN_BLOCKS_TO_KEEP of the main chain's tip but keep scanning
-            if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune) {
+            // don't prune files that could have a block above
+            // nLastBlockWeCanPrune but keep scanning
+            if (vinfoBlockFile[fileNumber].nHeightLast >
+                (unsigned int)nLastBlockWeCanPrune) {
                 continue;
             }
 
@@ -3774,6 +5194,70 @@ void FindFilesToPrune(std::set<int> &setFilesToPrune,
              nPruneTarget / 1024 / 1024, nCurrentUsage / 1024 / 1024,
              ((int64_t)nPruneTarget - (int64_t)nCurrentUsage) / 1024 / 1024,
              nLastBlockWeCanPrune, count);
+    return nCurrentUsage + nBuffer < nPruneTarget;
+}
+
+bool PruneBlockFiles(int nMaxPruneHeight, int nManualPruneHeight) {
+    std::set<int> setFilesToPrune;
+    {
+        LOCK2(cs_main, cs_LastBlockFile);
+        if (!fPruneMode || fReindex || chainActive.Tip() == nullptr) {
+            return true;
+        }
+
+        // Blocks within nPruneDepth of the tip are kept for reorganizations,
+        // and the blocks the coin database on disk would need to be replayed
+        // up to the tip after a crash.
+        const int nDepthHeight = chainActive.Tip()->nHeight - nPruneDepth;
+        int nCoinsHeight = -1;
+        BlockMap::iterator it =
+            mapBlockIndex.find(pcoinsWriter->GetBestBlockOnDisk());
+        if (it != mapBlockIndex.end()) {
+            nCoinsHeight = chainActive.FindFork(it->second)->nHeight;
+        }
+        const int nLastBlockWeCanPrune =
+            std::min(std::min(nDepthHeight, nCoinsHeight), nMaxPruneHeight);
+
+        if (nManualPruneHeight > 0) {
+            if (nLastBlockWeCanPrune > 0) {
+                FindFilesToPruneManual(
+                    setFilesToPrune,
+                    std::min(nManualPruneHeight, nLastBlockWeCanPrune));
+            }
+        } else if (fCheckForPruning) {
+            const bool fUnderTarget =
+                FindFilesToPrune(setFilesToPrune, Params().PruneAfterHeight(),
+                                 nLastBlockWeCanPrune);
+            // Still over the target because of the coin database: have the
+            // next flush write it, unless a write in progress gets it past
+            // the blocks already, and try again after.
+            fCheckForPruning = !fUnderTarget && nCoinsHeight < nDepthHeight &&
+                               nCoinsHeight <= nMaxPruneHeight;
+            if (fCheckForPruning) {
+                it = mapBlockIndex.find(pcoinsWriter->GetBestBlock());
+                if (it == mapBlockIndex.end() ||
+                    chainActive.FindFork(it->second)->nHeight < nDepthHeight) {
+                    fFlushForPrune = true;
+                }
+            }
+        }
+
+        if (setFilesToPrune.empty()) {
+            return true;
+        }
+        if (!fHavePruned) {
+            pblocktree->WriteFlag("prunedblockfiles", true);
+            fHavePruned = true;
+        }
+        // The block index must not point to the files anymore when they are
+        // deleted.
+        CValidationState state;
+        if (!WriteBlockIndex(state)) {
+            return false;
+        }
+    }
+    UnlinkPrunedFiles(setFilesToPrune);
+    return true;
 }
 
 bool CheckDiskSpace(uint64_t nAdditionalBytes) {
@@ -3822,59 +5306,230 @@ boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos,
     return GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, pos.nFile);
 }
 
-CBlockIndex *InsertBlockIndex(uint256 hash) {
-    if (hash.IsNull()) return nullptr;
-
-    // Return existing
-    BlockMap::iterator mi = mapBlockIndex.find(hash);
-    if (mi != mapBlockIndex.end()) return (*mi).second;
+/** Version of the block index snapshot format */
+static const uint32_t BLOCK_INDEX_SNAPSHOT_VERSION = 1;
 
-    // Create new
-    CBlockIndex *pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error(std::string(__func__) +
-                                 ": new CBlockIndex failed");
-    mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
+/** Whether mapBlockIndex holds the whole block index */
+static bool fBlockIndexLoaded = false;
 
-    return pindexNew;
+static boost::filesystem::path GetBlockIndexSnapshotPath() {
+    return GetDataDir() / "blocks" / "index.snapshot";
 }
 
-static bool LoadBlockIndexDB(const CChainParams &chainparams) {
-    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex)) return false;
+/**
+ * A block index entry as kept in the snapshot. It has the block hash next to
+ * the database record, so loading doesn't hash every header again.
+ */
+class CBlockIndexSnapshotEntry {
+public:
+    uint256 hash;
+    CDiskBlockIndex index;
 
-    boost::this_thread::interruption_point();
+    CBlockIndexSnapshotEntry() {}
+    explicit CBlockIndexSnapshotEntry(const CBlockIndex *pindex)
+        : hash(pindex->GetBlockHash()), index(pindex) {}
 
-    // Calculate nChainWork
-    std::vector<std::pair<int, CBlockIndex *>> vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(hash);
+        READWRITE(index);
+    }
+};
+
+bool WriteBlockIndexSnapshot() {
+    LOCK(cs_main);
+    if (!fBlockIndexLoaded || !pblocktree || !setDirtyBlockIndex.empty()) {
+        return false;
+    }
+
+    // Parents go before their children.
+    std::vector<const CBlockIndex *> vIndex;
+    vIndex.reserve(mapBlockIndex.size());
     for (const std::pair<uint256, CBlockIndex *> &item : mapBlockIndex) {
-        CBlockIndex *pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        vIndex.push_back(item.second);
     }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    for (const std::pair<int, CBlockIndex *> &item : vSortedByHeight) {
-        CBlockIndex *pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) +
-                             GetBlockProof(*pindex);
-        pindex->nTimeMax =
-            (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime)
-                           : pindex->nTime);
-        // We can link the chain of blocks for which we've received transactions
-        // at some point. Pruned nodes may have deleted the block.
-        if (pindex->nTx > 0) {
-            if (pindex->pprev) {
-                if (pindex->pprev->nChainTx) {
-                    pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
-                } else {
-                    pindex->nChainTx = 0;
-                    mapBlocksUnlinked.insert(
-                        std::make_pair(pindex->pprev, pindex));
-                }
-            } else {
-                pindex->nChainTx = pindex->nTx;
-            }
-        }
+    std::sort(vIndex.begin(), vIndex.end(),
+              [](const CBlockIndex *a, const CBlockIndex *b) {
+                  return a->nHeight < b->nHeight;
+              });
+
+    const uint64_t nId = GetRand(std::numeric_limits<uint64_t>::max());
+    const boost::filesystem::path path = GetBlockIndexSnapshotPath();
+    const boost::filesystem::path pathTmp = path.string() + ".new";
+    {
+        CAutoFile file(fopen(pathTmp.string().c_str(), "wb"), SER_DISK,
+                       CLIENT_VERSION);
+        if (file.IsNull()) {
+            return error("%s: failed to open %s", __func__, pathTmp.string());
+        }
+        try {
+            CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+            const uint64_t nCount = vIndex.size();
+            file << BLOCK_INDEX_SNAPSHOT_VERSION << nId << nCount;
+            hasher << BLOCK_INDEX_SNAPSHOT_VERSION << nId << nCount;
+            for (const CBlockIndex *pindex : vIndex) {
+                CBlockIndexSnapshotEntry entry(pindex);
+                file << entry;
+                hasher << entry;
+            }
+            file << hasher.GetHash();
+            FileCommit(file.Get());
+        } catch (const std::exception &e) {
+            return error("%s: failed to write %s: %s", __func__,
+                         pathTmp.string(), e.what());
+        }
+    }
+    if (!RenameOver(pathTmp, path)) {
+        return error("%s: failed to rename %s", __func__, pathTmp.string());
+    }
+
+    // The snapshot only counts once the database points at it.
+    if (!pblocktree->WriteIndexSnapshotId(nId)) {
+        return error("%s: failed to record the snapshot", __func__);
+    }
+    LogPrintf("Wrote %u block index entries to %s\n", vIndex.size(),
+              path.string());
+    return true;
+}
+
+/**
+ * Fill mapBlockIndex from the snapshot written by the last shutdown, and
+ * vSortedByHeight with its entries in height order. Returns false, with
+ * nothing loaded, if there is no snapshot that matches the database.
+ */
+static bool LoadBlockIndexSnapshot(
+    std::vector<std::pair<int, CBlockIndex *>> &vSortedByHeight) {
+    uint64_t nExpectedId;
+    if (!pblocktree->ReadIndexSnapshotId(nExpectedId)) {
+        return false;
+    }
+    // From here on the database moves away from the snapshot.
+    if (!pblocktree->EraseIndexSnapshotId()) {
+        return false;
+    }
+
+    const boost::filesystem::path path = GetBlockIndexSnapshotPath();
+    std::shared_ptr<const CMappedBlockFile> file =
+        CMappedBlockFile::Open(path, true);
+    if (!file || file->size() < sizeof(uint256)) {
+        return false;
+    }
+    const uint8_t *pbegin = file->data();
+    const uint8_t *pend = pbegin + file->size() - sizeof(uint256);
+    CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+    hasher.write((const char *)pbegin, pend - pbegin);
+    if (memcmp(hasher.GetHash().begin(), pend, sizeof(uint256)) != 0) {
+        return error("%s: %s is corrupt", __func__, path.string());
+    }
+
+    try {
+        CSpanReader reader(SER_DISK, CLIENT_VERSION, pbegin, pend);
+        uint32_t nVersion;
+        uint64_t nId, nCount;
+        reader >> nVersion >> nId >> nCount;
+        // No entry is smaller than its two hashes, which bounds the
+        // allocation below.
+        if (nVersion != BLOCK_INDEX_SNAPSHOT_VERSION || nId != nExpectedId ||
+            nCount > reader.size() / (2 * sizeof(uint256))) {
+            return false;
+        }
+
+        // Entries come in height order, and so are laid out in the arena.
+        LOCK(cs_blockIndexLookup);
+        mapBlockIndex.reserve(nCount);
+        vSortedByHeight.reserve(nCount);
+        for (uint64_t i = 0; i < nCount; i++) {
+            boost::this_thread::interruption_point();
+            CBlockIndexSnapshotEntry entry;
+            reader >> entry;
+            CBlockIndex &index = *blockIndexArena.Create(entry.index);
+
+            std::pair<BlockMap::iterator, bool> ret =
+                mapBlockIndex.insert(std::make_pair(entry.hash, &index));
+            if (!ret.second) {
+                throw std::ios_base::failure("duplicate entry");
+            }
+            index.phashBlock = &ret.first->first;
+            if (!entry.index.hashPrev.IsNull()) {
+                BlockMap::iterator mi =
+                    mapBlockIndex.find(entry.index.hashPrev);
+                if (mi == mapBlockIndex.end()) {
+                    throw std::ios_base::failure("entry before its parent");
+                }
+                index.pprev = mi->second;
+            }
+            vSortedByHeight.push_back(std::make_pair(index.nHeight, &index));
+        }
+    } catch (const std::ios_base::failure &e) {
+        LOCK(cs_blockIndexLookup);
+        mapBlockIndex.clear();
+        blockIndexArena.Clear();
+        vSortedByHeight.clear();
+        return error("%s: failed to read %s: %s", __func__, path.string(),
+                     e.what());
+    }
+
+    LogPrintf("%s: loaded %u entries from %s\n", __func__,
+              vSortedByHeight.size(), path.string());
+    return true;
+}
+
+CBlockIndex *InsertBlockIndex(uint256 hash) {
+    if (hash.IsNull()) return nullptr;
+
+    // Return existing
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
+    if (mi != mapBlockIndex.end()) return (*mi).second;
+
+    // Create new
+    LOCK(cs_blockIndexLookup);
+    CBlockIndex *pindexNew = blockIndexArena.Create();
+    mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
+    pindexNew->phashBlock = &((*mi).first);
+
+    return pindexNew;
+}
+
+static bool LoadBlockIndexDB(const CChainParams &chainparams) {
+    std::vector<std::pair<int, CBlockIndex *>> vSortedByHeight;
+    if (!LoadBlockIndexSnapshot(vSortedByHeight)) {
+        if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex)) return false;
+
+        boost::this_thread::interruption_point();
+
+        vSortedByHeight.reserve(mapBlockIndex.size());
+        for (const std::pair<uint256, CBlockIndex *> &item : mapBlockIndex) {
+            CBlockIndex *pindex = item.second;
+            vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        }
+        sort(vSortedByHeight.begin(), vSortedByHeight.end());
+    }
+
+    // Calculate nChainWork
+    for (const std::pair<int, CBlockIndex *> &item : vSortedByHeight) {
+        CBlockIndex *pindex = item.second;
+        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) +
+                             GetBlockProof(*pindex);
+        pindex->nTimeMax =
+            (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime)
+                           : pindex->nTime);
+        // We can link the chain of blocks for which we've received transactions
+        // at some point. Pruned nodes may have deleted the block.
+        if (pindex->nTx > 0) {
+            if (pindex->pprev) {
+                if (pindex->pprev->nChainTx) {
+                    pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+                } else {
+                    pindex->nChainTx = 0;
+                    mapBlocksUnlinked.insert(
+                        std::make_pair(pindex->pprev, pindex));
+                }
+            } else {
+                pindex->nChainTx = pindex->nTx;
+            }
+        }
         if (pindex->IsValid(BLOCK_VALID_TRANSACTIONS) &&
             (pindex->nChainTx || pindex->pprev == nullptr)) {
             setBlockIndexCandidates.insert(pindex);
@@ -3940,12 +5595,14 @@ static bool LoadBlockIndexDB(const CChainParams &chainparams) {
     // Check whether we need to continue reindexing
     bool fReindexing = false;
     pblocktree->ReadReindexing(fReindexing);
-    fReindex |= fReindexing;
+    if (fReindexing) {
+        fReindex = true;
+    }
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("%s: transaction index %s\n", __func__,
-              fTxIndex ? "enabled" : "disabled");
+    // Check whether we have a deposit index
+    pblocktree->ReadFlag("depositindex", fDepositIndex);
+    LogPrintf("%s: deposit index %s\n", __func__,
+              fDepositIndex ? "enabled" : "disabled");
 
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
@@ -3953,6 +5610,8 @@ static bool LoadBlockIndexDB(const CChainParams &chainparams) {
         return true;
     }
     chainActive.SetTip(it->second);
+    UpdateChainSnapshot();
+    UpdateInterestHistory();
 
     PruneBlockIndexCandidates();
 
@@ -3966,6 +5625,21 @@ static bool LoadBlockIndexDB(const CChainParams &chainparams) {
     return true;
 }
 
+/**
+ * The blocks the last successful VerifyDB checked, saved by a clean shutdown.
+ * Protected by cs_main.
+ */
+static CVerifiedBlocks verifiedBlocks;
+static bool fHaveVerifiedBlocks = false;
+
+bool WriteVerifiedBlocks() {
+    LOCK(cs_main);
+    if (!fHaveVerifiedBlocks) {
+        return true;
+    }
+    return pblocktree->WriteVerifiedBlocks(verifiedBlocks);
+}
+
 CVerifyDB::CVerifyDB() {
     uiInterface.ShowProgress(_("Verifying blocks..."), 0);
 }
@@ -3975,8 +5649,16 @@ CVerifyDB::~CVerifyDB() {
 }
 
 bool CVerifyDB::VerifyDB(const Config &config, CCoinsView *coinsview,
-                         int nCheckLevel, int nCheckDepth) {
+                         int nCheckLevel, int nCheckDepth,
+                         bool fSkipVerified) {
     LOCK(cs_main);
+    // A record left by a clean shutdown only holds until the node runs
+    // again: if this run crashes, the next one checks everything.
+    CVerifiedBlocks verifiedBefore;
+    const bool fVerifiedBefore = pblocktree->ReadVerifiedBlocks(verifiedBefore);
+    if (fVerifiedBefore) {
+        pblocktree->EraseVerifiedBlocks();
+    }
     if (chainActive.Tip() == nullptr || chainActive.Tip()->pprev == nullptr) {
         return true;
     }
@@ -3995,6 +5677,21 @@ bool CVerifyDB::VerifyDB(const Config &config, CCoinsView *coinsview,
     LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth,
               nCheckLevel);
 
+    // Blocks checked at this level or deeper before the last clean shutdown
+    // are not checked again, as long as they cover the rest of the range.
+    // Above them are the blocks connected since, which are.
+    const CBlockIndex *pindexVerified = nullptr;
+    if (fSkipVerified && fVerifiedBefore &&
+        verifiedBefore.nCheckLevel >= nCheckLevel &&
+        verifiedBefore.nHeight <=
+            std::max(1, chainActive.Height() - nCheckDepth)) {
+        BlockMap::iterator mi = mapBlockIndex.find(verifiedBefore.hashTip);
+        if (mi != mapBlockIndex.end() && chainActive.Contains(mi->second)) {
+            pindexVerified = mi->second;
+        }
+    }
+    int nVerifiedHeight = chainActive.Height() + 1;
+
     const CChainParams &chainparams = config.GetChainParams();
 
     CCoinsViewCache coins(coinsview);
@@ -4003,6 +5700,12 @@ bool CVerifyDB::VerifyDB(const Config &config, CCoinsView *coinsview,
     int nGoodTransactions = 0;
     CValidationState state;
     int reportDone = 0;
+    // From level 2 blocks and their undo data are read, and the undo
+    // checksums verified, a batch at a time on the disconnect read threads.
+    const CBlockIndex *pindexLast =
+        chainActive[chainActive.Height() - nCheckDepth - 1];
+    std::vector<DisconnectReadData> vReadAhead;
+    size_t nReadAhead = 0;
     LogPrintf("[0%%]...");
     for (CBlockIndex *pindex = chainActive.Tip(); pindex && pindex->pprev;
          pindex = pindex->pprev) {
@@ -4032,10 +5735,34 @@ bool CVerifyDB::VerifyDB(const Config &config, CCoinsView *coinsview,
             break;
         }
 
+        if (pindex == pindexVerified) {
+            LogPrintf("VerifyDB(): blocks from height %d down were verified "
+                      "before the last shutdown\n",
+                      pindex->nHeight);
+            nVerifiedHeight = verifiedBefore.nHeight;
+            break;
+        }
+
         CBlock block;
+        CBlockUndo undo;
+        bool fRead = false;
+        if (nCheckLevel >= 2) {
+            if (nReadAhead == vReadAhead.size()) {
+                vReadAhead = ReadBlocksForDisconnect(config, pindex,
+                                                     pindexLast, true);
+                nReadAhead = 0;
+            }
+            DisconnectReadData &data = vReadAhead[nReadAhead++];
+            assert(data.pindex == pindex);
+            if (data.fRead) {
+                block = std::move(data.block);
+                undo = std::move(data.blockUndo);
+                fRead = true;
+            }
+        }
 
         // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex, config)) {
+        if (!fRead && !ReadBlockFromDisk(block, pindex, config)) {
             return error(
                 "VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s",
                 pindex->nHeight, pindex->GetBlockHash().ToString());
@@ -4050,9 +5777,8 @@ bool CVerifyDB::VerifyDB(const Config &config, CCoinsView *coinsview,
         }
 
         // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            CDiskBlockPos pos = pindex->GetUndoPos();
+        CDiskBlockPos pos = pindex->GetUndoPos();
+        if (nCheckLevel >= 2 && !fRead) {
             if (!pos.IsNull()) {
                 if (!UndoReadFromDisk(undo, pos,
                                       pindex->pprev->GetBlockHash())) {
@@ -4068,7 +5794,12 @@ bool CVerifyDB::VerifyDB(const Config &config, CCoinsView *coinsview,
         if (nCheckLevel >= 3 && pindex == pindexState &&
             (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <=
                 nCoinCacheUsage) {
-            DisconnectResult res = DisconnectBlock(block, pindex, coins);
+            // The undo data read above is applied, not read again.
+            assert(pindex->GetBlockHash() == coins.GetBestBlock());
+            DisconnectResult res = pos.IsNull()
+                                       ? DISCONNECT_FAILED
+                                       : ApplyBlockUndo(undo, block, pindex,
+                                                        coins);
             if (res == DISCONNECT_FAILED) {
                 return error("VerifyDB(): *** irrecoverable inconsistency in "
                              "block data at %d, hash=%s",
@@ -4087,6 +5818,7 @@ bool CVerifyDB::VerifyDB(const Config &config, CCoinsView *coinsview,
         if (ShutdownRequested()) {
             return true;
         }
+        nVerifiedHeight = pindex->nHeight;
     }
 
     if (pindexFailure) {
@@ -4128,6 +5860,10 @@ bool CVerifyDB::VerifyDB(const Config &config, CCoinsView *coinsview,
               "transactions)\n",
               chainActive.Height() - pindexState->nHeight, nGoodTransactions);
 
+    verifiedBlocks.hashTip = chainActive.Tip()->GetBlockHash();
+    verifiedBlocks.nHeight = nVerifiedHeight;
+    verifiedBlocks.nCheckLevel = nCheckLevel;
+    fHaveVerifiedBlocks = true;
     return true;
 }
 
@@ -4148,7 +5884,7 @@ bool RewindBlockIndex(const Config &config) {
             // needless reindex/redownload of the blockchain).
             break;
         }
-        if (!DisconnectTip(config, state, true)) {
+        if (!DisconnectTip(config, state, nullptr)) {
             return error(
                 "RewindBlockIndex: unable to disconnect block at height %i",
                 pindex->nHeight);
@@ -4190,6 +5926,9 @@ void UnloadBlockIndex() {
     LOCK(cs_main);
     setBlockIndexCandidates.clear();
     chainActive.SetTip(nullptr);
+    UpdateChainSnapshot();
+    ResetInterestPeriodCache();
+    ResetInterestHistory();
     pindexBestInvalid = nullptr;
     pindexBestHeader = nullptr;
     mempool.clear();
@@ -4204,10 +5943,12 @@ void UnloadBlockIndex() {
         warningcache[b].clear();
     }
 
-    for (BlockMap::value_type &entry : mapBlockIndex) {
-        delete entry.second;
+    {
+        LOCK(cs_blockIndexLookup);
+        mapBlockIndex.clear();
+        blockIndexArena.Clear();
     }
-    mapBlockIndex.clear();
+    fBlockIndexLoaded = false;
     fHavePruned = false;
 }
 
@@ -4216,6 +5957,7 @@ bool LoadBlockIndex(const CChainParams &chainparams) {
     if (!fReindex && !LoadBlockIndexDB(chainparams)) {
         return false;
     }
+    fBlockIndexLoaded = true;
     return true;
 }
 
@@ -4227,9 +5969,9 @@ bool InitBlockIndex(const Config &config) {
         return true;
     }
 
-    // Use the provided setting for -txindex in the new database
-    fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
-    pblocktree->WriteFlag("txindex", fTxIndex);
+    // Use the provided setting for -depositindex in the new database
+    fDepositIndex = GetBoolArg("-depositindex", DEFAULT_DEPOSITINDEX);
+    pblocktree->WriteFlag("depositindex", fDepositIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the
@@ -4239,15 +5981,16 @@ bool InitBlockIndex(const Config &config) {
             const CChainParams &chainparams = config.GetChainParams();
             CBlock &block = const_cast<CBlock &>(chainparams.GenesisBlock());
             // Start new block file
-            unsigned int nBlockSize =
-                ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+            std::vector<uint8_t> vRecord;
+            bool fCompressed = MakeBlockRecord(block, vRecord);
             CDiskBlockPos blockPos;
             CValidationState state;
-            if (!FindBlockPos(state, blockPos, nBlockSize + 8, 0,
+            if (!FindBlockPos(state, blockPos, vRecord.size() + 8, 0,
                               block.GetBlockTime())) {
                 return error("LoadBlockIndex(): FindBlockPos failed");
             }
-            if (!WriteBlockToDisk(block, blockPos, chainparams.DiskMagic())) {
+            if (!WriteBlockToDisk(vRecord, fCompressed, blockPos,
+                                  chainparams.DiskMagic())) {
                 return error(
                     "LoadBlockIndex(): writing genesis block to disk failed");
             }
@@ -4268,16 +6011,121 @@ bool InitBlockIndex(const Config &config) {
     return true;
 }
 
-bool LoadExternalBlockFile(const Config &config, FILE *fileIn,
-                           CDiskBlockPos *dbp) {
-    // Map of disk positions for blocks with unknown parent (only used for
-    // reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
+/** Bytes of blocks read ahead of AcceptBlock during an import */
+static const size_t MAX_IMPORT_QUEUE_BYTES = 64 << 20;
 
-    const CChainParams &chainparams = config.GetChainParams();
+namespace {
 
-    int nLoaded = 0;
+/**
+ * Blocks of an import file on their way from the thread that reads them,
+ * through the threads that deserialize and CheckBlock them, back to
+ * LoadExternalBlockFile, which accepts them one at a time in file order.
+ */
+class CBlockImportQueue {
+public:
+    struct Item {
+        CDiskBlockPos pos;
+        std::vector<uint8_t> vRaw;
+        bool fCompressed;
+        //! Null if the block couldn't be deserialized.
+        std::shared_ptr<CBlock> pblock;
+        size_t nSize;
+        bool fChecked;
+    };
+
+    CBlockImportQueue(const Config &configIn, FILE *fileIn,
+                      const CDiskBlockPos *dbp, int nCheckThreads);
+    ~CBlockImportQueue();
+
+    /**
+     * Wait for the next block of the file to be checked. Returns false once
+     * the whole file has been read.
+     */
+    bool Pop(std::shared_ptr<Item> &item);
+
+private:
+    void ThreadRead(FILE *fileIn, const CDiskBlockPos *dbp);
+    void ThreadCheck();
+    bool Push(const std::shared_ptr<Item> &item);
+
+    const Config &config;
+
+    std::mutex cs;
+    std::condition_variable cond;
+    //! Everything read and not popped yet, in file order.
+    std::deque<std::shared_ptr<Item>> queue;
+    //! The part of queue no check thread has picked up yet.
+    std::deque<std::shared_ptr<Item>> queueToCheck;
+    size_t nQueuedBytes;
+    bool fReadDone;
+    bool fStop;
+
+    std::vector<std::thread> threads;
+};
+
+CBlockImportQueue::CBlockImportQueue(const Config &configIn, FILE *fileIn,
+                                     const CDiskBlockPos *dbp,
+                                     int nCheckThreads)
+    : config(configIn), nQueuedBytes(0), fReadDone(false), fStop(false) {
+    threads.emplace_back(
+        &TraceThread<std::function<void()>>, "importread",
+        std::function<void()>(
+            std::bind(&CBlockImportQueue::ThreadRead, this, fileIn, dbp)));
+    for (int i = 0; i < nCheckThreads; i++) {
+        threads.emplace_back(&TraceThread<std::function<void()>>,
+                             "importcheck",
+                             std::function<void()>(std::bind(
+                                 &CBlockImportQueue::ThreadCheck, this)));
+    }
+}
+
+CBlockImportQueue::~CBlockImportQueue() {
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+    }
+    cond.notify_all();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+bool CBlockImportQueue::Push(const std::shared_ptr<Item> &item) {
+    std::unique_lock<std::mutex> lock(cs);
+    // A block bigger than the limit still goes through on its own.
+    cond.wait(lock, [this] {
+        return fStop || queue.empty() ||
+               nQueuedBytes < MAX_IMPORT_QUEUE_BYTES;
+    });
+    if (fStop) {
+        return false;
+    }
+    queue.push_back(item);
+    queueToCheck.push_back(item);
+    nQueuedBytes += item->nSize;
+    cond.notify_all();
+    return true;
+}
+
+bool CBlockImportQueue::Pop(std::shared_ptr<Item> &item) {
+    std::unique_lock<std::mutex> lock(cs);
+    while (queue.empty() || !queue.front()->fChecked) {
+        if (queue.empty() && fReadDone) {
+            return false;
+        }
+        // Wake up now and then, the import thread can be interrupted.
+        cond.wait_for(lock, std::chrono::milliseconds(100));
+        boost::this_thread::interruption_point();
+    }
+    item = queue.front();
+    queue.pop_front();
+    nQueuedBytes -= item->nSize;
+    cond.notify_all();
+    return true;
+}
+
+void CBlockImportQueue::ThreadRead(FILE *fileIn, const CDiskBlockPos *dbp) {
+    const CChainParams &chainparams = config.GetChainParams();
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile
         // destructor. Make sure we have at least 2*MAX_TX_SIZE space in there
@@ -4286,14 +6134,13 @@ bool LoadExternalBlockFile(const Config &config, FILE *fileIn,
                              CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
         while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
-
             blkdat.SetPos(nRewind);
             // Start one byte further next time, in case of failure.
             nRewind++;
             // Remove former limit.
             blkdat.SetLimit();
             unsigned int nSize = 0;
+            bool fCompressed = false;
             try {
                 // Locate a header.
                 uint8_t buf[CMessageHeader::MESSAGE_START_SIZE];
@@ -4306,7 +6153,9 @@ bool LoadExternalBlockFile(const Config &config, FILE *fileIn,
                 }
                 // Read size.
                 blkdat >> nSize;
-                if (nSize < 80) {
+                fCompressed = (nSize & BLOCK_COMPRESSED_FLAG) != 0;
+                nSize &= ~BLOCK_COMPRESSED_FLAG;
+                if ((!fCompressed && nSize < 80) || nSize > MAX_SIZE) {
                     continue;
                 }
             } catch (const std::exception &) {
@@ -4314,17 +6163,121 @@ bool LoadExternalBlockFile(const Config &config, FILE *fileIn,
                 break;
             }
             try {
-                // read block
+                // Read the block as is, the check threads deserialize it.
+                std::shared_ptr<Item> item = std::make_shared<Item>();
                 uint64_t nBlockPos = blkdat.GetPos();
                 if (dbp) {
-                    dbp->nPos = nBlockPos;
+                    item->pos = CDiskBlockPos(dbp->nFile, nBlockPos);
                 }
+                item->nSize = nSize;
+                item->fCompressed = fCompressed;
+                item->fChecked = false;
                 blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock &block = *pblock;
-                blkdat >> block;
+                item->vRaw.resize(nSize);
+                // The buffer can't hold a whole block, read it in pieces.
+                for (size_t nRead = 0; nRead < nSize;) {
+                    size_t nNow = std::min<size_t>(nSize - nRead,
+                                                   MAX_TX_SIZE / 2);
+                    blkdat.read((char *)&item->vRaw[nRead], nNow);
+                    nRead += nNow;
+                }
                 nRewind = blkdat.GetPos();
+                if (!Push(item)) {
+                    break;
+                }
+            } catch (const std::exception &e) {
+                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__,
+                          e.what());
+            }
+        }
+    } catch (const std::runtime_error &e) {
+        AbortNode(std::string("System error: ") + e.what());
+    }
+
+    std::lock_guard<std::mutex> lock(cs);
+    fReadDone = true;
+    cond.notify_all();
+}
+
+void CBlockImportQueue::ThreadCheck() {
+    while (true) {
+        std::shared_ptr<Item> item;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            cond.wait(lock, [this] {
+                return fStop || fReadDone || !queueToCheck.empty();
+            });
+            if (fStop || queueToCheck.empty()) {
+                return;
+            }
+            item = queueToCheck.front();
+            queueToCheck.pop_front();
+        }
+
+        try {
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            {
+                CReplayTimer timer(ReplayPhase::DESERIALIZE);
+                if (item->fCompressed) {
+                    std::vector<uint8_t> vBlock;
+                    if (!DecompressBlock(item->vRaw.data(), item->vRaw.size(),
+                                         vBlock)) {
+                        throw std::runtime_error("corrupt compressed block");
+                    }
+                    item->vRaw.swap(vBlock);
+                }
+                CSpanReader reader(SER_DISK, CLIENT_VERSION,
+                                   item->vRaw.data(),
+                                   item->vRaw.data() + item->vRaw.size());
+                reader >> *pblock;
+            }
+            // A block that passes is marked checked and AcceptBlock skips
+            // these checks; one that fails is rejected there as usual.
+            CValidationState state;
+            CheckBlock(config, *pblock, state);
+            item->pblock = pblock;
+        } catch (const std::exception &e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__,
+                      e.what());
+        }
+        std::vector<uint8_t>().swap(item->vRaw);
+
+        std::lock_guard<std::mutex> lock(cs);
+        item->fChecked = true;
+        cond.notify_all();
+    }
+}
+
+} // namespace
+
+bool LoadExternalBlockFile(const Config &config, FILE *fileIn,
+                           CDiskBlockPos *dbp) {
+    // Map of disk positions for blocks with unknown parent (only used for
+    // reindex)
+    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+    int64_t nStart = GetTimeMillis();
+
+    const CChainParams &chainparams = config.GetChainParams();
+
+    int nLoaded = 0;
+    {
+        // Reading, deserializing and the context free checks run ahead on
+        // their own threads, this thread only accepts the blocks in order.
+        CBlockImportQueue importQueue(config, fileIn, dbp,
+                                      std::max(1, nScriptCheckThreads));
+        std::shared_ptr<CBlockImportQueue::Item> item;
+        while (importQueue.Pop(item)) {
+            boost::this_thread::interruption_point();
+
+            if (!item->pblock) {
+                continue;
+            }
+            if (dbp) {
+                dbp->nPos = item->pos.nPos;
+            }
+            try {
+                std::shared_ptr<CBlock> pblock = item->pblock;
+                const CBlock &block = *pblock;
 
                 // detect out of order blocks, and store them for later
                 uint256 hash = block.GetHash();
@@ -4415,8 +6368,6 @@ bool LoadExternalBlockFile(const Config &config, FILE *fileIn,
                           e.what());
             }
         }
-    } catch (const std::runtime_error &e) {
-        AbortNode(std::string("System error: ") + e.what());
     }
     if (nLoaded > 0) {
         LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded,
@@ -4753,9 +6704,167 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params &params,
                                        versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+/** Dumped mempool entries loaded per cs_main acquisition */
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 1000;
+static const uint64_t VALIDATION_CACHE_DUMP_VERSION = 1;
+
+/**
+ * Reload the signature and script execution caches saved by
+ * DumpValidationCaches, so the mempool replay and the first blocks after a
+ * restart don't verify everything again.
+ */
+static void LoadValidationCaches() {
+    FILE *filestr =
+        fopen((GetDataDir() / "sigcache.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return;
+    }
+
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != VALIDATION_CACHE_DUMP_VERSION) {
+            return;
+        }
+
+        // Both caches swap their nonce, so nothing may verify scripts
+        // meanwhile. Every signature check runs under cs_main.
+        LOCK(cs_main);
+        size_t nSigs = LoadSignatureCache(file);
+        size_t nScripts = LoadScriptExecutionCache(file);
+        LogPrintf("Imported validation caches from disk: %u signatures, %u "
+                  "script executions\n",
+                  nSigs, nScripts);
+    } catch (const std::exception &e) {
+        LogPrintf("Failed to deserialize validation caches on disk: %s. "
+                  "Continuing anyway.\n",
+                  e.what());
+    }
+}
+
+static void DumpValidationCaches() {
+    try {
+        FILE *filestr =
+            fopen((GetDataDir() / "sigcache.dat.new").string().c_str(), "wb");
+        if (!filestr) {
+            return;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = VALIDATION_CACHE_DUMP_VERSION;
+        file << version;
+        {
+            LOCK(cs_main);
+            DumpSignatureCache(file);
+            DumpScriptExecutionCache(file);
+        }
+
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "sigcache.dat.new",
+                   GetDataDir() / "sigcache.dat");
+    } catch (const std::exception &e) {
+        LogPrintf("Failed to dump validation caches: %s. Continuing anyway.\n",
+                  e.what());
+    }
+}
+
+/**
+ * A mempool entry as stored by mempool.dat version 2. The values
+ * AcceptToMemoryPool derived from the coins are kept, so a dump taken at the
+ * current tip can be reloaded without verifying scripts again.
+ */
+struct MempoolDumpEntry {
+    CTransactionRef tx;
+    int64_t nTime;
+    int64_t nFeeDelta;
+    CAmount nFee;
+    double entryPriority;
+    unsigned int entryHeight;
+    CAmount inChainInputValue;
+    bool spendsCoinbase;
+    int64_t sigOpCount;
+
+    MempoolDumpEntry() {}
+    MempoolDumpEntry(const CTxMemPoolEntry &entry, CAmount nFeeDeltaIn)
+        : tx(entry.GetSharedTx()), nTime(entry.GetTime()),
+          nFeeDelta(nFeeDeltaIn), nFee(entry.GetFee()),
+          entryPriority(entry.GetEntryPriority()),
+          entryHeight(entry.GetHeight()),
+          inChainInputValue(entry.GetInChainInputValue()),
+          spendsCoinbase(entry.GetSpendsCoinbase()),
+          sigOpCount(entry.GetSigOpCount()) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(tx);
+        READWRITE(nTime);
+        READWRITE(nFeeDelta);
+        READWRITE(nFee);
+        READWRITE(entryPriority);
+        READWRITE(entryHeight);
+        READWRITE(inChainInputValue);
+        READWRITE(spendsCoinbase);
+        READWRITE(sigOpCount);
+    }
+};
+
+/**
+ * Add an entry dumped at the current tip, trusting the fee, sigops and
+ * priority it recorded. Only what the mempool may have changed since is
+ * checked again. Returns false if that fails, for the caller to fall back to
+ * AcceptToMemoryPool.
+ */
+static bool AcceptDumpedEntry(const Config &config, CTxMemPool &pool,
+                              const MempoolDumpEntry &dumped) {
+    AssertLockHeld(cs_main);
+    const CTransaction &tx = *dumped.tx;
+
+    CValidationState state;
+    if (!ContextualCheckTransactionForCurrentBlock(config, tx, state)) {
+        return false;
+    }
+
+    {
+        LOCK(pool.cs);
+        if (pool.exists(tx.GetId())) {
+            return false;
+        }
+
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        for (const CTxIn &txin : tx.vin) {
+            if (pool.mapNextTx.count(txin.prevout) ||
+                !viewMemPool.HaveCoin(txin.prevout)) {
+                return false;
+            }
+        }
+
+        CTxMemPoolEntry entry(dumped.tx, dumped.nFee, dumped.nTime,
+                              dumped.entryPriority, dumped.entryHeight,
+                              dumped.inChainInputValue, dumped.spendsCoinbase,
+                              dumped.sigOpCount, LockPoints());
+        pool.addUnchecked(tx.GetId(), entry, false);
+    }
+
+    GetMainSignals().SyncTransaction(
+        dumped.tx, nullptr, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
+    return true;
+}
+
+template <typename T>
+static void WriteHashed(CAutoFile &file, CHashWriter &hasher, const T &obj) {
+    file << obj;
+    hasher << obj;
+}
 
 bool LoadMempool(const Config &config) {
+    LoadValidationCaches();
+
     int64_t nExpiryTimeout =
         GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
     FILE *filestr =
@@ -4768,6 +6877,7 @@ bool LoadMempool(const Config &config) {
     }
 
     int64_t count = 0;
+    int64_t trusted = 0;
     int64_t skipped = 0;
     int64_t failed = 0;
     int64_t nNow = GetTime();
@@ -4775,43 +6885,91 @@ bool LoadMempool(const Config &config) {
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != 1 && version != MEMPOOL_DUMP_VERSION) {
             return false;
         }
-        uint64_t num;
-        file >> num;
-        double prioritydummy = 0;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta(nFeeDelta);
-            if (amountdelta != CAmount(0)) {
-                mempool.PrioritiseTransaction(tx->GetId(),
-                                              tx->GetId().ToString(),
-                                              prioritydummy, amountdelta);
+
+        // Version 1 only has the transactions, version 2 the whole entries
+        // and the tip they were valid at, behind a checksum.
+        uint256 hashTip;
+        std::vector<MempoolDumpEntry> vDumped;
+        std::map<uint256, CAmount> mapDeltas;
+        if (version == 1) {
+            uint64_t num;
+            file >> num;
+            while (num--) {
+                MempoolDumpEntry dumped;
+                file >> dumped.tx;
+                file >> dumped.nTime;
+                file >> dumped.nFeeDelta;
+                vDumped.push_back(dumped);
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
+            file >> mapDeltas;
+        } else {
+            CHashVerifier<CAutoFile> verifier(&file);
+            verifier >> hashTip;
+            verifier >> vDumped;
+            verifier >> mapDeltas;
+            uint256 hashChecksum;
+            file >> hashChecksum;
+            if (hashChecksum != verifier.GetHash()) {
+                LogPrintf("Mempool file checksum mismatch. Continuing "
+                          "anyway.\n");
+                return false;
+            }
+        }
+
+        double prioritydummy = 0;
+        size_t i = 0;
+        while (i < vDumped.size()) {
+            // Hold cs_main for a batch at a time, so the node stays
+            // responsive and a new tip ends trusting the dump.
+            LOCK(cs_main);
+            bool fTrustDump = version == MEMPOOL_DUMP_VERSION &&
+                              chainActive.Tip() &&
+                              chainActive.Tip()->GetBlockHash() == hashTip;
+            size_t nEnd =
+                std::min(vDumped.size(), i + MEMPOOL_LOAD_BATCH_SIZE);
+            for (; i < nEnd; i++) {
+                const MempoolDumpEntry &dumped = vDumped[i];
+                const CTransactionRef &tx = dumped.tx;
+
+                CAmount amountdelta(dumped.nFeeDelta);
+                if (amountdelta != CAmount(0)) {
+                    mempool.PrioritiseTransaction(tx->GetId(),
+                                                  tx->GetId().ToString(),
+                                                  prioritydummy, amountdelta);
+                }
+                if (dumped.nTime + nExpiryTimeout <= nNow) {
+                    ++skipped;
+                    continue;
+                }
+                if (fTrustDump && AcceptDumpedEntry(config, mempool, dumped)) {
+                    ++count;
+                    ++trusted;
+                    continue;
+                }
+
+                CValidationState state;
                 AcceptToMemoryPoolWithTime(config, mempool, state, tx, true,
-                                           nullptr, nTime);
+                                           nullptr, dumped.nTime);
                 if (state.IsValid()) {
                     ++count;
                 } else {
                     ++failed;
                 }
-            } else {
-                ++skipped;
             }
             if (ShutdownRequested()) return false;
         }
-        std::map<uint256, CAmount> mapDeltas;
-        file >> mapDeltas;
+
+        // Dumped entries went in without trimming.
+        {
+            LOCK(cs_main);
+            LimitMempoolSize(
+                mempool,
+                GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000,
+                nExpiryTimeout);
+        }
 
         for (const auto &i : mapDeltas) {
             mempool.PrioritiseTransaction(i.first, i.first.ToString(),
@@ -4824,9 +6982,9 @@ bool LoadMempool(const Config &config) {
         return false;
     }
 
-    LogPrintf("Imported mempool transactions from disk: %i successes, %i "
-              "failed, %i expired\n",
-              count, failed, skipped);
+    LogPrintf("Imported mempool transactions from disk: %i successes (%i "
+              "without revalidation), %i failed, %i expired\n",
+              count, trusted, failed, skipped);
     return true;
 }
 
@@ -4834,14 +6992,42 @@ void DumpMempool(void) {
     int64_t start = GetTimeMicros();
 
     std::map<uint256, CAmount> mapDeltas;
-    std::vector<TxMempoolInfo> vinfo;
+    std::vector<MempoolDumpEntry> vDumped;
+    uint256 hashTip;
 
     {
-        LOCK(mempool.cs);
+        LOCK2(cs_main, mempool.cs);
+        if (chainActive.Tip()) {
+            hashTip = chainActive.Tip()->GetBlockHash();
+        }
         for (const auto &i : mempool.mapDeltas) {
             mapDeltas[i.first] = i.second.second;
         }
-        vinfo = mempool.infoAll();
+
+        // Parents have fewer ancestors than their children, so this order
+        // lets every entry find its parents when loaded.
+        std::vector<const CTxMemPoolEntry *> vEntries;
+        vEntries.reserve(mempool.mapTx.size());
+        for (const CTxMemPoolEntry &entry : mempool.mapTx) {
+            vEntries.push_back(&entry);
+        }
+        std::sort(vEntries.begin(), vEntries.end(),
+                  [](const CTxMemPoolEntry *a, const CTxMemPoolEntry *b) {
+                      return a->GetCountWithAncestors() <
+                             b->GetCountWithAncestors();
+                  });
+
+        vDumped.reserve(vEntries.size());
+        for (const CTxMemPoolEntry *entry : vEntries) {
+            const uint256 &txid = entry->GetTx().GetId();
+            std::map<uint256, CAmount>::iterator it = mapDeltas.find(txid);
+            CAmount nFeeDelta(0);
+            if (it != mapDeltas.end()) {
+                nFeeDelta = it->second;
+                mapDeltas.erase(it);
+            }
+            vDumped.emplace_back(*entry, nFeeDelta);
+        }
     }
 
     int64_t mid = GetTimeMicros();
@@ -4854,19 +7040,16 @@ void DumpMempool(void) {
         }
 
         CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
 
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
 
-        file << (uint64_t)vinfo.size();
-        for (const auto &i : vinfo) {
-            file << *(i.tx);
-            file << (int64_t)i.nTime;
-            file << (int64_t)i.nFeeDelta;
-            mapDeltas.erase(i.tx->GetId());
-        }
+        WriteHashed(file, hasher, hashTip);
+        WriteHashed(file, hasher, vDumped);
+        WriteHashed(file, hasher, mapDeltas);
+        file << hasher.GetHash();
 
-        file << mapDeltas;
         FileCommit(file.Get());
         file.fclose();
         RenameOver(GetDataDir() / "mempool.dat.new",
@@ -4877,6 +7060,136 @@ void DumpMempool(void) {
     } catch (const std::exception &e) {
         LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
     }
+
+    DumpValidationCaches();
+}
+
+static const uint64_t HOT_COINS_DUMP_VERSION = 1;
+
+void DumpHotCoins() {
+    const int64_t nMaxCoins = GetArg("-hotcoins", DEFAULT_HOT_COINS);
+    if (nMaxCoins <= 0) {
+        return;
+    }
+
+    std::vector<COutPoint> vOutPoints;
+    {
+        LOCK(cs_main);
+        if (pcoinsTip == nullptr) {
+            return;
+        }
+        pcoinsTip->GetHotCoins(nMaxCoins, vOutPoints);
+    }
+
+    try {
+        FILE *filestr =
+            fopen((GetDataDir() / "hotcoins.dat.new").string().c_str(), "wb");
+        if (!filestr) {
+            return;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = HOT_COINS_DUMP_VERSION;
+        file << version;
+        WriteHashed(file, hasher, vOutPoints);
+        file << hasher.GetHash();
+
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "hotcoins.dat.new",
+                   GetDataDir() / "hotcoins.dat");
+        LogPrintf("Dumped %u hot coins\n", vOutPoints.size());
+    } catch (const std::exception &e) {
+        LogPrintf("Failed to dump hot coins: %s. Continuing anyway.\n",
+                  e.what());
+    }
+}
+
+bool LoadHotCoins() {
+    FILE *filestr =
+        fopen((GetDataDir() / "hotcoins.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return false;
+    }
+
+    std::vector<COutPoint> vOutPoints;
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != HOT_COINS_DUMP_VERSION) {
+            return false;
+        }
+        CHashVerifier<CAutoFile> verifier(&file);
+        verifier >> vOutPoints;
+        uint256 hashChecksum;
+        file >> hashChecksum;
+        if (hashChecksum != verifier.GetHash()) {
+            LogPrintf("Hot coins file checksum mismatch. Continuing "
+                      "anyway.\n");
+            return false;
+        }
+    } catch (const std::exception &e) {
+        LogPrintf("Failed to deserialize hot coins on disk: %s. Continuing "
+                  "anyway.\n",
+                  e.what());
+        return false;
+    }
+
+    // A batch at a time like PrefetchInputs, which the prefetch threads and
+    // cs_main are shared with, so that blocks and the mempool reload go on
+    // meanwhile. Coins spent since the dump are not found and skipped.
+    int64_t nStart = GetTimeMillis();
+    size_t nLoaded = 0;
+    for (size_t i = 0; i < vOutPoints.size();
+         i += HOT_COINS_LOAD_BATCH_SIZE) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested()) {
+            return false;
+        }
+
+        LOCK(cs_main);
+        // Leave room for the blocks to come.
+        if (pcoinsTip->DynamicMemoryUsage() > nCoinCacheUsage / 2) {
+            break;
+        }
+        const CCoinsView &backend = *pcoinsTip->GetBackend();
+        const size_t nEnd =
+            std::min(vOutPoints.size(), i + HOT_COINS_LOAD_BATCH_SIZE);
+        std::vector<COutPoint> vBatch;
+        for (size_t j = i; j < nEnd; j++) {
+            if (!pcoinsTip->HaveCoinInCache(vOutPoints[j])) {
+                vBatch.push_back(vOutPoints[j]);
+            }
+        }
+        std::vector<Coin> vCoins(vBatch.size());
+        std::vector<CCoinPrefetch> vChecks;
+        vChecks.reserve(vBatch.size());
+        for (size_t j = 0; j < vBatch.size(); j++) {
+            vChecks.emplace_back(backend, vBatch[j], &vCoins[j]);
+        }
+        CCheckQueueControl<CCoinPrefetch> control(&prefetchqueue);
+        control.Add(vChecks);
+        control.Wait();
+
+        for (size_t j = 0; j < vBatch.size(); j++) {
+            if (!vCoins[j].IsSpent()) {
+                pcoinsTip->AddFetchedCoin(vBatch[j], std::move(vCoins[j]));
+                nLoaded++;
+            }
+        }
+    }
+
+    LogPrintf("Loaded %u of %u hot coins from disk in %dms\n", nLoaded,
+              vOutPoints.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+void ThreadLoadHotCoins() {
+    RenameThread("bitcoin-hotcoins");
+    LoadHotCoins();
 }
 
 //! Guess how far we are in the verification process at the given block index
@@ -4902,9 +7215,7 @@ public:
     CMainCleanup() {}
     ~CMainCleanup() {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
     }
 } instance_of_cmaincleanup;
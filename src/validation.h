@@ -14,6 +14,7 @@
 #include "amount.h"
 #include "chain.h"
 #include "coins.h"
+#include "interest.h"
 #include "protocol.h" // For CMessageHeader::MessageMagic
 #include "script/script_error.h"
 #include "sync.h"
@@ -26,13 +27,17 @@
 #include <cstdint>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <utility>
 #include <vector>
 
+class CAutoFile;
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockView;
+class CCoinsViewAsyncWrite;
 class CBloomFilter;
 class CChainParams;
 class CConnman;
@@ -40,10 +45,12 @@ class CInv;
 class Config;
 class CScriptCheck;
 class CTxMemPool;
+class CBlockUndo;
 class CTxUndo;
 class CValidationInterface;
 class CValidationState;
 class MineWorker;
+class SnapshotMetadata;
 struct ChainTxData;
 
 struct PrecomputedTransactionData;
@@ -58,6 +65,9 @@ static const bool DEFAULT_WHITELISTRELAY = true;
 static const bool DEFAULT_WHITELISTFORCERELAY = true;
 /** Default for -minrelaytxfee, minimum relay fee for transactions */
 static const CAmount DEFAULT_MIN_RELAY_TX_FEE(1000 * 100); // Update from 1000 PerKB to 100 SatoshiPerB
+/** Default for -contentminrelaytxfee, minimum relay fee for transactions
+ * carrying content, which cannot be waived for priority */
+static const CAmount DEFAULT_CONTENT_MIN_RELAY_TX_FEE(DEFAULT_MIN_RELAY_TX_FEE);
 //! -maxtxfee default
 static const CAmount DEFAULT_TRANSACTION_MAXFEE(COIN / 10);
 //! Discourage users to set fees higher than this amount (in satoshis) per kB
@@ -78,6 +88,8 @@ static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in
  * hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 336;
+/** Maximum kilobytes for transactions to store for processing during reorg */
+static const unsigned int MAX_DISCONNECTED_TX_POOL_SIZE = 20000;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -86,12 +98,23 @@ static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 
 /** Maximum number of script-checking threads allowed */
-static const int MAX_SCRIPTCHECK_THREADS = 16;
+static const int MAX_SCRIPTCHECK_THREADS = 64;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Number of blocks whose data is read in parallel ahead of a reorg */
+static const unsigned int DISCONNECT_READ_BATCH_SIZE = 16;
 /** Number of blocks that can be requested at any given time from a single peer.
  */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Bounds on the blocks requested from a peer whose download rate is known,
+ * sized so its requests take about BLOCK_DOWNLOAD_TARGET_SECONDS to arrive. */
+static const int MIN_ADAPTIVE_BLOCKS_IN_TRANSIT = 2;
+static const int MAX_ADAPTIVE_BLOCKS_IN_TRANSIT = 128;
+static const int64_t BLOCK_DOWNLOAD_TARGET_SECONDS = 4;
+/** Time in seconds after which the block holding back the download window is
+ * requested again from a peer at least twice as fast as the one it waits for.
+ */
+static const int64_t BLOCK_STRAGGLER_TIMEOUT = 2;
 /** Timeout in seconds during which a peer must stall block download progress
  * before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
@@ -100,6 +123,12 @@ static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
  *  less than this number, we reached its tip. Changing this value is a protocol
  * upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 2000;
+/** Headers fetched ahead of the main header sync that are held, at most, until
+ * the chain below them is known. */
+static const unsigned int MAX_HEADER_RANGE_BUFFER = 50 * MAX_HEADERS_RESULTS;
+/** Time in seconds a peer fetching a header range may go without delivering
+ * before the range is handed to another peer. */
+static const int64_t HEADER_RANGE_TIMEOUT = 60;
 /** Maximum depth of blocks we're willing to serve as compact blocks to peers
  *  when requested. For older blocks, a regular BLOCK response will be sent. */
 static const int MAX_CMPCTBLOCK_DEPTH = 5;
@@ -152,6 +181,7 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+static const bool DEFAULT_DEPOSITINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 /** Default for using fee filter */
@@ -166,6 +196,11 @@ static const int MAX_UNCONNECTING_HEADERS = 10;
 
 static const bool DEFAULT_PEERBLOOMFILTERS = true;
 
+/** Default for -hotcoins, coins whose cache entries outlive a restart */
+static const int64_t DEFAULT_HOT_COINS = 250000;
+/** Hot coins read with cs_main held at a time */
+static const size_t HOT_COINS_LOAD_BATCH_SIZE = 1000;
+
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
@@ -175,19 +210,24 @@ extern const std::string strMessageMagic;
 extern CWaitableCriticalSection csBestBlock;
 extern CConditionVariable cvBlockChange;
 extern std::atomic_bool fImporting;
-extern bool fReindex;
+extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fDepositIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+/** Whether new blocks are written to the block files compressed. */
+extern bool fBlockCompression;
 extern size_t nCoinCacheUsage;
 extern MineWorker *mineworker;
 
 /** A fee rate smaller than this is considered zero fee (for relaying, mining
  * and transaction creation) */
 extern CFeeRate minRelayTxFee;
+/** A fee rate transactions carrying content must pay to be relayed */
+extern CFeeRate contentMinRelayTxFee;
 /** Absolute maximum transaction fee (in satoshis) used by wallet and mempool
  * (rejects high fee in sendrawtransaction) */
 extern CAmount maxTxFee;
@@ -216,6 +256,9 @@ extern uint64_t nPruneTarget;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of
  * chainActive.Tip() will not be pruned. */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
+/** Number of blocks from the tip kept with their undo data for
+ * reorganizations, at least MIN_BLOCKS_TO_KEEP (-prunedepth). */
+extern int nPruneDepth;
 
 static const signed int DEFAULT_CHECKBLOCKS = 6;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
@@ -292,8 +335,27 @@ bool InitBlockIndex(const Config &config);
 bool LoadBlockIndex(const CChainParams &chainparams);
 /** Unload database information */
 void UnloadBlockIndex();
+/**
+ * Save the block index to a snapshot that the next LoadBlockIndex reads
+ * instead of the database, if nothing changes in between. Only done once the
+ * index is flushed.
+ */
+bool WriteBlockIndexSnapshot();
+/** Memory used by mapBlockIndex and its entries, in bytes. cs_main held */
+size_t BlockIndexMemoryUsage();
+/**
+ * Save which blocks the last VerifyDB checked, so that the next startup
+ * doesn't check them again. Only done at a clean shutdown.
+ */
+bool WriteVerifiedBlocks();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header proof-of-work checking thread */
+void ThreadHeaderCheck();
+/** Run an instance of the thread reading coins ahead of ConnectBlock */
+void ThreadCoinPrefetch();
+/** Run an instance of the thread reading blocks ahead of DisconnectTip */
+void ThreadDisconnectRead();
 /** Check whether we are doing an initial block download (synchronizing from
  * disk or network) */
 bool IsInitialBlockDownload();
@@ -312,6 +374,27 @@ std::string GetWarnings(const std::string &strFor);
 bool GetTransaction(const Config &config, const uint256 &hash,
                     CTransactionRef &tx, uint256 &hashBlock,
                     bool fAllowSlow = false);
+/**
+ * Retrieve the content of an output. Coins don't keep it, so it is read from
+ * the transaction that created the output.
+ */
+bool GetCoinContent(const Config &config, const COutPoint &outpoint,
+                    std::string &strContent);
+/**
+ * Read up to nLength bytes of an output's content, starting at nOffset, and
+ * its full size.
+ */
+bool ReadOutputContent(const Config &config, const COutPoint &outpoint,
+                       uint64_t nOffset, uint64_t nLength, std::string &strData,
+                       uint64_t &nSize);
+/**
+ * Replace the chainstate of a node at the genesis block with a snapshot, whose
+ * header has been read from file, and make its base block the tip. The blocks
+ * below it are treated as pruned.
+ */
+bool ActivateUTXOSnapshot(const Config &config, CAutoFile &file,
+                          const SnapshotMetadata &metadata,
+                          std::string &strError);
 /** Find the best known block, and make it the tip of the block chain */
 bool ActivateBestChain(
     const Config &config, CValidationState &state,
@@ -330,21 +413,34 @@ double GuessVerificationProgress(const ChainTxData &data, CBlockIndex *pindex);
  * target. Changing back to unpruned requires a reindex (which in this case
  * means the blockchain must be re-downloaded.)
  *
- * Pruning functions are called from FlushStateToDisk when the global
- * fCheckForPruning flag has been set. Block and undo files are deleted in
- * lock-step (when blk00003.dat is deleted, so is rev00003.dat.) Pruning cannot
- * take place until the longest chain is at least a certain length (100000 on
- * mainnet, 1000 on testnet, 1000 on regtest). Pruning will never delete a block
- * within a defined distance (currently 288) from the active chain's tip. The
- * block index is updated by unsetting HAVE_DATA and HAVE_UNDO for any blocks
- * that were stored in the deleted files. A db flag records the fact that at
- * least some block files have been pruned.
+ * Pruning functions are called from PruneBlockFiles, on the block pruner
+ * thread, when the global fCheckForPruning flag has been set. Block and undo
+ * files are deleted in lock-step (when blk00003.dat is deleted, so is
+ * rev00003.dat.) Pruning cannot take place until the longest chain is at least
+ * a certain length (100000 on mainnet, 1000 on testnet, 1000 on regtest).
+ * Pruning will never delete a block above nLastBlockWeCanPrune. The block
+ * index is updated by unsetting HAVE_DATA and HAVE_UNDO for any blocks that
+ * were stored in the deleted files. A db flag records the fact that at least
+ * some block files have been pruned.
  *
  * @param[out]   setFilesToPrune   The set of file indices that can be unlinked
  * will be returned
+ * @return Whether the files left are under the target
  */
-void FindFilesToPrune(std::set<int> &setFilesToPrune,
-                      uint64_t nPruneAfterHeight);
+bool FindFilesToPrune(std::set<int> &setFilesToPrune,
+                      uint64_t nPruneAfterHeight, int nLastBlockWeCanPrune);
+
+/**
+ * Prune the block and undo files, up to nManualPruneHeight if it is set, or
+ * else to stay under the target if fCheckForPruning is set. Neither the
+ * blocks within nPruneDepth of the tip, nor those above nMaxPruneHeight, nor
+ * those the coin database on disk isn't past are pruned. When the coin
+ * database holds pruning back, the next flush writes it.
+ *
+ * The block index is written before the files are deleted, without cs_main.
+ * Returns false on error.
+ */
+bool PruneBlockFiles(int nMaxPruneHeight, int nManualPruneHeight);
 
 /**
  *  Mark one block file as pruned.
@@ -381,6 +477,17 @@ bool AcceptToMemoryPool(const Config &config, CTxMemPool &pool,
                         bool fOverrideMempoolLimit = false,
                         const CAmount nAbsurdFee = CAmount(0));
 
+/**
+ * The checks of AcceptToMemoryPool that a transaction relayed as a skeleton
+ * can fail before its content is fetched: standardness, conflicts and fees.
+ * tx is the transaction without its nContentSize bytes of content, its
+ * GetTotalSize() being the size with them. Missing inputs pass, passing
+ * doesn't mean AcceptToMemoryPool will accept the whole transaction.
+ */
+bool PreCheckTxWithoutContent(const Config &config, CTxMemPool &pool,
+                              CValidationState &state, const CTransaction &tx,
+                              uint64_t nContentSize);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -394,7 +501,8 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params &params,
                                    Consensus::DeploymentPos pos);
 
 /**
- * Count ECDSA signature operations the old-fashioned (pre-0.6) way
+ * Count ECDSA signature operations the old-fashioned (pre-0.6) way, as counted
+ * once when tx was constructed
  * @return number of sigops this transaction's outputs will produce when spent
  * @see CTransaction::FetchInputs
  */
@@ -438,7 +546,7 @@ uint64_t GetTransactionSigOpCount(const CTransaction &tx,
 bool CheckInputs(const CTransaction &tx, CValidationState &state,
                  const CCoinsViewCache &view, bool fScriptChecks,
                  uint32_t flags, bool sigCacheStore, bool scriptCacheStore,
-                 const PrecomputedTransactionData &txdata,
+                 PrecomputedTransactionData &txdata,
                  std::vector<CScriptCheck> *pvChecks = nullptr);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
@@ -451,8 +559,35 @@ void UpdateCoins(const CTransaction &tx, CCoinsViewCache &inputs,
 CAmount GetInterest(CAmount principal, uint32_t locktime, uint32_t blockHeight);
 CAmount GetTxOutInterest(const CTxOut out,uint32_t nBaseHeight);
 CAmount GetTxInterest(const CTransaction &tx, uint32_t nBaseHeight);
+/**
+ * Interest tx may claim in a block on top of pindexPrev. Unlike the height
+ * based version, this does not depend on chainActive.
+ */
+CAmount GetTxInterest(const CTransaction &tx, const CBlockIndex *pindexPrev);
+/**
+ * Decay period of the interest paid in a block on top of pindexPrev, false if
+ * all interest is paid out. The interest a transaction may claim only depends
+ * on this period.
+ */
+bool GetInterestPeriodAfter(const CBlockIndex *pindexPrev, size_t &nPeriod);
 bool GetCurrentInterestInfo(double &periodMinInterestRate, CAmount &periodTotal, CAmount &periodToken, CAmount &totalLeft);
 double GetInterestRate(uint32_t nLockBlocks,uint32_t nBlockHeight);
+
+/**
+ * Interest paid out up to and including the block at nHeight of the active
+ * chain, false above the tip. Looked up without cs_main.
+ */
+bool GetChainInterestAt(int nHeight, uint64_t &nChainInterest);
+
+/**
+ * The decay period whose rates the block at nHeight of the active chain pays,
+ * the block after the tip included. False for the genesis block and above.
+ */
+bool GetInterestPeriodAtHeight(int nHeight,
+                               CInterestHistory::PeriodStart &start);
+
+/** The decay periods of the active chain and the heights they start at */
+std::vector<CInterestHistory::PeriodStart> GetInterestPeriodStarts();
 //CAmount GetFee(const CTransaction &tx,const CCoinsViewCache& view,uint32_t nBaseHeight);
 
 /** Context-independent validity checks for coinbase and non-coinbase
@@ -477,7 +612,8 @@ bool CheckTxInputs(const CTransaction &tx, CValidationState &state,
 
 /**
  * Closure representing one script verification.
- * Note that this stores references to the spending transaction.
+ * Note that this stores references to the spending transaction and to its
+ * PrecomputedTransactionData.
  */
 class CScriptCheck {
 private:
@@ -488,12 +624,13 @@ private:
     uint32_t nFlags;
     bool cacheStore;
     ScriptError error;
-    PrecomputedTransactionData txdata;
+    //!< Shared by the checks of a transaction, which it must outlive
+    const PrecomputedTransactionData *txdata;
 
 public:
     CScriptCheck()
         : amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false),
-          error(SCRIPT_ERR_UNKNOWN_ERROR), txdata() {}
+          error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(nullptr) {}
 
     CScriptCheck(const CScript &scriptPubKeyIn, const CAmount amountIn,
                  const CTransaction &txToIn, unsigned int nInIn,
@@ -501,7 +638,7 @@ public:
                  const PrecomputedTransactionData &txdataIn)
         : scriptPubKey(scriptPubKeyIn), amount(amountIn), ptxTo(&txToIn),
           nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn),
-          error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) {}
+          error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(&txdataIn) {}
 
     bool operator()();
 
@@ -520,12 +657,41 @@ public:
 };
 
 /** Functions for disk access for blocks */
+/**
+ * What WriteBlockToDisk stores for block: its serialization, compressed with
+ * -blockcompression if that makes it smaller. Returns whether it is compressed.
+ */
+bool MakeBlockRecord(const CBlock &block, std::vector<uint8_t> &vRecord);
+bool WriteBlockToDisk(const std::vector<uint8_t> &vRecord, bool fCompressed,
+                      CDiskBlockPos &pos,
+                      const CMessageHeader::MessageMagic &messageStart);
+/**
+ * Write block uncompressed, serialized straight into the file rather than into
+ * a record first.
+ */
 bool WriteBlockToDisk(const CBlock &block, CDiskBlockPos &pos,
                       const CMessageHeader::MessageMagic &messageStart);
 bool ReadBlockFromDisk(CBlock &block, const CDiskBlockPos &pos,
                        const Config &config);
 bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex,
                        const Config &config);
+/**
+ * Read the block of pindex as a CBlockView, which leaves the transactions in
+ * the mapped block file or the decompressed record. The header is checked as
+ * ReadBlockFromDisk checks it.
+ */
+bool ReadBlockViewFromDisk(CBlockView &view, const CBlockIndex *pindex,
+                           const Config &config);
+/**
+ * Read the serialized block at pos, without deserializing or checking it, e.g.
+ * to serve it to a peer. A block stored compressed is decompressed.
+ */
+bool ReadRawBlockFromDisk(std::vector<uint8_t> &block,
+                          const CDiskBlockPos &pos,
+                          const CMessageHeader::MessageMagic &messageStart);
+/** Read the undo data at pos of the block whose parent is hashBlock */
+bool UndoReadFromDisk(CBlockUndo &blockundo, const CDiskBlockPos &pos,
+                      const uint256 &hashBlock);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -587,13 +753,21 @@ class CVerifyDB {
 public:
     CVerifyDB();
     ~CVerifyDB();
+    /**
+     * Check the last nCheckDepth blocks of the best chain. With fSkipVerified,
+     * blocks that an earlier run checked before shutting down cleanly are
+     * skipped, see WriteVerifiedBlocks.
+     */
     bool VerifyDB(const Config &config, CCoinsView *coinsview, int nCheckLevel,
-                  int nCheckDepth);
+                  int nCheckDepth, bool fSkipVerified = false);
 };
 
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex *FindForkInGlobalIndex(const CChain &chain,
                                    const CBlockLocator &locator);
+/** The same for a chain snapshot, without cs_main */
+const CBlockIndex *FindForkInGlobalIndex(const CChainSnapshot &chain,
+                                         const CBlockLocator &locator);
 
 /** Mark a block as precious and reorganize. */
 bool PreciousBlock(const Config &config, CValidationState &state,
@@ -609,10 +783,33 @@ bool ResetBlockFailureFlags(CBlockIndex *pindex);
 /** The currently-connected chain of blocks (protected by cs_main). */
 extern CChain chainActive;
 
+/**
+ * chainActive as of its tip, for RPCs that read the chain without cs_main.
+ * Replaced under cs_main whenever the tip changes, so it is chainActive for
+ * whoever holds cs_main.
+ */
+std::shared_ptr<const CChainSnapshot> GetChainSnapshot();
+
+/**
+ * Held, besides cs_main, while entries are added to mapBlockIndex or it is
+ * cleared, for LookupBlockIndex. Taken after cs_main.
+ */
+extern CCriticalSection cs_blockIndexLookup;
+
+/**
+ * Find the block index entry of hash without cs_main, nullptr if there is
+ * none. The entry has its header fields, height and chain work set.
+ */
+CBlockIndex *LookupBlockIndex(const uint256 &hash);
+
 /** Global variable that points to the active CCoinsView (protected by cs_main)
  */
 extern CCoinsViewCache *pcoinsTip;
 
+/** Global variable that points to the view writing pcoinsTip's flushes to the
+ * coin database in the background (protected by cs_main) */
+extern CCoinsViewAsyncWrite *pcoinsWriter;
+
 /** Global variable that points to the active block tree (protected by cs_main)
  */
 extern CBlockTreeDB *pblocktree;
@@ -649,10 +846,22 @@ static const unsigned int REJECT_CONFLICT = 0x102;
 /** Get block file info entry for one block file */
 CBlockFileInfo *GetBlockFileInfo(size_t n);
 
-/** Dump the mempool to disk. */
+/** Dump the mempool and the signature and script caches to disk. */
 void DumpMempool();
 
-/** Load the mempool from disk. */
+/** Load the signature and script caches and the mempool from disk. */
 bool LoadMempool(const Config &config);
 
+/** Dump the outpoints of the most recently used coins of pcoinsTip. */
+void DumpHotCoins();
+
+/**
+ * Read the coins of the last DumpHotCoins into pcoinsTip with parallel reads,
+ * while the cache has room.
+ */
+bool LoadHotCoins();
+
+/** Run LoadHotCoins on a thread of its own. */
+void ThreadLoadHotCoins();
+
 #endif // BITCOIN_VALIDATION_H
@@ -5,13 +5,211 @@
 
 #include "validationinterface.h"
 
+#include "scheduler.h"
+#include "txdb.h"
+
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <mutex>
+
 static CMainSignals g_signals;
 
 CMainSignals &GetMainSignals() {
     return g_signals;
 }
 
-void RegisterValidationInterface(CValidationInterface *pwalletIn) {
+/**
+ * Connected to the signals in place of the listeners registered with fAsync,
+ * for the notifications they get asynchronously. Each is queued on the
+ * background scheduler and delivered to all of them in turn.
+ */
+class CValidationInterfaceQueue : public CValidationInterface {
+private:
+    //! Guards pqueue and pschedulerQueue
+    std::mutex cs_queue;
+    std::unique_ptr<SingleThreadedSchedulerClient> pqueue;
+    CScheduler *pschedulerQueue = nullptr;
+
+    //! Guards listeners, held while delivering to them so that a listener
+    //! unregistered from another thread is not called afterwards
+    std::mutex cs_listeners;
+    std::vector<CValidationInterface *> listeners;
+
+    typedef std::function<void(CValidationInterface *)> Callback;
+
+    void Deliver(const Callback &callback) {
+        std::lock_guard<std::mutex> lock(cs_listeners);
+        for (CValidationInterface *plistener : listeners) {
+            callback(plistener);
+        }
+    }
+
+    void Queue(Callback callback) {
+        Run(std::bind(&CValidationInterfaceQueue::Deliver, this,
+                      std::move(callback)));
+    }
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew,
+                         const CBlockIndex *pindexFork,
+                         bool fInitialDownload) override {
+        Queue([=](CValidationInterface *p) {
+            p->UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
+        });
+    }
+    void SyncTransaction(const CTransactionRef &ptx, const CBlockIndex *pindex,
+                         int posInBlock) override {
+        Queue([=](CValidationInterface *p) {
+            p->SyncTransaction(ptx, pindex, posInBlock);
+        });
+    }
+    void SetBestChain(const CBlockLocator &locator) override {
+        Queue([=](CValidationInterface *p) { p->SetBestChain(locator); });
+    }
+    void UpdatedTransaction(const uint256 &hash) override {
+        Queue([=](CValidationInterface *p) { p->UpdatedTransaction(hash); });
+    }
+    void Inventory(const uint256 &hash) override {
+        Queue([=](CValidationInterface *p) { p->Inventory(hash); });
+    }
+    void ResendWalletTransactions(int64_t nBestBlockTime,
+                                  CConnman *connman) override {
+        Queue([=](CValidationInterface *p) {
+            p->ResendWalletTransactions(nBestBlockTime, connman);
+        });
+    }
+    void ResetRequestCount(const uint256 &hash) override {
+        Queue([=](CValidationInterface *p) { p->ResetRequestCount(hash); });
+    }
+    void NewPoWValidBlock(const CBlockIndex *pindex,
+                          const std::shared_ptr<const CBlock> &block) override {
+        Queue([=](CValidationInterface *p) {
+            p->NewPoWValidBlock(pindex, block);
+        });
+    }
+    void BlockDeposits(const CBlockIndex *pindex,
+                       const DepositIndexEntries &created,
+                       const DepositIndexEntries &unlocked) override {
+        Queue([=](CValidationInterface *p) {
+            p->BlockDeposits(pindex, created, unlocked);
+        });
+    }
+
+public:
+    //! Returns whether this is the first listener, for the caller to connect
+    //! the queue to the signals
+    bool AddListener(CValidationInterface *pwalletIn) {
+        std::lock_guard<std::mutex> lock(cs_listeners);
+        listeners.push_back(pwalletIn);
+        return listeners.size() == 1;
+    }
+
+    //! Returns whether no listener is left, for the caller to disconnect the
+    //! queue from the signals
+    bool RemoveListener(CValidationInterface *pwalletIn) {
+        std::lock_guard<std::mutex> lock(cs_listeners);
+        auto it = std::find(listeners.begin(), listeners.end(), pwalletIn);
+        if (it == listeners.end()) {
+            return false;
+        }
+        listeners.erase(it);
+        return listeners.empty();
+    }
+
+    void RemoveAllListeners() {
+        std::lock_guard<std::mutex> lock(cs_listeners);
+        listeners.clear();
+    }
+
+    //! Runs func on the background scheduler once the notifications queued
+    //! so far have been delivered, or right away without one
+    void Run(std::function<void()> func) {
+        {
+            std::lock_guard<std::mutex> lock(cs_queue);
+            if (pqueue) {
+                pqueue->AddToProcessQueue(std::move(func));
+                return;
+            }
+        }
+        func();
+    }
+
+    void SetScheduler(CScheduler *pscheduler) {
+        std::lock_guard<std::mutex> lock(cs_queue);
+        pqueue.reset(pscheduler ? new SingleThreadedSchedulerClient(
+                                      pscheduler, "validationinterface")
+                                : nullptr);
+        pschedulerQueue = pscheduler;
+    }
+
+    void Flush() {
+        SingleThreadedSchedulerClient *pqueueFlushed;
+        {
+            std::lock_guard<std::mutex> lock(cs_queue);
+            if (!pqueue || pschedulerQueue->AreThreadsServicingQueue()) {
+                return;
+            }
+            pqueueFlushed = pqueue.get();
+        }
+        // Not under cs_queue, delivering may queue more.
+        pqueueFlushed->EmptyQueue();
+    }
+
+    size_t CallbacksPending() {
+        std::lock_guard<std::mutex> lock(cs_queue);
+        return pqueue ? pqueue->CallbacksPending() : 0;
+    }
+
+    //! The notifications a validating thread waits on, directly or for their
+    //! side effects
+    static void ConnectSynchronous(CValidationInterface *pwalletIn);
+    static void DisconnectSynchronous(CValidationInterface *pwalletIn);
+    //! The others, which the queue can deliver
+    static void ConnectAsynchronous(CValidationInterface *pwalletIn);
+    static void DisconnectAsynchronous(CValidationInterface *pwalletIn);
+};
+
+static CValidationInterfaceQueue g_queue;
+
+void CMainSignals::RegisterBackgroundSignalScheduler(CScheduler &scheduler) {
+    g_queue.SetScheduler(&scheduler);
+}
+
+void CMainSignals::UnregisterBackgroundSignalScheduler() {
+    g_queue.SetScheduler(nullptr);
+}
+
+void CMainSignals::FlushBackgroundCallbacks() {
+    g_queue.Flush();
+}
+
+size_t CMainSignals::CallbacksPending() {
+    return g_queue.CallbacksPending();
+}
+
+void CValidationInterfaceQueue::ConnectSynchronous(
+    CValidationInterface *pwalletIn) {
+    g_signals.BlockChecked.connect(
+        boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
+    g_signals.ScriptForMining.connect(
+        boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
+    g_signals.NewMiningWork.connect(
+        boost::bind(&CValidationInterface::NewMiningWork, pwalletIn, _1));
+}
+
+void CValidationInterfaceQueue::DisconnectSynchronous(
+    CValidationInterface *pwalletIn) {
+    g_signals.NewMiningWork.disconnect(
+        boost::bind(&CValidationInterface::NewMiningWork, pwalletIn, _1));
+    g_signals.ScriptForMining.disconnect(
+        boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
+    g_signals.BlockChecked.disconnect(
+        boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
+}
+
+void CValidationInterfaceQueue::ConnectAsynchronous(
+    CValidationInterface *pwalletIn) {
     g_signals.UpdatedBlockTip.connect(boost::bind(
         &CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
     g_signals.SyncTransaction.connect(boost::bind(
@@ -24,23 +222,18 @@ void RegisterValidationInterface(CValidationInterface *pwalletIn) {
         boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
     g_signals.Broadcast.connect(boost::bind(
         &CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
-    g_signals.BlockChecked.connect(
-        boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-    g_signals.ScriptForMining.connect(
-        boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
     g_signals.BlockFound.connect(
         boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
     g_signals.NewPoWValidBlock.connect(boost::bind(
         &CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+    g_signals.BlockDeposits.connect(boost::bind(
+        &CValidationInterface::BlockDeposits, pwalletIn, _1, _2, _3));
 }
 
-void UnregisterValidationInterface(CValidationInterface *pwalletIn) {
+void CValidationInterfaceQueue::DisconnectAsynchronous(
+    CValidationInterface *pwalletIn) {
     g_signals.BlockFound.disconnect(
         boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
-    g_signals.ScriptForMining.disconnect(
-        boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
-    g_signals.BlockChecked.disconnect(
-        boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
     g_signals.Broadcast.disconnect(boost::bind(
         &CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
     g_signals.Inventory.disconnect(
@@ -55,9 +248,29 @@ void UnregisterValidationInterface(CValidationInterface *pwalletIn) {
         &CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
     g_signals.NewPoWValidBlock.disconnect(boost::bind(
         &CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+    g_signals.BlockDeposits.disconnect(boost::bind(
+        &CValidationInterface::BlockDeposits, pwalletIn, _1, _2, _3));
+}
+
+void RegisterValidationInterface(CValidationInterface *pwalletIn, bool fAsync) {
+    CValidationInterfaceQueue::ConnectSynchronous(pwalletIn);
+    if (!fAsync) {
+        CValidationInterfaceQueue::ConnectAsynchronous(pwalletIn);
+    } else if (g_queue.AddListener(pwalletIn)) {
+        CValidationInterfaceQueue::ConnectAsynchronous(&g_queue);
+    }
+}
+
+void UnregisterValidationInterface(CValidationInterface *pwalletIn) {
+    if (g_queue.RemoveListener(pwalletIn)) {
+        CValidationInterfaceQueue::DisconnectAsynchronous(&g_queue);
+    }
+    CValidationInterfaceQueue::DisconnectAsynchronous(pwalletIn);
+    CValidationInterfaceQueue::DisconnectSynchronous(pwalletIn);
 }
 
 void UnregisterAllValidationInterfaces() {
+    g_queue.RemoveAllListeners();
     g_signals.BlockFound.disconnect_all_slots();
     g_signals.ScriptForMining.disconnect_all_slots();
     g_signals.BlockChecked.disconnect_all_slots();
@@ -68,4 +281,12 @@ void UnregisterAllValidationInterfaces() {
     g_signals.SyncTransaction.disconnect_all_slots();
     g_signals.UpdatedBlockTip.disconnect_all_slots();
     g_signals.NewPoWValidBlock.disconnect_all_slots();
+    g_signals.NewMiningWork.disconnect_all_slots();
+    g_signals.BlockDeposits.disconnect_all_slots();
+}
+
+void SyncWithValidationInterfaceQueue() {
+    std::promise<void> promise;
+    g_queue.Run([&promise] { promise.set_value(); });
+    promise.get_future().wait();
 }
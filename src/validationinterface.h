@@ -6,7 +6,11 @@
 #ifndef BITCOIN_VALIDATIONINTERFACE_H
 #define BITCOIN_VALIDATIONINTERFACE_H
 
+#include "primitives/transaction.h"
+
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include <boost/signals2/signal.hpp>
 
@@ -16,26 +20,46 @@ struct CBlockLocator;
 class CBlockIndex;
 class CConnman;
 class CReserveScript;
-class CTransaction;
+class CScheduler;
 class CValidationInterface;
 class CValidationState;
 class uint256;
+struct Work;
+struct CDepositIndexKey;
+struct CDepositIndexValue;
+
+// As in txdb.h
+typedef std::vector<std::pair<CDepositIndexKey, CDepositIndexValue>>
+    DepositIndexEntries;
 
 // These functions dispatch to one or all registered wallets
 
-/** Register a wallet to receive updates from core */
-void RegisterValidationInterface(CValidationInterface *pwalletIn);
+/**
+ * Register a wallet to receive updates from core. With fAsync, the
+ * notifications nothing waits on are delivered in order from the background
+ * scheduler thread instead of the thread that validated, which does not wait
+ * for the listener. BlockChecked, GetScriptForMining and NewMiningWork are
+ * always called synchronously.
+ */
+void RegisterValidationInterface(CValidationInterface *pwalletIn,
+                                 bool fAsync = false);
 /** Unregister a wallet from core */
 void UnregisterValidationInterface(CValidationInterface *pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
+/**
+ * Wait until the notifications queued for asynchronous listeners so far have
+ * been delivered. Must not be called with cs_main held, as the listeners take
+ * it.
+ */
+void SyncWithValidationInterfaceQueue();
 
 class CValidationInterface {
 protected:
     virtual void UpdatedBlockTip(const CBlockIndex *pindexNew,
                                  const CBlockIndex *pindexFork,
                                  bool fInitialDownload) {}
-    virtual void SyncTransaction(const CTransaction &tx,
+    virtual void SyncTransaction(const CTransactionRef &ptx,
                                  const CBlockIndex *pindex, int posInBlock) {}
     virtual void SetBestChain(const CBlockLocator &locator) {}
     virtual void UpdatedTransaction(const uint256 &hash) {}
@@ -47,9 +71,14 @@ protected:
     virtual void ResetRequestCount(const uint256 &hash){};
     virtual void NewPoWValidBlock(const CBlockIndex *pindex,
                                   const std::shared_ptr<const CBlock> &block){};
-    friend void ::RegisterValidationInterface(CValidationInterface *);
+    virtual void NewMiningWork(const Work &work) {}
+    virtual void BlockDeposits(const CBlockIndex *pindex,
+                               const DepositIndexEntries &created,
+                               const DepositIndexEntries &unlocked) {}
+    friend void ::RegisterValidationInterface(CValidationInterface *, bool);
     friend void ::UnregisterValidationInterface(CValidationInterface *);
     friend void ::UnregisterAllValidationInterfaces();
+    friend class CValidationInterfaceQueue;
 };
 
 struct CMainSignals {
@@ -71,7 +100,7 @@ struct CMainSignals {
      * removal was due to conflict from connected block), or appeared in a
      * disconnected block.
      */
-    boost::signals2::signal<void(const CTransaction &,
+    boost::signals2::signal<void(const CTransactionRef &,
                                  const CBlockIndex *pindex, int posInBlock)>
         SyncTransaction;
     /**
@@ -102,6 +131,33 @@ struct CMainSignals {
     boost::signals2::signal<void(const CBlockIndex *,
                                  const std::shared_ptr<const CBlock> &)>
         NewPoWValidBlock;
+    /** Notifies listeners of a new mining job */
+    boost::signals2::signal<void(const Work &)> NewMiningWork;
+    /**
+     * Notifies listeners of the deposits a block connected to the active chain
+     * creates, and, with -depositindex, of those that can be spent from the
+     * next block on. Only computed when there are listeners.
+     */
+    boost::signals2::signal<void(const CBlockIndex *,
+                                 const DepositIndexEntries &,
+                                 const DepositIndexEntries &)>
+        BlockDeposits;
+
+    /**
+     * Deliver the notifications of asynchronous listeners from the thread
+     * servicing scheduler. Until then, and once unregistered, they are
+     * delivered synchronously.
+     */
+    void RegisterBackgroundSignalScheduler(CScheduler &scheduler);
+    void UnregisterBackgroundSignalScheduler();
+    /**
+     * Deliver what is still queued for asynchronous listeners on the calling
+     * thread. Does nothing while a thread services the scheduler, so only
+     * useful at shutdown, once it stopped.
+     */
+    void FlushBackgroundCallbacks();
+    /** Number of notifications queued for asynchronous listeners */
+    size_t CallbacksPending();
 };
 
 CMainSignals &GetMainSignals();
@@ -311,13 +311,14 @@ CDB::CDB(const std::string &strFilename, const char *pszMode,
 void CDB::Flush() {
     if (activeTxn) return;
 
-    // Flush database activity from memory pool to disk log
-    unsigned int nMinutes = 0;
-    if (fReadOnly) nMinutes = 1;
+    if (fReadOnly) {
+        bitdb.dbenv->txn_checkpoint(
+            GetArg("-dblogsize", DEFAULT_WALLET_DBLOGSIZE) * 1024, 1, 0);
+        return;
+    }
 
-    bitdb.dbenv->txn_checkpoint(
-        nMinutes ? GetArg("-dblogsize", DEFAULT_WALLET_DBLOGSIZE) * 1024 : 0,
-        nMinutes, 0);
+    // A checkpoint each time would write back every page the writes touched.
+    bitdb.FlushLazily();
 }
 
 void CDB::Close() {
@@ -442,6 +443,12 @@ bool CDB::Rewrite(const std::string &strFile, const char *pszSkip) {
     return false;
 }
 
+void CDBEnv::FlushLazily() {
+    dbenv->log_flush(nullptr);
+    dbenv->txn_checkpoint(GetArg("-dblogsize", DEFAULT_WALLET_DBLOGSIZE) * 1024,
+                          1, 0);
+}
+
 void CDBEnv::Flush(bool fShutdown) {
     int64_t nStart = GetTimeMillis();
     // Flush log data to the actual data file on all files that are not in use
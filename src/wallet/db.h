@@ -72,6 +72,13 @@ public:
     bool Open(const boost::filesystem::path &path);
     void Close();
     void Flush(bool fShutdown);
+    /**
+     * Make what was committed survive a crash by syncing the log, which
+     * recovery replays, and only checkpoint the databases once the log has
+     * grown -dblogsize KiB or a minute has passed. The rest is left to Flush
+     * when the files are idle.
+     */
+    void FlushLazily();
     void CheckpointLSN(const std::string &strFile);
 
     void CloseDb(const std::string &strFile);
@@ -12,6 +12,7 @@
 #include "dstencode.h"
 #include "init.h"
 #include "net.h"
+#include "rpc/jsonstream.h"
 #include "rpc/misc.h"
 #include "rpc/server.h"
 #include "timedata.h"
@@ -368,7 +369,7 @@ static UniValue getaddressesbyaccount(const Config &config,
         const CTxDestination &dest = item.first;
         const std::string &strName = item.second.name;
         if (strName == strAccount) {
-            ret.push_back(EncodeDestination(dest));
+            ret.push_back(item.second.GetAddress(dest));
         }
     }
 
@@ -553,13 +554,15 @@ static UniValue listaddressgroupings(const Config &config,
         UniValue jsonGrouping(UniValue::VARR);
         for (const CTxDestination &address : grouping) {
             UniValue addressInfo(UniValue::VARR);
-            addressInfo.push_back(EncodeDestination(address));
+            std::map<CTxDestination, CAddressBookData>::const_iterator mi =
+                pwalletMain->mapAddressBook.find(address);
+            addressInfo.push_back(mi != pwalletMain->mapAddressBook.end()
+                                      ? mi->second.GetAddress(address)
+                                      : EncodeDestination(address));
             addressInfo.push_back(ValueFromAmount(balances[address]));
 
-            if (pwalletMain->mapAddressBook.find(address) !=
-                pwalletMain->mapAddressBook.end()) {
-                addressInfo.push_back(
-                    pwalletMain->mapAddressBook.find(address)->second.name);
+            if (mi != pwalletMain->mapAddressBook.end()) {
+                addressInfo.push_back(mi->second.name);
             }
             jsonGrouping.push_back(addressInfo);
         }
@@ -1101,16 +1104,27 @@ static UniValue sendfrom(const Config &config, const JSONRPCRequest &request) {
     return wtx.GetId().GetHex();
 }
 
+/** Blocks a deposit is locked for, from a lockdays argument */
+static uint32_t LockBlocksFromValue(const UniValue &value) {
+    RPCTypeCheckArgument(value, UniValue::VNUM);
+    const int nLockDays = value.get_int();
+    if (nLockDays < 16) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           "Invalid locktime, must > 16 blockdays");
+    }
+    return nLockDays * Params().GetConsensus().nBlocksPerDay;
+}
+
 static UniValue sendmany(const Config &config, const JSONRPCRequest &request) {
     if (!EnsureWalletIsAvailable(request.fHelp)) {
         return NullUniValue;
     }
 
     if (request.fHelp || request.params.size() < 2 ||
-        request.params.size() > 5) {
+        request.params.size() > 6) {
         throw std::runtime_error(
             "sendmany \"fromaccount\" {\"address\":amount,...} ( minconf "
-            "\"comment\" [\"address\",...] )\n"
+            "\"comment\" [\"address\",...] lockdays )\n"
             "\nSend multiple times. Amounts are double-precision floating "
             "point numbers." +
             HelpRequiringPassphrase() +
@@ -1144,6 +1158,10 @@ static UniValue sendmany(const Config &config, const JSONRPCRequest &request) {
             "address\n"
             "      ,...\n"
             "    ]\n"
+            "6. lockdays                (numeric, optional) Deposit each "
+            "amount instead, locked for\n"
+            "                           this many days, see "
+            "deposittoaddress.\n"
             "\nResult:\n"
             "\"txid\"                   (string) The transaction id for the "
             "send. Only 1 transaction is created regardless of \n"
@@ -1171,6 +1189,13 @@ static UniValue sendmany(const Config &config, const JSONRPCRequest &request) {
                            "1 \"\" "
                            "\"[\\\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XX\\\","
                            "\\\"1353tsE8YMTA4EuV7dgUXGjNFf9KpVvKHz\\\"]\"") +
+            "\nDeposit two amounts to two different addresses for 160 "
+            "days, in one transaction:\n" +
+            HelpExampleCli("sendmany",
+                           "\"\" "
+                           "\"{\\\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XX\\\":0.01,"
+                           "\\\"1353tsE8YMTA4EuV7dgUXGjNFf9KpVvKHz\\\":0.02}\" "
+                           "1 \"\" \"[]\" 160") +
             "\nAs a json rpc call\n" +
             HelpExampleRpc("sendmany",
                            "\"\", "
@@ -1202,10 +1227,15 @@ static UniValue sendmany(const Config &config, const JSONRPCRequest &request) {
     }
 
     UniValue subtractFeeFromAmount(UniValue::VARR);
-    if (request.params.size() > 4) {
+    if (request.params.size() > 4 && !request.params[4].isNull()) {
         subtractFeeFromAmount = request.params[4].get_array();
     }
 
+    uint32_t nLockBlocks = 0;
+    if (request.params.size() > 5 && !request.params[5].isNull()) {
+        nLockBlocks = LockBlocksFromValue(request.params[5]);
+    }
+
     std::set<CTxDestination> destinations;
     std::vector<CRecipient> vecSend;
 
@@ -1241,7 +1271,8 @@ static UniValue sendmany(const Config &config, const JSONRPCRequest &request) {
             }
         }
 
-        CRecipient recipient = {scriptPubKey, nAmount, 0, fSubtractFeeFromAmount};
+        CRecipient recipient = {scriptPubKey, nAmount, nLockBlocks,
+                                fSubtractFeeFromAmount};
         vecSend.push_back(recipient);
     }
 
@@ -1260,8 +1291,10 @@ static UniValue sendmany(const Config &config, const JSONRPCRequest &request) {
     CAmount nFeeRequired(0);
     int nChangePosRet = -1;
     std::string strFailReason;
+    // All the deposits are made with the same coins, and pay one fee.
     bool fCreated = pwalletMain->CreateTransaction(
-        vecSend, wtx, keyChange, nFeeRequired, nChangePosRet, strFailReason);
+        vecSend, wtx, keyChange, nFeeRequired, nChangePosRet, strFailReason,
+        nullptr, true, nLockBlocks > 0);
     if (!fCreated) {
         throw JSONRPCError(RPC_WALLET_INSUFFICIENT_FUNDS, strFailReason);
     }
@@ -1439,7 +1472,7 @@ static UniValue ListReceived(const Config &config, const UniValue &params,
             if (fIsWatchonly) {
                 obj.push_back(Pair("involvesWatchonly", true));
             }
-            obj.push_back(Pair("address", EncodeDestination(dest)));
+            obj.push_back(Pair("address", item.second.GetAddress(dest)));
             obj.push_back(Pair("account", strAccount));
             obj.push_back(Pair("amount", ValueFromAmount(nAmount)));
             obj.push_back(
@@ -1583,9 +1616,14 @@ static UniValue listreceivedbyaccount(const Config &config,
 }
 
 static void MaybePushAddress(UniValue &entry, const CTxDestination &dest) {
-    if (IsValidDestination(dest)) {
-        entry.push_back(Pair("address", EncodeDestination(dest)));
+    if (!IsValidDestination(dest)) {
+        return;
     }
+    std::map<CTxDestination, CAddressBookData>::const_iterator mi =
+        pwalletMain->mapAddressBook.find(dest);
+    entry.push_back(Pair("address", mi != pwalletMain->mapAddressBook.end()
+                                        ? mi->second.GetAddress(dest)
+                                        : EncodeDestination(dest)));
 }
 
 void ListTransactions(const CWalletTx &wtx, const std::string &strAccount,
@@ -1669,6 +1707,45 @@ void ListTransactions(const CWalletTx &wtx, const std::string &strAccount,
     }
 }
 
+/**
+ * The number of entries ListTransactions adds for wtx, without building
+ * them, for the entries listtransactions skips.
+ */
+static size_t CountTransactions(const CWalletTx &wtx,
+                                const std::string &strAccount, int nMinDepth,
+                                const isminefilter &filter) {
+    CAmount nFee;
+    std::string strSentAccount;
+    std::list<COutputEntry> listReceived;
+    std::list<COutputEntry> listSent;
+
+    wtx.GetAmounts(listReceived, listSent, nFee, strSentAccount, filter);
+
+    bool fAllAccounts = (strAccount == std::string("*"));
+    size_t nCount = 0;
+    if ((!listSent.empty() || nFee != CAmount(0)) &&
+        (fAllAccounts || strAccount == strSentAccount)) {
+        nCount += listSent.size();
+    }
+    if (listReceived.size() > 0 && wtx.GetDepthInMainChain() >= nMinDepth) {
+        for (const COutputEntry &r : listReceived) {
+            if (fAllAccounts) {
+                nCount++;
+                continue;
+            }
+            auto mi = pwalletMain->mapAddressBook.find(r.destination);
+            std::string account;
+            if (mi != pwalletMain->mapAddressBook.end()) {
+                account = mi->second.name;
+            }
+            if (account == strAccount) {
+                nCount++;
+            }
+        }
+    }
+    return nCount;
+}
+
 void AcentryToJSON(const CAccountingEntry &acentry,
                    const std::string &strAccount, UniValue &ret) {
     bool fAllAccounts = (strAccount == std::string("*"));
@@ -1791,8 +1868,6 @@ static UniValue listtransactions(const Config &config,
             HelpExampleRpc("listtransactions", "\"*\", 20, 100"));
     }
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-
     std::string strAccount = "*";
     if (request.params.size() > 0) {
         strAccount = request.params[0].get_str();
@@ -1820,24 +1895,44 @@ static UniValue listtransactions(const Config &config,
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
     }
     UniValue ret(UniValue::VARR);
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+
+        const CWallet::TxItems &txOrdered = pwalletMain->wtxOrdered;
+
+        // iterate backwards until we have nCount items to return, only
+        // counting the entries of the transactions before nFrom:
+        int nSkipped = 0;
+        for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin();
+             it != txOrdered.rend(); ++it) {
+            CWalletTx *const pwtx = (*it).second.first;
+            CAccountingEntry *const pacentry = (*it).second.second;
+            if (ret.empty()) {
+                int nEntries = 0;
+                if (pwtx != 0) {
+                    nEntries = CountTransactions(*pwtx, strAccount, 0, filter);
+                } else if (pacentry != 0 && (strAccount == "*" ||
+                                             pacentry->strAccount ==
+                                                 strAccount)) {
+                    nEntries = 1;
+                }
+                if (nSkipped + nEntries <= nFrom) {
+                    nSkipped += nEntries;
+                    continue;
+                }
+            }
+            if (pwtx != 0) {
+                ListTransactions(*pwtx, strAccount, 0, true, ret, filter);
+            }
+            if (pacentry != 0) {
+                AcentryToJSON(*pacentry, strAccount, ret);
+            }
 
-    const CWallet::TxItems &txOrdered = pwalletMain->wtxOrdered;
-
-    // iterate backwards until we have nCount items to return:
-    for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin();
-         it != txOrdered.rend(); ++it) {
-        CWalletTx *const pwtx = (*it).second.first;
-        if (pwtx != 0) {
-            ListTransactions(*pwtx, strAccount, 0, true, ret, filter);
-        }
-        CAccountingEntry *const pacentry = (*it).second.second;
-        if (pacentry != 0) {
-            AcentryToJSON(*pacentry, strAccount, ret);
-        }
-
-        if ((int)ret.size() >= (nCount + nFrom)) {
-            break;
+            if ((int)ret.size() >= (nCount + nFrom - nSkipped)) {
+                break;
+            }
         }
+        nFrom -= nSkipped;
     }
 
     // ret is newest to oldest
@@ -1866,6 +1961,18 @@ static UniValue listtransactions(const Config &config,
     // Return oldest to newest
     std::reverse(arrTmp.begin(), arrTmp.end());
 
+    if (request.pStream) {
+        // The entries are written one by one, without the locks, and neither
+        // go back into ret nor into the text of the whole array.
+        ret.clear();
+        request.pStream->BeginArray();
+        for (const UniValue &entry : arrTmp) {
+            request.pStream->Value(entry);
+        }
+        request.pStream->EndArray();
+        return NullUniValue;
+    }
+
     ret.clear();
     ret.setArray();
     ret.push_backV(arrTmp);
@@ -2098,13 +2205,17 @@ static UniValue listsinceblock(const Config &config,
 
     UniValue transactions(UniValue::VARR);
 
-    for (std::map<uint256, CWalletTx>::iterator it =
-             pwalletMain->mapWallet.begin();
-         it != pwalletMain->mapWallet.end(); it++) {
-        CWalletTx tx = (*it).second;
-
-        if (depth == -1 || tx.GetDepthInMainChain() < depth) {
-            ListTransactions(tx, "*", 0, true, transactions, filter);
+    if (depth == -1) {
+        for (const auto &entry : pwalletMain->mapWallet) {
+            ListTransactions(entry.second, "*", 0, true, transactions, filter);
+        }
+    } else {
+        // Only the transactions of the blocks after pindex, and those in none.
+        for (const CWalletTx *pwtx :
+             pwalletMain->GetTransactionsAfter(pindex->nHeight)) {
+            if (pwtx->GetDepthInMainChain() < depth) {
+                ListTransactions(*pwtx, "*", 0, true, transactions, filter);
+            }
         }
     }
 
@@ -2246,8 +2357,12 @@ static UniValue gettransaction(const Config &config,
     ListTransactions(wtx, "*", 0, false, details, filter);
     entry.push_back(Pair("details", details));
 
-    std::string strHex =
-        EncodeHexTx(static_cast<CTransaction>(wtx), RPCSerializationFlags());
+    CTransactionRef tx;
+    if (!pwalletMain->GetFullTransaction(wtx, tx)) {
+        throw JSONRPCError(RPC_WALLET_ERROR,
+                           "Cannot read the transaction from the wallet");
+    }
+    std::string strHex = EncodeHexTx(*tx, RPCSerializationFlags());
     entry.push_back(Pair("hex", strHex));
 
     return entry;
@@ -2871,6 +2986,11 @@ static UniValue getwalletinfo(const Config &config,
                             "  \"immature_balance\": xxxxxx,   (numeric) the "
                             "total immature balance of the wallet in " +
             CURRENCY_UNIT + "\n"
+                            "  \"locked_principal\": xxxxxx,   (numeric) the "
+                            "principal of the deposits still locked, see "
+                            "getmyinterest\n"
+                            "  \"locked_interest\": xxxxxx,    (numeric) the "
+                            "interest they pay\n"
                             "  \"txcount\": xxxxxxx,           (numeric) the "
                             "total number of transactions in the wallet\n"
                             "  \"keypoololdest\": xxxxxx,      (numeric) the "
@@ -2895,13 +3015,18 @@ static UniValue getwalletinfo(const Config &config,
 
     LOCK2(cs_main, pwalletMain->cs_wallet);
 
+    const CWalletBalances balances = pwalletMain->GetBalances();
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("walletversion", pwalletMain->GetVersion()));
-    obj.push_back(Pair("balance", ValueFromAmount(pwalletMain->GetBalance())));
+    obj.push_back(Pair("balance", ValueFromAmount(balances.nTrusted)));
     obj.push_back(Pair("unconfirmed_balance",
-                       ValueFromAmount(pwalletMain->GetUnconfirmedBalance())));
+                       ValueFromAmount(balances.nUntrustedPending)));
     obj.push_back(Pair("immature_balance",
-                       ValueFromAmount(pwalletMain->GetImmatureBalance())));
+                       ValueFromAmount(balances.nImmature)));
+    obj.push_back(Pair("locked_principal",
+                       ValueFromAmount(balances.nLockedPrincipal)));
+    obj.push_back(Pair("locked_interest",
+                       ValueFromAmount(balances.nLockedInterest)));
     obj.push_back(Pair("txcount", (int)pwalletMain->mapWallet.size()));
     obj.push_back(Pair("keypoololdest", pwalletMain->GetOldestKeyPoolTime()));
     obj.push_back(Pair("keypoolsize", (int)pwalletMain->GetKeyPoolSize()));
@@ -3089,11 +3214,14 @@ static UniValue listunspent(const Config &config,
         entry.push_back(Pair("vout", out.i));
 
         if (fValidAddress) {
-            entry.push_back(Pair("address", EncodeDestination(address)));
-
-            if (pwalletMain->mapAddressBook.count(address)) {
+            std::map<CTxDestination, CAddressBookData>::const_iterator mi =
+                pwalletMain->mapAddressBook.find(address);
+            if (mi != pwalletMain->mapAddressBook.end()) {
                 entry.push_back(
-                    Pair("account", pwalletMain->mapAddressBook[address].name));
+                    Pair("address", mi->second.GetAddress(address)));
+                entry.push_back(Pair("account", mi->second.name));
+            } else {
+                entry.push_back(Pair("address", EncodeDestination(address)));
             }
 
             if (scriptPubKey.IsPayToScriptHash()) {
@@ -3374,16 +3502,7 @@ static UniValue deposittoaddress(const Config &config,
 
     EnsureWalletIsUnlocked();
 
-    uint32_t nLockBlocks = 1;
-    int nLockDays = 0;
-    RPCTypeCheckArgument(request.params[0], UniValue::VNUM);
-    nLockDays = request.params[0].get_int();
-
-
-    if (nLockDays < 16 ) {
-        throw JSONRPCError(RPC_INVALID_PARAMETER, std::string("Invalid locktime, must > 16 blockdays"));
-    }
-    nLockBlocks = nLockDays * Params().GetConsensus().nBlocksPerDay;
+    const uint32_t nLockBlocks = LockBlocksFromValue(request.params[0]);
 
     // CAmount
     CAmount nAmount = AmountFromValue(request.params[1]);
@@ -3478,7 +3597,7 @@ static const CRPCCommand commands[] = {
     { "wallet",             "lockunspent",              lockunspent,              true,   {"unlock","transactions"} },
     { "wallet",             "move",                     movecmd,                  false,  {"fromaccount","toaccount","amount","minconf","comment"} },
     { "wallet",             "sendfrom",                 sendfrom,                 false,  {"fromaccount","toaddress","amount","minconf","comment","comment_to"} },
-    { "wallet",             "sendmany",                 sendmany,                 false,  {"fromaccount","amounts","minconf","comment","subtractfeefrom"} },
+    { "wallet",             "sendmany",                 sendmany,                 false,  {"fromaccount","amounts","minconf","comment","subtractfeefrom","lockdays"} },
     { "wallet",             "sendtoaddress",            sendtoaddress,            false,  {"address","amount","comment","comment_to","subtractfeefromamount"} },
     { "wallet",             "setaccount",               setaccount,               true,   {"address","account"} },
     { "wallet",             "settxfee",                 settxfee,                 true,   {"amount"} },
@@ -437,6 +437,73 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset) {
     empty_wallet();
 }
 
+static void add_bnb_coin(std::vector<CBnBCoin> &vBnBCoins, CAmount nValue,
+                         CAmount nFee = 0, CAmount nWaste = 0) {
+    CBnBCoin coin;
+    coin.coin = std::make_pair(nullptr, (unsigned int)vBnBCoins.size());
+    coin.nValue = nValue;
+    coin.nEffectiveValue = nValue - nFee;
+    coin.nWaste = nWaste;
+    vBnBCoins.push_back(coin);
+}
+
+BOOST_AUTO_TEST_CASE(bnb_search_test) {
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+    std::vector<CBnBCoin> vBnBCoins;
+    for (int i = 1; i <= 4; i++) {
+        add_bnb_coin(vBnBCoins, i * COIN);
+    }
+
+    // An exact match, or none.
+    BOOST_CHECK(
+        SelectCoinsBnB(vBnBCoins, 5 * COIN, 0, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 5 * COIN);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+    BOOST_CHECK(
+        SelectCoinsBnB(vBnBCoins, 10 * COIN, 0, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 4U);
+    BOOST_CHECK(
+        !SelectCoinsBnB(vBnBCoins, 11 * COIN, 0, setCoinsRet, nValueRet));
+    BOOST_CHECK(setCoinsRet.empty());
+
+    // Up to the cost of change more.
+    BOOST_CHECK(!SelectCoinsBnB(vBnBCoins, 450 * CENT, 10 * CENT, setCoinsRet,
+                                nValueRet));
+    BOOST_CHECK(SelectCoinsBnB(vBnBCoins, 450 * CENT, 50 * CENT, setCoinsRet,
+                               nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 5 * COIN);
+
+    // Selected by their effective value, those that add nothing are left
+    // out.
+    vBnBCoins.clear();
+    add_bnb_coin(vBnBCoins, 3 * COIN, COIN);
+    add_bnb_coin(vBnBCoins, COIN, COIN);
+    add_bnb_coin(vBnBCoins, 2 * COIN, COIN);
+    BOOST_CHECK(
+        SelectCoinsBnB(vBnBCoins, 3 * COIN, 0, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 5 * COIN);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+    // With waste, one coin rather than two.
+    vBnBCoins.clear();
+    add_bnb_coin(vBnBCoins, 2 * COIN, 0, CENT);
+    add_bnb_coin(vBnBCoins, 2 * COIN, 0, CENT);
+    add_bnb_coin(vBnBCoins, 4 * COIN, 0, CENT);
+    BOOST_CHECK(
+        SelectCoinsBnB(vBnBCoins, 4 * COIN, 0, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 1U);
+    // And less excess rather than fewer coins.
+    vBnBCoins.clear();
+    add_bnb_coin(vBnBCoins, 7 * COIN);
+    add_bnb_coin(vBnBCoins, 3 * COIN);
+    add_bnb_coin(vBnBCoins, 3 * COIN);
+    BOOST_CHECK(
+        SelectCoinsBnB(vBnBCoins, 6 * COIN, COIN, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 6 * COIN);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+}
+
 BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup) {
     LOCK(cs_main);
 
@@ -510,4 +577,263 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup) {
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(rescan_script_filter, TestChain100Setup) {
+    LOCK(cs_main);
+    CKey watchKey;
+    watchKey.MakeNewKey(true);
+    const CScript watchScript =
+        GetScriptForDestination(watchKey.GetPubKey().GetID());
+    const CScript redeemScript =
+        GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+    wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+    wallet.AddCScript(redeemScript);
+    wallet.AddWatchOnly(watchScript, 0);
+    ScriptSet setScripts;
+    wallet.GetScanScripts(setScripts);
+    BOOST_CHECK_EQUAL(setScripts.size(), 4U);
+    BOOST_CHECK(setScripts.count(redeemScript));
+    BOOST_CHECK(setScripts.count(
+        GetScriptForDestination(coinbaseKey.GetPubKey().GetID())));
+    BOOST_CHECK(
+        setScripts.count(GetScriptForDestination(CScriptID(redeemScript))));
+    BOOST_CHECK(setScripts.count(watchScript));
+
+    // The key pushed with OP_PUSHDATA1 rather than the way the wallet writes
+    // it, and a script of none of those.
+    const std::vector<uint8_t> vchPubKey =
+        ToByteVector(coinbaseKey.GetPubKey());
+    std::vector<uint8_t> vchScript = {OP_PUSHDATA1,
+                                      uint8_t(vchPubKey.size())};
+    vchScript.insert(vchScript.end(), vchPubKey.begin(), vchPubKey.end());
+    vchScript.push_back(OP_CHECKSIG);
+    CBlockIndex *pindexStart = chainActive.Tip();
+    CreateAndProcessBlock({}, CScript(vchScript.begin(), vchScript.end()));
+    CreateAndProcessBlock({}, watchScript);
+    CreateAndProcessBlock({}, CScript() << OP_TRUE);
+
+    BOOST_CHECK_EQUAL(wallet.ScanForWalletTransactions(pindexStart),
+                      pindexStart);
+    // The coinbase of pindexStart, and of two of the new blocks.
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(mine_scripts) {
+    CKey key, watchKey;
+    key.MakeNewKey(true);
+    watchKey.MakeNewKey(true);
+    const CScript watchScript =
+        GetScriptForDestination(watchKey.GetPubKey().GetID());
+    const CScript redeemScript = GetScriptForRawPubKey(watchKey.GetPubKey());
+
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+    wallet.AddKeyPubKey(key, key.GetPubKey());
+    wallet.AddCScript(redeemScript);
+    wallet.AddWatchOnly(watchScript, 0);
+
+    BOOST_CHECK(
+        wallet.MayBeMine(GetScriptForDestination(key.GetPubKey().GetID())));
+    BOOST_CHECK(wallet.MayBeMine(GetScriptForRawPubKey(key.GetPubKey())));
+    BOOST_CHECK(
+        wallet.MayBeMine(GetScriptForDestination(CScriptID(redeemScript))));
+    BOOST_CHECK(wallet.MayBeMine(watchScript));
+    // Neither the key nor a script of the wallet.
+    BOOST_CHECK(!wallet.MayBeMine(
+        GetScriptForDestination(CKeyID(uint160S("c0ffee")))));
+    BOOST_CHECK(!wallet.MayBeMine(
+        GetScriptForDestination(CScriptID(CScript() << OP_TRUE))));
+    BOOST_CHECK(!wallet.MayBeMine(CScript() << OP_TRUE));
+
+    // What the wallet no longer watches isn't.
+    wallet.RemoveWatchOnly(watchScript);
+    BOOST_CHECK(!wallet.MayBeMine(watchScript));
+    BOOST_CHECK(wallet.IsMine(CTxOut(COIN, watchScript)) == ISMINE_NO);
+    BOOST_CHECK(
+        wallet.MayBeMine(GetScriptForDestination(CScriptID(redeemScript))));
+}
+
+static CWalletTx MakeDeposit(const CWallet &wallet, const CScript &script,
+                             int nHeight, uint32_t nLockTime) {
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.push_back(CTxOut(11 * COIN, script, "", nLockTime, 10 * COIN));
+    CWalletTx wtx(&wallet, MakeTransactionRef(std::move(tx)));
+    wtx.hashBlock = chainActive[nHeight]->GetBlockHash();
+    wtx.nIndex = 0;
+    return wtx;
+}
+
+BOOST_FIXTURE_TEST_CASE(deposit_index, TestChain100Setup) {
+    LOCK(cs_main);
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+    wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+    const CScript script = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+
+    // Unlocking at heights 59 and 99, and someone else's.
+    CWalletTx a = MakeDeposit(wallet, script, 50, 10);
+    CWalletTx b = MakeDeposit(wallet, script, 60, 40);
+    CWalletTx c = MakeDeposit(
+        wallet, GetScriptForRawPubKey(otherKey.GetPubKey()), 60, 40);
+    wallet.LoadToWallet(b);
+    wallet.LoadToWallet(a);
+    wallet.LoadToWallet(c);
+
+    std::vector<CTxOutVerbose> vDeposits;
+    wallet.GetAllDeposit(vDeposits);
+    BOOST_REQUIRE_EQUAL(vDeposits.size(), 2U);
+    BOOST_CHECK(vDeposits[0].txid == a.GetId());
+    BOOST_CHECK_EQUAL(vDeposits[0].height, 50);
+    BOOST_CHECK(vDeposits[1].txid == b.GetId());
+    BOOST_CHECK_EQUAL(vDeposits[1].height, 60);
+
+    wallet.GetAllDeposit(vDeposits, 60);
+    BOOST_REQUIRE_EQUAL(vDeposits.size(), 1U);
+    BOOST_CHECK(vDeposits[0].txid == b.GetId());
+    wallet.GetAllDeposit(vDeposits, 0, 59);
+    BOOST_REQUIRE_EQUAL(vDeposits.size(), 1U);
+    BOOST_CHECK(vDeposits[0].txid == a.GetId());
+
+    // Moving to another block moves the deposit in the index.
+    a.hashBlock = chainActive[80]->GetBlockHash();
+    wallet.LoadToWallet(a);
+    wallet.GetAllDeposit(vDeposits, 0, 59);
+    BOOST_CHECK(vDeposits.empty());
+    wallet.GetAllDeposit(vDeposits, 89, 89);
+    BOOST_REQUIRE_EQUAL(vDeposits.size(), 1U);
+    BOOST_CHECK(vDeposits[0].txid == a.GetId());
+}
+
+BOOST_FIXTURE_TEST_CASE(cached_balances, TestChain100Setup) {
+    // Every query is checked against all transactions as well.
+    fCheckWalletBalances = true;
+    LOCK(cs_main);
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+    wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+    wallet.ScanForWalletTransactions(chainActive.Genesis());
+
+    // Unlocking at height 101.
+    CWalletTx deposit = MakeDeposit(
+        wallet, GetScriptForRawPubKey(coinbaseKey.GetPubKey()), 90, 12);
+    wallet.LoadToWallet(deposit);
+
+    const CWalletBalances before = wallet.GetBalances();
+    BOOST_CHECK(before.nImmature > 0);
+    BOOST_CHECK_EQUAL(before.nLockedPrincipal, 10 * COIN);
+    BOOST_CHECK_EQUAL(before.nLockedInterest, COIN);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), before.nTrusted);
+
+    // The wallet isn't told of the new blocks. The first coinbase matures
+    // and the deposit unlocks all the same.
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+    const CScript otherScript = GetScriptForRawPubKey(otherKey.GetPubKey());
+    CreateAndProcessBlock({}, otherScript);
+    BOOST_CHECK_EQUAL(wallet.GetBalances().nLockedPrincipal, 10 * COIN);
+    CreateAndProcessBlock({}, otherScript);
+    const CWalletBalances after = wallet.GetBalances();
+    BOOST_CHECK(after.nImmature < before.nImmature);
+    BOOST_CHECK_EQUAL(after.nTrusted + after.nImmature,
+                      before.nTrusted + before.nImmature);
+    BOOST_CHECK_EQUAL(after.nLockedPrincipal, 0);
+    BOOST_CHECK_EQUAL(after.nLockedInterest, 0);
+
+    // Abandoned transactions drop out.
+    CWalletTx pending = MakeDeposit(
+        wallet, GetScriptForRawPubKey(coinbaseKey.GetPubKey()), 0, 0);
+    pending.hashBlock = uint256();
+    pending.nIndex = -1;
+    wallet.LoadToWallet(pending);
+    BOOST_CHECK(wallet.GetBalances() == after);
+    BOOST_CHECK(wallet.AbandonTransaction(pending.GetId()));
+    BOOST_CHECK(wallet.GetBalances() == after);
+
+    // Starting over comes to the same.
+    wallet.MarkDirty();
+    BOOST_CHECK(wallet.GetBalances() == after);
+    fCheckWalletBalances = DEFAULT_CHECK_WALLET_BALANCES;
+}
+
+static bool HasCoin(const std::vector<COutput> &vCoins, const uint256 &txid) {
+    for (const COutput &coin : vCoins) {
+        if (coin.tx->GetId() == txid) {
+            return true;
+        }
+    }
+    return false;
+}
+
+BOOST_FIXTURE_TEST_CASE(available_coins_index, TestChain100Setup) {
+    LOCK(cs_main);
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+    wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+    wallet.ScanForWalletTransactions(chainActive.Genesis());
+    const CScript script = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+    const CScript otherScript = GetScriptForRawPubKey(otherKey.GetPubKey());
+
+    // None of the coinbases has matured. The deposits unlock at heights 60,
+    // 100 and 102.
+    CWalletTx a = MakeDeposit(wallet, script, 50, 10);
+    CWalletTx b = MakeDeposit(wallet, script, 60, 40);
+    CWalletTx c = MakeDeposit(wallet, script, 90, 12);
+    wallet.LoadToWallet(a);
+    wallet.LoadToWallet(b);
+    wallet.LoadToWallet(c);
+
+    std::vector<COutput> vCoins;
+    wallet.AvailableCoins(vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), 2U);
+    BOOST_CHECK(HasCoin(vCoins, a.GetId()));
+    BOOST_CHECK(HasCoin(vCoins, b.GetId()));
+    wallet.AvailableCoins(vCoins, true, nullptr, false, true);
+    BOOST_CHECK(vCoins.size() > 100U);
+    BOOST_CHECK(HasCoin(vCoins, c.GetId()));
+
+    // Spent by a transaction that isn't in the mempool, until it is
+    // abandoned.
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(a.GetId(), 0);
+    spend.vout.push_back(CTxOut(11 * COIN, otherScript));
+    CWalletTx wtxSpend(&wallet, MakeTransactionRef(std::move(spend)));
+    wallet.LoadToWallet(wtxSpend);
+    wallet.AvailableCoins(vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), 1U);
+    BOOST_CHECK(!HasCoin(vCoins, a.GetId()));
+    BOOST_CHECK(wallet.AbandonTransaction(wtxSpend.GetId()));
+    wallet.AvailableCoins(vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), 2U);
+    BOOST_CHECK(HasCoin(vCoins, a.GetId()));
+
+    // The wallet isn't told of the new blocks. The first coinbase matures,
+    // and then the last deposit unlocks.
+    CreateAndProcessBlock({}, otherScript);
+    wallet.AvailableCoins(vCoins);
+    const size_t nMatured = vCoins.size();
+    BOOST_CHECK(nMatured > 2U);
+    BOOST_CHECK(!HasCoin(vCoins, c.GetId()));
+    CreateAndProcessBlock({}, otherScript);
+    wallet.AvailableCoins(vCoins);
+    BOOST_CHECK(vCoins.size() > nMatured);
+    BOOST_CHECK(HasCoin(vCoins, c.GetId()));
+
+    // Indexing again comes to the same.
+    const size_t nAvailable = vCoins.size();
+    wallet.MarkDirty();
+    wallet.AvailableCoins(vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), nAvailable);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
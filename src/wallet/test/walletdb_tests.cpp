@@ -134,4 +134,125 @@ BOOST_AUTO_TEST_CASE(no_dest_fails) {
     BOOST_CHECK(!walletdb->WriteDestData(dst, "key", "value"));
 }
 
+BOOST_AUTO_TEST_CASE(batch_writes) {
+    const std::string strFile = (pathTemp / "batch_writes.dat").string();
+    CWallet wallet(strFile);
+    bool fFirstRun;
+    BOOST_CHECK(wallet.LoadWallet(fFirstRun) == DB_LOAD_OK);
+
+    CTxDestination dst1 = CKeyID(uint160S("c0ffee"));
+    CTxDestination dst2 = CKeyID(uint160S("f00d"));
+    {
+        LOCK(wallet.cs_wallet);
+        CWalletBatch batch(&wallet);
+        BOOST_CHECK(wallet.SetAddressBook(dst1, "name1", "receive"));
+        {
+            // Part of the outer batch, as is that of the key pool.
+            CWalletBatch nested(&wallet);
+            BOOST_CHECK(wallet.TopUpKeyPool(10));
+        }
+        BOOST_CHECK(wallet.SetAddressBook(dst2, "name2", "send"));
+    }
+
+    // All of it was committed.
+    CWalletDB walletdb(strFile);
+    auto w = LoadWallet(&walletdb);
+    BOOST_CHECK_EQUAL("name1", w->mapAddressBook[dst1].name);
+    BOOST_CHECK_EQUAL("send", w->mapAddressBook[dst2].purpose);
+    for (int64_t nIndex = 1; nIndex <= 11; nIndex++) {
+        CKeyPool keypool;
+        BOOST_CHECK(walletdb.ReadPool(nIndex, keypool));
+        BOOST_CHECK(w->HaveKey(keypool.vchPubKey.GetID()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(load_without_content) {
+    const std::string strFile =
+        (pathTemp / "load_without_content.dat").string();
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(uint256S("c0ffee"), 0);
+    mtx.vout.resize(2);
+    mtx.vout[0].nValue = 1000;
+    mtx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    mtx.vout[0].strContent = std::string(10000, 'c');
+    mtx.vout[1].nValue = 2000;
+    mtx.vout[1].scriptPubKey = CScript() << OP_TRUE;
+    const CTransactionRef tx = MakeTransactionRef(mtx);
+    BOOST_CHECK(CWalletDB(strFile, "cr+").WriteTx(CWalletTx(nullptr, tx)));
+
+    CWallet wallet(strFile);
+    bool fFirstRun;
+    BOOST_CHECK(wallet.LoadWallet(fFirstRun) == DB_LOAD_OK);
+    LOCK(wallet.cs_wallet);
+    CWalletTx &wtx = wallet.mapWallet[tx->GetId()];
+    BOOST_CHECK(wtx.fContentDropped);
+    BOOST_CHECK(wtx.GetId() == tx->GetId());
+    BOOST_CHECK(wtx.tx->vout[0].strContent.empty());
+    BOOST_CHECK_EQUAL(wtx.tx->vout[1].nValue, 2000);
+
+    // Writing the metadata keeps the content in the file.
+    wtx.mapValue["comment"] = "kept";
+    BOOST_CHECK(CWalletDB(strFile).WriteTx(wtx));
+    CTransactionRef txFull;
+    BOOST_CHECK(wallet.GetFullTransaction(wtx, txFull));
+    BOOST_CHECK(*txFull == *tx);
+
+    // Only a different scriptSig makes an equivalent transaction, not a
+    // different content, even next to one loaded without it.
+    CMutableTransaction mtxOther(*tx);
+    mtxOther.vout[0].strContent = std::string(10000, 'd');
+    const CWalletTx wtxOther(&wallet, MakeTransactionRef(mtxOther));
+    BOOST_CHECK(!wtx.IsEquivalentTo(wtxOther));
+    BOOST_CHECK(!wtxOther.IsEquivalentTo(wtx));
+    mtxOther.vout[0].strContent = tx->vout[0].strContent;
+    mtxOther.vin[0].scriptSig = CScript() << OP_1;
+    const CWalletTx wtxMalleated(&wallet, MakeTransactionRef(mtxOther));
+    BOOST_CHECK(wtx.IsEquivalentTo(wtxMalleated));
+    BOOST_CHECK(wtx.fContentDropped);
+
+    BOOST_CHECK(wtx.LoadContent());
+    BOOST_CHECK(!wtx.fContentDropped);
+    BOOST_CHECK(*wtx.tx == *tx);
+}
+
+//! Hardened BIP 32 child indices start here
+static const uint32_t HARDENED = 0x80000000;
+
+static CExtKey DeriveExternalChainKey(const CWallet &wallet,
+                                      const CPubKey &masterPubKey) {
+    CKey masterKey;
+    BOOST_CHECK(wallet.GetKey(masterPubKey.GetID(), masterKey));
+    CExtKey master, account, chain;
+    master.SetMaster(masterKey.begin(), masterKey.size());
+    master.Derive(account, HARDENED);
+    account.Derive(chain, HARDENED);
+    return chain;
+}
+
+BOOST_AUTO_TEST_CASE(hd_chain_key_cached) {
+    const std::string strFile = (pathTemp / "hd_chain_key_cached.dat").string();
+    CWallet wallet(strFile);
+    bool fFirstRun;
+    BOOST_CHECK(wallet.LoadWallet(fFirstRun) == DB_LOAD_OK);
+    LOCK(wallet.cs_wallet);
+
+    // Each key is the next child of m/0'/0', which is derived once.
+    const CPubKey masterPubKey = wallet.GenerateNewHDMasterKey();
+    BOOST_CHECK(wallet.SetHDMasterKey(masterPubKey));
+    const CExtKey chain = DeriveExternalChainKey(wallet, masterPubKey);
+    for (unsigned int i = 0; i < 3; i++) {
+        CExtKey child;
+        chain.Derive(child, i | HARDENED);
+        BOOST_CHECK(wallet.GenerateNewKey() == child.key.GetPubKey());
+    }
+
+    // And derived again for a new master key.
+    const CPubKey newMasterPubKey = wallet.GenerateNewHDMasterKey();
+    BOOST_CHECK(wallet.SetHDMasterKey(newMasterPubKey));
+    CExtKey child;
+    DeriveExternalChainKey(wallet, newMasterPubKey).Derive(child, HARDENED);
+    BOOST_CHECK(wallet.GenerateNewKey() == child.key.GetPubKey());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
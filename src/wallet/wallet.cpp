@@ -5,18 +5,24 @@
 
 #include "wallet/wallet.h"
 
+#include "blockfilter.h"
+#include "blockfilterindex.h"
+#include "blockview.h"
 #include "chain.h"
 #include "checkpoints.h"
 #include "config.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
 #include "dstencode.h"
+#include "hash.h"
+#include "init.h"
 #include "key.h"
 #include "keystore.h"
 #include "net.h"
 #include "policy/policy.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
+#include "random.h"
 #include "script/script.h"
 #include "script/sign.h"
 #include "timedata.h"
@@ -33,6 +39,8 @@
 #include <boost/thread.hpp>
 
 #include <cassert>
+#include <functional>
+#include <thread>
 
 CWallet *pwalletMain = nullptr;
 
@@ -41,6 +49,7 @@ CFeeRate payTxFee(DEFAULT_TRANSACTION_FEE);
 unsigned int nTxConfirmTarget = DEFAULT_TX_CONFIRM_TARGET;
 bool bSpendZeroConfChange = DEFAULT_SPEND_ZEROCONF_CHANGE;
 bool fSendFreeTransactions = DEFAULT_SEND_FREE_TRANSACTIONS;
+bool fCheckWalletBalances = DEFAULT_CHECK_WALLET_BALANCES;
 
 const char *DEFAULT_WALLET_DAT = "wallet.dat";
 const uint32_t BIP32_HARDENED_KEY_LIMIT = 0x80000000;
@@ -112,7 +121,7 @@ CPubKey CWallet::GenerateNewKey() {
 
     // Compressed public keys were introduced in version 0.6.0
     if (fCompressed) {
-        SetMinVersion(FEATURE_COMPRPUBKEY);
+        SetMinVersion(FEATURE_COMPRPUBKEY, pwalletdbBatch);
     }
 
     CPubKey pubkey = secret.GetPubKey();
@@ -129,33 +138,38 @@ CPubKey CWallet::GenerateNewKey() {
 }
 
 void CWallet::DeriveNewChildKey(CKeyMetadata &metadata, CKey &secret) {
+    // hdExternalChainKey
+    AssertLockHeld(cs_wallet);
     // for now we use a fixed keypath scheme of m/0'/0'/k
-    // master key seed (256bit)
-    CKey key;
-    // hd master key
-    CExtKey masterKey;
-    // key at m/0'
-    CExtKey accountKey;
-    // key at m/0'/0'
-    CExtKey externalChainChildKey;
     // key at m/0'/0'/<n>'
     CExtKey childKey;
 
-    // try to get the master key
-    if (!GetKey(hdChain.masterKeyID, key)) {
-        throw std::runtime_error(std::string(__func__) +
-                                 ": Master key not found");
-    }
+    if (hdExternalChainMasterID != hdChain.masterKeyID) {
+        // master key seed (256bit)
+        CKey key;
+        // hd master key
+        CExtKey masterKey;
+        // key at m/0'
+        CExtKey accountKey;
 
-    masterKey.SetMaster(key.begin(), key.size());
+        // try to get the master key
+        if (!GetKey(hdChain.masterKeyID, key)) {
+            throw std::runtime_error(std::string(__func__) +
+                                     ": Master key not found");
+        }
 
-    // derive m/0'
-    // use hardened derivation (child keys >= 0x80000000 are hardened after
-    // bip32)
-    masterKey.Derive(accountKey, BIP32_HARDENED_KEY_LIMIT);
+        masterKey.SetMaster(key.begin(), key.size());
 
-    // derive m/0'/0'
-    accountKey.Derive(externalChainChildKey, BIP32_HARDENED_KEY_LIMIT);
+        // derive m/0'
+        // use hardened derivation (child keys >= 0x80000000 are hardened
+        // after bip32)
+        masterKey.Derive(accountKey, BIP32_HARDENED_KEY_LIMIT);
+
+        // derive m/0'/0'
+        accountKey.Derive(hdExternalChainKey, BIP32_HARDENED_KEY_LIMIT);
+        hdExternalChainMasterID = hdChain.masterKeyID;
+    }
+    const CExtKey &externalChainChildKey = hdExternalChainKey;
 
     // derive child key at next index, skip keys already known to the wallet
     do {
@@ -174,7 +188,8 @@ void CWallet::DeriveNewChildKey(CKeyMetadata &metadata, CKey &secret) {
     secret = childKey.key;
 
     // update the chain model in the database
-    if (!CWalletDB(strWalletFile).WriteHDChain(hdChain)) {
+    std::unique_ptr<CWalletDB> pwalletdb;
+    if (!GetWalletDB(pwalletdb).WriteHDChain(hdChain)) {
         throw std::runtime_error(std::string(__func__) +
                                  ": Writing HD chain model failed");
     }
@@ -186,6 +201,7 @@ bool CWallet::AddKeyPubKey(const CKey &secret, const CPubKey &pubkey) {
     if (!CCryptoKeyStore::AddKeyPubKey(secret, pubkey)) {
         return false;
     }
+    AddMineScriptsOfKey(pubkey);
 
     // Check if we need to remove from watch-only.
     CScript script;
@@ -207,8 +223,9 @@ bool CWallet::AddKeyPubKey(const CKey &secret, const CPubKey &pubkey) {
         return true;
     }
 
-    return CWalletDB(strWalletFile)
-        .WriteKey(pubkey, secret.GetPrivKey(), mapKeyMetadata[pubkey.GetID()]);
+    std::unique_ptr<CWalletDB> pwalletdb;
+    return GetWalletDB(pwalletdb).WriteKey(pubkey, secret.GetPrivKey(),
+                                           mapKeyMetadata[pubkey.GetID()]);
 }
 
 bool CWallet::AddCryptedKey(const CPubKey &vchPubKey,
@@ -216,6 +233,7 @@ bool CWallet::AddCryptedKey(const CPubKey &vchPubKey,
     if (!CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret)) {
         return false;
     }
+    AddMineScriptsOfKey(vchPubKey);
 
     if (!fFileBacked) {
         return true;
@@ -227,9 +245,9 @@ bool CWallet::AddCryptedKey(const CPubKey &vchPubKey,
             vchPubKey, vchCryptedSecret, mapKeyMetadata[vchPubKey.GetID()]);
     }
 
-    return CWalletDB(strWalletFile)
-        .WriteCryptedKey(vchPubKey, vchCryptedSecret,
-                         mapKeyMetadata[vchPubKey.GetID()]);
+    std::unique_ptr<CWalletDB> pwalletdb;
+    return GetWalletDB(pwalletdb).WriteCryptedKey(
+        vchPubKey, vchCryptedSecret, mapKeyMetadata[vchPubKey.GetID()]);
 }
 
 bool CWallet::LoadKeyMetadata(const CTxDestination &keyID,
@@ -243,7 +261,11 @@ bool CWallet::LoadKeyMetadata(const CTxDestination &keyID,
 
 bool CWallet::LoadCryptedKey(const CPubKey &vchPubKey,
                              const std::vector<uint8_t> &vchCryptedSecret) {
-    return CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret);
+    if (!CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret)) {
+        return false;
+    }
+    AddMineScriptsOfKey(vchPubKey);
+    return true;
 }
 
 void CWallet::UpdateTimeFirstKey(int64_t nCreateTime) {
@@ -261,13 +283,20 @@ bool CWallet::AddCScript(const CScript &redeemScript) {
     if (!CCryptoKeyStore::AddCScript(redeemScript)) {
         return false;
     }
+    {
+        LOCK(cs_KeyStore);
+        setMineScripts.insert(
+            GetScriptForDestination(CScriptID(redeemScript)));
+    }
 
     if (!fFileBacked) {
         return true;
     }
 
-    return CWalletDB(strWalletFile)
-        .WriteCScript(Hash160(redeemScript), redeemScript);
+    LOCK(cs_wallet);
+    std::unique_ptr<CWalletDB> pwalletdb;
+    return GetWalletDB(pwalletdb).WriteCScript(Hash160(redeemScript),
+                                               redeemScript);
 }
 
 bool CWallet::LoadCScript(const CScript &redeemScript) {
@@ -286,13 +315,22 @@ bool CWallet::LoadCScript(const CScript &redeemScript) {
         return true;
     }
 
-    return CCryptoKeyStore::AddCScript(redeemScript);
+    if (!CCryptoKeyStore::AddCScript(redeemScript)) {
+        return false;
+    }
+    LOCK(cs_KeyStore);
+    setMineScripts.insert(GetScriptForDestination(CScriptID(redeemScript)));
+    return true;
 }
 
 bool CWallet::AddWatchOnly(const CScript &dest) {
     if (!CCryptoKeyStore::AddWatchOnly(dest)) {
         return false;
     }
+    {
+        LOCK(cs_KeyStore);
+        setMineScripts.insert(dest);
+    }
 
     const CKeyMetadata &meta = mapKeyMetadata[CScriptID(dest)];
     UpdateTimeFirstKey(meta.nCreateTime);
@@ -302,7 +340,9 @@ bool CWallet::AddWatchOnly(const CScript &dest) {
         return true;
     }
 
-    return CWalletDB(strWalletFile).WriteWatchOnly(dest, meta);
+    LOCK(cs_wallet);
+    std::unique_ptr<CWalletDB> pwalletdb;
+    return GetWalletDB(pwalletdb).WriteWatchOnly(dest, meta);
 }
 
 bool CWallet::AddWatchOnly(const CScript &dest, int64_t nCreateTime) {
@@ -315,12 +355,15 @@ bool CWallet::RemoveWatchOnly(const CScript &dest) {
     if (!CCryptoKeyStore::RemoveWatchOnly(dest)) {
         return false;
     }
+    // The script may also be one of a key or a redeem script.
+    RebuildMineScripts();
 
     if (!HaveWatchOnly()) {
         NotifyWatchonlyChanged(false);
     }
 
-    if (fFileBacked && !CWalletDB(strWalletFile).EraseWatchOnly(dest)) {
+    std::unique_ptr<CWalletDB> pwalletdb;
+    if (fFileBacked && !GetWalletDB(pwalletdb).EraseWatchOnly(dest)) {
         return false;
     }
 
@@ -328,7 +371,12 @@ bool CWallet::RemoveWatchOnly(const CScript &dest) {
 }
 
 bool CWallet::LoadWatchOnly(const CScript &dest) {
-    return CCryptoKeyStore::AddWatchOnly(dest);
+    if (!CCryptoKeyStore::AddWatchOnly(dest)) {
+        return false;
+    }
+    LOCK(cs_KeyStore);
+    setMineScripts.insert(dest);
+    return true;
 }
 
 bool CWallet::Unlock(const SecureString &strWalletPassphrase) {
@@ -357,6 +405,14 @@ bool CWallet::Unlock(const SecureString &strWalletPassphrase) {
     return false;
 }
 
+bool CWallet::Lock() {
+    const bool fLocked = CCryptoKeyStore::Lock();
+    LOCK(cs_wallet);
+    hdExternalChainKey = CExtKey();
+    hdExternalChainMasterID.SetNull();
+    return fLocked;
+}
+
 bool CWallet::ChangeWalletPassphrase(
     const SecureString &strOldWalletPassphrase,
     const SecureString &strNewWalletPassphrase) {
@@ -432,6 +488,17 @@ bool CWallet::ChangeWalletPassphrase(
     return false;
 }
 
+CWalletDB &CWallet::GetWalletDB(std::unique_ptr<CWalletDB> &pwalletdbOwn,
+                                bool fFlushOnClose) const {
+    AssertLockHeld(cs_wallet);
+    if (pwalletdbBatch) {
+        return *pwalletdbBatch;
+    }
+
+    pwalletdbOwn.reset(new CWalletDB(strWalletFile, "r+", fFlushOnClose));
+    return *pwalletdbOwn;
+}
+
 void CWallet::SetBestChain(const CBlockLocator &loc) {
     CWalletDB walletdb(strWalletFile);
     walletdb.WriteBestBlock(loc);
@@ -458,14 +525,11 @@ bool CWallet::SetMinVersion(enum WalletFeature nVersion, CWalletDB *pwalletdbIn,
     }
 
     if (fFileBacked) {
-        CWalletDB *pwalletdb =
-            pwalletdbIn ? pwalletdbIn : new CWalletDB(strWalletFile);
+        std::unique_ptr<CWalletDB> pwalletdbOwn;
+        CWalletDB &walletdb =
+            pwalletdbIn ? *pwalletdbIn : GetWalletDB(pwalletdbOwn);
         if (nWalletVersion > 40000) {
-            pwalletdb->WriteMinVersion(nWalletVersion);
-        }
-
-        if (!pwalletdbIn) {
-            delete pwalletdb;
+            walletdb.WriteMinVersion(nWalletVersion);
         }
     }
 
@@ -679,6 +743,217 @@ void CWallet::AddToSpends(const uint256 &wtxid) {
     }
 }
 
+/** Height a deposit confirmed at nHeight unlocks at, see getmyinterest */
+static int GetDepositUnlockHeight(int nHeight, const CTxOut &txout) {
+    if (nHeight == DEPOSIT_UNCONFIRMED) {
+        return DEPOSIT_UNCONFIRMED;
+    }
+    return int(std::min<int64_t>(int64_t(nHeight) + txout.nLockTime - 1,
+                                 DEPOSIT_UNCONFIRMED - 1));
+}
+
+/**
+ * Height of the block the wallet thinks wtx is in, DEPOSIT_UNCONFIRMED if none.
+ * Whether that block is still in the active chain is checked on every lookup.
+ */
+static int GetIndexedHeight(const CWalletTx &wtx) {
+    if (wtx.hashUnset()) {
+        return DEPOSIT_UNCONFIRMED;
+    }
+    const CBlockIndex *pindex = LookupBlockIndex(wtx.hashBlock);
+    return pindex ? pindex->nHeight : DEPOSIT_UNCONFIRMED;
+}
+
+void CWallet::AddToDeposits(const CWalletTx &wtx) {
+    AssertLockHeld(cs_wallet);
+    RemoveFromDeposits(wtx.GetId());
+
+    const int nHeight = GetIndexedHeight(wtx);
+
+    bool fDeposits = false;
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        const CTxOut &txout = wtx.tx->vout[i];
+        if (txout.nPrincipal <= 0 || IsMine(txout) == ISMINE_NO) {
+            continue;
+        }
+        setDeposits.insert(std::make_pair(GetDepositUnlockHeight(nHeight, txout),
+                                          COutPoint(wtx.GetId(), i)));
+        fDeposits = true;
+    }
+    if (fDeposits) {
+        mapDepositHeight[wtx.GetId()] = nHeight;
+    }
+}
+
+void CWallet::AddToHeightIndex(const CWalletTx &wtx) {
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    const CBlockIndex *pindex = nullptr;
+    const int nHeight = wtx.GetDepthInMainChain(pindex) > 0
+                            ? pindex->nHeight
+                            : DEPOSIT_UNCONFIRMED;
+    auto ret = mapTxIndexedHeight.emplace(wtx.GetId(), nHeight);
+    if (!ret.second) {
+        if (ret.first->second == nHeight) {
+            return;
+        }
+        setTxByHeight.erase(std::make_pair(ret.first->second, wtx.GetId()));
+        ret.first->second = nHeight;
+    }
+    setTxByHeight.emplace(nHeight, wtx.GetId());
+}
+
+void CWallet::RemoveFromHeightIndex(const uint256 &wtxid) {
+    AssertLockHeld(cs_wallet);
+    std::map<uint256, int>::iterator it = mapTxIndexedHeight.find(wtxid);
+    if (it != mapTxIndexedHeight.end()) {
+        setTxByHeight.erase(std::make_pair(it->second, wtxid));
+        mapTxIndexedHeight.erase(it);
+    }
+}
+
+std::vector<const CWalletTx *>
+CWallet::GetTransactionsAfter(int nHeight) const {
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    std::vector<const CWalletTx *> vWtx;
+    for (auto it =
+             setTxByHeight.lower_bound(std::make_pair(nHeight + 1, uint256()));
+         it != setTxByHeight.end(); ++it) {
+        std::map<uint256, CWalletTx>::const_iterator mi =
+            mapWallet.find(it->second);
+        if (mi != mapWallet.end()) {
+            vWtx.push_back(&mi->second);
+        }
+    }
+    return vWtx;
+}
+
+void CWallet::RemoveFromDeposits(const uint256 &wtxid) {
+    AssertLockHeld(cs_wallet);
+    std::map<uint256, int>::iterator it = mapDepositHeight.find(wtxid);
+    if (it == mapDepositHeight.end()) {
+        return;
+    }
+    const int nHeight = it->second;
+    mapDepositHeight.erase(it);
+
+    std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(wtxid);
+    if (mi == mapWallet.end()) {
+        return;
+    }
+    const CTransaction &tx = *mi->second.tx;
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        setDeposits.erase(std::make_pair(
+            GetDepositUnlockHeight(nHeight, tx.vout[i]), COutPoint(wtxid, i)));
+    }
+}
+
+/**
+ * Height an output of wtx in a block at nHeight can be spent from, see the
+ * maturity and lock time checks of AvailableCoins.
+ */
+static int GetCoinSpendableHeight(int nHeight, const CWalletTx &wtx,
+                                  const CTxOut &txout) {
+    if (nHeight == DEPOSIT_UNCONFIRMED) {
+        return DEPOSIT_UNCONFIRMED;
+    }
+    int64_t nSpendable = int64_t(nHeight) + txout.nLockTime;
+    if (wtx.IsCoinBase()) {
+        nSpendable =
+            std::max<int64_t>(nSpendable, int64_t(nHeight) + COINBASE_MATURITY);
+    }
+    return int(std::min<int64_t>(nSpendable, DEPOSIT_UNCONFIRMED - 1));
+}
+
+bool CWallet::IsSpentInWallet(const COutPoint &outpoint) const {
+    AssertLockHeld(cs_wallet);
+    std::pair<TxSpends::const_iterator, TxSpends::const_iterator> range =
+        mapTxSpends.equal_range(outpoint);
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
+        std::map<uint256, CWalletTx>::const_iterator mit =
+            mapWallet.find(it->second);
+        if (mit == mapWallet.end()) {
+            continue;
+        }
+        // Like IsSpent, but for a conflicted transaction whose block left the
+        // active chain, which is indexed then and checked on lookup.
+        const CWalletTx &wtx = mit->second;
+        if (!wtx.isAbandoned() && (wtx.hashUnset() || wtx.nIndex != -1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CWallet::AddToAvailableCoins(const CWalletTx &wtx) {
+    AssertLockHeld(cs_wallet);
+    const uint256 wtxid = wtx.GetId();
+    const CTransaction &tx = *wtx.tx;
+
+    std::map<uint256, int>::iterator it = mapCoinHeight.find(wtxid);
+    if (it != mapCoinHeight.end()) {
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            setAvailableCoins.erase(std::make_pair(
+                GetCoinSpendableHeight(it->second, wtx, tx.vout[i]),
+                COutPoint(wtxid, i)));
+        }
+        mapCoinHeight.erase(it);
+    }
+
+    const int nHeight = GetIndexedHeight(wtx);
+    bool fMine = false;
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        if (IsMine(tx.vout[i]) == ISMINE_NO) {
+            continue;
+        }
+        // Keyed on even if all are spent, for when the spending transaction
+        // is abandoned or conflicted.
+        fMine = true;
+        if (!IsSpentInWallet(COutPoint(wtxid, i))) {
+            setAvailableCoins.insert(std::make_pair(
+                GetCoinSpendableHeight(nHeight, wtx, tx.vout[i]),
+                COutPoint(wtxid, i)));
+        }
+    }
+    if (fMine) {
+        mapCoinHeight[wtxid] = nHeight;
+    }
+}
+
+void CWallet::UpdateAvailableCoin(const COutPoint &outpoint) {
+    AssertLockHeld(cs_wallet);
+    std::map<uint256, int>::const_iterator it =
+        mapCoinHeight.find(outpoint.hash);
+    std::map<uint256, CWalletTx>::const_iterator mi =
+        mapWallet.find(outpoint.hash);
+    if (it == mapCoinHeight.end() || mi == mapWallet.end() ||
+        outpoint.n >= mi->second.tx->vout.size()) {
+        return;
+    }
+
+    const CWalletTx &wtx = mi->second;
+    const CTxOut &txout = wtx.tx->vout[outpoint.n];
+    const std::pair<int, COutPoint> coin(
+        GetCoinSpendableHeight(it->second, wtx, txout), outpoint);
+    if (IsMine(txout) != ISMINE_NO && !IsSpentInWallet(outpoint)) {
+        setAvailableCoins.insert(coin);
+    } else {
+        setAvailableCoins.erase(coin);
+    }
+}
+
+void CWallet::UpdateAvailableCoins(const CWalletTx &wtx) {
+    AssertLockHeld(cs_wallet);
+    AddToAvailableCoins(wtx);
+    if (wtx.IsCoinBase()) {
+        return;
+    }
+    for (const CTxIn &txin : wtx.tx->vin) {
+        UpdateAvailableCoin(txin.prevout);
+    }
+}
+
 bool CWallet::EncryptWallet(const SecureString &strWalletPassphrase) {
     if (IsCrypted()) {
         return false;
@@ -880,7 +1155,8 @@ int64_t CWallet::IncOrderPosNext(CWalletDB *pwalletdb) {
     if (pwalletdb) {
         pwalletdb->WriteOrderPosNext(nOrderPosNext);
     } else {
-        CWalletDB(strWalletFile).WriteOrderPosNext(nOrderPosNext);
+        std::unique_ptr<CWalletDB> pwalletdbOwn;
+        GetWalletDB(pwalletdbOwn).WriteOrderPosNext(nOrderPosNext);
     }
 
     return nRet;
@@ -965,8 +1241,21 @@ bool CWallet::GetAccountPubkey(CPubKey &pubKey, std::string strAccount,
 
 void CWallet::MarkDirty() {
     LOCK(cs_wallet);
+    // What is mine may have changed, all balances are worked out again and
+    // the outputs indexed again.
+    fBalancesValid = false;
+    setAvailableCoins.clear();
+    mapCoinHeight.clear();
     for (std::pair<const uint256, CWalletTx> &item : mapWallet) {
         item.second.MarkDirty();
+        AddToAvailableCoins(item.second);
+    }
+}
+
+void CWallet::MarkBalancesDirty(const uint256 &wtxid) const {
+    LOCK(cs_wallet);
+    if (fBalancesValid) {
+        setBalanceDirty.insert(wtxid);
     }
 }
 
@@ -1004,7 +1293,8 @@ bool CWallet::MarkReplaced(const uint256 &originalHash,
 bool CWallet::AddToWallet(const CWalletTx &wtxIn, bool fFlushOnClose) {
     LOCK(cs_wallet);
 
-    CWalletDB walletdb(strWalletFile, "r+", fFlushOnClose);
+    std::unique_ptr<CWalletDB> pwalletdb;
+    CWalletDB &walletdb = GetWalletDB(pwalletdb, fFlushOnClose);
 
     uint256 hash = wtxIn.GetId();
 
@@ -1106,6 +1396,11 @@ bool CWallet::AddToWallet(const CWalletTx &wtxIn, bool fFlushOnClose) {
         return false;
     }
 
+    // Its block may have changed, and so may IsMine() since it was added.
+    AddToDeposits(wtx);
+    UpdateAvailableCoins(wtx);
+    AddToHeightIndex(wtx);
+
     // Break debit/credit balance caches:
     wtx.MarkDirty();
 
@@ -1131,8 +1426,17 @@ bool CWallet::LoadToWallet(const CWalletTx &wtxIn) {
     mapWallet[txid] = wtxIn;
     CWalletTx &wtx = mapWallet[txid];
     wtx.BindWallet(this);
+    // Output content is most of what large wallets hold, and nothing but
+    // serializing the transaction needs it. It is read back from the file
+    // then.
+    if (fFileBacked && wtx.tx->HasContent()) {
+        wtx.tx = MakeTransactionRef(wtx.tx->WithoutContent());
+        wtx.fContentDropped = true;
+    }
     wtxOrdered.insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, nullptr)));
     AddToSpends(txid);
+    AddToDeposits(wtx);
+    UpdateAvailableCoins(wtx);
     for (const CTxIn &txin : wtx.tx->vin) {
         if (mapWallet.count(txin.prevout.hash)) {
             CWalletTx &prevtx = mapWallet[txin.prevout.hash];
@@ -1145,6 +1449,26 @@ bool CWallet::LoadToWallet(const CWalletTx &wtxIn) {
     return true;
 }
 
+bool CWallet::GetFullTransaction(const CWalletTx &wtx,
+                                 CTransactionRef &tx) const {
+    if (!wtx.fContentDropped) {
+        tx = wtx.tx;
+        return true;
+    }
+
+    LOCK(cs_wallet);
+    std::unique_ptr<CWalletDB> pwalletdb;
+    CWalletTx wtxStored;
+    if (!GetWalletDB(pwalletdb).ReadTx(wtx.GetId(), wtxStored) ||
+        wtxStored.GetId() != wtx.GetId()) {
+        return error("%s: cannot read transaction %s from the wallet",
+                     __func__, wtx.GetId().ToString());
+    }
+
+    tx = wtxStored.tx;
+    return true;
+}
+
 /**
  * Add a transaction to the wallet, or update it. pIndex and posInBlock should
  * be set when the transaction was known to be included in a block. When
@@ -1237,6 +1561,9 @@ bool CWallet::AbandonTransaction(const uint256 &hashTx) {
             wtx.nIndex = -1;
             wtx.setAbandoned();
             wtx.MarkDirty();
+            AddToDeposits(wtx);
+            UpdateAvailableCoins(wtx);
+            AddToHeightIndex(wtx);
             walletdb.WriteTx(wtx);
             NotifyTransactionChanged(this, wtx.GetId(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet
@@ -1282,7 +1609,8 @@ void CWallet::MarkConflicted(const uint256 &hashBlock, const uint256 &hashTx) {
     }
 
     // Do not flush the wallet here for performance reasons
-    CWalletDB walletdb(strWalletFile, "r+", false);
+    std::unique_ptr<CWalletDB> pwalletdb;
+    CWalletDB &walletdb = GetWalletDB(pwalletdb, false);
 
     std::set<uint256> todo;
     std::set<uint256> done;
@@ -1302,6 +1630,9 @@ void CWallet::MarkConflicted(const uint256 &hashBlock, const uint256 &hashTx) {
             wtx.nIndex = -1;
             wtx.hashBlock = hashBlock;
             wtx.MarkDirty();
+            AddToDeposits(wtx);
+            UpdateAvailableCoins(wtx);
+            AddToHeightIndex(wtx);
             walletdb.WriteTx(wtx);
             // Iterate over all its outputs, and mark transactions in the wallet
             // that spend them conflicted too.
@@ -1326,8 +1657,9 @@ void CWallet::MarkConflicted(const uint256 &hashBlock, const uint256 &hashTx) {
     }
 }
 
-void CWallet::SyncTransaction(const CTransaction &tx, const CBlockIndex *pindex,
-                              int posInBlock) {
+void CWallet::SyncTransaction(const CTransactionRef &ptx,
+                              const CBlockIndex *pindex, int posInBlock) {
+    const CTransaction &tx = *ptx;
     LOCK2(cs_main, cs_wallet);
 
     if (!AddToWalletIfInvolvingMe(tx, pindex, posInBlock, true)) {
@@ -1377,6 +1709,11 @@ CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter &filter) const {
 }
 
 isminetype CWallet::IsMine(const CTxOut &txout) const {
+    // Most outputs of the blocks and transactions the wallet sees are
+    // rejected here, without solving them.
+    if (!MayBeMine(txout.scriptPubKey)) {
+        return ISMINE_NO;
+    }
     return ::IsMine(*this, txout.scriptPubKey);
 }
 
@@ -1550,7 +1887,8 @@ bool CWallet::SetHDMasterKey(const CPubKey &pubkey) {
 
 bool CWallet::SetHDChain(const CHDChain &chain, bool memonly) {
     LOCK(cs_wallet);
-    if (!memonly && !CWalletDB(strWalletFile).WriteHDChain(chain)) {
+    std::unique_ptr<CWalletDB> pwalletdb;
+    if (!memonly && !GetWalletDB(pwalletdb).WriteHDChain(chain)) {
         throw std::runtime_error(std::string(__func__) +
                                  ": writing chain failed");
     }
@@ -1700,74 +2038,299 @@ void CWalletTx::GetAccountAmounts(const std::string &strAccount,
     }
 }
 
+SaltedScriptHasher::SaltedScriptHasher()
+    : k0(GetRand(std::numeric_limits<uint64_t>::max())),
+      k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t SaltedScriptHasher::operator()(const CScript &script) const {
+    return CSipHasher(k0, k1).Write(script.data(), script.size()).Finalize();
+}
+
+static bool IsCanonicalPayToPubKeyHash(const CScript &script) {
+    return script.size() == 25 && script[0] == OP_DUP &&
+           script[1] == OP_HASH160 && script[2] == 20 &&
+           script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG;
+}
+
+/**
+ * Whether script may pay to a wallet with the scripts setScripts, which
+ * GetScanScripts returns. Those are the scripts the wallet writes, keys and
+ * key hashes can also be pushed other ways, and a bare multisig is the
+ * wallet's if it has all the keys.
+ */
+static bool ScriptMayBeMine(const ScriptSet &setScripts,
+                            const CScript &script) {
+    if (setScripts.count(script)) {
+        return true;
+    }
+    // Written the way the wallet writes them, these would be in the set.
+    if (script.IsPayToScriptHash() || IsCanonicalPayToPubKeyHash(script)) {
+        return false;
+    }
+    std::vector<std::vector<uint8_t>> vSolutions;
+    txnouttype whichType;
+    if (!Solver(script, whichType, vSolutions)) {
+        return false;
+    }
+    switch (whichType) {
+        case TX_PUBKEY:
+            return setScripts.count(
+                GetScriptForRawPubKey(CPubKey(vSolutions[0])));
+        case TX_PUBKEYHASH:
+            return setScripts.count(
+                GetScriptForDestination(CKeyID(uint160(vSolutions[0]))));
+        case TX_MULTISIG:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void CWallet::AddMineScriptsOfKey(const CPubKey &pubkey) {
+    LOCK(cs_KeyStore);
+    setMineScripts.insert(GetScriptForDestination(pubkey.GetID()));
+    setMineScripts.insert(GetScriptForRawPubKey(pubkey));
+}
+
+void CWallet::RebuildMineScripts() {
+    LOCK(cs_KeyStore);
+    setMineScripts.clear();
+    std::set<CKeyID> setKeyIDs;
+    GetKeys(setKeyIDs);
+    for (const CKeyID &keyID : setKeyIDs) {
+        CPubKey pubkey;
+        if (GetPubKey(keyID, pubkey)) {
+            AddMineScriptsOfKey(pubkey);
+        }
+    }
+    for (const auto &it : mapScripts) {
+        setMineScripts.insert(GetScriptForDestination(it.first));
+    }
+    setMineScripts.insert(setWatchOnly.begin(), setWatchOnly.end());
+}
+
+void CWallet::GetScanScripts(ScriptSet &setScripts) const {
+    LOCK(cs_KeyStore);
+    setScripts = setMineScripts;
+}
+
+bool CWallet::MayBeMine(const CScript &script) const {
+    LOCK(cs_KeyStore);
+    return ScriptMayBeMine(setMineScripts, script);
+}
+
+bool CWallet::SpendsFromWallet(const CTransaction &tx) const {
+    AssertLockHeld(cs_wallet);
+    for (const CTxIn &txin : tx.vin) {
+        if (mapTxSpends.count(txin.prevout) ||
+            mapWallet.count(txin.prevout.hash)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CWallet::SpendsFromWallet(const std::vector<COutPoint> &vPrevout) const {
+    AssertLockHeld(cs_wallet);
+    for (const COutPoint &prevout : vPrevout) {
+        if (mapTxSpends.count(prevout) || mapWallet.count(prevout.hash)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions from or to
  * us. If fUpdate is true, found transactions that already exist in the wallet
  * will be updated.
  *
+ * Blocks are read in batches of WALLET_RESCAN_BATCH_BLOCKS, on several threads
+ * and without locks, which also match the outputs against the scripts of the
+ * wallet. The blocks are read as CBlockViews, and only the transactions that
+ * may be the wallet's are deserialized and added under cs_main and cs_wallet,
+ * taken once per batch. The batch a file backed wallet
+ * got to is written down, and a rescan that was interrupted by a shutdown
+ * resumes there on the next start.
+ *
+ * With -blockfilterindex, blocks whose filters match none of those scripts
+ * aren't read at all. Bare multisig, keys pushed other than the way the wallet
+ * writes them, and conflicts with wallet transactions in such blocks are
+ * missed.
+ *
  * Returns pointer to the first block in the last contiguous range that was
  * successfully scanned.
  */
 CBlockIndex *CWallet::ScanForWalletTransactions(CBlockIndex *pindexStart,
                                                 bool fUpdate) {
-    LOCK2(cs_main, cs_wallet);
-
     CBlockIndex *ret = nullptr;
     int64_t nNow = GetTime();
     const CChainParams &chainParams = Params();
+    const Config &config = GetConfig();
 
     CBlockIndex *pindex = pindexStart;
-
-    // No need to read and scan block, if block was created before our wallet
-    // birthday (as adjusted for block time variability)
-    while (pindex && nTimeFirstKey &&
-           (pindex->GetBlockTime() < (nTimeFirstKey - 7200))) {
-        pindex = chainActive.Next(pindex);
+    ScriptSet setScripts;
+    double dProgressStart, dProgressTip;
+    {
+        LOCK2(cs_main, cs_wallet);
+        // No need to read and scan block, if block was created before our
+        // wallet birthday (as adjusted for block time variability)
+        while (pindex && nTimeFirstKey &&
+               (pindex->GetBlockTime() < (nTimeFirstKey - 7200))) {
+            pindex = chainActive.Next(pindex);
+        }
+        dProgressStart =
+            GuessVerificationProgress(chainParams.TxData(), pindex);
+        dProgressTip =
+            GuessVerificationProgress(chainParams.TxData(), chainActive.Tip());
+        GetScanScripts(setScripts);
+    }
+    // With the block filter index, the blocks whose filters match none of
+    // the scripts aren't read at all.
+    CGCSFilter::ElementSet setFilterElements;
+    const bool fFilters =
+        g_blockfilterindex && !g_blockfilterindex->IsDropping();
+    if (fFilters) {
+        for (const CScript &script : setScripts) {
+            setFilterElements.emplace(script.begin(), script.end());
+        }
     }
 
     // Show rescan progress in GUI as dialog or on splashscreen, if -rescan on
     // startup.
     ShowProgress(_("Rescanning..."), 0);
-    double dProgressStart =
-        GuessVerificationProgress(chainParams.TxData(), pindex);
-    double dProgressTip =
-        GuessVerificationProgress(chainParams.TxData(), chainActive.Tip());
+    const int nThreads = std::max(
+        1, std::min<int>(WALLET_RESCAN_THREADS,
+                         std::thread::hardware_concurrency()));
+    CBlockIndex *pindexLast = nullptr;
     while (pindex) {
-        if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
+        if (ShutdownRequested()) {
+            LogPrintf("Rescan interrupted at block %d, it resumes there on "
+                      "the next start\n",
+                      pindex->nHeight);
+            break;
+        }
+
+        std::vector<CBlockIndex *> vBatch;
+        {
+            LOCK(cs_main);
+            for (; pindex && vBatch.size() < WALLET_RESCAN_BATCH_BLOCKS;
+                 pindex = chainActive.Next(pindex)) {
+                vBatch.push_back(pindex);
+            }
+        }
+        if (vBatch.empty()) {
+            break;
+        }
+
+        if (dProgressTip - dProgressStart > 0.0) {
             ShowProgress(
                 _("Rescanning..."),
-                std::max(1,
-                         std::min(99, (int)((GuessVerificationProgress(
-                                                 chainParams.TxData(), pindex) -
-                                             dProgressStart) /
-                                            (dProgressTip - dProgressStart) *
-                                            100))));
+                std::max(1, std::min(99, (int)((GuessVerificationProgress(
+                                                    chainParams.TxData(),
+                                                    vBatch.front()) -
+                                                dProgressStart) /
+                                               (dProgressTip - dProgressStart) *
+                                               100))));
+        }
+
+        // For each block whether it was read, and for each of its
+        // transactions whether it has an output that may be ours.
+        std::vector<CBlockView> vBlocks(vBatch.size());
+        std::vector<char> vRead(vBatch.size(), false);
+        std::vector<std::vector<char>> vMayBeMine(vBatch.size());
+        std::vector<std::thread> threads;
+        for (int nThread = 0; nThread < nThreads; nThread++) {
+            threads.emplace_back([&, nThread]() {
+                for (size_t i = nThread; i < vBatch.size(); i += nThreads) {
+                    CBlockFilter filter;
+                    if (fFilters &&
+                        g_blockfilterindex->LookupFilter(vBatch[i], filter) &&
+                        !filter.GetFilter().MatchAny(setFilterElements)) {
+                        vRead[i] = true;
+                        continue;
+                    }
+                    vRead[i] =
+                        ReadBlockViewFromDisk(vBlocks[i], vBatch[i], config);
+                    if (!vRead[i]) {
+                        continue;
+                    }
+                    for (const CTransactionView &tx :
+                         vBlocks[i].GetTransactions()) {
+                        bool fMayBeMine = false;
+                        for (const CTxOutView &txout : tx.GetOutputs()) {
+                            // A script the wallet writes fits in the
+                            // CScript without allocating.
+                            if (ScriptMayBeMine(
+                                    setScripts,
+                                    CScript(txout.scriptPubKey.begin(),
+                                            txout.scriptPubKey.end()))) {
+                                fMayBeMine = true;
+                                break;
+                            }
+                        }
+                        vMayBeMine[i].push_back(fMayBeMine);
+                    }
+                }
+            });
+        }
+        for (std::thread &thread : threads) {
+            thread.join();
         }
 
-        CBlock block;
-        if (ReadBlockFromDisk(block, pindex, GetConfig())) {
-            for (size_t posInBlock = 0; posInBlock < block.vtx.size();
+        LOCK2(cs_main, cs_wallet);
+        // The wallet transactions of the blocks in one database transaction.
+        CWalletBatch batch(this);
+        for (size_t i = 0; i < vBatch.size(); i++) {
+            CBlockIndex *pindexBlock = vBatch[i];
+            if (!chainActive.Contains(pindexBlock)) {
+                // Disconnected since it was read, go on from the fork.
+                pindex = chainActive.Next(chainActive.FindFork(pindexBlock));
+                break;
+            }
+            pindexLast = pindexBlock;
+            if (!vRead[i]) {
+                ret = nullptr;
+                continue;
+            }
+            const std::vector<CTransactionView> &vtx =
+                vBlocks[i].GetTransactions();
+            for (size_t posInBlock = 0; posInBlock < vtx.size();
                  ++posInBlock) {
-                AddToWalletIfInvolvingMe(*block.vtx[posInBlock], pindex,
-                                         posInBlock, fUpdate);
+                // Anything else can't be from or to us, nor conflict with a
+                // wallet transaction, and isn't deserialized.
+                const CTransactionView &tx = vtx[posInBlock];
+                if (vMayBeMine[i][posInBlock] ||
+                    SpendsFromWallet(tx.GetPrevouts()) ||
+                    mapWallet.count(tx.GetId())) {
+                    AddToWalletIfInvolvingMe(*tx.Get(), pindexBlock,
+                                             posInBlock, fUpdate);
+                }
             }
 
             if (!ret) {
-                ret = pindex;
+                ret = pindexBlock;
             }
-        } else {
-            ret = nullptr;
         }
 
-        pindex = chainActive.Next(pindex);
-        if (GetTime() >= nNow + 60) {
+        if (fFileBacked && pindexLast) {
+            std::unique_ptr<CWalletDB> pwalletdb;
+            GetWalletDB(pwalletdb).WriteRescanProgress(
+                chainActive.GetLocator(pindexLast));
+        }
+        if (pindexLast && GetTime() >= nNow + 60) {
             nNow = GetTime();
             LogPrintf("Still rescanning. At block %d. Progress=%f\n",
-                      pindex->nHeight,
-                      GuessVerificationProgress(chainParams.TxData(), pindex));
+                      pindexLast->nHeight,
+                      GuessVerificationProgress(chainParams.TxData(),
+                                                pindexLast));
         }
     }
 
+    if (fFileBacked && !pindex) {
+        CWalletDB(strWalletFile).EraseRescanProgress();
+    }
+
     // Hide progress dialog in GUI.
     ShowProgress(_("Rescanning..."), 100);
 
@@ -1802,6 +2365,10 @@ void CWallet::ReacceptWalletTransactions() {
     for (std::pair<const int64_t, CWalletTx *> &item : mapSorted) {
         CWalletTx &wtx = *(item.second);
 
+        if (!wtx.LoadContent()) {
+            continue;
+        }
+
         LOCK(mempool.cs);
         CValidationState state;
         wtx.AcceptToMemoryPool(maxTxFee, state);
@@ -1816,7 +2383,7 @@ bool CWalletTx::RelayWalletTransaction(CConnman *connman) {
 
     CValidationState state;
     // GetDepthInMainChain already catches known conflicts.
-    if (InMempool() || AcceptToMemoryPool(maxTxFee, state)) {
+    if (InMempool() || (LoadContent() && AcceptToMemoryPool(maxTxFee, state))) {
         LogPrintf("Relaying wtx %s\n", GetId().ToString());
         if (connman) {
             CInv inv(MSG_TX, GetId());
@@ -1829,6 +2396,21 @@ bool CWalletTx::RelayWalletTransaction(CConnman *connman) {
     return false;
 }
 
+bool CWalletTx::LoadContent() {
+    if (!fContentDropped) {
+        return true;
+    }
+
+    CTransactionRef txFull;
+    if (!pwallet->GetFullTransaction(*this, txFull)) {
+        return false;
+    }
+
+    tx = std::move(txFull);
+    fContentDropped = false;
+    return true;
+}
+
 std::set<uint256> CWalletTx::GetConflicts() const {
     std::set<uint256> result;
     if (pwallet != nullptr) {
@@ -1840,6 +2422,21 @@ std::set<uint256> CWalletTx::GetConflicts() const {
     return result;
 }
 
+void CWalletTx::MarkDirty() {
+    fCreditCached = false;
+    fAvailableCreditCached = false;
+    fImmatureCreditCached = false;
+    fWatchDebitCached = false;
+    fWatchCreditCached = false;
+    fAvailableWatchCreditCached = false;
+    fImmatureWatchCreditCached = false;
+    fDebitCached = false;
+    fChangeCached = false;
+    if (pwallet) {
+        pwallet->MarkBalancesDirty(GetId());
+    }
+}
+
 CAmount CWalletTx::GetDebit(const isminefilter &filter) const {
     if (tx->vin.empty()) return CAmount(0);
 
@@ -2053,8 +2650,16 @@ bool CWalletTx::IsTrusted() const {
 }
 
 bool CWalletTx::IsEquivalentTo(const CWalletTx &_tx) const {
-    CMutableTransaction tx1 = *this->tx;
-    CMutableTransaction tx2 = *_tx.tx;
+    // Signatures cover the output content, so it is compared too, read back
+    // from the wallet file for a side loaded without it.
+    CTransactionRef ptx1 = this->tx;
+    CTransactionRef ptx2 = _tx.tx;
+    if ((fContentDropped && !pwallet->GetFullTransaction(*this, ptx1)) ||
+        (_tx.fContentDropped && !pwallet->GetFullTransaction(_tx, ptx2))) {
+        return false;
+    }
+    CMutableTransaction tx1 = *ptx1;
+    CMutableTransaction tx2 = *ptx2;
     for (unsigned int i = 0; i < tx1.vin.size(); i++) {
         tx1.vin[i].scriptSig = CScript();
     }
@@ -2131,92 +2736,247 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime,
  *
  * @{
  */
-CAmount CWallet::GetBalance() const {
-    LOCK2(cs_main, cs_wallet);
+CWalletBalances &CWalletBalances::operator+=(const CWalletBalances &b) {
+    nTrusted += b.nTrusted;
+    nUntrustedPending += b.nUntrustedPending;
+    nImmature += b.nImmature;
+    nWatchOnlyTrusted += b.nWatchOnlyTrusted;
+    nWatchOnlyUntrustedPending += b.nWatchOnlyUntrustedPending;
+    nWatchOnlyImmature += b.nWatchOnlyImmature;
+    nLockedPrincipal += b.nLockedPrincipal;
+    nLockedInterest += b.nLockedInterest;
+    return *this;
+}
+
+CWalletBalances &CWalletBalances::operator-=(const CWalletBalances &b) {
+    nTrusted -= b.nTrusted;
+    nUntrustedPending -= b.nUntrustedPending;
+    nImmature -= b.nImmature;
+    nWatchOnlyTrusted -= b.nWatchOnlyTrusted;
+    nWatchOnlyUntrustedPending -= b.nWatchOnlyUntrustedPending;
+    nWatchOnlyImmature -= b.nWatchOnlyImmature;
+    nLockedPrincipal -= b.nLockedPrincipal;
+    nLockedInterest -= b.nLockedInterest;
+    return *this;
+}
+
+bool operator==(const CWalletBalances &a, const CWalletBalances &b) {
+    return a.nTrusted == b.nTrusted &&
+           a.nUntrustedPending == b.nUntrustedPending &&
+           a.nImmature == b.nImmature &&
+           a.nWatchOnlyTrusted == b.nWatchOnlyTrusted &&
+           a.nWatchOnlyUntrustedPending == b.nWatchOnlyUntrustedPending &&
+           a.nWatchOnlyImmature == b.nWatchOnlyImmature &&
+           a.nLockedPrincipal == b.nLockedPrincipal &&
+           a.nLockedInterest == b.nLockedInterest;
+}
+
+CWalletBalances CWallet::GetTxBalances(const CWalletTx &wtx, bool &fMempool,
+                                       bool &fTip) const {
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
 
-    CAmount nTotal(0);
-    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin();
-         it != mapWallet.end(); ++it) {
-        const CWalletTx *pcoin = &(*it).second;
-        if (pcoin->IsTrusted()) {
-            nTotal += pcoin->GetAvailableCredit();
+    const int nDepth = wtx.GetDepthInMainChain();
+    const bool fFinal = CheckFinalTx(wtx);
+    const bool fImmature = wtx.IsCoinBase() && wtx.GetBlocksToMaturity() > 0;
+    // Whether it is trusted depends on the mempool, and on the tip for
+    // conflicts. The mempool counts a new tip as an update too.
+    fMempool = nDepth <= 0 || !fFinal;
+    fTip = fImmature;
+
+    CWalletBalances part;
+    if (wtx.IsTrusted()) {
+        part.nTrusted = wtx.GetAvailableCredit();
+        part.nWatchOnlyTrusted = wtx.GetAvailableWatchOnlyCredit();
+    } else if (nDepth == 0 && wtx.InMempool()) {
+        part.nUntrustedPending = wtx.GetAvailableCredit();
+        part.nWatchOnlyUntrustedPending = wtx.GetAvailableWatchOnlyCredit();
+    }
+    part.nImmature = wtx.GetImmatureCredit();
+    part.nWatchOnlyImmature = wtx.GetImmatureWatchOnlyCredit();
+
+    // The deposits getmyinterest counts: those GetAllDeposit returns from the
+    // tip on, that are still locked at the tip.
+    std::map<uint256, int>::const_iterator it =
+        mapDepositHeight.find(wtx.GetId());
+    if (it == mapDepositHeight.end() || !fFinal || fImmature || nDepth < 0 ||
+        (nDepth == 0 && !wtx.InMempool())) {
+        return part;
+    }
+    const int nHeight = chainActive.Height();
+    const int nTxHeight = wtx.GetTxHeight();
+    for (const CTxOut &txout : wtx.tx->vout) {
+        if (txout.nPrincipal <= 0 || IsMine(txout) == ISMINE_NO ||
+            GetDepositUnlockHeight(it->second, txout) < nHeight ||
+            nHeight - nTxHeight + 1 > int64_t(txout.nLockTime)) {
+            continue;
         }
+        part.nLockedPrincipal += txout.nPrincipal;
+        part.nLockedInterest += txout.nValue - txout.nPrincipal;
+        // Unlocks as the tip moves on.
+        fTip = true;
+    }
+    return part;
+}
+
+void CWallet::UpdateTxBalances(const uint256 &wtxid) const {
+    std::map<uint256, CWalletBalances>::iterator it =
+        mapBalanceParts.find(wtxid);
+    if (it != mapBalanceParts.end()) {
+        balancesCached -= it->second;
+        mapBalanceParts.erase(it);
     }
+    setBalanceMempool.erase(wtxid);
+    setBalanceTip.erase(wtxid);
 
-    return nTotal;
+    std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(wtxid);
+    if (mi == mapWallet.end()) {
+        return;
+    }
+    bool fMempool, fTip;
+    const CWalletBalances part = GetTxBalances(mi->second, fMempool, fTip);
+    if (!part.IsNull()) {
+        balancesCached += part;
+        mapBalanceParts.emplace(wtxid, part);
+    }
+    if (fMempool) {
+        setBalanceMempool.insert(wtxid);
+    }
+    if (fTip) {
+        setBalanceTip.insert(wtxid);
+    }
 }
 
-CAmount CWallet::GetUnconfirmedBalance() const {
+CWalletBalances CWallet::GetBalances() const {
     LOCK2(cs_main, cs_wallet);
 
-    CAmount nTotal(0);
-    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin();
-         it != mapWallet.end(); ++it) {
-        const CWalletTx *pcoin = &(*it).second;
-        if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 &&
-            pcoin->InMempool()) {
-            nTotal += pcoin->GetAvailableCredit();
+    // Parts are only worked out again as the tip moves on. Blocks that are
+    // disconnected tell the wallet of their transactions, but deposits lock
+    // again and coinbases turn immature without, so start over then.
+    const CBlockIndex *pindexTip = chainActive.Tip();
+    if (pindexBalanceTip &&
+        (!pindexTip ||
+         pindexTip->GetAncestor(nBalanceTipHeight) != pindexBalanceTip)) {
+        fBalancesValid = false;
+    }
+
+    if (!fBalancesValid) {
+        balancesCached = CWalletBalances();
+        mapBalanceParts.clear();
+        setBalanceDirty.clear();
+        setBalanceMempool.clear();
+        setBalanceTip.clear();
+        for (const std::pair<const uint256, CWalletTx> &item : mapWallet) {
+            UpdateTxBalances(item.first);
+        }
+        fBalancesValid = true;
+    } else {
+        const unsigned int nMempoolUpdated = mempool.GetTransactionsUpdated();
+        if (nMempoolUpdated != nBalanceMempoolUpdated) {
+            setBalanceDirty.insert(setBalanceMempool.begin(),
+                                   setBalanceMempool.end());
         }
+        if (pindexTip != pindexBalanceTip) {
+            setBalanceDirty.insert(setBalanceTip.begin(), setBalanceTip.end());
+        }
+        for (const uint256 &wtxid : setBalanceDirty) {
+            UpdateTxBalances(wtxid);
+        }
+        setBalanceDirty.clear();
+    }
+    nBalanceMempoolUpdated = mempool.GetTransactionsUpdated();
+    pindexBalanceTip = pindexTip;
+    nBalanceTipHeight = chainActive.Height();
+
+    if (fCheckWalletBalances) {
+        CWalletBalances total;
+        for (const std::pair<const uint256, CWalletTx> &item : mapWallet) {
+            bool fMempool, fTip;
+            total += GetTxBalances(item.second, fMempool, fTip);
+        }
+        assert(total == balancesCached);
     }
 
-    return nTotal;
+    return balancesCached;
 }
 
-CAmount CWallet::GetImmatureBalance() const {
-    LOCK2(cs_main, cs_wallet);
+CAmount CWallet::GetBalance() const {
+    return GetBalances().nTrusted;
+}
 
-    CAmount nTotal(0);
-    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin();
-         it != mapWallet.end(); ++it) {
-        const CWalletTx *pcoin = &(*it).second;
-        nTotal += pcoin->GetImmatureCredit();
-    }
+CAmount CWallet::GetUnconfirmedBalance() const {
+    return GetBalances().nUntrustedPending;
+}
 
-    return nTotal;
+CAmount CWallet::GetImmatureBalance() const {
+    return GetBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const {
-    LOCK2(cs_main, cs_wallet);
+    return GetBalances().nWatchOnlyTrusted;
+}
 
-    CAmount nTotal(0);
-    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin();
-         it != mapWallet.end(); ++it) {
-        const CWalletTx *pcoin = &(*it).second;
-        if (pcoin->IsTrusted()) {
-            nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
+CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const {
+    return GetBalances().nWatchOnlyUntrustedPending;
+}
 
-    return nTotal;
+CAmount CWallet::GetImmatureWatchOnlyBalance() const {
+    return GetBalances().nWatchOnlyImmature;
 }
 
-CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const {
-    LOCK2(cs_main, cs_wallet);
+/**
+ * Whether the outputs of pcoin may be available, and its depth. See
+ * AvailableCoins.
+ */
+static bool IsAvailableTx(const CWalletTx *pcoin, bool fOnlyConfirmed,
+                          bool includeLocked, int &nDepth) {
+    nDepth = pcoin->GetDepthInMainChain();
+    if (nDepth < 0) {
+        return false;
+    }
 
-    CAmount nTotal(0);
-    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin();
-         it != mapWallet.end(); ++it) {
-        const CWalletTx *pcoin = &(*it).second;
-        if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 &&
-            pcoin->InMempool()) {
-            nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
+    // We should not consider coins which aren't at least in our mempool.
+    // It's possible for these to be conflicted via ancestors which we may
+    // never be able to detect.
+    if (nDepth == 0 && !pcoin->InMempool()) {
+        return false;
     }
 
-    return nTotal;
-}
+    if (!CheckFinalTx(*pcoin)) {
+        return false;
+    }
 
-CAmount CWallet::GetImmatureWatchOnlyBalance() const {
-    LOCK2(cs_main, cs_wallet);
+    if (fOnlyConfirmed && !pcoin->IsTrusted()) {
+        return false;
+    }
 
-    CAmount nTotal(0);
-    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin();
-         it != mapWallet.end(); ++it) {
-        const CWalletTx *pcoin = &(*it).second;
-        nTotal += pcoin->GetImmatureWatchOnlyCredit();
+    if (!includeLocked && pcoin->IsCoinBase() &&
+        pcoin->GetBlocksToMaturity() > 0) {
+        return false;
     }
 
-    return nTotal;
+    // Platopia-Core: Removed check that prevents consideration of coins from
+    // transactions that are replacing other transactions. This check based
+    // on pcoin->mapValue.count("replaces_txid") which was not being set
+    // anywhere.
+
+    // Similarly, we should not consider coins from transactions that have
+    // been replaced. In the example above, we would want to prevent
+    // creation of a transaction A' spending an output of A, because if
+    // transaction B were initially confirmed, conflicting with A and A', we
+    // wouldn't want to the user to create a transaction D intending to
+    // replace A', but potentially resulting in a scenario where A, A', and
+    // D could all be accepted (instead of just B and D, or just A and A'
+    // like the user would want).
+
+    // Platopia-Core: retained this check as 'replaced_by_txid' is still set
+    // in the wallet code.
+    if (nDepth == 0 && fOnlyConfirmed &&
+        pcoin->mapValue.count("replaced_by_txid")) {
+        return false;
+    }
+
+    return true;
 }
 
 void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlyConfirmed,
@@ -2225,86 +2985,82 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlyConfirmed,
     vCoins.clear();
 
     LOCK2(cs_main, cs_wallet);
-    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin();
-         it != mapWallet.end(); ++it) {
-        const uint256 &wtxid = it->first;
-        const CWalletTx *pcoin = &(*it).second;
-
-        if (!CheckFinalTx(*pcoin)) {
-            continue;
-        }
-
-        if (fOnlyConfirmed && !pcoin->IsTrusted()) {
-            continue;
-        }
-
-        if (!includeLocked && pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0) {
-            continue;
-        }
-
-        int nDepth = pcoin->GetDepthInMainChain();
-        if (nDepth < 0) {
+    // Unless locked ones are wanted, only the outputs that can be spent in the
+    // next block: those with more confirmations than their lock time, which
+    // leaves out those not in a block.
+    CoinIndex::const_iterator itEnd =
+        includeLocked ? setAvailableCoins.end()
+                      : setAvailableCoins.lower_bound(std::make_pair(
+                            chainActive.Height() + 1, COutPoint(uint256(), 0)));
+
+    const CWalletTx *pcoinLast = nullptr;
+    bool fAvailable = false;
+    int nDepth = 0;
+    for (CoinIndex::const_iterator itCoin = setAvailableCoins.begin();
+         itCoin != itEnd; ++itCoin) {
+        const COutPoint &outpoint = itCoin->second;
+        std::map<uint256, CWalletTx>::const_iterator it =
+            mapWallet.find(outpoint.hash);
+        if (it == mapWallet.end()) {
             continue;
         }
-
-        // We should not consider coins which aren't at least in our mempool.
-        // It's possible for these to be conflicted via ancestors which we may
-        // never be able to detect.
-        if (nDepth == 0 && !pcoin->InMempool()) {
-            continue;
+        const CWalletTx *pcoin = &it->second;
+        // The outputs of a transaction are next to each other, mostly.
+        if (pcoin != pcoinLast) {
+            pcoinLast = pcoin;
+            fAvailable =
+                IsAvailableTx(pcoin, fOnlyConfirmed, includeLocked, nDepth);
         }
-
-        // Platopia-Core: Removed check that prevents consideration of coins from
-        // transactions that are replacing other transactions. This check based
-        // on pcoin->mapValue.count("replaces_txid") which was not being set
-        // anywhere.
-
-        // Similarly, we should not consider coins from transactions that have
-        // been replaced. In the example above, we would want to prevent
-        // creation of a transaction A' spending an output of A, because if
-        // transaction B were initially confirmed, conflicting with A and A', we
-        // wouldn't want to the user to create a transaction D intending to
-        // replace A', but potentially resulting in a scenario where A, A', and
-        // D could all be accepted (instead of just B and D, or just A and A'
-        // like the user would want).
-
-        // Platopia-Core: retained this check as 'replaced_by_txid' is still set
-        // in the wallet code.
-        if (nDepth == 0 && fOnlyConfirmed &&
-            pcoin->mapValue.count("replaced_by_txid")) {
+        if (!fAvailable) {
             continue;
         }
 
-        const int confirmations = pcoin->GetDepthInMainChain();
-        for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
-            isminetype mine = IsMine(pcoin->tx->vout[i]);
-            if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO &&
-                !IsLockedCoin((*it).first, i) &&
-				(includeLocked || confirmations > pcoin->tx->vout[i].nLockTime) &&
-                (pcoin->tx->vout[i].nValue > CAmount(0) || fIncludeZeroValue) &&
-                (!coinControl || !coinControl->HasSelected() ||
-                 coinControl->fAllowOtherInputs ||
-                 coinControl->IsSelected(COutPoint((*it).first, i)))) {
-                vCoins.push_back(COutput(
-                    pcoin, i, nDepth,
-                    ((mine & ISMINE_SPENDABLE) != ISMINE_NO) ||
-                        (coinControl && coinControl->fAllowWatchOnly &&
-                         (mine & ISMINE_WATCH_SOLVABLE) != ISMINE_NO),
-                    (mine & (ISMINE_SPENDABLE | ISMINE_WATCH_SOLVABLE)) !=
-                        ISMINE_NO));
-            }
+        const unsigned int i = outpoint.n;
+        const CTxOut &txout = pcoin->tx->vout[i];
+        isminetype mine = IsMine(txout);
+        if (!IsSpent(outpoint.hash, i) && mine != ISMINE_NO &&
+            !IsLockedCoin(outpoint.hash, i) &&
+            (includeLocked || nDepth > int64_t(txout.nLockTime)) &&
+            (txout.nValue > CAmount(0) || fIncludeZeroValue) &&
+            (!coinControl || !coinControl->HasSelected() ||
+             coinControl->fAllowOtherInputs ||
+             coinControl->IsSelected(outpoint))) {
+            vCoins.push_back(COutput(
+                pcoin, i, nDepth,
+                ((mine & ISMINE_SPENDABLE) != ISMINE_NO) ||
+                    (coinControl && coinControl->fAllowWatchOnly &&
+                     (mine & ISMINE_WATCH_SOLVABLE) != ISMINE_NO),
+                (mine & (ISMINE_SPENDABLE | ISMINE_WATCH_SOLVABLE)) !=
+                    ISMINE_NO));
         }
     }
 }
 
-void CWallet::GetAllDeposit(std::vector<CTxOutVerbose> &vDepositItem) const {
+void CWallet::GetAllDeposit(std::vector<CTxOutVerbose> &vDepositItem,
+                            int nMinUnlockHeight, int nMaxUnlockHeight) const {
     vDepositItem.clear();
 
     LOCK2(cs_main, cs_wallet);
-    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin();
-         it != mapWallet.end(); ++it) {
-        const uint256 &wtxid = it->first;
-        const CWalletTx *pcoin = &(*it).second;
+    DepositIndex::const_iterator it = setDeposits.lower_bound(
+        std::make_pair(nMinUnlockHeight, COutPoint(uint256(), 0)));
+    DepositIndex::const_iterator itUnconfirmed = setDeposits.lower_bound(
+        std::make_pair(DEPOSIT_UNCONFIRMED, COutPoint(uint256(), 0)));
+    for (; it != setDeposits.end(); ++it) {
+        if (it->first > nMaxUnlockHeight && it->first != DEPOSIT_UNCONFIRMED) {
+            // Skip to the deposits not in a block yet.
+            it = itUnconfirmed;
+            if (it == setDeposits.end()) {
+                break;
+            }
+        }
+
+        const COutPoint &outpoint = it->second;
+        std::map<uint256, CWalletTx>::const_iterator mi =
+            mapWallet.find(outpoint.hash);
+        if (mi == mapWallet.end()) {
+            continue;
+        }
+        const CWalletTx *pcoin = &mi->second;
 
         if (!CheckFinalTx(*pcoin)) {
             continue;
@@ -2323,16 +3079,9 @@ void CWallet::GetAllDeposit(std::vector<CTxOutVerbose> &vDepositItem) const {
             continue;
         }
 
-        const int confirmations = pcoin->GetDepthInMainChain();
-        for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
-            if(pcoin->tx->vout[i].nPrincipal <= 0)
-            {
-                continue;
-            }
-            if (IsMine(pcoin->tx->vout[i]) != ISMINE_NO) {
-                vDepositItem.push_back(CTxOutVerbose(pcoin->tx->vout[i], pcoin->tx->GetId(), i, pcoin->GetTxHeight()));
-            }
-        }
+        vDepositItem.push_back(CTxOutVerbose(pcoin->tx->vout[outpoint.n],
+                                             pcoin->tx->GetId(), outpoint.n,
+                                             pcoin->GetTxHeight()));
     }
 }
 
@@ -2378,6 +3127,107 @@ static void ApproximateBestSubset(
     }
 }
 
+bool SelectCoinsBnB(
+    std::vector<CBnBCoin> vCoins, const CAmount nTarget,
+    const CAmount nCostOfChange,
+    std::set<std::pair<const CWalletTx *, unsigned int>> &setCoinsRet,
+    CAmount &nValueRet) {
+    setCoinsRet.clear();
+    nValueRet = CAmount(0);
+
+    // Coins that cost more to spend than they add are no use.
+    vCoins.erase(std::remove_if(vCoins.begin(), vCoins.end(),
+                                [](const CBnBCoin &coin) {
+                                    return coin.nEffectiveValue <= 0;
+                                }),
+                 vCoins.end());
+    if (vCoins.empty()) {
+        return false;
+    }
+    std::sort(vCoins.begin(), vCoins.end(),
+              [](const CBnBCoin &a, const CBnBCoin &b) {
+                  return a.nEffectiveValue > b.nEffectiveValue;
+              });
+
+    // The coins not decided on yet add up to nAvailable.
+    CAmount nAvailable = 0;
+    for (const CBnBCoin &coin : vCoins) {
+        nAvailable += coin.nEffectiveValue;
+    }
+    if (nAvailable < nTarget) {
+        return false;
+    }
+
+    // Depth first, with the largest coins first: each step includes the next
+    // coin, or backtracks to the last coin included and leaves it out.
+    std::vector<bool> vfSelected;
+    std::vector<bool> vfBest;
+    CAmount nSelected = 0;
+    CAmount nWaste = 0;
+    CAmount nBestWaste = MAX_MONEY;
+    // Once the coins cost more now than in the long term, more of them only
+    // waste more.
+    const bool fWasteGrows = vCoins[0].nWaste > 0;
+    for (size_t nTries = 0; nTries < BNB_TOTAL_TRIES; nTries++) {
+        bool fBacktrack = false;
+        if (nSelected + nAvailable < nTarget ||
+            nSelected > nTarget + nCostOfChange ||
+            (fWasteGrows && nWaste > nBestWaste)) {
+            fBacktrack = true;
+        } else if (nSelected >= nTarget) {
+            const CAmount nTotalWaste = nWaste + nSelected - nTarget;
+            if (nTotalWaste <= nBestWaste) {
+                vfBest = vfSelected;
+                vfBest.resize(vCoins.size(), false);
+                nBestWaste = nTotalWaste;
+            }
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            while (!vfSelected.empty() && !vfSelected.back()) {
+                vfSelected.pop_back();
+                nAvailable += vCoins[vfSelected.size()].nEffectiveValue;
+            }
+            if (vfSelected.empty()) {
+                // Searched all.
+                break;
+            }
+            vfSelected.back() = false;
+            const CBnBCoin &coin = vCoins[vfSelected.size() - 1];
+            nSelected -= coin.nEffectiveValue;
+            nWaste -= coin.nWaste;
+            continue;
+        }
+
+        const size_t i = vfSelected.size();
+        const CBnBCoin &coin = vCoins[i];
+        nAvailable -= coin.nEffectiveValue;
+        // Including a coin like the one just left out would only find the
+        // same sets again.
+        if (i > 0 && !vfSelected.back() &&
+            coin.nEffectiveValue == vCoins[i - 1].nEffectiveValue &&
+            coin.nWaste == vCoins[i - 1].nWaste) {
+            vfSelected.push_back(false);
+        } else {
+            vfSelected.push_back(true);
+            nSelected += coin.nEffectiveValue;
+            nWaste += coin.nWaste;
+        }
+    }
+
+    if (vfBest.empty()) {
+        return false;
+    }
+    for (size_t i = 0; i < vCoins.size(); i++) {
+        if (vfBest[i]) {
+            setCoinsRet.insert(vCoins[i].coin);
+            nValueRet += vCoins[i].nValue;
+        }
+    }
+    return true;
+}
+
 bool CWallet::SelectCoinsMinConf(
     const CAmount nTargetValue, const int nConfMine, const int nConfTheirs,
     const uint64_t nMaxAncestors, std::vector<COutput> vCoins,
@@ -2592,6 +3442,53 @@ bool CWallet::SelectCoins(
     return res;
 }
 
+bool CWallet::SelectCoinsNoChange(
+    const std::vector<COutput> &vAvailableCoins,
+    const CMutableTransaction &txNew, const CAmount nValue,
+    const CFeeRate &feeRate,
+    std::set<std::pair<const CWalletTx *, unsigned int>> &setCoinsRet,
+    CAmount &nValueRet) const {
+    // Spending them later costs at least the required fee.
+    const CFeeRate longTermFeeRate(GetRequiredFee(1000));
+    std::vector<CBnBCoin> vCoins;
+    for (const COutput &output : vAvailableCoins) {
+        // Those SelectCoins tries first.
+        const CWalletTx *pcoin = output.tx;
+        if (!output.fSpendable ||
+            output.nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? 1 : 6)) {
+            continue;
+        }
+
+        const CTxOut &txout = pcoin->tx->vout[output.i];
+        SignatureData sigdata;
+        if (!ProduceSignature(DummySignatureCreator(this), txout.scriptPubKey,
+                              sigdata)) {
+            continue;
+        }
+        const CTxIn txin(pcoin->GetId(), output.i, txout.nValue,
+                         sigdata.scriptSig);
+        const size_t nInputBytes =
+            ::GetSerializeSize(txin, SER_NETWORK, PROTOCOL_VERSION);
+
+        CBnBCoin coin;
+        coin.coin = std::make_pair(pcoin, (unsigned int)output.i);
+        coin.nValue = txout.nValue;
+        coin.nEffectiveValue = txout.nValue - feeRate.GetFee(nInputBytes);
+        coin.nWaste = feeRate.GetFee(nInputBytes) -
+                      longTermFeeRate.GetFee(nInputBytes);
+        vCoins.push_back(coin);
+    }
+
+    // The fee of all but the inputs. Change would cost its output and the
+    // input spending it, the dust threshold without its factor three.
+    const size_t nBytes =
+        ::GetSerializeSize(txNew, SER_NETWORK, PROTOCOL_VERSION);
+    const CTxOut change(0, GetScriptForDestination(CKeyID()));
+    return SelectCoinsBnB(vCoins, nValue + feeRate.GetFee(nBytes),
+                          change.GetDustThreshold(feeRate) / 3, setCoinsRet,
+                          nValueRet);
+}
+
 bool CWallet::FundTransaction(CMutableTransaction &tx, CAmount &nFeeRet,
                               bool overrideEstimatedFeeRate,
                               const CFeeRate &specificFeeRate,
@@ -2722,6 +3619,23 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient> &vecSend,
         std::vector<COutput> vAvailableCoins;
         AvailableCoins(vAvailableCoins, true, coinControl);
 
+        // Allow to override the default confirmation target over the
+        // CoinControl instance.
+        int currentConfirmationTarget = nTxConfirmTarget;
+        if (coinControl && coinControl->nConfirmTarget > 0) {
+            currentConfirmationTarget = coinControl->nConfirmTarget;
+        }
+
+        // First look for coins that pay exactly enough, less than change
+        // would cost, at the fee rate the loop below comes to. Unless the
+        // fee is paid some other way than at a fee rate.
+        bool fTryNoChange =
+            nSubtractFeeFromAmount == 0 && !fSendFreeTransactions &&
+            !(coinControl &&
+              (coinControl->HasSelected() ||
+               coinControl->nMinimumTotalFee > 0));
+        bool fNoChange = false;
+
         nFeeRet = CAmount(0);
         // Start with no fee and loop until there is enough fee.
         while (true) {
@@ -2784,11 +3698,23 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient> &vecSend,
 
             // Choose coins to use.
             CAmount nValueIn(0);
-            setCoins.clear();
-            if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins,
-                             nValueIn, coinControl)) {
-                strFailReason = _("Insufficient funds");
-                return false;
+            if (fTryNoChange) {
+                fTryNoChange = false;
+                CFeeRate feeRate(GetMinimumFee(1000, currentConfirmationTarget,
+                                               mempool));
+                if (coinControl && coinControl->fOverrideFeeRate) {
+                    feeRate = coinControl->nFeeRate;
+                }
+                fNoChange = SelectCoinsNoChange(vAvailableCoins, txNew, nValue,
+                                                feeRate, setCoins, nValueIn);
+            }
+            if (!fNoChange) {
+                setCoins.clear();
+                if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins,
+                                 nValueIn, coinControl)) {
+                    strFailReason = _("Insufficient funds");
+                    return false;
+                }
             }
 
             for (const auto &pcoin : setCoins) {
@@ -2805,7 +3731,12 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient> &vecSend,
             }
 
             const CAmount nChange = nValueIn - nValueToSelect;
-            if (nChange > CAmount(0)) {
+            if (fNoChange) {
+                // The excess is less than change would cost.
+                nChangePosInOut = -1;
+                nFeeRet += nChange;
+                reservekey.ReturnKey();
+            } else if (nChange > CAmount(0)) {
                 // Fill a vout to ourself.
                 // TODO: pass in scriptChange instead of reservekey so change
                 // transaction isn't always pay-to-bitcoin-address.
@@ -2920,13 +3851,6 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient> &vecSend,
                 vin.scriptSig = CScript();
             }
 
-            // Allow to override the default confirmation target over the
-            // CoinControl instance.
-            int currentConfirmationTarget = nTxConfirmTarget;
-            if (coinControl && coinControl->nConfirmTarget > 0) {
-                currentConfirmationTarget = coinControl->nConfirmTarget;
-            }
-
             // Can we complete this as a free transaction?
             if (fSendFreeTransactions &&
                 nBytes <= MAX_FREE_TRANSACTION_CREATE_SIZE) {
@@ -2997,7 +3921,8 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient> &vecSend,
                 }
             }
 
-            // Include more fee and try again.
+            // Include more fee and try again, with change if need be.
+            fNoChange = false;
             nFeeRet = nFeeNeeded;
             continue;
         }
@@ -3006,25 +3931,28 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient> &vecSend,
             uint32_t nHashType = SIGHASH_ALL;
 
             CTransaction txNewConst(txNew);
-            int nIn = 0;
+            const PrecomputedSignatureHash sighashData(txNewConst);
+            std::vector<const CTxOut *> vSpent;
             for (const auto &coin : setCoins) {
-                const CScript &scriptPubKey =
-                    coin.first->tx->vout[coin.second].scriptPubKey;
-                SignatureData sigdata;
-
-                if (!ProduceSignature(
-                        TransactionSignatureCreator(
-                            this, &txNewConst, nIn,
-                            coin.first->tx->vout[coin.second].nValue,
-                            nHashType),
-                        scriptPubKey, sigdata)) {
+                vSpent.push_back(&coin.first->tx->vout[coin.second]);
+            }
+
+            // The inputs of large transactions are signed in parallel.
+            std::vector<SignatureData> vSigData(vSpent.size());
+            std::vector<char> vSigned(vSpent.size(), false);
+            ForEachInputParallel(vSpent.size(), [&](size_t nIn) {
+                vSigned[nIn] = ProduceSignature(
+                    TransactionSignatureCreator(this, &txNewConst, nIn,
+                                                vSpent[nIn]->nValue, nHashType,
+                                                &sighashData),
+                    vSpent[nIn]->scriptPubKey, vSigData[nIn]);
+            });
+            for (size_t nIn = 0; nIn < vSpent.size(); nIn++) {
+                if (!vSigned[nIn]) {
                     strFailReason = _("Signing transaction failed");
                     return false;
-                } else {
-                    UpdateTransaction(txNew, nIn, sigdata);
                 }
-
-                nIn++;
+                UpdateTransaction(txNew, nIn, vSigData[nIn]);
             }
         }
 
@@ -3195,6 +4123,14 @@ DBErrors CWallet::LoadWallet(bool &fFirstRunRet) {
 
     fFirstRunRet = !vchDefaultKey.IsValid();
 
+    {
+        // The chain is loaded by now.
+        LOCK2(cs_main, cs_wallet);
+        for (const auto &entry : mapWallet) {
+            AddToHeightIndex(entry.second);
+        }
+    }
+
     uiInterface.LoadWallet(this);
 
     return DB_LOAD_OK;
@@ -3222,6 +4158,12 @@ DBErrors CWallet::ZapSelectTx(std::vector<uint256> &vHashIn,
         return nZapSelectTxRet;
     }
 
+    {
+        LOCK(cs_wallet);
+        for (const uint256 &hash : vHashOut) {
+            RemoveFromHeightIndex(hash);
+        }
+    }
     MarkDirty();
 
     return DB_LOAD_OK;
@@ -3275,12 +4217,14 @@ bool CWallet::SetAddressBook(const CTxDestination &address,
         return false;
     }
 
-    if (!strPurpose.empty() &&
-        !CWalletDB(strWalletFile).WritePurpose(address, strPurpose)) {
+    LOCK(cs_wallet);
+    std::unique_ptr<CWalletDB> pwalletdb;
+    CWalletDB &walletdb = GetWalletDB(pwalletdb);
+    if (!strPurpose.empty() && !walletdb.WritePurpose(address, strPurpose)) {
         return false;
     }
 
-    return CWalletDB(strWalletFile).WriteName(address, strName);
+    return walletdb.WriteName(address, strName);
 }
 
 bool CWallet::DelAddressBook(const CTxDestination &address) {
@@ -3290,9 +4234,11 @@ bool CWallet::DelAddressBook(const CTxDestination &address) {
 
         if (fFileBacked) {
             // Delete destdata tuples associated with address.
+            std::unique_ptr<CWalletDB> pwalletdb;
+            CWalletDB &walletdb = GetWalletDB(pwalletdb);
             for (const std::pair<std::string, std::string> &item :
                  mapAddressBook[address].destdata) {
-                CWalletDB(strWalletFile).EraseDestData(address, item.first);
+                walletdb.EraseDestData(address, item.first);
             }
         }
         mapAddressBook.erase(address);
@@ -3306,8 +4252,11 @@ bool CWallet::DelAddressBook(const CTxDestination &address) {
         return false;
     }
 
-    CWalletDB(strWalletFile).ErasePurpose(address);
-    return CWalletDB(strWalletFile).EraseName(address);
+    LOCK(cs_wallet);
+    std::unique_ptr<CWalletDB> pwalletdb;
+    CWalletDB &walletdb = GetWalletDB(pwalletdb);
+    walletdb.ErasePurpose(address);
+    return walletdb.EraseName(address);
 }
 
 bool CWallet::SetDefaultKey(const CPubKey &vchPubKey) {
@@ -3324,7 +4273,9 @@ bool CWallet::SetDefaultKey(const CPubKey &vchPubKey) {
  */
 bool CWallet::NewKeyPool() {
     LOCK(cs_wallet);
-    CWalletDB walletdb(strWalletFile);
+    CWalletBatch batch(this);
+    std::unique_ptr<CWalletDB> pwalletdb;
+    CWalletDB &walletdb = GetWalletDB(pwalletdb);
     for (int64_t nIndex : setKeyPool) {
         walletdb.ErasePool(nIndex);
     }
@@ -3346,25 +4297,25 @@ bool CWallet::NewKeyPool() {
     return true;
 }
 
-bool CWallet::TopUpKeyPool(unsigned int kpSize) {
-    LOCK(cs_wallet);
-
-    if (IsLocked()) {
-        return false;
+unsigned int CWallet::GetKeyPoolTargetSize(unsigned int kpSize) const {
+    if (kpSize > 0) {
+        return kpSize;
     }
+    return std::max(GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), int64_t(0));
+}
 
-    CWalletDB walletdb(strWalletFile);
+unsigned int CWallet::GenerateKeyPoolKeys(unsigned int nTargetSize,
+                                          unsigned int nMaxKeys) {
+    AssertLockHeld(cs_wallet);
 
-    // Top up key pool.
-    unsigned int nTargetSize;
-    if (kpSize > 0) {
-        nTargetSize = kpSize;
-    } else {
-        nTargetSize =
-            std::max(GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), int64_t(0));
-    }
+    // All the keys in one transaction, a large -keypool would be bounded by
+    // the log syncs otherwise.
+    CWalletBatch batch(this);
+    std::unique_ptr<CWalletDB> pwalletdb;
+    CWalletDB &walletdb = GetWalletDB(pwalletdb);
 
-    while (setKeyPool.size() < (nTargetSize + 1)) {
+    unsigned int nKeys = 0;
+    while (setKeyPool.size() < (nTargetSize + 1) && nKeys < nMaxKeys) {
         int64_t nEnd = 1;
         if (!setKeyPool.empty()) {
             nEnd = *(--setKeyPool.end()) + 1;
@@ -3376,12 +4327,56 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize) {
         }
 
         setKeyPool.insert(nEnd);
+        nKeys++;
         LogPrintf("keypool added key %d, size=%u\n", nEnd, setKeyPool.size());
     }
 
+    return nKeys;
+}
+
+bool CWallet::TopUpKeyPool(unsigned int kpSize) {
+    LOCK(cs_wallet);
+
+    if (IsLocked()) {
+        return false;
+    }
+
+    // Top up key pool.
+    GenerateKeyPoolKeys(GetKeyPoolTargetSize(kpSize),
+                        std::numeric_limits<unsigned int>::max());
     return true;
 }
 
+void CWallet::ThreadTopUpKeyPool() {
+    RenameThread("bitcoin-keypool");
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(csKeyPoolTopUp);
+            while (!fKeyPoolLow) {
+                condKeyPoolTopUp.wait(lock);
+            }
+            fKeyPoolLow = false;
+        }
+
+        // A few keys per hold of cs_wallet, reserving a key waits for no more
+        // than those.
+        try {
+            while (true) {
+                boost::this_thread::interruption_point();
+                LOCK(cs_wallet);
+                if (IsLocked() ||
+                    GenerateKeyPoolKeys(GetKeyPoolTargetSize(),
+                                        KEYPOOL_TOPUP_BATCH) == 0) {
+                    break;
+                }
+            }
+        } catch (const std::exception &e) {
+            // Reserving a key tops the pool up itself when it is empty.
+            PrintExceptionContinue(&e, "bitcoin-keypool");
+        }
+    }
+}
+
 void CWallet::ReserveKeyFromKeyPool(int64_t &nIndex, CKeyPool &keypool) {
     nIndex = -1;
     keypool.vchPubKey = CPubKey();
@@ -3389,7 +4384,17 @@ void CWallet::ReserveKeyFromKeyPool(int64_t &nIndex, CKeyPool &keypool) {
     LOCK(cs_wallet);
 
     if (!IsLocked()) {
-        TopUpKeyPool();
+        // Without the thread, or when it fell behind, the keys are generated
+        // here.
+        if (!fKeyPoolTopUpThread || setKeyPool.empty()) {
+            TopUpKeyPool();
+        } else if (setKeyPool.size() <= GetKeyPoolTargetSize() / 2) {
+            {
+                boost::lock_guard<boost::mutex> lock(csKeyPoolTopUp);
+                fKeyPoolLow = true;
+            }
+            condKeyPoolTopUp.notify_one();
+        }
     }
 
     // Get the oldest key.
@@ -3710,6 +4715,37 @@ void CReserveKey::ReturnKey() {
     vchPubKey = CPubKey();
 }
 
+CWalletBatch::CWalletBatch(CWallet *pwalletIn) : pwallet(pwalletIn) {
+    AssertLockHeld(pwallet->cs_wallet);
+    if (!pwallet->fFileBacked || pwallet->pwalletdbBatch) {
+        return;
+    }
+
+    pwalletdb.reset(new CWalletDB(pwallet->strWalletFile));
+    if (!pwalletdb->TxnBegin()) {
+        // The writes go one by one then.
+        LogPrintf("%s: could not begin a wallet database transaction\n",
+                  __func__);
+        pwalletdb.reset();
+        return;
+    }
+
+    pwallet->pwalletdbBatch = pwalletdb.get();
+}
+
+CWalletBatch::~CWalletBatch() {
+    if (!pwalletdb) {
+        return;
+    }
+
+    pwallet->pwalletdbBatch = nullptr;
+    // Closing the handle syncs the log once for all the writes.
+    if (!pwalletdb->TxnCommit()) {
+        LogPrintf("%s: committing the wallet database transaction failed\n",
+                  __func__);
+    }
+}
+
 void CWallet::GetAllReserveKeys(std::set<CKeyID> &setAddress) const {
     setAddress.clear();
 
@@ -4025,6 +5061,11 @@ std::string CWallet::GetWalletHelpString(bool showDebug) {
     if (showDebug) {
         strUsage += HelpMessageGroup(_("Wallet debugging/testing options:"));
 
+        strUsage += HelpMessageOpt(
+            "-checkwalletbalances",
+            strprintf("Check the cached wallet balances against all "
+                      "transactions on every query (default: %d)",
+                      DEFAULT_CHECK_WALLET_BALANCES));
         strUsage += HelpMessageOpt(
             "-dblogsize=<n>",
             strprintf("Flush wallet database activity from memory to disk log "
@@ -4164,7 +5205,9 @@ CWallet *CWallet::CreateWalletFromFile(const std::string walletFile) {
 
     LogPrintf(" wallet      %15dms\n", GetTimeMillis() - nStart);
 
-    RegisterValidationInterface(walletInstance);
+    // Validation does not wait for the wallet, wallet RPC calls catch up
+    // with the notifications before they run.
+    RegisterValidationInterface(walletInstance, true);
 
     CBlockIndex *pindexRescan = chainActive.Tip();
     if (GetBoolArg("-rescan", false)) {
@@ -4177,6 +5220,15 @@ CWallet *CWallet::CreateWalletFromFile(const std::string walletFile) {
         } else {
             pindexRescan = chainActive.Genesis();
         }
+        // A rescan that was interrupted resumes where it got to.
+        if (pindexRescan && walletdb.ReadRescanProgress(locator)) {
+            CBlockIndex *pindexProgress =
+                FindForkInGlobalIndex(chainActive, locator);
+            if (pindexProgress &&
+                pindexProgress->nHeight < pindexRescan->nHeight) {
+                pindexRescan = pindexProgress;
+            }
+        }
     }
 
     if (chainActive.Tip() && chainActive.Tip() != pindexRescan) {
@@ -4277,6 +5329,14 @@ void CWallet::postInitProcess(boost::thread_group &threadGroup) {
     if (!CWallet::fFlushThreadRunning.exchange(true)) {
         threadGroup.create_thread(ThreadFlushWalletDB);
     }
+
+    // And one to top up the key pool.
+    if (fFileBacked) {
+        threadGroup.create_thread(
+            std::bind(&CWallet::ThreadTopUpKeyPool, this));
+        LOCK(cs_wallet);
+        fKeyPoolTopUpThread = true;
+    }
 }
 
 bool CWallet::ParameterInteraction() {
@@ -4404,6 +5464,8 @@ bool CWallet::ParameterInteraction() {
         GetBoolArg("-spendzeroconfchange", DEFAULT_SPEND_ZEROCONF_CHANGE);
     fSendFreeTransactions =
         GetBoolArg("-sendfreetransactions", DEFAULT_SEND_FREE_TRANSACTIONS);
+    fCheckWalletBalances =
+        GetBoolArg("-checkwalletbalances", DEFAULT_CHECK_WALLET_BALANCES);
 
     if (fSendFreeTransactions &&
         GetArg("-limitfreerelay", DEFAULT_LIMITFREERELAY) <= 0) {
@@ -7,6 +7,7 @@
 #define BITCOIN_WALLET_WALLET_H
 
 #include "amount.h"
+#include "dstencode.h"
 #include "script/ismine.h"
 #include "script/sign.h"
 #include "streams.h"
@@ -23,10 +24,13 @@
 #include <algorithm>
 #include <atomic>
 #include <cstdint>
+#include <limits>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdexcept>
 #include <string>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -39,8 +43,11 @@ extern CFeeRate payTxFee;
 extern unsigned int nTxConfirmTarget;
 extern bool bSpendZeroConfChange;
 extern bool fSendFreeTransactions;
+extern bool fCheckWalletBalances;
 
 static const unsigned int DEFAULT_KEYPOOL_SIZE = 100;
+//! Keys the background key pool top-up generates per hold of cs_wallet
+static const unsigned int KEYPOOL_TOPUP_BATCH = 10;
 //! -paytxfee default
 static const CAmount DEFAULT_TRANSACTION_FEE(1000 * 100);
 //! -fallbackfee default
@@ -53,6 +60,8 @@ static const CAmount WALLET_INCREMENTAL_RELAY_FEE(500000);
 static const CAmount MIN_CHANGE = CENT;
 //! final minimum change amount after paying for fees
 static const CAmount MIN_FINAL_CHANGE = MIN_CHANGE / 2;
+//! Steps the branch and bound coin selection takes at most
+static const size_t BNB_TOTAL_TRIES = 100000;
 //! Default for -spendzeroconfchange
 static const bool DEFAULT_SPEND_ZEROCONF_CHANGE = true;
 //! Default for -sendfreetransactions
@@ -67,6 +76,14 @@ static const bool DEFAULT_WALLETBROADCAST = true;
 static const bool DEFAULT_DISABLE_WALLET = false;
 //! if set, all keys will be derived by using BIP32
 static const bool DEFAULT_USE_HD_WALLET = true;
+//! Unlock height deposits not in a block yet are indexed with
+static const int DEPOSIT_UNCONFIRMED = std::numeric_limits<int>::max();
+//! Default for -checkwalletbalances
+static const bool DEFAULT_CHECK_WALLET_BALANCES = false;
+//! Blocks a rescan reads ahead, and adds to the wallet under one lock
+static const size_t WALLET_RESCAN_BATCH_BLOCKS = 100;
+//! Threads a rescan reads blocks on, at most
+static const int WALLET_RESCAN_THREADS = 4;
 
 extern const char *DEFAULT_WALLET_DAT;
 
@@ -129,6 +146,21 @@ public:
 
     typedef std::map<std::string, std::string> StringMap;
     StringMap destdata;
+
+    /**
+     * The encoded address of dest, the destination this is the data of. It
+     * is worked out the first time, listings that return many addresses
+     * would otherwise spend most of their time encoding them.
+     */
+    const std::string &GetAddress(const CTxDestination &dest) const {
+        if (strAddress.empty()) {
+            strAddress = EncodeDestination(dest);
+        }
+        return strAddress;
+    }
+
+private:
+    mutable std::string strAddress;
 };
 
 struct CRecipient {
@@ -300,6 +332,11 @@ public:
     mutable CAmount nImmatureWatchCreditCached;
     mutable CAmount nAvailableWatchCreditCached;
     mutable CAmount nChangeCached;
+    /**
+     * Whether tx was loaded without the content of its outputs, which stays
+     * in the wallet file only. See CWallet::LoadToWallet.
+     */
+    bool fContentDropped;
 
     CWalletTx() { Init(nullptr); }
 
@@ -335,6 +372,7 @@ public:
         nAvailableWatchCreditCached = CAmount(0);
         nImmatureWatchCreditCached = CAmount(0);
         nChangeCached = CAmount(0);
+        fContentDropped = false;
         nOrderPos = -1;
     }
 
@@ -382,17 +420,7 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty() {
-        fCreditCached = false;
-        fAvailableCreditCached = false;
-        fImmatureCreditCached = false;
-        fWatchDebitCached = false;
-        fWatchCreditCached = false;
-        fAvailableWatchCreditCached = false;
-        fImmatureWatchCreditCached = false;
-        fDebitCached = false;
-        fChangeCached = false;
-    }
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn) {
         pwallet = pwalletIn;
@@ -432,6 +460,9 @@ public:
 
     bool RelayWalletTransaction(CConnman *connman);
 
+    /** Put the content of the outputs back in tx if it was left out */
+    bool LoadContent();
+
     std::set<uint256> GetConflicts() const;
 };
 
@@ -455,6 +486,28 @@ public:
     std::string ToString() const;
 };
 
+/** A coin for SelectCoinsBnB */
+struct CBnBCoin {
+    std::pair<const CWalletTx *, unsigned int> coin;
+    CAmount nValue;
+    //! nValue less the fee of the input spending it
+    CAmount nEffectiveValue;
+    //! What that fee is more than at the long term fee rate
+    CAmount nWaste;
+};
+
+/**
+ * Branch and bound search for the coins whose effective values add up to at
+ * least nTarget and at most nTarget + nCostOfChange, so they need no change
+ * output, with the least waste: that of the coins and the excess, which goes
+ * to the fee. Gives up after BNB_TOTAL_TRIES steps.
+ */
+bool SelectCoinsBnB(
+    std::vector<CBnBCoin> vCoins, const CAmount nTarget,
+    const CAmount nCostOfChange,
+    std::set<std::pair<const CWalletTx *, unsigned int>> &setCoinsRet,
+    CAmount &nValueRet);
+
 /** Private key that includes an expiration date in case it never gets used. */
 class CWalletKey {
 public:
@@ -555,6 +608,47 @@ private:
     std::vector<char> _ssExtra;
 };
 
+/** The balances of a wallet, or what one transaction adds to them */
+struct CWalletBalances {
+    //! Available credit of trusted transactions, GetBalance
+    CAmount nTrusted;
+    //! Of untrusted ones in the mempool, GetUnconfirmedBalance
+    CAmount nUntrustedPending;
+    //! Of coinbases not mature yet, GetImmatureBalance
+    CAmount nImmature;
+    CAmount nWatchOnlyTrusted;
+    CAmount nWatchOnlyUntrustedPending;
+    CAmount nWatchOnlyImmature;
+    //! Principal and interest of the deposits still locked, getmyinterest
+    CAmount nLockedPrincipal;
+    CAmount nLockedInterest;
+
+    CWalletBalances()
+        : nTrusted(0), nUntrustedPending(0), nImmature(0),
+          nWatchOnlyTrusted(0), nWatchOnlyUntrustedPending(0),
+          nWatchOnlyImmature(0), nLockedPrincipal(0), nLockedInterest(0) {}
+
+    bool IsNull() const { return *this == CWalletBalances(); }
+
+    CWalletBalances &operator+=(const CWalletBalances &b);
+    CWalletBalances &operator-=(const CWalletBalances &b);
+    friend bool operator==(const CWalletBalances &a, const CWalletBalances &b);
+};
+
+/** Salted hash of a script, for the script sets of the wallet */
+class SaltedScriptHasher {
+private:
+    /** Salt, not const so that the sets can be assigned */
+    uint64_t k0, k1;
+
+public:
+    SaltedScriptHasher();
+
+    size_t operator()(const CScript &script) const;
+};
+
+typedef std::unordered_set<CScript, SaltedScriptHasher> ScriptSet;
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of
  * transactions and balances, and provides the ability to create new
@@ -574,8 +668,41 @@ private:
         std::set<std::pair<const CWalletTx *, unsigned int>> &setCoinsRet,
         CAmount &nValueRet, const CCoinControl *coinControl = nullptr) const;
 
+    /**
+     * Select confirmed coins that pay nValue and the fee at feeRate of a
+     * transaction with the outputs of txNew, without change. See
+     * SelectCoinsBnB.
+     */
+    bool SelectCoinsNoChange(
+        const std::vector<COutput> &vAvailableCoins,
+        const CMutableTransaction &txNew, const CAmount nValue,
+        const CFeeRate &feeRate,
+        std::set<std::pair<const CWalletTx *, unsigned int>> &setCoinsRet,
+        CAmount &nValueRet) const;
+
     CWalletDB *pwalletdbEncryption;
 
+    /**
+     * The scripts the wallet writes for its keys, the pay to script hash
+     * scripts of its redeem scripts and its watch-only scripts, which makes
+     * IsMine one lookup for the outputs that aren't the wallet's. Kept up to
+     * date with the keystore, under cs_KeyStore.
+     */
+    ScriptSet setMineScripts;
+    void AddMineScriptsOfKey(const CPubKey &pubkey);
+    void RebuildMineScripts();
+
+    //! The database handle of the open CWalletBatch, if any
+    CWalletDB *pwalletdbBatch;
+    friend class CWalletBatch;
+
+    /**
+     * The database handle the wallet writes with: that of the open
+     * CWalletBatch, or else a new one kept in pwalletdbOwn.
+     */
+    CWalletDB &GetWalletDB(std::unique_ptr<CWalletDB> &pwalletdbOwn,
+                           bool fFlushOnClose = true) const;
+
     //! the current wallet version: clients below this version are not able to
     //! load the wallet
     int nWalletVersion;
@@ -597,6 +724,76 @@ private:
     void AddToSpends(const COutPoint &outpoint, const uint256 &wtxid);
     void AddToSpends(const uint256 &wtxid);
 
+    /**
+     * Deposits paying to this wallet, by the height they unlock at, so
+     * deposit queries don't walk all of mapWallet. Deposits not in a known
+     * block are indexed under DEPOSIT_UNCONFIRMED.
+     */
+    typedef std::set<std::pair<int, COutPoint>> DepositIndex;
+    DepositIndex setDeposits;
+    //! Block height the deposits of each indexed transaction were keyed on
+    std::map<uint256, int> mapDepositHeight;
+    void AddToDeposits(const CWalletTx &wtx);
+    void RemoveFromDeposits(const uint256 &wtxid);
+
+    /**
+     * Transactions by the height of their block in the active chain, so
+     * listsinceblock doesn't walk all of mapWallet. Transactions in no block
+     * of the active chain, conflicted and abandoned ones are indexed under
+     * DEPOSIT_UNCONFIRMED. AddToWallet keeps it up to date, blocks connected
+     * and disconnected go through it; it is built once the wallet is loaded.
+     */
+    std::set<std::pair<int, uint256>> setTxByHeight;
+    //! Height each transaction of setTxByHeight is indexed under
+    std::map<uint256, int> mapTxIndexedHeight;
+    void AddToHeightIndex(const CWalletTx &wtx);
+    void RemoveFromHeightIndex(const uint256 &wtxid);
+
+    /**
+     * Outputs paying to this wallet that no wallet transaction spends, by the
+     * height they can be spent from, so AvailableCoins doesn't walk all of
+     * mapWallet and its spent outputs. That is the height of their block, and
+     * for coinbases and deposits the height they mature or unlock at. Outputs
+     * not in a known block are indexed under DEPOSIT_UNCONFIRMED. Whether the
+     * block is still in the active chain, and whether a spending transaction
+     * is, is checked on every lookup.
+     */
+    typedef std::set<std::pair<int, COutPoint>> CoinIndex;
+    CoinIndex setAvailableCoins;
+    //! Block height the outputs of each transaction paying to us were keyed on
+    std::map<uint256, int> mapCoinHeight;
+    //! Whether a wallet transaction that isn't abandoned or conflicted spends
+    //! outpoint, without looking at the chain.
+    bool IsSpentInWallet(const COutPoint &outpoint) const;
+    void AddToAvailableCoins(const CWalletTx &wtx);
+    void UpdateAvailableCoin(const COutPoint &outpoint);
+    //! Index the outputs of wtx and those it spends again
+    void UpdateAvailableCoins(const CWalletTx &wtx);
+
+    /**
+     * GetBalances keeps the sum of what each transaction adds to the balances,
+     * and works out again only the parts that may have changed since: those of
+     * transactions marked dirty, and those that change without the wallet
+     * being told, with the mempool or with the tip. Guarded by cs_wallet.
+     */
+    mutable CWalletBalances balancesCached;
+    //! The parts in balancesCached, those that aren't zero
+    mutable std::map<uint256, CWalletBalances> mapBalanceParts;
+    //! Transactions whose part is to be worked out again
+    mutable std::set<uint256> setBalanceDirty;
+    //! Transactions whose part changes with the mempool, and with the tip
+    mutable std::set<uint256> setBalanceMempool;
+    mutable std::set<uint256> setBalanceTip;
+    //! Whether balancesCached is the sum of mapBalanceParts, else start over
+    mutable bool fBalancesValid;
+    mutable unsigned int nBalanceMempoolUpdated;
+    mutable const CBlockIndex *pindexBalanceTip;
+    mutable int nBalanceTipHeight;
+    //! What wtx adds to the balances, and what that changes with
+    CWalletBalances GetTxBalances(const CWalletTx &wtx, bool &fMempool,
+                                  bool &fTip) const;
+    void UpdateTxBalances(const uint256 &wtxid) const;
+
     /* Mark a transaction (and its in-wallet descendants) as conflicting with a
      * particular block. */
     void MarkConflicted(const uint256 &hashBlock, const uint256 &hashTx);
@@ -610,6 +807,29 @@ private:
 
     std::set<int64_t> setKeyPool;
 
+    /**
+     * The key pool is topped up on a thread of its own once postInitProcess
+     * started it, when it is down to half its size, so that reserving a key
+     * doesn't wait for new ones to be generated and written.
+     */
+    bool fKeyPoolTopUpThread;
+    boost::mutex csKeyPoolTopUp;
+    boost::condition_variable condKeyPoolTopUp;
+    bool fKeyPoolLow;
+    void ThreadTopUpKeyPool();
+    //! Generate up to nMaxKeys keys towards nTargetSize. Returns how many.
+    unsigned int GenerateKeyPoolKeys(unsigned int nTargetSize,
+                                     unsigned int nMaxKeys);
+    unsigned int GetKeyPoolTargetSize(unsigned int kpSize = 0) const;
+
+    /**
+     * The key at m/0'/0' of the HD chain of hdExternalChainMasterID, derived
+     * from the master key once rather than for every key. Cleared when the
+     * wallet is locked.
+     */
+    CExtKey hdExternalChainKey;
+    CKeyID hdExternalChainMasterID;
+
     int64_t nTimeFirstKey;
 
     /**
@@ -673,11 +893,18 @@ public:
         fFileBacked = false;
         nMasterKeyMaxID = 0;
         pwalletdbEncryption = nullptr;
+        pwalletdbBatch = nullptr;
         nOrderPosNext = 0;
         nNextResend = 0;
         nLastResend = 0;
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
+        fBalancesValid = false;
+        nBalanceMempoolUpdated = 0;
+        pindexBalanceTip = nullptr;
+        nBalanceTipHeight = -1;
+        fKeyPoolTopUpThread = false;
+        fKeyPoolLow = false;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -687,6 +914,12 @@ public:
     typedef std::multimap<int64_t, TxPair> TxItems;
     TxItems wtxOrdered;
 
+    /**
+     * The transactions confirmed in the active chain after nHeight, or not
+     * at all, in height order. Requires cs_main and cs_wallet.
+     */
+    std::vector<const CWalletTx *> GetTransactionsAfter(int nHeight) const;
+
     int64_t nOrderPosNext;
     std::map<uint256, int> mapRequestCount;
 
@@ -714,7 +947,14 @@ public:
                         bool fIncludeZeroValue = false,
                         bool includeLocked = false) const;
 
-    void GetAllDeposit(std::vector<CTxOutVerbose> &vDepositItem) const;
+    /**
+     * Deposits paying to this wallet unlocking from nMinUnlockHeight to
+     * nMaxUnlockHeight, in unlock height order. Deposits not in a block yet
+     * come last and are always included.
+     */
+    void GetAllDeposit(
+        std::vector<CTxOutVerbose> &vDepositItem, int nMinUnlockHeight = 0,
+        int nMaxUnlockHeight = std::numeric_limits<int>::max()) const;
 
     /**
      * Shuffle and select coins until nTargetValue is reached while avoiding
@@ -746,7 +986,11 @@ public:
     bool AddKeyPubKey(const CKey &key, const CPubKey &pubkey) override;
     //! Adds a key to the store, without saving it to disk (used by LoadWallet)
     bool LoadKey(const CKey &key, const CPubKey &pubkey) {
-        return CCryptoKeyStore::AddKeyPubKey(key, pubkey);
+        if (!CCryptoKeyStore::AddKeyPubKey(key, pubkey)) {
+            return false;
+        }
+        AddMineScriptsOfKey(pubkey);
+        return true;
     }
 
     //! Load metadata (used by LoadWallet)
@@ -792,6 +1036,7 @@ public:
     bool LoadWatchOnly(const CScript &dest);
 
     bool Unlock(const SecureString &strWalletPassphrase);
+    bool Lock() override;
     bool ChangeWalletPassphrase(const SecureString &strOldWalletPassphrase,
                                 const SecureString &strNewWalletPassphrase);
     bool EncryptWallet(const SecureString &strWalletPassphrase);
@@ -810,20 +1055,44 @@ public:
                           bool bForceNew = false);
 
     void MarkDirty();
+    //! Work out the part wtxid adds to the balances again on the next call
+    void MarkBalancesDirty(const uint256 &wtxid) const;
     bool AddToWallet(const CWalletTx &wtxIn, bool fFlushOnClose = true);
     bool LoadToWallet(const CWalletTx &wtxIn);
-    void SyncTransaction(const CTransaction &tx, const CBlockIndex *pindex,
+    /**
+     * The full transaction of wtx, read from the wallet file if its output
+     * content was left out. Use it wherever the transaction is serialized.
+     */
+    bool GetFullTransaction(const CWalletTx &wtx, CTransactionRef &tx) const;
+    void SyncTransaction(const CTransactionRef &ptx, const CBlockIndex *pindex,
                          int posInBlock) override;
     bool AddToWalletIfInvolvingMe(const CTransaction &tx,
                                   const CBlockIndex *pIndex, int posInBlock,
                                   bool fUpdate);
     CBlockIndex *ScanForWalletTransactions(CBlockIndex *pindexStart,
                                            bool fUpdate = false);
+    //! The scripts outputs paying to the wallet mostly have, for rescans
+    void GetScanScripts(ScriptSet &setScripts) const;
+    /**
+     * Whether script may pay to the wallet. False is certain, true leaves it
+     * to IsMine.
+     */
+    bool MayBeMine(const CScript &script) const;
+    //! Whether tx spends an output of a wallet transaction, or one a wallet
+    //! transaction spends
+    bool SpendsFromWallet(const CTransaction &tx) const;
+    //! The same for the outpoints a transaction spends
+    bool SpendsFromWallet(const std::vector<COutPoint> &vPrevout) const;
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime,
                                   CConnman *connman) override;
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime,
                                                         CConnman *connman);
+    /**
+     * All balances at once. Cheap but for the transactions that changed, see
+     * balancesCached, and cross-checked with -checkwalletbalances.
+     */
+    CWalletBalances GetBalances() const;
     CAmount GetBalance() const;
     CAmount GetUnconfirmedBalance() const;
     CAmount GetImmatureBalance() const;
@@ -1091,6 +1360,25 @@ public:
     void KeepScript() override { KeepKey(); }
 };
 
+/**
+ * Makes the database writes of the wallet while it lives one transaction of
+ * a logical operation, such as a key pool top up or an import, instead of a
+ * transaction and a log sync each. The writes are committed when it goes out
+ * of scope. cs_wallet must be held for its whole life: on this thread the
+ * wallet file may only be used through the batch meanwhile, which the
+ * methods of CWallet do. A batch opened inside another one is part of it.
+ */
+class CWalletBatch {
+public:
+    explicit CWalletBatch(CWallet *pwalletIn);
+    ~CWalletBatch();
+
+private:
+    CWallet *pwallet;
+    //! nullptr if this batch is part of another one, or not needed
+    std::unique_ptr<CWalletDB> pwalletdb;
+};
+
 /**
  * Account information.
  * Stored in wallet with key "acc"+string account name.
@@ -74,9 +74,25 @@ bool CWalletDB::ErasePurpose(const CTxDestination &address) {
                                 EncodeAddr(address, Params())));
 }
 
+bool CWalletDB::ReadTx(const uint256 &hash, CWalletTx &wtx) {
+    return Read(std::make_pair(std::string("tx"), hash), wtx);
+}
+
 bool CWalletDB::WriteTx(const CWalletTx &wtx) {
     nWalletDBUpdateCounter++;
-    return Write(std::make_pair(std::string("tx"), wtx.GetId()), wtx);
+    if (!wtx.fContentDropped) {
+        return Write(std::make_pair(std::string("tx"), wtx.GetId()), wtx);
+    }
+
+    // Only the metadata is new, the transaction is the one already written.
+    CWalletTx wtxStored;
+    if (!ReadTx(wtx.GetId(), wtxStored)) {
+        return false;
+    }
+    CWalletTx wtxFull(wtx);
+    wtxFull.tx = wtxStored.tx;
+    wtxFull.fContentDropped = false;
+    return Write(std::make_pair(std::string("tx"), wtx.GetId()), wtxFull);
 }
 
 bool CWalletDB::EraseTx(uint256 hash) {
@@ -168,6 +184,21 @@ bool CWalletDB::ReadBestBlock(CBlockLocator &locator) {
     return Read(std::string("bestblock_nomerkle"), locator);
 }
 
+bool CWalletDB::WriteRescanProgress(const CBlockLocator &locator) {
+    nWalletDBUpdateCounter++;
+    return Write(std::string("rescanprogress"), locator);
+}
+
+bool CWalletDB::ReadRescanProgress(CBlockLocator &locator) {
+    return Read(std::string("rescanprogress"), locator) &&
+           !locator.vHave.empty();
+}
+
+bool CWalletDB::EraseRescanProgress() {
+    nWalletDBUpdateCounter++;
+    return Erase(std::string("rescanprogress"));
+}
+
 bool CWalletDB::WriteOrderPosNext(int64_t nOrderPosNext) {
     nWalletDBUpdateCounter++;
     return Write(std::string("orderposnext"), nOrderPosNext);
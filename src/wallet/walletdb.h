@@ -121,6 +121,7 @@ public:
                       const std::string &purpose);
     bool ErasePurpose(const CTxDestination &address);
 
+    bool ReadTx(const uint256 &hash, CWalletTx &wtx);
     bool WriteTx(const CWalletTx &wtx);
     bool EraseTx(uint256 hash);
 
@@ -139,6 +140,11 @@ public:
     bool WriteBestBlock(const CBlockLocator &locator);
     bool ReadBestBlock(CBlockLocator &locator);
 
+    //! The block a rescan got to, so it resumes there if interrupted
+    bool WriteRescanProgress(const CBlockLocator &locator);
+    bool ReadRescanProgress(CBlockLocator &locator);
+    bool EraseRescanProgress();
+
     bool WriteOrderPosNext(int64_t nOrderPosNext);
 
     bool WriteDefaultKey(const CPubKey &vchPubKey);
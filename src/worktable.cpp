@@ -0,0 +1,171 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "worktable.h"
+
+#include "core_memusage.h"
+#include "memusage.h"
+
+#include <algorithm>
+
+CWorkTable::CWorkTable(size_t nMaxWorkIn)
+    : nMaxWork(std::max<size_t>(nMaxWorkIn, 1)), nNextSequence(0) {}
+
+std::shared_ptr<Work> CWorkTable::Add(const CBlock &block,
+                                      const ethash_h256_t &boundary) {
+    return Add(block, block.GetBaseEthash(), boundary);
+}
+
+std::shared_ptr<Work> CWorkTable::Add(const CBlock &block,
+                                      const ethash_h256_t &blockEthash,
+                                      const ethash_h256_t &boundary) {
+    LOCK(cs);
+    auto it = mapWork.find(blockEthash);
+    if (it != mapWork.end()) {
+        // The header hash commits to nBits, so the boundary is the same too.
+        return it->second.work;
+    }
+
+    std::shared_ptr<Work> work(
+        new Work{block, blockEthash, boundary, false, 0, false});
+    const uint64_t nSequence = nNextSequence++;
+    mapWork.emplace(blockEthash, Entry{work, nSequence});
+    mapSequence.emplace(nSequence, blockEthash);
+    mapHeight[block.nBlockHeight].push_back(blockEthash);
+
+    while (mapWork.size() > nMaxWork) {
+        RemoveLocked(mapSequence.begin()->second);
+    }
+    return work;
+}
+
+std::shared_ptr<Work>
+CWorkTable::Get(const ethash_h256_t &blockEthash) const {
+    LOCK(cs);
+    auto it = mapWork.find(blockEthash);
+    if (it == mapWork.end()) {
+        return nullptr;
+    }
+    return it->second.work;
+}
+
+std::shared_ptr<Work> CWorkTable::GetNewest() const {
+    LOCK(cs);
+    for (auto it = mapSequence.rbegin(); it != mapSequence.rend(); ++it) {
+        const std::shared_ptr<Work> &work = mapWork.at(it->second).work;
+        if (!work->done) {
+            return work;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<Work> CWorkTable::AddShare(const ethash_h256_t &blockEthash,
+                                           uint64_t nNonce,
+                                           bool &fDuplicate) {
+    LOCK(cs);
+    fDuplicate = false;
+    auto it = mapWork.find(blockEthash);
+    if (it == mapWork.end()) {
+        return nullptr;
+    }
+    std::set<uint64_t> &setNonces = it->second.setNonces;
+    if (setNonces.count(nNonce)) {
+        fDuplicate = true;
+    } else if (setNonces.size() < MAX_WORK_SHARES) {
+        setNonces.insert(nNonce);
+    }
+    return it->second.work;
+}
+
+std::shared_ptr<Work> CWorkTable::SetSolution(const ethash_h256_t &blockEthash,
+                                              uint64_t nNonce,
+                                              const ethash_h256_t &hashMix) {
+    LOCK(cs);
+    auto it = mapWork.find(blockEthash);
+    if (it == mapWork.end()) {
+        return nullptr;
+    }
+    Work &work = *it->second.work;
+    work.block.nNonce = nNonce;
+    work.block.hashMix = hashMix;
+    work.done = true;
+    return it->second.work;
+}
+
+void CWorkTable::Remove(const ethash_h256_t &blockEthash) {
+    LOCK(cs);
+    RemoveLocked(blockEthash);
+}
+
+void CWorkTable::RemoveUpToHeight(uint32_t nHeight) {
+    LOCK(cs);
+    while (!mapHeight.empty() && mapHeight.begin()->first <= nHeight) {
+        // RemoveLocked erases the height entry once it is empty.
+        RemoveLocked(mapHeight.begin()->second.back());
+    }
+}
+
+void CWorkTable::Clear() {
+    LOCK(cs);
+    mapWork.clear();
+    mapSequence.clear();
+    mapHeight.clear();
+}
+
+size_t CWorkTable::Size() const {
+    LOCK(cs);
+    return mapWork.size();
+}
+
+size_t CWorkTable::DynamicMemoryUsage() const {
+    LOCK(cs);
+    size_t nUsage = memusage::DynamicUsage(mapWork) +
+                    memusage::DynamicUsage(mapSequence) +
+                    memusage::DynamicUsage(mapHeight);
+    for (const auto &it : mapWork) {
+        nUsage += memusage::DynamicUsage(it.second.work) +
+                  RecursiveDynamicUsage(it.second.work->block) +
+                  memusage::DynamicUsage(it.second.setNonces);
+    }
+    for (const auto &it : mapHeight) {
+        nUsage += memusage::DynamicUsage(it.second);
+    }
+    return nUsage;
+}
+
+std::vector<std::shared_ptr<Work>> CWorkTable::GetAll() const {
+    LOCK(cs);
+    std::vector<std::shared_ptr<Work>> vWork;
+    vWork.reserve(mapSequence.size());
+    for (const auto &entry : mapSequence) {
+        vWork.push_back(mapWork.at(entry.second).work);
+    }
+    return vWork;
+}
+
+void CWorkTable::RemoveLocked(const ethash_h256_t blockEthash) {
+    AssertLockHeld(cs);
+    auto it = mapWork.find(blockEthash);
+    if (it == mapWork.end()) {
+        return;
+    }
+
+    const uint32_t nHeight = it->second.work->block.nBlockHeight;
+    auto hit = mapHeight.find(nHeight);
+    if (hit != mapHeight.end()) {
+        std::vector<ethash_h256_t> &vHashes = hit->second;
+        vHashes.erase(std::remove_if(vHashes.begin(), vHashes.end(),
+                                     [&](const ethash_h256_t &hash) {
+                                         return EthashEqual()(hash,
+                                                              blockEthash);
+                                     }),
+                      vHashes.end());
+        if (vHashes.empty()) {
+            mapHeight.erase(hit);
+        }
+    }
+    mapSequence.erase(it->second.nSequence);
+    mapWork.erase(it);
+}
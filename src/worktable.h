@@ -0,0 +1,127 @@
+// Copyright (c) 2018 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WORKTABLE_H
+#define BITCOIN_WORKTABLE_H
+
+#include "ethash/ethash.h"
+#include "primitives/block.h"
+#include "sync.h"
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+/** Default number of mining jobs kept around for late submissions */
+static const size_t DEFAULT_MAX_RETAINED_WORK = 16;
+/** Nonces remembered per mining job, to turn down solutions submitted twice */
+static const size_t MAX_WORK_SHARES = 10000;
+
+struct Work {
+    CBlock block;
+    ethash_h256_t blockEthash;
+    ethash_h256_t boundary;
+    bool done;
+    int  miningThreads;  //number of threads
+    bool deprecated;     //mined by others
+};
+
+/**
+ * Outstanding mining jobs, indexed by their ethash header hash and by height.
+ *
+ * Shared between the internal miner and the getwork/submitwork RPCs, so all
+ * accesses are locked. Jobs stay in the table after newer ones are added, up
+ * to a fixed number, so a solution for one of the previous templates can
+ * still be found in O(1); the oldest jobs are evicted first.
+ */
+class CWorkTable {
+public:
+    explicit CWorkTable(size_t nMaxWorkIn = DEFAULT_MAX_RETAINED_WORK);
+
+    /**
+     * Add a job for block, or return the existing one if a job with the same
+     * header hash and boundary is already known.
+     */
+    std::shared_ptr<Work> Add(const CBlock &block,
+                              const ethash_h256_t &boundary);
+    /** Same, with the block's GetBaseEthash() already computed */
+    std::shared_ptr<Work> Add(const CBlock &block,
+                              const ethash_h256_t &blockEthash,
+                              const ethash_h256_t &boundary);
+
+    /** Find a job by header hash, or nullptr */
+    std::shared_ptr<Work> Get(const ethash_h256_t &blockEthash) const;
+
+    /** The most recently added job that isn't done yet, or nullptr */
+    std::shared_ptr<Work> GetNewest() const;
+
+    /**
+     * Record that nNonce was submitted for the job with this header hash,
+     * before it is checked. Returns the job, or nullptr if it is unknown (or
+     * already evicted). fDuplicate is set if nNonce was submitted for it
+     * before, among the last MAX_WORK_SHARES.
+     */
+    std::shared_ptr<Work> AddShare(const ethash_h256_t &blockEthash,
+                                   uint64_t nNonce, bool &fDuplicate);
+
+    /**
+     * Record a solution for the job with this header hash and mark it done,
+     * once its block is accepted.
+     * Returns the job, or nullptr if it is unknown (or already evicted).
+     */
+    std::shared_ptr<Work> SetSolution(const ethash_h256_t &blockEthash,
+                                      uint64_t nNonce,
+                                      const ethash_h256_t &hashMix);
+
+    void Remove(const ethash_h256_t &blockEthash);
+    /** Remove every job for a height at or below nHeight */
+    void RemoveUpToHeight(uint32_t nHeight);
+    void Clear();
+
+    size_t Size() const;
+    /** Memory used by the jobs and their blocks, in bytes */
+    size_t DynamicMemoryUsage() const;
+    /** All jobs, oldest first */
+    std::vector<std::shared_ptr<Work>> GetAll() const;
+
+private:
+    struct EthashHasher {
+        size_t operator()(const ethash_h256_t &hash) const {
+            // The header hash is a keccak output, any 8 bytes will do
+            size_t n;
+            std::memcpy(&n, hash.b, sizeof(n));
+            return n;
+        }
+    };
+    struct EthashEqual {
+        bool operator()(const ethash_h256_t &a, const ethash_h256_t &b) const {
+            return std::memcmp(a.b, b.b, sizeof(a.b)) == 0;
+        }
+    };
+    struct Entry {
+        std::shared_ptr<Work> work;
+        uint64_t nSequence;
+        //! Nonces submitted for the job
+        std::set<uint64_t> setNonces;
+    };
+
+    mutable CCriticalSection cs;
+    const size_t nMaxWork;
+    uint64_t nNextSequence;
+    std::unordered_map<ethash_h256_t, Entry, EthashHasher, EthashEqual>
+        mapWork;
+    //! Insertion order, for eviction and GetNewest()
+    std::map<uint64_t, ethash_h256_t> mapSequence;
+    //! Jobs per block height
+    std::map<uint32_t, std::vector<ethash_h256_t>> mapHeight;
+
+    //! By value: callers pass references into the indexes it erases from
+    void RemoveLocked(const ethash_h256_t blockEthash);
+};
+
+#endif // BITCOIN_WORKTABLE_H
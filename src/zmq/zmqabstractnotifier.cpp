@@ -14,6 +14,20 @@ bool CZMQAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/) {
 }
 
 bool CZMQAbstractNotifier::NotifyTransaction(
-    const CTransaction & /*transaction*/) {
+    const CZMQTransaction & /*transaction*/) {
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyMiningJob(const CZMQMiningJob & /*job*/) {
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyMempoolRemoved(
+    const uint256 & /*txid*/, const std::string & /*reason*/) {
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyDeposits(
+    const std::vector<CZMQDeposit> & /*deposits*/, bool /*fUnlocked*/) {
     return true;
 }
@@ -7,11 +7,45 @@
 
 #include "zmqconfig.h"
 
+#include "amount.h"
+#include "ethash/ethash.h"
+
+#include <memory>
+#include <vector>
+
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
 typedef CZMQAbstractNotifier *(*CZMQNotifierFactory)();
 
+/** Serialized data, shared by the notifiers that publish it */
+typedef std::shared_ptr<const std::vector<uint8_t>> ZMQDataRef;
+
+/**
+ * A transaction to notify: its id, and its serialization if a notifier
+ * publishes raw transactions.
+ */
+struct CZMQTransaction {
+    uint256 txid;
+    ZMQDataRef raw;
+};
+
+/** A new mining job, as eth_getWork returns it, and its height */
+struct CZMQMiningJob {
+    ethash_h256_t header;
+    ethash_h256_t seed;
+    ethash_h256_t boundary;
+    uint32_t nHeight;
+};
+
+/** A deposit output, what it locks and pays, and when it unlocks */
+struct CZMQDeposit {
+    COutPoint outpoint;
+    CAmount nPrincipal;
+    CAmount nInterest;
+    uint32_t nUnlockHeight;
+};
+
 class CZMQAbstractNotifier {
 public:
     CZMQAbstractNotifier() : psocket(0) {}
@@ -30,7 +64,18 @@ public:
     virtual void Shutdown() = 0;
 
     virtual bool NotifyBlock(const CBlockIndex *pindex);
-    virtual bool NotifyTransaction(const CTransaction &transaction);
+    virtual bool NotifyTransaction(const CZMQTransaction &transaction);
+    virtual bool NotifyMiningJob(const CZMQMiningJob &job);
+    //! A transaction left the mempool other than for a block
+    virtual bool NotifyMempoolRemoved(const uint256 &txid,
+                                      const std::string &reason);
+    //! Deposits created by a block, or that can be spent from the next block
+    virtual bool NotifyDeposits(const std::vector<CZMQDeposit> &deposits,
+                                bool fUnlocked);
+    //! Account for nCount transactions dropped before reaching the notifier
+    virtual void SkipTransactions(uint32_t nCount) {}
+    //! Account for nCount mempool removals dropped before reaching it
+    virtual void SkipMempoolRemovals(uint32_t nCount) {}
 
 protected:
     void *psocket;
@@ -6,15 +6,22 @@
 #include "zmqpublishnotifier.h"
 
 #include "streams.h"
+#include "txdb.h"
+#include "txmempool.h"
 #include "util.h"
 #include "validation.h"
 #include "version.h"
+#include "worktable.h"
+
+#include <functional>
 
 void zmqError(const char *str) {
     LogPrint("zmq", "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
 }
 
-CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(nullptr) {}
+CZMQNotificationInterface::CZMQNotificationInterface()
+    : pcontext(nullptr), fRawTx(false), fMempoolRemoved(false), nQueuedTx(0),
+      nDroppedTx(0), nDroppedRemoved(0), fStop(false) {}
 
 CZMQNotificationInterface::~CZMQNotificationInterface() {
     Shutdown();
@@ -38,6 +45,14 @@ CZMQNotificationInterface *CZMQNotificationInterface::Create() {
         CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] =
         CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
+    factories["pubminingjob"] =
+        CZMQAbstractNotifier::Create<CZMQPublishMiningJobNotifier>;
+    factories["pubmempoolremoved"] =
+        CZMQAbstractNotifier::Create<CZMQPublishMempoolRemovedNotifier>;
+    factories["pubdeposit"] =
+        CZMQAbstractNotifier::Create<CZMQPublishDepositNotifier>;
+    factories["pubdepositmatured"] =
+        CZMQAbstractNotifier::Create<CZMQPublishDepositMaturedNotifier>;
 
     for (std::map<std::string, CZMQNotifierFactory>::const_iterator i =
              factories.begin();
@@ -56,6 +71,9 @@ CZMQNotificationInterface *CZMQNotificationInterface::Create() {
     if (!notifiers.empty()) {
         notificationInterface = new CZMQNotificationInterface();
         notificationInterface->notifiers = notifiers;
+        notificationInterface->fRawTx = IsArgSet("-zmqpubrawtx");
+        notificationInterface->fMempoolRemoved =
+            IsArgSet("-zmqpubmempoolremoved");
 
         if (!notificationInterface->Initialize()) {
             delete notificationInterface;
@@ -95,12 +113,31 @@ bool CZMQNotificationInterface::Initialize() {
         return false;
     }
 
+    thread = std::thread(&TraceThread<std::function<void()>>, "zmqpub",
+                         std::function<void()>(std::bind(
+                             &CZMQNotificationInterface::ThreadPublish, this)));
+    if (fMempoolRemoved) {
+        mempool.NotifyEntryRemoved.connect(boost::bind(
+            &CZMQNotificationInterface::MempoolRemoved, this, _1, _2));
+    }
     return true;
 }
 
 // Called during shutdown sequence
 void CZMQNotificationInterface::Shutdown() {
     LogPrint("zmq", "zmq: Shutdown notification interface\n");
+    if (thread.joinable()) {
+        if (fMempoolRemoved) {
+            mempool.NotifyEntryRemoved.disconnect(boost::bind(
+                &CZMQNotificationInterface::MempoolRemoved, this, _1, _2));
+        }
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            fStop = true;
+        }
+        cond.notify_all();
+        thread.join();
+    }
     if (pcontext) {
         for (std::list<CZMQAbstractNotifier *>::iterator i = notifiers.begin();
              i != notifiers.end(); ++i) {
@@ -115,16 +152,90 @@ void CZMQNotificationInterface::Shutdown() {
     }
 }
 
-void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew,
-                                                const CBlockIndex *pindexFork,
-                                                bool fInitialDownload) {
-    // In IBD or blocks were disconnected without any new ones
-    if (fInitialDownload || pindexNew == pindexFork) return;
+void CZMQNotificationInterface::Queue(Notification &&notification) {
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (notification.type == Notification::TRANSACTION ||
+            notification.type == Notification::MEMPOOL_REMOVED) {
+            if (nQueuedTx >= MAX_ZMQ_QUEUED_TRANSACTIONS) {
+                if (notification.type == Notification::TRANSACTION) {
+                    nDroppedTx++;
+                } else {
+                    nDroppedRemoved++;
+                }
+                return;
+            }
+            nQueuedTx++;
+        }
+        queue.push_back(std::move(notification));
+    }
+    cond.notify_one();
+}
 
+void CZMQNotificationInterface::ThreadPublish() {
+    while (true) {
+        std::deque<Notification> batch;
+        uint32_t nDropped, nDroppedRemovals;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            cond.wait(lock, [this] { return fStop || !queue.empty(); });
+            // What is queued is still sent at shutdown.
+            if (queue.empty()) {
+                return;
+            }
+            batch.swap(queue);
+            nQueuedTx = 0;
+            nDropped = nDroppedTx;
+            nDroppedTx = 0;
+            nDroppedRemovals = nDroppedRemoved;
+            nDroppedRemoved = 0;
+        }
+
+        for (const Notification &notification : batch) {
+            Publish(notification);
+        }
+
+        // Transactions are only dropped while the queue is full, after all
+        // those in the batch.
+        if (nDropped > 0 || nDroppedRemovals > 0) {
+            LogPrintf("zmq: Dropped %u transaction and %u mempool removal "
+                      "notifications, the publisher fell behind\n",
+                      nDropped, nDroppedRemovals);
+            for (CZMQAbstractNotifier *notifier : notifiers) {
+                notifier->SkipTransactions(nDropped);
+                notifier->SkipMempoolRemovals(nDroppedRemovals);
+            }
+        }
+    }
+}
+
+void CZMQNotificationInterface::Publish(const Notification &notification) {
     for (std::list<CZMQAbstractNotifier *>::iterator i = notifiers.begin();
          i != notifiers.end();) {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindexNew)) {
+        bool fSent = true;
+        switch (notification.type) {
+            case Notification::BLOCK:
+                fSent = notifier->NotifyBlock(notification.pindex);
+                break;
+            case Notification::TRANSACTION:
+                fSent = notifier->NotifyTransaction(notification.tx);
+                break;
+            case Notification::MINING_JOB:
+                fSent = notifier->NotifyMiningJob(notification.job);
+                break;
+            case Notification::MEMPOOL_REMOVED:
+                fSent = notifier->NotifyMempoolRemoved(notification.tx.txid,
+                                                       notification.reason);
+                break;
+            case Notification::DEPOSITS:
+            case Notification::DEPOSITS_UNLOCKED:
+                fSent = notifier->NotifyDeposits(
+                    notification.deposits,
+                    notification.type == Notification::DEPOSITS_UNLOCKED);
+                break;
+        }
+        if (fSent) {
             i++;
         } else {
             notifier->Shutdown();
@@ -133,17 +244,77 @@ void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew,
     }
 }
 
-void CZMQNotificationInterface::SyncTransaction(const CTransaction &tx,
+void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew,
+                                                const CBlockIndex *pindexFork,
+                                                bool fInitialDownload) {
+    // In IBD or blocks were disconnected without any new ones
+    if (fInitialDownload || pindexNew == pindexFork) return;
+
+    Notification notification(Notification::BLOCK);
+    notification.pindex = pindexNew;
+    Queue(std::move(notification));
+}
+
+void CZMQNotificationInterface::SyncTransaction(const CTransactionRef &ptx,
                                                 const CBlockIndex *pindex,
                                                 int posInBlock) {
-    for (std::list<CZMQAbstractNotifier *>::iterator i = notifiers.begin();
-         i != notifiers.end();) {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx)) {
-            i++;
-        } else {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
+    const CTransaction &tx = *ptx;
+    Notification notification(Notification::TRANSACTION);
+    notification.tx.txid = tx.GetId();
+    if (fRawTx) {
+        // Serialized once for all raw transaction notifiers
+        auto raw = std::make_shared<std::vector<uint8_t>>();
+        raw->reserve(tx.GetTotalSize());
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, *raw, 0, tx);
+        notification.tx.raw = std::move(raw);
+    }
+    Queue(std::move(notification));
+}
+
+void CZMQNotificationInterface::NewMiningWork(const Work &work) {
+    Notification notification(Notification::MINING_JOB);
+    notification.job.header = work.blockEthash;
+    notification.job.seed = ethash_get_seedhash(work.block.nBlockHeight);
+    notification.job.boundary = work.boundary;
+    notification.job.nHeight = work.block.nBlockHeight;
+    Queue(std::move(notification));
+}
+
+static std::vector<CZMQDeposit> ToDeposits(const DepositIndexEntries &entries) {
+    std::vector<CZMQDeposit> deposits;
+    deposits.reserve(entries.size());
+    for (const auto &entry : entries) {
+        deposits.push_back({entry.first.outpoint, entry.second.nPrincipal,
+                            entry.second.nInterest,
+                            entry.first.nUnlockHeight});
+    }
+    return deposits;
+}
+
+void CZMQNotificationInterface::BlockDeposits(
+    const CBlockIndex *pindex, const DepositIndexEntries &created,
+    const DepositIndexEntries &unlocked) {
+    if (!created.empty()) {
+        Notification notification(Notification::DEPOSITS);
+        notification.deposits = ToDeposits(created);
+        Queue(std::move(notification));
+    }
+    if (!unlocked.empty()) {
+        Notification notification(Notification::DEPOSITS_UNLOCKED);
+        notification.deposits = ToDeposits(unlocked);
+        Queue(std::move(notification));
+    }
+}
+
+void CZMQNotificationInterface::MempoolRemoved(CTransactionRef tx,
+                                               MemPoolRemovalReason reason) {
+    // hashblock stands for the transactions of a new block, there can be
+    // thousands of them.
+    if (reason == MemPoolRemovalReason::BLOCK) {
+        return;
     }
+    Notification notification(Notification::MEMPOOL_REMOVED);
+    notification.tx.txid = tx->GetId();
+    notification.reason = RemovalReasonToString(reason);
+    Queue(std::move(notification));
 }
@@ -6,13 +6,34 @@
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
 #include "validationinterface.h"
+#include "zmqabstractnotifier.h"
 
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
 #include <map>
+#include <mutex>
 #include <string>
+#include <thread>
 
 class CBlockIndex;
-class CZMQAbstractNotifier;
+enum class MemPoolRemovalReason;
 
+/** Default for -zmqpubhwm, the messages queued per subscriber at most */
+static const int DEFAULT_ZMQ_SNDHWM = 1000;
+/**
+ * Transactions and mempool removals waiting for the publisher thread at most,
+ * more are dropped and leave a gap in the sequence numbers. The other
+ * notifications are never dropped.
+ */
+static const size_t MAX_ZMQ_QUEUED_TRANSACTIONS = 50000;
+
+/**
+ * Publishes to the notifiers on a thread of its own, so validation doesn't
+ * wait for ZMQ. Notifications are queued as they come, the thread takes all
+ * that are waiting at once.
+ */
 class CZMQNotificationInterface : public CValidationInterface {
 public:
     virtual ~CZMQNotificationInterface();
@@ -24,17 +45,65 @@ protected:
     void Shutdown();
 
     // CValidationInterface
-    void SyncTransaction(const CTransaction &tx, const CBlockIndex *pindex,
+    void SyncTransaction(const CTransactionRef &ptx, const CBlockIndex *pindex,
                          int posInBlock) override;
     void UpdatedBlockTip(const CBlockIndex *pindexNew,
                          const CBlockIndex *pindexFork,
                          bool fInitialDownload) override;
+    void NewMiningWork(const Work &work) override;
+    void BlockDeposits(const CBlockIndex *pindex,
+                       const DepositIndexEntries &created,
+                       const DepositIndexEntries &unlocked) override;
 
 private:
     CZMQNotificationInterface();
 
+    struct Notification {
+        enum Type {
+            BLOCK,
+            TRANSACTION,
+            MINING_JOB,
+            MEMPOOL_REMOVED,
+            DEPOSITS,
+            DEPOSITS_UNLOCKED,
+        };
+
+        Type type;
+        //! BLOCK
+        const CBlockIndex *pindex;
+        //! TRANSACTION, and MEMPOOL_REMOVED with the txid only
+        CZMQTransaction tx;
+        //! MINING_JOB
+        CZMQMiningJob job;
+        //! MEMPOOL_REMOVED
+        std::string reason;
+        //! DEPOSITS and DEPOSITS_UNLOCKED
+        std::vector<CZMQDeposit> deposits;
+
+        explicit Notification(Type typeIn) : type(typeIn), pindex(nullptr) {}
+    };
+
+    void ThreadPublish();
+    void Publish(const Notification &notification);
+    void Queue(Notification &&notification);
+    void MempoolRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+
     void *pcontext;
+    // Only used by the publisher thread once it runs
     std::list<CZMQAbstractNotifier *> notifiers;
+    // Whether transactions are serialized for a raw transaction notifier
+    bool fRawTx;
+    // Whether a notifier publishes mempool removals
+    bool fMempoolRemoved;
+
+    std::mutex cs;
+    std::condition_variable cond;
+    std::deque<Notification> queue;
+    size_t nQueuedTx;
+    uint32_t nDroppedTx;
+    uint32_t nDroppedRemoved;
+    bool fStop;
+    std::thread thread;
 };
 
 #endif // BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
@@ -3,14 +3,13 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "zmqpublishnotifier.h"
+#include "zmqnotificationinterface.h"
 #include "config.h"
-#include "rpc/server.h"
-#include "streams.h"
+#include "net_processing.h"
 #include "util.h"
+#include "utilstrencodings.h"
 #include "validation.h"
 
-#include <cstdarg>
-
 static std::multimap<std::string, CZMQAbstractPublishNotifier *>
     mapPublishNotifiers;
 
@@ -18,40 +17,24 @@ static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX = "hashtx";
 static const char *MSG_RAWBLOCK = "rawblock";
 static const char *MSG_RAWTX = "rawtx";
-
-// Internal function to send multipart message
-static int zmq_send_multipart(void *sock, const void *data, size_t size, ...) {
-    va_list args;
-    va_start(args, size);
-
-    while (1) {
-        zmq_msg_t msg;
-
-        int rc = zmq_msg_init_size(&msg, size);
-        if (rc != 0) {
-            zmqError("Unable to initialize ZMQ msg");
-            return -1;
-        }
-
-        void *buf = zmq_msg_data(&msg);
-        memcpy(buf, data, size);
-
-        data = va_arg(args, const void *);
-
-        rc = zmq_msg_send(&msg, sock, data ? ZMQ_SNDMORE : 0);
-        if (rc == -1) {
-            zmqError("Unable to send ZMQ msg");
-            zmq_msg_close(&msg);
-            return -1;
-        }
-
-        zmq_msg_close(&msg);
-
-        if (!data) break;
-
-        size = va_arg(args, size_t);
+static const char *MSG_MININGJOB = "miningjob";
+static const char *MSG_MEMPOOLREMOVED = "mempoolremoved";
+static const char *MSG_DEPOSIT = "deposit";
+static const char *MSG_DEPOSITMATURED = "depositmatured";
+
+// Internal function to send one part of a multipart message, closing msg
+static bool zmq_send_part(void *sock, zmq_msg_t *msg, bool fMore) {
+    int rc = zmq_msg_send(msg, sock, fMore ? ZMQ_SNDMORE : 0);
+    if (rc == -1) {
+        zmqError("Unable to send ZMQ msg");
     }
-    return 0;
+    zmq_msg_close(msg);
+    return rc != -1;
+}
+
+// Drops the reference zero-copy messages hold on their data
+static void zmq_release_data(void * /*data*/, void *hint) {
+    delete static_cast<ZMQDataRef *>(hint);
 }
 
 bool CZMQAbstractPublishNotifier::Initialize(void *pcontext) {
@@ -68,7 +51,16 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext) {
             return false;
         }
 
-        int rc = zmq_bind(psocket, address.c_str());
+        // Messages for a subscriber that is this far behind are dropped
+        int hwm = GetArg("-zmqpubhwm", DEFAULT_ZMQ_SNDHWM);
+        int rc = zmq_setsockopt(psocket, ZMQ_SNDHWM, &hwm, sizeof(hwm));
+        if (rc != 0) {
+            zmqError("Failed to set outbound message high water mark");
+            zmq_close(psocket);
+            return false;
+        }
+
+        rc = zmq_bind(psocket, address.c_str());
         if (rc != 0) {
             zmqError("Failed to bind address");
             zmq_close(psocket);
@@ -118,15 +110,30 @@ void CZMQAbstractPublishNotifier::Shutdown() {
 }
 
 bool CZMQAbstractPublishNotifier::SendMessage(const char *command,
-                                              const void *data, size_t size) {
+                                              zmq_msg_t *msg) {
     assert(psocket);
 
     /* send three parts, command & data & a LE 4byte sequence number */
-    uint8_t msgseq[sizeof(uint32_t)];
-    WriteLE32(&msgseq[0], nSequence);
-    int rc = zmq_send_multipart(psocket, command, strlen(command), data, size,
-                                msgseq, (size_t)sizeof(uint32_t), (void *)0);
-    if (rc == -1) return false;
+    zmq_msg_t msgcommand;
+    // The commands are static strings, which ZMQ can send as they are.
+    zmq_msg_init_data(&msgcommand, const_cast<char *>(command),
+                      strlen(command), nullptr, nullptr);
+    if (!zmq_send_part(psocket, &msgcommand, true)) {
+        zmq_msg_close(msg);
+        return false;
+    }
+    if (!zmq_send_part(psocket, msg, true)) {
+        return false;
+    }
+    zmq_msg_t msgseq;
+    if (zmq_msg_init_size(&msgseq, sizeof(uint32_t)) != 0) {
+        zmqError("Unable to initialize ZMQ msg");
+        return false;
+    }
+    WriteLE32(static_cast<uint8_t *>(zmq_msg_data(&msgseq)), nSequence);
+    if (!zmq_send_part(psocket, &msgseq, false)) {
+        return false;
+    }
 
     /* increment memory only sequence number after sending */
     nSequence++;
@@ -134,6 +141,30 @@ bool CZMQAbstractPublishNotifier::SendMessage(const char *command,
     return true;
 }
 
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command,
+                                              const void *data, size_t size) {
+    zmq_msg_t msg;
+    if (zmq_msg_init_size(&msg, size) != 0) {
+        zmqError("Unable to initialize ZMQ msg");
+        return false;
+    }
+    memcpy(zmq_msg_data(&msg), data, size);
+    return SendMessage(command, &msg);
+}
+
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command,
+                                              const ZMQDataRef &data) {
+    zmq_msg_t msg;
+    ZMQDataRef *hint = new ZMQDataRef(data);
+    if (zmq_msg_init_data(&msg, const_cast<uint8_t *>(data->data()),
+                          data->size(), zmq_release_data, hint) != 0) {
+        delete hint;
+        zmqError("Unable to initialize ZMQ msg");
+        return false;
+    }
+    return SendMessage(command, &msg);
+}
+
 bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex) {
     uint256 hash = pindex->GetBlockHash();
     LogPrint("zmq", "zmq: Publish hashblock %s\n", hash.GetHex());
@@ -144,8 +175,8 @@ bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex) {
 }
 
 bool CZMQPublishHashTransactionNotifier::NotifyTransaction(
-    const CTransaction &transaction) {
-    uint256 txid = transaction.GetId();
+    const CZMQTransaction &transaction) {
+    const uint256 &txid = transaction.txid;
     LogPrint("zmq", "zmq: Publish hashtx %s\n", txid.GetHex());
     char data[32];
     for (unsigned int i = 0; i < 32; i++)
@@ -157,27 +188,76 @@ bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex) {
     LogPrint("zmq", "zmq: Publish rawblock %s\n",
              pindex->GetBlockHash().GetHex());
 
-    const Config &config = GetConfig();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+    // Blocks are stored as they are serialized on the network, they are sent
+    // as read, through the cache of blocks served to peers.
+    CDiskBlockPos pos;
     {
         LOCK(cs_main);
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex, config)) {
-            zmqError("Can't read block from disk");
-            return false;
-        }
-
-        ss << block;
+        pos = pindex->GetBlockPos();
+    }
+    ZMQDataRef block = GetRawBlock(GetConfig(), pindex->GetBlockHash(), pos);
+    if (!block) {
+        zmqError("Can't read block from disk");
+        return false;
     }
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+    return SendMessage(MSG_RAWBLOCK, block);
 }
 
 bool CZMQPublishRawTransactionNotifier::NotifyTransaction(
-    const CTransaction &transaction) {
-    uint256 txid = transaction.GetId();
-    LogPrint("zmq", "zmq: Publish rawtx %s\n", txid.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ss << transaction;
-    return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
+    const CZMQTransaction &transaction) {
+    LogPrint("zmq", "zmq: Publish rawtx %s\n", transaction.txid.GetHex());
+    assert(transaction.raw);
+    return SendMessage(MSG_RAWTX, transaction.raw);
+}
+
+bool CZMQPublishMiningJobNotifier::NotifyMiningJob(const CZMQMiningJob &job) {
+    LogPrint("zmq", "zmq: Publish miningjob %s\n",
+             ethash_h256_encode(job.header));
+    // The hashes in the byte order eth_getWork shows them in, and the height
+    uint8_t data[3 * 32 + 4];
+    for (unsigned int i = 0; i < 32; i++) {
+        data[31 - i] = job.header.b[i];
+        data[63 - i] = job.seed.b[i];
+        data[95 - i] = job.boundary.b[i];
+    }
+    WriteLE32(&data[96], job.nHeight);
+    return SendMessage(MSG_MININGJOB, data, sizeof(data));
+}
+
+bool CZMQPublishMempoolRemovedNotifier::NotifyMempoolRemoved(
+    const uint256 &txid, const std::string &reason) {
+    LogPrint("zmq", "zmq: Publish mempoolremoved %s (%s)\n", txid.GetHex(),
+             reason);
+    // The hash as hashtx sends it, followed by the reason
+    std::vector<uint8_t> data(32 + reason.size());
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = txid.begin()[i];
+    memcpy(&data[32], reason.data(), reason.size());
+    return SendMessage(MSG_MEMPOOLREMOVED, data.data(), data.size());
+}
+
+bool CZMQPublishDepositNotifier::NotifyDeposits(
+    const std::vector<CZMQDeposit> &deposits, bool fUnlockedIn) {
+    if (fUnlockedIn != fUnlocked) {
+        return true;
+    }
+    const char *command = fUnlocked ? MSG_DEPOSITMATURED : MSG_DEPOSIT;
+    for (const CZMQDeposit &deposit : deposits) {
+        LogPrint("zmq", "zmq: Publish %s %s\n", command,
+                 deposit.outpoint.ToString());
+        // txid as hashtx sends it, LE output index, principal, interest and
+        // unlock height
+        uint8_t data[32 + 4 + 8 + 8 + 4];
+        for (unsigned int i = 0; i < 32; i++)
+            data[31 - i] = deposit.outpoint.hash.begin()[i];
+        WriteLE32(&data[32], deposit.outpoint.n);
+        WriteLE64(&data[36], deposit.nPrincipal);
+        WriteLE64(&data[44], deposit.nInterest);
+        WriteLE32(&data[52], deposit.nUnlockHeight);
+        if (!SendMessage(command, data, sizeof(data))) {
+            return false;
+        }
+    }
+    return true;
 }
@@ -14,7 +14,16 @@ private:
     //!< upcounting per message sequence number
     uint32_t nSequence;
 
+    //! Send command, the data in msg and the sequence number. Closes msg.
+    bool SendMessage(const char *command, zmq_msg_t *msg);
+
+protected:
+    //! Leave a gap of nCount in the sequence numbers, for lost messages
+    void SkipSequence(uint32_t nCount) { nSequence += nCount; }
+
 public:
+    CZMQAbstractPublishNotifier() : nSequence(0) {}
+
     /* send zmq multipart message
        parts:
           * command
@@ -22,6 +31,8 @@ public:
           * message sequence number
     */
     bool SendMessage(const char *command, const void *data, size_t size);
+    //! Send data without copying it, it is released once ZMQ has sent it
+    bool SendMessage(const char *command, const ZMQDataRef &data);
 
     bool Initialize(void *pcontext) override;
     void Shutdown() override;
@@ -34,7 +45,8 @@ public:
 
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier {
 public:
-    bool NotifyTransaction(const CTransaction &transaction) override;
+    bool NotifyTransaction(const CZMQTransaction &transaction) override;
+    void SkipTransactions(uint32_t nCount) override { SkipSequence(nCount); }
 };
 
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier {
@@ -44,7 +56,40 @@ public:
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier {
 public:
-    bool NotifyTransaction(const CTransaction &transaction) override;
+    bool NotifyTransaction(const CZMQTransaction &transaction) override;
+    void SkipTransactions(uint32_t nCount) override { SkipSequence(nCount); }
+};
+
+class CZMQPublishMiningJobNotifier : public CZMQAbstractPublishNotifier {
+public:
+    bool NotifyMiningJob(const CZMQMiningJob &job) override;
+};
+
+class CZMQPublishMempoolRemovedNotifier : public CZMQAbstractPublishNotifier {
+public:
+    bool NotifyMempoolRemoved(const uint256 &txid,
+                              const std::string &reason) override;
+    void SkipMempoolRemovals(uint32_t nCount) override {
+        SkipSequence(nCount);
+    }
+};
+
+/** Publishes deposits as they are created, or as they unlock with fUnlocked */
+class CZMQPublishDepositNotifier : public CZMQAbstractPublishNotifier {
+public:
+    explicit CZMQPublishDepositNotifier(bool fUnlockedIn = false)
+        : fUnlocked(fUnlockedIn) {}
+
+    bool NotifyDeposits(const std::vector<CZMQDeposit> &deposits,
+                        bool fUnlockedIn) override;
+
+private:
+    const bool fUnlocked;
+};
+
+class CZMQPublishDepositMaturedNotifier : public CZMQPublishDepositNotifier {
+public:
+    CZMQPublishDepositMaturedNotifier() : CZMQPublishDepositNotifier(true) {}
 };
 
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
@@ -41,6 +41,10 @@ class GetBlockTemplateLPTest(BitcoinTestFramework):
         self.nodes[0].generate(10)
         templat = self.nodes[0].getblocktemplate()
         longpollid = templat['longpollid']
+        # the ethash fields match the header of the next block
+        assert_equal(templat['blockheight'], templat['height'])
+        assert(templat['seedhash'].startswith('0x'))
+        assert(templat['boundary'].startswith('0x'))
         # longpollid should not change between successive invocations if
         # nothing else happens
         templat2 = self.nodes[0].getblocktemplate()
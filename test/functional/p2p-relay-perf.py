@@ -0,0 +1,285 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Measure block and transaction relay across a network of nodes.
+
+This is a benchmark rather than a test: it only fails if the network doesn't
+converge. It starts --nodes nodes connected as --topology, then
+
+- mines --blocks blocks, each on the next node in turn, and times how long
+  every node takes to have it, with the compact block reconstructions and
+  round trips this took;
+- sends --txs transactions from every node in turn, at --txrate a second,
+  and times how long every mempool takes to have them all;
+- reports the bytes sent by message type during each phase.
+
+The topology, which node sends what and the amounts all derive from --seed,
+so that two builds, or two sets of --nodeargs, can be run on the same load
+and compared. --json writes the results to a file for that.
+
+Run it directly, or with test_runner.py --perf.
+"""
+
+import json
+import random
+import threading
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+
+TOPOLOGIES = ["line", "ring", "star", "full", "random"]
+
+
+def make_topology(name, n, degree, rng):
+    """The edges of the network, as pairs of node indexes."""
+    if name == "line":
+        return [(i, i + 1) for i in range(n - 1)]
+    if name == "ring":
+        return [(i, (i + 1) % n) for i in range(n)] if n > 2 else \
+            make_topology("line", n, degree, rng)
+    if name == "star":
+        return [(0, i) for i in range(1, n)]
+    if name == "full":
+        return [(i, j) for i in range(n) for j in range(i + 1, n)]
+    # A random spanning tree keeps the network connected, random edges are
+    # then added until every node has about degree peers.
+    order = list(range(n))
+    rng.shuffle(order)
+    edges = set()
+    for k in range(1, n):
+        a, b = order[k], order[rng.randrange(k)]
+        edges.add((min(a, b), max(a, b)))
+    candidates = [(i, j) for i in range(n) for j in range(i + 1, n)
+                  if (i, j) not in edges]
+    rng.shuffle(candidates)
+    for (i, j) in candidates:
+        if len(edges) >= n * degree // 2:
+            break
+        edges.add((i, j))
+    return sorted(edges)
+
+
+def percentile(values, p):
+    values = sorted(values)
+    if not values:
+        return 0
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+class RelayPerfTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.setup_clean_chain = True
+        self.num_nodes = 4
+
+    def add_options(self, parser):
+        parser.add_option("--nodes", dest="nodes", default=4, type="int",
+                          help="Number of nodes, at most %d (default: %%default)" % MAX_NODES)
+        parser.add_option("--topology", dest="topology", default="ring",
+                          choices=TOPOLOGIES,
+                          help="One of %s (default: %%default)" % ", ".join(TOPOLOGIES))
+        parser.add_option("--degree", dest="degree", default=3, type="int",
+                          help="Peers per node of the random topology (default: %default)")
+        parser.add_option("--blocks", dest="blocks", default=20, type="int",
+                          help="Blocks to relay (default: %default)")
+        parser.add_option("--txs", dest="txs", default=200, type="int",
+                          help="Transactions to relay (default: %default)")
+        parser.add_option("--txrate", dest="txrate", default=0, type="float",
+                          help="Transactions sent a second, 0 for as fast as possible (default: %default)")
+        parser.add_option("--txsperblock", dest="txsperblock", default=20, type="int",
+                          help="Transactions in the mempool when each block is mined, to exercise compact blocks (default: %default)")
+        parser.add_option("--seed", dest="seed", default=1, type="int",
+                          help="Seed of the topology and load (default: %default)")
+        parser.add_option("--nodeargs", dest="nodeargs", default="",
+                          help="Extra arguments of every node, like \"-msghandlerthreads=4\"")
+        parser.add_option("--json", dest="json",
+                          help="Write the results to this file")
+
+    def setup_chain(self):
+        assert 2 <= self.options.nodes <= MAX_NODES
+        self.num_nodes = self.options.nodes
+        self.rng = random.Random(self.options.seed)
+        # Only confirmed coins are spent, so that the wallets never build
+        # chains of unconfirmed transactions that hit the mempool limits.
+        args = ["-whitelist=127.0.0.1", "-spendzeroconfchange=0"]
+        args += self.options.nodeargs.split()
+        self.extra_args = [args] * self.num_nodes
+        super().setup_chain()
+
+    def setup_network(self):
+        self.setup_nodes()
+        self.edges = make_topology(self.options.topology, self.num_nodes,
+                                   self.options.degree, self.rng)
+        self.log.info("Topology %s: %s" % (self.options.topology, self.edges))
+        for (a, b) in self.edges:
+            connect_nodes_bi(self.nodes, a, b)
+        self.sync_all()
+
+    def bytes_sent(self):
+        """Bytes sent by all nodes, by message type."""
+        total = {}
+        for node in self.nodes:
+            for peer in node.getpeerinfo():
+                for msg, n in peer["bytessent_per_msg"].items():
+                    total[msg] = total.get(msg, 0) + n
+        return total
+
+    def bytes_sent_since(self, before):
+        after = self.bytes_sent()
+        return {msg: n - before.get(msg, 0) for msg, n in after.items()
+                if n != before.get(msg, 0)}
+
+    def compact_block_stats(self):
+        received, roundtrips = 0, 0
+        for node in self.nodes:
+            for peer in node.getpeerinfo():
+                cmpct = peer.get("compactblocks", {})
+                received += cmpct.get("received", 0)
+                roundtrips += cmpct.get("roundtrips", 0)
+        return received, roundtrips
+
+    def fund_nodes(self):
+        """Give every node enough confirmed coins for its share of the load."""
+        n = self.num_nodes
+        per_node = (self.options.txs + self.options.blocks *
+                    self.options.txsperblock) // n + 10
+        self.nodes[0].generate(101 + n)
+        sync_blocks(self.nodes)
+        amount = satoshi_round(self.nodes[0].getbalance() / (n * per_node * 2))
+        self.amount = satoshi_round(amount / 10)
+        for i in range(n):
+            outputs = {self.nodes[i].getnewaddress(): amount
+                       for _ in range(per_node)}
+            self.nodes[0].sendmany("", outputs)
+        self.nodes[0].generate(1)
+        self.sync_all()
+        self.addresses = [node.getnewaddress() for node in self.nodes]
+
+    def send_tx(self, k):
+        """Send the k-th transaction of the load, return its txid."""
+        sender = k % self.num_nodes
+        receiver = self.rng.randrange(self.num_nodes)
+        return self.nodes[sender].sendtoaddress(self.addresses[receiver],
+                                                self.amount)
+
+    def measure_blocks(self):
+        self.log.info("Relaying %d blocks" % self.options.blocks)
+        before = self.bytes_sent()
+        cmpct_before = self.compact_block_stats()
+        latencies = []
+        k = 0
+        for b in range(self.options.blocks):
+            # Fill the mempools first, so that the block has transactions
+            # that the other nodes already know.
+            for i in range(self.options.txsperblock):
+                self.send_tx(k + i)
+            k += self.options.txsperblock
+            sync_mempools(self.nodes)
+
+            miner = self.nodes[b % self.num_nodes]
+            arrivals = [None] * self.num_nodes
+
+            # Every node waits on its own RPC connection, from its own thread.
+            def wait(i, blockhash):
+                self.nodes[i].waitforblock(blockhash, 60000)
+                arrivals[i] = time.time()
+
+            start = time.time()
+            blockhash = miner.generate(1)[0]
+            threads = [threading.Thread(target=wait, args=(i, blockhash))
+                       for i in range(self.num_nodes)
+                       if self.nodes[i] is not miner]
+            for t in threads:
+                t.start()
+            for t in threads:
+                t.join()
+            for i in range(self.num_nodes):
+                if self.nodes[i] is not miner:
+                    assert arrivals[i] is not None
+                    latencies.append(arrivals[i] - start)
+        cmpct_after = self.compact_block_stats()
+        received = cmpct_after[0] - cmpct_before[0]
+        roundtrips = cmpct_after[1] - cmpct_before[1]
+        return {
+            "latency_ms_p50": percentile(latencies, 50) * 1000,
+            "latency_ms_p90": percentile(latencies, 90) * 1000,
+            "latency_ms_max": max(latencies) * 1000,
+            "compact_blocks": received,
+            "compact_roundtrips": roundtrips,
+            "compact_reconstruction_rate":
+                (received - roundtrips) / received if received else 0,
+            "bytes_sent": self.bytes_sent_since(before),
+        }
+
+    def measure_txs(self):
+        self.log.info("Relaying %d transactions" % self.options.txs)
+        before = self.bytes_sent()
+        seen = {}
+        start = time.time()
+        txids = []
+        for k in range(self.options.txs):
+            if self.options.txrate > 0:
+                delay = start + k / self.options.txrate - time.time()
+                if delay > 0:
+                    time.sleep(delay)
+            txid = self.send_tx(k)
+            txids.append(txid)
+            seen[txid] = (time.time(), set())
+        sent = time.time()
+
+        # Poll the mempools until every node has every transaction.
+        pending = set(txids)
+        latencies = []
+        deadline = time.time() + 120
+        while pending:
+            assert time.time() < deadline, "transactions did not propagate"
+            pools = [set(node.getrawmempool()) for node in self.nodes]
+            now = time.time()
+            for txid in list(pending):
+                sent_at, nodes = seen[txid]
+                for i, pool in enumerate(pools):
+                    if i not in nodes and txid in pool:
+                        nodes.add(i)
+                        latencies.append(now - sent_at)
+                if len(nodes) == self.num_nodes:
+                    pending.remove(txid)
+            time.sleep(0.05)
+        end = time.time()
+        return {
+            "send_seconds": sent - start,
+            "propagation_seconds": end - start,
+            "throughput_tx_per_second": len(txids) / (end - start),
+            "latency_ms_p50": percentile(latencies, 50) * 1000,
+            "latency_ms_p90": percentile(latencies, 90) * 1000,
+            "bytes_sent": self.bytes_sent_since(before),
+        }
+
+    def run_test(self):
+        self.fund_nodes()
+        results = {
+            "nodes": self.num_nodes,
+            "topology": self.options.topology,
+            "edges": self.edges,
+            "seed": self.options.seed,
+            "nodeargs": self.options.nodeargs,
+            "blocks": self.measure_blocks(),
+            "txs": self.measure_txs(),
+        }
+        for phase in ["blocks", "txs"]:
+            for key, value in sorted(results[phase].items()):
+                if key == "bytes_sent":
+                    value = ", ".join("%s=%d" % item
+                                      for item in sorted(value.items()))
+                elif isinstance(value, float):
+                    value = "%.3f" % value
+                self.log.info("%s %s: %s" % (phase, key, value))
+        if self.options.json:
+            with open(self.options.json, "w", encoding="utf8") as f:
+                json.dump(results, f, indent=2, sort_keys=True)
+
+
+if __name__ == '__main__':
+    RelayPerfTest().main()
@@ -131,7 +131,13 @@ EXTENDED_SCRIPTS = [
     'p2p-acceptblock.py',
 ]
 
-ALL_SCRIPTS = BASE_SCRIPTS + ZMQ_SCRIPTS + EXTENDED_SCRIPTS
+PERF_SCRIPTS = [
+    # Benchmarks rather than tests, only run with --perf or by name. They
+    # take their own options, like p2p-relay-perf.py --nodes=8.
+    'p2p-relay-perf.py',
+]
+
+ALL_SCRIPTS = BASE_SCRIPTS + ZMQ_SCRIPTS + EXTENDED_SCRIPTS + PERF_SCRIPTS
 
 
 def main():
@@ -156,6 +162,8 @@ def main():
                         help='how many test scripts to run in parallel. Default=4.')
     parser.add_argument('--nozmq', action='store_true',
                         help='do not run the zmq tests')
+    parser.add_argument('--perf', action='store_true',
+                        help='run the performance scripts instead of the tests')
     args, unknown_args = parser.parse_known_args()
 
     # Create a set to store arguments and create the passon string
@@ -199,6 +207,8 @@ def main():
         # in the ALL_SCRIPTS list. Accept the name with or without .py extension.
         test_list = [t for t in ALL_SCRIPTS if
                      (t in tests or re.sub(".py$", "", t) in tests)]
+    elif args.perf:
+        test_list = PERF_SCRIPTS
     else:
         # No individual tests have been specified. Run base tests, and
         # optionally ZMQ tests and extended tests.